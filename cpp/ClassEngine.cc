@@ -21,6 +21,7 @@
 #include<sstream>
 #include<numeric>
 #include<cassert>
+#include<algorithm>
 
 //#define DBUG
 
@@ -65,7 +66,7 @@ template string str(const unsigned long long &x);
 //---------------
 // Constructors --
 //----------------
-ClassEngine::ClassEngine(const ClassParams& pars, bool verbose): cl(0),dofree(true){
+ClassEngine::ClassEngine(const ClassParams& pars, bool verbose): cl(0),hasEmulator(false),emulated(false),dofree(true),nStages(0){
 
   //prepare fp structure
   size_t n=pars.size();
@@ -78,6 +79,7 @@ ClassEngine::ClassEngine(const ClassParams& pars, bool verbose): cl(0),dofree(tr
     strcpy(fc.value[i],pars.value(i).c_str());
     //store
     parNames.push_back(pars.key(i));
+    parValues.push_back(pars.value(i));
     //identify lmax
     if(verbose) cout << pars.key(i) << "\t" << pars.value(i) <<endl;
     if (pars.key(i)=="l_max_scalars") {
@@ -88,8 +90,11 @@ ClassEngine::ClassEngine(const ClassParams& pars, bool verbose): cl(0),dofree(tr
   if( verbose ) cout << __FILE__ << " : using lmax=" << _lmax <<endl;
   // assert(_lmax>0); // this collides with transfer function calculations
 
+  //index parameter names (they are not modified by updateParValues)
+  if (parser_index(&fc,_errmsg) == _FAILURE_) throw invalid_argument(_errmsg);
+
     //input
-  if (input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&sp,&nl,&le,&sd,&op,_errmsg) == _FAILURE_)
+  if (input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,_errmsg) == _FAILURE_)
     throw invalid_argument(_errmsg);
 
   //proetction parametres mal defini
@@ -100,9 +105,9 @@ ClassEngine::ClassEngine(const ClassParams& pars, bool verbose): cl(0),dofree(tr
   //calcul class
   computeCls();
 
-  //cout <<"creating " << sp.ct_size << " arrays" <<endl;
+  //cout <<"creating " << hr.ct_size << " arrays" <<endl;
   if( pt.has_cl_cmb_temperature || pt.has_cl_cmb_polarization || pt.has_cl_lensing_potential ){
-    cl=new double[sp.ct_size];
+    cl=new double[hr.ct_size];
   }
 
   //printFC();
@@ -110,7 +115,7 @@ ClassEngine::ClassEngine(const ClassParams& pars, bool verbose): cl(0),dofree(tr
 }
 
 
-ClassEngine::ClassEngine(const ClassParams& pars,const string & precision_file, bool verbose): cl(0),dofree(true){
+ClassEngine::ClassEngine(const ClassParams& pars,const string & precision_file, bool verbose): cl(0),hasEmulator(false),emulated(false),dofree(true),nStages(0){
 
   struct file_content fc_precision;
   fc_precision.size = 0;
@@ -130,6 +135,9 @@ ClassEngine::ClassEngine(const ClassParams& pars,const string & precision_file,
   for (size_t i=0;i<pars.size();i++){
     strcpy(fc_input.name[i],pars.key(i).c_str());
     strcpy(fc_input.value[i],pars.value(i).c_str());
+    //store
+    parNames.push_back(pars.key(i));
+    parValues.push_back(pars.value(i));
     if (pars.key(i)=="l_max_scalars") {
       istringstream strstrm(pars.value(i));
       strstrm >> _lmax;
@@ -147,7 +155,7 @@ ClassEngine::ClassEngine(const ClassParams& pars,const string & precision_file,
   parser_free(&fc_precision);
 
   //input
-  if (input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&sp,&nl,&le,&sd,&op,_errmsg) == _FAILURE_)
+  if (input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,_errmsg) == _FAILURE_)
     throw invalid_argument(_errmsg);
 
   //proetction parametres mal defini
@@ -158,9 +166,9 @@ ClassEngine::ClassEngine(const ClassParams& pars,const string & precision_file,
   //calcul class
   computeCls();
 
-  //cout <<"creating " << sp.ct_size << " arrays" <<endl;
+  //cout <<"creating " << hr.ct_size << " arrays" <<endl;
   if( pt.has_cl_cmb_temperature || pt.has_cl_cmb_polarization || pt.has_cl_lensing_potential ){
-    cl=new double[sp.ct_size];
+    cl=new double[hr.ct_size];
   }
   //printFC();
 
@@ -176,35 +184,191 @@ ClassEngine::~ClassEngine()
 {
 
   //printFC();
-  dofree && freeStructs();
+  freeStructs();
 
   if( pt.has_cl_cmb_temperature || pt.has_cl_cmb_polarization || pt.has_cl_lensing_potential ){
     delete [] cl;
   }
 
+  if (hasEmulator) emulator_free(&em);
+
 }
 
 //-----------------
 // Member functions --
 //-----------------
 bool ClassEngine::updateParValues(const std::vector<double>& par){
-  dofree && freeStructs();
+
+  //earliest stage affected by the parameters that changed since the last run
+  Stage from=NSTAGES;
   for (size_t i=0;i<par.size();i++) {
     double val=par[i];
-    strcpy(fc.value[i],str(val).c_str());
+    string value=str(val);
+    if (value!=parValues[i]) {
+      Stage first=firstStage(parNames[i]);
+      if (first<from) from=first;
+      parValues[i]=value;
+    }
+    strcpy(fc.value[i],value.c_str());
     strcpy(fc.name[i],parNames[i].c_str());
 #ifdef DBUG
-    cout << "update par values #" << i << "\t" <<  val << "\t" << str(val).c_str() << endl;
+    cout << "update par values #" << i << "\t" <<  val << "\t" << value << endl;
 #endif
   }
-  int status=computeCls();
+  //stages that are not computed (after a failure or an emulated run) have to be
+  if (from>nStages) from=static_cast<Stage>(nStages);
+
+  //use the emulator instead of CLASS inside its training box
+  emulated=false;
+  if (from==NSTAGES) return true;
+  if (hasEmulator){
+    std::vector<double> empars(em.par_size);
+    short usable;
+    emulator_match(&em,&fc,&empars[0],&usable);
+    if (usable==_TRUE_){
+      if (emulator_evaluate(&em,&empars[0],&emOutput[0],_errmsg) == _FAILURE_) throw runtime_error(_errmsg);
+      freeStructs();
+      emulated=true;
+      dofree=false;
+      return true;
+    }
+  }
+
+  freeStructs(from);
+  int status=computeCls(from);
 #ifdef DBUG
-  cout << "update par status=" << status << " succes=" << _SUCCESS_ << endl;
+  cout << "update par status=" << status << " succes=" << _SUCCESS_ << " from stage " << from << endl;
 #endif
 
   return (status==_SUCCESS_);
 }
 
+ClassEngine::Stage ClassEngine::firstStage(const string& name){
+
+  //parameters of the thermal history
+  static const char * thermodynamics[] = {
+    "YHe","tau_reio","z_reio","reionization_exponent","reionization_width",
+    "helium_fullreio_redshift","helium_fullreio_width"};
+  //parameters of the primordial spectrum
+  static const char * primordial[] = {
+    "A_s","ln10^{10}A_s","ln_A_s_1e10","n_s","alpha_s","beta_s","r","n_t","alpha_t","k_pivot",
+    "f_bi","n_bi","alpha_bi","f_cdi","n_cdi","alpha_cdi","f_nid","n_nid","alpha_nid","f_niv","n_niv","alpha_niv",
+    "c_ad_bi","n_ad_bi","alpha_ad_bi","c_ad_cdi","n_ad_cdi","alpha_ad_cdi",
+    "c_ad_nid","n_ad_nid","alpha_ad_nid","c_ad_niv","n_ad_niv","alpha_ad_niv",
+    "c_bi_cdi","n_bi_cdi","alpha_bi_cdi","c_bi_nid","n_bi_nid","alpha_bi_nid",
+    "c_bi_niv","n_bi_niv","alpha_bi_niv","c_cdi_nid","n_cdi_nid","alpha_cdi_nid",
+    "c_cdi_niv","n_cdi_niv","alpha_cdi_niv","c_nid_niv","n_nid_niv","alpha_nid_niv",
+    "V_0","V_1","V_2","V_3","V_4","H_0","H_1","H_2","H_3","H_4","phi_end",
+    "Vparam0","Vparam1","Vparam2","Vparam3","Vparam4","ln_aH_ratio","N_star",
+    "custom1","custom2","custom3","custom4","custom5","custom6","custom7","custom8","custom9","custom10"};
+  //parameters of the non-linear corrections only
+  static const char * nonlinear[] = {"eta_0","c_min","z_infinity"};
+  //parameters of the spectral distortions only
+  static const char * distortions[] = {"sd_add_y","sd_add_mu"};
+
+  for (size_t i=0;i<sizeof(thermodynamics)/sizeof(thermodynamics[0]);i++)
+    if (name==thermodynamics[i]) return THERMODYNAMICS;
+  for (size_t i=0;i<sizeof(primordial)/sizeof(primordial[0]);i++)
+    if (name==primordial[i]) return PRIMORDIAL;
+  for (size_t i=0;i<sizeof(nonlinear)/sizeof(nonlinear[0]);i++)
+    if (name==nonlinear[i]) return FOURIER;
+  for (size_t i=0;i<sizeof(distortions)/sizeof(distortions[0]);i++)
+    if (name==distortions[i]) return DISTORTIONS;
+
+  //anything else (including derived or shooting parameters like sigma8 or 100*theta_s) may change the background
+  return BACKGROUND;
+}
+
+bool ClassEngine::useEmulator(const string & emulator_file){
+  if (hasEmulator){
+    emulator_free(&em);
+    hasEmulator=false;
+  }
+  emulated=false;
+  if (emulator_file.empty()) return true;
+  if (emulator_read(const_cast<char*>(emulator_file.c_str()),&em,_errmsg) == _FAILURE_){
+    cerr << ">>>fail reading emulator: " << _errmsg << endl;
+    return false;
+  }
+  emOutput.resize(em.out_size);
+  hasEmulator=true;
+  return true;
+}
+
+std::vector<bool> ClassEngine::evaluateBatch(const std::vector<ClassParams>& points,
+                                             const std::vector<Engine::cltype>& cltypes,
+                                             int lmax,
+                                             double * cls,
+                                             const std::vector<double>& k,
+                                             const std::vector<double>& z,
+                                             double * pk,
+                                             int threads){
+
+  const int npoints=points.size();
+  const size_t clSize=cltypes.size()*(lmax+1);
+  const size_t pkSize=k.size()*z.size();
+  //std::vector<bool> packs bits and cannot be written concurrently
+  std::vector<char> success(npoints,0);
+
+  //thread budget: as many points as possible at once, the remaining threads go to the runs
+  int outer=1, inner=1;
+#ifdef _OPENMP
+  int total=(threads>0) ? threads : omp_get_max_threads();
+  outer=std::max(1,std::min(total,npoints));
+  inner=std::max(1,total/outer);
+  int levels=omp_get_max_active_levels();
+  omp_set_max_active_levels(2);
+#endif
+
+#pragma omp parallel for num_threads(outer) schedule(dynamic,1)
+  for (int ip=0;ip<npoints;ip++){
+
+#ifdef _OPENMP
+    omp_set_num_threads(inner);
+#endif
+
+    double * pcl=(cls!=NULL) ? cls+ip*clSize : NULL;
+    double * ppk=(pk!=NULL) ? pk+ip*pkSize : NULL;
+    if (pcl!=NULL) std::fill(pcl,pcl+clSize,0.);
+    if (ppk!=NULL) std::fill(ppk,ppk+pkSize,0.);
+
+    //exceptions cannot leave the parallel region
+    try{
+      ClassEngine engine(points[ip],false);
+      if (!engine.dofree) throw runtime_error("CLASS failed");
+
+      if (pcl!=NULL){
+        for (size_t it=0;it<cltypes.size();it++)
+          for (int l=2;l<=lmax;l++)
+            pcl[it*(lmax+1)+l]=engine.getCl(cltypes[it],l);
+      }
+
+      if ((ppk!=NULL) && (pkSize>0)){
+        enum pk_outputs pk_output=(engine.fo.method==nl_none) ? pk_linear : pk_nonlinear;
+        if (fourier_pks_at_kvec_and_zvec(&engine.ba,&engine.fo,pk_output,
+                                         const_cast<double*>(&k[0]),k.size(),
+                                         const_cast<double*>(&z[0]),z.size(),
+                                         ppk,NULL) == _FAILURE_)
+          throw runtime_error(engine.fo.error_message);
+      }
+
+      success[ip]=1;
+    }
+    catch(exception &e){
+      if (pcl!=NULL) std::fill(pcl,pcl+clSize,0.);
+      if (ppk!=NULL) std::fill(ppk,ppk+pkSize,0.);
+#pragma omp critical (ClassEngine_evaluateBatch)
+      cerr << ">>>fail evaluating point #" << ip << ": " << e.what() << endl;
+    }
+  }
+
+#ifdef _OPENMP
+  omp_set_max_active_levels(levels);
+#endif
+
+  return std::vector<bool>(success.begin(),success.end());
+}
+
 //print content of file_content
 void ClassEngine::printFC() {
   printf("FILE_CONTENT SIZE=%d\n",fc.size);
@@ -213,130 +377,152 @@ void ClassEngine::printFC() {
 
 }
 int ClassEngine::class_main(
+			    Stage from,
 			    struct file_content *pfc,
 			    struct precision * ppr,
 			    struct background * pba,
-			    struct thermo * pth,
-			    struct perturbs * ppt,
-			    struct transfers * ptr,
+			    struct thermodynamics * pth,
+			    struct perturbations * ppt,
+			    struct transfer * ptr,
 			    struct primordial * ppm,
-			    struct spectra * psp,
-			    struct nonlinear * pnl,
+			    struct harmonic * phr,
+			    struct fourier * pfo,
 			    struct lensing * ple,
 			    struct distortions * psd,
 			    struct output * pop,
 			    ErrorMsg errmsg) {
 
-
-  if (input_read_from_file(pfc,ppr,pba,pth,ppt,ptr,ppm,psp,pnl,ple,psd,pop,errmsg) == _FAILURE_) {
+  //stages before 'from' are kept: read the input into temporary structures,
+  //and copy only those of the stages that are recomputed
+  struct precision pr_in;
+  struct background ba_in;
+  struct thermodynamics th_in;
+  struct perturbations pt_in;
+  struct transfer tr_in;
+  struct primordial pm_in;
+  struct harmonic hr_in;
+  struct fourier fo_in;
+  struct lensing le_in;
+  struct distortions sd_in;
+  struct output op_in;
+
+  //time and memory of each stage of this run (those that are kept do not appear)
+  profile_init(&prof);
+  profile_start(&prof,profile_input);
+  if (input_read_from_file(pfc,&pr_in,&ba_in,&th_in,&pt_in,&tr_in,&pm_in,&hr_in,&fo_in,&le_in,&sd_in,&op_in,errmsg) == _FAILURE_) {
     printf("\n\nError running input_read_from_file \n=>%s\n",errmsg);
+    freeStructs();
     dofree=false;
     return _FAILURE_;
   }
 
-  if (background_init(ppr,pba) == _FAILURE_) {
-    printf("\n\nError running background_init \n=>%s\n",pba->error_message);
-    dofree=false;
-    return _FAILURE_;
-  }
-
-  if (thermodynamics_init(ppr,pba,pth) == _FAILURE_) {
-    printf("\n\nError in thermodynamics_init \n=>%s\n",pth->error_message);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
-  }
-
-  if (perturb_init(ppr,pba,pth,ppt) == _FAILURE_) {
-    printf("\n\nError in perturb_init \n=>%s\n",ppt->error_message);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
-  }
-
-  if (primordial_init(ppr,ppt,ppm) == _FAILURE_) {
-    printf("\n\nError in primordial_init \n=>%s\n",ppm->error_message);
-    perturb_free(&pt);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
+  profile_stop(&prof,profile_input);
+
+  //precision parameters are not in firstStage(), they always restart from the background
+  if (from<=BACKGROUND) {*ppr=pr_in; *pba=ba_in;}
+  if (from<=THERMODYNAMICS) *pth=th_in;
+  if (from<=PERTURBATIONS) *ppt=pt_in;
+  if (from<=PRIMORDIAL) *ppm=pm_in;
+  if (from<=FOURIER) *pfo=fo_in;
+  if (from<=TRANSFER) *ptr=tr_in;
+  if (from<=HARMONIC) *phr=hr_in;
+  if (from<=LENSING) *ple=le_in;
+  if (from<=DISTORTIONS) *psd=sd_in;
+  *pop=op_in;
+  freeInput((from>BACKGROUND) ? &ba_in : NULL,(from>PERTURBATIONS) ? &pt_in : NULL);
+
+  //number of threads of this run (the setting belongs to the calling thread, and is restored on exit)
+  int threads=class_threads_set(pr_in.num_threads);
+
+  for (int stage=from; stage<NSTAGES; stage++) {
+
+    int status=_SUCCESS_;
+    const char * name="";
+    char * message=errmsg;
+    //the stages are in the same order as those of the profile, after the input
+    enum profile_stage prof_stage=static_cast<enum profile_stage>(profile_background+stage);
+
+    profile_start(&prof,prof_stage);
+    switch(stage) {
+    case BACKGROUND:
+      status=background_init(ppr,pba);
+      name="background_init"; message=pba->error_message;
+      break;
+    case THERMODYNAMICS:
+      status=thermodynamics_init(ppr,pba,pth);
+      name="thermodynamics_init"; message=pth->error_message;
+      break;
+    case PERTURBATIONS:
+      status=perturbations_init(ppr,pba,pth,ppt);
+      name="perturbations_init"; message=ppt->error_message;
+      break;
+    case PRIMORDIAL:
+      status=primordial_init(ppr,ppt,ppm);
+      name="primordial_init"; message=ppm->error_message;
+      break;
+    case FOURIER:
+      status=fourier_init(ppr,pba,pth,ppt,ppm,pfo);
+      name="fourier_init"; message=pfo->error_message;
+      break;
+    case TRANSFER:
+      status=transfer_init(ppr,pba,pth,ppt,pfo,ptr);
+      name="transfer_init"; message=ptr->error_message;
+      break;
+    case HARMONIC:
+      status=harmonic_init(ppr,pba,ppt,ppm,pfo,ptr,phr);
+      name="harmonic_init"; message=phr->error_message;
+      break;
+    case LENSING:
+      status=lensing_init(ppr,ppt,phr,pfo,ple);
+      name="lensing_init"; message=ple->error_message;
+      break;
+    case DISTORTIONS:
+      status=distortions_init(ppr,pba,pth,ppt,ppm,psd);
+      name="distortions_init"; message=psd->error_message;
+      break;
+    }
+    profile_stop(&prof,prof_stage);
+
+    if (status == _FAILURE_) {
+      printf("\n\nError in %s \n=>%s\n",name,message);
+      //free all the stages computed so far, kept ones included
+      freeStructs();
+      dofree=false;
+      class_threads_set(threads);
+      return _FAILURE_;
+    }
+    nStages=stage+1;
   }
 
-  if (nonlinear_init(ppr,pba,pth,ppt,ppm,pnl) == _FAILURE_)  {
-    printf("\n\nError in nonlinear_init \n=>%s\n",pnl->error_message);
-    primordial_free(&pm);
-    perturb_free(&pt);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
-  }
+  if (pop->profile_verbose > 0) profile_print(&prof);
 
-  if (transfer_init(ppr,pba,pth,ppt,pnl,ptr) == _FAILURE_) {
-    printf("\n\nError in transfer_init \n=>%s\n",ptr->error_message);
-    nonlinear_free(&nl);
-    primordial_free(&pm);
-    perturb_free(&pt);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
-  }
+  dofree=true;
+  class_threads_set(threads);
+  return _SUCCESS_;
+}
 
-  if (spectra_init(ppr,pba,ppt,ppm,pnl,ptr,psp) == _FAILURE_) {
-    printf("\n\nError in spectra_init \n=>%s\n",psp->error_message);
-    transfer_free(&tr);
-    nonlinear_free(&nl);
-    primordial_free(&pm);
-    perturb_free(&pt);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
-  }
+//free what input_read_from_file() allocated in the temporary structures of kept stages
+void ClassEngine::freeInput(struct background * pba,struct perturbations * ppt){
 
-  if (lensing_init(ppr,ppt,psp,pnl,ple) == _FAILURE_) {
-    printf("\n\nError in lensing_init \n=>%s\n",ple->error_message);
-    spectra_free(&sp);
-    transfer_free(&tr);
-    nonlinear_free(&nl);
-    primordial_free(&pm);
-    perturb_free(&pt);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
-  }
+  if (pba != NULL) background_free_input(pba);
 
-  if (distortions_init(ppr,pba,pth,ppt,ppm,psd) == _FAILURE_) {
-    printf("\n\nError in distortions_init \n=>%s\n",psd->error_message);
-    lensing_free(&le);
-    spectra_free(&sp);
-    transfer_free(&tr);
-    nonlinear_free(&nl);
-    primordial_free(&pm);
-    perturb_free(&pt);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
+  if (ppt != NULL) {
+    if (ppt->alpha_idm_dr != NULL)
+      free(ppt->alpha_idm_dr);
+    if (ppt->beta_idr != NULL)
+      free(ppt->beta_idr);
   }
-
-  dofree=true;
-  return _SUCCESS_;
 }
 
 
-int ClassEngine::computeCls(){
+int ClassEngine::computeCls(Stage from){
 
 #ifdef DBUG
-  cout <<"call computecls" << endl;
+  cout <<"call computecls from stage " << from << endl;
   //printFC();
 #endif
 
-  int status=this->class_main(&fc,&pr,&ba,&th,&pt,&tr,&pm,&sp,&nl,&le,&sd,&op,_errmsg);
+  int status=this->class_main(from,&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,_errmsg);
 #ifdef DBUG
   cout <<"status=" << status << endl;
 #endif
@@ -344,54 +530,64 @@ int ClassEngine::computeCls(){
 
 }
 
+//free the stages from 'from' onwards, in the reverse order of their computation
 int
-ClassEngine::freeStructs(){
-
-
-  if (distortions_free(&sd) == _FAILURE_) {
-    printf("\n\nError in distortions_free \n=>%s\n",sd.error_message);
-    return _FAILURE_;
-  }
+ClassEngine::freeStructs(Stage from){
 
-  if (lensing_free(&le) == _FAILURE_) {
-    printf("\n\nError in spectra_free \n=>%s\n",le.error_message);
-    return _FAILURE_;
-  }
+  for (int stage=nStages-1; stage>=from; stage--) {
 
-  if (nonlinear_free(&nl) == _FAILURE_) {
-    printf("\n\nError in nonlinear_free \n=>%s\n",nl.error_message);
-    return _FAILURE_;
-  }
+    int status=_SUCCESS_;
+    const char * name="";
+    char * message=_errmsg;
 
-  if (spectra_free(&sp) == _FAILURE_) {
-    printf("\n\nError in spectra_free \n=>%s\n",sp.error_message);
-    return _FAILURE_;
-  }
-
-  if (primordial_free(&pm) == _FAILURE_) {
-    printf("\n\nError in primordial_free \n=>%s\n",pm.error_message);
-    return _FAILURE_;
-  }
-
-  if (transfer_free(&tr) == _FAILURE_) {
-    printf("\n\nError in transfer_free \n=>%s\n",tr.error_message);
-    return _FAILURE_;
-  }
+    switch(stage) {
+    case DISTORTIONS:
+      status=distortions_free(&sd);
+      name="distortions_free"; message=sd.error_message;
+      break;
+    case LENSING:
+      status=lensing_free(&le);
+      name="lensing_free"; message=le.error_message;
+      break;
+    case HARMONIC:
+      status=harmonic_free(&hr);
+      name="harmonic_free"; message=hr.error_message;
+      break;
+    case TRANSFER:
+      status=transfer_free(&tr);
+      name="transfer_free"; message=tr.error_message;
+      break;
+    case FOURIER:
+      status=fourier_free(&fo);
+      name="fourier_free"; message=fo.error_message;
+      break;
+    case PRIMORDIAL:
+      status=primordial_free(&pm);
+      name="primordial_free"; message=pm.error_message;
+      break;
+    case PERTURBATIONS:
+      status=perturbations_free(&pt);
+      name="perturbations_free"; message=pt.error_message;
+      break;
+    case THERMODYNAMICS:
+      status=thermodynamics_free(&th);
+      name="thermodynamics_free"; message=th.error_message;
+      break;
+    case BACKGROUND:
+      status=background_free(&ba);
+      name="background_free"; message=ba.error_message;
+      break;
+    }
 
-  if (perturb_free(&pt) == _FAILURE_) {
-    printf("\n\nError in perturb_free \n=>%s\n",pt.error_message);
-    return _FAILURE_;
-  }
+    nStages=stage;
 
-  if (thermodynamics_free(&th) == _FAILURE_) {
-    printf("\n\nError in thermodynamics_free \n=>%s\n",th.error_message);
-    return _FAILURE_;
+    if (status == _FAILURE_) {
+      printf("\n\nError in %s \n=>%s\n",name,message);
+      return _FAILURE_;
+    }
   }
 
-  if (background_free(&ba) == _FAILURE_) {
-    printf("\n\nError in background_free \n=>%s\n",ba.error_message);
-    return _FAILURE_;
-  }
+  if (nStages < NSTAGES) dofree=false;
 
   return _SUCCESS_;
 }
@@ -403,12 +599,28 @@ void ClassEngine::call_perturb_sources_at_tau(
                            double tau,
                            double * psource
                            ) {
-  if( perturb_sources_at_tau( &pt, index_md, index_ic, index_tp, tau, psource ) == _FAILURE_){
+  if( perturbations_sources_at_tau( &pt, index_md, index_ic, index_tp, tau, psource ) == _FAILURE_){
     cerr << ">>>fail getting Tk type=" << (int)index_tp <<endl;
     throw out_of_range(pt.error_message);
   }
 }
 
+void ClassEngine::call_perturb_sources_at_tau_vec(
+                           int index_md,
+                           int index_ic,
+                           const std::vector<int>& index_tp,
+                           const std::vector<double>& tau,
+                           double * psources
+                           ) {
+  if( perturbations_sources_at_tau_vec( &pt, index_md, index_ic,
+                                        const_cast<int*>(index_tp.data()), (int)index_tp.size(),
+                                        const_cast<double*>(tau.data()), (int)tau.size(),
+                                        psources ) == _FAILURE_){
+    cerr << ">>>fail getting sources at " << tau.size() << " values of tau" <<endl;
+    throw out_of_range(pt.error_message);
+  }
+}
+
 void
 ClassEngine::getTk( double z,
    std::vector<double>& k,
@@ -460,7 +672,7 @@ ClassEngine::getTk( double z,
   call_perturb_sources_at_tau(index_md, 0, pt.index_tp_delta_tot, tau, &d_tot[0]);
   call_perturb_sources_at_tau(index_md, 0, pt.index_tp_theta_b, tau, &t_b[0]);
   call_perturb_sources_at_tau(index_md, 0, pt.index_tp_theta_ncdm1, tau, &t_ncdm[0]);
-  call_perturb_sources_at_tau(index_md, 0, pt.index_tp_theta_tot, tau, &d_tot[0]);
+  call_perturb_sources_at_tau(index_md, 0, pt.index_tp_theta_tot, tau, &t_tot[0]);
 
   //
   std::vector<double> h_prime(pt.k_size[index_md],0.0), eta_prime(pt.k_size[index_md],0.0);
@@ -489,11 +701,13 @@ ClassEngine::getTk( double z,
 double
 ClassEngine::getCl(Engine::cltype t,const long &l){
 
+  if (emulated) return getEmulatedCl(t,l);
+
   if (!dofree) throw out_of_range("no Cl available because CLASS failed");
 
-  if (output_total_cl_at_l(&sp,&le,&op,static_cast<double>(l),cl) == _FAILURE_){
+  if (output_total_cl_at_l(&hr,&le,&op,static_cast<int>(l),cl) == _FAILURE_){
     cerr << ">>>fail getting Cl type=" << (int)t << " @l=" << l <<endl;
-    throw out_of_range(sp.error_message);
+    throw out_of_range(hr.error_message);
   }
 
   double zecl=-1;
@@ -504,31 +718,67 @@ ClassEngine::getCl(Engine::cltype t,const long &l){
   switch(t)
     {
     case TT:
-      (sp.has_tt==_TRUE_) ? zecl=tomuk2*cl[sp.index_ct_tt] : throw invalid_argument("no ClTT available");
+      (hr.has_tt==_TRUE_) ? zecl=tomuk2*cl[hr.index_ct_tt] : throw invalid_argument("no ClTT available");
       break;
     case TE:
-      (sp.has_te==_TRUE_) ? zecl=tomuk2*cl[sp.index_ct_te] : throw invalid_argument("no ClTE available");
+      (hr.has_te==_TRUE_) ? zecl=tomuk2*cl[hr.index_ct_te] : throw invalid_argument("no ClTE available");
       break;
     case EE:
-      (sp.has_ee==_TRUE_) ? zecl=tomuk2*cl[sp.index_ct_ee] : throw invalid_argument("no ClEE available");
+      (hr.has_ee==_TRUE_) ? zecl=tomuk2*cl[hr.index_ct_ee] : throw invalid_argument("no ClEE available");
       break;
     case BB:
-      (sp.has_bb==_TRUE_) ? zecl=tomuk2*cl[sp.index_ct_bb] : throw invalid_argument("no ClBB available");
+      (hr.has_bb==_TRUE_) ? zecl=tomuk2*cl[hr.index_ct_bb] : throw invalid_argument("no ClBB available");
       break;
     case PP:
-      (sp.has_pp==_TRUE_) ? zecl=cl[sp.index_ct_pp] : throw invalid_argument("no ClPhi-Phi available");
+      (hr.has_pp==_TRUE_) ? zecl=cl[hr.index_ct_pp] : throw invalid_argument("no ClPhi-Phi available");
       break;
     case TP:
-      (sp.has_tp==_TRUE_) ? zecl=tomuk*cl[sp.index_ct_tp] : throw invalid_argument("no ClT-Phi available");
+      (hr.has_tp==_TRUE_) ? zecl=tomuk*cl[hr.index_ct_tp] : throw invalid_argument("no ClT-Phi available");
       break;
     case EP:
-      (sp.has_ep==_TRUE_) ? zecl=tomuk*cl[sp.index_ct_ep] : throw invalid_argument("no ClE-Phi available");
+      (hr.has_ep==_TRUE_) ? zecl=tomuk*cl[hr.index_ct_ep] : throw invalid_argument("no ClE-Phi available");
       break;
     }
 
   return zecl;
 
 }
+double
+ClassEngine::getEmulatedCl(Engine::cltype t,const long &l){
+
+  double emcl[_EMULATOR_CL_TYPES_];
+  if (emulator_cl_at_l(&em,&emOutput[0],static_cast<int>(l),emcl,_errmsg) == _FAILURE_){
+    cerr << ">>>fail getting emulated Cl type=" << (int)t << " @l=" << l <<endl;
+    throw out_of_range(_errmsg);
+  }
+
+  double tomuk=1e6*Tcmb();
+  double tomuk2=tomuk*tomuk;
+
+  switch(t)
+    {
+    case TT:
+      if (em.has_cl[emulator_tt]==_TRUE_) return tomuk2*emcl[emulator_tt];
+      break;
+    case TE:
+      if (em.has_cl[emulator_te]==_TRUE_) return tomuk2*emcl[emulator_te];
+      break;
+    case EE:
+      if (em.has_cl[emulator_ee]==_TRUE_) return tomuk2*emcl[emulator_ee];
+      break;
+    case BB:
+      if (em.has_cl[emulator_bb]==_TRUE_) return tomuk2*emcl[emulator_bb];
+      break;
+    case PP:
+      if (em.has_cl[emulator_pp]==_TRUE_) return emcl[emulator_pp];
+      break;
+    default:
+      break;
+    }
+  throw invalid_argument("this Cl type was not emulated");
+
+}
+
 void
 ClassEngine::getCls(const std::vector<unsigned>& lvec, //input
 		      std::vector<double>& cltt,
@@ -608,20 +858,12 @@ double ClassEngine::get_f(double z)
 
 double ClassEngine::get_sigma8(double z)
 {
-  double tau;
-  int index;
-  double *pvecback;
   double sigma8 = 0.;
-  //transform redshift in conformal time
-  background_tau_of_z(&ba,z,&tau);
 
-  //pvecback must be allocated
-  pvecback=(double *)malloc(ba.bg_size*sizeof(double));
-
-  //call to fill pvecback
-  background_at_tau(&ba,tau,long_info,inter_normal, &index, pvecback);
-  //background_at_tau(pba,tau,pba->long_info,pba->inter_normal,&last_index,pvecback);
-  spectra_sigma(&ba,&pm,&sp,8./ba.h,z,&sigma8);
+  if (fourier_sigmas_at_z(&pr,&ba,&fo,8./ba.h,z,fo.index_pk_m,out_sigma,&sigma8) == _FAILURE_){
+    cerr << ">>>fail getting sigma8 @z=" << z <<endl;
+    throw out_of_range(fo.error_message);
+  }
 
 #ifdef DBUG
   cout << "sigma_8= "<< sigma8 <<endl;
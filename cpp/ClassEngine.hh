@@ -78,14 +78,42 @@ public:
   ~ClassEngine();
 
   //modfiers: _FAILURE_ returned if CLASS pb:
+  //only the stages downstream of the earliest one affected by a modified parameter are recomputed
   bool updateParValues(const std::vector<double>& par);
 
+  //stages of a CLASS run, in the order in which they are computed
+  enum Stage {BACKGROUND,THERMODYNAMICS,PERTURBATIONS,PRIMORDIAL,FOURIER,TRANSFER,HARMONIC,LENSING,DISTORTIONS,NSTAGES};
+
+  //earliest stage affected by an input parameter (BACKGROUND if not known to be later)
+  static Stage firstStage(const string& name);
+
+  //load an emulator written by test/test_emulator.c (or unload it with an empty name):
+  //updateParValues() then evaluates it instead of running CLASS whenever the parameters
+  //are inside its training box, and getCl() returns the emulated lensed Cl's
+  bool useEmulator(const string & emulator_file);
+  inline bool isEmulated() const {return emulated;}
+
+  //run CLASS for many parameter points concurrently. 'threads' OpenMP threads (all available if 0) are
+  //split between the points and the inner loops of each run. For point ip, the Cl's of getCl() are
+  //written to cls[(ip*cltypes.size()+it)*(lmax+1)+l] (2<=l<=lmax, zero below), and P(k,z) in Mpc^3
+  //(non-linear if a non-linear method is requested) to pk[(ip*z.size()+iz)*k.size()+ik]; either
+  //buffer may be NULL. Returns for each point whether its run succeeded (its entries are zero if not)
+  static std::vector<bool> evaluateBatch(const std::vector<ClassParams>& points,
+                                         const std::vector<Engine::cltype>& cltypes,
+                                         int lmax,
+                                         double * cls,
+                                         const std::vector<double>& k,
+                                         const std::vector<double>& z,
+                                         double * pk,
+                                         int threads=0);
+
 
   //get value at l ( 2<l<lmax): in units = (micro-K)^2
   //don't call if FAILURE returned previously
   //throws std::execption if pb
 
   double getCl(Engine::cltype t,const long &l);
+  double getEmulatedCl(Engine::cltype t,const long &l);
   void getCls(const std::vector<unsigned>& lVec, //input
 	      std::vector<double>& cltt,
 	      std::vector<double>& clte,
@@ -104,6 +132,16 @@ public:
                            double * psource
                            );
 
+  // several types at several tau in one call; psources has
+  // tau_size*tp_size*k_size entries, k running fastest
+  void call_perturb_sources_at_tau_vec(
+                           int index_md,
+                           int index_ic,
+                           const std::vector<int>& index_tp,
+                           const std::vector<double>& tau,
+                           double * psources
+                           );
+
   void getTk( double z,
         std::vector<double>& k,
         std::vector<double>& d_cdm,
@@ -131,11 +169,15 @@ public:
   double getTauReio() const {return th.tau_reio;}
 
   //may need that
-  inline int numCls() const {return sp.ct_size;};
+  inline int numCls() const {return hr.ct_size;};
   inline double Tcmb() const {return ba.T_cmb;}
 
   inline int l_max_scalars() const {return _lmax;}
 
+  //wall and CPU time, threads and memory of the stages computed by the last run
+  //(see struct profile in common.h; printed after each run if profile_verbose is set)
+  inline const struct profile& getProfile() const {return prof;}
+
   //print content of file_content
   void printFC();
 
@@ -144,42 +186,53 @@ private:
   struct file_content fc;
   struct precision pr;        /* for precision parameters */
   struct background ba;       /* for cosmological background */
-  struct thermo th;           /* for thermodynamics */
-  struct perturbs pt;         /* for source functions */
-  struct transfers tr;        /* for transfer functions */
+  struct thermodynamics th;   /* for thermodynamics */
+  struct perturbations pt;    /* for source functions */
+  struct transfer tr;         /* for transfer functions */
   struct primordial pm;       /* for primordial spectra */
-  struct spectra sp;          /* for output spectra */
-  struct nonlinear nl;        /* for non-linear spectra */
+  struct harmonic hr;         /* for output spectra */
+  struct fourier fo;          /* for non-linear spectra */
   struct lensing le;          /* for lensed spectra */
   struct distortions sd;      /* for spectral distortions */
   struct output op;           /* for output files */
 
+  struct profile prof;         /* for the time and memory of each stage */
+
   ErrorMsg _errmsg;            /* for error messages */
   double * cl;
 
+  struct emulator em;          /* for the emulator */
+  bool hasEmulator;
+  bool emulated;
+  std::vector<double> emOutput;
+
   //helpers
   bool dofree;
-  int freeStructs();
+  int nStages;                 //stages [BACKGROUND,nStages) are computed and allocated
+  int freeStructs(Stage from=BACKGROUND);
+  void freeInput(struct background * pba,struct perturbations * ppt);
 
   //call once /model
-  int computeCls();
+  int computeCls(Stage from=BACKGROUND);
 
   int class_main(
+		 Stage from,
 		 struct file_content *pfc,
 		 struct precision * ppr,
 		 struct background * pba,
-		 struct thermo * pth,
-		 struct perturbs * ppt,
-		 struct transfers * ptr,
+		 struct thermodynamics * pth,
+		 struct perturbations * ppt,
+		 struct transfer * ptr,
 		 struct primordial * ppm,
-		 struct spectra * psp,
-		 struct nonlinear * pnl,
+		 struct harmonic * phr,
+		 struct fourier * pfo,
 		 struct lensing * ple,
 		 struct distortions * psd,
 		 struct output * pop,
 		 ErrorMsg errmsg);
-  //parnames
+  //parnames, and values of the last run
   std::vector<std::string> parNames;
+  std::vector<std::string> parValues;
 
 protected:
 
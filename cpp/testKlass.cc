@@ -36,8 +36,8 @@ int main(int argc,char** argv){
   pars.add("perturbations_verbose",1);
   pars.add("transfer_verbose",1);
   pars.add("primordial_verbose",1);
-  pars.add("spectra_verbose",1);
-  pars.add("nonlinear_verbose",1);
+  pars.add("harmonic_verbose",1);
+  pars.add("fourier_verbose",1);
   pars.add("lensing_verbose",1);
 
   ClassEngine* tKlass(0);
@@ -432,7 +432,7 @@ double rec_swift_hyrec_dxHIIdlna(HYREC_DATA *data, double xe, double xHII, doubl
   double Alpha[2], DAlpha[2], Beta[2], R2p2s, RLya;
   double DK_K_fid, DK_K, fitted_RLya;
   double C_2s, C_2p, gamma_2s, gamma_2p, s, Dxe2;
-  static double diff[3];
+  double diff[3];
   unsigned i;
   double ratio;
   char sub_message[128];
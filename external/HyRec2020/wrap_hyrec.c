@@ -7,6 +7,9 @@
 #include "thermodynamics.h"
 #include "wrap_hyrec.h"
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 
 /**
  * Initialize the thermohyrec structure, and in particular HyRec 2020.
@@ -38,14 +41,11 @@ int thermodynamics_hyrec_init(struct precision* ppr, struct background * pba, st
     printf("    Starting HyRec at z = %.10e until z = %.10e\n",phy->zstart, phy->zend);
   }
 
-  /** - allocate hyrec internally */
+  /** - allocate hyrec internally, with rate tables shared between runs */
   phy->data->path_to_hyrec = ppr->hyrec_path;
-  hyrec_allocate(phy->data, phy->zstart, phy->zend);
-  /* Error during allocation */
-  if(phy->data->error != 0){
-    class_call_message(phy->error_message,"hyrec_allocate",phy->data->error_message);
-    return _FAILURE_;
-  }
+  class_call(thermodynamics_hyrec_allocate(ppr, phy),
+             phy->error_message,
+             phy->error_message);
 
   /** - set cosmological parameters for hyrec */
   phy->data->cosmo->T0 = T_cmb;
@@ -76,13 +76,425 @@ int thermodynamics_hyrec_init(struct precision* ppr, struct background * pba, st
  */
 int thermodynamics_hyrec_free(struct thermohyrec* phy){
 
-  /* We just need to free hyrec (without error management) */
-  hyrec_free(phy->data);
+  /* We just need to free hyrec (without error management), as
+     hyrec_free() would, but releasing the rate tables instead of
+     freeing them */
+  thermodynamics_hyrec_tables_release(phy);
+  free(phy->data->cosmo->inj_params);
+  free(phy->data->cosmo);
+  free(phy->data->xe_output);
+  free(phy->data->Tm_output);
+  free(phy->data->error_message);
+  if (MODEL == FULL) free_radiation(phy->data->rad);
+  free(phy->data->rad);
   free(phy->data);
 
   return _SUCCESS_;
 }
 
+/**
+ * Allocate the internal structures of HyRec, as hyrec_allocate()
+ * does, but with rate tables obtained from
+ * thermodynamics_hyrec_tables_acquire() instead of being read from
+ * disk at each run.
+ *
+ * @param ppr   Input: pointer to precision structure
+ * @param phy   Input/Output: pointer to thermohyrec structure, with phy->data allocated and phy->zstart, phy->zend set
+ * @return the error status
+ */
+int thermodynamics_hyrec_allocate(struct precision* ppr, struct thermohyrec* phy){
+
+  HYREC_DATA * data = phy->data;
+  double DLNA;
+
+  if (MODEL == SWIFT) DLNA = DLNA_SWIFT;
+  else DLNA = DLNA_HYREC;
+
+  data->error = 0;
+  class_alloc(data->error_message, SIZE_ErrorM, phy->error_message);
+  sprintf(data->error_message, "\n**** ERROR HAS OCCURRED in HYREC-2 ****\n");
+
+  data->zmax = (phy->zstart > 3000.? phy->zstart : 3000.);
+  data->zmin = phy->zend;
+
+  class_call(thermodynamics_hyrec_tables_acquire(ppr, phy),
+             phy->error_message,
+             phy->error_message);
+
+  class_alloc(data->cosmo, sizeof(REC_COSMOPARAMS), phy->error_message);
+  class_alloc(data->cosmo->inj_params, sizeof(INJ_PARAMS), phy->error_message);
+
+  data->Nz = (long int) (log((1.+phy->zstart)/(1.+phy->zend))/DLNA) + 2;
+  class_alloc(data->rad, sizeof(RADIATION), phy->error_message);
+
+  if (MODEL == FULL) allocate_radiation(data->rad, (long int) (log(10.)/DLNA), &data->error, data->error_message);
+
+  data->xe_output = create_1D_array(data->Nz, &data->error, data->error_message);
+  data->Tm_output = create_1D_array(data->Nz, &data->error, data->error_message);
+
+  /* Error during allocation */
+  if(data->error != 0){
+    class_call_message(phy->error_message,"hyrec_allocate",data->error_message);
+    return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Rate tables of HyRec (effective rates, two-photon rates and SWIFT
+ * correction function), read at most once per process and shared by
+ * all thermohyrec structures using the same files. They are never
+ * modified after being read. thermohyrec_tables_users counts the
+ * structures currently pointing to them: the tables stay in memory
+ * when it drops to zero, for later runs, until
+ * thermodynamics_hyrec_tables_clear() is called.
+ */
+
+static HYREC_ATOMIC * thermohyrec_atomic = NULL;
+static FIT_FUNC * thermohyrec_fit = NULL;
+static char thermohyrec_tables_key[2*_FILENAMESIZE_+2];
+static int thermohyrec_tables_users = 0;
+static void * thermohyrec_tables_map = NULL;
+static size_t thermohyrec_tables_map_size = 0;
+
+/** identifies the binary form of the tables written by thermodynamics_hyrec_tables_write() */
+#define _HYREC_TABLES_MAGIC_ "CLASS_HYREC_TABLES_1"
+
+/**
+ * Header of the binary form of the tables, followed by (in this order,
+ * all as doubles) logTR_tab, TM_TR_tab, logAlpha_tab[0] and
+ * logAlpha_tab[1] (NTM rows of NTR values), logR2p2s_tab, DlogTR,
+ * DTM_TR, Eb_tab, A1s_tab, A2s_tab, A3s3d_tab, A4s4d_tab and the five
+ * columns of swift_func.
+ */
+
+struct thermohyrec_tables_header {
+  char magic[24];
+  int sizeof_double;
+  int ntr;
+  int ntm;
+  int nvirt;
+  int dkk_size;
+};
+
+/**
+ * Number of doubles following the header in the binary form of the tables
+ */
+
+#define _HYREC_TABLES_DOUBLES_ (NTR+NTM+2*NTM*NTR+NTR+2+5*NVIRT+5*DKK_SIZE)
+
+/**
+ * Write the tables in binary form, so that later runs can map them
+ * into memory instead of parsing the text files.
+ *
+ * @param filename Input: name of the binary file
+ * @param atomic   Input: effective and two-photon rates
+ * @param fit      Input: SWIFT correction function
+ * @return _SUCCESS_ if the file could be written, _FAILURE_ otherwise
+ */
+
+int thermodynamics_hyrec_tables_write(char * filename,
+                                      HYREC_ATOMIC * atomic,
+                                      FIT_FUNC * fit){
+
+  FILE * fB;
+  struct thermohyrec_tables_header header;
+  int l, j, written = 0;
+
+  fB = fopen(filename,"wb");
+  if (fB == NULL)
+    return _FAILURE_;
+
+  memset(&header,0,sizeof(header));
+  strcpy(header.magic,_HYREC_TABLES_MAGIC_);
+  header.sizeof_double = sizeof(double);
+  header.ntr = NTR;
+  header.ntm = NTM;
+  header.nvirt = NVIRT;
+  header.dkk_size = DKK_SIZE;
+
+  fwrite(&header,sizeof(header),1,fB);
+  written += fwrite(atomic->logTR_tab,sizeof(double),NTR,fB);
+  written += fwrite(atomic->TM_TR_tab,sizeof(double),NTM,fB);
+  for (l = 0; l <= 1; l++)
+    for (j = 0; j < NTM; j++)
+      written += fwrite(atomic->logAlpha_tab[l][j],sizeof(double),NTR,fB);
+  written += fwrite(atomic->logR2p2s_tab,sizeof(double),NTR,fB);
+  written += fwrite(&(atomic->DlogTR),sizeof(double),1,fB);
+  written += fwrite(&(atomic->DTM_TR),sizeof(double),1,fB);
+  written += fwrite(atomic->Eb_tab,sizeof(double),NVIRT,fB);
+  written += fwrite(atomic->A1s_tab,sizeof(double),NVIRT,fB);
+  written += fwrite(atomic->A2s_tab,sizeof(double),NVIRT,fB);
+  written += fwrite(atomic->A3s3d_tab,sizeof(double),NVIRT,fB);
+  written += fwrite(atomic->A4s4d_tab,sizeof(double),NVIRT,fB);
+  for (j = 0; j < 5; j++)
+    written += fwrite(fit->swift_func[j],sizeof(double),DKK_SIZE,fB);
+
+  fclose(fB);
+
+  if (written != _HYREC_TABLES_DOUBLES_) {
+    remove(filename);
+    return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Map the binary form of the tables into memory. The large tables
+ * (logAlpha_tab and swift_func) point directly into the read-only
+ * mapping, the small fixed-size ones are copied into the structure.
+ *
+ * @param filename Input: name of the binary file
+ * @param atomic   Output: effective and two-photon rates
+ * @param fit      Output: SWIFT correction function
+ * @param found    Output: _FALSE_ if the file does not exist or has the wrong format (nothing is mapped then)
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+int thermodynamics_hyrec_tables_map(char * filename,
+                                    HYREC_ATOMIC * atomic,
+                                    FIT_FUNC * fit,
+                                    short * found,
+                                    ErrorMsg errmsg){
+
+  FILE * fB;
+  int l, j;
+  struct stat st;
+  struct thermohyrec_tables_header * header;
+  size_t size;
+  void * map;
+  double * data;
+
+  *found = _FALSE_;
+
+  /* (open() cannot be used here, since background.h defines 'open' as a spatial curvature) */
+  fB = fopen(filename,"rb");
+  if (fB == NULL)
+    return _SUCCESS_;
+
+  size = sizeof(struct thermohyrec_tables_header)+_HYREC_TABLES_DOUBLES_*sizeof(double);
+  if ((fstat(fileno(fB),&st) != 0) || ((size_t)st.st_size != size)) {
+    fclose(fB);
+    return _SUCCESS_;
+  }
+
+  map = mmap(NULL,size,PROT_READ,MAP_SHARED,fileno(fB),0);
+  fclose(fB);
+  class_test(map == MAP_FAILED,
+             errmsg,
+             "could not map file %s into memory",filename);
+
+  header = (struct thermohyrec_tables_header *)map;
+  if ((strncmp(header->magic,_HYREC_TABLES_MAGIC_,sizeof(header->magic)) != 0) ||
+      (header->sizeof_double != sizeof(double)) ||
+      (header->ntr != NTR) ||
+      (header->ntm != NTM) ||
+      (header->nvirt != NVIRT) ||
+      (header->dkk_size != DKK_SIZE)) {
+    munmap(map,size);
+    return _SUCCESS_;
+  }
+
+  data = (double *)((char *)map+sizeof(struct thermohyrec_tables_header));
+
+  memcpy(atomic->logTR_tab,data,NTR*sizeof(double)); data += NTR;
+  memcpy(atomic->TM_TR_tab,data,NTM*sizeof(double)); data += NTM;
+  for (l = 0; l <= 1; l++) {
+    class_alloc(atomic->logAlpha_tab[l],NTM*sizeof(double *),errmsg);
+    for (j = 0; j < NTM; j++) {
+      atomic->logAlpha_tab[l][j] = data;
+      data += NTR;
+    }
+  }
+  memcpy(atomic->logR2p2s_tab,data,NTR*sizeof(double)); data += NTR;
+  atomic->DlogTR = *(data++);
+  atomic->DTM_TR = *(data++);
+  memcpy(atomic->Eb_tab,data,NVIRT*sizeof(double)); data += NVIRT;
+  memcpy(atomic->A1s_tab,data,NVIRT*sizeof(double)); data += NVIRT;
+  memcpy(atomic->A2s_tab,data,NVIRT*sizeof(double)); data += NVIRT;
+  memcpy(atomic->A3s3d_tab,data,NVIRT*sizeof(double)); data += NVIRT;
+  memcpy(atomic->A4s4d_tab,data,NVIRT*sizeof(double)); data += NVIRT;
+  for (j = 0; j < 5; j++) {
+    fit->swift_func[j] = data;
+    data += DKK_SIZE;
+  }
+
+  thermohyrec_tables_map = map;
+  thermohyrec_tables_map_size = size;
+  *found = _TRUE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Point the thermohyrec structure to the shared tables, reading them
+ * first if needed: from the binary file ppr->hyrec_binary_tables_file
+ * if ppr->hyrec_binary_tables is true and this file exists (otherwise
+ * the file is written after reading the text tables), or from the
+ * text files in ppr->hyrec_path. If the shared tables come from other
+ * files and are still in use, private tables are read instead.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param phy Input/Output: pointer to thermohyrec structure, with phy->data allocated
+ * @return the error status
+ */
+
+int thermodynamics_hyrec_tables_acquire(struct precision * ppr,
+                                        struct thermohyrec * phy){
+
+  char key[2*_FILENAMESIZE_+2];
+  short found = _FALSE_;
+  int status = _SUCCESS_;
+  HYREC_DATA * data = phy->data;
+
+  sprintf(key,"%s|%s",ppr->hyrec_path,(ppr->hyrec_binary_tables == _TRUE_ ? ppr->hyrec_binary_tables_file : ""));
+
+#pragma omp critical (thermohyrec_tables)
+  {
+    if ((thermohyrec_atomic != NULL) && (strcmp(key,thermohyrec_tables_key) != 0) && (thermohyrec_tables_users == 0)) {
+      thermodynamics_hyrec_tables_free();
+    }
+
+    if (thermohyrec_atomic == NULL) {
+
+      thermohyrec_atomic = (HYREC_ATOMIC *) malloc(sizeof(HYREC_ATOMIC));
+      thermohyrec_fit = (FIT_FUNC *) malloc(sizeof(FIT_FUNC));
+
+      if (ppr->hyrec_binary_tables == _TRUE_) {
+        status = thermodynamics_hyrec_tables_map(ppr->hyrec_binary_tables_file,thermohyrec_atomic,thermohyrec_fit,&found,phy->error_message);
+      }
+
+      if ((status == _SUCCESS_) && (found == _FALSE_)) {
+        allocate_and_read_atomic(thermohyrec_atomic, &data->error, data->path_to_hyrec, data->error_message);
+        allocate_and_read_fit(thermohyrec_fit, &data->error, data->path_to_hyrec, data->error_message);
+        if ((data->error == 0) && (ppr->hyrec_binary_tables == _TRUE_)) {
+          /* failing to write the binary file only means that the text files will be read again next time */
+          thermodynamics_hyrec_tables_write(ppr->hyrec_binary_tables_file,thermohyrec_atomic,thermohyrec_fit);
+        }
+      }
+
+      strcpy(thermohyrec_tables_key,key);
+
+      if ((status == _FAILURE_) || (data->error != 0)) {
+        free(thermohyrec_atomic);
+        free(thermohyrec_fit);
+        thermohyrec_atomic = NULL;
+        thermohyrec_fit = NULL;
+      }
+    }
+
+    if ((status == _SUCCESS_) && (data->error == 0)) {
+      if (strcmp(key,thermohyrec_tables_key) == 0) {
+        data->atomic = thermohyrec_atomic;
+        data->fit = thermohyrec_fit;
+        thermohyrec_tables_users++;
+        phy->shared_tables = _TRUE_;
+      }
+      else {
+        data->atomic = (HYREC_ATOMIC *) malloc(sizeof(HYREC_ATOMIC));
+        allocate_and_read_atomic(data->atomic, &data->error, data->path_to_hyrec, data->error_message);
+        data->fit = (FIT_FUNC *) malloc(sizeof(FIT_FUNC));
+        allocate_and_read_fit(data->fit, &data->error, data->path_to_hyrec, data->error_message);
+        phy->shared_tables = _FALSE_;
+      }
+    }
+  }
+
+  if (status == _FAILURE_)
+    return _FAILURE_;
+
+  if (data->error != 0) {
+    class_call_message(phy->error_message,"allocate_and_read_atomic",data->error_message);
+    return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Release the tables used by a thermohyrec structure: private tables
+ * are freed, shared ones stay in memory for later runs.
+ *
+ * @param phy Input/Output: pointer to thermohyrec structure
+ * @return the error status
+ */
+
+int thermodynamics_hyrec_tables_release(struct thermohyrec * phy){
+
+  if (phy->shared_tables == _TRUE_) {
+#pragma omp critical (thermohyrec_tables)
+    {
+      thermohyrec_tables_users--;
+    }
+  }
+  else {
+    free_atomic(phy->data->atomic);
+    free(phy->data->atomic);
+    free_fit(phy->data->fit);
+    free(phy->data->fit);
+  }
+
+  phy->data->atomic = NULL;
+  phy->data->fit = NULL;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the shared tables, unless some thermohyrec structure still
+ * uses them (they are then kept, and freed by a later call).
+ *
+ * @return the error status
+ */
+
+int thermodynamics_hyrec_tables_clear(){
+
+#pragma omp critical (thermohyrec_tables)
+  {
+    if (thermohyrec_tables_users == 0)
+      thermodynamics_hyrec_tables_free();
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the shared tables, whoever uses them. Only called by
+ * thermodynamics_hyrec_tables_acquire() and
+ * thermodynamics_hyrec_tables_clear(), which make sure no
+ * thermohyrec structure does.
+ *
+ * @return the error status
+ */
+
+int thermodynamics_hyrec_tables_free(){
+
+  if (thermohyrec_atomic == NULL)
+    return _SUCCESS_;
+
+  if (thermohyrec_tables_map != NULL) {
+    /* only the row pointers were allocated, the rows belong to the mapping */
+    free(thermohyrec_atomic->logAlpha_tab[0]);
+    free(thermohyrec_atomic->logAlpha_tab[1]);
+    munmap(thermohyrec_tables_map,thermohyrec_tables_map_size);
+    thermohyrec_tables_map = NULL;
+    thermohyrec_tables_map_size = 0;
+  }
+  else {
+    free_atomic(thermohyrec_atomic);
+    free_fit(thermohyrec_fit);
+  }
+  free(thermohyrec_atomic);
+  free(thermohyrec_fit);
+  thermohyrec_atomic = NULL;
+  thermohyrec_fit = NULL;
+
+  return _SUCCESS_;
+}
+
 /**
  * Calculate the derivative of the hydrogen HII ionization fraction
  *
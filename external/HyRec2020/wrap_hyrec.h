@@ -20,6 +20,8 @@ struct thermohyrec{
 
   double xHeII_limit;
 
+  short shared_tables; /**< _TRUE_ if data->atomic and data->fit are the tables shared between runs, _FALSE_ if they were read for this structure only */
+
   ErrorMsg error_message;
 
   int thermohyrec_verbose;
@@ -42,6 +44,20 @@ extern "C" {
 
   int thermodynamics_hyrec_free(struct thermohyrec* phy);
 
+  int thermodynamics_hyrec_allocate(struct precision* ppr, struct thermohyrec* phy);
+
+  int thermodynamics_hyrec_tables_write(char * filename, HYREC_ATOMIC * atomic, FIT_FUNC * fit);
+
+  int thermodynamics_hyrec_tables_map(char * filename, HYREC_ATOMIC * atomic, FIT_FUNC * fit, short * found, ErrorMsg errmsg);
+
+  int thermodynamics_hyrec_tables_acquire(struct precision * ppr, struct thermohyrec * phy);
+
+  int thermodynamics_hyrec_tables_release(struct thermohyrec * phy);
+
+  int thermodynamics_hyrec_tables_clear();
+
+  int thermodynamics_hyrec_tables_free();
+
   int hyrec_dx_H_dz(struct thermodynamics* pth, struct thermohyrec* phy, double x_H, double x_He, double xe, double nH, double z, double Hz, double Tmat, double Trad, double *dx_H_dz);
   int hyrec_dx_He_dz(struct thermodynamics* pth, struct thermohyrec* phy, double x_H, double x_He, double xe, double nH, double z, double Hz, double Tmat, double Trad, double *dx_He_dz);
 
@@ -0,0 +1,56 @@
+#!/usr/bin/python
+from __future__ import print_function
+import sys
+import struct
+
+# README:
+#
+# This is an example python script for the external_Pk mode of Class,
+# with 'external_Pk_protocol = worker'. It generates the primordial
+# spectrum of LambdaCDM, like generate_Pk_example_w_tensors.py, but it
+# is launched only once and answers the requests of Class until Class
+# exits.
+#
+# Each request is a line with the number of columns wanted (2 for k
+# and P_s, 3 for k, P_s and P_t) followed by the ten parameters
+# "custom1" to "custom10". The answer is a line with the number of
+# values of k, followed by the rows of the table as doubles in binary
+# (native byte order).
+#
+# Only the function giving P(k) and the limits of k need to be edited.
+
+def P_s(k, k_0, A_s, n_s) :
+    return A_s * (k/k_0)**(n_s-1.)
+
+def P_t(k, k_0, A_t, n_t) :
+    return A_t * (k/k_0)**(n_t)
+
+k_min  = 1.e-6
+k_max  = 10.
+k_per_decade_primordial = 200.
+
+#
+# And nothing should need to be edited from here on.
+#
+
+# Filling the array of k's (once for all requests)
+ks = [float(k_min)]
+while ks[-1] <= float(k_max) :
+    ks.append(ks[-1]*10.**(1./float(k_per_decade_primordial)))
+
+stdin = getattr(sys.stdin, 'buffer', sys.stdin)
+stdout = getattr(sys.stdout, 'buffer', sys.stdout)
+
+for request in iter(stdin.readline, b'') :
+    fields = request.split()
+    n_columns = int(fields[0])
+    k_0, A_s, n_s, A_t, n_t = [float(x) for x in fields[1:6]]
+    rows = []
+    for k in ks :
+        rows.append(k)
+        rows.append(P_s(k, k_0, A_s, n_s))
+        if n_columns == 3 :
+            rows.append(P_t(k, k_0, A_t, n_t))
+    stdout.write(("%d\n" % len(ks)).encode())
+    stdout.write(struct.pack("%dd" % len(rows), *rows))
+    stdout.flush()
@@ -8,6 +8,32 @@
  */
 #include "injection.h"
 #include "thermodynamics.h"
+#include <sys/stat.h>
+
+/**
+ * Splined tables read from the f_eff and chi files, kept in memory by
+ * injection_table_cache_store() with the name, size and modification
+ * time of the file they were read from, and the PBH mass evolution of
+ * the last run with its key.
+ */
+
+#define _INJECTION_TABLE_CACHE_MAX_ 8
+
+static int injection_table_cache_size = 0;
+static int injection_table_cache_next = 0;
+static FileName injection_table_cache_file[_INJECTION_TABLE_CACHE_MAX_];
+static time_t injection_table_cache_mtime[_INJECTION_TABLE_CACHE_MAX_];
+static off_t injection_table_cache_bytes[_INJECTION_TABLE_CACHE_MAX_];
+static int injection_table_cache_columns[_INJECTION_TABLE_CACHE_MAX_];
+static int injection_table_cache_rows[_INJECTION_TABLE_CACHE_MAX_];
+static double * injection_table_cache_data[_INJECTION_TABLE_CACHE_MAX_];
+
+static short injection_PBH_cache_used = _FALSE_;
+static unsigned long long injection_PBH_cache_key_value;
+static int injection_PBH_cache_Nz = 0;
+static double * injection_PBH_cache_table = NULL; /* z, mass, mass_dd, F, F_dd, each of size injection_PBH_cache_Nz */
+static double injection_PBH_cache_z_evaporation;
+static double injection_PBH_cache_QCD_activation;
 
 /**
  * Initialize injection structure.
@@ -35,6 +61,7 @@ int injection_init(struct precision * ppr,
   pin->last_index_x_chi = 0;
   pin->last_index_z_chi = 0;
   pin->last_index_z_feff = 0;
+  pin->use_cache = ppr->injection_cache;
 
   /** - Import quantities from other structures */
   /* Precision structure */
@@ -770,19 +797,8 @@ int injection_rate_PBH_evaporation_mass_evolution(struct background * pba,
   double current_mass, current_pbh_temperature;
   double f_EM, f_nu, f_q, f_pi, f_bos, f;
   double loop_z, time_now, time_prev, dt, dlnz, lnz_ini;
-
-  /** - Set initial parameters */
-  current_mass = pin->PBH_evaporation_mass;                                                         // [g]
-  pin->PBH_z_evaporation = 0;
-  lnz_ini = log(1+pin->z_initial);
-  dlnz = lnz_ini/(pin->Nz_PBH-1);
-  loop_z = pin->z_initial*1.0001;
-  time_prev = 0.;                                                                                   // [s]
-
-  /** - Alloate local variables */
-  class_alloc(pvecback_loop,
-              pba->bg_size*sizeof(double),
-              pin->error_message);
+  unsigned long long key = 0;
+  short found;
 
   /** - Alloate variables for PBH mass evolution */
   class_alloc(pin->PBH_table_z,
@@ -801,6 +817,43 @@ int injection_rate_PBH_evaporation_mass_evolution(struct background * pba,
               pin->Nz_PBH*sizeof(double),
               pin->error_message);
 
+  /** - If the mass evolution of the previous run was computed for the same PBH mass and background, take it */
+  if (pin->use_cache == _TRUE_) {
+    class_call(injection_PBH_cache_key(pba,pin,&key),
+               pin->error_message,
+               pin->error_message);
+    /* the stored evolution is shared by all threads */
+#pragma omp critical (injection_cache)
+    {
+      found = _FALSE_;
+      if ((injection_PBH_cache_used == _TRUE_) && (injection_PBH_cache_key_value == key)) {
+        memcpy(pin->PBH_table_z,injection_PBH_cache_table,pin->Nz_PBH*sizeof(double));
+        memcpy(pin->PBH_table_mass,injection_PBH_cache_table+pin->Nz_PBH,pin->Nz_PBH*sizeof(double));
+        memcpy(pin->PBH_table_mass_dd,injection_PBH_cache_table+2*pin->Nz_PBH,pin->Nz_PBH*sizeof(double));
+        memcpy(pin->PBH_table_F,injection_PBH_cache_table+3*pin->Nz_PBH,pin->Nz_PBH*sizeof(double));
+        memcpy(pin->PBH_table_F_dd,injection_PBH_cache_table+4*pin->Nz_PBH,pin->Nz_PBH*sizeof(double));
+        pin->PBH_z_evaporation = injection_PBH_cache_z_evaporation;
+        pin->PBH_QCD_activation = injection_PBH_cache_QCD_activation;
+        found = _TRUE_;
+      }
+    }
+    if (found == _TRUE_)
+      return _SUCCESS_;
+  }
+
+  /** - Set initial parameters */
+  current_mass = pin->PBH_evaporation_mass;                                                         // [g]
+  pin->PBH_z_evaporation = 0;
+  lnz_ini = log(1+pin->z_initial);
+  dlnz = lnz_ini/(pin->Nz_PBH-1);
+  loop_z = pin->z_initial*1.0001;
+  time_prev = 0.;                                                                                   // [s]
+
+  /** - Alloate local variables */
+  class_alloc(pvecback_loop,
+              pba->bg_size*sizeof(double),
+              pin->error_message);
+
   /** - Fill tables with PBH mass evolution */
   /* For the parametrization of F(M) we follow PRD44 (1991) 376 with
    * the additional modification that we dress the "free QCD-particles"
@@ -896,6 +949,30 @@ int injection_rate_PBH_evaporation_mass_evolution(struct background * pba,
              pin->error_message,
              pin->error_message);
 
+  /** - Keep the mass evolution for the next run */
+  if (pin->use_cache == _TRUE_) {
+#pragma omp critical (injection_cache)
+    {
+      if (pin->Nz_PBH > injection_PBH_cache_Nz) {
+        free(injection_PBH_cache_table);
+        injection_PBH_cache_table = malloc(5*pin->Nz_PBH*sizeof(double));
+        injection_PBH_cache_Nz = (injection_PBH_cache_table == NULL) ? 0 : pin->Nz_PBH;
+        injection_PBH_cache_used = _FALSE_;
+      }
+      if (injection_PBH_cache_table != NULL) {
+        memcpy(injection_PBH_cache_table,pin->PBH_table_z,pin->Nz_PBH*sizeof(double));
+        memcpy(injection_PBH_cache_table+pin->Nz_PBH,pin->PBH_table_mass,pin->Nz_PBH*sizeof(double));
+        memcpy(injection_PBH_cache_table+2*pin->Nz_PBH,pin->PBH_table_mass_dd,pin->Nz_PBH*sizeof(double));
+        memcpy(injection_PBH_cache_table+3*pin->Nz_PBH,pin->PBH_table_F,pin->Nz_PBH*sizeof(double));
+        memcpy(injection_PBH_cache_table+4*pin->Nz_PBH,pin->PBH_table_F_dd,pin->Nz_PBH*sizeof(double));
+        injection_PBH_cache_z_evaporation = pin->PBH_z_evaporation;
+        injection_PBH_cache_QCD_activation = pin->PBH_QCD_activation;
+        injection_PBH_cache_key_value = key;
+        injection_PBH_cache_used = _TRUE_;
+      }
+    }
+  }
+
   return _SUCCESS_;
 }
 
@@ -1135,6 +1212,8 @@ int injection_read_feff_from_file(struct precision* ppr,
 
   /** - Define local variables */
   FILE * fA;
+  short found;
+  int status;
   char line[_LINE_LENGTH_MAX_];
   char * left;
   int headlines = 0;
@@ -1142,6 +1221,16 @@ int injection_read_feff_from_file(struct precision* ppr,
 
   pin->feff_z_size = 0;
 
+  /** - If this file was already read and splined, take the table from memory */
+  if (pin->use_cache == _TRUE_) {
+#pragma omp critical (injection_cache)
+    status = injection_table_cache_fetch(pin,f_eff_file,3,&(pin->feff_table),&(pin->feff_z_size),&found);
+    if (status == _FAILURE_)
+      return _FAILURE_;
+    if (found == _TRUE_)
+      return _SUCCESS_;
+  }
+
   /** - Read file header */
   /* The file is assumed to contain:
    *    - The number of lines of the file
@@ -1206,6 +1295,14 @@ int injection_read_feff_from_file(struct precision* ppr,
              pin->error_message,
              pin->error_message);
 
+  /** - Keep the splined table for later runs */
+  if (pin->use_cache == _TRUE_) {
+#pragma omp critical (injection_cache)
+    status = injection_table_cache_store(pin,f_eff_file,3,pin->feff_table,pin->feff_z_size);
+    if (status == _FAILURE_)
+      return _FAILURE_;
+  }
+
   return _SUCCESS_;
 }
 
@@ -1224,6 +1321,8 @@ int injection_read_chi_z_from_file(struct precision* ppr,
 
   /** Define local variables */
   FILE * fA;
+  short found;
+  int status;
   char line[_LINE_LENGTH_MAX_];
   char * left;
   int headlines = 0;
@@ -1231,6 +1330,16 @@ int injection_read_chi_z_from_file(struct precision* ppr,
 
   pin->chiz_size = 0;
 
+  /** - If this file was already read and splined, take the table from memory */
+  if (pin->use_cache == _TRUE_) {
+#pragma omp critical (injection_cache)
+    status = injection_table_cache_fetch(pin,chi_z_file,2*pin->dep_size+1,&(pin->chiz_table),&(pin->chiz_size),&found);
+    if (status == _FAILURE_)
+      return _FAILURE_;
+    if (found == _TRUE_)
+      return _SUCCESS_;
+  }
+
   /* The file is assumed to contain:
    *    - The number of lines of the file
    *    - The columns (xe , chi_heat, chi_Lya, chi_H, chi_He, chi_lowE) where chi_i represents the
@@ -1299,6 +1408,14 @@ int injection_read_chi_z_from_file(struct precision* ppr,
                pin->error_message);
   }
 
+  /** - Keep the splined table for later runs */
+  if (pin->use_cache == _TRUE_) {
+#pragma omp critical (injection_cache)
+    status = injection_table_cache_store(pin,chi_z_file,2*pin->dep_size+1,pin->chiz_table,pin->chiz_size);
+    if (status == _FAILURE_)
+      return _FAILURE_;
+  }
+
   return _SUCCESS_;
 }
 
@@ -1317,6 +1434,8 @@ int injection_read_chi_x_from_file(struct precision* ppr,
 
   /** Define local variables */
   FILE * fA;
+  short found;
+  int status;
   char line[_LINE_LENGTH_MAX_];
   char * left;
   int headlines = 0;
@@ -1324,6 +1443,16 @@ int injection_read_chi_x_from_file(struct precision* ppr,
 
   pin->chix_size = 0;
 
+  /** - If this file was already read and splined, take the table from memory */
+  if (pin->use_cache == _TRUE_) {
+#pragma omp critical (injection_cache)
+    status = injection_table_cache_fetch(pin,chi_x_file,2*pin->dep_size+1,&(pin->chix_table),&(pin->chix_size),&found);
+    if (status == _FAILURE_)
+      return _FAILURE_;
+    if (found == _TRUE_)
+      return _SUCCESS_;
+  }
+
   /** - Read file header */
   /* The file is assumed to contain:
    *    - The number of lines of the file
@@ -1395,10 +1524,179 @@ int injection_read_chi_x_from_file(struct precision* ppr,
                pin->error_message);
   }
 
+  /** - Keep the splined table for later runs */
+  if (pin->use_cache == _TRUE_) {
+#pragma omp critical (injection_cache)
+    status = injection_table_cache_store(pin,chi_x_file,2*pin->dep_size+1,pin->chix_table,pin->chix_size);
+    if (status == _FAILURE_)
+      return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+}
+
+
+
+
+/**
+ * If the file was already read with the same size and modification
+ * time, allocate the table and copy into it the splined table kept by
+ * injection_table_cache_store().
+ *
+ * @param pin     Input: pointer to injection structure
+ * @param file    Input: name of the file
+ * @param columns Input: number of columns of the table
+ * @param table   Output: pointer to the allocated table (if found)
+ * @param rows    Output: number of rows of the table (if found)
+ * @param found   Output: _TRUE_ if the table was found
+ * @return the error status
+ */
+int injection_table_cache_fetch(struct injection* pin,
+                                char* file,
+                                int columns,
+                                double** table,
+                                int* rows,
+                                short* found){
+
+  /** - Define local variables */
+  struct stat file_status;
+  int index_cache;
+
+  *found = _FALSE_;
+
+  /* a missing file is reported by the caller when trying to read it */
+  if (stat(file,&file_status) != 0)
+    return _SUCCESS_;
+
+  for (index_cache=0; index_cache<injection_table_cache_size; index_cache++) {
+    if ((strcmp(injection_table_cache_file[index_cache],file) == 0) &&
+        (injection_table_cache_mtime[index_cache] == file_status.st_mtime) &&
+        (injection_table_cache_bytes[index_cache] == file_status.st_size) &&
+        (injection_table_cache_columns[index_cache] == columns)) {
+
+      *rows = injection_table_cache_rows[index_cache];
+      class_alloc(*table,
+                  columns*(*rows)*sizeof(double),
+                  pin->error_message);
+      memcpy(*table,
+             injection_table_cache_data[index_cache],
+             columns*(*rows)*sizeof(double));
+      *found = _TRUE_;
+      break;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+
+/**
+ * Keep a copy of the splined table read from a file, with the size and
+ * modification time of the file. When all slots are used, the oldest
+ * table is replaced.
+ *
+ * @param pin     Input: pointer to injection structure
+ * @param file    Input: name of the file
+ * @param columns Input: number of columns of the table
+ * @param table   Input: splined table
+ * @param rows    Input: number of rows of the table
+ * @return the error status
+ */
+int injection_table_cache_store(struct injection* pin,
+                                char* file,
+                                int columns,
+                                double* table,
+                                int rows){
+
+  /** - Define local variables */
+  struct stat file_status;
+  int index_cache;
+
+  if (stat(file,&file_status) != 0)
+    return _SUCCESS_;
+
+  if (injection_table_cache_size < _INJECTION_TABLE_CACHE_MAX_) {
+    index_cache = injection_table_cache_size;
+    injection_table_cache_size++;
+    injection_table_cache_data[index_cache] = NULL;
+  }
+  else {
+    index_cache = injection_table_cache_next;
+    injection_table_cache_next = (injection_table_cache_next+1)%_INJECTION_TABLE_CACHE_MAX_;
+  }
+
+  class_realloc(injection_table_cache_data[index_cache],
+                injection_table_cache_data[index_cache],
+                columns*rows*sizeof(double),
+                pin->error_message);
+  memcpy(injection_table_cache_data[index_cache],
+         table,
+         columns*rows*sizeof(double));
+
+  strcpy(injection_table_cache_file[index_cache],file);
+  injection_table_cache_mtime[index_cache] = file_status.st_mtime;
+  injection_table_cache_bytes[index_cache] = file_status.st_size;
+  injection_table_cache_columns[index_cache] = columns;
+  injection_table_cache_rows[index_cache] = rows;
+
+  return _SUCCESS_;
+}
+
+
+/**
+ * Compute the key identifying the input of the PBH mass evolution: PBH
+ * mass, redshift sampling, and content of the background table.
+ *
+ * @param pba   Input: pointer to background structure
+ * @param pin   Input: pointer to injection structure
+ * @param key   Output: key
+ * @return the error status
+ */
+int injection_PBH_cache_key(struct background * pba,
+                            struct injection * pin,
+                            unsigned long long * key){
+
+  *key = 14695981039346656037ULL;
+
+  thermodynamics_recombination_cache_hash(&(pin->PBH_evaporation_mass),sizeof(pin->PBH_evaporation_mass),key);
+  thermodynamics_recombination_cache_hash(&(pin->z_initial),sizeof(pin->z_initial),key);
+  thermodynamics_recombination_cache_hash(&(pin->Nz_PBH),sizeof(pin->Nz_PBH),key);
+
+  thermodynamics_recombination_cache_hash(&(pba->bt_size),sizeof(pba->bt_size),key);
+  thermodynamics_recombination_cache_hash(&(pba->bg_size),sizeof(pba->bg_size),key);
+  thermodynamics_recombination_cache_hash(pba->z_table,pba->bt_size*sizeof(double),key);
+  thermodynamics_recombination_cache_hash(pba->background_table,pba->bt_size*pba->bg_size*sizeof(double),key);
+
   return _SUCCESS_;
 }
 
 
+/**
+ * Free the tables kept by injection_table_cache_store() and the PBH
+ * mass evolution kept by injection_rate_PBH_evaporation_mass_evolution().
+ *
+ * @return the error status
+ */
+int injection_cache_clear(){
+
+  int index_cache;
+
+#pragma omp critical (injection_cache)
+  {
+    for (index_cache=0; index_cache<injection_table_cache_size; index_cache++) {
+      free(injection_table_cache_data[index_cache]);
+    }
+    injection_table_cache_size = 0;
+    injection_table_cache_next = 0;
+
+    free(injection_PBH_cache_table);
+    injection_PBH_cache_table = NULL;
+    injection_PBH_cache_Nz = 0;
+    injection_PBH_cache_used = _FALSE_;
+  }
+
+  return _SUCCESS_;
+}
 
 
 /**
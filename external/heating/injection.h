@@ -172,6 +172,8 @@ struct injection{
 
   int to_store;
 
+  short use_cache; /* reuse the file tables and PBH mass evolution of previous runs (see injection_table_cache_fetch()) */
+
   /* Book-keeping */
 
   ErrorMsg error_message;
@@ -254,6 +256,26 @@ extern "C" {
                                      struct injection* phe,
                                      char* chi_x_file);
 
+  /* Tables kept for later runs */
+  int injection_table_cache_fetch(struct injection* phe,
+                                  char* file,
+                                  int columns,
+                                  double** table,
+                                  int* rows,
+                                  short* found);
+
+  int injection_table_cache_store(struct injection* phe,
+                                  char* file,
+                                  int columns,
+                                  double* table,
+                                  int rows);
+
+  int injection_PBH_cache_key(struct background * pba,
+                              struct injection * phe,
+                              unsigned long long * key);
+
+  int injection_cache_clear();
+
   int injection_output_titles(struct injection* phe,char* titles_heat);
 
   int injection_output_data(struct injection * phe,
@@ -9,6 +9,15 @@
 #include "primordial.h"
 #include "noninjection.h"
 
+/* Integrals over k of the acoustic dissipation at each coarse redshift
+   for the last run, with the key of the primordial spectrum and
+   damping scales from which they were computed (see
+   noninjection_acoustic_diss_table()) */
+static short noninjection_cache_used = _FALSE_;
+static unsigned long long noninjection_cache_key_value;
+static int noninjection_cache_z_size = 0;
+static double * noninjection_cache_integral = NULL;
+
 /**
  * Initialize the noninjection structure.
  *
@@ -39,6 +48,9 @@ int noninjection_init(struct precision* ppr,
   double h,a,b;
   double temp_injection;
   double z_coarse;
+  double * kD_coarse;
+  double * factor_coarse;
+  double * integral_coarse;
 
   /* z-table */
   pni->z_size = pth->tt_size;
@@ -112,9 +124,16 @@ int noninjection_init(struct precision* ppr,
              pni->error_message,
              pni->error_message);
 
-  class_alloc(pni->integrand_approx,
+  /** - The integrand of the acoustic dissipation is, at all redshifts,
+        k P(k) times a damping factor: multiply once for all k P(k) by
+        the trapezoidal weights */
+  class_alloc(pni->k_kernel,
               pni->k_size*sizeof(double),
               pni->error_message);
+  for (index_k=0; index_k<pni->k_size; index_k++) {
+    pni->k_kernel[index_k] = pni->k[index_k]*pni->pk_primordial_k[index_k]*pni->k_weights[index_k];
+  }
+  pni->use_cache = ppr->injection_cache;
 
   /** - Allocate backgorund and thermodynamcis vectors */
   last_index_back = 0;
@@ -138,6 +157,7 @@ int noninjection_init(struct precision* ppr,
              pni->error_message);
 
   pni->f_nu_wkb = (1.-pvecback[pba->index_bg_rho_g]/(pvecback[pba->index_bg_Omega_r]*pvecback[pba->index_bg_rho_crit]));
+  pni->A_wkb = 1./(1.+4./15.*pni->f_nu_wkb);
 
   /** - Import quantities from other structures */
   /* Background structure */
@@ -151,7 +171,20 @@ int noninjection_init(struct precision* ppr,
   pni->fHe = pth->fHe;                                                                              // [-]
   pni->N_e0 = pth->n_e;                                                                             // [1/m^3]
 
-  /** - Loop over z and calculate the heating at each point */
+  class_alloc(kD_coarse,
+              pni->z_size_coarse*sizeof(double),
+              pni->error_message);
+  class_alloc(factor_coarse,
+              pni->z_size_coarse*sizeof(double),
+              pni->error_message);
+  class_alloc(integral_coarse,
+              pni->z_size_coarse*sizeof(double),
+              pni->error_message);
+
+  /** - Loop over z and calculate the heating at each point, except for
+        the integrals over k of the acoustic dissipation, which only
+        depend on the damping scale at each z and are computed
+        afterwards for all z at once */
   dEdt = 0.;
   for(index_z=0; index_z<pni->z_size_coarse; ++index_z){
 
@@ -201,15 +234,31 @@ int noninjection_init(struct precision* ppr,
                pni->error_message);
     pni->noninjection_table[index_z]+=dEdt;
 
-    /* Second order acoustic dissipation of BAO */
+    /* Second order acoustic dissipation of BAO: the rate is proportional to the integral over k,
+       keep the rate for a unit integral */
+    kD_coarse[index_z] = pni->kD;
+    pni->acc_diss_integral = 1.;
     class_call(noninjection_rate_acoustic_diss(pni,
                                                z_coarse,
-                                               &dEdt),
+                                               &(factor_coarse[index_z])),
                pni->error_message,
                pni->error_message);
-    pni->noninjection_table[index_z]+=dEdt;
   }
 
+  class_call(noninjection_acoustic_diss_table(pni,
+                                              kD_coarse,
+                                              integral_coarse),
+             pni->error_message,
+             pni->error_message);
+
+  for(index_z=0; index_z<pni->z_size_coarse; ++index_z){
+    pni->noninjection_table[index_z] += factor_coarse[index_z]*integral_coarse[index_z];
+  }
+
+  free(kD_coarse);
+  free(factor_coarse);
+  free(integral_coarse);
+
   /** - Spline coarse z table in view of interpolation */
   class_call(array_spline_table_columns2(pni->z_table_coarse,
                                          pni->z_size_coarse,
@@ -266,7 +315,7 @@ int noninjection_free(struct noninjection* pni){
   free(pni->noninjection_table);
   free(pni->ddnoninjection_table);
 
-  free(pni->integrand_approx);
+  free(pni->k_kernel);
 
   return _SUCCESS_;
 }
@@ -323,7 +372,10 @@ int noninjection_rate_adiabatic_cooling(struct noninjection * pni,
 
 
 /**
- * Calculate heating from dissipation of acoustic waves.
+ * Calculate heating from dissipation of acoustic waves, in the WKB
+ * approximation, given the integral over k computed by
+ * noninjection_acoustic_diss_integral() for the current damping scale
+ * and stored in pni->acc_diss_integral.
  *
  * @param pni            Input: pointer to noninjection structure
  * @param z              Input: redshift
@@ -335,37 +387,139 @@ int noninjection_rate_acoustic_diss(struct noninjection * pni,
                                     double * energy_rate){
 
   /** Define local variables */
-  int index_k;
   double dQrho_dz;
-  double A_wkb;
 
   /** a) Calculate full function */
   // CURRENTLY NOT YET IMPLEMENTED
 
   /** b) Calculate approximated function */
-  if (_TRUE_){
+  dQrho_dz = 4.*pni->A_wkb*pni->A_wkb*pni->acc_diss_integral*pni->dkD_dz;
+
+  *energy_rate = dQrho_dz*pni->H*pni->rho_g/pni->a;                                                 // [J/(m^3 s)]
+
+  return _SUCCESS_;
+}
+
+/**
+ * Integral over k of k P(k) exp(-2 (k/kD)^2) for the dissipation of
+ * acoustic waves, for a given damping scale kD. It only reads the
+ * table pni->k_kernel, and can be called by several threads at once.
+ *
+ * @param pni       Input: pointer to noninjection structure
+ * @param kD        Input: damping scale [1/Mpc]
+ * @param integral  Output: integral
+ * @return the error status
+ */
+int noninjection_acoustic_diss_integral(struct noninjection * pni,
+                                        double kD,
+                                        double * integral){
 
-    A_wkb = 1./(1.+4./15.*pni->f_nu_wkb);
+  int index_k;
+  double minus_two_over_kD2 = -2./(kD*kD);
+  double sum = 0.;
+
+  for (index_k=0; index_k<pni->k_size; index_k++) {
+    sum += pni->k_kernel[index_k]*exp(minus_two_over_kD2*pni->k[index_k]*pni->k[index_k]);
+  }
+
+  *integral = sum;
+
+  return _SUCCESS_;
+}
 
-    /* Define integrand for approximated function */
-    for (index_k=0; index_k<pni->k_size; index_k++) {
-      pni->integrand_approx[index_k] = 4.*A_wkb*A_wkb*pow(pni->k[index_k],1.)*
-                              pni->pk_primordial_k[index_k]*
-                              exp(-2.*pow(pni->k[index_k]/pni->kD,2.))*
-                              pni->dkD_dz;
+/**
+ * Integrals of noninjection_acoustic_diss_integral() for the damping
+ * scales at all coarse redshifts. The redshifts are distributed among
+ * threads. If pni->use_cache is _TRUE_ and the previous run had the
+ * same wavenumbers, primordial spectrum and damping scales (as for
+ * instance when only late-time or non-linear parameters vary), its
+ * integrals are taken instead.
+ *
+ * @param pni       Input: pointer to noninjection structure
+ * @param kD        Input: damping scale at each coarse redshift [1/Mpc]
+ * @param integral  Output: integral at each coarse redshift (already allocated)
+ * @return the error status
+ */
+int noninjection_acoustic_diss_table(struct noninjection * pni,
+                                     double * kD,
+                                     double * integral){
+
+  int index_z;
+  int abort;
+  short found = _FALSE_;
+  unsigned long long key = 14695981039346656037ULL;
+
+  /** - Look for the integrals of the previous run */
+  if (pni->use_cache == _TRUE_) {
+    thermodynamics_recombination_cache_hash(&(pni->k_size),sizeof(pni->k_size),&key);
+    thermodynamics_recombination_cache_hash(pni->k,pni->k_size*sizeof(double),&key);
+    thermodynamics_recombination_cache_hash(pni->k_kernel,pni->k_size*sizeof(double),&key);
+    thermodynamics_recombination_cache_hash(&(pni->z_size_coarse),sizeof(pni->z_size_coarse),&key);
+    thermodynamics_recombination_cache_hash(kD,pni->z_size_coarse*sizeof(double),&key);
+
+#pragma omp critical (noninjection_cache)
+    {
+      if ((noninjection_cache_used == _TRUE_) &&
+          (noninjection_cache_key_value == key) &&
+          (noninjection_cache_z_size == pni->z_size_coarse)) {
+        memcpy(integral,noninjection_cache_integral,pni->z_size_coarse*sizeof(double));
+        found = _TRUE_;
+      }
     }
+    if (found == _TRUE_)
+      return _SUCCESS_;
+  }
 
-    class_call(array_trapezoidal_integral(pni->integrand_approx,
-                                          pni->k_size,
-                                          pni->k_weights,
-                                          &dQrho_dz,
-                                          pni->error_message),
-               pni->error_message,
-               pni->error_message);
+  /** - Otherwise compute them */
+  abort = _FALSE_;
 
+#pragma omp parallel for schedule(static)
+  for (index_z=0; index_z<pni->z_size_coarse; index_z++) {
+    class_call_parallel(noninjection_acoustic_diss_integral(pni,
+                                                            kD[index_z],
+                                                            &(integral[index_z])),
+                        pni->error_message,
+                        pni->error_message);
   }
 
-  *energy_rate = dQrho_dz*pni->H*pni->rho_g/pni->a;                                                 // [J/(m^3 s)]
+  if (abort == _TRUE_)
+    return _FAILURE_;
+
+  /** - Keep them for the next run */
+  if (pni->use_cache == _TRUE_) {
+#pragma omp critical (noninjection_cache)
+    {
+      if (pni->z_size_coarse != noninjection_cache_z_size) {
+        free(noninjection_cache_integral);
+        noninjection_cache_integral = malloc(pni->z_size_coarse*sizeof(double));
+        noninjection_cache_z_size = (noninjection_cache_integral == NULL) ? 0 : pni->z_size_coarse;
+        noninjection_cache_used = _FALSE_;
+      }
+      if (noninjection_cache_integral != NULL) {
+        memcpy(noninjection_cache_integral,integral,pni->z_size_coarse*sizeof(double));
+        noninjection_cache_key_value = key;
+        noninjection_cache_used = _TRUE_;
+      }
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the integrals kept by noninjection_acoustic_diss_table().
+ *
+ * @return the error status
+ */
+int noninjection_cache_clear(){
+
+#pragma omp critical (noninjection_cache)
+  {
+    free(noninjection_cache_integral);
+    noninjection_cache_integral = NULL;
+    noninjection_cache_z_size = 0;
+    noninjection_cache_used = _FALSE_;
+  }
 
   return _SUCCESS_;
 }
@@ -17,7 +17,8 @@ struct noninjection{
   double* pk_primordial_k;
 
   /* Array related to WKB approximation for diss. of acc. waves */
-  double* integrand_approx;
+  double* k_kernel;           /* k P(k) times the trapezoidal weight of each wavenumber */
+  short use_cache;            /* reuse the integrals over k of the previous run (see noninjection_acoustic_diss_table()) */
 
   /* Arrays related to redshift */
   double* z_table_coarse;
@@ -33,6 +34,8 @@ struct noninjection{
   /* Temporary quantities */
   // WKB approximation quantities
   double f_nu_wkb;
+  double A_wkb;
+  double acc_diss_integral;
   double dkD_dz;
   double kD;
   // Fixed thermodynamic quantities
@@ -105,6 +108,16 @@ extern "C" {
                                       double z,
                                       double * energy_rate);
 
+  int noninjection_acoustic_diss_integral(struct noninjection * pni,
+                                          double kD,
+                                          double * integral);
+
+  int noninjection_acoustic_diss_table(struct noninjection * pni,
+                                       double * kD,
+                                       double * integral);
+
+  int noninjection_cache_clear();
+
   int noninjection_output_titles(struct noninjection * pni, char* titles);
 
   int noninjection_output_data(struct noninjection * pni,
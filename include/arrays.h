@@ -10,6 +10,30 @@
 #define _SPLINE_NATURAL_ 0 /**< natural spline: ddy0=ddyn=0 */
 #define _SPLINE_EST_DERIV_ 1 /**< spline with estimation of first derivative on both edges */
 #define array_spline_eval(y,ddy,inf,sup,h,a,b) ((a)*(y)[inf]+(b)*(y)[sup] + (((a)*(a)*(a)-(a))* (ddy)[inf] + ((b)*(b)*(b)-(b))* (ddy)[sup])*(h)*(h)/6.)
+#define _SPLINE_BLOCK_SIZE_ 32 /**< number of columns splined together by array_spline_table_block() */
+#define _SPLINE_PARALLEL_MIN_SIZE_ 100000 /**< minimum number of table elements for splining columns in parallel */
+
+/**
+ * Coefficients of the cubic spline equations which depend only on the
+ * sampling x, shared by all columns of a table (see
+ * array_spline_coefficients_init())
+ */
+
+struct spline_coefficients {
+  int x_size;                  /**< number of sampled values */
+  short spline_mode;           /**< _SPLINE_NATURAL_ or _SPLINE_EST_DERIV_ */
+  double * sig;                /**< sig[i] = (x[i]-x[i-1])/(x[i+1]-x[i-1]) */
+  double * w;                  /**< factors of the backward sweep, ddy[i] = w[i]*ddy[i+1]+u[i] */
+  double * inv_p;              /**< inverse pivots of the forward sweep */
+  double * inv_dx;             /**< inv_dx[i] = 1/(x[i+1]-x[i]) */
+  double * six_over_dx2;       /**< six_over_dx2[i] = 6/(x[i+1]-x[i-1]) */
+  double first_a1;             /**< weights of the first derivative estimated at x[0] */
+  double first_a2;
+  double last_a1;              /**< weights of the first derivative estimated at x[x_size-1] */
+  double last_a2;
+  double qn;                   /**< coefficient of the last equation */
+  double last_inv_denominator; /**< inverse pivot of the last equation */
+};
 
 /**
  * Boilerplate for C++
@@ -98,6 +122,40 @@ extern "C" {
 				      short spline_mode,
 				      ErrorMsg errmsg);
 
+  int array_spline_coefficients_init(
+                                     double * x,
+                                     int x_size,
+                                     short spline_mode,
+                                     struct spline_coefficients * psc,
+                                     ErrorMsg errmsg
+                                     );
+
+  int array_spline_coefficients_free(
+                                     struct spline_coefficients * psc
+                                     );
+
+  int array_spline_table_block(
+                               struct spline_coefficients * psc,
+                               double * y_array,
+                               double * ddy_array,
+                               int x_stride,
+                               int y_stride,
+                               int index_y_min,
+                               int index_y_max
+                               );
+
+  int array_spline_table_strided(
+                                 double * x,
+                                 int x_size,
+                                 double * y_array,
+                                 int y_size,
+                                 double * ddy_array,
+                                 int x_stride,
+                                 int y_stride,
+                                 short spline_mode,
+                                 ErrorMsg errmsg
+                                 );
+
   int array_spline_table_columns(
 		       double * x,
 		       int x_size,
@@ -193,6 +251,24 @@ int array_integrate_all_trapzd_or_spline(
 		   double * result,
 		   ErrorMsg errmsg);
 
+  int array_integrate_all_trapzd_or_spline_weights(
+                                                   double * x,
+                                                   int n_lines,
+                                                   int index_start_spline,
+                                                   double * w,
+                                                   ErrorMsg errmsg);
+
+  int array_weighted_product(
+                             double * a,
+                             double * b,
+                             double * w,
+                             int m,
+                             int n,
+                             short symmetric,
+                             double * aw,
+                             double * c,
+                             ErrorMsg errmsg);
+
   int array_integrate_spline_table_line_to_line(
 						double * x_array,
 						int n_lines,
@@ -337,6 +413,28 @@ int array_integrate_all_trapzd_or_spline(
                         double* b,
                         ErrorMsg errmsg);
 
+  int array_spline_hunt_vec(
+                            double * x_array,
+                            int x_size,
+                            double * x_vec,
+                            int x_vec_size,
+                            int * index_vec,
+                            double * b_vec,
+                            ErrorMsg errmsg
+                            );
+
+  int array_interpolate_spline_vec(
+                                   double * x_array,
+                                   double * y_array,
+                                   double * ddy_array,
+                                   int y_size,
+                                   int index_y,
+                                   int x_vec_size,
+                                   int * index_vec,
+                                   double * b_vec,
+                                   double * result
+                                   );
+
   int array_interpolate_two(
 			    double * array_x,
 			    int n_columns_x,
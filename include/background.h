@@ -16,7 +16,7 @@ enum spatial_curvature {flat,open,closed};
 
 /** list of possible parametrisations of the DE equation of state */
 
-enum equation_of_state {CLP,EDE};
+enum equation_of_state {CLP,EDE,CARDASSIAN};
 
 /** list of formats for the vector of background quantities */
 
@@ -83,6 +83,7 @@ struct background
   /* the following parameters help to define the analytical ncdm phase space distributions (p-s-d) */
   double * ncdm_psd_parameters;          /**< list of parameters for specifying/modifying ncdm p.s.d.'s, to be customized for given model
                                               (could be e.g. mixing angles) */
+  int ncdm_psd_parameters_size;          /**< number of entries in ncdm_psd_parameters */
   double * M_ncdm;                       /**< vector of masses of non-cold relic: dimensionless ratios m_ncdm/T_ncdm */
   double * m_ncdm_in_eV;                 /**< list of ncdm masses in eV (inferred from M_ncdm and other parameters above) */
   double * Omega0_ncdm, Omega0_ncdm_tot; /**< Omega0_ncdm for each species and for the total Omega0_ncdm */
@@ -110,6 +111,8 @@ struct background
   double cs2_fld;  /**< \f$ c^2_{s~DE} \f$: sound speed of the fluid in the frame comoving with the fluid (so, this is
                         not [delta p/delta rho] in the synchronous or newtonian gauge!) */
   double Omega_EDE;        /**< \f$ wa_{DE} \f$: Early Dark Energy density parameter */
+  double cardassian_q;     /**< \f$ q \f$ of the modified polytropic Cardassian expansion, \f$ H^2 \propto \rho_m [1+(\rho_m/\rho_{card})^{q(n-1)}]^{1/q} \f$ */
+  double cardassian_n;     /**< \f$ n \f$ of the Cardassian expansion (\f$ q=1 \f$: power law \f$ H^2 = A \rho_m + B \rho_m^n \f$) */
   double * scf_parameters; /**< list of parameters describing the scalar field potential */
   short attractor_ic_scf;  /**< whether the scalar field has attractor initial conditions */
   int scf_tuning_index;    /**< index in scf_parameters used for tuning */
@@ -138,6 +141,7 @@ struct background
   double H_eq;      /**< Hubble rate at radiation/matter equality [Mpc^-1] */
   double z_eq;      /**< redshift at radiation/matter equality */
   double tau_eq;    /**< conformal time at radiation/matter equality [Mpc] */
+  double cardassian_x0; /**< \f$ (\rho_m/\rho_{card})^{q(n-1)} \f$ today in the Cardassian case, fixed by Omega0_fld */
 
   //@}
 
@@ -277,6 +281,7 @@ struct background
   short has_ncdm;      /**< presence of non-cold dark matter? */
   short has_lambda;    /**< presence of cosmological constant? */
   short has_fld;       /**< presence of fluid with constant w and cs2? */
+  short has_fld_ode;   /**< is rho_fld integrated by background_solve()? (otherwise it is given in closed form by background_w_fld()) */
   short has_ur;        /**< presence of ultra-relativistic neutrinos/relics? */
   short has_idr;       /**< presence of interacting dark radiation? */
   short has_curvature; /**< presence of global spatial curvature? */
@@ -300,6 +305,14 @@ struct background
   int * q_size_ncdm;    /**< Size of the q_ncdm arrays */
   double * factor_ncdm; /**< List of normalization factors for calculating energy density etc.*/
 
+  short ncdm_bg_tabulated;      /**< _TRUE_ if background_functions() interpolates the tables below instead of calling background_ncdm_momenta() */
+  int * ncdm_bg_table_size;     /**< for each species, number of values of ln(y) in the table, with y=M_ncdm/(1+z)=m/T */
+  double ncdm_bg_table_lny_min; /**< first value of ln(y) in the tables (common to all species) */
+  double ncdm_bg_table_dlny;    /**< step in ln(y) in the tables */
+  double ** ncdm_bg_table;      /**< for each species, ln of the momentum integrals of (rho, p, pseudo_p), without the factor_ncdm*(1+z)^4 normalization, as ncdm_bg_table[n_ncdm][index_y*3+index] */
+  double ** ncdm_bg_dd_table;   /**< for each species, second derivatives of ncdm_bg_table with respect to ln(y) */
+  double ** ncdm_bg_small_y;    /**< for each species, sums of q^3 w and q w giving the expansion of the integrals to order y^2 below the table */
+
   //@}
 
   /** @name - technical parameters */
@@ -307,6 +320,7 @@ struct background
   //@{
 
   short shooting_failed;  /**< flag is set to true if shooting failed. */
+  short is_from_shooting; /**< flag set by input_shooting() when this structure was computed at the converged step of the shooting: background_init() then has nothing left to compute */
   ErrorMsg shooting_error; /**< Error message from shooting failed. */
 
   short background_verbose; /**< flag regulating the amount of information sent to standard output (none if set to zero) */
@@ -354,6 +368,26 @@ struct background_parameters_for_distributions {
 
 };
 
+/**
+ * momentum quadrature of one ncdm species, kept in memory by
+ * background_ncdm_init() for later runs with the same distribution
+ * function and tolerances
+ */
+
+struct background_ncdm_quadrature {
+
+  unsigned long long key; /**< key computed by background_ncdm_quadrature_key() */
+
+  int q_size;             /**< number of momenta for perturbations */
+  double * q;             /**< momenta for perturbations */
+  double * w;             /**< weights for perturbations */
+
+  int q_size_bg;          /**< number of momenta for background */
+  double * q_bg;          /**< momenta for background */
+  double * w_bg;          /**< weights for background */
+
+};
+
 /**************************************************************/
 /* @cond INCLUDE_WITH_DOXYGEN */
 /*
@@ -381,6 +415,34 @@ extern "C" {
                         double * pvecback
                         );
 
+  int background_tau_interval(
+                              struct background *pba,
+                              double tau,
+                              int * last_index,
+                              double * h,
+                              double * a,
+                              double * b
+                              );
+
+  int background_at_tau_columns(
+                                struct background *pba,
+                                double tau,
+                                int * columns,
+                                int columns_size,
+                                int * last_index,
+                                double * pvecback
+                                );
+
+  int background_at_tau_vec(
+                            struct background *pba,
+                            double * tau_vec,
+                            int tau_size,
+                            int * columns,
+                            int columns_size,
+                            int * last_index,
+                            double * pvecback_vec
+                            );
+
   int background_tau_of_z(
                           struct background *pba,
                           double z,
@@ -446,6 +508,28 @@ extern "C" {
                            struct background *pba
                            );
 
+  int background_ncdm_quadrature_key(
+                                     struct precision *ppr,
+                                     struct background *pba,
+                                     struct background_parameters_for_distributions *pbadist,
+                                     unsigned long long * key
+                                     );
+
+  int background_ncdm_quadrature_fetch(
+                                       unsigned long long key,
+                                       struct background *pba,
+                                       int n_ncdm,
+                                       short * found
+                                       );
+
+  int background_ncdm_quadrature_store(
+                                       unsigned long long key,
+                                       struct background *pba,
+                                       int n_ncdm
+                                       );
+
+  int background_ncdm_quadrature_clear();
+
   int background_ncdm_momenta(
                              double * qvec,
                              double * wvec,
@@ -460,6 +544,24 @@ extern "C" {
                              double * pseudo_p
                              );
 
+  int background_ncdm_table_init(
+                                 struct precision *ppr,
+                                 struct background *pba
+                                 );
+
+  int background_ncdm_table_free(
+                                 struct background *pba
+                                 );
+
+  int background_ncdm_momenta_tabulated(
+                                        struct background *pba,
+                                        int n_ncdm,
+                                        double z,
+                                        double * rho,
+                                        double * p,
+                                        double * pseudo_p
+                                        );
+
   int background_ncdm_M_from_Omega(
                                    struct precision *ppr,
                                    struct background *pba,
@@ -476,6 +578,26 @@ extern "C" {
                        struct background *pba
                        );
 
+  int background_solve_quadrature(
+                                  struct precision *ppr,
+                                  struct background *pba,
+                                  double * pvecback_integration
+                                  );
+
+  int background_closed_form(
+                             struct background *pba,
+                             double a,
+                             double * H,
+                             double * rho_g,
+                             double * rho_b,
+                             double * rho_M
+                             );
+
+  int background_table_thin(
+                            struct precision *ppr,
+                            struct background *pba
+                            );
+
   int background_initial_conditions(
                                     struct precision *ppr,
                                     struct background *pba,
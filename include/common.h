@@ -8,6 +8,10 @@
 #include "svnversion.h"
 #include <stdarg.h>
 
+#ifdef _MPI
+#include "mpi.h"
+#endif
+
 #ifdef _OPENMP
 #include "omp.h"
 #endif
@@ -25,6 +29,12 @@
 #define _SUCCESS_ 0 /**< integer returned after successful call of a function */
 #define _FAILURE_ 1 /**< integer returned after failure in a function */
 
+#ifdef __GNUC__
+#define _FORCE_INLINE_ inline __attribute__((always_inline)) /**< for functions that must be inlined, so that their constant arguments propagate into their body */
+#else
+#define _FORCE_INLINE_ inline
+#endif
+
 #define _ERRORMSGSIZE_ 2048 /**< generic error messages are cut beyond this number of characters */
 typedef char ErrorMsg[_ERRORMSGSIZE_]; /**< Generic error messages (there is such a field in each structure) */
 
@@ -51,6 +61,8 @@ typedef char FileName[_FILENAMESIZE_];
 
 #define _QUADRATURE_MAX_BG_ 800 /**< maximum allowed number of abssices in quadrature integral estimation */
 
+#define _NCDM_QUADRATURE_CACHE_MAX_ 16 /**< maximum number of ncdm momentum quadratures kept in memory for later runs */
+
 #define _TOLVAR_ 100. /**< The minimum allowed variation is the machine precision times this number */
 
 #define _HUGE_ 1.e99
@@ -77,6 +89,10 @@ typedef char FileName[_FILENAMESIZE_];
 
 /* @endcond */
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* needed because of weird openmp bug on macosx lion... */
 
 void class_protect_sprintf(char* dest, char* tpl,...);
@@ -91,6 +107,151 @@ int compare_doubles(const void * a,
                     const void * b);
 int string_begins_with(char* thestring, char beginchar);
 
+/* distribution of work over MPI processes (trivial when compiled without -D_MPI) */
+
+int class_mpi_rank_and_size(int * rank, int * size);
+int class_mpi_allreduce_sum(double * array, size_t size, ErrorMsg error_message);
+int class_mpi_allreduce_sum_float(float * array, size_t size, ErrorMsg error_message);
+int class_mpi_synchronize_abort(int * abort, ErrorMsg error_message);
+
+/* number of threads of the runs performed by the calling thread (trivial when compiled without OpenMP) */
+
+int class_threads_set(int num_threads);
+
+/* placement of large tables on the NUMA nodes of the threads filling them (see tools/common.c) */
+
+#define _FIRST_TOUCH_PAGE_ 4096 /**< size of the memory pages dealt to the threads by class_first_touch() */
+#define _FIRST_TOUCH_MIN_ 1048576 /**< smaller arrays are initialised by the calling thread only */
+
+int class_first_touch(void * pointer, size_t size);
+
+/* profile of a run: time, threads and memory of each stage (see tools/common.c) */
+
+enum profile_stage {
+  profile_input,
+  profile_background,
+  profile_thermodynamics,
+  profile_perturbations,
+  profile_primordial,
+  profile_fourier,
+  profile_transfer,
+  profile_harmonic,
+  profile_lensing,
+  profile_distortions,
+  profile_output,
+  _PROFILE_STAGES_ /**< number of stages */
+};
+
+extern const char * profile_stage_name[_PROFILE_STAGES_];
+
+struct profile {
+  short has_stage[_PROFILE_STAGES_]; /**< whether the stage ran since the last profile_init() */
+  double wall[_PROFILE_STAGES_];     /**< wall-clock time of the stage, in s */
+  double cpu[_PROFILE_STAGES_];      /**< CPU time of the process during the stage (all threads), in s */
+  int threads[_PROFILE_STAGES_];     /**< number of threads of the parallel regions of the stage */
+  double bytes[_PROFILE_STAGES_];    /**< bytes requested from class_alloc(), class_calloc() and class_realloc() during the stage */
+  double peak_rss[_PROFILE_STAGES_]; /**< highest resident memory of the process so far at the end of the stage, in bytes */
+  double start_wall, start_cpu, start_bytes; /**< values at the start of the current stage */
+};
+
+void profile_init(struct profile * pprof);
+void profile_start(struct profile * pprof, enum profile_stage stage);
+void profile_stop(struct profile * pprof, enum profile_stage stage);
+void profile_print(struct profile * pprof);
+void class_alloc_count(size_t size);
+
+/* optional tracking of the memory allocated by CLASS (compile with -D_MEMORY_TRACKING, see tools/common.c) */
+
+#ifdef _MEMORY_TRACKING
+void * class_memory_malloc(size_t size, const char * file, int line);
+void * class_memory_calloc(size_t number, size_t size, const char * file, int line);
+void * class_memory_realloc(void * pointer, size_t size, const char * file, int line);
+void class_memory_free(void * pointer);
+void class_memory_check(const char * file, const char * function);
+void class_memory_print();
+#endif
+
+/* optional tracing of the work items of the parallel loops (compile with -D_TRACE, see tools/common.c) */
+
+#ifdef _TRACE
+double class_trace_time();
+void class_trace_event(const char * module, const char * task, int index, double start);
+int class_trace_write(char * filename, ErrorMsg error_message);
+#endif
+
+/* optional hardware counters of the main kernels (compile with -D_COUNTERS, see tools/common.c) */
+
+enum counter_kernel {
+  counter_perturbations_derivs,    /**< perturbations_derivs() */
+  counter_ndf15_linear_algebra,    /**< LU decompositions and solves of evolver_ndf15 */
+  counter_transfer_integrate,      /**< transfer_integrate() */
+  counter_harmonic_compute_cl,     /**< harmonic_compute_cl() */
+  counter_lensing_d,               /**< recurrences of the Wigner d-functions of the lensing module */
+  counter_hyperspherical,          /**< recurrences of the hyperspherical Bessel functions */
+  _COUNTER_KERNELS_                /**< number of kernels */
+};
+
+#ifdef _COUNTERS
+void class_counters_start(enum counter_kernel kernel);
+void class_counters_stop(enum counter_kernel kernel);
+void class_counters_reset();
+void class_counters_print();
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+/* with -D_MEMORY_TRACKING, all allocations of the C files including
+   this header (in particular those of class_alloc(), class_calloc(),
+   class_realloc() and class_alloc_parallel()) are recorded with their
+   file and line, class_memory_leaks() reports at the end of a *_free()
+   function the memory of its file still in use, and
+   class_memory_report() prints the usage of each file and call site.
+   Without it, these two macros do nothing and malloc() is called
+   directly. */
+
+#ifdef _MEMORY_TRACKING
+#ifndef __cplusplus
+#define malloc(size) class_memory_malloc(size,__FILE__,__LINE__)
+#define calloc(number,size) class_memory_calloc(number,size,__FILE__,__LINE__)
+#define realloc(pointer,size) class_memory_realloc(pointer,size,__FILE__,__LINE__)
+#define free(pointer) class_memory_free(pointer)
+#endif
+#define class_memory_leaks() class_memory_check(__FILE__,__func__)
+#define class_memory_report() class_memory_print()
+#else
+#define class_memory_leaks()
+#define class_memory_report()
+#endif
+
+/* with -D_TRACE, class_trace_begin() and class_trace_end() around the
+   body of a parallel loop record one event per work item (thread,
+   start, duration, module and index of the item), written by
+   class_trace_write() in the Chrome trace format. Without it, they do
+   nothing. class_trace_begin() declares a variable: one pair per block. */
+
+#ifdef _TRACE
+#define class_trace_begin() double class_trace_start = class_trace_time()
+#define class_trace_end(module,task,index) class_trace_event(module,task,index,class_trace_start)
+#else
+#define class_trace_begin()
+#define class_trace_end(module,task,index)
+#endif
+
+/* with -D_COUNTERS, class_counters_begin() and class_counters_end()
+   around a kernel add the hardware events (cycles, instructions, cache
+   misses, ...) of the calling thread during the kernel to its totals,
+   printed by profile_print(). Without it, they do nothing. */
+
+#ifdef _COUNTERS
+#define class_counters_begin(kernel) class_counters_start(kernel)
+#define class_counters_end(kernel) class_counters_stop(kernel)
+#else
+#define class_counters_begin(kernel)
+#define class_counters_end(kernel)
+#endif
+
 /* general CLASS macros */
 
 #define class_build_error_string(dest,tmpl,...) {                                                                \
@@ -152,6 +313,7 @@ int string_begins_with(char* thestring, char beginchar);
     class_alloc_message(error_message_output,#pointer, size_int);                                                \
     return _FAILURE_;                                                                                            \
   }                                                                                                              \
+  class_alloc_count(size);                                                                                       \
 }
 
 /* same inside parallel structure */
@@ -165,9 +327,23 @@ int string_begins_with(char* thestring, char beginchar);
       class_alloc_message(error_message_output,#pointer, size_int);                                              \
       abort=_TRUE_;                                                                                              \
     }                                                                                                            \
+    else                                                                                                         \
+      class_alloc_count(size);                                                                                   \
   }                                                                                                              \
 }
 
+/* same for the large tables filled by parallel loops: with -D_NUMA,
+   their pages are interleaved over the NUMA nodes of the threads by
+   class_first_touch(); otherwise this is class_alloc() */
+#ifdef _NUMA
+#define class_alloc_first_touch(pointer, size, error_message_output)  {                                          \
+  class_alloc(pointer, size, error_message_output);                                                              \
+  class_first_touch(pointer,size);                                                                               \
+}
+#else
+#define class_alloc_first_touch(pointer, size, error_message_output) class_alloc(pointer, size, error_message_output)
+#endif
+
 /* macro for allocating memory, initializing it with zeros/ and returning error if it failed */
 #define class_calloc(pointer, init,size, error_message_output)  {                                                \
   pointer=calloc(init,size);                                                                                     \
@@ -177,6 +353,7 @@ int string_begins_with(char* thestring, char beginchar);
     class_alloc_message(error_message_output,#pointer, size_int);                                                \
     return _FAILURE_;                                                                                            \
   }                                                                                                              \
+  class_alloc_count((size_t)(init)*(size));                                                                      \
 }
 
 /* macro for re-allocating memory, returning error if it failed */
@@ -188,6 +365,7 @@ int string_begins_with(char* thestring, char beginchar);
     class_alloc_message(error_message_output,#pointer, size_int);                                                \
     return _FAILURE_;                                                                                            \
   }                                                                                                              \
+  class_alloc_count(size);                                                                                       \
 }
 
 // Testing
@@ -345,7 +523,8 @@ struct output;
  */
 enum evolver_type {
   rk, /* Runge-Kutta integrator */
-  ndf15 /* stiff integrator */
+  ndf15, /* stiff integrator */
+  rosenbrock /* linearly implicit (Rosenbrock-type) stiff integrator */
 };
 
 /**
@@ -22,6 +22,13 @@ struct generic_integrator_workspace
   double * ak6;
   double * ytemp;
 
+  /* solution at the beginning of the current step, and interpolated
+     solution, used by generic_integrator_dense() */
+  double * yold;
+  double * dydxold;
+  double * yinterp;
+  double * dydxinterp;
+
   double stepmin;
 
   /**
@@ -60,6 +67,28 @@ extern "C" {
 			 double hmin,
 			 struct generic_integrator_workspace * pgi);
 
+  int generic_integrator_dense(int (*derivs)(double x,
+					     double y[],
+					     double yprime[],
+					     void * parameters_and_workspace,
+					     ErrorMsg error_message),
+			       double x1,
+			       double x2,
+			       double ystart[],
+			       void * parameters_and_workspace_for_derivs,
+			       double eps,
+			       double hmin,
+			       double * x_sampling,
+			       int x_size,
+			       int * next_index_x,
+			       int (*output)(double x,
+					     double y[],
+					     double dy[],
+					     int index_x,
+					     void * parameters_and_workspace,
+					     ErrorMsg error_message),
+			       struct generic_integrator_workspace * pgi);
+
   int rkqs(double *x,
 	   double htry,
 	   double eps,
@@ -17,6 +17,12 @@
 typedef char DetectorName[_MAX_DETECTOR_NAME_LENGTH_];
 typedef char DetectorFileName[_FILENAMESIZE_+_MAX_DETECTOR_NAME_LENGTH_+256];
 
+/* kinds of detector data shared between runs by distortions_acquire_data() */
+#define _SD_DATA_BR_ 0       /**< branching ratios */
+#define _SD_DATA_SD_ 1       /**< spectral shapes */
+#define _SD_DATA_KINDS_ 2
+#define _SD_DATA_ARRAYS_ 9   /**< arrays of each kind: grid, three columns, PCA vectors, and second derivatives of the last four */
+
 /** List of possible branching ratio approximations */
 
 enum br_approx {bra_sharp_sharp,bra_sharp_soft,bra_soft_soft,bra_soft_soft_cons,bra_exact};
@@ -151,6 +157,9 @@ struct distortions
   double * ddS_vec;                          /**< second derivative of the above ddS_vec[index_s*S_vec_size+index_x] */
   int S_vec_size;                            /**< number of PCA component S spectral shapes */
 
+  short has_shared_br_data;                  /**< do the branching ratios above point to the data shared between runs? */
+  short has_shared_sd_data;                  /**< do the spectral shapes above point to the data shared between runs? */
+
 
   double * delta_Ic_array;                   /**< delta_Ic[index_x] for detectors with given sensitivity in each bin */
 
@@ -280,6 +289,41 @@ extern "C" {
                                       int * index);
   int distortions_free_sd_data(struct distortions * psd);
 
+  /* Branching ratios and spectral shapes shared between runs */
+  int distortions_data_arrays(struct distortions * psd,
+                              int kind,
+                              double ** arrays[_SD_DATA_ARRAYS_],
+                              int ** size,
+                              int ** vec_size,
+                              short ** shared);
+  int distortions_data_point(struct distortions * psd,
+                             int kind,
+                             double * block,
+                             int size,
+                             int vec_size);
+  int distortions_data_write(char * filename,
+                             int kind);
+  int distortions_data_map_file(char * filename,
+                                int kind,
+                                short * found,
+                                ErrorMsg errmsg);
+  int distortions_data_load(struct precision * ppr,
+                            struct distortions * psd,
+                            int kind,
+                            char * bin_file);
+  int distortions_data_free(int kind);
+  int distortions_acquire_data(struct precision * ppr,
+                               struct distortions * psd,
+                               int kind);
+  int distortions_release_data(struct distortions * psd,
+                               int kind);
+  int distortions_projection_load(struct distortions * psd,
+                                  int kind,
+                                  short * found);
+  int distortions_projection_store(struct distortions * psd,
+                                   int kind);
+  int distortions_data_clear();
+
   /* Output */
   int distortions_output_heat_titles(struct distortions * psd, char titles[_MAXTITLESTRINGLENGTH_]);
   int distortions_output_heat_data(struct distortions * psd,
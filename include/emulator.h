@@ -0,0 +1,178 @@
+/**
+ * definitions for module emulator.c
+ */
+
+#ifndef __EMULATOR__
+#define __EMULATOR__
+
+#include "common.h"
+#include "parser.h"
+
+/**
+ * lensed C_l types that can be emulated, in the order in which they
+ * are stored in the output vector
+ */
+
+enum emulator_cl_types {emulator_tt, emulator_ee, emulator_te, emulator_bb, emulator_pp};
+
+#define _EMULATOR_CL_TYPES_ 5 /**< number of types in enum emulator_cl_types */
+
+/**
+ * Polynomial emulator of the lensed C_l's and of P(k,z), fitted by
+ * least squares on a set of runs of the code (see
+ * test/test_emulator.c).
+ *
+ * The cosmological parameters are rescaled to [-1,1] across the
+ * training box, and each output is a polynomial of total degree
+ * 'degree' in these rescaled parameters. The outputs are ln(C_l) for
+ * tt, ee, bb, pp, the correlation coefficient
+ * C_l^te/sqrt(C_l^tt C_l^ee) for te, and ln(P(k,z)) on a grid of
+ * (k,z).
+ */
+
+struct emulator {
+
+  /** @name - parameters of the training box */
+
+  //@{
+
+  int par_size;         /**< number of emulated parameters */
+  FileArg * par_name;   /**< par_name[index_par] = name of the input parameter */
+  double * par_min;     /**< lower edge of the box */
+  double * par_max;     /**< upper edge of the box */
+
+  int fixed_size;       /**< number of input parameters held fixed during the training */
+  FileArg * fixed_name; /**< their names */
+  FileArg * fixed_value;/**< and their values */
+
+  //@}
+
+  /** @name - polynomial basis */
+
+  //@{
+
+  int degree;           /**< maximum total degree of the polynomials */
+  int basis_size;       /**< number of monomials */
+  int * exponent;       /**< exponent[index_basis*par_size+index_par] = power of parameter index_par in monomial index_basis */
+
+  //@}
+
+  /** @name - layout of the emulated outputs */
+
+  //@{
+
+  short has_cl[_EMULATOR_CL_TYPES_]; /**< which lensed C_l types are emulated */
+  int index_cl[_EMULATOR_CL_TYPES_]; /**< position of the first multipole (l=2) of each of them in the output vector */
+  int l_max;            /**< largest multipole */
+
+  int k_size;           /**< number of wavenumbers of the P(k,z) grid (0 if P(k,z) is not emulated) */
+  double * ln_k;        /**< ln(k) of the grid, k in 1/Mpc */
+  int z_size;           /**< number of redshifts of the P(k,z) grid */
+  double * z;           /**< redshifts of the grid */
+  short pk_nonlinear;   /**< _TRUE_ if the emulated P(k,z) is the non-linear one */
+  int index_pk;         /**< position of ln(P(k,z)) in the output vector, as [index_pk+index_z*k_size+index_k] */
+
+  int out_size;         /**< size of the output vector */
+
+  //@}
+
+  /** @name - fit and error model */
+
+  //@{
+
+  double * coefficient; /**< coefficient[index_basis*out_size+index_out] */
+  double * error;       /**< error[index_out] = rms residual of each output over the validation runs */
+  double error_cl_max;  /**< largest absolute residual over the validation runs of the ln(C_l)'s and of the te correlation coefficient */
+  double error_pk_max;  /**< largest absolute residual over the validation runs of ln(P(k,z)) */
+
+  //@}
+};
+
+/**
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int emulator_init(
+                    struct emulator * pem,
+                    int par_size,
+                    int degree,
+                    ErrorMsg error_message
+                    );
+
+  int emulator_outputs_init(
+                            struct emulator * pem,
+                            short * has_cl,
+                            int l_max,
+                            int k_size,
+                            double k_min,
+                            double k_max,
+                            int z_size,
+                            double z_max,
+                            short pk_nonlinear,
+                            ErrorMsg error_message
+                            );
+
+  int emulator_train(
+                     struct emulator * pem,
+                     int sample_size,
+                     int validation_size,
+                     double * parameters,
+                     double * outputs,
+                     ErrorMsg error_message
+                     );
+
+  int emulator_evaluate(
+                        struct emulator * pem,
+                        double * parameters,
+                        double * output,
+                        ErrorMsg error_message
+                        );
+
+  int emulator_match(
+                     struct emulator * pem,
+                     struct file_content * pfc,
+                     double * parameters,
+                     short * usable
+                     );
+
+  int emulator_cl_at_l(
+                       struct emulator * pem,
+                       double * output,
+                       int l,
+                       double * cl,
+                       ErrorMsg error_message
+                       );
+
+  int emulator_pk_at_k_and_z(
+                             struct emulator * pem,
+                             double * output,
+                             double k,
+                             double z,
+                             double * pk,
+                             ErrorMsg error_message
+                             );
+
+  int emulator_write(
+                     struct emulator * pem,
+                     char * filename,
+                     ErrorMsg error_message
+                     );
+
+  int emulator_read(
+                    char * filename,
+                    struct emulator * pem,
+                    ErrorMsg error_message
+                    );
+
+  int emulator_free(
+                    struct emulator * pem
+                    );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
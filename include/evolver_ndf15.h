@@ -22,6 +22,7 @@ struct jacobian{
 	int has_grouping;
 	int has_pattern;
 	int new_jacobian; /* True if sp_ludcmp has not been run on the current jacobian. */
+	int has_jacobian; /* True once numjac has filled dfdy (or xjac in the sparse case). */
 	int cnzmax;
 	int *col_group; /* Column grouping. Groups go from 0 to max_group*/
 	int *col_wi; /* Workarray for column grouping*/
@@ -52,6 +53,38 @@ struct numjac_workspace{
 	int * Rowmax;
 };
 
+/**
+ * Optional information that a calling module can pass to
+ * evolver_ndf15_with_options(). Any field left to NULL falls back to
+ * the default behaviour of evolver_ndf15().
+ */
+struct ndf15_options{
+	/** Structural sparsity pattern of the jacobian, in compressed column
+	    format: column j has row indices Ai[Ap[j]] to Ai[Ap[j+1]-1], sorted
+	    in increasing order, always including the diagonal. The pattern
+	    must contain every entry that can be non-zero. When it is provided,
+	    numjac trusts it from the first call and uses column grouping
+	    right away, instead of computing a few dense jacobians first. The
+	    function sets *has_pattern to _FALSE_ if it cannot provide a
+	    pattern with less than max_nonzero entries. */
+	int (*jacobian_pattern)(int neq, int max_nonzero, int * Ap, int * Ai, int * has_pattern,
+				void * parameters_and_workspace, ErrorMsg error_message);
+	/** Jacobian structure kept by the caller between calls with the same
+	    system of equations, initialised with initialize_jacobian() and
+	    freed with uninitialize_jacobian() by the caller. The memory,
+	    sparsity pattern (trusted or still being learned) and column
+	    grouping of the previous call are reused, and the first jacobian
+	    of the call is computed with them. The finite difference
+	    increments start again from their initial value. If NULL, a new
+	    jacobian structure is set up at the beginning of each call. */
+	struct jacobian * jac;
+	/** If not NULL, array of six integers to which the statistics of the
+	    call are added: successful steps, failed steps, function
+	    evaluations, jacobians computed, LU decompositions and linear
+	    solves (in this order, like stepstat in evolver_ndf15.c). */
+	int * stepstat;
+};
+
 /**
  * Boilerplate for C++
  */
@@ -115,6 +148,31 @@ int evolver_ndf15(
 		ErrorMsg error_message),
 	ErrorMsg error_message);
 
+int evolver_ndf15_with_options(
+	int (*derivs)(double x,double * y,double * dy,
+		void * parameters_and_workspace, ErrorMsg error_message),
+	double x_ini,
+	double x_final,
+	double * y_inout,
+ 	int * used_in_output,
+	int neq,
+	void * parameters_and_workspace_for_derivs,
+	double rtol,
+	double minimum_variation,
+	int (*timescale_and_approximation)(double x,
+					   void * parameters_and_workspace,
+					   double * timescales,
+					   ErrorMsg error_message),
+	double timestep_over_timescale,
+	double * t_vec,
+	int t_res,
+	int (*output)(double x,double y[],double dy[],int index_x,void * parameters_and_workspace,
+		ErrorMsg error_message),
+	int (*print_variables)(double x, double y[], double dy[], void *parameters_and_workspace,
+		ErrorMsg error_message),
+	struct ndf15_options * options,
+	ErrorMsg error_message);
+
 
 #ifdef __cplusplus
 }
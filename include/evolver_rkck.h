@@ -3,6 +3,18 @@
 
 #include "dei_rkck.h"
 
+/**
+ * Optional information that a calling module can pass to
+ * evolver_rk_with_options(). A NULL pointer gives the default
+ * behaviour of evolver_rk().
+ */
+struct rk_options{
+	/** If _TRUE_, do not shorten the steps to land on each output
+	    value, but interpolate the solution at the output values with
+	    the cubic Hermite continuous extension of each step. */
+	short dense_output;
+};
+
 /**************************************************************/
 
 /**
@@ -45,6 +57,73 @@ extern "C" {
 					     ErrorMsg error_message),
 		      ErrorMsg error_message);
 
+  int evolver_rk_dense(int (*derivs)(double x,
+				    double * y,
+				    double * dy,
+				    void * parameters_and_workspace,
+				    ErrorMsg error_message),
+		      double x_ini,
+		      double x_end,
+		      double * y,
+		      int * used_in_output,
+		      int y_size,
+		      void * parameters_and_workspace_for_derivs,
+		      double tolerance,
+		      double minimum_variation,
+		      int (*evaluate_timescale)(double x,
+						void * parameters_and_workspace,
+						double * timescale,
+						ErrorMsg error_message),
+		      double timestep_over_timescale,
+		      double * x_sampling,
+		      int x_size,
+		      int (*output)(double x,
+				    double y[],
+				    double dy[],
+				    int index_x,
+				    void * parameters_and_workspace,
+				    ErrorMsg error_message),
+		      int (*print_variables)(double x,
+					     double y[],
+					     double dy[],
+					     void * parameters_and_workspace,
+					     ErrorMsg error_message),
+		      ErrorMsg error_message);
+
+  int evolver_rk_with_options(int (*derivs)(double x,
+				    double * y,
+				    double * dy,
+				    void * parameters_and_workspace,
+				    ErrorMsg error_message),
+		      double x_ini,
+		      double x_end,
+		      double * y,
+		      int * used_in_output,
+		      int y_size,
+		      void * parameters_and_workspace_for_derivs,
+		      double tolerance,
+		      double minimum_variation,
+		      int (*evaluate_timescale)(double x,
+						void * parameters_and_workspace,
+						double * timescale,
+						ErrorMsg error_message),
+		      double timestep_over_timescale,
+		      double * x_sampling,
+		      int x_size,
+		      int (*output)(double x,
+				    double y[],
+				    double dy[],
+				    int index_x,
+				    void * parameters_and_workspace,
+				    ErrorMsg error_message),
+		      int (*print_variables)(double x,
+					     double y[],
+					     double dy[],
+					     void * parameters_and_workspace,
+					     ErrorMsg error_message),
+		      struct rk_options * options,
+		      ErrorMsg error_message);
+
 #ifdef __cplusplus
 }
 #endif
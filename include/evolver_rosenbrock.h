@@ -0,0 +1,71 @@
+#ifndef __EVO_ROSENBROCK__
+#define __EVO_ROSENBROCK__
+#include "common.h"
+#include "evolver_ndf15.h"
+/**************************************************************/
+
+/**
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int linearisation_solve(struct jacobian *jac, double *rhs, double *x, int neq, ErrorMsg error_message);
+
+int evolver_rosenbrock(
+	int (*derivs)(double x,double * y,double * dy,
+		void * parameters_and_workspace, ErrorMsg error_message),
+	double x_ini,
+	double x_final,
+	double * y_inout,
+ 	int * used_in_output,
+	int neq,
+	void * parameters_and_workspace_for_derivs,
+	double rtol,
+	double minimum_variation,
+	int (*timescale_and_approximation)(double x,
+					   void * parameters_and_workspace,
+					   double * timescales,
+					   ErrorMsg error_message),
+	double timestep_over_timescale,
+	double * t_vec,
+	int tres,
+	int (*output)(double x,double y[],double dy[],int index_x,void * parameters_and_workspace,
+		ErrorMsg error_message),
+	int (*print_variables)(double x, double y[], double dy[], void *parameters_and_workspace,
+		ErrorMsg error_message),
+	ErrorMsg error_message);
+
+int evolver_rosenbrock_with_options(
+	int (*derivs)(double x,double * y,double * dy,
+		void * parameters_and_workspace, ErrorMsg error_message),
+	double x_ini,
+	double x_final,
+	double * y_inout,
+ 	int * used_in_output,
+	int neq,
+	void * parameters_and_workspace_for_derivs,
+	double rtol,
+	double minimum_variation,
+	int (*timescale_and_approximation)(double x,
+					   void * parameters_and_workspace,
+					   double * timescales,
+					   ErrorMsg error_message),
+	double timestep_over_timescale,
+	double * t_vec,
+	int tres,
+	int (*output)(double x,double y[],double dy[],int index_x,void * parameters_and_workspace,
+		ErrorMsg error_message),
+	int (*print_variables)(double x, double y[], double dy[], void *parameters_and_workspace,
+		ErrorMsg error_message),
+	struct ndf15_options * options,
+	ErrorMsg error_message);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**************************************************************/
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * definitions for module fft.c
+ */
+
+#ifndef __FFT__
+#define __FFT__
+
+#include "common.h"
+
+/**
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int fft_radix2(
+                 double * re,
+                 double * im,
+                 int n,
+                 int sign,
+                 ErrorMsg error_message
+                 );
+
+  int fft_log_gamma(
+                    double x,
+                    double y,
+                    double * ln_gamma_re,
+                    double * ln_gamma_im,
+                    ErrorMsg error_message
+                    );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
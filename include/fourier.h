@@ -2,6 +2,7 @@
 
 #include "primordial.h"
 #include "trigonometric_integrals.h"
+#include "fft.h"
 
 #ifndef __FOURIER__
 #define __FOURIER__
@@ -12,13 +13,25 @@
 
 #define _MAX_NUM_EXTRAPOLATION_ 100000
 
+#define _PKS_PARALLEL_MIN_SIZE_ 10000 /**< minimum number of values of P(k,z) computed by fourier_pks_at_kvec_and_zvec() for distributing the redshifts among threads */
+
+#define _HALOFIT_WARM_START_STEP_ 0.01 /**< first step in log10(R) when bracketing the non-linear scale of Halofit around its value at the previous time */
+
+#define _SIGMA_FFTLOG_BIAS_ 2.5 /**< power-law bias q of the FFTLog evaluation of the sigmas: k^3 P(k) k^(-q) is expanded in Fourier series in ln(k); q must be in ]2,4[ and not too close to 3 */
+#define _SIGMA_FFTLOG_KR_MIN_ 10. /**< the FFTLog evaluation of the sigmas is only used for R > _SIGMA_FFTLOG_KR_MIN_/k_max, below which it is affected by the sharp cut of P(k) at k_max */
+#define _SIGMA_FFTLOG_PADDING_ 2 /**< minimum ratio of the size of the FFTLog grid to the number of sampled wavenumbers, the rest being zero-padded */
+
+#define _HMCODE_NFW_TABLE_KS_MIN_ 1.e-12 /**< smallest value of k r_s in the table of the NFW window of HMcode */
+#define _HMCODE_NFW_TABLE_KS_MAX_ 1. /**< largest value of k r_s in the table of the NFW window of HMcode */
+#define _HMCODE_NFW_TABLE_C_MIN_ 1. /**< smallest concentration in the table of the NFW window of HMcode */
+#define _HMCODE_NFW_TABLE_C_MAX_ 100. /**< largest concentration in the table of the NFW window of HMcode */
+#define _HMCODE_NFW_TABLE_KRV_MAX_ 2. /**< the table of the NFW window is only used for k r_v = k r_s c below this value; above, the window oscillates in c and is computed from sine and cosine integrals */
+
 enum non_linear_method {nl_none,nl_halofit,nl_HMcode};
 enum pk_outputs {pk_linear,pk_nonlinear};
 
 enum source_extrapolation {extrap_zero,extrap_only_max,extrap_only_max_units,extrap_max_scaled,extrap_hmcode,extrap_user_defined};
 
-enum halofit_integral_type {halofit_integral_one, halofit_integral_two, halofit_integral_three};
-
 enum hmcode_baryonic_feedback_model {nl_emu_dmonly, nl_owls_dmonly, nl_owls_ref, nl_owls_agn, nl_owls_dblim, nl_user_defined};
 enum out_sigmas {out_sigma,out_sigma_prime,out_sigma_disp};
 
@@ -51,6 +64,10 @@ struct fourier {
 
   short has_pk_eq;  /**< flag: in case wa_fld is defined and non-zero, should we use the pk_eq method? */
 
+  short lazy_evaluation; /**< flag: compute the spectra only on first access through the query functions (see fourier_lazy_compute()) */
+
+  short has_pk_bicubic; /**< flag: precompute the coefficients of a bicubic interpolation of P(k,z), used by fourier_pk_bicubic_at_points() */
+
   //@}
 
   /** @name - information on number of modes and pairs of initial conditions */
@@ -145,6 +162,16 @@ struct fourier {
 
   double ** ddln_pk_nl; /**< second derivative of above array with respect to log(tau), for spline interpolation. */
 
+  int pk_bicubic_tau_cells; /**< number of intervals in log(tau) of the tables below (1 if ln_tau_size=1) */
+
+  double ** pk_bicubic_l;  /**< if has_pk_bicubic, coefficients of the bicubic interpolation of ln_pk_l in (log(k),log(tau)):
+                              within the cell [index_k,index_k+1]x[index_tau,index_tau+1],
+                              ln_pk = sum_{p,q} pk_bicubic_l[index_pk][((index_tau * (pfo->k_size-1) + index_k) * 4 + p) * 4 + q] u^p v^q
+                              where u and v are the reduced coordinates in log(k) and log(tau), between 0 and 1.
+                              The interpolation coincides with a spline in log(tau) followed by a natural spline in log(k). */
+
+  double ** pk_bicubic_nl; /**< same for ln_pk_nl (only if method > nl_none) */
+
   double * sigma8;   /**< sigma8[index_pk] */
 
   //@}
@@ -157,7 +184,9 @@ struct fourier {
 
   int tau_size;    /**< tau_size = number of values */
   double * tau;    /**< tau[index_tau] = list of time values, covering
-                      all the values of the perturbation module */
+                      all the values of the perturbation module, or only
+                      the late times z<z_max_pk when no C_l's are requested */
+  int tau_offset;  /**< index of tau[0] in the time sampling of the perturbation module */
 
   double ** nl_corr_density;   /**< nl_corr_density[index_pk][index_tau * ppt->k_size + index_k] */
   double ** k_nl;              /**< wavenumber at which non-linear corrections become important,
@@ -189,6 +218,16 @@ struct fourier {
 
   short fourier_verbose;  	/**< amount of information written in standard output */
 
+  short is_pending;             /**< _TRUE_ as long as the spectra of a lazy fourier_init() have not been computed */
+#ifdef _OPENMP
+  omp_lock_t lazy_lock;         /**< lock of the lazy computation of this structure */
+#endif
+  struct precision * ppr;       /**< pointer to precision structure, stored for a lazy computation */
+  struct background * pba;      /**< pointer to background structure, stored for a lazy computation */
+  struct thermodynamics * pth;  /**< pointer to thermodynamics structure, stored for a lazy computation */
+  struct perturbations * ppt;   /**< pointer to perturbation structure, stored for a lazy computation */
+  struct primordial * ppm;      /**< pointer to primordial structure, stored for a lazy computation */
+
   ErrorMsg error_message; 	/**< zone for writing error messages */
 
   //@}
@@ -206,8 +245,8 @@ struct fourier_workspace {
   //@{
 
   double * rtab; /** List of R values */
-  double * stab; /** List of Sigma Values */
-  double * ddstab; /** Splined sigma */
+  double * stab; /** List of Sigma Values, stab[index_tau*n_hmcode_tables+index_r] */
+  double * ddstab; /** Splined sigma, same layout */
 
   double * growtable;
   double * ztable;
@@ -217,6 +256,10 @@ struct fourier_workspace {
   double ** sigma_disp;
   double ** sigma_disp_100;
   double ** sigma_prime;
+  double ** r_nl;     /** r_nl[index_pk][index_tau]: non-linear radius, where sigma(r_nl)=delta_c */
+  double ** sigma_nl; /** sigma_nl[index_pk][index_tau]: sigma(r_nl) found by the bisection */
+
+  short ** sigmas_known; /** sigmas_known[index_pk][index_tau]: _TRUE_ if the quantities above (and stab, ddstab for index_pk=0) are already known at this time, e.g. from a previous run with the same linear spectra */
 
   double dark_energy_correction; /** this is the ratio [g_wcdm(z_infinity)/g_lcdm(z_infinity)]^1.5
                                   * (power comes from Dolag et al. (2004) correction)
@@ -224,6 +267,78 @@ struct fourier_workspace {
 
   //@}
 
+  /** @name - linear spectra from which the sigmas were computed (only with hmcode_cache) */
+
+  //@{
+
+  double ** lnpk_l;   /** lnpk_l[index_pk][index_tau*k_size_extra+index_k] */
+  double * cache_key; /** cache_key[2*index_tau] = tau and cache_key[2*index_tau+1] = Omega_m(tau) */
+
+  //@}
+
+  /** @name - table of the NFW window, W(k r_s, c) on a grid of log(k r_s) and log(c) (NULL if not used) */
+
+  //@{
+
+  int nfw_ks_size;
+  int nfw_c_size;
+  double nfw_ln_ks_min;
+  double nfw_dln_ks;
+  double nfw_ln_c_min;
+  double nfw_dln_c;
+  double * nfw_window; /** nfw_window[index_c*nfw_ks_size+index_ks] */
+
+  //@}
+
+};
+
+/**
+ * Quantities of HMcode kept in memory by fourier_hmcode_cache_store()
+ * for the next runs: the values of all the parameters on which they
+ * depend, the linear spectra (with their extrapolation to
+ * hmcode_max_k_extra) and the background quantities at each time, the
+ * tables of sigma(R) and the other sigma's at each time.
+ */
+
+struct fourier_hmcode_cache {
+
+  short is_filled; /**< _TRUE_ once a run has stored its quantities */
+
+  /** @name - parameters on which the cached quantities depend */
+
+  //@{
+
+  int pk_size;
+  int tau_size;
+  int k_size_extra;
+  int n_hmcode_tables;
+  int nsteps_for_p1h_integral;
+  double rmin_for_sigtab;
+  double rmax_for_sigtab;
+  double sigma_k_per_decade;
+  int sigma_fftlog;
+  double hmcode_tol_sigma;
+  double mmin_for_p1h_integral;
+  double mmax_for_p1h_integral;
+  double h;
+  double Omega0_m;
+  double Omega0_ncdm_tot;
+
+  //@}
+
+  /** @name - cached arrays, with the layout of the workspace, pk by pk */
+
+  //@{
+
+  double * ln_k;        /**< ln_k[index_k] for the k_size_extra values of k */
+  double * cache_key;   /**< same as in the workspace */
+  double * lnpk_l;      /**< lnpk_l[(index_pk*tau_size+index_tau)*k_size_extra+index_k] */
+  double * stab;        /**< same as in the workspace */
+  double * ddstab;      /**< same as in the workspace */
+  double * sigmas;      /**< sigma_8, sigma_disp, sigma_disp_100, sigma_prime, r_nl and sigma_nl, each as [index_pk*tau_size+index_tau] */
+  short * sigmas_known; /**< sigmas_known[index_pk*tau_size+index_tau] */
+
+  //@}
 };
 
 /********************************************************************************/
@@ -298,6 +413,21 @@ extern "C" {
                                      double * out_pk_cb
                                      );
 
+  int fourier_pk_bicubic_at_points(
+                                   struct background * pba,
+                                   struct fourier * pfo,
+                                   enum pk_outputs pk_output,
+                                   int index_pk,
+                                   double * kvec,
+                                   double * zvec,
+                                   int points_size,
+                                   double * out_pk
+                                   );
+
+  int fourier_pk_bicubic_init(
+                              struct fourier * pfo
+                              );
+
   int fourier_sigmas_at_z(
                             struct precision * ppr,
                             struct background * pba,
@@ -309,6 +439,18 @@ extern "C" {
                             double * result
                             );
 
+  int fourier_sigmas_at_rvec_and_z(
+                                   struct precision * ppr,
+                                   struct background * pba,
+                                   struct fourier * pfo,
+                                   double * rvec,
+                                   int rvec_size,
+                                   double z,
+                                   int index_pk,
+                                   enum out_sigmas sigma_output,
+                                   double * result
+                                   );
+
   int fourier_pk_tilt_at_k_and_z(
                                     struct background * pba,
                                     struct primordial * ppm,
@@ -343,6 +485,19 @@ extern "C" {
                      struct fourier *pfo
                      );
 
+  int fourier_lazy_compute(
+                           struct fourier *pfo
+                           );
+
+  int fourier_spectra(
+                      struct precision *ppr,
+                      struct background *pba,
+                      struct thermodynamics *pth,
+                      struct perturbations *ppt,
+                      struct primordial *ppm,
+                      struct fourier *pfo
+                      );
+
   int fourier_indices(
                         struct precision *ppr,
                         struct background *pba,
@@ -396,6 +551,26 @@ extern "C" {
                        double * result
                        );
 
+  int fourier_sigmas_fftlog_size(
+                                 struct fourier * pfo,
+                                 int k_size,
+                                 double k_per_decade,
+                                 int * fftlog_size
+                                 );
+
+  int fourier_sigmas_fftlog(
+                            struct fourier * pfo,
+                            double * lnpk_l,
+                            double * ddlnpk_l,
+                            int k_size,
+                            double k_per_decade,
+                            int fftlog_size,
+                            double * ln_r,
+                            double * sigma,
+                            double * sigma_prime,
+                            double * sigma_disp
+                            );
+
   int fourier_sigma_at_z(
                            struct background * pba,
                            struct fourier * pfo,
@@ -417,23 +592,31 @@ extern "C" {
                         double *pk_nl,
                         double *lnpk_l,
                         double *ddlnpk_l,
+                        double k_nl_guess,
                         double *k_nl,
                         short * halofit_found_k_max
                         );
 
+  int fourier_halofit_at_all_tau(
+                                 struct precision *ppr,
+                                 struct background *pba,
+                                 struct perturbations *ppt,
+                                 struct primordial *ppm,
+                                 struct fourier *pfo,
+                                 short ** nl_corr_not_computable
+                                 );
+
   int fourier_halofit_integrate(
-                                  struct fourier *pfo,
-                                  double * integrand_array,
-                                  int integrand_size,
-                                  int ia_size,
-                                  int index_ia_k,
-                                  int index_ia_pk,
-                                  int index_ia_sum,
-                                  int index_ia_ddsum,
-                                  double R,
-                                  enum halofit_integral_type type,
-                                  double * sum
-                                  );
+                                struct spline_coefficients * psc,
+                                double * k,
+                                double * pk,
+                                int integrand_size,
+                                double * integrand,
+                                double * ddintegrand,
+                                double R,
+                                int sum_size,
+                                double * sum
+                                );
 
   int fourier_hmcode(
                        struct precision *ppr,
@@ -452,6 +635,16 @@ extern "C" {
                        struct fourier_workspace * pnw
                        );
 
+  int fourier_hmcode_at_all_tau(
+                                struct precision *ppr,
+                                struct background *pba,
+                                struct perturbations *ppt,
+                                struct primordial *ppm,
+                                struct fourier *pfo,
+                                struct fourier_workspace * pnw,
+                                short ** nl_corr_not_computable
+                                );
+
   int fourier_hmcode_workspace_init(
                                       struct precision *ppr,
                                       struct background *pba,
@@ -505,14 +698,37 @@ extern "C" {
                                double * growth
                                );
 
+  int fourier_hmcode_nfw_table_init(
+                                     struct precision *ppr,
+                                     struct fourier * pfo,
+                                     struct fourier_workspace * pnw
+                                     );
+
   int fourier_hmcode_window_nfw(
                                   struct fourier * pfo,
+                                  struct fourier_workspace * pnw,
                                   double k,
                                   double rv,
                                   double c,
                                   double *window_nfw
                                   );
 
+  int fourier_hmcode_cache_fetch(
+                                  struct precision *ppr,
+                                  struct background *pba,
+                                  struct fourier *pfo,
+                                  struct fourier_workspace * pnw
+                                  );
+
+  int fourier_hmcode_cache_store(
+                                  struct precision *ppr,
+                                  struct background *pba,
+                                  struct fourier *pfo,
+                                  struct fourier_workspace * pnw
+                                  );
+
+  int fourier_hmcode_cache_clear();
+
   int fourier_hmcode_halomassfunction(
                                         double nu,
                                         double *hmf
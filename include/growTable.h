@@ -23,6 +23,31 @@ typedef struct {
   ErrorMsg error_message; /**< error message slot */
 } growTable;
 
+/**
+ * one chunk of a growArena.
+ */
+typedef struct gtArenaChunk {
+  struct gtArenaChunk * next; /**< next chunk, or NULL for the last one */
+  long sz;                    /**< total size of data */
+  long csz;                   /**< real size of data */
+  char * data;                /**< start of the data, right after this structure */
+} gtArenaChunk;
+
+/**
+ * growArena structure: a growTable that appends data in a list of
+ * chunks, so that data already written is never moved. Each call to
+ * gt_arena_add() writes its data contiguously inside one chunk.
+ */
+typedef struct {
+  gtArenaChunk * first; /**< first chunk */
+  gtArenaChunk * last;  /**< chunk currently being filled */
+  int nchunks;          /**< number of chunks */
+  long csz;             /**< real size of all data */
+  int freeze;           /**< if set to _TRUE_ no data can be added */
+
+  ErrorMsg error_message; /**< error message slot */
+} growArena;
+
 /** Boilerplate for C++ */
 #ifdef __cplusplus
 extern "C" {
@@ -40,6 +65,14 @@ int gt_getPtr(growTable*, void** ptr);
 
 int gt_free(growTable*);
 
+int gt_arena_init(growArena*, long sz);
+int gt_arena_add(growArena*, void* data, long sz);
+int gt_arena_getSize(growArena*, long *idx);
+int gt_arena_getChunk(growArena*, int index, void** ptr, long *sz);
+int gt_arena_retrieveAll(growArena*, void* data);
+int gt_arena_getPtr(growArena*, void** ptr);
+int gt_arena_free(growArena*);
+
 /** Boilerplate for C++ */
 #ifdef __cplusplus
 }
@@ -29,6 +29,8 @@ struct harmonic {
                    and number of bins minus one means all
                    correlations */
 
+  short lazy_evaluation; /**< flag: compute the \f$C_l\f$'s only on first access through the query functions (see harmonic_lazy_compute()) */
+
   //@}
 
   /** @name - information on number of modes and pairs of initial conditions */
@@ -132,11 +134,54 @@ struct harmonic {
 
   short harmonic_verbose; /**< flag regulating the amount of information sent to standard output (none if set to zero) */
 
+  short is_pending;             /**< _TRUE_ as long as the \f$C_l\f$'s of a lazy harmonic_init() have not been computed */
+#ifdef _OPENMP
+  omp_lock_t lazy_lock;         /**< lock of the lazy computation of this structure */
+#endif
+  struct precision * ppr;       /**< pointer to precision structure, stored for a lazy computation */
+  struct background * pba;      /**< pointer to background structure, stored for a lazy computation */
+  struct perturbations * ppt;   /**< pointer to perturbation structure, stored for a lazy computation */
+  struct primordial * ppm;      /**< pointer to primordial structure, stored for a lazy computation */
+  struct transfer * ptr;        /**< pointer to transfer structure, stored for a lazy computation */
+
   ErrorMsg error_message; /**< zone for writing error messages */
 
   //@}
 };
 
+/**
+ * maximum number of transfer types combined in one field of
+ * harmonic_offload (a number count bin sums up to ten of them)
+ */
+
+#define _HARMONIC_OFFLOAD_TERMS_ 10
+
+/**
+ * Everything needed to compute the \f$ C_l\f$'s of one mode with
+ * harmonic_cls_l_range_offload() or harmonic_cls_l_range_matrix(),
+ * which write each integral over k as a weighted sum. The transfer
+ * functions are first combined in a few fields (e.g. temperature =
+ * t0+t1+t2, or the sum of all number count contributions of a bin),
+ * and each type of \f$ C_l\f$ is the integral of the product of two
+ * fields.
+ */
+
+struct harmonic_offload {
+
+  int q_size;            /**< number of wavenumbers */
+  double * q_weight;     /**< q_weight[index_q]: weight of each wavenumber in the integral over k (spline or trapezoidal) */
+  double * pk;           /**< pk[index_q*ic_ic_size+index_ic1_ic2]: primordial spectrum times \f$ 4 \pi/k \f$ */
+
+  int field_size;        /**< number of fields */
+  int * field_tt;        /**< field_tt[index_field*_HARMONIC_OFFLOAD_TERMS_+index_term]: transfer types summed up in each field, -1 for unused terms */
+  short * field_lfactor; /**< same, _TRUE_ if the transfer function is multiplied by l(l+1) */
+
+  int * ct_field_1;      /**< ct_field_1[index_ct]: first field of each type of \f$ C_l\f$ */
+  int * ct_field_2;      /**< ct_field_2[index_ct]: second field */
+  short * ct_kind;       /**< ct_kind[index_ct]: 0 for null spectra, 1 for products field_1(ic1)*field_2(ic2), 2 for symmetrised products */
+
+};
+
 /*************************************************************************************************************/
 /* @cond INCLUDE_WITH_DOXYGEN */
 /*
@@ -156,6 +201,12 @@ extern "C" {
                       double ** cl_md_ic
                       );
 
+  int harmonic_cl_at_l_array(
+                            struct harmonic * phr,
+                            int l_max,
+                            double * cl_tot
+                            );
+
   /* internal functions */
 
   int harmonic_init(
@@ -172,6 +223,10 @@ extern "C" {
                    struct harmonic * phr
                    );
 
+  int harmonic_lazy_compute(
+                            struct harmonic * phr
+                            );
+
   int harmonic_indices(
                       struct background * pba,
                       struct perturbations * ppt,
@@ -181,6 +236,7 @@ extern "C" {
                       );
 
   int harmonic_cls(
+                  struct precision * ppr,
                   struct background * pba,
                   struct perturbations * ppt,
                   struct transfer * ptr,
@@ -188,6 +244,61 @@ extern "C" {
                   struct harmonic * phr
                   );
 
+  int harmonic_cls_l_range(
+                          struct background * pba,
+                          struct perturbations * ppt,
+                          struct transfer * ptr,
+                          struct primordial * ppm,
+                          struct harmonic * phr,
+                          int index_md,
+                          int index_l_min,
+                          int index_l_max
+                          );
+
+  int harmonic_cls_interpolate_strided(
+                                      struct transfer * ptr,
+                                      struct harmonic * phr,
+                                      int index_md,
+                                      int index_tt,
+                                      int index_ct_first,
+                                      int ct_num
+                                      );
+
+  int harmonic_offload_init(
+                           struct background * pba,
+                           struct perturbations * ppt,
+                           struct transfer * ptr,
+                           struct primordial * ppm,
+                           struct harmonic * phr,
+                           int index_md,
+                           struct harmonic_offload * pho
+                           );
+
+  int harmonic_offload_free(
+                           struct harmonic_offload * pho
+                           );
+
+  int harmonic_cls_l_range_offload(
+                                  struct perturbations * ppt,
+                                  struct transfer * ptr,
+                                  struct harmonic * phr,
+                                  int index_md,
+                                  int index_l_min,
+                                  int index_l_max,
+                                  struct harmonic_offload * pho
+                                  );
+
+  int harmonic_cls_l_range_matrix(
+                                 struct perturbations * ppt,
+                                 struct transfer * ptr,
+                                 struct harmonic * phr,
+                                 int index_md,
+                                 int index_l_min,
+                                 int index_l_max,
+                                 int l_block_size,
+                                 struct harmonic_offload * pho
+                                 );
+
   int harmonic_compute_cl(
                          struct background * pba,
                          struct perturbations * ppt,
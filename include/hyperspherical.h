@@ -11,9 +11,31 @@
 #define _HYPER_SAFETY_ 1e-5
 #define _TRIG_PRECISSION_ 1e-7
 #define _HYPER_BLOCK_ 8
+/** The chunked recurrences work on _HYPER_CHUNK_ x-values at once, so that
+    their inner loops over x run a few SIMD registers wide
+    (_HYPER_SIMD_WIDTH_ doubles each). Both can be overridden with -D. */
+#ifndef _HYPER_SIMD_WIDTH_
+#if defined(__AVX512F__)
+#define _HYPER_SIMD_WIDTH_ 8
+#elif defined(__AVX__)
+#define _HYPER_SIMD_WIDTH_ 4
+#else
+#define _HYPER_SIMD_WIDTH_ 2 /* SSE2 or NEON */
+#endif
+#endif
+#ifndef _HYPER_CHUNK_
+#if _HYPER_SIMD_WIDTH_ > 4
+#define _HYPER_CHUNK_ (4*_HYPER_SIMD_WIDTH_)
+#else
 #define _HYPER_CHUNK_ 16
+#endif
+#endif
 #define _TWO_OVER_THREE_ 0.666666666666666666666666666667e0
 #define _HIS_BYTE_ALIGNMENT_ 16
+#define _HERMITE_SUMS_ 4 /* number of partial sums in hermite4_convolution_csource.h */
+#define _HERMITE_CONVOLUTION_MAX_ 8 /* maximum number of sets of weights per function in hyperspherical_Hermite4_convolution_multi() */
+#define _HYPER_CACHE_MAX_ 1024 /* maximum number of tables kept in memory by hyperspherical_HIS_create_cached() */
+#define _HYPER_CACHE_VERSION_ 1 /* to be incremented whenever the layout of cached tables changes */
 
 typedef struct HypersphericalInterpolationStructure{
   int K;                 //Sign of the curvature, (0,-1,1)
@@ -29,8 +51,34 @@ typedef struct HypersphericalInterpolationStructure{
   double *cotK;          //Vector of cot_K(xvec)
   double *phi;        //array of size nl*nx. [y_{l1}(x1) t_{l1}(x2)...]
   double *dphi;       //Same as phivec, but containing derivatives.
+  void *block;        //If not NULL, all the arrays above point inside this single block (table read from a cache)
+  size_t block_size;     //Size of block in bytes
+  int block_is_mapped;   //_TRUE_ if block is a read-only memory map of a cache file, _FALSE_ if it was allocated
 } HyperInterpStruct;
 
+/**
+ * Header of a table stored by hyperspherical_HIS_create_cached(), in
+ * memory or in a file. It contains all the input arguments of
+ * hyperspherical_HIS_create() except the l list, which is stored right
+ * after it.
+ */
+struct hyperspherical_cache_header{
+  char magic[8];
+  unsigned long long key;
+  int version;
+  int K;
+  int nl;
+  int x_size;
+  int l_WKB;
+  int trig_order;
+  double beta;
+  double xmin;
+  double xmax;
+  double sampling;
+  double phiminabs;
+  double delta_x;
+};
+
 struct WKB_parameters{
    int K;
    int l;
@@ -57,6 +105,51 @@ extern "C" {
                                 ErrorMsg error_message);
 
   int hyperspherical_HIS_free(HyperInterpStruct *pHIS, ErrorMsg error_message);
+  int hyperspherical_HIS_create_cached(int K,
+                                       double beta,
+                                       int nl,
+                                       int *lvec,
+                                       double xmin,
+                                       double xmax,
+                                       double sampling,
+                                       int l_WKB,
+                                       double phiminabs,
+                                       int cache_size,
+                                       char *cache_directory,
+                                       HyperInterpStruct *pHIS,
+                                       ErrorMsg error_message);
+  int hyperspherical_HIS_cache_header(int K,
+                                      double beta,
+                                      int nl,
+                                      int *lvec,
+                                      double xmin,
+                                      double xmax,
+                                      double sampling,
+                                      int l_WKB,
+                                      double phiminabs,
+                                      struct hyperspherical_cache_header *header);
+  int hyperspherical_HIS_cache_match(struct hyperspherical_cache_header *header,
+                                     int *lvec,
+                                     void *block,
+                                     size_t block_size);
+  size_t hyperspherical_HIS_block_size(int nl, int nx);
+  int hyperspherical_HIS_to_block(HyperInterpStruct *pHIS,
+                                  struct hyperspherical_cache_header *header,
+                                  void *block);
+  int hyperspherical_HIS_from_block(void *block,
+                                    size_t block_size,
+                                    int block_is_mapped,
+                                    HyperInterpStruct *pHIS);
+  int hyperspherical_HIS_cache_read_file(char *cache_directory,
+                                         struct hyperspherical_cache_header *header,
+                                         int *lvec,
+                                         HyperInterpStruct *pHIS,
+                                         int *found);
+  int hyperspherical_HIS_cache_write_file(char *cache_directory,
+                                          void *block,
+                                          size_t block_size,
+                                          ErrorMsg error_message);
+  int hyperspherical_HIS_cache_clear();
   int hyperspherical_forwards_recurrence(int K,
                                          int lmax,
                                          double beta,
@@ -176,6 +269,12 @@ int hyperspherical_forwards_recurrence_chunk(int K,
   int hyperspherical_Hermite4_interpolation_vector_Phid2Phi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *Phi,double *d2Phi, ErrorMsg error_message);
   int hyperspherical_Hermite4_interpolation_vector_dPhid2Phi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *dPhi,double *d2Phi, ErrorMsg error_message);
   int hyperspherical_Hermite4_interpolation_vector_PhidPhid2Phi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *Phi,double *dPhi,double *d2Phi, ErrorMsg error_message);
+  int hyperspherical_Hermite4_convolution(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *weight,double *sum_Phi,double *sum_dPhi,double *sum_d2Phi, ErrorMsg error_message);
+  int hyperspherical_Hermite4_convolution_Phi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *weight,double *result_Phi);
+  int hyperspherical_Hermite4_convolution_dPhi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *weight,double *result_dPhi);
+  int hyperspherical_Hermite4_convolution_d2Phi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *weight,double *result_d2Phi);
+  int hyperspherical_Hermite4_convolution_Phid2Phi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *weight,double *result_Phi,double *result_d2Phi);
+  int hyperspherical_Hermite4_convolution_multi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,int n_Phi,double **weight_Phi,double *sum_Phi,int n_dPhi,double **weight_dPhi,double *sum_dPhi,int n_d2Phi,double **weight_d2Phi,double *sum_d2Phi,ErrorMsg error_message);
   int hyperspherical_Hermite6_interpolation_vector_Phi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *Phi, ErrorMsg error_message);
   int hyperspherical_Hermite6_interpolation_vector_dPhi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *dPhi, ErrorMsg error_message);
   int hyperspherical_Hermite6_interpolation_vector_d2Phi(HyperInterpStruct *pHIS,int nxi,int lnum,double *xinterp,double *d2Phi, ErrorMsg error_message);
@@ -213,6 +213,23 @@ enum computation_stage {cs_background, cs_thermodynamics, cs_perturbations, cs_p
  * Structure for all temporary parameters for background fzero function
  */
 
+/* number of shooting steps whose background and thermodynamics structures are kept when ppr->shooting_reuse_structures is true */
+#define _SHOOTING_KEPT_STEPS_ 2
+
+/**
+ * Background and thermodynamics structures computed at one step of the
+ * shooting, kept by input_try_unknown_parameters() so that
+ * input_shooting() can hand over those of the converged step
+ */
+
+struct shooting_step {
+  short used;                 /**< does this slot contain a step? */
+  short has_thermodynamics;   /**< was the thermodynamics structure computed (and kept)? */
+  double * unknown_parameter; /**< values of the unknown parameters at this step */
+  struct background * pba;    /**< background structure of this step */
+  struct thermodynamics * pth; /**< thermodynamics structure of this step */
+};
+
 struct fzerofun_workspace {
   int * unknown_parameters_index;
   struct file_content fc;
@@ -220,6 +237,10 @@ struct fzerofun_workspace {
   double * target_value;
   int target_size;
   enum computation_stage required_computation_stage;
+  short warm_start; /**< start one-dimensional shootings from the previous solution (see input_find_root_warm()) */
+  short reuse_structures; /**< keep the structures of the last steps in kept_step[] */
+  struct shooting_step kept_step[_SHOOTING_KEPT_STEPS_]; /**< structures of the last steps */
+  int kept_step_next; /**< slot of kept_step[] used by the next step */
 };
 
 /**************************************************************/
@@ -304,6 +325,28 @@ extern "C" {
                       struct fzerofun_workspace * pfzw,
                       ErrorMsg errmsg);
 
+  int input_shooting_keep_step(struct fzerofun_workspace * pfzw,
+                               double * unknown_parameter,
+                               struct background * pba,
+                               struct thermodynamics * pth,
+                               short has_thermodynamics,
+                               ErrorMsg errmsg);
+
+  int input_shooting_hand_over(struct fzerofun_workspace * pfzw,
+                               double * unknown_parameter,
+                               struct background * pba,
+                               struct thermodynamics * pth,
+                               ErrorMsg errmsg);
+
+  int input_shooting_free_steps(struct fzerofun_workspace * pfzw);
+
+  int input_find_root_warm(double * xzero,
+                           int * fevals,
+                           double tol_x_rel,
+                           struct fzerofun_workspace * pfzw,
+                           short * converged,
+                           ErrorMsg errmsg);
+
   int input_fzerofun_1d(double input,
                         void * fzerofun_workspace,
                         double * output,
@@ -5,6 +5,96 @@
 
 #include "harmonic.h"
 
+/**
+ * Wigner d-functions \f$ d^l_{mm'} \f$ computed by lensing_d_at_mu(),
+ * used by the fused kernel of lensing_lensed_cl_fused()
+ */
+
+enum wigner_d {wigner_d00,wigner_d11,wigner_d1m1,wigner_d2m2,wigner_d22,wigner_d20,wigner_d31,wigner_d3m1,wigner_d3m3,wigner_d40,wigner_d4m2,wigner_d4m4,wigner_d_size};
+
+#define _LENSING_MU_GROUP_ 8 /**< maximum number of values of mu for which lensing_d_at_mu() runs the recurrences together */
+
+#define _LENSING_D_CACHE_VERSION_ 1 /**< to be incremented whenever the layout of cached tables of Wigner d-functions changes */
+#define _LENSING_D_CACHE_ALIGNMENT_ 16 /**< the arrays of a cached table start at a multiple of this number of bytes */
+
+/**
+ * Header of a table of Gauss-Legendre nodes, weights and Wigner
+ * d-functions stored by lensing_d_cache_store(), in memory or in a
+ * file. It contains everything these tables depend on.
+ */
+
+struct lensing_d_cache_header {
+  char magic[8];
+  unsigned long long key;
+  int version;
+  int l_unlensed_max;
+  int num_mu;
+  int accurate_lensing;
+  double tol_gauss_legendre;
+};
+
+/**
+ * Table of the lensing module read from or stored in the cache: a
+ * single block of memory made of the header, mu[index_mu],
+ * w8[index_mu] and the d-functions d[index_d][index_mu*(l_unlensed_max+1)+l]
+ * of all the types of enum wigner_d. It is released by
+ * lensing_d_cache_release().
+ */
+
+struct lensing_d_table {
+  void * block;
+  size_t block_size;
+  short block_is_mapped; /**< _TRUE_ if the block is a memory-mapped file */
+  short block_is_cached; /**< _TRUE_ if the block is the one kept in memory */
+  double * mu;
+  double * w8;
+  double * d[wigner_d_size];
+};
+
+/**
+ * Lensed correlation functions: \f$ \xi \f$ for TT, \f$ \xi^X \f$ for TE,
+ * \f$ \xi_+ \f$ and \f$ \xi_- \f$ for EE and BB
+ */
+
+enum lensing_ksi {lensing_ksi_tt,lensing_ksi_te,lensing_ksi_p,lensing_ksi_m,lensing_ksi_size};
+
+/**
+ * Linear response of the lensed \f$ C_l\f$'s around the spectra of an
+ * exact computation (the fiducial spectra), built by
+ * lensing_response_build() and kept in memory by
+ * lensing_response_keep().
+ *
+ * Each lensed spectrum is a quadrature over mu of a correlation
+ * function \f$ \xi(\mu) = \sum_l K(\mu,l) C_l \f$, linear in the unlensed
+ * spectrum, with a kernel K depending on \f$ C_l^{\phi\phi} \f$ through
+ * sigma2(mu) and Cgl2(mu). The response matrices are kept in this
+ * factorized form: the kernels K, the derivatives of \f$ \xi \f$ with
+ * respect to sigma2 and Cgl2, and the d-functions giving sigma2, Cgl2
+ * and the quadratures. Applying them costs O(l_unlensed_max x num_mu).
+ */
+
+struct lensing_response {
+  struct lensing_d_cache_header header; /**< multipoles and values of mu of the fiducial computation */
+  int has_tt;      /**< lensed types of the fiducial computation */
+  int has_te;
+  int has_ee;
+  int has_bb;
+  int lt_size;
+  int l_size;      /**< number of multipoles of the table of lensed spectra */
+  double * l;      /**< l[index_l] */
+  double * w8;     /**< quadrature weights w8[index_mu] */
+  double * d[wigner_d_size]; /**< d-functions d[index_d][index_mu*(l_unlensed_max+1)+l], only for d00, d11, d1m1, d2m2, d20, d22 */
+  double * cl_tt;  /**< fiducial unlensed spectra cl_tt[l], etc. (NULL when not needed) */
+  double * cl_te;
+  double * cl_ee;
+  double * cl_bb;
+  double * cl_pp;
+  double * cl_lens; /**< fiducial lensed spectra, in the format of lensing->cl_lens */
+  double * kernel[lensing_ksi_size]; /**< kernels kernel[index_ksi][index_mu*(l_unlensed_max+1)+l] */
+  double * dksi_dsigma2[lensing_ksi_size]; /**< derivatives dksi_dsigma2[index_ksi][index_mu] */
+  double * dksi_dCgl2[lensing_ksi_size];   /**< derivatives dksi_dCgl2[index_ksi][index_mu] */
+};
+
 /**
  * Structure containing everything about lensed spectra that other modules need to know.
  *
@@ -25,6 +115,8 @@ struct lensing {
 
   short has_lensed_cls; /**< do we need to compute lensed \f$ C_l\f$'s at all ? */
 
+  short lazy_evaluation; /**< flag: compute the lensed \f$ C_l\f$'s only on first access through the query functions (see lensing_lazy_compute()) */
+
   //@}
 
   /** @name - information on number of type of C_l's (TT, TE...) */
@@ -87,6 +179,15 @@ struct lensing {
 
   short lensing_verbose; /**< flag regulating the amount of information sent to standard output (none if set to zero) */
 
+  short is_pending;             /**< _TRUE_ as long as the lensed \f$ C_l\f$'s of a lazy lensing_init() have not been computed */
+#ifdef _OPENMP
+  omp_lock_t lazy_lock;         /**< lock of the lazy computation of this structure */
+#endif
+  struct precision * ppr;       /**< pointer to precision structure, stored for a lazy computation */
+  struct perturbations * ppt;   /**< pointer to perturbation structure, stored for a lazy computation */
+  struct harmonic * phr;        /**< pointer to harmonic structure, stored for a lazy computation */
+  struct fourier * pfo;         /**< pointer to fourier structure, stored for a lazy computation */
+
   ErrorMsg error_message; /**< zone for writing error messages */
 
   //@}
@@ -107,6 +208,12 @@ extern "C" {
                       double * cl_lensed
                       );
 
+  int lensing_cl_at_l_array(
+                            struct lensing * ple,
+                            int l_max,
+                            double * cl_lensed
+                            );
+
   int lensing_init(
 		   struct precision * ppr,
                    struct perturbations * ppt,
@@ -119,6 +226,23 @@ extern "C" {
                    struct lensing * ple
                    );
 
+  int lensing_lazy_compute(
+                           struct lensing * ple
+                           );
+
+  int lensing_spectra(
+                      struct precision * ppr,
+                      struct perturbations * ppt,
+                      struct harmonic * phr,
+                      struct fourier * pfo,
+                      struct lensing * ple
+                      );
+
+  int lensing_table_unlensed(
+                             struct harmonic * phr,
+                             struct lensing * ple
+                             );
+
   int lensing_indices(
 		      struct precision * ppr,
                       struct harmonic * phr,
@@ -150,6 +274,34 @@ extern "C" {
 			      int nmu,
 			      struct lensing * ple
 			      );
+  int lensing_lensed_cl_fused(
+                              struct precision * ppr,
+                              struct lensing * ple,
+                              double * mu,
+                              double * w8,
+                              int num_mu,
+                              double * cl_tt,
+                              double * cl_te,
+                              double * cl_ee,
+                              double * cl_bb,
+                              double * cl_pp
+                              );
+
+  int lensing_lensed_cl_fused_at_mu(
+                                    struct precision * ppr,
+                                    struct lensing * ple,
+                                    double ** d,
+                                    double * sqrt_l,
+                                    double * cl_tt,
+                                    double * cl_te,
+                                    double * cl_ee,
+                                    double * cl_bb,
+                                    double * cl_pp,
+                                    double Cgl_1,
+                                    double w8,
+                                    double * cl_quad
+                                    );
+
   int lensing_addback_cl_tt(
 			    struct lensing *ple,
 			    double *cl_tt
@@ -315,6 +467,102 @@ extern "C" {
                    double ** d4m4
                    );
 
+  int lensing_d_coefficients(
+                             int lmax,
+                             double * coef
+                             );
+
+  int lensing_d_at_mu(
+                      double * mu,
+                      int nmu,
+                      enum wigner_d index_d,
+                      int lmax,
+                      double * coef,
+                      double ** d
+                      );
+
+  int lensing_d_cache_header(
+                             struct precision * ppr,
+                             int l_unlensed_max,
+                             int num_mu,
+                             struct lensing_d_cache_header * header
+                             );
+
+  int lensing_d_cache_match(
+                            struct lensing_d_cache_header * header,
+                            void * block,
+                            size_t block_size
+                            );
+
+  size_t lensing_d_cache_block_size(
+                                    int l_unlensed_max,
+                                    int num_mu
+                                    );
+
+  int lensing_d_table_from_block(
+                                 void * block,
+                                 size_t block_size,
+                                 int block_is_mapped,
+                                 struct lensing_d_table * table
+                                 );
+
+  int lensing_d_cache_fetch(
+                            struct precision * ppr,
+                            struct lensing_d_cache_header * header,
+                            struct lensing_d_table * table,
+                            int * found
+                            );
+
+  int lensing_d_cache_store(
+                            struct precision * ppr,
+                            struct lensing_d_cache_header * header,
+                            double * mu,
+                            double * w8,
+                            struct lensing_d_table * table,
+                            ErrorMsg error_message
+                            );
+
+  int lensing_d_cache_release(
+                              struct lensing_d_table * table
+                              );
+
+  int lensing_d_cache_clear();
+
+  int lensing_response_build(
+                             struct precision * ppr,
+                             struct lensing * ple,
+                             int num_mu,
+                             double * w8,
+                             double ** d[wigner_d_size],
+                             double * Cgl2,
+                             double * sigma2,
+                             double * cl_tt,
+                             double * cl_te,
+                             double * cl_ee,
+                             double * cl_bb,
+                             double * cl_pp,
+                             struct lensing_response ** response
+                             );
+
+  int lensing_response_keep(
+                            struct lensing * ple,
+                            struct lensing_response * response
+                            );
+
+  int lensing_response_relens(
+                              struct precision * ppr,
+                              struct harmonic * phr,
+                              struct lensing * ple,
+                              int num_mu,
+                              int * relensed
+                              );
+
+  int lensing_response_free(
+                            struct lensing_response * response
+                            );
+
+  int lensing_response_clear();
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,6 +4,7 @@
 #define __OUTPUT__
 
 #include "common.h"
+#include "parser.h"
 #include "lensing.h"
 #include "distortions.h"
 
@@ -45,6 +46,8 @@ struct output {
 
   enum file_format output_format; /**< which format for output files (definitions, order of columns, etc.) */
 
+  short write_binary; /**< flag stating whether output files are written in the binary NumPy format (.npy) instead of text */
+
   short write_background; /**< flag for outputing background evolution in file */
   short write_thermodynamics; /**< flag for outputing thermodynamical evolution in file */
   short write_perturbations; /**< flag for outputing perturbations of selected wavenumber(s) in file(s) */
@@ -60,12 +63,65 @@ struct output {
   //@{
 
   short output_verbose; /**< flag regulating the amount of information sent to standard output (none if set to zero) */
+  short profile_verbose; /**< if positive, print the time, threads and memory of each module at the end of the run */
 
   ErrorMsg error_message; /**< zone for writing error messages */
 
   //@}
 };
 
+#define _OUTPUT_PACKED_CL_TYPES_ 6 /**< number of types of C_l's in struct output_packed: TT, EE, TE, BB, PP, TP */
+
+/**
+ * Main results of a run gathered in contiguous arrays by
+ * output_packed_init(), as sent by class_server and written by
+ * class_grid
+ */
+
+struct output_packed {
+
+  int has_cl[_OUTPUT_PACKED_CL_TYPES_]; /**< which of TT, EE, TE, BB, PP, TP are available */
+  int l_max;                            /**< largest multipole of the C_l's (0 if there are none) */
+  double * cl[_OUTPUT_PACKED_CL_TYPES_]; /**< for each available type, C_l for l = 0 to l_max: lensed if lensing was requested, total unlensed otherwise (NULL for other types) */
+  double * cl_table;                    /**< memory block holding all C_l's */
+
+  int k_size;                           /**< number of wavenumbers of P(k,z) (0 if it was not requested) */
+  int z_size;                           /**< number of redshifts of P(k,z) (0 if it was not requested) */
+  double * k;                           /**< wavenumbers in 1/Mpc (pointer to pfo->k, not allocated here) */
+  double * z;                           /**< redshifts, those of 'z_pk' (pointer to pop->z_pk, not allocated here) */
+  double * pk;                          /**< total matter power spectrum in Mpc^3, non-linear if 'non_linear' was set, as pk[index_z*k_size+index_k] */
+
+};
+
+/**
+ * Central finite-difference derivatives of the results of struct
+ * output_packed with respect to some input parameters, filled by
+ * output_derivatives_init()
+ */
+
+struct output_derivatives {
+
+  int par_size;                         /**< number of parameters */
+  FileArg * name;                       /**< their names */
+  double * fiducial;                    /**< their fiducial values, read in the input */
+  double * step;                        /**< their steps: the derivatives use the runs at fiducial-step and fiducial+step */
+
+  int has_cl[_OUTPUT_PACKED_CL_TYPES_]; /**< which of TT, EE, TE, BB, PP, TP are available */
+  int l_max;                            /**< largest multipole of the C_l's (0 if there are none) */
+  double * cl;                          /**< fiducial C_l's as cl[index_type*(l_max+1)+l] (zero for the types that are not available) */
+  double * dcl;                         /**< their derivatives as dcl[(index_par*_OUTPUT_PACKED_CL_TYPES_+index_type)*(l_max+1)+l] */
+
+  int k_size;                           /**< number of wavenumbers of P(k,z): those of the fiducial run within the range of all runs (0 if P(k,z) was not requested) */
+  int z_size;                           /**< number of redshifts of P(k,z) */
+  double * k;                           /**< wavenumbers in 1/Mpc */
+  double * z;                           /**< redshifts */
+  double * pk;                          /**< fiducial P(k,z) in Mpc^3 as pk[index_z*k_size+index_k] */
+  double * dpk;                         /**< its derivatives as dpk[(index_par*z_size+index_z)*k_size+index_k] */
+
+  ErrorMsg error_message;               /**< zone for writing error messages */
+
+};
+
 /*************************************************************************************************************/
 /* @cond INCLUDE_WITH_DOXYGEN */
 /*
@@ -83,6 +139,38 @@ extern "C" {
                            double * cl
                            );
 
+  int output_packed_init(
+                         struct background * pba,
+                         struct perturbations * ppt,
+                         struct fourier * pfo,
+                         struct harmonic * phr,
+                         struct lensing * ple,
+                         struct output * pop,
+                         struct output_packed * popk
+                         );
+
+  int output_packed_free(
+                         struct output_packed * popk
+                         );
+
+  int output_derivatives_init(
+                              struct file_content * pfc,
+                              int par_size,
+                              FileArg * name,
+                              double * step,
+                              int runs,
+                              struct output_derivatives * pod
+                              );
+
+  int output_derivatives_write(
+                               struct output_derivatives * pod,
+                               char * filename
+                               );
+
+  int output_derivatives_free(
+                              struct output_derivatives * pod
+                              );
+
   int output_init(
                   struct background * pba,
                   struct thermodynamics * pth,
@@ -152,10 +240,46 @@ extern "C" {
                          struct output * pop
                          );
 
-  int output_print_data(FILE *out,
+  int output_print_titles(
+                          FILE * out,
+                          char titles[_MAXTITLESTRINGLENGTH_]
+                          );
+
+  int output_streamed_perturbations_titles(
+                                           struct output * pop,
+                                           FileName file_name,
+                                           char * mode_name,
+                                           double k,
+                                           char titles[_MAXTITLESTRINGLENGTH_]
+                                           );
+
+  int output_print_data(struct output * pop,
+                        FILE *out,
                         char titles[_MAXTITLESTRINGLENGTH_],
                         double *dataptr,
                         int tau_size);
+
+  int output_open_file(
+                       struct output * pop,
+                       FILE ** file,
+                       FileName file_name,
+                       ErrorMsg error_message
+                       );
+
+  int output_write_npy_header(
+                              FILE * out,
+                              char * titles,
+                              int rows,
+                              ErrorMsg error_message
+                              );
+
+  void output_one_value(
+                        struct output * pop,
+                        FILE * out,
+                        double value,
+                        short condition
+                        );
+
   int output_open_cl_file(
                           struct harmonic * phr,
                           struct output * pop,
@@ -186,6 +310,7 @@ extern "C" {
                           );
 
   int output_one_line_of_pk(
+                            struct output * pop,
                             FILE * tkfile,
                             double one_k,
                             double one_pk
@@ -15,6 +15,8 @@ struct file_content {
   FileArg * name;      /**< list of (size) names */
   FileArg * value;     /**< list of (size) values */
   short * read;        /**< set to _TRUE_ if this parameter is effectively read */
+  int * hash_table;    /**< hash index of the names (open addressing): for each of the (hash_size) slots, position of a name in the list, or -1 */
+  int hash_size;       /**< number of slots in hash_table (a power of two), or 0 if no index was built: names are then searched one by one */
 };
 
 /**************************************************************/
@@ -33,11 +35,24 @@ extern "C" {
 
   int parser_free(struct file_content * pfc);
 
+  int parser_index(struct file_content * pfc,
+                   ErrorMsg errmsg);
+
+  int parser_find(struct file_content * pfc,
+                  char * name,
+                  int start,
+                  int * index);
+
 
   int parser_read_file(char * filename,
                        struct file_content * pfc,
                        ErrorMsg errmsg);
 
+  int parser_read_text(char * text,
+                       char * filename,
+                       struct file_content * pfc,
+                       ErrorMsg errmsg);
+
   int parser_read_line(char * line,
                        int * is_data,
                        char * name,
@@ -95,6 +110,11 @@ extern "C" {
                  struct file_content * pfc3,
                  ErrorMsg errmsg);
 
+  int parser_merge(struct file_content * pfc_default,
+                   struct file_content * pfc_new,
+                   struct file_content * pfc,
+                   ErrorMsg errmsg);
+
   int parser_check_options(char * strinput,
                            char ** options,
                            int N_options,
@@ -80,10 +80,75 @@ enum selection_type {gaussian,tophat,dirac};
  */
 #define _MAX_NUMBER_OF_K_FILES_ 30
 
+/**
+ * number of rows buffered by each thread before being written, when
+ * the perturbations for k_output_values are streamed to binary files
+ */
+#define _STREAM_BUFFER_ROWS_ 256
+
+//@}
+
+//@{
+
+/**
+ * maximum number of source tables kept in memory by perturbations_init() for later runs
+ */
+#define _PERTURBATIONS_CACHE_MAX_ 8
+
+/**
+ * maximum number of approximation switches per wavenumber kept for the warm start of the next run
+ */
+#define _PERTURBATIONS_SWITCHES_MAX_ 16
+
 //@}
 
 
 
+/**
+ * Times of the approximation switches found by
+ * perturbations_find_approximation_switches() at each wavenumber of one
+ * mode, in the order of the bisections (by approximation, then
+ * chronologically)
+ */
+
+struct perturbations_switches {
+
+  int k_size;    /**< number of wavenumbers */
+  double * k;    /**< their values, in increasing order */
+  int * ap;      /**< ap[index_k*_PERTURBATIONS_SWITCHES_MAX_+index_switch]: approximation (index_ap) of each switch, then -1 */
+  double * tau;  /**< tau[index_k*_PERTURBATIONS_SWITCHES_MAX_+index_switch]: time of each switch */
+
+};
+
+/**
+ * Work done by the ODE evolver for one wavenumber over one of the time
+ * intervals in which the approximation scheme is uniform. The step,
+ * jacobian and LU counters are only filled by the ndf15 evolver, and
+ * the wall time only when compiling with OpenMP.
+ */
+
+struct perturbations_solver_statistics {
+
+  double tau_start; /**< conformal time at the beginning of the interval */
+  double tau_end;   /**< conformal time at the end of the interval */
+
+  short tca_on;        /**< is the tight-coupling approximation on? */
+  short rsa_on;        /**< is the radiation streaming approximation on? */
+  short tca_idm_dr_on; /**< is the dark tight-coupling approximation (idm-idr) on? */
+  short rsa_idr_on;    /**< is the dark radiation streaming approximation on? */
+  short ufa_on;        /**< is the ur fluid approximation on? */
+  short ncdmfa_on;     /**< is the ncdm fluid approximation on? */
+
+  int pt_size;              /**< number of perturbations integrated over the interval */
+  int derivs_calls;         /**< number of calls to perturbations_derivs() */
+  int jacobian_evaluations; /**< number of jacobians computed */
+  int lu_decompositions;    /**< number of LU decompositions */
+  int accepted_steps;       /**< number of successful steps */
+  int rejected_steps;       /**< number of failed steps */
+  double wall_time;         /**< time spent in the evolver, in seconds */
+
+};
+
 /**
  * Structure containing everything about perturbations that other
  * modules need to know, in particular tabled values of the source
@@ -164,6 +229,9 @@ struct perturbations
   double eisw_lisw_split_z; /**< at which redshift do we define the cut between eisw and lisw ?*/
 
   int store_perturbations;  /**< Do we want to store perturbations? */
+  short stream_perturbations; /**< Do we want to write the perturbations for k_output_values directly to binary files while they are integrated, instead of storing them? */
+  FileName stream_root; /**< root of the names of these binary files (same as for the other output files) */
+  int store_solver_statistics; /**< Do we want to store statistics of the ODE evolver for each wavenumber? */
   int k_output_values_num;       /**< Number of perturbation outputs (default=0) */
   double k_output_values[_MAX_NUMBER_OF_K_FILES_];    /**< List of k values where perturbation output is requested. */
 
@@ -425,6 +493,29 @@ struct perturbations
 
   //@}
 
+  /** @name - statistics of the ODE evolver, stored if store_solver_statistics is set to _TRUE_ */
+
+  //@{
+
+  int ** solver_statistics_size; /**< number of approximation intervals of each wavenumber:
+                                    solver_statistics_size[index_md][index_ic * ppt->k_size[index_md] + index_k] */
+
+  struct perturbations_solver_statistics *** solver_statistics; /**< statistics of each interval:
+                                                                   solver_statistics[index_md]
+                                                                                    [index_ic * ppt->k_size[index_md] + index_k]
+                                                                                    [index_interval] */
+
+  //@}
+
+  /** @name - times of the approximation switches, if perturbations_switch_warm_start is set (NULL otherwise, and after perturbations_init()) */
+
+  //@{
+
+  struct perturbations_switches * switches;          /**< switches[index_md]: found in this run, kept for the next one at the end of perturbations_init() */
+  struct perturbations_switches * switches_previous; /**< switches[index_md]: found in the previous run, used as brackets (NULL if there is none) */
+
+  //@}
+
   /** @name - technical parameters */
 
   //@{
@@ -510,6 +601,9 @@ struct perturbations_vector
                             perturbations enter in the calculation of
                             source functions */
 
+  int pt_capacity;        /**< number of elements allocated in y, dy and used_in_sources (at least pt_size) */
+  short is_pooled;        /**< _TRUE_ if this vector belongs to the pool of a perturbations_workspace, and is released rather than freed by perturbations_vector_free() */
+
 };
 
 
@@ -555,6 +649,12 @@ struct perturbations_workspace
   struct perturbations_vector * pv; /**< pointer to vector of integrated
                                  perturbations and their
                                  time-derivatives */
+  struct perturbations_vector * pv_pool[2]; /**< vectors owned by the
+                                               workspace, recycled for
+                                               all wavenumbers: at an
+                                               approximation switch, one
+                                               holds the old and the other
+                                               the new perturbations */
 
   double delta_rho;		    /**< total density perturbation (gives delta Too) */
   double rho_plus_p_theta;	/**< total (rho+p)*theta perturbation (gives delta Toi) */
@@ -581,6 +681,21 @@ struct perturbations_workspace
   double * theta_ncdm;	/**< velocity divergence theta of each ncdm species */
   double * shear_ncdm;	/**< shear for each ncdm species */
 
+  /** @name - momentum bins of all ncdm species, in the order of their hierarchies in the vector of perturbations */
+
+  //@{
+
+  int ncdm_bin_size;        /**< total number of momentum bins */
+  int * ncdm_bin_start;     /**< index of the first bin of each species */
+  double * ncdm_q;          /**< momentum q of each bin */
+  double * ncdm_dlnf0_dlnq; /**< d ln(f0)/d ln(q) of each bin */
+  double * ncdm_M2;         /**< squared mass of the species of each bin */
+  double * ncdm_q2w;        /**< q^2 times the quadrature weight of each bin */
+  double * ncdm_epsilon;    /**< energy sqrt(q^2+a^2 M^2) of each bin at a = ncdm_epsilon_a */
+  double ncdm_epsilon_a;    /**< scale factor of ncdm_epsilon (negative until computed) */
+
+  //@}
+
   double delta_m;	/**< relative density perturbation of all non-relativistic species */
   double theta_m;	/**< velocity divergence theta of all non-relativistic species */
 
@@ -593,8 +708,12 @@ struct perturbations_workspace
   double S_fld;                /**< S quantity sourcing Gamma_prime evolution in PPF scheme (equivalent to eq. 15 in 0808.3125) */
   double Gamma_prime_fld;      /**< Gamma_prime in PPF scheme (equivalent to eq. 14 in 0808.3125) */
 
-  FILE * perturbations_output_file; /**< filepointer to output file*/
+  FILE * perturbations_output_file; /**< filepointer to output file, when the perturbations for k_output_values are streamed */
   int index_ikout;            /**< index for output k value (when k_output_values is set) */
+  double * stream_buffer;     /**< rows waiting to be written to perturbations_output_file */
+  int stream_buffer_rows;     /**< number of rows in stream_buffer */
+  int stream_row_size;        /**< number of doubles per row (number of titles of the current mode) */
+  int stream_buffer_size;     /**< allocated size of stream_buffer, in doubles */
 
   //@}
 
@@ -631,9 +750,24 @@ struct perturbations_workspace
 
   int max_l_max;    /**< maximum l_max for any multipole */
   double * s_l;     /**< array of freestreaming coefficients \f$ s_l = \sqrt{1-K*(l^2-1)/k^2} \f$*/
+  double * c_l_minus; /**< array of hierarchy coefficients \f$ l s_l/(2l+1) \f$ multiplying the multipole (l-1) in free-streaming equations */
+  double * c_l_plus;  /**< array of hierarchy coefficients \f$ (l+1) s_{l+1}/(2l+1) \f$ multiplying the multipole (l+1) in free-streaming equations */
+
+  //@}
+
+  /** @name - jacobians of the ndf15 evolver kept from one wavenumber to the next */
+
+  //@{
+
+  int jacobian_size;          /**< number of stored jacobians, one per approximation scheme met so far */
+  struct jacobian * jacobian; /**< stored jacobians */
+  int * jacobian_neq;         /**< number of equations of each stored jacobian */
+  int * jacobian_approx;      /**< approximation scheme of each stored jacobian: jacobian_approx[index_jac*ap_size+index_ap] */
 
   //@}
 
+  int derivs_calls; /**< number of calls to perturbations_derivs() with this workspace (for solver statistics) */
+
 };
 
 /**
@@ -656,6 +790,26 @@ struct perturbations_parameters_and_workspace {
 
 };
 
+/**
+ * Species seen by the right-hand side of the perturbation
+ * equations. The generic perturbations_derivs() copies them from the
+ * background structure at each call. The variants chosen by
+ * perturbations_derivs_select() get them as compile-time constants,
+ * so that the compiler drops the branches of absent species.
+ */
+
+struct perturbations_species {
+
+  short has_ncdm;   /**< presence of non-cold dark matter? */
+  short has_fld;    /**< presence of fluid? */
+  short has_scf;    /**< presence of scalar field? */
+  short has_idr;    /**< presence of interacting dark radiation? */
+  short has_idm_dr; /**< presence of dark matter interacting with dark radiation? */
+  short has_dcdm;   /**< presence of decaying cold dark matter? */
+  short has_dr;     /**< presence of its decay radiation? */
+
+};
+
 /*************************************************************************************************************/
 /* @cond INCLUDE_WITH_DOXYGEN */
 /*
@@ -674,6 +828,17 @@ extern "C" {
                              double * pvecsources
                              );
 
+  int perturbations_sources_at_tau_vec(
+                                       struct perturbations * ppt,
+                                       int index_md,
+                                       int index_ic,
+                                       int * tp_vec,
+                                       int tp_vec_size,
+                                       double * tau_vec,
+                                       int tau_vec_size,
+                                       double * psources
+                                       );
+
   int perturbations_output_data(
                           struct background * pba,
                           struct perturbations * ppt,
@@ -704,10 +869,88 @@ extern "C" {
                    struct perturbations * ppt
                    );
 
+  int perturbations_k_schedule(
+                               struct precision * ppr,
+                               struct thermodynamics * pth,
+                               struct perturbations * ppt,
+                               int index_md,
+                               int has_measured_cost,
+                               double * k_cost,
+                               int * k_order
+                               );
+
+  int perturbations_mpi_gather(
+                               struct perturbations * ppt,
+                               int index_md,
+                               int index_ic,
+                               int mpi_rank,
+                               int * k_rank,
+                               double * k_cost
+                               );
+
   int perturbations_free(
                    struct perturbations * ppt
                    );
 
+  int perturbations_cache_hash(
+                               const void * data,
+                               size_t size,
+                               unsigned long long * key
+                               );
+
+  int perturbations_cache_key(
+                              struct precision * ppr,
+                              struct background * pba,
+                              struct thermodynamics * pth,
+                              struct perturbations * ppt,
+                              unsigned long long * key
+                              );
+
+  int perturbations_cache_fetch(
+                                struct precision * ppr,
+                                unsigned long long key,
+                                struct perturbations * ppt,
+                                short * found
+                                );
+
+  int perturbations_cache_store(
+                                struct precision * ppr,
+                                unsigned long long key,
+                                struct perturbations * ppt
+                                );
+
+  int perturbations_cache_clear();
+
+  int perturbations_switches_init(
+                                  struct perturbations * ppt
+                                  );
+
+  int perturbations_switches_keep(
+                                  struct perturbations * ppt
+                                  );
+
+  int perturbations_switches_clear();
+
+  int perturbations_switch_bracket(
+                                   struct precision * ppr,
+                                   struct background * pba,
+                                   struct thermodynamics * pth,
+                                   struct perturbations * ppt,
+                                   int index_md,
+                                   double k,
+                                   struct perturbations_workspace * ppw,
+                                   int index_ap,
+                                   int index_switch,
+                                   int flag_ini,
+                                   double * lower_bound,
+                                   double * upper_bound
+                                   );
+
+  int perturbations_copy_sources(
+                                 struct perturbations * ppt_in,
+                                 struct perturbations * ppt_out
+                                 );
+
   int perturbations_indices(
                       struct precision * ppr,
                       struct background * pba,
@@ -721,6 +964,21 @@ extern "C" {
                                        struct thermodynamics * pth,
                                        struct perturbations * ppt
                                        );
+
+  int perturbations_timesampling_thinning(
+                                          struct precision * ppr,
+                                          struct perturbations * ppt
+                                          );
+
+  int perturbations_timesampling_curvature(
+                                           struct perturbations * ppt,
+                                           double * source,
+                                           int stride,
+                                           int index_tau,
+                                           double * abs_source,
+                                           double * abs_der2
+                                           );
+
   int perturbations_get_k_list(
                          struct precision * ppr,
                          struct background * pba,
@@ -743,6 +1001,26 @@ extern "C" {
                              struct perturbations_workspace * ppw
                              );
 
+  int perturbations_hierarchy_coefficients(
+                                           struct perturbations_workspace * ppw
+                                           );
+
+  int perturbations_workspace_jacobian(
+                                       struct perturbations * ppt,
+                                       struct perturbations_workspace * ppw,
+                                       struct jacobian ** jac
+                                       );
+
+  int perturbations_jacobian_pattern(
+                                     int neq,
+                                     int max_nonzero,
+                                     int * Ap,
+                                     int * Ai,
+                                     int * has_pattern,
+                                     void * parameters_and_workspace,
+                                     ErrorMsg error_message
+                                     );
+
   int perturbations_solve(
                     struct precision * ppr,
                     struct background * pba,
@@ -754,6 +1032,15 @@ extern "C" {
                     struct perturbations_workspace * ppw
                     );
 
+  int perturbations_solver_statistics_fill(
+                                           struct background * pba,
+                                           struct perturbations * ppt,
+                                           int index_md,
+                                           struct perturbations_workspace * ppw,
+                                           int * stepstat,
+                                           struct perturbations_solver_statistics * pss
+                                           );
+
   int perturbations_prepare_k_output(
                                struct background * pba,
                                struct perturbations * ppt
@@ -779,6 +1066,7 @@ extern "C" {
                                           struct thermodynamics * pth,
                                           struct perturbations * ppt,
                                           int index_md,
+                                          int index_k,
                                           double k,
                                           struct perturbations_workspace * ppw,
                                           double tau_ini,
@@ -868,6 +1156,32 @@ extern "C" {
                       ErrorMsg error_message
                       );
 
+  int perturbations_stream_open(
+                                struct perturbations * ppt,
+                                int index_md,
+                                int index_ic,
+                                struct perturbations_workspace * ppw
+                                );
+
+  int perturbations_stream_flush(
+                                 struct perturbations_workspace * ppw,
+                                 ErrorMsg error_message
+                                 );
+
+  int perturbations_stream_close(
+                                 struct perturbations * ppt,
+                                 struct perturbations_workspace * ppw
+                                 );
+
+  int perturbations_output_row(
+                               struct perturbations_workspace * ppw,
+                               double ** data,
+                               int * size_data,
+                               int row_size,
+                               double ** dataptr,
+                               ErrorMsg error_message
+                               );
+
   int perturbations_print_variables(
                               double tau,
                               double * y,
@@ -884,6 +1198,12 @@ extern "C" {
                      ErrorMsg error_message
                      );
 
+  int perturbations_derivs_select(
+                            struct precision * ppr,
+                            struct background * pba,
+                            int (**derivs)()
+                            );
+
   int perturbations_tca_slip_and_shear(
                                  double * y,
                                  void * parameters_and_workspace,
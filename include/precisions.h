@@ -13,6 +13,37 @@ class_precision_parameter(a_ini_over_a_today_default,double,1.e-14)
  * Number of background integration steps that are stored in the output vector
  */
 class_precision_parameter(background_Nloga,int,3000)
+/**
+ * If _TRUE_, the background table computed on the background_Nloga
+ * values is thinned by background_table_thin(): only the values of
+ * loga needed to interpolate all background quantities to a relative
+ * accuracy tol_background_table are kept.
+ */
+class_precision_parameter(background_table_adaptive,int,_FALSE_)
+/**
+ * Relative accuracy of the spline interpolation of background
+ * quantities in the thinned background table
+ */
+class_precision_parameter(tol_background_table,double,1.e-8)
+/**
+ * Initial spacing (in number of values out of background_Nloga)
+ * between the values of loga kept in the thinned background table,
+ * before refinement
+ */
+class_precision_parameter(background_table_stride,int,64)
+/**
+ * If _TRUE_, models in which all densities are known in closed form
+ * (no ncdm, dcdm, dr, scf, and no fluid other than CLP or Cardassian) skip the
+ * background evolver: tau, t and rs are obtained by quadrature on the
+ * loga values of the background table, and the growth factor by a
+ * fixed-step integration
+ */
+class_precision_parameter(background_quadrature,int,_TRUE_)
+/**
+ * Number of fixed steps per interval of the background table used for
+ * the growth factor when background_quadrature is _TRUE_
+ */
+class_precision_parameter(background_quadrature_substeps,int,1)
 /**
  * Evolver to be used for thermodynamics (rk, ndf15)
  */
@@ -66,6 +97,30 @@ class_precision_parameter(tol_ncdm_bg,double,1.e-5)
  * Using w = pressure/density, this quantifies the maximum deviation from 1/3. (for relativistic species)
  */
 class_precision_parameter(tol_ncdm_initial_w,double,1.e-3)
+/**
+ * If _TRUE_, the momentum quadratures of ncdm species found by
+ * background_ncdm_init() are kept in memory, and reused by later runs
+ * in the same process with the same distribution function and
+ * tolerances.
+ */
+class_precision_parameter(ncdm_quadrature_cache,int,_TRUE_)
+/**
+ * If _TRUE_, the momentum integrals giving the density, pressure and
+ * pseudo-pressure of each ncdm species are tabulated once as a
+ * function of y=m/T in background_init(), and interpolated in
+ * background_functions() instead of being summed over momenta at
+ * each call.
+ */
+class_precision_parameter(ncdm_bg_tabulate,int,_FALSE_)
+/**
+ * Number of points per decade of y=m/T in the tables of ncdm integrals
+ */
+class_precision_parameter(ncdm_bg_table_points_per_decade,double,100.)
+/**
+ * Smallest value of y=m/T in the tables of ncdm integrals. Below it,
+ * the integrals are given by their expansion to second order in y.
+ */
+class_precision_parameter(ncdm_bg_table_y_min,double,1.e-3)
 /**
  * Tolerance on the deviation of the conformal time of equality from the true value in 1/Mpc.
  */
@@ -88,6 +143,25 @@ class_precision_parameter(tol_shooting_deltaF,double,1.e-6)
  * Relative tolerance of root x during shooting (only 1D case)
  */
 class_precision_parameter(tol_shooting_deltax_rel,double,1.e-5)
+/**
+ * If _TRUE_, a one-dimensional shooting starts from the solution of the
+ * previous shooting for the same target in the same thread (shifted
+ * according to the change of the target value), and refines it with
+ * secant steps, instead of bracketing the root from the analytic guess
+ * (useful for neighbouring points of a Monte Carlo chain). The unknown
+ * parameter found then depends on the previous run within
+ * tol_shooting_deltax_rel, so that the results depend on the order of
+ * the runs, and with class_grid -j on the scheduling of the points.
+ */
+class_precision_parameter(shooting_warm_start,int,_FALSE_)
+/**
+ * If _TRUE_, the background and thermodynamics structures computed at
+ * the converged step of the shooting are handed over to
+ * background_init() and thermodynamics_init() instead of being computed
+ * again. The shooting steps then use the full thermodynamics sampling
+ * (thermo_Nz_lin, thermo_Nz_log), so that the results are unchanged.
+ */
+class_precision_parameter(shooting_reuse_structures,int,_FALSE_)
 /*
  * Currently unused parameter.
  */
@@ -209,6 +283,35 @@ class_precision_parameter(recfast_z_switch_late,double,800.)
  */
 
 class_string_parameter(hyrec_path,"/external/HyRec2020/","hyrec_path") /**< Path to hyrec */
+/**
+ * If _TRUE_, the HyRec rate tables are memory-mapped from the binary
+ * file hyrec_binary_tables_file, which is first written from the text
+ * tables in hyrec_path if it does not exist or has the wrong format
+ */
+class_precision_parameter(hyrec_binary_tables,int,_FALSE_)
+class_string_parameter(hyrec_binary_tables_file,"/external/HyRec2020/hyrec_tables.bin","hyrec_binary_tables_file")
+
+/*
+ * Recombination emulator parameters
+ */
+
+/**
+ * Grid of recombination histories interpolated when
+ * 'recombination_emulator = yes', as written by test/test_recombination_emulator.c
+ */
+class_string_parameter(recombination_emulator_file,"/external/HyRec2020/recombination_emulator.dat","recombination_emulator_file")
+/**
+ * With 'recombination_emulator_check = yes', largest relative
+ * difference on x_e or T_b allowed between the emulated and full histories
+ */
+class_precision_parameter(tol_recombination_emulator,double,1.e-3)
+/**
+ * If _TRUE_, the recombination history above the start of reionization
+ * is kept in memory, and reused by the next run if it only differs by
+ * its reionization parameters (z_reio, tau_reio, ...); only the
+ * reionization interval is then integrated again
+ */
+class_precision_parameter(thermodynamics_recombination_cache,int,_TRUE_)
 
 /*
  * Reionization parameters
@@ -225,6 +328,15 @@ class_precision_parameter(reionization_start_factor,double,8.0) /**< Searching o
 
 class_string_parameter(chi_z_Galli,"/external/heating/Galli_et_al_2013.dat","Galli_file") /**< File containing the chi approximation according to Galli et al 2013 */
 class_precision_parameter(z_start_chi_approx,double,2.0e3) /**< Switching redshift from full heating to chosen approx for deposition function */
+/**
+ * If _TRUE_, the splined tables read from the f_eff and chi files are
+ * kept in memory for later runs (until the file is modified), and so
+ * is the PBH mass evolution as long as the background and the PBH mass
+ * do not change, and the integrals over k of the non-injected acoustic
+ * dissipation as long as the primordial spectrum and the damping scale
+ * do not change
+ */
+class_precision_parameter(injection_cache,int,_TRUE_)
 
 /*
  * Perturbation parameters
@@ -298,6 +410,14 @@ class_precision_parameter(perturbations_integration_stepsize,double,0.5)
  * default step \f$ d \tau \f$ for sampling the source function, in units of the timescale involved in the sources: \f$ (\dot{\kappa}- \ddot{\kappa}/\dot{\kappa})^{-1} \f$
  */
 class_precision_parameter(perturbations_sampling_stepsize,double,0.1)
+/**
+ * if non-zero, once source functions are computed, remove from their time
+ * sampling all points that are not needed to keep the error of linear
+ * interpolation between neighbouring points below this value (relative
+ * to the local maximum of each source function, estimated from its
+ * second derivative)
+ */
+class_precision_parameter(tol_perturbations_sampling,double,0.)
 /**
  * control parameter for the precision of the perturbation integration,
  * IMPORTANT FOR SETTING THE STEPSIZE OF NDF15
@@ -316,6 +436,25 @@ class_precision_parameter(c_gamma_k_H_square_max,double,1.0e3)
  * approximations must be switched on/off (units of Mpc)
  */
 class_precision_parameter(tol_tau_approx,double,1.0e-10)
+/**
+ * Whether the times of the approximation switches found for each
+ * wavenumber are kept for the next run in the same process, which
+ * then looks for each switch in a narrow bracket around the time found
+ * at the closest wavenumber, before falling back to the bisection over
+ * the whole integration range if this bracket does not contain it.
+ * When an approximation can switch more than once in the integration
+ * range (e.g. around reionization), the bracket may select a different
+ * switch than the full bisection: the results of a run then depend on
+ * the run computed before it in the process (for concurrent runs, on
+ * their scheduling), at the level of 1e-5 on the spectra. Off by
+ * default, also in class_grid and class_server.
+ */
+class_precision_parameter(perturbations_switch_warm_start,int,_FALSE_)
+/**
+ * relative half-width of the bracket around the switch time of the
+ * previous run, when perturbations_switch_warm_start is set
+ */
+class_precision_parameter(perturbations_switch_bracket,double,0.02)
 /**
  * method for switching off photon perturbations
  */
@@ -357,9 +496,41 @@ class_precision_parameter(ncdm_fluid_trigger_tau_over_tau_k,double,31.0)
  */
 class_precision_parameter(neglect_CMB_sources_below_visibility,double,1.0e-3)
 /**
- * The type of evolver to use: options are ndf15 or rk
+ * The type of evolver to use: options are ndf15, rk or rosenbrock
  */
 class_type_parameter(evolver,int,enum evolver_type,ndf15)
+/**
+ * Whether the rk evolver (when selected for the background,
+ * thermodynamics or perturbations) should keep its natural step size
+ * and interpolate the solution at output times, instead of shortening
+ * its steps to land on each of them
+ */
+class_precision_parameter(evolver_rk_dense_output,int,_FALSE_)
+/**
+ * Whether the ndf15 evolver should use the sparsity pattern of the
+ * scalar perturbation equations known from their structure, instead of
+ * inferring it from a few dense numerical jacobians
+ */
+class_precision_parameter(perturbations_jacobian_pattern,int,_TRUE_)
+/**
+ * Whether the ndf15 evolver should keep the jacobian structure (sparsity
+ * pattern, column grouping) of the previous wavenumber solved
+ * by the same thread
+ */
+class_precision_parameter(perturbations_reuse_jacobian,int,_TRUE_)
+/**
+ * Whether the perturbation equations should use a version of
+ * perturbations_derivs() compiled for the species present (LCDM,
+ * LCDM+ncdm, LCDM+fld), when there is one, rather than the generic one
+ */
+class_precision_parameter(perturbations_specialised_derivs,int,_TRUE_)
+/**
+ * Number of source tables kept in memory by perturbations_init(), so
+ * that a later run with identical precision parameters, perturbation
+ * settings, background and thermodynamics can skip the integration of
+ * the perturbations (0 to disable, at most _PERTURBATIONS_CACHE_MAX_)
+ */
+class_precision_parameter(perturbations_cache_size,int,0)
 
 /*
  * Primordial parameters
@@ -390,6 +561,8 @@ class_precision_parameter(primordial_inflation_extra_efolds,double,2.0) /**< a s
 
 class_precision_parameter(l_linstep,int,40) /**< factor for logarithmic spacing of values of l over which bessel and transfer functions are sampled */
 
+class_precision_parameter(l_stride_smooth,int,1) /**< the transfer functions of the CMB lensing potential (when neither temperature, polarization nor number counts are requested) and of galaxy lensing (when number counts are not requested) only enter spectra that are smooth in l: in the part of the l list with linear spacing, they are computed for one value out of l_stride_smooth, and their C_l's are interpolated at the others */
+
 class_precision_parameter(l_logstep,double,1.12) /**< maximum spacing of values of l over which Bessel and transfer functions are sampled (so, spacing becomes linear instead of logarithmic at some point) */
 
 class_precision_parameter(hyper_x_min,double,1.0e-5)  /**< flat case: lower bound on the smallest value of x at which we sample \f$ \Phi_l^{\nu}(x)\f$ or \f$ j_l(x)\f$ */
@@ -400,6 +573,21 @@ class_precision_parameter(hyper_nu_sampling_step,double,1000.0)  /**< open/close
 class_precision_parameter(hyper_phi_min_abs,double,1.0e-10)  /**< small value of Bessel function used in calculation of first point x (\f$ \Phi_l^{\nu}(x) \f$ equals hyper_phi_min_abs) */
 class_precision_parameter(hyper_x_tol,double,1.0e-4)  /**< tolerance parameter used to determine first value of x */
 class_precision_parameter(hyper_flat_approximation_nu,double,4000.0)  /**< value of nu below which the flat approximation is used to compute Bessel function */
+/**
+ * Number of tables of hyperspherical Bessel functions kept in memory,
+ * so that later runs in the same process with the same l list, x grid
+ * and precision read them instead of computing them (0 to disable, at
+ * most _HYPER_CACHE_MAX_; the curved cases need one table per
+ * wavenumber)
+ */
+class_precision_parameter(hyper_cache_size,int,0)
+/**
+ * If _TRUE_, the same tables are also written to and memory-mapped
+ * from files in hyper_cache_directory, shared by all runs on a node
+ */
+class_precision_parameter(hyper_cache_use_file,int,_FALSE_)
+class_string_parameter(hyper_cache_directory,"/hyper_cache","hyper_cache_directory") /**< directory of the files written when hyper_cache_use_file is _TRUE_ */
+class_precision_parameter(hyper_cache_xmax_step,double,0.05) /**< when tables are cached, the largest x of the flat table is rounded up to a multiple of this step in log(x) */
 
 class_precision_parameter(q_linstep,double,0.45)         /**< asymptotic linear sampling step in q
                                space, in units of \f$ 2\pi/r_a(\tau_rec) \f$
@@ -446,6 +634,8 @@ class_precision_parameter(transfer_neglect_delta_k_T_t2,double,0.2) /**< same fo
 class_precision_parameter(transfer_neglect_delta_k_T_e,double,0.25)  /**< same for polarization source function E of tensor mode */
 class_precision_parameter(transfer_neglect_delta_k_T_b,double,0.1)  /**< same for polarization source function B of tensor mode */
 
+class_precision_parameter(transfer_neglect_statistics,int,_FALSE_) /**< diagnostic mode: compute all the integrals cut by transfer_can_be_neglected(), count them, print the fraction of the integral over ln(k) of the squared transfer functions that they carry, and cut them only after that (results are unchanged, but the transfer module is slower) */
+class_precision_parameter(transfer_neglect_budget,double,0.) /**< with transfer_neglect_statistics, if positive: instead of transfer_neglect_delta_k_*, cut the integrals with the smallest delta_k (printed, to be used in production runs) such that, for each type and multipole, the cut part carries at most this fraction of the integral over ln(k) of the squared transfer function */
 class_precision_parameter(transfer_neglect_late_source,double,400.0)  /**< value of l below which the CMB source functions can be neglected at late time, excepted when there is a Late ISW contribution */
 
 class_precision_parameter(l_switch_limber,double,10.) /**< when to use the Limber approximation for project gravitational potential cl's */
@@ -467,11 +657,38 @@ class_precision_parameter(selection_sampling_bessel,double,20.0)/**< controls sa
 class_precision_parameter(selection_sampling_bessel_los,double,ppr->selection_sampling_bessel)/**< controls sampling of integral over time when selection functions vary slower than Bessel functions. This parameter is specific to number counts contributions to Cl integrated along the line of sight. Increase for better sampling */
 class_precision_parameter(selection_tophat_edge,double,0.1) /**< controls how smooth are the edge of top-hat window function (<<1 for very sharp, 0.1 for sharp) */
 
+class_precision_parameter(transfer_sources_k_major,int,_TRUE_) /**< keep a copy of the perturbation sources and of their second derivatives in k interleaved and ordered by wavenumber, then time, so that their interpolation at a given wavenumber reads contiguous memory. Results do not depend on this choice */
+
+class_precision_parameter(transfer_fuse_nc_bins,int,_TRUE_) /**< in the flat case, compute the transfer functions of all the local number count contributions (density, rsd, doppler, gr) of a bin together, with one interpolation of the Bessel functions for all of them. Results do not depend on this choice */
+
+class_precision_parameter(transfer_stream_l_block_size,int,0) /**< if positive, transfer_init() only prepares the calculation, and the transfer functions are computed by blocks of this number of multipoles during harmonic_init(), each block being integrated over k and then overwritten by the next one. This reduces the memory used by the table of transfer functions, but ptr->transfer only contains the last block after harmonic_init(): do not use when the transfer functions themselves are needed */
+
+class_precision_parameter(transfer_l_block_size,int,0) /**< number of multipoles per task in the parallel loop of the transfer module. If 0, each task deals with one wavenumber, unless in the flat case there are too few wavenumbers for all threads: then tasks deal with one wavenumber, one type and a block of multipoles. Results do not depend on this choice */
+
+class_precision_parameter(transfer_single_precision,int,_FALSE_) /**< store the table of transfer functions Delta_l(q) in single precision, halving its size (useful with many number count bins); transfer functions are still computed in double precision */
+/**
+ * Number of tables of transfer functions kept in memory by
+ * transfer_init(), so that a later run in the same process with
+ * identical source functions, non-linear corrections and transfer
+ * settings (e.g. when only primordial parameters change, or when a
+ * point is computed again) skips the line-of-sight integrals (0 to
+ * disable, at most _TRANSFER_CACHE_MAX_; not used when transfer
+ * functions are streamed or with transfer_neglect_statistics)
+ */
+class_precision_parameter(transfer_cache_size,int,0)
+
+class_precision_parameter(harmonic_matrix_integration,int,_FALSE_) /**< compute the integrals over k of the C_l's with harmonic_cls_l_range_matrix(): for each multipole, the combinations of transfer functions entering all types of C_l's are stored as a (fields x k) matrix, and all the C_l's follow from one weighted matrix product. Results agree with the default path up to rounding errors */
+
+class_precision_parameter(harmonic_l_block_size,int,8) /**< number of consecutive multipoles per task in the parallel loop of harmonic_cls_l_range_matrix() */
+
+class_precision_parameter(harmonic_offload,int,_FALSE_) /**< compute the integrals over k of the C_l's with harmonic_cls_l_range_offload(), in OpenMP target regions that run on an accelerator when CLASS is compiled with offloading (see the Makefile), or on the host threads otherwise. Results agree with the default path up to rounding errors */
+
 /*
  * Nonlinear module precision parameters
  * */
 
 class_precision_parameter(sigma_k_per_decade,double,80.) /**< logarithmic stepsize controlling the precision of integrals for sigma(R,k) and similar quantitites */
+class_precision_parameter(sigma_fftlog,int,_FALSE_) /**< compute sigma(R), sigma'(R) and sigma_disp(R) with the FFTLog method, for all radii of a logarithmic grid at once (one transform per redshift), and interpolate them: used for sigma8, for fourier_sigmas_at_rvec_and_z() and for the tables of sigma(R) of HMcode. Radii below _SIGMA_FFTLOG_KR_MIN_/k_max or above 1/k_min are still integrated directly */
 
 class_precision_parameter(fourier_min_k_max,double,20.0) /**< when
                                using an algorithm to compute nonlinear
@@ -541,6 +758,24 @@ class_precision_parameter(nsteps_for_p1h_integral,int,256)
 class_precision_parameter(mmin_for_p1h_integral,double,1.e3)
 class_precision_parameter(mmax_for_p1h_integral,double,1.e18)
 
+/**
+ * number of points per decade, in k r_s and in c, of the table of the
+ * Fourier transformed NFW profile used in the 1-halo integral, in the
+ * range where it does not oscillate (k r_v below
+ * _HMCODE_NFW_TABLE_KRV_MAX_). The interpolation error is about 1e-7
+ * for 50 points per decade. If 0, the window is always computed from
+ * sine and cosine integrals
+ */
+class_precision_parameter(hmcode_nfw_points_per_decade,int,50)
+/**
+ * If _TRUE_, the tables of sigma(R) and the sigma's of HMcode at each
+ * time are kept in memory, so that later runs in the same process
+ * (e.g. from classy or ClassEngine) with the same linear spectra, as
+ * when only the baryonic feedback parameters change, only redo the
+ * 1-halo and 2-halo terms
+ */
+class_precision_parameter(hmcode_cache,int,_FALSE_)
+
 
 /*
  * Lensing precision parameters
@@ -549,6 +784,40 @@ class_precision_parameter(mmax_for_p1h_integral,double,1.e18)
 class_precision_parameter(accurate_lensing,int,_FALSE_) /**< switch between Gauss-Legendre quadrature integration and simple quadrature on a subdomain of angles */
 class_precision_parameter(num_mu_minus_lmax,int,70) /**< difference between num_mu and l_max, increase for more precision */
 class_precision_parameter(delta_l_max,int,500)/**< difference between l_max in unlensed and lensed spectra */
+class_precision_parameter(lensing_mu_block_size,int,0) /**< if positive, the Wigner d-functions of the lensing module are computed by blocks of this number of values of mu, and the correlation functions and lensed C_l's are accumulated block by block, so that only O(l_max x lensing_mu_block_size) memory is needed for them instead of O(l_max x num_mu). Results do not depend on this choice */
+class_precision_parameter(lensing_fused,int,_FALSE_) /**< if _TRUE_, the lensed C_l's are computed by a fused kernel: a single parallel region over mu, in which each thread computes all the Wigner d-functions at its value of mu and uses them at once for Cgl, Cgl2, sigma2, the correlation functions and their contribution to the lensed C_l's. Only O(l_max x number of threads) memory is then needed for the d-functions, and lensing_mu_block_size is ignored. Results only differ from the default method by the order in which the contributions of the threads are summed */
+/**
+ * If _TRUE_, the Gauss-Legendre nodes and weights and the Wigner
+ * d-functions of the lensing module, which only depend on
+ * l_unlensed_max, num_mu_minus_lmax, accurate_lensing and
+ * tol_gauss_legendre, are kept in memory, so that later runs in the
+ * same process with the same values (e.g. from classy or ClassEngine)
+ * only redo the accumulation of the correlation functions and lensed
+ * C_l's. The d-functions are then all held at once, as with the default
+ * lensing_mu_block_size; the cache is not used by the fused kernel
+ */
+class_precision_parameter(lensing_d_cache,int,_FALSE_)
+/**
+ * If _TRUE_, the same tables are also written to and memory-mapped
+ * from files in lensing_d_cache_directory, shared by all runs on a node
+ */
+class_precision_parameter(lensing_d_cache_use_file,int,_FALSE_)
+class_string_parameter(lensing_d_cache_directory,"/lensing_cache","lensing_d_cache_directory") /**< directory of the files written when lensing_d_cache_use_file is _TRUE_ */
+/**
+ * If _TRUE_, the lensing module keeps in memory the linear response of
+ * the lensed C_l's to the unlensed ones and to C_l^phiphi, around the
+ * spectra of its last exact computation. A later run with the same
+ * multipoles and values of mu, whose unlensed TT, EE and phiphi spectra
+ * differ from these fiducial ones by less than
+ * lensing_response_tolerance (maximum relative difference over l), is
+ * then relensed at first order from these responses, without computing
+ * the d-functions and correlation functions again. Otherwise, the exact
+ * computation is done and gives the new fiducial spectra; it then uses
+ * neither the fused kernel nor lensing_mu_block_size, and the responses
+ * take about 10 x l_max x num_mu doubles of memory
+ */
+class_precision_parameter(lensing_response,int,_FALSE_)
+class_precision_parameter(lensing_response_tolerance,double,0.05) /**< largest relative change of the unlensed spectra for which the lensed ones are obtained from the responses */
 class_precision_parameter(tol_gauss_legendre,double,ppr->smallest_allowed_variation) /**< tolerance with which quadrature points are found: must be very small for an accurate integration (if not entered manually, set automatically to match machine precision) */
 
 /*
@@ -570,6 +839,28 @@ class_precision_parameter(tol_sd_detector,double,1.e-5)
 
 class_string_parameter(sd_external_path,"/external/distortions","sd_external_path")
 
+/**
+ * Should the splined branching ratios and spectral shapes of the
+ * detector be mapped from a binary file written next to the text files
+ * in sd_external_path (which is first written if it does not exist or
+ * does not match the text file)?
+ */
+class_precision_parameter(sd_binary_tables,int,_FALSE_)
+
+/*
+ * Parallelization
+ */
+
+/**
+ * Number of OpenMP threads of the parallel regions of a run. If 0, the
+ * OpenMP default is kept (e.g. the value of OMP_NUM_THREADS). This is
+ * applied by the caller (main(), classy, ClassEngine) to the thread
+ * that performs the run only, so that runs performed concurrently by
+ * other threads may each use their own number. Results do not depend
+ * on this choice.
+ */
+class_precision_parameter(num_threads,int,0)
+
 
 #undef class_precision_parameter
 #undef class_string_parameter
@@ -69,6 +69,14 @@ enum inflation_module_behavior {
   analytical
 };
 
+/** enum specifying how the command of the external_Pk mode passes its table */
+
+enum external_Pk_protocol {
+  external_text,   /**< launched at each run, writes lines of text */
+  external_binary, /**< launched at each run, writes doubles in binary */
+  external_worker  /**< launched once, answers each request with doubles in binary */
+};
+
 /**
  * Structure containing everything about primordial spectra that other modules need to know.
  *
@@ -198,6 +206,9 @@ struct primordial {
   double custom9;  /**< one parameter of the primordial computed in 'external_Pk' */
   double custom10; /**< one parameter of the primordial computed in 'external_Pk' */
 
+  enum external_Pk_protocol external_protocol; /**< how the command passes its table */
+  short external_cache; /**< if _TRUE_, keep the table in memory and reuse it while the command and the custom parameters are unchanged */
+
   //@}
 
   /** @name - pre-computed table of primordial spectra, and related quantities */
@@ -329,6 +340,37 @@ struct primordial_inflation_parameters_and_workspace {
 };
 
 
+/**
+ * Table of the external_Pk mode kept in memory for the next runs, with
+ * the command and the custom parameters from which it was obtained.
+ */
+
+struct primordial_external_cache {
+
+  short is_filled;   /**< _TRUE_ once a run has stored its table */
+
+  /** @name - key of the cached table */
+
+  //@{
+
+  char * command;    /**< command generating the table */
+  double custom[10]; /**< values of custom1 to custom10 */
+  short has_tensors; /**< whether the table has a tensor column */
+
+  //@}
+
+  /** @name - cached table */
+
+  //@{
+
+  int lnk_size;      /**< number of ln(k) values */
+  double * lnk;      /**< lnk[index_k] */
+  double * lnpk_s;   /**< ln of the scalar spectrum, lnpk_s[index_k] */
+  double * lnpk_t;   /**< ln of the tensor spectrum, lnpk_t[index_k] (if has_tensors) */
+
+  //@}
+};
+
 /*************************************************************************************************************/
 /* @cond INCLUDE_WITH_DOXYGEN */
 /*
@@ -346,6 +388,15 @@ extern "C" {
                                double * pk
                                );
 
+  int primordial_spectrum_at_k_array(
+                                     struct primordial * ppm,
+                                     int index_md,
+                                     enum linear_or_logarithmic mode,
+                                     double * input,
+                                     int input_size,
+                                     double * output
+                                     );
+
   int primordial_init(
                       struct precision  * ppr,
                       struct perturbations   * ppt,
@@ -426,7 +477,7 @@ extern "C" {
                                           struct perturbations * ppt,
                                           struct primordial * ppm,
                                           struct precision * ppr,
-                                          double * y_ini,
+                                          double * y_start,
                                           int index_k
                                           );
 
@@ -506,6 +557,8 @@ extern "C" {
                                         struct primordial * ppm
                                         );
 
+  int primordial_external_spectrum_clear();
+
   int primordial_output_titles(struct perturbations * ppt,
                                struct primordial * ppm,
                                char titles[_MAXTITLESTRINGLENGTH_]
@@ -40,6 +40,7 @@ typedef struct adaptive_integration_tree_node{
 			int (*test)(void * params_for_function, double q, double *psi),
 			int (*function)(void * params_for_function, double q, double *f0),
 			void * params_for_function,
+			int parallel_adapt,
 			ErrorMsg errmsg);
        int get_qsampling_manual(double *x,
 				double *w,
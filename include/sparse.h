@@ -30,6 +30,9 @@ typedef struct sparse_numerical{
 	int *q;			/* Column permutation */
 	int *wamd;		/* Work array for sp_amd */
 	double *w;		/* Work array for sp_lu */
+	/* Symbolic factorisation, reusable as long as the sparsity pattern does not change: */
+	int has_ordering;	/* True if q holds a column ordering computed for the current pattern. */
+	int has_symbolic;	/* True if xi, topvec, pinv and p hold a factorisation of the current pattern, so that sp_refactor can be used. */
 } sp_num;
 
 
@@ -49,7 +52,8 @@ void dfsr(int j, sp_mat *G, int *top, int *xik, int *pinv);
 int sp_splsolve(sp_mat *G, sp_mat *B, int k, int*xik, int top, double *x, int *pinv);
 int sp_ludcmp(sp_num *N, sp_mat *A, double pivtol);
 int sp_lusolve(sp_num *N, double *b, double *x);
-int sp_refactor(sp_num *N, sp_mat *A);
+int sp_refactor(sp_num *N, sp_mat *A, double pivtol);
+int sp_num_invalidate(sp_num *N);
 int column_grouping(sp_mat *G, int *col_g, int *col_wi);
 int sp_amd(int *Cp, int *Ci, int n, int cnzmax, int *P, int *W);
 int sp_wclear(int mark, int lemax, int *w, int n);
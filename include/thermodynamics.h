@@ -6,6 +6,7 @@
 #include "background.h"
 #include "evolver_ndf15.h"
 #include "evolver_rkck.h"
+#include "evolver_rosenbrock.h"
 #include "wrap_hyrec.h"
 #include "wrap_recfast.h"
 #include "injection.h"
@@ -164,6 +165,12 @@ struct thermodynamics
   double annihilation_f_halo; /**< takes the contribution of DM annihilation in halos into account*/
   double annihilation_z_halo; /**< characteristic redshift for DM annihilation in halos*/
 
+  /** parameters for the recombination emulator */
+
+  short has_recombination_emulator; /**< do we want to interpolate x_e(z) and T_b(z) above the start of reionization in the grid ppr->recombination_emulator_file, instead of integrating the recombination equations? */
+
+  short recombination_emulator_check; /**< if has_recombination_emulator is true: do we want to run the full calculation anyway, and compare it with the interpolated history? */
+
   double a_idm_dr;      /**< strength of the coupling between interacting dark matter and interacting dark radiation (idm-idr) */
   double b_idr;         /**< strength of the self coupling for interacting dark radiation (idr-idr) */
   double nindex_idm_dr; /**< temperature dependence of the interaction between dark matter and dark radiation */
@@ -274,6 +281,9 @@ struct thermodynamics
   double fHe;  /**< \f$ f_{He} \f$: primordial helium-to-hydrogen nucleon ratio 4*n_He/n_H */
   double n_e;  /**< total number density of electrons today (free or not) */
 
+  short recombination_emulated;        /**< _TRUE_ if the recombination history above the start of reionization was interpolated by the emulator */
+  double recombination_emulator_error; /**< if recombination_emulator_check is true: largest relative difference on x_e or T_b between the emulated and full histories (-1 if it could not be computed) */
+
   //@}
 
   /**
@@ -291,6 +301,8 @@ struct thermodynamics
 
   //@{
 
+  short is_from_shooting; /**< flag set by input_shooting() when this structure was computed at the converged step of the shooting: thermodynamics_init() then has nothing left to compute */
+
   short thermodynamics_verbose; /**< flag regulating the amount of information sent to standard output (none if set to zero) */
   short hyrec_verbose; /**< flag regulating the amount of information sent to standard output from hyrec (none if set to zero) */
 
@@ -306,6 +318,55 @@ struct thermodynamics
  * on: thus they cannot be accessed by other modules.
  */
 
+#define _RECOMBINATION_EMULATOR_AXES_ 4 /**< number of parameters of the recombination emulator grid: omega_b, omega_cdm, YHe, N_eff */
+#define _RECOMBINATION_EMULATOR_CORNERS_ 16 /**< number of grid nodes entering one multilinear interpolation (2^_RECOMBINATION_EMULATOR_AXES_) */
+
+/**
+ * Grid of recombination histories read from ppr->recombination_emulator_file
+ * and interpolated by the emulator, kept in memory by
+ * thermodynamics_emulator_load() for later runs
+ */
+
+struct recombination_emulator {
+
+  FileName file;                                /**< file from which the grid was read */
+
+  enum recombination_algorithm recombination;  /**< recombination code used to compute the grid */
+  double T_cmb;                                 /**< CMB temperature today used to compute the grid */
+
+  int axis_size[_RECOMBINATION_EMULATOR_AXES_]; /**< number of nodes along (omega_b, omega_cdm, YHe, N_eff) */
+  double * axis[_RECOMBINATION_EMULATOR_AXES_]; /**< growing values of the nodes along each of these directions */
+  int node_size;                                /**< total number of nodes */
+
+  int z_size;                                   /**< number of redshifts */
+  double * z;                                   /**< growing values of the redshifts */
+
+  double * lnxe;                                /**< ln(x_e) at each node and redshift, lnxe[index_node*z_size+index_z] */
+  double * lnTb;                                /**< ln(T_b) at each node and redshift (same layout) */
+  double * dTb;                                 /**< dT_b/dz at each node and redshift (same layout) */
+
+};
+
+/**
+ * Table of primordial helium fractions YHe(omega_b, Delta N_eff)
+ * from BBN, read from ppr->sBBN_file by thermodynamics_bbn_load()
+ */
+
+struct bbn_table {
+
+  FileName file;       /**< file from which the table was read */
+  long long bytes;     /**< size of this file when it was read */
+  long long mtime;     /**< modification time of this file when it was read */
+
+  int num_omegab;      /**< number of values of omega_b */
+  int num_deltaN;      /**< number of values of Delta N_eff */
+  double * omegab;     /**< growing values of omega_b */
+  double * deltaN;     /**< growing values of Delta N_eff */
+  double * YHe;        /**< YHe[index_deltaN*num_omegab+index_omegab] */
+  double * ddYHe;      /**< second derivative of YHe along Delta N_eff (same layout) */
+
+};
+
 /**
  * Vector of thermodynamical quantities to integrate over, and indices of this vector
  */
@@ -467,6 +528,15 @@ extern "C" {
                           double * pvecback,
                           double * pvecthermo);
 
+  int thermodynamics_at_z_columns(struct background * pba,
+                                  struct thermodynamics * pth,
+                                  double z,
+                                  int * columns,
+                                  int columns_size,
+                                  int * last_index,
+                                  double * pvecback,
+                                  double * pvecthermo);
+
   int thermodynamics_init(struct precision * ppr,
                           struct background * pba,
                           struct thermodynamics * pth);
@@ -597,6 +667,75 @@ extern "C" {
                                            struct thermo_reionization_parameters * preio,
                                            double * x);
 
+  int thermodynamics_bbn_load(struct precision * ppr,
+                              struct thermodynamics * pth,
+                              struct bbn_table ** ppbbn);
+
+  int thermodynamics_bbn_clear();
+
+  int thermodynamics_emulator_load(struct precision * ppr,
+                                   struct thermodynamics * pth,
+                                   struct recombination_emulator ** pprem);
+
+  int thermodynamics_emulator_clear();
+
+  int thermodynamics_emulator_weights(struct background * pba,
+                                      struct thermodynamics * pth,
+                                      struct recombination_emulator * prem,
+                                      double z_min,
+                                      int * node,
+                                      double * weight,
+                                      short * is_inside);
+
+  int thermodynamics_emulator_at_z(struct recombination_emulator * prem,
+                                   int * node,
+                                   double * weight,
+                                   double z,
+                                   int * last_index,
+                                   double * x,
+                                   double * Tmat,
+                                   double * dTmat);
+
+  int thermodynamics_emulator_solve(struct precision * ppr,
+                                    struct background * pba,
+                                    struct thermodynamics * pth,
+                                    struct thermo_workspace * ptw,
+                                    short * emulated);
+
+  int thermodynamics_emulator_check(struct precision * ppr,
+                                    struct background * pba,
+                                    struct thermodynamics * pth,
+                                    struct thermo_workspace * ptw);
+
+  int thermodynamics_vector_init_before_reionization(struct thermodynamics * pth,
+                                                     struct thermo_workspace * ptw,
+                                                     double D_Tmat,
+                                                     double x_He,
+                                                     double x_H,
+                                                     double Tmat);
+
+  int thermodynamics_recombination_cache_hash(const void * data,
+                                              size_t size,
+                                              unsigned long long * key);
+
+  int thermodynamics_recombination_cache_key(struct precision * ppr,
+                                             struct background * pba,
+                                             struct thermodynamics * pth,
+                                             struct thermo_workspace * ptw,
+                                             double * interval_limit,
+                                             unsigned long long * key);
+
+  int thermodynamics_recombination_cache_store(struct thermodynamics * pth,
+                                               struct thermo_workspace * ptw,
+                                               unsigned long long key);
+
+  int thermodynamics_recombination_cache_fetch(struct thermodynamics * pth,
+                                               struct thermo_workspace * ptw,
+                                               unsigned long long key,
+                                               short * found);
+
+  int thermodynamics_recombination_cache_clear();
+
   int thermodynamics_output_titles(struct background * pba,
                                    struct thermodynamics *pth,
                                    char titles[_MAXTITLESTRINGLENGTH_]);
@@ -50,6 +50,29 @@
         bin = index_tt - ptr->index_tt_nc_g4;                                                            \
       if (_index_tt_in_range_(ptr->index_tt_nc_g5,   ppt->selection_num, ppt->has_nc_gr))                \
         bin = index_tt - ptr->index_tt_nc_g5;
+/* macro: index of one element of the table of transfer functions of a given mode (which may contain only a block of multipoles, see transfer_compute_l_block()) */
+#define _transfer_index_(ptr,index_md,index_ic,index_tt,index_l,index_q) \
+  ((((index_ic) * (ptr)->tt_size[index_md] + (index_tt)) * (ptr)->l_table_size[index_md] + (index_l) - (ptr)->index_l_table_min) * (ptr)->q_size + (index_q))
+/* macro: is the transfer function of a given mode and type computed at a given multipole index (see l_stride_tt) */
+#define _transfer_l_is_sampled_(ptr,index_md,index_tt,index_l) \
+  (((index_l) <= (ptr)->index_l_linstep) ||                              \
+   ((((index_l) - (ptr)->index_l_linstep) % (ptr)->l_stride_tt[index_md][index_tt]) == 0) || \
+   ((index_l) >= (ptr)->l_size_tt[index_md][index_tt]-1))
+/* macro: read one element of the table of transfer functions of a given mode, stored in double or single precision */
+#define _transfer_get_(ptr,index_md,index) \
+  (((ptr)->transfer_float != NULL) ? (double)((ptr)->transfer_float[index_md][index]) : (ptr)->transfer[index_md][index])
+/* macro: write one element of the table of transfer functions of a given mode, stored in double or single precision */
+#define _transfer_set_(ptr,index_md,index,value)                      \
+  {                                                                     \
+    if ((ptr)->transfer_float != NULL)                                  \
+      (ptr)->transfer_float[index_md][index] = (float)(value);          \
+    else                                                                \
+      (ptr)->transfer[index_md][index] = (value);                       \
+  }
+/* minimum number of tasks per thread in the parallel loop of transfer_init(), below which wavenumbers are split over types and multipoles */
+#define _TRANSFER_TASKS_PER_THREAD_ 8
+/* maximum number of tables of transfer functions kept in memory by transfer_init() for later runs */
+#define _TRANSFER_CACHE_MAX_ 8
 /**
  * Structure containing everything about transfer functions in
  * harmonic space \f$ \Delta_l^{X} (q) \f$ that other modules need to
@@ -155,6 +178,10 @@ struct transfer {
 
   int ** l_size_tt;  /**< number of multipole values for which we effectively compute the transfer function,l_size_tt[index_md][index_tt] */
 
+  int ** l_stride_tt; /**< l list of each type: beyond index_l_linstep, the transfer function of type index_tt is only computed for one multipole index out of l_stride_tt[index_md][index_tt], and for the last one, l_size_tt[index_md][index_tt]-1 (see _transfer_l_is_sampled_()); it is set to zero for the others, where the harmonic module interpolates the C_l's involving such types only */
+
+  int index_l_linstep; /**< index of the first multipole of the l list with linear spacing */
+
   int * l_size;   /**< number of multipole values for each requested mode, l_size[index_md] */
 
   int l_size_max; /**< greatest of all l_size[index_md] */
@@ -185,7 +212,27 @@ struct transfer {
 
   //@{
 
-  double ** transfer; /**< table of transfer functions for each mode, initial condition, type, multipole and wavenumber, with argument transfer[index_md][((index_ic * ptr->tt_size[index_md] + index_tt) * ptr->l_size[index_md] + index_l) * ptr->q_size + index_q] */
+  double ** transfer; /**< table of transfer functions for each mode, initial condition, type, multipole and wavenumber, with argument transfer[index_md][_transfer_index_(ptr,index_md,index_ic,index_tt,index_l,index_q)] */
+
+  float ** transfer_float; /**< same table in single precision, used instead of transfer (then set to NULL) when ppr->transfer_single_precision is true; both should be accessed through the _transfer_get_ and _transfer_set_ macros */
+
+  int * l_table_size; /**< number of multipoles in the table for each mode: l_size[index_md], or at most l_stream_block_size when transfer functions are streamed */
+
+  int index_l_table_min; /**< index of the first multipole in the table (0 unless transfer functions are streamed) */
+
+  int l_stream_block_size; /**< if positive, transfer functions are computed by blocks of this number of multipoles with transfer_compute_l_block(), when harmonic_init() needs them */
+
+  struct transfer_context * ptc; /**< when transfer functions are streamed, everything needed to compute them (NULL otherwise, or once harmonic_init() is done) */
+
+  //@}
+
+  /** @name - statistics on neglected integrals (only if ppr->transfer_neglect_statistics is set, NULL otherwise) */
+
+  //@{
+
+  long ** neglect_count_computed; /**< neglect_count_computed[index_md][index_tt]: number of (l, q) integrals computed and kept */
+  long ** neglect_count_cut;      /**< neglect_count_cut[index_md][index_tt]: number of (l, q) integrals cut by transfer_can_be_neglected() */
+  long ** neglect_count_late;     /**< neglect_count_late[index_md][index_tt]: number of (l, q) integrals without late sources (transfer_late_source_can_be_neglected()) */
 
   //@}
 
@@ -207,6 +254,53 @@ struct transfer {
  * stored in the transfer module)
 */
 
+/**
+ * Time sampling of the number count and lensing sources. It depends
+ * on the type and on the background, but not on the wavenumber: it
+ * is computed once in transfer_precompute_selection(), together with
+ * the selection functions, and shared by all threads.
+ */
+
+struct transfer_sampling {
+
+  int tau_size_max;          /**< maximum number of times (leading dimension of the arrays below) */
+  int * tau_size;            /**< tau_size[index_tt]: number of times, or 0 if the sources of this type are not resampled */
+  double * tau0_minus_tau;   /**< tau0_minus_tau[index_tt*tau_size_max+index_tau]: values of (tau0-tau) */
+  double * w_trapz;          /**< w_trapz[index_tt*tau_size_max+index_tau]: trapezoidal weights for integration over tau */
+  int * index_resample;      /**< index_resample[index_tt*tau_size_max+index_tau]: index of the last value of ppt->tau_sampling below tau */
+  double * weight_resample;  /**< weight_resample[index_tt*tau_size_max+index_tau]: weight of the next value in the linear interpolation of the perturbation sources at tau */
+
+};
+
+/**
+ * Everything needed to compute the transfer functions of a range of
+ * multipoles with transfer_compute_l_range(), prepared by
+ * transfer_init(). It is kept in the transfer structure between
+ * transfer_init() and harmonic_init() when transfer functions are
+ * streamed.
+ */
+
+struct transfer_context {
+
+  struct precision * ppr;     /**< pointer to precision structure */
+  struct background * pba;    /**< pointer to background structure */
+  struct perturbations * ppt; /**< pointer to perturbation structure */
+  struct fourier * pfo;       /**< pointer to fourier structure */
+
+  double tau0;                /**< conformal time today */
+  double tau_rec;             /**< conformal time at recombination */
+  double tau0_minus_tau_cut;  /**< value of (tau0-tau) below which late CMB sources can be neglected */
+  int tau_size_max;           /**< maximum number of sampling times for transfer sources */
+
+  double *** sources;         /**< sources S(k,tau) of the perturbation module, eventually with non-linear corrections */
+  double *** sources_spline;  /**< their second derivatives with respect to k (see transfer_perturbation_source_spline()) */
+  int ** tp_of_tt;            /**< correspondence between perturbation and transfer source types */
+  double * window;            /**< precomputed selection functions */
+  struct transfer_sampling sampling; /**< time sampling of the number count and lensing sources */
+  HyperInterpStruct BIS;      /**< flat spherical bessel functions */
+
+};
+
 struct transfer_workspace {
 
   /** @name - quantities related to Bessel functions */
@@ -219,6 +313,8 @@ struct transfer_workspace {
 
   HyperInterpStruct * pBIS;  /**< pointer to structure containing all the spherical bessel functions of the flat case (used even in the non-flat case, for approximation schemes). pBIS = pointer to Bessel Interpolation Structure. */
 
+  struct transfer_sampling * psa; /**< pointer to the time sampling of the number count and lensing sources (shared by all threads) */
+
   int l_size;        /**< number of l values */
 
   //@}
@@ -246,6 +342,9 @@ struct transfer_workspace {
                                     case) */
   double * cscKgen;              /**< cscKgen[index_tau]: useful trigonometric function */
   double * cotKgen;              /**< cotKgen[index_tau]: useful trigonometric function */
+  double * weights;              /**< weights[index_tau]: source times trapezoidal weight, for the flat-space convolution in transfer_integrate_flat() */
+  double * bin_sources;          /**< bin_sources[index_type*tau_size_max+index_tau]: sources of the local number count types of one bin, for transfer_compute_for_each_q_bin() */
+  double * bin_weights;          /**< bin_weights[index_type*tau_size_max+index_tau]: the same times trapezoidal weights, for transfer_integrate_flat_bin() */
 
   //@}
 
@@ -258,6 +357,26 @@ struct transfer_workspace {
 
   //@}
 
+  /** @name - content of the workspace, since the tasks of the parallel loop in transfer_init() can come in any order (-1 when not yet computed) */
+
+  //@{
+
+  int index_q_HIS;          /**< wavenumber for which HIS has been computed */
+  int index_q_interpolated; /**< wavenumber at which interpolated_sources are computed */
+  int index_md_interpolated; /**< mode of interpolated_sources */
+  int index_ic_interpolated; /**< initial condition of interpolated_sources */
+  int index_tp_interpolated; /**< perturbation source type of interpolated_sources */
+  int index_tt_sources;     /**< transfer type of sources, tau0_minus_tau, w_trapz, chi, cscKgen and cotKgen (for the interpolated sources above) */
+  int index_md_weights;     /**< mode for which the interpolation weights below are computed */
+  int index_q_weights;      /**< wavenumber for which the interpolation weights below are computed */
+  int index_k_weights;      /**< index of the sampled wavenumber of the perturbation module just below this wavenumber */
+  double a_weights;         /**< weight a of the spline interpolation between index_k_weights and index_k_weights+1 */
+  double b_weights;         /**< weight b=1-a of the spline interpolation */
+  double h_weights;         /**< step between these two sampled wavenumbers */
+  int index_tau_limber[3];  /**< bracketing indices found by the last calls to transfer_limber_interpolate() at each of the (up to three) times used by transfer_limber(); searches for the next multipole start there */
+
+  //@}
+
   double tau0_minus_tau_cut; /**< critical value of (tau0-tau) in time cut approximation for the wavenumber at hand */
   short neglect_late_source; /**< flag stating whether we use the time cut approximation for the wavenumber at hand */
 };
@@ -312,6 +431,13 @@ extern "C" {
                     struct transfer * ptr
                     );
 
+  int transfer_mpi_gather(
+                          struct perturbations * ppt,
+                          struct transfer * ptr,
+                          int mpi_rank,
+                          int mpi_size
+                          );
+
   int transfer_free(
                     struct transfer * ptr
                     );
@@ -333,6 +459,7 @@ extern "C" {
                                                             );
 
   int transfer_perturbation_source_spline(
+                                          struct precision * ppr,
                                           struct perturbations * ppt,
                                           struct transfer * ptr,
                                           double *** sources,
@@ -415,6 +542,24 @@ extern "C" {
                                int * tau_size
                                );
 
+  int transfer_compute_l_block(
+                               struct transfer * ptr,
+                               int index_l_min,
+                               int index_l_max
+                               );
+
+  int transfer_compute_l_range(
+                               struct transfer * ptr,
+                               struct transfer_context * ptc,
+                               int index_l_min,
+                               int index_l_max
+                               );
+
+  int transfer_context_free(
+                            struct transfer * ptr,
+                            struct transfer_context * ptc
+                            );
+
   int transfer_compute_for_each_q(
                                   struct precision * ppr,
                                   struct background * pba,
@@ -422,6 +567,8 @@ extern "C" {
                                   struct transfer * ptr,
                                   int ** tp_of_tt,
                                   int index_q,
+                                  int index_l_min,
+                                  int index_l_max,
                                   int tau_size_max,
                                   double tau_rec,
                                   double *** sources,
@@ -430,6 +577,82 @@ extern "C" {
                                   struct transfer_workspace * ptw
                                   );
 
+  int transfer_compute_for_each_q_type(
+                                       struct precision * ppr,
+                                       struct background * pba,
+                                       struct perturbations * ppt,
+                                       struct transfer * ptr,
+                                       int ** tp_of_tt,
+                                       int index_q,
+                                       int index_md,
+                                       int index_ic,
+                                       int index_tt,
+                                       int index_l_min,
+                                       int index_l_max,
+                                       int tau_size_max,
+                                       double tau_rec,
+                                       double *** sources,
+                                       double *** sources_spline,
+                                       double * window,
+                                       struct transfer_workspace * ptw
+                                       );
+
+  int transfer_compute_for_each_q_bin(
+                                      struct precision * ppr,
+                                      struct background * pba,
+                                      struct perturbations * ppt,
+                                      struct transfer * ptr,
+                                      int ** tp_of_tt,
+                                      int index_q,
+                                      int index_md,
+                                      int index_ic,
+                                      int bin_size,
+                                      int * bin_tt,
+                                      int index_l_min,
+                                      int index_l_max,
+                                      int tau_size_max,
+                                      double tau_rec,
+                                      double *** sources,
+                                      double *** sources_spline,
+                                      double * window,
+                                      struct transfer_workspace * ptw
+                                      );
+
+  int transfer_workspace_sources(
+                                 struct precision * ppr,
+                                 struct background * pba,
+                                 struct perturbations * ppt,
+                                 struct transfer * ptr,
+                                 int ** tp_of_tt,
+                                 int index_q,
+                                 int index_md,
+                                 int index_ic,
+                                 int index_tt,
+                                 int tau_size_max,
+                                 double tau_rec,
+                                 double *** sources,
+                                 double *** sources_spline,
+                                 double * window,
+                                 struct transfer_workspace * ptw
+                                 );
+
+  int transfer_nc_bin_types(
+                            struct perturbations * ppt,
+                            struct transfer * ptr,
+                            int bin,
+                            int * bin_size,
+                            int * bin_tt
+                            );
+
+  int transfer_define_tasks(
+                            struct precision * ppr,
+                            struct perturbations * ppt,
+                            struct transfer * ptr,
+                            int sgnK,
+                            int * task_per_q,
+                            int * l_block_size
+                            );
+
   int transfer_radial_coordinates(
                                   struct transfer * ptr,
                                   struct transfer_workspace * ptw,
@@ -438,8 +661,10 @@ extern "C" {
                                   );
 
   int transfer_interpolate_sources(
+                                   struct precision * ppr,
                                    struct perturbations * ppt,
                                    struct transfer * ptr,
+                                   struct transfer_workspace * ptw,
                                    int index_q,
                                    int index_md,
                                    int index_ic,
@@ -461,6 +686,7 @@ extern "C" {
                        int index_tt,
                        double * sources,
                        double * window,
+                       struct transfer_sampling * psa,
                        int tau_size_max,
                        double * tau0_minus_tau,
                        double * delta_tau,
@@ -501,15 +727,8 @@ extern "C" {
                                 int tau_size);
 
   int transfer_source_resample(
-                               struct precision * ppr,
-                               struct background * pba,
-                               struct perturbations * ppt,
-                               struct transfer * ptr,
-                               int bin,
-                               double * tau0_minus_tau,
-                               int tau_size,
-                               int index_md,
-                               double tau0,
+                               struct transfer_sampling * psa,
+                               int index_tt,
                                double * interpolated_sources,
                                double * sources);
 
@@ -577,6 +796,28 @@ extern "C" {
                          double * trsf
                          );
 
+  int transfer_integrate_flat(
+                              struct transfer * ptr,
+                              struct transfer_workspace * ptw,
+                              int index_l,
+                              radial_function_type radial_type,
+                              int index_tau_max,
+                              int index_tau_max_Bessel,
+                              double tau0_minus_tau_min_bessel,
+                              double * trsf
+                              );
+
+  int transfer_integrate_flat_bin(
+                                  struct transfer * ptr,
+                                  struct transfer_workspace * ptw,
+                                  int index_l,
+                                  double k,
+                                  int bin_size,
+                                  radial_function_type * radial_type,
+                                  double ** sources,
+                                  double * trsf
+                                  );
+
   int transfer_limber(
                       struct transfer * ptr,
                       struct transfer_workspace * ptw,
@@ -594,6 +835,7 @@ extern "C" {
                                   double * sources,
                                   int tau_size,
                                   double tau0_minus_tau_limber,
+                                  int * index_tau_guess,
                                   double * S
                                   );
 
@@ -623,6 +865,23 @@ extern "C" {
                                 short * neglect
                                 );
 
+  int transfer_neglect_delta_k(
+                               struct precision * ppr,
+                               struct perturbations * ppt,
+                               struct transfer * ptr,
+                               int index_md,
+                               int index_tt,
+                               short * has_cut,
+                               double * delta_k
+                               );
+
+  int transfer_neglect_statistics(
+                                  struct precision * ppr,
+                                  struct perturbations * ppt,
+                                  struct transfer * ptr,
+                                  double ra_rec
+                                  );
+
   int transfer_late_source_can_be_neglected(
                                             struct precision * ppr,
                                             struct perturbations * ppt,
@@ -711,9 +970,25 @@ extern "C" {
                      struct transfer * ptr,
                      double tau_rec,
                      int tau_size_max,
-                     double ** window
+                     double ** window,
+                     struct transfer_sampling * psa
                      );
 
+  int transfer_sampling_store(
+                              struct perturbations * ppt,
+                              struct transfer * ptr,
+                              struct transfer_sampling * psa,
+                              int index_tt,
+                              double tau0,
+                              double * tau0_minus_tau,
+                              double * w_trapz,
+                              int tau_size
+                              );
+
+  int transfer_sampling_free(
+                             struct transfer_sampling * psa
+                             );
+
   int transfer_f_evo(
                    struct background* pba,
                    struct transfer * ptr,
@@ -723,6 +998,38 @@ extern "C" {
                    double* f_evo
                   );
 
+  int transfer_cache_key(
+                         struct precision * ppr,
+                         struct background * pba,
+                         struct thermodynamics * pth,
+                         struct perturbations * ppt,
+                         struct fourier * pfo,
+                         struct transfer * ptr,
+                         unsigned long long * key
+                         );
+
+  int transfer_cache_fetch(
+                           unsigned long long key,
+                           struct perturbations * ppt,
+                           struct transfer * ptr,
+                           short * found
+                           );
+
+  int transfer_cache_store(
+                           struct precision * ppr,
+                           unsigned long long key,
+                           struct perturbations * ppt,
+                           struct transfer * ptr
+                           );
+
+  int transfer_cache_clear();
+
+  int transfer_copy_tables(
+                           struct perturbations * ppt,
+                           struct transfer * ptr_in,
+                           struct transfer * ptr_out
+                           );
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,9 +1,83 @@
 /** @file class.c
  * Julien Lesgourgues, 17.04.2011
+ *
+ * Usage: ./class [file.ini] [file.pre]
+ *    or: ./class -d <steps> <results> [file.ini] [file.pre]
+ *
+ * With -d, CLASS computes the derivatives of the C_l's and P(k,z) with
+ * respect to some parameters, by central finite differences (see
+ * output_derivatives_init()). The file <steps> has the format of an
+ * input file, with one line 'name = step' per parameter, e.g.
+ *
+ *   omega_b = 0.0002
+ *   n_s = 0.005
+ *
+ * and the fiducial values are those of the input files. The runs share
+ * the parsed input and everything that CLASS caches across runs, and
+ * are computed concurrently. The derivatives are written in binary
+ * form in <results> (see output_derivatives_write()), and no other
+ * output file is written.
  */
 
 #include "class.h"
 
+/**
+ * Derivative mode of main(), for the arguments given after -d
+ *
+ * @param argc Input: number of arguments after -d
+ * @param argv Input: arguments after -d
+ * @return the error status
+ */
+
+static int class_derivatives(int argc, char **argv) {
+
+  struct file_content fc_steps;  /* one line 'name = step' per parameter */
+  struct file_content fc;        /* parameters of the input and precision files */
+  struct output_derivatives od;  /* derivatives of the C_l's and P(k,z) */
+  ErrorMsg errmsg;
+  double * step;
+  int index_par, found;
+
+  if (argc < 2) {
+    printf("\n\nUsage: ./class -d <steps> <results> [file.ini] [file.pre]\n");
+    return _FAILURE_;
+  }
+
+  /* (argv[1], the results file, plays the role of the program name for input_find_file) */
+  if (parser_read_file(argv[0],&fc_steps,errmsg) == _FAILURE_ ||
+      input_find_file(argc-1,argv+1,&fc,errmsg) == _FAILURE_) {
+    printf("\n\nError reading the parameters \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  step = (double *)malloc(MAX(fc_steps.size,1)*sizeof(double));
+  for (index_par=0; index_par<fc_steps.size; index_par++) {
+    if (parser_read_double(&fc_steps,fc_steps.name[index_par],step+index_par,&found,errmsg) == _FAILURE_) {
+      printf("\n\nError reading the steps in %s \n=>%s\n",argv[0],errmsg);
+      return _FAILURE_;
+    }
+  }
+
+  if (output_derivatives_init(&fc,fc_steps.size,fc_steps.name,step,0,&od) == _FAILURE_) {
+    printf("\n\nError in output_derivatives_init \n=>%s\n",od.error_message);
+    return _FAILURE_;
+  }
+
+  if (output_derivatives_write(&od,argv[1]) == _FAILURE_) {
+    printf("\n\nError in output_derivatives_write \n=>%s\n",od.error_message);
+    return _FAILURE_;
+  }
+
+  printf("derivatives with respect to %d parameters written in %s\n",od.par_size,argv[1]);
+
+  output_derivatives_free(&od);
+  free(step);
+  parser_free(&fc_steps);
+  parser_free(&fc);
+
+  return _SUCCESS_;
+}
+
 int main(int argc, char **argv) {
 
   struct precision pr;        /* for precision parameters */
@@ -17,62 +91,106 @@ int main(int argc, char **argv) {
   struct lensing le;          /* for lensed spectra */
   struct distortions sd;      /* for spectral distortions */
   struct output op;           /* for output files */
+  struct profile prof;        /* for the time and memory of each module */
   ErrorMsg errmsg;            /* for error messages */
+  int mpi_rank, mpi_size;     /* index of this MPI process and number of processes (0 and 1 without MPI) */
+#ifdef _TRACE
+  char trace_file[_FILENAMESIZE_+32]; /* for the trace of the parallel loops */
+#endif
+
+  if ((argc > 1) && (strcmp(argv[1],"-d") == 0))
+    return class_derivatives(argc-2,argv+2);
+
+#ifdef _MPI
+  MPI_Init(&argc,&argv);
+#endif
+  class_mpi_rank_and_size(&mpi_rank,&mpi_size);
 
+  profile_init(&prof);
+
+  profile_start(&prof,profile_input);
   if (input_init(argc, argv,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg) == _FAILURE_) {
     printf("\n\nError running input_init \n=>%s\n",errmsg);
     return _FAILURE_;
   }
+  profile_stop(&prof,profile_input);
+
+  /* number of threads of the parallel regions, if specified in the input */
+  class_threads_set(pr.num_threads);
 
+  profile_start(&prof,profile_background);
   if (background_init(&pr,&ba) == _FAILURE_) {
     printf("\n\nError running background_init \n=>%s\n",ba.error_message);
     return _FAILURE_;
   }
+  profile_stop(&prof,profile_background);
 
+  profile_start(&prof,profile_thermodynamics);
   if (thermodynamics_init(&pr,&ba,&th) == _FAILURE_) {
     printf("\n\nError in thermodynamics_init \n=>%s\n",th.error_message);
     return _FAILURE_;
   }
+  profile_stop(&prof,profile_thermodynamics);
 
+  profile_start(&prof,profile_perturbations);
   if (perturbations_init(&pr,&ba,&th,&pt) == _FAILURE_) {
     printf("\n\nError in perturbations_init \n=>%s\n",pt.error_message);
     return _FAILURE_;
   }
+  profile_stop(&prof,profile_perturbations);
 
+  profile_start(&prof,profile_primordial);
   if (primordial_init(&pr,&pt,&pm) == _FAILURE_) {
     printf("\n\nError in primordial_init \n=>%s\n",pm.error_message);
     return _FAILURE_;
   }
+  profile_stop(&prof,profile_primordial);
 
+  profile_start(&prof,profile_fourier);
   if (fourier_init(&pr,&ba,&th,&pt,&pm,&fo) == _FAILURE_) {
     printf("\n\nError in fourier_init \n=>%s\n",fo.error_message);
     return _FAILURE_;
   }
+  profile_stop(&prof,profile_fourier);
 
+  profile_start(&prof,profile_transfer);
   if (transfer_init(&pr,&ba,&th,&pt,&fo,&tr) == _FAILURE_) {
     printf("\n\nError in transfer_init \n=>%s\n",tr.error_message);
     return _FAILURE_;
   }
+  profile_stop(&prof,profile_transfer);
 
+  profile_start(&prof,profile_harmonic);
   if (harmonic_init(&pr,&ba,&pt,&pm,&fo,&tr,&hr) == _FAILURE_) {
     printf("\n\nError in harmonic_init \n=>%s\n",hr.error_message);
     return _FAILURE_;
   }
+  profile_stop(&prof,profile_harmonic);
 
+  profile_start(&prof,profile_lensing);
   if (lensing_init(&pr,&pt,&hr,&fo,&le) == _FAILURE_) {
     printf("\n\nError in lensing_init \n=>%s\n",le.error_message);
     return _FAILURE_;
   }
+  profile_stop(&prof,profile_lensing);
 
+  profile_start(&prof,profile_distortions);
   if (distortions_init(&pr,&ba,&th,&pt,&pm,&sd) == _FAILURE_) {
     printf("\n\nError in distortions_init \n=>%s\n",sd.error_message);
     return _FAILURE_;
   }
+  profile_stop(&prof,profile_distortions);
 
-  if (output_init(&ba,&th,&pt,&pm,&tr,&hr,&fo,&le,&sd,&op) == _FAILURE_) {
+  /* with MPI, all processes hold the full results, but only the first one writes them */
+  profile_start(&prof,profile_output);
+  if ((mpi_rank == 0) && (output_init(&ba,&th,&pt,&pm,&tr,&hr,&fo,&le,&sd,&op) == _FAILURE_)) {
     printf("\n\nError in output_init \n=>%s\n",op.error_message);
     return _FAILURE_;
   }
+  profile_stop(&prof,profile_output);
+
+  if ((mpi_rank == 0) && (op.profile_verbose > 0))
+    profile_print(&prof);
 
   /****** all calculations done, now free the structures ******/
 
@@ -121,6 +239,25 @@ int main(int argc, char **argv) {
     return _FAILURE_;
   }
 
+  /* memory of each file and call site, when compiled with -D_MEMORY_TRACKING */
+  class_memory_report();
+
+#ifdef _TRACE
+  /* work items of the parallel loops, one file per MPI process */
+  if (mpi_size > 1)
+    sprintf(trace_file,"%strace_%d.json",op.root,mpi_rank);
+  else
+    sprintf(trace_file,"%strace.json",op.root);
+  if (class_trace_write(trace_file,errmsg) == _FAILURE_) {
+    printf("\n\nError in class_trace_write \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+#endif
+
+#ifdef _MPI
+  MPI_Finalize();
+#endif
+
   return _SUCCESS_;
 
 }
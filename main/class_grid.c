@@ -0,0 +1,363 @@
+/** @file class_grid.c
+ * Run CLASS on a list of cosmologies sharing the same input and precision files
+ *
+ * Usage: ./class_grid [-j <n>] <points> <results> [file.ini] [file.pre]
+ *
+ * The input and precision files are read once and define the
+ * parameters common to all points. The file <points> contains, apart
+ * from blank lines and comments starting with '#' or '%', one line
+ * with the names of the varied parameters, then one line per point
+ * with their values, separated by spaces or tabs:
+ *
+ *   # omega_b   omega_cdm   n_s
+ *   omega_b     omega_cdm   n_s
+ *   0.0220      0.118       0.96
+ *   0.0224      0.120       0.97
+ *
+ * All points are computed in the same process, so that everything
+ * that CLASS caches across runs (ncdm quadratures, HyRec and injection
+ * tables, lensing Wigner functions, recombination histories, ...) is
+ * built once. As in class_server, the caches that only help repeated
+ * runs are switched on unless the files set them:
+ * perturbations_cache_size = 4, transfer_cache_size = 2 and
+ * hmcode_cache = 1.
+ *
+ * With -j <n>, n points are computed at the same time. Each of them
+ * uses num_threads threads if this parameter is set, otherwise the
+ * available threads divided by n. One point at a time with all
+ * threads is best when the parallel parts of one run use them well
+ * (e.g. many k's and l's); more points with fewer threads each are
+ * better for cheap runs, whose serial parts then overlap.
+ *
+ * The file <results> is written in binary form. It starts with
+ * int number_of_points, followed by one record per point in the order
+ * in which they are completed (not necessarily that of <points>):
+ *
+ *   int index of the point in <points> (starting from 0), then exactly
+ *   the answer of class_server to a request (see class_server.c):
+ *   int status, then either the error message or the C_l's and P(k,z)
+ *   of struct output_packed (see output.h).
+ *
+ * All integers are native 'int' and all reals native 'double'.
+ */
+
+#include "class.h"
+
+/* initialize one more module if all previous ones succeeded, counting them in 'stage' */
+#define grid_init(init, error_message) {        \
+    if (status == _SUCCESS_) {                  \
+      if ((init) == _FAILURE_) {                \
+        strcpy(errmsg,error_message);           \
+        status = _FAILURE_;                     \
+      }                                         \
+      else                                      \
+        stage++;                                \
+    }                                           \
+  }
+
+/**
+ * Write count elements in the results file, remembering any failure
+ */
+
+static void grid_write(const void * buffer, size_t size, size_t count, FILE * file, short * write_error) {
+
+  if ((count > 0) && (fwrite(buffer,size,count,file) != count))
+    *write_error = _TRUE_;
+}
+
+/**
+ * Read the names of the varied parameters and their values at each point
+ *
+ * @param filename    Input: name of the file
+ * @param param_size  Output: number of varied parameters
+ * @param names       Output: their names (allocated here)
+ * @param point_size  Output: number of points
+ * @param values      Output: values[index_point*param_size+index_param] (allocated here)
+ * @param errmsg      Output: error message
+ * @return the error status
+ */
+
+static int grid_read_points(char * filename,
+                            int * param_size,
+                            FileArg ** names,
+                            int * point_size,
+                            FileArg ** values,
+                            ErrorMsg errmsg) {
+
+  FILE * file;
+  char line[_LINE_LENGTH_MAX_];
+  char * token;
+  char * saveptr;
+  char * left;
+  int line_number = 0;
+  int point_max = 0;
+  int counter;
+
+  *param_size = 0;
+  *point_size = 0;
+  *names = NULL;
+  *values = NULL;
+
+  class_open(file,filename,"r",errmsg);
+
+  while (fgets(line,_LINE_LENGTH_MAX_,file) != NULL) {
+
+    line_number++;
+
+    left = line;
+    while ((left[0] == ' ') || (left[0] == '\t'))
+      left++;
+    if ((left[0] == '#') || (left[0] == '%') || (left[0] == '\n') || (left[0] == '\r') || (left[0] == '\0'))
+      continue;
+
+    /* the first line gives the names */
+    if (*param_size == 0) {
+      for (token = strtok_r(left," \t\r\n",&saveptr); token != NULL; token = strtok_r(NULL," \t\r\n",&saveptr)) {
+        class_realloc(*names,*names,(*param_size+1)*sizeof(FileArg),errmsg);
+        strcpy((*names)[*param_size],token);
+        (*param_size)++;
+      }
+      continue;
+    }
+
+    if (*point_size == point_max) {
+      point_max = 2*point_max+64;
+      class_realloc(*values,*values,point_max*(*param_size)*sizeof(FileArg),errmsg);
+    }
+
+    counter = 0;
+    for (token = strtok_r(left," \t\r\n",&saveptr); token != NULL; token = strtok_r(NULL," \t\r\n",&saveptr)) {
+      class_test(counter == *param_size,
+                 errmsg,
+                 "line %d of file %s has more values than the %d parameter names",line_number,filename,*param_size);
+      strcpy((*values)[(*point_size)*(*param_size)+counter],token);
+      counter++;
+    }
+    class_test(counter < *param_size,
+               errmsg,
+               "line %d of file %s has %d values instead of %d",line_number,filename,counter,*param_size);
+    (*point_size)++;
+  }
+
+  fclose(file);
+
+  class_test(*point_size == 0,
+             errmsg,
+             "file %s should contain the names of the parameters, then at least one point",filename);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Run CLASS on one point and write its record
+ *
+ * @param pfc_default   Input: parameters of the input and precision files
+ * @param param_size    Input: number of varied parameters
+ * @param names         Input: their names
+ * @param values        Input: their values at this point
+ * @param index_point   Input: index of the point
+ * @param inner_threads Input: number of threads of this run if num_threads is not set
+ * @param results       Input: results file
+ * @param write_error   Output: set to _TRUE_ if the record could not be written
+ * @return the status of the run
+ */
+
+static int grid_run(struct file_content * pfc_default,
+                    int param_size,
+                    FileArg * names,
+                    FileArg * values,
+                    int index_point,
+                    int inner_threads,
+                    FILE * results,
+                    short * write_error) {
+
+  struct precision pr;
+  struct background ba;
+  struct thermodynamics th;
+  struct perturbations pt;
+  struct primordial pm;
+  struct fourier fo;
+  struct transfer tr;
+  struct harmonic hr;
+  struct lensing le;
+  struct distortions sd;
+  struct output op;
+  struct file_content fc_point;
+  struct file_content fc;
+  struct output_packed opk;  /* C_l's and P(k,z) written in the record */
+  ErrorMsg errmsg;
+  int stage = 0;             /* number of modules initialized */
+  int status = _SUCCESS_;
+  int index_param, index_type, size;
+  int threads = 0;
+
+  errmsg[0] = '\0';
+  fc.size = 0;
+  fc.hash_size = 0;
+  opk.cl_table = NULL;
+  opk.pk = NULL;
+
+  if (parser_init(&fc_point,param_size,"points",errmsg) == _FAILURE_) {
+    status = _FAILURE_;
+  }
+  else {
+    for (index_param=0; index_param<param_size; index_param++) {
+      strcpy(fc_point.name[index_param],names[index_param]);
+      strcpy(fc_point.value[index_param],values[index_param]);
+      fc_point.read[index_param] = _FALSE_;
+    }
+    if (parser_index(&fc_point,errmsg) == _FAILURE_ ||
+        parser_merge(pfc_default,&fc_point,&fc,errmsg) == _FAILURE_ ||
+        input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg) == _FAILURE_) {
+      status = _FAILURE_;
+    }
+    parser_free(&fc_point);
+  }
+  parser_free(&fc);
+
+  if (status == _SUCCESS_) {
+
+    threads = class_threads_set((pr.num_threads > 0) ? pr.num_threads : inner_threads);
+
+    grid_init(background_init(&pr,&ba),ba.error_message);
+    grid_init(thermodynamics_init(&pr,&ba,&th),th.error_message);
+    grid_init(perturbations_init(&pr,&ba,&th,&pt),pt.error_message);
+    grid_init(primordial_init(&pr,&pt,&pm),pm.error_message);
+    grid_init(fourier_init(&pr,&ba,&th,&pt,&pm,&fo),fo.error_message);
+    grid_init(transfer_init(&pr,&ba,&th,&pt,&fo,&tr),tr.error_message);
+    grid_init(harmonic_init(&pr,&ba,&pt,&pm,&fo,&tr,&hr),hr.error_message);
+    grid_init(lensing_init(&pr,&pt,&hr,&fo,&le),le.error_message);
+    grid_init(distortions_init(&pr,&ba,&th,&pt,&pm,&sd),sd.error_message);
+  }
+
+  if (status == _SUCCESS_ &&
+      output_packed_init(&ba,&pt,&fo,&hr,&le,&op,&opk) == _FAILURE_) {
+    strcpy(errmsg,op.error_message);
+    status = _FAILURE_;
+  }
+
+  /** - write the record, in one piece */
+
+#pragma omp critical (grid_results)
+  {
+    grid_write(&index_point,sizeof(int),1,results,write_error);
+    grid_write(&status,sizeof(int),1,results,write_error);
+    if (status == _FAILURE_) {
+      fprintf(stderr,"Error at point %d\n=>%s\n",index_point,errmsg);
+      size = strlen(errmsg);
+      grid_write(&size,sizeof(int),1,results,write_error);
+      grid_write(errmsg,1,size,results,write_error);
+    }
+    else {
+      grid_write(opk.has_cl,sizeof(int),_OUTPUT_PACKED_CL_TYPES_,results,write_error);
+      grid_write(&(opk.l_max),sizeof(int),1,results,write_error);
+      for (index_type=0; index_type<_OUTPUT_PACKED_CL_TYPES_; index_type++) {
+        if (opk.has_cl[index_type] == _TRUE_)
+          grid_write(opk.cl[index_type],sizeof(double),opk.l_max+1,results,write_error);
+      }
+      grid_write(&(opk.k_size),sizeof(int),1,results,write_error);
+      grid_write(&(opk.z_size),sizeof(int),1,results,write_error);
+      grid_write(opk.k,sizeof(double),opk.k_size,results,write_error);
+      grid_write(opk.z,sizeof(double),opk.z_size,results,write_error);
+      grid_write(opk.pk,sizeof(double),opk.z_size*opk.k_size,results,write_error);
+    }
+  }
+
+  /** - free the structures (the caches shared by all points are kept) */
+
+  output_packed_free(&opk);
+
+  if (stage > 8) distortions_free(&sd);
+  if (stage > 7) lensing_free(&le);
+  if (stage > 6) harmonic_free(&hr);
+  if (stage > 5) transfer_free(&tr);
+  if (stage > 4) fourier_free(&fo);
+  if (stage > 3) primordial_free(&pm);
+  if (stage > 2) perturbations_free(&pt);
+  if (stage > 1) thermodynamics_free(&th);
+  if (stage > 0) background_free(&ba);
+
+  if (threads > 0)
+    class_threads_set(threads);
+
+  return status;
+}
+
+int main(int argc, char **argv) {
+
+  struct file_content fc_grid;   /* caches switched on by default for grids */
+  struct file_content fc_input;  /* parameters of the input and precision files */
+  struct file_content fc;        /* parameters common to all points */
+  char grid_defaults[] =
+    "perturbations_cache_size = 4\n"
+    "transfer_cache_size = 2\n"
+    "hmcode_cache = 1\n";
+  ErrorMsg errmsg;
+  int first = 1;                 /* index of the first positional argument */
+  int outer_threads = 1;
+  int inner_threads = 1;
+  int param_size, point_size, index_point;
+  int failed = 0;
+  short write_error = _FALSE_;
+  FileArg * names;
+  FileArg * values;
+  FILE * results;
+
+  if ((argc > 2) && (strcmp(argv[1],"-j") == 0)) {
+    outer_threads = atoi(argv[2]);
+    first = 3;
+  }
+
+  if ((argc < first+2) || (outer_threads < 1)) {
+    printf("\n\nUsage: %s [-j <n>] <points> <results> [file.ini] [file.pre]\n",argv[0]);
+    return _FAILURE_;
+  }
+
+  /* the caches that a single run does not need are switched on, unless set in the files
+     (argv[first+1], the results file, plays the role of the program name for input_find_file) */
+  if (grid_read_points(argv[first],&param_size,&names,&point_size,&values,errmsg) == _FAILURE_ ||
+      input_find_file(argc-first-1,argv+first+1,&fc_input,errmsg) == _FAILURE_ ||
+      parser_read_text(grid_defaults,"grid defaults",&fc_grid,errmsg) == _FAILURE_ ||
+      parser_merge(&fc_grid,&fc_input,&fc,errmsg) == _FAILURE_) {
+    printf("\n\nError reading the parameters \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+  parser_free(&fc_grid);
+  parser_free(&fc_input);
+
+  results = fopen(argv[first+1],"wb");
+  if (results == NULL) {
+    printf("\n\nError: could not open %s for writing\n",argv[first+1]);
+    return _FAILURE_;
+  }
+  fwrite(&point_size,sizeof(int),1,results);
+
+#ifdef _OPENMP
+  /* the threads of each point are nested in those running the points */
+  inner_threads = MAX(1,omp_get_max_threads()/outer_threads);
+  if (outer_threads > 1)
+    omp_set_max_active_levels(2);
+#endif
+
+#pragma omp parallel for schedule(dynamic,1) num_threads(outer_threads) reduction(+:failed)
+  for (index_point=0; index_point<point_size; index_point++) {
+    if (grid_run(&fc,param_size,names,values+index_point*param_size,index_point,inner_threads,results,&write_error) == _FAILURE_)
+      failed++;
+  }
+
+  if (fclose(results) != 0)
+    write_error = _TRUE_;
+
+  printf("%d points computed (%d failed), results written in %s\n",point_size-failed,failed,argv[first+1]);
+
+  free(names);
+  free(values);
+  parser_free(&fc);
+
+  if (write_error == _TRUE_) {
+    printf("\n\nError: could not write all results in %s\n",argv[first+1]);
+    return _FAILURE_;
+  }
+
+  return (failed > 0) ? _FAILURE_ : _SUCCESS_;
+}
@@ -0,0 +1,320 @@
+/** @file class_server.c
+ * Long-running CLASS process answering requests on a local socket
+ *
+ * Usage: ./class_server <socket> [file.ini] [file.pre]
+ *
+ * The input and precision files are read once, and define the default
+ * parameters of all requests. The server then accepts connections on
+ * the Unix socket <socket>, and treats their requests one after the
+ * other. All structures are freed after each request, but the process
+ * keeps everything that CLASS caches across runs (ncdm quadratures,
+ * recombination histories, HyRec and injection tables, perturbation
+ * sources, lensing Wigner functions, external spectra, ...), so that
+ * short-lived client processes share one warm engine instead of each
+ * paying the start-up and table-building cost. The caches that only
+ * help repeated runs are switched on unless the files set them:
+ * perturbations_cache_size = 4 (the sources are reused when only
+ * primordial, non-linear or later parameters change),
+ * transfer_cache_size = 2 (the transfer functions are reused when a
+ * point is computed again, or when only primordial parameters change
+ * without non-linear corrections) and hmcode_cache = 1. Setting
+ * hyper_cache_size also keeps the Bessel functions, at the price of a
+ * slightly different sampling.
+ *
+ * A connection may send several requests. All integers are native
+ * 'int' and all reals native 'double' (client and server run on the
+ * same machine). A request is:
+ *
+ *   int size, followed by size characters: parameters in the format
+ *   of an input file ('name = value' lines), added to the default ones
+ *   or replacing them. size = 0 runs the default parameters.
+ *
+ * and the answer is:
+ *
+ *   int status (_SUCCESS_ or _FAILURE_), then
+ *   - if _FAILURE_: int size, followed by size characters of error message;
+ *   - if _SUCCESS_, the content of struct output_packed (see output.h):
+ *     int has_cl[6]: which of TT, EE, TE, BB, PP, TP are returned,
+ *     int l_max,
+ *     for each returned type: double cl[l_max+1], the lensed C_l's if
+ *       lensing was requested, the total unlensed ones otherwise,
+ *     int k_size, int z_size (zero if P(k) was not requested),
+ *     double k[k_size] in 1/Mpc, double z[z_size] (those of 'z_pk'),
+ *     double pk[z_size*k_size] in Mpc^3, as pk[index_z*k_size+index_k]:
+ *       total matter power spectrum, non-linear if 'non_linear' is set.
+ *
+ * The server stops on SIGINT or SIGTERM.
+ */
+
+#include "class.h"
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* initialize one more module if all previous ones succeeded, counting them in 'stage' */
+#define server_init(init, error_message) {      \
+    if (status == _SUCCESS_) {                  \
+      if ((init) == _FAILURE_) {                \
+        strcpy(errmsg,error_message);           \
+        status = _FAILURE_;                     \
+      }                                         \
+      else                                      \
+        stage++;                                \
+    }                                           \
+  }
+
+static volatile sig_atomic_t server_stop = _FALSE_;
+
+static void server_signal(int sig) {
+  server_stop = _TRUE_;
+}
+
+/**
+ * Read or write exactly size bytes on a socket
+ */
+
+static int server_read(int fd, void * buffer, size_t size) {
+
+  char * p = buffer;
+  ssize_t n;
+
+  while (size > 0) {
+    n = read(fd,p,size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return _FAILURE_;
+    p += n;
+    size -= n;
+  }
+  return _SUCCESS_;
+}
+
+static int server_write(int fd, const void * buffer, size_t size) {
+
+  const char * p = buffer;
+  ssize_t n;
+
+  while (size > 0) {
+    n = write(fd,p,size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return _FAILURE_;
+    p += n;
+    size -= n;
+  }
+  return _SUCCESS_;
+}
+
+/**
+ * Run CLASS on one request and send the answer
+ *
+ * @param fd          Input: socket of the connection
+ * @param pfc_default Input: default parameters
+ * @param text        Input: parameters of the request
+ * @return _FAILURE_ only if the connection is broken
+ */
+
+static int server_run(int fd,
+                      struct file_content * pfc_default,
+                      char * text) {
+
+  struct precision pr;
+  struct background ba;
+  struct thermodynamics th;
+  struct perturbations pt;
+  struct primordial pm;
+  struct fourier fo;
+  struct transfer tr;
+  struct harmonic hr;
+  struct lensing le;
+  struct distortions sd;
+  struct output op;
+  struct file_content fc_request;
+  struct file_content fc;
+  ErrorMsg errmsg;
+  int stage = 0;            /* number of modules initialized */
+  int status = _SUCCESS_;
+  int answer = _SUCCESS_;
+  struct output_packed opk;  /* C_l's and P(k,z) sent back */
+  int index_type, size;
+  int threads = 0;
+
+  errmsg[0] = '\0';
+  fc_request.size = 0;
+  fc_request.hash_size = 0;
+  fc.size = 0;
+  fc.hash_size = 0;
+  opk.cl_table = NULL;
+  opk.pk = NULL;
+
+  if (parser_read_text(text,"request",&fc_request,errmsg) == _FAILURE_ ||
+      parser_merge(pfc_default,&fc_request,&fc,errmsg) == _FAILURE_ ||
+      input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg) == _FAILURE_) {
+    status = _FAILURE_;
+  }
+  parser_free(&fc_request);
+  parser_free(&fc);
+
+  if (status == _SUCCESS_) {
+
+    threads = class_threads_set(pr.num_threads);
+
+    server_init(background_init(&pr,&ba),ba.error_message);
+    server_init(thermodynamics_init(&pr,&ba,&th),th.error_message);
+    server_init(perturbations_init(&pr,&ba,&th,&pt),pt.error_message);
+    server_init(primordial_init(&pr,&pt,&pm),pm.error_message);
+    server_init(fourier_init(&pr,&ba,&th,&pt,&pm,&fo),fo.error_message);
+    server_init(transfer_init(&pr,&ba,&th,&pt,&fo,&tr),tr.error_message);
+    server_init(harmonic_init(&pr,&ba,&pt,&pm,&fo,&tr,&hr),hr.error_message);
+    server_init(lensing_init(&pr,&pt,&hr,&fo,&le),le.error_message);
+    server_init(distortions_init(&pr,&ba,&th,&pt,&pm,&sd),sd.error_message);
+  }
+
+  /** - collect the C_l's and P(k,z) */
+
+  if (status == _SUCCESS_ &&
+      output_packed_init(&ba,&pt,&fo,&hr,&le,&op,&opk) == _FAILURE_) {
+    strcpy(errmsg,op.error_message);
+    status = _FAILURE_;
+  }
+
+  /** - send the answer */
+
+  if (server_write(fd,&status,sizeof(int)) == _FAILURE_) {
+    answer = _FAILURE_;
+  }
+  else if (status == _FAILURE_) {
+    size = strlen(errmsg);
+    if (server_write(fd,&size,sizeof(int)) == _FAILURE_ ||
+        server_write(fd,errmsg,size) == _FAILURE_)
+      answer = _FAILURE_;
+  }
+  else {
+    if (server_write(fd,opk.has_cl,_OUTPUT_PACKED_CL_TYPES_*sizeof(int)) == _FAILURE_ ||
+        server_write(fd,&(opk.l_max),sizeof(int)) == _FAILURE_)
+      answer = _FAILURE_;
+    for (index_type=0; answer == _SUCCESS_ && index_type<_OUTPUT_PACKED_CL_TYPES_; index_type++) {
+      if (opk.has_cl[index_type] == _TRUE_ &&
+          server_write(fd,opk.cl[index_type],(opk.l_max+1)*sizeof(double)) == _FAILURE_)
+        answer = _FAILURE_;
+    }
+    if (answer == _SUCCESS_ &&
+        (server_write(fd,&(opk.k_size),sizeof(int)) == _FAILURE_ ||
+         server_write(fd,&(opk.z_size),sizeof(int)) == _FAILURE_ ||
+         server_write(fd,opk.k,opk.k_size*sizeof(double)) == _FAILURE_ ||
+         server_write(fd,opk.z,opk.z_size*sizeof(double)) == _FAILURE_ ||
+         server_write(fd,opk.pk,opk.z_size*opk.k_size*sizeof(double)) == _FAILURE_))
+      answer = _FAILURE_;
+  }
+
+  /** - free the structures (the caches shared by all runs are kept) */
+
+  output_packed_free(&opk);
+
+  if (stage > 8) distortions_free(&sd);
+  if (stage > 7) lensing_free(&le);
+  if (stage > 6) harmonic_free(&hr);
+  if (stage > 5) transfer_free(&tr);
+  if (stage > 4) fourier_free(&fo);
+  if (stage > 3) primordial_free(&pm);
+  if (stage > 2) perturbations_free(&pt);
+  if (stage > 1) thermodynamics_free(&th);
+  if (stage > 0) background_free(&ba);
+
+  if (threads > 0)
+    class_threads_set(threads);
+
+  return answer;
+}
+
+int main(int argc, char **argv) {
+
+  struct file_content fc_server; /* caches switched on by default in the server */
+  struct file_content fc_input;  /* parameters of the input and precision files */
+  struct file_content fc;        /* default parameters of the requests */
+  char server_defaults[] =
+    "perturbations_cache_size = 4\n"
+    "transfer_cache_size = 2\n"
+    "hmcode_cache = 1\n";
+  struct sockaddr_un address;
+  struct sigaction action;
+  ErrorMsg errmsg;
+  int server_fd, fd;
+  int size;
+  char * text;
+
+  if (argc < 2) {
+    printf("\n\nUsage: %s <socket> [file.ini] [file.pre]\n",argv[0]);
+    return _FAILURE_;
+  }
+
+  /* the caches that a single run does not need are switched on, unless set in the files */
+  if (input_find_file(argc-1,argv+1,&fc_input,errmsg) == _FAILURE_ ||
+      parser_read_text(server_defaults,"server defaults",&fc_server,errmsg) == _FAILURE_ ||
+      parser_merge(&fc_server,&fc_input,&fc,errmsg) == _FAILURE_) {
+    printf("\n\nError reading the default parameters \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+  parser_free(&fc_server);
+  parser_free(&fc_input);
+
+  /* stop cleanly on SIGINT or SIGTERM, and survive clients that disconnect early */
+  memset(&action,0,sizeof(action));
+  action.sa_handler = server_signal;
+  sigaction(SIGINT,&action,NULL);
+  sigaction(SIGTERM,&action,NULL);
+  signal(SIGPIPE,SIG_IGN);
+
+  memset(&address,0,sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(argv[1]) >= sizeof(address.sun_path)) {
+    printf("\n\nError: socket name '%s' too long\n",argv[1]);
+    return _FAILURE_;
+  }
+  strcpy(address.sun_path,argv[1]);
+  unlink(argv[1]);
+
+  server_fd = socket(AF_UNIX,SOCK_STREAM,0);
+  if (server_fd < 0 ||
+      bind(server_fd,(struct sockaddr *)&address,sizeof(address)) < 0 ||
+      listen(server_fd,SOMAXCONN) < 0) {
+    printf("\n\nError: cannot listen on socket '%s' (%s)\n",argv[1],strerror(errno));
+    return _FAILURE_;
+  }
+
+  printf("CLASS server listening on %s\n",argv[1]);
+  fflush(stdout);
+
+  while (server_stop == _FALSE_) {
+
+    fd = accept(server_fd,NULL,NULL);
+    if (fd < 0) continue;
+
+    /* requests of this connection, until the client closes it */
+    while (server_stop == _FALSE_ &&
+           server_read(fd,&size,sizeof(int)) == _SUCCESS_ &&
+           size >= 0) {
+
+      text = malloc(size+1);
+      if (text == NULL || server_read(fd,text,size) == _FAILURE_) {
+        free(text);
+        break;
+      }
+      text[size] = '\0';
+
+      if (server_run(fd,&fc,text) == _FAILURE_) {
+        free(text);
+        break;
+      }
+      free(text);
+    }
+
+    close(fd);
+  }
+
+  close(server_fd);
+  unlink(argv[1]);
+  parser_free(&fc);
+
+  return _SUCCESS_;
+}
@@ -0,0 +1,852 @@
+/** @file class_tune.c
+ * Search the cheapest precision settings keeping the C_l's and P(k) close to a reference
+ *
+ * Usage: ./class_tune [-e <sigma>] [-p <error>] [-o <output.pre>] <points> <reference.pre> [file.ini] [file.pre]
+ *
+ * The reference precision file (e.g. cl_ref.pre or pk_ref.pre) defines
+ * the truth: the C_l's and P(k,z) of each point of the file <points>
+ * are first computed with the input and precision files plus the
+ * reference file. <points> has the format of class_grid (one line with
+ * the names of the varied parameters, then one line of values per
+ * point) and samples the range of parameters over which the settings
+ * must be accurate.
+ *
+ * Each numerical precision parameter p set in the reference file is
+ * then moved from its reference value p_ref towards its value p_start
+ * in the input and precision files (or its default of precisions.h):
+ * p(t) = p_ref (p_start/p_ref)^t, or p_ref + t (p_start-p_ref) if one of
+ * them is not positive, rounded for integers. t = 0 is the reference
+ * and t = 1 the starting settings; values of t up to 2 (by steps of
+ * 0.25) are tried for positive parameters, i.e. settings cheaper than
+ * the starting ones. A set of values is accepted if, at all points,
+ *
+ *  - each C_l differs from the reference by less than <sigma> times
+ *    its cosmic variance, sqrt((C_l^XY^2+C_l^XX C_l^YY)/(2l+1)), for all
+ *    l and types (-e, default: 0.1);
+ *  - P(k,z) differs from the reference, interpolated at the same k, by
+ *    less than the relative error <error> (-p, default: 1.e-3).
+ *
+ * The search first finds the largest common t of all parameters
+ * accepted (bisection between 0 and 1, unless t = 1 is accepted), then
+ * increases the t of each parameter in turn, in the order of the
+ * reference file, as long as the settings are accepted. Every set of
+ * values costs one run per point: with the full reference files and
+ * several points, the search takes hours, and may be restricted to the
+ * relevant parameters by removing the others from a copy of the
+ * reference file.
+ *
+ * The parameters whose value differs from the starting one are written
+ * in <output.pre> (default: tuned.pre), together with the non-numerical
+ * parameters of the reference file. The time of the reference, starting
+ * and tuned settings, summed over all points, and their largest errors
+ * are printed at the end.
+ */
+
+#include "class.h"
+#include <stddef.h>
+
+#define _TUNE_STEP_ 0.25   /**< step in t of the search of each parameter */
+#define _TUNE_T_MAX_ 2.    /**< largest t tried for positive parameters */
+#define _TUNE_BISECTIONS_ 4 /**< number of bisections of the common t */
+
+/* initialize one more module if all previous ones succeeded, counting them in 'stage' */
+#define tune_init(init, error_message) {        \
+    if (status == _SUCCESS_) {                  \
+      if ((init) == _FAILURE_) {                \
+        strcpy(errmsg,error_message);           \
+        status = _FAILURE_;                     \
+      }                                         \
+      else                                      \
+        stage++;                                \
+    }                                           \
+  }
+
+/** numerical precision parameter of precisions.h */
+struct tune_precision {
+  const char * name;
+  short is_int;       /**< whether it is an int (or an enumeration), otherwise a double */
+  size_t offset;      /**< position in struct precision */
+};
+
+/* table of all numerical precision parameters, generated from precisions.h */
+#define class_precision_parameter(NAME,TYPE,DEF_VALUE) {#NAME,(sizeof(TYPE) == sizeof(int)),offsetof(struct precision,NAME)},
+#define class_string_parameter(NAME,DIR,STRING)
+#define class_type_parameter(NAME,READ_TP,REAL_TP,DEF_VAL) {#NAME,_TRUE_,offsetof(struct precision,NAME)},
+static struct tune_precision tune_precisions[] = {
+#include "precisions.h"
+};
+
+/** precision parameter of the reference file varied by the search */
+struct tune_knob {
+  FileArg name;
+  short is_int;       /**< whether the value is rounded to an integer */
+  double reference;   /**< value in the reference file (t = 0) */
+  double start;       /**< value in the input files, or default (t = 1) */
+  double t_max;       /**< largest t tried */
+};
+
+/** everything shared by the runs of the search */
+struct tune_context {
+  struct file_content fc_input;     /**< parameters of the input and precision files */
+  struct file_content fc_fixed;     /**< parameters of the reference file that are not varied */
+  int param_size;                   /**< number of varied cosmological parameters */
+  FileArg * names;                  /**< their names */
+  int point_size;                   /**< number of points */
+  FileArg * values;                 /**< values[index_point*param_size+index_param] */
+  struct output_packed * reference; /**< results of the reference settings at each point */
+  int knob_size;                    /**< number of precision parameters varied */
+  struct tune_knob * knob;          /**< these parameters */
+  double cl_target;                 /**< largest error on the C_l's, in units of cosmic variance */
+  double pk_target;                 /**< largest relative error on P(k,z) */
+};
+
+/**
+ * Wall-clock time in seconds
+ */
+
+static double tune_time() {
+
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return now.tv_sec+1.e-9*now.tv_nsec;
+#endif
+}
+
+/**
+ * Value of a precision parameter at position t between its reference
+ * (t = 0) and starting (t = 1) values
+ */
+
+static double tune_value(struct tune_knob * pknob, double t) {
+
+  double value;
+
+  if ((pknob->reference > 0.) && (pknob->start > 0.))
+    value = pknob->reference*pow(pknob->start/pknob->reference,t);
+  else
+    value = pknob->reference+t*(pknob->start-pknob->reference);
+
+  if (pknob->is_int == _TRUE_)
+    value = floor(value+0.5);
+
+  return value;
+}
+
+/**
+ * Read the names of the varied parameters and their values at each
+ * point, in the format of class_grid
+ *
+ * @param filename    Input: name of the file
+ * @param ptc         Output: param_size, names, point_size and values are set (names and values allocated here)
+ * @param errmsg      Output: error message
+ * @return the error status
+ */
+
+static int tune_read_points(char * filename,
+                            struct tune_context * ptc,
+                            ErrorMsg errmsg) {
+
+  FILE * file;
+  char line[_LINE_LENGTH_MAX_];
+  char * token;
+  char * saveptr;
+  char * left;
+  int line_number = 0;
+  int point_max = 0;
+  int counter;
+
+  ptc->param_size = 0;
+  ptc->point_size = 0;
+  ptc->names = NULL;
+  ptc->values = NULL;
+
+  class_open(file,filename,"r",errmsg);
+
+  while (fgets(line,_LINE_LENGTH_MAX_,file) != NULL) {
+
+    line_number++;
+
+    left = line;
+    while ((left[0] == ' ') || (left[0] == '\t'))
+      left++;
+    if ((left[0] == '#') || (left[0] == '%') || (left[0] == '\n') || (left[0] == '\r') || (left[0] == '\0'))
+      continue;
+
+    /* the first line gives the names */
+    if (ptc->param_size == 0) {
+      for (token = strtok_r(left," \t\r\n",&saveptr); token != NULL; token = strtok_r(NULL," \t\r\n",&saveptr)) {
+        class_realloc(ptc->names,ptc->names,(ptc->param_size+1)*sizeof(FileArg),errmsg);
+        strcpy(ptc->names[ptc->param_size],token);
+        ptc->param_size++;
+      }
+      continue;
+    }
+
+    if (ptc->point_size == point_max) {
+      point_max = 2*point_max+16;
+      class_realloc(ptc->values,ptc->values,point_max*ptc->param_size*sizeof(FileArg),errmsg);
+    }
+
+    counter = 0;
+    for (token = strtok_r(left," \t\r\n",&saveptr); token != NULL; token = strtok_r(NULL," \t\r\n",&saveptr)) {
+      class_test(counter == ptc->param_size,
+                 errmsg,
+                 "line %d of file %s has more values than the %d parameter names",line_number,filename,ptc->param_size);
+      strcpy(ptc->values[ptc->point_size*ptc->param_size+counter],token);
+      counter++;
+    }
+    class_test(counter < ptc->param_size,
+               errmsg,
+               "line %d of file %s has %d values instead of %d",line_number,filename,counter,ptc->param_size);
+    ptc->point_size++;
+  }
+
+  fclose(file);
+
+  class_test(ptc->point_size == 0,
+             errmsg,
+             "file %s should contain the names of the parameters, then at least one point",filename);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Sort the parameters of the reference file into the precision
+ * parameters varied by the search and the fixed ones
+ *
+ * @param pfc_reference Input: parameters of the reference file
+ * @param ptc           Input/Output: fc_input is used, knob_size, knob and fc_fixed are set
+ * @param errmsg        Output: error message
+ * @return the error status
+ */
+
+static int tune_knobs_init(struct file_content * pfc_reference,
+                           struct tune_context * ptc,
+                           ErrorMsg errmsg) {
+
+  struct precision pr;
+  struct background ba;
+  struct thermodynamics th;
+  struct perturbations pt;
+  struct primordial pm;
+  struct fourier fo;
+  struct transfer tr;
+  struct harmonic hr;
+  struct lensing le;
+  struct distortions sd;
+  struct output op;
+  struct tune_knob * pknob;
+  char * fixed = NULL;
+  int fixed_length = 0;
+  int index, index_precision;
+  int precision_size = sizeof(tune_precisions)/sizeof(struct tune_precision);
+  double value;
+  char * end;
+
+  /* starting values: those of the input and precision files, or the defaults */
+  class_call(input_read_precisions(&(ptc->fc_input),&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg),
+             errmsg,
+             errmsg);
+
+  class_alloc(ptc->knob,pfc_reference->size*sizeof(struct tune_knob),errmsg);
+  ptc->knob_size = 0;
+
+  for (index=0; index<pfc_reference->size; index++) {
+
+    for (index_precision=0; index_precision<precision_size; index_precision++)
+      if (strcmp(tune_precisions[index_precision].name,pfc_reference->name[index]) == 0)
+        break;
+
+    value = strtod(pfc_reference->value[index],&end);
+
+    if ((index_precision < precision_size) && (end != pfc_reference->value[index])) {
+
+      pknob = ptc->knob+ptc->knob_size;
+      strcpy(pknob->name,pfc_reference->name[index]);
+      pknob->is_int = tune_precisions[index_precision].is_int;
+      pknob->reference = value;
+      if (pknob->is_int == _TRUE_)
+        pknob->start = *(int*)((char*)&pr+tune_precisions[index_precision].offset);
+      else
+        pknob->start = *(double*)((char*)&pr+tune_precisions[index_precision].offset);
+
+      /* extrapolation beyond the starting value only for positive parameters */
+      if ((pknob->reference > 0.) && (pknob->start > 0.))
+        pknob->t_max = _TUNE_T_MAX_;
+      else
+        pknob->t_max = 1.;
+
+      /* a parameter with the same value in both settings is left out */
+      if (pknob->start != pknob->reference)
+        ptc->knob_size++;
+    }
+    else {
+      /* kept at its reference value in all settings */
+      class_realloc(fixed,fixed,fixed_length+2*_ARGUMENT_LENGTH_MAX_+8,errmsg);
+      fixed_length += sprintf(fixed+fixed_length,"%s = %s\n",pfc_reference->name[index],pfc_reference->value[index]);
+    }
+  }
+
+  class_call(parser_read_text((fixed == NULL ? "" : fixed),"fixed reference parameters",&(ptc->fc_fixed),errmsg),
+             errmsg,
+             errmsg);
+  free(fixed);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Parameters of the settings with positions t of the varied precision
+ * parameters, including the fixed parameters of the reference file
+ *
+ * @param ptc    Input: search
+ * @param t      Input: position of each varied parameter
+ * @param pfc    Output: parameters (allocated here)
+ * @param errmsg Output: error message
+ * @return the error status
+ */
+
+static int tune_settings(struct tune_context * ptc,
+                         double * t,
+                         struct file_content * pfc,
+                         ErrorMsg errmsg) {
+
+  struct file_content fc_knobs;
+  struct file_content fc_precision;
+  int index_knob;
+
+  class_call(parser_init(&fc_knobs,ptc->knob_size,"tuned parameters",errmsg),errmsg,errmsg);
+  for (index_knob=0; index_knob<ptc->knob_size; index_knob++) {
+    strcpy(fc_knobs.name[index_knob],ptc->knob[index_knob].name);
+    if (ptc->knob[index_knob].is_int == _TRUE_)
+      sprintf(fc_knobs.value[index_knob],"%d",(int)tune_value(ptc->knob+index_knob,t[index_knob]));
+    else
+      sprintf(fc_knobs.value[index_knob],"%.10g",tune_value(ptc->knob+index_knob,t[index_knob]));
+    fc_knobs.read[index_knob] = _FALSE_;
+  }
+
+  class_call(parser_index(&fc_knobs,errmsg),errmsg,errmsg);
+  class_call(parser_merge(&(ptc->fc_fixed),&fc_knobs,&fc_precision,errmsg),errmsg,errmsg);
+  class_call(parser_merge(&(ptc->fc_input),&fc_precision,pfc,errmsg),errmsg,errmsg);
+
+  parser_free(&fc_knobs);
+  parser_free(&fc_precision);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Run CLASS on one point with some settings, keeping its C_l's and P(k,z)
+ *
+ * @param ptc         Input: search
+ * @param pfc_settings Input: input and precision parameters
+ * @param index_point Input: index of the point
+ * @param popk        Output: results (to be freed with output_packed_free() if the run succeeded)
+ * @param errmsg      Output: error message of the run
+ * @return the status of the run
+ */
+
+static int tune_run(struct tune_context * ptc,
+                    struct file_content * pfc_settings,
+                    int index_point,
+                    struct output_packed * popk,
+                    ErrorMsg errmsg) {
+
+  struct precision pr;
+  struct background ba;
+  struct thermodynamics th;
+  struct perturbations pt;
+  struct primordial pm;
+  struct fourier fo;
+  struct transfer tr;
+  struct harmonic hr;
+  struct lensing le;
+  struct distortions sd;
+  struct output op;
+  struct file_content fc_point;
+  struct file_content fc;
+  int stage = 0;             /* number of modules initialized */
+  int status = _SUCCESS_;
+  int index_param;
+
+  errmsg[0] = '\0';
+  fc.size = 0;
+  fc.hash_size = 0;
+  popk->cl_table = NULL;
+  popk->pk = NULL;
+
+  if (parser_init(&fc_point,ptc->param_size,"points",errmsg) == _FAILURE_) {
+    status = _FAILURE_;
+  }
+  else {
+    for (index_param=0; index_param<ptc->param_size; index_param++) {
+      strcpy(fc_point.name[index_param],ptc->names[index_param]);
+      strcpy(fc_point.value[index_param],ptc->values[index_point*ptc->param_size+index_param]);
+      fc_point.read[index_param] = _FALSE_;
+    }
+    if (parser_index(&fc_point,errmsg) == _FAILURE_ ||
+        parser_merge(pfc_settings,&fc_point,&fc,errmsg) == _FAILURE_ ||
+        input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg) == _FAILURE_) {
+      status = _FAILURE_;
+    }
+    parser_free(&fc_point);
+  }
+  parser_free(&fc);
+
+  if (status == _SUCCESS_) {
+    tune_init(background_init(&pr,&ba),ba.error_message);
+    tune_init(thermodynamics_init(&pr,&ba,&th),th.error_message);
+    tune_init(perturbations_init(&pr,&ba,&th,&pt),pt.error_message);
+    tune_init(primordial_init(&pr,&pt,&pm),pm.error_message);
+    tune_init(fourier_init(&pr,&ba,&th,&pt,&pm,&fo),fo.error_message);
+    tune_init(transfer_init(&pr,&ba,&th,&pt,&fo,&tr),tr.error_message);
+    tune_init(harmonic_init(&pr,&ba,&pt,&pm,&fo,&tr,&hr),hr.error_message);
+    tune_init(lensing_init(&pr,&pt,&hr,&fo,&le),le.error_message);
+  }
+
+  if (status == _SUCCESS_ &&
+      output_packed_init(&ba,&pt,&fo,&hr,&le,&op,popk) == _FAILURE_) {
+    strcpy(errmsg,op.error_message);
+    status = _FAILURE_;
+  }
+
+  /* the wavenumbers and redshifts of popk point to structures freed below */
+  if (status == _SUCCESS_) {
+    if (popk->k_size > 0) {
+      popk->k = malloc(popk->k_size*sizeof(double));
+      popk->z = malloc(popk->z_size*sizeof(double));
+      if ((popk->k == NULL) || (popk->z == NULL)) {
+        sprintf(errmsg,"could not allocate the wavenumbers and redshifts of the results");
+        status = _FAILURE_;
+      }
+      else {
+        memcpy(popk->k,fo.k,popk->k_size*sizeof(double));
+        memcpy(popk->z,op.z_pk,popk->z_size*sizeof(double));
+      }
+    }
+    else {
+      popk->k = NULL;
+      popk->z = NULL;
+    }
+  }
+
+  if (stage > 7) lensing_free(&le);
+  if (stage > 6) harmonic_free(&hr);
+  if (stage > 5) transfer_free(&tr);
+  if (stage > 4) fourier_free(&fo);
+  if (stage > 3) primordial_free(&pm);
+  if (stage > 2) perturbations_free(&pt);
+  if (stage > 1) thermodynamics_free(&th);
+  if (stage > 0) background_free(&ba);
+
+  return status;
+}
+
+/**
+ * Free the results of a successful run
+ */
+
+static void tune_results_free(struct output_packed * popk) {
+
+  free(popk->k);
+  free(popk->z);
+  output_packed_free(popk);
+}
+
+/**
+ * Largest differences between the results of some settings and those
+ * of the reference at one point
+ *
+ * @param pref     Input: results of the reference settings
+ * @param popk     Input: results of the settings
+ * @param cl_error Input/Output: largest error on the C_l's so far, in units of cosmic variance
+ * @param pk_error Input/Output: largest relative error on P(k,z) so far
+ */
+
+static void tune_compare(struct output_packed * pref,
+                         struct output_packed * popk,
+                         double * cl_error,
+                         double * pk_error) {
+
+  /* auto-correlations XX and YY of each type XY of TT, EE, TE, BB, PP, TP */
+  int auto_x[_OUTPUT_PACKED_CL_TYPES_] = {0,1,0,3,4,0};
+  int auto_y[_OUTPUT_PACKED_CL_TYPES_] = {0,1,1,3,4,4};
+  int index_type, l, l_max, index_z, index_k, index_ref;
+  double variance, pk_ref, x;
+
+  /** - C_l's, compared to the cosmic variance of the reference */
+
+  l_max = MIN(pref->l_max,popk->l_max);
+
+  for (index_type=0; index_type<_OUTPUT_PACKED_CL_TYPES_; index_type++) {
+
+    if ((pref->has_cl[index_type] == _FALSE_) || (popk->has_cl[index_type] == _FALSE_) ||
+        (pref->has_cl[auto_x[index_type]] == _FALSE_) || (pref->has_cl[auto_y[index_type]] == _FALSE_))
+      continue;
+
+    for (l=2; l<=l_max; l++) {
+      variance = (pref->cl[index_type][l]*pref->cl[index_type][l]
+                  +pref->cl[auto_x[index_type]][l]*pref->cl[auto_y[index_type]][l])/(2.*l+1.);
+      if (variance > 0.)
+        *cl_error = MAX(*cl_error,fabs(popk->cl[index_type][l]-pref->cl[index_type][l])/sqrt(variance));
+    }
+  }
+
+  /** - P(k,z), with the reference interpolated linearly in log(k) and log(P) at the wavenumbers of the settings */
+
+  if ((pref->k_size < 2) || (popk->k_size == 0) || (pref->z_size != popk->z_size))
+    return;
+
+  for (index_z=0; index_z<popk->z_size; index_z++) {
+    index_ref = 0;
+    for (index_k=0; index_k<popk->k_size; index_k++) {
+
+      if ((popk->k[index_k] < pref->k[0]) || (popk->k[index_k] > pref->k[pref->k_size-1]))
+        continue;
+
+      while ((index_ref < pref->k_size-2) && (pref->k[index_ref+1] < popk->k[index_k]))
+        index_ref++;
+
+      x = log(popk->k[index_k]/pref->k[index_ref])/log(pref->k[index_ref+1]/pref->k[index_ref]);
+      pk_ref = exp((1.-x)*log(pref->pk[index_z*pref->k_size+index_ref])
+                   +x*log(pref->pk[index_z*pref->k_size+index_ref+1]));
+
+      *pk_error = MAX(*pk_error,fabs(popk->pk[index_z*popk->k_size+index_k]/pk_ref-1.));
+    }
+  }
+}
+
+/**
+ * Run all points with the settings of positions t, and compare them
+ * to the reference
+ *
+ * @param ptc      Input: search
+ * @param t          Input: position of each varied parameter
+ * @param all_points Input: whether to run all points even when the settings are rejected at a first one
+ * @param seconds  Output: time of all runs
+ * @param cl_error Output: largest error on the C_l's, in units of cosmic variance
+ * @param pk_error Output: largest relative error on P(k,z)
+ * @param accepted Output: whether all runs succeeded within the targets
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+static int tune_evaluate(struct tune_context * ptc,
+                         double * t,
+                         short all_points,
+                         double * seconds,
+                         double * cl_error,
+                         double * pk_error,
+                         short * accepted,
+                         ErrorMsg errmsg) {
+
+  struct file_content fc;
+  struct output_packed opk;
+  ErrorMsg run_error;
+  int index_point;
+  double start;
+
+  class_call(tune_settings(ptc,t,&fc,errmsg),errmsg,errmsg);
+
+  *seconds = 0.;
+  *cl_error = 0.;
+  *pk_error = 0.;
+  *accepted = _TRUE_;
+
+  for (index_point=0; index_point<ptc->point_size; index_point++) {
+
+    start = tune_time();
+
+    if (tune_run(ptc,&fc,index_point,&opk,run_error) == _FAILURE_) {
+      printf("    (run failed at point %d: %s)\n",index_point,run_error);
+      *accepted = _FALSE_;
+      break;
+    }
+
+    *seconds += tune_time()-start;
+
+    tune_compare(ptc->reference+index_point,&opk,cl_error,pk_error);
+    tune_results_free(&opk);
+
+    /* no need to run the other points of rejected settings, unless their time is needed */
+    if ((*cl_error > ptc->cl_target) || (*pk_error > ptc->pk_target)) {
+      *accepted = _FALSE_;
+      if (all_points == _FALSE_)
+        break;
+    }
+  }
+
+  parser_free(&fc);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write the precision parameters of the tuned settings
+ *
+ * @param filename Input: name of the file
+ * @param ptc      Input: search
+ * @param t        Input: position of each varied parameter
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+static int tune_write(char * filename,
+                      struct tune_context * ptc,
+                      double * t,
+                      ErrorMsg errmsg) {
+
+  FILE * file;
+  int index_knob, index;
+  double value;
+
+  class_open(file,filename,"w",errmsg);
+
+  fprintf(file,"# precision file written by class_tune: C_l's within %g times their cosmic variance\n",ptc->cl_target);
+  fprintf(file,"# and P(k) within a relative error of %g of the reference, at the %d point(s) tested\n",ptc->pk_target,ptc->point_size);
+
+  for (index_knob=0; index_knob<ptc->knob_size; index_knob++) {
+    value = tune_value(ptc->knob+index_knob,t[index_knob]);
+    if (value == ptc->knob[index_knob].start)
+      continue;
+    if (ptc->knob[index_knob].is_int == _TRUE_)
+      fprintf(file,"%s = %d\n",ptc->knob[index_knob].name,(int)value);
+    else
+      fprintf(file,"%s = %.6g\n",ptc->knob[index_knob].name,value);
+  }
+
+  for (index=0; index<ptc->fc_fixed.size; index++)
+    fprintf(file,"%s = %s\n",ptc->fc_fixed.name[index],ptc->fc_fixed.value[index]);
+
+  fclose(file);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Search of the tuned settings
+ *
+ * @param ptc            Input: search, with the results of the reference settings
+ * @param reference_time Input: time of all points with the reference settings
+ * @param start_accepted Input: whether the starting settings are accepted
+ * @param start_time     Input: time of all points with the starting settings
+ * @param start_cl       Input: their largest error on the C_l's
+ * @param start_pk       Input: their largest error on P(k,z)
+ * @param t              Output: position of each varied parameter in the tuned settings
+ * @param tuned_time     Output: time of all points with the tuned settings
+ * @param tuned_cl       Output: their largest error on the C_l's
+ * @param tuned_pk       Output: their largest error on P(k,z)
+ * @param errmsg         Output: error message
+ * @return the error status
+ */
+
+static int tune_search(struct tune_context * ptc,
+                       double reference_time,
+                       short start_accepted,
+                       double start_time,
+                       double start_cl,
+                       double start_pk,
+                       double * t,
+                       double * tuned_time,
+                       double * tuned_cl,
+                       double * tuned_pk,
+                       ErrorMsg errmsg) {
+
+  double * t_try;
+  double t_low, t_high = 1., t_mid;
+  double seconds, cl_error, pk_error;
+  short accepted;
+  int index_knob, index_bisection;
+
+  class_alloc(t_try,MAX(ptc->knob_size,1)*sizeof(double),errmsg);
+
+  /** - common position of all parameters: t = 1 (the starting settings) if
+        accepted, otherwise bisection from t = 0 (the reference settings) */
+
+  if (start_accepted == _TRUE_) {
+    t_low = 1.;
+    *tuned_time = start_time;
+    *tuned_cl = start_cl;
+    *tuned_pk = start_pk;
+  }
+  else {
+    t_low = 0.;
+    *tuned_time = reference_time;
+    *tuned_cl = 0.;
+    *tuned_pk = 0.;
+    for (index_bisection=0; index_bisection<_TUNE_BISECTIONS_; index_bisection++) {
+      t_mid = 0.5*(t_low+t_high);
+      for (index_knob=0; index_knob<ptc->knob_size; index_knob++)
+        t_try[index_knob] = t_mid;
+      class_call(tune_evaluate(ptc,t_try,_TRUE_,&seconds,&cl_error,&pk_error,&accepted,errmsg),errmsg,errmsg);
+      printf(" -> all parameters at t = %.4f: %s (%.3g sigma on C_l, %.3g on P(k), %.2f s)\n",
+             t_mid,(accepted == _TRUE_ ? "accepted" : "rejected"),cl_error,pk_error,seconds);
+      fflush(stdout);
+      if (accepted == _TRUE_) {
+        t_low = t_mid;
+        *tuned_time = seconds;
+        *tuned_cl = cl_error;
+        *tuned_pk = pk_error;
+      }
+      else {
+        t_high = t_mid;
+      }
+    }
+  }
+
+  for (index_knob=0; index_knob<ptc->knob_size; index_knob++)
+    t[index_knob] = t_low;
+
+  /** - then each parameter in turn, as far as the settings are accepted */
+
+  for (index_knob=0; index_knob<ptc->knob_size; index_knob++) {
+
+    memcpy(t_try,t,ptc->knob_size*sizeof(double));
+
+    while (t_try[index_knob]+_TUNE_STEP_ <= ptc->knob[index_knob].t_max+1.e-10) {
+
+      t_try[index_knob] += _TUNE_STEP_;
+
+      /* integers may not change over one step */
+      if (tune_value(ptc->knob+index_knob,t_try[index_knob]) == tune_value(ptc->knob+index_knob,t[index_knob]))
+        continue;
+
+      class_call(tune_evaluate(ptc,t_try,_FALSE_,&seconds,&cl_error,&pk_error,&accepted,errmsg),errmsg,errmsg);
+
+      printf(" -> %s = %g: %s (%.3g sigma on C_l, %.3g on P(k), %.2f s)\n",
+             ptc->knob[index_knob].name,tune_value(ptc->knob+index_knob,t_try[index_knob]),
+             (accepted == _TRUE_ ? "accepted" : "rejected"),cl_error,pk_error,seconds);
+      fflush(stdout);
+
+      if (accepted == _FALSE_)
+        break;
+
+      t[index_knob] = t_try[index_knob];
+      *tuned_time = seconds;
+      *tuned_cl = cl_error;
+      *tuned_pk = pk_error;
+    }
+  }
+
+  free(t_try);
+
+  return _SUCCESS_;
+}
+
+int main(int argc, char **argv) {
+
+  struct tune_context tc;
+  struct file_content fc_reference;
+  struct file_content fc;
+  char * output_name = "tuned.pre";
+  ErrorMsg errmsg;
+  int first = 1;                 /* index of the first positional argument */
+  int index_point, index_knob;
+  double * t;
+  double start;
+  double reference_time = 0., start_time, start_cl, start_pk, tuned_time, tuned_cl, tuned_pk;
+  short accepted;
+
+  tc.cl_target = 0.1;
+  tc.pk_target = 1.e-3;
+
+  for (; (first<argc-1) && (argv[first][0] == '-'); first+=2) {
+    if (strcmp(argv[first],"-e") == 0)
+      tc.cl_target = atof(argv[first+1]);
+    else if (strcmp(argv[first],"-p") == 0)
+      tc.pk_target = atof(argv[first+1]);
+    else if (strcmp(argv[first],"-o") == 0)
+      output_name = argv[first+1];
+    else
+      break;
+  }
+
+  if ((argc < first+2) || (argv[first][0] == '-') || (tc.cl_target <= 0.) || (tc.pk_target <= 0.)) {
+    printf("\n\nUsage: %s [-e <sigma>] [-p <error>] [-o <output.pre>] <points> <reference.pre> [file.ini] [file.pre]\n",argv[0]);
+    return _FAILURE_;
+  }
+
+  /* (argv[first+1], the reference file, plays the role of the program name for input_find_file) */
+  if (tune_read_points(argv[first],&tc,errmsg) == _FAILURE_ ||
+      input_find_file(argc-first-1,argv+first+1,&(tc.fc_input),errmsg) == _FAILURE_ ||
+      parser_read_file(argv[first+1],&fc_reference,errmsg) == _FAILURE_ ||
+      tune_knobs_init(&fc_reference,&tc,errmsg) == _FAILURE_) {
+    printf("\n\nError reading the parameters \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  printf("Tuning %d precision parameter(s) of %s at %d point(s), %d other parameter(s) kept at their reference value\n",
+         tc.knob_size,argv[first+1],tc.point_size,tc.fc_fixed.size);
+
+  /** - results of the reference settings */
+
+  tc.reference = malloc(tc.point_size*sizeof(struct output_packed));
+  if ((tc.reference == NULL) ||
+      (parser_merge(&(tc.fc_input),&fc_reference,&fc,errmsg) == _FAILURE_)) {
+    printf("\n\nError preparing the reference runs\n");
+    return _FAILURE_;
+  }
+
+  for (index_point=0; index_point<tc.point_size; index_point++) {
+    start = tune_time();
+    if (tune_run(&tc,&fc,index_point,tc.reference+index_point,errmsg) == _FAILURE_) {
+      printf("\n\nError in the reference run of point %d\n=>%s\n",index_point,errmsg);
+      return _FAILURE_;
+    }
+    reference_time += tune_time()-start;
+  }
+  parser_free(&fc);
+  printf(" -> reference settings: %.2f s\n",reference_time);
+
+  /** - starting settings, then search */
+
+  t = malloc(MAX(tc.knob_size,1)*sizeof(double));
+  for (index_knob=0; index_knob<tc.knob_size; index_knob++)
+    t[index_knob] = 1.;
+
+  if (tune_evaluate(&tc,t,_TRUE_,&start_time,&start_cl,&start_pk,&accepted,errmsg) == _FAILURE_) {
+    printf("\n\nError in the search \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+  printf(" -> starting settings: %s (%.3g sigma on C_l, %.3g on P(k), %.2f s)\n",
+         (accepted == _TRUE_ ? "accepted" : "rejected"),start_cl,start_pk,start_time);
+  fflush(stdout);
+
+  if (tune_search(&tc,reference_time,accepted,start_time,start_cl,start_pk,t,&tuned_time,&tuned_cl,&tuned_pk,errmsg) == _FAILURE_ ||
+      tune_write(output_name,&tc,t,errmsg) == _FAILURE_) {
+    printf("\n\nError in the search \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  /** - report */
+
+  printf("\n%-40s %14s %14s %14s\n","parameter","reference","start","tuned");
+  for (index_knob=0; index_knob<tc.knob_size; index_knob++)
+    printf("%-40s %14g %14g %14g\n",tc.knob[index_knob].name,tc.knob[index_knob].reference,
+           tc.knob[index_knob].start,tune_value(tc.knob+index_knob,t[index_knob]));
+
+  printf("\n%-20s %12s %16s %16s\n","settings","time [s]","C_l [sigma]","P(k)");
+  printf("%-20s %12.2f %16.3g %16.3g\n","reference",reference_time,0.,0.);
+  printf("%-20s %12.2f %16.3g %16.3g%s\n","start",start_time,start_cl,start_pk,
+         ((start_cl > tc.cl_target) || (start_pk > tc.pk_target) ? "  (outside the targets)" : ""));
+  printf("%-20s %12.2f %16.3g %16.3g\n","tuned",tuned_time,tuned_cl,tuned_pk);
+  printf("\nSpeed-up of the tuned settings: %.2f with respect to the reference, %.2f with respect to the start\n",
+         reference_time/tuned_time,start_time/tuned_time);
+  printf("Tuned settings written in %s\n",output_name);
+
+  for (index_point=0; index_point<tc.point_size; index_point++)
+    tune_results_free(tc.reference+index_point);
+  free(tc.reference);
+  free(tc.knob);
+  free(tc.names);
+  free(tc.values);
+  free(t);
+  parser_free(&fc_reference);
+  parser_free(&(tc.fc_input));
+  parser_free(&(tc.fc_fixed));
+
+  return _SUCCESS_;
+}
@@ -10,6 +10,8 @@ DEF _MAX_NUMBER_OF_K_FILES_ = 30
 DEF _MAXTITLESTRINGLENGTH_ = 8000
 DEF _FILENAMESIZE_ = 256
 DEF _LINE_LENGTH_MAX_ = 1024
+DEF _PROFILE_STAGES_ = 11
+DEF _OUTPUT_PACKED_CL_TYPES_ = 6
 
 cdef extern from "class.h":
 
@@ -52,8 +54,30 @@ cdef extern from "class.h":
         out_sigma_prime
         out_sigma_disp
 
+    cdef enum profile_stage:
+        profile_input
+        profile_background
+        profile_thermodynamics
+        profile_perturbations
+        profile_primordial
+        profile_fourier
+        profile_transfer
+        profile_harmonic
+        profile_lensing
+        profile_distortions
+        profile_output
+
+    cdef struct profile:
+        short has_stage[_PROFILE_STAGES_]
+        double wall[_PROFILE_STAGES_]
+        double cpu[_PROFILE_STAGES_]
+        int threads[_PROFILE_STAGES_]
+        double bytes[_PROFILE_STAGES_]
+        double peak_rss[_PROFILE_STAGES_]
+
     cdef struct precision:
         ErrorMsg error_message
+        int num_threads
 
     cdef struct background:
         ErrorMsg error_message
@@ -66,6 +90,15 @@ cdef extern from "class.h":
         int index_bg_D
         int index_bg_f
         int index_bg_Omega_m
+        int index_bg_H_prime
+        int index_bg_rho_g
+        int index_bg_rho_b
+        int index_bg_rho_tot
+        int index_bg_p_tot
+        int index_bg_rho_crit
+        int index_bg_Omega_r
+        int index_bg_time
+        int index_bg_rs
         short  has_ncdm
         double T_cmb
         double h
@@ -93,6 +126,10 @@ cdef extern from "class.h":
         double Omega0_scf
         double Omega0_k
         int bt_size
+        double * tau_table
+        double * z_table
+        double * loga_table
+        double * background_table
         double Omega0_m
         double Omega0_r
         double Omega0_de
@@ -106,6 +143,13 @@ cdef extern from "class.h":
         int th_size
         int index_th_xe
         int index_th_Tb
+        int index_th_dkappa
+        int index_th_exp_m_kappa
+        int index_th_g
+        int index_th_wb
+        int index_th_cb2
+        int index_th_tau_d
+        int index_th_rate
         double tau_reio
         double z_reio
         double z_rec
@@ -132,6 +176,26 @@ cdef extern from "class.h":
         double m_idm
 
         int tt_size
+        double * z_table
+        double * tau_table
+        double * thermodynamics_table
+
+    cdef struct perturbations_solver_statistics:
+        double tau_start
+        double tau_end
+        short tca_on
+        short rsa_on
+        short tca_idm_dr_on
+        short rsa_idr_on
+        short ufa_on
+        short ncdmfa_on
+        int pt_size
+        int derivs_calls
+        int jacobian_evaluations
+        int lu_decompositions
+        int accepted_steps
+        int rejected_steps
+        double wall_time
 
     cdef struct perturbations:
         ErrorMsg error_message
@@ -170,7 +234,51 @@ cdef extern from "class.h":
 
         int * k_size
         int * ic_size
+        int * tp_size
         int index_md_scalars
+        int index_md_vectors
+        int index_md_tensors
+        int md_size
+        double ** k
+
+        int index_tp_t0
+        int index_tp_t1
+        int index_tp_t2
+        int index_tp_p
+        int index_tp_delta_m
+        int index_tp_delta_cb
+        int index_tp_delta_tot
+        int index_tp_theta_m
+        int index_tp_theta_cb
+        int index_tp_theta_tot
+        int index_tp_phi
+        int index_tp_phi_prime
+        int index_tp_phi_plus_psi
+        int index_tp_psi
+        int index_tp_h
+        int index_tp_h_prime
+        int index_tp_eta
+        int index_tp_eta_prime
+        short has_source_t
+        short has_source_p
+        short has_source_delta_m
+        short has_source_delta_cb
+        short has_source_delta_tot
+        short has_source_theta_m
+        short has_source_theta_cb
+        short has_source_theta_tot
+        short has_source_phi
+        short has_source_phi_prime
+        short has_source_phi_plus_psi
+        short has_source_psi
+        short has_source_h
+        short has_source_h_prime
+        short has_source_eta
+        short has_source_eta_prime
+
+        int store_solver_statistics
+        int ** solver_statistics_size
+        perturbations_solver_statistics *** solver_statistics
 
     cdef struct transfer:
         ErrorMsg error_message
@@ -244,6 +352,24 @@ cdef extern from "class.h":
 
     cdef struct output:
         ErrorMsg error_message
+        short profile_verbose
+
+    cdef struct output_derivatives:
+        int par_size
+        FileArg * name
+        double * fiducial
+        double * step
+        int has_cl[_OUTPUT_PACKED_CL_TYPES_]
+        int l_max
+        double * cl
+        double * dcl
+        int k_size
+        int z_size
+        double * k
+        double * z
+        double * pk
+        double * dpk
+        ErrorMsg error_message
 
     cdef struct distortions:
         double * sd_parameter_table
@@ -312,12 +438,31 @@ cdef extern from "class.h":
         int index_pk_cluster
         ErrorMsg error_message
 
+    cdef enum emulator_cl_types:
+        emulator_tt
+        emulator_ee
+        emulator_te
+        emulator_bb
+        emulator_pp
+
+    cdef struct emulator:
+        int par_size
+        short has_cl[5]
+        int l_max
+        int k_size
+        short pk_nonlinear
+        int out_size
+        double error_cl_max
+        double error_pk_max
+
     cdef struct file_content:
         char * filename
         int size
         FileArg * name
         FileArg * value
         short * read
+        int * hash_table
+        int hash_size
 
     void lensing_free(void*)
     void harmonic_free(void*)
@@ -329,21 +474,31 @@ cdef extern from "class.h":
     void fourier_free(void*)
     void distortions_free(void*)
 
+    int parser_index(void*,char*)
+
     cdef int _FAILURE_
     cdef int _FALSE_
     cdef int _TRUE_
 
     int input_read_from_file(void*, void*, void*, void*, void*, void*, void*, void*, void*,
-        void*, void*, void*, char*)
-    int background_init(void*,void*)
-    int thermodynamics_init(void*,void*,void*)
-    int perturbations_init(void*,void*,void*,void*)
-    int primordial_init(void*,void*,void*)
-    int fourier_init(void*,void*,void*,void*,void*,void*)
-    int transfer_init(void*,void*,void*,void*,void*,void*)
-    int harmonic_init(void*,void*,void*,void*,void*,void*,void*)
-    int lensing_init(void*,void*,void*,void*,void*)
-    int distortions_init(void*,void*,void*,void*,void*,void*)
+        void*, void*, void*, char*) nogil
+    int background_init(void*,void*) nogil
+    int thermodynamics_init(void*,void*,void*) nogil
+    int perturbations_init(void*,void*,void*,void*) nogil
+    int primordial_init(void*,void*,void*) nogil
+    int fourier_init(void*,void*,void*,void*,void*,void*) nogil
+    int transfer_init(void*,void*,void*,void*,void*,void*) nogil
+    int harmonic_init(void*,void*,void*,void*,void*,void*,void*) nogil
+    int lensing_init(void*,void*,void*,void*,void*) nogil
+    int distortions_init(void*,void*,void*,void*,void*,void*) nogil
+
+    int class_threads_set(int num_threads)
+
+    const char * profile_stage_name[_PROFILE_STAGES_]
+    void profile_init(profile * pprof)
+    void profile_start(profile * pprof, profile_stage stage) nogil
+    void profile_stop(profile * pprof, profile_stage stage) nogil
+    void profile_print(profile * pprof)
 
     int background_tau_of_z(void* pba, double z,double* tau)
     int background_z_of_tau(void* pba, double tau,double* z)
@@ -356,6 +511,7 @@ cdef extern from "class.h":
     int thermodynamics_output_titles(void * pba, void *pth, char titles[_MAXTITLESTRINGLENGTH_])
     int thermodynamics_output_data(void *pba, void *pth, int number_of_titles, double *data)
 
+    int perturbations_sources_at_tau_vec(void *ppt, int index_md, int index_ic, int * tp_vec, int tp_vec_size, double * tau_vec, int tau_vec_size, double * psources)
     int perturbations_output_data(void *pba,void *ppt, file_format output_format, double z, int number_of_titles, double *data)
     int perturbations_output_firstline_and_ic_suffix(void *ppt, int index_ic, char first_line[_LINE_LENGTH_MAX_], FileName ic_suffix)
     int perturbations_output_titles(void *pba, void *ppt,  file_format output_format, char titles[_MAXTITLESTRINGLENGTH_])
@@ -366,6 +522,20 @@ cdef extern from "class.h":
     int harmonic_cl_at_l(void* phr,double l,double * cl,double * * cl_md,double * * cl_md_ic)
     int lensing_cl_at_l(void * ple,int l,double * cl_lensed)
 
+    int emulator_read(char * filename, void * pem, char * errmsg)
+    int emulator_free(void * pem)
+    int emulator_match(void * pem, void * pfc, double * parameters, short * usable)
+    int emulator_evaluate(void * pem, double * parameters, double * output, char * errmsg)
+    int emulator_cl_at_l(void * pem, double * output, int l, double * cl, char * errmsg)
+    int emulator_pk_at_k_and_z(void * pem, double * output, double k, double z, double * pk, char * errmsg)
+    int harmonic_cl_at_l_array(void * phr,int l_max,double * cl_tot)
+    int lensing_cl_at_l_array(void * ple,int l_max,double * cl_lensed)
+
+    int output_derivatives_init(void * pfc, int par_size, FileArg * name, double * step, int runs, void * pod) nogil
+    int output_derivatives_free(void * pod)
+
+    int fourier_lazy_compute(void * pfo)
+
     int harmonic_pk_at_z(
         void * pba,
         void * phr,
@@ -436,6 +606,27 @@ cdef extern from "class.h":
         int sigma_output,
         double * result)
 
+    int fourier_pk_bicubic_at_points(
+        void * pba,
+        void * pfo,
+        int pk_output,
+        int index_pk,
+        double * kvec,
+        double * zvec,
+        int points_size,
+        double * out_pk)
+
+    int fourier_sigmas_at_rvec_and_z(
+        void * ppr,
+        void * pba,
+        void * pfo,
+        double * rvec,
+        int rvec_size,
+        double z,
+        int index_pk,
+        int sigma_output,
+        double * result)
+
     int fourier_pks_at_kvec_and_zvec(
         void * pba,
         void * pfo,
@@ -14,6 +14,7 @@ extract cosmological parameters.
 from math import exp,log
 import numpy as np
 cimport numpy as np
+np.import_array()
 from libc.stdlib cimport *
 from libc.stdio cimport *
 from libc.string cimport *
@@ -22,6 +23,8 @@ cimport cython
 
 # Nils : Added for python 3.x and python 2.x compatibility
 import sys
+import os
+import threading
 def viewdictitems(d):
     if sys.version_info >= (3,0):
         return d.items()
@@ -31,15 +34,78 @@ def viewdictitems(d):
 ctypedef np.float_t DTYPE_t
 ctypedef np.int_t DTYPE_i
 
+cdef np.ndarray _table_view(object owner, double * table, int nd, np.npy_intp * dims):
+    """
+    Read-only array of shape dims on the C table, without copy. The
+    array holds a reference to owner (the Class instance owning the
+    table), but the table itself only lives until the next compute() or
+    struct_cleanup() of that instance: copy the array to keep it longer.
+    """
+    cdef np.ndarray view = np.PyArray_SimpleNewFromData(nd, dims, np.NPY_DOUBLE, <void*>table)
+    np.set_array_base(view, owner)
+    view.flags.writeable = False
+    return view
+
 
 
 # Import the .pxd containing definitions
 from cclassy cimport *
 
 DEF _MAXTITLESTRINGLENGTH_ = 8000
+DEF _PROFILE_STAGES_ = 11
+DEF _OUTPUT_PACKED_CL_TYPES_ = 6
 
 __version__ = _VERSION_.decode("utf-8")
 
+# Thread pool shared by the compute_async() of all instances, created on
+# first use, and number of computations submitted to each pool and not
+# done yet
+_executor = None
+_executor_workers = None
+_executor_pending = {}
+_executor_lock = threading.Lock()
+
+def set_async_workers(workers):
+    """
+    set_async_workers(workers)
+
+    Set the number of worker threads of the pool used by
+    Class.compute_async() (by default, the number of cores). With
+    several workers, choose the 'num_threads' parameter of each instance
+    so that workers*num_threads does not exceed the number of cores.
+    The previous pool is only shut down when the computations already
+    submitted to it are done, so that their futures, which other
+    instances may still hold, complete as usual.
+    """
+    global _executor, _executor_workers
+    with _executor_lock:
+        if _executor is not None:
+            if _executor not in _executor_pending:
+                _executor.shutdown(wait=False)
+            _executor = None
+        _executor_workers = workers
+
+def _async_submit(fn, *args):
+    global _executor
+    from concurrent.futures import ThreadPoolExecutor
+    with _executor_lock:
+        if _executor is None:
+            _executor = ThreadPoolExecutor(max_workers=_executor_workers or os.cpu_count() or 1)
+        executor = _executor
+        future = executor.submit(fn, *args)
+        _executor_pending[executor] = _executor_pending.get(executor, 0) + 1
+    future.add_done_callback(lambda f: _async_done(executor))
+    return future
+
+def _async_done(executor):
+    # shut down a pool replaced by set_async_workers() after its last computation
+    with _executor_lock:
+        _executor_pending[executor] -= 1
+        if _executor_pending[executor] == 0:
+            del _executor_pending[executor]
+            if executor is not _executor:
+                executor.shutdown(wait=False)
+
 # Implement a specific Exception (this might not be optimally designed, nor
 # even acceptable for python standards. It, however, does the job).
 # The idea is to raise either an AttributeError if the problem happened while
@@ -98,11 +164,17 @@ cdef class Class:
     cdef lensing le
     cdef distortions sd
     cdef file_content fc
+    cdef profile prof
+    cdef emulator em
+    cdef double * em_output
 
     cpdef int computed # Flag to see if classy has already computed with the given pars
     cpdef int allocated # Flag to see if classy structs are allocated already
+    cpdef int has_emulator # Flag to see if an emulator was loaded with use_emulator()
+    cpdef int emulated # Flag to see if the last compute() was served by the emulator
     cpdef object _pars # Dictionary of the parameters
     cpdef object ncp   # Keeps track of the structures initialized, in view of cleaning.
+    cdef object _future # Future of the last compute_async()
 
     # Defining two new properties to recover, respectively, the parameters used
     # or the age (set after computation). Follow this syntax if you want to
@@ -130,8 +202,14 @@ cdef class Class:
         cpdef char* dumc
         self.allocated = False
         self.computed = False
+        self.has_emulator = False
+        self.emulated = False
+        self.em_output = NULL
+        profile_init(&self.prof)
+        self._future = None
         self._pars = {}
         self.fc.size=0
+        self.fc.hash_size=0
         self.fc.filename = <char*>malloc(sizeof(char)*30)
         assert(self.fc.filename!=NULL)
         dumc = "NOFILE"
@@ -143,6 +221,7 @@ cdef class Class:
         if self.allocated:
           self.struct_cleanup()
         self.empty()
+        self.use_emulator(None)
         # Reset all the fc to zero if its not already done
         if self.fc.size !=0:
             self.fc.size=0
@@ -150,6 +229,9 @@ cdef class Class:
             free(self.fc.value)
             free(self.fc.read)
             free(self.fc.filename)
+        if self.fc.hash_size !=0:
+            self.fc.hash_size=0
+            free(self.fc.hash_table)
 
     # Set up the dictionary
     def set(self,*pars,**kars):
@@ -172,6 +254,7 @@ cdef class Class:
     # taken at their default (in Class)
     def _fillparfile(self):
         cdef char* dumc
+        cdef ErrorMsg errmsg
 
         if self.fc.size!=0:
             free(self.fc.name)
@@ -200,6 +283,74 @@ cdef class Class:
             self.fc.read[i] = _FALSE_
             i+=1
 
+        # index parameter names (this also frees the index of the previous names)
+        if parser_index(&self.fc,errmsg) == _FAILURE_:
+            raise CosmoSevereError(errmsg)
+
+    def use_emulator(self, filename):
+        """
+        use_emulator(filename)
+
+        Load an emulator of the lensed C_l's and of P(k,z), as written by
+        test/test_emulator.c, or unload it if filename is None. When the
+        parameters passed to set() consist of the emulated parameters,
+        inside the training box, and of the parameters held fixed during
+        the training, with the same values, compute() then evaluates the
+        emulator instead of running the modules. Otherwise it falls back
+        to the full calculation.
+
+        After an emulated compute(), only lensed_cl(), pk(), pk_lin() (if
+        the emulated spectrum is the linear one) and emulator_errors()
+        are available.
+
+        Parameters
+        ----------
+        filename : str or None
+                Emulator file
+        """
+        cdef ErrorMsg errmsg
+        if self.has_emulator:
+            emulator_free(&self.em)
+            free(self.em_output)
+            self.em_output = NULL
+            self.has_emulator = False
+        self.emulated = False
+        self.computed = False
+        if filename is None:
+            return
+        if emulator_read(filename.encode(), &self.em, errmsg) == _FAILURE_:
+            raise CosmoSevereError(errmsg)
+        self.em_output = <double*> malloc(sizeof(double)*self.em.out_size)
+        assert(self.em_output!=NULL)
+        self.has_emulator = True
+
+    def emulator_errors(self):
+        """
+        Return the largest residuals of the loaded emulator over its
+        validation runs, as a dictionary with keys 'cl' (on ln(C_l),
+        and on the te correlation coefficient) and 'pk' (on ln(P(k,z)))
+        """
+        if not self.has_emulator:
+            raise CosmoSevereError("No emulator loaded: call use_emulator() first")
+        return {'cl': self.em.error_cl_max, 'pk': self.em.error_pk_max}
+
+    def _compute_emulated(self):
+        """
+        Evaluate the emulator if it can replace the full calculation with
+        the current parameters, and return whether it did
+        """
+        cdef short usable
+        cdef ErrorMsg errmsg
+        cdef np.ndarray[DTYPE_t, ndim=1] parameters = np.zeros(self.em.par_size, dtype=np.double)
+
+        self._fillparfile()
+        emulator_match(&self.em, &self.fc, &parameters[0], &usable)
+        if usable == _FALSE_:
+            return False
+        if emulator_evaluate(&self.em, &parameters[0], self.em_output, errmsg) == _FAILURE_:
+            raise CosmoSevereError(errmsg)
+        return True
+
     # Called at the end of a run, to free memory
     def struct_cleanup(self):
         if(self.allocated != True):
@@ -319,6 +470,8 @@ cdef class Class:
 
         """
         cdef ErrorMsg errmsg
+        cdef int status
+        cdef int threads
 
         # Append to the list level all the modules necessary to compute.
         level = self._check_task_dependency(level)
@@ -337,6 +490,18 @@ cdef class Class:
         # Otherwise, proceed with the normal computation.
         self.computed = False
 
+        # Time and memory of each module of this run, see get_timings()
+        profile_init(&self.prof)
+
+        # If an emulator was loaded and covers the current parameters,
+        # evaluate it instead of running the modules
+        self.emulated = False
+        if self.has_emulator and self._compute_emulated():
+            self.emulated = True
+            self.ncp = set()
+            self.computed = True
+            return
+
         # Equivalent of writing a parameter file
         self._fillparfile()
 
@@ -355,9 +520,14 @@ cdef class Class:
         # non-understood parameters asked to the wrapper is a problematic
         # situation.
         if "input" in level:
-            if input_read_from_file(&self.fc, &self.pr, &self.ba, &self.th,
-                                    &self.pt, &self.tr, &self.pm, &self.hr,
-                                    &self.fo, &self.le, &self.sd, &self.op, errmsg) == _FAILURE_:
+            # (this may run the background and thermodynamics modules for shooting)
+            with nogil:
+                profile_start(&self.prof, profile_input)
+                status = input_read_from_file(&self.fc, &self.pr, &self.ba, &self.th,
+                                              &self.pt, &self.tr, &self.pm, &self.hr,
+                                              &self.fo, &self.le, &self.sd, &self.op, errmsg)
+                profile_stop(&self.prof, profile_input)
+            if status == _FAILURE_:
                 raise CosmoSevereError(errmsg)
             self.ncp.add("input")
             # This part is done to list all the unread parameters, for debugging
@@ -375,74 +545,285 @@ cdef class Class:
         # The following list of computation is straightforward. If the "_init"
         # methods fail, call `struct_cleanup` and raise a CosmoComputationError
         # with the error message from the faulty module of CLASS.
-        if "background" in level:
-            if background_init(&(self.pr), &(self.ba)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.ba.error_message)
-            self.ncp.add("background")
+        # The modules run without the GIL, so that several instances can
+        # compute concurrently from different python threads, each with the
+        # number of threads given by its 'num_threads' parameter (the setting
+        # belongs to the calling thread, and is restored on exit).
+        threads = class_threads_set(self.pr.num_threads)
+        try:
+            if "background" in level:
+                with nogil:
+                    profile_start(&self.prof, profile_background)
+                    status = background_init(&(self.pr), &(self.ba))
+                    profile_stop(&self.prof, profile_background)
+                if status == _FAILURE_:
+                    self.struct_cleanup()
+                    raise CosmoComputationError(self.ba.error_message)
+                self.ncp.add("background")
+
+            if "thermodynamics" in level:
+                with nogil:
+                    profile_start(&self.prof, profile_thermodynamics)
+                    status = thermodynamics_init(&(self.pr), &(self.ba),
+                                                 &(self.th))
+                    profile_stop(&self.prof, profile_thermodynamics)
+                if status == _FAILURE_:
+                    self.struct_cleanup()
+                    raise CosmoComputationError(self.th.error_message)
+                self.ncp.add("thermodynamics")
+
+            if "perturb" in level:
+                with nogil:
+                    profile_start(&self.prof, profile_perturbations)
+                    status = perturbations_init(&(self.pr), &(self.ba),
+                                                &(self.th), &(self.pt))
+                    profile_stop(&self.prof, profile_perturbations)
+                if status == _FAILURE_:
+                    self.struct_cleanup()
+                    raise CosmoComputationError(self.pt.error_message)
+                self.ncp.add("perturb")
+
+            if "primordial" in level:
+                with nogil:
+                    profile_start(&self.prof, profile_primordial)
+                    status = primordial_init(&(self.pr), &(self.pt),
+                                             &(self.pm))
+                    profile_stop(&self.prof, profile_primordial)
+                if status == _FAILURE_:
+                    self.struct_cleanup()
+                    raise CosmoComputationError(self.pm.error_message)
+                self.ncp.add("primordial")
+
+            if "fourier" in level:
+                with nogil:
+                    profile_start(&self.prof, profile_fourier)
+                    status = fourier_init(&self.pr, &self.ba, &self.th,
+                                          &self.pt, &self.pm, &self.fo)
+                    profile_stop(&self.prof, profile_fourier)
+                if status == _FAILURE_:
+                    self.struct_cleanup()
+                    raise CosmoComputationError(self.fo.error_message)
+                self.ncp.add("fourier")
+
+            if "transfer" in level:
+                with nogil:
+                    profile_start(&self.prof, profile_transfer)
+                    status = transfer_init(&(self.pr), &(self.ba), &(self.th),
+                                           &(self.pt), &(self.fo), &(self.tr))
+                    profile_stop(&self.prof, profile_transfer)
+                if status == _FAILURE_:
+                    self.struct_cleanup()
+                    raise CosmoComputationError(self.tr.error_message)
+                self.ncp.add("transfer")
+
+            if "harmonic" in level:
+                with nogil:
+                    profile_start(&self.prof, profile_harmonic)
+                    status = harmonic_init(&(self.pr), &(self.ba), &(self.pt),
+                                           &(self.pm), &(self.fo), &(self.tr),
+                                           &(self.hr))
+                    profile_stop(&self.prof, profile_harmonic)
+                if status == _FAILURE_:
+                    self.struct_cleanup()
+                    raise CosmoComputationError(self.hr.error_message)
+                self.ncp.add("harmonic")
+
+            if "lensing" in level:
+                with nogil:
+                    profile_start(&self.prof, profile_lensing)
+                    status = lensing_init(&(self.pr), &(self.pt), &(self.hr),
+                                          &(self.fo), &(self.le))
+                    profile_stop(&self.prof, profile_lensing)
+                if status == _FAILURE_:
+                    self.struct_cleanup()
+                    raise CosmoComputationError(self.le.error_message)
+                self.ncp.add("lensing")
+
+            if "distortions" in level:
+                with nogil:
+                    profile_start(&self.prof, profile_distortions)
+                    status = distortions_init(&(self.pr), &(self.ba), &(self.th),
+                                              &(self.pt), &(self.pm), &(self.sd))
+                    profile_stop(&self.prof, profile_distortions)
+                if status == _FAILURE_:
+                    self.struct_cleanup()
+                    raise CosmoComputationError(self.sd.error_message)
+                self.ncp.add("distortions")
+        finally:
+            class_threads_set(threads)
+
+        if self.op.profile_verbose > 0:
+            profile_print(&self.prof)
 
-        if "thermodynamics" in level:
-            if thermodynamics_init(&(self.pr), &(self.ba),
-                                   &(self.th)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.th.error_message)
-            self.ncp.add("thermodynamics")
+        self.computed = True
 
-        if "perturb" in level:
-            if perturbations_init(&(self.pr), &(self.ba),
-                            &(self.th), &(self.pt)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.pt.error_message)
-            self.ncp.add("perturb")
+        # At this point, the cosmological instance contains everything needed. The
+        # following functions are only to output the desired numbers
+        return
 
-        if "primordial" in level:
-            if primordial_init(&(self.pr), &(self.pt),
-                               &(self.pm)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.pm.error_message)
-            self.ncp.add("primordial")
+    def compute_async(self, level=["distortions"], executor=None):
+        """
+        compute_async(level=["distortions"], executor=None)
 
-        if "fourier" in level:
-            if fourier_init(&self.pr, &self.ba, &self.th,
-                              &self.pt, &self.pm, &self.fo) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.fo.error_message)
-            self.ncp.add("fourier")
+        Run compute() in a worker thread, and return at once a
+        concurrent.futures.Future. Its result() is None when the
+        computation is over, or raises the CosmoError of compute().
+        Since the modules of CLASS run without the GIL, several
+        instances can compute at the same time in one python process.
+        Each of them uses the number of OpenMP threads given by its
+        'num_threads' parameter (the OpenMP default if absent).
 
-        if "transfer" in level:
-            if transfer_init(&(self.pr), &(self.ba), &(self.th),
-                             &(self.pt), &(self.fo), &(self.tr)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.tr.error_message)
-            self.ncp.add("transfer")
+        The instance must not be used (set(), compute(), outputs...)
+        before the future is done.
 
-        if "harmonic" in level:
-            if harmonic_init(&(self.pr), &(self.ba), &(self.pt),
-                            &(self.pm), &(self.fo), &(self.tr),
-                            &(self.hr)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.hr.error_message)
-            self.ncp.add("harmonic")
+        Parameters
+        ----------
+        level : list
+                see compute()
+        executor : concurrent.futures.Executor, optional
+                executor running the computation. By default, a thread
+                pool shared by all instances, with as many workers as set
+                by set_async_workers() (number of cores otherwise)
+        """
+        if self._future is not None and not self._future.done():
+            raise CosmoSevereError("compute_async() called while the previous computation of this instance is running")
+        if executor is None:
+            self._future = _async_submit(self.compute, list(level))
+        else:
+            self._future = executor.submit(self.compute, list(level))
+        return self._future
 
-        if "lensing" in level:
-            if lensing_init(&(self.pr), &(self.pt), &(self.hr),
-                            &(self.fo), &(self.le)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.le.error_message)
-            self.ncp.add("lensing")
+    def derivatives(self, steps, runs=0):
+        """
+        derivatives(steps, runs=0)
 
-        if "distortions" in level:
-            if distortions_init(&(self.pr), &(self.ba), &(self.th),
-                                &(self.pt), &(self.pm), &(self.sd)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.sd.error_message)
-            self.ncp.add("distortions")
+        Return the derivatives of the C_l's and P(k,z) with respect to
+        some parameters, by central finite differences
+        [f(x+h)-f(x-h)]/(2h). The 2*len(steps)+1 runs are done by CLASS
+        in one call without the GIL (see output_derivatives_init() in
+        output.c): they share the parsed parameters and everything that
+        CLASS caches across runs, and are computed concurrently. The
+        fiducial values are those set in this instance, which needs not
+        be computed and is left unchanged. The C_l's are the lensed ones
+        if lensing was requested, the total unlensed ones otherwise, and
+        P(k,z) is the total matter power spectrum (non-linear if
+        'non_linear' is set) at the redshifts of 'z_pk'.
 
-        self.computed = True
+        Parameters
+        ----------
+        steps : dict
+                step h of each parameter, e.g. {'omega_b': 2e-4, 'n_s': 0.005}
+        runs : int, optional
+                number of runs computed at the same time (by default, as
+                many as the OpenMP threads)
 
-        # At this point, the cosmological instance contains everything needed. The
-        # following functions are only to output the desired numbers
-        return
+        Returns
+        -------
+        derivatives : dict
+                'parameters' (list of names, in the order of steps),
+                'fiducial' and 'step' (arrays of their values), 'cl' (the
+                fiducial C_l's, as returned by lensed_cl()), 'dcl'
+                (dictionary of the derivatives of 'cl' for each
+                parameter), 'k' (in 1/Mpc, at the wavenumbers of the
+                fiducial run within the range of all runs), 'z', 'pk'
+                (fiducial P(k,z) in Mpc^3, array of shape (z_size,k_size))
+                and 'dpk' (dictionary of its derivatives for each
+                parameter). The keys about P(k,z) are absent if it was
+                not requested.
+        """
+        cdef output_derivatives od
+        cdef FileArg * names
+        cdef double * step_array
+        cdef int par_size = len(steps)
+        cdef int c_runs = runs
+        cdef int status
+        cdef int index_par, index_type
+        cdef char* dumc
+        cdef np.npy_intp dims[2]
+
+        self._fillparfile()
+
+        names = <FileArg*> malloc(sizeof(FileArg)*max(par_size,1))
+        step_array = <double*> malloc(sizeof(double)*max(par_size,1))
+        if names == NULL or step_array == NULL:
+            free(names)
+            free(step_array)
+            raise CosmoSevereError("could not allocate the parameters of derivatives()")
+        parameters = list(steps)
+        for index_par, name in enumerate(parameters):
+            dumcp = name.encode()
+            dumc = dumcp
+            sprintf(names[index_par],"%s",dumc)
+            step_array[index_par] = steps[name]
+
+        with nogil:
+            status = output_derivatives_init(&self.fc, par_size, names, step_array, c_runs, &od)
+        free(names)
+        free(step_array)
+        if status == _FAILURE_:
+            output_derivatives_free(&od)
+            raise CosmoComputationError(od.error_message)
+
+        # copy the results, which are freed before returning
+        result = {'parameters': parameters}
+        dims[0] = par_size
+        result['fiducial'] = _table_view(self, od.fiducial, 1, dims).copy()
+        result['step'] = _table_view(self, od.step, 1, dims).copy()
+
+        types = ['tt', 'ee', 'te', 'bb', 'pp', 'tp']
+        if od.cl != NULL:
+            dims[0] = od.l_max+1
+            result['cl'] = {'ell': np.arange(od.l_max+1)}
+            result['dcl'] = {name: {'ell': np.arange(od.l_max+1)} for name in parameters}
+            for index_type in range(_OUTPUT_PACKED_CL_TYPES_):
+                if od.has_cl[index_type]:
+                    result['cl'][types[index_type]] = _table_view(self, od.cl+index_type*(od.l_max+1), 1, dims).copy()
+                    for index_par, name in enumerate(parameters):
+                        result['dcl'][name][types[index_type]] = _table_view(
+                            self, od.dcl+(index_par*_OUTPUT_PACKED_CL_TYPES_+index_type)*(od.l_max+1), 1, dims).copy()
+
+        if od.k_size > 0:
+            dims[0] = od.z_size
+            dims[1] = od.k_size
+            result['k'] = _table_view(self, od.k, 1, &dims[1]).copy()
+            result['z'] = _table_view(self, od.z, 1, dims).copy()
+            result['pk'] = _table_view(self, od.pk, 2, dims).copy()
+            result['dpk'] = {}
+            for index_par, name in enumerate(parameters):
+                result['dpk'][name] = _table_view(self, od.dpk+index_par*od.z_size*od.k_size, 2, dims).copy()
+
+        output_derivatives_free(&od)
+        return result
+
+    def get_timings(self):
+        """
+        get_timings()
+
+        Return the profile of the modules run by the last compute(), as a
+        dictionary whose keys are the module names (input, background,
+        ..., distortions) and values dictionaries with keys 'wall' and
+        'cpu' (wall-clock and CPU time of the process, in s), 'threads'
+        (number of OpenMP threads), 'bytes' (bytes allocated by the
+        module, without subtracting those it freed) and 'peak_rss' (peak
+        resident memory of the process at the end of the module, in
+        bytes). Modules that did not run (kept from a previous
+        computation, or emulated) are absent. Setting 'profile_verbose'
+        prints the same numbers at the end of compute().
+
+        With concurrent computations in the same process (compute_async()),
+        the CPU time and memory include those of the other instances.
+        """
+        cdef int index_stage
+        timings = {}
+        for index_stage in range(_PROFILE_STAGES_):
+            if self.prof.has_stage[index_stage]:
+                timings[profile_stage_name[index_stage].decode()] = {
+                    'wall': self.prof.wall[index_stage],
+                    'cpu': self.prof.cpu[index_stage],
+                    'threads': self.prof.threads[index_stage],
+                    'bytes': self.prof.bytes[index_stage],
+                    'peak_rss': self.prof.peak_rss[index_stage]}
+        return timings
 
     def raw_cl(self, lmax=-1, nofail=False):
         """
@@ -471,17 +852,7 @@ cdef class Class:
                 ell array.
         """
         cdef int lmaxR
-        cdef double *rcl = <double*> calloc(self.hr.ct_size,sizeof(double))
-
-        # Quantities for tensor modes
-        cdef double **cl_md = <double**> calloc(self.hr.md_size, sizeof(double*))
-        for index_md in range(self.hr.md_size):
-            cl_md[index_md] = <double*> calloc(self.hr.ct_size, sizeof(double))
-
-        # Quantities for isocurvature modes
-        cdef double **cl_md_ic = <double**> calloc(self.hr.md_size, sizeof(double*))
-        for index_md in range(self.hr.md_size):
-            cl_md_ic[index_md] = <double*> calloc(self.hr.ct_size*self.hr.ic_ic_size[index_md], sizeof(double))
+        cdef np.ndarray[DTYPE_t, ndim=2] cl_array
 
         # Define a list of integers, refering to the flags and indices of each
         # possible output Cl. It allows for a clear and concise way of looping
@@ -511,27 +882,18 @@ cdef class Class:
             else:
                 raise CosmoSevereError("Can only compute up to lmax=%d"%lmaxR)
 
-        # Initialise all the needed Cls arrays
+        # Recover all the C_l's from CLASS in one call, in one contiguous
+        # row per type; the returned arrays are views on these rows
+        cl_array = np.zeros((self.hr.ct_size, lmax+1), dtype=np.double)
+        if harmonic_cl_at_l_array(&self.hr, lmax, &cl_array[0,0]) == _FAILURE_:
+            raise CosmoSevereError(self.hr.error_message)
+
         cl = {}
-        for elem in spectra:
-            cl[elem] = np.zeros(lmax+1, dtype=np.double)
-
-        # Recover for each ell the information from CLASS
-        for ell from 2<=ell<lmax+1:
-            if harmonic_cl_at_l(&self.hr, ell, rcl, cl_md, cl_md_ic) == _FAILURE_:
-                raise CosmoSevereError(self.hr.error_message)
-            for flag, index, name in has_flags:
-                if name in spectra:
-                    cl[name][ell] = rcl[index]
+        for flag, index, name in has_flags:
+            if name in spectra:
+                cl[name] = cl_array[index]
         cl['ell'] = np.arange(lmax+1)
 
-        free(rcl)
-        for index_md in range(self.hr.md_size):
-            free(cl_md[index_md])
-            free(cl_md_ic[index_md])
-        free(cl_md)
-        free(cl_md_ic)
-
         return cl
 
     def lensed_cl(self, lmax=-1,nofail=False):
@@ -557,7 +919,10 @@ cdef class Class:
                 important from the python point of view.
         """
         cdef int lmaxR
-        cdef double *lcl = <double*> calloc(self.le.lt_size,sizeof(double))
+        cdef np.ndarray[DTYPE_t, ndim=2] cl_array
+
+        if self.emulated:
+            return self._emulated_lensed_cl(lmax)
 
         # Define a list of integers, refering to the flags and indices of each
         # possible output Cl. It allows for a clear and concise way of looping
@@ -588,19 +953,48 @@ cdef class Class:
             else:
                 raise CosmoSevereError("Can only compute up to lmax=%d"%lmaxR)
 
+        # Recover all the lensed C_l's from CLASS in one call, in one
+        # contiguous row per type; the returned arrays are views on these rows
+        cl_array = np.zeros((self.le.lt_size, lmax+1), dtype=np.double)
+        if lensing_cl_at_l_array(&self.le, lmax, &cl_array[0,0]) == _FAILURE_:
+            raise CosmoSevereError(self.le.error_message)
+
+        cl = {}
+        for flag, index, name in has_flags:
+            if name in spectra:
+                cl[name] = cl_array[index]
+        cl['ell'] = np.arange(lmax+1)
+
+        return cl
+
+    def _emulated_lensed_cl(self, lmax):
+        """
+        Lensed C_l's from the emulator, in the same format as lensed_cl()
+        """
+        cdef int l
+        cdef ErrorMsg errmsg
+        cdef double cl_l[5]
+
+        names = [(emulator_tt, 'tt'), (emulator_ee, 'ee'), (emulator_te, 'te'),
+                 (emulator_bb, 'bb'), (emulator_pp, 'pp')]
+        spectra = [(index, name) for index, name in names if self.em.has_cl[index]]
+        if not spectra:
+            raise CosmoSevereError("No lensed Cl emulated")
+        if lmax == -1:
+            lmax = self.em.l_max
+        if lmax > self.em.l_max:
+            raise CosmoSevereError("Can only emulate up to lmax=%d"%self.em.l_max)
+
         cl = {}
-        # Simple Cls, for temperature and polarisation, are not so big in size
-        for elem in spectra:
-            cl[elem] = np.zeros(lmax+1, dtype=np.double)
-        for ell from 2<=ell<lmax+1:
-            if lensing_cl_at_l(&self.le,ell,lcl) == _FAILURE_:
-                raise CosmoSevereError(self.le.error_message)
-            for flag, index, name in has_flags:
-                if name in spectra:
-                    cl[name][ell] = lcl[index]
+        for index, name in spectra:
+            cl[name] = np.zeros(lmax+1, dtype=np.double)
+        for l in range(2, lmax+1):
+            if emulator_cl_at_l(&self.em, self.em_output, l, cl_l, errmsg) == _FAILURE_:
+                raise CosmoSevereError(errmsg)
+            for index, name in spectra:
+                cl[name][l] = cl_l[index]
         cl['ell'] = np.arange(lmax+1)
 
-        free(lcl)
         return cl
 
     def density_cl(self, lmax=-1, nofail=False):
@@ -625,17 +1019,7 @@ cdef class Class:
             starts at index_ct_dd.
         """
         cdef int lmaxR
-        cdef double *dcl = <double*> calloc(self.hr.ct_size,sizeof(double))
-
-        # Quantities for tensor modes
-        cdef double **cl_md = <double**> calloc(self.hr.md_size, sizeof(double*))
-        for index_md in range(self.hr.md_size):
-            cl_md[index_md] = <double*> calloc(self.hr.ct_size, sizeof(double))
-
-        # Quantities for isocurvature modes
-        cdef double **cl_md_ic = <double**> calloc(self.hr.md_size, sizeof(double*))
-        for index_md in range(self.hr.md_size):
-            cl_md_ic[index_md] = <double*> calloc(self.hr.ct_size*self.hr.ic_ic_size[index_md], sizeof(double))
+        cdef np.ndarray[DTYPE_t, ndim=2] cl_array
 
         lmaxR = self.pt.l_lss_max
         has_flags = [
@@ -668,47 +1052,36 @@ cdef class Class:
             else:
                 raise CosmoSevereError("Can only compute up to lmax=%d"%lmaxR)
 
+        # Recover all the C_l's from CLASS in one call, in one contiguous
+        # row per type; the returned arrays are views on these rows
+        cl_array = np.zeros((self.hr.ct_size, lmax+1), dtype=np.double)
+        if harmonic_cl_at_l_array(&self.hr, lmax, &cl_array[0,0]) == _FAILURE_:
+            raise CosmoSevereError(self.hr.error_message)
+
         cl = {}
 
         # For density Cls, the size is bigger (different redshfit bins)
         # computes the size, given the number of correlations needed to be computed
         size = int((self.hr.d_size*(self.hr.d_size+1)-(self.hr.d_size-self.hr.non_diag)*
                 (self.hr.d_size-1-self.hr.non_diag))/2);
-        for elem in ['dd', 'll', 'dl']:
-            if elem in spectra:
-                cl[elem] = {}
-                for index in range(size):
-                    cl[elem][index] = np.zeros(
-                        lmax+1, dtype=np.double)
-        for elem in ['td', 'tl']:
-            if elem in spectra:
-                cl[elem] = np.zeros(lmax+1, dtype=np.double)
-
-        for ell from 2<=ell<lmax+1:
-            if harmonic_cl_at_l(&self.hr, ell, dcl, cl_md, cl_md_ic) == _FAILURE_:
-                raise CosmoSevereError(self.hr.error_message)
-            if 'dd' in spectra:
-                for index in range(size):
-                    cl['dd'][index][ell] = dcl[self.hr.index_ct_dd+index]
-            if 'll' in spectra:
-                for index in range(size):
-                    cl['ll'][index][ell] = dcl[self.hr.index_ct_ll+index]
-            if 'dl' in spectra:
-                for index in range(size):
-                    cl['dl'][index][ell] = dcl[self.hr.index_ct_dl+index]
-            if 'td' in spectra:
-                cl['td'][ell] = dcl[self.hr.index_ct_td]
-            if 'tl' in spectra:
-                cl['tl'][ell] = dcl[self.hr.index_ct_tl]
+        if 'dd' in spectra:
+            cl['dd'] = {}
+            for index in range(size):
+                cl['dd'][index] = cl_array[self.hr.index_ct_dd+index]
+        if 'll' in spectra:
+            cl['ll'] = {}
+            for index in range(size):
+                cl['ll'][index] = cl_array[self.hr.index_ct_ll+index]
+        if 'dl' in spectra:
+            cl['dl'] = {}
+            for index in range(size):
+                cl['dl'][index] = cl_array[self.hr.index_ct_dl+index]
+        if 'td' in spectra:
+            cl['td'] = cl_array[self.hr.index_ct_td]
+        if 'tl' in spectra:
+            cl['tl'] = cl_array[self.hr.index_ct_tl]
         cl['ell'] = np.arange(lmax+1)
 
-        free(dcl)
-        for index_md in range(self.hr.md_size):
-            free(cl_md[index_md])
-            free(cl_md_ic[index_md])
-        free(cl_md)
-        free(cl_md_ic)
-
         return cl
 
     def z_of_r (self,z_array):
@@ -768,6 +1141,12 @@ cdef class Class:
 
         """
         cdef double pk
+        cdef ErrorMsg errmsg
+
+        if self.emulated:
+            if emulator_pk_at_k_and_z(&self.em,self.em_output,k,z,&pk,errmsg)==_FAILURE_:
+                raise CosmoSevereError(errmsg)
+            return pk
 
         if (self.pt.has_pk_matter == _FALSE_):
             raise CosmoSevereError("No power spectrum computed. You must add mPk to the list of outputs.")
@@ -820,6 +1199,14 @@ cdef class Class:
 
         """
         cdef double pk_lin
+        cdef ErrorMsg errmsg
+
+        if self.emulated:
+            if self.em.pk_nonlinear:
+                raise CosmoSevereError("The emulator was trained on the non-linear P(k): the linear one is not available")
+            if emulator_pk_at_k_and_z(&self.em,self.em_output,k,z,&pk_lin,errmsg)==_FAILURE_:
+                raise CosmoSevereError(errmsg)
+            return pk_lin
 
         if (self.pt.has_pk_matter == _FALSE_):
             raise CosmoSevereError("No power spectrum computed. You must add mPk to the list of outputs.")
@@ -1020,6 +1407,10 @@ cdef class Class:
         if nonlinear == True and self.fo.method == nl_none:
             raise CosmoSevereError("You ask classy to return an array of nonlinear P(k,z) values, but the input parameters sent to CLASS did not require any non-linear P(k,z) calculations; add e.g. 'halofit' or 'HMcode' in 'nonlinear'")
 
+        # the tables below are read directly (computed here with lazy evaluation)
+        if fourier_lazy_compute(&self.fo) == _FAILURE_:
+            raise CosmoSevereError(self.fo.error_message)
+
         # check wich type of P(k) to return (total or clustering only, i.e. without massive neutrino contribution)
         if (only_clustering_species == True):
             index_pk = self.fo.index_pk_cluster
@@ -1061,6 +1452,59 @@ cdef class Class:
 
         return pk_at_k_z, k, z
 
+    def get_pk_table(self, nonlinear = False):
+        """
+        Return the internal tables of ln(P(k,tau)) of the fourier module,
+        as read-only arrays sharing their memory with CLASS (no copy).
+
+        The arrays are only valid until the next compute() or
+        struct_cleanup(): copy them to keep them longer.
+
+        Parameters
+        ----------
+        nonlinear : bool
+                Whether to return the non-linear (if computed) or the
+                linear (default) spectra
+
+        Returns
+        -------
+        pk : dictionary with 'k' (array of size k_size, in 1/Mpc), 'ln_tau'
+                (array of size ln_tau_size, the last value being today),
+                and 'ln_pk', the dictionary of the tables of shape
+                (ln_tau_size, k_size) of ln(P) in Mpc^3, with key 'm' for
+                total matter and 'cb' for baryons+cdm (if different).
+                For the non-linear spectra, only the times from index
+                index_tau_min_nl-(tau_size-ln_tau_size) on are meaningful.
+        """
+        cdef np.npy_intp dims[2]
+        cdef double ** ln_pk
+
+        if (not "fourier" in self.ncp) or self.fo.has_pk_matter == False:
+            raise CosmoSevereError("No P(k,z) table: add 'mPk' in 'output' and call compute() first")
+
+        if nonlinear == True and self.fo.method == nl_none:
+            raise CosmoSevereError("You ask classy to return the nonlinear P(k,z) table, but the input parameters sent to CLASS did not require any non-linear P(k,z) calculations; add e.g. 'halofit' or 'HMcode' in 'nonlinear'")
+
+        # the tables below are read directly (computed here with lazy evaluation)
+        if fourier_lazy_compute(&self.fo) == _FAILURE_:
+            raise CosmoSevereError(self.fo.error_message)
+
+        if nonlinear == True:
+            ln_pk = self.fo.ln_pk_nl
+        else:
+            ln_pk = self.fo.ln_pk_l
+
+        dims[0] = self.fo.ln_tau_size
+        dims[1] = self.fo.k_size
+
+        tables = {'m': _table_view(self, ln_pk[self.fo.index_pk_m], 2, dims)}
+        if self.fo.has_pk_cb:
+            tables['cb'] = _table_view(self, ln_pk[self.fo.index_pk_cb], 2, dims)
+
+        return {'k': _table_view(self, self.fo.k, 1, &dims[1]),
+                'ln_tau': _table_view(self, self.fo.ln_tau, 1, dims),
+                'ln_pk': tables}
+
     # Gives sigma(R,z) for a given (R,z)
     def sigma(self,double R,double z):
         """
@@ -1116,6 +1560,53 @@ cdef class Class:
 
         return sigma_cb
 
+    # Gives sigma(R,z) for an array of R at a given z
+    def sigma_array(self, np.ndarray[DTYPE_t,ndim=1] R, double z):
+        """
+        Gives sigma (total matter) for an array of R (in units of Mpc) at a given z
+
+        P(k,z) is interpolated only once. If the precision parameter
+        sigma_fftlog is set, all values come from a single FFTLog
+        transform instead of one integral over k per radius.
+        """
+        cdef np.ndarray[DTYPE_t, ndim=1] R_c = np.ascontiguousarray(R, dtype='float64')
+        cdef np.ndarray[DTYPE_t, ndim=1] sigma = np.zeros(R_c.shape[0],'float64')
+
+        if (self.pt.has_pk_matter == _FALSE_):
+            raise CosmoSevereError("No power spectrum computed. In order to get sigma(R,z) you must add mPk to the list of outputs.")
+
+        if (self.pt.k_max_for_pk < self.ba.h):
+            raise CosmoSevereError("In order to get sigma(R,z) you must set 'P_k_max_h/Mpc' to 1 or bigger, in order to have k_max > 1 h/Mpc.")
+
+        if fourier_sigmas_at_rvec_and_z(&self.pr,&self.ba,&self.fo,<double*> R_c.data,R_c.shape[0],z,self.fo.index_pk_m,out_sigma,<double*> sigma.data)==_FAILURE_:
+            raise CosmoSevereError(self.fo.error_message)
+
+        return sigma
+
+    # Gives sigma_cb(R,z) for an array of R at a given z
+    def sigma_cb_array(self, np.ndarray[DTYPE_t,ndim=1] R, double z):
+        """
+        Gives sigma (cdm+b) for an array of R (in units of Mpc) at a given z
+
+        Same conventions as sigma_array().
+        """
+        cdef np.ndarray[DTYPE_t, ndim=1] R_c = np.ascontiguousarray(R, dtype='float64')
+        cdef np.ndarray[DTYPE_t, ndim=1] sigma_cb = np.zeros(R_c.shape[0],'float64')
+
+        if (self.pt.has_pk_matter == _FALSE_):
+            raise CosmoSevereError("No power spectrum computed. In order to get sigma(R,z) you must add mPk to the list of outputs.")
+
+        if (self.fo.has_pk_cb == _FALSE_):
+            raise CosmoSevereError("sigma_cb not computed by CLASS (probably because there are no massive neutrinos)")
+
+        if (self.pt.k_max_for_pk < self.ba.h):
+            raise CosmoSevereError("In order to get sigma(R,z) you must set 'P_k_max_h/Mpc' to 1 or bigger, in order to have k_max > 1 h/Mpc.")
+
+        if fourier_sigmas_at_rvec_and_z(&self.pr,&self.ba,&self.fo,<double*> R_c.data,R_c.shape[0],z,self.fo.index_pk_cb,out_sigma,<double*> sigma_cb.data)==_FAILURE_:
+            raise CosmoSevereError(self.fo.error_message)
+
+        return sigma_cb
+
     # Gives effective logarithmic slope of P_L(k,z) (total matter) for a given (k,z)
     def pk_tilt(self,double k,double z):
         """
@@ -1204,6 +1695,8 @@ cdef class Class:
 
     def sigma8(self):
         self.compute(["fourier"])
+        if fourier_lazy_compute(&self.fo) == _FAILURE_:
+            raise CosmoSevereError(self.fo.error_message)
         return self.fo.sigma8[self.fo.index_pk_m]
 
     #def neff(self):
@@ -1212,6 +1705,8 @@ cdef class Class:
 
     def sigma8_cb(self):
         self.compute(["fourier"])
+        if fourier_lazy_compute(&self.fo) == _FAILURE_:
+            raise CosmoSevereError(self.fo.error_message)
         return self.fo.sigma8[self.fo.index_pk_cb]
 
     def rs_drag(self):
@@ -1534,22 +2029,72 @@ cdef class Class:
         number_of_titles = len(names)
         timesteps = self.ba.bt_size
 
-        data = <double*>malloc(sizeof(double)*timesteps*number_of_titles)
+        # the output routine fills the table in place, each column is then a view on it
+        table = np.empty((timesteps, number_of_titles), dtype=np.double)
+        data = <double*>np.PyArray_DATA(table)
 
         if background_output_data(&self.ba, number_of_titles, data)==_FAILURE_:
+            free(titles)
             raise CosmoSevereError(self.ba.error_message)
 
         background = {}
 
         for i in range(number_of_titles):
-            background[names[i]] = np.zeros(timesteps, dtype=np.double)
-            for index in range(timesteps):
-                background[names[i]][index] = data[index*number_of_titles+i]
+            background[names[i]] = table[:,i]
 
         free(titles)
-        free(data)
         return background
 
+    def get_background_table(self):
+        """
+        Return the internal background table of the last compute(), as
+        read-only arrays sharing their memory with CLASS (no copy).
+
+        Unlike get_background(), the quantities are in the units and
+        conventions of the background module, on its own time sampling.
+        The arrays are only valid until the next compute() or
+        struct_cleanup(): copy them to keep them longer.
+
+        Returns
+        -------
+        background : dictionary with the time sampling 'tau', 'z' and
+                'loga' (arrays of size bt_size), the table 'table' of shape
+                (bt_size, bg_size), and 'columns', the dictionary of the
+                indices in 'table' of the main quantities.
+        """
+        cdef np.npy_intp dims[2]
+
+        if not "background" in self.ncp:
+            raise CosmoSevereError("No background table: call compute() first")
+
+        dims[0] = self.ba.bt_size
+        dims[1] = self.ba.bg_size
+
+        columns = {
+            'a': self.ba.index_bg_a,
+            'H': self.ba.index_bg_H,
+            'H_prime': self.ba.index_bg_H_prime,
+            'rho_g': self.ba.index_bg_rho_g,
+            'rho_b': self.ba.index_bg_rho_b,
+            'rho_tot': self.ba.index_bg_rho_tot,
+            'p_tot': self.ba.index_bg_p_tot,
+            'rho_crit': self.ba.index_bg_rho_crit,
+            'Omega_r': self.ba.index_bg_Omega_r,
+            'Omega_m': self.ba.index_bg_Omega_m,
+            'conf_distance': self.ba.index_bg_conf_distance,
+            'ang_distance': self.ba.index_bg_ang_distance,
+            'lum_distance': self.ba.index_bg_lum_distance,
+            'time': self.ba.index_bg_time,
+            'rs': self.ba.index_bg_rs,
+            'D': self.ba.index_bg_D,
+            'f': self.ba.index_bg_f}
+
+        return {'tau': _table_view(self, self.ba.tau_table, 1, dims),
+                'z': _table_view(self, self.ba.z_table, 1, dims),
+                'loga': _table_view(self, self.ba.loga_table, 1, dims),
+                'table': _table_view(self, self.ba.background_table, 2, dims),
+                'columns': columns}
+
     def get_thermodynamics(self):
         """
         Return the thermodynamics quantities.
@@ -1572,22 +2117,62 @@ cdef class Class:
         number_of_titles = len(names)
         timesteps = self.th.tt_size
 
-        data = <double*>malloc(sizeof(double)*timesteps*number_of_titles)
+        # the output routine fills the table in place, each column is then a view on it
+        table = np.empty((timesteps, number_of_titles), dtype=np.double)
+        data = <double*>np.PyArray_DATA(table)
 
         if thermodynamics_output_data(&self.ba, &self.th, number_of_titles, data)==_FAILURE_:
+            free(titles)
             raise CosmoSevereError(self.th.error_message)
 
         thermodynamics = {}
 
         for i in range(number_of_titles):
-            thermodynamics[names[i]] = np.zeros(timesteps, dtype=np.double)
-            for index in range(timesteps):
-                thermodynamics[names[i]][index] = data[index*number_of_titles+i]
+            thermodynamics[names[i]] = table[:,i]
 
         free(titles)
-        free(data)
         return thermodynamics
 
+    def get_thermodynamics_table(self):
+        """
+        Return the internal thermodynamics table of the last compute(), as
+        read-only arrays sharing their memory with CLASS (no copy).
+
+        The table is sampled in decreasing time, from z=0 to the largest
+        redshift. The arrays are only valid until the next compute() or
+        struct_cleanup(): copy them to keep them longer.
+
+        Returns
+        -------
+        thermodynamics : dictionary with the sampling 'z' and 'tau' (arrays
+                of size tt_size), the table 'table' of shape (tt_size,
+                th_size), and 'columns', the dictionary of the indices in
+                'table' of the main quantities.
+        """
+        cdef np.npy_intp dims[2]
+
+        if not "thermodynamics" in self.ncp:
+            raise CosmoSevereError("No thermodynamics table: call compute() first")
+
+        dims[0] = self.th.tt_size
+        dims[1] = self.th.th_size
+
+        columns = {
+            'x_e': self.th.index_th_xe,
+            "kappa'": self.th.index_th_dkappa,
+            'exp(-kappa)': self.th.index_th_exp_m_kappa,
+            'g': self.th.index_th_g,
+            'Tb': self.th.index_th_Tb,
+            'w_b': self.th.index_th_wb,
+            'c_b^2': self.th.index_th_cb2,
+            'tau_d': self.th.index_th_tau_d,
+            'rate': self.th.index_th_rate}
+
+        return {'z': _table_view(self, self.th.z_table, 1, dims),
+                'tau': _table_view(self, self.th.tau_table, 1, dims),
+                'table': _table_view(self, self.th.thermodynamics_table, 2, dims),
+                'columns': columns}
+
     def get_primordial(self):
         """
         Return the primordial scalar and/or tensor spectrum depending on 'modes'.
@@ -1611,20 +2196,20 @@ cdef class Class:
         number_of_titles = len(names)
         timesteps = self.pm.lnk_size
 
-        data = <double*>malloc(sizeof(double)*timesteps*number_of_titles)
+        # the output routine fills the table in place, each column is then a view on it
+        table = np.empty((timesteps, number_of_titles), dtype=np.double)
+        data = <double*>np.PyArray_DATA(table)
 
         if primordial_output_data(&self.pt, &self.pm, number_of_titles, data)==_FAILURE_:
+            free(titles)
             raise CosmoSevereError(self.pm.error_message)
 
         primordial = {}
 
         for i in range(number_of_titles):
-            primordial[names[i]] = np.zeros(timesteps, dtype=np.double)
-            for index in range(timesteps):
-                primordial[names[i]][index] = data[index*number_of_titles+i]
+            primordial[names[i]] = table[:,i]
 
         free(titles)
-        free(data)
         return primordial
 
 
@@ -1649,6 +2234,9 @@ cdef class Class:
                 perturbations['scalar'] is an array of length 'k_output_values' of
                 dictionary containing scalar perturbations.
                 Similar for perturbations['vector'] and perturbations['tensor'].
+                The arrays are read-only views on the tables of the
+                perturbation module, valid until the next compute() or
+                struct_cleanup().
         """
 
         perturbations = {}
@@ -1664,7 +2252,7 @@ cdef class Class:
             list names
             list tmparray
             dict tmpdict
-            double[:,::1] data_mv
+            np.npy_intp dims[2]
             double ** thedata
             int * thesizes
 
@@ -1693,14 +2281,92 @@ cdef class Class:
                 for j in range(self.pt.k_output_values_num):
                     timesteps = thesizes[j]//number_of_titles
                     tmpdict={}
-                    data_mv = <double[:timesteps,:number_of_titles]> thedata[j]
+                    dims[0] = timesteps
+                    dims[1] = number_of_titles
+                    table = _table_view(self, thedata[j], 2, dims)
                     for i in range(number_of_titles):
-                        tmpdict[names[i]] = np.asarray(data_mv[:,i])
+                        tmpdict[names[i]] = table[:,i]
                     tmparray.append(tmpdict)
             perturbations[mode] = tmparray
 
         return perturbations
 
+    def get_perturbations_solver_statistics(self):
+        """
+        Return the work done by the evolver of perturbations, for each
+        wavenumber and each time interval in which the approximation scheme
+        is uniform.
+
+        .. note::
+
+            you need to set 'store_solver_statistics' to 'yes', and have some
+            perturbations computed. Step, jacobian and LU counters are only
+            filled by the ndf15 evolver, and wall times only when CLASS is
+            compiled with OpenMP. With MPI, each process only knows about the
+            wavenumbers that it evolved.
+
+        Returns
+        -------
+        statistics : dict of dicts of arrays
+                statistics['scalar'] (and similarly 'vector', 'tensor') is a
+                dictionary of arrays with one entry per interval: 'index_ic',
+                'index_k', 'k' [1/Mpc], 'tau_start', 'tau_end' [Mpc], the
+                approximation flags 'tca_on', 'rsa_on', 'tca_idm_dr_on',
+                'rsa_idr_on', 'ufa_on', 'ncdmfa_on', the number of equations
+                'pt_size', the counters 'derivs_calls', 'jacobian_evaluations',
+                'lu_decompositions', 'accepted_steps', 'rejected_steps', and
+                'wall_time' [s].
+        """
+        cdef int index_md, index_ic, index_k, index_interval, index_ick
+        cdef perturbations_solver_statistics * pss
+
+        statistics = {}
+
+        if (not 'perturb' in self.ncp) or (not self.pt.store_solver_statistics):
+            return statistics
+
+        names = ['index_ic','index_k','k','tau_start','tau_end',
+                 'tca_on','rsa_on','tca_idm_dr_on','rsa_idr_on','ufa_on','ncdmfa_on',
+                 'pt_size','derivs_calls','jacobian_evaluations','lu_decompositions',
+                 'accepted_steps','rejected_steps','wall_time']
+
+        for mode in ['scalar','vector','tensor']:
+            if mode=='scalar' and self.pt.has_scalars:
+                index_md = self.pt.index_md_scalars
+            elif mode=='vector' and self.pt.has_vectors:
+                index_md = self.pt.index_md_vectors
+            elif mode=='tensor' and self.pt.has_tensors:
+                index_md = self.pt.index_md_tensors
+            else:
+                continue
+            rows = {name:[] for name in names}
+            for index_ic in range(self.pt.ic_size[index_md]):
+                for index_k in range(self.pt.k_size[index_md]):
+                    index_ick = index_ic*self.pt.k_size[index_md]+index_k
+                    for index_interval in range(self.pt.solver_statistics_size[index_md][index_ick]):
+                        pss = &(self.pt.solver_statistics[index_md][index_ick][index_interval])
+                        rows['index_ic'].append(index_ic)
+                        rows['index_k'].append(index_k)
+                        rows['k'].append(self.pt.k[index_md][index_k])
+                        rows['tau_start'].append(pss.tau_start)
+                        rows['tau_end'].append(pss.tau_end)
+                        rows['tca_on'].append(pss.tca_on)
+                        rows['rsa_on'].append(pss.rsa_on)
+                        rows['tca_idm_dr_on'].append(pss.tca_idm_dr_on)
+                        rows['rsa_idr_on'].append(pss.rsa_idr_on)
+                        rows['ufa_on'].append(pss.ufa_on)
+                        rows['ncdmfa_on'].append(pss.ncdmfa_on)
+                        rows['pt_size'].append(pss.pt_size)
+                        rows['derivs_calls'].append(pss.derivs_calls)
+                        rows['jacobian_evaluations'].append(pss.jacobian_evaluations)
+                        rows['lu_decompositions'].append(pss.lu_decompositions)
+                        rows['accepted_steps'].append(pss.accepted_steps)
+                        rows['rejected_steps'].append(pss.rejected_steps)
+                        rows['wall_time'].append(pss.wall_time)
+            statistics[mode] = {name:np.asarray(rows[name]) for name in names}
+
+        return statistics
+
     def get_transfer(self, z=0., output_format='class'):
         """
         Return the density and/or velocity transfer functions for all initial
@@ -1744,26 +2410,27 @@ cdef class Class:
         number_of_titles = len(names)
         timesteps = self.pt.k_size[index_md]
 
-        size_ic_data = timesteps*number_of_titles;
         ic_num = self.pt.ic_size[index_md];
 
-        data = <double*>malloc(sizeof(double)*size_ic_data*ic_num)
+        # the output routine fills the table in place, each column is then a view on it
+        table = np.empty((ic_num, timesteps, number_of_titles), dtype=np.double)
+        data = <double*>np.PyArray_DATA(table)
 
         if perturbations_output_data(&self.ba, &self.pt, outf, <double> z, number_of_titles, data)==_FAILURE_:
+            free(titles)
             raise CosmoSevereError(self.pt.error_message)
 
         transfers = {}
 
         for index_ic in range(ic_num):
             if perturbations_output_firstline_and_ic_suffix(&self.pt, index_ic, ic_info, ic_suffix)==_FAILURE_:
+                free(titles)
                 raise CosmoSevereError(self.pt.error_message)
             ic_key = <bytes> ic_suffix
 
             tmpdict = {}
             for i in range(number_of_titles):
-                tmpdict[names[i]] = np.zeros(timesteps, dtype=np.double)
-                for index in range(timesteps):
-                    tmpdict[names[i]][index] = data[index_ic*size_ic_data+index*number_of_titles+i]
+                tmpdict[names[i]] = table[index_ic,:,i]
 
             if ic_num==1:
                 transfers = tmpdict
@@ -1771,7 +2438,6 @@ cdef class Class:
                 transfers[ic_key] = tmpdict
 
         free(titles)
-        free(data)
 
         return transfers
 
@@ -1947,8 +2613,12 @@ cdef class Class:
             elif name == 'phi_max':
                 value = self.pm.phi_max
             elif name == 'sigma8':
+                if fourier_lazy_compute(&self.fo) == _FAILURE_:
+                    raise CosmoSevereError(self.fo.error_message)
                 value = self.fo.sigma8[self.fo.index_pk_m]
             elif name == 'sigma8_cb':
+                if fourier_lazy_compute(&self.fo) == _FAILURE_:
+                    raise CosmoSevereError(self.fo.error_message)
                 value = self.fo.sigma8[self.fo.index_pk_cb]
             elif name == 'k_eq':
                 value = self.ba.a_eq*self.ba.H_eq
@@ -2233,32 +2903,148 @@ make        fourier_scale_cb(z, z_size)
         # Store itself into the context, to be accessed by the likelihoods
         ctx.add('cosmo', self)
 
-    def get_pk_array(self, np.ndarray[DTYPE_t,ndim=1] k, np.ndarray[DTYPE_t,ndim=1] z, int k_size, int z_size, nonlinear):
-        """ Fast function to get the power spectrum on a k and z array """
-        cdef np.ndarray[DTYPE_t, ndim=1] pk = np.zeros(k_size*z_size,'float64')
-        cdef np.ndarray[DTYPE_t, ndim=1] pk_cb = np.zeros(k_size*z_size,'float64')
+    def get_pk_array(self, np.ndarray[DTYPE_t,ndim=1] k, np.ndarray[DTYPE_t,ndim=1] z, int k_size, int z_size, nonlinear, np.ndarray[DTYPE_t,ndim=1] out=None):
+        """
+        Fast function to get the power spectrum on a k and z array
 
-        if nonlinear == 0:
-            fourier_pks_at_kvec_and_zvec(&self.ba, &self.fo, pk_linear, <double*> k.data, k_size, <double*> z.data, z_size, <double*> pk.data, <double*> pk_cb.data)
+        Returns P(k_i,z_j) at index j*k_size+i. If out is given (a
+        contiguous float64 array of size at least k_size*z_size), the
+        result is written into it and out is returned, so that no memory
+        is allocated.
+        """
+        cdef np.ndarray[DTYPE_t, ndim=1] pk = self._pk_array_output(out, k_size*z_size)
+        cdef pk_outputs pk_output = pk_linear if nonlinear == 0 else pk_nonlinear
 
-        else:
-            fourier_pks_at_kvec_and_zvec(&self.ba, &self.fo, pk_nonlinear, <double*> k.data, k_size, <double*> z.data, z_size, <double*> pk.data, <double*> pk_cb.data)
+        if fourier_pks_at_kvec_and_zvec(&self.ba, &self.fo, pk_output, <double*> k.data, k_size, <double*> z.data, z_size, <double*> pk.data, NULL) == _FAILURE_:
+            raise CosmoSevereError(self.fo.error_message)
 
         return pk
 
-    def get_pk_cb_array(self, np.ndarray[DTYPE_t,ndim=1] k, np.ndarray[DTYPE_t,ndim=1] z, int k_size, int z_size, nonlinear):
-        """ Fast function to get the power spectrum on a k and z array """
-        cdef np.ndarray[DTYPE_t, ndim=1] pk = np.zeros(k_size*z_size,'float64')
-        cdef np.ndarray[DTYPE_t, ndim=1] pk_cb = np.zeros(k_size*z_size,'float64')
+    def get_pk_cb_array(self, np.ndarray[DTYPE_t,ndim=1] k, np.ndarray[DTYPE_t,ndim=1] z, int k_size, int z_size, nonlinear, np.ndarray[DTYPE_t,ndim=1] out=None):
+        """
+        Fast function to get the power spectrum of cdm+baryons on a k and z array
 
-        if nonlinear == 0:
-            fourier_pks_at_kvec_and_zvec(&self.ba, &self.fo, pk_linear, <double*> k.data, k_size, <double*> z.data, z_size, <double*> pk.data, <double*> pk_cb.data)
+        Same conventions as get_pk_array(), including the optional output buffer out.
+        """
+        cdef np.ndarray[DTYPE_t, ndim=1] pk_cb = self._pk_array_output(out, k_size*z_size)
+        cdef pk_outputs pk_output = pk_linear if nonlinear == 0 else pk_nonlinear
 
-        else:
-            fourier_pks_at_kvec_and_zvec(&self.ba, &self.fo, pk_nonlinear, <double*> k.data, k_size, <double*> z.data, z_size, <double*> pk.data, <double*> pk_cb.data)
+        if fourier_pks_at_kvec_and_zvec(&self.ba, &self.fo, pk_output, <double*> k.data, k_size, <double*> z.data, z_size, NULL, <double*> pk_cb.data) == _FAILURE_:
+            raise CosmoSevereError(self.fo.error_message)
 
         return pk_cb
 
+    def get_pk_bicubic(self, np.ndarray[DTYPE_t,ndim=1] k, np.ndarray[DTYPE_t,ndim=1] z, nonlinear, cdmbar=False, np.ndarray[DTYPE_t,ndim=1] out=None):
+        """
+        Fast function to get the power spectrum at a list of points (k_i,z_i)
+
+        Requires 'pk_bicubic':'yes'. Returns P(k_i,z_i) (k in 1/Mpc) at
+        index i, from the bicubic interpolation precomputed in the fourier
+        module, or 0 for k_i outside the computed range. If cdmbar is
+        True, returns the power spectrum of cdm+baryons. Same convention
+        as get_pk_array() for the optional output buffer out.
+        """
+        cdef int points_size = k.shape[0]
+        cdef np.ndarray[DTYPE_t, ndim=1] pk
+        cdef pk_outputs pk_output = pk_linear if nonlinear == 0 else pk_nonlinear
+        cdef int index_pk
+
+        if z.shape[0] != points_size:
+            raise CosmoSevereError("the arrays of k and z should have the same size, not %d and %d" % (points_size, z.shape[0]))
+
+        if cdmbar:
+            if (self.fo.has_pk_cb == _FALSE_):
+                raise CosmoSevereError("P_cb not computed by CLASS (probably because there are no massive neutrinos)")
+            index_pk = self.fo.index_pk_cb
+        else:
+            index_pk = self.fo.index_pk_m
+
+        pk = self._pk_array_output(out, points_size)
+
+        if fourier_pk_bicubic_at_points(&self.ba, &self.fo, pk_output, index_pk, <double*> k.data, <double*> z.data, points_size, <double*> pk.data) == _FAILURE_:
+            raise CosmoSevereError(self.fo.error_message)
+
+        return pk
+
+    def _pk_array_output(self, out, size):
+        """ Output array of get_pk_array(), get_pk_cb_array(), get_pk_bicubic() and get_sources_at_tau(): out if given, after checking it, or a new one """
+        if out is None:
+            return np.zeros(size,'float64')
+        if (out.dtype != np.float64) or (not out.flags['C_CONTIGUOUS']) or (out.shape[0] < size):
+            raise CosmoSevereError("the output array should be a contiguous float64 array of size at least %d" % size)
+        return out
+
+    def get_sources_at_tau(self, tau, types, index_ic=0, out=None):
+        """
+        Scalar source functions S_X(k,tau) of several types at several conformal times
+
+        tau is an array of conformal times in Mpc (sorted values are
+        fastest) and types a list of names among the keys of
+        source_types(). Returns a tuple (sources, k): sources has shape
+        (len(tau), len(types), k_size), with k (in 1/Mpc) a read-only
+        view on the wavenumbers of the perturbation module. If out is
+        given (a contiguous float64 array of size at least
+        len(tau)*len(types)*k_size), the sources are written into it
+        and returned as a view of shape (len(tau), len(types), k_size),
+        so that repeated calls allocate no memory.
+        """
+        cdef int index_md = self.pt.index_md_scalars
+        cdef np.ndarray[DTYPE_t, ndim=1] tau_c = np.ascontiguousarray(np.atleast_1d(tau), dtype='float64')
+        cdef np.ndarray[np.int32_t, ndim=1] tp_c
+        cdef np.ndarray[DTYPE_t, ndim=1] sources
+        cdef np.npy_intp dims[1]
+        cdef int k_size
+
+        if self.pt.has_scalars == _FALSE_:
+            raise CosmoSevereError("No scalar source functions computed")
+        if (index_ic < 0) or (index_ic >= self.pt.ic_size[index_md]):
+            raise CosmoSevereError("index_ic=%d is not in the range [0,%d]" % (index_ic, self.pt.ic_size[index_md]-1))
+
+        available = self.source_types()
+        for name in types:
+            if name not in available:
+                raise CosmoSevereError("source type '%s' not computed, available types are %s" % (name, list(available)))
+        tp_c = np.array([available[name] for name in types], dtype=np.int32)
+
+        k_size = self.pt.k_size[index_md]
+        sources = self._pk_array_output(out, tau_c.shape[0]*tp_c.shape[0]*k_size)
+
+        if perturbations_sources_at_tau_vec(&self.pt, index_md, index_ic, <int*> tp_c.data, tp_c.shape[0], <double*> tau_c.data, tau_c.shape[0], <double*> sources.data) == _FAILURE_:
+            raise CosmoSevereError(self.pt.error_message)
+
+        dims[0] = k_size
+        return sources[:tau_c.shape[0]*tp_c.shape[0]*k_size].reshape((tau_c.shape[0], tp_c.shape[0], k_size)), _table_view(self, self.pt.k[index_md], 1, dims)
+
+    def source_types(self):
+        """
+        Names of the scalar source functions available to get_sources_at_tau(), with their index
+        """
+        types = {}
+        if self.pt.has_scalars == _FALSE_:
+            return types
+        for name, has, index in [
+                ('t0', self.pt.has_source_t, self.pt.index_tp_t0),
+                ('t1', self.pt.has_source_t, self.pt.index_tp_t1),
+                ('t2', self.pt.has_source_t, self.pt.index_tp_t2),
+                ('p', self.pt.has_source_p, self.pt.index_tp_p),
+                ('delta_m', self.pt.has_source_delta_m, self.pt.index_tp_delta_m),
+                ('delta_cb', self.pt.has_source_delta_cb, self.pt.index_tp_delta_cb),
+                ('delta_tot', self.pt.has_source_delta_tot, self.pt.index_tp_delta_tot),
+                ('theta_m', self.pt.has_source_theta_m, self.pt.index_tp_theta_m),
+                ('theta_cb', self.pt.has_source_theta_cb, self.pt.index_tp_theta_cb),
+                ('theta_tot', self.pt.has_source_theta_tot, self.pt.index_tp_theta_tot),
+                ('phi', self.pt.has_source_phi, self.pt.index_tp_phi),
+                ('phi_prime', self.pt.has_source_phi_prime, self.pt.index_tp_phi_prime),
+                ('phi_plus_psi', self.pt.has_source_phi_plus_psi, self.pt.index_tp_phi_plus_psi),
+                ('psi', self.pt.has_source_psi, self.pt.index_tp_psi),
+                ('h', self.pt.has_source_h, self.pt.index_tp_h),
+                ('h_prime', self.pt.has_source_h_prime, self.pt.index_tp_h_prime),
+                ('eta', self.pt.has_source_eta, self.pt.index_tp_eta),
+                ('eta_prime', self.pt.has_source_eta_prime, self.pt.index_tp_eta_prime)]:
+            if has == _TRUE_:
+                types[name] = index
+        return types
+
     def Omega0_k(self):
         """ Curvature contribution """
         return self.ba.Omega0_k
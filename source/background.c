@@ -240,11 +240,47 @@ int background_at_tau(
 
   /** - define local variables */
   double z;
+  int index_tau;
+  double h,a,b;
 
-  /** - Get current redshift */
-  class_call(background_z_of_tau(pba,tau,&z),
-             pba->error_message,
-             pba->error_message);
+  /** - Get current redshift. In closeby mode, the tau and loga tables
+      share the same sampling, so the interval is hunted for in
+      tau_table starting from *last_index rather than found again by
+      bisection over the whole table. */
+  if (inter_mode == inter_closeby) {
+
+    class_test(tau < pba->tau_table[0],
+               pba->error_message,
+               "out of range: tau=%e < tau_min=%e\n",tau,pba->tau_table[0]);
+
+    class_test(tau > pba->tau_table[pba->bt_size-1],
+               pba->error_message,
+               "out of range: tau=%e > tau_max=%e\n",tau,pba->tau_table[pba->bt_size-1]);
+
+    index_tau = *last_index;
+
+    class_call(array_spline_hunt(pba->tau_table,
+                                 pba->bt_size,
+                                 tau,
+                                 &index_tau,
+                                 &h,
+                                 &a,
+                                 &b,
+                                 pba->error_message),
+               pba->error_message,
+               pba->error_message);
+
+    z = array_spline_eval(pba->z_table,
+                          pba->d2z_dtau2_table,
+                          index_tau,
+                          index_tau+1,
+                          h,a,b);
+  }
+  else {
+    class_call(background_z_of_tau(pba,tau,&z),
+               pba->error_message,
+               pba->error_message);
+  }
 
   /** - Get background at corresponding redshift */
   class_call(background_at_z(pba,z,return_format,inter_mode,last_index,pvecback),
@@ -254,6 +290,180 @@ int background_at_tau(
   return _SUCCESS_;
 }
 
+/**
+ * Find the interval of the background table containing a given
+ * conformal time, hunting from a hint rather than bisecting over the
+ * whole table. Since the tau and loga tables share the same sampling,
+ * this interval is also the one of log(a) in the background table.
+ *
+ * @param pba        Input: pointer to background structure (containing pre-computed table)
+ * @param tau        Input: value of conformal time
+ * @param last_index Input/Output: hint for the interval (any value is valid, but a close one makes the search faster), then index of the interval
+ * @param h          Output: step in loga between the two tabulated values
+ * @param a          Output: weight of the lower value for spline interpolation in loga
+ * @param b          Output: weight of the upper value for spline interpolation in loga
+ * @return the error status
+ */
+
+int background_tau_interval(
+                            struct background *pba,
+                            double tau,
+                            int * last_index,
+                            double * h,
+                            double * a,
+                            double * b
+                            ) {
+
+  double h_tau,a_tau,b_tau;
+  double z,loga;
+
+  class_test(tau < pba->tau_table[0],
+             pba->error_message,
+             "out of range: tau=%e < tau_min=%e\n",tau,pba->tau_table[0]);
+
+  class_test(tau > pba->tau_table[pba->bt_size-1],
+             pba->error_message,
+             "out of range: tau=%e > tau_max=%e\n",tau,pba->tau_table[pba->bt_size-1]);
+
+  class_call(array_spline_hunt(pba->tau_table,
+                               pba->bt_size,
+                               tau,
+                               last_index,
+                               &h_tau,
+                               &a_tau,
+                               &b_tau,
+                               pba->error_message),
+             pba->error_message,
+             pba->error_message);
+
+  z = array_spline_eval(pba->z_table,
+                        pba->d2z_dtau2_table,
+                        *last_index,
+                        *last_index+1,
+                        h_tau,a_tau,b_tau);
+
+  loga = -log(1+z);
+
+  *h = pba->loga_table[*last_index+1]-pba->loga_table[*last_index];
+  *b = (loga-pba->loga_table[*last_index])/(*h);
+  *a = 1.-(*b);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Background quantities at given conformal time tau, for a subset of
+ * them only.
+ *
+ * Same as background_at_tau() in closeby mode, but the interval is
+ * searched only once (in the tau table), starting from an explicit
+ * hint owned by the caller (e.g. one per workspace), and only the
+ * requested quantities are interpolated. They are written at their
+ * usual position pvecback[index_bg], other entries are left untouched.
+ *
+ * @param pba          Input: pointer to background structure (containing pre-computed table)
+ * @param tau          Input: value of conformal time
+ * @param columns      Input: list of indices index_bg of the requested quantities, or NULL for the first columns_size ones
+ * @param columns_size Input: number of requested quantities
+ * @param last_index   Input/Output: index of the previous/current interval in the interpolation table
+ * @param pvecback     Output: vector of background quantities (assumed to be already allocated)
+ * @return the error status
+ */
+
+int background_at_tau_columns(
+                              struct background *pba,
+                              double tau,
+                              int * columns,
+                              int columns_size,
+                              int * last_index,
+                              double * pvecback
+                              ) {
+
+  double h,a,b;
+  double * line_inf;
+  double * line_sup;
+  double * dd_line_inf;
+  double * dd_line_sup;
+  int i,index_bg;
+
+  class_call(background_tau_interval(pba,tau,last_index,&h,&a,&b),
+             pba->error_message,
+             pba->error_message);
+
+  line_inf = pba->background_table+(*last_index)*pba->bg_size;
+  line_sup = line_inf+pba->bg_size;
+  dd_line_inf = pba->d2background_dloga2_table+(*last_index)*pba->bg_size;
+  dd_line_sup = dd_line_inf+pba->bg_size;
+
+  for (i=0; i<columns_size; i++) {
+    index_bg = (columns == NULL) ? i : columns[i];
+    pvecback[index_bg] =
+      a*line_inf[index_bg] + b*line_sup[index_bg]
+      + ((a*a*a-a)*dd_line_inf[index_bg] + (b*b*b-b)*dd_line_sup[index_bg])*h*h/6.;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Background quantities at many values of conformal time, for a
+ * subset of them only.
+ *
+ * Each interval is hunted for starting from the previous one, so this
+ * is most efficient for sorted tau values.
+ *
+ * @param pba          Input: pointer to background structure (containing pre-computed table)
+ * @param tau_vec      Input: values of conformal time
+ * @param tau_size     Input: number of values of conformal time
+ * @param columns      Input: list of indices index_bg of the requested quantities, or NULL for the first columns_size ones
+ * @param columns_size Input: number of requested quantities
+ * @param last_index   Input/Output: hint for the first interval, then index of the interval of the last value
+ * @param pvecback_vec Output: array of size tau_size*columns_size, with requested quantity i at tau_vec[index_tau] in pvecback_vec[index_tau*columns_size+i]
+ * @return the error status
+ */
+
+int background_at_tau_vec(
+                          struct background *pba,
+                          double * tau_vec,
+                          int tau_size,
+                          int * columns,
+                          int columns_size,
+                          int * last_index,
+                          double * pvecback_vec
+                          ) {
+
+  double h,a,b,h2_over_6;
+  double * line_inf;
+  double * line_sup;
+  double * dd_line_inf;
+  double * dd_line_sup;
+  double * result;
+  int i,index_bg,index_tau;
+
+  for (index_tau=0; index_tau<tau_size; index_tau++) {
+
+    class_call(background_tau_interval(pba,tau_vec[index_tau],last_index,&h,&a,&b),
+               pba->error_message,
+               pba->error_message);
+
+    line_inf = pba->background_table+(*last_index)*pba->bg_size;
+    line_sup = line_inf+pba->bg_size;
+    dd_line_inf = pba->d2background_dloga2_table+(*last_index)*pba->bg_size;
+    dd_line_sup = dd_line_inf+pba->bg_size;
+    result = pvecback_vec+index_tau*columns_size;
+    h2_over_6 = h*h/6.;
+
+    for (i=0; i<columns_size; i++) {
+      index_bg = (columns == NULL) ? i : columns[i];
+      result[i] =
+        a*line_inf[index_bg] + b*line_sup[index_bg]
+        + ((a*a*a-a)*dd_line_inf[index_bg] + (b*b*b-b)*dd_line_sup[index_bg])*h2_over_6;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * Conformal time at given redshift.
  *
@@ -489,20 +699,32 @@ int background_functions(
 
       /* function returning background ncdm[n_ncdm] quantities (only
          those for which non-NULL pointers are passed) */
-      class_call(background_ncdm_momenta(
-                                         pba->q_ncdm_bg[n_ncdm],
-                                         pba->w_ncdm_bg[n_ncdm],
-                                         pba->q_size_ncdm_bg[n_ncdm],
-                                         pba->M_ncdm[n_ncdm],
-                                         pba->factor_ncdm[n_ncdm],
-                                         1./a-1.,
-                                         NULL,
-                                         &rho_ncdm,
-                                         &p_ncdm,
-                                         NULL,
-                                         &pseudo_p_ncdm),
-                 pba->error_message,
-                 pba->error_message);
+      if (pba->ncdm_bg_tabulated == _TRUE_) {
+        class_call(background_ncdm_momenta_tabulated(pba,
+                                                     n_ncdm,
+                                                     1./a-1.,
+                                                     &rho_ncdm,
+                                                     &p_ncdm,
+                                                     &pseudo_p_ncdm),
+                   pba->error_message,
+                   pba->error_message);
+      }
+      else {
+        class_call(background_ncdm_momenta(
+                                           pba->q_ncdm_bg[n_ncdm],
+                                           pba->w_ncdm_bg[n_ncdm],
+                                           pba->q_size_ncdm_bg[n_ncdm],
+                                           pba->M_ncdm[n_ncdm],
+                                           pba->factor_ncdm[n_ncdm],
+                                           1./a-1.,
+                                           NULL,
+                                           &rho_ncdm,
+                                           &p_ncdm,
+                                           NULL,
+                                           &pseudo_p_ncdm),
+                   pba->error_message,
+                   pba->error_message);
+      }
 
       pvecback[pba->index_bg_rho_ncdm1+n_ncdm] = rho_ncdm;
       rho_tot += rho_ncdm;
@@ -531,13 +753,16 @@ int background_functions(
   /* fluid with w(a) and constant cs2 */
   if (pba->has_fld == _TRUE_) {
 
-    /* get rho_fld from vector of integrated variables */
-    pvecback[pba->index_bg_rho_fld] = pvecback_B[pba->index_bi_rho_fld];
-
     /* get w_fld from dedicated function */
     class_call(background_w_fld(pba,a,&w_fld,&dw_over_da,&integral_fld), pba->error_message, pba->error_message);
     pvecback[pba->index_bg_w_fld] = w_fld;
 
+    /* get rho_fld from vector of integrated variables, or from its closed form when there is one */
+    if (pba->has_fld_ode == _TRUE_)
+      pvecback[pba->index_bg_rho_fld] = pvecback_B[pba->index_bi_rho_fld];
+    else
+      pvecback[pba->index_bg_rho_fld] = pba->Omega0_fld * pow(pba->H0,2) * exp(integral_fld);
+
     // Obsolete: at the beginning, we had here the analytic integral solution corresponding to the case w=w0+w1(1-a/a0):
     // pvecback[pba->index_bg_rho_fld] = pba->Omega0_fld * pow(pba->H0,2) / pow(a,3.*(1.+pba->w0_fld+pba->wa_fld)) * exp(3.*pba->wa_fld*(a-1.));
     // But now everthing is integrated numerically for a given w_fld(a) defined in the function background_w_fld.
@@ -662,6 +887,7 @@ int background_w_fld(
   double dOmega_ede_over_da = 0.;
   double d2Omega_ede_over_da2 = 0.;
   double a_eq, Omega_r, Omega_m;
+  double s, x, u, D, N, dD, dN, g, dg;
 
   /** - first, define the function w(a) */
   switch (pba->fluid_equation_of_state) {
@@ -691,6 +917,21 @@ int background_w_fld(
     // w_ede(a) taken from eq. (11) in 1706.00730
     *w_fld = - dOmega_ede_over_da*a/Omega_ede/3./(1.-Omega_ede)+a_eq/3./(a+a_eq);
     break;
+  case CARDASSIAN:
+    // H^2 = rho_m (1+x)^(1/q) with x = x0 a^(-3q(n-1)), so that rho_card = rho_m [(1+x)^(1/q)-1].
+    // Then w = (n-1) x (1+x)^(1/q-1) / [(1+x)^(1/q)-1], going from q(n-1) when x->0 to n-1 when x->infinity.
+    if (a <= 0.) {
+      *w_fld = pba->cardassian_q*(pba->cardassian_n-1.);
+      break;
+    }
+    s = 1./pba->cardassian_q;
+    x = pba->cardassian_x0*pow(a,-3.*pba->cardassian_q*(pba->cardassian_n-1.));
+    u = 1.+x;
+    D = expm1(s*log1p(x));
+    N = x*pow(u,s-1.);
+    g = N/D;
+    *w_fld = (pba->cardassian_n-1.)*g;
+    break;
   }
 
 
@@ -710,6 +951,17 @@ int background_w_fld(
       + dOmega_ede_over_da*dOmega_ede_over_da*a/3./(1.-Omega_ede)/(1.-Omega_ede)/Omega_ede
       + a_eq/3./(a+a_eq)/(a+a_eq);
     break;
+  case CARDASSIAN:
+    if (a <= 0.) {
+      *dw_over_da_fld = 0.;
+      break;
+    }
+    // dw/da = (n-1) dg/dx dx/da with dx/da = -3q(n-1) x/a
+    dN = pow(u,s-1.) + (s-1.)*x*pow(u,s-2.);
+    dD = s*pow(u,s-1.);
+    dg = (dN*D-N*dD)/D/D;
+    *dw_over_da_fld = (pba->cardassian_n-1.)*dg*(-3.*pba->cardassian_q*(pba->cardassian_n-1.)*x/a);
+    break;
   }
 
   /** - finally, give the analytic solution of the following integral:
@@ -729,6 +981,14 @@ int background_w_fld(
   case EDE:
     class_stop(pba->error_message,"EDE implementation not finished: to finish it, read the comments in background.c just before this line\n");
     break;
+  case CARDASSIAN:
+    // rho_card(a)/rho_card(a0) = a^-3 D(x)/D(x0), with D(x0) = Omega0_fld/Omega0_m
+    if (a <= 0.) {
+      *integral_fld = 0.;
+      break;
+    }
+    *integral_fld = -3.*log(a) + log(D) - log(expm1(s*log1p(pba->cardassian_x0)));
+    break;
   }
 
   /** note: of course you can generalise these formulas to anything,
@@ -768,6 +1028,18 @@ int background_init(
                     "Shooting failed, try optimising input_get_guess(). Error message:\n\n%s",
                     pba->shooting_error);
 
+  /** - if the background was computed at the converged step of the shooting, there is nothing left to do */
+  if (pba->is_from_shooting == _TRUE_) {
+    pba->is_from_shooting = _FALSE_;
+    if (pba->background_verbose > 0) {
+      printf(" -> background computed during the shooting\n");
+    }
+    class_call(background_output_budget(pba),
+               pba->error_message,
+               pba->error_message);
+    return _SUCCESS_;
+  }
+
   /** - assign values to all indices in vectors of background quantities */
   class_call(background_indices(pba),
              pba->error_message,
@@ -778,6 +1050,11 @@ int background_init(
              pba->error_message,
              pba->error_message);
 
+  /** - if requested, tabulate the ncdm momentum integrals as a function of m/T */
+  class_call(background_ncdm_table_init(ppr,pba),
+             pba->error_message,
+             pba->error_message);
+
   /** - integrate the background over log(a), allocate and fill the background table */
   class_call(background_solve(ppr,pba),
              pba->error_message,
@@ -817,6 +1094,8 @@ int background_free(
               pba->error_message,
               pba->error_message);
 
+  class_memory_leaks();
+
   return _SUCCESS_;
 }
 
@@ -840,6 +1119,10 @@ int background_free_noinput(
   free(pba->background_table);
   free(pba->d2background_dloga2_table);
 
+  class_call(background_ncdm_table_free(pba),
+             pba->error_message,
+             pba->error_message);
+
   return _SUCCESS_;
 }
 /**
@@ -915,6 +1198,8 @@ int background_indices(
   int index_bg;
   /* a running index for the vector of background quantities to be integrated */
   int index_bi;
+  /* matter density fixing the Cardassian expansion today */
+  double Omega0_m;
 
   /** - initialize all flags: which species are present? */
 
@@ -925,6 +1210,7 @@ int background_indices(
   pba->has_scf = _FALSE_;
   pba->has_lambda = _FALSE_;
   pba->has_fld = _FALSE_;
+  pba->has_fld_ode = _FALSE_;
   pba->has_ur = _FALSE_;
   pba->has_idr = _FALSE_;
   pba->has_idm_dr = _FALSE_;
@@ -948,8 +1234,16 @@ int background_indices(
   if (pba->Omega0_lambda != 0.)
     pba->has_lambda = _TRUE_;
 
-  if (pba->Omega0_fld != 0.)
+  if (pba->Omega0_fld != 0.) {
     pba->has_fld = _TRUE_;
+    /* the Cardassian density has a closed form, the other ones are integrated */
+    pba->has_fld_ode = _TRUE_;
+    if (pba->fluid_equation_of_state == CARDASSIAN) {
+      pba->has_fld_ode = _FALSE_;
+      Omega0_m = pba->Omega0_b + pba->Omega0_cdm + pba->Omega0_idm_dr;
+      pba->cardassian_x0 = pow(1.+pba->Omega0_fld/Omega0_m,pba->cardassian_q)-1.;
+    }
+  }
 
   if (pba->Omega0_ur != 0.)
     pba->has_ur = _TRUE_;
@@ -1096,7 +1390,7 @@ int background_indices(
   class_define_index(pba->index_bi_rho_dr,pba->has_dr,index_bi,1);
 
   /* -> energy density in fluid */
-  class_define_index(pba->index_bi_rho_fld,pba->has_fld,index_bi,1);
+  class_define_index(pba->index_bi_rho_fld,pba->has_fld_ode,index_bi,1);
 
   /* -> scalar field and its derivative wrt conformal time (Zuma) */
   class_define_index(pba->index_bi_phi_scf,pba->has_scf,index_bi,1);
@@ -1146,6 +1440,7 @@ int background_ncdm_distribution(
   double ksi;
   double qlast,dqlast,f0last,df0last;
   double *param;
+  int last_index;
   /* Variables corresponding to entries in param: */
   //double square_s12,square_s23,square_s13;
   //double mixing_matrix[3][3];
@@ -1186,7 +1481,7 @@ int background_ncdm_distribution(
                                           pbadist_local->d2f0,
                                           1,
                                           q,
-                                          &pbadist_local->last_index,
+                                          &last_index,
                                           f0,
                                           1,
                                           pba->error_message),
@@ -1306,6 +1601,8 @@ int background_ncdm_init(
   double f0m2,f0m1,f0,f0p1,f0p2,dq,q,df0dq,tmp1,tmp2;
   struct background_parameters_for_distributions pbadist;
   FILE *psdfile;
+  short cache_found;
+  unsigned long long cache_key;
 
   pbadist.pba = pba;
 
@@ -1362,60 +1659,87 @@ int background_ncdm_init(
 
     /* Handle perturbation qsampling: */
     if (pba->ncdm_quadrature_strategy[k]==qm_auto) {
-      /** Automatic q-sampling for this species */
-      class_alloc(pba->q_ncdm[k],_QUADRATURE_MAX_*sizeof(double),pba->error_message);
-      class_alloc(pba->w_ncdm[k],_QUADRATURE_MAX_*sizeof(double),pba->error_message);
-
-      class_call(get_qsampling(pba->q_ncdm[k],
-                               pba->w_ncdm[k],
-                               &(pba->q_size_ncdm[k]),
-                               _QUADRATURE_MAX_,
-                               ppr->tol_ncdm,
-                               pbadist.q,
-                               pbadist.tablesize,
-                               background_ncdm_test_function,
-                               background_ncdm_distribution,
-                               &pbadist,
-                               pba->error_message),
-                 pba->error_message,
-                 pba->error_message);
-      pba->q_ncdm[k]=realloc(pba->q_ncdm[k],pba->q_size_ncdm[k]*sizeof(double));
-      pba->w_ncdm[k]=realloc(pba->w_ncdm[k],pba->q_size_ncdm[k]*sizeof(double));
+      /** Automatic q-sampling for this species, eventually read from
+          memory if a previous run in this process used the same
+          distribution function and tolerances */
+      cache_found = _FALSE_;
+      if (ppr->ncdm_quadrature_cache == _TRUE_) {
+        class_call(background_ncdm_quadrature_key(ppr,pba,&pbadist,&cache_key),
+                   pba->error_message,
+                   pba->error_message);
+        /* the quadratures in memory are shared by all threads */
+#pragma omp critical (background_ncdm_quadrature)
+        status = background_ncdm_quadrature_fetch(cache_key,pba,k,&cache_found);
+        if (status == _FAILURE_)
+          return _FAILURE_;
+      }
 
+      if (cache_found == _FALSE_) {
+
+        class_alloc(pba->q_ncdm[k],_QUADRATURE_MAX_*sizeof(double),pba->error_message);
+        class_alloc(pba->w_ncdm[k],_QUADRATURE_MAX_*sizeof(double),pba->error_message);
+
+        class_call(get_qsampling(pba->q_ncdm[k],
+                                 pba->w_ncdm[k],
+                                 &(pba->q_size_ncdm[k]),
+                                 _QUADRATURE_MAX_,
+                                 ppr->tol_ncdm,
+                                 pbadist.q,
+                                 pbadist.tablesize,
+                                 background_ncdm_test_function,
+                                 background_ncdm_distribution,
+                                 &pbadist,
+                                 (pbadist.tablesize > 0 ? _TRUE_ : _FALSE_),
+                                 pba->error_message),
+                   pba->error_message,
+                   pba->error_message);
+        pba->q_ncdm[k]=realloc(pba->q_ncdm[k],pba->q_size_ncdm[k]*sizeof(double));
+        pba->w_ncdm[k]=realloc(pba->w_ncdm[k],pba->q_size_ncdm[k]*sizeof(double));
+
+        /* Handle background q_sampling: */
+        class_alloc(pba->q_ncdm_bg[k],_QUADRATURE_MAX_BG_*sizeof(double),pba->error_message);
+        class_alloc(pba->w_ncdm_bg[k],_QUADRATURE_MAX_BG_*sizeof(double),pba->error_message);
+
+        class_call(get_qsampling(pba->q_ncdm_bg[k],
+                                 pba->w_ncdm_bg[k],
+                                 &(pba->q_size_ncdm_bg[k]),
+                                 _QUADRATURE_MAX_BG_,
+                                 ppr->tol_ncdm_bg,
+                                 pbadist.q,
+                                 pbadist.tablesize,
+                                 background_ncdm_test_function,
+                                 background_ncdm_distribution,
+                                 &pbadist,
+                                 (pbadist.tablesize > 0 ? _TRUE_ : _FALSE_),
+                                 pba->error_message),
+                   pba->error_message,
+                   pba->error_message);
+
+        pba->q_ncdm_bg[k]=realloc(pba->q_ncdm_bg[k],pba->q_size_ncdm_bg[k]*sizeof(double));
+        pba->w_ncdm_bg[k]=realloc(pba->w_ncdm_bg[k],pba->q_size_ncdm_bg[k]*sizeof(double));
+
+        if (ppr->ncdm_quadrature_cache == _TRUE_) {
+#pragma omp critical (background_ncdm_quadrature)
+          status = background_ncdm_quadrature_store(cache_key,pba,k);
+          if (status == _FAILURE_)
+            return _FAILURE_;
+        }
+      }
 
       if (pba->background_verbose > 0) {
-        printf("ncdm species i=%d sampled with %d points for purpose of perturbation integration\n",
+        printf("ncdm species i=%d sampled with %d points for purpose of perturbation integration%s\n",
                k+1,
-               pba->q_size_ncdm[k]);
+               pba->q_size_ncdm[k],
+               (cache_found == _TRUE_ ? " (read from memory)" : ""));
       }
 
-      /* Handle background q_sampling: */
-      class_alloc(pba->q_ncdm_bg[k],_QUADRATURE_MAX_BG_*sizeof(double),pba->error_message);
-      class_alloc(pba->w_ncdm_bg[k],_QUADRATURE_MAX_BG_*sizeof(double),pba->error_message);
-
-      class_call(get_qsampling(pba->q_ncdm_bg[k],
-                               pba->w_ncdm_bg[k],
-                               &(pba->q_size_ncdm_bg[k]),
-                               _QUADRATURE_MAX_BG_,
-                               ppr->tol_ncdm_bg,
-                               pbadist.q,
-                               pbadist.tablesize,
-                               background_ncdm_test_function,
-                               background_ncdm_distribution,
-                               &pbadist,
-                               pba->error_message),
-                 pba->error_message,
-                 pba->error_message);
-
-      pba->q_ncdm_bg[k]=realloc(pba->q_ncdm_bg[k],pba->q_size_ncdm_bg[k]*sizeof(double));
-      pba->w_ncdm_bg[k]=realloc(pba->w_ncdm_bg[k],pba->q_size_ncdm_bg[k]*sizeof(double));
-
       /** - in verbose mode, inform user of number of sampled momenta
           for background quantities */
       if (pba->background_verbose > 0) {
-        printf("ncdm species i=%d sampled with %d points for purpose of background integration\n",
+        printf("ncdm species i=%d sampled with %d points for purpose of background integration%s\n",
                k+1,
-               pba->q_size_ncdm_bg[k]);
+               pba->q_size_ncdm_bg[k],
+               (cache_found == _TRUE_ ? " (read from memory)" : ""));
       }
     }
     else{
@@ -1511,6 +1835,209 @@ int background_ncdm_init(
   return _SUCCESS_;
 }
 
+
+/**
+ * Momentum quadratures stored by background_ncdm_quadrature_store(),
+ * and index of the next slot to fill
+ */
+
+static struct background_ncdm_quadrature background_ncdm_quadrature_table[_NCDM_QUADRATURE_CACHE_MAX_];
+static short background_ncdm_quadrature_used[_NCDM_QUADRATURE_CACHE_MAX_];
+static int background_ncdm_quadrature_next = 0;
+
+/**
+ * Compute a 64-bit FNV-1a key identifying everything that determines
+ * the automatic momentum quadrature of one ncdm species: the index of
+ * the species (the analytic distribution may depend on it), its
+ * chemical potential, the optional ncdm_psd_parameters, the tabulated
+ * distribution when it is read from a file (tablesize is zero
+ * otherwise), the two tolerances and the maximum numbers of points.
+ *
+ * @param ppr    Input: pointer to precision structure
+ * @param pba    Input: pointer to background structure
+ * @param pbadist Input: parameters of the distribution function of the species
+ * @param key    Output: key
+ * @return the error status
+ */
+
+int background_ncdm_quadrature_key(
+                                   struct precision *ppr,
+                                   struct background *pba,
+                                   struct background_parameters_for_distributions *pbadist,
+                                   unsigned long long * key
+                                   ) {
+
+  const unsigned char * byte;
+  size_t index, size;
+  int n_ncdm = pbadist->n_ncdm;
+  int section, quadrature_max[2] = {_QUADRATURE_MAX_,_QUADRATURE_MAX_BG_};
+  double tol[2];
+  const void * data;
+
+  tol[0] = ppr->tol_ncdm;
+  tol[1] = ppr->tol_ncdm_bg;
+
+  *key = 14695981039346656037ULL;
+
+  for (section = 0; section < 8; section++) {
+    switch (section) {
+    case 0: data = &n_ncdm;                      size = sizeof(int); break;
+    case 1: data = &(pbadist->tablesize);        size = sizeof(int); break;
+    case 2: data = &(pba->ksi_ncdm[n_ncdm]);     size = sizeof(double); break;
+    case 3: data = pba->ncdm_psd_parameters;     size = pba->ncdm_psd_parameters_size*sizeof(double); break;
+    case 4: data = pbadist->q;                   size = pbadist->tablesize*sizeof(double); break;
+    case 5: data = pbadist->f0;                  size = pbadist->tablesize*sizeof(double); break;
+    case 6: data = tol;                          size = 2*sizeof(double); break;
+    default: data = quadrature_max;              size = 2*sizeof(int); break;
+    }
+    if (data == NULL)
+      size = 0;
+    byte = (const unsigned char *) data;
+    for (index = 0; index < size; index++) {
+      *key ^= byte[index];
+      *key *= 1099511628211ULL;
+    }
+    /* also hash the size of each section, so that sections cannot be confused */
+    byte = (const unsigned char *) &size;
+    for (index = 0; index < sizeof(size_t); index++) {
+      *key ^= byte[index];
+      *key *= 1099511628211ULL;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Look for the momentum quadrature of ncdm species n_ncdm among those
+ * stored in memory, and if it is found, allocate and fill q_ncdm,
+ * w_ncdm, q_ncdm_bg, w_ncdm_bg and the corresponding sizes.
+ *
+ * @param key    Input: key computed by background_ncdm_quadrature_key()
+ * @param pba    Input/Output: pointer to background structure
+ * @param n_ncdm Input: index of the ncdm species
+ * @param found  Output: whether the quadrature was found
+ * @return the error status
+ */
+
+int background_ncdm_quadrature_fetch(
+                                     unsigned long long key,
+                                     struct background *pba,
+                                     int n_ncdm,
+                                     short * found
+                                     ) {
+
+  int index_cache;
+  struct background_ncdm_quadrature * pquad;
+
+  *found = _FALSE_;
+
+  for (index_cache = 0; index_cache < _NCDM_QUADRATURE_CACHE_MAX_; index_cache++) {
+    if ((background_ncdm_quadrature_used[index_cache] == _TRUE_) && (background_ncdm_quadrature_table[index_cache].key == key)) {
+      *found = _TRUE_;
+      break;
+    }
+  }
+
+  if (*found == _FALSE_)
+    return _SUCCESS_;
+
+  pquad = &(background_ncdm_quadrature_table[index_cache]);
+
+  pba->q_size_ncdm[n_ncdm] = pquad->q_size;
+  pba->q_size_ncdm_bg[n_ncdm] = pquad->q_size_bg;
+  class_alloc(pba->q_ncdm[n_ncdm],pquad->q_size*sizeof(double),pba->error_message);
+  class_alloc(pba->w_ncdm[n_ncdm],pquad->q_size*sizeof(double),pba->error_message);
+  class_alloc(pba->q_ncdm_bg[n_ncdm],pquad->q_size_bg*sizeof(double),pba->error_message);
+  class_alloc(pba->w_ncdm_bg[n_ncdm],pquad->q_size_bg*sizeof(double),pba->error_message);
+  memcpy(pba->q_ncdm[n_ncdm],pquad->q,pquad->q_size*sizeof(double));
+  memcpy(pba->w_ncdm[n_ncdm],pquad->w,pquad->q_size*sizeof(double));
+  memcpy(pba->q_ncdm_bg[n_ncdm],pquad->q_bg,pquad->q_size_bg*sizeof(double));
+  memcpy(pba->w_ncdm_bg[n_ncdm],pquad->w_bg,pquad->q_size_bg*sizeof(double));
+
+  return _SUCCESS_;
+}
+
+/**
+ * Store in memory a copy of the momentum quadrature of ncdm species
+ * n_ncdm. When _NCDM_QUADRATURE_CACHE_MAX_ quadratures are already
+ * stored, the oldest one is replaced.
+ *
+ * @param key    Input: key computed by background_ncdm_quadrature_key()
+ * @param pba    Input: pointer to background structure
+ * @param n_ncdm Input: index of the ncdm species
+ * @return the error status
+ */
+
+int background_ncdm_quadrature_store(
+                                     unsigned long long key,
+                                     struct background *pba,
+                                     int n_ncdm
+                                     ) {
+
+  int index_cache;
+  struct background_ncdm_quadrature * pquad;
+
+  index_cache = background_ncdm_quadrature_next % _NCDM_QUADRATURE_CACHE_MAX_;
+  pquad = &(background_ncdm_quadrature_table[index_cache]);
+
+  if (background_ncdm_quadrature_used[index_cache] == _TRUE_) {
+    free(pquad->q);
+    free(pquad->w);
+    free(pquad->q_bg);
+    free(pquad->w_bg);
+    background_ncdm_quadrature_used[index_cache] = _FALSE_;
+  }
+
+  pquad->key = key;
+  pquad->q_size = pba->q_size_ncdm[n_ncdm];
+  pquad->q_size_bg = pba->q_size_ncdm_bg[n_ncdm];
+  class_alloc(pquad->q,pquad->q_size*sizeof(double),pba->error_message);
+  class_alloc(pquad->w,pquad->q_size*sizeof(double),pba->error_message);
+  class_alloc(pquad->q_bg,pquad->q_size_bg*sizeof(double),pba->error_message);
+  class_alloc(pquad->w_bg,pquad->q_size_bg*sizeof(double),pba->error_message);
+  memcpy(pquad->q,pba->q_ncdm[n_ncdm],pquad->q_size*sizeof(double));
+  memcpy(pquad->w,pba->w_ncdm[n_ncdm],pquad->q_size*sizeof(double));
+  memcpy(pquad->q_bg,pba->q_ncdm_bg[n_ncdm],pquad->q_size_bg*sizeof(double));
+  memcpy(pquad->w_bg,pba->w_ncdm_bg[n_ncdm],pquad->q_size_bg*sizeof(double));
+
+  background_ncdm_quadrature_used[index_cache] = _TRUE_;
+  background_ncdm_quadrature_next = index_cache+1;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free all momentum quadratures stored in memory by
+ * background_ncdm_quadrature_store().
+ *
+ * @return the error status
+ */
+
+int background_ncdm_quadrature_clear(
+                                     ) {
+
+  int index_cache;
+  struct background_ncdm_quadrature * pquad;
+
+#pragma omp critical (background_ncdm_quadrature)
+  {
+    for (index_cache = 0; index_cache < _NCDM_QUADRATURE_CACHE_MAX_; index_cache++) {
+      if (background_ncdm_quadrature_used[index_cache] == _TRUE_) {
+        pquad = &(background_ncdm_quadrature_table[index_cache]);
+        free(pquad->q);
+        free(pquad->w);
+        free(pquad->q_bg);
+        free(pquad->w_bg);
+        background_ncdm_quadrature_used[index_cache] = _FALSE_;
+      }
+    }
+    background_ncdm_quadrature_next = 0;
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * For a given ncdm species: given the quadrature weights, the mass
  * and the redshift, find background quantities by a quick weighted
@@ -1589,6 +2116,221 @@ int background_ncdm_momenta(
   return _SUCCESS_;
 }
 
+/**
+ * Tabulate the momentum integrals of the density, pressure and
+ * pseudo-pressure of each ncdm species as a function of ln(y), with
+ * y=M_ncdm/(1+z)=m/T. For a given quadrature, these integrals depend
+ * only on y, up to the normalization factor_ncdm*(1+z)^4. The table
+ * goes from ppr->ncdm_bg_table_y_min to M_ncdm (i.e. today), and
+ * holds the logarithm of the integrals, which are smooth and
+ * monotonic in ln(y).
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input/Output: pointer to background structure
+ * @return the error status
+ */
+
+int background_ncdm_table_init(
+                               struct precision *ppr,
+                               struct background *pba
+                               ) {
+
+  int n_ncdm,index_y,index_q;
+  double lny,rho,p,pseudo_p;
+  double * lny_table;
+  int lny_size_max;
+
+  pba->ncdm_bg_tabulated = _FALSE_;
+
+  if ((pba->has_ncdm == _FALSE_) || (ppr->ncdm_bg_tabulate == _FALSE_))
+    return _SUCCESS_;
+
+  class_test(ppr->ncdm_bg_table_y_min <= 0.,
+             pba->error_message,
+             "ncdm_bg_table_y_min=%e should be strictly positive",ppr->ncdm_bg_table_y_min);
+  class_test(ppr->ncdm_bg_table_points_per_decade <= 0.,
+             pba->error_message,
+             "ncdm_bg_table_points_per_decade=%e should be strictly positive",ppr->ncdm_bg_table_points_per_decade);
+
+  pba->ncdm_bg_table_lny_min = log(ppr->ncdm_bg_table_y_min);
+  pba->ncdm_bg_table_dlny = log(10.)/ppr->ncdm_bg_table_points_per_decade;
+
+  class_alloc(pba->ncdm_bg_table_size,pba->N_ncdm*sizeof(int),pba->error_message);
+  class_alloc(pba->ncdm_bg_table,pba->N_ncdm*sizeof(double*),pba->error_message);
+  class_alloc(pba->ncdm_bg_dd_table,pba->N_ncdm*sizeof(double*),pba->error_message);
+  class_alloc(pba->ncdm_bg_small_y,pba->N_ncdm*sizeof(double*),pba->error_message);
+
+  /* number of points (at least four, for the spline) needed to reach M_ncdm */
+  lny_size_max = 0;
+  for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
+    pba->ncdm_bg_table_size[n_ncdm] = MAX(4,(int)ceil((log(pba->M_ncdm[n_ncdm])-pba->ncdm_bg_table_lny_min)/pba->ncdm_bg_table_dlny)+2);
+    lny_size_max = MAX(lny_size_max,pba->ncdm_bg_table_size[n_ncdm]);
+  }
+
+  class_alloc(lny_table,lny_size_max*sizeof(double),pba->error_message);
+  for (index_y=0; index_y<lny_size_max; index_y++)
+    lny_table[index_y] = pba->ncdm_bg_table_lny_min+index_y*pba->ncdm_bg_table_dlny;
+
+  for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
+
+    class_alloc(pba->ncdm_bg_table[n_ncdm],3*pba->ncdm_bg_table_size[n_ncdm]*sizeof(double),pba->error_message);
+    class_alloc(pba->ncdm_bg_dd_table[n_ncdm],3*pba->ncdm_bg_table_size[n_ncdm]*sizeof(double),pba->error_message);
+    class_alloc(pba->ncdm_bg_small_y[n_ncdm],2*sizeof(double),pba->error_message);
+
+    for (index_y=0; index_y<pba->ncdm_bg_table_size[n_ncdm]; index_y++) {
+      lny = lny_table[index_y];
+      /* with factor=1 and z=0, the integrals are computed for M=y */
+      class_call(background_ncdm_momenta(pba->q_ncdm_bg[n_ncdm],
+                                         pba->w_ncdm_bg[n_ncdm],
+                                         pba->q_size_ncdm_bg[n_ncdm],
+                                         exp(lny),
+                                         1.,
+                                         0.,
+                                         NULL,
+                                         &rho,
+                                         &p,
+                                         NULL,
+                                         &pseudo_p),
+                 pba->error_message,
+                 pba->error_message);
+      pba->ncdm_bg_table[n_ncdm][3*index_y] = log(rho);
+      pba->ncdm_bg_table[n_ncdm][3*index_y+1] = log(p);
+      pba->ncdm_bg_table[n_ncdm][3*index_y+2] = log(pseudo_p);
+    }
+
+    class_call(array_spline_table_lines(lny_table,
+                                        pba->ncdm_bg_table_size[n_ncdm],
+                                        pba->ncdm_bg_table[n_ncdm],
+                                        3,
+                                        pba->ncdm_bg_dd_table[n_ncdm],
+                                        _SPLINE_EST_DERIV_,
+                                        pba->error_message),
+               pba->error_message,
+               pba->error_message);
+
+    /* for small y, epsilon = q + y^2/(2q) + O(y^4), so the integrals
+       only depend on the sums of q^3 w and q w */
+    pba->ncdm_bg_small_y[n_ncdm][0] = 0.;
+    pba->ncdm_bg_small_y[n_ncdm][1] = 0.;
+    for (index_q=0; index_q<pba->q_size_ncdm_bg[n_ncdm]; index_q++) {
+      pba->ncdm_bg_small_y[n_ncdm][0] += pow(pba->q_ncdm_bg[n_ncdm][index_q],3)*pba->w_ncdm_bg[n_ncdm][index_q];
+      pba->ncdm_bg_small_y[n_ncdm][1] += pba->q_ncdm_bg[n_ncdm][index_q]*pba->w_ncdm_bg[n_ncdm][index_q];
+    }
+  }
+
+  free(lny_table);
+
+  pba->ncdm_bg_tabulated = _TRUE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the tables of ncdm momentum integrals, if they were allocated
+ * by background_ncdm_table_init()
+ *
+ * @param pba Input/Output: pointer to background structure
+ * @return the error status
+ */
+
+int background_ncdm_table_free(
+                               struct background *pba
+                               ) {
+
+  int n_ncdm;
+
+  if (pba->ncdm_bg_tabulated == _TRUE_) {
+    for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
+      free(pba->ncdm_bg_table[n_ncdm]);
+      free(pba->ncdm_bg_dd_table[n_ncdm]);
+      free(pba->ncdm_bg_small_y[n_ncdm]);
+    }
+    free(pba->ncdm_bg_table_size);
+    free(pba->ncdm_bg_table);
+    free(pba->ncdm_bg_dd_table);
+    free(pba->ncdm_bg_small_y);
+    pba->ncdm_bg_tabulated = _FALSE_;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Same as background_ncdm_momenta() for the density, pressure and
+ * pseudo-pressure, but interpolating the tables of
+ * background_ncdm_table_init(). Beyond the last tabulated value
+ * (i.e. in the future), the momentum sums are computed directly.
+ *
+ * @param pba      Input: pointer to background structure
+ * @param n_ncdm   Input: index of ncdm species
+ * @param z        Input: redshift
+ * @param rho      Output: density
+ * @param p        Output: pressure
+ * @param pseudo_p Output: pseudo-pressure used in ncdm fluid approximation
+ * @return the error status
+ */
+
+int background_ncdm_momenta_tabulated(
+                                      struct background *pba,
+                                      int n_ncdm,
+                                      double z,
+                                      double * rho,
+                                      double * p,
+                                      double * pseudo_p
+                                      ) {
+
+  double y,y2,factor2,x,a,b,h2_over_6;
+  double * table;
+  double * dd_table;
+  int index_y;
+
+  y = pba->M_ncdm[n_ncdm]/(1.+z);
+  x = (log(y)-pba->ncdm_bg_table_lny_min)/pba->ncdm_bg_table_dlny;
+
+  /** - beyond the table, sum over momenta */
+  if (x > pba->ncdm_bg_table_size[n_ncdm]-1) {
+    class_call(background_ncdm_momenta(pba->q_ncdm_bg[n_ncdm],
+                                       pba->w_ncdm_bg[n_ncdm],
+                                       pba->q_size_ncdm_bg[n_ncdm],
+                                       pba->M_ncdm[n_ncdm],
+                                       pba->factor_ncdm[n_ncdm],
+                                       z,
+                                       NULL,
+                                       rho,
+                                       p,
+                                       NULL,
+                                       pseudo_p),
+               pba->error_message,
+               pba->error_message);
+    return _SUCCESS_;
+  }
+
+  factor2 = pba->factor_ncdm[n_ncdm]*pow(1+z,4);
+
+  /** - below the table, use the expansion at order y^2 */
+  if (x < 0.) {
+    y2 = y*y;
+    *rho = factor2*(pba->ncdm_bg_small_y[n_ncdm][0]+0.5*y2*pba->ncdm_bg_small_y[n_ncdm][1]);
+    *p = factor2*(pba->ncdm_bg_small_y[n_ncdm][0]-0.5*y2*pba->ncdm_bg_small_y[n_ncdm][1])/3.;
+    *pseudo_p = factor2*(pba->ncdm_bg_small_y[n_ncdm][0]-1.5*y2*pba->ncdm_bg_small_y[n_ncdm][1])/3.;
+    return _SUCCESS_;
+  }
+
+  /** - otherwise, spline interpolation on the evenly spaced ln(y) values */
+  index_y = MIN((int)x,pba->ncdm_bg_table_size[n_ncdm]-2);
+  b = x-index_y;
+  a = 1.-b;
+  h2_over_6 = pba->ncdm_bg_table_dlny*pba->ncdm_bg_table_dlny/6.;
+  table = pba->ncdm_bg_table[n_ncdm]+3*index_y;
+  dd_table = pba->ncdm_bg_dd_table[n_ncdm]+3*index_y;
+
+  *rho = factor2*exp(a*table[0]+b*table[3]+((a*a*a-a)*dd_table[0]+(b*b*b-b)*dd_table[3])*h2_over_6);
+  *p = factor2*exp(a*table[1]+b*table[4]+((a*a*a-a)*dd_table[1]+(b*b*b-b)*dd_table[4])*h2_over_6);
+  *pseudo_p = factor2*exp(a*table[2]+b*table[5]+((a*a*a-a)*dd_table[2]+(b*b*b-b)*dd_table[5])*h2_over_6);
+
+  return _SUCCESS_;
+}
+
 /**
  * When the user passed the density fraction Omega_ncdm or
  * omega_ncdm in input but not the mass, infer the mass with Newton iteration method.
@@ -1806,7 +2548,9 @@ int background_solve(
 
   /* evolvers */
   extern int evolver_rk();
+  extern int evolver_rk_dense();
   extern int evolver_ndf15();
+  extern int evolver_rosenbrock();
   int (*generic_evolver)() = evolver_ndf15;
 
   /* initial and final loga values */
@@ -1854,43 +2598,73 @@ int background_solve(
     used_in_output[index_loga] = 1;
   }
 
-  /** - choose the right evolver */
-  switch (ppr->background_evolver) {
+  /** - when all densities are known in closed form, integrate by
+        quadrature with background_solve_quadrature() */
+  if ((ppr->background_quadrature == _TRUE_) &&
+      (pba->has_ncdm == _FALSE_) &&
+      (pba->has_dcdm == _FALSE_) &&
+      (pba->has_dr == _FALSE_) &&
+      (pba->has_scf == _FALSE_) &&
+      ((pba->has_fld_ode == _FALSE_) || (pba->fluid_equation_of_state == CLP))) {
 
-  case rk:
-    generic_evolver = evolver_rk;
     if (pba->background_verbose > 1) {
-      printf("%s\n", "Chose rk as generic_evolver");
+      printf("%s\n", "Chose quadrature instead of generic_evolver");
     }
-    break;
 
-  case ndf15:
-    generic_evolver = evolver_ndf15;
-    if (pba->background_verbose > 1) {
-      printf("%s\n", "Chose ndf15 as generic_evolver");
-    }
-    break;
+    class_call(background_solve_quadrature(ppr,pba,pvecback_integration),
+               pba->error_message,
+               pba->error_message);
   }
+  else {
 
-  /** - perform the integration */
-  class_call(generic_evolver(background_derivs,
-                             loga_ini,
-                             loga_final,
-                             pvecback_integration,
-                             used_in_output,
-                             pba->bi_size,
-                             &bpaw,
-                             ppr->tol_background_integration,
-                             ppr->smallest_allowed_variation,
-                             background_timescale, //'evaluate_timescale', required by evolver_rk but not by ndf15
-                             ppr->background_integration_stepsize,
-                             pba->loga_table,
-                             pba->bt_size,
-                             background_sources,
-                             NULL, //'print_variables' in evolver_rk could be set, but, not required
-                             pba->error_message),
-             pba->error_message,
-             pba->error_message);
+    /** - otherwise, choose the right evolver */
+    switch (ppr->background_evolver) {
+
+    case rk:
+      if (ppr->evolver_rk_dense_output == _TRUE_)
+        generic_evolver = evolver_rk_dense;
+      else
+        generic_evolver = evolver_rk;
+      if (pba->background_verbose > 1) {
+        printf("%s\n", "Chose rk as generic_evolver");
+      }
+      break;
+
+    case ndf15:
+      generic_evolver = evolver_ndf15;
+      if (pba->background_verbose > 1) {
+        printf("%s\n", "Chose ndf15 as generic_evolver");
+      }
+      break;
+
+    case rosenbrock:
+      generic_evolver = evolver_rosenbrock;
+      if (pba->background_verbose > 1) {
+        printf("%s\n", "Chose rosenbrock as generic_evolver");
+      }
+      break;
+    }
+
+    /** - perform the integration */
+    class_call(generic_evolver(background_derivs,
+                               loga_ini,
+                               loga_final,
+                               pvecback_integration,
+                               used_in_output,
+                               pba->bi_size,
+                               &bpaw,
+                               ppr->tol_background_integration,
+                               ppr->smallest_allowed_variation,
+                               background_timescale, //'evaluate_timescale', required by evolver_rk but not by ndf15
+                               ppr->background_integration_stepsize,
+                               pba->loga_table,
+                               pba->bt_size,
+                               background_sources,
+                               NULL, //'print_variables' in evolver_rk could be set, but, not required
+                               pba->error_message),
+               pba->error_message,
+               pba->error_message);
+  }
 
   /** - recover some quantities today */
   /* -> age in Gyears */
@@ -1925,6 +2699,13 @@ int background_solve(
     pba->background_table[index_loga*pba->bg_size+pba->index_bg_lum_distance] = comoving_radius*(1.+pba->z_table[index_loga]);
   }
 
+  /** - if requested, keep only the values of loga needed for accurate interpolation */
+  if (ppr->background_table_adaptive == _TRUE_) {
+    class_call(background_table_thin(ppr,pba),
+               pba->error_message,
+               pba->error_message);
+  }
+
   /** - fill tables of second derivatives (in view of spline interpolation) */
   class_call(array_spline_table_lines(pba->z_table,
                                       pba->bt_size,
@@ -2015,6 +2796,470 @@ int background_solve(
 
 }
 
+/**
+ * Integrate the background by quadrature, for models in which all
+ * densities are known in closed form (see background_closed_form()).
+ *
+ * This replaces the generic evolver in background_solve(), and is
+ * also used for a fluid with w(a) = w0 + wa (1-a) (CLP), whose density
+ * is otherwise integrated by the evolver. Starting
+ * from the initial conditions in pvecback_integration at
+ * loga_table[0]:
+ *
+ * - tau, t and the flat-space sound horizon integral F = int c_s
+ *   dtau are integrated over each interval of loga_table with a
+ *   three-point Gauss-Legendre rule, in parallel, and then summed
+ *   up. With curvature, the sound horizon follows from \f$ drs/dF =
+ *   \sqrt{1-K rs^2} \f$, i.e. \f$ rs = \sin(\sqrt{K} (F+F_0))/\sqrt{K}
+ *   \f$ (or sinh for K<0);
+ *
+ * - the growth factor D and its derivative D' are integrated with a
+ *   fourth-order Runge-Kutta scheme, with
+ *   ppr->background_quadrature_substeps steps per interval;
+ *
+ * - the rows of background_table, z_table and tau_table are then
+ *   filled in parallel with background_functions().
+ *
+ * @param ppr                  Input: pointer to precision structure
+ * @param pba                  Input/Output: pointer to background structure, with loga_table filled and tables allocated
+ * @param pvecback_integration Input/Output: integrated quantities, at loga_table[0] in input and today in output
+ * @return the error status
+ */
+
+int background_solve_quadrature(
+                                struct precision *ppr,
+                                struct background *pba,
+                                double * pvecback_integration
+                                ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  /* integrated quantities on each value of loga_table */
+  double * y_table;
+  double * y, * y_prev;
+  /* increments of tau, t and F over each interval */
+  double * delta;
+  /* Gauss-Legendre nodes (in units of the half-interval) and weights */
+  double x_gl[3] = {-sqrt(0.6), 0., sqrt(0.6)};
+  double w_gl[3] = {5./18., 8./18., 5./18.};
+  double loga, dloga, a, H, rho_g, rho_b, rho_M;
+  double sqrtK, F;
+  double w_fld, dw_over_da, integral_fld;
+  /* growth factor and its derivative, Runge-Kutta slopes */
+  double D, D_prime, h, D_k[4], D_prime_k[4], rate_mid[2], rate_end[2], rate_ini[2];
+  int index_loga, index_gl, index_sub, n_sub;
+  int bi_size = pba->bi_size;
+  int abort;
+
+  n_sub = ppr->background_quadrature_substeps;
+  class_test(n_sub < 1,
+             pba->error_message,
+             "background_quadrature_substeps=%d should be at least one",n_sub);
+
+  class_alloc(y_table,pba->bt_size*bi_size*sizeof(double),pba->error_message);
+  class_alloc(delta,3*(pba->bt_size-1)*sizeof(double),pba->error_message);
+
+  /** - integrate 1/H, 1/(aH) and c_s/(aH) over each interval of loga_table */
+  abort = _FALSE_;
+
+#pragma omp parallel for schedule(static) shared(pba,delta,x_gl,w_gl,abort) \
+  private(index_loga,index_gl,dloga,loga,a,H,rho_g,rho_b,rho_M)
+
+  for (index_loga=0; index_loga<pba->bt_size-1; index_loga++) {
+
+#pragma omp flush(abort)
+
+    dloga = pba->loga_table[index_loga+1]-pba->loga_table[index_loga];
+    delta[3*index_loga] = 0.;
+    delta[3*index_loga+1] = 0.;
+    delta[3*index_loga+2] = 0.;
+
+    for (index_gl=0; index_gl<3; index_gl++) {
+
+      loga = pba->loga_table[index_loga] + 0.5*dloga*(1.+x_gl[index_gl]);
+      a = exp(loga);
+
+      class_call_parallel(background_closed_form(pba,a,&H,&rho_g,&rho_b,&rho_M),
+                          pba->error_message,
+                          pba->error_message);
+
+      delta[3*index_loga] += w_gl[index_gl]*dloga/a/H;
+      delta[3*index_loga+1] += w_gl[index_gl]*dloga/H;
+      delta[3*index_loga+2] += w_gl[index_gl]*dloga/a/H/sqrt(3.*(1.+3.*rho_b/4./rho_g));
+    }
+  }
+
+  if (abort == _TRUE_) return _FAILURE_;
+
+  /** - sum them up, and convert the flat-space sound horizon
+        integral to rs in presence of curvature */
+  memcpy(y_table,pvecback_integration,bi_size*sizeof(double));
+
+  sqrtK = sqrt(fabs(pba->K));
+  if (pba->sgnK == 0) { F = pvecback_integration[pba->index_bi_rs]; }
+  else if (pba->sgnK == 1) { F = asin(sqrtK*pvecback_integration[pba->index_bi_rs])/sqrtK; }
+  else { F = asinh(sqrtK*pvecback_integration[pba->index_bi_rs])/sqrtK; }
+
+  for (index_loga=1; index_loga<pba->bt_size; index_loga++) {
+
+    y = y_table + index_loga*bi_size;
+    y_prev = y - bi_size;
+
+    y[pba->index_bi_tau] = y_prev[pba->index_bi_tau] + delta[3*(index_loga-1)];
+    y[pba->index_bi_time] = y_prev[pba->index_bi_time] + delta[3*(index_loga-1)+1];
+    F += delta[3*(index_loga-1)+2];
+
+    if (pba->sgnK == 0) { y[pba->index_bi_rs] = F; }
+    else if (pba->sgnK == 1) { y[pba->index_bi_rs] = sin(sqrtK*F)/sqrtK; }
+    else { y[pba->index_bi_rs] = sinh(sqrtK*F)/sqrtK; }
+  }
+
+  /** - integrate the growth equation \f$ dD/dloga = D'/(aH) \f$,
+        \f$ dD'/dloga = -D' + (3/2) (a/H) \rho_M D \f$ with fixed Runge-Kutta steps.
+        The rates 1/(aH) and (3/2) a \rho_M / H are only needed at
+        the beginning, middle and end of each step */
+  D = pvecback_integration[pba->index_bi_D];
+  D_prime = pvecback_integration[pba->index_bi_D_prime];
+
+  a = exp(pba->loga_table[0]);
+  class_call(background_closed_form(pba,a,&H,&rho_g,&rho_b,&rho_M),
+             pba->error_message,
+             pba->error_message);
+  rate_end[0] = 1./a/H;
+  rate_end[1] = 1.5*a*rho_M/H;
+
+  for (index_loga=1; index_loga<pba->bt_size; index_loga++) {
+
+    h = (pba->loga_table[index_loga]-pba->loga_table[index_loga-1])/n_sub;
+
+    for (index_sub=0; index_sub<n_sub; index_sub++) {
+
+      loga = pba->loga_table[index_loga-1] + index_sub*h;
+
+      rate_ini[0] = rate_end[0];
+      rate_ini[1] = rate_end[1];
+
+      a = exp(loga+0.5*h);
+      class_call(background_closed_form(pba,a,&H,&rho_g,&rho_b,&rho_M),
+                 pba->error_message,
+                 pba->error_message);
+      rate_mid[0] = 1./a/H;
+      rate_mid[1] = 1.5*a*rho_M/H;
+
+      a = exp(loga+h);
+      class_call(background_closed_form(pba,a,&H,&rho_g,&rho_b,&rho_M),
+                 pba->error_message,
+                 pba->error_message);
+      rate_end[0] = 1./a/H;
+      rate_end[1] = 1.5*a*rho_M/H;
+
+      D_k[0] = D_prime*rate_ini[0];
+      D_prime_k[0] = -D_prime + rate_ini[1]*D;
+      D_k[1] = (D_prime+0.5*h*D_prime_k[0])*rate_mid[0];
+      D_prime_k[1] = -(D_prime+0.5*h*D_prime_k[0]) + rate_mid[1]*(D+0.5*h*D_k[0]);
+      D_k[2] = (D_prime+0.5*h*D_prime_k[1])*rate_mid[0];
+      D_prime_k[2] = -(D_prime+0.5*h*D_prime_k[1]) + rate_mid[1]*(D+0.5*h*D_k[1]);
+      D_k[3] = (D_prime+h*D_prime_k[2])*rate_end[0];
+      D_prime_k[3] = -(D_prime+h*D_prime_k[2]) + rate_end[1]*(D+h*D_k[2]);
+
+      D += h/6.*(D_k[0]+2.*D_k[1]+2.*D_k[2]+D_k[3]);
+      D_prime += h/6.*(D_prime_k[0]+2.*D_prime_k[1]+2.*D_prime_k[2]+D_prime_k[3]);
+    }
+
+    y_table[index_loga*bi_size+pba->index_bi_D] = D;
+    y_table[index_loga*bi_size+pba->index_bi_D_prime] = D_prime;
+  }
+
+  /** - fill the rows of the background table, as background_sources() does for the evolver */
+  abort = _FALSE_;
+
+#pragma omp parallel for schedule(static) shared(pba,y_table,bi_size,abort) \
+  private(index_loga,a,w_fld,dw_over_da,integral_fld)
+
+  for (index_loga=0; index_loga<pba->bt_size; index_loga++) {
+
+#pragma omp flush(abort)
+
+    a = exp(pba->loga_table[index_loga]);
+    pba->z_table[index_loga] = MAX(0.,1./a-1.);
+    pba->tau_table[index_loga] = y_table[index_loga*bi_size+pba->index_bi_tau];
+
+    /* a fluid density integrated by the evolver is given here by its closed form */
+    if (pba->has_fld_ode == _TRUE_) {
+      class_call_parallel(background_w_fld(pba,a,&w_fld,&dw_over_da,&integral_fld),
+                          pba->error_message,
+                          pba->error_message);
+      y_table[index_loga*bi_size+pba->index_bi_rho_fld] = pba->Omega0_fld*pba->H0*pba->H0*exp(integral_fld);
+    }
+
+    class_call_parallel(background_functions(pba,
+                                             a,
+                                             y_table+index_loga*bi_size,
+                                             long_info,
+                                             pba->background_table+index_loga*pba->bg_size),
+                        pba->error_message,
+                        pba->error_message);
+  }
+
+  if (abort == _TRUE_) return _FAILURE_;
+
+  /** - return the integrated quantities today */
+  memcpy(pvecback_integration,y_table+(pba->bt_size-1)*bi_size,bi_size*sizeof(double));
+
+  free(y_table);
+  free(delta);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Closed-form Hubble rate and the densities entering the sound speed
+ * and the growth equation, for the models handled by
+ * background_solve_quadrature(). This must agree with the sum of
+ * densities in background_functions().
+ *
+ * @param pba   Input: pointer to background structure
+ * @param a     Input: scale factor (in fact, a/a_0)
+ * @param H     Output: Hubble rate
+ * @param rho_g Output: photon density
+ * @param rho_b Output: baryon density
+ * @param rho_M Output: density of the species clustering in the growth equation (b, cdm, idm_dr)
+ * @return the error status
+ */
+
+int background_closed_form(
+                           struct background *pba,
+                           double a,
+                           double * H,
+                           double * rho_g,
+                           double * rho_b,
+                           double * rho_M
+                           ) {
+
+  double H0_sq, a_3, rho_tot, w_fld, dw_over_da, integral_fld;
+
+  H0_sq = pba->H0*pba->H0;
+  a_3 = a*a*a;
+
+  *rho_g = pba->Omega0_g*H0_sq/a_3/a;
+  *rho_b = pba->Omega0_b*H0_sq/a_3;
+  *rho_M = *rho_b;
+  rho_tot = *rho_g + *rho_b;
+
+  if (pba->has_cdm == _TRUE_) {
+    *rho_M += pba->Omega0_cdm*H0_sq/a_3;
+    rho_tot += pba->Omega0_cdm*H0_sq/a_3;
+  }
+  if (pba->has_idm_dr == _TRUE_) {
+    *rho_M += pba->Omega0_idm_dr*H0_sq/a_3;
+    rho_tot += pba->Omega0_idm_dr*H0_sq/a_3;
+  }
+  if (pba->has_ur == _TRUE_) {
+    rho_tot += pba->Omega0_ur*H0_sq/a_3/a;
+  }
+  if (pba->has_idr == _TRUE_) {
+    rho_tot += pba->Omega0_idr*H0_sq/a_3/a;
+  }
+  if (pba->has_lambda == _TRUE_) {
+    rho_tot += pba->Omega0_lambda*H0_sq;
+  }
+  if (pba->has_fld == _TRUE_) {
+    class_call(background_w_fld(pba,a,&w_fld,&dw_over_da,&integral_fld),
+               pba->error_message,
+               pba->error_message);
+    rho_tot += pba->Omega0_fld*H0_sq*exp(integral_fld);
+  }
+
+  class_test(rho_tot-pba->K/a/a <= 0.,
+             pba->error_message,
+             "rho_crit = %e instead of strictly positive",rho_tot-pba->K/a/a);
+
+  *H = sqrt(rho_tot-pba->K/a/a);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Thin the background table, computed on background_Nloga evenly
+ * spaced values of loga, by keeping only the values needed to
+ * interpolate it accurately. This reduces bt_size, and thus the cost
+ * of all later lookups.
+ *
+ * We start from one value out of ppr->background_table_stride. For
+ * each interval between two kept values, the spline interpolation of
+ * all quantities in loga (and of z in tau, as used by
+ * background_at_tau()) is compared with the dropped values; where the
+ * relative error exceeds ppr->tol_background_table, the middle value
+ * is kept as well. This is repeated until all dropped values are
+ * reproduced within tolerance. The error on each quantity is relative
+ * to its value, or to 1e-3 times its maximum over the table when it
+ * crosses zero.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input/Output: pointer to background structure, with bt_size and all tables except second derivatives replaced by thinned ones
+ * @return the error status
+ */
+
+int background_table_thin(
+                          struct precision *ppr,
+                          struct background *pba
+                          ) {
+
+  /* flags for kept values, and list of their indices */
+  short * keep;
+  int * index_kept;
+  int kept_size;
+  /* sub-tables of kept values and their second derivatives */
+  double * loga_sub;
+  double * tau_sub;
+  double * z_sub;
+  double * table_sub;
+  double * dd_table_sub;
+  double * dd_z_sub;
+  /* maximum of each quantity over the table */
+  double * column_max;
+  int index_loga,index_kept_loga,index_bg,inf,sup,stride,added;
+  double h,a,b,value,exact,error_max;
+
+  stride = MAX(ppr->background_table_stride,1);
+
+  class_calloc(keep,pba->bt_size,sizeof(short),pba->error_message);
+  class_alloc(index_kept,pba->bt_size*sizeof(int),pba->error_message);
+  class_alloc(loga_sub,pba->bt_size*sizeof(double),pba->error_message);
+  class_alloc(tau_sub,pba->bt_size*sizeof(double),pba->error_message);
+  class_alloc(z_sub,pba->bt_size*sizeof(double),pba->error_message);
+  class_alloc(dd_z_sub,pba->bt_size*sizeof(double),pba->error_message);
+  class_alloc(table_sub,pba->bt_size*pba->bg_size*sizeof(double),pba->error_message);
+  class_alloc(dd_table_sub,pba->bt_size*pba->bg_size*sizeof(double),pba->error_message);
+  class_calloc(column_max,pba->bg_size,sizeof(double),pba->error_message);
+
+  for (index_loga=0; index_loga<pba->bt_size; index_loga++) {
+    for (index_bg=0; index_bg<pba->bg_size; index_bg++) {
+      column_max[index_bg] = MAX(column_max[index_bg],fabs(pba->background_table[index_loga*pba->bg_size+index_bg]));
+    }
+  }
+
+  /** - start from evenly spaced values, always including the first and last ones */
+  for (index_loga=0; index_loga<pba->bt_size; index_loga+=stride)
+    keep[index_loga] = _TRUE_;
+  keep[pba->bt_size-1] = _TRUE_;
+
+  do {
+
+    /** - spline interpolation of the kept values */
+    kept_size = 0;
+    for (index_loga=0; index_loga<pba->bt_size; index_loga++) {
+      if (keep[index_loga] == _TRUE_) {
+        index_kept[kept_size] = index_loga;
+        loga_sub[kept_size] = pba->loga_table[index_loga];
+        tau_sub[kept_size] = pba->tau_table[index_loga];
+        z_sub[kept_size] = pba->z_table[index_loga];
+        memcpy(table_sub+kept_size*pba->bg_size,
+               pba->background_table+index_loga*pba->bg_size,
+               pba->bg_size*sizeof(double));
+        kept_size++;
+      }
+    }
+
+    class_test(kept_size < 3,
+               pba->error_message,
+               "background_table_stride=%d too large for background_Nloga=%d",stride,pba->bt_size);
+
+    class_call(array_spline_table_lines(loga_sub,
+                                        kept_size,
+                                        table_sub,
+                                        pba->bg_size,
+                                        dd_table_sub,
+                                        _SPLINE_EST_DERIV_,
+                                        pba->error_message),
+               pba->error_message,
+               pba->error_message);
+
+    class_call(array_spline_table_lines(tau_sub,
+                                        kept_size,
+                                        z_sub,
+                                        1,
+                                        dd_z_sub,
+                                        _SPLINE_EST_DERIV_,
+                                        pba->error_message),
+               pba->error_message,
+               pba->error_message);
+
+    /** - check the dropped values inside each interval, and refine where needed */
+    added = 0;
+    for (index_kept_loga=0; index_kept_loga<kept_size-1; index_kept_loga++) {
+
+      inf = index_kept[index_kept_loga];
+      sup = index_kept[index_kept_loga+1];
+      if (sup-inf < 2)
+        continue;
+
+      error_max = 0.;
+
+      for (index_loga=inf+1; (index_loga<sup) && (error_max <= 1.); index_loga++) {
+
+        h = loga_sub[index_kept_loga+1]-loga_sub[index_kept_loga];
+        b = (pba->loga_table[index_loga]-loga_sub[index_kept_loga])/h;
+        a = 1.-b;
+
+        for (index_bg=0; index_bg<pba->bg_size; index_bg++) {
+          value = array_spline_eval(table_sub+index_bg,
+                                    dd_table_sub+index_bg,
+                                    index_kept_loga*pba->bg_size,
+                                    (index_kept_loga+1)*pba->bg_size,
+                                    h,a,b);
+          exact = pba->background_table[index_loga*pba->bg_size+index_bg];
+          if (value != exact) {
+            error_max = MAX(error_max,fabs(value-exact)/(ppr->tol_background_table*MAX(fabs(exact),1.e-3*column_max[index_bg])));
+          }
+        }
+
+        h = tau_sub[index_kept_loga+1]-tau_sub[index_kept_loga];
+        b = (pba->tau_table[index_loga]-tau_sub[index_kept_loga])/h;
+        a = 1.-b;
+
+        value = array_spline_eval(z_sub,dd_z_sub,index_kept_loga,index_kept_loga+1,h,a,b);
+        exact = pba->z_table[index_loga];
+        error_max = MAX(error_max,fabs(value-exact)/(ppr->tol_background_table*MAX(fabs(exact),1.e-3*pba->z_table[0])));
+      }
+
+      if (error_max > 1.) {
+        keep[(inf+sup)/2] = _TRUE_;
+        added++;
+      }
+    }
+
+  } while (added > 0);
+
+  if (pba->background_verbose > 1) {
+    printf(" -> background table thinned from %d to %d values of loga\n",pba->bt_size,kept_size);
+  }
+
+  /** - replace the tables by the thinned ones */
+  for (index_kept_loga=0; index_kept_loga<kept_size; index_kept_loga++) {
+    index_loga = index_kept[index_kept_loga];
+    pba->loga_table[index_kept_loga] = pba->loga_table[index_loga];
+    pba->tau_table[index_kept_loga] = pba->tau_table[index_loga];
+    pba->z_table[index_kept_loga] = pba->z_table[index_loga];
+  }
+  memcpy(pba->background_table,table_sub,kept_size*pba->bg_size*sizeof(double));
+  pba->bt_size = kept_size;
+
+  free(keep);
+  free(index_kept);
+  free(loga_sub);
+  free(tau_sub);
+  free(z_sub);
+  free(dd_z_sub);
+  free(table_sub);
+  free(dd_table_sub);
+  free(column_max);
+
+  return _SUCCESS_;
+}
+
 /**
  * Assign initial values to background integrated variables.
  *
@@ -2150,7 +3395,8 @@ int background_initial_conditions(
        calling background_w_fld */
 
     /* rho_fld at initial time */
-    pvecback_integration[pba->index_bi_rho_fld] = rho_fld_today * exp(integral_fld);
+    if (pba->has_fld_ode == _TRUE_)
+      pvecback_integration[pba->index_bi_rho_fld] = rho_fld_today * exp(integral_fld);
 
   }
 
@@ -2541,7 +3787,7 @@ int background_derivs(
     dy[pba->index_bi_rho_dr] = -4.*y[pba->index_bi_rho_dr]+pba->Gamma_dcdm/H*y[pba->index_bi_rho_dcdm];
   }
 
-  if (pba->has_fld == _TRUE_) {
+  if (pba->has_fld_ode == _TRUE_) {
     /** - Compute fld density \f$ d\rho/dloga = -3 (1+w_{fld}(a)) \rho \f$ */
     dy[pba->index_bi_rho_fld] = -3.*(1.+pvecback[pba->index_bg_w_fld])*y[pba->index_bi_rho_fld];
   }
@@ -12,6 +12,9 @@
 
 #include "distortions.h"
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 /**
  * Initialize the distortions structure.
  *
@@ -132,6 +135,8 @@ int distortions_free(struct distortions * psd) {
     free(psd->DI);
   }
 
+  class_memory_leaks();
+
   return _SUCCESS_;
 }
 
@@ -572,7 +577,9 @@ int distortions_compute_branching_ratios(struct precision * ppr,
   double f_g, f_y, f_mu;
   double *f_E;
   double bb_vis;
-  int last_index = 0;
+  int last_index;
+  short found;
+  int abort;
 
   /** Allocate space for branching ratios in br_table */
   class_alloc(psd->br_table,
@@ -586,12 +593,13 @@ int distortions_compute_branching_ratios(struct precision * ppr,
 
   /** Calulate branching ratios */
   if(psd->sd_branching_approx != bra_exact){
+#pragma omp parallel for private(index_z,bb_vis,f_g,f_y,f_mu) schedule(static)
     for(index_z=0; index_z<psd->z_size; ++index_z){
       bb_vis = exp(-pow(psd->z[index_z]/psd->z_th,2.5));
 
       /* 1) Calculate branching ratios using sharp_sharp transition */
       if(psd->sd_branching_approx == bra_sharp_sharp){
-        if(psd->z[index_z]>psd->z_th){
+        if(psd->z[index_z]>=psd->z_th){
           f_g = 1.;
           f_y = 0.;
           f_mu = 0.;
@@ -601,7 +609,7 @@ int distortions_compute_branching_ratios(struct precision * ppr,
           f_y = 0.;
           f_mu = 1.;
         }
-        if(psd->z[index_z]<psd->z_muy){
+        if(psd->z[index_z]<=psd->z_muy){
           f_g = 0.;
           f_y = 1.;
           f_mu = 0.;
@@ -615,7 +623,7 @@ int distortions_compute_branching_ratios(struct precision * ppr,
           f_y = 0.;
           f_mu = bb_vis;
         }
-        if(psd->z[index_z]<psd->z_muy){
+        if(psd->z[index_z]<=psd->z_muy){
           f_y = 1.;
           f_mu = 0.;
         }
@@ -644,46 +652,71 @@ int distortions_compute_branching_ratios(struct precision * ppr,
   else{
     /* 5) Calculate branching ratios according to Chluba & Jeong 2014 */
 
-    /* Read and spline data from file branching_ratios.dat */
-    class_call(distortions_read_br_data(ppr,psd),
+    /* Read and spline data from file branching_ratios.dat (or take it from memory) */
+    class_call(distortions_acquire_data(ppr,psd,_SD_DATA_BR_),
                psd->error_message,
                psd->error_message);
-    class_call(distortions_spline_br_data(psd),
+
+    /* The interpolation on the z grid does not depend on cosmology:
+       take it from a previous run with the same detector if possible */
+    class_call(distortions_projection_load(psd,_SD_DATA_BR_,&found),
                psd->error_message,
                psd->error_message);
 
-    /* Allocate local variable */
-    class_alloc(f_E,
-                psd->sd_PCA_size*sizeof(double),
-                psd->error_message);
-
-    /* Interpolate over z */
-    for(index_z=0; index_z<psd->z_size; ++index_z){
-      class_call(distortions_interpolate_br_data(psd,
-                                                 psd->z[index_z],
-                                                 &f_g,
-                                                 &f_y,
-                                                 &f_mu,
-                                                 f_E,
-                                                 &last_index),
-                 psd->error_message,
-                 psd->error_message);
+    if(found == _FALSE_){
+
+      abort = _FALSE_;
+
+#pragma omp parallel private(index_z,index_k,f_g,f_y,f_mu,f_E,last_index)
+      {
+        class_alloc_parallel(f_E,
+                             psd->sd_PCA_size*sizeof(double),
+                             psd->error_message);
+        last_index = 0;
+
+        /* Interpolate over z */
+#pragma omp for schedule(static)
+        for(index_z=0; index_z<psd->z_size; ++index_z){
+
+#pragma omp flush(abort)
+
+          class_call_parallel(distortions_interpolate_br_data(psd,
+                                                              psd->z[index_z],
+                                                              &f_g,
+                                                              &f_y,
+                                                              &f_mu,
+                                                              f_E,
+                                                              &last_index),
+                              psd->error_message,
+                              psd->error_message);
+
+          if(abort == _TRUE_)
+            continue;
+
+          /* Store quantities in the table*/
+          psd->br_table[psd->index_type_g][index_z] = f_g;
+          psd->br_table[psd->index_type_y][index_z] = f_y;
+          psd->br_table[psd->index_type_mu][index_z] = f_mu;
+          for(index_k=0; index_k<psd->sd_PCA_size; ++index_k){
+            psd->br_table[psd->index_type_PCA+index_k][index_z] = f_E[index_k];
+          }
+        }
 
-      /* Store quantities in the table*/
-      psd->br_table[psd->index_type_g][index_z] = f_g;
-      psd->br_table[psd->index_type_y][index_z] = f_y;
-      psd->br_table[psd->index_type_mu][index_z] = f_mu;
-      for(index_k=0; index_k<psd->sd_PCA_size; ++index_k){
-        psd->br_table[psd->index_type_PCA+index_k][index_z] = f_E[index_k];
+        free(f_E);
       }
 
+      if(abort == _TRUE_)
+        return _FAILURE_;
+
+      class_call(distortions_projection_store(psd,_SD_DATA_BR_),
+                 psd->error_message,
+                 psd->error_message);
     }
 
-    /* Free space allocated in distortions_read_br_data */
-    class_call(distortions_free_br_data(psd),
+    /* Release space allocated in distortions_acquire_data */
+    class_call(distortions_release_data(psd,_SD_DATA_BR_),
                psd->error_message,
                psd->error_message);
-    free(f_E);
 
   }
 
@@ -719,6 +752,7 @@ int distortions_compute_heating_rate(struct precision* ppr,
   double *pvecback;
   double heat;
   double H, a, rho_g;
+  int abort;
 
   if (psd->include_only_exotic == _FALSE_) {
     /** Update heating table with second order contributions */
@@ -727,37 +761,62 @@ int distortions_compute_heating_rate(struct precision* ppr,
                psd->error_message);
   }
 
-  /** Allocate space for background vector */
-  last_index_back = 0;
-  class_alloc(pvecback,
-              pba->bg_size*sizeof(double),
-              psd->error_message);
-
   /** Allocate space for total heating function */
   class_alloc(psd->dQrho_dz_tot,
               psd->z_size*sizeof(double*),
               psd->error_message);
 
-  /* Loop over z and calculate the heating at each point */
-  for(index_z=0; index_z<psd->z_size; ++index_z){
+  /** Import the conversion factor a/(H rho_g) from the background
+      structure at each z (in parallel, the background interpolation
+      being thread-safe with one pvecback per thread) */
+  abort = _FALSE_;
 
-    /** Import quantities from background structure */
-    class_call(background_tau_of_z(pba,
-                                   psd->z[index_z],
-                                   &tau),
-               pba->error_message,
-               psd->error_message);
-    class_call(background_at_tau(pba,
-                                 tau,
-                                 long_info,
-                                 inter_closeby,
-                                 &last_index_back,
-                                 pvecback),
-               pba->error_message,
-               psd->error_message);
-    H = pvecback[pba->index_bg_H]*_c_/_Mpc_over_m_;               // [1/s]
-    a = pvecback[pba->index_bg_a];                                // [-]
-    rho_g = pvecback[pba->index_bg_rho_g]*_Jm3_over_Mpc2_;        // [J/m^3]
+#pragma omp parallel private(index_z,tau,last_index_back,pvecback,H,a,rho_g)
+  {
+    class_alloc_parallel(pvecback,
+                         pba->bg_size*sizeof(double),
+                         psd->error_message);
+    last_index_back = 0;
+
+#pragma omp for schedule(static)
+    for(index_z=0; index_z<psd->z_size; ++index_z){
+
+#pragma omp flush(abort)
+
+      class_call_parallel(background_tau_of_z(pba,
+                                              psd->z[index_z],
+                                              &tau),
+                          pba->error_message,
+                          psd->error_message);
+      class_call_parallel(background_at_tau(pba,
+                                            tau,
+                                            long_info,
+                                            inter_closeby,
+                                            &last_index_back,
+                                            pvecback),
+                          pba->error_message,
+                          psd->error_message);
+
+      if(abort == _TRUE_)
+        continue;
+
+      H = pvecback[pba->index_bg_H]*_c_/_Mpc_over_m_;               // [1/s]
+      a = pvecback[pba->index_bg_a];                                // [-]
+      rho_g = pvecback[pba->index_bg_rho_g]*_Jm3_over_Mpc2_;        // [J/m^3]
+
+      psd->dQrho_dz_tot[index_z] = a/(H*rho_g);                     // [s m^3/J]
+    }
+
+    free(pvecback);
+  }
+
+  if(abort == _TRUE_)
+    return _FAILURE_;
+
+  /* Loop over z and calculate the heating at each point (serially, since
+     the non-injection and injection structures keep the last position
+     of their interpolation) */
+  for(index_z=0; index_z<psd->z_size; ++index_z){
 
     heat = 0;
 
@@ -780,11 +839,9 @@ int distortions_compute_heating_rate(struct precision* ppr,
     }
 
     /** Calculate total heating rate */
-    psd->dQrho_dz_tot[index_z] = heat*a/(H*rho_g);                // [-]
+    psd->dQrho_dz_tot[index_z] *= heat;                             // [-]
   }
 
-  free(pvecback);
-
   if (psd->include_only_exotic == _FALSE_) {
     /** Update heating table with second order contributions */
     class_call(noninjection_free(pni),
@@ -815,8 +872,10 @@ int distortions_compute_spectral_shapes(struct precision * ppr,
 
   /** Define local variables */
   double * S;
-  int last_index = 0;
+  int last_index;
   int index_type, index_x, index_k;
+  short found;
+  int abort;
   double sum_S, sum_G;
   double g;
   double y_reio, DI_reio;
@@ -864,6 +923,7 @@ int distortions_compute_spectral_shapes(struct precision * ppr,
   /** Calculate spectral shapes */
   if(psd->sd_branching_approx != bra_exact || psd->sd_PCA_size == 0){
     /* If no PCA analysis is required, the shapes have simple analistical form */
+#pragma omp parallel for private(index_x) schedule(static)
     for(index_x=0; index_x<psd->x_size; ++index_x){
       psd->sd_shape_table[psd->index_type_g][index_x] = pow(psd->x[index_x],4.)*exp(-psd->x[index_x])/
                                                            pow(1.-exp(-psd->x[index_x]),2.);        // [-]
@@ -878,41 +938,67 @@ int distortions_compute_spectral_shapes(struct precision * ppr,
     /* If PCA analysis is required, the shapes has to be vectorized. This is done in the external
        file spectral_shapes.dat using generate_PCA_files.py */
 
-    /* Read and spline data from file spectral_shapes.dat */
-    class_call(distortions_read_sd_data(ppr,psd),
+    /* Read and spline data from file spectral_shapes.dat (or take it from memory) */
+    class_call(distortions_acquire_data(ppr,psd,_SD_DATA_SD_),
                psd->error_message,
                psd->error_message);
-    class_call(distortions_spline_sd_data(psd),
+
+    /* The interpolation on the detector frequencies does not depend on
+       the heating history: take it from a previous run if possible */
+    class_call(distortions_projection_load(psd,_SD_DATA_SD_,&found),
                psd->error_message,
                psd->error_message);
 
-    /* Allocate local variable */
-    class_alloc(S,
-                psd->sd_PCA_size*sizeof(double),
-                psd->error_message);
+    if(found == _FALSE_){
 
-    /* Interpolate over z */
-    for(index_x=0; index_x<psd->x_size; ++index_x){
-      class_call(distortions_interpolate_sd_data(psd,
-                                                 psd->x[index_x]*psd->x_to_nu,
-                                                 &psd->sd_shape_table[psd->index_type_g][index_x],
-                                                 &psd->sd_shape_table[psd->index_type_y][index_x],
-                                                 &psd->sd_shape_table[psd->index_type_mu][index_x],
-                                                 S,
-                                                 &last_index),
-                 psd->error_message,
-                 psd->error_message);
+      abort = _FALSE_;
 
-    for(index_k=0; index_k<psd->sd_PCA_size; ++index_k){
-        psd->sd_shape_table[psd->index_type_PCA+index_k][index_x] = S[index_k];
+#pragma omp parallel private(index_x,index_k,S,last_index)
+      {
+        class_alloc_parallel(S,
+                             psd->sd_PCA_size*sizeof(double),
+                             psd->error_message);
+        last_index = 0;
+
+        /* Interpolate over x */
+#pragma omp for schedule(static)
+        for(index_x=0; index_x<psd->x_size; ++index_x){
+
+#pragma omp flush(abort)
+
+          class_call_parallel(distortions_interpolate_sd_data(psd,
+                                                              psd->x[index_x]*psd->x_to_nu,
+                                                              &psd->sd_shape_table[psd->index_type_g][index_x],
+                                                              &psd->sd_shape_table[psd->index_type_y][index_x],
+                                                              &psd->sd_shape_table[psd->index_type_mu][index_x],
+                                                              S,
+                                                              &last_index),
+                              psd->error_message,
+                              psd->error_message);
+
+          if(abort == _TRUE_)
+            continue;
+
+          for(index_k=0; index_k<psd->sd_PCA_size; ++index_k){
+            psd->sd_shape_table[psd->index_type_PCA+index_k][index_x] = S[index_k];
+          }
+        }
+
+        free(S);
       }
+
+      if(abort == _TRUE_)
+        return _FAILURE_;
+
+      class_call(distortions_projection_store(psd,_SD_DATA_SD_),
+                 psd->error_message,
+                 psd->error_message);
     }
 
-    /* Free allocated space */
-    class_call(distortions_free_sd_data(psd),
+    /* Release allocated space */
+    class_call(distortions_release_data(psd,_SD_DATA_SD_),
                psd->error_message,
                psd->error_message);
-    free(S);
   }
 
   /** Compute distortion amplitude for residual parameter epsilon */
@@ -954,6 +1040,7 @@ int distortions_compute_spectral_shapes(struct precision * ppr,
   }
 
   /** Calculate spectral distortions according to Chluba & Jeong 2014 (arxiv:1306.5751, Eq. (11)) */
+#pragma omp parallel for private(index_x,index_type,g) schedule(static)
   for(index_x=0;index_x<psd->x_size;++index_x){
     psd->DI[index_x] = 0.;
 
@@ -1795,6 +1882,690 @@ int distortions_free_sd_data(struct distortions * psd){
   return _SUCCESS_;
 }
 
+/**
+ * Branching ratios (kind _SD_DATA_BR_) and spectral shapes (kind
+ * _SD_DATA_SD_) of the last detector used, already splined, shared by
+ * all distortions structures. Each kind is stored as one block of
+ * _SD_DATA_ARRAYS_ arrays in the order of distortions_data_arrays(),
+ * either allocated or mapped from the binary file written next to the
+ * text file. The block is identified by the name, size and modification
+ * time of the text file (which distortions_generate_detector() may
+ * rewrite), and for the spectral shapes by DI_units, which divides the
+ * values read. distortions_data_users counts the structures currently
+ * pointing to it: it stays in memory when this drops to zero, for later
+ * runs, until distortions_data_clear() is called.
+ */
+
+static short distortions_data_used[_SD_DATA_KINDS_] = {_FALSE_,_FALSE_};
+static double * distortions_data_block[_SD_DATA_KINDS_] = {NULL,NULL};
+static void * distortions_data_map[_SD_DATA_KINDS_] = {NULL,NULL};
+static size_t distortions_data_map_size[_SD_DATA_KINDS_];
+static DetectorFileName distortions_data_file[_SD_DATA_KINDS_];
+static long long distortions_data_bytes[_SD_DATA_KINDS_];
+static long long distortions_data_mtime[_SD_DATA_KINDS_];
+static double distortions_data_DI_units[_SD_DATA_KINDS_];
+static int distortions_data_size[_SD_DATA_KINDS_];
+static int distortions_data_vec_size[_SD_DATA_KINDS_];
+static int distortions_data_users[_SD_DATA_KINDS_] = {0,0};
+
+/**
+ * Projection of the shared data of each kind on the grid of the last
+ * run that used it: the branching ratios interpolated on the z grid
+ * (kind _SD_DATA_BR_) and the spectral shapes interpolated on the
+ * detector frequencies (kind _SD_DATA_SD_), which do not depend on the
+ * heating history. It is stored as
+ * distortions_projection_table[kind][index_type*grid_size+index], and
+ * identified by the grid itself, the number of types and (for the
+ * spectral shapes) x_to_nu. It is freed together with the shared block.
+ */
+
+static double * distortions_projection_grid[_SD_DATA_KINDS_] = {NULL,NULL};
+static double * distortions_projection_table[_SD_DATA_KINDS_] = {NULL,NULL};
+static int distortions_projection_size[_SD_DATA_KINDS_];
+static int distortions_projection_type_size[_SD_DATA_KINDS_];
+static double distortions_projection_x_to_nu[_SD_DATA_KINDS_];
+
+/** identifies the binary form of the data written by distortions_data_write() */
+#define _SD_DATA_MAGIC_ "CLASS_SD_DATA_1"
+
+/**
+ * Header of the binary form of the data, followed by the block of
+ * (7+2*vec_size)*size doubles
+ */
+
+struct distortions_data_header {
+  char magic[24];
+  int sizeof_double;
+  int kind;
+  int size;
+  int vec_size;
+  long long source_bytes;
+  long long source_mtime;
+  double DI_units;
+};
+
+/**
+ * Give the addresses of the fields of the distortions structure holding
+ * the data of one kind, in the order in which they are stored in the
+ * shared block: grid, the three scalar columns, the PCA vectors, and
+ * the second derivatives of the last four.
+ *
+ * @param psd      Input: pointer to the distortions structure
+ * @param kind     Input: _SD_DATA_BR_ or _SD_DATA_SD_
+ * @param arrays   Output: addresses of the _SD_DATA_ARRAYS_ pointers
+ * @param size     Output: address of the number of grid points
+ * @param vec_size Output: address of the number of PCA vectors
+ * @param shared   Output: address of the flag telling whether the data is shared
+ * @return the error status
+ */
+
+int distortions_data_arrays(struct distortions * psd,
+                            int kind,
+                            double ** arrays[_SD_DATA_ARRAYS_],
+                            int ** size,
+                            int ** vec_size,
+                            short ** shared){
+
+  if(kind == _SD_DATA_BR_){
+    arrays[0] = &(psd->br_exact_z);
+    arrays[1] = &(psd->f_g_exact);
+    arrays[2] = &(psd->f_y_exact);
+    arrays[3] = &(psd->f_mu_exact);
+    arrays[4] = &(psd->E_vec);
+    arrays[5] = &(psd->ddf_g_exact);
+    arrays[6] = &(psd->ddf_y_exact);
+    arrays[7] = &(psd->ddf_mu_exact);
+    arrays[8] = &(psd->ddE_vec);
+    *size = &(psd->br_exact_Nz);
+    *vec_size = &(psd->E_vec_size);
+    *shared = &(psd->has_shared_br_data);
+  }
+  else{
+    arrays[0] = &(psd->PCA_nu);
+    arrays[1] = &(psd->PCA_G_T);
+    arrays[2] = &(psd->PCA_Y_SZ);
+    arrays[3] = &(psd->PCA_M_mu);
+    arrays[4] = &(psd->S_vec);
+    arrays[5] = &(psd->ddPCA_G_T);
+    arrays[6] = &(psd->ddPCA_Y_SZ);
+    arrays[7] = &(psd->ddPCA_M_mu);
+    arrays[8] = &(psd->ddS_vec);
+    *size = &(psd->PCA_Nnu);
+    *vec_size = &(psd->S_vec_size);
+    *shared = &(psd->has_shared_sd_data);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Point the fields of the distortions structure to a block of data
+ *
+ * @param psd      Input/Output: pointer to the distortions structure
+ * @param kind     Input: _SD_DATA_BR_ or _SD_DATA_SD_
+ * @param block    Input: block of data
+ * @param size     Input: number of grid points
+ * @param vec_size Input: number of PCA vectors
+ * @return the error status
+ */
+
+int distortions_data_point(struct distortions * psd,
+                           int kind,
+                           double * block,
+                           int size,
+                           int vec_size){
+
+  double ** arrays[_SD_DATA_ARRAYS_];
+  int * psize;
+  int * pvec_size;
+  short * shared;
+  int index_array;
+
+  distortions_data_arrays(psd,kind,arrays,&psize,&pvec_size,&shared);
+
+  for(index_array=0; index_array<_SD_DATA_ARRAYS_; index_array++){
+    *(arrays[index_array]) = block;
+    block += ((index_array == 4 || index_array == 8) ? vec_size*size : size);
+  }
+  *psize = size;
+  *pvec_size = vec_size;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write the shared block of one kind in binary form, so that later runs
+ * can map it into memory instead of reading and splining the text file.
+ *
+ * @param filename Input: name of the binary file
+ * @param kind     Input: _SD_DATA_BR_ or _SD_DATA_SD_
+ * @return _SUCCESS_ if the file could be written, _FAILURE_ otherwise
+ */
+
+int distortions_data_write(char * filename,
+                           int kind){
+
+  FILE * fB;
+  struct distortions_data_header header;
+  size_t doubles = (7+2*distortions_data_vec_size[kind])*distortions_data_size[kind];
+  size_t written;
+
+  fB = fopen(filename,"wb");
+  if(fB == NULL)
+    return _FAILURE_;
+
+  memset(&header,0,sizeof(header));
+  strcpy(header.magic,_SD_DATA_MAGIC_);
+  header.sizeof_double = sizeof(double);
+  header.kind = kind;
+  header.size = distortions_data_size[kind];
+  header.vec_size = distortions_data_vec_size[kind];
+  header.source_bytes = distortions_data_bytes[kind];
+  header.source_mtime = distortions_data_mtime[kind];
+  header.DI_units = distortions_data_DI_units[kind];
+
+  fwrite(&header,sizeof(header),1,fB);
+  written = fwrite(distortions_data_block[kind],sizeof(double),doubles,fB);
+  fclose(fB);
+
+  if(written != doubles){
+    remove(filename);
+    return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Map the binary form of the data of one kind into memory, if it was
+ * written from the same text file and, for the spectral shapes, with
+ * the same DI_units. The shared block then points into the read-only
+ * mapping.
+ *
+ * @param filename Input: name of the binary file
+ * @param kind     Input: _SD_DATA_BR_ or _SD_DATA_SD_
+ * @param found    Output: _FALSE_ if the file does not exist or does not match (nothing is mapped then)
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+int distortions_data_map_file(char * filename,
+                              int kind,
+                              short * found,
+                              ErrorMsg errmsg){
+
+  FILE * fB;
+  struct stat st;
+  struct distortions_data_header header;
+  size_t size;
+  void * map;
+
+  *found = _FALSE_;
+
+  /* (open() cannot be used here, since background.h defines 'open' as a spatial curvature) */
+  fB = fopen(filename,"rb");
+  if(fB == NULL)
+    return _SUCCESS_;
+
+  if((fread(&header,sizeof(header),1,fB) != 1) ||
+     (strncmp(header.magic,_SD_DATA_MAGIC_,sizeof(header.magic)) != 0) ||
+     (header.sizeof_double != sizeof(double)) ||
+     (header.kind != kind) ||
+     (header.source_bytes != distortions_data_bytes[kind]) ||
+     (header.source_mtime != distortions_data_mtime[kind]) ||
+     (header.DI_units != distortions_data_DI_units[kind]) ||
+     (header.size <= 0) ||
+     (header.vec_size < 0)){
+    fclose(fB);
+    return _SUCCESS_;
+  }
+
+  size = sizeof(header)+(7+2*header.vec_size)*(size_t)header.size*sizeof(double);
+  if((fstat(fileno(fB),&st) != 0) || ((size_t)st.st_size != size)){
+    fclose(fB);
+    return _SUCCESS_;
+  }
+
+  map = mmap(NULL,size,PROT_READ,MAP_SHARED,fileno(fB),0);
+  fclose(fB);
+  class_test(map == MAP_FAILED,
+             errmsg,
+             "could not map file %s into memory",filename);
+
+  distortions_data_map[kind] = map;
+  distortions_data_map_size[kind] = size;
+  distortions_data_block[kind] = (double *)((char *)map+sizeof(header));
+  distortions_data_size[kind] = header.size;
+  distortions_data_vec_size[kind] = header.vec_size;
+  *found = _TRUE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Fill the shared block of one kind: from the binary file if
+ * ppr->sd_binary_tables is true and the file matches, otherwise by
+ * reading and splining the text file (and then writing the binary file
+ * if ppr->sd_binary_tables is true). The identification of the text
+ * file must already be stored in the distortions_data_* arrays.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param psd      Input: pointer to the distortions structure (used for reading the text file)
+ * @param kind     Input: _SD_DATA_BR_ or _SD_DATA_SD_
+ * @param bin_file Input: name of the binary file
+ * @return the error status
+ */
+
+int distortions_data_load(struct precision * ppr,
+                          struct distortions * psd,
+                          int kind,
+                          char * bin_file){
+
+  double ** arrays[_SD_DATA_ARRAYS_];
+  int * size;
+  int * vec_size;
+  short * shared;
+  int index_array;
+  int length;
+  double * block;
+  short found = _FALSE_;
+
+  if(ppr->sd_binary_tables == _TRUE_){
+    class_call(distortions_data_map_file(bin_file,kind,&found,psd->error_message),
+               psd->error_message,
+               psd->error_message);
+    if(found == _TRUE_)
+      return _SUCCESS_;
+  }
+
+  /** Read and spline the text file in the fields of psd, then move them to one block */
+  if(kind == _SD_DATA_BR_){
+    class_call(distortions_read_br_data(ppr,psd),
+               psd->error_message,
+               psd->error_message);
+    class_call(distortions_spline_br_data(psd),
+               psd->error_message,
+               psd->error_message);
+  }
+  else{
+    class_call(distortions_read_sd_data(ppr,psd),
+               psd->error_message,
+               psd->error_message);
+    class_call(distortions_spline_sd_data(psd),
+               psd->error_message,
+               psd->error_message);
+  }
+
+  distortions_data_arrays(psd,kind,arrays,&size,&vec_size,&shared);
+
+  class_alloc(distortions_data_block[kind],
+              (7+2*(*vec_size))*(*size)*sizeof(double),
+              psd->error_message);
+  block = distortions_data_block[kind];
+  for(index_array=0; index_array<_SD_DATA_ARRAYS_; index_array++){
+    length = ((index_array == 4 || index_array == 8) ? (*vec_size)*(*size) : (*size));
+    memcpy(block,*(arrays[index_array]),length*sizeof(double));
+    block += length;
+  }
+  distortions_data_size[kind] = *size;
+  distortions_data_vec_size[kind] = *vec_size;
+
+  *shared = _FALSE_;
+  if(kind == _SD_DATA_BR_){
+    class_call(distortions_free_br_data(psd),
+               psd->error_message,
+               psd->error_message);
+  }
+  else{
+    class_call(distortions_free_sd_data(psd),
+               psd->error_message,
+               psd->error_message);
+  }
+
+  if(ppr->sd_binary_tables == _TRUE_){
+    /* failing to write the binary file only means that the text file will be read again next time */
+    distortions_data_write(bin_file,kind);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the shared block of one kind (without checking its users)
+ *
+ * @param kind     Input: _SD_DATA_BR_ or _SD_DATA_SD_
+ * @return the error status
+ */
+
+int distortions_data_free(int kind){
+
+  if(distortions_data_map[kind] != NULL){
+    munmap(distortions_data_map[kind],distortions_data_map_size[kind]);
+  }
+  else{
+    free(distortions_data_block[kind]);
+  }
+  distortions_data_map[kind] = NULL;
+  distortions_data_block[kind] = NULL;
+  distortions_data_used[kind] = _FALSE_;
+
+  /* the projection was computed from this block */
+  free(distortions_projection_grid[kind]);
+  free(distortions_projection_table[kind]);
+  distortions_projection_grid[kind] = NULL;
+  distortions_projection_table[kind] = NULL;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Point the distortions structure to the splined branching ratios
+ * (kind _SD_DATA_BR_) or spectral shapes (kind _SD_DATA_SD_) of the
+ * detector, replacing distortions_read_*_data() followed by
+ * distortions_spline_*_data(). The data is shared between runs and
+ * structures. If the shared data belongs to another detector and is
+ * still in use, private data is read instead.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param psd      Input/Output: pointer to the distortions structure
+ * @param kind     Input: _SD_DATA_BR_ or _SD_DATA_SD_
+ * @return the error status
+ */
+
+int distortions_acquire_data(struct precision * ppr,
+                             struct distortions * psd,
+                             int kind){
+
+  DetectorFileName file;
+  DetectorFileName bin_file;
+  struct stat st;
+  double ** arrays[_SD_DATA_ARRAYS_];
+  int * size;
+  int * vec_size;
+  short * shared;
+  long long bytes, mtime;
+  double DI_units;
+  short match;
+  int status = _SUCCESS_;
+
+  distortions_data_arrays(psd,kind,arrays,&size,&vec_size,&shared);
+  *shared = _FALSE_;
+
+  sprintf(file,"%s/%s_%s.dat",ppr->sd_external_path,psd->sd_detector_name,(kind == _SD_DATA_BR_ ? "branching_ratios" : "distortions_shapes"));
+  sprintf(bin_file,"%s/%s_%s.bin",ppr->sd_external_path,psd->sd_detector_name,(kind == _SD_DATA_BR_ ? "branching_ratios" : "distortions_shapes"));
+
+  /* without the text file, read it anyway to get the usual error message */
+  if(stat(file,&st) == 0){
+
+    bytes = st.st_size;
+    mtime = st.st_mtime;
+    DI_units = (kind == _SD_DATA_SD_ ? psd->DI_units : 0.);
+
+#pragma omp critical (distortions_data)
+    {
+      match = ((distortions_data_used[kind] == _TRUE_) &&
+               (strcmp(distortions_data_file[kind],file) == 0) &&
+               (distortions_data_bytes[kind] == bytes) &&
+               (distortions_data_mtime[kind] == mtime) &&
+               (distortions_data_DI_units[kind] == DI_units));
+
+      if((match == _FALSE_) && (distortions_data_used[kind] == _TRUE_) && (distortions_data_users[kind] == 0)){
+        distortions_data_free(kind);
+      }
+
+      if(distortions_data_used[kind] == _FALSE_){
+        strcpy(distortions_data_file[kind],file);
+        distortions_data_bytes[kind] = bytes;
+        distortions_data_mtime[kind] = mtime;
+        distortions_data_DI_units[kind] = DI_units;
+        status = distortions_data_load(ppr,psd,kind,bin_file);
+        if(status == _SUCCESS_){
+          distortions_data_used[kind] = _TRUE_;
+          match = _TRUE_;
+        }
+      }
+
+      if((status == _SUCCESS_) && (match == _TRUE_)){
+        distortions_data_point(psd,kind,distortions_data_block[kind],distortions_data_size[kind],distortions_data_vec_size[kind]);
+        distortions_data_users[kind]++;
+        *shared = _TRUE_;
+      }
+    }
+
+    if(status == _FAILURE_)
+      return _FAILURE_;
+
+    if(*shared == _TRUE_)
+      return _SUCCESS_;
+  }
+
+  /** Otherwise read private data, as distortions_free_*_data() will free it */
+  if(kind == _SD_DATA_BR_){
+    class_call(distortions_read_br_data(ppr,psd),
+               psd->error_message,
+               psd->error_message);
+    class_call(distortions_spline_br_data(psd),
+               psd->error_message,
+               psd->error_message);
+  }
+  else{
+    class_call(distortions_read_sd_data(ppr,psd),
+               psd->error_message,
+               psd->error_message);
+    class_call(distortions_spline_sd_data(psd),
+               psd->error_message,
+               psd->error_message);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Release the data obtained from distortions_acquire_data(): private
+ * data is freed, shared data stays in memory for later runs.
+ *
+ * @param psd      Input/Output: pointer to the distortions structure
+ * @param kind     Input: _SD_DATA_BR_ or _SD_DATA_SD_
+ * @return the error status
+ */
+
+int distortions_release_data(struct distortions * psd,
+                             int kind){
+
+  double ** arrays[_SD_DATA_ARRAYS_];
+  int * size;
+  int * vec_size;
+  short * shared;
+  int index_array;
+
+  distortions_data_arrays(psd,kind,arrays,&size,&vec_size,&shared);
+
+  if(*shared == _TRUE_){
+#pragma omp critical (distortions_data)
+    {
+      distortions_data_users[kind]--;
+    }
+    for(index_array=0; index_array<_SD_DATA_ARRAYS_; index_array++){
+      *(arrays[index_array]) = NULL;
+    }
+    *shared = _FALSE_;
+  }
+  else if(kind == _SD_DATA_BR_){
+    class_call(distortions_free_br_data(psd),
+               psd->error_message,
+               psd->error_message);
+  }
+  else{
+    class_call(distortions_free_sd_data(psd),
+               psd->error_message,
+               psd->error_message);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Fill br_table (kind _SD_DATA_BR_) or sd_shape_table (kind
+ * _SD_DATA_SD_) with the projection stored by a previous run, if it was
+ * computed from the same shared data on the same grid. Only possible
+ * while the structure uses the shared data (between
+ * distortions_acquire_data() and distortions_release_data()).
+ *
+ * @param psd      Input/Output: pointer to the distortions structure
+ * @param kind     Input: _SD_DATA_BR_ or _SD_DATA_SD_
+ * @param found    Output: _TRUE_ if the table has been filled
+ * @return the error status
+ */
+
+int distortions_projection_load(struct distortions * psd,
+                                int kind,
+                                short * found){
+
+  double ** arrays[_SD_DATA_ARRAYS_];
+  int * size;
+  int * vec_size;
+  short * shared;
+  double * grid;
+  int grid_size;
+  double x_to_nu;
+  double ** table;
+  int index_type;
+
+  distortions_data_arrays(psd,kind,arrays,&size,&vec_size,&shared);
+
+  *found = _FALSE_;
+
+  if(*shared == _FALSE_)
+    return _SUCCESS_;
+
+  if(kind == _SD_DATA_BR_){
+    grid = psd->z;
+    grid_size = psd->z_size;
+    x_to_nu = 0.;
+    table = psd->br_table;
+  }
+  else{
+    grid = psd->x;
+    grid_size = psd->x_size;
+    x_to_nu = psd->x_to_nu;
+    table = psd->sd_shape_table;
+  }
+
+#pragma omp critical (distortions_data)
+  {
+    if((distortions_projection_table[kind] != NULL) &&
+       (distortions_projection_size[kind] == grid_size) &&
+       (distortions_projection_type_size[kind] == psd->type_size) &&
+       (distortions_projection_x_to_nu[kind] == x_to_nu) &&
+       (memcmp(distortions_projection_grid[kind],grid,grid_size*sizeof(double)) == 0)){
+      for(index_type=0; index_type<psd->type_size; index_type++){
+        memcpy(table[index_type],
+               distortions_projection_table[kind]+index_type*grid_size,
+               grid_size*sizeof(double));
+      }
+      *found = _TRUE_;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Store br_table (kind _SD_DATA_BR_) or sd_shape_table (kind
+ * _SD_DATA_SD_) as the projection of the shared data, for
+ * distortions_projection_load() in later runs. Nothing is stored if the
+ * structure uses private data.
+ *
+ * @param psd      Input: pointer to the distortions structure
+ * @param kind     Input: _SD_DATA_BR_ or _SD_DATA_SD_
+ * @return the error status
+ */
+
+int distortions_projection_store(struct distortions * psd,
+                                 int kind){
+
+  double ** arrays[_SD_DATA_ARRAYS_];
+  int * size;
+  int * vec_size;
+  short * shared;
+  double * grid;
+  int grid_size;
+  double x_to_nu;
+  double ** table;
+  double * new_grid;
+  double * new_table;
+  int index_type;
+
+  distortions_data_arrays(psd,kind,arrays,&size,&vec_size,&shared);
+
+  if(*shared == _FALSE_)
+    return _SUCCESS_;
+
+  if(kind == _SD_DATA_BR_){
+    grid = psd->z;
+    grid_size = psd->z_size;
+    x_to_nu = 0.;
+    table = psd->br_table;
+  }
+  else{
+    grid = psd->x;
+    grid_size = psd->x_size;
+    x_to_nu = psd->x_to_nu;
+    table = psd->sd_shape_table;
+  }
+
+  class_alloc(new_grid,
+              grid_size*sizeof(double),
+              psd->error_message);
+  class_alloc(new_table,
+              psd->type_size*grid_size*sizeof(double),
+              psd->error_message);
+
+  memcpy(new_grid,grid,grid_size*sizeof(double));
+  for(index_type=0; index_type<psd->type_size; index_type++){
+    memcpy(new_table+index_type*grid_size,
+           table[index_type],
+           grid_size*sizeof(double));
+  }
+
+#pragma omp critical (distortions_data)
+  {
+    /* the shared data cannot have been replaced while this structure uses it */
+    free(distortions_projection_grid[kind]);
+    free(distortions_projection_table[kind]);
+    distortions_projection_grid[kind] = new_grid;
+    distortions_projection_table[kind] = new_table;
+    distortions_projection_size[kind] = grid_size;
+    distortions_projection_type_size[kind] = psd->type_size;
+    distortions_projection_x_to_nu[kind] = x_to_nu;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the shared branching ratios and spectral shapes, unless some
+ * distortions structure still uses them (they are then kept, and freed
+ * by a later call).
+ *
+ * @return the error status
+ */
+
+int distortions_data_clear(){
+
+  int kind;
+
+#pragma omp critical (distortions_data)
+  {
+    for(kind=0; kind<_SD_DATA_KINDS_; kind++){
+      if((distortions_data_used[kind] == _TRUE_) && (distortions_data_users[kind] == 0))
+        distortions_data_free(kind);
+    }
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * Define title of columns in the heat output
  *
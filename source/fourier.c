@@ -81,6 +81,12 @@ int fourier_pk_at_z(
   int last_index;
   short do_ic = _FALSE_;
 
+  /** - compute the spectra on first access, in case of lazy evaluation */
+
+  class_call(fourier_lazy_compute(pfo),
+             pfo->error_message,
+             pfo->error_message);
+
   /** - check whether we need the decomposition into contributions from each initial condition */
 
   if ((pk_output == pk_linear) && (pfo->ic_size > 1) && (out_pk_ic != NULL))
@@ -402,6 +408,12 @@ int fourier_pk_at_k_and_z(
   double * pk_primordial_kmin;
   short do_ic = _FALSE_;
 
+  /** - compute the spectra on first access, in case of lazy evaluation */
+
+  class_call(fourier_lazy_compute(pfo),
+             pfo->error_message,
+             pfo->error_message);
+
   /** - preliminary: check whether we need the decomposition into contributions from each initial condition */
 
   if ((pk_output == pk_linear) && (pfo->ic_size > 1) && (out_pk_ic != NULL))
@@ -733,15 +745,18 @@ int fourier_pks_at_k_and_z(
  * input k_i falls outside the pre-computed range [kmin,kmax]: in that
  * case, it just returns P(k,z)=0 for such a k_i
  *
+ * For large grids, the redshifts are distributed among OpenMP threads;
+ * the results do not depend on the number of threads.
+ *
  * @param pba            Input: pointer to background structure
  * @param pfo            Input: pointer to fourier structure
  * @param pk_output      Input: pk_linear or pk_nonlinear
- * @param kvec           Input: array of wavenumbers in ascending order (in 1/Mpc)
+ * @param kvec           Input: array of wavenumbers (in 1/Mpc); any order is accepted, ascending order is fastest
  * @param kvec_size      Input: size of array of wavenumbers
  * @param zvec           Input: array of redshifts in arbitrary order
  * @param zvec_size      Input: size of array of redshifts
- * @param out_pk         Output: P(k_i,z_j) for total matter (if available) in Mpc**3
- * @param out_pk_cb      Output: P_cb(k_i,z_j) for cdm+baryons (if available) in Mpc**3
+ * @param out_pk         Output: P(k_i,z_j) for total matter (if available) in Mpc**3, or NULL to skip it
+ * @param out_pk_cb      Output: P_cb(k_i,z_j) for cdm+baryons (if available) in Mpc**3, or NULL to skip it
  * @return the error status
  */
 
@@ -755,75 +770,109 @@ int fourier_pks_at_kvec_and_zvec(
                                    int zvec_size,
                                    double * out_pk,   // output_pk[index_zvec*kvec_size+index_kvec],
                                                       // already allocated
-                                                      //(or NULL if user knows there is no _m output)
+                                                      //(or NULL to skip the _m output)
                                    double * out_pk_cb // output_pk[index_zvec*kvec_size+index_kvec],
                                                       //already allocated
-                                                      //(or NULL if user knows there is no _cb output)
+                                                      //(or NULL to skip the _cb output)
                                   ) {
 
   /** Summary: */
 
   /** - define local variables */
 
-  int index_k, index_kvec, index_zvec;
+  int index_kvec, index_zvec;
   double * ln_kvec;
+  int * index_k_vec;
+  double * b_vec;
   double * ln_pk_table = NULL;
   double * ddln_pk_table = NULL;
   double * ln_pk_cb_table = NULL;
   double * ddln_pk_cb_table = NULL;
-  double h, a, b;
+  short has_m, has_cb;
+  short parallel;
+  int abort;
+
+  /** - compute the spectra on first access (before any parallel region), in case of lazy evaluation */
+
+  class_call(fourier_lazy_compute(pfo),
+             pfo->error_message,
+             pfo->error_message);
+
+  /** - a spectrum is computed if it is available and its output array is not NULL */
+
+  has_m = ((pfo->has_pk_m == _TRUE_) && (out_pk != NULL));
+  has_cb = ((pfo->has_pk_cb == _TRUE_) && (out_pk_cb != NULL));
+
+  /** - the redshifts are distributed among threads only for grids
+      large enough to pay for the parallel regions */
+
+  parallel = ((zvec_size > 1) && ((long)zvec_size*MAX(kvec_size,pfo->k_size) >= _PKS_PARALLEL_MIN_SIZE_));
 
   /** - Allocate arrays */
 
   class_alloc(ln_kvec, sizeof(double)*kvec_size,
               pfo->error_message);
+  class_alloc(index_k_vec, sizeof(int)*kvec_size,
+              pfo->error_message);
+  class_alloc(b_vec, sizeof(double)*kvec_size,
+              pfo->error_message);
 
-  if (pfo->has_pk_m == _TRUE_) {
+  if (has_m == _TRUE_) {
     class_alloc(ln_pk_table, sizeof(double)*pfo->k_size*zvec_size,
                 pfo->error_message);
     class_alloc(ddln_pk_table, sizeof(double)*pfo->k_size*zvec_size,
                 pfo->error_message);
   }
-  if (pfo->has_pk_cb == _TRUE_) {
+  if (has_cb == _TRUE_) {
     class_alloc(ln_pk_cb_table, sizeof(double)*pfo->k_size*zvec_size,
                 pfo->error_message);
     class_alloc(ddln_pk_cb_table, sizeof(double)*pfo->k_size*zvec_size,
                 pfo->error_message);
   }
 
-  /** - Construct table of log(P(k_n,z_j)) for pre-computed wavenumbers but requested redshifts: */
+  /** - Construct table of log(P(k_n,z_j)) for pre-computed wavenumbers but requested redshifts
+      (fourier_pk_at_z() locates each redshift once in the table of ln(tau) for all wavenumbers) */
+
+  abort = _FALSE_;
 
+#pragma omp parallel for private(index_zvec) schedule(static) if (parallel)
   for (index_zvec=0; index_zvec<zvec_size; index_zvec++){
 
-    if (pfo->has_pk_m == _TRUE_) {
-      class_call(fourier_pk_at_z(pba,
-                                   pfo,
-                                   logarithmic,
-                                   pk_output,
-                                   zvec[index_zvec],
-                                   pfo->index_pk_m,
-                                   &(ln_pk_table[index_zvec * pfo->k_size]),
-                                   NULL),
-                 pfo->error_message,
-                 pfo->error_message);
+#pragma omp flush(abort)
+
+    if (has_m == _TRUE_) {
+      class_call_parallel(fourier_pk_at_z(pba,
+                                          pfo,
+                                          logarithmic,
+                                          pk_output,
+                                          zvec[index_zvec],
+                                          pfo->index_pk_m,
+                                          &(ln_pk_table[index_zvec * pfo->k_size]),
+                                          NULL),
+                          pfo->error_message,
+                          pfo->error_message);
     }
-    if (pfo->has_pk_cb == _TRUE_) {
-      class_call(fourier_pk_at_z(pba,
-                                   pfo,
-                                   logarithmic,
-                                   pk_output,
-                                   zvec[index_zvec],
-                                   pfo->index_pk_cb,
-                                   &(ln_pk_cb_table[index_zvec * pfo->k_size]),
-                                   NULL),
-                 pfo->error_message,
-                 pfo->error_message);
+    if (has_cb == _TRUE_) {
+      class_call_parallel(fourier_pk_at_z(pba,
+                                          pfo,
+                                          logarithmic,
+                                          pk_output,
+                                          zvec[index_zvec],
+                                          pfo->index_pk_cb,
+                                          &(ln_pk_cb_table[index_zvec * pfo->k_size]),
+                                          NULL),
+                          pfo->error_message,
+                          pfo->error_message);
     }
   }
 
-  /** - Spline it for interpolation along k */
+  if (abort == _TRUE_)
+    return _FAILURE_;
 
-  if (pfo->has_pk_m == _TRUE_) {
+  /** - Spline it for interpolation along k (the spline coefficients of
+      the table of ln(k) are computed once for all redshifts) */
+
+  if (has_m == _TRUE_) {
 
     class_call(array_spline_table_columns2(pfo->ln_k,
                                            pfo->k_size,
@@ -835,7 +884,7 @@ int fourier_pks_at_kvec_and_zvec(
                pfo->error_message,
                pfo->error_message);
   }
-  if (pfo->has_pk_cb == _TRUE_) {
+  if (has_cb == _TRUE_) {
 
     class_call(array_spline_table_columns2(pfo->ln_k,
                                            pfo->k_size,
@@ -848,91 +897,482 @@ int fourier_pks_at_kvec_and_zvec(
                pfo->error_message);
   }
 
-  /** - Construct ln(kvec): */
+  /** - Construct ln(kvec), and locate each value in the table of
+      pre-computed wavenumbers, once for all redshifts: */
 
   for (index_kvec=0; index_kvec<kvec_size; index_kvec++)
     ln_kvec[index_kvec] = log(kvec[index_kvec]);
 
-  /** - Loop over first k values. If k<kmin, fill output with zeros. If not, go to next step. */
+  class_call(array_spline_hunt_vec(pfo->ln_k,
+                                   pfo->k_size,
+                                   ln_kvec,
+                                   kvec_size,
+                                   index_k_vec,
+                                   b_vec,
+                                   pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
 
-  for(index_kvec = 0; index_kvec<kvec_size; index_kvec++){
+  /** - For each redshift, interpolate along k. For k<kmin or k>kmax,
+      fill output with zeros (if needed, one could add instead some
+      extrapolation here) */
+
+#pragma omp parallel for private(index_zvec,index_kvec) schedule(static) if (parallel)
+  for (index_zvec = 0; index_zvec < zvec_size; index_zvec++) {
+
+    if (has_m == _TRUE_) {
+
+      array_interpolate_spline_vec(pfo->ln_k,
+                                   ln_pk_table + index_zvec * pfo->k_size,
+                                   ddln_pk_table + index_zvec * pfo->k_size,
+                                   1,
+                                   0,
+                                   kvec_size,
+                                   index_k_vec,
+                                   b_vec,
+                                   out_pk + index_zvec * kvec_size);
+
+      for (index_kvec=0; index_kvec<kvec_size; index_kvec++) {
+        if (index_k_vec[index_kvec] < 0)
+          out_pk[index_zvec*kvec_size+index_kvec] = 0.;
+        else
+          out_pk[index_zvec*kvec_size+index_kvec] = exp(out_pk[index_zvec*kvec_size+index_kvec]);
+      }
+    }
 
-    /* check whether one should go to next step */
-    if (ln_kvec[index_kvec] >= pfo->ln_k[0])
-      break;
+    if (has_cb == _TRUE_) {
+
+      array_interpolate_spline_vec(pfo->ln_k,
+                                   ln_pk_cb_table + index_zvec * pfo->k_size,
+                                   ddln_pk_cb_table + index_zvec * pfo->k_size,
+                                   1,
+                                   0,
+                                   kvec_size,
+                                   index_k_vec,
+                                   b_vec,
+                                   out_pk_cb + index_zvec * kvec_size);
+
+      for (index_kvec=0; index_kvec<kvec_size; index_kvec++) {
+        if (index_k_vec[index_kvec] < 0)
+          out_pk_cb[index_zvec*kvec_size+index_kvec] = 0.;
+        else
+          out_pk_cb[index_zvec*kvec_size+index_kvec] = exp(out_pk_cb[index_zvec*kvec_size+index_kvec]);
+      }
+    }
+  }
+
+  free(ln_kvec);
+  free(index_k_vec);
+  free(b_vec);
+  if (has_m == _TRUE_) {
+    free(ln_pk_table);
+    free(ddln_pk_table);
+  }
+  if (has_cb == _TRUE_) {
+    free(ln_pk_cb_table);
+    free(ddln_pk_cb_table);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Evaluate the bicubic interpolation of P(k,z) at one point, for
+ * fourier_pk_bicubic_at_points().
+ *
+ * @param pba   Input: pointer to background structure
+ * @param pfo   Input: pointer to fourier structure
+ * @param coef  Input: table of coefficients (pfo->pk_bicubic_l or _nl for one pk type)
+ * @param k     Input: wavenumber in 1/Mpc
+ * @param z     Input: redshift
+ * @param pk    Output: P(k,z) in Mpc**3
+ * @return the error status
+ */
+
+static int fourier_pk_bicubic_at_point(
+                                       struct background * pba,
+                                       struct fourier * pfo,
+                                       double * coef,
+                                       double k,
+                                       double z,
+                                       double * pk
+                                       ) {
+
+  double tau, ln_tau, ln_k, u, v, row;
+  double * cell;
+  int index_k, index_tau, inf, sup, mid, p;
+
+  /** - no extrapolation outside [kmin,kmax] */
+
+  if ((k <= 0.) || (log(k) < pfo->ln_k[0]) || (log(k) > pfo->ln_k[pfo->k_size-1])) {
+    *pk = 0.;
+    return _SUCCESS_;
+  }
+  ln_k = log(k);
+
+  /** - locate the cell and the reduced coordinate in log(tau) */
+
+  if (pfo->ln_tau_size == 1) {
+
+    class_test(z != 0.,
+               pfo->error_message,
+               "You are asking for the matter power spectrum at z=%e but the code was asked to store it only at z=0. You probably forgot to pass the input parameter z_max_pk (see explanatory.ini)",z);
+
+    index_tau = 0;
+    v = 0.;
+  }
+  else {
+
+    class_call(background_tau_of_z(pba,
+                                   z,
+                                   &tau),
+               pba->error_message,
+               pfo->error_message);
+
+    ln_tau = log(tau);
+
+    class_test((ln_tau < pfo->ln_tau[0]-_EPSILON_) || (ln_tau > pfo->ln_tau[pfo->ln_tau_size-1]+_EPSILON_),
+               pfo->error_message,
+               "requested z was not inside of tau tabulation range (Requested ln(tau_=%.10e, Min %.10e, Max %.10e). Solution might be to increase input parameter z_max_pk (see explanatory.ini)",
+               ln_tau,pfo->ln_tau[0],pfo->ln_tau[pfo->ln_tau_size-1]);
+
+    ln_tau = MAX(MIN(ln_tau,pfo->ln_tau[pfo->ln_tau_size-1]),pfo->ln_tau[0]);
+
+    inf = 0;
+    sup = pfo->ln_tau_size-1;
+    while (sup-inf > 1) {
+      mid = (inf+sup)/2;
+      if (ln_tau < pfo->ln_tau[mid]) sup = mid;
+      else inf = mid;
+    }
+    index_tau = inf;
+    v = (ln_tau-pfo->ln_tau[inf])/(pfo->ln_tau[sup]-pfo->ln_tau[inf]);
+  }
+
+  /** - locate the cell and the reduced coordinate in log(k) */
+
+  inf = 0;
+  sup = pfo->k_size-1;
+  while (sup-inf > 1) {
+    mid = (inf+sup)/2;
+    if (ln_k < pfo->ln_k[mid]) sup = mid;
+    else inf = mid;
+  }
+  index_k = inf;
+  u = (ln_k-pfo->ln_k[inf])/(pfo->ln_k[sup]-pfo->ln_k[inf]);
+
+  /** - evaluate the bicubic polynomial of this cell */
+
+  cell = coef + (index_tau*(pfo->k_size-1)+index_k)*16;
+
+  *pk = 0.;
+  for (p=3; p>=0; p--) {
+    row = ((cell[4*p+3]*v+cell[4*p+2])*v+cell[4*p+1])*v+cell[4*p];
+    *pk = *pk*u+row;
+  }
+
+  *pk = exp(*pk);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Return P(k,z) for a list of points (k_i,z_i) passed in input, for
+ * one pk type (_m, _cb), either linear or nonlinear, from the
+ * coefficients of the bicubic interpolation precomputed by
+ * fourier_pk_bicubic_init() (requires 'pk_bicubic = yes').
+ *
+ * Each point only costs the location of its cell in the tables of
+ * log(k) and log(tau) and the evaluation of one bicubic polynomial:
+ * unlike in fourier_pk_at_k_and_z(), nothing is re-interpolated or
+ * re-splined for each call. The results coincide with those of
+ * fourier_pk_at_k_and_z() up to rounding errors. The function only
+ * reads the fourier structure, so it can be called concurrently from
+ * several threads; for many points, it distributes them itself among
+ * threads.
+ *
+ * Like fourier_pks_at_kvec_and_zvec(), it performs no extrapolation
+ * when k_i falls outside the pre-computed range [kmin,kmax]: in that
+ * case, it returns P(k,z)=0.
+ *
+ * @param pba         Input: pointer to background structure
+ * @param pfo         Input: pointer to fourier structure
+ * @param pk_output   Input: pk_linear or pk_nonlinear
+ * @param index_pk    Input: index of pk type (_m, _cb)
+ * @param kvec        Input: array of wavenumbers k_i (in 1/Mpc)
+ * @param zvec        Input: array of redshifts z_i
+ * @param points_size Input: number of points
+ * @param out_pk      Output: P(k_i,z_i) in Mpc**3, already allocated
+ * @return the error status
+ */
+
+int fourier_pk_bicubic_at_points(
+                                 struct background * pba,
+                                 struct fourier * pfo,
+                                 enum pk_outputs pk_output,
+                                 int index_pk,
+                                 double * kvec,
+                                 double * zvec,
+                                 int points_size,
+                                 double * out_pk
+                                 ) {
+
+  int index_point;
+  double * coef;
+  int abort;
+
+  /** - compute the spectra on first access (before any parallel region), in case of lazy evaluation */
+
+  class_call(fourier_lazy_compute(pfo),
+             pfo->error_message,
+             pfo->error_message);
+
+  class_test(pfo->has_pk_bicubic == _FALSE_,
+             pfo->error_message,
+             "the coefficients of the bicubic interpolation of P(k,z) have not been computed: set 'pk_bicubic' to 'yes'");
+
+  class_test((pk_output == pk_nonlinear) && (pfo->method == nl_none),
+             pfo->error_message,
+             "the non-linear P(k,z) has not been computed: set 'non_linear'");
+
+  if (pk_output == pk_linear)
+    coef = pfo->pk_bicubic_l[index_pk];
+  else
+    coef = pfo->pk_bicubic_nl[index_pk];
+
+  /** - loop over points */
+
+  abort = _FALSE_;
+
+#pragma omp parallel for private(index_point) schedule(static) if (points_size >= _PKS_PARALLEL_MIN_SIZE_)
+  for (index_point=0; index_point<points_size; index_point++) {
+
+#pragma omp flush(abort)
+
+    class_call_parallel(fourier_pk_bicubic_at_point(pba,
+                                                    pfo,
+                                                    coef,
+                                                    kvec[index_point],
+                                                    zvec[index_point],
+                                                    &(out_pk[index_point])),
+                        pfo->error_message,
+                        pfo->error_message);
+  }
+
+  if (abort == _TRUE_)
+    return _FAILURE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * First derivatives at the nodes of a cubic spline, given the values
+ * and second derivatives y[i*stride], ddy[i*stride] at the nodes x[i],
+ * for fourier_pk_bicubic_fill().
+ *
+ * @param x      Input: nodes
+ * @param x_size Input: number of nodes (at least 2)
+ * @param y      Input: values
+ * @param ddy    Input: second derivatives
+ * @param stride Input: stride of y, ddy and dy
+ * @param dy     Output: first derivatives
+ */
 
-    /* deal with k<k_min */
-    for (index_zvec = 0; index_zvec < zvec_size; index_zvec++) {
-      if (pfo->has_pk_m == _TRUE_)     out_pk[index_zvec*kvec_size+index_kvec] = 0.;
-      if (pfo->has_pk_cb == _TRUE_) out_pk_cb[index_zvec*kvec_size+index_kvec] = 0.;
-      /* (If needed, one could add instead some extrapolation here) */
+static void fourier_pk_bicubic_derivatives(
+                                           double * x,
+                                           int x_size,
+                                           double * y,
+                                           double * ddy,
+                                           int stride,
+                                           double * dy
+                                           ) {
+  int i;
+  double h;
+
+  for (i=0; i<x_size-1; i++) {
+    h = x[i+1]-x[i];
+    dy[i*stride] = (y[(i+1)*stride]-y[i*stride])/h-h*(2.*ddy[i*stride]+ddy[(i+1)*stride])/6.;
+  }
+
+  h = x[x_size-1]-x[x_size-2];
+  dy[(x_size-1)*stride] = (y[(x_size-1)*stride]-y[(x_size-2)*stride])/h+h*(ddy[(x_size-2)*stride]+2.*ddy[(x_size-1)*stride])/6.;
+}
+
+/**
+ * Fill the coefficients of the bicubic interpolation of one table of
+ * ln(P(k,tau)), for fourier_pk_bicubic_init().
+ *
+ * The values of the function, of its derivatives with respect to
+ * log(k) and log(tau), and of its cross derivative at the corners of
+ * each cell are those of the tensor product of the spline in log(tau)
+ * already computed by fourier_spectra() (ddln_pk) and of a natural
+ * spline in log(k). The bicubic polynomial matching them in each cell
+ * is then this tensor-product spline itself.
+ *
+ * @param pfo     Input: pointer to fourier structure
+ * @param ln_pk   Input: table ln_pk[index_tau * pfo->k_size + index_k]
+ * @param ddln_pk Input: its second derivative with respect to log(tau) (not used if ln_tau_size=1)
+ * @param coef    Output: coefficients, see pfo->pk_bicubic_l
+ * @return the error status
+ */
+
+static int fourier_pk_bicubic_fill(
+                                   struct fourier * pfo,
+                                   double * ln_pk,
+                                   double * ddln_pk,
+                                   double * coef
+                                   ) {
+
+  /* matrix converting (f(0),f(1),f'(0),f'(1)) into the coefficients of a cubic polynomial on [0,1] */
+  double hermite[4][4] = {{1.,0.,0.,0.},{0.,0.,1.,0.},{-3.,3.,-2.,-1.},{2.,-2.,1.,1.}};
+  double corners[4][4], tmp[4][4];
+  double * dk;
+  double * dtau;
+  double * dk_dtau;
+  double * dd;
+  int k_size = pfo->k_size;
+  int tau_size = pfo->ln_tau_size;
+  int index_k, index_tau, index_tau_up, i, j, a;
+  double hk, htau;
+
+  class_alloc(dk,tau_size*k_size*sizeof(double),pfo->error_message);
+  class_calloc(dtau,tau_size*k_size,sizeof(double),pfo->error_message);
+  class_alloc(dk_dtau,tau_size*k_size*sizeof(double),pfo->error_message);
+  class_alloc(dd,tau_size*k_size*sizeof(double),pfo->error_message);
+
+  /** - derivatives with respect to log(tau), from the spline of fourier_spectra() */
+
+  if (tau_size > 1) {
+    for (index_k=0; index_k<k_size; index_k++) {
+      fourier_pk_bicubic_derivatives(pfo->ln_tau,tau_size,ln_pk+index_k,ddln_pk+index_k,k_size,dtau+index_k);
     }
   }
 
-  /** - Deal with case kmin<=k<=kmax. For better performance, do not
-      loop through kvec, but through pre-computed k values. */
+  /** - derivatives with respect to log(k) of the function and of its
+        derivative with respect to log(tau), from natural splines */
+
+  class_call(array_spline_table_columns(pfo->ln_k,
+                                        k_size,
+                                        ln_pk,
+                                        tau_size,
+                                        dd,
+                                        _SPLINE_NATURAL_,
+                                        pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
+  for (index_tau=0; index_tau<tau_size; index_tau++) {
+    fourier_pk_bicubic_derivatives(pfo->ln_k,k_size,ln_pk+index_tau*k_size,dd+index_tau*k_size,1,dk+index_tau*k_size);
+  }
+
+  class_call(array_spline_table_columns(pfo->ln_k,
+                                        k_size,
+                                        dtau,
+                                        tau_size,
+                                        dd,
+                                        _SPLINE_NATURAL_,
+                                        pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
 
-  for (index_k=0; index_k < (pfo->k_size-1); index_k++){
+  for (index_tau=0; index_tau<tau_size; index_tau++) {
+    fourier_pk_bicubic_derivatives(pfo->ln_k,k_size,dtau+index_tau*k_size,dd+index_tau*k_size,1,dk_dtau+index_tau*k_size);
+  }
 
-    /** --> Loop through k_i's that fall in interval [k_n,k_n+1] */
+  /** - coefficients of each cell: hermite * corners * hermite^T, with the
+        derivatives rescaled to the reduced coordinates u and v */
 
-    while ((index_kvec < kvec_size) && (ln_kvec[index_kvec] <= pfo->ln_k[index_k+1])){
+  for (index_tau=0; index_tau<pfo->pk_bicubic_tau_cells; index_tau++) {
 
-      /** --> for each of them, perform spine interpolation */
+    index_tau_up = (tau_size > 1 ? index_tau+1 : index_tau);
+    htau = (tau_size > 1 ? pfo->ln_tau[index_tau+1]-pfo->ln_tau[index_tau] : 0.);
 
-      h = pfo->ln_k[index_k+1]-pfo->ln_k[index_k];
-      b = (ln_kvec[index_kvec] - pfo->ln_k[index_k])/h;
-      a = 1.-b;
+    for (index_k=0; index_k<k_size-1; index_k++) {
 
-      for (index_zvec = 0; index_zvec < zvec_size; index_zvec++) {
+      hk = pfo->ln_k[index_k+1]-pfo->ln_k[index_k];
 
-        if (pfo->has_pk_m == _TRUE_) {
+      for (i=0; i<2; i++) {
+        corners[i][0] = ln_pk[index_tau*k_size+index_k+i];
+        corners[i][1] = ln_pk[index_tau_up*k_size+index_k+i];
+        corners[i][2] = htau*dtau[index_tau*k_size+index_k+i];
+        corners[i][3] = htau*dtau[index_tau_up*k_size+index_k+i];
+        corners[i+2][0] = hk*dk[index_tau*k_size+index_k+i];
+        corners[i+2][1] = hk*dk[index_tau_up*k_size+index_k+i];
+        corners[i+2][2] = hk*htau*dk_dtau[index_tau*k_size+index_k+i];
+        corners[i+2][3] = hk*htau*dk_dtau[index_tau_up*k_size+index_k+i];
+      }
 
-          out_pk[index_zvec*kvec_size+index_kvec] =
-            exp(
-                array_spline_eval(ln_pk_table,
-                                  ddln_pk_table,
-                                  (index_zvec * pfo->k_size + index_k),
-                                  (index_zvec * pfo->k_size + index_k+1),
-                                  h,a,b)
-                );
+      for (i=0; i<4; i++) {
+        for (j=0; j<4; j++) {
+          tmp[i][j] = 0.;
+          for (a=0; a<4; a++)
+            tmp[i][j] += hermite[i][a]*corners[a][j];
         }
-        if (pfo->has_pk_cb == _TRUE_) {
-
-          out_pk_cb[index_zvec*kvec_size+index_kvec] =
-            exp(
-                array_spline_eval(ln_pk_cb_table,
-                                  ddln_pk_cb_table,
-                                  (index_zvec * pfo->k_size + index_k),
-                                  (index_zvec * pfo->k_size + index_k+1),
-                                  h,a,b)
-                );
+      }
+
+      for (i=0; i<4; i++) {
+        for (j=0; j<4; j++) {
+          coef[(index_tau*(k_size-1)+index_k)*16+4*i+j] = 0.;
+          for (a=0; a<4; a++)
+            coef[(index_tau*(k_size-1)+index_k)*16+4*i+j] += tmp[i][a]*hermite[j][a];
         }
       }
-      index_kvec++;
     }
   }
 
-  /** - Loop over possible remaining k values with k > kmax, to fill output with zeros. */
+  free(dk);
+  free(dtau);
+  free(dk_dtau);
+  free(dd);
 
-  while (index_kvec < kvec_size) {
+  return _SUCCESS_;
+}
 
-    for (index_zvec = 0; index_zvec < zvec_size; index_zvec++) {
-      if (pfo->has_pk_m == _TRUE_)     out_pk[index_zvec*kvec_size+index_kvec] = 0.;
-      if (pfo->has_pk_cb == _TRUE_) out_pk_cb[index_zvec*kvec_size+index_kvec] = 0.;
-      /* (If needed, one could add instead some extrapolation here) */
-    }
-    index_kvec++;
-  }
+/**
+ * Precompute the coefficients of the bicubic interpolation of the
+ * linear and (if any) non-linear P(k,z), for all pk types. Called at
+ * the end of fourier_spectra() if 'pk_bicubic = yes'.
+ *
+ * @param pfo Input/Output: pointer to fourier structure
+ * @return the error status
+ */
 
-  free(ln_kvec);
-  if (pfo->has_pk_m == _TRUE_) {
-    free(ln_pk_table);
-    free(ddln_pk_table);
-  }
-  if (pfo->has_pk_cb == _TRUE_) {
-    free(ln_pk_cb_table);
-    free(ddln_pk_cb_table);
+int fourier_pk_bicubic_init(
+                            struct fourier * pfo
+                            ) {
+
+  int index_pk;
+  int coef_size;
+
+  pfo->pk_bicubic_tau_cells = MAX(pfo->ln_tau_size-1,1);
+  coef_size = pfo->pk_bicubic_tau_cells*(pfo->k_size-1)*16;
+
+  class_alloc(pfo->pk_bicubic_l,pfo->pk_size*sizeof(double*),pfo->error_message);
+  if (pfo->method > nl_none)
+    class_alloc(pfo->pk_bicubic_nl,pfo->pk_size*sizeof(double*),pfo->error_message);
+
+  for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+
+    class_alloc(pfo->pk_bicubic_l[index_pk],coef_size*sizeof(double),pfo->error_message);
+
+    class_call(fourier_pk_bicubic_fill(pfo,
+                                       pfo->ln_pk_l[index_pk],
+                                       (pfo->ln_tau_size > 1 ? pfo->ddln_pk_l[index_pk] : NULL),
+                                       pfo->pk_bicubic_l[index_pk]),
+               pfo->error_message,
+               pfo->error_message);
+
+    if (pfo->method > nl_none) {
+
+      class_alloc(pfo->pk_bicubic_nl[index_pk],coef_size*sizeof(double),pfo->error_message);
+
+      class_call(fourier_pk_bicubic_fill(pfo,
+                                         pfo->ln_pk_nl[index_pk],
+                                         (pfo->ln_tau_size > 1 ? pfo->ddln_pk_nl[index_pk] : NULL),
+                                         pfo->pk_bicubic_nl[index_pk]),
+                 pfo->error_message,
+                 pfo->error_message);
+    }
   }
 
   return _SUCCESS_;
@@ -1038,8 +1478,70 @@ int fourier_sigmas_at_z(
                           double * result
                           ) {
 
+  class_call(fourier_sigmas_at_rvec_and_z(ppr,
+                                          pba,
+                                          pfo,
+                                          &R,
+                                          1,
+                                          z,
+                                          index_pk,
+                                          sigma_output,
+                                          result),
+             pfo->error_message,
+             pfo->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine computes sigma(R,z), or other similar derived
+ * quantitites, for one given pk type (_m, _cb), at one redshift z
+ * and for an array of radii R.
+ *
+ * P(k,z) is interpolated only once. By default the integral over k
+ * is performed separately for each R by fourier_sigmas(). If
+ * ppr->sigma_fftlog is set, the quantity is rather computed at once
+ * for a logarithmic grid of radii by fourier_sigmas_fftlog(), and
+ * splined along ln(R), except for the radii outside the range where
+ * this method is accurate, for which fourier_sigmas() is still
+ * called.
+ *
+ * Same caveats as fourier_sigmas_at_z() for the convergence with
+ * k_max.
+ *
+ * @param ppr          Input: pointer to precision structure
+ * @param pba          Input: pointer to background structure
+ * @param pfo          Input: pointer to fourier structure
+ * @param rvec         Input: array of radii in Mpc
+ * @param rvec_size    Input: size of the array of radii
+ * @param z            Input: redshift
+ * @param index_pk     Input: type of pk (_m, _cb)
+ * @param sigma_output Input: quantity to be computed (sigma, sigma', ...)
+ * @param result       Output: array of results, of size rvec_size
+ * @return the error status
+ */
+
+int fourier_sigmas_at_rvec_and_z(
+                                 struct precision * ppr,
+                                 struct background * pba,
+                                 struct fourier * pfo,
+                                 double * rvec,
+                                 int rvec_size,
+                                 double z,
+                                 int index_pk,
+                                 enum out_sigmas sigma_output,
+                                 double * result
+                                 ) {
+
   double * out_pk;
   double * ddout_pk;
+  double * ln_r=NULL;
+  double * sigmas=NULL;
+  double * ddsigmas=NULL;
+  int fftlog_size=0;
+  int index_r;
+  int last_index=0;
+  double r_min=0., r_max=0.;
 
   /** - allocate temporary array for P(k,z) as a function of k */
 
@@ -1071,32 +1573,102 @@ int fourier_sigmas_at_z(
              pfo->error_message,
              pfo->error_message);
 
-  /** - calll the function computing the sigmas */
+  /** - with the FFTLog method, get the requested quantity on a grid
+        of radii and spline it along ln(R) */
 
-  class_call(fourier_sigmas(pfo,
-                              R,
-                              out_pk,
-                              ddout_pk,
-                              pfo->k_size,
-                              ppr->sigma_k_per_decade,
-                              sigma_output,
-                              result),
-             pfo->error_message,
-             pfo->error_message);
+  if (ppr->sigma_fftlog == _TRUE_) {
 
-  /** - free allocated arrays */
+    r_min = _SIGMA_FFTLOG_KR_MIN_/pfo->k[pfo->k_size-1];
+    r_max = 1./pfo->k[0];
 
-  free(out_pk);
-  free(ddout_pk);
+    class_call(fourier_sigmas_fftlog_size(pfo,
+                                          pfo->k_size,
+                                          ppr->sigma_k_per_decade,
+                                          &fftlog_size),
+               pfo->error_message,
+               pfo->error_message);
 
-  return _SUCCESS_;
-}
+    class_alloc(ln_r, fftlog_size*sizeof(double), pfo->error_message);
+    class_alloc(sigmas, fftlog_size*sizeof(double), pfo->error_message);
+    class_alloc(ddsigmas, fftlog_size*sizeof(double), pfo->error_message);
 
-/**
- * Return the value of the non-linearity wavenumber k_nl for a given redshift z
- *
- * @param pba     Input: pointer to background structure
- * @param pfo     Input: pointer to fourier structure
+    class_call(fourier_sigmas_fftlog(pfo,
+                                     out_pk,
+                                     ddout_pk,
+                                     pfo->k_size,
+                                     ppr->sigma_k_per_decade,
+                                     fftlog_size,
+                                     ln_r,
+                                     (sigma_output == out_sigma ? sigmas : NULL),
+                                     (sigma_output == out_sigma_prime ? sigmas : NULL),
+                                     (sigma_output == out_sigma_disp ? sigmas : NULL)),
+               pfo->error_message,
+               pfo->error_message);
+
+    class_call(array_spline_table_columns(ln_r,
+                                          fftlog_size,
+                                          sigmas,
+                                          1,
+                                          ddsigmas,
+                                          _SPLINE_EST_DERIV_,
+                                          pfo->error_message),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
+  /** - interpolate or integrate for each radius */
+
+  for (index_r=0; index_r<rvec_size; index_r++) {
+
+    if ((ppr->sigma_fftlog == _TRUE_) && (rvec[index_r] >= r_min) && (rvec[index_r] <= r_max)) {
+
+      class_call(array_interpolate_spline(ln_r,
+                                          fftlog_size,
+                                          sigmas,
+                                          ddsigmas,
+                                          1,
+                                          log(rvec[index_r]),
+                                          &last_index,
+                                          &(result[index_r]),
+                                          1,
+                                          pfo->error_message),
+                 pfo->error_message,
+                 pfo->error_message);
+    }
+    else {
+
+      class_call(fourier_sigmas(pfo,
+                                rvec[index_r],
+                                out_pk,
+                                ddout_pk,
+                                pfo->k_size,
+                                ppr->sigma_k_per_decade,
+                                sigma_output,
+                                &(result[index_r])),
+                 pfo->error_message,
+                 pfo->error_message);
+    }
+  }
+
+  /** - free allocated arrays */
+
+  free(out_pk);
+  free(ddout_pk);
+
+  if (ppr->sigma_fftlog == _TRUE_) {
+    free(ln_r);
+    free(sigmas);
+    free(ddsigmas);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Return the value of the non-linearity wavenumber k_nl for a given redshift z
+ *
+ * @param pba     Input: pointer to background structure
+ * @param pfo     Input: pointer to fourier structure
  * @param z       Input: redshift
  * @param k_nl    Output: k_nl value
  * @param k_nl_cb Ouput: k_nl value of the cdm+baryon part only, if there is ncdm
@@ -1113,6 +1685,12 @@ int fourier_k_nl_at_z(
 
   double tau;
 
+  /** - compute the spectra on first access, in case of lazy evaluation */
+
+  class_call(fourier_lazy_compute(pfo),
+             pfo->error_message,
+             pfo->error_message);
+
   /** - convert input redshift into a conformal time */
 
   class_call(background_tau_of_z(pba,
@@ -1180,6 +1758,11 @@ int fourier_k_nl_at_z(
  * Initialize the fourier structure, and in particular the
  * nl_corr_density and k_nl interpolation tables.
  *
+ * With lazy evaluation, only the indices and arrays are set up here,
+ * and the spectra are computed by fourier_lazy_compute() on first
+ * access (except when the transfer module needs the non-linear
+ * corrections).
+ *
  * @param ppr Input: pointer to precision structure
  * @param pba Input: pointer to background structure
  * @param pth Input: pointer to therodynamics structure
@@ -1199,24 +1782,13 @@ int fourier_init(
                    ) {
 
   int index_ncdm;
-  int index_k;
-  int index_tau;
-  int index_tau_sources;
-  int index_tau_late;
-  int index_pk;
-
-  double **pk_nl;
-  double **lnpk_l;
-  double **ddlnpk_l;
-
-  short nl_corr_not_computable_at_this_k = _FALSE_;
 
-  double * pvecback;
-  int last_index;
-  double a,z;
-
-  struct fourier_workspace nw;
-  struct fourier_workspace * pnw;
+  pfo->is_pending = _FALSE_;
+#ifdef _OPENMP
+  omp_init_lock(&(pfo->lazy_lock));
+#endif
+  pfo->pk_bicubic_l = NULL;
+  pfo->pk_bicubic_nl = NULL;
 
   /** - preliminary tests */
 
@@ -1264,6 +1836,69 @@ int fourier_init(
              pfo->error_message,
              pfo->error_message);
 
+  /** - with lazy evaluation, stop here and compute the spectra on
+      first access, unless the transfer module needs the non-linear
+      corrections of the sources */
+
+  if ((pfo->lazy_evaluation == _TRUE_) &&
+      ((pfo->method == nl_none) || (ppt->has_cls == _FALSE_))) {
+    pfo->ppr = ppr;
+    pfo->pba = pba;
+    pfo->pth = pth;
+    pfo->ppt = ppt;
+    pfo->ppm = ppm;
+    pfo->is_pending = _TRUE_;
+    if (pfo->fourier_verbose > 0)
+      printf(" -> deferred until the first query (lazy evaluation)\n");
+    return _SUCCESS_;
+  }
+
+  class_call(fourier_spectra(ppr,pba,pth,ppt,ppm,pfo),
+             pfo->error_message,
+             pfo->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute the linear and non-linear power spectra tabulated in the
+ * fourier structure, once its indices have been defined by
+ * fourier_init().
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to therodynamics structure
+ * @param ppt Input: pointer to perturbation structure
+ * @param ppm Input: pointer to primordial structure
+ * @param pfo Input/Output: pointer to fourier structure
+ * @return the error status
+ */
+
+int fourier_spectra(
+                    struct precision *ppr,
+                    struct background *pba,
+                    struct thermodynamics *pth,
+                    struct perturbations *ppt,
+                    struct primordial *ppm,
+                    struct fourier *pfo
+                    ) {
+
+  int index_k;
+  int index_tau;
+  int index_tau_sources;
+  int index_tau_late;
+  int index_pk;
+
+  short nl_corr_not_computable_at_this_k = _FALSE_;
+  short ** nl_corr_not_computable;
+
+  double * pvecback;
+  int last_index;
+  double a,z;
+
+  struct fourier_workspace nw;
+  struct fourier_workspace * pnw;
+
   /** - get the linear power spectrum at each time */
 
   for (index_tau=0; index_tau<pfo->ln_tau_size;index_tau++) {
@@ -1380,27 +2015,35 @@ int fourier_init(
 	if ((pfo->fourier_verbose > 0) && (pfo->method == nl_HMcode))
       printf("Computing non-linear matter power spectrum with HMcode \n");
 
-    /** --> allocate temporary arrays for spectra at each given time/redshift */
+    /** --> allocate the flags telling at which times the non-linear
+            corrections could be computed */
 
-    class_alloc(pk_nl,
-                pfo->k_size*sizeof(double),
+    class_alloc(nl_corr_not_computable,
+                pfo->pk_size*sizeof(short *),
                 pfo->error_message);
 
-    class_alloc(lnpk_l,
-                pfo->k_size*sizeof(double),
-                pfo->error_message);
+    for (index_pk=0; index_pk<pfo->pk_size; index_pk++)
+      class_alloc(nl_corr_not_computable[index_pk],pfo->tau_size*sizeof(short),pfo->error_message);
 
-    class_alloc(ddlnpk_l,
-                pfo->k_size*sizeof(double),
-                pfo->error_message);
+    /** --> With Halofit, compute the non-linear corrections at all
+            times at once, independently for each time (and in
+            parallel) */
 
-    for (index_pk=0; index_pk<pfo->pk_size; index_pk++){
-      class_alloc(pk_nl[index_pk],pfo->k_size*sizeof(double),pfo->error_message);
-      class_alloc(lnpk_l[index_pk],pfo->k_size_extra*sizeof(double),pfo->error_message);
-      class_alloc(ddlnpk_l[index_pk],pfo->k_size_extra*sizeof(double),pfo->error_message);
+    if (pfo->method == nl_halofit) {
+
+      class_call(fourier_halofit_at_all_tau(ppr,
+                                            pba,
+                                            ppt,
+                                            ppm,
+                                            pfo,
+                                            nl_corr_not_computable),
+                 pfo->error_message,
+                 pfo->error_message);
     }
 
-    /** --> Then go through preliminary steps specific to HMcode */
+    /** --> With HMcode, go through some preliminary steps, and then
+            compute the non-linear corrections at all times in the
+            same way */
 
     if (pfo->method == nl_HMcode){
 
@@ -1417,11 +2060,33 @@ int fourier_init(
       class_call(fourier_hmcode_baryonic_feedback(pfo),
                  pfo->error_message,
                  pfo->error_message);
+
+      if (ppr->hmcode_cache == _TRUE_) {
+        class_call(fourier_hmcode_cache_fetch(ppr,pba,pfo,pnw),
+                   pfo->error_message,
+                   pfo->error_message);
+      }
+
+      class_call(fourier_hmcode_at_all_tau(ppr,
+                                           pba,
+                                           ppt,
+                                           ppm,
+                                           pfo,
+                                           pnw,
+                                           nl_corr_not_computable),
+                 pfo->error_message,
+                 pfo->error_message);
+
+      if (ppr->hmcode_cache == _TRUE_) {
+        class_call(fourier_hmcode_cache_store(ppr,pba,pfo,pnw),
+                   pfo->error_message,
+                   pfo->error_message);
+      }
     }
 
-    /** --> Loop over decreasing time/growing redhsift. For each
-            time/redshift, compute P_NL(k,z) using either Halofit or
-            HMcode */
+    /** --> Loop over decreasing time/growing redhsift, to collect
+            the results of Halofit or HMcode until the first time at
+            which they could not be computed */
 
     /* this flag will become _TRUE_ at the minimum redshift such that
        the non-lienar corrections cannot be consistently computed */
@@ -1433,109 +2098,17 @@ int fourier_init(
 
     for (index_tau = pfo->tau_size-1; index_tau>=0; index_tau--) {
 
-      /* loop over index_pk, defined such that it is ensured
-       * that index_pk starts at index_pk_cb when neutrinos are
-       * included. This is necessary for hmcode, since the sigmatable
-       * needs to be filled for sigma_cb only. Thus, when HMcode
-       * evalutes P_m_nl, it needs both P_m_l and P_cb_l. */
-
       for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
 
-        /* get P_L(k) at this time */
-        class_call(fourier_pk_linear(
-                                       pba,
-                                       ppt,
-                                       ppm,
-                                       pfo,
-                                       index_pk,
-                                       index_tau,
-                                       pfo->k_size_extra,
-                                       lnpk_l[index_pk],
-                                       NULL
-                                       ),
-                   pfo->error_message,
-                   pfo->error_message);
-
-        /* spline P_L(k) at this time along k */
-        class_call(array_spline_table_columns(
-                                              pfo->ln_k,
-                                              pfo->k_size_extra,
-                                              lnpk_l[index_pk],
-                                              1,
-                                              ddlnpk_l[index_pk],
-                                              _SPLINE_NATURAL_,
-                                              pfo->error_message),
-                   pfo->error_message,
-                   pfo->error_message);
-
         /* if we are still in a range of time where P_NL(k) should be computable */
         if (nl_corr_not_computable_at_this_k == _FALSE_) {
 
-          /* get P_NL(k) at this time with Halofit */
-          if (pfo->method == nl_halofit) {
-
-            class_call(fourier_halofit(
-                                         ppr,
-                                         pba,
-                                         ppt,
-                                         ppm,
-                                         pfo,
-                                         index_pk,
-                                         pfo->tau[index_tau],
-                                         pk_nl[index_pk],
-                                         lnpk_l[index_pk],
-                                         ddlnpk_l[index_pk],
-                                         &(pfo->k_nl[index_pk][index_tau]),
-                                         &nl_corr_not_computable_at_this_k),
-                       pfo->error_message,
-                       pfo->error_message);
-
-          }
-
-          /* get P_NL(k) at this time with HMcode */
-          else if (pfo->method == nl_HMcode) {
-
-            /* (preliminary step: fill table of sigma's, only for _cb if there is both _cb and _m) */
-            if (index_pk == 0) {
-              class_call(fourier_hmcode_fill_sigtab(ppr,
-                                                      pba,
-                                                      ppt,
-                                                      ppm,
-                                                      pfo,
-                                                      index_tau,
-                                                      lnpk_l[index_pk],
-                                                      ddlnpk_l[index_pk],
-                                                      pnw),
-                         pfo->error_message, pfo->error_message);
-            }
-
-            class_call(fourier_hmcode(ppr,
-                                        pba,
-                                        ppt,
-                                        ppm,
-                                        pfo,
-                                        index_pk,
-                                        index_tau,
-                                        pfo->tau[index_tau],
-                                        pk_nl[index_pk],
-                                        lnpk_l,
-                                        ddlnpk_l,
-                                        &(pfo->k_nl[index_pk][index_tau]),
-                                        &nl_corr_not_computable_at_this_k,
-                                        pnw),
-                       pfo->error_message,
-                       pfo->error_message);
-          }
-
-          /* infer and store R_NL=(P_NL/P_L)^1/2 */
-          if (nl_corr_not_computable_at_this_k == _FALSE_) {
-            for (index_k=0; index_k<pfo->k_size; index_k++) {
-              pfo->nl_corr_density[index_pk][index_tau * pfo->k_size + index_k] = sqrt(pk_nl[index_pk][index_k]/exp(lnpk_l[index_pk][index_k]));
-            }
-          }
+          /* P_NL(k) at this time has already been computed, and R_NL
+             stored if this was possible */
+          nl_corr_not_computable_at_this_k = nl_corr_not_computable[index_pk][index_tau];
 
-          /* otherwise we met the first problematic value of time */
-          else {
+          /* if we met the first problematic value of time */
+          if (nl_corr_not_computable_at_this_k == _TRUE_) {
 
             /* store the index of that value */
             pfo->index_tau_min_nl = MIN(pfo->tau_size-1,index_tau+1); //this MIN() ensures that index_tau_min_nl is never out of bounds
@@ -1607,15 +2180,9 @@ int fourier_init(
 
     /* --> free temporary arrays */
 
-    for (index_pk=0; index_pk<pfo->pk_size; index_pk++){
-      free(pk_nl[index_pk]);
-      free(lnpk_l[index_pk]);
-      free(ddlnpk_l[index_pk]);
-    }
-
-    free(pk_nl);
-    free(lnpk_l);
-    free(ddlnpk_l);
+    for (index_pk=0; index_pk<pfo->pk_size; index_pk++)
+      free(nl_corr_not_computable[index_pk]);
+    free(nl_corr_not_computable);
 
     /** --> free the nonlinear workspace */
 
@@ -1633,6 +2200,14 @@ int fourier_init(
                "Your non-linear method variable is set to %d, out of the range defined in fourier.h",pfo->method);
   }
 
+  /** - if requested, precompute the coefficients of the bicubic interpolation of P(k,z) */
+
+  if (pfo->has_pk_bicubic == _TRUE_) {
+    class_call(fourier_pk_bicubic_init(pfo),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
   return _SUCCESS_;
 }
 
@@ -1693,12 +2268,76 @@ int fourier_free(
       free(pfo->ddln_pk_nl);
   }
 
+  if (pfo->pk_bicubic_l != NULL) {
+    for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+      free(pfo->pk_bicubic_l[index_pk]);
+      if (pfo->method > nl_none)
+        free(pfo->pk_bicubic_nl[index_pk]);
+    }
+    free(pfo->pk_bicubic_l);
+    if (pfo->method > nl_none)
+      free(pfo->pk_bicubic_nl);
+    pfo->pk_bicubic_l = NULL;
+    pfo->pk_bicubic_nl = NULL;
+  }
+
   if (pfo->has_pk_eq == _TRUE_) {
     free(pfo->pk_eq_tau);
     free(pfo->pk_eq_w_and_Omega);
     free(pfo->pk_eq_ddw_and_ddOmega);
   }
 
+#ifdef _OPENMP
+  omp_destroy_lock(&(pfo->lazy_lock));
+#endif
+
+  class_memory_leaks();
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute the spectra of a fourier structure initialized with lazy
+ * evaluation ('lazy_evaluation = yes'), if this has not been done
+ * yet. Does nothing otherwise.
+ *
+ * This function is called by all the query functions
+ * fourier_pk_...(), fourier_sigmas_at_z() and fourier_k_nl_at_z(),
+ * so that the spectra are computed on first access. The first call
+ * should not be issued concurrently from several threads.
+ *
+ * @param pfo Input/Output: pointer to fourier structure
+ * @return the error status
+ */
+
+int fourier_lazy_compute(
+                         struct fourier *pfo
+                         ) {
+
+  int status = _SUCCESS_;
+
+  if (pfo->is_pending == _FALSE_)
+    return _SUCCESS_;
+
+  /* each structure has its own lock, so that other runs are not held up */
+#ifdef _OPENMP
+  omp_set_lock(&(pfo->lazy_lock));
+#endif
+  if (pfo->is_pending == _TRUE_) {
+    /* cleared first, since the computation itself calls the query functions */
+    pfo->is_pending = _FALSE_;
+    if (pfo->fourier_verbose > 0)
+      printf("Computing linear Fourier spectra (lazy evaluation).\n");
+    status = fourier_spectra(pfo->ppr,pfo->pba,pfo->pth,pfo->ppt,pfo->ppm,pfo);
+  }
+#ifdef _OPENMP
+  omp_unset_lock(&(pfo->lazy_lock));
+#endif
+
+  /* the error message has already been written by fourier_spectra() */
+  if (status == _FAILURE_)
+    return _FAILURE_;
+
   return _SUCCESS_;
 }
 
@@ -1924,15 +2563,24 @@ int fourier_get_tau_list(
     }
   }
 
-  /** -> for non-linear calculations: we wills store a correction factor for all times */
+  /** -> for non-linear calculations: we will store a correction
+      factor for all times when the transfer module needs it for the
+      C_l's, and otherwise only for the late times at which P(k) is
+      stored */
   if (pfo->method > nl_none) {
 
-    pfo->tau_size = ppt->tau_size;
+    if (ppt->has_cls == _TRUE_) {
+      pfo->tau_size = ppt->tau_size;
+    }
+    else {
+      pfo->tau_size = ppt->ln_tau_size;
+    }
+    pfo->tau_offset = ppt->tau_size - pfo->tau_size;
 
     class_alloc(pfo->tau,pfo->tau_size*sizeof(double),pfo->error_message);
 
     for (index_tau=0; index_tau<pfo->tau_size; index_tau++) {
-      pfo->tau[index_tau] = ppt->tau_sampling[index_tau];
+      pfo->tau[index_tau] = ppt->tau_sampling[pfo->tau_offset+index_tau];
     }
   }
   return _SUCCESS_;
@@ -2123,6 +2771,7 @@ int fourier_pk_linear(
   int index_k;
   int index_tp;
   int index_ic1,index_ic2,index_ic1_ic1,index_ic1_ic2,index_ic2_ic2;
+  double * primordial_pk_all;
   double * primordial_pk;
   double pk;
   double * pk_ic;
@@ -2130,9 +2779,13 @@ int fourier_pk_linear(
   double source_ic2;
   double cosine_correlation;
 
-  /** - allocate temporary vector where the primordial spectrum will be stored */
+  /** - get the primordial spectrum at all k values in one sweep */
 
-  class_alloc(primordial_pk,pfo->ic_ic_size*sizeof(double),pfo->error_message);
+  class_alloc(primordial_pk_all,k_size*pfo->ic_ic_size*sizeof(double),pfo->error_message);
+
+  class_call(primordial_spectrum_at_k_array(ppm,pfo->index_md_scalars,logarithmic,pfo->ln_k,k_size,primordial_pk_all),
+             ppm->error_message,
+             pfo->error_message);
 
   class_alloc(pk_ic,pfo->ic_ic_size*sizeof(double),pfo->error_message);
 
@@ -2151,9 +2804,7 @@ int fourier_pk_linear(
   for (index_k=0; index_k<k_size; index_k++) {
 
     /** --> get primordial spectrum */
-    class_call(primordial_spectrum_at_k(ppm,pfo->index_md_scalars,logarithmic,pfo->ln_k[index_k],primordial_pk),
-               ppm->error_message,
-               pfo->error_message);
+    primordial_pk = primordial_pk_all + index_k*pfo->ic_ic_size;
 
     /** --> initialize a local variable for P_m(k) and P_cb(k) to zero */
     pk = 0.;
@@ -2252,7 +2903,7 @@ int fourier_pk_linear(
     lnpk[index_k] = log(pk);
   }
 
-  free(primordial_pk);
+  free(primordial_pk_all);
   free(pk_ic);
 
   return _SUCCESS_;
@@ -2432,76 +3083,369 @@ int fourier_sigmas(
 }
 
 /**
- * This routine computes the variance of density fluctuations in a
- * sphere of radius R at redshift z, sigma(R,z) for one given pk type (_m, _cb).
- *
- * Try to use instead fourier_sigmas_at_z(). This function is just
- * maintained for compatibility with the deprecated function
- * harmonic_sigma()
- *
- * The integral is performed until the maximum value of k_max defined
- * in the perturbation module. Here there is not automatic checking
- * that k_max is large enough for the result to be well
- * converged. E.g. to get an accurate sigma8 at R = 8 Mpc/h, the user
- * should pass at least about P_k_max_h/Mpc = 1.
+ * Number of radii at which fourier_sigmas_fftlog() returns the
+ * sigmas, for a given input P(k): the smallest power of two at least
+ * _SIGMA_FFTLOG_PADDING_ times larger than the number of wavenumbers
+ * used in fourier_sigmas().
  *
- * @param pba          Input: pointer to background structure
  * @param pfo          Input: pointer to fourier structure
- * @param R            Input: radius in Mpc
- * @param z            Input: redshift
- * @param index_pk     Input: type of pk (_m, _cb)
- * @param k_per_decade Input: logarithmic step for the integral (recommended: pass ppr->sigma_k_per_decade)
- * @param result       Output: result
+ * @param k_size       Input: dimension of the input P(k), as in fourier_sigmas()
+ * @param k_per_decade Input: logarithmic step in k and in R (recommended: pass ppr->sigma_k_per_decade)
+ * @param fftlog_size  Output: number of radii
  * @return the error status
  */
 
-int fourier_sigma_at_z(
-                         struct background * pba,
-                         struct fourier * pfo,
-                         double R,
-                         double z,
-                         int index_pk,
-                         double k_per_decade,
-                         double * result
-                         ) {
+int fourier_sigmas_fftlog_size(
+                               struct fourier * pfo,
+                               int k_size,
+                               double k_per_decade,
+                               int * fftlog_size
+                               ) {
 
-  double * out_pk;
-  double * ddout_pk;
+  int integrand_size;
 
-  /** - allocate temporary array for P(k,z) as a function of k */
+  integrand_size=(int)(log(pfo->k[k_size-1]/pfo->k[0])/log(10.)*k_per_decade)+1;
 
-  class_alloc(out_pk, pfo->k_size*sizeof(double), pfo->error_message);
-  class_alloc(ddout_pk, pfo->k_size*sizeof(double), pfo->error_message);
+  *fftlog_size = 1;
+  while (*fftlog_size < _SIGMA_FFTLOG_PADDING_*integrand_size)
+    *fftlog_size *= 2;
 
-  /** - get P(k,z) as a function of k, for the right z */
+  return _SUCCESS_;
+}
 
-  class_call(fourier_pk_at_z(pba,
-                               pfo,
-                               logarithmic,
-                               pk_linear,
-                               z,
-                               index_pk,
-                               out_pk,
-                               NULL),
-             pfo->error_message,
-             pfo->error_message);
+/**
+ * Mellin transform of the square of the top-hat window,
+ *
+ * M(s) = int_0^infty dx x^(s-1) W(x)^2
+ *      = 72 2^(-s) cos(pi s/2) Gamma(s) / [(s-1)(s-3)(s-4)(s-6)],
+ *
+ * for 0 < Re(s) < 4, multiplied by exp(i phase). The product is
+ * computed through its logarithm, since at large Im(s) the cosine
+ * and Gamma factors are separately huge and tiny.
+ *
+ * @param s_re          Input: real part of s
+ * @param s_im          Input: imaginary part of s
+ * @param phase         Input: additional phase
+ * @param u_re          Output: real part of the result
+ * @param u_im          Output: imaginary part of the result
+ * @param error_message Output: error message
+ * @return the error status
+ */
 
-  /** - spline it along k */
+static int fourier_sigmas_fftlog_kernel(
+                                        double s_re,
+                                        double s_im,
+                                        double phase,
+                                        double * u_re,
+                                        double * u_im,
+                                        ErrorMsg error_message
+                                        ) {
+
+  double ln_re, ln_im, ln_gamma_re, ln_gamma_im;
+  double alpha, beta, sign_beta, damping, bracket_re, bracket_im;
+  double poles[4] = {1.,3.,4.,6.};
+  int index_pole;
+
+  /** - ln(72 2^(-s)) */
+  ln_re = log(72.)-s_re*log(2.);
+  ln_im = -s_im*log(2.)+phase;
+
+  /** - ln(cos(pi s/2)), with cos(a+ib) = exp(|b|)/2 [exp(-i sgn(b) a) + exp(-2|b|) exp(i sgn(b) a)] */
+  alpha = 0.5*_PI_*s_re;
+  beta = 0.5*_PI_*s_im;
+  sign_beta = (beta >= 0. ? 1. : -1.);
+  damping = exp(-2.*fabs(beta));
+  bracket_re = cos(alpha)*(1.+damping);
+  bracket_im = -sign_beta*sin(alpha)*(1.-damping);
+  ln_re += fabs(beta)-log(2.)+0.5*log(bracket_re*bracket_re+bracket_im*bracket_im);
+  ln_im += atan2(bracket_im,bracket_re);
+
+  /** - ln(Gamma(s)) */
+  class_call(fft_log_gamma(s_re,s_im,&ln_gamma_re,&ln_gamma_im,error_message),
+             error_message,
+             error_message);
+  ln_re += ln_gamma_re;
+  ln_im += ln_gamma_im;
+
+  /** - ln of the denominator */
+  for (index_pole=0; index_pole<4; index_pole++) {
+    ln_re -= 0.5*log((s_re-poles[index_pole])*(s_re-poles[index_pole])+s_im*s_im);
+    ln_im -= atan2(s_im,s_re-poles[index_pole]);
+  }
 
-  class_call(array_spline_table_columns(pfo->ln_k,
-                                        pfo->k_size,
-                                        out_pk,
-                                        1,
-                                        ddout_pk,
-                                        _SPLINE_EST_DERIV_,
-                                        pfo->error_message),
-             pfo->error_message,
-             pfo->error_message);
+  *u_re = exp(ln_re)*cos(ln_im);
+  *u_im = exp(ln_re)*sin(ln_im);
 
-  /** - calll the function computing the sigmas */
+  return _SUCCESS_;
+}
 
-  class_call(fourier_sigmas(pfo,
-                              R,
+/**
+ * Calculate sigma(R), sigma'(R) = d[sigma(R)^2]/dR and sigma_disp(R)
+ * (with the same definitions as in fourier_sigmas()) at once for all
+ * radii of a logarithmic grid, with the FFTLog method (Hamilton 2000,
+ * astro-ph/9905191).
+ *
+ * The function Delta^2(k) k^(-q) = k^3 P(k) k^(-q) / (2 pi^2) is
+ * sampled with the same logarithmic step and over the same range as
+ * in fourier_sigmas(), zero-padded, and expanded in a discrete
+ * Fourier series in ln(k). Each term of the series contributes to
+ * the integrals over k in proportion to the Mellin transform of the
+ * squared top-hat window, and the sum over terms at all radii is
+ * again a discrete Fourier transform. The bias q must be in ]2,4[
+ * for the three integrals to converge term by term.
+ *
+ * The radii are R_j = exp(ln_r[j]) with ln_r[j+1]-ln_r[j] = ln(10)/k_per_decade,
+ * reciprocal to the (padded) grid of wavenumbers. The results are
+ * most accurate away from the first and last few points, which are
+ * affected by the periodicity of the discrete transform.
+ *
+ * @param pfo          Input: pointer to fourier structure
+ * @param lnpk_l       Input: array of ln(P(k))
+ * @param ddlnpk_l     Input: its spline along k
+ * @param k_size       Input: dimension of array lnpk_l, as in fourier_sigmas()
+ * @param k_per_decade Input: logarithmic step in k and in R (recommended: pass ppr->sigma_k_per_decade)
+ * @param fftlog_size  Input: number of radii, given by fourier_sigmas_fftlog_size()
+ * @param ln_r         Output: array of ln(R), R in Mpc
+ * @param sigma        Output: array of sigma(R) (can be NULL)
+ * @param sigma_prime  Output: array of sigma'(R) (can be NULL)
+ * @param sigma_disp   Output: array of sigma_disp(R) (can be NULL)
+ * @return the error status
+ */
+
+int fourier_sigmas_fftlog(
+                          struct fourier * pfo,
+                          double * lnpk_l,
+                          double * ddlnpk_l,
+                          int k_size,
+                          double k_per_decade,
+                          int fftlog_size,
+                          double * ln_r,
+                          double * sigma,
+                          double * sigma_prime,
+                          double * sigma_disp
+                          ) {
+
+  double * re;
+  double * im;
+  double * re_disp=NULL;
+  double * im_disp=NULL;
+  int integrand_size, n_pad, index_k, index_r, index_m, last_index=0;
+  double q, dlnk, ln_k, ln_k_min, ln_r_min, lnpk, eta, phase;
+  double c_re, c_im, u_re, u_im, a_re, a_im, b_re, b_im, r_q, norm;
+
+  q = _SIGMA_FFTLOG_BIAS_;
+  dlnk = log(10.)/k_per_decade;
+
+  integrand_size=(int)(log(pfo->k[k_size-1]/pfo->k[0])/log(10.)*k_per_decade)+1;
+
+  class_test(fftlog_size < 2*integrand_size,
+             pfo->error_message,
+             "the FFTLog grid of %d points is too small for %d wavenumbers: get its size from fourier_sigmas_fftlog_size()",
+             fftlog_size,integrand_size);
+
+  /** - the data is centered in the padded grid of wavenumbers; the
+        grid of radii is such that k_n R_{N-1-n} = 1 */
+
+  n_pad = (fftlog_size-integrand_size)/2;
+  ln_k_min = pfo->ln_k[0]-n_pad*dlnk;
+  ln_r_min = -ln_k_min-(fftlog_size-1)*dlnk;
+  phase = -(ln_k_min+ln_r_min);
+
+  class_calloc(re,fftlog_size,sizeof(double),pfo->error_message);
+  class_calloc(im,fftlog_size,sizeof(double),pfo->error_message);
+  if (sigma_disp != NULL) {
+    class_alloc(re_disp,fftlog_size*sizeof(double),pfo->error_message);
+    class_alloc(im_disp,fftlog_size*sizeof(double),pfo->error_message);
+  }
+
+  /** - sample k^3 P(k) k^(-q) */
+
+  for (index_k=0; index_k<integrand_size; index_k++) {
+
+    ln_k = MIN(pfo->ln_k[0]+index_k*dlnk,pfo->ln_k[k_size-1]);
+
+    if (index_k == 0) {
+      lnpk = lnpk_l[0];
+    }
+    else {
+      class_call(array_interpolate_spline(pfo->ln_k,
+                                          k_size,
+                                          lnpk_l,
+                                          ddlnpk_l,
+                                          1,
+                                          ln_k,
+                                          &last_index,
+                                          &lnpk,
+                                          1,
+                                          pfo->error_message),
+                 pfo->error_message,
+                 pfo->error_message);
+    }
+
+    re[n_pad+index_k] = exp(lnpk+(3.-q)*ln_k);
+  }
+
+  /** - coefficients c_m of the Fourier series */
+
+  class_call(fft_radix2(re,im,fftlog_size,-1,pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
+  /** - multiply them by the Mellin transform of the window and by the
+        phase of the first radius. The outputs sigma^2 and R d(sigma^2)/dR
+        being both real, they are packed as the real and imaginary part
+        of a single transform. The Nyquist term, which has no
+        symmetric partner, is dropped. */
+
+  for (index_m=0; index_m<fftlog_size; index_m++) {
+
+    if (index_m == fftlog_size/2) {
+      re[index_m] = 0.;
+      im[index_m] = 0.;
+      if (sigma_disp != NULL) {
+        re_disp[index_m] = 0.;
+        im_disp[index_m] = 0.;
+      }
+      continue;
+    }
+
+    eta = 2.*_PI_*(index_m < fftlog_size/2 ? index_m : index_m-fftlog_size)/(fftlog_size*dlnk);
+    c_re = re[index_m]/fftlog_size;
+    c_im = im[index_m]/fftlog_size;
+
+    if (sigma_disp != NULL) {
+      class_call(fourier_sigmas_fftlog_kernel(q-2.,eta,eta*phase,&u_re,&u_im,pfo->error_message),
+                 pfo->error_message,
+                 pfo->error_message);
+      re_disp[index_m] = c_re*u_re-c_im*u_im;
+      im_disp[index_m] = c_re*u_im+c_im*u_re;
+    }
+
+    class_call(fourier_sigmas_fftlog_kernel(q,eta,eta*phase,&u_re,&u_im,pfo->error_message),
+               pfo->error_message,
+               pfo->error_message);
+    a_re = c_re*u_re-c_im*u_im;
+    a_im = c_re*u_im+c_im*u_re;
+    b_re = -q*a_re+eta*a_im;
+    b_im = -q*a_im-eta*a_re;
+    re[index_m] = a_re-b_im;
+    im[index_m] = a_im+b_re;
+  }
+
+  /** - sum the series at all radii */
+
+  class_call(fft_radix2(re,im,fftlog_size,-1,pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
+  if (sigma_disp != NULL) {
+    class_call(fft_radix2(re_disp,im_disp,fftlog_size,-1,pfo->error_message),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
+  /** - properly normalize the final results */
+
+  norm = 1./(2.*_PI_*_PI_);
+
+  for (index_r=0; index_r<fftlog_size; index_r++) {
+
+    ln_r[index_r] = ln_r_min+index_r*dlnk;
+    r_q = exp(-q*ln_r[index_r]);
+
+    if (sigma != NULL)
+      sigma[index_r] = sqrt(MAX(re[index_r]*r_q*norm,0.));
+
+    if (sigma_prime != NULL)
+      sigma_prime[index_r] = im[index_r]*r_q*norm/exp(ln_r[index_r]);
+
+    if (sigma_disp != NULL)
+      sigma_disp[index_r] = sqrt(MAX(re_disp[index_r]*r_q*exp(2.*ln_r[index_r])*norm/3.,0.));
+  }
+
+  /** - free allocated arrays */
+
+  free(re);
+  free(im);
+  if (sigma_disp != NULL) {
+    free(re_disp);
+    free(im_disp);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine computes the variance of density fluctuations in a
+ * sphere of radius R at redshift z, sigma(R,z) for one given pk type (_m, _cb).
+ *
+ * Try to use instead fourier_sigmas_at_z(). This function is just
+ * maintained for compatibility with the deprecated function
+ * harmonic_sigma()
+ *
+ * The integral is performed until the maximum value of k_max defined
+ * in the perturbation module. Here there is not automatic checking
+ * that k_max is large enough for the result to be well
+ * converged. E.g. to get an accurate sigma8 at R = 8 Mpc/h, the user
+ * should pass at least about P_k_max_h/Mpc = 1.
+ *
+ * @param pba          Input: pointer to background structure
+ * @param pfo          Input: pointer to fourier structure
+ * @param R            Input: radius in Mpc
+ * @param z            Input: redshift
+ * @param index_pk     Input: type of pk (_m, _cb)
+ * @param k_per_decade Input: logarithmic step for the integral (recommended: pass ppr->sigma_k_per_decade)
+ * @param result       Output: result
+ * @return the error status
+ */
+
+int fourier_sigma_at_z(
+                         struct background * pba,
+                         struct fourier * pfo,
+                         double R,
+                         double z,
+                         int index_pk,
+                         double k_per_decade,
+                         double * result
+                         ) {
+
+  double * out_pk;
+  double * ddout_pk;
+
+  /** - allocate temporary array for P(k,z) as a function of k */
+
+  class_alloc(out_pk, pfo->k_size*sizeof(double), pfo->error_message);
+  class_alloc(ddout_pk, pfo->k_size*sizeof(double), pfo->error_message);
+
+  /** - get P(k,z) as a function of k, for the right z */
+
+  class_call(fourier_pk_at_z(pba,
+                               pfo,
+                               logarithmic,
+                               pk_linear,
+                               z,
+                               index_pk,
+                               out_pk,
+                               NULL),
+             pfo->error_message,
+             pfo->error_message);
+
+  /** - spline it along k */
+
+  class_call(array_spline_table_columns(pfo->ln_k,
+                                        pfo->k_size,
+                                        out_pk,
+                                        1,
+                                        ddout_pk,
+                                        _SPLINE_EST_DERIV_,
+                                        pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
+  /** - calll the function computing the sigmas */
+
+  class_call(fourier_sigmas(pfo,
+                              R,
                               out_pk,
                               ddout_pk,
                               pfo->k_size,
@@ -2519,6 +3463,132 @@ int fourier_sigma_at_z(
   return _SUCCESS_;
 }
 
+/**
+ * Compute with Halofit the non-linear corrections R_NL=(P_NL/P_L)^1/2
+ * and the non-linear wavenumber at all times pfo->tau, for all pk
+ * types (_m, _cb).
+ *
+ * The times are distributed among threads by contiguous blocks. Each
+ * thread runs through its block by decreasing time, and passes the
+ * non-linear wavenumber found at one time as a starting guess for
+ * the next one. Where the corrections cannot be computed, a flag is
+ * raised and the tables are not filled: it is up to the caller to
+ * find the first such time and to set R_NL=1 beyond it.
+ *
+ * @param ppr         Input: pointer to precision structure
+ * @param pba         Input: pointer to background structure
+ * @param ppt         Input: pointer to perturbation structure
+ * @param ppm         Input: pointer to primordial structure
+ * @param pfo         Input/Output: pointer to fourier structure (fills nl_corr_density and k_nl)
+ * @param nl_corr_not_computable Output: flags nl_corr_not_computable[index_pk][index_tau] (_TRUE_ if not possible)
+ * @return the error status
+ */
+
+int fourier_halofit_at_all_tau(
+                               struct precision *ppr,
+                               struct background *pba,
+                               struct perturbations *ppt,
+                               struct primordial *ppm,
+                               struct fourier *pfo,
+                               short ** nl_corr_not_computable
+                               ) {
+
+  int index_tau;
+  int index_pk;
+  int index_k;
+  double * pk_nl;
+  double * lnpk_l;
+  double * ddlnpk_l;
+  double * k_nl_guess;
+  int abort = _FALSE_;
+
+#pragma omp parallel private(index_tau,index_pk,index_k,pk_nl,lnpk_l,ddlnpk_l,k_nl_guess)
+  {
+    class_alloc_parallel(pk_nl,pfo->k_size*sizeof(double),pfo->error_message);
+    class_alloc_parallel(lnpk_l,pfo->k_size_extra*sizeof(double),pfo->error_message);
+    class_alloc_parallel(ddlnpk_l,pfo->k_size_extra*sizeof(double),pfo->error_message);
+    class_alloc_parallel(k_nl_guess,pfo->pk_size*sizeof(double),pfo->error_message);
+
+    /* no guess for the first time of each block */
+    if (abort == _FALSE_) {
+      for (index_pk=0; index_pk<pfo->pk_size; index_pk++)
+        k_nl_guess[index_pk] = 0.;
+    }
+
+#pragma omp for schedule(static)
+    for (index_tau = pfo->tau_size-1; index_tau >= 0; index_tau--) {
+
+      for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+
+        /* get P_L(k) at this time */
+        class_call_parallel(fourier_pk_linear(pba,
+                                              ppt,
+                                              ppm,
+                                              pfo,
+                                              index_pk,
+                                              pfo->tau_offset+index_tau,
+                                              pfo->k_size_extra,
+                                              lnpk_l,
+                                              NULL),
+                            pfo->error_message,
+                            pfo->error_message);
+
+        /* spline P_L(k) at this time along k */
+        class_call_parallel(array_spline_table_columns(pfo->ln_k,
+                                                       pfo->k_size_extra,
+                                                       lnpk_l,
+                                                       1,
+                                                       ddlnpk_l,
+                                                       _SPLINE_NATURAL_,
+                                                       pfo->error_message),
+                            pfo->error_message,
+                            pfo->error_message);
+
+        /* get P_NL(k) at this time */
+        class_call_parallel(fourier_halofit(ppr,
+                                            pba,
+                                            ppt,
+                                            ppm,
+                                            pfo,
+                                            index_pk,
+                                            pfo->tau[index_tau],
+                                            pk_nl,
+                                            lnpk_l,
+                                            ddlnpk_l,
+                                            k_nl_guess[index_pk],
+                                            &(pfo->k_nl[index_pk][index_tau]),
+                                            &(nl_corr_not_computable[index_pk][index_tau])),
+                            pfo->error_message,
+                            pfo->error_message);
+
+        if (abort == _TRUE_)
+          continue;
+
+        /* infer and store R_NL=(P_NL/P_L)^1/2 */
+        if (nl_corr_not_computable[index_pk][index_tau] == _FALSE_) {
+          for (index_k=0; index_k<pfo->k_size; index_k++) {
+            pfo->nl_corr_density[index_pk][index_tau * pfo->k_size + index_k] = sqrt(pk_nl[index_k]/exp(lnpk_l[index_k]));
+          }
+          k_nl_guess[index_pk] = pfo->k_nl[index_pk][index_tau];
+        }
+        else {
+          k_nl_guess[index_pk] = 0.;
+        }
+      }
+    }
+
+    free(pk_nl);
+    free(lnpk_l);
+    free(ddlnpk_l);
+    free(k_nl_guess);
+  }
+
+  if (abort == _TRUE_)
+    return _FAILURE_;
+
+  return _SUCCESS_;
+}
+
 /**
  * Calculation of the nonlinear matter power spectrum with Halofit
  * (includes Takahashi 2012 + Bird 2013 revisions).
@@ -2539,6 +3609,7 @@ int fourier_sigma_at_z(
  * @param pk_nl       Output: non linear spectrum at the relevant time
  * @param lnpk_l      Input: array of log(P(k)_linear)
  * @param ddlnpk_l    Input: array of second derivative of log(P(k)_linear) wrt k, for spline interpolation
+ * @param k_nl_guess  Input: non-linear wavenumber at a neighbouring time, to narrow down its search (or zero if not known)
  * @param k_nl        Output: non-linear wavenumber
  * @param nl_corr_not_computable_at_this_k Ouput: flag concerning the status of the calculation (_TRUE_ if not possible)
  * @return the error status
@@ -2555,6 +3626,7 @@ int fourier_halofit(
                       double *pk_nl,
                       double *lnpk_l,
                       double *ddlnpk_l,
+                      double k_nl_guess,
                       double *k_nl,
                       short * nl_corr_not_computable_at_this_k
                       ) {
@@ -2577,28 +3649,22 @@ int fourier_halofit(
 
   int last_index=0;
   int counter;
+  double sum[3];
   double sum1,sum2,sum3;
   double anorm;
 
-  double *integrand_array;
+  double * k_integrand;  /* k_integrand[index_k]: values of k for the window integrals */
+  double * pk_integrand; /* pk_integrand[index_k]: P_L(k) k^2/(2 pi^2) at these values */
+  double * integrand;    /* integrand[index_sum*integrand_size+index_k]: integrand of each window integral */
+  double * ddintegrand;  /* its second derivative */
   int integrand_size;
-  int index_ia_k;
-  int index_ia_pk;
-  int index_ia_sum;
-  int index_ia_ddsum;
-  /*
-    int index_ia_sum2;
-    int index_ia_ddsum2;
-    int index_ia_sum3;
-    int index_ia_ddsum3;
-  */
-  int ia_size;
-  int index_ia;
+  struct spline_coefficients sc;
 
-  double k_integrand;
   double lnpk_integrand;
 
   double R;
+  double xlog_guess,xlog_try,step;
+  short direction;
 
   double * w_and_Omega;
 
@@ -2667,32 +3733,30 @@ int fourier_halofit(
   /*      Until the 17.02.2015 the values of k used for integrating sigma(R) quantities needed by Halofit where the same as in the perturbation module.
           Since then, we sample these integrals on more values, in order to get more precise integrals (thanks Matteo Zennaro for noticing the need for this).
 
-          We create a temporary integrand_array which columns will be:
+          We create temporary arrays with:
           - k in 1/Mpc
-          - just linear P(k) in Mpc**3
-          - 1/(2(pi**2)) P(k) k**2 exp(-(kR)**2) or 1/(2(pi**2)) P(k) k**2 2 (kR) exp(-(kR)**2) or 1/(2(pi**2)) P(k) k**2 4 (kR)(1-kR) exp(-(kR)**2)
-          - second derivative of previous line with spline
-  */
+          - 1/(2(pi**2)) P(k) k**2 in Mpc, with the linear P(k)
+          - the integrands 1/(2(pi**2)) P(k) k**2 exp(-(kR)**2), 1/(2(pi**2)) P(k) k**2 2 (kR)**2 exp(-(kR)**2) and 1/(2(pi**2)) P(k) k**2 4 (kR)**2 (1-(kR)**2) exp(-(kR)**2)
+          - the second derivatives of the integrands with spline
 
-  index_ia=0;
-  class_define_index(index_ia_k,     _TRUE_,index_ia,1);
-  class_define_index(index_ia_pk,    _TRUE_,index_ia,1);
-  class_define_index(index_ia_sum,   _TRUE_,index_ia,1);
-  class_define_index(index_ia_ddsum, _TRUE_,index_ia,1);
-  ia_size = index_ia;
+          The spline coefficients depending only on the sampling in k
+          are computed once for all integrals.
+  */
 
   integrand_size=(int)(log(pfo->k[pfo->k_size-1]/pfo->k[0])/log(10.)*ppr->halofit_k_per_decade)+1;
 
-  class_alloc(integrand_array,integrand_size*ia_size*sizeof(double),pfo->error_message);
+  class_alloc(k_integrand,integrand_size*sizeof(double),pfo->error_message);
+  class_alloc(pk_integrand,integrand_size*sizeof(double),pfo->error_message);
+  class_alloc(integrand,3*integrand_size*sizeof(double),pfo->error_message);
+  class_alloc(ddintegrand,3*integrand_size*sizeof(double),pfo->error_message);
 
-
-  /* we fill integrand_array with values of k and P(k) using interpolation */
+  /* we fill these arrays with values of k and P(k) using interpolation */
 
   last_index=0;
 
   for (index_k=0; index_k < integrand_size; index_k++) {
 
-    k_integrand=pfo->k[0]*pow(10.,index_k/ppr->halofit_k_per_decade);
+    k_integrand[index_k]=pfo->k[0]*pow(10.,index_k/ppr->halofit_k_per_decade);
 
     if (index_k ==0 ) {
       lnpk_integrand = lnpk_l[0];
@@ -2705,7 +3769,7 @@ int fourier_halofit(
                                           lnpk_l,
                                           ddlnpk_l,
                                           1,
-                                          log(k_integrand),
+                                          log(k_integrand[index_k]),
                                           &last_index,
                                           &lnpk_integrand,
                                           1,
@@ -2714,11 +3778,18 @@ int fourier_halofit(
                  pfo->error_message);
     }
 
-    integrand_array[index_k*ia_size + index_ia_k] = k_integrand;
-    integrand_array[index_k*ia_size + index_ia_pk] = exp(lnpk_integrand);
+    pk_integrand[index_k] = exp(lnpk_integrand)*k_integrand[index_k]*k_integrand[index_k]*anorm;
 
   }
 
+  class_call(array_spline_coefficients_init(k_integrand,
+                                            integrand_size,
+                                            _SPLINE_NATURAL_,
+                                            &sc,
+                                            pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
   class_call(background_at_tau(pba,tau,long_info,inter_normal,&last_index,pvecback),
              pba->error_message,
              pfo->error_message);
@@ -2744,21 +3815,19 @@ int fourier_halofit(
      other redshifts, so there is normally no need to change i
   */
 
-  R=sqrt(-log(ppr->halofit_sigma_precision))/integrand_array[(integrand_size-1)*ia_size + index_ia_k];
+  R=sqrt(-log(ppr->halofit_sigma_precision))/k_integrand[integrand_size-1];
 
   class_call(fourier_halofit_integrate(
-                                         pfo,
-                                         integrand_array,
-                                         integrand_size,
-                                         ia_size,
-                                         index_ia_k,
-                                         index_ia_pk,
-                                         index_ia_sum,
-                                         index_ia_ddsum,
-                                         R,
-                                         halofit_integral_one,
-                                         &sum1
-                                         ),
+                                       &sc,
+                                       k_integrand,
+                                       pk_integrand,
+                                       integrand_size,
+                                       integrand,
+                                       ddintegrand,
+                                       R,
+                                       1,
+                                       &sum1
+                                       ),
              pfo->error_message,
              pfo->error_message);
 
@@ -2783,7 +3852,11 @@ int fourier_halofit(
   if (sigma < 1.) {
     * nl_corr_not_computable_at_this_k = _TRUE_;
     free(pvecback);
-    free(integrand_array);
+    free(k_integrand);
+    free(pk_integrand);
+    free(integrand);
+    free(ddintegrand);
+    array_spline_coefficients_free(&sc);
     return _SUCCESS_;
   }
   else {
@@ -2805,18 +3878,16 @@ int fourier_halofit(
 
   /* corresponding value of sigma_R */
   class_call(fourier_halofit_integrate(
-                                         pfo,
-                                         integrand_array,
-                                         integrand_size,
-                                         ia_size,
-                                         index_ia_k,
-                                         index_ia_pk,
-                                         index_ia_sum,
-                                         index_ia_ddsum,
-                                         R,
-                                         halofit_integral_one,
-                                         &sum1
-                                         ),
+                                       &sc,
+                                       k_integrand,
+                                       pk_integrand,
+                                       integrand_size,
+                                       integrand,
+                                       ddintegrand,
+                                       R,
+                                       1,
+                                       &sum1
+                                       ),
              pfo->error_message,
              pfo->error_message);
 
@@ -2829,24 +3900,95 @@ int fourier_halofit(
 
   xlogr2 = log(R)/log(10.);
 
+  /* if the non-linear scale is known at a neighbouring time, the
+     root is searched in a narrower bracket around it: starting from
+     the guess, we step away from it in the direction of the root
+     with a doubling step until sigma crosses one */
+
+  if (k_nl_guess > 0.) {
+
+    xlog_guess = -log10(k_nl_guess);
+
+    if ((xlog_guess > xlogr1) && (xlog_guess < xlogr2)) {
+
+      R = pow(10,xlog_guess);
+
+      class_call(fourier_halofit_integrate(
+                                           &sc,
+                                           k_integrand,
+                                           pk_integrand,
+                                           integrand_size,
+                                           integrand,
+                                           ddintegrand,
+                                           R,
+                                           1,
+                                           &sum1
+                                           ),
+                 pfo->error_message,
+                 pfo->error_message);
+
+      /* sigma decreases with R: the root is at larger R if sigma > 1 */
+      if (sum1 > 1.) {
+        xlogr1 = xlog_guess;
+        direction = 1;
+      }
+      else {
+        xlogr2 = xlog_guess;
+        direction = -1;
+      }
+
+      step = _HALOFIT_WARM_START_STEP_;
+      xlog_try = xlog_guess + direction*step;
+
+      while ((xlog_try > xlogr1) && (xlog_try < xlogr2)) {
+
+        R = pow(10,xlog_try);
+
+        class_call(fourier_halofit_integrate(
+                                             &sc,
+                                             k_integrand,
+                                             pk_integrand,
+                                             integrand_size,
+                                             integrand,
+                                             ddintegrand,
+                                             R,
+                                             1,
+                                             &sum1
+                                             ),
+                   pfo->error_message,
+                   pfo->error_message);
+
+        if (sum1 > 1.)
+          xlogr1 = xlog_try;
+        else
+          xlogr2 = xlog_try;
+
+        /* stop as soon as the root is bracketed */
+        if (((direction == 1) && (sum1 <= 1.)) || ((direction == -1) && (sum1 > 1.)))
+          break;
+
+        step *= 2.;
+        xlog_try += direction*step;
+      }
+    }
+  }
+
   counter = 0;
   do {
     rmid = pow(10,(xlogr2+xlogr1)/2.0);
     counter ++;
 
     class_call(fourier_halofit_integrate(
-                                           pfo,
-                                           integrand_array,
-                                           integrand_size,
-                                           ia_size,
-                                           index_ia_k,
-                                           index_ia_pk,
-                                           index_ia_sum,
-                                           index_ia_ddsum,
-                                           rmid,
-                                           halofit_integral_one,
-                                           &sum1
-                                           ),
+                                         &sc,
+                                         k_integrand,
+                                         pk_integrand,
+                                         integrand_size,
+                                         integrand,
+                                         ddintegrand,
+                                         rmid,
+                                         1,
+                                         &sum1
+                                         ),
                pfo->error_message,
                pfo->error_message);
 
@@ -2875,39 +4017,25 @@ int fourier_halofit(
 
   } while (fabs(diff) > ppr->halofit_tol_sigma);
 
-  /* evaluate all the other integrals at R=rmid */
+  /* evaluate the three integrals at R=rmid in one pass */
 
   class_call(fourier_halofit_integrate(
-                                         pfo,
-                                         integrand_array,
-                                         integrand_size,
-                                         ia_size,
-                                         index_ia_k,
-                                         index_ia_pk,
-                                         index_ia_sum,
-                                         index_ia_ddsum,
-                                         rmid,
-                                         halofit_integral_two,
-                                         &sum2
-                                         ),
+                                       &sc,
+                                       k_integrand,
+                                       pk_integrand,
+                                       integrand_size,
+                                       integrand,
+                                       ddintegrand,
+                                       rmid,
+                                       3,
+                                       sum
+                                       ),
              pfo->error_message,
              pfo->error_message);
 
-  class_call(fourier_halofit_integrate(
-                                         pfo,
-                                         integrand_array,
-                                         integrand_size,
-                                         ia_size,
-                                         index_ia_k,
-                                         index_ia_pk,
-                                         index_ia_sum,
-                                         index_ia_ddsum,
-                                         rmid,
-                                         halofit_integral_three,
-                                         &sum3
-                                         ),
-             pfo->error_message,
-             pfo->error_message);
+  sum1 = sum[0];
+  sum2 = sum[1];
+  sum3 = sum[2];
 
   sigma  = sqrt(sum1);
   d1 = -sum2/sum1;
@@ -2987,82 +4115,297 @@ int fourier_halofit(
   }
 
   free(pvecback);
-  free(integrand_array);
+  free(k_integrand);
+  free(pk_integrand);
+  free(integrand);
+  free(ddintegrand);
+  array_spline_coefficients_free(&sc);
   return _SUCCESS_;
 }
 
 /**
  * Internal routione of Halofit. In original Halofit, this is
  * equivalent to the function wint(). It performs convolutions of the
- * linear spectrum with two window functions.
+ * linear spectrum with the Gaussian window function and its
+ * derivatives, i.e. the integrals over k of
+ * 1/(2(pi**2)) P(k) k**2 exp(-(kR)**2) times 1, 2 (kR)**2 and
+ * 4 (kR)**2 (1-(kR)**2).
+ *
+ * The integrands of all requested integrals are filled in one
+ * vectorized pass over k, splined together with the coefficients
+ * precomputed for this sampling in k, and integrated in one pass.
  *
- * @param pfo             Input: pointer to non linear structure
- * @param integrand_array Input: array with k, P_L(k) values
- * @param integrand_size  Input: one dimension of that array
- * @param ia_size         Input: other dimension of that array
- * @param index_ia_k      Input: index for k
- * @param index_ia_pk     Input: index for pk
- * @param index_ia_sum    Input: index for the result
- * @param index_ia_ddsum  Input: index for its spline
+ * @param psc             Input: spline coefficients of the sampling in k
+ * @param k               Input: sampled values of k (k[index_k])
+ * @param pk              Input: 1/(2(pi**2)) P_L(k) k**2 at these values
+ * @param integrand_size  Input: number of sampled values
+ * @param integrand       Input: workspace of size 3*integrand_size
+ * @param ddintegrand     Input: workspace of size 3*integrand_size
  * @param R               Input: radius
- * @param type            Input: which window function to use
- * @param sum             Output: result of the integral
+ * @param sum_size        Input: number of integrals (1 for the first one only, 3 for all)
+ * @param sum             Output: result of the integrals, sum[index_sum]
  * @return the error status
  */
 
 int fourier_halofit_integrate(
-                                struct fourier *pfo,
-                                double * integrand_array,
-                                int integrand_size,
-                                int ia_size,
-                                int index_ia_k,
-                                int index_ia_pk,
-                                int index_ia_sum,
-                                int index_ia_ddsum,
-                                double R,
-                                enum halofit_integral_type type,
-                                double * sum
-                                ) {
-
-  double k,pk,x2,integrand;
+                              struct spline_coefficients * psc,
+                              double * k,
+                              double * pk,
+                              int integrand_size,
+                              double * integrand,
+                              double * ddintegrand,
+                              double R,
+                              int sum_size,
+                              double * sum
+                              ) {
+
+  double x2,window,h;
+  double R2 = R*R;
   int index_k;
-  double anorm = 1./(2*pow(_PI_,2));
-
-  for (index_k=0; index_k < integrand_size; index_k++) {
-    k = integrand_array[index_k*ia_size + index_ia_k];
-    pk = integrand_array[index_k*ia_size + index_ia_pk];
-    x2 = k*k*R*R;
-
-    integrand = pk*k*k*anorm*exp(-x2);
-    if (type == halofit_integral_two) integrand *= 2.*x2;
-    if (type == halofit_integral_three) integrand *= 4.*x2*(1.-x2);
-
-    integrand_array[index_k*ia_size + index_ia_sum] = integrand;
+  int index_sum;
+  double * integrand_2 = integrand + integrand_size;
+  double * integrand_3 = integrand + 2*integrand_size;
+
+  /* fill in the integrands */
+  if (sum_size == 1) {
+    for (index_k=0; index_k < integrand_size; index_k++) {
+      integrand[index_k] = pk[index_k]*exp(-k[index_k]*k[index_k]*R2);
+    }
+  }
+  else {
+    for (index_k=0; index_k < integrand_size; index_k++) {
+      x2 = k[index_k]*k[index_k]*R2;
+      window = pk[index_k]*exp(-x2);
+      integrand[index_k] = window;
+      integrand_2[index_k] = window*(2.*x2);
+      integrand_3[index_k] = window*(4.*x2*(1.-x2));
+    }
   }
 
   /* fill in second derivatives */
-  class_call(array_spline(integrand_array,
-                          ia_size,
-                          integrand_size,
-                          index_ia_k,
-                          index_ia_sum,
-                          index_ia_ddsum,
-                          _SPLINE_NATURAL_,
-                          pfo->error_message),
-             pfo->error_message,
-             pfo->error_message);
+  array_spline_table_block(psc,
+                           integrand,
+                           ddintegrand,
+                           1,
+                           integrand_size,
+                           0,
+                           sum_size);
 
   /* integrate */
-  class_call(array_integrate_all_spline(integrand_array,
-                                        ia_size,
-                                        integrand_size,
-                                        index_ia_k,
-                                        index_ia_sum,
-                                        index_ia_ddsum,
-                                        sum,
-                                        pfo->error_message),
-             pfo->error_message,
-             pfo->error_message);
+  for (index_sum=0; index_sum < sum_size; index_sum++) {
+    sum[index_sum] = 0.;
+    for (index_k=0; index_k < integrand_size-1; index_k++) {
+      h = k[index_k+1]-k[index_k];
+      sum[index_sum] +=
+        (integrand[index_sum*integrand_size+index_k]+integrand[index_sum*integrand_size+index_k+1])*h/2.+
+        (ddintegrand[index_sum*integrand_size+index_k]+ddintegrand[index_sum*integrand_size+index_k+1])*h*h*h/24.;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute the non-linear corrections of HMcode at all times, for all
+ * types of spectra, and store R_NL=(P_NL/P_L)^1/2 when this is
+ * possible. The times are distributed dynamically among threads,
+ * each thread with its own copy of the linear spectra and of their
+ * second derivatives. Each thread receives its times in decreasing
+ * order: once the corrections could not be computed at a time, they
+ * cannot be at earlier times either, and these earlier times are
+ * only flagged (fourier_spectra() does not use them anyway).
+ *
+ * With hmcode_cache, the linear spectra and background quantities at
+ * each time are compared with those from which the sigma's of the
+ * workspace were computed. If anything differs, the sigma's are
+ * recomputed at this time.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param ppt Input: pointer to perturbation structure
+ * @param ppm Input: pointer to primordial structure
+ * @param pfo Input/Output: pointer to fourier structure
+ * @param pnw Input/Output: pointer to nonlinear workspace
+ * @param nl_corr_not_computable Output: nl_corr_not_computable[index_pk][index_tau] is _TRUE_ if the corrections could not be computed at this time
+ * @return the error status
+ */
+
+int fourier_hmcode_at_all_tau(
+                              struct precision *ppr,
+                              struct background *pba,
+                              struct perturbations *ppt,
+                              struct primordial *ppm,
+                              struct fourier *pfo,
+                              struct fourier_workspace * pnw,
+                              short ** nl_corr_not_computable
+                              ) {
+
+  int index_tau;
+  int index_pk;
+  int index_k;
+  int last_index;
+  short computable;
+  short sigmas_are_valid;
+  double * pk_nl;
+  double * lnpk_l_block;
+  double * ddlnpk_l_block;
+  double ** lnpk_l;
+  double ** ddlnpk_l;
+  double * pvecback;
+  int abort = _FALSE_;
+
+#pragma omp parallel private(index_tau,index_pk,index_k,last_index,computable,sigmas_are_valid,pk_nl,lnpk_l_block,ddlnpk_l_block,lnpk_l,ddlnpk_l,pvecback)
+  {
+    class_alloc_parallel(pk_nl,pfo->k_size*sizeof(double),pfo->error_message);
+    class_alloc_parallel(lnpk_l_block,pfo->pk_size*pfo->k_size_extra*sizeof(double),pfo->error_message);
+    class_alloc_parallel(ddlnpk_l_block,pfo->pk_size*pfo->k_size_extra*sizeof(double),pfo->error_message);
+    class_alloc_parallel(lnpk_l,pfo->pk_size*sizeof(double *),pfo->error_message);
+    class_alloc_parallel(ddlnpk_l,pfo->pk_size*sizeof(double *),pfo->error_message);
+    class_alloc_parallel(pvecback,pba->bg_size*sizeof(double),pfo->error_message);
+
+    if (abort == _FALSE_) {
+      for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+        lnpk_l[index_pk] = lnpk_l_block + index_pk*pfo->k_size_extra;
+        ddlnpk_l[index_pk] = ddlnpk_l_block + index_pk*pfo->k_size_extra;
+      }
+    }
+
+    computable = _TRUE_;
+    last_index = 0;
+
+#pragma omp for schedule(dynamic,1)
+    for (index_tau = pfo->tau_size-1; index_tau >= 0; index_tau--) {
+
+      if ((abort == _TRUE_) || (computable == _FALSE_)) {
+        for (index_pk=0; index_pk<pfo->pk_size; index_pk++)
+          nl_corr_not_computable[index_pk][index_tau] = _TRUE_;
+        continue;
+      }
+
+      /* get and spline P_L(k) at this time, for all types (HMcode
+         needs P_cb_l when evaluating P_m_nl) */
+      for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+
+        class_call_parallel(fourier_pk_linear(pba,
+                                              ppt,
+                                              ppm,
+                                              pfo,
+                                              index_pk,
+                                              pfo->tau_offset+index_tau,
+                                              pfo->k_size_extra,
+                                              lnpk_l[index_pk],
+                                              NULL),
+                            pfo->error_message,
+                            pfo->error_message);
+
+        class_call_parallel(array_spline_table_columns(pfo->ln_k,
+                                                       pfo->k_size_extra,
+                                                       lnpk_l[index_pk],
+                                                       1,
+                                                       ddlnpk_l[index_pk],
+                                                       _SPLINE_NATURAL_,
+                                                       pfo->error_message),
+                            pfo->error_message,
+                            pfo->error_message);
+      }
+
+      /* with the cache, check that the sigma's known at this time
+         were computed from the same linear spectra and background,
+         and keep the current ones for the next runs */
+      if ((ppr->hmcode_cache == _TRUE_) && (abort == _FALSE_)) {
+
+        class_call_parallel(background_at_tau(pba,pfo->tau[index_tau],long_info,inter_normal,&last_index,pvecback),
+                            pba->error_message,
+                            pfo->error_message);
+
+        sigmas_are_valid = ((pnw->cache_key[2*index_tau] == pfo->tau[index_tau]) &&
+                            (pnw->cache_key[2*index_tau+1] == pvecback[pba->index_bg_Omega_m]));
+
+        pnw->cache_key[2*index_tau] = pfo->tau[index_tau];
+        pnw->cache_key[2*index_tau+1] = pvecback[pba->index_bg_Omega_m];
+
+        for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+          if (memcmp(pnw->lnpk_l[index_pk]+index_tau*pfo->k_size_extra,lnpk_l[index_pk],pfo->k_size_extra*sizeof(double)) != 0) {
+            sigmas_are_valid = _FALSE_;
+            memcpy(pnw->lnpk_l[index_pk]+index_tau*pfo->k_size_extra,lnpk_l[index_pk],pfo->k_size_extra*sizeof(double));
+          }
+        }
+
+        if (sigmas_are_valid == _FALSE_) {
+          for (index_pk=0; index_pk<pfo->pk_size; index_pk++)
+            pnw->sigmas_known[index_pk][index_tau] = _FALSE_;
+        }
+      }
+
+      /* loop over index_pk, defined such that it is ensured that
+         index_pk starts at index_pk_cb when neutrinos are
+         included. This is necessary, since the sigma table needs to
+         be filled for sigma_cb only. */
+      for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+
+        if ((abort == _TRUE_) || (computable == _FALSE_)) {
+          nl_corr_not_computable[index_pk][index_tau] = _TRUE_;
+          continue;
+        }
+
+        /* (preliminary step: fill table of sigma's, only for _cb if there is both _cb and _m) */
+        if ((index_pk == 0) && (pnw->sigmas_known[index_pk][index_tau] == _FALSE_)) {
+          class_call_parallel(fourier_hmcode_fill_sigtab(ppr,
+                                                         pba,
+                                                         ppt,
+                                                         ppm,
+                                                         pfo,
+                                                         index_tau,
+                                                         lnpk_l[index_pk],
+                                                         ddlnpk_l[index_pk],
+                                                         pnw),
+                              pfo->error_message,
+                              pfo->error_message);
+        }
+
+        /* get P_NL(k) at this time */
+        class_call_parallel(fourier_hmcode(ppr,
+                                           pba,
+                                           ppt,
+                                           ppm,
+                                           pfo,
+                                           index_pk,
+                                           index_tau,
+                                           pfo->tau[index_tau],
+                                           pk_nl,
+                                           lnpk_l,
+                                           ddlnpk_l,
+                                           &(pfo->k_nl[index_pk][index_tau]),
+                                           &(nl_corr_not_computable[index_pk][index_tau]),
+                                           pnw),
+                            pfo->error_message,
+                            pfo->error_message);
+
+        if (abort == _TRUE_)
+          continue;
+
+        /* infer and store R_NL=(P_NL/P_L)^1/2 */
+        if (nl_corr_not_computable[index_pk][index_tau] == _FALSE_) {
+          for (index_k=0; index_k<pfo->k_size; index_k++) {
+            pfo->nl_corr_density[index_pk][index_tau * pfo->k_size + index_k] = sqrt(pk_nl[index_k]/exp(lnpk_l[index_pk][index_k]));
+          }
+        }
+        else {
+          computable = _FALSE_;
+        }
+      }
+    }
+
+    free(pk_nl);
+    free(lnpk_l_block);
+    free(ddlnpk_l_block);
+    free(lnpk_l);
+    free(ddlnpk_l);
+    free(pvecback);
+  }
+
+  if (abort == _TRUE_)
+    return _FAILURE_;
 
   return _SUCCESS_;
 }
@@ -3111,6 +4454,7 @@ int fourier_hmcode(
   int last_index=0;
   int index_pk_cb;
   int counter, index_nl;
+  short sigmas_known;
 
   int index_nu, index_cut;
   int index_y;
@@ -3205,41 +4549,51 @@ int fourier_hmcode(
   }
 
 
-  /** Get sigma(R=8 Mpc/h), sigma_disp(R=0), sigma_disp(R=100 Mpc/h) and write them into pfo structure */
+  /** Get sigma(R=8 Mpc/h), sigma_disp(R=0), sigma_disp(R=100 Mpc/h) and write them into the workspace (unless they are already known) */
 
-  class_call(fourier_sigmas(pfo,
-                              8./pba->h,
-                              lnpk_l[index_pk],ddlnpk_l[index_pk],
-                              pfo->k_size_extra,
-                              ppr->sigma_k_per_decade,
-                              out_sigma,
-                              &sigma8),
-             pfo->error_message,
-             pfo->error_message);
+  sigmas_known = pnw->sigmas_known[index_pk][index_tau];
 
-  class_call(fourier_sigmas(pfo,
-                              0.,
-                              lnpk_l[index_pk],ddlnpk_l[index_pk],
-                              pfo->k_size_extra,
-                              ppr->sigma_k_per_decade,
-                              out_sigma_disp,
-                              &sigma_disp),
-             pfo->error_message,
-             pfo->error_message);
+  if (sigmas_known == _FALSE_) {
+
+    class_call(fourier_sigmas(pfo,
+                                8./pba->h,
+                                lnpk_l[index_pk],ddlnpk_l[index_pk],
+                                pfo->k_size_extra,
+                                ppr->sigma_k_per_decade,
+                                out_sigma,
+                                &sigma8),
+               pfo->error_message,
+               pfo->error_message);
+
+    class_call(fourier_sigmas(pfo,
+                                0.,
+                                lnpk_l[index_pk],ddlnpk_l[index_pk],
+                                pfo->k_size_extra,
+                                ppr->sigma_k_per_decade,
+                                out_sigma_disp,
+                                &sigma_disp),
+               pfo->error_message,
+               pfo->error_message);
 
-  class_call(fourier_sigmas(pfo,
-                              100./pba->h,
-                              lnpk_l[index_pk],ddlnpk_l[index_pk],
-                              pfo->k_size_extra,
-                              ppr->sigma_k_per_decade,
-                              out_sigma_disp,
-                              &sigma_disp100),
-             pfo->error_message,
-             pfo->error_message);
+    class_call(fourier_sigmas(pfo,
+                                100./pba->h,
+                                lnpk_l[index_pk],ddlnpk_l[index_pk],
+                                pfo->k_size_extra,
+                                ppr->sigma_k_per_decade,
+                                out_sigma_disp,
+                                &sigma_disp100),
+               pfo->error_message,
+               pfo->error_message);
 
-  pnw->sigma_8[index_pk][index_tau] = sigma8;
-  pnw->sigma_disp[index_pk][index_tau] = sigma_disp;
-  pnw->sigma_disp_100[index_pk][index_tau] = sigma_disp100;
+    pnw->sigma_8[index_pk][index_tau] = sigma8;
+    pnw->sigma_disp[index_pk][index_tau] = sigma_disp;
+    pnw->sigma_disp_100[index_pk][index_tau] = sigma_disp100;
+  }
+  else {
+    sigma8 = pnw->sigma_8[index_pk][index_tau];
+    sigma_disp = pnw->sigma_disp[index_pk][index_tau];
+    sigma_disp100 = pnw->sigma_disp_100[index_pk][index_tau];
+  }
 
   /** Initialisation steps for the 1-Halo Power Integral */
   mmin=ppr->mmin_for_p1h_integral/pba->h; //Minimum mass for integration; (unit conversion from  m[Msun/h] to m[Msun]  )
@@ -3280,8 +4634,8 @@ int fourier_hmcode(
 
     class_call(array_interpolate_spline(pnw->rtab,
                                         nsig,
-                                        pnw->stab,
-                                        pnw->ddstab,
+                                        pnw->stab+index_tau*nsig,
+                                        pnw->ddstab+index_tau*nsig,
                                         1,
                                         r,
                                         &last_index,
@@ -3292,8 +4646,8 @@ int fourier_hmcode(
 
     class_call(array_interpolate_spline(pnw->rtab,
                                         nsig,
-                                        pnw->stab,
-                                        pnw->ddstab,
+                                        pnw->stab+index_tau*nsig,
+                                        pnw->ddstab+index_tau*nsig,
                                         1,
                                         r*fraction,
                                         &last_index,
@@ -3325,64 +4679,77 @@ int fourier_hmcode(
     return _SUCCESS_;
   }
 
-  /* make a first guess for the nonlinear scale */
-  class_call(array_interpolate_two_arrays_one_column(
-                                                     nu_arr,
-                                                     r_real,
-                                                     1,
-                                                     0,
-                                                     ppr->nsteps_for_p1h_integral,
-                                                     nu_nl,
-                                                     &r_nl,
-                                                     pfo->error_message),
-             pfo->error_message, pfo->error_message);
+  /* find the non-linear scale, unless it is already known */
+  if (sigmas_known == _FALSE_) {
 
-  class_call(array_search_bisect(ppr->nsteps_for_p1h_integral,nu_arr,nu_nl,&index_nl,pfo->error_message), pfo->error_message, pfo->error_message);
+    /* make a first guess for the nonlinear scale */
+    class_call(array_interpolate_two_arrays_one_column(
+                                                       nu_arr,
+                                                       r_real,
+                                                       1,
+                                                       0,
+                                                       ppr->nsteps_for_p1h_integral,
+                                                       nu_nl,
+                                                       &r_nl,
+                                                       pfo->error_message),
+               pfo->error_message, pfo->error_message);
 
-  r1 = r_real[index_nl-1];
-  r2 = r_real[index_nl+2];
+    class_call(array_search_bisect(ppr->nsteps_for_p1h_integral,nu_arr,nu_nl,&index_nl,pfo->error_message), pfo->error_message, pfo->error_message);
 
-  /* // for debugging: (if it happens that r_nl is not between r1 and r2, which should never be the case)
-     fprintf(stdout, "%e %e %e %e\n", r1, nu_arr[index_nl-1], r2, nu_arr[index_nl+2]);
-  */
+    r1 = r_real[index_nl-1];
+    r2 = r_real[index_nl+2];
 
-  /* do bisectional iteration between r1 and r2 to find the precise value of r_nl */
-  counter = 0;
-  do {
-    r_nl = (r1+r2)/2.;
-    counter ++;
+    /* // for debugging: (if it happens that r_nl is not between r1 and r2, which should never be the case)
+       fprintf(stdout, "%e %e %e %e\n", r1, nu_arr[index_nl-1], r2, nu_arr[index_nl+2]);
+    */
 
-    class_call(fourier_sigmas(pfo,
-                                r_nl,
-                                lnpk_l[index_pk_cb],ddlnpk_l[index_pk_cb],
-                                pfo->k_size_extra,
-                                ppr->sigma_k_per_decade,
-                                out_sigma,
-                                &sigma_nl),
-               pfo->error_message, pfo->error_message);
+    /* do bisectional iteration between r1 and r2 to find the precise value of r_nl */
+    counter = 0;
+    do {
+      r_nl = (r1+r2)/2.;
+      counter ++;
+
+      class_call(fourier_sigmas(pfo,
+                                  r_nl,
+                                  lnpk_l[index_pk_cb],ddlnpk_l[index_pk_cb],
+                                  pfo->k_size_extra,
+                                  ppr->sigma_k_per_decade,
+                                  out_sigma,
+                                  &sigma_nl),
+                 pfo->error_message, pfo->error_message);
 
-    diff = sigma_nl - delta_c;
+      diff = sigma_nl - delta_c;
 
-    if (diff > ppr->hmcode_tol_sigma){
-      r1=r_nl;
-    }
-    else if (diff < -ppr->hmcode_tol_sigma) {
-      r2 = r_nl;
-    }
+      if (diff > ppr->hmcode_tol_sigma){
+        r1=r_nl;
+      }
+      else if (diff < -ppr->hmcode_tol_sigma) {
+        r2 = r_nl;
+      }
 
-    class_test(counter > _MAX_IT_,
-               pfo->error_message,
-               "could not converge within maximum allowed number of iterations");
+      class_test(counter > _MAX_IT_,
+                 pfo->error_message,
+                 "could not converge within maximum allowed number of iterations");
+
+    } while (fabs(diff) > ppr->hmcode_tol_sigma);
 
-  } while (fabs(diff) > ppr->hmcode_tol_sigma);
+    if (pfo->fourier_verbose>5){
+      fprintf(stdout, "number of iterations for r_nl at z = %e: %d\n", z_at_tau, counter);
+    }
 
-  if (pfo->fourier_verbose>5){
-    fprintf(stdout, "number of iterations for r_nl at z = %e: %d\n", z_at_tau, counter);
+    pnw->r_nl[index_pk][index_tau] = r_nl;
+    pnw->sigma_nl[index_pk][index_tau] = sigma_nl;
+  }
+  else {
+    r_nl = pnw->r_nl[index_pk][index_tau];
+    sigma_nl = pnw->sigma_nl[index_pk][index_tau];
   }
+
   *k_nl = 1./r_nl;
 
   if (*k_nl > pfo->k[pfo->k_size-1]) {
     * nl_corr_not_computable_at_this_k = _TRUE_;
+    pnw->sigmas_known[index_pk][index_tau] = _TRUE_;
     free(mass);
     free(r_real);
     free(r_virial);
@@ -3397,22 +4764,29 @@ int fourier_hmcode(
 
   /* call sigma_prime function at r_nl to find the effective spectral index n_eff */
 
-  class_call(fourier_sigmas(pfo,
-                              r_nl,
-                              lnpk_l[index_pk_cb],ddlnpk_l[index_pk_cb],
-                              pfo->k_size_extra,
-                              ppr->sigma_k_per_decade,
-                              out_sigma_prime,
-                              &sigma_prime),
-             pfo->error_message,
-             pfo->error_message);
+  if (sigmas_known == _FALSE_) {
+
+    class_call(fourier_sigmas(pfo,
+                                r_nl,
+                                lnpk_l[index_pk_cb],ddlnpk_l[index_pk_cb],
+                                pfo->k_size_extra,
+                                ppr->sigma_k_per_decade,
+                                out_sigma_prime,
+                                &sigma_prime),
+               pfo->error_message,
+               pfo->error_message);
+
+    pnw->sigma_prime[index_pk][index_tau] = sigma_prime;
+    pnw->sigmas_known[index_pk][index_tau] = _TRUE_;
+  }
+  else {
+    sigma_prime = pnw->sigma_prime[index_pk][index_tau];
+  }
 
   dlnsigdlnR = r_nl*pow(sigma_nl, -2)*sigma_prime;
   n_eff = -3.- dlnsigdlnR;
   alpha = 3.24*pow(1.85, n_eff);
 
-  pnw->sigma_prime[index_pk][index_tau] = sigma_prime;
-
   /** Calculate halo concentration-mass relation conc(mass) (Bullock et al. 2001) */
   class_alloc(conc,ppr->nsteps_for_p1h_integral*sizeof(double),pfo->error_message);
 
@@ -3477,6 +4851,7 @@ int fourier_hmcode(
       //get the nu^eta-value of the window
       class_call(fourier_hmcode_window_nfw(
                                              pfo,
+                                             pnw,
                                              pow(nu_arr[index_mass], eta)*pfo->k[index_k],
                                              r_virial[index_mass],
                                              conc[index_mass],
@@ -3596,14 +4971,26 @@ int fourier_hmcode_workspace_init(
                                     struct fourier_workspace * pnw
                                     ){
 
-  int ng;
-  int index_pk;
+  int ng, nsig;
+  int index_pk, index_tau, i;
+  double rmin, rmax;
 
   /** - allocate arrays of the nonlinear workspace */
 
-  class_alloc(pnw->rtab,ppr->n_hmcode_tables*sizeof(double),pfo->error_message);
-  class_alloc(pnw->stab,ppr->n_hmcode_tables*sizeof(double),pfo->error_message);
-  class_alloc(pnw->ddstab,ppr->n_hmcode_tables*sizeof(double),pfo->error_message);
+  nsig = ppr->n_hmcode_tables;
+
+  class_alloc(pnw->rtab,nsig*sizeof(double),pfo->error_message);
+  class_alloc(pnw->stab,pfo->tau_size*nsig*sizeof(double),pfo->error_message);
+  class_alloc(pnw->ddstab,pfo->tau_size*nsig*sizeof(double),pfo->error_message);
+
+  /** - fill the values of r of the tables of sigma's, the same at all times */
+
+  rmin = ppr->rmin_for_sigtab/pba->h;
+  rmax = ppr->rmax_for_sigtab/pba->h;
+
+  for (i=0;i<nsig;i++){
+    pnw->rtab[i]=exp(log(rmin)+log(rmax/rmin)*i/(nsig-1));
+  }
 
   ng = ppr->n_hmcode_tables;
 
@@ -3616,13 +5003,42 @@ int fourier_hmcode_workspace_init(
   class_alloc(pnw->sigma_disp_100,pfo->pk_size*sizeof(double *),pfo->error_message);
   class_alloc(pnw->sigma_prime,pfo->pk_size*sizeof(double *),pfo->error_message);
 
+  class_alloc(pnw->r_nl,pfo->pk_size*sizeof(double *),pfo->error_message);
+  class_alloc(pnw->sigma_nl,pfo->pk_size*sizeof(double *),pfo->error_message);
+  class_alloc(pnw->sigmas_known,pfo->pk_size*sizeof(short *),pfo->error_message);
+
   for (index_pk=0; index_pk<pfo->pk_size; index_pk++){
     class_alloc(pnw->sigma_8[index_pk],pfo->tau_size*sizeof(double),pfo->error_message);
     class_alloc(pnw->sigma_disp[index_pk],pfo->tau_size*sizeof(double),pfo->error_message);
         class_alloc(pnw->sigma_disp_100[index_pk],pfo->tau_size*sizeof(double),pfo->error_message);
         class_alloc(pnw->sigma_prime[index_pk],pfo->tau_size*sizeof(double),pfo->error_message);
+    class_alloc(pnw->r_nl[index_pk],pfo->tau_size*sizeof(double),pfo->error_message);
+    class_alloc(pnw->sigma_nl[index_pk],pfo->tau_size*sizeof(double),pfo->error_message);
+    class_alloc(pnw->sigmas_known[index_pk],pfo->tau_size*sizeof(short),pfo->error_message);
+    for (index_tau=0; index_tau<pfo->tau_size; index_tau++)
+      pnw->sigmas_known[index_pk][index_tau] = _FALSE_;
   }
 
+  /** - with the cache, allocate the arrays keeping the linear spectra
+        and background quantities from which the sigma's are computed */
+
+  if (ppr->hmcode_cache == _TRUE_) {
+    class_alloc(pnw->lnpk_l,pfo->pk_size*sizeof(double *),pfo->error_message);
+    for (index_pk=0; index_pk<pfo->pk_size; index_pk++)
+      class_calloc(pnw->lnpk_l[index_pk],pfo->tau_size*pfo->k_size_extra,sizeof(double),pfo->error_message);
+    class_calloc(pnw->cache_key,2*pfo->tau_size,sizeof(double),pfo->error_message);
+  }
+  else {
+    pnw->lnpk_l = NULL;
+    pnw->cache_key = NULL;
+  }
+
+  /** - get the table of the NFW window */
+
+  class_call(fourier_hmcode_nfw_table_init(ppr,pfo,pnw),
+             pfo->error_message,
+             pfo->error_message);
+
   /** - fill table with scale independent growth factor */
 
   class_call(fourier_hmcode_fill_growtab(ppr,pba,pfo,pnw),
@@ -3660,12 +5076,27 @@ int fourier_hmcode_workspace_free(
     free(pnw->sigma_disp[index_pk]);
     free(pnw->sigma_disp_100[index_pk]);
     free(pnw->sigma_prime[index_pk]);
+    free(pnw->r_nl[index_pk]);
+    free(pnw->sigma_nl[index_pk]);
+    free(pnw->sigmas_known[index_pk]);
   }
 
   free(pnw->sigma_8);
   free(pnw->sigma_disp);
   free(pnw->sigma_disp_100);
   free(pnw->sigma_prime);
+  free(pnw->r_nl);
+  free(pnw->sigma_nl);
+  free(pnw->sigmas_known);
+
+  if (pnw->lnpk_l != NULL) {
+    for (index_pk=0; index_pk<pfo->pk_size; index_pk++)
+      free(pnw->lnpk_l[index_pk]);
+    free(pnw->lnpk_l);
+    free(pnw->cache_key);
+  }
+
+  free(pnw->nfw_window);
 
   return _SUCCESS_;
 }
@@ -3794,10 +5225,12 @@ int fourier_hmcode_baryonic_feedback(
 }
 
 /**
- * Function that fills pnw->rtab, pnw->stab and pnw->ddstab with (r,
- * sigma, ddsigma) logarithmically spaced in r.  Called by
- * fourier_init at for all tau to account for scale-dependant growth
- * before fourier_hmcode is called
+ * Function that fills pnw->stab and pnw->ddstab at index_tau with
+ * (sigma, ddsigma) at the values of r of pnw->rtab, logarithmically
+ * spaced.  Called by fourier_hmcode_at_all_tau() for all tau to
+ * account for scale-dependant growth before fourier_hmcode is called.
+ * If ppr->sigma_fftlog is set, sigma(R) is obtained for all radii
+ * from a single call to fourier_sigmas_fftlog().
  *
  * @param ppr Input: pointer to precision structure
  * @param pba Input: pointer to background structure
@@ -3828,11 +5261,60 @@ int fourier_hmcode_fill_sigtab(
   double sig;
   double * sigtab;
   int i, index_r, index_sig, index_ddsig, index_n, nsig;
+  double * ln_r_fftlog=NULL;
+  double * sig_fftlog=NULL;
+  double * ddsig_fftlog=NULL;
+  int fftlog_size=0;
+  int last_index=0;
+  double rmin_fftlog=0., rmax_fftlog=0.;
 
   rmin = ppr->rmin_for_sigtab/pba->h;
   rmax = ppr->rmax_for_sigtab/pba->h;
   nsig = ppr->n_hmcode_tables;
 
+  /** - with the FFTLog method, get sigma(R) on a fine logarithmic
+        grid in one go and spline it along ln(R) */
+
+  if (ppr->sigma_fftlog == _TRUE_) {
+
+    rmin_fftlog = _SIGMA_FFTLOG_KR_MIN_/pfo->k[pfo->k_size_extra-1];
+    rmax_fftlog = 1./pfo->k[0];
+
+    class_call(fourier_sigmas_fftlog_size(pfo,
+                                          pfo->k_size_extra,
+                                          ppr->sigma_k_per_decade,
+                                          &fftlog_size),
+               pfo->error_message,
+               pfo->error_message);
+
+    class_alloc(ln_r_fftlog,fftlog_size*sizeof(double),pfo->error_message);
+    class_alloc(sig_fftlog,fftlog_size*sizeof(double),pfo->error_message);
+    class_alloc(ddsig_fftlog,fftlog_size*sizeof(double),pfo->error_message);
+
+    class_call(fourier_sigmas_fftlog(pfo,
+                                     lnpk_l,
+                                     ddlnpk_l,
+                                     pfo->k_size_extra,
+                                     ppr->sigma_k_per_decade,
+                                     fftlog_size,
+                                     ln_r_fftlog,
+                                     sig_fftlog,
+                                     NULL,
+                                     NULL),
+               pfo->error_message,
+               pfo->error_message);
+
+    class_call(array_spline_table_columns(ln_r_fftlog,
+                                          fftlog_size,
+                                          sig_fftlog,
+                                          1,
+                                          ddsig_fftlog,
+                                          _SPLINE_EST_DERIV_,
+                                          pfo->error_message),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
   i=0;
   index_r=i;
   i++;
@@ -3847,16 +5329,32 @@ int fourier_hmcode_fill_sigtab(
   for (i=0;i<nsig;i++){
     r=exp(log(rmin)+log(rmax/rmin)*i/(nsig-1));
 
-    class_call(fourier_sigmas(pfo,
-                                r,
-                                lnpk_l,
-                                ddlnpk_l,
-                                pfo->k_size_extra,
-                                ppr->sigma_k_per_decade,
-                                out_sigma,
-                                &sig),
-               pfo->error_message,
-               pfo->error_message);
+    if ((ppr->sigma_fftlog == _TRUE_) && (r >= rmin_fftlog) && (r <= rmax_fftlog)) {
+      class_call(array_interpolate_spline(ln_r_fftlog,
+                                          fftlog_size,
+                                          sig_fftlog,
+                                          ddsig_fftlog,
+                                          1,
+                                          log(r),
+                                          &last_index,
+                                          &sig,
+                                          1,
+                                          pfo->error_message),
+                 pfo->error_message,
+                 pfo->error_message);
+    }
+    else {
+      class_call(fourier_sigmas(pfo,
+                                  r,
+                                  lnpk_l,
+                                  ddlnpk_l,
+                                  pfo->k_size_extra,
+                                  ppr->sigma_k_per_decade,
+                                  out_sigma,
+                                  &sig),
+                 pfo->error_message,
+                 pfo->error_message);
+    }
 
     sigtab[i*index_n+index_r]=r;
     sigtab[i*index_n+index_sig]=sig;
@@ -3872,22 +5370,19 @@ int fourier_hmcode_fill_sigtab(
 						  pfo->error_message),
              pfo->error_message,
              pfo->error_message);
-  if (index_tau == pfo->tau_size-1){
-    for (i=0;i<nsig;i++){
-      pnw->rtab[i] = sigtab[i*index_n+index_r];
-      pnw->stab[i] = sigtab[i*index_n+index_sig];
-      pnw->ddstab[i] = sigtab[i*index_n+index_ddsig];
-    }
-  }
-  else{
-    for (i=0;i<nsig;i++){
-      pnw->stab[i] = sigtab[i*index_n+index_sig];
-      pnw->ddstab[i] = sigtab[i*index_n+index_ddsig];
-    }
+  for (i=0;i<nsig;i++){
+    pnw->stab[index_tau*nsig+i] = sigtab[i*index_n+index_sig];
+    pnw->ddstab[index_tau*nsig+i] = sigtab[i*index_n+index_ddsig];
   }
 
   free(sigtab);
 
+  if (ppr->sigma_fftlog == _TRUE_) {
+    free(ln_r_fftlog);
+    free(sig_fftlog);
+    free(ddsig_fftlog);
+  }
+
   return _SUCCESS_;
 }
 
@@ -4062,10 +5557,123 @@ int fourier_hmcode_growint(
   return _SUCCESS_;
 }
 
+/**
+ * Table of the NFW window kept in memory by
+ * fourier_hmcode_nfw_table_init(), and number of points per decade
+ * with which it was computed (zero if there is none).
+ */
+
+static double * fourier_hmcode_nfw_window = NULL;
+static int fourier_hmcode_nfw_points_per_decade = 0;
+
+/**
+ * Get the table of the fourier transform of the NFW density profile,
+ * W(k r_s, c), on a grid of log(k r_s) and log(c) with
+ * hmcode_nfw_points_per_decade points per decade, in the ranges
+ * defined in fourier.h. The table does not depend on cosmology: it is
+ * computed once, and copied from memory by the next runs. If
+ * hmcode_nfw_points_per_decade is zero, pnw->nfw_window is NULL.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pfo Input: pointer to fourier structure
+ * @param pnw Output: pointer to nonlinear workspace
+ * @return the error status
+ */
+
+int fourier_hmcode_nfw_table_init(
+                                  struct precision *ppr,
+                                  struct fourier * pfo,
+                                  struct fourier_workspace * pnw
+                                  ){
+
+  int index_ks, index_c;
+  int found;
+  double * window;
+  double * old_window;
+  int abort;
+
+  pnw->nfw_window = NULL;
+
+  if (ppr->hmcode_nfw_points_per_decade <= 0)
+    return _SUCCESS_;
+
+  pnw->nfw_ks_size = (int)(log10(_HMCODE_NFW_TABLE_KS_MAX_/_HMCODE_NFW_TABLE_KS_MIN_)*ppr->hmcode_nfw_points_per_decade)+1;
+  pnw->nfw_c_size = (int)(log10(_HMCODE_NFW_TABLE_C_MAX_/_HMCODE_NFW_TABLE_C_MIN_)*ppr->hmcode_nfw_points_per_decade)+1;
+  pnw->nfw_ln_ks_min = log(_HMCODE_NFW_TABLE_KS_MIN_);
+  pnw->nfw_dln_ks = log(_HMCODE_NFW_TABLE_KS_MAX_/_HMCODE_NFW_TABLE_KS_MIN_)/(pnw->nfw_ks_size-1);
+  pnw->nfw_ln_c_min = log(_HMCODE_NFW_TABLE_C_MIN_);
+  pnw->nfw_dln_c = log(_HMCODE_NFW_TABLE_C_MAX_/_HMCODE_NFW_TABLE_C_MIN_)/(pnw->nfw_c_size-1);
+
+  class_alloc(window,pnw->nfw_ks_size*pnw->nfw_c_size*sizeof(double),pfo->error_message);
+
+  found = _FALSE_;
+
+#pragma omp critical (fourier_hmcode_nfw)
+  {
+    if ((fourier_hmcode_nfw_window != NULL) &&
+        (fourier_hmcode_nfw_points_per_decade == ppr->hmcode_nfw_points_per_decade)) {
+      memcpy(window,fourier_hmcode_nfw_window,pnw->nfw_ks_size*pnw->nfw_c_size*sizeof(double));
+      found = _TRUE_;
+    }
+  }
+
+  if (found == _FALSE_) {
+
+    /* pnw->nfw_window is still NULL, so that the window is computed from sine and cosine integrals */
+
+    abort = _FALSE_;
+
+#pragma omp parallel for private(index_ks) schedule(static)
+    for (index_c=0; index_c<pnw->nfw_c_size; index_c++) {
+      for (index_ks=0; index_ks<pnw->nfw_ks_size; index_ks++) {
+        /* with k=k_s c and r_v=1, the window is computed at k r_s */
+        class_call_parallel(fourier_hmcode_window_nfw(pfo,
+                                                      pnw,
+                                                      exp(pnw->nfw_ln_ks_min+index_ks*pnw->nfw_dln_ks+pnw->nfw_ln_c_min+index_c*pnw->nfw_dln_c),
+                                                      1.,
+                                                      exp(pnw->nfw_ln_c_min+index_c*pnw->nfw_dln_c),
+                                                      &(window[index_c*pnw->nfw_ks_size+index_ks])),
+                            pfo->error_message,
+                            pfo->error_message);
+      }
+    }
+
+    if (abort == _TRUE_) {
+      free(window);
+      return _FAILURE_;
+    }
+
+    /* keep a copy for the next runs */
+    class_alloc(old_window,pnw->nfw_ks_size*pnw->nfw_c_size*sizeof(double),pfo->error_message);
+    memcpy(old_window,window,pnw->nfw_ks_size*pnw->nfw_c_size*sizeof(double));
+
+#pragma omp critical (fourier_hmcode_nfw)
+    {
+      double * swap = fourier_hmcode_nfw_window;
+      fourier_hmcode_nfw_window = old_window;
+      fourier_hmcode_nfw_points_per_decade = ppr->hmcode_nfw_points_per_decade;
+      old_window = swap;
+    }
+
+    free(old_window);
+  }
+
+  pnw->nfw_window = window;
+
+  return _SUCCESS_;
+}
+
 /**
  * This is the fourier transform of the NFW density profile.
  *
+ * When the table of pnw is available, and k r_s and c are inside it
+ * with k r_v below _HMCODE_NFW_TABLE_KRV_MAX_, the window is
+ * interpolated in it with a cubic Lagrange polynomial in log(k r_s)
+ * and log(c). Otherwise, it is computed from sine and cosine
+ * integrals.
+ *
  * @param pfo Input: pointer to fourier structure
+ * @param pnw Input: pointer to nonlinear workspace
  * @param k   Input: wave vector
  * @param rv  Input: virial radius
  * @param c   Input: concentration = rv/rs (with scale radius rs)
@@ -4075,6 +5683,7 @@ int fourier_hmcode_growint(
 
 int fourier_hmcode_window_nfw(
                                 struct fourier * pfo,
+                                struct fourier_workspace * pnw,
                                 double k,
                                 double rv,
                                 double c,
@@ -4082,9 +5691,46 @@ int fourier_hmcode_window_nfw(
                                 ){
   double si1, si2, ci1, ci2, ks;
   double p1, p2, p3;
+  double x, y, wx[4], wy[4], line;
+  int index_ks, index_c, i, j;
+  double * table;
 
   ks = k*rv/c;
 
+  if ((pnw->nfw_window != NULL) &&
+      (ks >= _HMCODE_NFW_TABLE_KS_MIN_) && (ks <= _HMCODE_NFW_TABLE_KS_MAX_) &&
+      (c >= _HMCODE_NFW_TABLE_C_MIN_) && (c <= _HMCODE_NFW_TABLE_C_MAX_) &&
+      (ks*c <= _HMCODE_NFW_TABLE_KRV_MAX_)) {
+
+    /* position in the table, and first of the four nodes in each direction */
+    x = (log(ks)-pnw->nfw_ln_ks_min)/pnw->nfw_dln_ks;
+    y = (log(c)-pnw->nfw_ln_c_min)/pnw->nfw_dln_c;
+    index_ks = MAX(0,MIN((int)x-1,pnw->nfw_ks_size-4));
+    index_c = MAX(0,MIN((int)y-1,pnw->nfw_c_size-4));
+    x -= index_ks;
+    y -= index_c;
+
+    wx[0] = -(x-1.)*(x-2.)*(x-3.)/6.;
+    wx[1] = x*(x-2.)*(x-3.)/2.;
+    wx[2] = -x*(x-1.)*(x-3.)/2.;
+    wx[3] = x*(x-1.)*(x-2.)/6.;
+    wy[0] = -(y-1.)*(y-2.)*(y-3.)/6.;
+    wy[1] = y*(y-2.)*(y-3.)/2.;
+    wy[2] = -y*(y-1.)*(y-3.)/2.;
+    wy[3] = y*(y-1.)*(y-2.)/6.;
+
+    *window_nfw = 0.;
+    for (j=0; j<4; j++) {
+      table = pnw->nfw_window + (index_c+j)*pnw->nfw_ks_size + index_ks;
+      line = 0.;
+      for (i=0; i<4; i++)
+        line += wx[i]*table[i];
+      *window_nfw += wy[j]*line;
+    }
+
+    return _SUCCESS_;
+  }
+
   class_call(sine_integral(
                            ks*(1.+c),
                            &si2,
@@ -4147,6 +5793,248 @@ int fourier_hmcode_halomassfunction(
   return _SUCCESS_;
 }
 
+/**
+ * Quantities of HMcode kept in memory by fourier_hmcode_cache_store().
+ */
+
+static struct fourier_hmcode_cache fourier_hmcode_cache_slot;
+
+/**
+ * Fill the parameters on which the cached quantities of HMcode depend
+ * (the arrays are set to NULL).
+ *
+ * @param ppr   Input: pointer to precision structure
+ * @param pba   Input: pointer to background structure
+ * @param pfo   Input: pointer to fourier structure
+ * @param cache Output: cache with its parameters set
+ */
+
+static void fourier_hmcode_cache_parameters(
+                                            struct precision *ppr,
+                                            struct background *pba,
+                                            struct fourier *pfo,
+                                            struct fourier_hmcode_cache * cache
+                                            ) {
+
+  memset(cache,0,sizeof(struct fourier_hmcode_cache));
+
+  cache->pk_size = pfo->pk_size;
+  cache->tau_size = pfo->tau_size;
+  cache->k_size_extra = pfo->k_size_extra;
+  cache->n_hmcode_tables = ppr->n_hmcode_tables;
+  cache->nsteps_for_p1h_integral = ppr->nsteps_for_p1h_integral;
+  cache->rmin_for_sigtab = ppr->rmin_for_sigtab;
+  cache->rmax_for_sigtab = ppr->rmax_for_sigtab;
+  cache->sigma_k_per_decade = ppr->sigma_k_per_decade;
+  cache->sigma_fftlog = ppr->sigma_fftlog;
+  cache->hmcode_tol_sigma = ppr->hmcode_tol_sigma;
+  cache->mmin_for_p1h_integral = ppr->mmin_for_p1h_integral;
+  cache->mmax_for_p1h_integral = ppr->mmax_for_p1h_integral;
+  cache->h = pba->h;
+  cache->Omega0_m = pba->Omega0_m;
+  cache->Omega0_ncdm_tot = pba->Omega0_ncdm_tot;
+}
+
+/**
+ * Free the arrays of a cache.
+ *
+ * @param cache Input/Output: cache
+ */
+
+static void fourier_hmcode_cache_free_arrays(
+                                             struct fourier_hmcode_cache * cache
+                                             ) {
+  free(cache->ln_k);
+  free(cache->cache_key);
+  free(cache->lnpk_l);
+  free(cache->stab);
+  free(cache->ddstab);
+  free(cache->sigmas);
+  free(cache->sigmas_known);
+}
+
+/**
+ * Copy the sigma's of the workspace, and the linear spectra and
+ * background quantities from which they were computed, to the arrays
+ * of a cache, or the reverse.
+ *
+ * @param pfo      Input: pointer to fourier structure
+ * @param pnw      Input/Output: pointer to nonlinear workspace
+ * @param cache    Input/Output: cache with all its arrays allocated
+ * @param to_cache Input: _TRUE_ to copy from pnw to the cache, _FALSE_ for the reverse
+ */
+
+static void fourier_hmcode_cache_copy(
+                                      struct fourier *pfo,
+                                      struct fourier_workspace * pnw,
+                                      struct fourier_hmcode_cache * cache,
+                                      int to_cache
+                                      ) {
+
+  int index_pk;
+  int index_sigma;
+  size_t tau_size = pfo->tau_size;
+  size_t pk_tau_size = pfo->pk_size*tau_size;
+  size_t stab_size = tau_size*cache->n_hmcode_tables*sizeof(double);
+  double ** sigmas[6];
+
+  sigmas[0] = pnw->sigma_8;
+  sigmas[1] = pnw->sigma_disp;
+  sigmas[2] = pnw->sigma_disp_100;
+  sigmas[3] = pnw->sigma_prime;
+  sigmas[4] = pnw->r_nl;
+  sigmas[5] = pnw->sigma_nl;
+
+  if (to_cache == _TRUE_) {
+    memcpy(cache->ln_k,pfo->ln_k,pfo->k_size_extra*sizeof(double));
+    memcpy(cache->cache_key,pnw->cache_key,2*tau_size*sizeof(double));
+    memcpy(cache->stab,pnw->stab,stab_size);
+    memcpy(cache->ddstab,pnw->ddstab,stab_size);
+  }
+  else {
+    memcpy(pnw->cache_key,cache->cache_key,2*tau_size*sizeof(double));
+    memcpy(pnw->stab,cache->stab,stab_size);
+    memcpy(pnw->ddstab,cache->ddstab,stab_size);
+  }
+
+  for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+
+    if (to_cache == _TRUE_) {
+      memcpy(cache->lnpk_l+index_pk*tau_size*pfo->k_size_extra,pnw->lnpk_l[index_pk],tau_size*pfo->k_size_extra*sizeof(double));
+      memcpy(cache->sigmas_known+index_pk*tau_size,pnw->sigmas_known[index_pk],tau_size*sizeof(short));
+      for (index_sigma=0; index_sigma<6; index_sigma++)
+        memcpy(cache->sigmas+index_sigma*pk_tau_size+index_pk*tau_size,sigmas[index_sigma][index_pk],tau_size*sizeof(double));
+    }
+    else {
+      memcpy(pnw->lnpk_l[index_pk],cache->lnpk_l+index_pk*tau_size*pfo->k_size_extra,tau_size*pfo->k_size_extra*sizeof(double));
+      memcpy(pnw->sigmas_known[index_pk],cache->sigmas_known+index_pk*tau_size,tau_size*sizeof(short));
+      for (index_sigma=0; index_sigma<6; index_sigma++)
+        memcpy(sigmas[index_sigma][index_pk],cache->sigmas+index_sigma*pk_tau_size+index_pk*tau_size,tau_size*sizeof(double));
+    }
+  }
+}
+
+/**
+ * If the quantities kept in memory by a previous run were computed
+ * with the same parameters and values of k, copy them to the
+ * workspace. fourier_hmcode_at_all_tau() then checks at each time
+ * that the linear spectra and background quantities are also the
+ * same.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pfo Input: pointer to fourier structure
+ * @param pnw Input/Output: pointer to nonlinear workspace
+ * @return the error status
+ */
+
+int fourier_hmcode_cache_fetch(
+                               struct precision *ppr,
+                               struct background *pba,
+                               struct fourier *pfo,
+                               struct fourier_workspace * pnw
+                               ) {
+
+  struct fourier_hmcode_cache parameters;
+  struct fourier_hmcode_cache * slot = &fourier_hmcode_cache_slot;
+
+  fourier_hmcode_cache_parameters(ppr,pba,pfo,&parameters);
+
+#pragma omp critical (fourier_hmcode_cache)
+  {
+    if ((slot->is_filled == _TRUE_) &&
+        (slot->pk_size == parameters.pk_size) &&
+        (slot->tau_size == parameters.tau_size) &&
+        (slot->k_size_extra == parameters.k_size_extra) &&
+        (slot->n_hmcode_tables == parameters.n_hmcode_tables) &&
+        (slot->nsteps_for_p1h_integral == parameters.nsteps_for_p1h_integral) &&
+        (slot->rmin_for_sigtab == parameters.rmin_for_sigtab) &&
+        (slot->rmax_for_sigtab == parameters.rmax_for_sigtab) &&
+        (slot->sigma_k_per_decade == parameters.sigma_k_per_decade) &&
+        (slot->sigma_fftlog == parameters.sigma_fftlog) &&
+        (slot->hmcode_tol_sigma == parameters.hmcode_tol_sigma) &&
+        (slot->mmin_for_p1h_integral == parameters.mmin_for_p1h_integral) &&
+        (slot->mmax_for_p1h_integral == parameters.mmax_for_p1h_integral) &&
+        (slot->h == parameters.h) &&
+        (slot->Omega0_m == parameters.Omega0_m) &&
+        (slot->Omega0_ncdm_tot == parameters.Omega0_ncdm_tot) &&
+        (memcmp(slot->ln_k,pfo->ln_k,pfo->k_size_extra*sizeof(double)) == 0)) {
+
+      fourier_hmcode_cache_copy(pfo,pnw,slot,_FALSE_);
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Keep the sigma's of the workspace, and everything they depend on,
+ * in memory for the next runs, in place of the previous ones.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pfo Input: pointer to fourier structure
+ * @param pnw Input: pointer to nonlinear workspace
+ * @return the error status
+ */
+
+int fourier_hmcode_cache_store(
+                               struct precision *ppr,
+                               struct background *pba,
+                               struct fourier *pfo,
+                               struct fourier_workspace * pnw
+                               ) {
+
+  struct fourier_hmcode_cache cache;
+  struct fourier_hmcode_cache swap;
+  size_t pk_tau_size = pfo->pk_size*pfo->tau_size;
+
+  fourier_hmcode_cache_parameters(ppr,pba,pfo,&cache);
+
+  class_alloc(cache.ln_k,pfo->k_size_extra*sizeof(double),pfo->error_message);
+  class_alloc(cache.cache_key,2*pfo->tau_size*sizeof(double),pfo->error_message);
+  class_alloc(cache.lnpk_l,pk_tau_size*pfo->k_size_extra*sizeof(double),pfo->error_message);
+  class_alloc(cache.stab,pfo->tau_size*ppr->n_hmcode_tables*sizeof(double),pfo->error_message);
+  class_alloc(cache.ddstab,pfo->tau_size*ppr->n_hmcode_tables*sizeof(double),pfo->error_message);
+  class_alloc(cache.sigmas,6*pk_tau_size*sizeof(double),pfo->error_message);
+  class_alloc(cache.sigmas_known,pk_tau_size*sizeof(short),pfo->error_message);
+
+  fourier_hmcode_cache_copy(pfo,pnw,&cache,_TRUE_);
+  cache.is_filled = _TRUE_;
+
+#pragma omp critical (fourier_hmcode_cache)
+  {
+    swap = fourier_hmcode_cache_slot;
+    fourier_hmcode_cache_slot = cache;
+  }
+
+  fourier_hmcode_cache_free_arrays(&swap);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the quantities of HMcode kept in memory by
+ * fourier_hmcode_cache_store().
+ *
+ * @return the error status
+ */
+
+int fourier_hmcode_cache_clear() {
+
+  struct fourier_hmcode_cache swap;
+
+#pragma omp critical (fourier_hmcode_cache)
+  {
+    swap = fourier_hmcode_cache_slot;
+    memset(&fourier_hmcode_cache_slot,0,sizeof(struct fourier_hmcode_cache));
+  }
+
+  fourier_hmcode_cache_free_arrays(&swap);
+
+  return _SUCCESS_;
+}
+
 /**
  * Compute sigma8(z)
  *
@@ -9,7 +9,11 @@
  *
  * -# harmonic_init() at the beginning (but after transfer_init())
  * -# harmonic_cl_at_l() at any time for computing individual \f$ C_l \f$'s at any l
+ * -# harmonic_cl_at_l_array() at any time for computing the total \f$ C_l \f$'s at all l up to some l_max
  * -# harmonic_free() at the end
+ *
+ * With lazy evaluation, the table of \f$ C_l \f$'s is only computed on the
+ * first call to harmonic_cl_at_l() or harmonic_cl_at_l_array().
  */
 
 #include "harmonic.h"
@@ -51,6 +55,12 @@ int harmonic_cl_at_l(
   int index_ic1,index_ic2,index_ic1_ic2;
   int index_ct;
 
+  /** - compute the \f$ C_l\f$'s on first access, in case of lazy evaluation */
+
+  class_call(harmonic_lazy_compute(phr),
+             phr->error_message,
+             phr->error_message);
+
   /** - (a) treat case in which there is only one mode and one initial condition.
       Then, only cl_tot needs to be filled. */
 
@@ -245,6 +255,123 @@ int harmonic_cl_at_l(
 
 }
 
+/**
+ * Total anisotropy power spectra \f$ C_l\f$'s for all types and all
+ * integer multipoles 0 <= l <= l_max, summed over initial conditions
+ * and modes.
+ *
+ * This routine gives the same values as cl_tot in harmonic_cl_at_l()
+ * called at each l, but evaluates all multipoles in one sweep through
+ * the pre-computed table (without a bisection at each l), and writes
+ * the \f$ C_l\f$'s of each type in one contiguous array, which can for
+ * instance be exposed to Python without copying. Values at l smaller
+ * than the first multipole of the table (l=0,1) are set to zero, as
+ * well as those beyond the last computed multipole of a given mode, or
+ * beyond the l_max of a given type.
+ *
+ * This function can be called from whatever module at whatever time,
+ * provided that harmonic_init() has been called before, and
+ * harmonic_free() has not been called yet.
+ *
+ * @param phr    Input: pointer to harmonic structure (containing pre-computed table)
+ * @param l_max  Input: last multipole
+ * @param cl_tot Output: total \f$C_l\f$'s, cl_tot[index_ct*(l_max+1)+l] (must be already allocated)
+ * @return the error status
+ */
+
+int harmonic_cl_at_l_array(
+                          struct harmonic * phr,
+                          int l_max,
+                          double * cl_tot
+                          ) {
+
+  int l;
+  int index_md;
+  int index_ic1,index_ic2,index_ic1_ic2;
+  int index_ct;
+  int * last_index;
+  double * cl_md_ic; /* cl_md_ic[index_ic1_ic2*phr->ct_size+index_ct] for the current mode */
+  double * cl_md;    /* cl_md[index_ct] for the current mode */
+  int ic_ic_size_max = 1;
+
+  class_test(l_max < 0,
+             phr->error_message,
+             "l_max=%d should be positive",l_max);
+
+  class_call(harmonic_lazy_compute(phr),
+             phr->error_message,
+             phr->error_message);
+
+  for (index_md = 0; index_md < phr->md_size; index_md++)
+    ic_ic_size_max = MAX(ic_ic_size_max,phr->ic_ic_size[index_md]);
+
+  class_calloc(last_index,phr->md_size,sizeof(int),phr->error_message);
+  class_alloc(cl_md_ic,ic_ic_size_max*phr->ct_size*sizeof(double),phr->error_message);
+  class_alloc(cl_md,phr->ct_size*sizeof(double),phr->error_message);
+
+  for (l=0; l<=l_max; l++) {
+
+    for (index_ct=0; index_ct<phr->ct_size; index_ct++)
+      cl_tot[index_ct*(l_max+1)+l] = 0.;
+
+    for (index_md = 0; index_md < phr->md_size; index_md++) {
+
+      /* same condition as in harmonic_cl_at_l(), plus l within the table */
+      if ((l < phr->l[0]) || (l > phr->l[phr->l_size[index_md]-1]))
+        continue;
+
+      /* interpolate all ic and ct, starting from the interval of the previous l */
+      class_call(array_interpolate_spline_growing_closeby(phr->l,
+                                                          phr->l_size[index_md],
+                                                          phr->cl[index_md],
+                                                          phr->ddcl[index_md],
+                                                          phr->ic_ic_size[index_md]*phr->ct_size,
+                                                          (double)l,
+                                                          &(last_index[index_md]),
+                                                          cl_md_ic,
+                                                          phr->ic_ic_size[index_md]*phr->ct_size,
+                                                          phr->error_message),
+                 phr->error_message,
+                 phr->error_message);
+
+      /* sum up all ic for this mode, in the same order as harmonic_cl_at_l() */
+      if (phr->ic_size[index_md] == 1) {
+        for (index_ct=0; index_ct<phr->ct_size; index_ct++)
+          cl_md[index_ct] = (l > phr->l_max_ct[index_md][index_ct] ? 0. : cl_md_ic[index_ct]);
+      }
+      else {
+        for (index_ct=0; index_ct<phr->ct_size; index_ct++) {
+          cl_md[index_ct] = 0.;
+          if (l > phr->l_max_ct[index_md][index_ct])
+            continue;
+          for (index_ic1 = 0; index_ic1 < phr->ic_size[index_md]; index_ic1++) {
+            for (index_ic2 = index_ic1; index_ic2 < phr->ic_size[index_md]; index_ic2++) {
+              index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,phr->ic_size[index_md]);
+              if (phr->is_non_zero[index_md][index_ic1_ic2] == _FALSE_)
+                continue;
+              if (index_ic1 == index_ic2)
+                cl_md[index_ct] += cl_md_ic[index_ic1_ic2*phr->ct_size+index_ct];
+              else
+                cl_md[index_ct] += 2.*cl_md_ic[index_ic1_ic2*phr->ct_size+index_ct];
+            }
+          }
+        }
+      }
+
+      /* add contribution of this mode */
+      for (index_ct=0; index_ct<phr->ct_size; index_ct++)
+        cl_tot[index_ct*(l_max+1)+l] += cl_md[index_ct];
+    }
+  }
+
+  free(last_index);
+  free(cl_md_ic);
+  free(cl_md);
+
+  return _SUCCESS_;
+
+}
+
 /**
  * This routine initializes the harmonic structure (in particular,
  * computes table of anisotropy and Fourier spectra \f$ C_l^{X}, P(k), ... \f$)
@@ -271,6 +398,11 @@ int harmonic_init(
 
   /** Summary: */
 
+  phr->is_pending = _FALSE_;
+#ifdef _OPENMP
+  omp_init_lock(&(phr->lazy_lock));
+#endif
+
   /** - check that we really want to compute at least one spectrum */
 
   if (ppt->has_cls == _FALSE_) {
@@ -291,13 +423,26 @@ int harmonic_init(
              phr->error_message,
              phr->error_message);
 
-  /** - deal with \f$ C_l\f$'s, if any */
+  /** - deal with \f$ C_l\f$'s, if any (with lazy evaluation, just
+      store the pointers needed to compute them on first access) */
 
   if (ppt->has_cls == _TRUE_) {
 
-    class_call(harmonic_cls(pba,ppt,ptr,ppm,phr),
-               phr->error_message,
-               phr->error_message);
+    if (phr->lazy_evaluation == _TRUE_) {
+      phr->ppr = ppr;
+      phr->pba = pba;
+      phr->ppt = ppt;
+      phr->ppm = ppm;
+      phr->ptr = ptr;
+      phr->is_pending = _TRUE_;
+      if (phr->harmonic_verbose > 0)
+        printf(" -> deferred until the first query (lazy evaluation)\n");
+    }
+    else {
+      class_call(harmonic_cls(ppr,pba,ppt,ptr,ppm,phr),
+                 phr->error_message,
+                 phr->error_message);
+    }
 
   }
   else {
@@ -317,6 +462,49 @@ int harmonic_init(
   return _SUCCESS_;
 }
 
+/**
+ * This routine computes the table of \f$ C_l\f$'s of a harmonic
+ * structure initialized with lazy evaluation ('lazy_evaluation =
+ * yes'), if this has not been done yet. Does nothing otherwise.
+ *
+ * The transfer structure passed to harmonic_init() must not have
+ * been freed before the first call. The first call should not be
+ * issued concurrently from several threads.
+ *
+ * @param phr Input/Output: pointer to harmonic structure
+ * @return the error status
+ */
+
+int harmonic_lazy_compute(
+                          struct harmonic * phr
+                          ) {
+
+  int status = _SUCCESS_;
+
+  if (phr->is_pending == _FALSE_)
+    return _SUCCESS_;
+
+  /* each structure has its own lock, so that other runs are not held up */
+#ifdef _OPENMP
+  omp_set_lock(&(phr->lazy_lock));
+#endif
+  if (phr->is_pending == _TRUE_) {
+    if (phr->harmonic_verbose > 0)
+      printf("Computing unlensed harmonic spectra (lazy evaluation)\n");
+    status = harmonic_cls(phr->ppr,phr->pba,phr->ppt,phr->ptr,phr->ppm,phr);
+    phr->is_pending = _FALSE_;
+  }
+#ifdef _OPENMP
+  omp_unset_lock(&(phr->lazy_lock));
+#endif
+
+  /* the error message has already been written by harmonic_cls() */
+  if (status == _FAILURE_)
+    return _FAILURE_;
+
+  return _SUCCESS_;
+}
+
 /**
  * This routine frees all the memory space allocated by harmonic_init().
  *
@@ -336,17 +524,22 @@ int harmonic_free(
   if (phr->md_size > 0) {
     if (phr->ct_size > 0) {
 
-      for (index_md = 0; index_md < phr->md_size; index_md++) {
-        free(phr->l_max_ct[index_md]);
-        free(phr->cl[index_md]);
-        free(phr->ddcl[index_md]);
+      /* the tables of C_l's do not exist if they were never queried with lazy evaluation */
+      if (phr->is_pending == _FALSE_) {
+        for (index_md = 0; index_md < phr->md_size; index_md++) {
+          free(phr->cl[index_md]);
+          free(phr->ddcl[index_md]);
+        }
+        free(phr->l);
+        free(phr->l_size);
+        free(phr->cl);
+        free(phr->ddcl);
       }
-      free(phr->l);
-      free(phr->l_size);
+
+      for (index_md = 0; index_md < phr->md_size; index_md++)
+        free(phr->l_max_ct[index_md]);
       free(phr->l_max_ct);
       free(phr->l_max);
-      free(phr->cl);
-      free(phr->ddcl);
     }
 
     for (index_md=0; index_md < phr->md_size; index_md++)
@@ -358,6 +551,12 @@ int harmonic_free(
 
   }
 
+#ifdef _OPENMP
+  omp_destroy_lock(&(phr->lazy_lock));
+#endif
+
+  class_memory_leaks();
+
   return _SUCCESS_;
 
 }
@@ -651,6 +850,17 @@ int harmonic_indices(
  * This routine computes a table of values for all harmonic spectra \f$ C_l \f$'s,
  * given the transfer functions and primordial spectra.
  *
+ * If the transfer functions are streamed (see
+ * ppr->transfer_stream_l_block_size), they are computed here by
+ * blocks of multipoles with transfer_compute_l_block(), and each block
+ * is integrated before the next one overwrites it.
+ *
+ * If ppr->harmonic_offload is set, the integrals over k are computed
+ * by harmonic_cls_l_range_offload() instead of harmonic_cls_l_range();
+ * otherwise, if ppr->harmonic_matrix_integration is set, they are
+ * computed as matrix products by harmonic_cls_l_range_matrix().
+ *
+ * @param ppr Input: pointer to precision structure
  * @param pba Input: pointer to background structure
  * @param ppt Input: pointer to perturbation structure
  * @param ptr Input: pointer to transfer structure
@@ -660,6 +870,7 @@ int harmonic_indices(
  */
 
 int harmonic_cls(
+                struct precision * ppr,
                 struct background * pba,
                 struct perturbations * ppt,
                 struct transfer * ptr,
@@ -672,27 +883,10 @@ int harmonic_cls(
   /** - define local variables */
 
   int index_md;
-  int index_ic1,index_ic2,index_ic1_ic2;
   int index_l;
-  int index_ct;
-  int cl_integrand_num_columns;
-
-  double * cl_integrand; /* array with argument cl_integrand[index_k*cl_integrand_num_columns+1+phr->index_ct] */
-  double * transfer_ic1; /* array with argument transfer_ic1[index_tt] */
-  double * transfer_ic2; /* idem */
-  double * primordial_pk;  /* array with argument primordial_pk[index_ic_ic]*/
-
-  /* This code can be optionally compiled with the openmp option for parallel computation.
-     Inside parallel regions, the use of the command "return" is forbidden.
-     For error management, instead of "return _FAILURE_", we will set the variable below
-     to "abort = _TRUE_". This will lead to a "return _FAILURE_" jus after leaving the
-     parallel region. */
-  int abort;
-
-#ifdef _OPENMP
-  /* instrumentation times */
-  double tstart, tstop;
-#endif
+  int index_l_min;
+  int index_l_max;
+  struct harmonic_offload * pho = NULL;
 
   /** - allocate pointers to arrays where results will be stored */
 
@@ -720,127 +914,1094 @@ int harmonic_cls(
 
     class_alloc(phr->cl[index_md],sizeof(double)*phr->l_size[index_md]*phr->ct_size*phr->ic_ic_size[index_md],phr->error_message);
     class_alloc(phr->ddcl[index_md],sizeof(double)*phr->l_size[index_md]*phr->ct_size*phr->ic_ic_size[index_md],phr->error_message);
-    cl_integrand_num_columns = 1+phr->ct_size*2; /* one for k, ct_size for each type, ct_size for each second derivative of each type */
+  }
 
-    /** - --> (c) loop over initial conditions */
+  /** - if the integrals are offloaded or written as matrix products, prepare their weights, primordial spectra and fields for each mode */
 
-    for (index_ic1 = 0; index_ic1 < phr->ic_size[index_md]; index_ic1++) {
-      for (index_ic2 = index_ic1; index_ic2 < phr->ic_size[index_md]; index_ic2++) {
-        index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,phr->ic_size[index_md]);
+  if ((ppr->harmonic_offload == _TRUE_) || (ppr->harmonic_matrix_integration == _TRUE_)) {
+    class_alloc(pho,phr->md_size*sizeof(struct harmonic_offload),phr->error_message);
+    for (index_md = 0; index_md < phr->md_size; index_md++) {
+      class_call(harmonic_offload_init(pba,ppt,ptr,ppm,phr,index_md,&(pho[index_md])),
+                 phr->error_message,
+                 phr->error_message);
+    }
+  }
 
-        /* non-diagonal coefficients should be computed only if non-zero correlation */
-        if (phr->is_non_zero[index_md][index_ic1_ic2] == _TRUE_) {
+  /** - compute the \f$ C_l\f$'s with harmonic_cls_l_range(): for each
+      block of multipoles if transfer functions are streamed, or
+      for all multipoles of each mode otherwise */
 
-          /* initialize error management flag */
-          abort = _FALSE_;
+  if (ptr->ptc != NULL) {
 
-          /* beginning of parallel region */
+    for (index_l_min = 0; index_l_min < ptr->l_size_max; index_l_min += ptr->l_stream_block_size) {
 
-#pragma omp parallel                                                    \
-  shared(ptr,ppm,index_md,phr,ppt,cl_integrand_num_columns,index_ic1,index_ic2,abort) \
-  private(tstart,cl_integrand,primordial_pk,transfer_ic1,transfer_ic2,index_l,tstop)
+      index_l_max = MIN(index_l_min+ptr->l_stream_block_size,ptr->l_size_max);
+
+      class_call(transfer_compute_l_block(ptr,index_l_min,index_l_max),
+                 ptr->error_message,
+                 phr->error_message);
+
+      for (index_md = 0; index_md < phr->md_size; index_md++) {
+        if (index_l_min < phr->l_size[index_md]) {
+          if (ppr->harmonic_offload == _TRUE_) {
+            class_call(harmonic_cls_l_range_offload(ppt,ptr,phr,index_md,index_l_min,MIN(index_l_max,phr->l_size[index_md]),&(pho[index_md])),
+                       phr->error_message,
+                       phr->error_message);
+          }
+          else if (ppr->harmonic_matrix_integration == _TRUE_) {
+            class_call(harmonic_cls_l_range_matrix(ppt,ptr,phr,index_md,index_l_min,MIN(index_l_max,phr->l_size[index_md]),ppr->harmonic_l_block_size,&(pho[index_md])),
+                       phr->error_message,
+                       phr->error_message);
+          }
+          else {
+            class_call(harmonic_cls_l_range(pba,ppt,ptr,ppm,phr,index_md,index_l_min,MIN(index_l_max,phr->l_size[index_md])),
+                       phr->error_message,
+                       phr->error_message);
+          }
+        }
+      }
+    }
+
+    class_call(transfer_context_free(ptr,ptr->ptc),
+               ptr->error_message,
+               phr->error_message);
+  }
+  else {
+    for (index_md = 0; index_md < phr->md_size; index_md++) {
+      if (ppr->harmonic_offload == _TRUE_) {
+        class_call(harmonic_cls_l_range_offload(ppt,ptr,phr,index_md,0,phr->l_size[index_md],&(pho[index_md])),
+                   phr->error_message,
+                   phr->error_message);
+      }
+      else if (ppr->harmonic_matrix_integration == _TRUE_) {
+        class_call(harmonic_cls_l_range_matrix(ppt,ptr,phr,index_md,0,phr->l_size[index_md],ppr->harmonic_l_block_size,&(pho[index_md])),
+                   phr->error_message,
+                   phr->error_message);
+      }
+      else {
+        class_call(harmonic_cls_l_range(pba,ppt,ptr,ppm,phr,index_md,0,phr->l_size[index_md]),
+                   phr->error_message,
+                   phr->error_message);
+      }
+    }
+  }
+
+  if (pho != NULL) {
+    for (index_md = 0; index_md < phr->md_size; index_md++) {
+      class_call(harmonic_offload_free(&(pho[index_md])),
+                 phr->error_message,
+                 phr->error_message);
+    }
+    free(pho);
+  }
+
+  /** - for each mode, now that all possible \f$ C_l\f$'s have been computed,
+      interpolate those computed on the l list of smooth types only (see
+      ptr->l_stride_tt), and compute second derivative of the array in
+      which they are stored, in view of spline interpolation. */
+
+  for (index_md = 0; index_md < phr->md_size; index_md++) {
+
+    if (_scalars_ && (phr->has_pp == _TRUE_)) {
+      class_call(harmonic_cls_interpolate_strided(ptr,phr,index_md,ptr->index_tt_lcmb,phr->index_ct_pp,1),
+                 phr->error_message,
+                 phr->error_message);
+    }
+
+    if (_scalars_ && (phr->has_ll == _TRUE_)) {
+      class_call(harmonic_cls_interpolate_strided(ptr,phr,index_md,ptr->index_tt_lensing,phr->index_ct_ll,
+                                                  (phr->d_size*(phr->d_size+1)-(phr->d_size-phr->non_diag)*(phr->d_size-1-phr->non_diag))/2),
+                 phr->error_message,
+                 phr->error_message);
+    }
+
+    class_call(array_spline_table_lines(phr->l,
+                                        phr->l_size[index_md],
+                                        phr->cl[index_md],
+                                        phr->ic_ic_size[index_md]*phr->ct_size,
+                                        phr->ddcl[index_md],
+                                        _SPLINE_EST_DERIV_,
+                                        phr->error_message),
+               phr->error_message,
+               phr->error_message);
+  }
+
+  return _SUCCESS_;
 
-          {
+}
+
+/**
+ * This routine computes the \f$ C_l\f$'s of one mode, for all pairs
+ * of initial conditions and for the multipoles index_l_min <= index_l
+ * < index_l_max, whose transfer functions must be in the table of the
+ * transfer structure.
+ *
+ * @param pba         Input: pointer to background structure
+ * @param ppt         Input: pointer to perturbation structure
+ * @param ptr         Input: pointer to transfer structure
+ * @param ppm         Input: pointer to primordial structure
+ * @param phr         Input/Output: pointer to harmonic structure
+ * @param index_md    Input: index of mode under consideration
+ * @param index_l_min Input: index of first multipole
+ * @param index_l_max Input: index of last multipole plus one
+ * @return the error status
+ */
+
+int harmonic_cls_l_range(
+                        struct background * pba,
+                        struct perturbations * ppt,
+                        struct transfer * ptr,
+                        struct primordial * ppm,
+                        struct harmonic * phr,
+                        int index_md,
+                        int index_l_min,
+                        int index_l_max
+                        ) {
+
+  int index_ic1,index_ic2,index_ic1_ic2;
+  int index_l;
+  int index_ct;
+  int cl_integrand_num_columns;
+
+  double * cl_integrand; /* array with argument cl_integrand[index_k*cl_integrand_num_columns+1+phr->index_ct] */
+  double * transfer_ic1; /* array with argument transfer_ic1[index_tt] */
+  double * transfer_ic2; /* idem */
+  double * primordial_pk;  /* array with argument primordial_pk[index_q*phr->ic_ic_size[index_md]+index_ic_ic]*/
+
+  /* This code can be optionally compiled with the openmp option for parallel computation.
+     Inside parallel regions, the use of the command "return" is forbidden.
+     For error management, instead of "return _FAILURE_", we will set the variable below
+     to "abort = _TRUE_". This will lead to a "return _FAILURE_" jus after leaving the
+     parallel region. */
+  int abort;
 
 #ifdef _OPENMP
-            tstart = omp_get_wtime();
+  /* instrumentation times */
+  double tstart, tstop;
 #endif
 
-            class_alloc_parallel(cl_integrand,
-                                 ptr->q_size*cl_integrand_num_columns*sizeof(double),
-                                 phr->error_message);
+  cl_integrand_num_columns = 1+phr->ct_size*2; /* one for k, ct_size for each type, ct_size for each second derivative of each type */
+
+  /** - primordial spectrum at each wavenumber, computed once for all multipoles */
+
+  class_alloc(primordial_pk,
+              ptr->q_size*phr->ic_ic_size[index_md]*sizeof(double),
+              phr->error_message);
+
+  class_call(primordial_spectrum_at_k_array(ppm,index_md,linear,ptr->k[index_md],ptr->q_size,primordial_pk),
+             ppm->error_message,
+             phr->error_message);
+
+  /** - loop over initial conditions */
 
-            class_alloc_parallel(primordial_pk,
-                                 phr->ic_ic_size[index_md]*sizeof(double),
-                                 phr->error_message);
+  for (index_ic1 = 0; index_ic1 < phr->ic_size[index_md]; index_ic1++) {
+    for (index_ic2 = index_ic1; index_ic2 < phr->ic_size[index_md]; index_ic2++) {
+      index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,phr->ic_size[index_md]);
 
-            class_alloc_parallel(transfer_ic1,
-                                 ptr->tt_size[index_md]*sizeof(double),
-                                 phr->error_message);
+      /* non-diagonal coefficients should be computed only if non-zero correlation */
+      if (phr->is_non_zero[index_md][index_ic1_ic2] == _TRUE_) {
 
-            class_alloc_parallel(transfer_ic2,
-                                 ptr->tt_size[index_md]*sizeof(double),
-                                 phr->error_message);
+        /* initialize error management flag */
+        abort = _FALSE_;
+
+        /* beginning of parallel region */
+
+#pragma omp parallel                                                    \
+  shared(ptr,ppm,index_md,phr,ppt,cl_integrand_num_columns,primordial_pk,index_ic1,index_ic2,index_l_min,index_l_max,abort) \
+  private(tstart,cl_integrand,transfer_ic1,transfer_ic2,index_l,tstop)
+
+        {
+
+#ifdef _OPENMP
+          tstart = omp_get_wtime();
+#endif
+
+          class_alloc_parallel(cl_integrand,
+                               ptr->q_size*cl_integrand_num_columns*sizeof(double),
+                               phr->error_message);
+
+          class_alloc_parallel(transfer_ic1,
+                               ptr->tt_size[index_md]*sizeof(double),
+                               phr->error_message);
+
+          class_alloc_parallel(transfer_ic2,
+                               ptr->tt_size[index_md]*sizeof(double),
+                               phr->error_message);
 
 #pragma omp for schedule (dynamic)
 
-            /** - ---> loop over l values defined in the transfer module.
-                For each l, compute the \f$ C_l\f$'s for all types (TT, TE, ...)
-                by convolving primordial spectra with transfer  functions.
-                This elementary task is assigned to harmonic_compute_cl() */
+          /** - ---> loop over l values defined in the transfer module.
+              For each l, compute the \f$ C_l\f$'s for all types (TT, TE, ...)
+              by convolving primordial spectra with transfer  functions.
+              This elementary task is assigned to harmonic_compute_cl() */
 
-            for (index_l=0; index_l < ptr->l_size[index_md]; index_l++) {
+          for (index_l=index_l_min; index_l < index_l_max; index_l++) {
 
 #pragma omp flush(abort)
 
-              class_call_parallel(harmonic_compute_cl(pba,
-                                                     ppt,
-                                                     ptr,
-                                                     ppm,
-                                                     phr,
-                                                     index_md,
-                                                     index_ic1,
-                                                     index_ic2,
-                                                     index_l,
-                                                     cl_integrand_num_columns,
-                                                     cl_integrand,
-                                                     primordial_pk,
-                                                     transfer_ic1,
-                                                     transfer_ic2),
-                                  phr->error_message,
-                                  phr->error_message);
-
-            } /* end of loop over l */
+            class_trace_begin();
+            class_counters_begin(counter_harmonic_compute_cl);
+
+            class_call_parallel(harmonic_compute_cl(pba,
+                                                   ppt,
+                                                   ptr,
+                                                   ppm,
+                                                   phr,
+                                                   index_md,
+                                                   index_ic1,
+                                                   index_ic2,
+                                                   index_l,
+                                                   cl_integrand_num_columns,
+                                                   cl_integrand,
+                                                   primordial_pk,
+                                                   transfer_ic1,
+                                                   transfer_ic2),
+                                phr->error_message,
+                                phr->error_message);
+
+            class_counters_end(counter_harmonic_compute_cl);
+            class_trace_end("harmonic","index_l",index_l);
+
+          } /* end of loop over l */
 
 #ifdef _OPENMP
-            tstop = omp_get_wtime();
-            if (phr->harmonic_verbose > 1)
-              printf("In %s: time spent in parallel region (loop over l's) = %e s for thread %d\n",
-                     __func__,tstop-tstart,omp_get_thread_num());
+          tstop = omp_get_wtime();
+          if (phr->harmonic_verbose > 1)
+            printf("In %s: time spent in parallel region (loop over l's) = %e s for thread %d\n",
+                   __func__,tstop-tstart,omp_get_thread_num());
 #endif
-            free(cl_integrand);
+          free(cl_integrand);
 
-            free(primordial_pk);
+          free(transfer_ic1);
 
-            free(transfer_ic1);
+          free(transfer_ic2);
 
-            free(transfer_ic2);
+        } /* end of parallel region */
 
-          } /* end of parallel region */
+        if (abort == _TRUE_) return _FAILURE_;
 
-          if (abort == _TRUE_) return _FAILURE_;
+      }
+      else {
 
+        /* set non-diagonal coefficients to zero if pair of ic's uncorrelated */
+
+        for (index_l=index_l_min; index_l < index_l_max; index_l++) {
+          for (index_ct=0; index_ct<phr->ct_size; index_ct++) {
+            phr->cl[index_md]
+              [(index_l * phr->ic_ic_size[index_md] + index_ic1_ic2) * phr->ct_size + index_ct]
+              = 0.;
+          }
         }
-        else {
+      }
+    }
+  }
+
+  free(primordial_pk);
 
-          /* set non-diagonal coefficients to zero if pair of ic's uncorrelated */
+  return _SUCCESS_;
+
+}
 
-          for (index_l=0; index_l < ptr->l_size[index_md]; index_l++) {
-            for (index_ct=0; index_ct<phr->ct_size; index_ct++) {
-              phr->cl[index_md]
-                [(index_l * phr->ic_ic_size[index_md] + index_ic1_ic2) * phr->ct_size + index_ct]
-                = 0.;
+/**
+ * This routine fills the \f$ C_l\f$'s of the types index_ct_first <=
+ * index_ct < index_ct_first+ct_num at the multipoles that are not in
+ * the l list of the transfer type index_tt (see ptr->l_stride_tt and
+ * _transfer_l_is_sampled_()), by spline interpolation of their values
+ * on this list. These types of \f$ C_l\f$'s must only involve transfer
+ * types with the same l list.
+ *
+ * @param ptr            Input: pointer to transfer structure
+ * @param phr            Input/Output: pointer to harmonic structure
+ * @param index_md       Input: index of mode under consideration
+ * @param index_tt       Input: transfer type whose l list is used
+ * @param index_ct_first Input: first type of C_l's to interpolate
+ * @param ct_num         Input: number of types of C_l's to interpolate
+ * @return the error status
+ */
+
+int harmonic_cls_interpolate_strided(
+                                    struct transfer * ptr,
+                                    struct harmonic * phr,
+                                    int index_md,
+                                    int index_tt,
+                                    int index_ct_first,
+                                    int ct_num
+                                    ) {
+
+  int l_size = ptr->l_size_tt[index_md][index_tt];
+  int column_size = phr->ic_ic_size[index_md]*phr->ct_size;
+  int sample_size;
+  int index_l;
+  int index_sample;
+  int index_ic1_ic2;
+  int index_ct;
+  int last_index = 0;
+  double * l_sample;
+  double * cl_sample;
+  double * ddcl_sample;
+  double * cl_interpolated;
+
+  if (ptr->l_stride_tt[index_md][index_tt] <= 1)
+    return _SUCCESS_;
+
+  l_size = MIN(l_size,phr->l_size[index_md]);
+
+  class_alloc(l_sample,l_size*sizeof(double),phr->error_message);
+  class_alloc(cl_sample,l_size*column_size*sizeof(double),phr->error_message);
+  class_alloc(ddcl_sample,l_size*column_size*sizeof(double),phr->error_message);
+  class_alloc(cl_interpolated,column_size*sizeof(double),phr->error_message);
+
+  sample_size = 0;
+  for (index_l = 0; index_l < l_size; index_l++) {
+    if (_transfer_l_is_sampled_(ptr,index_md,index_tt,index_l)) {
+      l_sample[sample_size] = phr->l[index_l];
+      memcpy(cl_sample+sample_size*column_size,phr->cl[index_md]+index_l*column_size,column_size*sizeof(double));
+      sample_size++;
+    }
+  }
+
+  class_test(sample_size < 3,
+             phr->error_message,
+             "only %d multipoles in the l list of transfer type %d: decrease l_stride_smooth",sample_size,index_tt);
+
+  class_call(array_spline_table_lines(l_sample,
+                                      sample_size,
+                                      cl_sample,
+                                      column_size,
+                                      ddcl_sample,
+                                      _SPLINE_EST_DERIV_,
+                                      phr->error_message),
+             phr->error_message,
+             phr->error_message);
+
+  for (index_l = 0; index_l < l_size; index_l++) {
+    if (!_transfer_l_is_sampled_(ptr,index_md,index_tt,index_l)) {
+
+      class_call(array_interpolate_spline(l_sample,
+                                          sample_size,
+                                          cl_sample,
+                                          ddcl_sample,
+                                          column_size,
+                                          phr->l[index_l],
+                                          &last_index,
+                                          cl_interpolated,
+                                          column_size,
+                                          phr->error_message),
+                 phr->error_message,
+                 phr->error_message);
+
+      for (index_ic1_ic2 = 0; index_ic1_ic2 < phr->ic_ic_size[index_md]; index_ic1_ic2++) {
+        for (index_ct = index_ct_first; index_ct < index_ct_first+ct_num; index_ct++) {
+          index_sample = index_ic1_ic2*phr->ct_size+index_ct;
+          phr->cl[index_md][index_l*column_size+index_sample] = cl_interpolated[index_sample];
+        }
+      }
+    }
+  }
+
+  free(l_sample);
+  free(cl_sample);
+  free(ddcl_sample);
+  free(cl_interpolated);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine prepares the computation of the \f$ C_l\f$'s of one
+ * mode by harmonic_cls_l_range_offload(): it computes the weights of
+ * the integral over k, equivalent to the spline (or, in the closed
+ * case, partly trapezoidal) integration of harmonic_compute_cl(), the
+ * primordial spectrum at each wavenumber, and the combinations of
+ * transfer functions entering each type of \f$ C_l\f$.
+ *
+ * @param pba       Input: pointer to background structure
+ * @param ppt       Input: pointer to perturbation structure
+ * @param ptr       Input: pointer to transfer structure
+ * @param ppm       Input: pointer to primordial structure
+ * @param phr       Input: pointer to harmonic structure
+ * @param index_md  Input: index of mode under consideration
+ * @param pho       Output: pointer to harmonic_offload structure
+ * @return the error status
+ */
+
+int harmonic_offload_init(
+                         struct background * pba,
+                         struct perturbations * ppt,
+                         struct transfer * ptr,
+                         struct primordial * ppm,
+                         struct harmonic * phr,
+                         int index_md,
+                         struct harmonic_offload * pho
+                         ) {
+
+  int index_q;
+  int index_ic1_ic2;
+  int index_q_spline = 0;
+  int index_field;
+  int index_ct;
+  int index_d1,index_d2;
+  int field_t = -1;
+  int field_e = -1;
+  int field_b = -1;
+  int field_p = -1;
+  int field_nc = -1;
+  int field_l = -1;
+  int term_size;
+  int term_tt[_HARMONIC_OFFLOAD_TERMS_];
+  short term_lfactor[_HARMONIC_OFFLOAD_TERMS_];
+  int index_term;
+  double factor;
+
+  /** - weights of the integral over k */
+
+  pho->q_size = ptr->q_size;
+
+  class_alloc(pho->q_weight,ptr->q_size*sizeof(double),phr->error_message);
+
+  /* see the technical point on index_q_spline in harmonic_compute_cl() */
+  if (pba->sgnK == 1) {
+    index_q_spline = ptr->index_q_flat_approximation;
+  }
+
+  class_call(array_integrate_all_trapzd_or_spline_weights(ptr->k[index_md],
+                                                          ptr->q_size,
+                                                          index_q_spline,
+                                                          pho->q_weight,
+                                                          phr->error_message),
+             phr->error_message,
+             phr->error_message);
+
+  /* weight of the first point of the discrete sum in the closed case, as in harmonic_compute_cl() */
+  if (pba->sgnK == 1) {
+    pho->q_weight[0] += ptr->q[0]/ptr->k[0][0]*sqrt(pba->K)/2.;
+  }
+
+  /** - primordial spectrum times \f$ 4 \pi/k \f$ at each wavenumber */
+
+  class_alloc(pho->pk,ptr->q_size*phr->ic_ic_size[index_md]*sizeof(double),phr->error_message);
+
+  class_call(primordial_spectrum_at_k_array(ppm,index_md,linear,ptr->k[index_md],ptr->q_size,pho->pk),
+             ppm->error_message,
+             phr->error_message);
+
+  for (index_q=0; index_q < ptr->q_size; index_q++) {
+
+    factor = 4. * _PI_ / ptr->k[index_md][index_q];
+
+    for (index_ic1_ic2=0; index_ic1_ic2 < phr->ic_ic_size[index_md]; index_ic1_ic2++) {
+      pho->pk[index_q*phr->ic_ic_size[index_md]+index_ic1_ic2] *= factor;
+    }
+  }
+
+  /** - fields: the same combinations of transfer functions as in harmonic_compute_cl() */
+
+  pho->field_size = 0;
+  if (ppt->has_cl_cmb_temperature == _TRUE_) {
+    field_t = pho->field_size++;
+  }
+  if ((ppt->has_cl_cmb_polarization == _TRUE_) && ((phr->has_ee == _TRUE_) || (phr->has_te == _TRUE_) || (_scalars_ && (phr->has_ep == _TRUE_)))) {
+    field_e = pho->field_size++;
+  }
+  if (_tensors_ && (phr->has_bb == _TRUE_)) {
+    field_b = pho->field_size++;
+  }
+  if (_scalars_ && ((phr->has_pp == _TRUE_) || (phr->has_tp == _TRUE_) || (phr->has_ep == _TRUE_) || (phr->has_pd == _TRUE_))) {
+    field_p = pho->field_size++;
+  }
+  if (_scalars_ && ((phr->has_dd == _TRUE_) || (phr->has_td == _TRUE_) || (phr->has_pd == _TRUE_) || (phr->has_dl == _TRUE_))) {
+    field_nc = pho->field_size;
+    pho->field_size += phr->d_size;
+  }
+  if (_scalars_ && ((phr->has_ll == _TRUE_) || (phr->has_tl == _TRUE_) || (phr->has_dl == _TRUE_))) {
+    field_l = pho->field_size;
+    pho->field_size += phr->d_size;
+  }
+
+  class_alloc(pho->field_tt,MAX(pho->field_size,1)*_HARMONIC_OFFLOAD_TERMS_*sizeof(int),phr->error_message);
+  class_alloc(pho->field_lfactor,MAX(pho->field_size,1)*_HARMONIC_OFFLOAD_TERMS_*sizeof(short),phr->error_message);
+
+  for (index_field=0; index_field < pho->field_size; index_field++) {
+
+    term_size = 0;
+
+    if (index_field == field_t) {
+      if (_scalars_) {
+        term_tt[term_size++] = ptr->index_tt_t0;
+        term_tt[term_size++] = ptr->index_tt_t1;
+        term_tt[term_size++] = ptr->index_tt_t2;
+      }
+      if (_vectors_) {
+        term_tt[term_size++] = ptr->index_tt_t1;
+        term_tt[term_size++] = ptr->index_tt_t2;
+      }
+      if (_tensors_) {
+        term_tt[term_size++] = ptr->index_tt_t2;
+      }
+    }
+    if (index_field == field_e)
+      term_tt[term_size++] = ptr->index_tt_e;
+    if (index_field == field_b)
+      term_tt[term_size++] = ptr->index_tt_b;
+    if (index_field == field_p)
+      term_tt[term_size++] = ptr->index_tt_lcmb;
+    for (index_term=0; index_term < _HARMONIC_OFFLOAD_TERMS_; index_term++)
+      term_lfactor[index_term] = _FALSE_;
+    if ((field_nc >= 0) && (index_field >= field_nc) && (index_field < field_nc+phr->d_size)) {
+      index_d1 = index_field-field_nc;
+      if (ppt->has_nc_density == _TRUE_) {
+        term_tt[term_size++] = ptr->index_tt_density+index_d1;
+      }
+      if (ppt->has_nc_rsd == _TRUE_) {
+        term_tt[term_size++] = ptr->index_tt_rsd+index_d1;
+        term_tt[term_size++] = ptr->index_tt_d0+index_d1;
+        term_tt[term_size++] = ptr->index_tt_d1+index_d1;
+      }
+      if (ppt->has_nc_lens == _TRUE_) {
+        term_lfactor[term_size] = _TRUE_;
+        term_tt[term_size++] = ptr->index_tt_nc_lens+index_d1;
+      }
+      if (ppt->has_nc_gr == _TRUE_) {
+        term_tt[term_size++] = ptr->index_tt_nc_g1+index_d1;
+        term_tt[term_size++] = ptr->index_tt_nc_g2+index_d1;
+        term_tt[term_size++] = ptr->index_tt_nc_g3+index_d1;
+        term_tt[term_size++] = ptr->index_tt_nc_g4+index_d1;
+        term_tt[term_size++] = ptr->index_tt_nc_g5+index_d1;
+      }
+    }
+    if ((field_l >= 0) && (index_field >= field_l) && (index_field < field_l+phr->d_size))
+      term_tt[term_size++] = ptr->index_tt_lensing+index_field-field_l;
+
+    for (index_term=0; index_term < _HARMONIC_OFFLOAD_TERMS_; index_term++) {
+      pho->field_tt[index_field*_HARMONIC_OFFLOAD_TERMS_+index_term] = (index_term < term_size ? term_tt[index_term] : -1);
+      pho->field_lfactor[index_field*_HARMONIC_OFFLOAD_TERMS_+index_term] = (index_term < term_size ? term_lfactor[index_term] : _FALSE_);
+    }
+  }
+
+  /** - types of \f$ C_l\f$: the product of which fields, as in harmonic_compute_cl() */
+
+  class_alloc(pho->ct_field_1,phr->ct_size*sizeof(int),phr->error_message);
+  class_alloc(pho->ct_field_2,phr->ct_size*sizeof(int),phr->error_message);
+  class_alloc(pho->ct_kind,phr->ct_size*sizeof(short),phr->error_message);
+
+  for (index_ct=0; index_ct<phr->ct_size; index_ct++) {
+    pho->ct_field_1[index_ct] = 0;
+    pho->ct_field_2[index_ct] = 0;
+    pho->ct_kind[index_ct] = 0;
+  }
+
+#define _set_ct_(index_ct,field_1,field_2,kind) { \
+    pho->ct_field_1[index_ct] = field_1;          \
+    pho->ct_field_2[index_ct] = field_2;          \
+    pho->ct_kind[index_ct] = kind;                \
+  }
+
+  if (phr->has_tt == _TRUE_)
+    _set_ct_(phr->index_ct_tt,field_t,field_t,1);
+  if (phr->has_ee == _TRUE_)
+    _set_ct_(phr->index_ct_ee,field_e,field_e,1);
+  if (phr->has_te == _TRUE_)
+    _set_ct_(phr->index_ct_te,field_t,field_e,2);
+  if (_tensors_ && (phr->has_bb == _TRUE_))
+    _set_ct_(phr->index_ct_bb,field_b,field_b,1);
+  if (_scalars_ && (phr->has_pp == _TRUE_))
+    _set_ct_(phr->index_ct_pp,field_p,field_p,1);
+  if (_scalars_ && (phr->has_tp == _TRUE_))
+    _set_ct_(phr->index_ct_tp,field_t,field_p,2);
+  if (_scalars_ && (phr->has_ep == _TRUE_))
+    _set_ct_(phr->index_ct_ep,field_e,field_p,2);
+  if (_scalars_ && (phr->has_dd == _TRUE_)) {
+    index_ct=0;
+    for (index_d1=0; index_d1<phr->d_size; index_d1++) {
+      for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
+        _set_ct_(phr->index_ct_dd+index_ct,field_nc+index_d1,field_nc+index_d2,1);
+        index_ct++;
+      }
+    }
+  }
+  if (_scalars_ && (phr->has_td == _TRUE_)) {
+    for (index_d1=0; index_d1<phr->d_size; index_d1++)
+      _set_ct_(phr->index_ct_td+index_d1,field_t,field_nc+index_d1,2);
+  }
+  if (_scalars_ && (phr->has_pd == _TRUE_)) {
+    for (index_d1=0; index_d1<phr->d_size; index_d1++)
+      _set_ct_(phr->index_ct_pd+index_d1,field_p,field_nc+index_d1,2);
+  }
+  if (_scalars_ && (phr->has_ll == _TRUE_)) {
+    index_ct=0;
+    for (index_d1=0; index_d1<phr->d_size; index_d1++) {
+      for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
+        _set_ct_(phr->index_ct_ll+index_ct,field_l+index_d1,field_l+index_d2,1);
+        index_ct++;
+      }
+    }
+  }
+  if (_scalars_ && (phr->has_tl == _TRUE_)) {
+    for (index_d1=0; index_d1<phr->d_size; index_d1++)
+      _set_ct_(phr->index_ct_tl+index_d1,field_t,field_l+index_d1,2);
+  }
+  if (_scalars_ && (phr->has_dl == _TRUE_)) {
+    index_ct=0;
+    for (index_d1=0; index_d1<phr->d_size; index_d1++) {
+      for (index_d2=MAX(index_d1-phr->non_diag,0); index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
+        _set_ct_(phr->index_ct_dl+index_ct,field_nc+index_d1,field_l+index_d2,1);
+        index_ct++;
+      }
+    }
+  }
+
+#undef _set_ct_
+
+  /* null spectra (C_l^BB of scalars, C_l^pp of tensors, etc.) */
+  for (index_ct=0; index_ct<phr->ct_size; index_ct++) {
+    if ((_scalars_ && (phr->has_bb == _TRUE_) && (index_ct == phr->index_ct_bb)) ||
+        (_tensors_ && (phr->has_pp == _TRUE_) && (index_ct == phr->index_ct_pp)) ||
+        (_tensors_ && (phr->has_tp == _TRUE_) && (index_ct == phr->index_ct_tp)) ||
+        (_tensors_ && (phr->has_ep == _TRUE_) && (index_ct == phr->index_ct_ep)) ||
+        (_tensors_ && (phr->has_dd == _TRUE_) && (index_ct == phr->index_ct_dd)) ||
+        (_tensors_ && (phr->has_td == _TRUE_) && (index_ct == phr->index_ct_td)) ||
+        (_tensors_ && (phr->has_pd == _TRUE_) && (index_ct == phr->index_ct_pd)) ||
+        (_tensors_ && (phr->has_ll == _TRUE_) && (index_ct == phr->index_ct_ll)) ||
+        (_tensors_ && (phr->has_tl == _TRUE_) && (index_ct == phr->index_ct_tl)) ||
+        (_tensors_ && (phr->has_dl == _TRUE_) && (index_ct == phr->index_ct_dl))
+        ) {
+      pho->ct_kind[index_ct] = 0;
+    }
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Free the arrays of a harmonic_offload structure
+ *
+ * @param pho Input: pointer to harmonic_offload structure
+ * @return the error status
+ */
+
+int harmonic_offload_free(
+                         struct harmonic_offload * pho
+                         ) {
+
+  free(pho->q_weight);
+  free(pho->pk);
+  free(pho->field_tt);
+  free(pho->field_lfactor);
+  free(pho->ct_field_1);
+  free(pho->ct_field_2);
+  free(pho->ct_kind);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine computes the \f$ C_l\f$'s of one mode, for all pairs
+ * of initial conditions and for the multipoles index_l_min <= index_l
+ * < index_l_max, like harmonic_cls_l_range(), but in two regular
+ * kernels written as OpenMP target regions: the first combines the
+ * transfer functions into fields, the second integrates each product of
+ * fields over k as a weighted sum. When the code is compiled with
+ * offloading (e.g. gcc -fopenmp -foffload=nvptx-none, see the Makefile),
+ * the tables are copied once to the device and both kernels run there;
+ * otherwise they run on the host threads. The results agree with those
+ * of harmonic_cls_l_range() up to rounding errors.
+ *
+ * @param ppt         Input: pointer to perturbation structure
+ * @param ptr         Input: pointer to transfer structure
+ * @param phr         Input/Output: pointer to harmonic structure
+ * @param index_md    Input: index of mode under consideration
+ * @param index_l_min Input: index of first multipole
+ * @param index_l_max Input: index of last multipole plus one
+ * @param pho         Input: pointer to harmonic_offload structure prepared by harmonic_offload_init()
+ * @return the error status
+ */
+
+int harmonic_cls_l_range_offload(
+                                struct perturbations * ppt,
+                                struct transfer * ptr,
+                                struct harmonic * phr,
+                                int index_md,
+                                int index_l_min,
+                                int index_l_max,
+                                struct harmonic_offload * pho
+                                ) {
+
+  /* sizes and tables copied to local variables, to be mapped to the device */
+  int l_size = index_l_max-index_l_min;
+  int q_size = ptr->q_size;
+  int ic_size = phr->ic_size[index_md];
+  int ic_ic_size = phr->ic_ic_size[index_md];
+  int tt_size = ptr->tt_size[index_md];
+  int ct_size = phr->ct_size;
+  int field_size = pho->field_size;
+  int l_table_size = ptr->l_table_size[index_md];
+  int l_offset = index_l_min-ptr->index_l_table_min;
+  size_t table_size = (size_t)ic_size*tt_size*l_table_size*q_size;
+  size_t field_table_size = (size_t)ic_size*MAX(field_size,1)*l_size*q_size;
+  int term_size = MAX(field_size,1)*_HARMONIC_OFFLOAD_TERMS_;
+  size_t cl_size = (size_t)l_size*ic_ic_size*ct_size;
+  double * transfer_double = (ptr->transfer_float == NULL ? ptr->transfer[index_md] : NULL);
+  float * transfer_float = (ptr->transfer_float == NULL ? NULL : ptr->transfer_float[index_md]);
+  double * q_weight = pho->q_weight;
+  double * pk = pho->pk;
+  int * field_tt = pho->field_tt;
+  short * field_lfactor = pho->field_lfactor;
+  int * ct_field_1 = pho->ct_field_1;
+  int * ct_field_2 = pho->ct_field_2;
+  short * ct_kind = pho->ct_kind;
+
+  double * l_value;
+  double * field;
+  double * cl_block;
+  int * ic1_of_ic_ic;
+  int * ic2_of_ic_ic;
+  short * is_non_zero;
+
+  int index_ic1,index_ic2,index_ic1_ic2;
+  int index_l,index_q,index_field,index_ct,index_term;
+  int index_tt;
+  double value,sum,weight;
+  double * field_11;
+  double * field_12;
+  double * field_21;
+  double * field_22;
+
+  if (l_size <= 0)
+    return _SUCCESS_;
+
+  class_alloc(l_value,l_size*sizeof(double),phr->error_message);
+  class_alloc(field,field_table_size*sizeof(double),phr->error_message);
+  class_alloc(cl_block,cl_size*sizeof(double),phr->error_message);
+  class_alloc(ic1_of_ic_ic,ic_ic_size*sizeof(int),phr->error_message);
+  class_alloc(ic2_of_ic_ic,ic_ic_size*sizeof(int),phr->error_message);
+  class_alloc(is_non_zero,ic_ic_size*sizeof(short),phr->error_message);
+
+  for (index_l=0; index_l < l_size; index_l++)
+    l_value[index_l] = phr->l[index_l_min+index_l];
+
+  for (index_ic1 = 0; index_ic1 < ic_size; index_ic1++) {
+    for (index_ic2 = index_ic1; index_ic2 < ic_size; index_ic2++) {
+      index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,ic_size);
+      ic1_of_ic_ic[index_ic1_ic2] = index_ic1;
+      ic2_of_ic_ic[index_ic1_ic2] = index_ic2;
+      is_non_zero[index_ic1_ic2] = phr->is_non_zero[index_md][index_ic1_ic2];
+    }
+  }
+
+#pragma omp target data                                                 \
+  map(to: q_weight[0:q_size], pk[0:q_size*ic_ic_size], field_tt[0:term_size], field_lfactor[0:term_size], \
+      ct_field_1[0:ct_size], ct_field_2[0:ct_size], ct_kind[0:ct_size], l_value[0:l_size], \
+      ic1_of_ic_ic[0:ic_ic_size], ic2_of_ic_ic[0:ic_ic_size], is_non_zero[0:ic_ic_size]) \
+  map(alloc: field[0:field_table_size])                                 \
+  map(from: cl_block[0:cl_size])
+  {
+
+    /** - first kernel: fields, field[((index_ic*field_size+index_field)*l_size+index_l)*q_size+index_q] */
+
+    if (transfer_double != NULL) {
+#pragma omp target teams distribute parallel for collapse(4)            \
+  map(to: transfer_double[0:table_size])                                \
+  private(index_term,index_tt,value)
+      for (index_ic1 = 0; index_ic1 < ic_size; index_ic1++) {
+        for (index_field = 0; index_field < field_size; index_field++) {
+          for (index_l = 0; index_l < l_size; index_l++) {
+            for (index_q = 0; index_q < q_size; index_q++) {
+              value = 0.;
+              for (index_term = 0; index_term < _HARMONIC_OFFLOAD_TERMS_; index_term++) {
+                index_tt = field_tt[index_field*_HARMONIC_OFFLOAD_TERMS_+index_term];
+                if (index_tt >= 0) {
+                  if (field_lfactor[index_field*_HARMONIC_OFFLOAD_TERMS_+index_term] == _TRUE_)
+                    value += l_value[index_l]*(l_value[index_l]+1.)
+                      *transfer_double[(((size_t)index_ic1*tt_size+index_tt)*l_table_size+index_l+l_offset)*q_size+index_q];
+                  else
+                    value += transfer_double[(((size_t)index_ic1*tt_size+index_tt)*l_table_size+index_l+l_offset)*q_size+index_q];
+                }
+              }
+              field[(((size_t)index_ic1*field_size+index_field)*l_size+index_l)*q_size+index_q] = value;
+            }
+          }
+        }
+      }
+    }
+    else {
+#pragma omp target teams distribute parallel for collapse(4)            \
+  map(to: transfer_float[0:table_size])                                 \
+  private(index_term,index_tt,value)
+      for (index_ic1 = 0; index_ic1 < ic_size; index_ic1++) {
+        for (index_field = 0; index_field < field_size; index_field++) {
+          for (index_l = 0; index_l < l_size; index_l++) {
+            for (index_q = 0; index_q < q_size; index_q++) {
+              value = 0.;
+              for (index_term = 0; index_term < _HARMONIC_OFFLOAD_TERMS_; index_term++) {
+                index_tt = field_tt[index_field*_HARMONIC_OFFLOAD_TERMS_+index_term];
+                if (index_tt >= 0) {
+                  if (field_lfactor[index_field*_HARMONIC_OFFLOAD_TERMS_+index_term] == _TRUE_)
+                    value += l_value[index_l]*(l_value[index_l]+1.)
+                      *(double)transfer_float[(((size_t)index_ic1*tt_size+index_tt)*l_table_size+index_l+l_offset)*q_size+index_q];
+                  else
+                    value += (double)transfer_float[(((size_t)index_ic1*tt_size+index_tt)*l_table_size+index_l+l_offset)*q_size+index_q];
+                }
+              }
+              field[(((size_t)index_ic1*field_size+index_field)*l_size+index_l)*q_size+index_q] = value;
+            }
+          }
+        }
+      }
+    }
+
+    /** - second kernel: C_l's, integrals over k of products of fields */
+
+#pragma omp target teams distribute parallel for collapse(3)            \
+  private(index_ic1,index_ic2,index_q,sum,weight,field_11,field_12,field_21,field_22)
+    for (index_l = 0; index_l < l_size; index_l++) {
+      for (index_ic1_ic2 = 0; index_ic1_ic2 < ic_ic_size; index_ic1_ic2++) {
+        for (index_ct = 0; index_ct < ct_size; index_ct++) {
+          sum = 0.;
+          if ((ct_kind[index_ct] > 0) && (is_non_zero[index_ic1_ic2] == _TRUE_)) {
+            index_ic1 = ic1_of_ic_ic[index_ic1_ic2];
+            index_ic2 = ic2_of_ic_ic[index_ic1_ic2];
+            field_11 = field+(((size_t)index_ic1*field_size+ct_field_1[index_ct])*l_size+index_l)*q_size;
+            field_22 = field+(((size_t)index_ic2*field_size+ct_field_2[index_ct])*l_size+index_l)*q_size;
+            if (ct_kind[index_ct] == 1) {
+              for (index_q = 0; index_q < q_size; index_q++) {
+                weight = q_weight[index_q]*pk[index_q*ic_ic_size+index_ic1_ic2];
+                sum += weight*field_11[index_q]*field_22[index_q];
+              }
+            }
+            else {
+              field_12 = field+(((size_t)index_ic1*field_size+ct_field_2[index_ct])*l_size+index_l)*q_size;
+              field_21 = field+(((size_t)index_ic2*field_size+ct_field_1[index_ct])*l_size+index_l)*q_size;
+              for (index_q = 0; index_q < q_size; index_q++) {
+                weight = q_weight[index_q]*pk[index_q*ic_ic_size+index_ic1_ic2];
+                sum += weight*0.5*(field_11[index_q]*field_22[index_q]+field_12[index_q]*field_21[index_q]);
+              }
             }
           }
+          cl_block[((size_t)index_l*ic_ic_size+index_ic1_ic2)*ct_size+index_ct] = sum;
         }
       }
     }
 
-    /** - --> (d) now that for a given mode, all possible \f$ C_l\f$'s have been computed,
-        compute second derivative of the array in which they are stored,
-        in view of spline interpolation. */
+  } /* end of target data region */
 
-    class_call(array_spline_table_lines(phr->l,
-                                        phr->l_size[index_md],
-                                        phr->cl[index_md],
-                                        phr->ic_ic_size[index_md]*phr->ct_size,
-                                        phr->ddcl[index_md],
-                                        _SPLINE_EST_DERIV_,
-                                        phr->error_message),
-               phr->error_message,
-               phr->error_message);
+  /** - store the results */
+
+  for (index_l=0; index_l < l_size; index_l++) {
+    for (index_ic1_ic2 = 0; index_ic1_ic2 < ic_ic_size; index_ic1_ic2++) {
+      for (index_ct = 0; index_ct < ct_size; index_ct++) {
+        phr->cl[index_md][((index_l_min+index_l) * ic_ic_size + index_ic1_ic2) * ct_size + index_ct]
+          = cl_block[((size_t)index_l*ic_ic_size+index_ic1_ic2)*ct_size+index_ct];
+      }
+    }
   }
 
+  free(l_value);
+  free(field);
+  free(cl_block);
+  free(ic1_of_ic_ic);
+  free(ic2_of_ic_ic);
+  free(is_non_zero);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine computes the \f$ C_l\f$'s of one mode, for all pairs
+ * of initial conditions and for the multipoles index_l_min <= index_l
+ * < index_l_max, like harmonic_cls_l_range(), but as matrix products.
+ * For each multipole and initial condition, the fields of pho (the
+ * combinations of transfer functions entering the \f$ C_l\f$'s) are
+ * stored as the rows of a (fields x k) matrix F. For each pair of
+ * initial conditions, the integrals over k of all products of fields
+ * are then the elements of the single matrix product F_1 W F_2^T, where
+ * W is the diagonal matrix of the weights of the integral times the
+ * primordial spectrum. Each type of \f$ C_l\f$ is one element of this
+ * product (or the half sum of two symmetric elements). For
+ * auto-correlations, F_1 = F_2 and the product is a symmetric rank-k
+ * update. Products are computed by array_weighted_product(), with BLAS
+ * if CLASS is compiled with -D_BLAS (see the Makefile) or with blocked
+ * loops otherwise: with many number count and lensing bins, this is the
+ * cost of a dense linear algebra kernel. The parallel
+ * loop deals with blocks of l_block_size consecutive multipoles, whose
+ * transfer functions are contiguous in the table of the transfer
+ * structure. The results agree with those of harmonic_cls_l_range()
+ * up to rounding errors.
+ *
+ * @param ppt          Input: pointer to perturbation structure
+ * @param ptr          Input: pointer to transfer structure
+ * @param phr          Input/Output: pointer to harmonic structure
+ * @param index_md     Input: index of mode under consideration
+ * @param index_l_min  Input: index of first multipole
+ * @param index_l_max  Input: index of last multipole plus one
+ * @param l_block_size Input: number of multipoles per task
+ * @param pho          Input: pointer to harmonic_offload structure prepared by harmonic_offload_init()
+ * @return the error status
+ */
+
+int harmonic_cls_l_range_matrix(
+                               struct perturbations * ppt,
+                               struct transfer * ptr,
+                               struct harmonic * phr,
+                               int index_md,
+                               int index_l_min,
+                               int index_l_max,
+                               int l_block_size,
+                               struct harmonic_offload * pho
+                               ) {
+
+  int q_size = ptr->q_size;
+  int ic_size = phr->ic_size[index_md];
+  int ic_ic_size = phr->ic_ic_size[index_md];
+  int field_size = pho->field_size;
+  int block_size;
+  int block_num;
+  int index_block;
+  int l_num;
+  int index_l,index_l_block;
+  int index_ic1,index_ic2,index_ic1_ic2;
+  int index_field,index_term;
+  int index_tt;
+  int index_q;
+  int index_ct;
+  double lfactor;
+  double * field;          /* field[((index_ic*block_size+index_l_block)*field_size+index_field)*q_size+index_q]: matrices F */
+  double * weight;         /* weight[index_q]: weight of the integral times primordial spectrum */
+  double * weighted_field; /* weighted_field[index_field*q_size+index_q]: workspace for the lines of F_1 W */
+  double * product;        /* product[index_field_1*field_size+index_field_2]: elements of F_1 W F_2^T */
+  double * field_1;
+  double * field_2;
+  double * cl;
+
+  /* error management flag for the parallel region */
+  int abort;
+
+  if (index_l_max <= index_l_min)
+    return _SUCCESS_;
+
+  block_size = MAX(l_block_size,1);
+  block_num = (index_l_max-index_l_min+block_size-1)/block_size;
+
+  abort = _FALSE_;
+
+#pragma omp parallel                                                    \
+  shared(ppt,ptr,phr,pho,index_md,index_l_min,index_l_max,block_size,block_num,q_size,ic_size,ic_ic_size,field_size,abort) \
+  private(index_block,l_num,index_l,index_l_block,index_ic1,index_ic2,index_ic1_ic2,index_field,index_term, \
+          index_tt,index_q,index_ct,lfactor,field,weight,weighted_field,product,field_1,field_2,cl)
+  {
+
+    class_alloc_parallel(field,(size_t)ic_size*MAX(field_size,1)*block_size*q_size*sizeof(double),phr->error_message);
+    class_alloc_parallel(weight,q_size*sizeof(double),phr->error_message);
+    class_alloc_parallel(weighted_field,(size_t)MAX(field_size,1)*q_size*sizeof(double),phr->error_message);
+    class_alloc_parallel(product,MAX(field_size*field_size,1)*sizeof(double),phr->error_message);
+
+#pragma omp for schedule (dynamic)
+
+    for (index_block=0; index_block < block_num; index_block++) {
+
+#pragma omp flush(abort)
+
+      if (abort == _TRUE_) continue;
+
+      class_trace_begin();
+
+      l_num = MIN(block_size,index_l_max-index_l_min-index_block*block_size);
+
+      /** - fields of the block of multipoles, each term adding one contiguous row of the table of transfer functions */
+
+      for (index_ic1=0; index_ic1 < ic_size; index_ic1++) {
+        for (index_field=0; index_field < field_size; index_field++) {
+          for (index_l_block=0; index_l_block < l_num; index_l_block++) {
+
+            index_l = index_l_min+index_block*block_size+index_l_block;
+            field_1 = field+(((size_t)index_ic1*block_size+index_l_block)*field_size+index_field)*q_size;
+
+            for (index_q=0; index_q < q_size; index_q++)
+              field_1[index_q] = 0.;
+
+            for (index_term=0; index_term < _HARMONIC_OFFLOAD_TERMS_; index_term++) {
+              index_tt = pho->field_tt[index_field*_HARMONIC_OFFLOAD_TERMS_+index_term];
+              if (index_tt < 0)
+                continue;
+              lfactor = 1.;
+              if (pho->field_lfactor[index_field*_HARMONIC_OFFLOAD_TERMS_+index_term] == _TRUE_)
+                lfactor = phr->l[index_l]*(phr->l[index_l]+1.);
+              for (index_q=0; index_q < q_size; index_q++)
+                field_1[index_q] += lfactor*_transfer_get_(ptr,index_md,_transfer_index_(ptr,index_md,index_ic1,index_tt,index_l,index_q));
+            }
+          }
+        }
+      }
+
+      /** - for each multipole and pair of initial conditions, one matrix product F_1 W F_2^T
+          (computed by array_weighted_product(), as a symmetric rank-k update if F_1 = F_2)
+          gives all the \f$ C_l\f$'s */
+
+      for (index_l_block=0; index_l_block < l_num; index_l_block++) {
+
+        index_l = index_l_min+index_block*block_size+index_l_block;
+
+        for (index_ic1=0; index_ic1 < ic_size; index_ic1++) {
+          for (index_ic2=index_ic1; index_ic2 < ic_size; index_ic2++) {
+
+            index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,ic_size);
+            cl = phr->cl[index_md]+((size_t)index_l*ic_ic_size+index_ic1_ic2)*phr->ct_size;
+
+            /* set non-diagonal coefficients to zero if pair of ic's uncorrelated */
+            if (phr->is_non_zero[index_md][index_ic1_ic2] == _FALSE_) {
+              for (index_ct=0; index_ct < phr->ct_size; index_ct++)
+                cl[index_ct] = 0.;
+              continue;
+            }
+
+            for (index_q=0; index_q < q_size; index_q++)
+              weight[index_q] = pho->q_weight[index_q]*pho->pk[index_q*ic_ic_size+index_ic1_ic2];
+
+            field_1 = field+((size_t)index_ic1*block_size+index_l_block)*field_size*q_size;
+            field_2 = field+((size_t)index_ic2*block_size+index_l_block)*field_size*q_size;
+
+            /* symmetric rank-k update F W F^T for auto-correlations, general product F_1 W F_2^T otherwise */
+            class_call_parallel(array_weighted_product(field_1,
+                                                       field_2,
+                                                       weight,
+                                                       field_size,
+                                                       q_size,
+                                                       (index_ic2 == index_ic1 ? _TRUE_ : _FALSE_),
+                                                       weighted_field,
+                                                       product,
+                                                       phr->error_message),
+                                phr->error_message,
+                                phr->error_message);
+
+            for (index_ct=0; index_ct < phr->ct_size; index_ct++) {
+              if (pho->ct_kind[index_ct] == 1)
+                cl[index_ct] = product[pho->ct_field_1[index_ct]*field_size+pho->ct_field_2[index_ct]];
+              else if (pho->ct_kind[index_ct] == 2)
+                cl[index_ct] = 0.5*(product[pho->ct_field_1[index_ct]*field_size+pho->ct_field_2[index_ct]]
+                                    +product[pho->ct_field_2[index_ct]*field_size+pho->ct_field_1[index_ct]]);
+              else
+                cl[index_ct] = 0.;
+            }
+          }
+        }
+      }
+
+      class_trace_end("harmonic","index_l",index_l_min+index_block*block_size);
+
+    } /* end of loop over blocks of multipoles */
+
+    free(field);
+    free(weight);
+    free(weighted_field);
+    free(product);
+
+  } /* end of parallel region */
+
+  if (abort == _TRUE_) return _FAILURE_;
+
   return _SUCCESS_;
 
 }
@@ -861,7 +2022,7 @@ int harmonic_cls(
  * @param index_l       Input: index of multipole under consideration
  * @param cl_integrand_num_columns Input: number of columns in cl_integrand
  * @param cl_integrand  Input: an allocated workspace
- * @param primordial_pk Input: table of primordial spectrum values
+ * @param primordial_pk Input: table of primordial spectrum values, primordial_pk[index_q*phr->ic_ic_size[index_md]+index_ic1_ic2]
  * @param transfer_ic1  Input: table of transfer function values for first initial condition
  * @param transfer_ic2  Input: table of transfer function values for second initial condition
  * @return the error status
@@ -896,6 +2057,7 @@ int harmonic_compute_cl(
   double * transfer_ic1_nc=NULL;
   double * transfer_ic2_nc=NULL;
   double factor;
+  double pk;
   int index_q_spline=0;
 
   index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,phr->ic_size[index_md]);
@@ -912,28 +2074,23 @@ int harmonic_compute_cl(
 
     cl_integrand[index_q*cl_integrand_num_columns+0] = k;
 
-    class_call(primordial_spectrum_at_k(ppm,index_md,linear,k,primordial_pk),
-               ppm->error_message,
-               phr->error_message);
+    pk = primordial_pk[index_q*phr->ic_ic_size[index_md]+index_ic1_ic2];
 
-    /* above routine checks that k>0: no possible division by zero below */
+    /* primordial_spectrum_at_k_array() has checked that k>0: no possible division by zero below */
 
     for (index_tt=0; index_tt < ptr->tt_size[index_md]; index_tt++) {
 
       transfer_ic1[index_tt] =
-        ptr->transfer[index_md]
-        [((index_ic1 * ptr->tt_size[index_md] + index_tt)
-          * ptr->l_size[index_md] + index_l)
-         * ptr->q_size + index_q];
+        _transfer_get_(ptr,index_md,
+                       _transfer_index_(ptr,index_md,index_ic1,index_tt,index_l,index_q));
 
       if (index_ic1 == index_ic2) {
         transfer_ic2[index_tt] = transfer_ic1[index_tt];
       }
       else {
-        transfer_ic2[index_tt] = ptr->transfer[index_md]
-          [((index_ic2 * ptr->tt_size[index_md] + index_tt)
-            * ptr->l_size[index_md] + index_l)
-           * ptr->q_size + index_q];
+        transfer_ic2[index_tt] =
+          _transfer_get_(ptr,index_md,
+                         _transfer_index_(ptr,index_md,index_ic2,index_tt,index_l,index_q));
       }
     }
 
@@ -1058,49 +2215,49 @@ int harmonic_compute_cl(
 
     if (phr->has_tt == _TRUE_)
       cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_tt]=
-        primordial_pk[index_ic1_ic2]
+        pk
         * transfer_ic1_temp
         * transfer_ic2_temp
         * factor;
 
     if (phr->has_ee == _TRUE_)
       cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_ee]=
-        primordial_pk[index_ic1_ic2]
+        pk
         * transfer_ic1[ptr->index_tt_e]
         * transfer_ic2[ptr->index_tt_e]
         * factor;
 
     if (phr->has_te == _TRUE_)
       cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_te]=
-        primordial_pk[index_ic1_ic2]
+        pk
         * 0.5*(transfer_ic1_temp * transfer_ic2[ptr->index_tt_e] +
                transfer_ic1[ptr->index_tt_e] * transfer_ic2_temp)
         * factor;
 
     if (_tensors_ && (phr->has_bb == _TRUE_))
       cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_bb]=
-        primordial_pk[index_ic1_ic2]
+        pk
         * transfer_ic1[ptr->index_tt_b]
         * transfer_ic2[ptr->index_tt_b]
         * factor;
 
     if (_scalars_ && (phr->has_pp == _TRUE_))
       cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_pp]=
-        primordial_pk[index_ic1_ic2]
+        pk
         * transfer_ic1[ptr->index_tt_lcmb]
         * transfer_ic2[ptr->index_tt_lcmb]
         * factor;
 
     if (_scalars_ && (phr->has_tp == _TRUE_))
       cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_tp]=
-        primordial_pk[index_ic1_ic2]
+        pk
         * 0.5*(transfer_ic1_temp * transfer_ic2[ptr->index_tt_lcmb] +
                transfer_ic1[ptr->index_tt_lcmb] * transfer_ic2_temp)
         * factor;
 
     if (_scalars_ && (phr->has_ep == _TRUE_))
       cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_ep]=
-        primordial_pk[index_ic1_ic2]
+        pk
         * 0.5*(transfer_ic1[ptr->index_tt_e] * transfer_ic2[ptr->index_tt_lcmb] +
                transfer_ic1[ptr->index_tt_lcmb] * transfer_ic2[ptr->index_tt_e])
         * factor;
@@ -1110,7 +2267,7 @@ int harmonic_compute_cl(
       for (index_d1=0; index_d1<phr->d_size; index_d1++) {
         for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
           cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_dd+index_ct]=
-            primordial_pk[index_ic1_ic2]
+            pk
             * transfer_ic1_nc[index_d1]
             * transfer_ic2_nc[index_d2]
             * factor;
@@ -1122,7 +2279,7 @@ int harmonic_compute_cl(
     if (_scalars_ && (phr->has_td == _TRUE_)) {
       for (index_d1=0; index_d1<phr->d_size; index_d1++) {
         cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_td+index_d1]=
-          primordial_pk[index_ic1_ic2]
+          pk
           * 0.5*(transfer_ic1_temp * transfer_ic2_nc[index_d1] +
                  transfer_ic1_nc[index_d1] * transfer_ic2_temp)
           * factor;
@@ -1132,7 +2289,7 @@ int harmonic_compute_cl(
     if (_scalars_ && (phr->has_pd == _TRUE_)) {
       for (index_d1=0; index_d1<phr->d_size; index_d1++) {
         cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_pd+index_d1]=
-          primordial_pk[index_ic1_ic2]
+          pk
           * 0.5*(transfer_ic1[ptr->index_tt_lcmb] * transfer_ic2_nc[index_d1] +
                  transfer_ic1_nc[index_d1] * transfer_ic2[ptr->index_tt_lcmb])
           * factor;
@@ -1144,7 +2301,7 @@ int harmonic_compute_cl(
       for (index_d1=0; index_d1<phr->d_size; index_d1++) {
         for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
           cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_ll+index_ct]=
-            primordial_pk[index_ic1_ic2]
+            pk
             * transfer_ic1[ptr->index_tt_lensing+index_d1]
             * transfer_ic2[ptr->index_tt_lensing+index_d2]
             * factor;
@@ -1156,7 +2313,7 @@ int harmonic_compute_cl(
     if (_scalars_ && (phr->has_tl == _TRUE_)) {
       for (index_d1=0; index_d1<phr->d_size; index_d1++) {
         cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_tl+index_d1]=
-          primordial_pk[index_ic1_ic2]
+          pk
           * 0.5*(transfer_ic1_temp * transfer_ic2[ptr->index_tt_lensing+index_d1] +
                  transfer_ic1[ptr->index_tt_lensing+index_d1] * transfer_ic2_temp)
           * factor;
@@ -1168,7 +2325,7 @@ int harmonic_compute_cl(
       for (index_d1=0; index_d1<phr->d_size; index_d1++) {
         for (index_d2=MAX(index_d1-phr->non_diag,0); index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
           cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_dl+index_ct]=
-            primordial_pk[index_ic1_ic2]
+            pk
             * transfer_ic1_nc[index_d1] * transfer_ic2[ptr->index_tt_lensing+index_d2]
             * factor;
           index_ct++;
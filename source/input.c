@@ -126,8 +126,11 @@ int input_find_file(int argc,
       they will remain null and inform input_init that all parameters take
       default values. */
   fc->size = 0;
+  fc->hash_size = 0;
   fc_input.size = 0;
+  fc_input.hash_size = 0;
   fc_precision.size = 0;
+  fc_precision.hash_size = 0;
   input_file[0]='\0';
   precision_file[0]='\0';
 
@@ -557,6 +560,15 @@ int input_shooting(struct file_content * pfc,
   struct fzerofun_workspace fzw;
 
   *has_shooting=_FALSE_;
+  fzw.warm_start = ppr->shooting_warm_start;
+  fzw.reuse_structures = ppr->shooting_reuse_structures;
+  for (i=0; i < _SHOOTING_KEPT_STEPS_; i++) {
+    fzw.kept_step[i].used = _FALSE_;
+    fzw.kept_step[i].unknown_parameter = NULL;
+    fzw.kept_step[i].pba = NULL;
+    fzw.kept_step[i].pth = NULL;
+  }
+  fzw.kept_step_next = 0;
 
   /** Do we need to fix unknown parameters? */
   unknown_parameters_size = 0;
@@ -639,6 +651,11 @@ int input_shooting(struct file_content * pfc,
       strcpy(fzw.fc.name[fzw.unknown_parameters_index[counter]],unknown_namestrings[index_target]);
     }
 
+    /* all names are now known: index them for the many readings done while shooting */
+    class_call(parser_index(&(fzw.fc),
+                            errmsg),
+               errmsg,errmsg);
+
     /** If there is only one parameter, we use a more efficient Newton method for 1D cases */
     if (unknown_parameters_size == 1){
 
@@ -664,6 +681,7 @@ int input_shooting(struct file_content * pfc,
       // This needs to be done with enough accuracy. A standard double has a relative
       // precision of around 1e-16, so 1e-20 should be good enough for the shooting
       sprintf(fzw.fc.value[fzw.unknown_parameters_index[0]],"%.20e",xzero);
+      unknown_parameter[0] = xzero;
       if (input_verbose > 0) {
         fprintf(stdout," -> found '%s = %s'\n",
                 fzw.fc.name[fzw.unknown_parameters_index[0]],
@@ -712,6 +730,7 @@ int input_shooting(struct file_content * pfc,
       for (counter = 0; counter < unknown_parameters_size; counter++){
         sprintf(fzw.fc.value[fzw.unknown_parameters_index[counter]],
                 "%.20e",x_inout[counter]);
+        unknown_parameter[counter] = x_inout[counter];
         if (input_verbose > 0) {
           fprintf(stdout," -> found '%s = %s'\n",
                   fzw.fc.name[fzw.unknown_parameters_index[counter]],
@@ -737,6 +756,28 @@ int input_shooting(struct file_content * pfc,
     /** Set status of shooting */
     pba->shooting_failed = shooting_failed;
 
+    /** If requested, hand over the background and thermodynamics
+        structures of the converged step to the main computation
+        (not with the Pk_equal method, which runs the background
+        module again with other parameters), and free the other
+        kept steps */
+    if ((fzw.reuse_structures == _TRUE_) && (shooting_failed == _FALSE_) && (pfo->has_pk_eq == _FALSE_)) {
+      class_call(input_shooting_hand_over(&fzw,
+                                          unknown_parameter,
+                                          pba,
+                                          pth,
+                                          errmsg),
+                 errmsg,
+                 errmsg);
+      if ((input_verbose > 1) && (pba->is_from_shooting == _TRUE_)) {
+        fprintf(stdout," -> background%s of the converged shooting step kept\n",
+                (pth->is_from_shooting == _TRUE_ ? " and thermodynamics" : ""));
+      }
+    }
+    class_call(input_shooting_free_steps(&fzw),
+               errmsg,
+               errmsg);
+
     /* all parameters read in fzw must be considered as read in pfc. At the same
        time the parameters read before in pfc (like theta_s,...) must still be
        considered as read (hence we could not do a memcopy) */
@@ -760,6 +801,167 @@ int input_shooting(struct file_content * pfc,
 }
 
 
+/**
+ * Related to 'shooting': keep the background and (if computed and
+ * without exotic energy injection) thermodynamics structures of a
+ * shooting step in the next slot of pfzw->kept_step[], freeing the
+ * structures of the oldest step. The structures are moved: the caller
+ * must not free them.
+ *
+ * @param pfzw               Input/Output: pointer to shooting workspace
+ * @param unknown_parameter  Input: values of the unknown parameters at this step
+ * @param pba                Input: pointer to computed background structure
+ * @param pth                Input: pointer to computed thermodynamics structure
+ * @param has_thermodynamics Input: was the thermodynamics structure computed?
+ * @param errmsg             Input/Output: Error message
+ * @return the error status
+ */
+
+int input_shooting_keep_step(struct fzerofun_workspace * pfzw,
+                             double * unknown_parameter,
+                             struct background * pba,
+                             struct thermodynamics * pth,
+                             short has_thermodynamics,
+                             ErrorMsg errmsg){
+
+  struct shooting_step * pstep = &(pfzw->kept_step[pfzw->kept_step_next]);
+
+  /** - free the oldest step, or allocate the slot */
+  if (pstep->used == _TRUE_) {
+    if (pstep->has_thermodynamics == _TRUE_) {
+      class_call(thermodynamics_free(pstep->pth), pstep->pth->error_message, errmsg);
+    }
+    class_call(background_free(pstep->pba), pstep->pba->error_message, errmsg);
+    pstep->used = _FALSE_;
+  }
+  else if (pstep->pba == NULL) {
+    class_alloc(pstep->unknown_parameter,pfzw->target_size*sizeof(double),errmsg);
+    class_alloc(pstep->pba,sizeof(struct background),errmsg);
+    class_alloc(pstep->pth,sizeof(struct thermodynamics),errmsg);
+  }
+
+  /** - the injection structure is not moved: with exotic energy injection, the thermodynamics is computed again */
+  if ((has_thermodynamics == _TRUE_) && (pth->has_exotic_injection == _TRUE_)) {
+    class_call(thermodynamics_free(pth), pth->error_message, errmsg);
+    has_thermodynamics = _FALSE_;
+  }
+
+  memcpy(pstep->unknown_parameter,unknown_parameter,pfzw->target_size*sizeof(double));
+  *(pstep->pba) = *pba;
+  if (has_thermodynamics == _TRUE_)
+    *(pstep->pth) = *pth;
+  pstep->has_thermodynamics = has_thermodynamics;
+  pstep->used = _TRUE_;
+
+  pfzw->kept_step_next = (pfzw->kept_step_next+1)%_SHOOTING_KEPT_STEPS_;
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Related to 'shooting': if one of the kept steps was computed with
+ * exactly the values of the unknown parameters found by the shooting,
+ * replace the background and thermodynamics structures just read from
+ * the same input by those of this step, and set their flag
+ * is_from_shooting, so that background_init() and
+ * thermodynamics_init() do not compute them again.
+ *
+ * @param pfzw              Input/Output: pointer to shooting workspace
+ * @param unknown_parameter Input: values of the unknown parameters found by the shooting
+ * @param pba               Input/Output: pointer to background structure (input parameters already read)
+ * @param pth               Input/Output: pointer to thermodynamics structure (input parameters already read)
+ * @param errmsg            Input/Output: Error message
+ * @return the error status
+ */
+
+int input_shooting_hand_over(struct fzerofun_workspace * pfzw,
+                             double * unknown_parameter,
+                             struct background * pba,
+                             struct thermodynamics * pth,
+                             ErrorMsg errmsg){
+
+  struct shooting_step * pstep = NULL;
+  int index_step;
+  int i;
+  short background_verbose;
+  short thermodynamics_verbose;
+  short hyrec_verbose;
+
+  for (index_step=0; index_step < _SHOOTING_KEPT_STEPS_; index_step++) {
+    if (pfzw->kept_step[index_step].used == _FALSE_)
+      continue;
+    for (i=0; i < pfzw->target_size; i++) {
+      if (pfzw->kept_step[index_step].unknown_parameter[i] != unknown_parameter[i])
+        break;
+    }
+    if (i == pfzw->target_size) {
+      pstep = &(pfzw->kept_step[index_step]);
+      break;
+    }
+  }
+
+  if (pstep == NULL)
+    return _SUCCESS_;
+
+  /** - the input parameters of the kept structures were read from
+        the same file content: free those just read and take the kept
+        structures as a whole, with the verbosity of the main run */
+  background_verbose = pba->background_verbose;
+  class_call(background_free_input(pba), pba->error_message, errmsg);
+  *pba = *(pstep->pba);
+  pba->background_verbose = background_verbose;
+  pba->is_from_shooting = _TRUE_;
+
+  if (pstep->has_thermodynamics == _TRUE_) {
+    thermodynamics_verbose = pth->thermodynamics_verbose;
+    hyrec_verbose = pth->hyrec_verbose;
+    *pth = *(pstep->pth);
+    pth->thermodynamics_verbose = thermodynamics_verbose;
+    pth->hyrec_verbose = hyrec_verbose;
+    pth->is_from_shooting = _TRUE_;
+  }
+
+  /* the structures now belong to the main computation */
+  pstep->used = _FALSE_;
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Related to 'shooting': free the structures of the kept steps which
+ * were not handed over, and the slots of pfzw->kept_step[].
+ *
+ * @param pfzw Input/Output: pointer to shooting workspace
+ * @return the error status
+ */
+
+int input_shooting_free_steps(struct fzerofun_workspace * pfzw){
+
+  int index_step;
+  struct shooting_step * pstep;
+
+  for (index_step=0; index_step < _SHOOTING_KEPT_STEPS_; index_step++) {
+    pstep = &(pfzw->kept_step[index_step]);
+    if (pstep->used == _TRUE_) {
+      if (pstep->has_thermodynamics == _TRUE_)
+        thermodynamics_free(pstep->pth);
+      background_free(pstep->pba);
+      pstep->used = _FALSE_;
+    }
+    free(pstep->unknown_parameter);
+    free(pstep->pba);
+    free(pstep->pth);
+    pstep->unknown_parameter = NULL;
+    pstep->pba = NULL;
+    pstep->pth = NULL;
+  }
+
+  return _SUCCESS_;
+
+}
+
 /**
  * Related to 'shooting': for each target, check whether it is
  * sufficient to stick to the default value of the unkown parameter
@@ -802,12 +1004,34 @@ int input_needs_shooting_for_target(struct file_content * pfc,
 
 }
 
+/**
+ * Solution of the last successful one-dimensional shooting for each
+ * target, with the target value it was found for and an estimate of
+ * the derivative dx/dF at the root, used by input_find_root_warm().
+ * The memory is private to each thread, so that concurrent runs (in
+ * class_grid, class_server or the derivative mode) do not seed each
+ * other; a run still depends on the previous shooting of its thread.
+ */
+
+static short input_shooting_memory_used[_NUM_TARGETS_] = {_FALSE_};
+static double input_shooting_memory_target_value[_NUM_TARGETS_];
+static double input_shooting_memory_x[_NUM_TARGETS_];
+static double input_shooting_memory_dxdF[_NUM_TARGETS_];
+#pragma omp threadprivate(input_shooting_memory_used,input_shooting_memory_target_value,input_shooting_memory_x,input_shooting_memory_dxdF)
+
+/* largest number of secant steps of input_find_root_warm() before falling back to bracketing */
+#define _SHOOTING_WARM_START_MAX_ITER_ 8
+
 /**
  * Related to 'shooting': Find the root of a one-dimensional
  * function. This function starts from a first guess, then uses a few
  * steps to bracket the root, and then calls another function to
  * actually get the root.
  *
+ * If pfzw->warm_start is true and a previous shooting for the same
+ * target was successful in this thread, the bracketing is only used
+ * when the secant steps of input_find_root_warm() do not converge.
+ *
  * @param xzero     Output: root x such that f(x)=0 up to tolerance (f(x) = input_fzerofun_1d)
  * @param fevals    Output: number of iterations (that is, of CLASS runs) needed to find the root
  * @param tol_x_rel Input : Relative tolerance compared to bracket of root that is used to find root.
@@ -828,8 +1052,25 @@ int input_find_root(double *xzero,
   double x1, x2, f1, f2, dxdy, dx;
   int iter, iter2;
   int return_function;
+  short converged;
+
+  /** If possible, start from the previous solution and refine it with secant steps */
+  if ((pfzw->warm_start == _TRUE_) && (input_shooting_memory_used[pfzw->target_name[0]] == _TRUE_)) {
+
+    class_call(input_find_root_warm(xzero,
+                                    fevals,
+                                    tol_x_rel,
+                                    pfzw,
+                                    &converged,
+                                    errmsg),
+               errmsg,
+               errmsg);
+
+    if (converged == _TRUE_)
+      return _SUCCESS_;
+  }
 
-  /** Fisrt we do our guess */
+  /** Otherwise, fisrt we do our guess */
   class_call(input_get_guess(&x1, &dxdy, pfzw, errmsg),
              errmsg,
              errmsg);
@@ -881,6 +1122,86 @@ int input_find_root(double *xzero,
                                 errmsg),
              errmsg,errmsg);
 
+  /** Remember the root, and the slope between the bracketing points, for the next shooting
+      of this target in this thread */
+  input_shooting_memory_used[pfzw->target_name[0]] = _TRUE_;
+  input_shooting_memory_target_value[pfzw->target_name[0]] = pfzw->target_value[0];
+  input_shooting_memory_x[pfzw->target_name[0]] = *xzero;
+  input_shooting_memory_dxdF[pfzw->target_name[0]] = (x2-x1)/(f2-f1);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Related to 'shooting': find the root of a one-dimensional function
+ * starting from the root found by the previous shooting for the same
+ * target in this thread, shifted by dx/dF times the change of the target value, and
+ * iterating secant steps (the first one with the remembered dx/dF)
+ * until the next step is smaller than the tolerance. Like in
+ * input_fzero_ridder(), the root returned is then the last point at
+ * which the function was evaluated, so that the structures computed
+ * there can be kept (see input_shooting_hand_over()). For neighbouring
+ * points of a chain, this only requires one or two evaluations. If
+ * an evaluation fails or the steps do not converge, *converged is set
+ * to _FALSE_ and the caller should bracket the root as usual.
+ *
+ * @param xzero     Output: root x such that f(x)=0 up to tolerance (f(x) = input_fzerofun_1d)
+ * @param fevals    Input/Output: number of iterations (that is, of CLASS runs)
+ * @param tol_x_rel Input: relative tolerance on the root
+ * @param pfzw      Input: pointer to workspace containing targets, unkown parameters and other relevant information
+ * @param converged Output: _TRUE_ if the root was found
+ * @param errmsg    Input/Output: Error message
+ * @return the error status
+ */
+
+int input_find_root_warm(double *xzero,
+                         int *fevals,
+                         double tol_x_rel,
+                         struct fzerofun_workspace *pfzw,
+                         short *converged,
+                         ErrorMsg errmsg){
+
+  enum target_names target = pfzw->target_name[0];
+  double x0, x1, f0, f1, dxdF;
+  int iter;
+
+  *converged = _FALSE_;
+
+  dxdF = input_shooting_memory_dxdF[target];
+  x0 = input_shooting_memory_x[target] + dxdF*(pfzw->target_value[0]-input_shooting_memory_target_value[target]);
+
+  if (input_fzerofun_1d(x0, pfzw, &f0, errmsg) == _FAILURE_)
+    return _SUCCESS_;
+  (*fevals)++;
+
+  for (iter=0; iter<_SHOOTING_WARM_START_MAX_ITER_; iter++) {
+
+    if ((isfinite(dxdF) == 0) || (dxdF == 0.))
+      return _SUCCESS_;
+
+    x1 = x0 - f0*dxdF;
+
+    if (fabs(x1-x0) <= tol_x_rel*fabs(x1)) {
+      *xzero = x0;
+      *converged = _TRUE_;
+      input_shooting_memory_target_value[target] = pfzw->target_value[0];
+      input_shooting_memory_x[target] = x0;
+      input_shooting_memory_dxdF[target] = dxdF;
+      return _SUCCESS_;
+    }
+
+    if (input_fzerofun_1d(x1, pfzw, &f1, errmsg) == _FAILURE_)
+      return _SUCCESS_;
+    (*fevals)++;
+
+    if (f1 != f0)
+      dxdF = (x1-x0)/(f1-f0);
+
+    x0 = x1;
+    f0 = f1;
+  }
+
   return _SUCCESS_;
 
 }
@@ -1278,8 +1599,11 @@ int input_try_unknown_parameters(double * unknown_parameter,
   if (pfzw->required_computation_stage >= cs_thermodynamics){
    if (input_verbose>2)
      printf("Stage 2: thermodynamics\n");
-    pr.thermo_Nz_lin = 10000;
-    pr.thermo_Nz_log = 500;
+    /* a coarser sampling is enough for the shooting, unless the structures of the converged step are kept */
+    if (pfzw->reuse_structures == _FALSE_) {
+      pr.thermo_Nz_lin = 10000;
+      pr.thermo_Nz_log = 500;
+    }
     th.thermodynamics_verbose = 0;
     th.hyrec_verbose = 0;
     class_call_except(thermodynamics_init(&pr,&ba,&th), th.error_message, errmsg, background_free(&ba));
@@ -1303,6 +1627,7 @@ int input_try_unknown_parameters(double * unknown_parameter,
     if (input_verbose>2)
       printf("Stage 5: nonlinear\n");
     fo.fourier_verbose = 0;
+    fo.lazy_evaluation = _FALSE_;
     class_call_except(fourier_init(&pr,&ba,&th,&pt,&pm,&fo), fo.error_message, errmsg, primordial_free(&pm);perturbations_free(&pt);thermodynamics_free(&th);background_free(&ba));
   }
 
@@ -1317,6 +1642,7 @@ int input_try_unknown_parameters(double * unknown_parameter,
     if (input_verbose>2)
       printf("Stage 7: spectra\n");
     hr.harmonic_verbose = 0;
+    hr.lazy_evaluation = _FALSE_;
     class_call_except(harmonic_init(&pr,&ba,&pt,&pm,&fo,&tr,&hr),hr.error_message, errmsg, transfer_free(&tr);fourier_free(&fo);primordial_free(&pm);perturbations_free(&pt);thermodynamics_free(&th);background_free(&ba));
   }
 
@@ -1377,11 +1703,24 @@ int input_try_unknown_parameters(double * unknown_parameter,
   if (pfzw->required_computation_stage >= cs_perturbations){
     class_call(perturbations_free(&pt), pt.error_message, errmsg);
   }
-  if (pfzw->required_computation_stage >= cs_thermodynamics){
-    class_call(thermodynamics_free(&th), th.error_message, errmsg);
+  /* keep the background and thermodynamics for input_shooting(), if requested */
+  if ((pfzw->reuse_structures == _TRUE_) && (pfzw->required_computation_stage >= cs_background)){
+    class_call(input_shooting_keep_step(pfzw,
+                                        unknown_parameter,
+                                        &ba,
+                                        &th,
+                                        (pfzw->required_computation_stage >= cs_thermodynamics ? _TRUE_ : _FALSE_),
+                                        errmsg),
+               errmsg,
+               errmsg);
   }
-  if (pfzw->required_computation_stage >= cs_background){
-    class_call(background_free(&ba), ba.error_message, errmsg);
+  else {
+    if (pfzw->required_computation_stage >= cs_thermodynamics){
+      class_call(thermodynamics_free(&th), th.error_message, errmsg);
+    }
+    if (pfzw->required_computation_stage >= cs_background){
+      class_call(background_free(&ba), ba.error_message, errmsg);
+    }
   }
 
   /** Set filecontent to unread */
@@ -2126,6 +2465,11 @@ int input_read_parameters_general(struct file_content * pfc,
   /* Read */
   class_read_flag_or_deprecated("compute_damping_scale","compute damping scale",pth->compute_damping_scale);
 
+  /** 10) Recombination emulator */
+  /* Read */
+  class_read_flag("recombination_emulator",pth->has_recombination_emulator);
+  class_read_flag("recombination_emulator_check",pth->recombination_emulator_check);
+
   return _SUCCESS_;
 
 }
@@ -2358,6 +2702,8 @@ int input_read_parameters_species(struct file_content * pfc,
     /** 5.c) (optional) p.s.d.-parameters */
     /* Read */
     parser_read_list_of_doubles(pfc,"ncdm_psd_parameters",&entries_read,&(pba->ncdm_psd_parameters),&flag1,errmsg);
+    if (flag1 == _TRUE_)
+      pba->ncdm_psd_parameters_size = entries_read;
 
     /** 5.d) Mass or Omega of each ncdm species */
     /* Read */
@@ -2869,6 +3215,9 @@ int input_read_parameters_species(struct file_content * pfc,
       else if ((strstr(string1,"EDE") != NULL) || (strstr(string1,"ede") != NULL)) {
         pba->fluid_equation_of_state = EDE;
       }
+      else if ((strstr(string1,"CARDASSIAN") != NULL) || (strstr(string1,"cardassian") != NULL)) {
+        pba->fluid_equation_of_state = CARDASSIAN;
+      }
       else {
         class_stop(errmsg,"incomprehensible input '%s' for the field 'fluid_equation_of_state'",string1);
       }
@@ -2888,6 +3237,17 @@ int input_read_parameters_species(struct file_content * pfc,
       class_read_double("Omega_EDE",pba->Omega_EDE);
       class_read_double("cs2_fld",pba->cs2_fld);
     }
+    if (pba->fluid_equation_of_state == CARDASSIAN) {
+      /** 8.a.2.4) Equation of state of the fluid in 'CARDASSIAN' case */
+      /* Read */
+      class_read_double("cardassian_q",pba->cardassian_q);
+      class_read_double("cardassian_n",pba->cardassian_n);
+      class_read_double("cs2_fld",pba->cs2_fld);
+      /* Test */
+      class_test(pba->cardassian_q <= 0.,
+                 errmsg,
+                 "cardassian_q=%g must be strictly positive",pba->cardassian_q);
+    }
   }
 
   /** 8.b) If Omega scalar field (SCF) is different from 0 */
@@ -3375,6 +3735,10 @@ int input_read_parameters_nonlinear(struct file_content * pfc,
     }
   }
 
+  /** 2) Precomputed bicubic interpolation of P(k,z) */
+  /* Read */
+  class_read_flag("pk_bicubic",pfo->has_pk_bicubic);
+
   return _SUCCESS_;
 }
 
@@ -4166,6 +4530,35 @@ int input_read_parameters_primordial(struct file_content * pfc,
     class_read_double("custom8",ppm->custom8);
     class_read_double("custom9",ppm->custom9);
     class_read_double("custom10",ppm->custom10);
+
+    /** 1.g.3) Protocol of the command */
+    /* Read */
+    class_call(parser_read_string(pfc,"external_Pk_protocol",&string1,&flag1,errmsg),
+               errmsg,
+               errmsg);
+    /* Complete set of parameters */
+    if (flag1 == _TRUE_) {
+      if (strstr(string1,"text") != NULL){
+        ppm->external_protocol = external_text;
+      }
+      else if (strstr(string1,"binary") != NULL){
+        ppm->external_protocol = external_binary;
+      }
+      else if (strstr(string1,"worker") != NULL){
+        ppm->external_protocol = external_worker;
+      }
+      else {
+        class_stop(errmsg,"You specified 'external_Pk_protocol' as '%s'. It has to be one of {'text','binary','worker'}.",string1);
+      }
+    }
+    /* Test */
+    class_test((ppm->external_protocol != external_text) && (strncmp("cat ", ppm->command, 4) == 0),
+               errmsg,
+               "A table read with 'cat' can only use external_Pk_protocol = text");
+
+    /** 1.g.4) Cache of the table */
+    /* Read */
+    class_read_flag("external_Pk_cache",ppm->external_cache);
   }
 
   /* Final tests */
@@ -4990,14 +5383,19 @@ int input_read_parameters_output(struct file_content * pfc,
              errmsg);
   /* Complete set of parameters */
   if (flag1 == _TRUE_){
+    if ((strstr(string1,"npy") != NULL) || (strstr(string1,"NPY") != NULL)){
+      pop->write_binary = _TRUE_;
+      /* the column titles go to the header of the .npy files, and there is no room for the text headers */
+      pop->write_header = _FALSE_;
+    }
     if ((strstr(string1,"class") != NULL) || (strstr(string1,"CLASS") != NULL)){
       pop->output_format = class_format;
     }
     else if ((strstr(string1,"camb") != NULL) || (strstr(string1,"CAMB") != NULL)){
       pop->output_format = camb_format;
     }
-    else{
-      class_stop(errmsg,"You specified 'format' as '%s'. It has to be one of {'class','camb'}.",string1);
+    else if (pop->write_binary == _FALSE_){
+      class_stop(errmsg,"You specified 'format' as '%s'. It has to be one of {'class','camb'}, optionally followed by 'npy'.",string1);
     }
   }
 
@@ -5031,6 +5429,18 @@ int input_read_parameters_output(struct file_content * pfc,
     pop->write_perturbations = _TRUE_;
   }
 
+  /** 1.f.1) Stream these perturbations to binary files during the integration, instead of storing them */
+  /* Read */
+  class_read_flag("stream_perturbations",ppt->stream_perturbations);
+  /* Complete set of parameters */
+  if (ppt->stream_perturbations == _TRUE_) {
+    strcpy(ppt->stream_root,pop->root);
+  }
+
+  /** 1.f.2) Statistics of the ODE evolver for each wavenumber (only available through the python wrapper) */
+  /* Read */
+  class_read_flag("store_solver_statistics",ppt->store_solver_statistics);
+
   /** 1.g) Primordial spectra */
   /* Read */
   class_read_flag_or_deprecated("write_primordial","write primordial",pop->write_primordial);
@@ -5066,6 +5476,14 @@ int input_read_parameters_output(struct file_content * pfc,
   class_read_int("lensing_verbose",ple->lensing_verbose);
   class_read_int("distortions_verbose",psd->distortions_verbose);
   class_read_int("output_verbose",pop->output_verbose);
+  class_read_int("profile_verbose",pop->profile_verbose);
+
+  /** 3) Lazy evaluation of the fourier, harmonic and lensing modules */
+  /* Read */
+  class_read_flag("lazy_evaluation",pfo->lazy_evaluation);
+  /* Complete set of parameters */
+  phr->lazy_evaluation = pfo->lazy_evaluation;
+  ple->lazy_evaluation = pfo->lazy_evaluation;
 
 
   /**
@@ -5251,6 +5669,10 @@ int input_default_params(struct background *pba,
 
   /** 9) Damping scale */
   pth->compute_damping_scale = _FALSE_;
+  /** 10) Recombination emulator */
+  pth->has_recombination_emulator = _FALSE_;
+  pth->is_from_shooting = _FALSE_;
+  pth->recombination_emulator_check = _FALSE_;
 
   /**
    * Default to input_read_parameters_species
@@ -5283,6 +5705,8 @@ int input_default_params(struct background *pba,
   pba->ncdm_psd_files = NULL;
   /** 5.c) Analytic distribution function */
   pba->ncdm_psd_parameters = NULL;
+  pba->ncdm_psd_parameters_size = 0;
+  pba->ncdm_bg_tabulated = _FALSE_;
   pba->Omega0_ncdm_tot = 0.;
   /** 5.d) --> See read_parameters_background */
   /** 5.e) ncdm temperature */
@@ -5344,6 +5768,9 @@ int input_default_params(struct background *pba,
   pba->wa_fld = 0.;
   /** 9.a.2.2) 'EDE' case */
   pba->Omega_EDE = 0.;
+  /** 9.a.2.3) 'CARDASSIAN' case */
+  pba->cardassian_q = 1.;
+  pba->cardassian_n = 0.;
   /** 9.b) Omega scalar field */
   /** 9.b.1) Potential parameters and initial conditions */
   pba->scf_parameters = NULL;
@@ -5356,6 +5783,7 @@ int input_default_params(struct background *pba,
   pba->scf_tuning_index = 0;
   /** 9.b.4) Shooting parameter */
   pba->shooting_failed = _FALSE_;
+  pba->is_from_shooting = _FALSE_;
 
   /**
    * Deafult to input_read_parameters_heating
@@ -5420,6 +5848,7 @@ int input_default_params(struct background *pba,
   ppt->has_nl_corrections_based_on_delta_m = _FALSE_;
   pfo->method = nl_none;
   pfo->has_pk_eq = _FALSE_;
+  pfo->has_pk_bicubic = _FALSE_;
   pfo->extrapolation_method = extrap_max_scaled;
   pfo->feedback = nl_emu_dmonly;
   pfo->z_infinity = 10.;
@@ -5527,6 +5956,11 @@ int input_default_params(struct background *pba,
   ppm->custom9=0.;
   ppm->custom10=0.;
 
+  /** 1.g.3) Protocol of the command */
+  ppm->external_protocol=external_text;
+  /** 1.g.4) Cache of the table */
+  ppm->external_cache=_FALSE_;
+
   /**
    * Default to input_read_parameters_spectra
    */
@@ -5632,6 +6066,7 @@ int input_default_params(struct background *pba,
   pop->write_header = _TRUE_;
   /** 1.c) Format */
   pop->output_format = class_format;
+  pop->write_binary = _FALSE_;
   /** 1.d) Background quantities */
   pop->write_background = _FALSE_;
   /** 1.e) Thermodynamics quantities */
@@ -5640,6 +6075,9 @@ int input_default_params(struct background *pba,
   ppt->k_output_values_num=0;
   pop->write_perturbations = _FALSE_;
   ppt->store_perturbations = _FALSE_;
+  ppt->stream_perturbations = _FALSE_;
+  /** 1.f.2) Statistics of the ODE evolver for each wavenumber */
+  ppt->store_solver_statistics = _FALSE_;
   /** 1.g) Primordial spectra */
   pop->write_primordial = _FALSE_;
   /** 1.h) Exotic energy injection function */
@@ -5661,6 +6099,12 @@ int input_default_params(struct background *pba,
   ple->lensing_verbose = 0;
   psd->distortions_verbose = 0;
   pop->output_verbose = 0;
+  pop->profile_verbose = 0;
+
+  /** 3) Lazy evaluation */
+  pfo->lazy_evaluation = _FALSE_;
+  phr->lazy_evaluation = _FALSE_;
+  ple->lazy_evaluation = _FALSE_;
 
   return _SUCCESS_;
 
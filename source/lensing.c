@@ -12,11 +12,19 @@
  *
  * -# lensing_init() at the beginning (but after harmonic_init())
  * -# lensing_cl_at_l() at any time for computing Cl_lensed at any l
+ * -# lensing_cl_at_l_array() at any time for computing Cl_lensed at all l up to some l_max
  * -# lensing_free() at the end
+ *
+ * With lazy evaluation, the lensed spectra (and the unlensed ones they
+ * rely on) are only computed on the first call to lensing_cl_at_l() or
+ * lensing_cl_at_l_array().
  */
 
 #include "lensing.h"
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /**
  * Anisotropy power spectra \f$ C_l\f$'s for all types, modes and initial conditions.
@@ -48,6 +56,10 @@ int lensing_cl_at_l(
              ple->error_message,
              "you asked for lensed Cls at l=%d, they were computed only up to l=%d, you should increase l_max_scalars or decrease the precision parameter delta_l_max",l,ple->l_lensed_max);
 
+  class_call(lensing_lazy_compute(ple),
+             ple->error_message,
+             ple->error_message);
+
   class_call(array_interpolate_spline(ple->l,
                                       ple->l_size,
                                       ple->cl_lens,
@@ -69,10 +81,80 @@ int lensing_cl_at_l(
   return _SUCCESS_;
 }
 
+/**
+ * Lensed anisotropy power spectra \f$ C_l\f$'s for all types and all
+ * integer multipoles 0 <= l <= l_max.
+ *
+ * This routine gives the same values as lensing_cl_at_l() called at
+ * each l, but evaluates all multipoles in one sweep through the
+ * pre-computed table, and writes the \f$ C_l\f$'s of each type in one
+ * contiguous array. Values at l smaller than the first multipole of
+ * the table (l=0,1) are set to zero.
+ *
+ * @param ple        Input: pointer to lensing structure
+ * @param l_max      Input: last multipole
+ * @param cl_lensed  Output: lensed \f$C_l\f$'s, cl_lensed[index_lt*(l_max+1)+l] (must be already allocated)
+ * @return the error status
+ */
+
+int lensing_cl_at_l_array(
+                          struct lensing * ple,
+                          int l_max,
+                          double * cl_lensed
+                          ) {
+  int l;
+  int last_index = 0;
+  int index_lt;
+  double * cl_l;
+
+  class_test(l_max > ple->l_lensed_max,
+             ple->error_message,
+             "you asked for lensed Cls up to l=%d, they were computed only up to l=%d, you should increase l_max_scalars or decrease the precision parameter delta_l_max",l_max,ple->l_lensed_max);
+
+  class_call(lensing_lazy_compute(ple),
+             ple->error_message,
+             ple->error_message);
+
+  class_alloc(cl_l,ple->lt_size*sizeof(double),ple->error_message);
+
+  for (l=0; l<=l_max; l++) {
+
+    if (l < ple->l[0]) {
+      for (index_lt=0; index_lt<ple->lt_size; index_lt++)
+        cl_lensed[index_lt*(l_max+1)+l] = 0.;
+      continue;
+    }
+
+    class_call(array_interpolate_spline_growing_closeby(ple->l,
+                                                        ple->l_size,
+                                                        ple->cl_lens,
+                                                        ple->ddcl_lens,
+                                                        ple->lt_size,
+                                                        (double)l,
+                                                        &last_index,
+                                                        cl_l,
+                                                        ple->lt_size,
+                                                        ple->error_message),
+               ple->error_message,
+               ple->error_message);
+
+    /* set to zero for the types such that l<l_max */
+    for (index_lt=0; index_lt<ple->lt_size; index_lt++)
+      cl_lensed[index_lt*(l_max+1)+l] = (l > ple->l_max_lt[index_lt] ? 0. : cl_l[index_lt]);
+  }
+
+  free(cl_l);
+
+  return _SUCCESS_;
+}
+
 /**
  * This routine initializes the lensing structure (in particular,
  * computes table of lensed anisotropy spectra \f$ C_l^{X} \f$)
  *
+ * With lazy evaluation, only the indices are defined here, and the
+ * table is computed by lensing_lazy_compute() on first access.
+ *
  * @param ppr Input: pointer to precision structure
  * @param ppt Input: pointer to perturbation structure (just in case, not used in current version...)
  * @param phr Input: pointer to harmonic structure
@@ -89,6 +171,76 @@ int lensing_init(
                  struct lensing * ple
                  ) {
 
+  ple->is_pending = _FALSE_;
+#ifdef _OPENMP
+  omp_init_lock(&(ple->lazy_lock));
+#endif
+
+  /** - check that we really want to compute at least one spectrum */
+
+  if (ple->has_lensed_cls == _FALSE_) {
+    if (ple->lensing_verbose > 0)
+      printf("No lensing requested. Lensing module skipped.\n");
+    return _SUCCESS_;
+  }
+  else {
+    if (ple->lensing_verbose > 0) {
+      printf("Computing lensed spectra ");
+      if (ppr->accurate_lensing==_TRUE_)
+        printf("(accurate mode)\n");
+      else
+        printf("(fast mode)\n");
+    }
+  }
+
+  /** - initialize indices in the lensing structure */
+
+  class_call(lensing_indices(ppr,phr,ple),
+             ple->error_message,
+             ple->error_message);
+
+  /** - with lazy evaluation, stop here and compute the lensed spectra
+      on first access */
+
+  if (ple->lazy_evaluation == _TRUE_) {
+    ple->ppr = ppr;
+    ple->ppt = ppt;
+    ple->phr = phr;
+    ple->pfo = pfo;
+    ple->is_pending = _TRUE_;
+    if (ple->lensing_verbose > 0)
+      printf(" -> deferred until the first query (lazy evaluation)\n");
+    return _SUCCESS_;
+  }
+
+  class_call(lensing_spectra(ppr,ppt,phr,pfo,ple),
+             ple->error_message,
+             ple->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine computes the table of lensed anisotropy spectra
+ * \f$ C_l^{X} \f$, once the indices of the lensing structure have been
+ * defined by lensing_init()
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param ppt Input: pointer to perturbation structure (just in case, not used in current version...)
+ * @param phr Input: pointer to harmonic structure
+ * @param pfo Input: pointer to fourier structure
+ * @param ple Input/Output: pointer to lensing structure
+ * @return the error status
+ */
+
+int lensing_spectra(
+                    struct precision * ppr,
+                    struct perturbations * ppt,
+                    struct harmonic * phr,
+                    struct fourier * pfo,
+                    struct lensing * ple
+                    ) {
+
   /** Summary: */
   /** - Define local variables */
 
@@ -131,9 +283,11 @@ int lensing_init(
   double X_242;
 
   int num_mu,index_mu,icount;
+  int mu_block_size,index_mu_min,index_mu_block,nmu;
+  int index_l;
   int l;
   double ll;
-  double * cl_unlensed;  /* cl_unlensed[index_ct] */
+  double * cl_unlensed;  /* cl_unlensed[index_ct*(ple->l_unlensed_max+1)+l] */
   double * cl_tt; /* unlensed  cl, to be filled to avoid repeated calls to harmonic_cl_at_l */
   double * cl_te = NULL; /* unlensed  cl, to be filled to avoid repeated calls to harmonic_cl_at_l */
   double * cl_ee = NULL; /* unlensed  cl, to be filled to avoid repeated calls to harmonic_cl_at_l */
@@ -149,39 +303,23 @@ int lensing_init(
   double * sqrt4;
   double * sqrt5;
 
-  double ** cl_md_ic; /* array with argument
-                         cl_md_ic[index_md][index_ic1_ic2*phr->ct_size+index_ct] */
-
-  double ** cl_md;    /* array with argument
-                         cl_md[index_md][index_ct] */
+  struct lensing_d_cache_header d_cache_header;
+  struct lensing_d_table d_table;
+  int use_d_cache;
+  int d_cache_found;
 
-  int index_md;
+  double ** d[wigner_d_size];
+  struct lensing_response * response = NULL;
+  int use_fused;
+  int relensed;
 
   /* Timing */
   //double debut, fin;
   //double cpu_time;
 
-  /** - check that we really want to compute at least one spectrum */
-
-  if (ple->has_lensed_cls == _FALSE_) {
-    if (ple->lensing_verbose > 0)
-      printf("No lensing requested. Lensing module skipped.\n");
-    return _SUCCESS_;
-  }
-  else {
-    if (ple->lensing_verbose > 0) {
-      printf("Computing lensed spectra ");
-      if (ppr->accurate_lensing==_TRUE_)
-        printf("(accurate mode)\n");
-      else
-        printf("(fast mode)\n");
-    }
-  }
-
-  /** - initialize indices and allocate some of the arrays in the
-      lensing structure */
+  /** - allocate the table of spectra and fill it with the unlensed ones */
 
-  class_call(lensing_indices(ppr,phr,ple),
+  class_call(lensing_table_unlensed(phr,ple),
              ple->error_message,
              ple->error_message);
 
@@ -196,6 +334,20 @@ int lensing_init(
     /* Integrate correlation function difference on [0,pi/16] */
     num_mu = (ple->l_unlensed_max * 2 )/16;
   }
+
+  /** - with lensing_response, obtain the lensed spectra at first order
+      from the responses of a previous run when possible */
+
+  if (ppr->lensing_response == _TRUE_) {
+    class_call(lensing_response_relens(ppr,phr,ple,num_mu,&relensed),
+               ple->error_message,
+               ple->error_message);
+    if (relensed == _TRUE_)
+      return _SUCCESS_;
+  }
+
+  /* the responses are built from the tables of d-functions of all values of mu */
+  use_fused = ((ppr->lensing_fused == _TRUE_) && (ppr->lensing_response == _FALSE_));
   /** - allocate array of \f$ \mu \f$ values, as well as quadrature weights */
 
   class_alloc(mu,
@@ -208,7 +360,27 @@ int lensing_init(
               (num_mu-1)*sizeof(double),
               ple->error_message);
 
-  if (ppr->accurate_lensing == _TRUE_) {
+  /** - look for the nodes, weights and d-functions of a previous run with the same l_unlensed_max and num_mu in the cache */
+
+  use_d_cache = ((use_fused == _FALSE_) &&
+                 ((ppr->lensing_d_cache == _TRUE_) || (ppr->lensing_d_cache_use_file == _TRUE_)));
+  d_cache_found = _FALSE_;
+
+  if (use_d_cache == _TRUE_) {
+    class_call(lensing_d_cache_header(ppr,ple->l_unlensed_max,num_mu,&d_cache_header),
+               ple->error_message,
+               ple->error_message);
+    class_call(lensing_d_cache_fetch(ppr,&d_cache_header,&d_table,&d_cache_found),
+               ple->error_message,
+               ple->error_message);
+  }
+
+  if (d_cache_found == _TRUE_) {
+
+    memcpy(mu,d_table.mu,num_mu*sizeof(double));
+    memcpy(w8,d_table.w8,(num_mu-1)*sizeof(double));
+
+  } else if (ppr->accurate_lensing == _TRUE_) {
 
     //debut = omp_get_wtime();
     class_call(quadrature_gauss_legendre(mu,
@@ -232,505 +404,639 @@ int lensing_init(
     }
   }
 
-  /** - Compute \f$ d^l_{mm'} (\mu) \f$*/
-
-  icount = 0;
-  class_alloc(d00,
-              num_mu*sizeof(double*),
+  class_alloc(cl_unlensed,
+              phr->ct_size*(ple->l_unlensed_max+1)*sizeof(double),
               ple->error_message);
 
-  class_alloc(d11,
-              num_mu*sizeof(double*),
-              ple->error_message);
 
-  class_alloc(d1m1,
-              num_mu*sizeof(double*),
+  /** - Locally store unlensed temperature \f$ cl_{tt}\f$ and potential \f$ cl_{pp}\f$ spectra **/
+  class_alloc(cl_tt,
+              (ple->l_unlensed_max+1)*sizeof(double),
               ple->error_message);
+  if (ple->has_te==_TRUE_) {
+    class_alloc(cl_te,
+                (ple->l_unlensed_max+1)*sizeof(double),
+                ple->error_message);
+  }
+  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+    class_alloc(cl_ee,
+                (ple->l_unlensed_max+1)*sizeof(double),
+                ple->error_message);
 
-  class_alloc(d2m2,
-              num_mu*sizeof(double*),
+    class_alloc(cl_bb,
+                (ple->l_unlensed_max+1)*sizeof(double),
+                ple->error_message);
+  }
+  class_alloc(cl_pp,
+              (ple->l_unlensed_max+1)*sizeof(double),
               ple->error_message);
-  icount += 4*num_mu*(ple->l_unlensed_max+1);
 
-  if(ple->has_te==_TRUE_) {
+  class_call(harmonic_cl_at_l_array(phr,ple->l_unlensed_max,cl_unlensed),
+             phr->error_message,
+             ple->error_message);
 
-    class_alloc(d20,
-                num_mu*sizeof(double*),
-                ple->error_message);
+  for (l=2; l<=ple->l_unlensed_max; l++) {
+    cl_tt[l] = cl_unlensed[ple->index_lt_tt*(ple->l_unlensed_max+1)+l];
+    cl_pp[l] = cl_unlensed[ple->index_lt_pp*(ple->l_unlensed_max+1)+l];
+    if (ple->has_te==_TRUE_) {
+      cl_te[l] = cl_unlensed[ple->index_lt_te*(ple->l_unlensed_max+1)+l];
+    }
+    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+      cl_ee[l] = cl_unlensed[ple->index_lt_ee*(ple->l_unlensed_max+1)+l];
+      cl_bb[l] = cl_unlensed[ple->index_lt_bb*(ple->l_unlensed_max+1)+l];
+    }
+  }
 
-    class_alloc(d3m1,
-                num_mu*sizeof(double*),
-                ple->error_message);
+  if (use_fused == _TRUE_) {
 
-    class_alloc(d4m2,
-                num_mu*sizeof(double*),
-                ple->error_message);
-    icount += 3*num_mu*(ple->l_unlensed_max+1);
+    /** - Either compute the quadratures giving the lensed \f$ C_l\f$'s with the fused kernel, */
+
+    if (ple->lensing_verbose > 1)
+      printf(" -> fused kernel for the lensed correlation functions and C_l's\n");
+
+    class_call(lensing_lensed_cl_fused(ppr,ple,mu,w8,num_mu,cl_tt,cl_te,cl_ee,cl_bb,cl_pp),
+               ple->error_message,
+               ple->error_message);
   }
+  else {
 
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+    /** - or compute \f$ d^l_{mm'} (\mu) \f$*/
 
-    class_alloc(d22,
-                num_mu*sizeof(double*),
-                ple->error_message);
+    /* The Wigner d-functions are computed by blocks of mu_block_size
+       values of mu at a time, and the correlation functions and lensed
+       \f$ C_l\f$'s are accumulated block by block: only
+       O(l_unlensed_max x mu_block_size) memory is used for them. By
+       default, there is a single block of num_mu values. The pointers
+       d00[index_mu], etc. are defined for all values of mu, those of
+       index_mu and index_mu+mu_block_size pointing to the same place in
+       the buffer. */
+
+    if ((use_d_cache == _TRUE_) && (d_cache_found == _FALSE_)) {
+      class_counters_begin(counter_lensing_d);
+      class_call(lensing_d_cache_store(ppr,&d_cache_header,mu,w8,&d_table,ple->error_message),
+                 ple->error_message,
+                 ple->error_message);
+      class_counters_end(counter_lensing_d);
+    }
+
+    if ((ple->lensing_verbose > 1) && (use_d_cache == _TRUE_))
+      printf(" -> Wigner d-functions %s\n",(d_cache_found == _TRUE_ ? "read from the cache" : "computed and stored in the cache"));
+
+    /* With the cache, the d-functions of all values of mu are read from
+       its tables, and there is a single block. */
 
-    class_alloc(d31,
+    if ((use_d_cache == _FALSE_) && (ppr->lensing_response == _FALSE_) &&
+        (ppr->lensing_mu_block_size > 0) && (ppr->lensing_mu_block_size < num_mu))
+      mu_block_size = ppr->lensing_mu_block_size;
+    else
+      mu_block_size = num_mu;
+
+    if ((ple->lensing_verbose > 1) && (mu_block_size < num_mu))
+      printf(" -> Wigner d-functions computed by blocks of %d out of %d values of mu\n",mu_block_size,num_mu);
+
+    icount = 0;
+    class_alloc(d00,
                 num_mu*sizeof(double*),
                 ple->error_message);
 
-    class_alloc(d3m3,
+    class_alloc(d11,
                 num_mu*sizeof(double*),
                 ple->error_message);
 
-    class_alloc(d40,
+    class_alloc(d1m1,
                 num_mu*sizeof(double*),
                 ple->error_message);
 
-    class_alloc(d4m4,
+    class_alloc(d2m2,
                 num_mu*sizeof(double*),
                 ple->error_message);
-    icount += 5*num_mu*(ple->l_unlensed_max+1);
-  }
+    icount += 4*mu_block_size*(ple->l_unlensed_max+1);
 
-  icount += 5*(ple->l_unlensed_max+1); /* for arrays sqrt1[l] to sqrt5[l] */
+    if(ple->has_te==_TRUE_) {
 
-  /** - Allocate main contiguous buffer **/
-  class_alloc(buf_dxx,
-              icount * sizeof(double),
-              ple->error_message);
+      class_alloc(d20,
+                  num_mu*sizeof(double*),
+                  ple->error_message);
 
-  icount = 0;
-  for (index_mu=0; index_mu<num_mu; index_mu++) {
+      class_alloc(d3m1,
+                  num_mu*sizeof(double*),
+                  ple->error_message);
 
-    d00[index_mu] = &(buf_dxx[icount+index_mu            * (ple->l_unlensed_max+1)]);
-    d11[index_mu] = &(buf_dxx[icount+(index_mu+num_mu)   * (ple->l_unlensed_max+1)]);
-    d1m1[index_mu]= &(buf_dxx[icount+(index_mu+2*num_mu) * (ple->l_unlensed_max+1)]);
-    d2m2[index_mu]= &(buf_dxx[icount+(index_mu+3*num_mu) * (ple->l_unlensed_max+1)]);
-  }
-  icount += 4*num_mu*(ple->l_unlensed_max+1);
+      class_alloc(d4m2,
+                  num_mu*sizeof(double*),
+                  ple->error_message);
+      icount += 3*mu_block_size*(ple->l_unlensed_max+1);
+    }
 
-  if (ple->has_te==_TRUE_) {
-    for (index_mu=0; index_mu<num_mu; index_mu++) {
-      d20[index_mu] = &(buf_dxx[icount+index_mu            * (ple->l_unlensed_max+1)]);
-      d3m1[index_mu]= &(buf_dxx[icount+(index_mu+num_mu)   * (ple->l_unlensed_max+1)]);
-      d4m2[index_mu]= &(buf_dxx[icount+(index_mu+2*num_mu) * (ple->l_unlensed_max+1)]);
+    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+
+      class_alloc(d22,
+                  num_mu*sizeof(double*),
+                  ple->error_message);
+
+      class_alloc(d31,
+                  num_mu*sizeof(double*),
+                  ple->error_message);
+
+      class_alloc(d3m3,
+                  num_mu*sizeof(double*),
+                  ple->error_message);
+
+      class_alloc(d40,
+                  num_mu*sizeof(double*),
+                  ple->error_message);
+
+      class_alloc(d4m4,
+                  num_mu*sizeof(double*),
+                  ple->error_message);
+      icount += 5*mu_block_size*(ple->l_unlensed_max+1);
     }
-    icount += 3*num_mu*(ple->l_unlensed_max+1);
-  }
 
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+    /* the d-functions read from the cache are not in the buffer */
+    if (use_d_cache == _TRUE_)
+      icount = 0;
 
-    for (index_mu=0; index_mu<num_mu; index_mu++) {
-      d22[index_mu] = &(buf_dxx[icount+index_mu            * (ple->l_unlensed_max+1)]);
-      d31[index_mu] = &(buf_dxx[icount+(index_mu+num_mu)   * (ple->l_unlensed_max+1)]);
-      d3m3[index_mu]= &(buf_dxx[icount+(index_mu+2*num_mu) * (ple->l_unlensed_max+1)]);
-      d40[index_mu] = &(buf_dxx[icount+(index_mu+3*num_mu) * (ple->l_unlensed_max+1)]);
-      d4m4[index_mu]= &(buf_dxx[icount+(index_mu+4*num_mu) * (ple->l_unlensed_max+1)]);
-    }
-    icount += 5*num_mu*(ple->l_unlensed_max+1);
-  }
-
-  sqrt1 = &(buf_dxx[icount]);
-  icount += ple->l_unlensed_max+1;
-  sqrt2 = &(buf_dxx[icount]);
-  icount += ple->l_unlensed_max+1;
-  sqrt3 = &(buf_dxx[icount]);
-  icount += ple->l_unlensed_max+1;
-  sqrt4 = &(buf_dxx[icount]);
-  icount += ple->l_unlensed_max+1;
-  sqrt5 = &(buf_dxx[icount]);
-  icount += ple->l_unlensed_max+1;
-
-  //debut = omp_get_wtime();
-  class_call(lensing_d00(mu,num_mu,ple->l_unlensed_max,d00),
-             ple->error_message,
-             ple->error_message);
+    icount += 5*(ple->l_unlensed_max+1); /* for arrays sqrt1[l] to sqrt5[l] */
 
-  class_call(lensing_d11(mu,num_mu,ple->l_unlensed_max,d11),
-             ple->error_message,
-             ple->error_message);
+    /** - Allocate main contiguous buffer **/
+    class_alloc(buf_dxx,
+                icount * sizeof(double),
+                ple->error_message);
 
-  class_call(lensing_d1m1(mu,num_mu,ple->l_unlensed_max,d1m1),
-             ple->error_message,
-             ple->error_message);
+    icount = 0;
+    if (use_d_cache == _TRUE_) {
+      for (index_mu=0; index_mu<num_mu; index_mu++) {
+        d00[index_mu] = d_table.d[wigner_d00]+index_mu*(ple->l_unlensed_max+1);
+        d11[index_mu] = d_table.d[wigner_d11]+index_mu*(ple->l_unlensed_max+1);
+        d1m1[index_mu]= d_table.d[wigner_d1m1]+index_mu*(ple->l_unlensed_max+1);
+        d2m2[index_mu]= d_table.d[wigner_d2m2]+index_mu*(ple->l_unlensed_max+1);
+        if (ple->has_te==_TRUE_) {
+          d20[index_mu] = d_table.d[wigner_d20]+index_mu*(ple->l_unlensed_max+1);
+          d3m1[index_mu]= d_table.d[wigner_d3m1]+index_mu*(ple->l_unlensed_max+1);
+          d4m2[index_mu]= d_table.d[wigner_d4m2]+index_mu*(ple->l_unlensed_max+1);
+        }
+        if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+          d22[index_mu] = d_table.d[wigner_d22]+index_mu*(ple->l_unlensed_max+1);
+          d31[index_mu] = d_table.d[wigner_d31]+index_mu*(ple->l_unlensed_max+1);
+          d3m3[index_mu]= d_table.d[wigner_d3m3]+index_mu*(ple->l_unlensed_max+1);
+          d40[index_mu] = d_table.d[wigner_d40]+index_mu*(ple->l_unlensed_max+1);
+          d4m4[index_mu]= d_table.d[wigner_d4m4]+index_mu*(ple->l_unlensed_max+1);
+        }
+      }
+    }
+    else {
+      for (index_mu=0; index_mu<num_mu; index_mu++) {
 
-  class_call(lensing_d2m2(mu,num_mu,ple->l_unlensed_max,d2m2),
-             ple->error_message,
-             ple->error_message);
-  //fin = omp_get_wtime();
-  //cpu_time = (fin-debut);
-  //printf("time in lensing_dxx=%4.3f s\n",cpu_time);
+        index_mu_block = index_mu % mu_block_size;
 
+        d00[index_mu] = &(buf_dxx[icount+index_mu_block                  * (ple->l_unlensed_max+1)]);
+        d11[index_mu] = &(buf_dxx[icount+(index_mu_block+mu_block_size)  * (ple->l_unlensed_max+1)]);
+        d1m1[index_mu]= &(buf_dxx[icount+(index_mu_block+2*mu_block_size)* (ple->l_unlensed_max+1)]);
+        d2m2[index_mu]= &(buf_dxx[icount+(index_mu_block+3*mu_block_size)* (ple->l_unlensed_max+1)]);
+      }
+      icount += 4*mu_block_size*(ple->l_unlensed_max+1);
 
-  if (ple->has_te==_TRUE_) {
+      if (ple->has_te==_TRUE_) {
+        for (index_mu=0; index_mu<num_mu; index_mu++) {
+          index_mu_block = index_mu % mu_block_size;
+          d20[index_mu] = &(buf_dxx[icount+index_mu_block                  * (ple->l_unlensed_max+1)]);
+          d3m1[index_mu]= &(buf_dxx[icount+(index_mu_block+mu_block_size)  * (ple->l_unlensed_max+1)]);
+          d4m2[index_mu]= &(buf_dxx[icount+(index_mu_block+2*mu_block_size)* (ple->l_unlensed_max+1)]);
+        }
+        icount += 3*mu_block_size*(ple->l_unlensed_max+1);
+      }
 
-    class_call(lensing_d20(mu,num_mu,ple->l_unlensed_max,d20),
-               ple->error_message,
-               ple->error_message);
+      if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
 
-    class_call(lensing_d3m1(mu,num_mu,ple->l_unlensed_max,d3m1),
-               ple->error_message,
-               ple->error_message);
+        for (index_mu=0; index_mu<num_mu; index_mu++) {
+          index_mu_block = index_mu % mu_block_size;
+          d22[index_mu] = &(buf_dxx[icount+index_mu_block                  * (ple->l_unlensed_max+1)]);
+          d31[index_mu] = &(buf_dxx[icount+(index_mu_block+mu_block_size)  * (ple->l_unlensed_max+1)]);
+          d3m3[index_mu]= &(buf_dxx[icount+(index_mu_block+2*mu_block_size)* (ple->l_unlensed_max+1)]);
+          d40[index_mu] = &(buf_dxx[icount+(index_mu_block+3*mu_block_size)* (ple->l_unlensed_max+1)]);
+          d4m4[index_mu]= &(buf_dxx[icount+(index_mu_block+4*mu_block_size)* (ple->l_unlensed_max+1)]);
+        }
+        icount += 5*mu_block_size*(ple->l_unlensed_max+1);
+      }
+    }
 
-    class_call(lensing_d4m2(mu,num_mu,ple->l_unlensed_max,d4m2),
-               ple->error_message,
-               ple->error_message);
+    sqrt1 = &(buf_dxx[icount]);
+    icount += ple->l_unlensed_max+1;
+    sqrt2 = &(buf_dxx[icount]);
+    icount += ple->l_unlensed_max+1;
+    sqrt3 = &(buf_dxx[icount]);
+    icount += ple->l_unlensed_max+1;
+    sqrt4 = &(buf_dxx[icount]);
+    icount += ple->l_unlensed_max+1;
+    sqrt5 = &(buf_dxx[icount]);
+    icount += ple->l_unlensed_max+1;
+
+    /** - compute \f$ Cgl(\mu)\f$, \f$ Cgl2(\mu) \f$ and sigma2(\f$\mu\f$) */
+
+    class_alloc(Cgl,
+                num_mu*sizeof(double),
+                ple->error_message);
 
-  }
+    class_alloc(Cgl2,
+                num_mu*sizeof(double),
+                ple->error_message);
 
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+    class_alloc(sigma2,
+                (num_mu-1)*sizeof(double), /* Zero separation is omitted */
+                ple->error_message);
 
-    class_call(lensing_d22(mu,num_mu,ple->l_unlensed_max,d22),
-               ple->error_message,
-               ple->error_message);
+    /** - Compute sigma2\f$(\mu)\f$ and Cgl2(\f$\mu\f$), with a first pass over the blocks of mu computing only \f$ d^l_{11}\f$ and \f$ d^l_{1-1}\f$ **/
 
-    class_call(lensing_d31(mu,num_mu,ple->l_unlensed_max,d31),
-               ple->error_message,
-               ple->error_message);
+    //debut = omp_get_wtime();
+    for (index_mu_min=0; index_mu_min<num_mu; index_mu_min+=mu_block_size) {
 
-    class_call(lensing_d3m3(mu,num_mu,ple->l_unlensed_max,d3m3),
-               ple->error_message,
-               ple->error_message);
+      nmu = MIN(mu_block_size,num_mu-index_mu_min);
 
-    class_call(lensing_d40(mu,num_mu,ple->l_unlensed_max,d40),
-               ple->error_message,
-               ple->error_message);
+      if (use_d_cache == _FALSE_) {
 
-    class_call(lensing_d4m4(mu,num_mu,ple->l_unlensed_max,d4m4),
-               ple->error_message,
-               ple->error_message);
-  }
+        class_counters_begin(counter_lensing_d);
 
-  /** - compute \f$ Cgl(\mu)\f$, \f$ Cgl2(\mu) \f$ and sigma2(\f$\mu\f$) */
+        class_call(lensing_d11(mu+index_mu_min,nmu,ple->l_unlensed_max,d11+index_mu_min),
+                   ple->error_message,
+                   ple->error_message);
 
-  class_alloc(Cgl,
-              num_mu*sizeof(double),
-              ple->error_message);
+        class_call(lensing_d1m1(mu+index_mu_min,nmu,ple->l_unlensed_max,d1m1+index_mu_min),
+                   ple->error_message,
+                   ple->error_message);
 
-  class_alloc(Cgl2,
-              num_mu*sizeof(double),
-              ple->error_message);
+        class_counters_end(counter_lensing_d);
+      }
 
-  class_alloc(sigma2,
-              (num_mu-1)*sizeof(double), /* Zero separation is omitted */
-              ple->error_message);
+#pragma omp parallel for                        \
+    private (index_mu,l)                          \
+    schedule (static)
+      for (index_mu=index_mu_min; index_mu<index_mu_min+nmu; index_mu++) {
 
-  class_alloc(cl_unlensed,
-              phr->ct_size*sizeof(double),
-              ple->error_message);
+        Cgl[index_mu]=0;
+        Cgl2[index_mu]=0;
 
+        for (l=2; l<=ple->l_unlensed_max; l++) {
 
-  /** - Locally store unlensed temperature \f$ cl_{tt}\f$ and potential \f$ cl_{pp}\f$ spectra **/
-  class_alloc(cl_tt,
-              (ple->l_unlensed_max+1)*sizeof(double),
-              ple->error_message);
-  if (ple->has_te==_TRUE_) {
-    class_alloc(cl_te,
-                (ple->l_unlensed_max+1)*sizeof(double),
-                ple->error_message);
-  }
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
-    class_alloc(cl_ee,
-                (ple->l_unlensed_max+1)*sizeof(double),
-                ple->error_message);
+          Cgl[index_mu] += (2.*l+1.)*l*(l+1.)*
+            cl_pp[l]*d11[index_mu][l];
 
-    class_alloc(cl_bb,
-                (ple->l_unlensed_max+1)*sizeof(double),
-                ple->error_message);
-  }
-  class_alloc(cl_pp,
-              (ple->l_unlensed_max+1)*sizeof(double),
-              ple->error_message);
+          Cgl2[index_mu] += (2.*l+1.)*l*(l+1.)*
+            cl_pp[l]*d1m1[index_mu][l];
 
-  class_alloc(cl_md_ic,
-              phr->md_size*sizeof(double *),
-              ple->error_message);
+        }
 
-  class_alloc(cl_md,
-              phr->md_size*sizeof(double *),
-              ple->error_message);
+        Cgl[index_mu] /= 4.*_PI_;
+        Cgl2[index_mu] /= 4.*_PI_;
 
-  for (index_md = 0; index_md < phr->md_size; index_md++) {
+      }
+    }
 
-    if (phr->md_size > 1)
+    for (index_mu=0; index_mu<num_mu-1; index_mu++) {
+      /* Cgl(1.0) - Cgl(mu) */
+      sigma2[index_mu] = Cgl[num_mu-1] - Cgl[index_mu];
+    }
+    //fin = omp_get_wtime();
+    //cpu_time = (fin-debut);
+    //printf("time in Cgl,Cgl2,sigma2=%4.3f s\n",cpu_time);
 
-      class_alloc(cl_md[index_md],
-                  phr->ct_size*sizeof(double),
-                  ple->error_message);
 
-    if (phr->ic_size[index_md] > 1)
+    /** - compute ksi, ksi+, ksi-, ksiX */
 
-      class_alloc(cl_md_ic[index_md],
-                  phr->ic_ic_size[index_md]*phr->ct_size*sizeof(double),
-                  ple->error_message);
-  }
+    /** - --> ksi is for TT **/
+    if (ple->has_tt==_TRUE_) {
 
-  for (l=2; l<=ple->l_unlensed_max; l++) {
-    class_call(harmonic_cl_at_l(phr,l,cl_unlensed,cl_md,cl_md_ic),
-               phr->error_message,
-               ple->error_message);
-    cl_tt[l] = cl_unlensed[ple->index_lt_tt];
-    cl_pp[l] = cl_unlensed[ple->index_lt_pp];
-    if (ple->has_te==_TRUE_) {
-      cl_te[l] = cl_unlensed[ple->index_lt_te];
-    }
-    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
-      cl_ee[l] = cl_unlensed[ple->index_lt_ee];
-      cl_bb[l] = cl_unlensed[ple->index_lt_bb];
+      class_calloc(ksi,
+                   (num_mu-1),
+                   sizeof(double),
+                   ple->error_message);
     }
-  }
-
-  for (index_md = 0; index_md < phr->md_size; index_md++) {
-
-    if (phr->md_size > 1)
-      free(cl_md[index_md]);
-
-    if (phr->ic_size[index_md] > 1)
-      free(cl_md_ic[index_md]);
 
-  }
+    /** - --> ksiX is for TE **/
+    if (ple->has_te==_TRUE_) {
 
-  free(cl_md_ic);
-  free(cl_md);
+      class_calloc(ksiX,
+                   (num_mu-1),
+                   sizeof(double),
+                   ple->error_message);
+    }
 
-  /** - Compute sigma2\f$(\mu)\f$ and Cgl2(\f$\mu\f$) **/
+    /** - --> ksip, ksim for EE, BB **/
+    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
 
-  //debut = omp_get_wtime();
-#pragma omp parallel for                        \
-  private (index_mu,l)                          \
-  schedule (static)
-  for (index_mu=0; index_mu<num_mu; index_mu++) {
+      class_calloc(ksip,
+                   (num_mu-1),
+                   sizeof(double),
+                   ple->error_message);
 
-    Cgl[index_mu]=0;
-    Cgl2[index_mu]=0;
+      class_calloc(ksim,
+                   (num_mu-1),
+                   sizeof(double),
+                   ple->error_message);
+    }
 
-    for (l=2; l<=ple->l_unlensed_max; l++) {
+    for (l=2;l<=ple->l_unlensed_max;l++) {
 
-      Cgl[index_mu] += (2.*l+1.)*l*(l+1.)*
-        cl_pp[l]*d11[index_mu][l];
+      ll = (double)l;
+      sqrt1[l]=sqrt((ll+2)*(ll+1)*ll*(ll-1));
+      sqrt2[l]=sqrt((ll+2)*(ll-1));
+      sqrt3[l]=sqrt((ll+3)*(ll-2));
+      sqrt4[l]=sqrt((ll+4)*(ll+3)*(ll-2.)*(ll-3));
+      sqrt5[l]=sqrt(ll*(ll+1));
+    }
 
-      Cgl2[index_mu] += (2.*l+1.)*l*(l+1.)*
-        cl_pp[l]*d1m1[index_mu][l];
+    /** - the quadratures giving the lensed \f$ C_l\f$'s are accumulated in ple->cl_lens block by block */
 
+    for (index_l=0; index_l<ple->l_size; index_l++) {
+      if (ple->has_tt==_TRUE_)
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt] = 0.;
+      if (ple->has_te==_TRUE_)
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te] = 0.;
+      if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee] = 0.;
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb] = 0.;
+      }
     }
 
-    Cgl[index_mu] /= 4.*_PI_;
-    Cgl2[index_mu] /= 4.*_PI_;
-
-  }
+    /** - second pass over the blocks of mu: all d-functions, correlation functions, and their contribution to the lensed \f$ C_l\f$'s */
 
-  for (index_mu=0; index_mu<num_mu-1; index_mu++) {
-    /* Cgl(1.0) - Cgl(mu) */
-    sigma2[index_mu] = Cgl[num_mu-1] - Cgl[index_mu];
-  }
-  //fin = omp_get_wtime();
-  //cpu_time = (fin-debut);
-  //printf("time in Cgl,Cgl2,sigma2=%4.3f s\n",cpu_time);
+    for (index_mu_min=0; index_mu_min<num_mu; index_mu_min+=mu_block_size) {
 
+      nmu = MIN(mu_block_size,num_mu-index_mu_min);
 
-  /** - compute ksi, ksi+, ksi-, ksiX */
+      if (use_d_cache == _FALSE_) {
 
-  /** - --> ksi is for TT **/
-  if (ple->has_tt==_TRUE_) {
+        class_counters_begin(counter_lensing_d);
 
-    class_calloc(ksi,
-                 (num_mu-1),
-                 sizeof(double),
-                 ple->error_message);
-  }
+        //debut = omp_get_wtime();
+        class_call(lensing_d00(mu+index_mu_min,nmu,ple->l_unlensed_max,d00+index_mu_min),
+                   ple->error_message,
+                   ple->error_message);
 
-  /** - --> ksiX is for TE **/
-  if (ple->has_te==_TRUE_) {
+        /* with a single block, d11 and d1m1 are still there from the first pass */
+        if (mu_block_size < num_mu) {
 
-    class_calloc(ksiX,
-                 (num_mu-1),
-                 sizeof(double),
-                 ple->error_message);
-  }
+          class_call(lensing_d11(mu+index_mu_min,nmu,ple->l_unlensed_max,d11+index_mu_min),
+                     ple->error_message,
+                     ple->error_message);
 
-  /** - --> ksip, ksim for EE, BB **/
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+          class_call(lensing_d1m1(mu+index_mu_min,nmu,ple->l_unlensed_max,d1m1+index_mu_min),
+                     ple->error_message,
+                     ple->error_message);
+        }
 
-    class_calloc(ksip,
-                 (num_mu-1),
-                 sizeof(double),
-                 ple->error_message);
+        class_call(lensing_d2m2(mu+index_mu_min,nmu,ple->l_unlensed_max,d2m2+index_mu_min),
+                   ple->error_message,
+                   ple->error_message);
+        //fin = omp_get_wtime();
+        //cpu_time = (fin-debut);
+        //printf("time in lensing_dxx=%4.3f s\n",cpu_time);
 
-    class_calloc(ksim,
-                 (num_mu-1),
-                 sizeof(double),
-                 ple->error_message);
-  }
+        if (ple->has_te==_TRUE_) {
 
-  for (l=2;l<=ple->l_unlensed_max;l++) {
+          class_call(lensing_d20(mu+index_mu_min,nmu,ple->l_unlensed_max,d20+index_mu_min),
+                     ple->error_message,
+                     ple->error_message);
 
-    ll = (double)l;
-    sqrt1[l]=sqrt((ll+2)*(ll+1)*ll*(ll-1));
-    sqrt2[l]=sqrt((ll+2)*(ll-1));
-    sqrt3[l]=sqrt((ll+3)*(ll-2));
-    sqrt4[l]=sqrt((ll+4)*(ll+3)*(ll-2.)*(ll-3));
-    sqrt5[l]=sqrt(ll*(ll+1));
-  }
+          class_call(lensing_d3m1(mu+index_mu_min,nmu,ple->l_unlensed_max,d3m1+index_mu_min),
+                     ple->error_message,
+                     ple->error_message);
 
+          class_call(lensing_d4m2(mu+index_mu_min,nmu,ple->l_unlensed_max,d4m2+index_mu_min),
+                     ple->error_message,
+                     ple->error_message);
 
-  //debut = omp_get_wtime();
-#pragma omp parallel for                                                \
-  private (index_mu,l,ll,res,resX,resp,resm,lens,lensp,lensm,           \
-           fac,fac1,X_000,X_p000,X_220,X_022,X_p022,X_121,X_132,X_242)	\
-  schedule (static)
+        }
 
-  for (index_mu=0;index_mu<num_mu-1;index_mu++) {
+        if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
 
-    for (l=2;l<=ple->l_unlensed_max;l++) {
+          class_call(lensing_d22(mu+index_mu_min,nmu,ple->l_unlensed_max,d22+index_mu_min),
+                     ple->error_message,
+                     ple->error_message);
 
-      ll = (double)l;
+          class_call(lensing_d31(mu+index_mu_min,nmu,ple->l_unlensed_max,d31+index_mu_min),
+                     ple->error_message,
+                     ple->error_message);
 
-      fac = ll*(ll+1)/4.;
-      fac1 = (2*ll+1)/(4.*_PI_);
+          class_call(lensing_d3m3(mu+index_mu_min,nmu,ple->l_unlensed_max,d3m3+index_mu_min),
+                     ple->error_message,
+                     ple->error_message);
 
-      /* In the following we will keep terms of the form (sigma2)^k*(Cgl2)^m
-         with k+m <= 2 */
-
-      X_000 = exp(-fac*sigma2[index_mu]);
-      X_p000 = -fac*X_000;
-      /* X_220 = 0.25*sqrt1[l] * exp(-(fac-0.5)*sigma2[index_mu]); */
-      X_220 = 0.25*sqrt1[l] * X_000; /* Order 0 */
-      /* next 5 lines useless, but avoid compiler warning 'may be used uninitialized' */
-      X_242=0.;
-      X_132=0.;
-      X_121=0.;
-      X_p022=0.;
-      X_022=0.;
-
-      if (ple->has_te==_TRUE_ || ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
-        /* X_022 = exp(-(fac-1.)*sigma2[index_mu]); */
-        X_022 = X_000 * (1+sigma2[index_mu]*(1+0.5*sigma2[index_mu])); /* Order 2 */
-        X_p022 = -(fac-1.)*X_022; /* Old versions were missing the
-        minus sign in this line, which introduced a very small error
-        on the high-l C_l^TE lensed spectrum [credits for bug fix:
-        Selim Hotinli] */
-
-        /* X_242 = 0.25*sqrt4[l] * exp(-(fac-5./2.)*sigma2[index_mu]); */
-        X_242 = 0.25*sqrt4[l] * X_000; /* Order 0 */
-        if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+          class_call(lensing_d40(mu+index_mu_min,nmu,ple->l_unlensed_max,d40+index_mu_min),
+                     ple->error_message,
+                     ple->error_message);
 
-          /* X_121 = - 0.5*sqrt2[l] * exp(-(fac-2./3.)*sigma2[index_mu]);
-             X_132 = - 0.5*sqrt3[l] * exp(-(fac-5./3.)*sigma2[index_mu]); */
-          X_121 = -0.5*sqrt2[l] * X_000 * (1+2./3.*sigma2[index_mu]); /* Order 1 */
-          X_132 = -0.5*sqrt3[l] * X_000 * (1+5./3.*sigma2[index_mu]); /* Order 1 */
+          class_call(lensing_d4m4(mu+index_mu_min,nmu,ple->l_unlensed_max,d4m4+index_mu_min),
+                     ple->error_message,
+                     ple->error_message);
         }
+
+        class_counters_end(counter_lensing_d);
       }
 
+      /* the last value mu=1 (zero separation) only enters sigma2 */
+      nmu = MIN(index_mu_min+nmu,num_mu-1)-index_mu_min;
+
+      //debut = omp_get_wtime();
+    #pragma omp parallel for                                                \
+      private (index_mu,l,ll,res,resX,resp,resm,lens,lensp,lensm,           \
+               fac,fac1,X_000,X_p000,X_220,X_022,X_p022,X_121,X_132,X_242)	\
+      schedule (static)
+
+      for (index_mu=index_mu_min;index_mu<index_mu_min+nmu;index_mu++) {
+
+        class_trace_begin();
+
+        for (l=2;l<=ple->l_unlensed_max;l++) {
+
+          ll = (double)l;
+
+          fac = ll*(ll+1)/4.;
+          fac1 = (2*ll+1)/(4.*_PI_);
+
+          /* In the following we will keep terms of the form (sigma2)^k*(Cgl2)^m
+             with k+m <= 2 */
+
+          X_000 = exp(-fac*sigma2[index_mu]);
+          X_p000 = -fac*X_000;
+          /* X_220 = 0.25*sqrt1[l] * exp(-(fac-0.5)*sigma2[index_mu]); */
+          X_220 = 0.25*sqrt1[l] * X_000; /* Order 0 */
+          /* next 5 lines useless, but avoid compiler warning 'may be used uninitialized' */
+          X_242=0.;
+          X_132=0.;
+          X_121=0.;
+          X_p022=0.;
+          X_022=0.;
+
+          if (ple->has_te==_TRUE_ || ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+            /* X_022 = exp(-(fac-1.)*sigma2[index_mu]); */
+            X_022 = X_000 * (1+sigma2[index_mu]*(1+0.5*sigma2[index_mu])); /* Order 2 */
+            X_p022 = -(fac-1.)*X_022; /* Old versions were missing the
+            minus sign in this line, which introduced a very small error
+            on the high-l C_l^TE lensed spectrum [credits for bug fix:
+            Selim Hotinli] */
+
+            /* X_242 = 0.25*sqrt4[l] * exp(-(fac-5./2.)*sigma2[index_mu]); */
+            X_242 = 0.25*sqrt4[l] * X_000; /* Order 0 */
+            if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+
+              /* X_121 = - 0.5*sqrt2[l] * exp(-(fac-2./3.)*sigma2[index_mu]);
+                 X_132 = - 0.5*sqrt3[l] * exp(-(fac-5./3.)*sigma2[index_mu]); */
+              X_121 = -0.5*sqrt2[l] * X_000 * (1+2./3.*sigma2[index_mu]); /* Order 1 */
+              X_132 = -0.5*sqrt3[l] * X_000 * (1+5./3.*sigma2[index_mu]); /* Order 1 */
+            }
+          }
+
+
+          if (ple->has_tt==_TRUE_) {
+
+            res = fac1*cl_tt[l];
+
+            lens = (X_000*X_000*d00[index_mu][l] +
+                    X_p000*X_p000*d1m1[index_mu][l]
+                    *Cgl2[index_mu]*8./(ll*(ll+1)) +
+                    (X_p000*X_p000*d00[index_mu][l] +
+                     X_220*X_220*d2m2[index_mu][l])
+                    *Cgl2[index_mu]*Cgl2[index_mu]);
+            if (ppr->accurate_lensing == _FALSE_) {
+              /* Remove unlensed correlation function */
+              lens -= d00[index_mu][l];
+            }
+            res *= lens;
+            ksi[index_mu] += res;
+          }
+
+          if (ple->has_te==_TRUE_) {
+
+            resX = fac1*cl_te[l];
+
+
+            lens = ( X_022*X_000*d20[index_mu][l] +
+                     Cgl2[index_mu]*2.*X_p000/sqrt5[l] *
+                     (X_121*d11[index_mu][l] + X_132*d3m1[index_mu][l]) +
+                     0.5 * Cgl2[index_mu] * Cgl2[index_mu] *
+                     ( ( 2.*X_p022*X_p000+X_220*X_220 ) *
+                       d20[index_mu][l] + X_220*X_242*d4m2[index_mu][l] ) );
+            if (ppr->accurate_lensing == _FALSE_) {
+              lens -= d20[index_mu][l];
+            }
+            resX *= lens;
+            ksiX[index_mu] += resX;
+          }
+
+          if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+
+            resp = fac1*(cl_ee[l]+cl_bb[l]);
+            resm = fac1*(cl_ee[l]-cl_bb[l]);
+
+            lensp = ( X_022*X_022*d22[index_mu][l] +
+                      2.*Cgl2[index_mu]*X_132*X_121*d31[index_mu][l] +
+                      Cgl2[index_mu]*Cgl2[index_mu] *
+                      ( X_p022*X_p022*d22[index_mu][l] +
+                        X_242*X_220*d40[index_mu][l] ) );
+
+            lensm = ( X_022*X_022*d2m2[index_mu][l] +
+                      Cgl2[index_mu] *
+                      ( X_121*X_121*d1m1[index_mu][l] +
+                        X_132*X_132*d3m3[index_mu][l] ) +
+                      0.5 * Cgl2[index_mu] * Cgl2[index_mu] *
+                      ( 2.*X_p022*X_p022*d2m2[index_mu][l] +
+                        X_220*X_220*d00[index_mu][l] +
+                        X_242*X_242*d4m4[index_mu][l] ) );
+            if (ppr->accurate_lensing == _FALSE_) {
+              lensp -= d22[index_mu][l];
+              lensm -= d2m2[index_mu][l];
+            }
+            resp *= lensp;
+            resm *= lensm;
+            ksip[index_mu] += resp;
+            ksim[index_mu] += resm;
+          }
+        }
 
-      if (ple->has_tt==_TRUE_) {
+        class_trace_end("lensing","index_mu",index_mu);
+      }
+      //fin = omp_get_wtime();
+      //cpu_time = (fin-debut);
+      //printf("time in ksi=%4.3f s\n",cpu_time);
 
-        res = fac1*cl_tt[l];
-
-        lens = (X_000*X_000*d00[index_mu][l] +
-                X_p000*X_p000*d1m1[index_mu][l]
-                *Cgl2[index_mu]*8./(ll*(ll+1)) +
-                (X_p000*X_p000*d00[index_mu][l] +
-                 X_220*X_220*d2m2[index_mu][l])
-                *Cgl2[index_mu]*Cgl2[index_mu]);
-        if (ppr->accurate_lensing == _FALSE_) {
-          /* Remove unlensed correlation function */
-          lens -= d00[index_mu][l];
-        }
-        res *= lens;
-        ksi[index_mu] += res;
+      /** - add the contribution of this block to the integrals giving the lensed \f$ C_l\f$'s */
+      //debut = omp_get_wtime();
+      if (ple->has_tt==_TRUE_) {
+        class_call(lensing_lensed_cl_tt(ksi+index_mu_min,d00+index_mu_min,w8+index_mu_min,nmu,ple),
+                   ple->error_message,
+                   ple->error_message);
       }
 
       if (ple->has_te==_TRUE_) {
-
-        resX = fac1*cl_te[l];
-
-
-        lens = ( X_022*X_000*d20[index_mu][l] +
-                 Cgl2[index_mu]*2.*X_p000/sqrt5[l] *
-                 (X_121*d11[index_mu][l] + X_132*d3m1[index_mu][l]) +
-                 0.5 * Cgl2[index_mu] * Cgl2[index_mu] *
-                 ( ( 2.*X_p022*X_p000+X_220*X_220 ) *
-                   d20[index_mu][l] + X_220*X_242*d4m2[index_mu][l] ) );
-        if (ppr->accurate_lensing == _FALSE_) {
-          lens -= d20[index_mu][l];
-        }
-        resX *= lens;
-        ksiX[index_mu] += resX;
+        class_call(lensing_lensed_cl_te(ksiX+index_mu_min,d20+index_mu_min,w8+index_mu_min,nmu,ple),
+                   ple->error_message,
+                   ple->error_message);
       }
 
       if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
-
-        resp = fac1*(cl_ee[l]+cl_bb[l]);
-        resm = fac1*(cl_ee[l]-cl_bb[l]);
-
-        lensp = ( X_022*X_022*d22[index_mu][l] +
-                  2.*Cgl2[index_mu]*X_132*X_121*d31[index_mu][l] +
-                  Cgl2[index_mu]*Cgl2[index_mu] *
-                  ( X_p022*X_p022*d22[index_mu][l] +
-                    X_242*X_220*d40[index_mu][l] ) );
-
-        lensm = ( X_022*X_022*d2m2[index_mu][l] +
-                  Cgl2[index_mu] *
-                  ( X_121*X_121*d1m1[index_mu][l] +
-                    X_132*X_132*d3m3[index_mu][l] ) +
-                  0.5 * Cgl2[index_mu] * Cgl2[index_mu] *
-                  ( 2.*X_p022*X_p022*d2m2[index_mu][l] +
-                    X_220*X_220*d00[index_mu][l] +
-                    X_242*X_242*d4m4[index_mu][l] ) );
-        if (ppr->accurate_lensing == _FALSE_) {
-          lensp -= d22[index_mu][l];
-          lensm -= d2m2[index_mu][l];
-        }
-        resp *= lensp;
-        resm *= lensm;
-        ksip[index_mu] += resp;
-        ksim[index_mu] += resm;
+        class_call(lensing_lensed_cl_ee_bb(ksip+index_mu_min,ksim+index_mu_min,d22+index_mu_min,d2m2+index_mu_min,w8+index_mu_min,nmu,ple),
+                   ple->error_message,
+                   ple->error_message);
       }
+      //fin=omp_get_wtime();
+      //cpu_time = (fin-debut);
+      //printf("time in final lensing computation=%4.3f s\n",cpu_time);
     }
-  }
-  //fin = omp_get_wtime();
-  //cpu_time = (fin-debut);
-  //printf("time in ksi=%4.3f s\n",cpu_time);
 
+    /** - with lensing_response, compute the responses around these spectra */
 
-  /** - compute lensed \f$ C_l\f$'s by integration */
-  //debut = omp_get_wtime();
-  if (ple->has_tt==_TRUE_) {
-    class_call(lensing_lensed_cl_tt(ksi,d00,w8,num_mu-1,ple),
-               ple->error_message,
-               ple->error_message);
-    if (ppr->accurate_lensing == _FALSE_) {
-      class_call(lensing_addback_cl_tt(ple,cl_tt),
+    if (ppr->lensing_response == _TRUE_) {
+      d[wigner_d00] = d00; d[wigner_d11] = d11; d[wigner_d1m1] = d1m1; d[wigner_d2m2] = d2m2;
+      d[wigner_d22] = d22; d[wigner_d20] = d20; d[wigner_d31] = d31; d[wigner_d3m1] = d3m1;
+      d[wigner_d3m3] = d3m3; d[wigner_d40] = d40; d[wigner_d4m2] = d4m2; d[wigner_d4m4] = d4m4;
+
+      class_call(lensing_response_build(ppr,ple,num_mu,w8,d,Cgl2,sigma2,cl_tt,cl_te,cl_ee,cl_bb,cl_pp,&response),
                  ple->error_message,
                  ple->error_message);
     }
   }
 
-  if (ple->has_te==_TRUE_) {
-    class_call(lensing_lensed_cl_te(ksiX,d20,w8,num_mu-1,ple),
-               ple->error_message,
-               ple->error_message);
-    if (ppr->accurate_lensing == _FALSE_) {
+  /** - compute lensed \f$ C_l\f$'s from the accumulated quadratures */
+
+  for (index_l=0; index_l<ple->l_size; index_l++) {
+    if (ple->has_tt==_TRUE_)
+      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt] = ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt]*2.0*_PI_;
+    if (ple->has_te==_TRUE_)
+      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te] = ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te]*2.0*_PI_;
+    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+      /* the ee and bb entries hold the quadratures of ksi+ and ksi- */
+      resp = ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee];
+      resm = ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb];
+      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee] = (resp+resm)*_PI_;
+      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb] = (resp-resm)*_PI_;
+    }
+  }
+
+  if (ppr->accurate_lensing == _FALSE_) {
+    if (ple->has_tt==_TRUE_) {
+      class_call(lensing_addback_cl_tt(ple,cl_tt),
+                 ple->error_message,
+                 ple->error_message);
+    }
+    if (ple->has_te==_TRUE_) {
       class_call(lensing_addback_cl_te(ple,cl_te),
                  ple->error_message,
                  ple->error_message);
     }
+    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+      class_call(lensing_addback_cl_ee_bb(ple,cl_ee,cl_bb),
+                 ple->error_message,
+                 ple->error_message);
+    }
   }
 
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+  /** - keep the responses, with these lensed spectra as fiducial ones */
 
-    class_call(lensing_lensed_cl_ee_bb(ksip,ksim,d22,d2m2,w8,num_mu-1,ple),
+  if (response != NULL) {
+    class_call(lensing_response_keep(ple,response),
                ple->error_message,
                ple->error_message);
-    if (ppr->accurate_lensing == _FALSE_) {
-      class_call(lensing_addback_cl_ee_bb(ple,cl_ee,cl_bb),
-                 ple->error_message,
-                 ple->error_message);
-    }
   }
-  //fin=omp_get_wtime();
-  //cpu_time = (fin-debut);
-  //printf("time in final lensing computation=%4.3f s\n",cpu_time);
 
   /** - spline computed \f$ C_l\f$'s in view of interpolation */
 
@@ -745,36 +1051,44 @@ int lensing_init(
              ple->error_message);
 
   /** - Free lots of stuff **/
-  free(buf_dxx);
+  if (use_fused == _FALSE_) {
+    if (use_d_cache == _TRUE_) {
+      class_call(lensing_d_cache_release(&d_table),
+                 ple->error_message,
+                 ple->error_message);
+    }
 
-  free(d00);
-  free(d11);
-  free(d1m1);
-  free(d2m2);
-  if (ple->has_te==_TRUE_) {
-    free(d20);
-    free(d3m1);
-    free(d4m2);
-  }
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
-    free(d22);
-    free(d31);
-    free(d3m3);
-    free(d40);
-    free(d4m4);
-  }
+    free(buf_dxx);
 
-  if (ple->has_tt==_TRUE_)
-    free(ksi);
-  if (ple->has_te==_TRUE_)
-    free(ksiX);
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
-    free(ksip);
-    free(ksim);
+    free(d00);
+    free(d11);
+    free(d1m1);
+    free(d2m2);
+    if (ple->has_te==_TRUE_) {
+      free(d20);
+      free(d3m1);
+      free(d4m2);
+    }
+    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+      free(d22);
+      free(d31);
+      free(d3m3);
+      free(d40);
+      free(d4m4);
+    }
+
+    if (ple->has_tt==_TRUE_)
+      free(ksi);
+    if (ple->has_te==_TRUE_)
+      free(ksiX);
+    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+      free(ksip);
+      free(ksim);
+    }
+    free(Cgl);
+    free(Cgl2);
+    free(sigma2);
   }
-  free(Cgl);
-  free(Cgl2);
-  free(sigma2);
 
   free(mu);
   free(w8);
@@ -810,17 +1124,69 @@ int lensing_free(
 
   if (ple->has_lensed_cls == _TRUE_) {
 
-    free(ple->l);
-    free(ple->cl_lens);
-    free(ple->ddcl_lens);
+    /* the table does not exist if it was never queried with lazy evaluation */
+    if (ple->is_pending == _FALSE_) {
+      free(ple->l);
+      free(ple->cl_lens);
+      free(ple->ddcl_lens);
+    }
     free(ple->l_max_lt);
 
   }
 
+#ifdef _OPENMP
+  omp_destroy_lock(&(ple->lazy_lock));
+#endif
+
+  class_memory_leaks();
+
   return _SUCCESS_;
 
 }
 
+/**
+ * This routine computes the table of lensed spectra of a lensing
+ * structure initialized with lazy evaluation ('lazy_evaluation =
+ * yes'), if this has not been done yet. Does nothing otherwise.
+ *
+ * The harmonic structure passed to lensing_init() must not have
+ * been freed before the first call. The first call should not be
+ * issued concurrently from several threads.
+ *
+ * @param ple Input/Output: pointer to lensing structure
+ * @return the error status
+ */
+
+int lensing_lazy_compute(
+                         struct lensing * ple
+                         ) {
+
+  int status = _SUCCESS_;
+
+  if (ple->is_pending == _FALSE_)
+    return _SUCCESS_;
+
+  /* each structure has its own lock, so that other runs are not held up */
+#ifdef _OPENMP
+  omp_set_lock(&(ple->lazy_lock));
+#endif
+  if (ple->is_pending == _TRUE_) {
+    if (ple->lensing_verbose > 0)
+      printf("Computing lensed spectra (lazy evaluation)\n");
+    status = lensing_spectra(ple->ppr,ple->ppt,ple->phr,ple->pfo,ple);
+    ple->is_pending = _FALSE_;
+  }
+#ifdef _OPENMP
+  omp_unset_lock(&(ple->lazy_lock));
+#endif
+
+  /* the error message has already been written by lensing_spectra() */
+  if (status == _FAILURE_)
+    return _FAILURE_;
+
+  return _SUCCESS_;
+}
+
 /**
  * This routine defines indices and allocates tables in the lensing structure
  *
@@ -836,14 +1202,6 @@ int lensing_indices(
                     struct lensing * ple
                     ){
 
-  int index_l;
-
-  double ** cl_md_ic; /* array with argument
-                         cl_md_ic[index_md][index_ic1_ic2*phr->ct_size+index_ct] */
-
-  double ** cl_md;    /* array with argument
-                         cl_md[index_md][index_ct] */
-
   int index_md;
   int index_lt;
 
@@ -937,6 +1295,63 @@ int lensing_indices(
 
   ple->l_lensed_max = ple->l_unlensed_max - ppr->delta_l_max;
 
+  /* we want to output Cl_lensed up to the same l_max as Cl_unlensed
+     (even if a number delta_l_max of extra values of l have been used
+     internally for more accurate results). Notable exception to the
+     above rule: ClBB_lensed(scalars) must be outputed at least up to the same l_max as
+     ClEE_unlensed(scalars) (since ClBB_unlensed is null for scalars)
+  */
+
+  class_alloc(ple->l_max_lt,ple->lt_size*sizeof(double),ple->error_message);
+  for (index_lt = 0; index_lt < ple->lt_size; index_lt++) {
+    ple->l_max_lt[index_lt]=0.;
+    for (index_md = 0; index_md < phr->md_size; index_md++) {
+      ple->l_max_lt[index_lt]=MAX(ple->l_max_lt[index_lt],phr->l_max_ct[index_md][index_lt]);
+
+      if ((ple->has_bb == _TRUE_) && (ple->has_ee == _TRUE_) && (index_lt == ple->index_lt_bb)) {
+        ple->l_max_lt[index_lt]=MAX(ple->l_max_lt[index_lt],phr->l_max_ct[index_md][ple->index_lt_ee]);
+      }
+
+    }
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine allocates the table of lensed spectra in the lensing
+ * structure, and fills it with the unlensed spectra at the values of
+ * l sampled by the harmonic module, up to l_lensed_max
+ *
+ * @param phr  Input: pointer to harmonic structure
+ * @param ple  Input/output: pointer to lensing structure
+ * @return the error status
+ */
+
+int lensing_table_unlensed(
+                           struct harmonic * phr,
+                           struct lensing * ple
+                           ){
+
+  int index_l;
+
+  double ** cl_md_ic; /* array with argument
+                         cl_md_ic[index_md][index_ic1_ic2*phr->ct_size+index_ct] */
+
+  double ** cl_md;    /* array with argument
+                         cl_md[index_md][index_ct] */
+
+  int index_md;
+
+  /* the unlensed C_l's must be available (with lazy evaluation, this computes them) */
+
+  class_call(harmonic_lazy_compute(phr),
+             phr->error_message,
+             ple->error_message);
+
+  /* number of sampled multipoles */
+
   for (index_l=0; (index_l < phr->l_size_max) && (phr->l[index_l] <= ple->l_lensed_max); index_l++);
 
   if (index_l < phr->l_size_max) index_l++; /* one more point in order to be able to interpolate till ple->l_lensed_max */
@@ -1007,32 +1422,15 @@ int lensing_indices(
   free(cl_md_ic);
   free(cl_md);
 
-  /* we want to output Cl_lensed up to the same l_max as Cl_unlensed
-     (even if a number delta_l_max of extra values of l have been used
-     internally for more accurate results). Notable exception to the
-     above rule: ClBB_lensed(scalars) must be outputed at least up to the same l_max as
-     ClEE_unlensed(scalars) (since ClBB_unlensed is null for scalars)
-  */
-
-  class_alloc(ple->l_max_lt,ple->lt_size*sizeof(double),ple->error_message);
-  for (index_lt = 0; index_lt < ple->lt_size; index_lt++) {
-    ple->l_max_lt[index_lt]=0.;
-    for (index_md = 0; index_md < phr->md_size; index_md++) {
-      ple->l_max_lt[index_lt]=MAX(ple->l_max_lt[index_lt],phr->l_max_ct[index_md][index_lt]);
-
-      if ((ple->has_bb == _TRUE_) && (ple->has_ee == _TRUE_) && (index_lt == ple->index_lt_bb)) {
-        ple->l_max_lt[index_lt]=MAX(ple->l_max_lt[index_lt],phr->l_max_ct[index_md][ple->index_lt_ee]);
-      }
-
-    }
-  }
-
   return _SUCCESS_;
 
 }
 
 /**
- * This routine computes the lensed power spectra by Gaussian quadrature
+ * This routine adds the contribution of nmu values of mu to the
+ * Gaussian quadrature of the lensed \f$ cl_{tt}\f$, accumulated in
+ * ple->cl_lens (lensing_spectra() multiplies the result by \f$ 2 \pi \f$
+ * once all values of mu have been added)
  *
  * @param ksi  Input: Lensed correlation function (ksi[index_mu])
  * @param d00  Input: Legendre polynomials (\f$ d^l_{00}\f$[l][index_mu])
@@ -1061,11 +1459,11 @@ int lensing_lensed_cl_tt(
   schedule (static)
 
   for(index_l=0; index_l<ple->l_size; index_l++){
-    cle=0;
+    cle=ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt];
     for (imu=0;imu<nmu;imu++) {
       cle += ksi[imu]*d00[imu][(int)ple->l[index_l]]*w8[imu]; /* loop could be optimized */
     }
-    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt]=cle*2.0*_PI_;
+    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt]=cle;
   }
 
   return _SUCCESS_;
@@ -1095,7 +1493,10 @@ int lensing_addback_cl_tt(
 }
 
 /**
- * This routine computes the lensed power spectra by Gaussian quadrature
+ * This routine adds the contribution of nmu values of mu to the
+ * Gaussian quadrature of the lensed \f$ cl_{te}\f$, accumulated in
+ * ple->cl_lens (lensing_spectra() multiplies the result by \f$ 2 \pi \f$
+ * once all values of mu have been added)
  *
  * @param ksiX Input: Lensed correlation function (ksiX[index_mu])
  * @param d20  Input: Wigner d-function (\f$ d^l_{20}\f$[l][index_mu])
@@ -1124,11 +1525,11 @@ int lensing_lensed_cl_te(
   schedule (static)
 
   for(index_l=0; index_l < ple->l_size; index_l++){
-    clte=0;
+    clte=ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te];
     for (imu=0;imu<nmu;imu++) {
       clte += ksiX[imu]*d20[imu][(int)ple->l[index_l]]*w8[imu]; /* loop could be optimized */
     }
-    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te]=clte*2.0*_PI_;
+    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te]=clte;
   }
 
   return _SUCCESS_;
@@ -1158,7 +1559,11 @@ int lensing_addback_cl_te(
 }
 
 /**
- * This routine computes the lensed power spectra by Gaussian quadrature
+ * This routine adds the contribution of nmu values of mu to the
+ * Gaussian quadratures of ksi+ and ksi-, accumulated in the ee and bb
+ * entries of ple->cl_lens (lensing_init() combines them into the
+ * lensed \f$ cl_{ee}\f$, \f$ cl_{bb}\f$ once all values of mu have been
+ * added)
  *
  * @param ksip Input: Lensed correlation function (ksi+[index_mu])
  * @param ksim Input: Lensed correlation function (ksi-[index_mu])
@@ -1191,13 +1596,14 @@ int lensing_lensed_cl_ee_bb(
   schedule (static)
 
   for(index_l=0; index_l < ple->l_size; index_l++){
-    clp=0; clm=0;
+    clp=ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee];
+    clm=ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb];
     for (imu=0;imu<nmu;imu++) {
       clp += ksip[imu]*d22[imu][(int)ple->l[index_l]]*w8[imu]; /* loop could be optimized */
       clm += ksim[imu]*d2m2[imu][(int)ple->l[index_l]]*w8[imu]; /* loop could be optimized */
     }
-    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee]=(clp+clm)*_PI_;
-    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb]=(clp-clm)*_PI_;
+    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee]=clp;
+    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb]=clm;
   }
 
   return _SUCCESS_;
@@ -1231,14 +1637,408 @@ int lensing_addback_cl_ee_bb(
 }
 
 /**
- * This routine computes the d00 term
+ * This routine computes the Gaussian quadratures giving the lensed
+ * \f$ C_l\f$'s with a fused kernel, and stores them in ple->cl_lens
+ * like lensing_lensed_cl_tt(), lensing_lensed_cl_te() and
+ * lensing_lensed_cl_ee_bb() (lensing_init() then finishes the job in
+ * the same way).
  *
- * @param mu     Input: Vector of cos(beta) values
- * @param num_mu Input: Number of cos(beta) values
- * @param lmax   Input: maximum multipole
- * @param d00    Input/output: Result is stored here
+ * There is a single parallel region over groups of
+ * _LENSING_MU_GROUP_ values of mu. For each group, a thread computes
+ * all the needed Wigner d-functions with lensing_d_at_mu(), running the
+ * recurrences of the group together. It then uses them at once, for
+ * each mu, for Cgl, Cgl2, sigma2, the lensed correlation functions,
+ * and their contribution to the quadratures, accumulated in a private
+ * array (see lensing_lensed_cl_fused_at_mu()). The
+ * private arrays are summed in the order of the threads at the
+ * end. Only the value of Cgl at mu=1 (the last element of mu), needed
+ * for sigma2, is computed beforehand.
  *
- * Wigner d-functions, computed by recurrence
+ * @param ppr    Input: pointer to precision structure
+ * @param ple    Input/output: pointer to the lensing structure
+ * @param mu     Input: values of mu (the last one being 1)
+ * @param w8     Input: quadrature weights (w8[index_mu], for index_mu<num_mu-1)
+ * @param num_mu Input: number of values of mu
+ * @param cl_tt  Input: unlensed \f$ cl_{tt}\f$
+ * @param cl_te  Input: unlensed \f$ cl_{te}\f$ (if needed)
+ * @param cl_ee  Input: unlensed \f$ cl_{ee}\f$ (if needed)
+ * @param cl_bb  Input: unlensed \f$ cl_{bb}\f$ (if needed)
+ * @param cl_pp  Input: lensing potential \f$ cl_{\phi\phi}\f$
+ * @return the error status
+ */
+
+int lensing_lensed_cl_fused(
+                            struct precision * ppr,
+                            struct lensing * ple,
+                            double * mu,
+                            double * w8,
+                            int num_mu,
+                            double * cl_tt,
+                            double * cl_te,
+                            double * cl_ee,
+                            double * cl_bb,
+                            double * cl_pp
+                            ) {
+
+  int lmax = ple->l_unlensed_max;
+  double * coef;
+  double * sqrt_l;  /* sqrt_l[(index_sqrt-1)*(lmax+1)+l]: the factors sqrt1[l] to sqrt5[l] of lensing_init() */
+  double * dxx;     /* dxx[(index_d*_LENSING_MU_GROUP_+index_mu)*(lmax+1)+l], for a group of values of mu, private to each thread */
+  double * d_group[wigner_d_size][_LENSING_MU_GROUP_];
+  double * d[wigner_d_size];
+  double * cl_thread; /* cl_thread[(thread*ple->l_size+index_l)*4+index]: private quadratures of ksi, ksiX, ksi+, ksi- */
+  double Cgl_1;
+  double ll,res;
+  short needed[wigner_d_size];
+  int index_mu,index_mu_min,index_group,nmu,index_l,l,index,index_d;
+  int number_of_threads = 1;
+  int thread = 0;
+  int abort;
+
+  /** - which d-functions are needed */
+
+  for (index_d=0; index_d<wigner_d_size; index_d++)
+    needed[index_d] = _FALSE_;
+  needed[wigner_d00] = _TRUE_;
+  needed[wigner_d11] = _TRUE_;
+  needed[wigner_d1m1] = _TRUE_;
+  needed[wigner_d2m2] = _TRUE_;
+  if (ple->has_te==_TRUE_) {
+    needed[wigner_d20] = _TRUE_;
+    needed[wigner_d3m1] = _TRUE_;
+    needed[wigner_d4m2] = _TRUE_;
+  }
+  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+    needed[wigner_d22] = _TRUE_;
+    needed[wigner_d31] = _TRUE_;
+    needed[wigner_d3m3] = _TRUE_;
+    needed[wigner_d40] = _TRUE_;
+    needed[wigner_d4m4] = _TRUE_;
+  }
+
+  class_alloc(coef,wigner_d_size*4*(lmax+1)*sizeof(double),ple->error_message);
+  class_call(lensing_d_coefficients(lmax,coef),
+             ple->error_message,
+             ple->error_message);
+
+  class_alloc(sqrt_l,5*(lmax+1)*sizeof(double),ple->error_message);
+
+  for (l=2;l<=lmax;l++) {
+    ll = (double)l;
+    sqrt_l[l]=sqrt((ll+2)*(ll+1)*ll*(ll-1));
+    sqrt_l[(lmax+1)+l]=sqrt((ll+2)*(ll-1));
+    sqrt_l[2*(lmax+1)+l]=sqrt((ll+3)*(ll-2));
+    sqrt_l[3*(lmax+1)+l]=sqrt((ll+4)*(ll+3)*(ll-2.)*(ll-3));
+    sqrt_l[4*(lmax+1)+l]=sqrt(ll*(ll+1));
+  }
+
+  /** - Cgl at mu=1, needed by sigma2 at all other values of mu */
+
+  class_alloc(dxx,(lmax+1)*sizeof(double),ple->error_message);
+  class_call(lensing_d_at_mu(mu+num_mu-1,1,wigner_d11,lmax,coef,&dxx),
+             ple->error_message,
+             ple->error_message);
+  Cgl_1 = 0.;
+  for (l=2; l<=lmax; l++) {
+    Cgl_1 += (2.*l+1.)*l*(l+1.)*cl_pp[l]*dxx[l];
+  }
+  Cgl_1 /= 4.*_PI_;
+  free(dxx);
+
+#ifdef _OPENMP
+#pragma omp parallel
+  {
+    number_of_threads = omp_get_num_threads();
+  }
+#endif
+
+  class_calloc(cl_thread,number_of_threads*ple->l_size*4,sizeof(double),ple->error_message);
+
+  abort = _FALSE_;
+
+  /** - single parallel region over groups of values of mu (the last
+      value, mu=1, only enters sigma2) */
+
+#pragma omp parallel                                                    \
+  shared(ppr,ple,mu,w8,num_mu,lmax,coef,sqrt_l,cl_tt,cl_te,cl_ee,cl_bb, \
+         cl_pp,cl_thread,Cgl_1,needed,abort)                            \
+  private(thread,dxx,d_group,d,index_group,index_mu_min,nmu,index_mu,   \
+          index_d)                                                      \
+  num_threads(number_of_threads)
+  {
+    thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+
+    class_alloc_parallel(dxx,_LENSING_MU_GROUP_*wigner_d_size*(lmax+1)*sizeof(double),ple->error_message);
+
+    for (index_d=0; index_d<wigner_d_size; index_d++) {
+      for (index_mu=0; index_mu<_LENSING_MU_GROUP_; index_mu++) {
+        d_group[index_d][index_mu] = dxx + (index_d*_LENSING_MU_GROUP_+index_mu)*(lmax+1);
+      }
+    }
+
+#pragma omp for schedule (static)
+    for (index_group=0; index_group<(num_mu-1+_LENSING_MU_GROUP_-1)/_LENSING_MU_GROUP_; index_group++) {
+
+      if (abort == _TRUE_) continue;
+
+      class_trace_begin();
+
+      index_mu_min = index_group*_LENSING_MU_GROUP_;
+      nmu = MIN(_LENSING_MU_GROUP_,num_mu-1-index_mu_min);
+
+      /** - --> all the d-functions for this group of mu */
+
+      class_counters_begin(counter_lensing_d);
+      for (index_d=0; index_d<wigner_d_size; index_d++) {
+        if (needed[index_d] == _TRUE_)
+          lensing_d_at_mu(mu+index_mu_min,nmu,index_d,lmax,coef,d_group[index_d]);
+      }
+      class_counters_end(counter_lensing_d);
+
+      for (index_mu=index_mu_min; index_mu<index_mu_min+nmu; index_mu++) {
+
+        for (index_d=0; index_d<wigner_d_size; index_d++)
+          d[index_d] = d_group[index_d][index_mu-index_mu_min];
+
+        class_call_parallel(lensing_lensed_cl_fused_at_mu(ppr,ple,d,sqrt_l,cl_tt,cl_te,cl_ee,cl_bb,cl_pp,Cgl_1,w8[index_mu],
+                                                          cl_thread+thread*ple->l_size*4),
+                            ple->error_message,
+                            ple->error_message);
+      }
+
+      class_trace_end("lensing","index_mu",index_mu_min);
+    }
+
+    free(dxx);
+  }
+
+  if (abort == _TRUE_)
+    return _FAILURE_;
+
+  /** - sum the quadratures of all threads, in a fixed order */
+
+  for (index_l=0; index_l<ple->l_size; index_l++) {
+    for (index=0; index<4; index++) {
+      res = 0.;
+      for (thread=0; thread<number_of_threads; thread++) {
+        res += cl_thread[(thread*ple->l_size+index_l)*4+index];
+      }
+      if ((index == 0) && (ple->has_tt==_TRUE_))
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt] = res;
+      if ((index == 1) && (ple->has_te==_TRUE_))
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te] = res;
+      if ((index == 2) && (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_))
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee] = res;
+      if ((index == 3) && (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_))
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb] = res;
+    }
+  }
+
+  free(cl_thread);
+  free(sqrt_l);
+  free(coef);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine is the part of the fused kernel of
+ * lensing_lensed_cl_fused() done at each value of mu: from the
+ * Wigner d-functions at this mu, it computes Cgl, Cgl2, sigma2 and the
+ * lensed correlation functions (as in lensing_init()), and adds their
+ * contribution to the quadratures giving the lensed \f$ C_l\f$'s.
+ *
+ * @param ppr     Input: pointer to precision structure
+ * @param ple     Input: pointer to the lensing structure
+ * @param d       Input: d[index_d][l], the needed Wigner d-functions at this mu
+ * @param sqrt_l  Input: factors sqrt1[l] to sqrt5[l] of lensing_init(), sqrt_l[(index_sqrt-1)*(lmax+1)+l]
+ * @param cl_tt   Input: unlensed \f$ cl_{tt}\f$
+ * @param cl_te   Input: unlensed \f$ cl_{te}\f$ (if needed)
+ * @param cl_ee   Input: unlensed \f$ cl_{ee}\f$ (if needed)
+ * @param cl_bb   Input: unlensed \f$ cl_{bb}\f$ (if needed)
+ * @param cl_pp   Input: lensing potential \f$ cl_{\phi\phi}\f$
+ * @param Cgl_1   Input: Cgl at mu=1
+ * @param w8      Input: quadrature weight of this mu
+ * @param cl_quad Input/output: quadratures of ksi, ksiX, ksi+, ksi-, cl_quad[index_l*4+index]
+ * @return the error status
+ */
+
+int lensing_lensed_cl_fused_at_mu(
+                                  struct precision * ppr,
+                                  struct lensing * ple,
+                                  double ** d,
+                                  double * sqrt_l,
+                                  double * cl_tt,
+                                  double * cl_te,
+                                  double * cl_ee,
+                                  double * cl_bb,
+                                  double * cl_pp,
+                                  double Cgl_1,
+                                  double w8,
+                                  double * cl_quad
+                                  ) {
+
+  int lmax = ple->l_unlensed_max;
+  double * d00 = d[wigner_d00];
+  double * d11 = d[wigner_d11];
+  double * d1m1 = d[wigner_d1m1];
+  double * d2m2 = d[wigner_d2m2];
+  double * d22 = d[wigner_d22];
+  double * d20 = d[wigner_d20];
+  double * d31 = d[wigner_d31];
+  double * d3m1 = d[wigner_d3m1];
+  double * d3m3 = d[wigner_d3m3];
+  double * d40 = d[wigner_d40];
+  double * d4m2 = d[wigner_d4m2];
+  double * d4m4 = d[wigner_d4m4];
+  double * sqrt1 = sqrt_l;
+  double * sqrt2 = sqrt_l + (lmax+1);
+  double * sqrt3 = sqrt_l + 2*(lmax+1);
+  double * sqrt4 = sqrt_l + 3*(lmax+1);
+  double * sqrt5 = sqrt_l + 4*(lmax+1);
+  double Cgl, Cgl2, sigma2;
+  double ksi, ksiX, ksip, ksim;
+  double fac,fac1;
+  double X_000,X_p000,X_220,X_022,X_p022,X_121,X_132,X_242;
+  double res,resX,resp,resm,lens,lensp,lensm;
+  double ll;
+  int has_pol;
+  int index_l,l;
+
+  has_pol = (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_);
+
+  /** - Cgl, Cgl2 and sigma2 */
+
+  Cgl = 0.;
+  Cgl2 = 0.;
+  for (l=2; l<=lmax; l++) {
+    Cgl += (2.*l+1.)*l*(l+1.)*cl_pp[l]*d11[l];
+    Cgl2 += (2.*l+1.)*l*(l+1.)*cl_pp[l]*d1m1[l];
+  }
+  Cgl /= 4.*_PI_;
+  Cgl2 /= 4.*_PI_;
+
+  sigma2 = Cgl_1 - Cgl;
+
+  /** - lensed correlation functions, as in lensing_init() */
+
+  ksi = 0.;
+  ksiX = 0.;
+  ksip = 0.;
+  ksim = 0.;
+
+  for (l=2;l<=lmax;l++) {
+
+    ll = (double)l;
+
+    fac = ll*(ll+1)/4.;
+    fac1 = (2*ll+1)/(4.*_PI_);
+
+    X_000 = exp(-fac*sigma2);
+    X_p000 = -fac*X_000;
+    X_220 = 0.25*sqrt1[l] * X_000;
+    X_242=0.;
+    X_132=0.;
+    X_121=0.;
+    X_p022=0.;
+    X_022=0.;
+
+    if (ple->has_te==_TRUE_ || has_pol == _TRUE_) {
+      X_022 = X_000 * (1+sigma2*(1+0.5*sigma2));
+      X_p022 = -(fac-1.)*X_022;
+      X_242 = 0.25*sqrt4[l] * X_000;
+      if (has_pol == _TRUE_) {
+        X_121 = -0.5*sqrt2[l] * X_000 * (1+2./3.*sigma2);
+        X_132 = -0.5*sqrt3[l] * X_000 * (1+5./3.*sigma2);
+      }
+    }
+
+    if (ple->has_tt==_TRUE_) {
+      res = fac1*cl_tt[l];
+      lens = (X_000*X_000*d00[l] +
+              X_p000*X_p000*d1m1[l]
+              *Cgl2*8./(ll*(ll+1)) +
+              (X_p000*X_p000*d00[l] +
+               X_220*X_220*d2m2[l])
+              *Cgl2*Cgl2);
+      if (ppr->accurate_lensing == _FALSE_) {
+        lens -= d00[l];
+      }
+      res *= lens;
+      ksi += res;
+    }
+
+    if (ple->has_te==_TRUE_) {
+      resX = fac1*cl_te[l];
+      lens = ( X_022*X_000*d20[l] +
+               Cgl2*2.*X_p000/sqrt5[l] *
+               (X_121*d11[l] + X_132*d3m1[l]) +
+               0.5 * Cgl2 * Cgl2 *
+               ( ( 2.*X_p022*X_p000+X_220*X_220 ) *
+                 d20[l] + X_220*X_242*d4m2[l] ) );
+      if (ppr->accurate_lensing == _FALSE_) {
+        lens -= d20[l];
+      }
+      resX *= lens;
+      ksiX += resX;
+    }
+
+    if (has_pol == _TRUE_) {
+      resp = fac1*(cl_ee[l]+cl_bb[l]);
+      resm = fac1*(cl_ee[l]-cl_bb[l]);
+      lensp = ( X_022*X_022*d22[l] +
+                2.*Cgl2*X_132*X_121*d31[l] +
+                Cgl2*Cgl2 *
+                ( X_p022*X_p022*d22[l] +
+                  X_242*X_220*d40[l] ) );
+      lensm = ( X_022*X_022*d2m2[l] +
+                Cgl2 *
+                ( X_121*X_121*d1m1[l] +
+                  X_132*X_132*d3m3[l] ) +
+                0.5 * Cgl2 * Cgl2 *
+                ( 2.*X_p022*X_p022*d2m2[l] +
+                  X_220*X_220*d00[l] +
+                  X_242*X_242*d4m4[l] ) );
+      if (ppr->accurate_lensing == _FALSE_) {
+        lensp -= d22[l];
+        lensm -= d2m2[l];
+      }
+      resp *= lensp;
+      resm *= lensm;
+      ksip += resp;
+      ksim += resm;
+    }
+  }
+
+  /** - contribution of this mu to the quadratures */
+
+  for (index_l=0; index_l<ple->l_size; index_l++) {
+    l = (int)ple->l[index_l];
+    if (ple->has_tt==_TRUE_)
+      cl_quad[index_l*4] += ksi*d00[l]*w8;
+    if (ple->has_te==_TRUE_)
+      cl_quad[index_l*4+1] += ksiX*d20[l]*w8;
+    if (has_pol == _TRUE_) {
+      cl_quad[index_l*4+2] += ksip*d22[l]*w8;
+      cl_quad[index_l*4+3] += ksim*d2m2[l]*w8;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine computes the d00 term
+ *
+ * @param mu     Input: Vector of cos(beta) values
+ * @param num_mu Input: Number of cos(beta) values
+ * @param lmax   Input: maximum multipole
+ * @param d00    Input/output: Result is stored here
+ *
+ * Wigner d-functions, computed by recurrence
  * actual recurrence on \f$ \sqrt{(2l+1)/2} d^l_{mm'} \f$ for stability
  * Formulae from Kostelec & Rockmore 2003
  **/
@@ -1918,3 +2718,1297 @@ int lensing_d4m4(
   free(fac1); free(fac2); free(fac3); free(fac4);
   return _SUCCESS_;
 }
+
+/**
+ * This routine computes, once for all values of mu, the coefficients
+ * of the recurrences giving the Wigner d-functions of
+ * lensing_d00(),..., lensing_d4m4(), for use by lensing_d_at_mu().
+ *
+ * All these recurrences are written as
+ * \f$ D_{l+1} = f_1(l) (\mu + f_2(l)) D_l - f_3(l) D_{l-1} \f$, with
+ * \f$ D_l = \sqrt{(2l+1)/2} d^l_{mm'} \f$ and \f$ d^{l+1}_{mm'} = f_4(l) D_{l+1} \f$.
+ * The coefficients are exactly those of the routines computing each
+ * d-function, so that the results are the same.
+ *
+ * @param lmax   Input: maximum multipole
+ * @param coef   Output: coefficients, coef[(index_d*4+index_f)*(lmax+1)+l], of size wigner_d_size*4*(lmax+1)
+ * @return the error status
+ */
+
+int lensing_d_coefficients(
+                           int lmax,
+                           double * coef
+                           ) {
+  double ll;
+  int index_d, l;
+  double *fac1, *fac2, *fac3, *fac4;
+
+  for (index_d=0; index_d<wigner_d_size; index_d++) {
+
+    fac1 = coef + (index_d*4)*(lmax+1);
+    fac2 = coef + (index_d*4+1)*(lmax+1);
+    fac3 = coef + (index_d*4+2)*(lmax+1);
+    fac4 = coef + (index_d*4+3)*(lmax+1);
+
+    for (l=0; l<=lmax; l++) {
+      fac1[l] = 0.;
+      fac2[l] = 0.;
+      fac3[l] = 0.;
+      fac4[l] = 0.;
+    }
+
+    switch (index_d) {
+
+    case wigner_d00:
+      for (l=1; l<lmax; l++) {
+        ll = (double) l;
+        fac1[l] = sqrt((2*ll+3)/(2*ll+1))*(2*ll+1)/(ll+1);
+        fac3[l] = sqrt((2*ll+3)/(2*ll-1))*ll/(ll+1);
+        fac4[l] = sqrt(2./(2*ll+3));
+      }
+      break;
+
+    case wigner_d11:
+    case wigner_d1m1:
+      for (l=2;l<lmax;l++) {
+        ll = (double) l;
+        fac1[l] = sqrt((2*ll+3)/(2*ll+1))*(ll+1)*(2*ll+1)/(ll*(ll+2));
+        fac2[l] = 1.0/(ll*(ll+1.));
+        fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-1)*(ll+1)/(ll*(ll+2))*(ll+1)/ll;
+        fac4[l] = sqrt(2./(2*ll+3));
+        if (index_d == wigner_d11)
+          fac2[l] = -fac2[l];
+      }
+      break;
+
+    case wigner_d2m2:
+    case wigner_d22:
+      for (l=2;l<lmax;l++) {
+        ll = (double) l;
+        fac1[l] = sqrt((2*ll+3)/(2*ll+1))*(ll+1)*(2*ll+1)/((ll-1)*(ll+3));
+        fac2[l] = 4.0/(ll*(ll+1));
+        fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-2)*(ll+2)/((ll-1)*(ll+3))*(ll+1)/ll;
+        fac4[l] = sqrt(2./(2*ll+3));
+        if (index_d == wigner_d22)
+          fac2[l] = -fac2[l];
+      }
+      break;
+
+    case wigner_d20:
+      for (l=2;l<lmax;l++) {
+        ll = (double) l;
+        fac1[l] = sqrt((2*ll+3)*(2*ll+1)/((ll-1)*(ll+3)));
+        fac3[l] = sqrt((2*ll+3)*(ll-2)*(ll+2)/((2*ll-1)*(ll-1)*(ll+3)));
+        fac4[l] = sqrt(2./(2*ll+3));
+      }
+      break;
+
+    case wigner_d31:
+    case wigner_d3m1:
+      for (l=3;l<lmax;l++) {
+        ll = (double) l;
+        fac1[l] = sqrt((2*ll+3)*(2*ll+1)/((ll-2)*(ll+4)*ll*(ll+2))) * (ll+1);
+        fac2[l] = 3.0/(ll*(ll+1));
+        fac3[l] = sqrt((2*ll+3)/(2*ll-1)*(ll-3)*(ll+3)*(ll-1)*(ll+1)/((ll-2)*(ll+4)*ll*(ll+2)))*(ll+1)/ll;
+        fac4[l] = sqrt(2./(2*ll+3));
+        if (index_d == wigner_d31)
+          fac2[l] = -fac2[l];
+      }
+      break;
+
+    case wigner_d3m3:
+      for (l=3;l<lmax;l++) {
+        ll = (double) l;
+        fac1[l] = sqrt((2*ll+3)*(2*ll+1))*(ll+1)/((ll-2)*(ll+4));
+        fac2[l] = 9.0/(ll*(ll+1));
+        fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-3)*(ll+3)*(l+1)/((ll-2)*(ll+4)*ll);
+        fac4[l] = sqrt(2./(2*ll+3));
+      }
+      break;
+
+    case wigner_d40:
+      for (l=4;l<lmax;l++) {
+        ll = (double) l;
+        fac1[l] = sqrt((2*ll+3)*(2*ll+1)/((ll-3)*(ll+5)));
+        fac3[l] = sqrt((2*ll+3)*(ll-4)*(ll+4)/((2*ll-1)*(ll-3)*(ll+5)));
+        fac4[l] = sqrt(2./(2*ll+3));
+      }
+      break;
+
+    case wigner_d4m2:
+      for (l=4;l<lmax;l++) {
+        ll = (double) l;
+        fac1[l] = sqrt((2*ll+3)*(2*ll+1)/((ll-3)*(ll+5)*(ll-1)*(ll+3))) * (ll+1.);
+        fac2[l] = 8./(ll*(ll+1));
+        fac3[l] = sqrt((2*ll+3)*(ll-4)*(ll+4)*(ll-2)*(ll+2)/((2*ll-1)*(ll-3)*(ll+5)*(ll-1)*(ll+3)))*(ll+1)/ll;
+        fac4[l] = sqrt(2./(2*ll+3));
+      }
+      break;
+
+    case wigner_d4m4:
+      for (l=4;l<lmax;l++) {
+        ll = (double) l;
+        fac1[l] = sqrt((2*ll+3)*(2*ll+1))*(ll+1)/((ll-3)*(ll+5));
+        fac2[l] = 16./(ll*(ll+1));
+        fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-4)*(ll+4)*(ll+1)/((ll-3)*(ll+5)*ll);
+        fac4[l] = sqrt(2./(2*ll+3));
+      }
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine computes one Wigner d-function \f$ d^l_{mm'}(\mu) \f$
+ * for all multipoles at a few values of mu, by the recurrence of the
+ * corresponding routine lensing_d00(),..., lensing_d4m4(), with
+ * coefficients precomputed by lensing_d_coefficients(). The values of
+ * mu are treated together at each step of the recurrence: the
+ * recurrences at different mu being independent, this avoids waiting
+ * for the result of each step before the next one, and allows the
+ * compiler to vectorize the loop over mu.
+ *
+ * @param mu      Input: values of cos(beta)
+ * @param nmu     Input: number of values of mu, at most _LENSING_MU_GROUP_
+ * @param index_d Input: which d-function
+ * @param lmax    Input: maximum multipole
+ * @param coef    Input: coefficients computed by lensing_d_coefficients()
+ * @param d       Output: d[index_mu][l] for 0<=index_mu<nmu and 0<=l<=lmax
+ * @return the error status
+ */
+
+int lensing_d_at_mu(
+                    double * mu,
+                    int nmu,
+                    enum wigner_d index_d,
+                    int lmax,
+                    double * coef,
+                    double ** d
+                    ) {
+  double dlm1[_LENSING_MU_GROUP_], dl[_LENSING_MU_GROUP_], dlp1;
+  double x, * row;
+  int i, l, l_start = 0;
+  double *fac1, *fac2, *fac3, *fac4;
+
+  fac1 = coef + (index_d*4)*(lmax+1);
+  fac2 = coef + (index_d*4+1)*(lmax+1);
+  fac3 = coef + (index_d*4+2)*(lmax+1);
+  fac4 = coef + (index_d*4+3)*(lmax+1);
+
+  /* initial values, d[l_start-1] and d[l_start], and zeros below */
+  for (i=0; i<nmu; i++) {
+    x = mu[i];
+    row = d[i];
+    switch (index_d) {
+    case wigner_d00:
+      l_start = 1;
+      dlm1[i]=1.0/sqrt(2.); /* l=0 */
+      row[0]=dlm1[i]*sqrt(2.);
+      dl[i]=x * sqrt(3./2.); /*l=1*/
+      row[1]=dl[i]*sqrt(2./3.);
+      break;
+    case wigner_d11:
+      l_start = 2;
+      row[0]=0;
+      dlm1[i]=(1.0+x)/2. * sqrt(3./2.); /*l=1*/
+      row[1]=dlm1[i] * sqrt(2./3.);
+      dl[i]=(1.0+x)/2.*(2.0*x-1.0) * sqrt(5./2.); /*l=2*/
+      row[2] = dl[i] * sqrt(2./5.);
+      break;
+    case wigner_d1m1:
+      l_start = 2;
+      row[0]=0;
+      dlm1[i]=(1.0-x)/2. * sqrt(3./2.); /*l=1*/
+      row[1]=dlm1[i] * sqrt(2./3.);
+      dl[i]=(1.0-x)/2.*(2.0*x+1.0) * sqrt(5./2.); /*l=2*/
+      row[2] = dl[i] * sqrt(2./5.);
+      break;
+    case wigner_d2m2:
+    case wigner_d22:
+    case wigner_d20:
+      l_start = 2;
+      row[0]=0;
+      dlm1[i]=0.; /*l=1*/
+      row[1]=0;
+      if (index_d == wigner_d2m2)
+        dl[i]=(1.0-x)*(1.0-x)/4. * sqrt(5./2.); /*l=2*/
+      else if (index_d == wigner_d22)
+        dl[i]=(1.0+x)*(1.0+x)/4. * sqrt(5./2.);
+      else
+        dl[i]=sqrt(15.)/4.*(1-x*x);
+      row[2] = dl[i] * sqrt(2./5.);
+      break;
+    case wigner_d31:
+    case wigner_d3m1:
+    case wigner_d3m3:
+      l_start = 3;
+      row[0]=0;
+      row[1]=0;
+      dlm1[i]=0.; /*l=2*/
+      row[2]=0;
+      if (index_d == wigner_d31)
+        dl[i]=sqrt(105./2.)*(1+x)*(1+x)*(1-x)/8.; /*l=3*/
+      else if (index_d == wigner_d3m1)
+        dl[i]=sqrt(105./2.)*(1+x)*(1-x)*(1-x)/8.;
+      else
+        dl[i]=sqrt(7./2.)*(1-x)*(1-x)*(1-x)/8.;
+      row[3] = dl[i] * sqrt(2./7.);
+      break;
+    case wigner_d40:
+    case wigner_d4m2:
+    case wigner_d4m4:
+    default:
+      l_start = 4;
+      row[0]=0;
+      row[1]=0;
+      row[2]=0;
+      dlm1[i]=0.; /*l=3*/
+      row[3]=0;
+      if (index_d == wigner_d40)
+        dl[i]=sqrt(315.)*(1+x)*(1+x)*(1-x)*(1-x)/16.; /*l=4*/
+      else if (index_d == wigner_d4m2)
+        dl[i]=sqrt(126.)*(1+x)*(1-x)*(1-x)*(1-x)/16.;
+      else
+        dl[i]=sqrt(9./2.)*(1-x)*(1-x)*(1-x)*(1-x)/16.;
+      row[4] = dl[i] * sqrt(2./9.);
+      break;
+    }
+  }
+
+  for (l=l_start; l<lmax; l++) {
+    for (i=0; i<nmu; i++) {
+      dlp1 = fac1[l]*(mu[i]+fac2[l])*dl[i] - fac3[l]*dlm1[i];
+      d[i][l+1] = dlp1 * fac4[l];
+      dlm1[i] = dl[i];
+      dl[i] = dlp1;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Table of Gauss-Legendre nodes, weights and Wigner d-functions kept
+ * in memory by lensing_d_cache_store(), in the single block format of
+ * lensing_d_cache_block_size(), and number of runs using it at the
+ * moment (it is only replaced when this number is zero).
+ */
+
+static void * lensing_d_cache_block = NULL;
+static size_t lensing_d_cache_block_size_in_memory = 0;
+static short lensing_d_cache_block_is_mapped = _FALSE_;
+static int lensing_d_cache_users = 0;
+
+/**
+ * Fill the header describing the tables of the lensing module for a
+ * given l_unlensed_max and number of values of mu, including a key
+ * (FNV-1a hash of all the other fields) naming the file of the cache.
+ *
+ * @param ppr            Input: pointer to precision structure
+ * @param l_unlensed_max Input: maximum multipole of the d-functions
+ * @param num_mu         Input: number of values of mu, including mu=1
+ * @param header         Output: header
+ * @return the error status
+ */
+
+int lensing_d_cache_header(
+                           struct precision * ppr,
+                           int l_unlensed_max,
+                           int num_mu,
+                           struct lensing_d_cache_header * header
+                           ) {
+
+  const unsigned char * byte;
+  size_t index;
+  unsigned long long key = 14695981039346656037ULL;
+
+  memset(header,0,sizeof(struct lensing_d_cache_header));
+  memcpy(header->magic,"CLASSLWD",8);
+  header->version = _LENSING_D_CACHE_VERSION_;
+  header->l_unlensed_max = l_unlensed_max;
+  header->num_mu = num_mu;
+  header->accurate_lensing = ppr->accurate_lensing;
+  /* the tolerance only enters the Gauss-Legendre nodes of the accurate mode */
+  if (ppr->accurate_lensing == _TRUE_)
+    header->tol_gauss_legendre = ppr->tol_gauss_legendre;
+
+  byte = (const unsigned char *) &(header->version);
+  for (index = 0; index < sizeof(struct lensing_d_cache_header)-(size_t)((char*)&(header->version)-(char*)header); index++) {
+    key ^= byte[index];
+    key *= 1099511628211ULL;
+  }
+  header->key = key;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Check that a stored block contains the tables described by header.
+ * All the fields are compared, not only the key, so that a hash
+ * collision or a corrupted file can never give wrong tables.
+ *
+ * @return _TRUE_ if the block matches, _FALSE_ otherwise
+ */
+
+int lensing_d_cache_match(
+                          struct lensing_d_cache_header * header,
+                          void * block,
+                          size_t block_size
+                          ) {
+
+  struct lensing_d_cache_header * stored = (struct lensing_d_cache_header *) block;
+
+  if (block_size < sizeof(struct lensing_d_cache_header))
+    return _FALSE_;
+  if ((memcmp(stored->magic,header->magic,8) != 0) ||
+      (stored->key != header->key) ||
+      (stored->version != header->version) ||
+      (stored->l_unlensed_max != header->l_unlensed_max) ||
+      (stored->num_mu != header->num_mu) ||
+      (stored->accurate_lensing != header->accurate_lensing) ||
+      (stored->tol_gauss_legendre != header->tol_gauss_legendre))
+    return _FALSE_;
+  if (block_size != lensing_d_cache_block_size(header->l_unlensed_max,header->num_mu))
+    return _FALSE_;
+
+  return _TRUE_;
+}
+
+/**
+ * Size in bytes of the tables in the single block format: the header,
+ * mu, w8 (padded to num_mu values) and the wigner_d_size tables of
+ * d-functions, in the order of enum wigner_d.
+ */
+
+size_t lensing_d_cache_block_size(
+                                  int l_unlensed_max,
+                                  int num_mu
+                                  ) {
+
+  size_t header_size = (sizeof(struct lensing_d_cache_header)+_LENSING_D_CACHE_ALIGNMENT_-1)/_LENSING_D_CACHE_ALIGNMENT_*_LENSING_D_CACHE_ALIGNMENT_;
+
+  return header_size + sizeof(double)*(2*(size_t)num_mu+(size_t)wigner_d_size*(size_t)num_mu*(size_t)(l_unlensed_max+1));
+}
+
+/**
+ * Set all the fields of table from a block in the single block format.
+ * The arrays point inside the block.
+ */
+
+int lensing_d_table_from_block(
+                               void * block,
+                               size_t block_size,
+                               int block_is_mapped,
+                               struct lensing_d_table * table
+                               ) {
+
+  struct lensing_d_cache_header * header = (struct lensing_d_cache_header *) block;
+  size_t d_size = (size_t)header->num_mu*(size_t)(header->l_unlensed_max+1);
+  int index_d;
+
+  table->block = block;
+  table->block_size = block_size;
+  table->block_is_mapped = block_is_mapped;
+  table->block_is_cached = _FALSE_;
+  table->mu = (double *) ((char *) block + lensing_d_cache_block_size(0,0));
+  table->w8 = table->mu + header->num_mu;
+  for (index_d=0; index_d<wigner_d_size; index_d++)
+    table->d[index_d] = table->w8 + header->num_mu + index_d*d_size;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Make table the one kept in memory, unless the current one is being
+ * used by another run: table->block_is_cached tells which case occurred.
+ */
+
+static void lensing_d_cache_keep(
+                                 struct lensing_d_table * table
+                                 ) {
+
+#pragma omp critical (lensing_d_cache)
+  {
+    if (lensing_d_cache_users == 0) {
+      if (lensing_d_cache_block_is_mapped == _TRUE_)
+        munmap(lensing_d_cache_block,lensing_d_cache_block_size_in_memory);
+      else
+        free(lensing_d_cache_block);
+      lensing_d_cache_block = table->block;
+      lensing_d_cache_block_size_in_memory = table->block_size;
+      lensing_d_cache_block_is_mapped = table->block_is_mapped;
+      lensing_d_cache_users = 1;
+      table->block_is_cached = _TRUE_;
+    }
+  }
+}
+
+/**
+ * Look for the tables described by header, first in memory and then,
+ * if ppr->lensing_d_cache_use_file is _TRUE_, in the file
+ * lensing_d_cache_directory/lwd_<key>.dat, memory-mapped read-only if
+ * it matches. Any problem with the file (missing, truncated, written
+ * by another version) is not an error: the tables are then simply not
+ * found, and should be computed and given to lensing_d_cache_store().
+ *
+ * @param ppr    Input: pointer to precision structure
+ * @param header Input: header filled by lensing_d_cache_header()
+ * @param table  Output: tables, if found
+ * @param found  Output: _TRUE_ if table was filled
+ * @return the error status
+ */
+
+int lensing_d_cache_fetch(
+                          struct precision * ppr,
+                          struct lensing_d_cache_header * header,
+                          struct lensing_d_table * table,
+                          int * found
+                          ) {
+
+  FileName filename;
+  FILE * file;
+  struct stat file_stat;
+  void * block;
+
+  *found = _FALSE_;
+
+  if (ppr->lensing_d_cache == _TRUE_) {
+#pragma omp critical (lensing_d_cache)
+    {
+      if ((lensing_d_cache_block != NULL) &&
+          (lensing_d_cache_match(header,lensing_d_cache_block,lensing_d_cache_block_size_in_memory) == _TRUE_)) {
+        lensing_d_table_from_block(lensing_d_cache_block,lensing_d_cache_block_size_in_memory,lensing_d_cache_block_is_mapped,table);
+        table->block_is_cached = _TRUE_;
+        lensing_d_cache_users++;
+        *found = _TRUE_;
+      }
+    }
+    if (*found == _TRUE_)
+      return _SUCCESS_;
+  }
+
+  if (ppr->lensing_d_cache_use_file == _FALSE_)
+    return _SUCCESS_;
+
+  snprintf(filename,sizeof(FileName),"%s/lwd_%016llx.dat",ppr->lensing_d_cache_directory,header->key);
+
+  /* (the stdio functions are used to open the file, since open is one of the values of enum spatial_curvature) */
+  file = fopen(filename,"r");
+  if (file == NULL)
+    return _SUCCESS_;
+
+  if ((fstat(fileno(file),&file_stat) != 0) || (file_stat.st_size < (off_t)sizeof(struct lensing_d_cache_header))) {
+    fclose(file);
+    return _SUCCESS_;
+  }
+
+  block = mmap(NULL,file_stat.st_size,PROT_READ,MAP_SHARED,fileno(file),0);
+  fclose(file);
+  if (block == MAP_FAILED)
+    return _SUCCESS_;
+
+  if (lensing_d_cache_match(header,block,file_stat.st_size) == _FALSE_) {
+    munmap(block,file_stat.st_size);
+    return _SUCCESS_;
+  }
+
+  lensing_d_table_from_block(block,file_stat.st_size,_TRUE_,table);
+  *found = _TRUE_;
+
+  /* keep the mapped file in memory for the next runs */
+  if (ppr->lensing_d_cache == _TRUE_)
+    lensing_d_cache_keep(table);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute the Wigner d-functions of all the types of enum wigner_d at
+ * the nodes mu, and store them with mu and w8 in a new table, kept in
+ * memory if ppr->lensing_d_cache is _TRUE_ and written to the file
+ * lensing_d_cache_directory/lwd_<key>.dat if
+ * ppr->lensing_d_cache_use_file is _TRUE_. The file is first written
+ * under a unique temporary name and then renamed, so that other
+ * processes never read incomplete tables; failing to write it is not
+ * an error.
+ *
+ * @param ppr           Input: pointer to precision structure
+ * @param header        Input: header filled by lensing_d_cache_header()
+ * @param mu            Input: values of mu, the last one being 1
+ * @param w8            Input: quadrature weights of the num_mu-1 first values
+ * @param table         Output: new tables
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int lensing_d_cache_store(
+                          struct precision * ppr,
+                          struct lensing_d_cache_header * header,
+                          double * mu,
+                          double * w8,
+                          struct lensing_d_table * table,
+                          ErrorMsg error_message
+                          ) {
+
+  int (*lensing_d[wigner_d_size])(double *, int, int, double **) =
+    {lensing_d00,lensing_d11,lensing_d1m1,lensing_d2m2,lensing_d22,lensing_d20,
+     lensing_d31,lensing_d3m1,lensing_d3m3,lensing_d40,lensing_d4m2,lensing_d4m4};
+  int num_mu = header->num_mu;
+  int lmax = header->l_unlensed_max;
+  size_t block_size = lensing_d_cache_block_size(lmax,num_mu);
+  void * block;
+  double ** d;
+  int index_d, index_mu;
+  FileName filename, tmpname;
+  int fd;
+  size_t written;
+  ssize_t chunk;
+
+  class_calloc(block,block_size,1,error_message);
+  memcpy(block,header,sizeof(struct lensing_d_cache_header));
+  lensing_d_table_from_block(block,block_size,_FALSE_,table);
+
+  memcpy(table->mu,mu,num_mu*sizeof(double));
+  memcpy(table->w8,w8,(num_mu-1)*sizeof(double));
+
+  class_alloc(d,num_mu*sizeof(double*),error_message);
+  for (index_d=0; index_d<wigner_d_size; index_d++) {
+    for (index_mu=0; index_mu<num_mu; index_mu++)
+      d[index_mu] = table->d[index_d] + (size_t)index_mu*(lmax+1);
+    class_call(lensing_d[index_d](table->mu,num_mu,lmax,d),
+               error_message,
+               error_message);
+  }
+  free(d);
+
+  if (ppr->lensing_d_cache_use_file == _TRUE_) {
+
+    mkdir(ppr->lensing_d_cache_directory,0777);
+
+    snprintf(filename,sizeof(FileName),"%s/lwd_%016llx.dat",ppr->lensing_d_cache_directory,header->key);
+    snprintf(tmpname,sizeof(FileName),"%s/lwd_%016llx.XXXXXX",ppr->lensing_d_cache_directory,header->key);
+
+    fd = mkstemp(tmpname);
+    if (fd >= 0) {
+
+      /* readable by all the runs on the node, like files created with fopen() */
+      fchmod(fd,0644);
+
+      for (written = 0; written < block_size; written += chunk) {
+        chunk = write(fd,(char *) block + written,block_size-written);
+        if (chunk <= 0)
+          break;
+      }
+      close(fd);
+
+      if ((written < block_size) || (rename(tmpname,filename) != 0))
+        unlink(tmpname);
+    }
+  }
+
+  if (ppr->lensing_d_cache == _TRUE_)
+    lensing_d_cache_keep(table);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Release a table given by lensing_d_cache_fetch() or
+ * lensing_d_cache_store(): the table kept in memory stays there, the
+ * others are freed or unmapped.
+ *
+ * @param table Input: table
+ * @return the error status
+ */
+
+int lensing_d_cache_release(
+                            struct lensing_d_table * table
+                            ) {
+
+  if (table->block_is_cached == _TRUE_) {
+#pragma omp critical (lensing_d_cache)
+    {
+      lensing_d_cache_users--;
+    }
+  }
+  else if (table->block_is_mapped == _TRUE_) {
+    munmap(table->block,table->block_size);
+  }
+  else {
+    free(table->block);
+  }
+  table->block = NULL;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the tables kept in memory by lensing_d_cache_store(), unless a
+ * run is using them at the moment.
+ *
+ * @return the error status
+ */
+
+int lensing_d_cache_clear() {
+
+#pragma omp critical (lensing_d_cache)
+  {
+    if (lensing_d_cache_users == 0) {
+      if (lensing_d_cache_block_is_mapped == _TRUE_)
+        munmap(lensing_d_cache_block,lensing_d_cache_block_size_in_memory);
+      else
+        free(lensing_d_cache_block);
+      lensing_d_cache_block = NULL;
+      lensing_d_cache_block_size_in_memory = 0;
+      lensing_d_cache_block_is_mapped = _FALSE_;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Fiducial responses kept in memory by lensing_response_keep(), and
+ * number of runs using them at the moment (they are only replaced when
+ * this number is zero).
+ */
+
+static struct lensing_response * lensing_response_fiducial = NULL;
+static int lensing_response_users = 0;
+
+/**
+ * Compute the responses of the lensed correlation functions around the
+ * unlensed spectra and \f$ C_l^{\phi\phi} \f$ of the current run, at
+ * the end of the exact computation of lensing_spectra() (with all
+ * values of mu in a single block).
+ *
+ * For each mu and l, the terms of the correlation functions computed
+ * in lensing_spectra() are written as fac1 x C_l x lens(sigma2,Cgl2).
+ * The kernels are fac1 x lens, and the derivatives of the correlation
+ * functions with respect to sigma2 and Cgl2 follow from the analytic
+ * derivatives of the functions X_000, X_022, etc. (with the same
+ * truncation in powers of sigma2 and Cgl2 as in lensing_spectra()).
+ * The fiducial lensed spectra are added by lensing_response_keep().
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param ple      Input: pointer to lensing structure
+ * @param num_mu   Input: number of values of mu (the last one being 1)
+ * @param w8       Input: quadrature weights (w8[index_mu], for index_mu<num_mu-1)
+ * @param d        Input: d-functions d[index_d][index_mu][l] of all the types needed by the lensed spectra
+ * @param Cgl2     Input: Cgl2[index_mu]
+ * @param sigma2   Input: sigma2[index_mu]
+ * @param cl_tt    Input: unlensed \f$ cl_{tt}\f$
+ * @param cl_te    Input: unlensed \f$ cl_{te}\f$ (if needed)
+ * @param cl_ee    Input: unlensed \f$ cl_{ee}\f$ (if needed)
+ * @param cl_bb    Input: unlensed \f$ cl_{bb}\f$ (if needed)
+ * @param cl_pp    Input: lensing potential \f$ cl_{\phi\phi}\f$
+ * @param response Output: new responses, to be given to lensing_response_keep()
+ * @return the error status
+ */
+
+int lensing_response_build(
+                           struct precision * ppr,
+                           struct lensing * ple,
+                           int num_mu,
+                           double * w8,
+                           double ** d[wigner_d_size],
+                           double * Cgl2,
+                           double * sigma2,
+                           double * cl_tt,
+                           double * cl_te,
+                           double * cl_ee,
+                           double * cl_bb,
+                           double * cl_pp,
+                           struct lensing_response ** response
+                           ) {
+
+  struct lensing_response * pre;
+  int lmax = ple->l_unlensed_max;
+  size_t d_size = (size_t)num_mu*(size_t)(lmax+1);
+  enum wigner_d stored_d[6] = {wigner_d00,wigner_d11,wigner_d1m1,wigner_d2m2,wigner_d20,wigner_d22};
+  int has_pol = ((ple->has_te == _TRUE_) || (ple->has_ee == _TRUE_) || (ple->has_bb == _TRUE_));
+  int has_ee_bb = ((ple->has_ee == _TRUE_) || (ple->has_bb == _TRUE_));
+  int index_d, index_ksi, index_mu, l;
+  double ll, s, c, fac, fac1, E;
+  double X000, X000_s, Xp000, Xp000_s, X220, X220_s;
+  double X022, X022_s, Xp022, Xp022_s, X242, X242_s;
+  double X121, X121_s, X132, X132_s;
+  double lens, lens_s, lens_c, cl_p, cl_m;
+  double * kernel;
+
+  class_calloc(pre,1,sizeof(struct lensing_response),ple->error_message);
+
+  class_call(lensing_d_cache_header(ppr,lmax,num_mu,&(pre->header)),
+             ple->error_message,
+             ple->error_message);
+  pre->has_tt = ple->has_tt;
+  pre->has_te = ple->has_te;
+  pre->has_ee = ple->has_ee;
+  pre->has_bb = ple->has_bb;
+  pre->lt_size = ple->lt_size;
+  pre->l_size = ple->l_size;
+
+  class_alloc(pre->l,ple->l_size*sizeof(double),ple->error_message);
+  memcpy(pre->l,ple->l,ple->l_size*sizeof(double));
+  class_alloc(pre->w8,(num_mu-1)*sizeof(double),ple->error_message);
+  memcpy(pre->w8,w8,(num_mu-1)*sizeof(double));
+  class_alloc(pre->cl_lens,ple->l_size*ple->lt_size*sizeof(double),ple->error_message);
+
+  /** - copy the d-functions needed for sigma2, Cgl2 and the quadratures */
+  for (index_d=0; index_d<6; index_d++) {
+    if (d[stored_d[index_d]] == NULL)
+      continue;
+    class_alloc(pre->d[stored_d[index_d]],d_size*sizeof(double),ple->error_message);
+    for (index_mu=0; index_mu<num_mu; index_mu++)
+      memcpy(pre->d[stored_d[index_d]]+(size_t)index_mu*(lmax+1),d[stored_d[index_d]][index_mu],(lmax+1)*sizeof(double));
+  }
+
+  /** - copy the fiducial unlensed spectra */
+  class_alloc(pre->cl_tt,(lmax+1)*sizeof(double),ple->error_message);
+  memcpy(pre->cl_tt,cl_tt,(lmax+1)*sizeof(double));
+  class_alloc(pre->cl_pp,(lmax+1)*sizeof(double),ple->error_message);
+  memcpy(pre->cl_pp,cl_pp,(lmax+1)*sizeof(double));
+  if (ple->has_te == _TRUE_) {
+    class_alloc(pre->cl_te,(lmax+1)*sizeof(double),ple->error_message);
+    memcpy(pre->cl_te,cl_te,(lmax+1)*sizeof(double));
+  }
+  if (has_ee_bb == _TRUE_) {
+    class_alloc(pre->cl_ee,(lmax+1)*sizeof(double),ple->error_message);
+    memcpy(pre->cl_ee,cl_ee,(lmax+1)*sizeof(double));
+    class_alloc(pre->cl_bb,(lmax+1)*sizeof(double),ple->error_message);
+    memcpy(pre->cl_bb,cl_bb,(lmax+1)*sizeof(double));
+  }
+
+  /** - allocate the kernels and derivatives of the correlation functions needed */
+  for (index_ksi=0; index_ksi<lensing_ksi_size; index_ksi++) {
+    if (((index_ksi == lensing_ksi_tt) && (ple->has_tt == _FALSE_)) ||
+        ((index_ksi == lensing_ksi_te) && (ple->has_te == _FALSE_)) ||
+        ((index_ksi >= lensing_ksi_p) && (has_ee_bb == _FALSE_)))
+      continue;
+    class_calloc(pre->kernel[index_ksi],d_size,sizeof(double),ple->error_message);
+    class_calloc(pre->dksi_dsigma2[index_ksi],num_mu,sizeof(double),ple->error_message);
+    class_calloc(pre->dksi_dCgl2[index_ksi],num_mu,sizeof(double),ple->error_message);
+  }
+
+  /** - compute them for each mu, except the last value mu=1 */
+
+#pragma omp parallel for                                                \
+  private (index_mu,l,ll,s,c,fac,fac1,E,X000,X000_s,Xp000,Xp000_s,X220,X220_s, \
+           X022,X022_s,Xp022,Xp022_s,X242,X242_s,X121,X121_s,X132,X132_s, \
+           lens,lens_s,lens_c,cl_p,cl_m,kernel)                         \
+  schedule (static)
+
+  for (index_mu=0; index_mu<num_mu-1; index_mu++) {
+
+    s = sigma2[index_mu];
+    c = Cgl2[index_mu];
+
+    for (l=2; l<=lmax; l++) {
+
+      ll = (double)l;
+      fac = ll*(ll+1)/4.;
+      fac1 = (2*ll+1)/(4.*_PI_);
+
+      /* the functions of lensing_spectra() and their derivatives with respect to sigma2 */
+      E = exp(-fac*s);
+      X000 = E;
+      X000_s = -fac*E;
+      Xp000 = -fac*E;
+      Xp000_s = fac*fac*E;
+      X220 = 0.25*sqrt((ll+2)*(ll+1)*ll*(ll-1))*E;
+      X220_s = -fac*X220;
+      X022 = X022_s = Xp022 = Xp022_s = X242 = X242_s = 0.;
+      X121 = X121_s = X132 = X132_s = 0.;
+
+      if (has_pol == _TRUE_) {
+        X022 = E*(1+s*(1+0.5*s));
+        X022_s = -fac*X022 + E*(1+s);
+        Xp022 = -(fac-1.)*X022;
+        Xp022_s = -(fac-1.)*X022_s;
+        X242 = 0.25*sqrt((ll+4)*(ll+3)*(ll-2.)*(ll-3))*E;
+        X242_s = -fac*X242;
+        if (has_ee_bb == _TRUE_) {
+          X121 = -0.5*sqrt((ll+2)*(ll-1))*E*(1+2./3.*s);
+          X121_s = -fac*X121 - 0.5*sqrt((ll+2)*(ll-1))*E*2./3.;
+          X132 = -0.5*sqrt((ll+3)*(ll-2))*E*(1+5./3.*s);
+          X132_s = -fac*X132 - 0.5*sqrt((ll+3)*(ll-2))*E*5./3.;
+        }
+      }
+
+      if (ple->has_tt == _TRUE_) {
+
+        lens = (X000*X000*d[wigner_d00][index_mu][l] +
+                Xp000*Xp000*d[wigner_d1m1][index_mu][l]*c*8./(ll*(ll+1)) +
+                (Xp000*Xp000*d[wigner_d00][index_mu][l] +
+                 X220*X220*d[wigner_d2m2][index_mu][l])*c*c);
+        lens_s = (2.*X000*X000_s*d[wigner_d00][index_mu][l] +
+                  2.*Xp000*Xp000_s*d[wigner_d1m1][index_mu][l]*c*8./(ll*(ll+1)) +
+                  (2.*Xp000*Xp000_s*d[wigner_d00][index_mu][l] +
+                   2.*X220*X220_s*d[wigner_d2m2][index_mu][l])*c*c);
+        lens_c = (Xp000*Xp000*d[wigner_d1m1][index_mu][l]*8./(ll*(ll+1)) +
+                  2.*(Xp000*Xp000*d[wigner_d00][index_mu][l] +
+                      X220*X220*d[wigner_d2m2][index_mu][l])*c);
+        if (ppr->accurate_lensing == _FALSE_)
+          lens -= d[wigner_d00][index_mu][l];
+
+        kernel = pre->kernel[lensing_ksi_tt]+(size_t)index_mu*(lmax+1);
+        kernel[l] = fac1*lens;
+        pre->dksi_dsigma2[lensing_ksi_tt][index_mu] += fac1*cl_tt[l]*lens_s;
+        pre->dksi_dCgl2[lensing_ksi_tt][index_mu] += fac1*cl_tt[l]*lens_c;
+      }
+
+      if (ple->has_te == _TRUE_) {
+
+        lens = (X022*X000*d[wigner_d20][index_mu][l] +
+                c*2.*Xp000/sqrt(ll*(ll+1))*
+                (X121*d[wigner_d11][index_mu][l] + X132*d[wigner_d3m1][index_mu][l]) +
+                0.5*c*c*((2.*Xp022*Xp000+X220*X220)*d[wigner_d20][index_mu][l] +
+                         X220*X242*d[wigner_d4m2][index_mu][l]));
+        lens_s = ((X022_s*X000+X022*X000_s)*d[wigner_d20][index_mu][l] +
+                  c*2./sqrt(ll*(ll+1))*
+                  (Xp000_s*(X121*d[wigner_d11][index_mu][l] + X132*d[wigner_d3m1][index_mu][l]) +
+                   Xp000*(X121_s*d[wigner_d11][index_mu][l] + X132_s*d[wigner_d3m1][index_mu][l])) +
+                  0.5*c*c*((2.*(Xp022_s*Xp000+Xp022*Xp000_s)+2.*X220*X220_s)*d[wigner_d20][index_mu][l] +
+                           (X220_s*X242+X220*X242_s)*d[wigner_d4m2][index_mu][l]));
+        lens_c = (2.*Xp000/sqrt(ll*(ll+1))*
+                  (X121*d[wigner_d11][index_mu][l] + X132*d[wigner_d3m1][index_mu][l]) +
+                  c*((2.*Xp022*Xp000+X220*X220)*d[wigner_d20][index_mu][l] +
+                     X220*X242*d[wigner_d4m2][index_mu][l]));
+        if (ppr->accurate_lensing == _FALSE_)
+          lens -= d[wigner_d20][index_mu][l];
+
+        kernel = pre->kernel[lensing_ksi_te]+(size_t)index_mu*(lmax+1);
+        kernel[l] = fac1*lens;
+        pre->dksi_dsigma2[lensing_ksi_te][index_mu] += fac1*cl_te[l]*lens_s;
+        pre->dksi_dCgl2[lensing_ksi_te][index_mu] += fac1*cl_te[l]*lens_c;
+      }
+
+      if (has_ee_bb == _TRUE_) {
+
+        cl_p = cl_ee[l]+cl_bb[l];
+        cl_m = cl_ee[l]-cl_bb[l];
+
+        lens = (X022*X022*d[wigner_d22][index_mu][l] +
+                2.*c*X132*X121*d[wigner_d31][index_mu][l] +
+                c*c*(Xp022*Xp022*d[wigner_d22][index_mu][l] +
+                     X242*X220*d[wigner_d40][index_mu][l]));
+        lens_s = (2.*X022*X022_s*d[wigner_d22][index_mu][l] +
+                  2.*c*(X132_s*X121+X132*X121_s)*d[wigner_d31][index_mu][l] +
+                  c*c*(2.*Xp022*Xp022_s*d[wigner_d22][index_mu][l] +
+                       (X242_s*X220+X242*X220_s)*d[wigner_d40][index_mu][l]));
+        lens_c = (2.*X132*X121*d[wigner_d31][index_mu][l] +
+                  2.*c*(Xp022*Xp022*d[wigner_d22][index_mu][l] +
+                        X242*X220*d[wigner_d40][index_mu][l]));
+        if (ppr->accurate_lensing == _FALSE_)
+          lens -= d[wigner_d22][index_mu][l];
+
+        kernel = pre->kernel[lensing_ksi_p]+(size_t)index_mu*(lmax+1);
+        kernel[l] = fac1*lens;
+        pre->dksi_dsigma2[lensing_ksi_p][index_mu] += fac1*cl_p*lens_s;
+        pre->dksi_dCgl2[lensing_ksi_p][index_mu] += fac1*cl_p*lens_c;
+
+        lens = (X022*X022*d[wigner_d2m2][index_mu][l] +
+                c*(X121*X121*d[wigner_d1m1][index_mu][l] +
+                   X132*X132*d[wigner_d3m3][index_mu][l]) +
+                0.5*c*c*(2.*Xp022*Xp022*d[wigner_d2m2][index_mu][l] +
+                         X220*X220*d[wigner_d00][index_mu][l] +
+                         X242*X242*d[wigner_d4m4][index_mu][l]));
+        lens_s = (2.*X022*X022_s*d[wigner_d2m2][index_mu][l] +
+                  c*(2.*X121*X121_s*d[wigner_d1m1][index_mu][l] +
+                     2.*X132*X132_s*d[wigner_d3m3][index_mu][l]) +
+                  0.5*c*c*(4.*Xp022*Xp022_s*d[wigner_d2m2][index_mu][l] +
+                           2.*X220*X220_s*d[wigner_d00][index_mu][l] +
+                           2.*X242*X242_s*d[wigner_d4m4][index_mu][l]));
+        lens_c = ((X121*X121*d[wigner_d1m1][index_mu][l] +
+                   X132*X132*d[wigner_d3m3][index_mu][l]) +
+                  c*(2.*Xp022*Xp022*d[wigner_d2m2][index_mu][l] +
+                     X220*X220*d[wigner_d00][index_mu][l] +
+                     X242*X242*d[wigner_d4m4][index_mu][l]));
+        if (ppr->accurate_lensing == _FALSE_)
+          lens -= d[wigner_d2m2][index_mu][l];
+
+        kernel = pre->kernel[lensing_ksi_m]+(size_t)index_mu*(lmax+1);
+        kernel[l] = fac1*lens;
+        pre->dksi_dsigma2[lensing_ksi_m][index_mu] += fac1*cl_m*lens_s;
+        pre->dksi_dCgl2[lensing_ksi_m][index_mu] += fac1*cl_m*lens_c;
+      }
+    }
+  }
+
+  *response = pre;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Store the lensed spectra of the current run in response, and make it
+ * the fiducial one kept in memory, unless the current one is being
+ * used by another run (response is then freed).
+ *
+ * @param ple      Input: pointer to lensing structure, with the lensed spectra computed
+ * @param response Input: responses given by lensing_response_build()
+ * @return the error status
+ */
+
+int lensing_response_keep(
+                          struct lensing * ple,
+                          struct lensing_response * response
+                          ) {
+
+  struct lensing_response * old = NULL;
+  int is_kept = _FALSE_;
+
+  memcpy(response->cl_lens,ple->cl_lens,ple->l_size*ple->lt_size*sizeof(double));
+
+#pragma omp critical (lensing_response)
+  {
+    if (lensing_response_users == 0) {
+      old = lensing_response_fiducial;
+      lensing_response_fiducial = response;
+      is_kept = _TRUE_;
+    }
+  }
+
+  if (old != NULL)
+    lensing_response_free(old);
+  if (is_kept == _FALSE_)
+    lensing_response_free(response);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Relens at first order around the fiducial spectra kept in memory, if
+ * they were computed with the same multipoles and values of mu, and if
+ * the unlensed TT, EE and \f$ \phi\phi \f$ spectra of the current run
+ * differ from them by less than ppr->lensing_response_tolerance. The
+ * changes of sigma2 and Cgl2 follow linearly from the change of
+ * \f$ C_l^{\phi\phi} \f$; the correlation functions change through
+ * their derivatives with respect to sigma2 and Cgl2, and through the
+ * kernels applied to the change of the unlensed spectra. Their changes
+ * are integrated over mu like in lensing_spectra(), and added to the
+ * fiducial lensed spectra.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param phr      Input: pointer to harmonic structure
+ * @param ple      Input/Output: pointer to lensing structure, with the table of spectra allocated by lensing_table_unlensed()
+ * @param num_mu   Input: number of values of mu of the exact computation
+ * @param relensed Output: _TRUE_ if the lensed spectra (and their splines) were computed
+ * @return the error status
+ */
+
+int lensing_response_relens(
+                            struct precision * ppr,
+                            struct harmonic * phr,
+                            struct lensing * ple,
+                            int num_mu,
+                            int * relensed
+                            ) {
+
+  struct lensing_d_cache_header header;
+  struct lensing_response * pre = NULL;
+  int lmax = ple->l_unlensed_max;
+  int has_ee_bb = ((ple->has_ee == _TRUE_) || (ple->has_bb == _TRUE_));
+  double * cl_unlensed;
+  double * delta_cl[lensing_ksi_size] = {NULL,NULL,NULL,NULL};
+  double * delta_pp, * delta_ee = NULL, * delta_bb = NULL;
+  double * delta_Cgl, * delta_Cgl2;
+  double * delta_ksi[lensing_ksi_size] = {NULL,NULL,NULL,NULL};
+  double ** d00 = NULL, ** d20 = NULL, ** d22 = NULL, ** d2m2 = NULL;
+  double * kernel;
+  double deviation, resp, resm;
+  int index_ksi, index_mu, index_l, index_lt, l;
+
+  *relensed = _FALSE_;
+
+  class_call(lensing_d_cache_header(ppr,lmax,num_mu,&header),
+             ple->error_message,
+             ple->error_message);
+
+  /** - look for fiducial responses computed with the same multipoles and values of mu */
+
+#pragma omp critical (lensing_response)
+  {
+    if ((lensing_response_fiducial != NULL) &&
+        (memcmp(&(lensing_response_fiducial->header),&header,sizeof(struct lensing_d_cache_header)) == 0) &&
+        (lensing_response_fiducial->has_tt == ple->has_tt) &&
+        (lensing_response_fiducial->has_te == ple->has_te) &&
+        (lensing_response_fiducial->has_ee == ple->has_ee) &&
+        (lensing_response_fiducial->has_bb == ple->has_bb) &&
+        (lensing_response_fiducial->lt_size == ple->lt_size) &&
+        (lensing_response_fiducial->l_size == ple->l_size) &&
+        (memcmp(lensing_response_fiducial->l,ple->l,ple->l_size*sizeof(double)) == 0)) {
+      pre = lensing_response_fiducial;
+      lensing_response_users++;
+    }
+  }
+
+  if (pre == NULL)
+    return _SUCCESS_;
+
+  /** - get the changes of the unlensed spectra, and check that they are within tolerance */
+
+  class_alloc(cl_unlensed,phr->ct_size*(lmax+1)*sizeof(double),ple->error_message);
+  class_call(harmonic_cl_at_l_array(phr,lmax,cl_unlensed),
+             phr->error_message,
+             ple->error_message);
+
+  class_calloc(delta_pp,lmax+1,sizeof(double),ple->error_message);
+  class_calloc(delta_cl[lensing_ksi_tt],lmax+1,sizeof(double),ple->error_message);
+  if (ple->has_te == _TRUE_)
+    class_calloc(delta_cl[lensing_ksi_te],lmax+1,sizeof(double),ple->error_message);
+  if (has_ee_bb == _TRUE_) {
+    class_calloc(delta_cl[lensing_ksi_p],lmax+1,sizeof(double),ple->error_message);
+    class_calloc(delta_cl[lensing_ksi_m],lmax+1,sizeof(double),ple->error_message);
+    class_calloc(delta_ee,lmax+1,sizeof(double),ple->error_message);
+    class_calloc(delta_bb,lmax+1,sizeof(double),ple->error_message);
+  }
+
+  deviation = 0.;
+  for (l=2; l<=lmax; l++) {
+    delta_pp[l] = cl_unlensed[ple->index_lt_pp*(lmax+1)+l]-pre->cl_pp[l];
+    delta_cl[lensing_ksi_tt][l] = cl_unlensed[ple->index_lt_tt*(lmax+1)+l]-pre->cl_tt[l];
+    if (pre->cl_pp[l] != 0.)
+      deviation = MAX(deviation,fabs(delta_pp[l]/pre->cl_pp[l]));
+    if (pre->cl_tt[l] != 0.)
+      deviation = MAX(deviation,fabs(delta_cl[lensing_ksi_tt][l]/pre->cl_tt[l]));
+    if (ple->has_te == _TRUE_)
+      delta_cl[lensing_ksi_te][l] = cl_unlensed[ple->index_lt_te*(lmax+1)+l]-pre->cl_te[l];
+    if (has_ee_bb == _TRUE_) {
+      delta_ee[l] = cl_unlensed[ple->index_lt_ee*(lmax+1)+l]-pre->cl_ee[l];
+      delta_bb[l] = cl_unlensed[ple->index_lt_bb*(lmax+1)+l]-pre->cl_bb[l];
+      delta_cl[lensing_ksi_p][l] = delta_ee[l]+delta_bb[l];
+      delta_cl[lensing_ksi_m][l] = delta_ee[l]-delta_bb[l];
+      if (pre->cl_ee[l] != 0.)
+        deviation = MAX(deviation,fabs(delta_ee[l]/pre->cl_ee[l]));
+    }
+  }
+
+  if (deviation <= ppr->lensing_response_tolerance) {
+
+    if (ple->lensing_verbose > 1)
+      printf(" -> relensed at first order around the fiducial spectra (relative change %e)\n",deviation);
+
+    /** - changes of Cgl and Cgl2 at each mu, giving that of sigma2 */
+
+    class_alloc(delta_Cgl,num_mu*sizeof(double),ple->error_message);
+    class_alloc(delta_Cgl2,num_mu*sizeof(double),ple->error_message);
+
+#pragma omp parallel for private (index_mu,l) schedule (static)
+    for (index_mu=0; index_mu<num_mu; index_mu++) {
+      delta_Cgl[index_mu] = 0.;
+      delta_Cgl2[index_mu] = 0.;
+      for (l=2; l<=lmax; l++) {
+        delta_Cgl[index_mu] += (2.*l+1.)*l*(l+1.)*delta_pp[l]*pre->d[wigner_d11][(size_t)index_mu*(lmax+1)+l];
+        delta_Cgl2[index_mu] += (2.*l+1.)*l*(l+1.)*delta_pp[l]*pre->d[wigner_d1m1][(size_t)index_mu*(lmax+1)+l];
+      }
+      delta_Cgl[index_mu] /= 4.*_PI_;
+      delta_Cgl2[index_mu] /= 4.*_PI_;
+    }
+
+    /** - changes of the correlation functions */
+
+    for (index_ksi=0; index_ksi<lensing_ksi_size; index_ksi++) {
+
+      if (pre->kernel[index_ksi] == NULL)
+        continue;
+
+      class_alloc(delta_ksi[index_ksi],(num_mu-1)*sizeof(double),ple->error_message);
+
+#pragma omp parallel for private (index_mu,l,kernel) schedule (static)
+      for (index_mu=0; index_mu<num_mu-1; index_mu++) {
+        kernel = pre->kernel[index_ksi]+(size_t)index_mu*(lmax+1);
+        delta_ksi[index_ksi][index_mu] =
+          pre->dksi_dsigma2[index_ksi][index_mu]*(delta_Cgl[num_mu-1]-delta_Cgl[index_mu])
+          + pre->dksi_dCgl2[index_ksi][index_mu]*delta_Cgl2[index_mu];
+        for (l=2; l<=lmax; l++)
+          delta_ksi[index_ksi][index_mu] += kernel[l]*delta_cl[index_ksi][l];
+      }
+    }
+
+    /** - integrate them like in lensing_spectra(), and add the fiducial lensed spectra */
+
+    for (index_l=0; index_l<ple->l_size; index_l++) {
+      if (ple->has_tt==_TRUE_)
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt] = 0.;
+      if (ple->has_te==_TRUE_)
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te] = 0.;
+      if (has_ee_bb == _TRUE_) {
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee] = 0.;
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb] = 0.;
+      }
+    }
+
+    class_alloc(d00,num_mu*sizeof(double*),ple->error_message);
+    class_alloc(d2m2,num_mu*sizeof(double*),ple->error_message);
+    if (ple->has_te == _TRUE_)
+      class_alloc(d20,num_mu*sizeof(double*),ple->error_message);
+    if (has_ee_bb == _TRUE_)
+      class_alloc(d22,num_mu*sizeof(double*),ple->error_message);
+    for (index_mu=0; index_mu<num_mu; index_mu++) {
+      d00[index_mu] = pre->d[wigner_d00]+(size_t)index_mu*(lmax+1);
+      d2m2[index_mu] = pre->d[wigner_d2m2]+(size_t)index_mu*(lmax+1);
+      if (ple->has_te == _TRUE_)
+        d20[index_mu] = pre->d[wigner_d20]+(size_t)index_mu*(lmax+1);
+      if (has_ee_bb == _TRUE_)
+        d22[index_mu] = pre->d[wigner_d22]+(size_t)index_mu*(lmax+1);
+    }
+
+    if (ple->has_tt==_TRUE_) {
+      class_call(lensing_lensed_cl_tt(delta_ksi[lensing_ksi_tt],d00,pre->w8,num_mu-1,ple),
+                 ple->error_message,
+                 ple->error_message);
+    }
+    if (ple->has_te==_TRUE_) {
+      class_call(lensing_lensed_cl_te(delta_ksi[lensing_ksi_te],d20,pre->w8,num_mu-1,ple),
+                 ple->error_message,
+                 ple->error_message);
+    }
+    if (has_ee_bb == _TRUE_) {
+      class_call(lensing_lensed_cl_ee_bb(delta_ksi[lensing_ksi_p],delta_ksi[lensing_ksi_m],d22,d2m2,pre->w8,num_mu-1,ple),
+                 ple->error_message,
+                 ple->error_message);
+    }
+
+    for (index_l=0; index_l<ple->l_size; index_l++) {
+      if (ple->has_tt==_TRUE_)
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt] *= 2.0*_PI_;
+      if (ple->has_te==_TRUE_)
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te] *= 2.0*_PI_;
+      if (has_ee_bb == _TRUE_) {
+        resp = ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee];
+        resm = ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb];
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee] = (resp+resm)*_PI_;
+        ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb] = (resp-resm)*_PI_;
+      }
+    }
+
+    if (ppr->accurate_lensing == _FALSE_) {
+      if (ple->has_tt==_TRUE_) {
+        class_call(lensing_addback_cl_tt(ple,delta_cl[lensing_ksi_tt]),
+                   ple->error_message,
+                   ple->error_message);
+      }
+      if (ple->has_te==_TRUE_) {
+        class_call(lensing_addback_cl_te(ple,delta_cl[lensing_ksi_te]),
+                   ple->error_message,
+                   ple->error_message);
+      }
+      if (has_ee_bb == _TRUE_) {
+        class_call(lensing_addback_cl_ee_bb(ple,delta_ee,delta_bb),
+                   ple->error_message,
+                   ple->error_message);
+      }
+    }
+
+    for (index_l=0; index_l<ple->l_size; index_l++) {
+      for (index_lt=0; index_lt<ple->lt_size; index_lt++) {
+        if (((index_lt == ple->index_lt_tt) && (ple->has_tt == _TRUE_)) ||
+            ((index_lt == ple->index_lt_te) && (ple->has_te == _TRUE_)) ||
+            (((index_lt == ple->index_lt_ee) || (index_lt == ple->index_lt_bb)) && (has_ee_bb == _TRUE_)))
+          ple->cl_lens[index_l*ple->lt_size+index_lt] += pre->cl_lens[index_l*ple->lt_size+index_lt];
+      }
+    }
+
+    class_call(array_spline_table_lines(ple->l,
+                                        ple->l_size,
+                                        ple->cl_lens,
+                                        ple->lt_size,
+                                        ple->ddcl_lens,
+                                        _SPLINE_EST_DERIV_,
+                                        ple->error_message),
+               ple->error_message,
+               ple->error_message);
+
+    free(delta_Cgl);
+    free(delta_Cgl2);
+    for (index_ksi=0; index_ksi<lensing_ksi_size; index_ksi++)
+      free(delta_ksi[index_ksi]);
+    free(d00);
+    free(d20);
+    free(d22);
+    free(d2m2);
+
+    *relensed = _TRUE_;
+  }
+  else if (ple->lensing_verbose > 1) {
+    printf(" -> unlensed spectra too far from the fiducial ones (relative change %e): exact computation\n",deviation);
+  }
+
+#pragma omp critical (lensing_response)
+  {
+    lensing_response_users--;
+  }
+
+  free(cl_unlensed);
+  free(delta_pp);
+  free(delta_ee);
+  free(delta_bb);
+  for (index_ksi=0; index_ksi<lensing_ksi_size; index_ksi++)
+    free(delta_cl[index_ksi]);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free responses built by lensing_response_build()
+ *
+ * @param response Input: responses
+ * @return the error status
+ */
+
+int lensing_response_free(
+                          struct lensing_response * response
+                          ) {
+
+  int index_d, index_ksi;
+
+  free(response->l);
+  free(response->w8);
+  for (index_d=0; index_d<wigner_d_size; index_d++)
+    free(response->d[index_d]);
+  free(response->cl_tt);
+  free(response->cl_te);
+  free(response->cl_ee);
+  free(response->cl_bb);
+  free(response->cl_pp);
+  free(response->cl_lens);
+  for (index_ksi=0; index_ksi<lensing_ksi_size; index_ksi++) {
+    free(response->kernel[index_ksi]);
+    free(response->dksi_dsigma2[index_ksi]);
+    free(response->dksi_dCgl2[index_ksi]);
+  }
+  free(response);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the fiducial responses kept in memory by
+ * lensing_response_keep(), unless a run is using them at the moment.
+ *
+ * @return the error status
+ */
+
+int lensing_response_clear() {
+
+  struct lensing_response * old = NULL;
+
+#pragma omp critical (lensing_response)
+  {
+    if (lensing_response_users == 0) {
+      old = lensing_response_fiducial;
+      lensing_response_fiducial = NULL;
+    }
+  }
+
+  if (old != NULL)
+    lensing_response_free(old);
+
+  return _SUCCESS_;
+}
@@ -8,12 +8,15 @@
  *
  * -# output_init() (must be called after harmonic_init())
  * -# output_total_cl_at_l() (can be called even before output_init())
+ * -# output_packed_init() and output_packed_free(), to get the main results in memory instead of files
+ * -# output_derivatives_init(), output_derivatives_write() and output_derivatives_free(), for the derivatives of these results with respect to some parameters
  *
- * No memory needs to be deallocated after that,
+ * No memory needs to be deallocated after output_init(),
  * hence there is no output_free() routine like in other modules.
  */
 
 #include "output.h"
+#include "input.h"
 
 int output_total_cl_at_l(
                          struct harmonic * phr,
@@ -90,6 +93,669 @@ int output_total_cl_at_l(
 
 }
 
+/**
+ * Gather the main results of a run in contiguous arrays: the C_l's
+ * (lensed if lensing was requested, otherwise total unlensed) and the
+ * total matter power spectrum at the redshifts of 'z_pk' (non-linear
+ * if 'non_linear' was set). The structures of the run can be freed
+ * once these arrays have been used, then output_packed_free() must be
+ * called, even if this function failed.
+ *
+ * @param pba  Input: pointer to background structure
+ * @param ppt  Input: pointer to perturbation structure
+ * @param pfo  Input: pointer to fourier structure
+ * @param phr  Input: pointer to harmonic structure
+ * @param ple  Input: pointer to lensing structure
+ * @param pop  Input: pointer to output structure
+ * @param popk Output: results
+ * @return the error status
+ */
+
+int output_packed_init(
+                       struct background * pba,
+                       struct perturbations * ppt,
+                       struct fourier * pfo,
+                       struct harmonic * phr,
+                       struct lensing * ple,
+                       struct output * pop,
+                       struct output_packed * popk
+                       ) {
+
+  int index_cl[_OUTPUT_PACKED_CL_TYPES_];
+  int index_type;
+  int index_z;
+
+  for (index_type=0; index_type<_OUTPUT_PACKED_CL_TYPES_; index_type++) {
+    popk->has_cl[index_type] = _FALSE_;
+    popk->cl[index_type] = NULL;
+  }
+  popk->l_max = 0;
+  popk->cl_table = NULL;
+  popk->k_size = 0;
+  popk->z_size = 0;
+  popk->k = NULL;
+  popk->z = NULL;
+  popk->pk = NULL;
+
+  /** - C_l's, from the lensing or harmonic module */
+
+  if (ppt->has_cls == _TRUE_) {
+
+    if (ple->has_lensed_cls == _TRUE_) {
+      popk->l_max = ple->l_lensed_max;
+      popk->has_cl[0] = ple->has_tt; index_cl[0] = ple->index_lt_tt;
+      popk->has_cl[1] = ple->has_ee; index_cl[1] = ple->index_lt_ee;
+      popk->has_cl[2] = ple->has_te; index_cl[2] = ple->index_lt_te;
+      popk->has_cl[3] = ple->has_bb; index_cl[3] = ple->index_lt_bb;
+      popk->has_cl[4] = ple->has_pp; index_cl[4] = ple->index_lt_pp;
+      popk->has_cl[5] = ple->has_tp; index_cl[5] = ple->index_lt_tp;
+
+      class_alloc(popk->cl_table,ple->lt_size*(popk->l_max+1)*sizeof(double),pop->error_message);
+      class_call(lensing_cl_at_l_array(ple,popk->l_max,popk->cl_table),
+                 ple->error_message,
+                 pop->error_message);
+    }
+    else {
+      popk->l_max = phr->l_max_tot;
+      popk->has_cl[0] = phr->has_tt; index_cl[0] = phr->index_ct_tt;
+      popk->has_cl[1] = phr->has_ee; index_cl[1] = phr->index_ct_ee;
+      popk->has_cl[2] = phr->has_te; index_cl[2] = phr->index_ct_te;
+      popk->has_cl[3] = phr->has_bb; index_cl[3] = phr->index_ct_bb;
+      popk->has_cl[4] = phr->has_pp; index_cl[4] = phr->index_ct_pp;
+      popk->has_cl[5] = phr->has_tp; index_cl[5] = phr->index_ct_tp;
+
+      class_alloc(popk->cl_table,phr->ct_size*(popk->l_max+1)*sizeof(double),pop->error_message);
+      class_call(harmonic_cl_at_l_array(phr,popk->l_max,popk->cl_table),
+                 phr->error_message,
+                 pop->error_message);
+    }
+
+    for (index_type=0; index_type<_OUTPUT_PACKED_CL_TYPES_; index_type++) {
+      if (popk->has_cl[index_type] == _TRUE_)
+        popk->cl[index_type] = popk->cl_table+index_cl[index_type]*(popk->l_max+1);
+    }
+  }
+
+  /** - P(k,z), from the fourier module */
+
+  if (ppt->has_pk_matter == _TRUE_) {
+
+    popk->k_size = pfo->k_size;
+    popk->z_size = pop->z_pk_num;
+    popk->k = pfo->k;
+    popk->z = pop->z_pk;
+
+    class_alloc(popk->pk,popk->z_size*popk->k_size*sizeof(double),pop->error_message);
+
+    for (index_z=0; index_z<popk->z_size; index_z++) {
+      class_call(fourier_pk_at_z(pba,
+                                 pfo,
+                                 linear,
+                                 (pfo->method == nl_none) ? pk_linear : pk_nonlinear,
+                                 popk->z[index_z],
+                                 pfo->index_pk_total,
+                                 popk->pk+index_z*popk->k_size,
+                                 NULL),
+                 pfo->error_message,
+                 pop->error_message);
+    }
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Free the arrays allocated by output_packed_init()
+ *
+ * @param popk Input: results
+ * @return the error status
+ */
+
+int output_packed_free(
+                       struct output_packed * popk
+                       ) {
+
+  free(popk->cl_table);
+  free(popk->pk);
+  popk->cl_table = NULL;
+  popk->pk = NULL;
+
+  return _SUCCESS_;
+
+}
+
+/* initialize one more module of a run if all previous ones succeeded, counting them in 'stage' */
+#define output_run_module(init, error_message) {        \
+    if (status == _SUCCESS_) {                          \
+      if ((init) == _FAILURE_) {                        \
+        strcpy(errmsg,error_message);                   \
+        status = _FAILURE_;                             \
+      }                                                 \
+      else                                              \
+        stage++;                                        \
+    }                                                   \
+  }
+
+/**
+ * Run CLASS with one parameter changed with respect to the input, and
+ * gather its results as in output_packed_init(). The wavenumbers and
+ * redshifts are copied in popk->k and popk->z (allocated here, unlike
+ * in output_packed_init()), since the structures of the run are freed
+ * before returning. On failure, nothing needs to be freed.
+ *
+ * @param pfc_default Input: parameters of the input
+ * @param name        Input: name of the parameter
+ * @param value       Input: its value in this run
+ * @param threads     Input: number of threads of this run if num_threads is not set
+ * @param popk        Output: results
+ * @param errmsg      Output: error message
+ * @return the error status
+ */
+
+static int output_derivatives_run(
+                                  struct file_content * pfc_default,
+                                  char * name,
+                                  double value,
+                                  int threads,
+                                  struct output_packed * popk,
+                                  ErrorMsg errmsg
+                                  ) {
+
+  struct precision pr;
+  struct background ba;
+  struct thermodynamics th;
+  struct perturbations pt;
+  struct primordial pm;
+  struct fourier fo;
+  struct transfer tr;
+  struct harmonic hr;
+  struct lensing le;
+  struct distortions sd;
+  struct output op;
+  struct file_content fc_point;
+  struct file_content fc;
+  int stage = 0;             /* number of modules initialized */
+  int status = _SUCCESS_;
+  int threads_before = 0;
+
+  errmsg[0] = '\0';
+  fc.size = 0;
+  fc.hash_size = 0;
+  popk->cl_table = NULL;
+  popk->pk = NULL;
+  popk->k = NULL;
+  popk->z = NULL;
+
+  /** - read the parameters of the input, with the value of this run */
+
+  if (parser_init(&fc_point,1,"derivatives",errmsg) == _FAILURE_) {
+    status = _FAILURE_;
+  }
+  else {
+    strcpy(fc_point.name[0],name);
+    sprintf(fc_point.value[0],"%.17g",value);
+    fc_point.read[0] = _FALSE_;
+    if (parser_index(&fc_point,errmsg) == _FAILURE_ ||
+        parser_merge(pfc_default,&fc_point,&fc,errmsg) == _FAILURE_ ||
+        input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg) == _FAILURE_) {
+      status = _FAILURE_;
+    }
+    parser_free(&fc_point);
+  }
+  parser_free(&fc);
+
+  /** - run all modules */
+
+  if (status == _SUCCESS_) {
+
+    threads_before = class_threads_set((pr.num_threads > 0) ? pr.num_threads : threads);
+
+    output_run_module(background_init(&pr,&ba),ba.error_message);
+    output_run_module(thermodynamics_init(&pr,&ba,&th),th.error_message);
+    output_run_module(perturbations_init(&pr,&ba,&th,&pt),pt.error_message);
+    output_run_module(primordial_init(&pr,&pt,&pm),pm.error_message);
+    output_run_module(fourier_init(&pr,&ba,&th,&pt,&pm,&fo),fo.error_message);
+    output_run_module(transfer_init(&pr,&ba,&th,&pt,&fo,&tr),tr.error_message);
+    output_run_module(harmonic_init(&pr,&ba,&pt,&pm,&fo,&tr,&hr),hr.error_message);
+    output_run_module(lensing_init(&pr,&pt,&hr,&fo,&le),le.error_message);
+    output_run_module(distortions_init(&pr,&ba,&th,&pt,&pm,&sd),sd.error_message);
+  }
+
+  /** - gather the results, with their own copy of k and z */
+
+  if (status == _SUCCESS_) {
+    if (output_packed_init(&ba,&pt,&fo,&hr,&le,&op,popk) == _FAILURE_) {
+      strcpy(errmsg,op.error_message);
+      status = _FAILURE_;
+    }
+    else if (popk->k_size > 0) {
+      popk->k = (double *)malloc(popk->k_size*sizeof(double));
+      popk->z = (double *)malloc(popk->z_size*sizeof(double));
+      if ((popk->k == NULL) || (popk->z == NULL)) {
+        sprintf(errmsg,"could not allocate the wavenumbers and redshifts of P(k,z)");
+        status = _FAILURE_;
+      }
+      else {
+        memcpy(popk->k,fo.k,popk->k_size*sizeof(double));
+        memcpy(popk->z,op.z_pk,popk->z_size*sizeof(double));
+      }
+    }
+  }
+
+  if (status == _FAILURE_) {
+    output_packed_free(popk);
+    free(popk->k);
+    free(popk->z);
+    popk->k = NULL;
+    popk->z = NULL;
+  }
+
+  /** - free the structures (the caches shared by all runs are kept) */
+
+  if (stage > 8) distortions_free(&sd);
+  if (stage > 7) lensing_free(&le);
+  if (stage > 6) harmonic_free(&hr);
+  if (stage > 5) transfer_free(&tr);
+  if (stage > 4) fourier_free(&fo);
+  if (stage > 3) primordial_free(&pm);
+  if (stage > 2) perturbations_free(&pt);
+  if (stage > 1) thermodynamics_free(&th);
+  if (stage > 0) background_free(&ba);
+
+  if (threads_before > 0)
+    class_threads_set(threads_before);
+
+  return status;
+}
+
+/**
+ * Free the results of the runs of output_derivatives_init()
+ *
+ * @param popk     Input: results of the runs (freed here)
+ * @param run_size Input: number of runs
+ */
+
+static void output_derivatives_free_runs(
+                                         struct output_packed * popk,
+                                         int run_size
+                                         ) {
+
+  int index_run;
+
+  for (index_run=0; index_run<run_size; index_run++) {
+    output_packed_free(popk+index_run);
+    free(popk[index_run].k);
+    free(popk[index_run].z);
+  }
+  free(popk);
+}
+
+/**
+ * Compute the derivatives of the C_l's and P(k,z) of struct
+ * output_packed with respect to some parameters, by central finite
+ * differences, [f(x+h)-f(x-h)]/(2h).
+ *
+ * The fiducial run is done first, with all threads: it fills the
+ * caches that CLASS keeps across runs of the same process
+ * (hyperspherical Bessel functions, ncdm quadratures, HyRec and
+ * injection tables, lensing Wigner functions, the fiducial spectra of
+ * 'lensing_response', ...). The 2*par_size other runs then share them
+ * and are computed 'runs' at a time, each with the available threads
+ * divided by 'runs' unless num_threads is set. The parameters of the
+ * input are parsed once by the caller and only merged with the changed
+ * parameter of each run.
+ *
+ * The wavenumbers of P(k,z) depend on the cosmology: the spectra of
+ * the other runs are interpolated at those of the fiducial run (with
+ * splines of ln P in ln k), restricted to the range covered by all
+ * runs.
+ *
+ * @param pfc      Input: parameters of the input, which must contain the fiducial values of the parameters
+ * @param par_size Input: number of parameters
+ * @param name     Input: their names
+ * @param step     Input: their (positive) steps
+ * @param runs     Input: number of runs computed at the same time (if not positive, as many as the threads, up to 2*par_size)
+ * @param pod      Output: derivatives, to be freed with output_derivatives_free() even if this function failed
+ * @return the error status
+ */
+
+int output_derivatives_init(
+                            struct file_content * pfc,
+                            int par_size,
+                            FileArg * name,
+                            double * step,
+                            int runs,
+                            struct output_derivatives * pod
+                            ) {
+
+  struct output_packed * popk; /* results of the fiducial run, then of the runs at fiducial-step and fiducial+step of each parameter */
+  ErrorMsg errmsg;
+  ErrorMsg run_errmsg;
+  ErrorMsg first_error;
+  int run_size = 2*par_size+1;
+  int index_par, index_run, index_type, index_z, index_k, l;
+  int max_threads = 1;
+  int inner_threads = 1;
+  int levels = 1;
+  int found;
+  int failed = 0;
+  int index_k_min, last_index, size;
+  double k_min, k_max, pk;
+  double * ln_k;
+  double * ln_pk;
+  double * ddln_pk;
+
+  pod->par_size = 0;
+  pod->name = NULL;
+  pod->fiducial = NULL;
+  pod->step = NULL;
+  pod->l_max = 0;
+  pod->cl = NULL;
+  pod->dcl = NULL;
+  pod->k_size = 0;
+  pod->z_size = 0;
+  pod->k = NULL;
+  pod->z = NULL;
+  pod->pk = NULL;
+  pod->dpk = NULL;
+  for (index_type=0; index_type<_OUTPUT_PACKED_CL_TYPES_; index_type++)
+    pod->has_cl[index_type] = _FALSE_;
+
+  class_test(par_size < 1,
+             pod->error_message,
+             "give at least one parameter");
+
+  /** - fiducial values and steps */
+
+  class_alloc(pod->name,par_size*sizeof(FileArg),pod->error_message);
+  class_alloc(pod->fiducial,par_size*sizeof(double),pod->error_message);
+  class_alloc(pod->step,par_size*sizeof(double),pod->error_message);
+  pod->par_size = par_size;
+
+  for (index_par=0; index_par<par_size; index_par++) {
+    strcpy(pod->name[index_par],name[index_par]);
+    class_call(parser_read_double(pfc,name[index_par],&(pod->fiducial[index_par]),&found,errmsg),
+               errmsg,
+               pod->error_message);
+    class_test(found == _FALSE_,
+               pod->error_message,
+               "the fiducial value of '%s' must be given in the input",name[index_par]);
+    class_test(step[index_par] <= 0.,
+               pod->error_message,
+               "the step of '%s' is %g, it should be positive",name[index_par],step[index_par]);
+    pod->step[index_par] = step[index_par];
+  }
+
+  /** - fiducial run first, then all others concurrently */
+
+  class_calloc(popk,run_size,sizeof(struct output_packed),pod->error_message);
+
+#ifdef _OPENMP
+  max_threads = omp_get_max_threads();
+  levels = omp_get_max_active_levels();
+#endif
+  if (runs <= 0)
+    runs = max_threads;
+  runs = MIN(runs,run_size-1);
+  inner_threads = MAX(1,max_threads/runs);
+
+  if (output_derivatives_run(pfc,name[0],pod->fiducial[0],max_threads,popk,run_errmsg) == _FAILURE_) {
+    snprintf(first_error,_ERRORMSGSIZE_,"fiducial run: %s",run_errmsg);
+    failed++;
+  }
+
+  if (failed == 0) {
+
+#ifdef _OPENMP
+    /* the threads of each run are nested in those running the runs */
+    if (runs > 1)
+      omp_set_max_active_levels(MAX(levels,2));
+#endif
+
+#pragma omp parallel for schedule(dynamic,1) num_threads(runs) private(index_par,run_errmsg)
+    for (index_run=1; index_run<run_size; index_run++) {
+      index_par = (index_run-1)/2;
+      if (output_derivatives_run(pfc,
+                                 name[index_par],
+                                 pod->fiducial[index_par]+(((index_run-1)%2 == 0) ? -1. : 1.)*pod->step[index_par],
+                                 inner_threads,
+                                 popk+index_run,
+                                 run_errmsg) == _FAILURE_) {
+#pragma omp critical (output_derivatives_error)
+        {
+          if (failed == 0)
+            snprintf(first_error,_ERRORMSGSIZE_,"run with %s = %g: %s",
+                    name[index_par],
+                    pod->fiducial[index_par]+(((index_run-1)%2 == 0) ? -1. : 1.)*pod->step[index_par],
+                    run_errmsg);
+          failed++;
+        }
+      }
+    }
+
+#ifdef _OPENMP
+    omp_set_max_active_levels(levels);
+#endif
+  }
+
+  if (failed > 0) {
+    output_derivatives_free_runs(popk,run_size);
+    class_test(_TRUE_,
+               pod->error_message,
+               "%s",first_error);
+  }
+
+  /** - central differences of the C_l's */
+
+  if (popk[0].cl_table != NULL) {
+
+    pod->l_max = popk[0].l_max;
+    for (index_type=0; index_type<_OUTPUT_PACKED_CL_TYPES_; index_type++)
+      pod->has_cl[index_type] = popk[0].has_cl[index_type];
+
+    for (index_run=1; index_run<run_size; index_run++) {
+      class_test(popk[index_run].l_max != pod->l_max,
+                 pod->error_message,
+                 "the runs for '%s' have l_max=%d instead of %d",name[(index_run-1)/2],popk[index_run].l_max,pod->l_max);
+    }
+
+    class_calloc(pod->cl,_OUTPUT_PACKED_CL_TYPES_*(pod->l_max+1),sizeof(double),pod->error_message);
+    class_calloc(pod->dcl,par_size*_OUTPUT_PACKED_CL_TYPES_*(pod->l_max+1),sizeof(double),pod->error_message);
+
+    for (index_type=0; index_type<_OUTPUT_PACKED_CL_TYPES_; index_type++) {
+      if (pod->has_cl[index_type] == _FALSE_)
+        continue;
+      for (l=0; l<=pod->l_max; l++)
+        pod->cl[index_type*(pod->l_max+1)+l] = popk[0].cl[index_type][l];
+      for (index_par=0; index_par<par_size; index_par++) {
+        for (l=0; l<=pod->l_max; l++) {
+          pod->dcl[(index_par*_OUTPUT_PACKED_CL_TYPES_+index_type)*(pod->l_max+1)+l] =
+            (popk[2*index_par+2].cl[index_type][l]-popk[2*index_par+1].cl[index_type][l])/(2.*pod->step[index_par]);
+        }
+      }
+    }
+  }
+
+  /** - central differences of P(k,z), at the wavenumbers of the fiducial run within the range of all runs */
+
+  if (popk[0].k_size > 0) {
+
+    k_min = popk[0].k[0];
+    k_max = popk[0].k[popk[0].k_size-1];
+    for (index_run=1; index_run<run_size; index_run++) {
+      k_min = MAX(k_min,popk[index_run].k[0]);
+      k_max = MIN(k_max,popk[index_run].k[popk[index_run].k_size-1]);
+    }
+
+    index_k_min = 0;
+    while ((index_k_min < popk[0].k_size) && (popk[0].k[index_k_min] < k_min))
+      index_k_min++;
+    while ((index_k_min+pod->k_size < popk[0].k_size) && (popk[0].k[index_k_min+pod->k_size] <= k_max))
+      pod->k_size++;
+    pod->z_size = popk[0].z_size;
+
+    class_test(pod->k_size == 0,
+               pod->error_message,
+               "the wavenumbers of the runs have no common range");
+
+    class_alloc(pod->k,pod->k_size*sizeof(double),pod->error_message);
+    class_alloc(pod->z,pod->z_size*sizeof(double),pod->error_message);
+    class_alloc(pod->pk,pod->z_size*pod->k_size*sizeof(double),pod->error_message);
+    class_calloc(pod->dpk,par_size*pod->z_size*pod->k_size,sizeof(double),pod->error_message);
+
+    memcpy(pod->k,popk[0].k+index_k_min,pod->k_size*sizeof(double));
+    memcpy(pod->z,popk[0].z,pod->z_size*sizeof(double));
+    for (index_z=0; index_z<pod->z_size; index_z++)
+      memcpy(pod->pk+index_z*pod->k_size,popk[0].pk+index_z*popk[0].k_size+index_k_min,pod->k_size*sizeof(double));
+
+    for (index_run=1; index_run<run_size; index_run++) {
+
+      index_par = (index_run-1)/2;
+      size = popk[index_run].k_size;
+      class_alloc(ln_k,size*sizeof(double),pod->error_message);
+      class_alloc(ln_pk,size*sizeof(double),pod->error_message);
+      class_alloc(ddln_pk,size*sizeof(double),pod->error_message);
+
+      for (index_k=0; index_k<size; index_k++)
+        ln_k[index_k] = log(popk[index_run].k[index_k]);
+
+      for (index_z=0; index_z<pod->z_size; index_z++) {
+
+        for (index_k=0; index_k<size; index_k++)
+          ln_pk[index_k] = log(popk[index_run].pk[index_z*size+index_k]);
+
+        class_call(array_spline_table_lines(ln_k,size,ln_pk,1,ddln_pk,_SPLINE_EST_DERIV_,pod->error_message),
+                   pod->error_message,
+                   pod->error_message);
+
+        /* the runs at fiducial-step and fiducial+step of each parameter come in this order */
+        last_index = 0;
+        for (index_k=0; index_k<pod->k_size; index_k++) {
+          class_call(array_interpolate_spline(ln_k,size,ln_pk,ddln_pk,1,log(pod->k[index_k]),&last_index,&pk,1,pod->error_message),
+                     pod->error_message,
+                     pod->error_message);
+          pod->dpk[(index_par*pod->z_size+index_z)*pod->k_size+index_k] +=
+            (((index_run-1)%2 == 0) ? -1. : 1.)*exp(pk)/(2.*pod->step[index_par]);
+        }
+      }
+
+      free(ln_k);
+      free(ln_pk);
+      free(ddln_pk);
+    }
+  }
+
+  output_derivatives_free_runs(popk,run_size);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Write the derivatives in a binary file: int par_size, then for each
+ * parameter int length, its name (length characters, without final
+ * null character), double fiducial value and double step; then, as in
+ * a record of class_grid, int has_cl[_OUTPUT_PACKED_CL_TYPES_],
+ * int l_max, the fiducial C_l's for l = 0 to l_max of each available
+ * type, int k_size, int z_size, k, z and the fiducial
+ * P(k,z)[index_z][index_k]; finally, for each parameter, the
+ * derivatives of the same C_l's and P(k,z). All integers are native
+ * 'int' and all reals native 'double'.
+ *
+ * @param pod      Input: derivatives
+ * @param filename Input: name of the file
+ * @return the error status
+ */
+
+int output_derivatives_write(
+                             struct output_derivatives * pod,
+                             char * filename
+                             ) {
+
+  FILE * file;
+  int index_par, index_type, length;
+  size_t count = 0;  /* number of elements to write */
+  size_t written = 0;
+
+  class_open(file,filename,"wb",pod->error_message);
+
+  count++; written += fwrite(&(pod->par_size),sizeof(int),1,file);
+  for (index_par=0; index_par<pod->par_size; index_par++) {
+    length = strlen(pod->name[index_par]);
+    count++; written += fwrite(&length,sizeof(int),1,file);
+    count += length; written += fwrite(pod->name[index_par],1,length,file);
+    count++; written += fwrite(&(pod->fiducial[index_par]),sizeof(double),1,file);
+    count++; written += fwrite(&(pod->step[index_par]),sizeof(double),1,file);
+  }
+
+  count += _OUTPUT_PACKED_CL_TYPES_; written += fwrite(pod->has_cl,sizeof(int),_OUTPUT_PACKED_CL_TYPES_,file);
+  count++; written += fwrite(&(pod->l_max),sizeof(int),1,file);
+  for (index_type=0; index_type<_OUTPUT_PACKED_CL_TYPES_; index_type++) {
+    if (pod->has_cl[index_type] == _TRUE_) {
+      count += pod->l_max+1;
+      written += fwrite(pod->cl+index_type*(pod->l_max+1),sizeof(double),pod->l_max+1,file);
+    }
+  }
+  count++; written += fwrite(&(pod->k_size),sizeof(int),1,file);
+  count++; written += fwrite(&(pod->z_size),sizeof(int),1,file);
+  count += pod->k_size; written += fwrite(pod->k,sizeof(double),pod->k_size,file);
+  count += pod->z_size; written += fwrite(pod->z,sizeof(double),pod->z_size,file);
+  count += pod->z_size*pod->k_size; written += fwrite(pod->pk,sizeof(double),pod->z_size*pod->k_size,file);
+
+  for (index_par=0; index_par<pod->par_size; index_par++) {
+    for (index_type=0; index_type<_OUTPUT_PACKED_CL_TYPES_; index_type++) {
+      if (pod->has_cl[index_type] == _TRUE_) {
+        count += pod->l_max+1;
+        written += fwrite(pod->dcl+(index_par*_OUTPUT_PACKED_CL_TYPES_+index_type)*(pod->l_max+1),sizeof(double),pod->l_max+1,file);
+      }
+    }
+    count += pod->z_size*pod->k_size;
+    written += fwrite(pod->dpk+index_par*pod->z_size*pod->k_size,sizeof(double),pod->z_size*pod->k_size,file);
+  }
+
+  class_test((fclose(file) != 0) || (written != count),
+             pod->error_message,
+             "could not write all derivatives in %s",filename);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Free the arrays allocated by output_derivatives_init()
+ *
+ * @param pod Input: derivatives
+ * @return the error status
+ */
+
+int output_derivatives_free(
+                            struct output_derivatives * pod
+                            ) {
+
+  free(pod->name);
+  free(pod->fiducial);
+  free(pod->step);
+  free(pod->cl);
+  free(pod->dcl);
+  free(pod->k);
+  free(pod->z);
+  free(pod->pk);
+  free(pod->dpk);
+  pod->name = NULL;
+  pod->fiducial = NULL;
+  pod->step = NULL;
+  pod->cl = NULL;
+  pod->dcl = NULL;
+  pod->k = NULL;
+  pod->z = NULL;
+  pod->pk = NULL;
+  pod->dpk = NULL;
+
+  return _SUCCESS_;
+
+}
+
 /**
  * This routine writes the output in files.
  *
@@ -843,7 +1509,8 @@ int output_pk(
 
       for (index_k=0; index_k<pfo->k_size; index_k++) {
 
-        class_call(output_one_line_of_pk(out_pk,
+        class_call(output_one_line_of_pk(pop,
+                                         out_pk,
                                          exp(pfo->ln_k[index_k])/pba->h,
                                          exp(ln_pk[index_k])*pow(pba->h,3)
                                          ),
@@ -856,7 +1523,8 @@ int output_pk(
 
             if (pfo->is_non_zero[index_ic1_ic2] == _TRUE_) {
 
-              class_call(output_one_line_of_pk(out_pk_ic[index_ic1_ic2],
+              class_call(output_one_line_of_pk(pop,
+                                               out_pk_ic[index_ic1_ic2],
                                                exp(pfo->ln_k[index_k])/pba->h,
                                                exp(ln_pk_ic[index_k * pfo->ic_ic_size + index_ic1_ic2])*pow(pba->h,3)),
                          pop->error_message,
@@ -986,7 +1654,9 @@ int output_tk(
       else
         sprintf(file_name,"%s%s%s%s%s",pop->root,redshift_suffix,"tk_",ic_suffix,".dat");
 
-      class_open(tkfile, file_name, "w", pop->error_message);
+      class_call(output_open_file(pop,&tkfile,file_name,pop->error_message),
+                 pop->error_message,
+                 pop->error_message);
 
       if (pop->write_header == _TRUE_) {
         if (pop->output_format == class_format) {
@@ -1019,10 +1689,13 @@ int output_tk(
         }
       }
 
-      output_print_data(tkfile,
-                        titles,
-                        data+index_ic*size_data,
-                        size_data);
+      class_call(output_print_data(pop,
+                                   tkfile,
+                                   titles,
+                                   data+index_ic*size_data,
+                                   size_data),
+                 pop->error_message,
+                 pop->error_message);
 
       /** - free memory and close files */
       fclose(tkfile);
@@ -1062,7 +1735,9 @@ int output_background(
              pop->error_message);
 
   sprintf(file_name,"%s%s",pop->root,"background.dat");
-  class_open(backfile,file_name,"w",pop->error_message);
+  class_call(output_open_file(pop,&backfile,file_name,pop->error_message),
+             pop->error_message,
+             pop->error_message);
 
   if (pop->write_header == _TRUE_) {
     fprintf(backfile,"# Table of selected background quantities\n");
@@ -1076,10 +1751,13 @@ int output_background(
     }
   }
 
-  output_print_data(backfile,
-                    titles,
-                    data,
-                    size_data);
+  class_call(output_print_data(pop,
+                               backfile,
+                               titles,
+                               data,
+                               size_data),
+             pop->error_message,
+             pop->error_message);
 
   free(data);
   fclose(backfile);
@@ -1114,7 +1792,9 @@ int output_thermodynamics(
              pop->error_message);
 
   sprintf(file_name,"%s%s",pop->root,"thermodynamics.dat");
-  class_open(thermofile,file_name,"w",pop->error_message);
+  class_call(output_open_file(pop,&thermofile,file_name,pop->error_message),
+             pop->error_message,
+             pop->error_message);
 
   if (pop->write_header == _TRUE_) {
     fprintf(thermofile,"# Table of selected thermodynamics quantities\n");
@@ -1141,10 +1821,13 @@ int output_thermodynamics(
     }
   }
 
-  output_print_data(thermofile,
-                    titles,
-                    data,
-                    size_data);
+  class_call(output_print_data(pop,
+                               thermofile,
+                               titles,
+                               data,
+                               size_data),
+             pop->error_message,
+             pop->error_message);
 
   free(data);
   fclose(thermofile);
@@ -1171,40 +1854,79 @@ int output_perturbations(
       index_md = ppt->index_md_scalars;
       k = ppt->k[index_md][ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout]];
       sprintf(file_name,"%s%s%d%s",pop->root,"perturbations_k",index_ikout,"_s.dat");
-      class_open(out, file_name, "w", ppt->error_message);
-      fprintf(out,"#scalar perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
-      output_print_data(out,
-                        ppt->scalar_titles,
-                        ppt->scalar_perturbations_data[index_ikout],
-                        ppt->size_scalar_perturbation_data[index_ikout]);
-
-      fclose(out);
+      if (ppt->stream_perturbations == _TRUE_) {
+        class_call(output_streamed_perturbations_titles(pop,file_name,"scalar",k,ppt->scalar_titles),
+                   pop->error_message,
+                   pop->error_message);
+      }
+      else {
+        class_call(output_open_file(pop,&out,file_name,pop->error_message),
+                   pop->error_message,
+                   pop->error_message);
+        if (pop->write_binary == _FALSE_)
+          fprintf(out,"#scalar perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
+        class_call(output_print_data(pop,
+                                     out,
+                                     ppt->scalar_titles,
+                                     ppt->scalar_perturbations_data[index_ikout],
+                                     ppt->size_scalar_perturbation_data[index_ikout]),
+                   pop->error_message,
+                   pop->error_message);
+
+        fclose(out);
+      }
     }
     if (ppt->has_vectors == _TRUE_){
       index_md = ppt->index_md_vectors;
       k = ppt->k[index_md][ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout]];
       sprintf(file_name,"%s%s%d%s",pop->root,"perturbations_k",index_ikout,"_v.dat");
-      class_open(out, file_name, "w", ppt->error_message);
-      fprintf(out,"#vector perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
-      output_print_data(out,
-                        ppt->vector_titles,
-                        ppt->vector_perturbations_data[index_ikout],
-                        ppt->size_vector_perturbation_data[index_ikout]);
-
-      fclose(out);
+      if (ppt->stream_perturbations == _TRUE_) {
+        class_call(output_streamed_perturbations_titles(pop,file_name,"vector",k,ppt->vector_titles),
+                   pop->error_message,
+                   pop->error_message);
+      }
+      else {
+        class_call(output_open_file(pop,&out,file_name,pop->error_message),
+                   pop->error_message,
+                   pop->error_message);
+        if (pop->write_binary == _FALSE_)
+          fprintf(out,"#vector perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
+        class_call(output_print_data(pop,
+                                     out,
+                                     ppt->vector_titles,
+                                     ppt->vector_perturbations_data[index_ikout],
+                                     ppt->size_vector_perturbation_data[index_ikout]),
+                   pop->error_message,
+                   pop->error_message);
+
+        fclose(out);
+      }
     }
     if (ppt->has_tensors == _TRUE_){
       index_md = ppt->index_md_tensors;
       k = ppt->k[index_md][ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout]];
       sprintf(file_name,"%s%s%d%s",pop->root,"perturbations_k",index_ikout,"_t.dat");
-      class_open(out, file_name, "w", ppt->error_message);
-      fprintf(out,"#tensor perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
-      output_print_data(out,
-                        ppt->tensor_titles,
-                        ppt->tensor_perturbations_data[index_ikout],
-                        ppt->size_tensor_perturbation_data[index_ikout]);
-
-      fclose(out);
+      if (ppt->stream_perturbations == _TRUE_) {
+        class_call(output_streamed_perturbations_titles(pop,file_name,"tensor",k,ppt->tensor_titles),
+                   pop->error_message,
+                   pop->error_message);
+      }
+      else {
+        class_call(output_open_file(pop,&out,file_name,pop->error_message),
+                   pop->error_message,
+                   pop->error_message);
+        if (pop->write_binary == _FALSE_)
+          fprintf(out,"#tensor perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
+        class_call(output_print_data(pop,
+                                     out,
+                                     ppt->tensor_titles,
+                                     ppt->tensor_perturbations_data[index_ikout],
+                                     ppt->size_tensor_perturbation_data[index_ikout]),
+                   pop->error_message,
+                   pop->error_message);
+
+        fclose(out);
+      }
     }
 
 
@@ -1239,15 +1961,20 @@ int output_primordial(
              ppm->error_message,
              pop->error_message);
 
-  class_open(out,file_name,"w",pop->error_message);
+  class_call(output_open_file(pop,&out,file_name,pop->error_message),
+             pop->error_message,
+             pop->error_message);
   if (pop->write_header == _TRUE_) {
     fprintf(out,"# Dimensionless primordial spectrum, equal to [k^3/2pi^2] P(k) \n");
   }
 
-  output_print_data(out,
-                    titles,
-                    data,
-                    size_data);
+  class_call(output_print_data(pop,
+                               out,
+                               titles,
+                               data,
+                               size_data),
+             pop->error_message,
+             pop->error_message);
 
   free(data);
   fclose(out);
@@ -1298,9 +2025,8 @@ int output_heating(struct injection* pin, struct noninjection* pni, struct outpu
                pop->error_message);
 
     /* File IO */
-    class_open(out_injection,
-               file_name_injection,
-               "w",
+    class_call(output_open_file(pop,&out_injection,file_name_injection,pop->error_message),
+               pop->error_message,
                pop->error_message);
 
     if(pop->write_header == _TRUE_){
@@ -1308,10 +2034,13 @@ int output_heating(struct injection* pin, struct noninjection* pni, struct outpu
       fprintf(out_injection,"# Heat is dE/dt|dep_h\n");
     }
 
-    output_print_data(out_injection,
-                      titles_injection,
-                      data_injection,
-                      size_data_injection);
+    class_call(output_print_data(pop,
+                                 out_injection,
+                                 titles_injection,
+                                 data_injection,
+                                 size_data_injection),
+               pop->error_message,
+               pop->error_message);
     free(data_injection);
     fclose(out_injection);
 
@@ -1329,7 +2058,7 @@ int output_heating(struct injection* pin, struct noninjection* pni, struct outpu
     number_of_titles_noninjection = get_number_of_titles(titles_noninjection);
 
     /* Data array */
-    size_data_noninjection = number_of_titles_noninjection*pin->z_size;
+    size_data_noninjection = number_of_titles_noninjection*pni->z_size;
     class_alloc(data_noninjection,
                 sizeof(double)*size_data_noninjection,
                 pop->error_message);
@@ -1340,19 +2069,21 @@ int output_heating(struct injection* pin, struct noninjection* pni, struct outpu
                pop->error_message);
 
     /* File IO */
-    class_open(out_noninjection,
-               file_name_noninjection,
-               "w",
+    class_call(output_open_file(pop,&out_noninjection,file_name_noninjection,pop->error_message),
+               pop->error_message,
                pop->error_message);
 
     if(pop->write_header == _TRUE_){
       fprintf(out_noninjection,"# Table of non-injected energy influencing the photon spectral distortions \n");
     }
 
-    output_print_data(out_noninjection,
-                      titles_noninjection,
-                      data_noninjection,
-                      size_data_noninjection);
+    class_call(output_print_data(pop,
+                                 out_noninjection,
+                                 titles_noninjection,
+                                 data_noninjection,
+                                 size_data_noninjection),
+               pop->error_message,
+               pop->error_message);
     free(data_noninjection);
     fclose(out_noninjection);
 
@@ -1400,9 +2131,8 @@ int output_distortions(
                pop->error_message);
 
     /* File IO */
-    class_open(out_heat,
-               file_name_heat,
-               "w",
+    class_call(output_open_file(pop,&out_heat,file_name_heat,pop->error_message),
+               pop->error_message,
                pop->error_message);
 
     if(pop->write_header == _TRUE_){
@@ -1411,10 +2141,13 @@ int output_distortions(
       fprintf(out_heat,"#\n");
     }
 
-    output_print_data(out_heat,
-                      titles_heat,
-                      data_heat,
-                      size_data_heat);
+    class_call(output_print_data(pop,
+                                 out_heat,
+                                 titles_heat,
+                                 data_heat,
+                                 size_data_heat),
+               pop->error_message,
+               pop->error_message);
     free(data_heat);
     fclose(out_heat);
 
@@ -1439,9 +2172,8 @@ int output_distortions(
                pop->error_message);
 
     /* File IO */
-    class_open(out_distortion,
-               file_name_distortion,
-               "w",
+    class_call(output_open_file(pop,&out_distortion,file_name_distortion,pop->error_message),
+               pop->error_message,
                pop->error_message);
 
     if(pop->write_header == _TRUE_){
@@ -1451,10 +2183,13 @@ int output_distortions(
       fprintf(out_distortion,"#\n");
     }
 
-    output_print_data(out_distortion,
-                      titles_distortion,
-                      data_distortion,
-                      size_data_distortion);
+    class_call(output_print_data(pop,
+                                 out_distortion,
+                                 titles_distortion,
+                                 data_distortion,
+                                 size_data_distortion),
+               pop->error_message,
+               pop->error_message);
     free(data_distortion);
     fclose(out_distortion);
   }
@@ -1463,30 +2198,49 @@ int output_distortions(
 }
 
 
-int output_print_data(FILE *out,
+/**
+ * This routine writes a table of data with its column titles, as text
+ * or in the binary NumPy format depending on pop->write_binary.
+ *
+ * @param pop          Input: pointer to output structure
+ * @param out          Input: file pointer, opened by output_open_file()
+ * @param titles       Input: column titles, separated by _DELIMITER_
+ * @param dataptr      Input: data, dataptr[index_row*number_of_titles+index_title]
+ * @param size_dataptr Input: size of dataptr
+ * @return the error status
+ */
+
+int output_print_data(struct output * pop,
+                      FILE *out,
                       char titles[_MAXTITLESTRINGLENGTH_],
                       double *dataptr,
                       int size_dataptr){
-  int colnum=1, number_of_titles;
+  int number_of_titles;
   int index_title, index_tau;
-  char thetitle[_MAXTITLESTRINGLENGTH_];
-  char *pch;
 
   /** Summary*/
 
-  /** - First we print the titles */
-  fprintf(out,"#");
-
-  strcpy(thetitle,titles);
-  pch = strtok(thetitle,_DELIMITER_);
-  while (pch != NULL){
-    class_fprintf_columntitle(out, pch, _TRUE_, colnum);
-    pch = strtok(NULL,_DELIMITER_);
+  /** - In binary mode, a header with the titles and the number of rows, followed by all the data at once */
+  if (pop->write_binary == _TRUE_) {
+    number_of_titles = get_number_of_titles(titles);
+    class_call(output_write_npy_header(out,
+                                       titles,
+                                       (number_of_titles > 0 ? size_dataptr/number_of_titles : 0),
+                                       pop->error_message),
+               pop->error_message,
+               pop->error_message);
+    if (number_of_titles > 0) {
+      class_test(fwrite(dataptr,sizeof(double),size_dataptr,out) != (size_t)size_dataptr,
+                 pop->error_message,
+                 "could not write the data");
+    }
+    return _SUCCESS_;
   }
-  fprintf(out,"\n");
+
+  /** - First we print the titles */
+  number_of_titles = output_print_titles(out,titles);
 
   /** - Then we print the data */
-  number_of_titles = colnum-1;
   if (number_of_titles>0){
     for (index_tau=0; index_tau<size_dataptr/number_of_titles; index_tau++){
       fprintf(out," ");
@@ -1499,6 +2253,242 @@ int output_print_data(FILE *out,
   return _SUCCESS_;
 }
 
+/**
+ * This routine writes the line of numbered column titles of a text
+ * file.
+ *
+ * @param out    Input: file pointer
+ * @param titles Input: column titles, separated by _DELIMITER_
+ * @return the number of titles
+ */
+
+int output_print_titles(
+                        FILE * out,
+                        char titles[_MAXTITLESTRINGLENGTH_]
+                        ) {
+
+  int colnum=1;
+  char thetitle[_MAXTITLESTRINGLENGTH_];
+  char *pch;
+  char *save;
+
+  fprintf(out,"#");
+
+  strcpy(thetitle,titles);
+  pch = strtok_r(thetitle,_DELIMITER_,&save);
+  while (pch != NULL){
+    class_fprintf_columntitle(out, pch, _TRUE_, colnum);
+    pch = strtok_r(NULL,_DELIMITER_,&save);
+  }
+  fprintf(out,"\n");
+
+  return colnum-1;
+}
+
+/**
+ * This routine writes the description of the perturbations for one of
+ * the k_output_values, when the perturbation module has streamed them
+ * to a binary file instead of storing them (stream_perturbations): a
+ * text file with the same name and comment line as usual, the name
+ * and row size of the binary file, and the column titles, but no data.
+ * This file is written as text even with the npy format.
+ *
+ * @param pop       Input: pointer to output structure
+ * @param file_name Input: name of the usual output file, ending with .dat (the binary file ends with .bin)
+ * @param mode_name Input: "scalar", "vector" or "tensor"
+ * @param k         Input: wavenumber in 1/Mpc
+ * @param titles    Input: column titles, separated by _DELIMITER_
+ * @return the error status
+ */
+
+int output_streamed_perturbations_titles(
+                                         struct output * pop,
+                                         FileName file_name,
+                                         char * mode_name,
+                                         double k,
+                                         char titles[_MAXTITLESTRINGLENGTH_]
+                                         ) {
+
+  FILE * out;
+  FileName bin_name;
+
+  strcpy(bin_name,file_name);
+  strcpy(bin_name+strlen(bin_name)-strlen(".dat"),".bin");
+
+  class_open(out,file_name,"w",pop->error_message);
+
+  fprintf(out,"#%s perturbations for mode k = %.*e Mpc^(-1)\n",mode_name,_OUTPUTPRECISION_,k);
+  fprintf(out,"#rows written to %s, as %d doubles each in native byte order\n",bin_name,get_number_of_titles(titles));
+  output_print_titles(out,titles);
+
+  fclose(out);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine opens an output file for writing, in binary mode with
+ * the extension .dat of the file name replaced by .npy if
+ * pop->write_binary is _TRUE_.
+ *
+ * @param pop           Input: pointer to output structure
+ * @param file          Output: returned pointer to file pointer
+ * @param file_name     Input/Output: name of the file (with the extension actually used on output)
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_open_file(
+                     struct output * pop,
+                     FILE * * file,
+                     FileName file_name,
+                     ErrorMsg error_message
+                     ) {
+
+  size_t length = strlen(file_name);
+
+  if (pop->write_binary == _TRUE_) {
+    if ((length >= 4) && (strcmp(file_name+length-4,".dat") == 0))
+      strcpy(file_name+length-4,".npy");
+    class_open(*file,file_name,"wb",error_message);
+  }
+  else {
+    class_open(*file,file_name,"w",error_message);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine writes the header of a file in the NumPy format (.npy)
+ * containing a one-dimensional array of rows, each row being made of
+ * doubles named after the column titles. Such a file can be read (or
+ * memory-mapped) with numpy.load(), and the columns accessed by their
+ * titles. Quotes and backslashes are escaped in the names, and a title
+ * already used by a previous column gets the suffix _<column number>,
+ * since the names of the fields must be distinct.
+ *
+ * @param out           Input: file pointer, opened by output_open_file()
+ * @param titles        Input: column titles, separated by _DELIMITER_
+ * @param rows          Input: number of rows that will follow the header
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_write_npy_header(
+                            FILE * out,
+                            char * titles,
+                            int rows,
+                            ErrorMsg error_message
+                            ) {
+
+  char * copy;
+  char * dict;
+  char ** title;
+  char * pch;
+  char * save;
+  char suffix[16];
+  int number_of_titles, index_title, index_previous;
+  size_t length, header_length, total_length, index_char;
+  unsigned char prefix[12];
+  size_t prefix_length;
+  int one = 1;
+  char endian = (*(char *)&one == 1) ? '<' : '>';
+
+  /** - split the titles */
+  length = strlen(titles);
+  class_alloc(copy,length+1,error_message);
+  strcpy(copy,titles);
+  number_of_titles = get_number_of_titles(titles);
+  class_alloc(title,MAX(number_of_titles,1)*sizeof(char*),error_message);
+  index_title = 0;
+  pch = strtok_r(copy,_DELIMITER_,&save);
+  while ((pch != NULL) && (index_title < number_of_titles)) {
+    title[index_title++] = pch;
+    pch = strtok_r(NULL,_DELIMITER_,&save);
+  }
+  number_of_titles = index_title;
+
+  /** - write the dictionary describing the array (escaped names are at most twice longer) */
+  class_alloc(dict,2*length+(size_t)number_of_titles*32+256,error_message);
+  strcpy(dict,"{'descr': [");
+  for (index_title=0; index_title<number_of_titles; index_title++) {
+    strcat(dict,"('");
+    index_char = strlen(dict);
+    for (pch=title[index_title]; *pch != '\0'; pch++) {
+      if ((*pch == '\'') || (*pch == '\\'))
+        dict[index_char++] = '\\';
+      dict[index_char++] = *pch;
+    }
+    dict[index_char] = '\0';
+    for (index_previous=0; index_previous<index_title; index_previous++) {
+      if (strcmp(title[index_previous],title[index_title]) == 0) {
+        sprintf(suffix,"_%d",index_title+1);
+        strcat(dict,suffix);
+        break;
+      }
+    }
+    sprintf(suffix,"', '%cf8'), ",endian);
+    strcat(dict,suffix);
+  }
+  sprintf(dict+strlen(dict),"], 'fortran_order': False, 'shape': (%d,), }",rows);
+
+  /** - pad the header with spaces and a newline, so that the data starts at a multiple of 64 bytes:
+      version 1.0 of the format stores the length of the header on 2 bytes, version 2.0 on 4 bytes */
+  header_length = strlen(dict)+1;
+  prefix_length = ((header_length+10+63)/64*64-10 <= 65535) ? 10 : 12;
+  total_length = (header_length+prefix_length+63)/64*64;
+  header_length = total_length-prefix_length;
+
+  memcpy(prefix,"\x93NUMPY",6);
+  prefix[6] = (prefix_length == 10) ? 1 : 2;
+  prefix[7] = 0;
+  for (index_char=0; index_char<prefix_length-8; index_char++)
+    prefix[8+index_char] = (unsigned char)((header_length >> (8*index_char)) & 0xff);
+
+  length = strlen(dict);
+  fwrite(prefix,1,prefix_length,out);
+  fwrite(dict,1,length,out);
+  for (index_char=length; index_char<header_length-1; index_char++)
+    fputc(' ',out);
+  fputc('\n',out);
+
+  free(dict);
+  free(title);
+  free(copy);
+
+  class_test(ferror(out),
+             error_message,
+             "could not write the header of a .npy file");
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine writes one value in a row of an output file, as text or
+ * in binary depending on pop->write_binary.
+ *
+ * @param pop       Input: pointer to output structure
+ * @param out       Input: file pointer
+ * @param value     Input: value
+ * @param condition Input: the value is only written if this is _TRUE_
+ */
+
+void output_one_value(
+                      struct output * pop,
+                      FILE * out,
+                      double value,
+                      short condition
+                      ) {
+
+  if (condition == _TRUE_) {
+    if (pop->write_binary == _TRUE_)
+      fwrite(&value,sizeof(double),1,out);
+    else
+      fprintf(out,"%*.*e ",_COLUMNWIDTH_,_OUTPUTPRECISION_,value);
+  }
+}
+
 
 /**
  * This routine opens one file where some \f$ C_l\f$'s will be written, and writes
@@ -1526,12 +2516,95 @@ int output_open_cl_file(
   int index_d1,index_d2;
   int colnum = 1;
   char tmp[60]; //A fixed number here is ok, since it should just correspond to the largest string which is printed to tmp.
+  char * titles;
+  char * pch;
+  char * save;
+
+  class_call(output_open_file(pop,clfile,filename,pop->error_message),
+             pop->error_message,
+             pop->error_message);
 
-  class_open(*clfile,filename,"w",pop->error_message);
+  /** - First we store the column titles, in the order of output_one_line_of_cl() */
 
-  if (pop->write_header == _TRUE_) {
+  class_calloc(titles,(phr->ct_size+1)*sizeof(tmp),sizeof(char),pop->error_message);
+
+  class_store_columntitle(titles,"l",_TRUE_);
+
+  if (pop->output_format == class_format) {
+    class_store_columntitle(titles,"TT",phr->has_tt);
+    class_store_columntitle(titles,"EE",phr->has_ee);
+    class_store_columntitle(titles,"TE",phr->has_te);
+    class_store_columntitle(titles,"BB",phr->has_bb);
+    class_store_columntitle(titles,"phiphi",phr->has_pp);
+    class_store_columntitle(titles,"TPhi",phr->has_tp);
+    class_store_columntitle(titles,"Ephi",phr->has_ep);
+  }
+  else if (pop->output_format == camb_format) {
+    class_store_columntitle(titles,"TT",phr->has_tt);
+    class_store_columntitle(titles,"EE",phr->has_ee);
+    class_store_columntitle(titles,"BB",phr->has_bb);
+    class_store_columntitle(titles,"TE",phr->has_te);
+    class_store_columntitle(titles,"dd",phr->has_pp);
+    class_store_columntitle(titles,"dT",phr->has_tp);
+    class_store_columntitle(titles,"dE",phr->has_ep);
+  }
+
+  /** - The entries that are independent of format type */
+
+  if (phr->has_dd == _TRUE_){
+    for (index_d1=0; index_d1<phr->d_size; index_d1++){
+      for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++){
+        sprintf(tmp,"dens[%d]-dens[%d]",index_d1+1,index_d2+1);
+        class_store_columntitle(titles,tmp,_TRUE_);
+      }
+    }
+  }
+  if (phr->has_td == _TRUE_){
+    for (index_d1=0; index_d1<phr->d_size; index_d1++){
+      sprintf(tmp,"T-dens[%d]",index_d1+1);
+      class_store_columntitle(titles,tmp,_TRUE_);
+    }
+  }
+  if (phr->has_pd == _TRUE_){
+    for (index_d1=0; index_d1<phr->d_size; index_d1++){
+      sprintf(tmp,"phi-dens[%d]",index_d1+1);
+      class_store_columntitle(titles,tmp,_TRUE_);
+    }
+  }
+  if (phr->has_ll == _TRUE_){
+    for (index_d1=0; index_d1<phr->d_size; index_d1++){
+      for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++){
+        sprintf(tmp,"lens[%d]-lens[%d]",index_d1+1,index_d2+1);
+        class_store_columntitle(titles,tmp,_TRUE_);
+      }
+    }
+  }
+  if (phr->has_tl == _TRUE_){
+    for (index_d1=0; index_d1<phr->d_size; index_d1++){
+      sprintf(tmp,"T-lens[%d]",index_d1+1);
+      class_store_columntitle(titles,tmp,_TRUE_);
+    }
+  }
+  if (phr->has_dl == _TRUE_){
+    for (index_d1=0; index_d1<phr->d_size; index_d1++){
+      for (index_d2=MAX(index_d1-phr->non_diag,0); index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
+        sprintf(tmp,"dens[%d]-lens[%d]",index_d1+1,index_d2+1);
+        class_store_columntitle(titles,tmp,_TRUE_);
+      }
+    }
+  }
+
+  /** - In binary mode, the header of the .npy file, with one row per multipole */
+
+  if (pop->write_binary == _TRUE_) {
+    class_call(output_write_npy_header(*clfile,titles,lmax-1,pop->error_message),
+               pop->error_message,
+               pop->error_message);
+  }
 
-    /** - First we deal with the entries that are dependent of format type */
+  else if (pop->write_header == _TRUE_) {
+
+    /** - Otherwise, the text header: first the entries that are dependent of format type */
 
     if (pop->output_format == class_format) {
       fprintf(*clfile,"# dimensionless %s\n",first_line);
@@ -1570,80 +2643,21 @@ int output_open_cl_file(
 
     fprintf(*clfile,"#\n");
 
-    if (0==1){
-      fprintf(*clfile,"#");
-      class_fprintf_columntitle(*clfile,"l",_TRUE_,colnum);
-    }
-    else{
-      fprintf(*clfile,"# 1:l ");
-      colnum++;
-    }
-    if (pop->output_format == class_format) {
-      class_fprintf_columntitle(*clfile,"TT",phr->has_tt,colnum);
-      class_fprintf_columntitle(*clfile,"EE",phr->has_ee,colnum);
-      class_fprintf_columntitle(*clfile,"TE",phr->has_te,colnum);
-      class_fprintf_columntitle(*clfile,"BB",phr->has_bb,colnum);
-      class_fprintf_columntitle(*clfile,"phiphi",phr->has_pp,colnum);
-      class_fprintf_columntitle(*clfile,"TPhi",phr->has_tp,colnum);
-      class_fprintf_columntitle(*clfile,"Ephi",phr->has_ep,colnum);
-    }
-    else if (pop->output_format == camb_format) {
-      class_fprintf_columntitle(*clfile,"TT",phr->has_tt,colnum);
-      class_fprintf_columntitle(*clfile,"EE",phr->has_ee,colnum);
-      class_fprintf_columntitle(*clfile,"BB",phr->has_bb,colnum);
-      class_fprintf_columntitle(*clfile,"TE",phr->has_te,colnum);
-      class_fprintf_columntitle(*clfile,"dd",phr->has_pp,colnum);
-      class_fprintf_columntitle(*clfile,"dT",phr->has_tp,colnum);
-      class_fprintf_columntitle(*clfile,"dE",phr->has_ep,colnum);
-    }
-
-    /** - Next deal with entries that are independent of format type */
+    /** - then the column titles, the first one (l) being narrower */
 
-    if (phr->has_dd == _TRUE_){
-      for (index_d1=0; index_d1<phr->d_size; index_d1++){
-        for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++){
-          sprintf(tmp,"dens[%d]-dens[%d]",index_d1+1,index_d2+1);
-          class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-        }
-      }
-    }
-    if (phr->has_td == _TRUE_){
-      for (index_d1=0; index_d1<phr->d_size; index_d1++){
-        sprintf(tmp,"T-dens[%d]",index_d1+1);
-        class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-      }
-    }
-    if (phr->has_pd == _TRUE_){
-      for (index_d1=0; index_d1<phr->d_size; index_d1++){
-        sprintf(tmp,"phi-dens[%d]",index_d1+1);
-        class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-      }
-    }
-    if (phr->has_ll == _TRUE_){
-      for (index_d1=0; index_d1<phr->d_size; index_d1++){
-        for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++){
-          sprintf(tmp,"lens[%d]-lens[%d]",index_d1+1,index_d2+1);
-          class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-        }
-      }
-    }
-    if (phr->has_tl == _TRUE_){
-      for (index_d1=0; index_d1<phr->d_size; index_d1++){
-        sprintf(tmp,"T-lens[%d]",index_d1+1);
-        class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-      }
-    }
-    if (phr->has_dl == _TRUE_){
-      for (index_d1=0; index_d1<phr->d_size; index_d1++){
-        for (index_d2=MAX(index_d1-phr->non_diag,0); index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
-          sprintf(tmp,"dens[%d]-lens[%d]",index_d1+1,index_d2+1);
-          class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-        }
-      }
+    fprintf(*clfile,"# 1:l ");
+    colnum++;
+    pch = strtok_r(titles,_DELIMITER_,&save);
+    pch = strtok_r(NULL,_DELIMITER_,&save);
+    while (pch != NULL){
+      class_fprintf_columntitle(*clfile,pch,_TRUE_,colnum);
+      pch = strtok_r(NULL,_DELIMITER_,&save);
     }
     fprintf(*clfile,"\n");
   }
 
+  free(titles);
+
   return _SUCCESS_;
 
 }
@@ -1675,31 +2689,29 @@ int output_one_line_of_cl(
 
   factor = l*(l+1)/2./_PI_;
 
-  fprintf(clfile," ");
-
-  if (0==1){
-    class_fprintf_int(clfile, (int)l, _TRUE_);
+  if (pop->write_binary == _TRUE_) {
+    output_one_value(pop,clfile,l,_TRUE_);
   }
-  else{
+  else {
+    fprintf(clfile," ");
     fprintf(clfile,"%4d ",(int)l);
   }
 
   if (pop->output_format == class_format) {
 
     for (index_ct=0; index_ct < ct_size; index_ct++) {
-      class_fprintf_double(clfile, factor*cl[index_ct], _TRUE_);
+      output_one_value(pop,clfile,factor*cl[index_ct],_TRUE_);
     }
-    fprintf(clfile,"\n");
   }
 
   if (pop->output_format == camb_format) {
-    class_fprintf_double(clfile, factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_tt], phr->has_tt);
-    class_fprintf_double(clfile, factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_ee], phr->has_ee);
-    class_fprintf_double(clfile, factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_bb], phr->has_bb);
-    class_fprintf_double(clfile, factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_te], phr->has_te);
-    class_fprintf_double(clfile, l*(l+1)*factor*cl[phr->index_ct_pp], phr->has_pp);
-    class_fprintf_double(clfile, sqrt(l*(l+1))*factor*pba->T_cmb*1.e6*cl[phr->index_ct_tp], phr->has_tp);
-    class_fprintf_double(clfile, sqrt(l*(l+1))*factor*pba->T_cmb*1.e6*cl[phr->index_ct_ep], phr->has_ep);
+    output_one_value(pop,clfile,factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_tt],phr->has_tt);
+    output_one_value(pop,clfile,factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_ee],phr->has_ee);
+    output_one_value(pop,clfile,factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_bb],phr->has_bb);
+    output_one_value(pop,clfile,factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_te],phr->has_te);
+    output_one_value(pop,clfile,l*(l+1)*factor*cl[phr->index_ct_pp],phr->has_pp);
+    output_one_value(pop,clfile,sqrt(l*(l+1))*factor*pba->T_cmb*1.e6*cl[phr->index_ct_tp],phr->has_tp);
+    output_one_value(pop,clfile,sqrt(l*(l+1))*factor*pba->T_cmb*1.e6*cl[phr->index_ct_ep],phr->has_ep);
     index_ct_rest = 0;
     if (phr->has_tt == _TRUE_)
       index_ct_rest++;
@@ -1717,12 +2729,13 @@ int output_one_line_of_cl(
       index_ct_rest++;
     /* Now print the remaining (if any) entries:*/
     for (index_ct=index_ct_rest; index_ct < ct_size; index_ct++) {
-      class_fprintf_double(clfile, factor*cl[index_ct], _TRUE_);
+      output_one_value(pop,clfile,factor*cl[index_ct],_TRUE_);
     }
+  }
 
+  if (pop->write_binary == _FALSE_)
     fprintf(clfile,"\n");
 
-  }
   return _SUCCESS_;
 
 }
@@ -1752,9 +2765,20 @@ int output_open_pk_file(
                         ) {
 
   int colnum = 1;
-  class_open(*pkfile,filename,"w",pop->error_message);
+  char titles[_MAXTITLESTRINGLENGTH_]={0};
 
-  if (pop->write_header == _TRUE_) {
+  class_call(output_open_file(pop,pkfile,filename,pop->error_message),
+             pop->error_message,
+             pop->error_message);
+
+  if (pop->write_binary == _TRUE_) {
+    class_store_columntitle(titles,"k (h/Mpc)",_TRUE_);
+    class_store_columntitle(titles,"P (Mpc/h)^3",_TRUE_);
+    class_call(output_write_npy_header(*pkfile,titles,pfo->k_size,pop->error_message),
+               pop->error_message,
+               pop->error_message);
+  }
+  else if (pop->write_header == _TRUE_) {
     fprintf(*pkfile,"# Matter power spectrum P(k) %sat redshift z=%g\n",first_line,z);
     fprintf(*pkfile,"# for k=%g to %g h/Mpc,\n",
             exp(pfo->ln_k[0])/pba->h,
@@ -1774,6 +2798,7 @@ int output_open_pk_file(
 /**
  * This routine writes one line with k and P(k)
  *
+ * @param pop     Input: pointer to output structure
  * @param pkfile  Input: file pointer
  * @param one_k   Input: wavenumber
  * @param one_pk  Input: matter power spectrum
@@ -1781,15 +2806,18 @@ int output_open_pk_file(
  */
 
 int output_one_line_of_pk(
+                          struct output * pop,
                           FILE * pkfile,
                           double one_k,
                           double one_pk
                           ) {
 
-  fprintf(pkfile," ");
-  class_fprintf_double(pkfile,one_k,_TRUE_);
-  class_fprintf_double(pkfile,one_pk,_TRUE_);
-  fprintf(pkfile,"\n");
+  if (pop->write_binary == _FALSE_)
+    fprintf(pkfile," ");
+  output_one_value(pop,pkfile,one_k,_TRUE_);
+  output_one_value(pop,pkfile,one_pk,_TRUE_);
+  if (pop->write_binary == _FALSE_)
+    fprintf(pkfile,"\n");
 
   return _SUCCESS_;
 
@@ -104,6 +104,144 @@ int perturbations_sources_at_tau(
   return _SUCCESS_;
 }
 
+/**
+ * Several source functions \f$ S^{X} (k, \tau) \f$ at several values
+ * of conformal time tau.
+ *
+ * Same result as calling perturbations_sources_at_tau() for each pair
+ * (tau, type), but each tau is located only once in the table for
+ * all requested types, starting from the position of the previous
+ * one (this takes a few steps when tau_vec is sorted, in any
+ * direction). The output is written in a caller-provided buffer, with
+ * k running fastest, so that the wrappers can expose it without a
+ * copy as an array of shape (tau_vec_size, tp_vec_size, k_size).
+ *
+ * @param ppt         Input: pointer to perturbation structure containing interpolation tables
+ * @param index_md    Input: index of requested mode
+ * @param index_ic    Input: index of requested initial condition
+ * @param tp_vec      Input: indices of requested source function types
+ * @param tp_vec_size Input: number of requested types
+ * @param tau_vec     Input: values of conformal time, in any order
+ * @param tau_vec_size Input: number of values of conformal time
+ * @param psources    Output: array (already allocated) of size tau_vec_size*tp_vec_size*k_size[index_md], with psources[(index_tau*tp_vec_size+index_tp_vec)*k_size[index_md]+index_k]
+ * @return the error status
+ */
+
+int perturbations_sources_at_tau_vec(
+                                     struct perturbations * ppt,
+                                     int index_md,
+                                     int index_ic,
+                                     int * tp_vec,
+                                     int tp_vec_size,
+                                     double * tau_vec,
+                                     int tau_vec_size,
+                                     double * psources
+                                     ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  int index_tau,index_tp_vec,index_k,inf,k_size;
+  int * index_tau_vec;
+  double * ln_tau_vec;
+  double * b_vec;
+  double h,a=0.,b=0.,ca=0.,cb=0.;
+  double * source;
+  double * ddsource;
+  double * result;
+
+  k_size = ppt->k_size[index_md];
+
+  for (index_tp_vec=0; index_tp_vec<tp_vec_size; index_tp_vec++) {
+    class_test((tp_vec[index_tp_vec] < 0) || (tp_vec[index_tp_vec] >= ppt->tp_size[index_md]),
+               ppt->error_message,
+               "source type index %d is not computed for mode %d",tp_vec[index_tp_vec],index_md);
+  }
+
+  for (index_tau=0; index_tau<tau_vec_size; index_tau++) {
+    class_test(tau_vec[index_tau] <= 0.,
+               ppt->error_message,
+               "conformal time tau=%e should be positive",tau_vec[index_tau]);
+  }
+
+  class_alloc(index_tau_vec,tau_vec_size*sizeof(int),ppt->error_message);
+  class_alloc(ln_tau_vec,tau_vec_size*sizeof(double),ppt->error_message);
+  class_alloc(b_vec,tau_vec_size*sizeof(double),ppt->error_message);
+
+  /** - locate all values of tau in the table of late times, where
+        sources are splined; values outside of it get index -1 */
+
+  for (index_tau=0; index_tau<tau_vec_size; index_tau++) {
+    ln_tau_vec[index_tau] = log(tau_vec[index_tau]);
+    index_tau_vec[index_tau] = -1;
+  }
+
+  if (ppt->ln_tau_size > 1) {
+    class_call(array_spline_hunt_vec(ppt->ln_tau,
+                                     ppt->ln_tau_size,
+                                     ln_tau_vec,
+                                     tau_vec_size,
+                                     index_tau_vec,
+                                     b_vec,
+                                     ppt->error_message),
+               ppt->error_message,
+               ppt->error_message);
+  }
+
+  /** - interpolate each requested type at each tau, with the same
+        spline coefficients for all types and wavenumbers */
+
+  for (index_tau=0; index_tau<tau_vec_size; index_tau++) {
+
+    inf = index_tau_vec[index_tau];
+
+    if (inf >= 0) {
+      h = ppt->ln_tau[inf+1] - ppt->ln_tau[inf];
+      b = b_vec[index_tau];
+      a = 1.-b;
+      ca = (a*a*a-a)*h*h/6.;
+      cb = (b*b*b-b)*h*h/6.;
+    }
+
+    for (index_tp_vec=0; index_tp_vec<tp_vec_size; index_tp_vec++) {
+
+      result = psources + (index_tau*tp_vec_size+index_tp_vec)*k_size;
+
+      /* early times, or beyond the table: same treatment (or same
+         error) as perturbations_sources_at_tau() */
+      if (inf < 0) {
+        class_call(perturbations_sources_at_tau(ppt,
+                                                index_md,
+                                                index_ic,
+                                                tp_vec[index_tp_vec],
+                                                tau_vec[index_tau],
+                                                result),
+                   ppt->error_message,
+                   ppt->error_message);
+        continue;
+      }
+
+      source = ppt->late_sources[index_md][index_ic * ppt->tp_size[index_md] + tp_vec[index_tp_vec]];
+      ddsource = ppt->ddlate_sources[index_md][index_ic * ppt->tp_size[index_md] + tp_vec[index_tp_vec]];
+
+      for (index_k=0; index_k<k_size; index_k++) {
+        result[index_k] =
+          a * source[inf*k_size+index_k] +
+          b * source[(inf+1)*k_size+index_k] +
+          ca * ddsource[inf*k_size+index_k] +
+          cb * ddsource[(inf+1)*k_size+index_k];
+      }
+    }
+  }
+
+  free(index_tau_vec);
+  free(ln_tau_vec);
+  free(b_vec);
+
+  return _SUCCESS_;
+}
+
 /**
  * Function called by the output module or the wrappers, which returns all
  * the source functions \f$ S^{X} (k, \tau) \f$ at a given conformal
@@ -135,6 +273,7 @@ int perturbations_output_data(
   double *dataptr;
 
   double * pvecsources;
+  int * tp_vec;
 
   double tau;
 
@@ -180,27 +319,39 @@ int perturbations_output_data(
                "Asking sources at a z bigger than z_max_pk, something probably went wrong\n",
                ppt->error_message);
 
+    /* all types at once for each initial condition, then
+       reordered with the types running fastest */
+
     class_alloc(pvecsources,
-                ppt->k_size[index_md]*sizeof(double),
+                ppt->tp_size[index_md]*ppt->k_size[index_md]*sizeof(double),
+                ppt->error_message);
+    class_alloc(tp_vec,
+                ppt->tp_size[index_md]*sizeof(int),
                 ppt->error_message);
 
-    for (index_k=0; index_k<ppt->k_size[index_md]; index_k++) {
-      for (index_tp=0; index_tp<ppt->tp_size[index_md]; index_tp++) {
-        for (index_ic=0; index_ic<ppt->ic_size[index_md]; index_ic++) {
-          class_call(perturbations_sources_at_tau(ppt,
-                                            index_md,
-                                            index_ic,
-                                            index_tp,
-                                            tau,
-                                            pvecsources),
-                     ppt->error_message,
-                     ppt->error_message);
+    for (index_tp=0; index_tp<ppt->tp_size[index_md]; index_tp++)
+      tp_vec[index_tp] = index_tp;
+
+    for (index_ic=0; index_ic<ppt->ic_size[index_md]; index_ic++) {
+      class_call(perturbations_sources_at_tau_vec(ppt,
+                                                  index_md,
+                                                  index_ic,
+                                                  tp_vec,
+                                                  ppt->tp_size[index_md],
+                                                  &tau,
+                                                  1,
+                                                  pvecsources),
+                 ppt->error_message,
+                 ppt->error_message);
 
+      for (index_k=0; index_k<ppt->k_size[index_md]; index_k++) {
+        for (index_tp=0; index_tp<ppt->tp_size[index_md]; index_tp++) {
           tkfull[(index_k * ppt->ic_size[index_md] + index_ic) * ppt->tp_size[index_md] + index_tp] =
-            pvecsources[index_k];
+            pvecsources[index_tp * ppt->k_size[index_md] + index_k];
         }
       }
     }
+    free(tp_vec);
     free(pvecsources);
   }
 
@@ -467,6 +618,16 @@ int perturbations_init(
   int index_ic;
   /* running index for wavenumbers */
   int index_k;
+  /* running index in the order in which wavenumbers are evolved */
+  int index_order;
+  /* predicted or measured cost of each wavenumber, and order in which they are evolved */
+  double * k_cost;
+  int * k_order;
+  int has_measured_cost;
+  /* index of the MPI process in charge of each wavenumber, index of the current process and number of processes (one if no MPI) */
+  int * k_rank;
+  int mpi_rank, mpi_size;
+  int index_ikout;
   /* running index for type of perturbation */
   int index_tp;
   /* pointer to one struct perturbations_workspace per thread (one if no openmp) */
@@ -488,9 +649,17 @@ int perturbations_init(
   /* unsigned integer that will be set to the size of the workspace */
   size_t sz;
 
+  /* whether the source functions can be read from / stored in memory, and under which key */
+  int use_cache;
+  short cache_found;
+  unsigned long long cache_key;
+  int cache_status;
+
 #ifdef _OPENMP
   /* instrumentation times */
   double tstart, tstop, tspent;
+  double * thread_tspent;
+  double tspent_min, tspent_max, tspent_mean;
 #endif
 
   /** - perform preliminary checks */
@@ -630,6 +799,35 @@ int perturbations_init(
              _omegab_BIG_);
   */
 
+  ppt->switches = NULL;
+  ppt->switches_previous = NULL;
+
+  /** - if the same run has already been done in this process, get the
+      source functions from memory and exit */
+
+  use_cache = ((ppr->perturbations_cache_size > 0) &&
+               (ppt->k_output_values_num == 0) &&
+               (ppt->store_solver_statistics == _FALSE_));
+
+  if (use_cache == _TRUE_) {
+
+    class_call(perturbations_cache_key(ppr,pba,pth,ppt,&cache_key),
+               ppt->error_message,
+               ppt->error_message);
+
+    /* the source tables in memory are shared by all threads */
+#pragma omp critical (perturbations_cache)
+    cache_status = perturbations_cache_fetch(ppr,cache_key,ppt,&cache_found);
+    if (cache_status == _FAILURE_)
+      return _FAILURE_;
+
+    if (cache_found == _TRUE_) {
+      if (ppt->perturbations_verbose > 0)
+        printf(" -> source functions identical to a previous run, read from memory\n");
+      return _SUCCESS_;
+    }
+  }
+
   /** - initialize all indices and lists in perturbations structure using perturbations_indices() */
 
   class_call(perturbations_indices(ppr,
@@ -673,6 +871,35 @@ int perturbations_init(
              ppt->error_message,
              ppt->error_message);
 
+  /** - if we want statistics of the ODE evolver, allocate the list of
+      intervals of each wavenumber (filled by perturbations_solve()) */
+
+  if (ppt->store_solver_statistics == _TRUE_) {
+
+    class_alloc(ppt->solver_statistics_size,ppt->md_size*sizeof(int *),ppt->error_message);
+    class_alloc(ppt->solver_statistics,ppt->md_size*sizeof(struct perturbations_solver_statistics **),ppt->error_message);
+
+    for (index_md = 0; index_md < ppt->md_size; index_md++) {
+      class_calloc(ppt->solver_statistics_size[index_md],
+                   ppt->ic_size[index_md]*ppt->k_size[index_md],
+                   sizeof(int),
+                   ppt->error_message);
+      class_calloc(ppt->solver_statistics[index_md],
+                   ppt->ic_size[index_md]*ppt->k_size[index_md],
+                   sizeof(struct perturbations_solver_statistics *),
+                   ppt->error_message);
+    }
+  }
+
+  /** - if requested, prepare the table of the approximation switch
+      times, and get those of the previous run as first guesses */
+
+  if (ppr->perturbations_switch_warm_start == _TRUE_) {
+    class_call(perturbations_switches_init(ppt),
+               ppt->error_message,
+               ppt->error_message);
+  }
+
   /** - create an array of workspaces in multi-thread case */
 
 #ifdef _OPENMP
@@ -684,6 +911,9 @@ int perturbations_init(
 #endif
 
   class_alloc(pppw,number_of_threads * sizeof(struct perturbations_workspace *),ppt->error_message);
+#ifdef _OPENMP
+  class_alloc(thread_tspent,number_of_threads * sizeof(double),ppt->error_message);
+#endif
 
   /** - loop over modes (scalar, tensors, etc). For each mode: */
 
@@ -726,6 +956,16 @@ int perturbations_init(
 
     if (abort == _TRUE_) return _FAILURE_;
 
+    class_alloc(k_cost,ppt->k_size[index_md]*sizeof(double),ppt->error_message);
+    class_alloc(k_order,ppt->k_size[index_md]*sizeof(int),ppt->error_message);
+    class_alloc(k_rank,ppt->k_size[index_md]*sizeof(int),ppt->error_message);
+    has_measured_cost = _FALSE_;
+
+    class_call_except(class_mpi_rank_and_size(&mpi_rank,&mpi_size),
+                      ppt->error_message,
+                      ppt->error_message,
+                      free(k_cost);free(k_order);free(k_rank));
+
     /** - --> (c) loop over initial conditions and wavenumbers; for each of them, evolve perturbations and compute source functions with perturbations_solve() */
 
     for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
@@ -735,11 +975,36 @@ int perturbations_init(
         printf("evolving %d wavenumbers\n",ppt->k_size[index_md]);
       }
 
+      /** - ---> order wavenumbers by decreasing cost, predicted for the
+          first initial condition and measured for the next ones */
+
+      class_call_except(perturbations_k_schedule(ppr,
+                                                 pth,
+                                                 ppt,
+                                                 index_md,
+                                                 has_measured_cost,
+                                                 k_cost,
+                                                 k_order),
+                        ppt->error_message,
+                        ppt->error_message,
+                        free(k_cost);free(k_order);free(k_rank));
+
+      /** - ---> with MPI, deal the wavenumbers to processes in this
+          order, so that each of them gets a similar share of expensive
+          and cheap ones. Wavenumbers for which the evolution of
+          perturbations is written to files are kept in the first
+          process, which does the output. */
+
+      for (index_order = 0; index_order < ppt->k_size[index_md]; index_order++)
+        k_rank[k_order[index_order]] = index_order % mpi_size;
+      for (index_ikout = 0; index_ikout < ppt->k_output_values_num; index_ikout++)
+        k_rank[ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout]] = 0;
+
       abort = _FALSE_;
 
 #pragma omp parallel                                                    \
-  shared(pppw,ppr,pba,pth,ppt,index_md,index_ic,abort,number_of_threads) \
-  private(index_k,thread,tstart,tstop,tspent)                           \
+  shared(pppw,ppr,pba,pth,ppt,index_md,index_ic,abort,number_of_threads,k_cost,k_order,k_rank,mpi_rank,thread_tspent) \
+  private(index_order,index_k,thread,tstart,tstop,tspent)               \
   num_threads(number_of_threads)
 
       {
@@ -749,11 +1014,16 @@ int perturbations_init(
         tspent=0.;
 #endif
 
+        /* the most expensive wavenumbers are evolved first, so that
+           cheap ones fill the gaps at the end of the loop */
 #pragma omp for schedule (dynamic)
 
-        /* integrating backwards is slightly more optimal for parallel runs */
-        //for (index_k = 0; index_k < ppt->k_size; index_k++) {
-        for (index_k = ppt->k_size[index_md]-1; index_k >=0; index_k--) {
+        for (index_order = 0; index_order < ppt->k_size[index_md]; index_order++) {
+
+          index_k = k_order[index_order];
+
+          if (k_rank[index_k] != mpi_rank)
+            continue;
 
           if ((ppt->perturbations_verbose > 2) && (abort == _FALSE_)) {
             printf("evolving mode k=%e /Mpc  (%d/%d)",ppt->k[index_md][index_k],index_k+1,ppt->k_size[index_md]);
@@ -762,6 +1032,8 @@ int perturbations_init(
             printf("\n");
           }
 
+          class_trace_begin();
+
 #ifdef _OPENMP
           tstart = omp_get_wtime();
 #endif
@@ -781,13 +1053,17 @@ int perturbations_init(
           tstop = omp_get_wtime();
 
           tspent += tstop-tstart;
+          k_cost[index_k] = tstop-tstart;
 #endif
 
+          class_trace_end("perturbations","index_k",index_k);
+
 #pragma omp flush(abort)
 
         } /* end of loop over wavenumbers */
 
 #ifdef _OPENMP
+        thread_tspent[thread] = tspent;
         if (ppt->perturbations_verbose>2)
           printf("In %s: time spent in parallel region (loop over k's) = %e s for thread %d\n",
                  __func__,tspent,omp_get_thread_num());
@@ -795,10 +1071,60 @@ int perturbations_init(
 
       } /* end of parallel region */
 
-      if (abort == _TRUE_) return _FAILURE_;
+      class_call_except(class_mpi_synchronize_abort(&abort,ppt->error_message),
+                        ppt->error_message,
+                        ppt->error_message,
+                        free(k_cost);free(k_order);free(k_rank));
+
+      if (abort == _TRUE_) {
+        free(k_cost);
+        free(k_order);
+        free(k_rank);
+        return _FAILURE_;
+      }
+
+      /** - ---> with MPI, share the source functions (and the measured
+          costs) computed by each process with all other processes */
+
+      if (mpi_size > 1) {
+        class_call_except(perturbations_mpi_gather(ppt,
+                                                   index_md,
+                                                   index_ic,
+                                                   mpi_rank,
+                                                   k_rank,
+                                                   k_cost),
+                          ppt->error_message,
+                          ppt->error_message,
+                          free(k_cost);free(k_order);free(k_rank));
+      }
+
+#ifdef _OPENMP
+      has_measured_cost = _TRUE_;
+
+      /** - ---> report the load balance between threads: the ratio of
+          the maximum to the mean time spent per thread is one for a
+          perfect schedule */
+
+      if (ppt->perturbations_verbose > 1) {
+        tspent_min = thread_tspent[0];
+        tspent_max = thread_tspent[0];
+        tspent_mean = 0.;
+        for (thread=0; thread<number_of_threads; thread++) {
+          tspent_min = MIN(tspent_min,thread_tspent[thread]);
+          tspent_max = MAX(tspent_max,thread_tspent[thread]);
+          tspent_mean += thread_tspent[thread]/number_of_threads;
+        }
+        printf("time spent per thread over %d threads: min %e s, mean %e s, max %e s (max/mean = %f)\n",
+               number_of_threads,tspent_min,tspent_mean,tspent_max,tspent_max/MAX(tspent_mean,DBL_MIN));
+      }
+#endif
 
     } /* end of loop over initial conditions */
 
+    free(k_cost);
+    free(k_order);
+    free(k_rank);
+
     abort = _FALSE_;
 
 #pragma omp parallel                                \
@@ -823,6 +1149,18 @@ int perturbations_init(
   } /* end loop over modes */
 
   free(pppw);
+#ifdef _OPENMP
+  free(thread_tspent);
+#endif
+
+  /** - remove the sampling times that are not needed for
+      interpolating sources with the requested accuracy */
+
+  if (ppr->tol_perturbations_sampling > 0.) {
+    class_call(perturbations_timesampling_thinning(ppr,ppt),
+               ppt->error_message,
+               ppt->error_message);
+  }
 
   /** - spline the source array with respect to the time variable */
 
@@ -867,6 +1205,140 @@ int perturbations_init(
 
   }
 
+  /** - keep the approximation switch times for the next run */
+
+  if (ppt->switches != NULL) {
+    class_call(perturbations_switches_keep(ppt),
+               ppt->error_message,
+               ppt->error_message);
+  }
+
+  /** - keep a copy of the source functions for later runs with the same input */
+
+  if (use_cache == _TRUE_) {
+#pragma omp critical (perturbations_cache)
+    cache_status = perturbations_cache_store(ppr,cache_key,ppt);
+    if (cache_status == _FAILURE_)
+      return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Order the wavenumbers of a given mode by decreasing expected
+ * cost. Evolving the most expensive wavenumbers first (longest
+ * processing time first scheduling) reduces the time that threads spend
+ * idle at the end of the parallel loop over k.
+ *
+ * When no timing is available yet, the cost is predicted from the
+ * number of oscillations that the full Boltzmann hierarchy has to
+ * follow, which is of the order of k times the time at which the
+ * radiation streaming approximation can be switched on (or the end of
+ * the integration if it comes first). Otherwise, the cost measured for
+ * the previous initial condition is used.
+ *
+ * @param ppr               Input: pointer to precision structure
+ * @param pth               Input: pointer to thermodynamics structure
+ * @param ppt               Input: pointer to the perturbation structure
+ * @param index_md          Input: index of mode under consideration (scalar/.../tensor)
+ * @param has_measured_cost Input: whether k_cost contains measured timings
+ * @param k_cost            Input/Output: cost of each wavenumber (filled with the prediction if has_measured_cost is _FALSE_)
+ * @param k_order           Output: indices of wavenumbers in the order in which they should be evolved
+ * @return the error status
+ */
+
+int perturbations_k_schedule(
+                             struct precision * ppr,
+                             struct thermodynamics * pth,
+                             struct perturbations * ppt,
+                             int index_md,
+                             int has_measured_cost,
+                             double * k_cost,
+                             int * k_order
+                             ) {
+
+  int index_k,index_order,index_tmp;
+  double k,tau_end,tau_rsa;
+
+  if (has_measured_cost == _FALSE_) {
+    tau_end = ppt->tau_sampling[ppt->tau_size-1];
+    for (index_k = 0; index_k < ppt->k_size[index_md]; index_k++) {
+      k = ppt->k[index_md][index_k];
+      tau_rsa = MAX(ppr->radiation_streaming_trigger_tau_over_tau_k/k,pth->tau_free_streaming);
+      k_cost[index_k] = 1.+k*MIN(tau_rsa,tau_end);
+    }
+  }
+
+  /** - insertion sort starting from decreasing k, so that wavenumbers
+      with equal costs keep the order of decreasing k */
+
+  for (index_order = 0; index_order < ppt->k_size[index_md]; index_order++) {
+    index_k = ppt->k_size[index_md]-1-index_order;
+    for (index_tmp = index_order; (index_tmp > 0) && (k_cost[k_order[index_tmp-1]] < k_cost[index_k]); index_tmp--)
+      k_order[index_tmp] = k_order[index_tmp-1];
+    k_order[index_tmp] = index_k;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Combine the source functions of a given mode and initial condition
+ * computed by the different MPI processes. Each process only evolved
+ * the wavenumbers attributed to it in k_rank: the contributions of all
+ * other wavenumbers are set to zero, and the tables are then summed
+ * over processes. The same is done for the cost of each wavenumber,
+ * so that all processes compute the same schedule for the next
+ * initial condition.
+ *
+ * @param ppt      Input/Output: pointer to the perturbation structure
+ * @param index_md Input: index of mode under consideration (scalar/.../tensor)
+ * @param index_ic Input: index of initial condition under consideration
+ * @param mpi_rank Input: index of the current MPI process
+ * @param k_rank   Input: index of the MPI process that evolved each wavenumber
+ * @param k_cost   Input/Output: cost of each wavenumber
+ * @return the error status
+ */
+
+int perturbations_mpi_gather(
+                             struct perturbations * ppt,
+                             int index_md,
+                             int index_ic,
+                             int mpi_rank,
+                             int * k_rank,
+                             double * k_cost
+                             ) {
+
+  int index_tp,index_tau,index_k;
+  double * source;
+
+  for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
+
+    source = ppt->sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp];
+
+    for (index_tau = 0; index_tau < ppt->tau_size; index_tau++)
+      for (index_k = 0; index_k < ppt->k_size[index_md]; index_k++)
+        if (k_rank[index_k] != mpi_rank)
+          source[index_tau*ppt->k_size[index_md]+index_k] = 0.;
+
+    class_call(class_mpi_allreduce_sum(source,
+                                       ppt->k_size[index_md]*ppt->tau_size,
+                                       ppt->error_message),
+               ppt->error_message,
+               ppt->error_message);
+  }
+
+  for (index_k = 0; index_k < ppt->k_size[index_md]; index_k++)
+    if (k_rank[index_k] != mpi_rank)
+      k_cost[index_k] = 0.;
+
+  class_call(class_mpi_allreduce_sum(k_cost,
+                                     ppt->k_size[index_md],
+                                     ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
+
   return _SUCCESS_;
 }
 
@@ -884,7 +1356,7 @@ int perturbations_free(
                  struct perturbations * ppt
                  ) {
 
-  int index_md,index_ic,index_tp;
+  int index_md,index_ic,index_tp,index_k;
   int filenum;
 
   if (ppt->has_perturbations == _TRUE_) {
@@ -910,6 +1382,17 @@ int perturbations_free(
 
     }
 
+    if (ppt->store_solver_statistics == _TRUE_) {
+      for (index_md = 0; index_md < ppt->md_size; index_md++) {
+        for (index_k = 0; index_k < ppt->ic_size[index_md]*ppt->k_size[index_md]; index_k++)
+          free(ppt->solver_statistics[index_md][index_k]);
+        free(ppt->solver_statistics[index_md]);
+        free(ppt->solver_statistics_size[index_md]);
+      }
+      free(ppt->solver_statistics);
+      free(ppt->solver_statistics_size);
+    }
+
     free(ppt->tau_sampling);
     if (ppt->ln_tau_size > 1)
       free(ppt->ln_tau);
@@ -930,31 +1413,643 @@ int perturbations_free(
     free(ppt->late_sources);
     free(ppt->ddlate_sources);
 
-    if (ppt->alpha_idm_dr != NULL)
-      free(ppt->alpha_idm_dr);
+    if (ppt->alpha_idm_dr != NULL)
+      free(ppt->alpha_idm_dr);
+
+    if (ppt->beta_idr != NULL)
+      free(ppt->beta_idr);
+
+    /** Stuff related to perturbations output: */
+
+    /** - Free non-NULL pointers */
+    if (ppt->k_output_values_num > 0 )
+      free(ppt->index_k_output_values);
+
+    for (filenum = 0; filenum<_MAX_NUMBER_OF_K_FILES_; filenum++){
+      if (ppt->scalar_perturbations_data[filenum] != NULL)
+        free(ppt->scalar_perturbations_data[filenum]);
+      if (ppt->vector_perturbations_data[filenum] != NULL)
+        free(ppt->vector_perturbations_data[filenum]);
+      if (ppt->tensor_perturbations_data[filenum] != NULL)
+        free(ppt->tensor_perturbations_data[filenum]);
+    }
+
+  }
+
+  class_memory_leaks();
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Source tables kept in memory by perturbations_cache_store(), with
+ * the key identifying the input they were computed from.
+ */
+
+static struct perturbations perturbations_cache_table[_PERTURBATIONS_CACHE_MAX_];
+static unsigned long long perturbations_cache_keys[_PERTURBATIONS_CACHE_MAX_];
+static short perturbations_cache_used[_PERTURBATIONS_CACHE_MAX_];
+static int perturbations_cache_next = 0;
+
+/**
+ * Update a 64-bit FNV-1a hash with the content of a memory zone.
+ *
+ * @param data Input: pointer to the memory zone
+ * @param size Input: size of the memory zone in bytes
+ * @param key  Input/Output: hash value to update
+ * @return the error status
+ */
+
+int perturbations_cache_hash(
+                             const void * data,
+                             size_t size,
+                             unsigned long long * key
+                             ) {
+
+  const unsigned char * byte = (const unsigned char *) data;
+  size_t index;
+
+  for (index = 0; index < size; index++) {
+    *key ^= byte[index];
+    *key *= 1099511628211ULL;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute the key identifying the input of perturbations_init():
+ * all precision parameters, the input parameters of the perturbation
+ * structure, and the content of the background and thermodynamics
+ * tables together with the few scalar quantities read directly from
+ * these structures. Two runs with the same key lead to the same source
+ * functions, even if they differ by parameters only used in later
+ * modules (primordial spectrum, non-linear corrections, lensing,
+ * output, ...).
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to thermodynamics structure
+ * @param ppt Input: pointer to perturbation structure (only input parameters are used)
+ * @param key Output: key
+ * @return the error status
+ */
+
+int perturbations_cache_key(
+                            struct precision * ppr,
+                            struct background * pba,
+                            struct thermodynamics * pth,
+                            struct perturbations * ppt,
+                            unsigned long long * key
+                            ) {
+
+  int n_ncdm;
+
+  *key = 14695981039346656037ULL;
+
+  /** - precision parameters, listed with the same macros as in the declaration of struct precision */
+
+#undef class_precision_parameter
+#undef class_string_parameter
+#undef class_type_parameter
+#define class_precision_parameter(NAME,TYPE,DEF_VALUE)                  \
+  perturbations_cache_hash(&(ppr->NAME),sizeof(ppr->NAME),key);
+#define class_string_parameter(NAME,DIR,STRING)                         \
+  perturbations_cache_hash(ppr->NAME,strlen(ppr->NAME),key);
+#define class_type_parameter(NAME,READ_TP,REAL_TP,DEF_VAL)              \
+  perturbations_cache_hash(&(ppr->NAME),sizeof(ppr->NAME),key);
+#include "precisions.h"
+#undef class_precision_parameter
+#undef class_string_parameter
+#undef class_type_parameter
+
+  /** - input parameters of the perturbation structure that affect
+      the source functions, field by field (hashing the structure as a
+      whole would include its padding bytes), then the content of the
+      arrays alpha_idm_dr and beta_idr */
+
+  perturbations_cache_hash(&(ppt->has_perturbations),sizeof(ppt->has_perturbations),key);
+  perturbations_cache_hash(&(ppt->has_cls),sizeof(ppt->has_cls),key);
+  perturbations_cache_hash(&(ppt->has_scalars),sizeof(ppt->has_scalars),key);
+  perturbations_cache_hash(&(ppt->has_vectors),sizeof(ppt->has_vectors),key);
+  perturbations_cache_hash(&(ppt->has_tensors),sizeof(ppt->has_tensors),key);
+  perturbations_cache_hash(&(ppt->has_ad),sizeof(ppt->has_ad),key);
+  perturbations_cache_hash(&(ppt->has_bi),sizeof(ppt->has_bi),key);
+  perturbations_cache_hash(&(ppt->has_cdi),sizeof(ppt->has_cdi),key);
+  perturbations_cache_hash(&(ppt->has_nid),sizeof(ppt->has_nid),key);
+  perturbations_cache_hash(&(ppt->has_niv),sizeof(ppt->has_niv),key);
+  perturbations_cache_hash(&(ppt->has_perturbed_recombination),sizeof(ppt->has_perturbed_recombination),key);
+  perturbations_cache_hash(&(ppt->tensor_method),sizeof(ppt->tensor_method),key);
+  perturbations_cache_hash(&(ppt->evolve_tensor_ur),sizeof(ppt->evolve_tensor_ur),key);
+  perturbations_cache_hash(&(ppt->evolve_tensor_ncdm),sizeof(ppt->evolve_tensor_ncdm),key);
+  perturbations_cache_hash(&(ppt->has_cl_cmb_temperature),sizeof(ppt->has_cl_cmb_temperature),key);
+  perturbations_cache_hash(&(ppt->has_cl_cmb_polarization),sizeof(ppt->has_cl_cmb_polarization),key);
+  perturbations_cache_hash(&(ppt->has_cl_cmb_lensing_potential),sizeof(ppt->has_cl_cmb_lensing_potential),key);
+  perturbations_cache_hash(&(ppt->has_cl_lensing_potential),sizeof(ppt->has_cl_lensing_potential),key);
+  perturbations_cache_hash(&(ppt->has_cl_number_count),sizeof(ppt->has_cl_number_count),key);
+  perturbations_cache_hash(&(ppt->has_pk_matter),sizeof(ppt->has_pk_matter),key);
+  perturbations_cache_hash(&(ppt->has_density_transfers),sizeof(ppt->has_density_transfers),key);
+  perturbations_cache_hash(&(ppt->has_velocity_transfers),sizeof(ppt->has_velocity_transfers),key);
+  perturbations_cache_hash(&(ppt->has_metricpotential_transfers),sizeof(ppt->has_metricpotential_transfers),key);
+  perturbations_cache_hash(&(ppt->has_Nbody_gauge_transfers),sizeof(ppt->has_Nbody_gauge_transfers),key);
+  perturbations_cache_hash(&(ppt->has_nl_corrections_based_on_delta_m),sizeof(ppt->has_nl_corrections_based_on_delta_m),key);
+  perturbations_cache_hash(&(ppt->has_nc_density),sizeof(ppt->has_nc_density),key);
+  perturbations_cache_hash(&(ppt->has_nc_rsd),sizeof(ppt->has_nc_rsd),key);
+  perturbations_cache_hash(&(ppt->has_nc_lens),sizeof(ppt->has_nc_lens),key);
+  perturbations_cache_hash(&(ppt->has_nc_gr),sizeof(ppt->has_nc_gr),key);
+  perturbations_cache_hash(&(ppt->l_scalar_max),sizeof(ppt->l_scalar_max),key);
+  perturbations_cache_hash(&(ppt->l_vector_max),sizeof(ppt->l_vector_max),key);
+  perturbations_cache_hash(&(ppt->l_tensor_max),sizeof(ppt->l_tensor_max),key);
+  perturbations_cache_hash(&(ppt->l_lss_max),sizeof(ppt->l_lss_max),key);
+  perturbations_cache_hash(&(ppt->k_max_for_pk),sizeof(ppt->k_max_for_pk),key);
+  perturbations_cache_hash(&(ppt->selection_num),sizeof(ppt->selection_num),key);
+  perturbations_cache_hash(&(ppt->selection),sizeof(ppt->selection),key);
+  perturbations_cache_hash(&(ppt->switch_sw),sizeof(ppt->switch_sw),key);
+  perturbations_cache_hash(&(ppt->switch_eisw),sizeof(ppt->switch_eisw),key);
+  perturbations_cache_hash(&(ppt->switch_lisw),sizeof(ppt->switch_lisw),key);
+  perturbations_cache_hash(&(ppt->switch_dop),sizeof(ppt->switch_dop),key);
+  perturbations_cache_hash(&(ppt->switch_pol),sizeof(ppt->switch_pol),key);
+  perturbations_cache_hash(&(ppt->eisw_lisw_split_z),sizeof(ppt->eisw_lisw_split_z),key);
+  perturbations_cache_hash(&(ppt->store_perturbations),sizeof(ppt->store_perturbations),key);
+  perturbations_cache_hash(&(ppt->k_output_values_num),sizeof(ppt->k_output_values_num),key);
+  perturbations_cache_hash(&(ppt->three_ceff2_ur),sizeof(ppt->three_ceff2_ur),key);
+  perturbations_cache_hash(&(ppt->three_cvis2_ur),sizeof(ppt->three_cvis2_ur),key);
+  perturbations_cache_hash(&(ppt->z_max_pk),sizeof(ppt->z_max_pk),key);
+  perturbations_cache_hash(ppt->selection_mean,ppt->selection_num*sizeof(double),key);
+  perturbations_cache_hash(ppt->selection_width,ppt->selection_num*sizeof(double),key);
+  perturbations_cache_hash(ppt->k_output_values,ppt->k_output_values_num*sizeof(double),key);
+
+  if (ppt->alpha_idm_dr != NULL)
+    perturbations_cache_hash(ppt->alpha_idm_dr,(ppr->l_max_idr-1)*sizeof(double),key);
+  if (ppt->beta_idr != NULL)
+    perturbations_cache_hash(ppt->beta_idr,(ppr->l_max_idr-1)*sizeof(double),key);
+  perturbations_cache_hash(&(ppt->idr_nature),sizeof(ppt->idr_nature),key);
+  perturbations_cache_hash(&(ppt->gauge),sizeof(ppt->gauge),key);
+
+  /** - background table and background quantities used by this module */
+
+  perturbations_cache_hash(&(pba->bt_size),sizeof(pba->bt_size),key);
+  perturbations_cache_hash(&(pba->bg_size),sizeof(pba->bg_size),key);
+  perturbations_cache_hash(pba->tau_table,pba->bt_size*sizeof(double),key);
+  perturbations_cache_hash(pba->z_table,pba->bt_size*sizeof(double),key);
+  perturbations_cache_hash(pba->background_table,pba->bt_size*pba->bg_size*sizeof(double),key);
+
+  perturbations_cache_hash(&(pba->H0),sizeof(pba->H0),key);
+  perturbations_cache_hash(&(pba->h),sizeof(pba->h),key);
+  perturbations_cache_hash(&(pba->K),sizeof(pba->K),key);
+  perturbations_cache_hash(&(pba->sgnK),sizeof(pba->sgnK),key);
+  perturbations_cache_hash(&(pba->T_cmb),sizeof(pba->T_cmb),key);
+  perturbations_cache_hash(&(pba->Omega0_b),sizeof(pba->Omega0_b),key);
+  perturbations_cache_hash(&(pba->Omega0_idm_dr),sizeof(pba->Omega0_idm_dr),key);
+  perturbations_cache_hash(&(pba->Omega0_idr),sizeof(pba->Omega0_idr),key);
+  perturbations_cache_hash(&(pba->Gamma_dcdm),sizeof(pba->Gamma_dcdm),key);
+  perturbations_cache_hash(&(pba->conformal_age),sizeof(pba->conformal_age),key);
+
+  perturbations_cache_hash(&(pba->has_cdm),sizeof(pba->has_cdm),key);
+  perturbations_cache_hash(&(pba->has_dcdm),sizeof(pba->has_dcdm),key);
+  perturbations_cache_hash(&(pba->has_dr),sizeof(pba->has_dr),key);
+  perturbations_cache_hash(&(pba->has_ncdm),sizeof(pba->has_ncdm),key);
+  perturbations_cache_hash(&(pba->has_lambda),sizeof(pba->has_lambda),key);
+  perturbations_cache_hash(&(pba->has_fld),sizeof(pba->has_fld),key);
+  perturbations_cache_hash(&(pba->has_ur),sizeof(pba->has_ur),key);
+  perturbations_cache_hash(&(pba->has_idr),sizeof(pba->has_idr),key);
+  perturbations_cache_hash(&(pba->has_idm_dr),sizeof(pba->has_idm_dr),key);
+  perturbations_cache_hash(&(pba->has_curvature),sizeof(pba->has_curvature),key);
+  perturbations_cache_hash(&(pba->has_scf),sizeof(pba->has_scf),key);
+
+  if (pba->has_fld == _TRUE_) {
+    perturbations_cache_hash(&(pba->fluid_equation_of_state),sizeof(pba->fluid_equation_of_state),key);
+    perturbations_cache_hash(&(pba->w0_fld),sizeof(pba->w0_fld),key);
+    perturbations_cache_hash(&(pba->wa_fld),sizeof(pba->wa_fld),key);
+    perturbations_cache_hash(&(pba->Omega_EDE),sizeof(pba->Omega_EDE),key);
+    perturbations_cache_hash(&(pba->cardassian_q),sizeof(pba->cardassian_q),key);
+    perturbations_cache_hash(&(pba->cardassian_n),sizeof(pba->cardassian_n),key);
+    perturbations_cache_hash(&(pba->cs2_fld),sizeof(pba->cs2_fld),key);
+    perturbations_cache_hash(&(pba->use_ppf),sizeof(pba->use_ppf),key);
+    perturbations_cache_hash(&(pba->c_gamma_over_c_fld),sizeof(pba->c_gamma_over_c_fld),key);
+  }
+
+  if (pba->has_scf == _TRUE_) {
+    perturbations_cache_hash(pba->scf_parameters,pba->scf_parameters_size*sizeof(double),key);
+  }
+
+  if (pba->has_ncdm == _TRUE_) {
+    perturbations_cache_hash(&(pba->N_ncdm),sizeof(pba->N_ncdm),key);
+    perturbations_cache_hash(pba->M_ncdm,pba->N_ncdm*sizeof(double),key);
+    perturbations_cache_hash(pba->factor_ncdm,pba->N_ncdm*sizeof(double),key);
+    perturbations_cache_hash(pba->q_size_ncdm,pba->N_ncdm*sizeof(int),key);
+    for (n_ncdm = 0; n_ncdm < pba->N_ncdm; n_ncdm++) {
+      perturbations_cache_hash(pba->q_ncdm[n_ncdm],pba->q_size_ncdm[n_ncdm]*sizeof(double),key);
+      perturbations_cache_hash(pba->w_ncdm[n_ncdm],pba->q_size_ncdm[n_ncdm]*sizeof(double),key);
+      perturbations_cache_hash(pba->dlnf0_dlnq_ncdm[n_ncdm],pba->q_size_ncdm[n_ncdm]*sizeof(double),key);
+    }
+  }
+
+  /** - thermodynamics table and thermodynamics quantities used by this module */
+
+  perturbations_cache_hash(&(pth->tt_size),sizeof(pth->tt_size),key);
+  perturbations_cache_hash(&(pth->th_size),sizeof(pth->th_size),key);
+  perturbations_cache_hash(pth->z_table,pth->tt_size*sizeof(double),key);
+  perturbations_cache_hash(pth->tau_table,pth->tt_size*sizeof(double),key);
+  perturbations_cache_hash(pth->thermodynamics_table,pth->tt_size*pth->th_size*sizeof(double),key);
+
+  perturbations_cache_hash(&(pth->YHe),sizeof(pth->YHe),key);
+  perturbations_cache_hash(&(pth->z_rec),sizeof(pth->z_rec),key);
+  perturbations_cache_hash(&(pth->tau_rec),sizeof(pth->tau_rec),key);
+  perturbations_cache_hash(&(pth->rs_rec),sizeof(pth->rs_rec),key);
+  perturbations_cache_hash(&(pth->tau_ini),sizeof(pth->tau_ini),key);
+  perturbations_cache_hash(&(pth->tau_free_streaming),sizeof(pth->tau_free_streaming),key);
+  perturbations_cache_hash(&(pth->tau_idr_free_streaming),sizeof(pth->tau_idr_free_streaming),key);
+  perturbations_cache_hash(&(pth->angular_rescaling),sizeof(pth->angular_rescaling),key);
+  perturbations_cache_hash(&(pth->a_idm_dr),sizeof(pth->a_idm_dr),key);
+  perturbations_cache_hash(&(pth->b_idr),sizeof(pth->b_idr),key);
+  perturbations_cache_hash(&(pth->nindex_idm_dr),sizeof(pth->nindex_idm_dr),key);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Look for source functions stored in memory under a given key. If
+ * they are found, fill the perturbation structure with a copy of
+ * them, exactly as perturbations_init() would do.
+ *
+ * @param ppr   Input: pointer to precision structure
+ * @param key   Input: key computed by perturbations_cache_key()
+ * @param ppt   Input/Output: perturbation structure
+ * @param found Output: whether source functions were found under this key
+ * @return the error status
+ */
+
+int perturbations_cache_fetch(
+                              struct precision * ppr,
+                              unsigned long long key,
+                              struct perturbations * ppt,
+                              short * found
+                              ) {
+
+  int index_cache;
+  double * alpha_idm_dr;
+  double * beta_idr;
+  short perturbations_verbose;
+
+  *found = _FALSE_;
+
+  for (index_cache = 0; index_cache < _PERTURBATIONS_CACHE_MAX_; index_cache++) {
+    if ((perturbations_cache_used[index_cache] == _TRUE_) && (perturbations_cache_keys[index_cache] == key)) {
+      *found = _TRUE_;
+      break;
+    }
+  }
+
+  if (*found == _FALSE_)
+    return _SUCCESS_;
+
+  /** - the input parameters and the arrays alpha_idm_dr, beta_idr
+      belong to the caller, everything else comes from the stored
+      structure */
+
+  alpha_idm_dr = ppt->alpha_idm_dr;
+  beta_idr = ppt->beta_idr;
+  perturbations_verbose = ppt->perturbations_verbose;
+
+  memcpy(ppt,&(perturbations_cache_table[index_cache]),sizeof(struct perturbations));
+
+  ppt->alpha_idm_dr = alpha_idm_dr;
+  ppt->beta_idr = beta_idr;
+  ppt->perturbations_verbose = perturbations_verbose;
+
+  class_call(perturbations_copy_sources(&(perturbations_cache_table[index_cache]),ppt),
+             ppt->error_message,
+             ppt->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Store a copy of the source functions of a perturbation structure
+ * in memory under a given key. When ppr->perturbations_cache_size
+ * tables are already stored, the oldest one is replaced.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param key Input: key computed by perturbations_cache_key()
+ * @param ppt Input: perturbation structure filled by perturbations_init()
+ * @return the error status
+ */
+
+int perturbations_cache_store(
+                              struct precision * ppr,
+                              unsigned long long key,
+                              struct perturbations * ppt
+                              ) {
+
+  int index_cache;
+  int filenum;
+  struct perturbations * ppt_cache;
+
+  index_cache = perturbations_cache_next % MIN(ppr->perturbations_cache_size,_PERTURBATIONS_CACHE_MAX_);
+  ppt_cache = &(perturbations_cache_table[index_cache]);
+
+  if (perturbations_cache_used[index_cache] == _TRUE_) {
+    class_call(perturbations_free(ppt_cache),
+               ppt_cache->error_message,
+               ppt->error_message);
+    perturbations_cache_used[index_cache] = _FALSE_;
+  }
+
+  /** - the stored structure does not own the input arrays, nor any
+      perturbation output, so that it can be freed with
+      perturbations_free() */
+
+  memcpy(ppt_cache,ppt,sizeof(struct perturbations));
+
+  ppt_cache->alpha_idm_dr = NULL;
+  ppt_cache->beta_idr = NULL;
+  for (filenum = 0; filenum<_MAX_NUMBER_OF_K_FILES_; filenum++){
+    ppt_cache->scalar_perturbations_data[filenum] = NULL;
+    ppt_cache->vector_perturbations_data[filenum] = NULL;
+    ppt_cache->tensor_perturbations_data[filenum] = NULL;
+  }
+
+  class_call(perturbations_copy_sources(ppt,ppt_cache),
+             ppt_cache->error_message,
+             ppt->error_message);
+
+  perturbations_cache_keys[index_cache] = key;
+  perturbations_cache_used[index_cache] = _TRUE_;
+  perturbations_cache_next = index_cache+1;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free all source functions stored in memory by
+ * perturbations_cache_store().
+ *
+ * @return the error status
+ */
+
+int perturbations_cache_clear(
+                              ) {
+
+  int index_cache;
+
+#pragma omp critical (perturbations_cache)
+  {
+    for (index_cache = 0; index_cache < _PERTURBATIONS_CACHE_MAX_; index_cache++) {
+      if (perturbations_cache_used[index_cache] == _TRUE_) {
+        perturbations_free(&(perturbations_cache_table[index_cache]));
+        perturbations_cache_used[index_cache] = _FALSE_;
+      }
+    }
+    perturbations_cache_next = 0;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Times of the approximation switches of the last run that called
+ * perturbations_switches_keep(), for each of its perturbations_switches_last_md_size modes
+ */
+
+static struct perturbations_switches * perturbations_switches_last = NULL;
+static int perturbations_switches_last_md_size = 0;
+
+/**
+ * Free the switch times of md_size modes.
+ *
+ * @param psw     Input: switch times (can be NULL)
+ * @param md_size Input: number of modes
+ */
+
+static void perturbations_switches_free(
+                                        struct perturbations_switches * psw,
+                                        int md_size
+                                        ) {
+
+  int index_md;
+
+  if (psw == NULL)
+    return;
+
+  for (index_md = 0; index_md < md_size; index_md++) {
+    free(psw[index_md].k);
+    free(psw[index_md].ap);
+    free(psw[index_md].tau);
+  }
+  free(psw);
+}
+
+/**
+ * Allocate the switch times of md_size modes, copying those of psw_in
+ * if it is not NULL, or otherwise with the wavenumbers of ppt and no
+ * switch found yet.
+ *
+ * @param ppt     Input: pointer to the perturbation structure (for the wavenumbers and the error message)
+ * @param psw_in  Input: switch times to copy, or NULL
+ * @param md_size Input: number of modes
+ * @param psw_out Output: allocated switch times
+ * @return the error status
+ */
+
+static int perturbations_switches_alloc(
+                                        struct perturbations * ppt,
+                                        struct perturbations_switches * psw_in,
+                                        int md_size,
+                                        struct perturbations_switches ** psw_out
+                                        ) {
+
+  int index_md, index, size;
+  struct perturbations_switches * psw;
+
+  class_calloc(psw,md_size,sizeof(struct perturbations_switches),ppt->error_message);
+  *psw_out = psw;
+
+  for (index_md = 0; index_md < md_size; index_md++) {
+
+    psw[index_md].k_size = (psw_in == NULL) ? ppt->k_size[index_md] : psw_in[index_md].k_size;
+    size = psw[index_md].k_size*_PERTURBATIONS_SWITCHES_MAX_;
+
+    class_alloc(psw[index_md].k,MAX(psw[index_md].k_size,1)*sizeof(double),ppt->error_message);
+    class_alloc(psw[index_md].ap,MAX(size,1)*sizeof(int),ppt->error_message);
+    class_alloc(psw[index_md].tau,MAX(size,1)*sizeof(double),ppt->error_message);
+
+    if (psw_in == NULL) {
+      memcpy(psw[index_md].k,ppt->k[index_md],psw[index_md].k_size*sizeof(double));
+      for (index = 0; index < size; index++)
+        psw[index_md].ap[index] = -1;
+    }
+    else {
+      memcpy(psw[index_md].k,psw_in[index_md].k,psw[index_md].k_size*sizeof(double));
+      memcpy(psw[index_md].ap,psw_in[index_md].ap,size*sizeof(int));
+      memcpy(psw[index_md].tau,psw_in[index_md].tau,size*sizeof(double));
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Prepare the warm start of the approximation switches: allocate the
+ * table of the switch times of this run, and copy those of the last
+ * run with the same number of modes, if any (other runs of the
+ * process may replace them while this one is running).
+ *
+ * @param ppt Input/Output: pointer to the perturbation structure, after perturbations_indices()
+ * @return the error status
+ */
+
+int perturbations_switches_init(
+                                struct perturbations * ppt
+                                ) {
+
+  int status = _SUCCESS_;
+
+  class_call(perturbations_switches_alloc(ppt,NULL,ppt->md_size,&(ppt->switches)),
+             ppt->error_message,
+             ppt->error_message);
+
+#pragma omp critical (perturbations_switches)
+  {
+    if ((perturbations_switches_last != NULL) && (perturbations_switches_last_md_size == ppt->md_size))
+      status = perturbations_switches_alloc(ppt,perturbations_switches_last,ppt->md_size,&(ppt->switches_previous));
+  }
+
+  return status;
+}
+
+/**
+ * Keep the switch times found in this run for the next ones, in place
+ * of those of the last run.
+ *
+ * @param ppt Input/Output: pointer to the perturbation structure
+ * @return the error status
+ */
+
+int perturbations_switches_keep(
+                                struct perturbations * ppt
+                                ) {
+
+#pragma omp critical (perturbations_switches)
+  {
+    perturbations_switches_free(perturbations_switches_last,perturbations_switches_last_md_size);
+    perturbations_switches_last = ppt->switches;
+    perturbations_switches_last_md_size = ppt->md_size;
+  }
+
+  perturbations_switches_free(ppt->switches_previous,ppt->md_size);
+  ppt->switches = NULL;
+  ppt->switches_previous = NULL;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the switch times kept by perturbations_switches_keep().
+ *
+ * @return the error status
+ */
+
+int perturbations_switches_clear(
+                                 ) {
+
+#pragma omp critical (perturbations_switches)
+  {
+    perturbations_switches_free(perturbations_switches_last,perturbations_switches_last_md_size);
+    perturbations_switches_last = NULL;
+    perturbations_switches_last_md_size = 0;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Allocate in ppt_out a copy of all the arrays of ppt_in that
+ * perturbations_free() deallocates (k and tau samplings, sizes, source
+ * tables and their splines). All other fields of ppt_out are assumed
+ * to be already identical to those of ppt_in.
+ *
+ * @param ppt_in  Input: perturbation structure filled by perturbations_init()
+ * @param ppt_out Output: perturbation structure receiving the copy
+ * @return the error status
+ */
+
+int perturbations_copy_sources(
+                               struct perturbations * ppt_in,
+                               struct perturbations * ppt_out
+                               ) {
 
-    if (ppt->beta_idr != NULL)
-      free(ppt->beta_idr);
+  int index_md,index_ic,index_tp,index_source;
+  int md_size = ppt_in->md_size;
 
-    /** Stuff related to perturbations output: */
+  class_alloc(ppt_out->tau_sampling,ppt_in->tau_size*sizeof(double),ppt_out->error_message);
+  memcpy(ppt_out->tau_sampling,ppt_in->tau_sampling,ppt_in->tau_size*sizeof(double));
 
-    /** - Free non-NULL pointers */
-    if (ppt->k_output_values_num > 0 )
-      free(ppt->index_k_output_values);
+  if (ppt_in->ln_tau_size > 1) {
+    class_alloc(ppt_out->ln_tau,ppt_in->ln_tau_size*sizeof(double),ppt_out->error_message);
+    memcpy(ppt_out->ln_tau,ppt_in->ln_tau,ppt_in->ln_tau_size*sizeof(double));
+  }
 
-    for (filenum = 0; filenum<_MAX_NUMBER_OF_K_FILES_; filenum++){
-      if (ppt->scalar_perturbations_data[filenum] != NULL)
-        free(ppt->scalar_perturbations_data[filenum]);
-      if (ppt->vector_perturbations_data[filenum] != NULL)
-        free(ppt->vector_perturbations_data[filenum]);
-      if (ppt->tensor_perturbations_data[filenum] != NULL)
-        free(ppt->tensor_perturbations_data[filenum]);
+  class_alloc(ppt_out->tp_size,md_size*sizeof(int),ppt_out->error_message);
+  class_alloc(ppt_out->ic_size,md_size*sizeof(int),ppt_out->error_message);
+  class_alloc(ppt_out->k_size,md_size*sizeof(int),ppt_out->error_message);
+  class_alloc(ppt_out->k_size_cmb,md_size*sizeof(int),ppt_out->error_message);
+  class_alloc(ppt_out->k_size_cl,md_size*sizeof(int),ppt_out->error_message);
+  memcpy(ppt_out->tp_size,ppt_in->tp_size,md_size*sizeof(int));
+  memcpy(ppt_out->ic_size,ppt_in->ic_size,md_size*sizeof(int));
+  memcpy(ppt_out->k_size,ppt_in->k_size,md_size*sizeof(int));
+  memcpy(ppt_out->k_size_cmb,ppt_in->k_size_cmb,md_size*sizeof(int));
+  memcpy(ppt_out->k_size_cl,ppt_in->k_size_cl,md_size*sizeof(int));
+
+  class_alloc(ppt_out->k,md_size*sizeof(double *),ppt_out->error_message);
+  class_alloc(ppt_out->sources,md_size*sizeof(double **),ppt_out->error_message);
+  class_alloc(ppt_out->late_sources,md_size*sizeof(double **),ppt_out->error_message);
+  class_alloc(ppt_out->ddlate_sources,md_size*sizeof(double **),ppt_out->error_message);
+
+  for (index_md = 0; index_md < md_size; index_md++) {
+
+    class_alloc(ppt_out->k[index_md],ppt_in->k_size[index_md]*sizeof(double),ppt_out->error_message);
+    memcpy(ppt_out->k[index_md],ppt_in->k[index_md],ppt_in->k_size[index_md]*sizeof(double));
+
+    class_alloc(ppt_out->sources[index_md],
+                ppt_in->ic_size[index_md]*ppt_in->tp_size[index_md]*sizeof(double *),
+                ppt_out->error_message);
+    class_alloc(ppt_out->late_sources[index_md],
+                ppt_in->ic_size[index_md]*ppt_in->tp_size[index_md]*sizeof(double *),
+                ppt_out->error_message);
+    class_alloc(ppt_out->ddlate_sources[index_md],
+                ppt_in->ic_size[index_md]*ppt_in->tp_size[index_md]*sizeof(double *),
+                ppt_out->error_message);
+
+    for (index_ic = 0; index_ic < ppt_in->ic_size[index_md]; index_ic++) {
+      for (index_tp = 0; index_tp < ppt_in->tp_size[index_md]; index_tp++) {
+
+        index_source = index_ic*ppt_in->tp_size[index_md]+index_tp;
+
+        class_alloc(ppt_out->sources[index_md][index_source],
+                    ppt_in->k_size[index_md]*ppt_in->tau_size*sizeof(double),
+                    ppt_out->error_message);
+        memcpy(ppt_out->sources[index_md][index_source],
+               ppt_in->sources[index_md][index_source],
+               ppt_in->k_size[index_md]*ppt_in->tau_size*sizeof(double));
+
+        if (ppt_in->ln_tau_size > 1) {
+          ppt_out->late_sources[index_md][index_source] =
+            &(ppt_out->sources[index_md][index_source][(ppt_in->tau_size-ppt_in->ln_tau_size)*ppt_in->k_size[index_md]]);
+
+          class_alloc(ppt_out->ddlate_sources[index_md][index_source],
+                      ppt_in->k_size[index_md]*ppt_in->ln_tau_size*sizeof(double),
+                      ppt_out->error_message);
+          memcpy(ppt_out->ddlate_sources[index_md][index_source],
+                 ppt_in->ddlate_sources[index_md][index_source],
+                 ppt_in->k_size[index_md]*ppt_in->ln_tau_size*sizeof(double));
+        }
+      }
     }
-
   }
 
   return _SUCCESS_;
-
 }
 
 /**
@@ -1803,9 +2898,9 @@ int perturbations_timesampling_for_sources(
     for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
       for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
 
-        class_alloc(ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_tp],
-                    ppt->k_size[index_md] * ppt->tau_size * sizeof(double),
-                    ppt->error_message);
+        class_alloc_first_touch(ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_tp],
+                                ppt->k_size[index_md] * ppt->tau_size * sizeof(double),
+                                ppt->error_message);
 
         if (ppt->ln_tau_size > 1) {
           /* late_sources is just a pointer to the end of sources (starting from the relevant time index) */
@@ -1824,6 +2919,280 @@ int perturbations_timesampling_for_sources(
   return _SUCCESS_;
 }
 
+/**
+ * Thin out the time sampling of source functions, once they have been
+ * computed on the grid defined by perturbations_timesampling_for_sources().
+ *
+ * This grid is built from the background and thermodynamical
+ * timescales only, and is common to all modes, types and
+ * wavenumbers. In some time ranges it is finer than actually needed by
+ * all source functions. Here, the error of linear interpolation of a
+ * source function S between two sampling times tau_1 and tau_2 is
+ * estimated as \f$ (\tau_2-\tau_1)^2/8 \max|S''| \f$, with the second
+ * derivative evaluated on the original grid. Starting from the first
+ * time, we keep the furthest sampling time such that, for all modes,
+ * initial conditions, types and wavenumbers, this error is smaller than
+ * ppr->tol_perturbations_sampling times the maximum of |S| over the
+ * same interval: the tolerance is local, so that small features (like
+ * the reionization bump of the visibility function) are as well
+ * resolved as large ones. The first and last times, and the beginning
+ * of the late-time range used for P(k,z), are always kept.
+ *
+ * The source tables, tau_sampling and ln_tau are then compacted, and
+ * tau_size and ln_tau_size updated. Must be called before splining the
+ * late sources.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param ppt Input/Output: perturbation structure with filled source tables
+ * @return the error status
+ */
+
+int perturbations_timesampling_thinning(
+                                        struct precision * ppr,
+                                        struct perturbations * ppt
+                                        ) {
+
+  int index_md,index_source;
+  int index_tau,index_k,index_left,index_right;
+  int index_late,new_tau_size,new_index_late;
+  int index_column,column_size;
+  int k_size;
+  int * index_kept;
+  int * column_stride;
+  short * is_protected;
+  short accept;
+  double ** column_source;
+  double * source_max;
+  double * source_floor;
+  double * curvature_max;
+  double * source;
+  double dtau,s,c;
+
+  /* variations of a source function smaller than this fraction of its
+     maximum over all times are considered as numerical noise */
+  const double relative_floor = 1.e-6;
+
+  if (ppt->tau_size < 3)
+    return _SUCCESS_;
+
+  /** - find the times that must be kept */
+
+  class_calloc(is_protected,ppt->tau_size,sizeof(short),ppt->error_message);
+
+  is_protected[0] = _TRUE_;
+  is_protected[ppt->tau_size-1] = _TRUE_;
+
+  /* keep the beginning of the late-time range together with the few
+     points taken before z_max_pk to avoid boundary effects in its
+     interpolation */
+  index_late = ppt->tau_size-ppt->ln_tau_size;
+  for (index_tau = index_late; (index_tau < index_late+5) && (index_tau < ppt->tau_size); index_tau++)
+    is_protected[index_tau] = _TRUE_;
+
+  /** - list all source functions of one wavenumber (called columns
+      below), with their maximum over time */
+
+  column_size = 0;
+  for (index_md = 0; index_md < ppt->md_size; index_md++)
+    column_size += ppt->ic_size[index_md]*ppt->tp_size[index_md]*ppt->k_size[index_md];
+
+  class_alloc(column_source,column_size*sizeof(double*),ppt->error_message);
+  class_alloc(column_stride,column_size*sizeof(int),ppt->error_message);
+  class_alloc(source_max,column_size*sizeof(double),ppt->error_message);
+  class_alloc(source_floor,column_size*sizeof(double),ppt->error_message);
+  class_alloc(curvature_max,column_size*sizeof(double),ppt->error_message);
+
+  index_column = 0;
+  for (index_md = 0; index_md < ppt->md_size; index_md++) {
+    for (index_source = 0; index_source < ppt->ic_size[index_md]*ppt->tp_size[index_md]; index_source++) {
+      for (index_k = 0; index_k < ppt->k_size[index_md]; index_k++) {
+        column_source[index_column] = ppt->sources[index_md][index_source]+index_k;
+        column_stride[index_column] = ppt->k_size[index_md];
+        s = 0.;
+        for (index_tau = 0; index_tau < ppt->tau_size; index_tau++)
+          s = MAX(s,fabs(column_source[index_column][index_tau*column_stride[index_column]]));
+        source_floor[index_column] = relative_floor*s;
+        index_column++;
+      }
+    }
+  }
+
+  /** - select the times to keep, starting from the first one */
+
+  class_alloc(index_kept,ppt->tau_size*sizeof(int),ppt->error_message);
+
+  new_tau_size = 0;
+  new_index_late = 0;
+  index_left = 0;
+  index_kept[new_tau_size++] = index_left;
+
+  while (index_left < ppt->tau_size-1) {
+
+    index_right = index_left+1;
+
+    for (index_column = 0; index_column < column_size; index_column++) {
+      source_max[index_column] = 0.;
+      curvature_max[index_column] = 0.;
+      for (index_tau = index_left; index_tau <= index_right; index_tau++) {
+        class_call(perturbations_timesampling_curvature(ppt,
+                                                        column_source[index_column],
+                                                        column_stride[index_column],
+                                                        index_tau,
+                                                        &s,
+                                                        &c),
+                   ppt->error_message,
+                   ppt->error_message);
+        source_max[index_column] = MAX(source_max[index_column],s);
+        curvature_max[index_column] = MAX(curvature_max[index_column],c);
+      }
+    }
+
+    /* try to skip the time index_right, i.e. to interpolate between
+       index_left and index_right+1 */
+    while ((is_protected[index_right] == _FALSE_) && (index_right+1 < ppt->tau_size)) {
+
+      dtau = ppt->tau_sampling[index_right+1]-ppt->tau_sampling[index_left];
+
+      accept = _TRUE_;
+      for (index_column = 0; index_column < column_size; index_column++) {
+        class_call(perturbations_timesampling_curvature(ppt,
+                                                        column_source[index_column],
+                                                        column_stride[index_column],
+                                                        index_right+1,
+                                                        &s,
+                                                        &c),
+                   ppt->error_message,
+                   ppt->error_message);
+        if (dtau*dtau/8.*MAX(curvature_max[index_column],c) >
+            ppr->tol_perturbations_sampling*MAX(MAX(source_max[index_column],s),source_floor[index_column])) {
+          accept = _FALSE_;
+          break;
+        }
+      }
+
+      if (accept == _FALSE_)
+        break;
+
+      index_right++;
+
+      for (index_column = 0; index_column < column_size; index_column++) {
+        class_call(perturbations_timesampling_curvature(ppt,
+                                                        column_source[index_column],
+                                                        column_stride[index_column],
+                                                        index_right,
+                                                        &s,
+                                                        &c),
+                   ppt->error_message,
+                   ppt->error_message);
+        source_max[index_column] = MAX(source_max[index_column],s);
+        curvature_max[index_column] = MAX(curvature_max[index_column],c);
+      }
+    }
+
+    if (index_right == index_late)
+      new_index_late = new_tau_size;
+    index_kept[new_tau_size++] = index_right;
+    index_left = index_right;
+  }
+
+  free(column_source);
+  free(column_stride);
+  free(source_max);
+  free(source_floor);
+  free(curvature_max);
+
+  /** - compact all arrays depending on time */
+
+  if (new_tau_size < ppt->tau_size) {
+
+    if (ppt->perturbations_verbose > 1)
+      printf(" -> time sampling of sources reduced from %d to %d values\n",ppt->tau_size,new_tau_size);
+
+    for (index_md = 0; index_md < ppt->md_size; index_md++) {
+
+      k_size = ppt->k_size[index_md];
+
+      for (index_source = 0; index_source < ppt->ic_size[index_md]*ppt->tp_size[index_md]; index_source++) {
+
+        source = ppt->sources[index_md][index_source];
+
+        /* index_kept[index_tau] >= index_tau, so that rows can be moved in increasing order */
+        for (index_tau = 0; index_tau < new_tau_size; index_tau++)
+          memmove(source+index_tau*k_size,
+                  source+index_kept[index_tau]*k_size,
+                  k_size*sizeof(double));
+
+        class_realloc(ppt->sources[index_md][index_source],
+                      ppt->sources[index_md][index_source],
+                      new_tau_size*k_size*sizeof(double),
+                      ppt->error_message);
+
+        if (ppt->ln_tau_size > 1)
+          ppt->late_sources[index_md][index_source] = ppt->sources[index_md][index_source]+new_index_late*k_size;
+      }
+    }
+
+    for (index_tau = 0; index_tau < new_tau_size; index_tau++)
+      ppt->tau_sampling[index_tau] = ppt->tau_sampling[index_kept[index_tau]];
+
+    class_realloc(ppt->tau_sampling,ppt->tau_sampling,new_tau_size*sizeof(double),ppt->error_message);
+
+    if (ppt->ln_tau_size > 1) {
+      ppt->ln_tau_size = new_tau_size-new_index_late;
+      for (index_tau = 0; index_tau < ppt->ln_tau_size; index_tau++)
+        ppt->ln_tau[index_tau] = log(ppt->tau_sampling[new_index_late+index_tau]);
+    }
+
+    ppt->tau_size = new_tau_size;
+  }
+
+  free(index_kept);
+  free(is_protected);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Absolute value and absolute second derivative of one source function
+ * at a given time of the original sampling used by
+ * perturbations_timesampling_thinning(). At the first and last times,
+ * the second derivative of the neighbouring time is used.
+ *
+ * @param ppt        Input: pointer to perturbation structure
+ * @param source     Input: pointer to the value of the source function at the first time
+ * @param stride     Input: distance between values at two consecutive times
+ * @param index_tau  Input: index of time in ppt->tau_sampling
+ * @param abs_source Output: absolute value of the source function
+ * @param abs_der2   Output: absolute value of its second derivative with respect to tau
+ * @return the error status
+ */
+
+int perturbations_timesampling_curvature(
+                                         struct perturbations * ppt,
+                                         double * source,
+                                         int stride,
+                                         int index_tau,
+                                         double * abs_source,
+                                         double * abs_der2
+                                         ) {
+
+  int index_mid;
+  double dtau_left,dtau_right;
+
+  *abs_source = fabs(source[index_tau*stride]);
+
+  index_mid = MIN(MAX(index_tau,1),ppt->tau_size-2);
+
+  dtau_left = ppt->tau_sampling[index_mid]-ppt->tau_sampling[index_mid-1];
+  dtau_right = ppt->tau_sampling[index_mid+1]-ppt->tau_sampling[index_mid];
+
+  *abs_der2 = fabs(2./(dtau_left+dtau_right)*
+                   ((source[(index_mid+1)*stride]-source[index_mid*stride])/dtau_right
+                    -(source[index_mid*stride]-source[(index_mid-1)*stride])/dtau_left));
+
+  return _SUCCESS_;
+}
+
 /**
  * Define the number of comoving wavenumbers using the information
  * passed in the precision structure.
@@ -2490,7 +3859,9 @@ int perturbations_workspace_init(
 
   int index_mt=0;
   int index_ap;
+  int index_pv;
   int l;
+  int n_ncdm,index_q,index_bin;
 
   /** - Compute maximum l_max for any multipole */;
   if (_scalars_) {
@@ -2506,6 +3877,13 @@ int perturbations_workspace_init(
     if (pba->has_ncdm == _TRUE_) ppw->max_l_max = MAX(ppw->max_l_max, ppr->l_max_ncdm);
   }
 
+  /** - no perturbation output is streamed yet */
+  ppw->perturbations_output_file = NULL;
+  ppw->stream_buffer = NULL;
+  ppw->stream_buffer_rows = 0;
+  ppw->stream_row_size = 0;
+  ppw->stream_buffer_size = 0;
+
   /** - Allocate \f$ s_l\f$[ ] array for freestreaming of multipoles (see arXiv:1305.3261) and initialize
       to 1.0, which is the K=0 value. */
   class_alloc(ppw->s_l, sizeof(double)*(ppw->max_l_max+1),ppt->error_message);
@@ -2513,6 +3891,18 @@ int perturbations_workspace_init(
     ppw->s_l[l] = 1.0;
   }
 
+  /** - Allocate the arrays of hierarchy coefficients \f$ l s_l/(2l+1) \f$
+      and \f$ (l+1) s_{l+1}/(2l+1) \f$, so that the loops over
+      multipoles in perturbations_derivs() contain no division and no
+      index-dependent branching, and can be vectorized by the
+      compiler. They are updated in perturbations_solve() in presence
+      of curvature. */
+  class_alloc(ppw->c_l_minus, sizeof(double)*(ppw->max_l_max+1),ppt->error_message);
+  class_alloc(ppw->c_l_plus, sizeof(double)*(ppw->max_l_max+1),ppt->error_message);
+  class_call(perturbations_hierarchy_coefficients(ppw),
+             ppt->error_message,
+             ppt->error_message);
+
   /** - define indices of metric perturbations obeying constraint
       equations (this can be done once and for all, because the
       vector of metric perturbations is the same whatever the
@@ -2596,6 +3986,27 @@ int perturbations_workspace_init(
   if (ppw->ap_size > 0)
     class_alloc(ppw->approx,ppw->ap_size*sizeof(int),ppt->error_message);
 
+  /** - allocate the two perturbation vectors recycled for all wavenumbers; their arrays are allocated at first use */
+
+  for (index_pv=0; index_pv<2; index_pv++) {
+    class_alloc(ppw->pv_pool[index_pv],sizeof(struct perturbations_vector),ppt->error_message);
+    ppw->pv_pool[index_pv]->l_max_ncdm = NULL;
+    ppw->pv_pool[index_pv]->q_size_ncdm = NULL;
+    ppw->pv_pool[index_pv]->y = NULL;
+    ppw->pv_pool[index_pv]->dy = NULL;
+    ppw->pv_pool[index_pv]->used_in_sources = NULL;
+    ppw->pv_pool[index_pv]->pt_capacity = 0;
+    ppw->pv_pool[index_pv]->is_pooled = _TRUE_;
+  }
+  ppw->pv = NULL;
+
+  /** - no jacobian of the ndf15 evolver is stored yet */
+
+  ppw->jacobian_size = 0;
+  ppw->jacobian = NULL;
+  ppw->jacobian_neq = NULL;
+  ppw->jacobian_approx = NULL;
+
   /** - For definiteness, initialize approximation flags to arbitrary
       values (correct values are overwritten in
       pertub_find_approximation_switches) */
@@ -2638,43 +4049,356 @@ int perturbations_workspace_init(
 
   }
 
-  return _SUCCESS_;
-}
+  /** - tabulate the momentum bins of all ncdm species in a single
+      list, following the order of their hierarchies in the vector
+      of perturbations, so that the right-hand side can treat them as
+      one block */
+
+  ppw->ncdm_bin_size = 0;
+  ppw->ncdm_bin_start = NULL;
+  ppw->ncdm_q = NULL;
+
+  if (pba->has_ncdm == _TRUE_) {
+
+    for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++)
+      ppw->ncdm_bin_size += pba->q_size_ncdm[n_ncdm];
+
+    class_alloc(ppw->ncdm_bin_start,(pba->N_ncdm+1)*sizeof(int),ppt->error_message);
+    class_alloc(ppw->ncdm_q,5*ppw->ncdm_bin_size*sizeof(double),ppt->error_message);
+    ppw->ncdm_dlnf0_dlnq = ppw->ncdm_q+ppw->ncdm_bin_size;
+    ppw->ncdm_M2 = ppw->ncdm_dlnf0_dlnq+ppw->ncdm_bin_size;
+    ppw->ncdm_q2w = ppw->ncdm_M2+ppw->ncdm_bin_size;
+    ppw->ncdm_epsilon = ppw->ncdm_q2w+ppw->ncdm_bin_size;
+
+    index_bin = 0;
+    for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
+      ppw->ncdm_bin_start[n_ncdm] = index_bin;
+      for (index_q=0; index_q<pba->q_size_ncdm[n_ncdm]; index_q++) {
+        ppw->ncdm_q[index_bin] = pba->q_ncdm[n_ncdm][index_q];
+        ppw->ncdm_dlnf0_dlnq[index_bin] = pba->dlnf0_dlnq_ncdm[n_ncdm][index_q];
+        ppw->ncdm_M2[index_bin] = pba->M_ncdm[n_ncdm]*pba->M_ncdm[n_ncdm];
+        ppw->ncdm_q2w[index_bin] = pba->q_ncdm[n_ncdm][index_q]*pba->q_ncdm[n_ncdm][index_q]*pba->w_ncdm[n_ncdm][index_q];
+        index_bin++;
+      }
+    }
+    ppw->ncdm_bin_start[pba->N_ncdm] = index_bin;
+    ppw->ncdm_epsilon_a = -1.;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the perturbations_workspace structure (with the exception of the
+ * perturbations_vector '-->pv' field, which is freed separately in
+ * perturbations_vector_free).
+ *
+ * @param ppt        Input: pointer to the perturbation structure
+ * @param index_md Input: index of mode under consideration (scalar/.../tensor)
+ * @param ppw        Input: pointer to perturbations_workspace structure to be freed
+ * @return the error status
+ */
+
+int perturbations_workspace_free (
+                            struct perturbations * ppt,
+                            int index_md,
+                            struct perturbations_workspace * ppw
+                            ) {
+
+  int index_jac,index_pv;
+
+  for (index_pv=0; index_pv<2; index_pv++) {
+    ppw->pv_pool[index_pv]->is_pooled = _FALSE_;
+    /* arrays not yet allocated are NULL, and free(NULL) does nothing */
+    class_call(perturbations_vector_free(ppw->pv_pool[index_pv]),
+               ppt->error_message,
+               ppt->error_message);
+  }
+
+  for (index_jac=0; index_jac<ppw->jacobian_size; index_jac++)
+    uninitialize_jacobian(&(ppw->jacobian[index_jac]));
+  if (ppw->jacobian_size > 0) {
+    free(ppw->jacobian);
+    free(ppw->jacobian_neq);
+    free(ppw->jacobian_approx);
+  }
+
+  free(ppw->stream_buffer);
+  free(ppw->s_l);
+  free(ppw->c_l_minus);
+  free(ppw->c_l_plus);
+  free(ppw->pvecback);
+  free(ppw->pvecthermo);
+  free(ppw->pvecmetric);
+  if (ppw->ap_size > 0)
+    free(ppw->approx);
+
+  if (_scalars_) {
+
+    if ((ppt->has_density_transfers == _TRUE_) || (ppt->has_velocity_transfers == _TRUE_) || (ppt->has_source_delta_m == _TRUE_)) {
+      free(ppw->delta_ncdm);
+      free(ppw->theta_ncdm);
+      free(ppw->shear_ncdm);
+    }
+  }
+
+  /* NULL without ncdm */
+  free(ppw->ncdm_bin_start);
+  free(ppw->ncdm_q);
+
+  free(ppw);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Fill the arrays of coefficients entering the free-streaming part of
+ * all Boltzmann hierarchies (photon temperature and polarization, ur,
+ * idr, dr, ncdm), given the current free-streaming coefficients
+ * s_l. For each multipole l < max_l_max, the time derivative of the
+ * l-th multipole reads (k or q k/epsilon) times [c_l_minus[l] F_(l-1)
+ * - c_l_plus[l] F_(l+1)], plus collision terms.
+ *
+ * @param ppw        Input/Output: pointer to perturbations_workspace structure
+ * @return the error status
+ */
+
+int perturbations_hierarchy_coefficients(
+                                         struct perturbations_workspace * ppw
+                                         ) {
+
+  int l;
+  double * s_l = ppw->s_l;
+
+  for (l=0; l<ppw->max_l_max; l++) {
+    ppw->c_l_minus[l] = l*s_l[l]/(2.*l+1.);
+    ppw->c_l_plus[l] = (l+1.)*s_l[l+1]/(2.*l+1.);
+  }
+  ppw->c_l_minus[ppw->max_l_max] = ppw->max_l_max*s_l[ppw->max_l_max]/(2.*ppw->max_l_max+1.);
+  ppw->c_l_plus[ppw->max_l_max] = 0.;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Find the jacobian of the ndf15 evolver stored in the workspace for
+ * the current approximation scheme and number of equations, or
+ * initialize a new one if there is none yet. Successive wavenumbers
+ * solved by the same thread go through the same approximation schemes,
+ * so that the sparsity pattern and column grouping found for the
+ * previous wavenumber can be used again.
+ *
+ * @param ppt        Input: pointer to the perturbation structure
+ * @param ppw        Input/Output: pointer to perturbations_workspace structure
+ * @param jac        Output: pointer to the stored jacobian
+ * @return the error status
+ */
+
+int perturbations_workspace_jacobian(
+                                     struct perturbations * ppt,
+                                     struct perturbations_workspace * ppw,
+                                     struct jacobian ** jac
+                                     ) {
+
+  int index_jac,index_ap,neq,same;
+
+  neq = ppw->pv->pt_size;
+
+  for (index_jac=0; index_jac<ppw->jacobian_size; index_jac++) {
+    same = (ppw->jacobian_neq[index_jac] == neq);
+    for (index_ap=0; (index_ap<ppw->ap_size) && (same == _TRUE_); index_ap++)
+      same = (ppw->jacobian_approx[index_jac*ppw->ap_size+index_ap] == ppw->approx[index_ap]);
+    if (same == _TRUE_) {
+      *jac = &(ppw->jacobian[index_jac]);
+      return _SUCCESS_;
+    }
+  }
+
+  /** - new approximation scheme: add a jacobian at the end of the list */
+
+  index_jac = ppw->jacobian_size;
+  ppw->jacobian_size++;
+
+  class_realloc(ppw->jacobian,ppw->jacobian,ppw->jacobian_size*sizeof(struct jacobian),ppt->error_message);
+  class_realloc(ppw->jacobian_neq,ppw->jacobian_neq,ppw->jacobian_size*sizeof(int),ppt->error_message);
+  class_realloc(ppw->jacobian_approx,ppw->jacobian_approx,ppw->jacobian_size*MAX(ppw->ap_size,1)*sizeof(int),ppt->error_message);
+
+  ppw->jacobian_neq[index_jac] = neq;
+  for (index_ap=0; index_ap<ppw->ap_size; index_ap++)
+    ppw->jacobian_approx[index_jac*ppw->ap_size+index_ap] = ppw->approx[index_ap];
+
+  class_call(initialize_jacobian(&(ppw->jacobian[index_jac]),neq,ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
+
+  *jac = &(ppw->jacobian[index_jac]);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Structural sparsity pattern of the jacobian of perturbations_derivs()
+ * for the current approximation scheme, in the compressed column format
+ * expected by the ndf15 evolver.
+ *
+ * Multipoles l>=3 of the free-streaming hierarchies (photon temperature
+ * and polarization, ur, idr, dr, ncdm for each momentum bin) only
+ * couple to their neighbours l-1 and l+1, and nothing except the l=2
+ * multipole of the same hierarchy depends on l=3. All other variables
+ * (l<=2 multipoles, fluids, metric) are conservatively assumed to be
+ * coupled with each other through the Einstein equations. This is only
+ * implemented for scalar modes: for other modes, *has_pattern is set
+ * to _FALSE_ and the evolver detects the sparsity numerically.
+ *
+ * @param neq                      Input: number of equations
+ * @param max_nonzero              Input: maximum number of non-zero entries
+ * @param Ap                       Output: column pointers (size neq+1)
+ * @param Ai                       Output: row indices (size max_nonzero)
+ * @param has_pattern              Output: whether a pattern was found
+ * @param parameters_and_workspace Input: pointer to perturbations_parameters_and_workspace structure
+ * @param error_message            Output: error message
+ * @return the error status
+ */
+
+int perturbations_jacobian_pattern(
+                                   int neq,
+                                   int max_nonzero,
+                                   int * Ap,
+                                   int * Ai,
+                                   int * has_pattern,
+                                   void * parameters_and_workspace,
+                                   ErrorMsg error_message
+                                   ) {
+
+  struct perturbations_parameters_and_workspace * pppaw;
+  struct background * pba;
+  struct perturbations * ppt;
+  struct perturbations_workspace * ppw;
+  struct perturbations_vector * pv;
+  int index_md;
+
+  /* is_tail[index_pt] is 1 for multipoles 3 <= l < l_max of free-streaming hierarchies, 2 for l = l_max, 0 otherwise */
+  int * is_tail;
+  int * hierarchy_start;
+  int * hierarchy_size;
+  int hierarchy_num=0,hierarchy_max;
+  int index_h,index_pt,index_row,nz;
+  int n_ncdm,index_q,idx;
+
+  pppaw = parameters_and_workspace;
+  pba = pppaw->pba;
+  ppt = pppaw->ppt;
+  ppw = pppaw->ppw;
+  pv = ppw->pv;
+  index_md = pppaw->index_md;
+
+  *has_pattern = _FALSE_;
+
+  if (!_scalars_)
+    return _SUCCESS_;
+
+  class_test(neq != pv->pt_size,
+             error_message,
+             "inconsistent number of equations: %d instead of %d",neq,pv->pt_size);
+
+  /** - list the tails (l >= 3) of all free-streaming hierarchies present in the current vector of perturbations */
+
+  /* at most five massless hierarchies, plus one per ncdm momentum bin */
+  hierarchy_max = 5;
+  if (pba->has_ncdm == _TRUE_) {
+    for (n_ncdm=0; n_ncdm < pv->N_ncdm; n_ncdm++)
+      hierarchy_max += pv->q_size_ncdm[n_ncdm];
+  }
+
+  class_alloc(hierarchy_start,2*hierarchy_max*sizeof(int),error_message);
+  hierarchy_size = hierarchy_start+hierarchy_max;
+
+  if ((ppw->approx[ppw->index_ap_rsa] == (int)rsa_off) && (ppw->approx[ppw->index_ap_tca] == (int)tca_off)) {
+    hierarchy_start[hierarchy_num] = pv->index_pt_l3_g;
+    hierarchy_size[hierarchy_num++] = pv->l_max_g-2;
+    hierarchy_start[hierarchy_num] = pv->index_pt_pol3_g;
+    hierarchy_size[hierarchy_num++] = pv->l_max_pol_g-2;
+  }
+
+  if (pba->has_dr == _TRUE_) {
+    hierarchy_start[hierarchy_num] = pv->index_pt_F0_dr+3;
+    hierarchy_size[hierarchy_num++] = pv->l_max_dr-2;
+  }
+
+  if ((pba->has_ur == _TRUE_) && (ppw->approx[ppw->index_ap_rsa] == (int)rsa_off) && (ppw->approx[ppw->index_ap_ufa] == (int)ufa_off)) {
+    hierarchy_start[hierarchy_num] = pv->index_pt_l3_ur;
+    hierarchy_size[hierarchy_num++] = pv->l_max_ur-2;
+  }
+
+  if ((pba->has_idr == _TRUE_) && (ppt->idr_nature == idr_free_streaming)) {
+    if ((ppw->approx[ppw->index_ap_rsa_idr] == (int)rsa_idr_off) &&
+        ((pba->has_idm_dr == _FALSE_) || (ppw->approx[ppw->index_ap_tca_idm_dr] == (int)tca_idm_dr_off))) {
+      hierarchy_start[hierarchy_num] = pv->index_pt_l3_idr;
+      hierarchy_size[hierarchy_num++] = pv->l_max_idr-2;
+    }
+  }
+
+  if ((pba->has_ncdm == _TRUE_) && (ppw->approx[ppw->index_ap_ncdmfa] == (int)ncdmfa_off)) {
+    idx = pv->index_pt_psi0_ncdm1;
+    for (n_ncdm=0; n_ncdm < pv->N_ncdm; n_ncdm++) {
+      for (index_q=0; index_q < pv->q_size_ncdm[n_ncdm]; index_q++) {
+        hierarchy_start[hierarchy_num] = idx+3;
+        hierarchy_size[hierarchy_num++] = pv->l_max_ncdm[n_ncdm]-2;
+        idx += pv->l_max_ncdm[n_ncdm]+1;
+      }
+    }
+  }
+
+  class_calloc(is_tail,neq,sizeof(int),error_message);
 
-/**
- * Free the perturbations_workspace structure (with the exception of the
- * perturbations_vector '-->pv' field, which is freed separately in
- * perturbations_vector_free).
- *
- * @param ppt        Input: pointer to the perturbation structure
- * @param index_md Input: index of mode under consideration (scalar/.../tensor)
- * @param ppw        Input: pointer to perturbations_workspace structure to be freed
- * @return the error status
- */
+  for (index_h=0; index_h<hierarchy_num; index_h++) {
+    for (index_pt=hierarchy_start[index_h]; index_pt<hierarchy_start[index_h]+hierarchy_size[index_h]-1; index_pt++)
+      is_tail[index_pt] = 1;
+    is_tail[hierarchy_start[index_h]+hierarchy_size[index_h]-1] = 2;
+  }
 
-int perturbations_workspace_free (
-                            struct perturbations * ppt,
-                            int index_md,
-                            struct perturbations_workspace * ppw
-                            ) {
+  free(hierarchy_start);
 
-  free(ppw->s_l);
-  free(ppw->pvecback);
-  free(ppw->pvecthermo);
-  free(ppw->pvecmetric);
-  if (ppw->ap_size > 0)
-    free(ppw->approx);
+  /** - fill the pattern column by column. The row of a tail multipole
+      depends on the multipoles l-1, l and l+1 (the latter if l <
+      l_max) of the same hierarchy; the row of a non-tail variable
+      depends on all non-tail variables and on the l=3 multipole
+      following it, if any */
 
-  if (_scalars_) {
+  nz = 0;
+  Ap[0] = 0;
+  *has_pattern = _TRUE_;
 
-    if ((ppt->has_density_transfers == _TRUE_) || (ppt->has_velocity_transfers == _TRUE_) || (ppt->has_source_delta_m == _TRUE_)) {
-      free(ppw->delta_ncdm);
-      free(ppw->theta_ncdm);
-      free(ppw->shear_ncdm);
+  for (index_pt=0; (index_pt<neq) && (*has_pattern == _TRUE_); index_pt++) {
+
+    if (is_tail[index_pt] == 0) {
+      for (index_row=0; index_row<neq; index_row++) {
+        if ((is_tail[index_row] == 0) || (index_row == index_pt+1)) {
+          if (nz >= max_nonzero) {
+            *has_pattern = _FALSE_;
+            break;
+          }
+          Ai[nz++] = index_row;
+        }
+      }
     }
+    else {
+      if (nz+3 > max_nonzero) {
+        *has_pattern = _FALSE_;
+        break;
+      }
+      /* a tail multipole is always preceded by a multipole of the same hierarchy */
+      if (is_tail[index_pt-1] != 2)
+        Ai[nz++] = index_pt-1;
+      Ai[nz++] = index_pt;
+      if ((index_pt+1 < neq) && (is_tail[index_pt+1] != 0))
+        Ai[nz++] = index_pt+1;
+    }
+
+    Ap[index_pt+1] = nz;
   }
 
-  free(ppw);
+  free(is_tail);
 
   return _SUCCESS_;
 }
@@ -2765,9 +4489,22 @@ int perturbations_solve(
   /* function pointer to ODE evolver and names of possible evolvers */
 
   extern int evolver_rk();
-  extern int evolver_ndf15();
+  extern int evolver_rk_dense();
   int (*generic_evolver)();
 
+  /* function computing the derivatives, possibly specialised for the species present */
+  int (*derivs)();
+
+  /* optional information passed to the ndf15 evolver */
+  struct ndf15_options ndf15_opt;
+
+  /* statistics of the ODE evolver within the current interval, if requested */
+  struct perturbations_solver_statistics * pss;
+  int stepstat[6],index_stat;
+#ifdef _OPENMP
+  double tstart;
+#endif
+
 
   /* Related to the perturbation output */
   int (*perhaps_print_variables)();
@@ -2790,6 +4527,9 @@ int perturbations_solve(
     for (l = 0; l<=ppw->max_l_max; l++){
       ppw->s_l[l] = sqrt(MAX(1.0-pba->K*(l*l-1.0)/k/k,0.));
     }
+    class_call(perturbations_hierarchy_coefficients(ppw),
+               ppt->error_message,
+               ppt->error_message);
   }
 
   /** - maximum value of tau for which sources are calculated for this wavenumber */
@@ -2944,6 +4684,7 @@ int perturbations_solve(
                                                  pth,
                                                  ppt,
                                                  index_md,
+                                                 index_k,
                                                  k,
                                                  ppw,
                                                  tau,
@@ -2958,6 +4699,14 @@ int perturbations_solve(
 
   free(interval_number_of);
 
+  if (ppt->store_solver_statistics == _TRUE_) {
+    class_calloc(ppt->solver_statistics[index_md][index_ic*ppt->k_size[index_md]+index_k],
+                 interval_number,
+                 sizeof(struct perturbations_solver_statistics),
+                 ppt->error_message);
+    ppt->solver_statistics_size[index_md][index_ic*ppt->k_size[index_md]+index_k] = interval_number;
+  }
+
   /** - fill the structure containing all fixed parameters, indices
       and workspaces needed by perturbations_derivs */
 
@@ -2974,6 +4723,12 @@ int perturbations_solve(
   ppaw.ppw->last_index_back = 0;
   ppaw.ppw->last_index_thermo = 0;
 
+  /** - choose the right-hand side of the equations, once for all intervals */
+
+  class_call(perturbations_derivs_select(ppr,pba,&derivs),
+             ppt->error_message,
+             ppt->error_message);
+
   /** - check whether we need to print perturbations to a file for this wavenumber */
 
   perhaps_print_variables = NULL;
@@ -2985,6 +4740,12 @@ int perturbations_solve(
     }
   }
 
+  if ((ppw->index_ikout >= 0) && (ppt->stream_perturbations == _TRUE_)) {
+    class_call(perturbations_stream_open(ppt,index_md,index_ic,ppw),
+               ppt->error_message,
+               ppt->error_message);
+  }
+
   /** - loop over intervals over which approximation scheme is uniform. For each interval: */
 
   for (index_interval=0; index_interval<interval_number; index_interval++) {
@@ -3029,38 +4790,123 @@ int perturbations_solve(
 
     /** - --> (d) integrate the perturbations over the current interval. */
 
+    if (ppt->store_solver_statistics == _TRUE_) {
+      ppw->derivs_calls = 0;
+      for (index_stat=0; index_stat<6; index_stat++)
+        stepstat[index_stat] = 0;
+#ifdef _OPENMP
+      tstart = omp_get_wtime();
+#endif
+    }
+
     if(ppr->evolver == rk){
-      generic_evolver = evolver_rk;
+      if (ppr->evolver_rk_dense_output == _TRUE_)
+        generic_evolver = evolver_rk_dense;
+      else
+        generic_evolver = evolver_rk;
+
+      class_call(generic_evolver(derivs,
+                                 interval_limit[index_interval],
+                                 interval_limit[index_interval+1],
+                                 ppw->pv->y,
+                                 ppw->pv->used_in_sources,
+                                 ppw->pv->pt_size,
+                                 &ppaw,
+                                 ppr->tol_perturbations_integration,
+                                 ppr->smallest_allowed_variation,
+                                 perturbations_timescale,
+                                 ppr->perturbations_integration_stepsize,
+                                 ppt->tau_sampling,
+                                 tau_actual_size,
+                                 perturbations_sources,
+                                 perhaps_print_variables,
+                                 ppt->error_message),
+                 ppt->error_message,
+                 ppt->error_message);
     }
     else{
-      generic_evolver = evolver_ndf15;
-    }
-
-    class_call(generic_evolver(perturbations_derivs,
-                               interval_limit[index_interval],
-                               interval_limit[index_interval+1],
-                               ppw->pv->y,
-                               ppw->pv->used_in_sources,
-                               ppw->pv->pt_size,
-                               &ppaw,
-                               ppr->tol_perturbations_integration,
-                               ppr->smallest_allowed_variation,
-                               perturbations_timescale,
-                               ppr->perturbations_integration_stepsize,
-                               ppt->tau_sampling,
-                               tau_actual_size,
-                               perturbations_sources,
-                               perhaps_print_variables,
-                               ppt->error_message),
-               ppt->error_message,
-               ppt->error_message);
+
+      /* the ndf15 (or rosenbrock) evolver can skip the search for the jacobian sparsity if we provide it */
+      if (ppr->perturbations_jacobian_pattern == _TRUE_)
+        ndf15_opt.jacobian_pattern = perturbations_jacobian_pattern;
+      else
+        ndf15_opt.jacobian_pattern = NULL;
+
+      /* reuse the jacobian structure of the previous wavenumber with the same approximation scheme */
+      if (ppr->perturbations_reuse_jacobian == _TRUE_) {
+        class_call(perturbations_workspace_jacobian(ppt,ppw,&(ndf15_opt.jac)),
+                   ppt->error_message,
+                   ppt->error_message);
+      }
+      else {
+        ndf15_opt.jac = NULL;
+      }
+
+      /* collect the step statistics of the evolver, if requested */
+      if (ppt->store_solver_statistics == _TRUE_)
+        ndf15_opt.stepstat = stepstat;
+      else
+        ndf15_opt.stepstat = NULL;
+
+      /* the rosenbrock evolver accepts the same options as ndf15 */
+      if (ppr->evolver == rosenbrock)
+        generic_evolver = evolver_rosenbrock_with_options;
+      else
+        generic_evolver = evolver_ndf15_with_options;
+
+      class_call(generic_evolver(derivs,
+                                 interval_limit[index_interval],
+                                 interval_limit[index_interval+1],
+                                 ppw->pv->y,
+                                 ppw->pv->used_in_sources,
+                                 ppw->pv->pt_size,
+                                 &ppaw,
+                                 ppr->tol_perturbations_integration,
+                                 ppr->smallest_allowed_variation,
+                                 perturbations_timescale,
+                                 ppr->perturbations_integration_stepsize,
+                                 ppt->tau_sampling,
+                                 tau_actual_size,
+                                 perturbations_sources,
+                                 perhaps_print_variables,
+                                 &ndf15_opt,
+                                 ppt->error_message),
+                 ppt->error_message,
+                 ppt->error_message);
+    }
+
+    /** - --> (e) if requested, store the work done by the evolver over this interval */
+
+    if (ppt->store_solver_statistics == _TRUE_) {
+
+      pss = &(ppt->solver_statistics[index_md][index_ic*ppt->k_size[index_md]+index_k][index_interval]);
+
+      pss->tau_start = interval_limit[index_interval];
+      pss->tau_end = interval_limit[index_interval+1];
+
+      class_call(perturbations_solver_statistics_fill(pba,
+                                                      ppt,
+                                                      index_md,
+                                                      ppw,
+                                                      stepstat,
+                                                      pss),
+                 ppt->error_message,
+                 ppt->error_message);
+
+#ifdef _OPENMP
+      pss->wall_time = omp_get_wtime()-tstart;
+#endif
+    }
 
   }
 
-  /** - if perturbations were printed in a file, close the file */
+  /** - if perturbations were streamed to a file, write the last rows and close the file */
 
-  //if (perhaps_print_variables != NULL)
-  //  fclose(ppw->perturbations_output_file);
+  if (ppw->perturbations_output_file != NULL) {
+    class_call(perturbations_stream_close(ppt,ppw),
+               ppt->error_message,
+               ppt->error_message);
+  }
 
   /** - fill the source terms array with zeros for all times between
       the last integrated time tau_max and tau_today. */
@@ -3089,6 +4935,59 @@ int perturbations_solve(
   return _SUCCESS_;
 }
 
+/**
+ * Fill the statistics of the ODE evolver for the interval that has
+ * just been integrated by perturbations_solve(): approximation scheme,
+ * number of equations, number of calls to perturbations_derivs()
+ * counted in the workspace, and step statistics returned by the ndf15
+ * evolver (left to zero with the rk evolver).
+ *
+ * @param pba      Input: pointer to background structure
+ * @param ppt      Input: pointer to the perturbation structure
+ * @param index_md Input: index of mode under consideration (scalar/.../tensor)
+ * @param ppw      Input: pointer to perturbations_workspace structure of this wavenumber
+ * @param stepstat Input: step statistics of evolver_ndf15_with_options() over the interval
+ * @param pss      Output: statistics of the interval
+ * @return the error status
+ */
+
+int perturbations_solver_statistics_fill(
+                                         struct background * pba,
+                                         struct perturbations * ppt,
+                                         int index_md,
+                                         struct perturbations_workspace * ppw,
+                                         int * stepstat,
+                                         struct perturbations_solver_statistics * pss
+                                         ) {
+
+  pss->tca_on = (ppw->approx[ppw->index_ap_tca] == (int)tca_on);
+  pss->rsa_on = (ppw->approx[ppw->index_ap_rsa] == (int)rsa_on);
+  pss->tca_idm_dr_on = _FALSE_;
+  pss->rsa_idr_on = _FALSE_;
+  pss->ufa_on = _FALSE_;
+  pss->ncdmfa_on = _FALSE_;
+
+  if (_scalars_) {
+    if (pba->has_idm_dr == _TRUE_)
+      pss->tca_idm_dr_on = (ppw->approx[ppw->index_ap_tca_idm_dr] == (int)tca_idm_dr_on);
+    if (pba->has_idr == _TRUE_)
+      pss->rsa_idr_on = (ppw->approx[ppw->index_ap_rsa_idr] == (int)rsa_idr_on);
+    if (pba->has_ur == _TRUE_)
+      pss->ufa_on = (ppw->approx[ppw->index_ap_ufa] == (int)ufa_on);
+    if (pba->has_ncdm == _TRUE_)
+      pss->ncdmfa_on = (ppw->approx[ppw->index_ap_ncdmfa] == (int)ncdmfa_on);
+  }
+
+  pss->pt_size = ppw->pv->pt_size;
+  pss->derivs_calls = ppw->derivs_calls;
+  pss->accepted_steps = stepstat[0];
+  pss->rejected_steps = stepstat[1];
+  pss->jacobian_evaluations = stepstat[3];
+  pss->lu_decompositions = stepstat[4];
+
+  return _SUCCESS_;
+}
+
 /**
  * Fill array of strings with the name of the 'k_output_values'
  * functions (transfer functions as a function of time, for fixed
@@ -3310,7 +5209,8 @@ int perturbations_find_approximation_number(
  * @param pth                Input: pointer to the thermodynamics structure
  * @param ppt                Input: pointer to the perturbation structure
  * @param index_md           Input: index of mode under consideration (scalar/.../tensor)
- * @param k                  Input: index of wavenumber
+ * @param index_k            Input: index of wavenumber
+ * @param k                  Input: wavenumber
  * @param ppw                Input: pointer to perturbations_workspace structure containing index values and workspaces
  * @param tau_ini            Input: initial time of the perturbation integration
  * @param tau_end            Input: final time of the perturbation integration
@@ -3328,6 +5228,7 @@ int perturbations_find_approximation_switches(
                                         struct thermodynamics * pth,
                                         struct perturbations * ppt,
                                         int index_md,
+                                        int index_k,
                                         double k,
                                         struct perturbations_workspace * ppw,
                                         double tau_ini,
@@ -3402,6 +5303,26 @@ int perturbations_find_approximation_switches(
 
           lower_bound=tau_min;
           upper_bound=tau_end;
+
+          /* with a warm start, first try a narrow bracket around the
+             time of the same switch in the previous run */
+          if (ppt->switches_previous != NULL) {
+            class_call(perturbations_switch_bracket(ppr,
+                                                    pba,
+                                                    pth,
+                                                    ppt,
+                                                    index_md,
+                                                    k,
+                                                    ppw,
+                                                    index_ap,
+                                                    index_switch,
+                                                    flag_ini,
+                                                    &lower_bound,
+                                                    &upper_bound),
+                       ppt->error_message,
+                       ppt->error_message);
+          }
+
           mid = 0.5*(lower_bound+upper_bound);
 
           while (upper_bound - lower_bound > precision) {
@@ -3429,6 +5350,13 @@ int perturbations_find_approximation_switches(
           }
 
           unsorted_tau_switch[index_switch_tot]=mid;
+
+          /* keep it for the warm start of the next run */
+          if ((ppt->switches != NULL) && (index_switch_tot < _PERTURBATIONS_SWITCHES_MAX_)) {
+            ppt->switches[index_md].ap[index_k*_PERTURBATIONS_SWITCHES_MAX_+index_switch_tot] = index_ap;
+            ppt->switches[index_md].tau[index_k*_PERTURBATIONS_SWITCHES_MAX_+index_switch_tot] = mid;
+          }
+
           index_switch_tot++;
 
           tau_min=mid;
@@ -3583,6 +5511,114 @@ int perturbations_find_approximation_switches(
   return _SUCCESS_;
 }
 
+
+/**
+ * With a warm start, narrow the bracket in which
+ * perturbations_find_approximation_switches() looks for a switch of
+ * approximation, around the time of the same switch (same
+ * approximation, same rank) found by the previous run at the closest
+ * wavenumber. The narrow bracket is only used if the approximation is
+ * checked to switch inside it; otherwise, or if the previous run did
+ * not find this switch, the bracket is left unchanged.
+ *
+ * @param ppr          Input: pointer to precision structure
+ * @param pba          Input: pointer to background structure
+ * @param pth          Input: pointer to the thermodynamics structure
+ * @param ppt          Input: pointer to the perturbation structure
+ * @param index_md     Input: index of mode under consideration (scalar/.../tensor)
+ * @param k            Input: wavenumber
+ * @param ppw          Input: pointer to perturbations_workspace structure containing index values and workspaces
+ * @param index_ap     Input: index of the approximation
+ * @param index_switch Input: rank of the switch among those of this approximation
+ * @param flag_ini     Input: value of the approximation at the initial time
+ * @param lower_bound  Input/Output: time before the switch
+ * @param upper_bound  Input/Output: time after the switch
+ * @return the error status
+ */
+
+int perturbations_switch_bracket(
+                                 struct precision * ppr,
+                                 struct background * pba,
+                                 struct thermodynamics * pth,
+                                 struct perturbations * ppt,
+                                 int index_md,
+                                 double k,
+                                 struct perturbations_workspace * ppw,
+                                 int index_ap,
+                                 int index_switch,
+                                 int flag_ini,
+                                 double * lower_bound,
+                                 double * upper_bound
+                                 ) {
+
+  struct perturbations_switches * psw = &(ppt->switches_previous[index_md]);
+  int index_k, index_k_min, index_k_max, index, rank;
+  double tau_previous = 0.;
+  double lower, upper;
+
+  if (psw->k_size == 0)
+    return _SUCCESS_;
+
+  /** - closest wavenumber of the previous run */
+
+  index_k_min = 0;
+  index_k_max = psw->k_size-1;
+  while (index_k_max-index_k_min > 1) {
+    index_k = (index_k_min+index_k_max)/2;
+    if (psw->k[index_k] > k)
+      index_k_max = index_k;
+    else
+      index_k_min = index_k;
+  }
+  index_k = (fabs(psw->k[index_k_max]-k) < fabs(psw->k[index_k_min]-k)) ? index_k_max : index_k_min;
+
+  /** - time of the same switch in the previous run */
+
+  rank = 0;
+  for (index = index_k*_PERTURBATIONS_SWITCHES_MAX_;
+       (index < (index_k+1)*_PERTURBATIONS_SWITCHES_MAX_) && (psw->ap[index] >= 0);
+       index++) {
+    if (psw->ap[index] == index_ap) {
+      if (rank == index_switch) {
+        tau_previous = psw->tau[index];
+        break;
+      }
+      rank++;
+    }
+  }
+
+  if ((tau_previous <= *lower_bound) || (tau_previous >= *upper_bound))
+    return _SUCCESS_;
+
+  /** - check that the approximation has not switched at the lower end
+      of the narrow bracket, and has switched at its upper end */
+
+  lower = MAX(*lower_bound,tau_previous*(1.-ppr->perturbations_switch_bracket));
+  upper = MIN(*upper_bound,tau_previous*(1.+ppr->perturbations_switch_bracket));
+
+  if (lower > *lower_bound) {
+    class_call(perturbations_approximations(ppr,pba,pth,ppt,index_md,k,lower,ppw),
+               ppt->error_message,
+               ppt->error_message);
+    if (ppw->approx[index_ap] > flag_ini+index_switch)
+      return _SUCCESS_;
+  }
+
+  if (upper < *upper_bound) {
+    class_call(perturbations_approximations(ppr,pba,pth,ppt,index_md,k,upper,ppw),
+               ppt->error_message,
+               ppt->error_message);
+    if (ppw->approx[index_ap] <= flag_ini+index_switch)
+      return _SUCCESS_;
+  }
+
+  *lower_bound = lower;
+  *upper_bound = upper;
+
+  return _SUCCESS_;
+
+}
+
 /**
  * Initialize the field '-->pv' of a perturbations_workspace structure, which
  * is a perturbations_vector structure. This structure contains indices and
@@ -3649,14 +5685,17 @@ int perturbations_vector_init(
   int n_ncdm,index_q,ncdm_l_size;
   double rho_plus_p_ncdm,q,q2,epsilon,a,factor;
 
-  /** - allocate a new perturbations_vector structure to which ppw-->pv will point at the end of the routine */
+  /** - take from the workspace pool the perturbations_vector
+      structure to which ppw-->pv will point at the end of the routine:
+      the first one for initial conditions, otherwise the one not
+      holding the current perturbations. Its arrays are only
+      (re)allocated when they are too small, so that after the first
+      wavenumber no memory allocation takes place here */
 
-  class_alloc(ppv,sizeof(struct perturbations_vector),ppt->error_message);
-
-  /** - initialize pointers to NULL (they will be allocated later if
-      needed), relevant for perturbations_vector_free() */
-  ppv->l_max_ncdm = NULL;
-  ppv->q_size_ncdm = NULL;
+  if ((pa_old == NULL) || (ppw->pv != ppw->pv_pool[0]))
+    ppv = ppw->pv_pool[0];
+  else
+    ppv = ppw->pv_pool[1];
 
   /** - define all indices in this new vector (depends on approximation scheme, described by the input structure ppw-->pa) */
 
@@ -3804,8 +5843,10 @@ int perturbations_vector_init(
     if (pba->has_ncdm == _TRUE_) {
       ppv->index_pt_psi0_ncdm1 = index_pt; /* density of ultra-relativistic neutrinos/relics */
       ppv->N_ncdm = pba->N_ncdm;
-      class_alloc(ppv->l_max_ncdm,ppv->N_ncdm*sizeof(double),ppt->error_message);
-      class_alloc(ppv->q_size_ncdm,ppv->N_ncdm*sizeof(double),ppt->error_message);
+      if (ppv->l_max_ncdm == NULL) {
+        class_alloc(ppv->l_max_ncdm,ppv->N_ncdm*sizeof(double),ppt->error_message);
+        class_alloc(ppv->q_size_ncdm,ppv->N_ncdm*sizeof(double),ppt->error_message);
+      }
 
       for(n_ncdm = 0; n_ncdm < pba->N_ncdm; n_ncdm++){
         // Set value of ppv->l_max_ncdm:
@@ -3918,8 +5959,10 @@ int perturbations_vector_init(
     if (ppt->evolve_tensor_ncdm == _TRUE_) {
       ppv->index_pt_psi0_ncdm1 = index_pt;
       ppv->N_ncdm = pba->N_ncdm;
-      class_alloc(ppv->l_max_ncdm,ppv->N_ncdm*sizeof(double),ppt->error_message);
-      class_alloc(ppv->q_size_ncdm,ppv->N_ncdm*sizeof(double),ppt->error_message);
+      if (ppv->l_max_ncdm == NULL) {
+        class_alloc(ppv->l_max_ncdm,ppv->N_ncdm*sizeof(double),ppt->error_message);
+        class_alloc(ppv->q_size_ncdm,ppv->N_ncdm*sizeof(double),ppt->error_message);
+      }
 
       for(n_ncdm = 0; n_ncdm < pba->N_ncdm; n_ncdm++){
         // Set value of ppv->l_max_ncdm:
@@ -3948,9 +5991,15 @@ int perturbations_vector_init(
   /** - allocate vectors for storing the values of all these
       quantities and their time-derivatives at a given time */
 
-  class_calloc(ppv->y,ppv->pt_size,sizeof(double),ppt->error_message);
-  class_alloc(ppv->dy,ppv->pt_size*sizeof(double),ppt->error_message);
-  class_alloc(ppv->used_in_sources,ppv->pt_size*sizeof(int),ppt->error_message);
+  if (ppv->pt_size > ppv->pt_capacity) {
+    class_realloc(ppv->y,ppv->y,ppv->pt_size*sizeof(double),ppt->error_message);
+    class_realloc(ppv->dy,ppv->dy,ppv->pt_size*sizeof(double),ppt->error_message);
+    class_realloc(ppv->used_in_sources,ppv->used_in_sources,ppv->pt_size*sizeof(int),ppt->error_message);
+    ppv->pt_capacity = ppv->pt_size;
+  }
+
+  for (index_pt=0; index_pt<ppv->pt_size; index_pt++)
+    ppv->y[index_pt] = 0.;
 
   /** - specify which perturbations are needed in the evaluation of source terms */
 
@@ -5039,7 +7088,9 @@ int perturbations_vector_init(
 }
 
 /**
- * Free the perturbations_vector structure.
+ * Free the perturbations_vector structure. Vectors belonging to the
+ * pool of a perturbations_workspace are only released, and kept
+ * allocated until perturbations_workspace_free().
  *
  * @param pv        Input: pointer to perturbations_vector structure to be freed
  * @return the error status
@@ -5049,6 +7100,9 @@ int perturbations_vector_free(
                         struct perturbations_vector * pv
                         ) {
 
+  if (pv->is_pooled == _TRUE_)
+    return _SUCCESS_;
+
   if (pv->l_max_ncdm != NULL) free(pv->l_max_ncdm);
   if (pv->q_size_ncdm != NULL) free(pv->q_size_ncdm);
   free(pv->y);
@@ -6097,6 +8151,10 @@ int perturbations_timescale(
   struct perturbations_workspace * ppw;
   double * pvecback;
   double * pvecthermo;
+  /* the only background and thermodynamics quantities needed here (H_prime
+     is used by thermodynamics_at_z_columns() above z_initial) */
+  int bg_columns[3];
+  int th_columns[1];
 
   /** - extract the fields of the parameter_and_workspace input structure */
   pppaw = parameters_and_workspace;
@@ -6106,6 +8164,10 @@ int perturbations_timescale(
   ppw = pppaw->ppw;
   pvecback = ppw->pvecback;
   pvecthermo = ppw->pvecthermo;
+  bg_columns[0] = pba->index_bg_a;
+  bg_columns[1] = pba->index_bg_H;
+  bg_columns[2] = pba->index_bg_H_prime;
+  th_columns[0] = pth->index_th_dkappa;
 
   /** - compute Fourier mode time scale = \f$ \tau_k = 1/k \f$ */
 
@@ -6118,7 +8180,7 @@ int perturbations_timescale(
   /** - evaluate background quantities with background_at_tau() and
       Hubble time scale \f$ \tau_h = a/a' \f$ */
 
-  class_call(background_at_tau(pba,tau, normal_info, ppw->inter_mode, &(ppw->last_index_back), pvecback),
+  class_call(background_at_tau_columns(pba,tau,bg_columns,3,&(ppw->last_index_back),pvecback),
              pba->error_message,
              error_message);
 
@@ -6139,13 +8201,14 @@ int perturbations_timescale(
 
     if (ppw->approx[ppw->index_ap_tca] == (int)tca_off) {
 
-      class_call(thermodynamics_at_z(pba,
-                                     pth,
-                                     1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
-                                     ppw->inter_mode,
-                                     &(ppw->last_index_thermo),
-                                     pvecback,
-                                     pvecthermo),
+      class_call(thermodynamics_at_z_columns(pba,
+                                             pth,
+                                             1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
+                                             th_columns,
+                                             1,
+                                             &(ppw->last_index_thermo),
+                                             pvecback,
+                                             pvecthermo),
                  pth->error_message,
                  error_message);
 
@@ -6170,13 +8233,14 @@ int perturbations_timescale(
 
     if (ppw->approx[ppw->index_ap_tca] == (int)tca_off) {
 
-      class_call(thermodynamics_at_z(pba,
-                                     pth,
-                                     1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
-                                     ppw->inter_mode,
-                                     &(ppw->last_index_thermo),
-                                     pvecback,
-                                     pvecthermo),
+      class_call(thermodynamics_at_z_columns(pba,
+                                             pth,
+                                             1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
+                                             th_columns,
+                                             1,
+                                             &(ppw->last_index_thermo),
+                                             pvecback,
+                                             pvecthermo),
                  pth->error_message,
                  error_message);
 
@@ -6200,13 +8264,14 @@ int perturbations_timescale(
 
     if (ppw->approx[ppw->index_ap_tca] == (int)tca_off) {
 
-      class_call(thermodynamics_at_z(pba,
-                                     pth,
-                                     1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
-                                     ppw->inter_mode,
-                                     &(ppw->last_index_thermo),
-                                     pvecback,
-                                     pvecthermo),
+      class_call(thermodynamics_at_z_columns(pba,
+                                             pth,
+                                             1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
+                                             th_columns,
+                                             1,
+                                             &(ppw->last_index_thermo),
+                                             pvecback,
+                                             pvecthermo),
                  pth->error_message,
                  error_message);
 
@@ -6225,6 +8290,70 @@ int perturbations_timescale(
   return _SUCCESS_;
 }
 
+/**
+ * Species of the background structure seen by the perturbation
+ * equations, for the generic versions of perturbations_derivs(),
+ * perturbations_einstein() and perturbations_total_stress_energy()
+ *
+ * @param pba Input: pointer to background structure
+ * @return the species flags
+ */
+
+static _FORCE_INLINE_ struct perturbations_species perturbations_species_of(
+                                                                           struct background * pba
+                                                                           ) {
+  struct perturbations_species sp;
+
+  sp.has_ncdm = pba->has_ncdm;
+  sp.has_fld = pba->has_fld;
+  sp.has_scf = pba->has_scf;
+  sp.has_idr = pba->has_idr;
+  sp.has_idm_dr = pba->has_idm_dr;
+  sp.has_dcdm = pba->has_dcdm;
+  sp.has_dr = pba->has_dr;
+
+  return sp;
+}
+
+static _FORCE_INLINE_ int perturbations_total_stress_energy_species(
+                                                                    struct precision * ppr,
+                                                                    struct background * pba,
+                                                                    struct thermodynamics * pth,
+                                                                    struct perturbations * ppt,
+                                                                    int index_md,
+                                                                    double k,
+                                                                    double * y,
+                                                                    struct perturbations_workspace * ppw,
+                                                                    struct perturbations_species sp
+                                                                    );
+
+/**
+ * Energy epsilon = sqrt(q^2+a^2 M^2) of all ncdm momentum bins at
+ * scale factor a, in the order of ppw->ncdm_q. They are computed in a
+ * single loop and kept in the workspace, since
+ * perturbations_total_stress_energy() and perturbations_derivs() need
+ * them at the same time.
+ *
+ * @param ppw Input/Output: pointer to perturbations_workspace structure
+ * @param a   Input: scale factor
+ * @return pointer to the energies of all bins
+ */
+
+static _FORCE_INLINE_ double * perturbations_ncdm_epsilon(
+                                                         struct perturbations_workspace * ppw,
+                                                         double a
+                                                         ) {
+  int index_bin;
+  double a2 = a*a;
+
+  if (ppw->ncdm_epsilon_a != a) {
+    for (index_bin=0; index_bin<ppw->ncdm_bin_size; index_bin++)
+      ppw->ncdm_epsilon[index_bin] = sqrt(ppw->ncdm_q[index_bin]*ppw->ncdm_q[index_bin]+a2*ppw->ncdm_M2[index_bin]);
+    ppw->ncdm_epsilon_a = a;
+  }
+
+  return ppw->ncdm_epsilon;
+}
 
 /**
  * Compute metric perturbations (those not integrated over time) using Einstein equations
@@ -6238,20 +8367,22 @@ int perturbations_timescale(
  * @param tau        Input: conformal time
  * @param y          Input: vector of perturbations (those integrated over time) (already allocated)
  * @param ppw        Input/Output: in output contains the updated metric perturbations
+ * @param sp         Input: species present (compile-time constants in the specialised versions of perturbations_derivs())
  * @return the error status
  */
 
-int perturbations_einstein(
-                     struct precision * ppr,
-                     struct background * pba,
-                     struct thermodynamics * pth,
-                     struct perturbations * ppt,
-                     int index_md,
-                     double k,
-                     double tau,
-                     double * y,
-                     struct perturbations_workspace * ppw
-                     ) {
+static _FORCE_INLINE_ int perturbations_einstein_species(
+                                                         struct precision * ppr,
+                                                         struct background * pba,
+                                                         struct thermodynamics * pth,
+                                                         struct perturbations * ppt,
+                                                         int index_md,
+                                                         double k,
+                                                         double tau,
+                                                         double * y,
+                                                         struct perturbations_workspace * ppw,
+                                                         struct perturbations_species sp
+                                                         ) {
   /** Summary: */
 
   /** - define local variables */
@@ -6270,7 +8401,7 @@ int perturbations_einstein(
   s2_squared = 1.-3.*pba->K/k2;
 
   /** - sum up perturbations from all species */
-  class_call(perturbations_total_stress_energy(ppr,pba,pth,ppt,index_md,k,y,ppw),
+  class_call(perturbations_total_stress_energy_species(ppr,pba,pth,ppt,index_md,k,y,ppw,sp),
              ppt->error_message,
              ppt->error_message);
 
@@ -6311,7 +8442,7 @@ int perturbations_einstein(
                    ppt->error_message);
       }
 
-      if ((pba->has_idr)&&(ppw->approx[ppw->index_ap_rsa_idr] == (int)rsa_idr_on)){
+      if ((sp.has_idr)&&(ppw->approx[ppw->index_ap_rsa_idr] == (int)rsa_idr_on)){
 
         class_call(perturbations_rsa_idr_delta_and_theta(ppr,pba,pth,ppt,k,y,a_prime_over_a,ppw->pvecthermo,ppw,ppt->error_message),
                    ppt->error_message,
@@ -6338,7 +8469,7 @@ int perturbations_einstein(
                    ppt->error_message);
       }
 
-      if ((pba->has_idr==_TRUE_)&&(ppw->approx[ppw->index_ap_rsa_idr] == (int)rsa_idr_on)) {
+      if ((sp.has_idr==_TRUE_)&&(ppw->approx[ppw->index_ap_rsa_idr] == (int)rsa_idr_on)) {
 
         class_call(perturbations_rsa_idr_delta_and_theta(ppr,pba,pth,ppt,k,y,a_prime_over_a,ppw->pvecthermo,ppw,ppt->error_message),
                    ppt->error_message,
@@ -6370,7 +8501,7 @@ int perturbations_einstein(
 
       }
 
-      if ((pba->has_idm_dr == _TRUE_)&&(ppw->approx[ppw->index_ap_tca_idm_dr] == (int)tca_idm_dr_on)){
+      if ((sp.has_idm_dr == _TRUE_)&&(ppw->approx[ppw->index_ap_tca_idm_dr] == (int)tca_idm_dr_on)){
 
         shear_idr = 0.5*8./15./ppw->pvecthermo[pth->index_th_dmu_idm_dr]/ppt->alpha_idm_dr[0]*(y[ppw->pv->index_pt_theta_idr]+k2*ppw->pvecmetric[ppw->index_mt_alpha]);
 
@@ -6457,16 +8588,66 @@ int perturbations_einstein(
 
 }
 
-int perturbations_total_stress_energy(
-                                struct precision * ppr,
-                                struct background * pba,
-                                struct thermodynamics * pth,
-                                struct perturbations * ppt,
-                                int index_md,
-                                double k,
-                                double * y,
-                                struct perturbations_workspace * ppw
-                                ) {
+/**
+ * Compute metric perturbations for the species of the background
+ * structure, see perturbations_einstein_species()
+ *
+ * @param ppr        Input: pointer to precision structure
+ * @param pba        Input: pointer to background structure
+ * @param pth        Input: pointer to thermodynamics structure
+ * @param ppt        Input: pointer to the perturbation structure
+ * @param index_md   Input: index of mode under consideration (scalar/.../tensor)
+ * @param k          Input: wavenumber
+ * @param tau        Input: conformal time
+ * @param y          Input: vector of perturbations (those integrated over time) (already allocated)
+ * @param ppw        Input/Output: in output contains the updated metric perturbations
+ * @return the error status
+ */
+
+int perturbations_einstein(
+                     struct precision * ppr,
+                     struct background * pba,
+                     struct thermodynamics * pth,
+                     struct perturbations * ppt,
+                     int index_md,
+                     double k,
+                     double tau,
+                     double * y,
+                     struct perturbations_workspace * ppw
+                     ) {
+
+  return perturbations_einstein_species(ppr,pba,pth,ppt,index_md,k,tau,y,ppw,perturbations_species_of(pba));
+
+}
+
+/**
+ * Sum up the energy density, pressure, velocity and shear
+ * perturbations of all species, and the sources of the Einstein
+ * equations that depend on them
+ *
+ * @param ppr        Input: pointer to precision structure
+ * @param pba        Input: pointer to background structure
+ * @param pth        Input: pointer to thermodynamics structure
+ * @param ppt        Input: pointer to the perturbation structure
+ * @param index_md   Input: index of mode under consideration (scalar/.../tensor)
+ * @param k          Input: wavenumber
+ * @param y          Input: vector of perturbations (those integrated over time)
+ * @param ppw        Input/Output: in output contains the total stress-energy perturbations
+ * @param sp         Input: species present (compile-time constants in the specialised versions of perturbations_derivs())
+ * @return the error status
+ */
+
+static _FORCE_INLINE_ int perturbations_total_stress_energy_species(
+                                                                    struct precision * ppr,
+                                                                    struct background * pba,
+                                                                    struct thermodynamics * pth,
+                                                                    struct perturbations * ppt,
+                                                                    int index_md,
+                                                                    double k,
+                                                                    double * y,
+                                                                    struct perturbations_workspace * ppw,
+                                                                    struct perturbations_species sp
+                                                                    ) {
   /** Summary: */
 
   /** - define local variables */
@@ -6493,6 +8674,9 @@ int perturbations_total_stress_energy(
   double rho_plus_p_ncdm;
   int index_q,n_ncdm,idx;
   double epsilon,q,q2,cg2_ncdm,w_ncdm,rho_ncdm_bg,p_ncdm_bg,pseudo_p_ncdm;
+  int index_bin;
+  double * epsilon_ncdm;
+  double q2w,q4w_over_epsilon;
   double w_fld,dw_over_da_fld,integral_fld;
   double gwncdm;
   double rho_relativistic;
@@ -6601,13 +8785,13 @@ int perturbations_total_stress_energy(
 
     /** - ---> (a.4.) interacting dark radiation */
 
-    if (pba->has_idr == _TRUE_) {
+    if (sp.has_idr == _TRUE_) {
       if (ppw->approx[ppw->index_ap_rsa_idr] == (int)rsa_idr_off) {
         delta_idr = y[ppw->pv->index_pt_delta_idr];
         theta_idr = y[ppw->pv->index_pt_theta_idr];
 
         if (ppt->idr_nature == idr_free_streaming){
-          if((pba->has_idm_dr == _TRUE_)&&(ppw->approx[ppw->index_ap_tca_idm_dr] == (int)tca_idm_dr_on)){
+          if((sp.has_idm_dr == _TRUE_)&&(ppw->approx[ppw->index_ap_tca_idm_dr] == (int)tca_idm_dr_on)){
             if(ppt->gauge == newtonian)
               shear_idr = 0.5*(8./15./ppw->pvecthermo[pth->index_th_dmu_idm_dr]/ppt->alpha_idm_dr[0]*(y[ppw->pv->index_pt_theta_idr]));
             else
@@ -6666,7 +8850,7 @@ int perturbations_total_stress_energy(
     }
 
     /* idm_dr contribution */
-    if (pba->has_idm_dr == _TRUE_) {
+    if (sp.has_idm_dr == _TRUE_) {
       ppw->delta_rho += ppw->pvecback[pba->index_bg_rho_idm_dr]*y[ppw->pv->index_pt_delta_idm_dr];
       ppw->rho_plus_p_theta += ppw->pvecback[pba->index_bg_rho_idm_dr]*y[ppw->pv->index_pt_theta_idm_dr];
       ppw->rho_plus_p_tot += ppw->pvecback[pba->index_bg_rho_idm_dr];
@@ -6682,7 +8866,7 @@ int perturbations_total_stress_energy(
     }
 
     /* dcdm contribution */
-    if (pba->has_dcdm == _TRUE_) {
+    if (sp.has_dcdm == _TRUE_) {
       ppw->delta_rho += ppw->pvecback[pba->index_bg_rho_dcdm]*y[ppw->pv->index_pt_delta_dcdm];
       ppw->rho_plus_p_theta += ppw->pvecback[pba->index_bg_rho_dcdm]*y[ppw->pv->index_pt_theta_dcdm];
 
@@ -6700,7 +8884,7 @@ int perturbations_total_stress_energy(
 
     /* ultra-relativistic decay radiation */
 
-    if (pba->has_dr == _TRUE_) {
+    if (sp.has_dr == _TRUE_) {
       /* We have delta_rho_dr = rho_dr * F0_dr / f, where F follows the
          convention in astro-ph/9907388 and f is defined as
          f = rho_dr*a^4/rho_crit_today. In CLASS density units
@@ -6727,7 +8911,7 @@ int perturbations_total_stress_energy(
     }
 
     /* interacting dark radiation */
-    if (pba->has_idr == _TRUE_) {
+    if (sp.has_idr == _TRUE_) {
       ppw->delta_rho += ppw->pvecback[pba->index_bg_rho_idr]*delta_idr;
       ppw->rho_plus_p_theta += 4./3.*ppw->pvecback[pba->index_bg_rho_idr]*theta_idr;
       if (ppt->idr_nature==idr_free_streaming)
@@ -6746,7 +8930,7 @@ int perturbations_total_stress_energy(
 
 
     /* non-cold dark matter contribution */
-    if (pba->has_ncdm == _TRUE_) {
+    if (sp.has_ncdm == _TRUE_) {
       idx = ppw->pv->index_pt_psi0_ncdm1;
       if(ppw->approx[ppw->index_ap_ncdmfa] == (int)ncdmfa_on){
         // The perturbations are evolved integrated:
@@ -6776,6 +8960,7 @@ int perturbations_total_stress_energy(
       }
       else{
         // We must integrate to find perturbations:
+        epsilon_ncdm = perturbations_ncdm_epsilon(ppw,a);
         for(n_ncdm=0; n_ncdm < pba->N_ncdm; n_ncdm++){
           rho_delta_ncdm = 0.0;
           rho_plus_p_theta_ncdm = 0.0;
@@ -6783,16 +8968,17 @@ int perturbations_total_stress_energy(
           delta_p_ncdm = 0.0;
           factor = pba->factor_ncdm[n_ncdm]/pow(a,4);
 
-          for (index_q=0; index_q < ppw->pv->q_size_ncdm[n_ncdm]; index_q ++) {
+          // the four sums over the momentum bins of this species in a single pass:
+          for (index_bin=ppw->ncdm_bin_start[n_ncdm]; index_bin < ppw->ncdm_bin_start[n_ncdm+1]; index_bin++) {
 
-            q = pba->q_ncdm[n_ncdm][index_q];
-            q2 = q*q;
-            epsilon = sqrt(q2+pba->M_ncdm[n_ncdm]*pba->M_ncdm[n_ncdm]*a2);
+            q = ppw->ncdm_q[index_bin];
+            q2w = ppw->ncdm_q2w[index_bin];
+            q4w_over_epsilon = q2w*q*q/epsilon_ncdm[index_bin];
 
-            rho_delta_ncdm += q2*epsilon*pba->w_ncdm[n_ncdm][index_q]*y[idx];
-            rho_plus_p_theta_ncdm += q2*q*pba->w_ncdm[n_ncdm][index_q]*y[idx+1];
-            rho_plus_p_shear_ncdm += q2*q2/epsilon*pba->w_ncdm[n_ncdm][index_q]*y[idx+2];
-            delta_p_ncdm += q2*q2/epsilon*pba->w_ncdm[n_ncdm][index_q]*y[idx];
+            rho_delta_ncdm += q2w*epsilon_ncdm[index_bin]*y[idx];
+            rho_plus_p_theta_ncdm += q2w*q*y[idx+1];
+            rho_plus_p_shear_ncdm += q4w_over_epsilon*y[idx+2];
+            delta_p_ncdm += q4w_over_epsilon*y[idx];
 
             //Jump to next momentum bin:
             idx+=(ppw->pv->l_max_ncdm[n_ncdm]+1);
@@ -6839,7 +9025,7 @@ int perturbations_total_stress_energy(
        from rho_plus_p_shear. So the contribution from the scalar field must be below all
        species with non-zero shear.
     */
-    if (pba->has_scf == _TRUE_) {
+    if (sp.has_scf == _TRUE_) {
 
       if (ppt->gauge == synchronous){
         delta_rho_scf =  1./3.*
@@ -6877,7 +9063,7 @@ int perturbations_total_stress_energy(
     /* add your extra species here */
 
     /* fluid contribution */
-    if (pba->has_fld == _TRUE_) {
+    if (sp.has_fld == _TRUE_) {
 
       class_call(background_w_fld(pba,a,&w_fld,&dw_over_da_fld,&integral_fld), pba->error_message, ppt->error_message);
       w_prime_fld = dw_over_da_fld * a_prime_over_a * a;
@@ -7047,7 +9233,7 @@ int perturbations_total_stress_energy(
         if (pba->has_ur == _TRUE_)
           rho_relativistic += ppw->pvecback[pba->index_bg_rho_ur];
 
-        if (pba->has_ncdm == _TRUE_) {
+        if (sp.has_ncdm == _TRUE_) {
           for(n_ncdm = 0; n_ncdm < pba->N_ncdm; n_ncdm++) {
             /* (3 p_ncdm1) is the "relativistic" contribution to rho_ncdm1 */
             rho_relativistic += 3.*ppw->pvecback[pba->index_bg_p_ncdm1+n_ncdm];
@@ -7096,6 +9282,36 @@ int perturbations_total_stress_energy(
   return _SUCCESS_;
 }
 
+/**
+ * Sum up the perturbations of all species present in the background
+ * structure, see perturbations_total_stress_energy_species()
+ *
+ * @param ppr        Input: pointer to precision structure
+ * @param pba        Input: pointer to background structure
+ * @param pth        Input: pointer to thermodynamics structure
+ * @param ppt        Input: pointer to the perturbation structure
+ * @param index_md   Input: index of mode under consideration (scalar/.../tensor)
+ * @param k          Input: wavenumber
+ * @param y          Input: vector of perturbations (those integrated over time)
+ * @param ppw        Input/Output: in output contains the total stress-energy perturbations
+ * @return the error status
+ */
+
+int perturbations_total_stress_energy(
+                                struct precision * ppr,
+                                struct background * pba,
+                                struct thermodynamics * pth,
+                                struct perturbations * ppt,
+                                int index_md,
+                                double k,
+                                double * y,
+                                struct perturbations_workspace * ppw
+                                ) {
+
+  return perturbations_total_stress_energy_species(ppr,pba,pth,ppt,index_md,k,y,ppw,perturbations_species_of(pba));
+
+}
+
 /**
  * Compute the source functions (three terms for temperature, one for
  * E or B modes, etc.)
@@ -7710,6 +9926,168 @@ int perturbations_sources(
 }
 
 
+/**
+ * Open the binary file receiving the perturbations of one of the
+ * k_output_values, when they are streamed instead of stored
+ * (stream_perturbations). The file is named
+ * <root>perturbations_k<index>_<s, v or t>.bin and contains the same
+ * rows and columns as the corresponding text or .npy file, as raw
+ * doubles in native byte order, without header: it can be read with
+ * numpy.fromfile(name).reshape(-1,number_of_columns), the column
+ * titles being written in the .dat file by the output module. Each
+ * wavenumber is integrated by a single thread, which therefore owns
+ * the file; for several initial conditions, the evolutions for each
+ * of them follow each other, as in the stored arrays.
+ *
+ * @param ppt      Input: pointer to perturbation structure
+ * @param index_md Input: index of mode under consideration
+ * @param index_ic Input: index of initial condition under consideration
+ * @param ppw      Input/Output: workspace of the thread, receiving the file and the row buffer
+ * @return the error status
+ */
+
+int perturbations_stream_open(
+                              struct perturbations * ppt,
+                              int index_md,
+                              int index_ic,
+                              struct perturbations_workspace * ppw
+                              ) {
+
+  FileName file_name;
+  char mode_letter;
+
+  if (_scalars_) {
+    mode_letter = 's';
+    ppw->stream_row_size = ppt->number_of_scalar_titles;
+  }
+  else if (_vectors_) {
+    mode_letter = 'v';
+    ppw->stream_row_size = ppt->number_of_vector_titles;
+  }
+  else {
+    mode_letter = 't';
+    ppw->stream_row_size = ppt->number_of_tensor_titles;
+  }
+
+  if (ppw->stream_buffer_size < _STREAM_BUFFER_ROWS_*ppw->stream_row_size) {
+    free(ppw->stream_buffer);
+    ppw->stream_buffer_size = _STREAM_BUFFER_ROWS_*ppw->stream_row_size;
+    class_alloc(ppw->stream_buffer,
+                ppw->stream_buffer_size*sizeof(double),
+                ppt->error_message);
+  }
+  ppw->stream_buffer_rows = 0;
+
+  sprintf(file_name,"%sperturbations_k%d_%c.bin",ppt->stream_root,ppw->index_ikout,mode_letter);
+  class_open(ppw->perturbations_output_file,
+             file_name,
+             (index_ic == 0) ? "wb" : "ab",
+             ppt->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write the rows buffered by perturbations_output_row() to the file
+ * opened by perturbations_stream_open().
+ *
+ * @param ppw           Input/Output: workspace of the thread
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int perturbations_stream_flush(
+                               struct perturbations_workspace * ppw,
+                               ErrorMsg error_message
+                               ) {
+
+  size_t size = (size_t)ppw->stream_buffer_rows*ppw->stream_row_size;
+
+  class_test(fwrite(ppw->stream_buffer,sizeof(double),size,ppw->perturbations_output_file) != size,
+             error_message,
+             "could not write the streamed perturbations for k_output_values number %d",
+             ppw->index_ikout);
+
+  ppw->stream_buffer_rows = 0;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write the last buffered rows and close the file opened by
+ * perturbations_stream_open().
+ *
+ * @param ppt Input: pointer to perturbation structure
+ * @param ppw Input/Output: workspace of the thread
+ * @return the error status
+ */
+
+int perturbations_stream_close(
+                               struct perturbations * ppt,
+                               struct perturbations_workspace * ppw
+                               ) {
+
+  class_call(perturbations_stream_flush(ppw,ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
+
+  fclose(ppw->perturbations_output_file);
+  ppw->perturbations_output_file = NULL;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Give the place of the next row of perturbations_print_variables():
+ * in the buffer of the thread if the perturbations are streamed
+ * (after writing the buffer if it is full), otherwise at the end of
+ * the array of the mode, which is then enlarged by one row.
+ *
+ * @param ppw           Input/Output: workspace of the thread
+ * @param data          Input/Output: array of stored rows (unused when streaming)
+ * @param size_data     Input/Output: number of doubles in this array
+ * @param row_size      Input: number of doubles per row
+ * @param dataptr       Output: where to write the row
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int perturbations_output_row(
+                             struct perturbations_workspace * ppw,
+                             double ** data,
+                             int * size_data,
+                             int row_size,
+                             double ** dataptr,
+                             ErrorMsg error_message
+                             ) {
+
+  if (ppw->perturbations_output_file != NULL) {
+    if (ppw->stream_buffer_rows == _STREAM_BUFFER_ROWS_) {
+      class_call(perturbations_stream_flush(ppw,error_message),
+                 error_message,
+                 error_message);
+    }
+    *dataptr = ppw->stream_buffer+ppw->stream_buffer_rows*row_size;
+    ppw->stream_buffer_rows++;
+    return _SUCCESS_;
+  }
+
+  if (*data == NULL){
+    class_alloc(*data,
+                sizeof(double)*row_size,
+                error_message);
+    *size_data = 0;
+  }
+  else{
+    *data = realloc(*data,
+                    sizeof(double)*(*size_data+row_size));
+  }
+  *dataptr = *data+*size_data;
+  *size_data += row_size;
+
+  return _SUCCESS_;
+}
+
 /**
  * When testing the code or a cosmological model, it can be useful to
  * output perturbations at each step of integration (and not just the
@@ -8109,22 +10487,16 @@ int perturbations_print_variables(double tau,
     }
 
     //    fprintf(ppw->perturbations_output_file," ");
-    /** - --> Handle (re-)allocation */
-    if (ppt->scalar_perturbations_data[ppw->index_ikout] == NULL){
-      class_alloc(ppt->scalar_perturbations_data[ppw->index_ikout],
-                  sizeof(double)*ppt->number_of_scalar_titles,
-                  error_message);
-      ppt->size_scalar_perturbation_data[ppw->index_ikout] = 0;
-    }
-    else{
-      ppt->scalar_perturbations_data[ppw->index_ikout] =
-        realloc(ppt->scalar_perturbations_data[ppw->index_ikout],
-                sizeof(double)*(ppt->size_scalar_perturbation_data[ppw->index_ikout]+ppt->number_of_scalar_titles));
-    }
+    /** - --> Get the row where the values go (in memory or in the stream buffer) */
+    class_call(perturbations_output_row(ppw,
+                                        &(ppt->scalar_perturbations_data[ppw->index_ikout]),
+                                        &(ppt->size_scalar_perturbation_data[ppw->index_ikout]),
+                                        ppt->number_of_scalar_titles,
+                                        &dataptr,
+                                        error_message),
+               error_message,
+               error_message);
     storeidx = 0;
-    dataptr = ppt->scalar_perturbations_data[ppw->index_ikout]+
-      ppt->size_scalar_perturbation_data[ppw->index_ikout];
-    ppt->size_scalar_perturbation_data[ppw->index_ikout] += ppt->number_of_scalar_titles;
 
     class_store_double(dataptr, tau, _TRUE_, storeidx);
     class_store_double(dataptr, pvecback[pba->index_bg_a], _TRUE_, storeidx);
@@ -8219,22 +10591,16 @@ int perturbations_print_variables(double tau,
       l4_ur = y[ppw->pv->index_pt_delta_ur+4];
     }
 
-    /** - --> Handle (re-)allocation */
-    if (ppt->tensor_perturbations_data[ppw->index_ikout] == NULL){
-      class_alloc(ppt->tensor_perturbations_data[ppw->index_ikout],
-                  sizeof(double)*ppt->number_of_tensor_titles,
-                  error_message);
-      ppt->size_tensor_perturbation_data[ppw->index_ikout] = 0;
-    }
-    else{
-      ppt->tensor_perturbations_data[ppw->index_ikout] =
-        realloc(ppt->tensor_perturbations_data[ppw->index_ikout],
-                sizeof(double)*(ppt->size_tensor_perturbation_data[ppw->index_ikout]+ppt->number_of_tensor_titles));
-    }
+    /** - --> Get the row where the values go (in memory or in the stream buffer) */
+    class_call(perturbations_output_row(ppw,
+                                        &(ppt->tensor_perturbations_data[ppw->index_ikout]),
+                                        &(ppt->size_tensor_perturbation_data[ppw->index_ikout]),
+                                        ppt->number_of_tensor_titles,
+                                        &dataptr,
+                                        error_message),
+               error_message,
+               error_message);
     storeidx = 0;
-    dataptr = ppt->tensor_perturbations_data[ppw->index_ikout]+
-      ppt->size_tensor_perturbation_data[ppw->index_ikout];
-    ppt->size_tensor_perturbation_data[ppw->index_ikout] += ppt->number_of_tensor_titles;
 
     //fprintf(ppw->perturbations_output_file," ");
     class_store_double(dataptr, tau, _TRUE_, storeidx);
@@ -8314,33 +10680,25 @@ int perturbations_print_variables(double tau,
 }
 
 /**
- * Compute derivative of all perturbations to be integrated
- *
- * For each mode (scalar/vector/tensor) and each wavenumber k, this
- * function computes the derivative of all values in the vector of
- * perturbed variables to be integrated.
- *
- * This is one of the few functions in the code which is passed to the generic_integrator() routine.
- * Since generic_integrator() should work with functions passed from various modules, the format of the arguments
- * is a bit special:
- * - fixed parameters and workspaces are passed through a generic pointer.
- *   generic_integrator() doesn't know what the content of this pointer is.
- * - errors are not written as usual in pth->error_message, but in a generic
- *   error_message passed in the list of arguments.
+ * Compute derivative of all perturbations to be integrated, for the
+ * species in sp. This is the body of perturbations_derivs() and of
+ * its versions specialised for a given set of species.
  *
  * @param tau                      Input: conformal time
  * @param y                        Input: vector of perturbations
  * @param dy                       Output: vector of its derivatives (already allocated)
  * @param parameters_and_workspace Input/Output: in input, fixed parameters (e.g. indices); in output, background and thermo quantities evaluated at tau.
  * @param error_message            Output: error message
+ * @param sp                       Input: species present (compile-time constants in the specialised versions)
  */
 
-int perturbations_derivs(double tau,
-                   double * y,
-                   double * dy,
-                   void * parameters_and_workspace,
-                   ErrorMsg error_message
-                   ) {
+static _FORCE_INLINE_ int perturbations_derivs_species(double tau,
+                                                       double * y,
+                                                       double * dy,
+                                                       void * parameters_and_workspace,
+                                                       ErrorMsg error_message,
+                                                       struct perturbations_species sp
+                                                       ) {
   /** Summary: */
 
   /** - define local variables */
@@ -8364,10 +10722,15 @@ int perturbations_derivs(double tau,
   double * pvecthermo;
   double * pvecmetric;
   double * s_l;
+  double * c_l_minus;
+  double * c_l_plus;
   struct perturbations_vector * pv;
 
   /* short-cut notations for the perturbations */
   double delta_g=0.,theta_g=0.,shear_g=0.;
+  double dkappa;
+  double * y_l;
+  double * dy_l;
   double delta_b,theta_b;
   double delta_idr=0., theta_idr=0.;
   double cb2,cs2,ca2,delta_p_b_over_rho_b;
@@ -8392,6 +10755,8 @@ int perturbations_derivs(double tau,
   int index_q,n_ncdm,idx;
   double q,epsilon,dlnf0_dlnq,qk_div_epsilon;
   double rho_ncdm_bg,p_ncdm_bg,pseudo_p_ncdm,w_ncdm,ca2_ncdm,ceff2_ncdm=0.,cvis2_ncdm=0.;
+  int index_bin,l_max_ncdm;
+  double * epsilon_ncdm;
 
   /* for use with curvature */
   double cotKgen, sqrt_absK;
@@ -8406,6 +10771,8 @@ int perturbations_derivs(double tau,
 
   pppaw = parameters_and_workspace;
 
+  class_counters_begin(counter_perturbations_derivs);
+
   k = pppaw->k;
   k2=k*k;
   index_md = pppaw->index_md;
@@ -8416,42 +10783,48 @@ int perturbations_derivs(double tau,
   ppw = pppaw->ppw;
 
   s_l = ppw->s_l;
+  c_l_minus = ppw->c_l_minus;
+  c_l_plus = ppw->c_l_plus;
   pvecback = ppw->pvecback;
   pvecthermo = ppw->pvecthermo;
   pvecmetric = ppw->pvecmetric;
   pv = ppw->pv;
 
+  ppw->derivs_calls++;
+
   /** - get background/thermo quantities in this point */
 
-  class_call(background_at_tau(pba,
-                               tau,
-                               normal_info,
-                               inter_closeby,
-                               &(ppw->last_index_back),
-                               pvecback),
+  class_call(background_at_tau_columns(pba,
+                                       tau,
+                                       NULL,
+                                       pba->bg_size_normal,
+                                       &(ppw->last_index_back),
+                                       pvecback),
              pba->error_message,
              error_message);
 
-  class_call(thermodynamics_at_z(pba,
-                                 pth,
-                                 1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
-                                 inter_closeby,
-                                 &(ppw->last_index_thermo),
-                                 pvecback,
-                                 pvecthermo),
+  class_call(thermodynamics_at_z_columns(pba,
+                                         pth,
+                                         1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
+                                         NULL,
+                                         pth->th_size,
+                                         &(ppw->last_index_thermo),
+                                         pvecback,
+                                         pvecthermo),
              pth->error_message,
              error_message);
 
   /** - get metric perturbations with perturbations_einstein() */
-  class_call(perturbations_einstein(ppr,
-                              pba,
-                              pth,
-                              ppt,
-                              index_md,
-                              k,
-                              tau,
-                              y,
-                              ppw),
+  class_call(perturbations_einstein_species(ppr,
+                                            pba,
+                                            pth,
+                                            ppt,
+                                            index_md,
+                                            k,
+                                            tau,
+                                            y,
+                                            ppw,
+                                            sp),
              ppt->error_message,
              error_message);
 
@@ -8461,8 +10834,9 @@ int perturbations_derivs(double tau,
   a2 = a*a;
   a_prime_over_a = pvecback[pba->index_bg_H] * a;
   R = 4./3. * pvecback[pba->index_bg_rho_g]/pvecback[pba->index_bg_rho_b];
+  dkappa = pvecthermo[pth->index_th_dkappa];
 
-  if((pba->has_idm_dr==_TRUE_)){
+  if((sp.has_idm_dr==_TRUE_)){
     Sinv = 4./3. * pvecback[pba->index_bg_rho_idr]/ pvecback[pba->index_bg_rho_idm_dr];
     dmu_idm_dr = pvecthermo[pth->index_th_dmu_idm_dr];
     dmu_idr = pth->b_idr/pth->a_idm_dr*pba->Omega0_idr/pba->Omega0_idm_dr*dmu_idm_dr;
@@ -8492,7 +10866,7 @@ int perturbations_derivs(double tau,
       theta_g = y[pv->index_pt_theta_g];
     }
 
-    if (pba->has_idr == _TRUE_){
+    if (sp.has_idr == _TRUE_){
       if (ppw->approx[ppw->index_ap_rsa_idr] == (int)rsa_idr_off){
         delta_idr = y[pv->index_pt_delta_idr];
         theta_idr = y[pv->index_pt_theta_idr];
@@ -8585,7 +10959,7 @@ int perturbations_derivs(double tau,
       theta_g = ppw->rsa_theta_g;
     }
 
-    if (pba->has_idr == _TRUE_){
+    if (sp.has_idr == _TRUE_){
       if (ppw->approx[ppw->index_ap_rsa_idr] == (int)rsa_idr_on){
         delta_idr = ppw->rsa_delta_idr;
         theta_idr = ppw->rsa_theta_idr;
@@ -8668,11 +11042,10 @@ int perturbations_derivs(double tau,
           - pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_l3_g];
 
         /** - -----> photon temperature l>3 */
+        y_l = y+pv->index_pt_delta_g;
+        dy_l = dy+pv->index_pt_delta_g;
         for (l = 4; l < pv->l_max_g; l++) {
-
-          dy[pv->index_pt_delta_g+l] = k/(2.0*l+1.0)*
-            (l*s_l[l]*y[pv->index_pt_delta_g+l-1]-(l+1)*s_l[l+1]*y[pv->index_pt_delta_g+l+1])
-            - pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_delta_g+l];
+          dy_l[l] = k*(c_l_minus[l]*y_l[l-1]-c_l_plus[l]*y_l[l+1]) - dkappa*y_l[l];
         }
 
         /** - -----> photon temperature lmax */
@@ -8701,10 +11074,10 @@ int perturbations_derivs(double tau,
 
         /** - -----> photon polarization l>2 */
 
+        y_l = y+pv->index_pt_pol0_g;
+        dy_l = dy+pv->index_pt_pol0_g;
         for (l=3; l < pv->l_max_pol_g; l++)
-          dy[pv->index_pt_pol0_g+l] = k/(2.*l+1)*
-            (l*s_l[l]*y[pv->index_pt_pol0_g+l-1]-(l+1.)*s_l[l+1]*y[pv->index_pt_pol0_g+l+1])
-            -pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_pol0_g+l];
+          dy_l[l] = k*(c_l_minus[l]*y_l[l-1]-c_l_plus[l]*y_l[l+1]) - dkappa*y_l[l];
 
         /** - -----> photon polarization lmax_pol */
 
@@ -8749,14 +11122,14 @@ int perturbations_derivs(double tau,
     }
 
     /** - ---> idr */
-    if (pba->has_idr == _TRUE_){
+    if (sp.has_idr == _TRUE_){
       if (ppw->approx[ppw->index_ap_rsa_idr] == (int)rsa_idr_off) {
         dy[pv->index_pt_delta_idr] = -4./3.*(theta_idr + metric_continuity);
       }
     }
 
     /** - ---> idm_dr */
-    if (pba->has_idm_dr == _TRUE_){
+    if (sp.has_idm_dr == _TRUE_){
 
       dy[pv->index_pt_delta_idm_dr] = -(y[pv->index_pt_theta_idm_dr]+metric_continuity); /* idm_dr density */
 
@@ -8796,7 +11169,7 @@ int perturbations_derivs(double tau,
 
     /** - ---> dcdm and dr */
 
-    if (pba->has_dcdm == _TRUE_) {
+    if (sp.has_dcdm == _TRUE_) {
 
       /** - ----> dcdm */
 
@@ -8808,7 +11181,7 @@ int perturbations_derivs(double tau,
 
     /** - ---> dr */
 
-    if ((pba->has_dcdm == _TRUE_)&&(pba->has_dr == _TRUE_)) {
+    if ((sp.has_dcdm == _TRUE_)&&(sp.has_dr == _TRUE_)) {
 
 
       /* f = rho_dr*a^4/rho_crit_today. In CLASS density units
@@ -8835,9 +11208,10 @@ int perturbations_derivs(double tau,
         (l*s_l[l]*s_l[2]*y[pv->index_pt_F0_dr+2]-(l+1.)*s_l[l+1]*y[pv->index_pt_F0_dr+4]);
 
       /** - ----> exact dr l>3 */
+      y_l = y+pv->index_pt_F0_dr;
+      dy_l = dy+pv->index_pt_F0_dr;
       for (l = 4; l < pv->l_max_dr; l++) {
-        dy[pv->index_pt_F0_dr+l] = k/(2.*l+1)*
-          (l*s_l[l]*y[pv->index_pt_F0_dr+l-1]-(l+1.)*s_l[l+1]*y[pv->index_pt_F0_dr+l+1]);
+        dy_l[l] = k*(c_l_minus[l]*y_l[l-1]-c_l_plus[l]*y_l[l+1]);
       }
 
       /** - ----> exact dr lmax_dr */
@@ -8849,7 +11223,7 @@ int perturbations_derivs(double tau,
 
     /** - ---> fluid (fld) */
 
-    if (pba->has_fld == _TRUE_) {
+    if (sp.has_fld == _TRUE_) {
 
       if (pba->use_ppf == _FALSE_){
 
@@ -8884,7 +11258,7 @@ int perturbations_derivs(double tau,
 
     /** - ---> scalar field (scf) */
 
-    if (pba->has_scf == _TRUE_) {
+    if (sp.has_scf == _TRUE_) {
 
       /** - ----> field value */
 
@@ -8898,11 +11272,11 @@ int perturbations_derivs(double tau,
 
     }
     /** - ---> interacting dark radiation */
-    if (pba->has_idr == _TRUE_){
+    if (sp.has_idr == _TRUE_){
 
       if (ppw->approx[ppw->index_ap_rsa_idr] == (int)rsa_idr_off) {
 
-        if ((pba->has_idm_dr == _FALSE_)||((pba->has_idm_dr == _TRUE_)&&(ppw->approx[ppw->index_ap_tca_idm_dr] == (int)tca_idm_dr_off))) {
+        if ((sp.has_idm_dr == _FALSE_)||((sp.has_idm_dr == _TRUE_)&&(ppw->approx[ppw->index_ap_tca_idm_dr] == (int)tca_idm_dr_off))) {
 
           /** - ----> idr velocity */
           if(ppt->idr_nature == idr_free_streaming)
@@ -8910,7 +11284,7 @@ int perturbations_derivs(double tau,
           else
             dy[pv->index_pt_theta_idr] = k2/4. * y[pv->index_pt_delta_idr] + metric_euler;
 
-          if (pba->has_idm_dr == _TRUE_)
+          if (sp.has_idm_dr == _TRUE_)
             dy[pv->index_pt_theta_idr] += dmu_idm_dr*(y[pv->index_pt_theta_idm_dr]-y[pv->index_pt_theta_idr]);
 
           if(ppt->idr_nature == idr_free_streaming){
@@ -8918,26 +11292,26 @@ int perturbations_derivs(double tau,
             /** - ----> exact idr shear */
             l = 2;
             dy[pv->index_pt_shear_idr] = 0.5*(8./15.*(y[pv->index_pt_theta_idr]+metric_shear)-3./5.*k*s_l[3]/s_l[2]*y[pv->index_pt_shear_idr+1]);
-            if (pba->has_idm_dr == _TRUE_)
+            if (sp.has_idm_dr == _TRUE_)
               dy[pv->index_pt_shear_idr]-= (ppt->alpha_idm_dr[l-2]*dmu_idm_dr + ppt->beta_idr[l-2]*dmu_idr)*y[pv->index_pt_shear_idr];
 
             /** - ----> exact idr l=3 */
             l = 3;
             dy[pv->index_pt_l3_idr] = k/(2.*l+1.)*(l*2.*s_l[l]*s_l[2]*y[pv->index_pt_shear_idr]-(l+1.)*s_l[l+1]*y[pv->index_pt_l3_idr+1]);
-            if (pba->has_idm_dr == _TRUE_)
+            if (sp.has_idm_dr == _TRUE_)
               dy[pv->index_pt_l3_idr]-= (ppt->alpha_idm_dr[l-2]*dmu_idm_dr + ppt->beta_idr[l-2]*dmu_idr)*y[pv->index_pt_l3_idr];
 
             /** - ----> exact idr l>3 */
             for (l = 4; l < pv->l_max_idr; l++) {
-              dy[pv->index_pt_delta_idr+l] = k/(2.*l+1)*(l*s_l[l]*y[pv->index_pt_delta_idr+l-1]-(l+1.)*s_l[l+1]*y[pv->index_pt_delta_idr+l+1]);
-              if (pba->has_idm_dr == _TRUE_)
+              dy[pv->index_pt_delta_idr+l] = k*(c_l_minus[l]*y[pv->index_pt_delta_idr+l-1]-c_l_plus[l]*y[pv->index_pt_delta_idr+l+1]);
+              if (sp.has_idm_dr == _TRUE_)
                 dy[pv->index_pt_delta_idr+l]-= (ppt->alpha_idm_dr[l-2]*dmu_idm_dr + ppt->beta_idr[l-2]*dmu_idr)*y[pv->index_pt_delta_idr+l];
             }
 
             /** - ----> exact idr lmax_dr */
             l = pv->l_max_idr;
             dy[pv->index_pt_delta_idr+l] = k*(s_l[l]*y[pv->index_pt_delta_idr+l-1]-(1.+l)*cotKgen*y[pv->index_pt_delta_idr+l]);
-            if (pba->has_idm_dr == _TRUE_)
+            if (sp.has_idm_dr == _TRUE_)
               dy[pv->index_pt_delta_idr+l]-= (ppt->alpha_idm_dr[l-2]*dmu_idm_dr + ppt->beta_idr[l-2]*dmu_idr)*y[pv->index_pt_delta_idr+l];
           }
         }
@@ -8987,9 +11361,10 @@ int perturbations_derivs(double tau,
             (l*2.*s_l[l]*s_l[2]*y[pv->index_pt_shear_ur]-(l+1.)*s_l[l+1]*y[pv->index_pt_l3_ur+1]);
 
           /** - -----> exact ur l>3 */
+          y_l = y+pv->index_pt_delta_ur;
+          dy_l = dy+pv->index_pt_delta_ur;
           for (l = 4; l < pv->l_max_ur; l++) {
-            dy[pv->index_pt_delta_ur+l] = k/(2.*l+1)*
-              (l*s_l[l]*y[pv->index_pt_delta_ur+l-1]-(l+1.)*s_l[l+1]*y[pv->index_pt_delta_ur+l+1]);
+            dy_l[l] = k*(c_l_minus[l]*y_l[l-1]-c_l_plus[l]*y_l[l+1]);
           }
 
           /** - -----> exact ur lmax_ur */
@@ -9035,7 +11410,7 @@ int perturbations_derivs(double tau,
 
     /** - ---> non-cold dark matter (ncdm): massive neutrinos, WDM, etc. */
     //TBC: curvature in all ncdm
-    if (pba->has_ncdm == _TRUE_) {
+    if (sp.has_ncdm == _TRUE_) {
 
       idx = pv->index_pt_psi0_ncdm1;
 
@@ -9119,50 +11494,55 @@ int perturbations_derivs(double tau,
 
       else {
 
-        /** - -----> loop over species */
-
-        for (n_ncdm=0; n_ncdm<pv->N_ncdm; n_ncdm++) {
+        /** - -----> loop over the momentum bins of all species at
+            once: with the full hierarchy, all species have the same
+            l_max_ncdm, so that their bins form a single block of
+            rows of l_max_ncdm+1 multipoles, and the energies of all
+            bins are computed in one loop by
+            perturbations_ncdm_epsilon() */
 
-          /** - -----> loop over momentum */
+        epsilon_ncdm = perturbations_ncdm_epsilon(ppw,a);
+        l_max_ncdm = pv->l_max_ncdm[0];
 
-          for (index_q=0; index_q < pv->q_size_ncdm[n_ncdm]; index_q++) {
+        for (index_bin=0; index_bin < ppw->ncdm_bin_size; index_bin++) {
 
-            /** - -----> define intermediate quantities */
+          /** - -----> define intermediate quantities */
 
-            dlnf0_dlnq = pba->dlnf0_dlnq_ncdm[n_ncdm][index_q];
-            q = pba->q_ncdm[n_ncdm][index_q];
-            epsilon = sqrt(q*q+a2*pba->M_ncdm[n_ncdm]*pba->M_ncdm[n_ncdm]);
-            qk_div_epsilon = k*q/epsilon;
+          dlnf0_dlnq = ppw->ncdm_dlnf0_dlnq[index_bin];
+          q = ppw->ncdm_q[index_bin];
+          epsilon = epsilon_ncdm[index_bin];
+          qk_div_epsilon = k*q/epsilon;
+          y_l = y+idx;
+          dy_l = dy+idx;
 
-            /** - -----> ncdm density for given momentum bin */
+          /** - -----> ncdm density for given momentum bin */
 
-            dy[idx] = -qk_div_epsilon*y[idx+1]+metric_continuity*dlnf0_dlnq/3.;
+          dy_l[0] = -qk_div_epsilon*y_l[1]+metric_continuity*dlnf0_dlnq/3.;
 
-            /** - -----> ncdm velocity for given momentum bin */
+          /** - -----> ncdm velocity for given momentum bin */
 
-            dy[idx+1] = qk_div_epsilon/3.0*(y[idx] - 2*s_l[2]*y[idx+2])
-              -epsilon*metric_euler/(3*q*k)*dlnf0_dlnq;
+          dy_l[1] = qk_div_epsilon/3.0*(y_l[0] - 2*s_l[2]*y_l[2])
+            -epsilon*metric_euler/(3*q*k)*dlnf0_dlnq;
 
-            /** - -----> ncdm shear for given momentum bin */
+          /** - -----> ncdm shear for given momentum bin */
 
-            dy[idx+2] = qk_div_epsilon/5.0*(2*s_l[2]*y[idx+1]-3.*s_l[3]*y[idx+3])
-              -s_l[2]*metric_shear*2./15.*dlnf0_dlnq;
+          dy_l[2] = qk_div_epsilon/5.0*(2*s_l[2]*y_l[1]-3.*s_l[3]*y_l[3])
+            -s_l[2]*metric_shear*2./15.*dlnf0_dlnq;
 
-            /** - -----> ncdm l>3 for given momentum bin */
+          /** - -----> ncdm l>3 for given momentum bin */
 
-            for(l=3; l<pv->l_max_ncdm[n_ncdm]; l++){
-              dy[idx+l] = qk_div_epsilon/(2.*l+1.0)*(l*s_l[l]*y[idx+(l-1)]-(l+1.)*s_l[l+1]*y[idx+(l+1)]);
-            }
+          for(l=3; l<l_max_ncdm; l++){
+            dy_l[l] = qk_div_epsilon*(c_l_minus[l]*y_l[l-1]-c_l_plus[l]*y_l[l+1]);
+          }
 
-            /** - -----> ncdm lmax for given momentum bin (truncation as in Ma and Bertschinger)
-                but with curvature taken into account a la arXiv:1305.3261 */
+          /** - -----> ncdm lmax for given momentum bin (truncation as in Ma and Bertschinger)
+              but with curvature taken into account a la arXiv:1305.3261 */
 
-            dy[idx+l] = qk_div_epsilon*y[idx+l-1]-(1.+l)*k*cotKgen*y[idx+l];
+          dy_l[l_max_ncdm] = qk_div_epsilon*y_l[l_max_ncdm-1]-(1.+l_max_ncdm)*k*cotKgen*y_l[l_max_ncdm];
 
-            /** - -----> jump to next momentum bin or species */
+          /** - -----> jump to next momentum bin */
 
-            idx += (pv->l_max_ncdm[n_ncdm]+1);
-          }
+          idx += l_max_ncdm+1;
         }
       }
     }
@@ -9270,11 +11650,10 @@ int perturbations_derivs(double tau,
       -pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_l3_g];
 
     /* additional momenta in Boltzmann hierarchy (beyond l=0,1,2,3,4) */
+    y_l = y+pv->index_pt_delta_g;
+    dy_l = dy+pv->index_pt_delta_g;
     for (l=4; l < pv->l_max_g; l++)
-      dy[pv->index_pt_delta_g+l] =
-        k/(2.*l+1.)*(l*s_l[l]*y[pv->index_pt_delta_g+l-1]
-                     -(l+1.)*s_l[l+1]*y[pv->index_pt_delta_g+l+1])
-        -pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_delta_g+l];
+      dy_l[l] = k*(c_l_minus[l]*y_l[l-1]-c_l_plus[l]*y_l[l+1]) - dkappa*y_l[l];
 
     /* l=lmax */
     l = pv->l_max_g;
@@ -9289,11 +11668,10 @@ int perturbations_derivs(double tau,
       -pvecthermo[pth->index_th_dkappa]*(y[pv->index_pt_pol0_g]-_SQRT6_*P1);
 
     /* additional momenta in Boltzmann hierarchy (beyond l=0,1,2,3,4) */
+    y_l = y+pv->index_pt_pol0_g;
+    dy_l = dy+pv->index_pt_pol0_g;
     for (l=1; l < pv->l_max_pol_g; l++)
-      dy[pv->index_pt_pol0_g+l] =
-        k/(2.*l+1.)*(l*s_l[l]*y[pv->index_pt_pol0_g+l-1]
-                     -(l+1.)*s_l[l+1]*y[pv->index_pt_pol0_g+l+1])
-        -pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_pol0_g+l];
+      dy_l[l] = k*(c_l_minus[l]*y_l[l-1]-c_l_plus[l]*y_l[l+1]) - dkappa*y_l[l];
 
     /* l=lmax */
     l = pv->l_max_pol_g;
@@ -9378,11 +11756,10 @@ int perturbations_derivs(double tau,
           -pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_l3_g];
 
         /* additional momenta in Boltzmann hierarchy (beyond l=0,1,2,3,4) */
+        y_l = y+pv->index_pt_delta_g;
+        dy_l = dy+pv->index_pt_delta_g;
         for (l=4; l < pv->l_max_g; l++)
-          dy[pv->index_pt_delta_g+l] =
-            k/(2.*l+1.)*(l*s_l[l]*y[pv->index_pt_delta_g+l-1]
-                         -(l+1.)*s_l[l+1]*y[pv->index_pt_delta_g+l+1])
-            -pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_delta_g+l];
+          dy_l[l] = k*(c_l_minus[l]*y_l[l-1]-c_l_plus[l]*y_l[l+1]) - dkappa*y_l[l];
 
         /* l=lmax */
         l = pv->l_max_g;
@@ -9397,11 +11774,10 @@ int perturbations_derivs(double tau,
           -pvecthermo[pth->index_th_dkappa]*(y[pv->index_pt_pol0_g]-_SQRT6_*P2);
 
         /* additional momenta in Boltzmann hierarchy (beyond l=0,1,2,3,4) */
+        y_l = y+pv->index_pt_pol0_g;
+        dy_l = dy+pv->index_pt_pol0_g;
         for (l=1; l < pv->l_max_pol_g; l++)
-          dy[pv->index_pt_pol0_g+l] =
-            k/(2.*l+1.)*(l*s_l[l]*y[pv->index_pt_pol0_g+l-1]
-                         -(l+1.)*s_l[l+1]*y[pv->index_pt_pol0_g+l+1])
-            -pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_pol0_g+l];
+          dy_l[l] = k*(c_l_minus[l]*y_l[l-1]-c_l_plus[l]*y_l[l+1]) - dkappa*y_l[l];
 
         /* l=lmax */
         l = pv->l_max_pol_g;
@@ -9426,9 +11802,10 @@ int perturbations_derivs(double tau,
       dy[pv->index_pt_l3_ur] = k/(2.*l+1.)*
         (l*2.*s_l[l]*s_l[2]*y[pv->index_pt_shear_ur]-(l+1.)*s_l[l+1]*y[pv->index_pt_l3_ur+1]);
 
+      y_l = y+pv->index_pt_delta_ur;
+      dy_l = dy+pv->index_pt_delta_ur;
       for (l = 4; l < pv->l_max_ur; l++) {
-        dy[pv->index_pt_delta_ur+l] = k/(2.*l+1)*
-          (l*s_l[l]*y[pv->index_pt_delta_ur+l-1]-(l+1.)*s_l[l+1]*y[pv->index_pt_delta_ur+l+1]);
+        dy_l[l] = k*(c_l_minus[l]*y_l[l-1]-c_l_plus[l]*y_l[l+1]);
       }
 
       l = pv->l_max_ur;
@@ -9464,8 +11841,10 @@ int perturbations_derivs(double tau,
 
           /** - ----> ncdm l>0 for given momentum bin */
 
+          y_l = y+idx;
+          dy_l = dy+idx;
           for(l=1; l<pv->l_max_ncdm[n_ncdm]; l++){
-            dy[idx+l] = qk_div_epsilon/(2.*l+1.0)*(l*s_l[l]*y[idx+(l-1)]-(l+1.)*s_l[l+1]*y[idx+(l+1)]);
+            dy_l[l] = qk_div_epsilon*(c_l_minus[l]*y_l[l-1]-c_l_plus[l]*y_l[l+1]);
           }
 
           /** - ----> ncdm lmax for given momentum bin (truncation as in Ma and Bertschinger)
@@ -9488,6 +11867,128 @@ int perturbations_derivs(double tau,
 
   }
 
+  class_counters_end(counter_perturbations_derivs);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute derivative of all perturbations to be integrated
+ *
+ * For each mode (scalar/vector/tensor) and each wavenumber k, this
+ * function computes the derivative of all values in the vector of
+ * perturbed variables to be integrated.
+ *
+ * This is one of the few functions in the code which is passed to the generic_integrator() routine.
+ * Since generic_integrator() should work with functions passed from various modules, the format of the arguments
+ * is a bit special:
+ * - fixed parameters and workspaces are passed through a generic pointer.
+ *   generic_integrator() doesn't know what the content of this pointer is.
+ * - errors are not written as usual in pth->error_message, but in a generic
+ *   error_message passed in the list of arguments.
+ *
+ * @param tau                      Input: conformal time
+ * @param y                        Input: vector of perturbations
+ * @param dy                       Output: vector of its derivatives (already allocated)
+ * @param parameters_and_workspace Input/Output: in input, fixed parameters (e.g. indices); in output, background and thermo quantities evaluated at tau.
+ * @param error_message            Output: error message
+ */
+
+int perturbations_derivs(double tau,
+                   double * y,
+                   double * dy,
+                   void * parameters_and_workspace,
+                   ErrorMsg error_message
+                   ) {
+
+  struct perturbations_parameters_and_workspace * pppaw = parameters_and_workspace;
+
+  return perturbations_derivs_species(tau,y,dy,parameters_and_workspace,error_message,perturbations_species_of(pppaw->pba));
+}
+
+/**
+ * Versions of perturbations_derivs() for the most common sets of
+ * species. Absent species are known at compile time, so that their
+ * branches disappear from perturbations_derivs(),
+ * perturbations_einstein() and perturbations_total_stress_energy()
+ * once inlined, leaving a shorter right-hand side that the compiler
+ * can optimise better. The arguments are those of perturbations_derivs().
+ */
+
+static int perturbations_derivs_lcdm(double tau,
+                                     double * y,
+                                     double * dy,
+                                     void * parameters_and_workspace,
+                                     ErrorMsg error_message
+                                     ) {
+
+  struct perturbations_species sp = {_FALSE_,_FALSE_,_FALSE_,_FALSE_,_FALSE_,_FALSE_,_FALSE_};
+
+  return perturbations_derivs_species(tau,y,dy,parameters_and_workspace,error_message,sp);
+}
+
+static int perturbations_derivs_lcdm_ncdm(double tau,
+                                          double * y,
+                                          double * dy,
+                                          void * parameters_and_workspace,
+                                          ErrorMsg error_message
+                                          ) {
+
+  struct perturbations_species sp = {_TRUE_,_FALSE_,_FALSE_,_FALSE_,_FALSE_,_FALSE_,_FALSE_};
+
+  return perturbations_derivs_species(tau,y,dy,parameters_and_workspace,error_message,sp);
+}
+
+static int perturbations_derivs_lcdm_fld(double tau,
+                                         double * y,
+                                         double * dy,
+                                         void * parameters_and_workspace,
+                                         ErrorMsg error_message
+                                         ) {
+
+  struct perturbations_species sp = {_FALSE_,_TRUE_,_FALSE_,_FALSE_,_FALSE_,_FALSE_,_FALSE_};
+
+  return perturbations_derivs_species(tau,y,dy,parameters_and_workspace,error_message,sp);
+}
+
+/**
+ * Choose the function computing the derivatives of the perturbations:
+ * a version specialised for the species of the background structure
+ * if there is one and if ppr->perturbations_specialised_derivs is set,
+ * otherwise the generic perturbations_derivs()
+ *
+ * @param ppr    Input: pointer to precision structure
+ * @param pba    Input: pointer to background structure
+ * @param derivs Output: function computing the derivatives
+ * @return the error status
+ */
+
+int perturbations_derivs_select(
+                                struct precision * ppr,
+                                struct background * pba,
+                                int (**derivs)()
+                                ) {
+
+  struct perturbations_species sp;
+
+  *derivs = perturbations_derivs;
+
+  if (ppr->perturbations_specialised_derivs == _FALSE_)
+    return _SUCCESS_;
+
+  sp = perturbations_species_of(pba);
+
+  if ((sp.has_scf == _TRUE_) || (sp.has_idr == _TRUE_) || (sp.has_idm_dr == _TRUE_) ||
+      (sp.has_dcdm == _TRUE_) || (sp.has_dr == _TRUE_))
+    return _SUCCESS_;
+
+  if ((sp.has_ncdm == _FALSE_) && (sp.has_fld == _FALSE_))
+    *derivs = perturbations_derivs_lcdm;
+  else if ((sp.has_ncdm == _TRUE_) && (sp.has_fld == _FALSE_))
+    *derivs = perturbations_derivs_lcdm_ncdm;
+  else if ((sp.has_ncdm == _FALSE_) && (sp.has_fld == _TRUE_))
+    *derivs = perturbations_derivs_lcdm_fld;
+
   return _SUCCESS_;
 }
 
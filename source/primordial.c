@@ -15,6 +15,8 @@
  */
 
 #include "primordial.h"
+#include <unistd.h>
+#include <sys/wait.h>
 
 /**
  * Primordial spectra for arbitrary argument and for all initial conditions.
@@ -174,6 +176,192 @@ int primordial_spectrum_at_k(
 
 }
 
+/**
+ * Primordial spectra for a whole array of arguments and for all
+ * initial conditions.
+ *
+ * Same as primordial_spectrum_at_k(), but for an array of wavenumbers
+ * filled in one sweep. The interval of the table containing each
+ * argument is found by hunting from the interval of the previous
+ * argument, which costs O(1) per argument when the array is sorted
+ * in increasing order, and falls back to a bisection otherwise. The spline formula is then applied to all pairs of
+ * initial conditions at once.
+ *
+ * For an analytic spectrum (primordial_spec_type = analytic_Pk) with
+ * uncorrelated initial conditions, the table is skipped and the
+ * spectrum is computed directly from the amplitudes, tilts and
+ * runnings, which gives the same result as the interpolation up to
+ * rounding errors (the spline of a second-order polynomial in ln(k) is
+ * exact).
+ *
+ * @param ppm        Input: pointer to primordial structure containing tabulated primordial spectrum
+ * @param index_md   Input: index of mode (scalar, tensor, ...)
+ * @param mode       Input: linear or logarithmic
+ * @param input      Input: wavenumbers in 1/Mpc (linear mode) or their logarithms (logarithmic mode)
+ * @param input_size Input: number of wavenumbers
+ * @param output     Output: for each wavenumber and each pair of initial conditions, same as in primordial_spectrum_at_k()
+ * @return the error status
+ */
+
+int primordial_spectrum_at_k_array(
+                                   struct primordial * ppm,
+                                   int index_md,
+                                   enum linear_or_logarithmic mode,
+                                   double * input,
+                                   int input_size,
+                                   double * output /* array with argument output[index_k*ppm->ic_ic_size[index_md]+index_ic1_ic2] (must be already allocated) */
+                                   ) {
+
+  int index_k;
+  int index_ic1,index_ic2,index_ic1_ic2;
+  int ic_size,ic_ic_size;
+  int inf,sup,mid;
+  short analytic;
+  double lnk,x,h,a,b;
+  double * pk;
+  double * lnpk;
+  double * ddlnpk;
+
+  ic_size = ppm->ic_size[index_md];
+  ic_ic_size = ppm->ic_ic_size[index_md];
+  lnpk = ppm->lnpk[index_md];
+  ddlnpk = ppm->ddlnpk[index_md];
+
+  /** - use the analytic fast path only when the initial conditions
+      are uncorrelated: the table stores the cross-correlation angles,
+      whose spline differs from the analytic value beyond rounding
+      errors */
+
+  analytic = (ppm->primordial_spec_type == analytic_Pk ? _TRUE_ : _FALSE_);
+
+  for (index_ic1 = 0; index_ic1 < ic_size; index_ic1++) {
+    for (index_ic2 = index_ic1+1; index_ic2 < ic_size; index_ic2++) {
+      if (ppm->is_non_zero[index_md][index_symmetric_matrix(index_ic1,index_ic2,ic_size)] == _TRUE_)
+        analytic = _FALSE_;
+    }
+  }
+
+  /** - index of the current interval of the table, [inf,inf+1] */
+  inf = 0;
+
+  for (index_k = 0; index_k < input_size; index_k++) {
+
+    pk = output + index_k*ic_ic_size;
+
+    /** - infer ln(k) from input, as in primordial_spectrum_at_k() */
+
+    if (mode == linear) {
+      class_test(input[index_k]<=0.,
+                 ppm->error_message,
+                 "k = %e",input[index_k]);
+      lnk=log(input[index_k]);
+    }
+    else {
+      lnk = input[index_k];
+    }
+
+    /** - outside the table, the scalar routine handles the analytic
+        extrapolation or returns the error */
+
+    if ((lnk > ppm->lnk[ppm->lnk_size-1]) || (lnk < ppm->lnk[0])) {
+
+      class_call(primordial_spectrum_at_k(ppm,index_md,mode,input[index_k],pk),
+                 ppm->error_message,
+                 ppm->error_message);
+
+      continue;
+    }
+
+    /** - analytic fast path: direct computation of the logarithms of the
+        diagonal spectra */
+
+    if (analytic == _TRUE_) {
+
+      x = lnk-log(ppm->k_pivot);
+
+      for (index_ic1 = 0; index_ic1 < ic_size; index_ic1++) {
+        index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic1,ic_size);
+        pk[index_ic1_ic2] = log(ppm->amplitude[index_md][index_ic1_ic2])
+          + (ppm->tilt[index_md][index_ic1_ic2]-1.)*x
+          + 0.5*ppm->running[index_md][index_ic1_ic2]*x*x;
+      }
+
+      for (index_ic1 = 0; index_ic1 < ic_size; index_ic1++) {
+        for (index_ic2 = index_ic1+1; index_ic2 < ic_size; index_ic2++) {
+          pk[index_symmetric_matrix(index_ic1,index_ic2,ic_size)] = 0.;
+        }
+      }
+    }
+
+    /** - otherwise, interpolate in the table */
+
+    else {
+
+      /** --> hunt for the interval containing ln(k), starting from the previous one */
+
+      if (lnk >= ppm->lnk[inf]) {
+        if ((inf < ppm->lnk_size-2) && (lnk > ppm->lnk[inf+1])) {
+          inf++;
+          if ((inf < ppm->lnk_size-2) && (lnk > ppm->lnk[inf+1])) {
+            sup = ppm->lnk_size-1;
+            while (sup-inf > 1) {
+              mid = (inf+sup)/2;
+              if (lnk < ppm->lnk[mid]) sup = mid; else inf = mid;
+            }
+          }
+        }
+      }
+      else {
+        sup = inf;
+        inf = 0;
+        while (sup-inf > 1) {
+          mid = (inf+sup)/2;
+          if (lnk < ppm->lnk[mid]) sup = mid; else inf = mid;
+        }
+      }
+
+      /** --> spline formula for all pairs of initial conditions, as in array_interpolate_spline() */
+
+      h = ppm->lnk[inf+1] - ppm->lnk[inf];
+      b = (lnk - ppm->lnk[inf])/h;
+      a = 1.-b;
+
+      for (index_ic1_ic2 = 0; index_ic1_ic2 < ic_ic_size; index_ic1_ic2++) {
+        pk[index_ic1_ic2] =
+          a * lnpk[inf*ic_ic_size+index_ic1_ic2] +
+          b * lnpk[(inf+1)*ic_ic_size+index_ic1_ic2] +
+          ((a*a*a-a)* ddlnpk[inf*ic_ic_size+index_ic1_ic2] +
+           (b*b*b-b)* ddlnpk[(inf+1)*ic_ic_size+index_ic1_ic2])*h*h/6.;
+      }
+    }
+
+    /** - in linear mode, apply the same transformation as in primordial_spectrum_at_k() */
+
+    if (mode == linear) {
+
+      for (index_ic1 = 0; index_ic1 < ic_size; index_ic1++) {
+        index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic1,ic_size);
+        pk[index_ic1_ic2]=exp(pk[index_ic1_ic2]);
+      }
+      for (index_ic1 = 0; index_ic1 < ic_size; index_ic1++) {
+        for (index_ic2 = index_ic1+1; index_ic2 < ic_size; index_ic2++) {
+          index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,ic_size);
+          if (ppm->is_non_zero[index_md][index_ic1_ic2] == _TRUE_) {
+            pk[index_ic1_ic2] *= sqrt(pk[index_symmetric_matrix(index_ic1,index_ic1,ic_size)]*
+                                      pk[index_symmetric_matrix(index_ic2,index_ic2,ic_size)]);
+          }
+          else {
+            pk[index_ic1_ic2] = 0.;
+          }
+        }
+      }
+    }
+  }
+
+  return _SUCCESS_;
+
+}
+
 /**
  * This routine initializes the primordial structure (in particular, it computes table of primordial spectrum values)
  *
@@ -195,6 +383,7 @@ int primordial_init(
 
   double k,k_min,k_max;
   int index_md,index_ic1,index_ic2,index_ic1_ic2,index_k;
+  int status;
   double pk,pk1,pk2;
   double dlnk,lnpk_pivot,lnpk_minus,lnpk_plus,lnpk_minusminus,lnpk_plusplus;
   /* uncomment if you use optional test below
@@ -393,10 +582,13 @@ int primordial_init(
     if (ppm->primordial_verbose > 0)
       printf(" (Pk calculated externally)\n");
 
-    class_call_except(primordial_external_spectrum_init(ppt,ppm),
-                      ppm->error_message,
-                      ppm->error_message,
-                      primordial_free(ppm));
+    /* the cached table and the worker process are shared by all threads */
+#pragma omp critical (primordial_external)
+    status = primordial_external_spectrum_init(ppt,ppm);
+    if (status == _FAILURE_) {
+      primordial_free(ppm);
+      return _FAILURE_;
+    }
   }
 
   else {
@@ -591,6 +783,8 @@ int primordial_free(
 
   }
 
+  class_memory_leaks();
+
   return _SUCCESS_;
 }
 
@@ -1583,6 +1777,13 @@ int primordial_inflation_analytic_spectra(
  * Routine with a loop over wavenumbers for the computation of the primordial
  * spectrum. For each wavenumber it calls primordial_inflation_one_wavenumber()
  *
+ * The background is first evolved once, in a single forward sweep
+ * through the increasing wavenumbers, and its value is stored at the
+ * time when each wavenumber must start being followed (aH =
+ * k/primordial_inflation_ratio_min). Each wavenumber then starts from
+ * this stored value, instead of evolving its own copy of the
+ * background from y_ini.
+ *
  * @param ppt   Input: pointer to perturbation structure
  * @param ppm   Input/output: pointer to primordial structure
  * @param ppr   Input: pointer to precision structure
@@ -1597,6 +1798,9 @@ int primordial_inflation_spectra(
                                  double * y_ini
                                  ) {
   int index_k;
+  double * y;
+  double * dy;
+  double * y_start; /* y_start[index_k*ppm->in_bg_size+index_in]: background when wavenumber index_k starts being followed */
 
   /* number of threads (always one if no openmp) */
   int number_of_threads=1;
@@ -1616,6 +1820,34 @@ int primordial_inflation_spectra(
   double tstart, tstop, tspent;
 #endif
 
+  /** - evolve the background once through the starting times of all wavenumbers (sorted by increasing values) */
+
+  class_alloc(y,ppm->in_size*sizeof(double),ppm->error_message);
+  class_alloc(dy,ppm->in_size*sizeof(double),ppm->error_message);
+  class_alloc(y_start,ppm->lnk_size*ppm->in_bg_size*sizeof(double),ppm->error_message);
+
+  memcpy(y,y_ini,ppm->in_bg_size*sizeof(double));
+
+  for (index_k=0; index_k < ppm->lnk_size; index_k++) {
+
+    class_call(primordial_inflation_evolve_background(ppm,
+                                                      ppr,
+                                                      y,
+                                                      dy,
+                                                      _aH_,
+                                                      exp(ppm->lnk[index_k])/ppr->primordial_inflation_ratio_min,
+                                                      _FALSE_,
+                                                      forward,
+                                                      conformal),
+               ppm->error_message,
+               ppm->error_message);
+
+    memcpy(y_start+index_k*ppm->in_bg_size,y,ppm->in_bg_size*sizeof(double));
+  }
+
+  free(y);
+  free(dy);
+
 #ifdef _OPENMP
 
 #pragma omp parallel
@@ -1626,7 +1858,7 @@ int primordial_inflation_spectra(
 
   abort = _FALSE_;
 
-#pragma omp parallel shared(ppt,ppm,ppr,abort,y_ini) private(index_k,thread,tspent,tstart,tstop) num_threads(number_of_threads)
+#pragma omp parallel shared(ppt,ppm,ppr,abort,y_start) private(index_k,thread,tspent,tstart,tstop) num_threads(number_of_threads)
 
   {
 
@@ -1640,11 +1872,13 @@ int primordial_inflation_spectra(
     /* loop over Fourier wavenumbers */
     for (index_k=0; index_k < ppm->lnk_size; index_k++) {
 
+      class_trace_begin();
+
 #ifdef _OPENMP
       tstart = omp_get_wtime();
 #endif
 
-      class_call_parallel(primordial_inflation_one_wavenumber(ppt,ppm,ppr,y_ini,index_k),
+      class_call_parallel(primordial_inflation_one_wavenumber(ppt,ppm,ppr,y_start+index_k*ppm->in_bg_size,index_k),
                           ppm->error_message,
                           ppm->error_message);
 
@@ -1654,6 +1888,8 @@ int primordial_inflation_spectra(
       tspent += tstop-tstart;
 #endif
 
+      class_trace_end("primordial","index_k",index_k);
+
     }
 
 #ifdef _OPENMP
@@ -1664,6 +1900,8 @@ int primordial_inflation_spectra(
 
   } /* end of parallel zone */
 
+  free(y_start);
+
   if (abort == _TRUE_) return _FAILURE_;
 
   ppm->is_non_zero[ppt->index_md_scalars][ppt->index_ic_ad] = _TRUE_;
@@ -1682,7 +1920,7 @@ int primordial_inflation_spectra(
  * @param ppt     Input: pointer to perturbation structure
  * @param ppm     Input/output: pointer to primordial structure
  * @param ppr     Input: pointer to precision structure
- * @param y_ini   Input: initial conditions for the vector of background/perturbations, already allocated and filled
+ * @param y_start Input: background when aH = k/primordial_inflation_ratio_min, computed by primordial_inflation_spectra()
  * @param index_k Input: index of wavenumber to be considered
  * @return the error status
  */
@@ -1691,7 +1929,7 @@ int primordial_inflation_one_wavenumber(
                                         struct perturbations * ppt,
                                         struct primordial * ppm,
                                         struct precision * ppr,
-                                        double * y_ini,
+                                        double * y_start,
                                         int index_k
                                         ) {
   double k;
@@ -1706,25 +1944,12 @@ int primordial_inflation_one_wavenumber(
   class_alloc(y,ppm->in_size*sizeof(double),ppm->error_message);
   class_alloc(dy,ppm->in_size*sizeof(double),ppm->error_message);
 
-  /** - initialize the background part of the running vector */
-  y[ppm->index_in_a] = y_ini[ppm->index_in_a];
-  y[ppm->index_in_phi] = y_ini[ppm->index_in_phi];
+  /** - initialize the background part of the running vector, at the
+      relevant initial time for integrating perturbations */
+  y[ppm->index_in_a] = y_start[ppm->index_in_a];
+  y[ppm->index_in_phi] = y_start[ppm->index_in_phi];
   if ((ppm->primordial_spec_type == inflation_V) || (ppm->primordial_spec_type == inflation_V_end))
-    y[ppm->index_in_dphi] = y_ini[ppm->index_in_dphi];
-
-  /** - evolve the background until the relevant initial time for
-      integrating perturbations */
-  class_call(primordial_inflation_evolve_background(ppm,
-                                                    ppr,
-                                                    y,
-                                                    dy,
-                                                    _aH_,
-                                                    k/ppr->primordial_inflation_ratio_min,
-                                                    _FALSE_,
-                                                    forward,
-                                                    conformal),
-             ppm->error_message,
-             ppm->error_message);
+    y[ppm->index_in_dphi] = y_start[ppm->index_in_dphi];
 
   /** - evolve the background/perturbation equations from this time and
       until some time after Horizon crossing */
@@ -3255,11 +3480,216 @@ int primordial_inflation_derivs(
   return _SUCCESS_;
 }
 
+/**
+ * Table of the external_Pk mode kept in memory for the next runs when
+ * external_Pk_cache is set.
+ */
+
+static struct primordial_external_cache primordial_external_cache_slot;
+
+/**
+ * Persistent process of the external_Pk mode with
+ * external_Pk_protocol = worker: its command, its process id, and the
+ * pipes connected to its standard input (requests) and output
+ * (answers).
+ */
+
+static char * primordial_external_worker_command = NULL;
+static pid_t primordial_external_worker_pid = 0;
+static FILE * primordial_external_worker_request = NULL;
+static FILE * primordial_external_worker_answer = NULL;
+
+/**
+ * Stop the worker of the external_Pk mode, if any: close its standard
+ * input, which tells it to exit, and wait for it.
+ *
+ * @return the error status
+ */
+
+static int primordial_external_worker_stop() {
+
+  if (primordial_external_worker_pid > 0) {
+    fclose(primordial_external_worker_request);
+    fclose(primordial_external_worker_answer);
+    waitpid(primordial_external_worker_pid,NULL,0);
+  }
+
+  free(primordial_external_worker_command);
+
+  primordial_external_worker_command = NULL;
+  primordial_external_worker_pid = 0;
+  primordial_external_worker_request = NULL;
+  primordial_external_worker_answer = NULL;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Make sure that a worker running the command of the external_Pk mode
+ * is alive. The worker of a previous run is kept if it runs the same
+ * command and has not exited; otherwise it is replaced by a new one,
+ * launched through the shell without arguments.
+ *
+ * @param ppm  Input: pointer to primordial structure
+ * @return the error status
+ */
+
+static int primordial_external_worker_start(
+                                            struct primordial * ppm
+                                            ) {
+
+  int to_worker[2];
+  int from_worker[2];
+  pid_t pid;
+
+  if (primordial_external_worker_pid > 0) {
+    if ((strcmp(primordial_external_worker_command,ppm->command) == 0) &&
+        (waitpid(primordial_external_worker_pid,NULL,WNOHANG) == 0)) {
+      return _SUCCESS_;
+    }
+    primordial_external_worker_stop();
+  }
+
+  if (ppm->primordial_verbose > 0)
+    printf(" -> launching worker: %s\n",ppm->command);
+
+  class_test((pipe(to_worker) != 0) || (pipe(from_worker) != 0),
+             ppm->error_message,
+             "Could not create the pipes to the external command.");
+
+  pid = fork();
+
+  class_test(pid < 0,
+             ppm->error_message,
+             "Could not launch the external command. Maybe you ran out of memory.");
+
+  if (pid == 0) {
+    /* child: connect the pipes to the standard input and output and run the command */
+    dup2(to_worker[0],STDIN_FILENO);
+    dup2(from_worker[1],STDOUT_FILENO);
+    close(to_worker[0]);
+    close(to_worker[1]);
+    close(from_worker[0]);
+    close(from_worker[1]);
+    execl("/bin/sh","sh","-c",ppm->command,(char *)NULL);
+    _exit(127);
+  }
+
+  close(to_worker[0]);
+  close(from_worker[1]);
+
+  primordial_external_worker_pid = pid;
+  primordial_external_worker_request = fdopen(to_worker[1],"w");
+  primordial_external_worker_answer = fdopen(from_worker[0],"r");
+
+  class_alloc(primordial_external_worker_command,
+              (strlen(ppm->command)+1)*sizeof(char),
+              ppm->error_message);
+  strcpy(primordial_external_worker_command,ppm->command);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Copy a table of ln(k), ln(P_s(k)) and ln(P_t(k)) into the primordial
+ * structure.
+ *
+ * @param ppt     Input: pointer to perturbation structure
+ * @param ppm     Input/output: pointer to primordial structure
+ * @param lnk_size Input: number of values of k
+ * @param lnk     Input: ln(k)
+ * @param lnpk_s  Input: ln of the scalar spectrum
+ * @param lnpk_t  Input: ln of the tensor spectrum (only read if there are tensors)
+ * @return the error status
+ */
+
+static int primordial_external_spectrum_store(
+                                              struct perturbations * ppt,
+                                              struct primordial * ppm,
+                                              int lnk_size,
+                                              double * lnk,
+                                              double * lnpk_s,
+                                              double * lnpk_t
+                                              ) {
+
+  ppm->lnk_size = lnk_size;
+  /** - Make room */
+  class_realloc(ppm->lnk,
+                ppm->lnk,
+                ppm->lnk_size*sizeof(double),
+                ppm->error_message);
+  class_realloc(ppm->lnpk[ppt->index_md_scalars],
+                ppm->lnpk[ppt->index_md_scalars],
+                ppm->lnk_size*sizeof(double),
+                ppm->error_message);
+  class_realloc(ppm->ddlnpk[ppt->index_md_scalars],
+                ppm->ddlnpk[ppt->index_md_scalars],
+                ppm->lnk_size*sizeof(double),
+                ppm->error_message);
+  if (ppt->has_tensors == _TRUE_) {
+    class_realloc(ppm->lnpk[ppt->index_md_tensors],
+                  ppm->lnpk[ppt->index_md_tensors],
+                  ppm->lnk_size*sizeof(double),
+                  ppm->error_message);
+    class_realloc(ppm->ddlnpk[ppt->index_md_tensors],
+                  ppm->ddlnpk[ppt->index_md_tensors],
+                  ppm->lnk_size*sizeof(double),
+                  ppm->error_message);
+  };
+  /** - Store values */
+  memcpy(ppm->lnk,lnk,lnk_size*sizeof(double));
+  memcpy(ppm->lnpk[ppt->index_md_scalars],lnpk_s,lnk_size*sizeof(double));
+  if (ppt->has_tensors == _TRUE_)
+    memcpy(ppm->lnpk[ppt->index_md_tensors],lnpk_t,lnk_size*sizeof(double));
+  /** - Tell CLASS that there are scalar (and tensor) modes */
+  ppm->is_non_zero[ppt->index_md_scalars][ppt->index_ic_ad] = _TRUE_;
+  if (ppt->has_tensors == _TRUE_)
+    ppm->is_non_zero[ppt->index_md_tensors][ppt->index_ic_ten] = _TRUE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the table kept in memory by external_Pk_cache.
+ *
+ * @return the error status
+ */
+
+static int primordial_external_spectrum_clear_cache() {
+
+  struct primordial_external_cache * pec = &primordial_external_cache_slot;
+
+  if (pec->is_filled == _TRUE_) {
+    free(pec->command);
+    free(pec->lnk);
+    free(pec->lnpk_s);
+    if (pec->has_tensors == _TRUE_)
+      free(pec->lnpk_t);
+  }
+  pec->is_filled = _FALSE_;
+
+  return _SUCCESS_;
+}
+
 /**
  * This routine reads the primordial spectrum from an external command,
  * and stores the tabulated values.
  * The sampling of the k's given by the external command is preserved.
  *
+ * Depending on external_Pk_protocol, the command is either launched at
+ * each run with the custom parameters as arguments and writes its table
+ * as lines of text ('text') or as doubles in binary ('binary'), or it
+ * is launched once and kept alive between runs ('worker'). A worker
+ * receives on its standard input one line per run, with the number of
+ * columns expected (2, or 3 with tensors) followed by the ten custom
+ * parameters; it answers with a line giving the number of values of k,
+ * followed by the rows of the table as doubles in binary. It exits when
+ * its standard input is closed.
+ *
+ * With external_Pk_cache, the table is kept in memory, and a later run
+ * with the same command and custom parameters reuses it without calling
+ * the command.
+ *
  * Author: Jesus Torrado (torradocacho@lorentz.leidenuniv.nl)
  * Date:   2013-12-20
  *
@@ -3278,12 +3708,46 @@ int primordial_external_spectrum_init(
   char line[_LINE_LENGTH_MAX_];
   char command_with_arguments[2*_ARGUMENT_LENGTH_MAX_];
   FILE *process;
-  int n_data_guess, n_data = 0;
+  int n_data_guess, n_data = 0, n_data_announced = -1;
   double *k = NULL, *pks = NULL, *pkt = NULL, *tmp = NULL;
   double this_k, this_pks, this_pkt;
+  double row[3];
+  int n_columns;
+  double custom[10];
+  struct primordial_external_cache * pec = &primordial_external_cache_slot;
   int status;
   int index_k;
 
+  n_columns = (ppt->has_tensors == _TRUE_ ? 3 : 2);
+
+  custom[0] = ppm->custom1;
+  custom[1] = ppm->custom2;
+  custom[2] = ppm->custom3;
+  custom[3] = ppm->custom4;
+  custom[4] = ppm->custom5;
+  custom[5] = ppm->custom6;
+  custom[6] = ppm->custom7;
+  custom[7] = ppm->custom8;
+  custom[8] = ppm->custom9;
+  custom[9] = ppm->custom10;
+
+  /** - With the cache, reuse the table of a previous run with the same command and custom parameters */
+  if ((ppm->external_cache == _TRUE_) &&
+      (pec->is_filled == _TRUE_) &&
+      (strcmp(pec->command,ppm->command) == 0) &&
+      (memcmp(pec->custom,custom,10*sizeof(double)) == 0) &&
+      (pec->has_tensors == ppt->has_tensors)) {
+
+    if (ppm->primordial_verbose > 0)
+      printf(" -> reusing the table of: %s\n",ppm->command);
+
+    class_call(primordial_external_spectrum_store(ppt,ppm,pec->lnk_size,pec->lnk,pec->lnpk_s,pec->lnpk_t),
+               ppm->error_message,
+               ppm->error_message);
+
+    return _SUCCESS_;
+  }
+
   /** - Initialization */
   /* Prepare the data (with some initial size) */
   n_data_guess = 100;
@@ -3291,35 +3755,80 @@ int primordial_external_spectrum_init(
   pks = (double *)malloc(n_data_guess*sizeof(double));
   if (ppt->has_tensors == _TRUE_)
     pkt = (double *)malloc(n_data_guess*sizeof(double));
-  /* Prepare the command */
-  /* If the command is just a "cat", no arguments need to be passed */
-  if(strncmp("cat ", ppm->command, 4) == 0) {
-    sprintf(arguments, " ");
+
+  /** - Send the request to the worker, which answers first with the number of rows */
+  if (ppm->external_protocol == external_worker) {
+
+    class_call(primordial_external_worker_start(ppm),
+               ppm->error_message,
+               ppm->error_message);
+
+    if (ppm->primordial_verbose > 0)
+      printf(" -> requesting table from worker: %s\n",ppm->command);
+
+    fprintf(primordial_external_worker_request,
+            "%d %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g\n",
+            n_columns,
+            custom[0], custom[1], custom[2], custom[3], custom[4],
+            custom[5], custom[6], custom[7], custom[8], custom[9]);
+    fflush(primordial_external_worker_request);
+
+    process = primordial_external_worker_answer;
+
+    class_test_except((fgets(line, sizeof(line)-1, process) == NULL) ||
+                      (sscanf(line, "%d", &n_data_announced) != 1),
+                      ppm->error_message,
+                      primordial_external_worker_stop(),
+                      "The external worker did not answer with the number of values of k. "
+                      "Try running it by hand to check for errors.");
   }
-  /* otherwise pass the list of arguments */
+
+  /** - Otherwise, launch the command and retrieve the output */
   else {
-    sprintf(arguments, " %g %g %g %g %g %g %g %g %g %g",
-            ppm->custom1, ppm->custom2, ppm->custom3, ppm->custom4, ppm->custom5,
-            ppm->custom6, ppm->custom7, ppm->custom8, ppm->custom9, ppm->custom10);
+    /* Prepare the command */
+    /* If the command is just a "cat", no arguments need to be passed */
+    if(strncmp("cat ", ppm->command, 4) == 0) {
+      sprintf(arguments, " ");
+    }
+    /* otherwise pass the list of arguments */
+    else {
+      sprintf(arguments, " %g %g %g %g %g %g %g %g %g %g",
+              ppm->custom1, ppm->custom2, ppm->custom3, ppm->custom4, ppm->custom5,
+              ppm->custom6, ppm->custom7, ppm->custom8, ppm->custom9, ppm->custom10);
+    }
+    /* write the actual command in a string */
+    sprintf(command_with_arguments, "%s %s", ppm->command, arguments);
+    if (ppm->primordial_verbose > 0)
+      printf(" -> running: %s\n",command_with_arguments);
+
+    /* Launch the process */
+    process = popen(command_with_arguments, "r");
+    class_test(process == NULL,
+               ppm->error_message,
+               "The program failed to set the environment for the external command. Maybe you ran out of memory.");
   }
-  /* write the actual command in a string */
-  sprintf(command_with_arguments, "%s %s", ppm->command, arguments);
-  if (ppm->primordial_verbose > 0)
-    printf(" -> running: %s\n",command_with_arguments);
 
-  /** - Launch the command and retrieve the output */
-  /* Launch the process */
-  process = popen(command_with_arguments, "r");
-  class_test(process == NULL,
-             ppm->error_message,
-             "The program failed to set the environment for the external command. Maybe you ran out of memory.");
   /* Read output and store it */
-  while (fgets(line, sizeof(line)-1, process) != NULL) {
-    if (ppt->has_tensors == _TRUE_) {
-      sscanf(line, "%lf %lf %lf", &this_k, &this_pks, &this_pkt);
+  while (_TRUE_) {
+    if (ppm->external_protocol == external_text) {
+      if (fgets(line, sizeof(line)-1, process) == NULL)
+        break;
+      if (ppt->has_tensors == _TRUE_) {
+        sscanf(line, "%lf %lf %lf", &this_k, &this_pks, &this_pkt);
+      }
+      else {
+        sscanf(line, "%lf %lf", &this_k, &this_pks);
+      }
     }
     else {
-      sscanf(line, "%lf %lf", &this_k, &this_pks);
+      if (n_data == n_data_announced)
+        break;
+      if (fread(row, sizeof(double), n_columns, process) != n_columns)
+        break;
+      this_k = row[0];
+      this_pks = row[1];
+      if (ppt->has_tensors == _TRUE_)
+        this_pkt = row[2];
     }
     /* Standard technique in C: if too many data, double the size of the vectors */
     /* (it is faster and safer that reallocating every new line) */
@@ -3350,20 +3859,30 @@ int primordial_external_spectrum_init(
       pkt[n_data] = this_pkt;
     }
     n_data++;
-    /* Check ascending order of the k's */
-    if(n_data>1) {
-      class_test(k[n_data-1] <= k[n_data-2],
-                 ppm->error_message,
-                 "The k's are not strictly sorted in ascending order, "
-                 "as it is required for the calculation of the splines.\n");
-    }
   }
-  /* Close the process */
-  status = pclose(process);
-  class_test(status != 0.,
-             ppm->error_message,
-             "The attempt to launch the external command was unsuccessful. "
-             "Try doing it by hand to check for errors.");
+  if (ppm->external_protocol == external_worker) {
+    /* The worker stays alive for the next runs, unless its answer was incomplete */
+    class_test_except(n_data != n_data_announced,
+                      ppm->error_message,
+                      primordial_external_worker_stop(),
+                      "The external worker announced %d values of k but sent %d.",
+                      n_data_announced,n_data);
+  }
+  else {
+    /* Close the process */
+    status = pclose(process);
+    class_test(status != 0.,
+               ppm->error_message,
+               "The attempt to launch the external command was unsuccessful. "
+               "Try doing it by hand to check for errors.");
+  }
+  /* Check ascending order of the k's */
+  for (index_k=1; index_k<n_data; index_k++) {
+    class_test(k[index_k] <= k[index_k-1],
+               ppm->error_message,
+               "The k's are not strictly sorted in ascending order, "
+               "as it is required for the calculation of the splines.\n");
+  }
   /* Test limits of the k's */
   class_test(k[1] > ppt->k_min,
              ppm->error_message,
@@ -3376,54 +3895,63 @@ int primordial_external_spectrum_init(
              "at least 2 points after the maximum value of k: %e . "
              "The splines interpolation would not be safe.",ppt->k_max);
 
-  /** - Store the read results into CLASS structures */
-  ppm->lnk_size = n_data;
-  /** - Make room */
-  class_realloc(ppm->lnk,
-                ppm->lnk,
-                ppm->lnk_size*sizeof(double),
-                ppm->error_message);
-  class_realloc(ppm->lnpk[ppt->index_md_scalars],
-                ppm->lnpk[ppt->index_md_scalars],
-                ppm->lnk_size*sizeof(double),
-                ppm->error_message);
-  class_realloc(ppm->ddlnpk[ppt->index_md_scalars],
-                ppm->ddlnpk[ppt->index_md_scalars],
-                ppm->lnk_size*sizeof(double),
-                ppm->error_message);
-  if (ppt->has_tensors == _TRUE_) {
-    class_realloc(ppm->lnpk[ppt->index_md_tensors],
-                  ppm->lnpk[ppt->index_md_tensors],
-                  ppm->lnk_size*sizeof(double),
-                  ppm->error_message);
-    class_realloc(ppm->ddlnpk[ppt->index_md_tensors],
-                  ppm->ddlnpk[ppt->index_md_tensors],
-                  ppm->lnk_size*sizeof(double),
-                  ppm->error_message);
-  };
-  /** - Store values */
-  for (index_k=0; index_k<ppm->lnk_size; index_k++) {
-    ppm->lnk[index_k] = log(k[index_k]);
-    ppm->lnpk[ppt->index_md_scalars][index_k] = log(pks[index_k]);
+  /** - Store the read results into CLASS structures, as logarithms */
+  for (index_k=0; index_k<n_data; index_k++) {
+    k[index_k] = log(k[index_k]);
+    pks[index_k] = log(pks[index_k]);
     if (ppt->has_tensors == _TRUE_)
-      ppm->lnpk[ppt->index_md_tensors][index_k] = log(pkt[index_k]);
-    /* DEBUG (with tensors)
-       fprintf(stderr,"Storing[%d(+1) of %d]: \n k = %g == %g\n pks = %g == %g\n pkt = %g == %g\n",
-       index_k, n_data,
-       ppm->lnk[index_k], log(k[index_k]),
-       ppm->lnpk[ppt->index_md_scalars][index_k], log(pks[index_k]),
-       ppm->lnpk[ppt->index_md_tensors][index_k], log(pkt[index_k]));
-    */
-  };
+      pkt[index_k] = log(pkt[index_k]);
+  }
+  class_call(primordial_external_spectrum_store(ppt,ppm,n_data,k,pks,pkt),
+             ppm->error_message,
+             ppm->error_message);
+
+  /** - With the cache, keep a copy of the table and of its key */
+  if (ppm->external_cache == _TRUE_) {
+    class_call(primordial_external_spectrum_clear_cache(),
+               ppm->error_message,
+               ppm->error_message);
+    class_alloc(pec->command,(strlen(ppm->command)+1)*sizeof(char),ppm->error_message);
+    strcpy(pec->command,ppm->command);
+    memcpy(pec->custom,custom,10*sizeof(double));
+    pec->has_tensors = ppt->has_tensors;
+    pec->lnk_size = n_data;
+    class_alloc(pec->lnk,n_data*sizeof(double),ppm->error_message);
+    memcpy(pec->lnk,k,n_data*sizeof(double));
+    class_alloc(pec->lnpk_s,n_data*sizeof(double),ppm->error_message);
+    memcpy(pec->lnpk_s,pks,n_data*sizeof(double));
+    if (ppt->has_tensors == _TRUE_) {
+      class_alloc(pec->lnpk_t,n_data*sizeof(double),ppm->error_message);
+      memcpy(pec->lnpk_t,pkt,n_data*sizeof(double));
+    }
+    pec->is_filled = _TRUE_;
+  }
+
   /** - Release the memory used locally */
   free(k);
   free(pks);
   if (ppt->has_tensors == _TRUE_)
     free(pkt);
-  /** - Tell CLASS that there are scalar (and tensor) modes */
-  ppm->is_non_zero[ppt->index_md_scalars][ppt->index_ic_ad] = _TRUE_;
-  if (ppt->has_tensors == _TRUE_)
-    ppm->is_non_zero[ppt->index_md_tensors][ppt->index_ic_ten] = _TRUE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the table kept in memory by external_Pk_cache and stop the
+ * worker of external_Pk_protocol = worker, if any. The next run calls
+ * the external command again.
+ *
+ * @return the error status
+ */
+
+int primordial_external_spectrum_clear() {
+
+#pragma omp critical (primordial_external)
+  {
+    primordial_external_spectrum_clear_cache();
+
+    primordial_external_worker_stop();
+  }
 
   return _SUCCESS_;
 }
@@ -38,6 +38,8 @@
 #include "helium.h"
 #include "wrap_hyrec.h"
 
+#include <sys/stat.h>
+
 
 /**
  * Thermodynamics quantities at given redshift z.
@@ -227,6 +229,84 @@ int thermodynamics_at_z(
   return _SUCCESS_;
 }
 
+/**
+ * Thermodynamics quantities at given redshift z, for a subset of them only.
+ *
+ * Same as thermodynamics_at_z() in closeby mode, but the interval is
+ * hunted for starting from an explicit hint owned by the caller
+ * (e.g. one per workspace), and only the requested quantities are
+ * interpolated. They are written at their usual position
+ * pvecthermo[index_th], other entries are left untouched. Outside of
+ * the range where all quantities are splined (z>z_initial, or at late
+ * times for reionization parametrizations requiring linear
+ * interpolation), this just calls thermodynamics_at_z() and all
+ * quantities are returned.
+ *
+ * @param pba          Input: pointer to background structure
+ * @param pth          Input: pointer to the thermodynamics structure (containing pre-computed table)
+ * @param z            Input: redshift
+ * @param columns      Input: list of indices index_th of the requested quantities, or NULL for the first columns_size ones
+ * @param columns_size Input: number of requested quantities
+ * @param last_index   Input/Output: index of the previous/current interval in the interpolation table
+ * @param pvecback     Input: vector of background quantities, as in thermodynamics_at_z() (at least a, H and H_prime should be filled)
+ * @param pvecthermo   Output: vector of thermodynamics quantities (assumed to be already allocated)
+ * @return the error status
+ */
+
+int thermodynamics_at_z_columns(struct background * pba,
+                                struct thermodynamics * pth,
+                                double z,
+                                int * columns,
+                                int columns_size,
+                                int * last_index,
+                                double * pvecback,
+                                double * pvecthermo
+                                ) {
+
+  double h,a,b;
+  double * line_inf;
+  double * line_sup;
+  double * dd_line_inf;
+  double * dd_line_sup;
+  int i,index_th;
+
+  if ((z >= pth->z_table[pth->tt_size-1])
+      || ((pth->reio_parametrization == reio_half_tanh) && (z < 2*pth->z_reio))
+      || ((pth->reio_parametrization == reio_inter) && (z < 50.))) {
+
+    class_call(thermodynamics_at_z(pba,pth,z,inter_closeby,last_index,pvecback,pvecthermo),
+               pth->error_message,
+               pth->error_message);
+
+    return _SUCCESS_;
+  }
+
+  class_call(array_spline_hunt(pth->z_table,
+                               pth->tt_size,
+                               z,
+                               last_index,
+                               &h,
+                               &a,
+                               &b,
+                               pth->error_message),
+             pth->error_message,
+             pth->error_message);
+
+  line_inf = pth->thermodynamics_table+(*last_index)*pth->th_size;
+  line_sup = line_inf+pth->th_size;
+  dd_line_inf = pth->d2thermodynamics_dz2_table+(*last_index)*pth->th_size;
+  dd_line_sup = dd_line_inf+pth->th_size;
+
+  for (i=0; i<columns_size; i++) {
+    index_th = (columns == NULL) ? i : columns[i];
+    pvecthermo[index_th] =
+      a*line_inf[index_th] + b*line_sup[index_th]
+      + ((a*a*a-a)*dd_line_inf[index_th] + (b*b*b-b)*dd_line_sup[index_th])*h*h/6.;
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * Initialize the thermodynamics structure, and in particular the
  * thermodynamics interpolation table.
@@ -296,6 +376,18 @@ int thermodynamics_init(
     ppr->thermo_Nz_log = ppr->thermo_Nz_log_if_idm_dr;
   }
 
+  /** - if the thermodynamics was computed at the converged step of the shooting, there is nothing left to do */
+  if (pth->is_from_shooting == _TRUE_) {
+    pth->is_from_shooting = _FALSE_;
+    if (pth->thermodynamics_verbose > 0) {
+      printf(" -> thermodynamics computed during the shooting\n");
+      class_call(thermodynamics_output_summary(pba,pth),
+                 pth->error_message,
+                 pth->error_message);
+    }
+    return _SUCCESS_;
+  }
+
   /** - test whether all parameters are in the correct regime */
   class_call(thermodynamics_checks(ppr,pba,pth),
              pth->error_message,
@@ -387,6 +479,8 @@ int thermodynamics_free(
   free(pth->thermodynamics_table);
   free(pth->d2thermodynamics_dz2_table);
 
+  class_memory_leaks();
+
   return _SUCCESS_;
 }
 
@@ -414,21 +508,12 @@ int thermodynamics_helium_from_bbn(
   /** Summary: */
 
   /** Define local variables */
-  FILE * fA;
-  char line[_LINE_LENGTH_MAX_];
-  char * left;
+  struct bbn_table * pbbn;
+  int status;
 
-  int num_omegab=0;
-  int num_deltaN=0;
-
-  double * omegab=NULL;
-  double * deltaN=NULL;
-  double * YHe=NULL;
-  double * ddYHe=NULL;
   double * YHe_at_deltaN=NULL;
   double * ddYHe_at_deltaN=NULL;
 
-  int array_line=0;
   double DeltaNeff;
   double omega_b;
   int last_index;
@@ -461,17 +546,145 @@ int thermodynamics_helium_from_bbn(
   /** - compute Delta N_eff as defined in bbn file, i.e. \f$ \Delta N_{eff}=0\f$ means \f$ N_{eff}=3.046\f$. Note that even if 3.044 is a better default value, we must keep 3.046 here as long as the BBN file we are using has been computed assuming 3.046. */
   DeltaNeff = Neff_bbn - 3.046;
 
-  /* the following file is assumed to contain (apart from comments and blank lines):
-     - the two numbers (num_omegab, num_deltaN) = number of values of BBN free parameters
-     - three columns (omegab, deltaN, YHe) where omegab = Omega0_b h^2 and deltaN = Neff-3.046 by definition
-     - omegab and deltaN are assumed to be arranged as:
-     omegab1 deltaN1 YHe
-     omegab2 deltaN1 YHe
-     .....
-     omegab1 delatN2 YHe
-     omegab2 deltaN2 YHe
-     .....
-  */
+  /** - get the table of YHe(omegab, deltaN), splined along deltaN, read from the file only if this was not already done by a previous run */
+#pragma omp critical (thermodynamics_bbn)
+  status = thermodynamics_bbn_load(ppr,pth,&pbbn);
+  if (status == _FAILURE_)
+    return _FAILURE_;
+
+  omega_b=pba->Omega0_b*pba->h*pba->h;
+
+  class_test(omega_b < pbbn->omegab[0],
+             pth->error_message,
+             "You have asked for an unrealistic small value omega_b = %e. The corresponding value of the primordial helium fraction cannot be found in the interpolation table. If you really want this value, you should fix YHe to a given value rather than to BBN",
+             omega_b);
+
+  class_test(omega_b > pbbn->omegab[pbbn->num_omegab-1],
+             pth->error_message,
+             "You have asked for an unrealistic high value omega_b = %e. The corresponding value of the primordial helium fraction cannot be found in the interpolation table. If you really want this value, you should fix YHe to a given value rather than to BBN",
+             omega_b);
+
+  class_test(DeltaNeff < pbbn->deltaN[0],
+             pth->error_message,
+             "You have asked for an unrealistic small value of Delta N_eff = %e. The corresponding value of the primordial helium fraction cannot be found in the interpolation table. If you really want this value, you should fix YHe to a given value rather than to BBN",
+             DeltaNeff);
+
+  class_test(DeltaNeff > pbbn->deltaN[pbbn->num_deltaN-1],
+             pth->error_message,
+             "You have asked for an unrealistic high value of Delta N_eff = %e. The corresponding value of the primordial helium fraction cannot be found in the interpolation table. If you really want this value, you should fix YHe to a given value rather than to BBN",
+             DeltaNeff);
+
+  class_alloc(YHe_at_deltaN,pbbn->num_omegab*sizeof(double),pth->error_message);
+  class_alloc(ddYHe_at_deltaN,pbbn->num_omegab*sizeof(double),pth->error_message);
+
+  /** - interpolate in one dimension (along deltaN) */
+  class_call(array_interpolate_spline(pbbn->deltaN,
+                                      pbbn->num_deltaN,
+                                      pbbn->YHe,
+                                      pbbn->ddYHe,
+                                      pbbn->num_omegab,
+                                      DeltaNeff,
+                                      &last_index,
+                                      YHe_at_deltaN,
+                                      pbbn->num_omegab,
+                                      pth->error_message),
+             pth->error_message,
+             pth->error_message);
+
+  /** - spline in remaining dimension (along omegab) */
+  class_call(array_spline_table_lines(pbbn->omegab,
+                                      pbbn->num_omegab,
+                                      YHe_at_deltaN,
+                                      1,
+                                      ddYHe_at_deltaN,
+                                      _SPLINE_NATURAL_,
+                                      pth->error_message),
+             pth->error_message,
+             pth->error_message);
+
+  /** - interpolate in remaining dimension (along omegab) */
+  class_call(array_interpolate_spline(pbbn->omegab,
+                                      pbbn->num_omegab,
+                                      YHe_at_deltaN,
+                                      ddYHe_at_deltaN,
+                                      1,
+                                      omega_b,
+                                      &last_index,
+                                      &(pth->YHe),
+                                      1,
+                                      pth->error_message),
+             pth->error_message,
+             pth->error_message);
+
+  /** - deallocate arrays */
+  free(YHe_at_deltaN);
+  free(ddYHe_at_deltaN);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Table of helium fractions read by thermodynamics_bbn_load()
+ */
+
+static struct bbn_table thermodynamics_bbn_table;
+static short thermodynamics_bbn_loaded = _FALSE_;
+
+/**
+ * Read the table of primordial helium fractions ppr->sBBN_file and
+ * spline it along deltaN, or return the one already in memory if it
+ * was read from the same file, with unchanged size and modification
+ * time. This avoids opening and parsing the file at each run in
+ * codes calling CLASS many times in the same process.
+ *
+ * Apart from comments and blank lines, the file is assumed to contain:
+ * - the two numbers (num_omegab, num_deltaN) = number of values of BBN free parameters
+ * - three columns (omegab, deltaN, YHe) where omegab = Omega0_b h^2 and deltaN = Neff-3.046 by definition
+ * - omegab and deltaN are assumed to be arranged as:
+ *   omegab1 deltaN1 YHe
+ *   omegab2 deltaN1 YHe
+ *   .....
+ *   omegab1 delatN2 YHe
+ *   omegab2 deltaN2 YHe
+ *   .....
+ *
+ * @param ppr   Input: pointer to precision structure
+ * @param pth   Input: pointer to thermodynamics structure (for error messages and verbosity)
+ * @param ppbbn Output: pointer to the table
+ * @return the error status
+ */
+
+int thermodynamics_bbn_load(
+                            struct precision * ppr,
+                            struct thermodynamics * pth,
+                            struct bbn_table ** ppbbn
+                            ) {
+
+  struct bbn_table * pbbn = &thermodynamics_bbn_table;
+  struct stat file_status;
+  FILE * fA;
+  char line[_LINE_LENGTH_MAX_];
+  char * left;
+  int array_line=0;
+
+  class_test(stat(ppr->sBBN_file,&file_status) != 0,
+             pth->error_message,
+             "could not find the BBN file %s",ppr->sBBN_file);
+
+  if ((thermodynamics_bbn_loaded == _TRUE_) &&
+      (strcmp(pbbn->file,ppr->sBBN_file) == 0) &&
+      (pbbn->bytes == (long long)file_status.st_size) &&
+      (pbbn->mtime == (long long)file_status.st_mtime)) {
+    *ppbbn = pbbn;
+    return _SUCCESS_;
+  }
+
+  class_call(thermodynamics_bbn_clear(),
+             pth->error_message,
+             pth->error_message);
+
+  pbbn->num_omegab = 0;
+  pbbn->num_deltaN = 0;
 
   class_open(fA,ppr->sBBN_file, "r",pth->error_message);
 
@@ -490,28 +703,31 @@ int thermodynamics_helium_from_bbn(
 
       /* if the line contains data, we must interpret it. If (num_omegab, num_deltaN)=(0,0), the current line must contain
          their values. Otherwise, it must contain (omegab, delatN, YHe). */
-      if ((num_omegab==0) && (num_deltaN==0)) {
+      if ((pbbn->num_omegab==0) && (pbbn->num_deltaN==0)) {
 
         /* read (num_omegab, num_deltaN), infer size of arrays and allocate them */
-        class_test(sscanf(line,"%d %d",&num_omegab,&num_deltaN) != 2,
+        class_test(sscanf(line,"%d %d",&(pbbn->num_omegab),&(pbbn->num_deltaN)) != 2,
                    pth->error_message,
                    "could not read value of parameters (num_omegab,num_deltaN) in file %s\n",ppr->sBBN_file);
 
-        class_alloc(omegab,num_omegab*sizeof(double),pth->error_message);
-        class_alloc(deltaN,num_deltaN*sizeof(double),pth->error_message);
-        class_alloc(YHe,num_omegab*num_deltaN*sizeof(double),pth->error_message);
-        class_alloc(ddYHe,num_omegab*num_deltaN*sizeof(double),pth->error_message);
-        class_alloc(YHe_at_deltaN,num_omegab*sizeof(double),pth->error_message);
-        class_alloc(ddYHe_at_deltaN,num_omegab*sizeof(double),pth->error_message);
+        class_alloc(pbbn->omegab,pbbn->num_omegab*sizeof(double),pth->error_message);
+        class_alloc(pbbn->deltaN,pbbn->num_deltaN*sizeof(double),pth->error_message);
+        class_alloc(pbbn->YHe,pbbn->num_omegab*pbbn->num_deltaN*sizeof(double),pth->error_message);
+        class_alloc(pbbn->ddYHe,pbbn->num_omegab*pbbn->num_deltaN*sizeof(double),pth->error_message);
         array_line=0;
 
       }
       else{
 
+        class_test(array_line >= pbbn->num_omegab*pbbn->num_deltaN,
+                   pth->error_message,
+                   "file %s contains more lines than announced by (num_omegab,num_deltaN)=(%d,%d)\n",
+                   ppr->sBBN_file,pbbn->num_omegab,pbbn->num_deltaN);
+
         /* read (omegab, deltaN, YHe) */
-        class_test(sscanf(line,"%lg %lg %lg",&(omegab[array_line%num_omegab]),
-                                             &(deltaN[array_line/num_omegab]),
-                                             &(YHe[array_line])
+        class_test(sscanf(line,"%lg %lg %lg",&(pbbn->omegab[array_line%pbbn->num_omegab]),
+                                             &(pbbn->deltaN[array_line/pbbn->num_omegab]),
+                                             &(pbbn->YHe[array_line])
                           ) != 3,
                    pth->error_message,
                    "could not read value of parameters (omegab,deltaN,YHe) in file %s\n",ppr->sBBN_file);
@@ -522,85 +738,57 @@ int thermodynamics_helium_from_bbn(
 
   fclose(fA);
 
+  class_test((pbbn->num_omegab == 0) || (array_line != pbbn->num_omegab*pbbn->num_deltaN),
+             pth->error_message,
+             "file %s contains %d lines of data while (num_omegab,num_deltaN)=(%d,%d)\n",
+             ppr->sBBN_file,array_line,pbbn->num_omegab,pbbn->num_deltaN);
+
   /** - spline in one dimension (along deltaN) */
-  class_call(array_spline_table_lines(deltaN,
-                                      num_deltaN,
-                                      YHe,
-                                      num_omegab,
-                                      ddYHe,
+  class_call(array_spline_table_lines(pbbn->deltaN,
+                                      pbbn->num_deltaN,
+                                      pbbn->YHe,
+                                      pbbn->num_omegab,
+                                      pbbn->ddYHe,
                                       _SPLINE_NATURAL_,
                                       pth->error_message),
              pth->error_message,
              pth->error_message);
 
-  omega_b=pba->Omega0_b*pba->h*pba->h;
-
-  class_test(omega_b < omegab[0],
-             pth->error_message,
-             "You have asked for an unrealistic small value omega_b = %e. The corresponding value of the primordial helium fraction cannot be found in the interpolation table. If you really want this value, you should fix YHe to a given value rather than to BBN",
-             omega_b);
+  strcpy(pbbn->file,ppr->sBBN_file);
+  pbbn->bytes = (long long)file_status.st_size;
+  pbbn->mtime = (long long)file_status.st_mtime;
+  thermodynamics_bbn_loaded = _TRUE_;
 
-  class_test(omega_b > omegab[num_omegab-1],
-             pth->error_message,
-             "You have asked for an unrealistic high value omega_b = %e. The corresponding value of the primordial helium fraction cannot be found in the interpolation table. If you really want this value, you should fix YHe to a given value rather than to BBN",
-             omega_b);
+  if (pth->thermodynamics_verbose > 1) {
+    printf(" -> read BBN table from %s (%d x %d values, %lu bytes kept in memory)\n",
+           ppr->sBBN_file,pbbn->num_omegab,pbbn->num_deltaN,
+           (unsigned long)((pbbn->num_omegab+pbbn->num_deltaN+2*pbbn->num_omegab*pbbn->num_deltaN)*sizeof(double)));
+  }
 
-  class_test(DeltaNeff < deltaN[0],
-             pth->error_message,
-             "You have asked for an unrealistic small value of Delta N_eff = %e. The corresponding value of the primordial helium fraction cannot be found in the interpolation table. If you really want this value, you should fix YHe to a given value rather than to BBN",
-             DeltaNeff);
+  *ppbbn = pbbn;
 
-  class_test(DeltaNeff > deltaN[num_deltaN-1],
-             pth->error_message,
-             "You have asked for an unrealistic high value of Delta N_eff = %e. The corresponding value of the primordial helium fraction cannot be found in the interpolation table. If you really want this value, you should fix YHe to a given value rather than to BBN",
-             DeltaNeff);
+  return _SUCCESS_;
+}
 
-  /** - interpolate in one dimension (along deltaN) */
-  class_call(array_interpolate_spline(deltaN,
-                                      num_deltaN,
-                                      YHe,
-                                      ddYHe,
-                                      num_omegab,
-                                      DeltaNeff,
-                                      &last_index,
-                                      YHe_at_deltaN,
-                                      num_omegab,
-                                      pth->error_message),
-             pth->error_message,
-             pth->error_message);
+/**
+ * Free the table of helium fractions kept in memory by
+ * thermodynamics_bbn_load().
+ *
+ * @return the error status
+ */
 
-  /** - spline in remaining dimension (along omegab) */
-  class_call(array_spline_table_lines(omegab,
-                                      num_omegab,
-                                      YHe_at_deltaN,
-                                      1,
-                                      ddYHe_at_deltaN,
-                                      _SPLINE_NATURAL_,
-                                      pth->error_message),
-             pth->error_message,
-             pth->error_message);
+int thermodynamics_bbn_clear(
+                             ) {
 
-  /** - interpolate in remaining dimension (along omegab) */
-  class_call(array_interpolate_spline(omegab,
-                                      num_omegab,
-                                      YHe_at_deltaN,
-                                      ddYHe_at_deltaN,
-                                      1,
-                                      omega_b,
-                                      &last_index,
-                                      &(pth->YHe),
-                                      1,
-                                      pth->error_message),
-             pth->error_message,
-             pth->error_message);
+  struct bbn_table * pbbn = &thermodynamics_bbn_table;
 
-  /** - deallocate arrays */
-  free(omegab);
-  free(deltaN);
-  free(YHe);
-  free(ddYHe);
-  free(YHe_at_deltaN);
-  free(ddYHe_at_deltaN);
+  if (thermodynamics_bbn_loaded == _TRUE_) {
+    free(pbbn->omegab);
+    free(pbbn->deltaN);
+    free(pbbn->YHe);
+    free(pbbn->ddYHe);
+    thermodynamics_bbn_loaded = _FALSE_;
+  }
 
   return _SUCCESS_;
 }
@@ -1391,23 +1579,39 @@ int thermodynamics_solve(
   /* other z sampling variables */
   int i;
   double * mz_output;
+  /* first interval to integrate over (the reionization one if the emulator filled the table above) */
+  int index_interval_start;
+  short emulated;
+  /* recombination history of a previous run with the same input apart from reionization */
+  short use_cache;
+  short cache_found = _FALSE_;
+  int cache_status;
+  unsigned long long cache_key = 0;
 
   /* contains all fixed parameters which should be passed to thermodynamics_derivs */
   struct thermodynamics_parameters_and_workspace tpaw;
 
   /* function pointer to ODE evolver and names of possible evolvers. */
   extern int evolver_rk();
+  extern int evolver_rk_dense();
   extern int evolver_ndf15();
+  extern int evolver_rosenbrock();
   int (*generic_evolver)() = evolver_ndf15;
 
   /** - choose evolver */
   switch (ppr->thermo_evolver) {
   case rk:
-    generic_evolver = evolver_rk;
+    if (ppr->evolver_rk_dense_output == _TRUE_)
+      generic_evolver = evolver_rk_dense;
+    else
+      generic_evolver = evolver_rk;
     break;
   case ndf15:
     generic_evolver = evolver_ndf15;
     break;
+  case rosenbrock:
+    generic_evolver = evolver_rosenbrock;
+    break;
   }
 
   /** - define the fields of the 'thermodynamics parameter and workspace' structure */
@@ -1439,15 +1643,61 @@ int thermodynamics_solve(
     interval_limit[index_ap+1] = -ptw->ptdw->ap_z_limits[index_ap];
   }
 
+  /** - if the recombination emulator is requested (and not only
+        checked), try to interpolate the recombination history
+        until the start of reionization */
+
+  index_interval_start = 0;
+  pth->recombination_emulated = _FALSE_;
+  pth->recombination_emulator_error = -1.;
+
+  if ((pth->has_recombination_emulator == _TRUE_) && (pth->recombination_emulator_check == _FALSE_)) {
+    class_call(thermodynamics_emulator_solve(ppr,pba,pth,ptw,&emulated),
+               pth->error_message,
+               pth->error_message);
+    if (emulated == _TRUE_)
+      index_interval_start = ptw->ptdw->index_ap_reio;
+  }
+
+  /** - otherwise, if a previous run only differed by its reionization
+        parameters, restore its recombination history and only
+        integrate over the reionization interval (with the bisection
+        over z_reio if tau_reio is an input) */
+
+  use_cache = ((ppr->thermodynamics_recombination_cache == _TRUE_) &&
+               (pth->has_exotic_injection == _FALSE_) &&
+               (index_interval_start == 0));
+
+  if (use_cache == _TRUE_) {
+    class_call(thermodynamics_recombination_cache_key(ppr,pba,pth,ptw,interval_limit,&cache_key),
+               pth->error_message,
+               pth->error_message);
+    /* the recombination history in memory is shared by all threads */
+#pragma omp critical (thermodynamics_recombination_cache)
+    cache_status = thermodynamics_recombination_cache_fetch(pth,ptw,cache_key,&cache_found);
+    if (cache_status == _FAILURE_)
+      return _FAILURE_;
+    if (cache_found == _TRUE_)
+      index_interval_start = ptw->ptdw->index_ap_reio;
+  }
+
   /** - loop over intervals over which approximation scheme is
         uniform. For each interval: */
 
-  for (index_interval=0; index_interval<interval_number; index_interval++) {
+  for (index_interval=index_interval_start; index_interval<interval_number; index_interval++) {
 
     /** - --> (a) fix current approximation scheme. */
 
     ptw->ptdw->ap_current = index_interval;
 
+    /* keep the recombination history for later runs before starting reionization */
+    if ((use_cache == _TRUE_) && (cache_found == _FALSE_) && (index_interval == ptw->ptdw->index_ap_reio)) {
+#pragma omp critical (thermodynamics_recombination_cache)
+      cache_status = thermodynamics_recombination_cache_store(pth,ptw,cache_key);
+      if (cache_status == _FAILURE_)
+        return _FAILURE_;
+    }
+
     /** - --> (b) define the vector of quantities to be integrated
                   over. If the current interval starts from the
                   initial time zinitial, fill the vector with initial
@@ -1521,6 +1771,13 @@ int thermodynamics_solve(
 
   }
 
+  /** - compare the full recombination history with the emulated one, if requested */
+  if ((pth->has_recombination_emulator == _TRUE_) && (pth->recombination_emulator_check == _TRUE_)) {
+    class_call(thermodynamics_emulator_check(ppr,pba,pth,ptw),
+               pth->error_message,
+               pth->error_message);
+  }
+
   /** - Compute reionization optical depth, if not supplied as input parameter */
   if (pth->reio_z_or_tau == reio_z) {
 
@@ -1550,60 +1807,952 @@ int thermodynamics_solve(
 }
 
 /**
- * Calculate those thermodynamics quantities which are not inside of
- * the thermodynamics table already.
+ * Grid of recombination histories read by thermodynamics_emulator_load()
+ */
+
+static struct recombination_emulator thermodynamics_emulator_table;
+static short thermodynamics_emulator_loaded = _FALSE_;
+
+/**
+ * Read the grid of recombination histories ppr->recombination_emulator_file,
+ * or return the one already in memory if it was read from the same file.
  *
- * @param ppr        Input: pointer to precision structure
- * @param pba        Input: pointer to background structure
- * @param pth        Input/Output: pointer to initialized thermodynamics structure
- * @param pvecback   Input: pointer to some allocated pvecback
+ * Apart from comments and blank lines, the file is assumed to contain:
+ * - the recombination code used to compute the grid ('hyrec' or 'recfast') and the CMB temperature today in K;
+ * - the numbers of nodes along omega_b, omega_cdm, YHe and N_eff, and the number of redshifts;
+ * - the growing values of the nodes along omega_b, then omega_cdm, YHe and N_eff;
+ * - the growing values of the redshifts;
+ * - for each node (N_eff running fastest, omega_b slowest) and each redshift, the triplet (x_e, T_b, dT_b/dz).
+ *
+ * Numbers can be split across lines in any way.
+ *
+ * @param ppr   Input: pointer to precision structure
+ * @param pth   Input: pointer to thermodynamics structure (only for error messages)
+ * @param pprem Output: pointer to the grid
  * @return the error status
  */
 
-int thermodynamics_calculate_remaining_quantities(
-                                                  struct precision * ppr,
-                                                  struct background * pba,
-                                                  struct thermodynamics* pth,
-                                                  double* pvecback
-                                                  ) {
+int thermodynamics_emulator_load(
+                                 struct precision * ppr,
+                                 struct thermodynamics * pth,
+                                 struct recombination_emulator ** pprem
+                                 ) {
 
-  /** Summary: */
+  struct recombination_emulator * prem = &thermodynamics_emulator_table;
+  FILE * fA;
+  char line[_LINE_LENGTH_MAX_];
+  char algorithm[_LINE_LENGTH_MAX_];
+  char * left;
+  char * right;
+  short has_header = _FALSE_;
+  double * data = NULL;
+  int data_size = 0;
+  int data_max = 0;
+  int index_data;
+  int index_axis;
+  int index_z;
+  int index;
+  int expected_size;
+  double value;
 
-  /* The temporary quantities stored in columns ddkappa and dddkappa will not be used anymore, so they can and WILL be overwritten by other
-     intermediate steps of other computations */
+  if ((thermodynamics_emulator_loaded == _TRUE_) && (strcmp(prem->file,ppr->recombination_emulator_file) == 0)) {
+    *pprem = prem;
+    return _SUCCESS_;
+  }
 
-  class_call(thermodynamics_calculate_conformal_drag_time(pba,pth,pvecback),
+  class_call(thermodynamics_emulator_clear(),
              pth->error_message,
              pth->error_message);
 
-  if (pth->compute_damping_scale == _TRUE_) {
-    class_call(thermodynamics_calculate_damping_scale(pba,pth,pvecback),
-               pth->error_message,
-               pth->error_message);
-  }
+  class_open(fA,ppr->recombination_emulator_file,"r",pth->error_message);
 
-  class_call(thermodynamics_calculate_opticals(ppr,pth),
-             pth->error_message,
-             pth->error_message);
+  /** - read the header, then all numbers of the file in a single array */
+  while (fgets(line,_LINE_LENGTH_MAX_-1,fA) != NULL) {
 
-  if (pba->has_idr == _TRUE_) {
-    class_call(thermodynamics_calculate_idm_dr_quantities(ppr,pba,pth,pvecback),
-               pth->error_message,
-               pth->error_message);
-  }
+    left=line;
+    while (left[0]==' ') {
+      left++;
+    }
 
-  /** - fill tables of second derivatives with respect to z (in view of spline interpolation) */
-  class_call(array_spline_table_lines(pth->z_table,
-                                      pth->tt_size,
-                                      pth->thermodynamics_table,
-                                      pth->th_size,
-                                      pth->d2thermodynamics_dz2_table,
-                                      _SPLINE_EST_DERIV_,
-                                      pth->error_message),
-             pth->error_message,
-             pth->error_message);
+    /* as in thermodynamics_helium_from_bbn(), skip blank lines and comments */
+    if (left[0] > 39) {
 
-  class_call(thermodynamics_calculate_recombination_quantities(ppr,pba,pth,pvecback),
+      if (has_header == _FALSE_) {
+        class_test(sscanf(left,"%s %lg",algorithm,&(prem->T_cmb)) != 2,
+                   pth->error_message,
+                   "could not read the recombination code and T_cmb in file %s",ppr->recombination_emulator_file);
+        if ((strstr(algorithm,"HYREC") != NULL) || (strstr(algorithm,"hyrec") != NULL) || (strstr(algorithm,"HyRec") != NULL)) {
+          prem->recombination = hyrec;
+        }
+        else if ((strstr(algorithm,"RECFAST") != NULL) || (strstr(algorithm,"recfast") != NULL) || (strstr(algorithm,"Recfast") != NULL)) {
+          prem->recombination = recfast;
+        }
+        else {
+          class_stop(pth->error_message,
+                     "recombination code '%s' in file %s should be one of {'recfast','hyrec'}",algorithm,ppr->recombination_emulator_file);
+        }
+        has_header = _TRUE_;
+      }
+      else {
+        while (_TRUE_) {
+          value = strtod(left,&right);
+          if (right == left)
+            break;
+          if (data_size == data_max) {
+            data_max = 2*data_max+1024;
+            class_realloc(data,data,data_max*sizeof(double),pth->error_message);
+          }
+          data[data_size++] = value;
+          left = right;
+        }
+      }
+    }
+  }
+
+  fclose(fA);
+
+  /** - check the sizes and distribute the numbers in the grid */
+  class_test(data_size < _RECOMBINATION_EMULATOR_AXES_+1,
+             pth->error_message,
+             "file %s is too short to contain the sizes of the grid",ppr->recombination_emulator_file);
+
+  index_data = 0;
+  prem->node_size = 1;
+  expected_size = _RECOMBINATION_EMULATOR_AXES_+1;
+  for (index_axis=0; index_axis<_RECOMBINATION_EMULATOR_AXES_; index_axis++) {
+    prem->axis_size[index_axis] = (int)data[index_data++];
+    class_test(prem->axis_size[index_axis] < 1,
+               pth->error_message,
+               "number of nodes along direction %d should be positive in file %s",index_axis,ppr->recombination_emulator_file);
+    prem->node_size *= prem->axis_size[index_axis];
+    expected_size += prem->axis_size[index_axis];
+  }
+  prem->z_size = (int)data[index_data++];
+  class_test(prem->z_size < 4,
+             pth->error_message,
+             "file %s should contain at least four redshifts",ppr->recombination_emulator_file);
+  expected_size += prem->z_size + 3*prem->node_size*prem->z_size;
+
+  class_test(data_size != expected_size,
+             pth->error_message,
+             "file %s contains %d numbers after its header, while the sizes of the grid imply %d",
+             ppr->recombination_emulator_file,data_size,expected_size);
+
+  for (index_axis=0; index_axis<_RECOMBINATION_EMULATOR_AXES_; index_axis++) {
+    class_alloc(prem->axis[index_axis],prem->axis_size[index_axis]*sizeof(double),pth->error_message);
+    for (index=0; index<prem->axis_size[index_axis]; index++) {
+      prem->axis[index_axis][index] = data[index_data++];
+      class_test((index > 0) && (prem->axis[index_axis][index] <= prem->axis[index_axis][index-1]),
+                 pth->error_message,
+                 "nodes along direction %d should be strictly growing in file %s",index_axis,ppr->recombination_emulator_file);
+    }
+  }
+
+  class_alloc(prem->z,prem->z_size*sizeof(double),pth->error_message);
+  for (index_z=0; index_z<prem->z_size; index_z++) {
+    prem->z[index_z] = data[index_data++];
+    class_test((index_z > 0) && (prem->z[index_z] <= prem->z[index_z-1]),
+               pth->error_message,
+               "redshifts should be strictly growing in file %s",ppr->recombination_emulator_file);
+  }
+
+  class_alloc(prem->lnxe,prem->node_size*prem->z_size*sizeof(double),pth->error_message);
+  class_alloc(prem->lnTb,prem->node_size*prem->z_size*sizeof(double),pth->error_message);
+  class_alloc(prem->dTb,prem->node_size*prem->z_size*sizeof(double),pth->error_message);
+
+  for (index=0; index<prem->node_size*prem->z_size; index++) {
+    class_test((data[index_data] <= 0.) || (data[index_data+1] <= 0.),
+               pth->error_message,
+               "x_e and T_b should be positive in file %s",ppr->recombination_emulator_file);
+    prem->lnxe[index] = log(data[index_data++]);
+    prem->lnTb[index] = log(data[index_data++]);
+    prem->dTb[index] = data[index_data++];
+  }
+
+  free(data);
+
+  strcpy(prem->file,ppr->recombination_emulator_file);
+  thermodynamics_emulator_loaded = _TRUE_;
+
+  *pprem = prem;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the grid of recombination histories kept in memory by
+ * thermodynamics_emulator_load().
+ *
+ * @return the error status
+ */
+
+int thermodynamics_emulator_clear(
+                                  ) {
+
+  int index_axis;
+  struct recombination_emulator * prem = &thermodynamics_emulator_table;
+
+  if (thermodynamics_emulator_loaded == _TRUE_) {
+    for (index_axis=0; index_axis<_RECOMBINATION_EMULATOR_AXES_; index_axis++) {
+      free(prem->axis[index_axis]);
+    }
+    free(prem->z);
+    free(prem->lnxe);
+    free(prem->lnTb);
+    free(prem->dTb);
+    thermodynamics_emulator_loaded = _FALSE_;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Find the nodes of the grid surrounding the current cosmology in the
+ * space (omega_b, omega_cdm, YHe, N_eff), and their weights in a
+ * multilinear interpolation. Along directions with a single node, the
+ * parameter must match it. The grid must also have been computed
+ * with the same recombination code and CMB temperature, and cover the
+ * redshifts of the thermodynamics table from z_min on.
+ *
+ * @param pba       Input: pointer to background structure
+ * @param pth       Input: pointer to thermodynamics structure
+ * @param prem      Input: pointer to the grid
+ * @param z_min     Input: smallest redshift to be interpolated
+ * @param node      Output: indices of the _RECOMBINATION_EMULATOR_CORNERS_ surrounding nodes
+ * @param weight    Output: their weights
+ * @param is_inside Output: _FALSE_ if the grid cannot be used for this model (node and weight are then meaningless)
+ * @return the error status
+ */
+
+int thermodynamics_emulator_weights(
+                                    struct background * pba,
+                                    struct thermodynamics * pth,
+                                    struct recombination_emulator * prem,
+                                    double z_min,
+                                    int * node,
+                                    double * weight,
+                                    short * is_inside
+                                    ) {
+
+  double param[_RECOMBINATION_EMULATOR_AXES_];
+  int index_lower[_RECOMBINATION_EMULATOR_AXES_];
+  double step[_RECOMBINATION_EMULATOR_AXES_];
+  int index_axis;
+  int index_corner;
+  int index;
+  int n;
+  double * axis;
+
+  param[0] = pba->Omega0_b*pba->h*pba->h;
+  param[1] = pba->Omega0_cdm*pba->h*pba->h;
+  param[2] = pth->YHe;
+  param[3] = pba->Neff;
+
+  *is_inside = _FALSE_;
+
+  /* the redshifts are compared up to the accuracy with which they are written in the file */
+  if ((prem->recombination != pth->recombination) ||
+      (fabs(prem->T_cmb/pba->T_cmb-1.) > 1.e-6) ||
+      (prem->z[0] > z_min*(1.+1.e-8)) ||
+      (prem->z[prem->z_size-1] < pth->z_table[pth->tt_size-1]*(1.-1.e-8))) {
+    return _SUCCESS_;
+  }
+
+  *is_inside = _TRUE_;
+
+  for (index_axis=0; index_axis<_RECOMBINATION_EMULATOR_AXES_; index_axis++) {
+    n = prem->axis_size[index_axis];
+    axis = prem->axis[index_axis];
+    if (n == 1) {
+      if (fabs(param[index_axis]-axis[0]) > 1.e-6*fabs(axis[0])) {
+        *is_inside = _FALSE_;
+        return _SUCCESS_;
+      }
+      index_lower[index_axis] = 0;
+      step[index_axis] = 0.;
+    }
+    else {
+      if ((param[index_axis] < axis[0]) || (param[index_axis] > axis[n-1])) {
+        *is_inside = _FALSE_;
+        return _SUCCESS_;
+      }
+      index = 0;
+      while ((index < n-2) && (param[index_axis] > axis[index+1])) {
+        index++;
+      }
+      index_lower[index_axis] = index;
+      step[index_axis] = (param[index_axis]-axis[index])/(axis[index+1]-axis[index]);
+    }
+  }
+
+  /** - each bit of index_corner tells whether the node is above (1) or below (0) the cosmology along one direction */
+  for (index_corner=0; index_corner<_RECOMBINATION_EMULATOR_CORNERS_; index_corner++) {
+    node[index_corner] = 0;
+    weight[index_corner] = 1.;
+    for (index_axis=0; index_axis<_RECOMBINATION_EMULATOR_AXES_; index_axis++) {
+      index = index_lower[index_axis];
+      if ((index_corner >> index_axis) & 1) {
+        weight[index_corner] *= step[index_axis];
+        if (prem->axis_size[index_axis] > 1)
+          index++;
+      }
+      else {
+        weight[index_corner] *= 1.-step[index_axis];
+      }
+      node[index_corner] = node[index_corner]*prem->axis_size[index_axis] + index;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Interpolate the recombination history of the grid at one redshift,
+ * multilinearly in ln(x_e), ln(T_b) and dT_b/dz between the nodes
+ * found by thermodynamics_emulator_weights(), and with a cubic
+ * Lagrange polynomial in ln(1+z) through the four redshifts of the
+ * grid closest to z (so that the derivatives of the table splined
+ * later on remain smooth). The redshift must lie inside the grid.
+ *
+ * @param prem       Input: pointer to the grid
+ * @param node       Input: indices of the surrounding nodes
+ * @param weight     Input: their weights
+ * @param z          Input: redshift
+ * @param last_index Input/Output: index of the redshift of the grid just below z, used as a starting point and updated
+ * @param x          Output: ionization fraction
+ * @param Tmat       Output: baryon temperature
+ * @param dTmat      Output: derivative of the baryon temperature with respect to z
+ * @return the error status
+ */
+
+int thermodynamics_emulator_at_z(
+                                 struct recombination_emulator * prem,
+                                 int * node,
+                                 double * weight,
+                                 double z,
+                                 int * last_index,
+                                 double * x,
+                                 double * Tmat,
+                                 double * dTmat
+                                 ) {
+
+  int index_z;
+  int index_first;
+  int index_corner;
+  int index_point;
+  int index_other;
+  int index_low;
+  double lnz;
+  double lnz_point[4];
+  double coef[4];
+  double lnxe = 0.;
+  double lnTb = 0.;
+  double dTb = 0.;
+
+  index_z = MAX(0,MIN(*last_index,prem->z_size-2));
+  while ((index_z > 0) && (z < prem->z[index_z])) {
+    index_z--;
+  }
+  while ((index_z < prem->z_size-2) && (z > prem->z[index_z+1])) {
+    index_z++;
+  }
+  *last_index = index_z;
+
+  /** - Lagrange coefficients on the four redshifts around z (shifted inwards at the edges of the grid) */
+  index_first = MAX(0,MIN(index_z-1,prem->z_size-4));
+  lnz = log(1.+MAX(prem->z[0],MIN(prem->z[prem->z_size-1],z)));
+  for (index_point=0; index_point<4; index_point++) {
+    lnz_point[index_point] = log(1.+prem->z[index_first+index_point]);
+  }
+  for (index_point=0; index_point<4; index_point++) {
+    coef[index_point] = 1.;
+    for (index_other=0; index_other<4; index_other++) {
+      if (index_other != index_point)
+        coef[index_point] *= (lnz-lnz_point[index_other])/(lnz_point[index_point]-lnz_point[index_other]);
+    }
+  }
+
+  for (index_corner=0; index_corner<_RECOMBINATION_EMULATOR_CORNERS_; index_corner++) {
+    if (weight[index_corner] == 0.)
+      continue;
+    index_low = node[index_corner]*prem->z_size+index_first;
+    for (index_point=0; index_point<4; index_point++) {
+      lnxe += weight[index_corner]*coef[index_point]*prem->lnxe[index_low+index_point];
+      lnTb += weight[index_corner]*coef[index_point]*prem->lnTb[index_low+index_point];
+      dTb += weight[index_corner]*coef[index_point]*prem->dTb[index_low+index_point];
+    }
+  }
+
+  *x = exp(lnxe);
+  *Tmat = exp(lnTb);
+  *dTmat = dTb;
+
+  return _SUCCESS_;
+}
+
+/**
+ * If possible, fill the thermodynamics table above the start of
+ * reionization with the recombination history interpolated in the
+ * grid ppr->recombination_emulator_file, and prepare the vector of
+ * the reionization approximation scheme, so that
+ * thermodynamics_solve() only needs to integrate over the last
+ * interval. This is not possible (and *emulated is set to _FALSE_)
+ * with exotic energy injection, when the grid was computed with
+ * another recombination code or CMB temperature, or when the current
+ * cosmology or the redshifts of the table lie outside the grid.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pba      Input: pointer to background structure
+ * @param pth      Input/Output: pointer to thermodynamics structure
+ * @param ptw      Input/Output: pointer to thermo workspace
+ * @param emulated Output: _TRUE_ if the recombination history was interpolated
+ * @return the error status
+ */
+
+int thermodynamics_emulator_solve(
+                                  struct precision * ppr,
+                                  struct background * pba,
+                                  struct thermodynamics * pth,
+                                  struct thermo_workspace * ptw,
+                                  short * emulated
+                                  ) {
+
+  struct recombination_emulator * prem;
+  struct thermo_diffeq_workspace * ptdw = ptw->ptdw;
+  int node[_RECOMBINATION_EMULATOR_CORNERS_];
+  double weight[_RECOMBINATION_EMULATOR_CORNERS_];
+  short is_inside;
+  int index_z;
+  int last_index;
+  double z,z_switch,x,Tmat,dTmat,Trad;
+  int status;
+
+  *emulated = _FALSE_;
+
+  if (pth->has_exotic_injection == _TRUE_) {
+    if (pth->thermodynamics_verbose > 1)
+      printf(" -> recombination emulator not used with exotic energy injection\n");
+    return _SUCCESS_;
+  }
+
+  /* the grid in memory is shared by all threads (which should then use the same file) */
+#pragma omp critical (thermodynamics_emulator)
+  status = thermodynamics_emulator_load(ppr,pth,&prem);
+  if (status == _FAILURE_)
+    return _FAILURE_;
+
+  z_switch = ptdw->ap_z_limits[ptdw->index_ap_frec];
+
+  class_call(thermodynamics_emulator_weights(pba,pth,prem,z_switch,node,weight,&is_inside),
+             pth->error_message,
+             pth->error_message);
+
+  if (is_inside == _FALSE_) {
+    if (pth->thermodynamics_verbose > 1)
+      printf(" -> recombination emulator not used: model outside grid %s\n",prem->file);
+    return _SUCCESS_;
+  }
+
+  /** - fill the table as thermodynamics_sources() would, in order of decreasing z */
+  last_index = prem->z_size-2;
+  for (index_z=pth->tt_size-1; (index_z >= 0) && (pth->z_table[index_z] >= z_switch); index_z--) {
+
+    z = pth->z_table[index_z];
+
+    class_call(thermodynamics_emulator_at_z(prem,node,weight,z,&last_index,&x,&Tmat,&dTmat),
+               pth->error_message,
+               pth->error_message);
+
+    pth->thermodynamics_table[index_z*pth->th_size+pth->index_th_xe] = x;
+    pth->thermodynamics_table[index_z*pth->th_size+pth->index_th_Tb] = Tmat;
+    pth->thermodynamics_table[index_z*pth->th_size+pth->index_th_dTb] = dTmat;
+    pth->thermodynamics_table[index_z*pth->th_size+pth->index_th_wb]
+      = _k_B_ / ( _c_ * _c_ * _m_H_ ) * (1. + (1./_not4_ - 1.) * ptw->YHe + x * (1.-ptw->YHe)) * Tmat;
+    pth->thermodynamics_table[index_z*pth->th_size+pth->index_th_cb2]
+      = _k_B_ / ( _c_ * _c_ * _m_H_ ) * (1. + (1./_not4_ - 1.) * ptw->YHe + x * (1.-ptw->YHe)) * Tmat * (1. + (1.+z) * dTmat / Tmat / 3.);
+    pth->thermodynamics_table[index_z*pth->th_size+pth->index_th_dkappa]
+      = (1.+z) * (1.+z) * ptw->SIunit_nH0 * x * _sigma_ * _Mpc_over_m_;
+  }
+
+  /** - build the vector of the full recombination scheme at the start
+        of reionization, from which thermodynamics_vector_init() will
+        start the reionization scheme. Helium is fully recombined by
+        then: all free electrons are attributed to hydrogen. */
+  class_call(thermodynamics_emulator_at_z(prem,node,weight,z_switch,&last_index,&x,&Tmat,&dTmat),
+             pth->error_message,
+             pth->error_message);
+
+  Trad = ptw->Tcmb*(1.+z_switch);
+
+  class_call(thermodynamics_vector_init_before_reionization(pth,ptw,Tmat-Trad,0.,x,Tmat),
+             pth->error_message,
+             pth->error_message);
+
+  pth->recombination_emulated = _TRUE_;
+  *emulated = _TRUE_;
+
+  if (pth->thermodynamics_verbose > 1)
+    printf(" -> recombination history above z=%g interpolated in grid %s\n",z_switch,prem->file);
+
+  return _SUCCESS_;
+}
+
+/**
+ * After a full calculation of the recombination history, compare it
+ * above the start of reionization with the one interpolated in the
+ * grid ppr->recombination_emulator_file. The largest relative
+ * difference on x_e or T_b is stored in
+ * pth->recombination_emulator_error (-1 if the grid cannot be used
+ * for this cosmology), and must not exceed ppr->tol_recombination_emulator.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pth Input/Output: pointer to thermodynamics structure
+ * @param ptw Input: pointer to thermo workspace
+ * @return the error status
+ */
+
+int thermodynamics_emulator_check(
+                                  struct precision * ppr,
+                                  struct background * pba,
+                                  struct thermodynamics * pth,
+                                  struct thermo_workspace * ptw
+                                  ) {
+
+  struct recombination_emulator * prem;
+  int node[_RECOMBINATION_EMULATOR_CORNERS_];
+  double weight[_RECOMBINATION_EMULATOR_CORNERS_];
+  short is_inside;
+  int index_z;
+  int last_index;
+  double z,z_switch,x,Tmat,dTmat,error,z_error=0.;
+  int status;
+
+  pth->recombination_emulator_error = -1.;
+
+  /* the grid in memory is shared by all threads (which should then use the same file) */
+#pragma omp critical (thermodynamics_emulator)
+  status = thermodynamics_emulator_load(ppr,pth,&prem);
+  if (status == _FAILURE_)
+    return _FAILURE_;
+
+  z_switch = ptw->ptdw->ap_z_limits[ptw->ptdw->index_ap_frec];
+
+  class_call(thermodynamics_emulator_weights(pba,pth,prem,z_switch,node,weight,&is_inside),
+             pth->error_message,
+             pth->error_message);
+
+  if ((pth->has_exotic_injection == _TRUE_) || (is_inside == _FALSE_)) {
+    if (pth->thermodynamics_verbose > 0)
+      printf(" -> recombination emulator cannot be checked: it would not be used for this model\n");
+    return _SUCCESS_;
+  }
+
+  pth->recombination_emulator_error = 0.;
+  last_index = prem->z_size-2;
+  for (index_z=pth->tt_size-1; (index_z >= 0) && (pth->z_table[index_z] >= z_switch); index_z--) {
+
+    z = pth->z_table[index_z];
+
+    class_call(thermodynamics_emulator_at_z(prem,node,weight,z,&last_index,&x,&Tmat,&dTmat),
+               pth->error_message,
+               pth->error_message);
+
+    error = MAX(fabs(x/pth->thermodynamics_table[index_z*pth->th_size+pth->index_th_xe]-1.),
+                fabs(Tmat/pth->thermodynamics_table[index_z*pth->th_size+pth->index_th_Tb]-1.));
+    if (error > pth->recombination_emulator_error) {
+      pth->recombination_emulator_error = error;
+      z_error = z;
+    }
+  }
+
+  if (pth->thermodynamics_verbose > 0)
+    printf(" -> recombination emulator: largest relative error on x_e or T_b = %e at z=%g\n",
+           pth->recombination_emulator_error,z_error);
+
+  class_test(pth->recombination_emulator_error > ppr->tol_recombination_emulator,
+             pth->error_message,
+             "the recombination history interpolated in grid %s differs from the full one by %e at z=%g, more than tol_recombination_emulator=%e",
+             prem->file,pth->recombination_emulator_error,z_error,ppr->tol_recombination_emulator);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Build the vector of the full recombination scheme at the start of
+ * reionization from given values of its components, as if the
+ * evolver had just integrated over all previous intervals, so that
+ * thermodynamics_vector_init() can start the reionization scheme from
+ * it. Used when the history above the start of reionization was not
+ * integrated but interpolated by the recombination emulator or
+ * restored from the recombination cache.
+ *
+ * @param pth    Input/Output: pointer to thermodynamics structure
+ * @param ptw    Input/Output: pointer to thermo workspace
+ * @param D_Tmat Input: difference between matter and radiation temperatures
+ * @param x_He   Input: Helium ionization fraction
+ * @param x_H    Input: Hydrogen ionization fraction
+ * @param Tmat   Input: matter temperature stored in the workspace
+ * @return the error status
+ */
+
+int thermodynamics_vector_init_before_reionization(
+                                                   struct thermodynamics * pth,
+                                                   struct thermo_workspace * ptw,
+                                                   double D_Tmat,
+                                                   double x_He,
+                                                   double x_H,
+                                                   double Tmat
+                                                   ) {
+
+  struct thermo_diffeq_workspace * ptdw = ptw->ptdw;
+  struct thermo_vector * ptv;
+  int index_ti;
+
+  class_alloc(ptv,sizeof(struct thermo_vector),pth->error_message);
+  index_ti = 0;
+  class_define_index(ptv->index_ti_D_Tmat,_TRUE_,index_ti,1);
+  class_define_index(ptv->index_ti_x_He,_TRUE_,index_ti,1);
+  class_define_index(ptv->index_ti_x_H,_TRUE_,index_ti,1);
+  ptv->ti_size = index_ti;
+
+  class_calloc(ptv->y,ptv->ti_size,sizeof(double),pth->error_message);
+  class_alloc(ptv->dy,ptv->ti_size*sizeof(double),pth->error_message);
+  class_alloc(ptv->used_in_output,ptv->ti_size*sizeof(int),pth->error_message);
+  for (index_ti=0; index_ti<ptv->ti_size; index_ti++) {
+    ptv->used_in_output[index_ti] = _TRUE_;
+  }
+
+  ptv->y[ptv->index_ti_D_Tmat] = D_Tmat;
+  ptv->y[ptv->index_ti_x_He] = x_He;
+  ptv->y[ptv->index_ti_x_H] = x_H;
+
+  ptdw->ptv = ptv;
+  ptdw->Tmat = Tmat;
+  ptdw->ap_current = ptdw->index_ap_frec;
+  ptdw->require_H = _TRUE_;
+  ptdw->require_He = _TRUE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Recombination history above the start of reionization kept in
+ * memory by thermodynamics_recombination_cache_store(), with the key
+ * identifying the input it was computed from, and the vector of the
+ * full recombination scheme at the start of reionization.
+ */
+
+static short thermodynamics_recombination_cache_used = _FALSE_;
+static unsigned long long thermodynamics_recombination_cache_key_value;
+static int thermodynamics_recombination_cache_z_size = 0;
+static double * thermodynamics_recombination_cache_table = NULL;
+static double thermodynamics_recombination_cache_y[4];
+
+/* number of columns of the thermodynamics table filled by the evolver (xe, Tb, dTb, wb, cb2, dkappa) */
+#define _RECOMBINATION_CACHE_COLUMNS_ 6
+
+/**
+ * Update a 64-bit FNV-1a hash with the content of a memory zone.
+ *
+ * @param data Input: pointer to the memory zone
+ * @param size Input: size of the memory zone in bytes
+ * @param key  Input/Output: hash value to update
+ * @return the error status
+ */
+
+int thermodynamics_recombination_cache_hash(
+                                            const void * data,
+                                            size_t size,
+                                            unsigned long long * key
+                                            ) {
+
+  const unsigned char * byte = (const unsigned char *) data;
+  size_t index;
+
+  for (index = 0; index < size; index++) {
+    *key ^= byte[index];
+    *key *= 1099511628211ULL;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute the key identifying the input of the recombination history
+ * above the start of reionization: all precision parameters, the
+ * background table and the few background quantities read by this
+ * module, the input parameters of the thermodynamics structure
+ * except the reionization ones, the redshifts of the table and the
+ * limits of the approximation intervals. Two runs with the same key
+ * only differ by their reionization history.
+ *
+ * @param ppr            Input: pointer to precision structure
+ * @param pba            Input: pointer to background structure
+ * @param pth            Input: pointer to thermodynamics structure
+ * @param ptw            Input: pointer to thermo workspace
+ * @param interval_limit Input: limits of the approximation intervals (in -z)
+ * @param key            Output: key
+ * @return the error status
+ */
+
+int thermodynamics_recombination_cache_key(
+                                           struct precision * ppr,
+                                           struct background * pba,
+                                           struct thermodynamics * pth,
+                                           struct thermo_workspace * ptw,
+                                           double * interval_limit,
+                                           unsigned long long * key
+                                           ) {
+
+  *key = 14695981039346656037ULL;
+
+  /** - precision parameters, listed with the same macros as in the declaration of struct precision */
+
+#undef class_precision_parameter
+#undef class_string_parameter
+#undef class_type_parameter
+#define class_precision_parameter(NAME,TYPE,DEF_VALUE)                  \
+  thermodynamics_recombination_cache_hash(&(ppr->NAME),sizeof(ppr->NAME),key);
+#define class_string_parameter(NAME,DIR,STRING)                         \
+  thermodynamics_recombination_cache_hash(ppr->NAME,strlen(ppr->NAME),key);
+#define class_type_parameter(NAME,READ_TP,REAL_TP,DEF_VAL)              \
+  thermodynamics_recombination_cache_hash(&(ppr->NAME),sizeof(ppr->NAME),key);
+#include "precisions.h"
+#undef class_precision_parameter
+#undef class_string_parameter
+#undef class_type_parameter
+
+  /** - background table and background quantities used by this module */
+
+  thermodynamics_recombination_cache_hash(&(pba->bt_size),sizeof(pba->bt_size),key);
+  thermodynamics_recombination_cache_hash(&(pba->bg_size),sizeof(pba->bg_size),key);
+  thermodynamics_recombination_cache_hash(pba->tau_table,pba->bt_size*sizeof(double),key);
+  thermodynamics_recombination_cache_hash(pba->z_table,pba->bt_size*sizeof(double),key);
+  thermodynamics_recombination_cache_hash(pba->background_table,pba->bt_size*pba->bg_size*sizeof(double),key);
+
+  thermodynamics_recombination_cache_hash(&(pba->H0),sizeof(pba->H0),key);
+  thermodynamics_recombination_cache_hash(&(pba->h),sizeof(pba->h),key);
+  thermodynamics_recombination_cache_hash(&(pba->T_cmb),sizeof(pba->T_cmb),key);
+  thermodynamics_recombination_cache_hash(&(pba->Neff),sizeof(pba->Neff),key);
+  thermodynamics_recombination_cache_hash(&(pba->Omega0_b),sizeof(pba->Omega0_b),key);
+  thermodynamics_recombination_cache_hash(&(pba->Omega0_cdm),sizeof(pba->Omega0_cdm),key);
+  thermodynamics_recombination_cache_hash(&(pba->Omega0_idm_dr),sizeof(pba->Omega0_idm_dr),key);
+  thermodynamics_recombination_cache_hash(&(pba->Omega0_idr),sizeof(pba->Omega0_idr),key);
+  thermodynamics_recombination_cache_hash(&(pba->T_idr),sizeof(pba->T_idr),key);
+
+  /** - input parameters of the thermodynamics structure not related to reionization */
+
+  thermodynamics_recombination_cache_hash(&(pth->YHe),sizeof(pth->YHe),key);
+  thermodynamics_recombination_cache_hash(&(pth->recombination),sizeof(pth->recombination),key);
+  thermodynamics_recombination_cache_hash(&(pth->recfast_photoion_mode),sizeof(pth->recfast_photoion_mode),key);
+  thermodynamics_recombination_cache_hash(&(pth->a_idm_dr),sizeof(pth->a_idm_dr),key);
+  thermodynamics_recombination_cache_hash(&(pth->b_idr),sizeof(pth->b_idr),key);
+  thermodynamics_recombination_cache_hash(&(pth->nindex_idm_dr),sizeof(pth->nindex_idm_dr),key);
+  thermodynamics_recombination_cache_hash(&(pth->m_idm_dr),sizeof(pth->m_idm_dr),key);
+
+  /** - quantities of the workspace, redshifts of the table and approximation intervals */
+
+  thermodynamics_recombination_cache_hash(&(ptw->YHe),sizeof(ptw->YHe),key);
+  thermodynamics_recombination_cache_hash(&(ptw->fHe),sizeof(ptw->fHe),key);
+  thermodynamics_recombination_cache_hash(&(ptw->SIunit_nH0),sizeof(ptw->SIunit_nH0),key);
+  thermodynamics_recombination_cache_hash(&(ptw->Tcmb),sizeof(ptw->Tcmb),key);
+
+  thermodynamics_recombination_cache_hash(&(pth->tt_size),sizeof(pth->tt_size),key);
+  thermodynamics_recombination_cache_hash(pth->z_table,pth->tt_size*sizeof(double),key);
+  thermodynamics_recombination_cache_hash(interval_limit,(ptw->ptdw->index_ap_reio+1)*sizeof(double),key);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Store the recombination history above the start of reionization
+ * (the columns of the thermodynamics table filled by the evolver) and
+ * the vector of the full recombination scheme, just before the
+ * reionization interval is integrated. The previously stored history
+ * is replaced.
+ *
+ * @param pth Input: pointer to thermodynamics structure
+ * @param ptw Input: pointer to thermo workspace
+ * @param key Input: key computed by thermodynamics_recombination_cache_key()
+ * @return the error status
+ */
+
+int thermodynamics_recombination_cache_store(
+                                             struct thermodynamics * pth,
+                                             struct thermo_workspace * ptw,
+                                             unsigned long long key
+                                             ) {
+
+  struct thermo_diffeq_workspace * ptdw = ptw->ptdw;
+  int column[_RECOMBINATION_CACHE_COLUMNS_] = {pth->index_th_xe,pth->index_th_Tb,pth->index_th_dTb,
+                                               pth->index_th_wb,pth->index_th_cb2,pth->index_th_dkappa};
+  double z_switch;
+  int z_size;
+  int index_z;
+  int index_column;
+
+  z_switch = ptdw->ap_z_limits[ptdw->index_ap_frec];
+
+  for (z_size=0; (z_size < pth->tt_size) && (pth->z_table[pth->tt_size-1-z_size] >= z_switch); z_size++);
+
+  if (z_size > thermodynamics_recombination_cache_z_size) {
+    class_realloc(thermodynamics_recombination_cache_table,
+                  thermodynamics_recombination_cache_table,
+                  z_size*_RECOMBINATION_CACHE_COLUMNS_*sizeof(double),
+                  pth->error_message);
+  }
+
+  for (index_z=0; index_z<z_size; index_z++) {
+    for (index_column=0; index_column<_RECOMBINATION_CACHE_COLUMNS_; index_column++) {
+      thermodynamics_recombination_cache_table[index_z*_RECOMBINATION_CACHE_COLUMNS_+index_column]
+        = pth->thermodynamics_table[(pth->tt_size-1-index_z)*pth->th_size+column[index_column]];
+    }
+  }
+
+  thermodynamics_recombination_cache_y[0] = ptdw->ptv->y[ptdw->ptv->index_ti_D_Tmat];
+  thermodynamics_recombination_cache_y[1] = ptdw->ptv->y[ptdw->ptv->index_ti_x_He];
+  thermodynamics_recombination_cache_y[2] = ptdw->ptv->y[ptdw->ptv->index_ti_x_H];
+  thermodynamics_recombination_cache_y[3] = ptdw->Tmat;
+
+  thermodynamics_recombination_cache_z_size = z_size;
+  thermodynamics_recombination_cache_key_value = key;
+  thermodynamics_recombination_cache_used = _TRUE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * If the recombination history stored by
+ * thermodynamics_recombination_cache_store() has the same key as the
+ * current run, copy it into the thermodynamics table and prepare the
+ * vector of the reionization approximation scheme, so that
+ * thermodynamics_solve() only needs to integrate over the last
+ * interval.
+ *
+ * @param pth   Input/Output: pointer to thermodynamics structure
+ * @param ptw   Input/Output: pointer to thermo workspace
+ * @param key   Input: key computed by thermodynamics_recombination_cache_key()
+ * @param found Output: _TRUE_ if the history was restored
+ * @return the error status
+ */
+
+int thermodynamics_recombination_cache_fetch(
+                                             struct thermodynamics * pth,
+                                             struct thermo_workspace * ptw,
+                                             unsigned long long key,
+                                             short * found
+                                             ) {
+
+  int column[_RECOMBINATION_CACHE_COLUMNS_] = {pth->index_th_xe,pth->index_th_Tb,pth->index_th_dTb,
+                                               pth->index_th_wb,pth->index_th_cb2,pth->index_th_dkappa};
+  int index_z;
+  int index_column;
+
+  *found = _FALSE_;
+
+  if ((thermodynamics_recombination_cache_used == _FALSE_) || (thermodynamics_recombination_cache_key_value != key))
+    return _SUCCESS_;
+
+  for (index_z=0; index_z<thermodynamics_recombination_cache_z_size; index_z++) {
+    for (index_column=0; index_column<_RECOMBINATION_CACHE_COLUMNS_; index_column++) {
+      pth->thermodynamics_table[(pth->tt_size-1-index_z)*pth->th_size+column[index_column]]
+        = thermodynamics_recombination_cache_table[index_z*_RECOMBINATION_CACHE_COLUMNS_+index_column];
+    }
+  }
+
+  class_call(thermodynamics_vector_init_before_reionization(pth,
+                                                            ptw,
+                                                            thermodynamics_recombination_cache_y[0],
+                                                            thermodynamics_recombination_cache_y[1],
+                                                            thermodynamics_recombination_cache_y[2],
+                                                            thermodynamics_recombination_cache_y[3]),
+             pth->error_message,
+             pth->error_message);
+
+  *found = _TRUE_;
+
+  if (pth->thermodynamics_verbose > 1)
+    printf(" -> recombination history above z=%g taken from previous run\n",ptw->ptdw->ap_z_limits[ptw->ptdw->index_ap_frec]);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the recombination history stored by
+ * thermodynamics_recombination_cache_store().
+ *
+ * @return the error status
+ */
+
+int thermodynamics_recombination_cache_clear() {
+
+#pragma omp critical (thermodynamics_recombination_cache)
+  {
+    free(thermodynamics_recombination_cache_table);
+    thermodynamics_recombination_cache_table = NULL;
+    thermodynamics_recombination_cache_z_size = 0;
+    thermodynamics_recombination_cache_used = _FALSE_;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Calculate those thermodynamics quantities which are not inside of
+ * the thermodynamics table already.
+ *
+ * @param ppr        Input: pointer to precision structure
+ * @param pba        Input: pointer to background structure
+ * @param pth        Input/Output: pointer to initialized thermodynamics structure
+ * @param pvecback   Input: pointer to some allocated pvecback
+ * @return the error status
+ */
+
+int thermodynamics_calculate_remaining_quantities(
+                                                  struct precision * ppr,
+                                                  struct background * pba,
+                                                  struct thermodynamics* pth,
+                                                  double* pvecback
+                                                  ) {
+
+  /** Summary: */
+
+  /* The temporary quantities stored in columns ddkappa and dddkappa will not be used anymore, so they can and WILL be overwritten by other
+     intermediate steps of other computations */
+
+  class_call(thermodynamics_calculate_conformal_drag_time(pba,pth,pvecback),
+             pth->error_message,
+             pth->error_message);
+
+  if (pth->compute_damping_scale == _TRUE_) {
+    class_call(thermodynamics_calculate_damping_scale(pba,pth,pvecback),
+               pth->error_message,
+               pth->error_message);
+  }
+
+  class_call(thermodynamics_calculate_opticals(ppr,pth),
+             pth->error_message,
+             pth->error_message);
+
+  if (pba->has_idr == _TRUE_) {
+    class_call(thermodynamics_calculate_idm_dr_quantities(ppr,pba,pth,pvecback),
+               pth->error_message,
+               pth->error_message);
+  }
+
+  /** - fill tables of second derivatives with respect to z (in view of spline interpolation) */
+  class_call(array_spline_table_lines(pth->z_table,
+                                      pth->tt_size,
+                                      pth->thermodynamics_table,
+                                      pth->th_size,
+                                      pth->d2thermodynamics_dz2_table,
+                                      _SPLINE_EST_DERIV_,
+                                      pth->error_message),
+             pth->error_message,
+             pth->error_message);
+
+  class_call(thermodynamics_calculate_recombination_quantities(ppr,pba,pth,pvecback),
              pth->error_message,
              pth->error_message);
 
@@ -1989,7 +3138,9 @@ int thermodynamics_reionization_evolve_with_tau(
 
   /* function pointer to ODE evolver and names of possible evolvers */
   extern int evolver_rk();
+  extern int evolver_rk_dense();
   extern int evolver_ndf15();
+  extern int evolver_rosenbrock();
   int (*generic_evolver)() = evolver_ndf15;
 
   /* pointers towards two thermo vector stuctures (see below) */
@@ -2008,11 +3159,17 @@ int thermodynamics_reionization_evolve_with_tau(
 
   switch (ppr->thermo_evolver) {
   case rk:
-    generic_evolver = evolver_rk;
+    if (ppr->evolver_rk_dense_output == _TRUE_)
+      generic_evolver = evolver_rk_dense;
+    else
+      generic_evolver = evolver_rk;
     break;
   case ndf15:
     generic_evolver = evolver_ndf15;
     break;
+  case rosenbrock:
+    generic_evolver = evolver_rosenbrock;
+    break;
   }
 
   /** - ptvs will be a pointer towards the same thermo vector that was
@@ -69,14 +69,47 @@ int transfer_functions_at_q(
                             ) {
   /** Summary: */
 
-  /** - interpolate in pre-computed table using array_interpolate_two() */
+  int inf,sup,mid;
+  float * transfer_float;
+
+  /** - when transfer functions are streamed, only the current block of multipoles is available */
+  class_test((index_l < ptr->index_l_table_min) || (index_l >= ptr->index_l_table_min+ptr->l_table_size[index_md]),
+             ptr->error_message,
+             "multipole index %d not in the table of transfer functions [%d, %d[",
+             index_l,ptr->index_l_table_min,ptr->index_l_table_min+ptr->l_table_size[index_md]);
+
+  /** - in single precision, interpolate linearly in pre-computed table after bisection */
+  if (ptr->transfer_float != NULL) {
+
+    transfer_float = ptr->transfer_float[index_md]
+      +_transfer_index_(ptr,index_md,index_ic,index_tt,index_l,0);
+
+    inf = 0;
+    sup = ptr->q_size-1;
+
+    class_test((q < ptr->q[inf]) || (q > ptr->q[sup]),
+               ptr->error_message,
+               "q=%e out of range [%e, %e]",q,ptr->q[inf],ptr->q[sup]);
+
+    while (sup-inf > 1) {
+      mid = (inf+sup)/2;
+      if (q < ptr->q[mid]) sup = mid;
+      else inf = mid;
+    }
+
+    *transfer_function = transfer_float[inf]
+      + (transfer_float[sup]-transfer_float[inf]) * (q-ptr->q[inf])/(ptr->q[sup]-ptr->q[inf]);
+
+    return _SUCCESS_;
+  }
+
+  /** - otherwise, interpolate in pre-computed table using array_interpolate_two() */
   class_call(array_interpolate_two(
                                    ptr->q,
                                    1,
                                    0,
                                    ptr->transfer[index_md]
-                                   +((index_ic * ptr->tt_size[index_md] + index_tt) * ptr->l_size[index_md] + index_l)
-                                   * ptr->q_size,
+                                   +_transfer_index_(ptr,index_md,index_ic,index_tt,index_l,0),
                                    1,
                                    ptr->q_size,
                                    q,
@@ -100,7 +133,7 @@ int transfer_functions_at_q(
  *
  * - for each thread (in case of parallel run), initialize the fields of a memory zone called the transfer_workspace with transfer_workspace_init()
  *
- * - loop over q values. For each q, compute the Bessel functions if needed with transfer_update_HIS(), and defer the calculation of all transfer functions to transfer_compute_for_each_q()
+ * - loop over tasks, defined by transfer_define_tasks(): either q values, or (q, type, block of l) triplets. For each of them, compute the Bessel functions if needed with transfer_update_HIS(), and defer the calculation of the transfer functions to transfer_compute_for_each_q() or transfer_compute_for_each_q_type()
  * - for each thread, free the the workspace with transfer_workspace_free()
  *
  * @param ppr Input: pointer to precision structure
@@ -125,9 +158,6 @@ int transfer_init(
 
   /** - define local variables */
 
-  /* running index for wavenumbers */
-  int index_q;
-
   /* conformal time today */
   double tau0;
   /* conformal time at recombination */
@@ -147,13 +177,13 @@ int transfer_init(
   /* array of source derivatives S''(k,tau)
      (second derivative with respect to k, not tau!),
      used to interpolate sources at the right values of k,
-     sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp][index_tau * ppt->k_size[index_md] + index_k]
+     sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp][index_tau * ppt->k_size[index_md] + index_k],
+     or, if ppr->transfer_sources_k_major is set, the sources and
+     these derivatives interleaved,
+     sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp][(index_k * ppt->tau_size + index_tau)*2 + 0 or 1]
   */
   double *** sources_spline;
 
-  /* pointer on workspace (one per thread if openmp) */
-  struct transfer_workspace * ptw;
-
   /** - array with the correspondence between the index of sources in
       the perturbation module and in the transfer module,
       tp_of_tt[index_md][index_tt]
@@ -165,19 +195,14 @@ int transfer_init(
   HyperInterpStruct BIS;
   double xmax;
 
-  /* This code can be optionally compiled with the openmp option for parallel computation.
-     Inside parallel regions, the use of the command "return" is forbidden.
-     For error management, instead of "return _FAILURE_", we will set the variable below
-     to "abort = _TRUE_". This will lead to a "return _FAILURE_" just after leaving the
-     parallel region. */
-  int abort;
-
-#ifdef _OPENMP
-
-  /* instrumentation times */
-  double tstart, tstop, tspent;
+  /* everything needed to compute the transfer functions of a range of multipoles */
+  struct transfer_context * ptc;
 
-#endif
+  /* tables of transfer functions kept in memory for later runs */
+  int use_cache;
+  short cache_found;
+  unsigned long long cache_key;
+  int cache_status;
 
   /** - check whether any spectrum in harmonic space (i.e., any \f$C_l\f$'s) is actually requested */
 
@@ -193,6 +218,32 @@ int transfer_init(
   if (ptr->transfer_verbose > 0)
     fprintf(stdout,"Computing transfers\n");
 
+  /** - if the same transfer functions have already been computed in
+      this process, get them from memory and exit */
+
+  use_cache = ((ppr->transfer_cache_size > 0) &&
+               (ppr->transfer_stream_l_block_size <= 0) &&
+               (ppr->transfer_neglect_statistics == _FALSE_));
+
+  if (use_cache == _TRUE_) {
+
+    class_call(transfer_cache_key(ppr,pba,pth,ppt,pfo,ptr,&cache_key),
+               ptr->error_message,
+               ptr->error_message);
+
+    /* the tables in memory are shared by all threads */
+#pragma omp critical (transfer_cache)
+    cache_status = transfer_cache_fetch(cache_key,ppt,ptr,&cache_found);
+    if (cache_status == _FAILURE_)
+      return _FAILURE_;
+
+    if (cache_found == _TRUE_) {
+      if (ptr->transfer_verbose > 0)
+        printf(" -> transfer functions identical to a previous run, read from memory\n");
+      return _SUCCESS_;
+    }
+  }
+
   /** - get number of modes (scalars, tensors...) */
 
   ptr->md_size = ppt->md_size;
@@ -236,7 +287,7 @@ int transfer_init(
               ptr->md_size*sizeof(double**),
               ptr->error_message);
 
-  class_call(transfer_perturbation_source_spline(ppt,ptr,sources,sources_spline),
+  class_call(transfer_perturbation_source_spline(ppr,ppt,ptr,sources,sources_spline),
              ptr->error_message,
              ptr->error_message);
 
@@ -264,17 +315,24 @@ int transfer_init(
   if (pba->sgnK == -1)
     xmax *= (ptr->l[ptr->l_size_max-1]/ppr->hyper_flat_approximation_nu)/asinh(ptr->l[ptr->l_size_max-1]/ppr->hyper_flat_approximation_nu)*1.01;
 
-  class_call(hyperspherical_HIS_create(0,
-                                       1.,
-                                       ptr->l_size_max,
-                                       ptr->l,
-                                       ppr->hyper_x_min,
-                                       xmax,
-                                       ppr->hyper_sampling_flat,
-                                       ptr->l[ptr->l_size_max-1]+1,
-                                       ppr->hyper_phi_min_abs,
-                                       &BIS,
-                                       ptr->error_message),
+  /* when tables are cached, round xmax up on a logarithmic grid,
+     so that runs with slightly different tau0 share the same table */
+  if ((ppr->hyper_cache_size > 0) || (ppr->hyper_cache_use_file == _TRUE_))
+    xmax = exp(ceil(log(xmax)/ppr->hyper_cache_xmax_step)*ppr->hyper_cache_xmax_step);
+
+  class_call(hyperspherical_HIS_create_cached(0,
+                                              1.,
+                                              ptr->l_size_max,
+                                              ptr->l,
+                                              ppr->hyper_x_min,
+                                              xmax,
+                                              ppr->hyper_sampling_flat,
+                                              ptr->l[ptr->l_size_max-1]+1,
+                                              ppr->hyper_phi_min_abs,
+                                              ppr->hyper_cache_size,
+                                              (ppr->hyper_cache_use_file == _TRUE_ ? ppr->hyper_cache_directory : NULL),
+                                              &BIS,
+                                              ptr->error_message),
              ptr->error_message,
              ptr->error_message);
 
@@ -292,28 +350,202 @@ int transfer_init(
              ptr->error_message,
              ptr->error_message);
 
-  /** - precompute window function for integrated nCl/sCl quantities*/
+  /** - precompute window function for integrated nCl/sCl quantities, and the time sampling of these sources */
   double* window;
+  struct transfer_sampling sampling;
   class_call(transfer_precompute_selection(ppr,
                                            pba,
                                            ppt,
                                            ptr,
                                            tau_rec,
                                            tau_size_max,
-                                           &(window)),
+                                           &(window),
+                                           &sampling),
+             ptr->error_message,
+             ptr->error_message);
+
+  /** - keep everything needed to compute the transfer functions in a context */
+
+  class_alloc(ptc,sizeof(struct transfer_context),ptr->error_message);
+
+  ptc->ppr = ppr;
+  ptc->pba = pba;
+  ptc->ppt = ppt;
+  ptc->pfo = pfo;
+  ptc->tau0 = tau0;
+  ptc->tau_rec = tau_rec;
+  ptc->tau0_minus_tau_cut = tau0-pth->tau_cut;
+  ptc->tau_size_max = tau_size_max;
+  ptc->sources = sources;
+  ptc->sources_spline = sources_spline;
+  ptc->tp_of_tt = tp_of_tt;
+  ptc->window = window;
+  ptc->sampling = sampling;
+  ptc->BIS = BIS;
+
+  /** - if transfer functions are streamed, they will be computed by
+      blocks of multipoles with transfer_compute_l_block(), called by
+      harmonic_init() */
+
+  if (ptr->l_stream_block_size > 0) {
+    ptr->ptc = ptc;
+    if (ptr->transfer_verbose > 1)
+      printf(" -> transfer functions will be computed by blocks of %d multipoles\n",ptr->l_stream_block_size);
+    return _SUCCESS_;
+  }
+
+  /** - otherwise, compute them for all multipoles, and free the context */
+
+  class_call(transfer_compute_l_range(ptr,ptc,0,ptr->l_size_max),
+             ptr->error_message,
+             ptr->error_message);
+
+  /** - with neglect statistics, the integrals cut by transfer_can_be_neglected() have been computed: analyse and cut them now */
+
+  if (ptr->neglect_count_cut != NULL) {
+    class_call(transfer_neglect_statistics(ppr,ppt,ptr,(tau0-tau_rec)*ptr->angular_rescaling),
+               ptr->error_message,
+               ptr->error_message);
+  }
+
+  class_call(transfer_context_free(ptr,ptc),
+             ptr->error_message,
+             ptr->error_message);
+
+  /** - keep a copy of the transfer functions for later runs with the same input */
+
+  if (use_cache == _TRUE_) {
+#pragma omp critical (transfer_cache)
+    cache_status = transfer_cache_store(ppr,cache_key,ppt,ptr);
+    if (cache_status == _FAILURE_)
+      return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute the transfer functions of the multipoles index_l_min <=
+ * index_l < index_l_max, when they are streamed (see
+ * ppr->transfer_stream_l_block_size). The table ptr->transfer then
+ * contains these multipoles only, starting at ptr->index_l_table_min =
+ * index_l_min. To be called after transfer_init(), as many times as
+ * needed, and before transfer_context_free().
+ *
+ * @param ptr         Input/Output: pointer to transfer structure
+ * @param index_l_min Input: index of first multipole
+ * @param index_l_max Input: index of last multipole plus one (at most index_l_min+ptr->l_stream_block_size)
+ * @return the error status
+ */
+
+int transfer_compute_l_block(
+                             struct transfer * ptr,
+                             int index_l_min,
+                             int index_l_max
+                             ) {
+
+  class_test(ptr->ptc == NULL,
+             ptr->error_message,
+             "transfer functions are not streamed, or the context needed to compute them has been freed");
+
+  class_test((index_l_min < 0) || (index_l_max > ptr->l_size_max) || (index_l_max-index_l_min > ptr->l_stream_block_size),
+             ptr->error_message,
+             "cannot compute the multipoles [%d, %d[ in a block of %d among %d",
+             index_l_min,index_l_max,ptr->l_stream_block_size,ptr->l_size_max);
+
+  ptr->index_l_table_min = index_l_min;
+
+  class_call(transfer_compute_l_range(ptr,ptr->ptc,index_l_min,index_l_max),
+             ptr->error_message,
+             ptr->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute the transfer functions of the multipoles index_l_min <=
+ * index_l < index_l_max, for all modes, initial conditions, types and
+ * wavenumbers, and store them in the table ptr->transfer.
+ *
+ * Main steps:
+ *
+ * - for each thread (in case of parallel run), initialize the fields of a memory zone called the transfer_workspace with transfer_workspace_init()
+ *
+ * - loop over tasks, defined by transfer_define_tasks(): either q values, or (q, type, block of l) triplets. For each of them, compute the Bessel functions if needed with transfer_update_HIS(), and defer the calculation of the transfer functions to transfer_compute_for_each_q() or transfer_compute_for_each_q_type()
+ * - for each thread, free the the workspace with transfer_workspace_free()
+ *
+ * @param ptr         Input/Output: pointer to transfer structure
+ * @param ptc         Input: context prepared by transfer_init()
+ * @param index_l_min Input: index of first multipole
+ * @param index_l_max Input: index of last multipole plus one
+ * @return the error status
+ */
+
+int transfer_compute_l_range(
+                             struct transfer * ptr,
+                             struct transfer_context * ptc,
+                             int index_l_min,
+                             int index_l_max
+                             ) {
+
+  struct precision * ppr = ptc->ppr;
+  struct background * pba = ptc->pba;
+  struct perturbations * ppt = ptc->ppt;
+  double tau0 = ptc->tau0;
+  double tau_rec = ptc->tau_rec;
+  int tau_size_max = ptc->tau_size_max;
+  double *** sources = ptc->sources;
+  double *** sources_spline = ptc->sources_spline;
+  int ** tp_of_tt = ptc->tp_of_tt;
+  double * window = ptc->window;
+
+  /* running index for wavenumbers */
+  int index_q;
+
+  /* pointer on workspace (one per thread if openmp) */
+  struct transfer_workspace * ptw;
+
+  /* This code can be optionally compiled with the openmp option for parallel computation.
+     Inside parallel regions, the use of the command "return" is forbidden.
+     For error management, instead of "return _FAILURE_", we will set the variable below
+     to "abort = _TRUE_". This will lead to a "return _FAILURE_" just after leaving the
+     parallel region. */
+  int abort;
+
+  /* index of the current MPI process and number of processes (one if no MPI) */
+  int mpi_rank, mpi_size;
+
+  /* tasks of the parallel loop: index_task = (index_q * task_per_q + index_type) * l_block_num + index_l_block */
+  int task_per_q, l_block_size, l_block_num;
+  int index_task, index_type, index_l_block;
+  int index_md, index_ic, index_tt;
+
+#ifdef _OPENMP
+
+  /* instrumentation times */
+  double tstart, tstop, tspent;
+
+#endif
+
+  /* with MPI, wavenumbers are dealt to processes in turn */
+  class_call(class_mpi_rank_and_size(&mpi_rank,&mpi_size),
+             ptr->error_message,
+             ptr->error_message);
+
+  /* split the loop over wavenumbers into tasks */
+  class_call(transfer_define_tasks(ppr,ppt,ptr,pba->sgnK,&task_per_q,&l_block_size),
              ptr->error_message,
              ptr->error_message);
 
-  /* (a.3.) workspace, allocated in a parallel zone since in openmp
-     version there is one workspace per thread */
+  l_block_num = (index_l_max-index_l_min+l_block_size-1)/l_block_size;
 
   /* initialize error management flag */
   abort = _FALSE_;
 
   /* beginning of parallel region */
 #pragma omp parallel                                                    \
-  shared(tau_size_max,ptr,ppr,pba,ppt,tp_of_tt,tau_rec,sources_spline,abort,BIS,tau0) \
-  private(ptw,index_q,tstart,tstop,tspent)
+  shared(tau_size_max,ptr,ptc,ppr,pba,ppt,tp_of_tt,tau_rec,sources,sources_spline,window,abort,tau0,mpi_rank,mpi_size,task_per_q,l_block_size,l_block_num,index_l_min,index_l_max) \
+  private(ptw,index_q,index_task,index_type,index_l_block,index_md,index_ic,index_tt,tstart,tstop,tspent)
   {
 
 #ifdef _OPENMP
@@ -331,48 +563,98 @@ int transfer_init(
                                                 tau_size_max,
                                                 pba->K,
                                                 pba->sgnK,
-                                                tau0-pth->tau_cut,
-                                                &BIS),
+                                                ptc->tau0_minus_tau_cut,
+                                                &(ptc->BIS)),
                         ptr->error_message,
                         ptr->error_message);
 
-    /** - loop over all wavenumbers (parallelized).*/
-    /* For each wavenumber: */
+    ptw->psa = &(ptc->sampling);
+
+    /** - loop over all tasks (parallelized), i.e. over wavenumbers, or over wavenumbers, types and blocks of multipoles.*/
+    /* For each task: */
 
 #pragma omp for schedule (dynamic)
 
-    for (index_q = 0; index_q < ptr->q_size; index_q++) {
+    for (index_task = 0; index_task < ptr->q_size*task_per_q*l_block_num; index_task++) {
+
+      index_q = index_task/(task_per_q*l_block_num);
+
+      if (index_q % mpi_size != mpi_rank)
+        continue;
+
+      class_trace_begin();
 
 #ifdef _OPENMP
       tstart = omp_get_wtime();
 #endif
 
-      if (ptr->transfer_verbose > 2)
+      if ((ptr->transfer_verbose > 2) && (index_task % (task_per_q*l_block_num) == 0))
         printf("Compute transfer for wavenumber [%d/%zu]\n",index_q,ptr->q_size-1);
 
-      /* Update interpolation structure: */
-      class_call_parallel(transfer_update_HIS(ppr,
-                                              ptr,
-                                              ptw,
-                                              index_q,
-                                              tau0),
-                          ptr->error_message,
-                          ptr->error_message);
-
-      class_call_parallel(transfer_compute_for_each_q(ppr,
-                                                      pba,
-                                                      ppt,
-                                                      ptr,
-                                                      tp_of_tt,
-                                                      index_q,
-                                                      tau_size_max,
-                                                      tau_rec,
-                                                      sources,
-                                                      sources_spline,
-                                                      window,
-                                                      ptw),
-                          ptr->error_message,
-                          ptr->error_message);
+      /* Update interpolation structure, unless this thread already did it for this wavenumber: */
+      if (ptw->index_q_HIS != index_q) {
+        class_call_parallel(transfer_update_HIS(ppr,
+                                                ptr,
+                                                ptw,
+                                                index_q,
+                                                tau0),
+                            ptr->error_message,
+                            ptr->error_message);
+        ptw->index_q_HIS = index_q;
+      }
+
+      if (task_per_q == 1) {
+
+        class_call_parallel(transfer_compute_for_each_q(ppr,
+                                                        pba,
+                                                        ppt,
+                                                        ptr,
+                                                        tp_of_tt,
+                                                        index_q,
+                                                        index_l_min,
+                                                        index_l_max,
+                                                        tau_size_max,
+                                                        tau_rec,
+                                                        sources,
+                                                        sources_spline,
+                                                        window,
+                                                        ptw),
+                            ptr->error_message,
+                            ptr->error_message);
+      }
+      else {
+
+        /* find the mode, initial condition and type of this task */
+        index_type = (index_task/l_block_num) % task_per_q;
+        index_l_block = index_task % l_block_num;
+        index_md = 0;
+        while (index_type >= ppt->ic_size[index_md]*ptr->tt_size[index_md]) {
+          index_type -= ppt->ic_size[index_md]*ptr->tt_size[index_md];
+          index_md++;
+        }
+        index_ic = index_type / ptr->tt_size[index_md];
+        index_tt = index_type % ptr->tt_size[index_md];
+
+        class_call_parallel(transfer_compute_for_each_q_type(ppr,
+                                                             pba,
+                                                             ppt,
+                                                             ptr,
+                                                             tp_of_tt,
+                                                             index_q,
+                                                             index_md,
+                                                             index_ic,
+                                                             index_tt,
+                                                             index_l_min+index_l_block*l_block_size,
+                                                             MIN(index_l_min+(index_l_block+1)*l_block_size,index_l_max),
+                                                             tau_size_max,
+                                                             tau_rec,
+                                                             sources,
+                                                             sources_spline,
+                                                             window,
+                                                             ptw),
+                            ptr->error_message,
+                            ptr->error_message);
+      }
 
 #ifdef _OPENMP
       tstop = omp_get_wtime();
@@ -380,9 +662,11 @@ int transfer_init(
       tspent += tstop-tstart;
 #endif
 
+      class_trace_end("transfer","index_q",index_q);
+
 #pragma omp flush(abort)
 
-    } /* end of loop over wavenumber */
+    } /* end of loop over tasks */
 
     /* free workspace allocated inside parallel zone */
     class_call_parallel(transfer_workspace_free(ptr,ptw),
@@ -397,26 +681,115 @@ int transfer_init(
 
   } /* end of parallel region */
 
+  class_call(class_mpi_synchronize_abort(&abort,ptr->error_message),
+             ptr->error_message,
+             ptr->error_message);
+
   if (abort == _TRUE_) return _FAILURE_;
 
-  /** - finally, free arrays allocated outside parallel zone */
-  free(window);
+  /** - with MPI, share the transfer functions computed by each process with all other processes */
+
+  if (mpi_size > 1) {
+    class_call(transfer_mpi_gather(ppt,ptr,mpi_rank,mpi_size),
+               ptr->error_message,
+               ptr->error_message);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the context prepared by transfer_init()
+ *
+ * @param ptr Input: pointer to transfer structure
+ * @param ptc Input: context to free
+ * @return the error status
+ */
+
+int transfer_context_free(
+                          struct transfer * ptr,
+                          struct transfer_context * ptc
+                          ) {
+
+  /** - free arrays allocated in transfer_init() */
+  free(ptc->window);
+
+  class_call(transfer_sampling_free(&(ptc->sampling)),
+             ptr->error_message,
+             ptr->error_message);
 
-  class_call(transfer_perturbation_sources_spline_free(ppt,ptr,sources_spline),
+  class_call(transfer_perturbation_sources_spline_free(ptc->ppt,ptr,ptc->sources_spline),
              ptr->error_message,
              ptr->error_message);
 
-  class_call(transfer_perturbation_sources_free(ppt,pfo,ptr,sources),
+  class_call(transfer_perturbation_sources_free(ptc->ppt,ptc->pfo,ptr,ptc->sources),
              ptr->error_message,
              ptr->error_message);
 
-  class_call(transfer_free_source_correspondence(ptr,tp_of_tt),
+  class_call(transfer_free_source_correspondence(ptr,ptc->tp_of_tt),
              ptr->error_message,
              ptr->error_message);
 
-  class_call(hyperspherical_HIS_free(&BIS,ptr->error_message),
+  class_call(hyperspherical_HIS_free(&(ptc->BIS),ptr->error_message),
              ptr->error_message,
              ptr->error_message);
+
+  if (ptr->ptc == ptc)
+    ptr->ptc = NULL;
+
+  free(ptc);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Combine the transfer functions computed by the different MPI
+ * processes. Each process only computed the wavenumbers index_q such
+ * that index_q modulo mpi_size equals mpi_rank: all other values are
+ * set to zero, and the tables are then summed over processes.
+ *
+ * @param ppt      Input: pointer to perturbation structure
+ * @param ptr      Input/Output: pointer to transfer structure
+ * @param mpi_rank Input: index of the current MPI process
+ * @param mpi_size Input: number of MPI processes
+ * @return the error status
+ */
+
+int transfer_mpi_gather(
+                        struct perturbations * ppt,
+                        struct transfer * ptr,
+                        int mpi_rank,
+                        int mpi_size
+                        ) {
+
+  int index_md;
+  size_t index,size;
+
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
+
+    size = ppt->ic_size[index_md] * ptr->tt_size[index_md] * ptr->l_table_size[index_md] * ptr->q_size;
+
+    /* the index of the wavenumber is the last (fastest) index of the table */
+    for (index = 0; index < size; index++)
+      if ((int)((index % ptr->q_size) % mpi_size) != mpi_rank)
+        _transfer_set_(ptr,index_md,index,0.);
+
+    if (ptr->transfer_float != NULL) {
+      class_call(class_mpi_allreduce_sum_float(ptr->transfer_float[index_md],
+                                               size,
+                                               ptr->error_message),
+                 ptr->error_message,
+                 ptr->error_message);
+    }
+    else {
+      class_call(class_mpi_allreduce_sum(ptr->transfer[index_md],
+                                         size,
+                                         ptr->error_message),
+                 ptr->error_message,
+                 ptr->error_message);
+    }
+  }
+
   return _SUCCESS_;
 }
 
@@ -438,19 +811,45 @@ int transfer_free(
 
   if (ptr->has_cls == _TRUE_) {
 
+    if (ptr->ptc != NULL) {
+      class_call(transfer_context_free(ptr,ptr->ptc),
+                 ptr->error_message,
+                 ptr->error_message);
+    }
+
     for (index_md = 0; index_md < ptr->md_size; index_md++) {
       free(ptr->l_size_tt[index_md]);
-      free(ptr->transfer[index_md]);
+      free(ptr->l_stride_tt[index_md]);
+      if (ptr->transfer_float != NULL)
+        free(ptr->transfer_float[index_md]);
+      else
+        free(ptr->transfer[index_md]);
       free(ptr->k[index_md]);
     }
 
     free(ptr->tt_size);
     free(ptr->l_size_tt);
+    free(ptr->l_stride_tt);
+
+    if (ptr->neglect_count_computed != NULL) {
+      for (index_md = 0; index_md < ptr->md_size; index_md++) {
+        free(ptr->neglect_count_computed[index_md]);
+        free(ptr->neglect_count_cut[index_md]);
+        free(ptr->neglect_count_late[index_md]);
+      }
+      free(ptr->neglect_count_computed);
+      free(ptr->neglect_count_cut);
+      free(ptr->neglect_count_late);
+    }
     free(ptr->l_size);
+    free(ptr->l_table_size);
     free(ptr->l);
     free(ptr->q);
     free(ptr->k);
-    free(ptr->transfer);
+    if (ptr->transfer_float != NULL)
+      free(ptr->transfer_float);
+    else
+      free(ptr->transfer);
 
     if (ptr->nz_size > 0) {
       free(ptr->nz_z);
@@ -466,58 +865,355 @@ int transfer_free(
     }
   }
 
+  class_memory_leaks();
+
   return _SUCCESS_;
 
 }
 
 /**
- * This routine defines all indices and allocates all tables
- * in the transfer structure
- *
- * Compute list of (k, l) values, allocate and fill corresponding
- * arrays in the transfer structure. Allocate the array of transfer
- * function tables.
+ * Tables of transfer functions kept in memory by
+ * transfer_cache_store(), with the key identifying the input they were
+ * computed from.
+ */
+
+static struct transfer transfer_cache_table[_TRANSFER_CACHE_MAX_];
+static unsigned long long transfer_cache_keys[_TRANSFER_CACHE_MAX_];
+static short transfer_cache_used[_TRANSFER_CACHE_MAX_];
+static int transfer_cache_next = 0;
+
+/**
+ * Compute the key identifying the input of transfer_init(): the key of
+ * the source functions (see perturbations_cache_key(), which already
+ * includes all precision parameters and the background and
+ * thermodynamics quantities used here), the input parameters of the
+ * transfer structure, and the non-linear corrections applied to the
+ * sources.
  *
- * @param ppr      Input: pointer to precision structure
- * @param ppt      Input: pointer to perturbation structure
- * @param ptr      Input/Output: pointer to transfer structure
- * @param q_period Input: order of magnitude of the oscillation period of transfer functions
- * @param K        Input: spatial curvature (in absolute value)
- * @param sgnK     Input: spatial curvature sign (open/closed/flat)
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to thermodynamics structure
+ * @param ppt Input: pointer to perturbation structure
+ * @param pfo Input: pointer to fourier structure
+ * @param ptr Input: pointer to transfer structure (only input parameters are used)
+ * @param key Output: key
  * @return the error status
  */
 
-int transfer_indices(
-                     struct precision * ppr,
-                     struct perturbations * ppt,
-                     struct transfer * ptr,
-                     double q_period,
-                     double K,
-                     int sgnK
-                     ) {
+int transfer_cache_key(
+                       struct precision * ppr,
+                       struct background * pba,
+                       struct thermodynamics * pth,
+                       struct perturbations * ppt,
+                       struct fourier * pfo,
+                       struct transfer * ptr,
+                       unsigned long long * key
+                       ) {
 
-  /** Summary: */
+  class_call(perturbations_cache_key(ppr,pba,pth,ppt,key),
+             ppt->error_message,
+             ptr->error_message);
 
-  /** - define local variables */
+  /** - input parameters of the transfer structure */
+
+  perturbations_cache_hash(&(ptr->lcmb_rescale),sizeof(ptr->lcmb_rescale),key);
+  perturbations_cache_hash(&(ptr->lcmb_tilt),sizeof(ptr->lcmb_tilt),key);
+  perturbations_cache_hash(&(ptr->lcmb_pivot),sizeof(ptr->lcmb_pivot),key);
+  perturbations_cache_hash(ptr->selection_bias,sizeof(ptr->selection_bias),key);
+  perturbations_cache_hash(ptr->selection_magnification_bias,sizeof(ptr->selection_magnification_bias),key);
+  perturbations_cache_hash(&(ptr->has_nz_file),sizeof(ptr->has_nz_file),key);
+  perturbations_cache_hash(&(ptr->has_nz_analytic),sizeof(ptr->has_nz_analytic),key);
+  perturbations_cache_hash(ptr->nz_file_name,strlen(ptr->nz_file_name),key);
+  perturbations_cache_hash(&(ptr->has_nz_evo_file),sizeof(ptr->has_nz_evo_file),key);
+  perturbations_cache_hash(&(ptr->has_nz_evo_analytic),sizeof(ptr->has_nz_evo_analytic),key);
+  perturbations_cache_hash(ptr->nz_evo_file_name,strlen(ptr->nz_evo_file_name),key);
+
+  /** - other quantities read in this module */
+
+  perturbations_cache_hash(&(pth->tau_cut),sizeof(pth->tau_cut),key);
+
+  /** - non-linear corrections of the sources, which depend on the
+      primordial spectrum */
+
+  perturbations_cache_hash(&(pfo->method),sizeof(pfo->method),key);
+  if ((pfo->method != nl_none) && (ppt->has_scalars == _TRUE_)) {
+    perturbations_cache_hash(pfo->nl_corr_density[pfo->index_pk_m],
+                             ppt->tau_size*ppt->k_size[ppt->index_md_scalars]*sizeof(double),
+                             key);
+    if (pfo->has_pk_cb == _TRUE_)
+      perturbations_cache_hash(pfo->nl_corr_density[pfo->index_pk_cb],
+                               ppt->tau_size*ppt->k_size[ppt->index_md_scalars]*sizeof(double),
+                               key);
+  }
 
-  int index_md,index_tt,index_tt_common;
+  return _SUCCESS_;
+}
 
-  /** - define indices for transfer types */
+/**
+ * Look for transfer functions stored in memory under a given key. If
+ * they are found, fill the transfer structure with a copy of them,
+ * exactly as transfer_init() would do.
+ *
+ * @param key   Input: key computed by transfer_cache_key()
+ * @param ppt   Input: pointer to perturbation structure
+ * @param ptr   Input/Output: transfer structure
+ * @param found Output: whether transfer functions were found under this key
+ * @return the error status
+ */
 
-  class_alloc(ptr->tt_size,ptr->md_size * sizeof(int),ptr->error_message);
+int transfer_cache_fetch(
+                         unsigned long long key,
+                         struct perturbations * ppt,
+                         struct transfer * ptr,
+                         short * found
+                         ) {
 
-  /** - type indices common to scalars and tensors */
+  int index_cache;
+  short transfer_verbose;
 
-  index_tt = 0;
+  *found = _FALSE_;
 
-  class_define_index(ptr->index_tt_t2,ppt->has_cl_cmb_temperature, index_tt,1);
-  class_define_index(ptr->index_tt_e, ppt->has_cl_cmb_polarization,index_tt,1);
+  for (index_cache = 0; index_cache < _TRANSFER_CACHE_MAX_; index_cache++) {
+    if ((transfer_cache_used[index_cache] == _TRUE_) && (transfer_cache_keys[index_cache] == key)) {
+      *found = _TRUE_;
+      break;
+    }
+  }
 
-  index_tt_common=index_tt;
+  if (*found == _FALSE_)
+    return _SUCCESS_;
 
-  /** - type indices for scalars */
+  transfer_verbose = ptr->transfer_verbose;
 
-  if (ppt->has_scalars == _TRUE_) {
+  memcpy(ptr,&(transfer_cache_table[index_cache]),sizeof(struct transfer));
+
+  ptr->transfer_verbose = transfer_verbose;
+
+  class_call(transfer_copy_tables(ppt,&(transfer_cache_table[index_cache]),ptr),
+             ptr->error_message,
+             ptr->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Store a copy of the transfer functions of a transfer structure in
+ * memory under a given key. When ppr->transfer_cache_size tables are
+ * already stored, the oldest one is replaced.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param key Input: key computed by transfer_cache_key()
+ * @param ppt Input: pointer to perturbation structure
+ * @param ptr Input: transfer structure filled by transfer_init()
+ * @return the error status
+ */
+
+int transfer_cache_store(
+                         struct precision * ppr,
+                         unsigned long long key,
+                         struct perturbations * ppt,
+                         struct transfer * ptr
+                         ) {
+
+  int index_cache;
+  struct transfer * ptr_cache;
+
+  index_cache = transfer_cache_next % MIN(ppr->transfer_cache_size,_TRANSFER_CACHE_MAX_);
+  ptr_cache = &(transfer_cache_table[index_cache]);
+
+  if (transfer_cache_used[index_cache] == _TRUE_) {
+    class_call(transfer_free(ptr_cache),
+               ptr_cache->error_message,
+               ptr->error_message);
+    transfer_cache_used[index_cache] = _FALSE_;
+  }
+
+  memcpy(ptr_cache,ptr,sizeof(struct transfer));
+
+  class_call(transfer_copy_tables(ppt,ptr,ptr_cache),
+             ptr_cache->error_message,
+             ptr->error_message);
+
+  transfer_cache_keys[index_cache] = key;
+  transfer_cache_used[index_cache] = _TRUE_;
+  transfer_cache_next = index_cache+1;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free all transfer functions stored in memory by
+ * transfer_cache_store().
+ *
+ * @return the error status
+ */
+
+int transfer_cache_clear(
+                         ) {
+
+  int index_cache;
+
+#pragma omp critical (transfer_cache)
+  {
+    for (index_cache = 0; index_cache < _TRANSFER_CACHE_MAX_; index_cache++) {
+      if (transfer_cache_used[index_cache] == _TRUE_) {
+        transfer_free(&(transfer_cache_table[index_cache]));
+        transfer_cache_used[index_cache] = _FALSE_;
+      }
+    }
+    transfer_cache_next = 0;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Allocate in ptr_out a copy of all the arrays of ptr_in that
+ * transfer_free() deallocates (lists of types, multipoles and
+ * wavenumbers, tables of transfer functions, selection and evolution
+ * functions read from files). All other fields of ptr_out are assumed
+ * to be already identical to those of ptr_in. The transfer functions
+ * must not be streamed, and neglect statistics are not copied.
+ *
+ * @param ppt     Input: pointer to perturbation structure
+ * @param ptr_in  Input: transfer structure filled by transfer_init()
+ * @param ptr_out Output: transfer structure receiving the copy
+ * @return the error status
+ */
+
+int transfer_copy_tables(
+                         struct perturbations * ppt,
+                         struct transfer * ptr_in,
+                         struct transfer * ptr_out
+                         ) {
+
+  int index_md;
+  int md_size = ptr_in->md_size;
+  size_t size;
+
+  ptr_out->ptc = NULL;
+  ptr_out->neglect_count_computed = NULL;
+  ptr_out->neglect_count_cut = NULL;
+  ptr_out->neglect_count_late = NULL;
+
+  if (ptr_in->has_cls == _FALSE_)
+    return _SUCCESS_;
+
+  class_alloc(ptr_out->tt_size,md_size*sizeof(int),ptr_out->error_message);
+  class_alloc(ptr_out->l_size,md_size*sizeof(int),ptr_out->error_message);
+  class_alloc(ptr_out->l_table_size,md_size*sizeof(int),ptr_out->error_message);
+  memcpy(ptr_out->tt_size,ptr_in->tt_size,md_size*sizeof(int));
+  memcpy(ptr_out->l_size,ptr_in->l_size,md_size*sizeof(int));
+  memcpy(ptr_out->l_table_size,ptr_in->l_table_size,md_size*sizeof(int));
+
+  class_alloc(ptr_out->l,ptr_in->l_size_max*sizeof(int),ptr_out->error_message);
+  memcpy(ptr_out->l,ptr_in->l,ptr_in->l_size_max*sizeof(int));
+
+  class_alloc(ptr_out->q,ptr_in->q_size*sizeof(double),ptr_out->error_message);
+  memcpy(ptr_out->q,ptr_in->q,ptr_in->q_size*sizeof(double));
+
+  class_alloc(ptr_out->l_size_tt,md_size*sizeof(int *),ptr_out->error_message);
+  class_alloc(ptr_out->l_stride_tt,md_size*sizeof(int *),ptr_out->error_message);
+  class_alloc(ptr_out->k,md_size*sizeof(double *),ptr_out->error_message);
+  if (ptr_in->transfer_float != NULL) {
+    class_alloc(ptr_out->transfer_float,md_size*sizeof(float *),ptr_out->error_message);
+  }
+  else {
+    class_alloc(ptr_out->transfer,md_size*sizeof(double *),ptr_out->error_message);
+  }
+
+  for (index_md = 0; index_md < md_size; index_md++) {
+
+    class_alloc(ptr_out->l_size_tt[index_md],ptr_in->tt_size[index_md]*sizeof(int),ptr_out->error_message);
+    class_alloc(ptr_out->l_stride_tt[index_md],ptr_in->tt_size[index_md]*sizeof(int),ptr_out->error_message);
+    memcpy(ptr_out->l_size_tt[index_md],ptr_in->l_size_tt[index_md],ptr_in->tt_size[index_md]*sizeof(int));
+    memcpy(ptr_out->l_stride_tt[index_md],ptr_in->l_stride_tt[index_md],ptr_in->tt_size[index_md]*sizeof(int));
+
+    class_alloc(ptr_out->k[index_md],ptr_in->q_size*sizeof(double),ptr_out->error_message);
+    memcpy(ptr_out->k[index_md],ptr_in->k[index_md],ptr_in->q_size*sizeof(double));
+
+    size = (size_t)ppt->ic_size[index_md]*ptr_in->tt_size[index_md]*ptr_in->l_table_size[index_md]*ptr_in->q_size;
+    if (ptr_in->transfer_float != NULL) {
+      class_alloc(ptr_out->transfer_float[index_md],size*sizeof(float),ptr_out->error_message);
+      memcpy(ptr_out->transfer_float[index_md],ptr_in->transfer_float[index_md],size*sizeof(float));
+    }
+    else {
+      class_alloc(ptr_out->transfer[index_md],size*sizeof(double),ptr_out->error_message);
+      memcpy(ptr_out->transfer[index_md],ptr_in->transfer[index_md],size*sizeof(double));
+    }
+  }
+
+  if (ptr_in->nz_size > 0) {
+    class_alloc(ptr_out->nz_z,ptr_in->nz_size*sizeof(double),ptr_out->error_message);
+    class_alloc(ptr_out->nz_nz,ptr_in->nz_size*sizeof(double),ptr_out->error_message);
+    class_alloc(ptr_out->nz_ddnz,ptr_in->nz_size*sizeof(double),ptr_out->error_message);
+    memcpy(ptr_out->nz_z,ptr_in->nz_z,ptr_in->nz_size*sizeof(double));
+    memcpy(ptr_out->nz_nz,ptr_in->nz_nz,ptr_in->nz_size*sizeof(double));
+    memcpy(ptr_out->nz_ddnz,ptr_in->nz_ddnz,ptr_in->nz_size*sizeof(double));
+  }
+
+  if (ptr_in->nz_evo_size > 0) {
+    class_alloc(ptr_out->nz_evo_z,ptr_in->nz_evo_size*sizeof(double),ptr_out->error_message);
+    class_alloc(ptr_out->nz_evo_nz,ptr_in->nz_evo_size*sizeof(double),ptr_out->error_message);
+    class_alloc(ptr_out->nz_evo_dlog_nz,ptr_in->nz_evo_size*sizeof(double),ptr_out->error_message);
+    class_alloc(ptr_out->nz_evo_dd_dlog_nz,ptr_in->nz_evo_size*sizeof(double),ptr_out->error_message);
+    memcpy(ptr_out->nz_evo_z,ptr_in->nz_evo_z,ptr_in->nz_evo_size*sizeof(double));
+    memcpy(ptr_out->nz_evo_nz,ptr_in->nz_evo_nz,ptr_in->nz_evo_size*sizeof(double));
+    memcpy(ptr_out->nz_evo_dlog_nz,ptr_in->nz_evo_dlog_nz,ptr_in->nz_evo_size*sizeof(double));
+    memcpy(ptr_out->nz_evo_dd_dlog_nz,ptr_in->nz_evo_dd_dlog_nz,ptr_in->nz_evo_size*sizeof(double));
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine defines all indices and allocates all tables
+ * in the transfer structure
+ *
+ * Compute list of (k, l) values, allocate and fill corresponding
+ * arrays in the transfer structure. Allocate the array of transfer
+ * function tables.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param ppt      Input: pointer to perturbation structure
+ * @param ptr      Input/Output: pointer to transfer structure
+ * @param q_period Input: order of magnitude of the oscillation period of transfer functions
+ * @param K        Input: spatial curvature (in absolute value)
+ * @param sgnK     Input: spatial curvature sign (open/closed/flat)
+ * @return the error status
+ */
+
+int transfer_indices(
+                     struct precision * ppr,
+                     struct perturbations * ppt,
+                     struct transfer * ptr,
+                     double q_period,
+                     double K,
+                     int sgnK
+                     ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  int index_md,index_tt,index_tt_common;
+
+  /** - define indices for transfer types */
+
+  class_alloc(ptr->tt_size,ptr->md_size * sizeof(int),ptr->error_message);
+
+  /** - type indices common to scalars and tensors */
+
+  index_tt = 0;
+
+  class_define_index(ptr->index_tt_t2,ppt->has_cl_cmb_temperature, index_tt,1);
+  class_define_index(ptr->index_tt_e, ppt->has_cl_cmb_polarization,index_tt,1);
+
+  index_tt_common=index_tt;
+
+  /** - type indices for scalars */
+
+  if (ppt->has_scalars == _TRUE_) {
 
     index_tt = index_tt_common;
 
@@ -575,13 +1271,23 @@ int transfer_indices(
 
   class_alloc(ptr->l_size_tt,ptr->md_size * sizeof(int *),ptr->error_message);
 
+  class_alloc(ptr->l_stride_tt,ptr->md_size * sizeof(int *),ptr->error_message);
+
   for (index_md = 0; index_md < ptr->md_size; index_md++) {
     class_alloc(ptr->l_size_tt[index_md],ptr->tt_size[index_md] * sizeof(int),ptr->error_message);
+    class_alloc(ptr->l_stride_tt[index_md],ptr->tt_size[index_md] * sizeof(int),ptr->error_message);
   }
 
   /* array (of array) of transfer functions for each mode, transfer[index_md] */
 
-  class_alloc(ptr->transfer,ptr->md_size * sizeof(double *),ptr->error_message);
+  if (ppr->transfer_single_precision == _TRUE_) {
+    ptr->transfer = NULL;
+    class_alloc(ptr->transfer_float,ptr->md_size * sizeof(float *),ptr->error_message);
+  }
+  else {
+    class_alloc(ptr->transfer,ptr->md_size * sizeof(double *),ptr->error_message);
+    ptr->transfer_float = NULL;
+  }
 
   /** - get q values using transfer_get_q_list() */
 
@@ -619,14 +1325,58 @@ int transfer_indices(
              ptr->error_message,
              ptr->error_message);
 
+  /** - number of multipoles stored at a time: all of them, or
+      a block of them if transfer functions are streamed */
+
+  ptr->l_stream_block_size = MAX(ppr->transfer_stream_l_block_size,0);
+  ptr->index_l_table_min = 0;
+  ptr->ptc = NULL;
+
+  /** - counters of neglected integrals */
+
+  ptr->neglect_count_computed = NULL;
+  ptr->neglect_count_cut = NULL;
+  ptr->neglect_count_late = NULL;
+
+  if (ppr->transfer_neglect_statistics == _TRUE_) {
+
+    class_test(ptr->l_stream_block_size > 0,
+               ptr->error_message,
+               "transfer_neglect_statistics needs all transfer functions at once: set transfer_stream_l_block_size to 0");
+
+    class_alloc(ptr->neglect_count_computed,ptr->md_size*sizeof(long *),ptr->error_message);
+    class_alloc(ptr->neglect_count_cut,ptr->md_size*sizeof(long *),ptr->error_message);
+    class_alloc(ptr->neglect_count_late,ptr->md_size*sizeof(long *),ptr->error_message);
+
+    for (index_md = 0; index_md < ptr->md_size; index_md++) {
+      class_calloc(ptr->neglect_count_computed[index_md],ptr->tt_size[index_md],sizeof(long),ptr->error_message);
+      class_calloc(ptr->neglect_count_cut[index_md],ptr->tt_size[index_md],sizeof(long),ptr->error_message);
+      class_calloc(ptr->neglect_count_late[index_md],ptr->tt_size[index_md],sizeof(long),ptr->error_message);
+    }
+  }
+
+  class_alloc(ptr->l_table_size,ptr->md_size*sizeof(int),ptr->error_message);
+
   /** - loop over modes (scalar, etc). For each mode: */
 
   for (index_md = 0; index_md < ptr->md_size; index_md++) {
 
-    /** - allocate arrays of transfer functions, (ptr->transfer[index_md])[index_ic][index_tt][index_l][index_k] */
-    class_alloc(ptr->transfer[index_md],
-                ppt->ic_size[index_md] * ptr->tt_size[index_md] * ptr->l_size[index_md] * ptr->q_size * sizeof(double),
-                ptr->error_message);
+    if (ptr->l_stream_block_size > 0)
+      ptr->l_table_size[index_md] = MIN(ptr->l_stream_block_size,ptr->l_size[index_md]);
+    else
+      ptr->l_table_size[index_md] = ptr->l_size[index_md];
+
+    /** - allocate arrays of transfer functions, (ptr->transfer[index_md])[index_ic][index_tt][index_l-index_l_table_min][index_k] */
+    if (ptr->transfer_float != NULL) {
+      class_alloc_first_touch(ptr->transfer_float[index_md],
+                              ppt->ic_size[index_md] * ptr->tt_size[index_md] * ptr->l_table_size[index_md] * ptr->q_size * sizeof(float),
+                              ptr->error_message);
+    }
+    else {
+      class_alloc_first_touch(ptr->transfer[index_md],
+                              ppt->ic_size[index_md] * ptr->tt_size[index_md] * ptr->l_table_size[index_md] * ptr->q_size * sizeof(double),
+                              ptr->error_message);
+    }
 
   }
 
@@ -707,7 +1457,25 @@ int transfer_perturbation_copy_sources_and_nl_corrections(
 }
 
 
+/**
+ * Spline all the sources passed by the perturbation module with
+ * respect to k. If ppr->transfer_sources_k_major is set, the sources
+ * and their second derivatives are then copied, interleaved, in an
+ * array ordered by wavenumber and then time: the interpolation at a
+ * given wavenumber in transfer_interpolate_sources() then reads two
+ * contiguous blocks of memory, instead of four values per time with a
+ * stride of k_size.
+ *
+ * @param ppr            Input: pointer to precision structure
+ * @param ppt            Input: pointer to perturbation structure
+ * @param ptr            Input: pointer to transfer structure
+ * @param sources        Input: array of sources
+ * @param sources_spline Output: array of second derivatives of sources (or of sources and second derivatives)
+ * @return the error status
+ */
+
 int transfer_perturbation_source_spline(
+                                        struct precision * ppr,
                                         struct perturbations * ppt,
                                         struct transfer * ptr,
                                         double *** sources,
@@ -716,6 +1484,11 @@ int transfer_perturbation_source_spline(
   int index_md;
   int index_ic;
   int index_tp;
+  int index_k;
+  int index_tau;
+  double * source;
+  double * spline;
+  double * table;
 
   for (index_md = 0; index_md < ptr->md_size; index_md++) {
 
@@ -741,6 +1514,26 @@ int transfer_perturbation_source_spline(
                    ptr->error_message,
                    ptr->error_message);
 
+        if (ppr->transfer_sources_k_major == _TRUE_) {
+
+          source = sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp];
+          spline = sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp];
+
+          class_alloc(table,
+                      2*ppt->k_size[index_md]*ppt->tau_size*sizeof(double),
+                      ptr->error_message);
+
+          for (index_k = 0; index_k < ppt->k_size[index_md]; index_k++) {
+            for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
+              table[(index_k*ppt->tau_size+index_tau)*2] = source[index_tau*ppt->k_size[index_md]+index_k];
+              table[(index_k*ppt->tau_size+index_tau)*2+1] = spline[index_tau*ppt->k_size[index_md]+index_k];
+            }
+          }
+
+          free(spline);
+          sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp] = table;
+        }
+
       }
     }
   }
@@ -914,6 +1707,8 @@ int transfer_get_l_list(
 
   increment = ppr->l_linstep*ptr->angular_rescaling;
 
+  ptr->index_l_linstep = index_l;
+
   while ((ptr->l[index_l]+increment) <= l_max) {
 
     index_l ++;
@@ -992,6 +1787,23 @@ int transfer_get_l_list(
 
       ptr->l_size[index_md] = MAX(ptr->l_size[index_md],ptr->l_size_tt[index_md][index_tt]);
 
+      /* l list of this type: types entering only smooth C_l's (phi-phi,
+         or lensing-lensing) can be sampled with a larger stride; this
+         must match the interpolation in harmonic_cls_interpolate_strided() */
+
+      ptr->l_stride_tt[index_md][index_tt] = 1;
+
+      if (_scalars_ && (ppr->l_stride_smooth > 1)) {
+
+        if ((ppt->has_cl_cmb_lensing_potential == _TRUE_) && (index_tt == ptr->index_tt_lcmb) &&
+            (ppt->has_cl_cmb_temperature == _FALSE_) && (ppt->has_cl_cmb_polarization == _FALSE_) &&
+            (ppt->has_cl_number_count == _FALSE_))
+          ptr->l_stride_tt[index_md][index_tt] = ppr->l_stride_smooth;
+
+        if ((ppt->has_cl_lensing_potential == _TRUE_) && (index_tt >= ptr->index_tt_lensing) && (index_tt < ptr->index_tt_lensing+ppt->selection_num) &&
+            (ppt->has_cl_number_count == _FALSE_))
+          ptr->l_stride_tt[index_md][index_tt] = ppr->l_stride_smooth;
+      }
     }
   }
 
@@ -1678,6 +2490,98 @@ int transfer_source_tau_size(
   return _SUCCESS_;
 }
 
+/**
+ * This routine splits the loop over wavenumbers of transfer_init()
+ * into tasks. By default, each task deals with all the transfer
+ * functions of one wavenumber (task_per_q=1). In the flat case, when
+ * there are too few wavenumbers to keep all threads busy, or when the
+ * precision parameter transfer_l_block_size is set, each task deals
+ * with one wavenumber, one (mode, initial condition, type) triplet and
+ * one block of l_block_size multipoles: task_per_q is then the number
+ * of such triplets. In the non-flat case, this is not the default,
+ * since each thread then recomputes the hyperspherical Bessel
+ * functions of the wavenumbers it deals with.
+ *
+ * @param ppr          Input: pointer to precision structure
+ * @param ppt          Input: pointer to perturbation structure
+ * @param ptr          Input: pointer to transfer structure
+ * @param sgnK         Input: sign of the curvature
+ * @param task_per_q   Output: number of (mode, initial condition, type) tasks per wavenumber, or 1 for one task per wavenumber
+ * @param l_block_size Output: number of multipoles per task
+ * @return the error status
+ */
+
+int transfer_define_tasks(
+                          struct precision * ppr,
+                          struct perturbations * ppt,
+                          struct transfer * ptr,
+                          int sgnK,
+                          int * task_per_q,
+                          int * l_block_size
+                          ) {
+
+  int number_of_threads = 1;
+  int index_md;
+  int type_size = 0;
+  int l_block_num;
+
+#ifdef _OPENMP
+#pragma omp parallel
+  {
+    number_of_threads = omp_get_num_threads();
+  }
+#endif
+
+  for (index_md = 0; index_md < ptr->md_size; index_md++)
+    type_size += ppt->ic_size[index_md]*ptr->tt_size[index_md];
+
+  *task_per_q = 1;
+  *l_block_size = ptr->l_size_max;
+
+  if (ppr->transfer_l_block_size > 0) {
+    *task_per_q = type_size;
+    *l_block_size = MIN(ppr->transfer_l_block_size,ptr->l_size_max);
+  }
+  else if ((sgnK == 0) && (ptr->q_size < _TRANSFER_TASKS_PER_THREAD_*number_of_threads)) {
+    *task_per_q = type_size;
+    /* number of blocks of multipoles such that there are at least _TRANSFER_TASKS_PER_THREAD_ tasks per thread */
+    l_block_num = (_TRANSFER_TASKS_PER_THREAD_*number_of_threads+ptr->q_size*type_size-1)/(ptr->q_size*type_size);
+    *l_block_size = MAX(1,(ptr->l_size_max+l_block_num-1)/l_block_num);
+  }
+
+  if (ptr->transfer_verbose > 1)
+    printf(" -> %zu tasks: %d per wavenumber, of %d multipoles\n",
+           ptr->q_size*(*task_per_q)*((ptr->l_size_max+*l_block_size-1)/(*l_block_size)),
+           *task_per_q*((ptr->l_size_max+*l_block_size-1)/(*l_block_size)),
+           *l_block_size);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine computes all the transfer functions of one wavenumber,
+ * for the multipoles index_l_min <= index_l < index_l_max, by calling
+ * transfer_compute_for_each_q_type() for each mode, initial condition
+ * and type, or transfer_compute_for_each_q_bin() for the local number
+ * count types of each bin.
+ *
+ * @param ppr                 Input: pointer to precision structure
+ * @param pba                 Input: pointer to background structure
+ * @param ppt                 Input: pointer to perturbation structure
+ * @param ptr                 Input/Output: pointer to transfer structure
+ * @param tp_of_tt            Input: correspondence between perturbation and transfer source types
+ * @param index_q             Input: index of wavenumber
+ * @param index_l_min         Input: first multipole index
+ * @param index_l_max         Input: last multipole index plus one (larger values than l_size[index_md] are allowed)
+ * @param tau_size_max        Input: maximum number of times in transfer sources
+ * @param tau_rec             Input: conformal time at recombination
+ * @param pert_sources        Input: perturbation sources
+ * @param pert_sources_spline Input: their second derivatives with respect to k
+ * @param window              Input: precomputed selection functions
+ * @param ptw                 Input/Output: pointer to workspace
+ * @return the error status
+ */
+
 int transfer_compute_for_each_q(
                                 struct precision * ppr,
                                 struct background * pba,
@@ -1685,6 +2589,8 @@ int transfer_compute_for_each_q(
                                 struct transfer * ptr,
                                 int ** tp_of_tt,
                                 int index_q,
+                                int index_l_min,
+                                int index_l_max,
                                 int tau_size_max,
                                 double tau_rec,
                                 double *** pert_sources,
@@ -1693,250 +2599,746 @@ int transfer_compute_for_each_q(
                                 struct transfer_workspace * ptw
                                 ) {
 
-  /** Summary: */
-
-  /** - define local variables */
-
-  /* running index for modes */
   int index_md;
-  /* running index for initial conditions */
   int index_ic;
-  /* running index for transfer types */
   int index_tt;
-  /* running index for multipoles */
-  int index_l;
+  int bin=0;
+  int bin_size;
+  int bin_tt[_HERMITE_CONVOLUTION_MAX_];
 
-  /** - we deal with workspaces, i.e. with contiguous memory zones (one
-      per thread) containing various fields used by the integration
-      routine */
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
+    for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+      for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
 
-  /* - first workspace field: perturbation source interpolated from perturbation structure */
-  double * interpolated_sources;
+        /* in the flat case, the local number count types of a bin are
+           dealt with together, when the first of them is reached */
+        if ((ppr->transfer_fuse_nc_bins == _TRUE_) && (ptw->sgnK == 0) && (_scalars_) && (_nonintegrated_ncl_)) {
 
-  /* - second workspace field: list of tau0-tau values, tau0_minus_tau[index_tau] */
-  double * tau0_minus_tau;
+          _get_bin_nonintegrated_ncl_(index_tt)
 
-  /* - third workspace field: list of trapezoidal weights for integration over tau */
-  double * w_trapz;
+          class_call(transfer_nc_bin_types(ppt,ptr,bin,&bin_size,bin_tt),
+                     ptr->error_message,
+                     ptr->error_message);
 
-  /* - fourth workspace field, containing just a double: number of time values */
-  int * tau_size;
+          if (bin_size > 1) {
+            if (index_tt == bin_tt[0]) {
+              class_call(transfer_compute_for_each_q_bin(ppr,
+                                                         pba,
+                                                         ppt,
+                                                         ptr,
+                                                         tp_of_tt,
+                                                         index_q,
+                                                         index_md,
+                                                         index_ic,
+                                                         bin_size,
+                                                         bin_tt,
+                                                         index_l_min,
+                                                         index_l_max,
+                                                         tau_size_max,
+                                                         tau_rec,
+                                                         pert_sources,
+                                                         pert_sources_spline,
+                                                         window,
+                                                         ptw),
+                         ptr->error_message,
+                         ptr->error_message);
+            }
+            continue;
+          }
+        }
 
-  /* - fifth workspace field, identical to above interpolated sources:
-     sources[index_tau] */
-  double * sources;
+        class_call(transfer_compute_for_each_q_type(ppr,
+                                                    pba,
+                                                    ppt,
+                                                    ptr,
+                                                    tp_of_tt,
+                                                    index_q,
+                                                    index_md,
+                                                    index_ic,
+                                                    index_tt,
+                                                    index_l_min,
+                                                    index_l_max,
+                                                    tau_size_max,
+                                                    tau_rec,
+                                                    pert_sources,
+                                                    pert_sources_spline,
+                                                    window,
+                                                    ptw),
+                   ptr->error_message,
+                   ptr->error_message);
+      }
+    }
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine computes the transfer functions of one wavenumber, one
+ * mode, one initial condition and one type, for the multipoles
+ * index_l_min <= index_l < index_l_max. The interpolated and transfer
+ * sources are only computed if the workspace does not already contain
+ * them (the index_*_interpolated and index_tt_sources fields of the
+ * workspace keep track of its content).
+ *
+ * @param ppr                 Input: pointer to precision structure
+ * @param pba                 Input: pointer to background structure
+ * @param ppt                 Input: pointer to perturbation structure
+ * @param ptr                 Input/Output: pointer to transfer structure
+ * @param tp_of_tt            Input: correspondence between perturbation and transfer source types
+ * @param index_q             Input: index of wavenumber
+ * @param index_md            Input: index of mode
+ * @param index_ic            Input: index of initial condition
+ * @param index_tt            Input: index of transfer type
+ * @param index_l_min         Input: first multipole index
+ * @param index_l_max         Input: last multipole index plus one (larger values than l_size[index_md] are allowed)
+ * @param tau_size_max        Input: maximum number of times in transfer sources
+ * @param tau_rec             Input: conformal time at recombination
+ * @param pert_sources        Input: perturbation sources
+ * @param pert_sources_spline Input: their second derivatives with respect to k
+ * @param window              Input: precomputed selection functions
+ * @param ptw                 Input/Output: pointer to workspace
+ * @return the error status
+ */
+
+int transfer_compute_for_each_q_type(
+                                     struct precision * ppr,
+                                     struct background * pba,
+                                     struct perturbations * ppt,
+                                     struct transfer * ptr,
+                                     int ** tp_of_tt,
+                                     int index_q,
+                                     int index_md,
+                                     int index_ic,
+                                     int index_tt,
+                                     int index_l_min,
+                                     int index_l_max,
+                                     int tau_size_max,
+                                     double tau_rec,
+                                     double *** pert_sources,
+                                     double *** pert_sources_spline,
+                                     double * window,
+                                     struct transfer_workspace * ptw
+                                     ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  /* running index for multipoles */
+  int index_l;
+
+  /* - list of tau0-tau values in the workspace, tau0_minus_tau[index_tau] */
+  double * tau0_minus_tau = ptw->tau0_minus_tau;
 
   /** - for a given l, maximum value of k such that we can convolve
       the source with Bessel functions j_l(x) without reaching x_max */
   double q_max_bessel;
 
-  /* a value of index_type */
-  int previous_type;
-
   double l;
 
   short neglect;
 
+  /* with neglect statistics, whether the integral would be cut by transfer_can_be_neglected() */
+  short cut = _FALSE_;
+
   radial_function_type radial_type;
 
-  /** - store the sources in the workspace and define all
-      fields in this workspace */
-  interpolated_sources = ptw->interpolated_sources;
-  tau0_minus_tau = ptw->tau0_minus_tau;
-  w_trapz  = ptw->w_trapz;
-  tau_size = &(ptw->tau_size);
-  sources = ptw->sources;
+  index_l_max = MIN(index_l_max,ptr->l_size[index_md]);
 
-  /** - loop over all modes. For each mode */
+  /** - if we reached q_max for this mode, there is nothing to be done */
 
-  for (index_md = 0; index_md < ptr->md_size; index_md++) {
+  if (ptr->k[index_md][index_q] > ppt->k[index_md][ppt->k_size_cl[index_md]-1]) {
 
-    /* if we reached q_max for this mode, there is nothing to be done */
+    for (index_l = index_l_min; index_l < index_l_max; index_l++) {
 
-    if (ptr->k[index_md][index_q] <= ppt->k[index_md][ppt->k_size_cl[index_md]-1]) {
+      _transfer_set_(ptr,index_md,
+                     _transfer_index_(ptr,index_md,index_ic,index_tt,index_l,index_q),
+                     0.);
+    }
+    return _SUCCESS_;
+  }
 
-      /** - loop over initial conditions. */
-      /* For each of them: */
+  /** - interpolate the source and compute the transfer source, unless they are already in the workspace */
+  class_call(transfer_workspace_sources(ppr,
+                                        pba,
+                                        ppt,
+                                        ptr,
+                                        tp_of_tt,
+                                        index_q,
+                                        index_md,
+                                        index_ic,
+                                        index_tt,
+                                        tau_size_max,
+                                        tau_rec,
+                                        pert_sources,
+                                        pert_sources_spline,
+                                        window,
+                                        ptw),
+             ptr->error_message,
+             ptr->error_message);
 
-      for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+  /** - Select radial function type */
+  class_call(transfer_select_radial_function(
+                                             ppt,
+                                             ptr,
+                                             index_md,
+                                             index_tt,
+                                             &radial_type),
+             ptr->error_message,
+             ptr->error_message);
 
-        /* initialize the previous type index */
-        previous_type=-1;
+  for (index_l = index_l_min; index_l < index_l_max; index_l++) {
+
+    l = (double)ptr->l[index_l];
+
+    /* neglect transfer function when l is much smaller than k*tau0 */
+    class_call(transfer_can_be_neglected(ppr,
+                                         ppt,
+                                         ptr,
+                                         index_md,
+                                         index_ic,
+                                         index_tt,
+                                         (pba->conformal_age-tau_rec)*ptr->angular_rescaling,
+                                         ptr->q[index_q],
+                                         l,
+                                         &neglect),
+               ptr->error_message,
+               ptr->error_message);
 
-        /* - loop over types. For each of them: */
+    /* with neglect statistics, compute the integral anyway; it will be cut by transfer_neglect_statistics() */
+    if (ptr->neglect_count_cut != NULL) {
+      cut = neglect;
+      neglect = _FALSE_;
+    }
 
-        for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+    /* for K>0 (closed), transfer functions only defined for l<nu */
+    if ((ptw->sgnK == 1) && (ptr->l[index_l] >= (int)(ptr->q[index_q]/sqrt(ptw->K)+0.2))) {
+      neglect = _TRUE_;
+    }
+    /* This would maybe go into transfer_can_be_neglected later: */
+    if ((ptw->sgnK != 0) && (index_l>=ptw->HIS.l_size) && (index_q < ptr->index_q_flat_approximation)) {
+      neglect = _TRUE_;
+    }
+    /* multipoles not in the l list of this type */
+    if (!_transfer_l_is_sampled_(ptr,index_md,index_tt,index_l)) {
+      neglect = _TRUE_;
+    }
+    if (neglect == _TRUE_) {
 
-          /** - check if we must now deal with a new source with a
-              new index ppt->index_type. If yes, interpolate it at the
-              right values of k. */
+      _transfer_set_(ptr,index_md,
+                     _transfer_index_(ptr,index_md,index_ic,index_tt,index_l,index_q),
+                     0.);
+    }
+    else {
 
-          if (tp_of_tt[index_md][index_tt] != previous_type) {
+      /* for a given l, maximum value of k such that we can
+         convolve the source with Bessel functions j_l(x)
+         without reaching x_max (this is relevant in the flat
+         case when the bessels are computed with the old bessel
+         module. otherwise this condition is guaranteed by the
+         choice of proper xmax when computing bessels) */
+      if (ptw->sgnK == 0) {
+        q_max_bessel = ptw->pBIS->x[ptw->pBIS->x_size-1]/tau0_minus_tau[0];
+      }
+      else {
+        q_max_bessel = ptr->q[ptr->q_size-1];
+      }
 
-            class_call(transfer_interpolate_sources(ppt,
-                                                    ptr,
-                                                    index_q,
-                                                    index_md,
-                                                    index_ic,
-                                                    tp_of_tt[index_md][index_tt],
-                                                    pert_sources[index_md][index_ic * ppt->tp_size[index_md] + tp_of_tt[index_md][index_tt]],
-                                                    pert_sources_spline[index_md][index_ic * ppt->tp_size[index_md] + tp_of_tt[index_md][index_tt]],
-                                                    interpolated_sources),
-                       ptr->error_message,
-                       ptr->error_message);
-          }
+      /* neglect late time CMB sources when l is above threshold */
+      class_call(transfer_late_source_can_be_neglected(ppr,
+                                                       ppt,
+                                                       ptr,
+                                                       index_md,
+                                                       index_tt,
+                                                       l,
+                                                       &(ptw->neglect_late_source)),
+                 ptr->error_message,
+                 ptr->error_message);
 
-          previous_type = tp_of_tt[index_md][index_tt];
+      if (ptr->neglect_count_cut != NULL) {
+        if (cut == _TRUE_) {
+#pragma omp atomic
+          ptr->neglect_count_cut[index_md][index_tt]++;
+        }
+        else {
+#pragma omp atomic
+          ptr->neglect_count_computed[index_md][index_tt]++;
+        }
+        if (ptw->neglect_late_source == _TRUE_) {
+#pragma omp atomic
+          ptr->neglect_count_late[index_md][index_tt]++;
+        }
+      }
 
-          /* the code makes a distinction between "perturbation
-             sources" (e.g. gravitational potential) and "transfer
-             sources" (e.g. total density fluctuations, obtained
-             through the Poisson equation, and observed with a given
-             selection function).
+      /* compute the transfer function for this l */
+      class_call(transfer_compute_for_each_l(
+                                             ptw,
+                                             ppr,
+                                             ppt,
+                                             ptr,
+                                             index_q,
+                                             index_md,
+                                             index_ic,
+                                             index_tt,
+                                             index_l,
+                                             l,
+                                             q_max_bessel,
+                                             radial_type
+                                             ),
+                 ptr->error_message,
+                 ptr->error_message);
+    }
 
-             The next routine computes the transfer source given the
-             interpolated perturbation source, and copies it in the
-             workspace. */
+  } /* end of loop over l */
 
-          class_call(transfer_sources(ppr,
-                                      pba,
-                                      ppt,
-                                      ptr,
-                                      interpolated_sources,
-                                      tau_rec,
-                                      index_q,
-                                      index_md,
-                                      index_tt,
-                                      sources,
-                                      window,
-                                      tau_size_max,
-                                      tau0_minus_tau,
-                                      w_trapz,
-                                      tau_size),
-                     ptr->error_message,
-                     ptr->error_message);
+  return _SUCCESS_;
 
-          /* now that the array of times tau0_minus_tau is known, we can
-             infer the array of radial coordinates r(tau0_minus_tau) as well as a
-             few other quantities related by trigonometric functions */
+}
 
-          class_call(transfer_radial_coordinates(ptr,ptw,index_md,index_q),
-                     ptr->error_message,
-                     ptr->error_message);
+/**
+ * This routine computes the transfer functions of one wavenumber, one
+ * mode, one initial condition and all the local number count types
+ * (density, rsd, doppler, gr) of one bin, listed in bin_tt, in the
+ * flat case, for the multipoles index_l_min <= index_l < index_l_max.
+ * These types share the time sampling of the bin, so that the Bessel
+ * functions and their derivatives are interpolated only once for all
+ * those that are integrated exactly, by
+ * transfer_integrate_flat_bin(). The others (Limber approximation)
+ * are dealt with by transfer_compute_for_each_l(), as in
+ * transfer_compute_for_each_q_type(). The results are identical.
+ *
+ * @param ppr                 Input: pointer to precision structure
+ * @param pba                 Input: pointer to background structure
+ * @param ppt                 Input: pointer to perturbation structure
+ * @param ptr                 Input/Output: pointer to transfer structure
+ * @param tp_of_tt            Input: correspondence between perturbation and transfer source types
+ * @param index_q             Input: index of wavenumber
+ * @param index_md            Input: index of mode
+ * @param index_ic            Input: index of initial condition
+ * @param bin_size            Input: number of types of the bin
+ * @param bin_tt              Input: their indices
+ * @param index_l_min         Input: first multipole index
+ * @param index_l_max         Input: last multipole index plus one (larger values than l_size[index_md] are allowed)
+ * @param tau_size_max        Input: maximum number of times in transfer sources
+ * @param tau_rec             Input: conformal time at recombination
+ * @param pert_sources        Input: perturbation sources
+ * @param pert_sources_spline Input: their second derivatives with respect to k
+ * @param window              Input: precomputed selection functions
+ * @param ptw                 Input/Output: pointer to workspace
+ * @return the error status
+ */
 
-          /** - Select radial function type */
-          class_call(transfer_select_radial_function(
-                                                     ppt,
-                                                     ptr,
-                                                     index_md,
-                                                     index_tt,
-                                                     &radial_type),
-                     ptr->error_message,
-                     ptr->error_message);
+int transfer_compute_for_each_q_bin(
+                                    struct precision * ppr,
+                                    struct background * pba,
+                                    struct perturbations * ppt,
+                                    struct transfer * ptr,
+                                    int ** tp_of_tt,
+                                    int index_q,
+                                    int index_md,
+                                    int index_ic,
+                                    int bin_size,
+                                    int * bin_tt,
+                                    int index_l_min,
+                                    int index_l_max,
+                                    int tau_size_max,
+                                    double tau_rec,
+                                    double *** pert_sources,
+                                    double *** pert_sources_spline,
+                                    double * window,
+                                    struct transfer_workspace * ptw
+                                    ) {
 
-          for (index_l = 0; index_l < ptr->l_size[index_md]; index_l++) {
-
-            l = (double)ptr->l[index_l];
-
-            /* neglect transfer function when l is much smaller than k*tau0 */
-            class_call(transfer_can_be_neglected(ppr,
-                                                 ppt,
-                                                 ptr,
-                                                 index_md,
-                                                 index_ic,
-                                                 index_tt,
-                                                 (pba->conformal_age-tau_rec)*ptr->angular_rescaling,
-                                                 ptr->q[index_q],
-                                                 l,
-                                                 &neglect),
-                       ptr->error_message,
-                       ptr->error_message);
+  int index_type;
+  int index_tt;
+  int index_l;
+  int tau_size = 0;
+  int fused_size;
+  int fused_type[_HERMITE_CONVOLUTION_MAX_];
+  radial_function_type radial_type[_HERMITE_CONVOLUTION_MAX_];
+  radial_function_type fused_radial_type[_HERMITE_CONVOLUTION_MAX_];
+  double * fused_sources[_HERMITE_CONVOLUTION_MAX_];
+  double trsf[_HERMITE_CONVOLUTION_MAX_];
+  double * sources = ptw->sources;
+  double q_max_bessel;
+  double l;
+  short neglect;
+  short use_limber;
 
-            /* for K>0 (closed), transfer functions only defined for l<nu */
-            if ((ptw->sgnK == 1) && (ptr->l[index_l] >= (int)(ptr->q[index_q]/sqrt(ptw->K)+0.2))) {
-              neglect = _TRUE_;
-            }
-            /* This would maybe go into transfer_can_be_neglected later: */
-            if ((ptw->sgnK != 0) && (index_l>=ptw->HIS.l_size) && (index_q < ptr->index_q_flat_approximation)) {
-              neglect = _TRUE_;
-            }
-            if (neglect == _TRUE_) {
+  class_test(bin_size > _HERMITE_CONVOLUTION_MAX_,
+             ptr->error_message,
+             "%d types in one bin, increase _HERMITE_CONVOLUTION_MAX_",bin_size);
+
+  /** - beyond q_max for this mode, or for a Dirac selection function, deal with each type separately */
+  if ((ptr->k[index_md][index_q] > ppt->k[index_md][ppt->k_size_cl[index_md]-1]) || (ppt->selection == dirac)) {
+    for (index_type = 0; index_type < bin_size; index_type++) {
+      class_call(transfer_compute_for_each_q_type(ppr,
+                                                  pba,
+                                                  ppt,
+                                                  ptr,
+                                                  tp_of_tt,
+                                                  index_q,
+                                                  index_md,
+                                                  index_ic,
+                                                  bin_tt[index_type],
+                                                  index_l_min,
+                                                  index_l_max,
+                                                  tau_size_max,
+                                                  tau_rec,
+                                                  pert_sources,
+                                                  pert_sources_spline,
+                                                  window,
+                                                  ptw),
+                 ptr->error_message,
+                 ptr->error_message);
+    }
+    return _SUCCESS_;
+  }
 
-              ptr->transfer[index_md][((index_ic * ptr->tt_size[index_md] + index_tt)
-                                       * ptr->l_size[index_md] + index_l)
-                                      * ptr->q_size + index_q] = 0.;
-            }
-            else {
-
-              /* for a given l, maximum value of k such that we can
-                 convolve the source with Bessel functions j_l(x)
-                 without reaching x_max (this is relevant in the flat
-                 case when the bessels are computed with the old bessel
-                 module. otherwise this condition is guaranteed by the
-                 choice of proper xmax when computing bessels) */
-              if (ptw->sgnK == 0) {
-                q_max_bessel = ptw->pBIS->x[ptw->pBIS->x_size-1]/tau0_minus_tau[0];
-              }
-              else {
-                q_max_bessel = ptr->q[ptr->q_size-1];
-              }
+  /** - compute the transfer sources of all types, and keep a copy of each of them */
+  for (index_type = 0; index_type < bin_size; index_type++) {
 
-              /* neglect late time CMB sources when l is above threshold */
-              class_call(transfer_late_source_can_be_neglected(ppr,
-                                                               ppt,
-                                                               ptr,
-                                                               index_md,
-                                                               index_tt,
-                                                               l,
-                                                               &(ptw->neglect_late_source)),
-                         ptr->error_message,
-                         ptr->error_message);
+    index_tt = bin_tt[index_type];
 
-              /* compute the transfer function for this l */
-              class_call(transfer_compute_for_each_l(
-                                                     ptw,
-                                                     ppr,
-                                                     ppt,
-                                                     ptr,
-                                                     index_q,
-                                                     index_md,
-                                                     index_ic,
-                                                     index_tt,
-                                                     index_l,
-                                                     l,
-                                                     q_max_bessel,
-                                                     radial_type
-                                                     ),
-                         ptr->error_message,
-                         ptr->error_message);
-            }
+    class_call(transfer_workspace_sources(ppr,
+                                          pba,
+                                          ppt,
+                                          ptr,
+                                          tp_of_tt,
+                                          index_q,
+                                          index_md,
+                                          index_ic,
+                                          index_tt,
+                                          tau_size_max,
+                                          tau_rec,
+                                          pert_sources,
+                                          pert_sources_spline,
+                                          window,
+                                          ptw),
+               ptr->error_message,
+               ptr->error_message);
+
+    if (index_type == 0)
+      tau_size = ptw->tau_size;
+
+    class_test(ptw->tau_size != tau_size,
+               ptr->error_message,
+               "the types of bin %d should share the same time sampling",index_type);
+
+    memcpy(ptw->bin_sources+index_type*tau_size_max,ptw->sources,tau_size*sizeof(double));
+
+    class_call(transfer_select_radial_function(ppt,
+                                               ptr,
+                                               index_md,
+                                               index_tt,
+                                               &(radial_type[index_type])),
+               ptr->error_message,
+               ptr->error_message);
+  }
+
+  q_max_bessel = ptw->pBIS->x[ptw->pBIS->x_size-1]/ptw->tau0_minus_tau[0];
+
+  /** - loop over multipoles */
+  for (index_l = index_l_min; index_l < MIN(index_l_max,ptr->l_size[index_md]); index_l++) {
+
+    l = (double)ptr->l[index_l];
+
+    fused_size = 0;
+
+    for (index_type = 0; index_type < bin_size; index_type++) {
+
+      index_tt = bin_tt[index_type];
+
+      class_call(transfer_can_be_neglected(ppr,
+                                           ppt,
+                                           ptr,
+                                           index_md,
+                                           index_ic,
+                                           index_tt,
+                                           (pba->conformal_age-tau_rec)*ptr->angular_rescaling,
+                                           ptr->q[index_q],
+                                           l,
+                                           &neglect),
+                 ptr->error_message,
+                 ptr->error_message);
 
-          } /* end of loop over l */
+      if ((neglect == _TRUE_) || (index_l >= ptr->l_size_tt[index_md][index_tt])) {
+        _transfer_set_(ptr,index_md,
+                       _transfer_index_(ptr,index_md,index_ic,index_tt,index_l,index_q),
+                       0.);
+        continue;
+      }
 
-        } /* end of loop over type */
+      class_call(transfer_late_source_can_be_neglected(ppr,
+                                                       ppt,
+                                                       ptr,
+                                                       index_md,
+                                                       index_tt,
+                                                       l,
+                                                       &(ptw->neglect_late_source)),
+                 ptr->error_message,
+                 ptr->error_message);
 
-      } /* end of loop over initial condition */
+      class_call(transfer_use_limber(ppr,
+                                     ppt,
+                                     ptr,
+                                     q_max_bessel,
+                                     index_md,
+                                     index_tt,
+                                     ptr->q[index_q],
+                                     l,
+                                     &use_limber),
+                 ptr->error_message,
+                 ptr->error_message);
 
+      if ((use_limber == _FALSE_) && (ptw->neglect_late_source == _FALSE_) &&
+          ((radial_type[index_type] == SCALAR_TEMPERATURE_0) ||
+           (radial_type[index_type] == SCALAR_TEMPERATURE_1) ||
+           (radial_type[index_type] == NC_RSD))) {
+        fused_type[fused_size] = index_type;
+        fused_radial_type[fused_size] = radial_type[index_type];
+        fused_sources[fused_size] = ptw->bin_sources+index_type*tau_size_max;
+        fused_size++;
+      }
+      else {
+        /* the workspace sources temporarily point to the copy for this type */
+        ptw->sources = ptw->bin_sources+index_type*tau_size_max;
+        class_call(transfer_compute_for_each_l(ptw,
+                                               ppr,
+                                               ppt,
+                                               ptr,
+                                               index_q,
+                                               index_md,
+                                               index_ic,
+                                               index_tt,
+                                               index_l,
+                                               l,
+                                               q_max_bessel,
+                                               radial_type[index_type]),
+                   ptr->error_message,
+                   ptr->error_message);
+        ptw->sources = sources;
+      }
     }
 
-    else {
+    if (fused_size > 0) {
 
-      for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
-        for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
-          for (index_l = 0; index_l < ptr->l_size[index_md]; index_l++) {
+      class_call(transfer_integrate_flat_bin(ptr,
+                                             ptw,
+                                             index_l,
+                                             ptr->k[index_md][index_q],
+                                             fused_size,
+                                             fused_radial_type,
+                                             fused_sources,
+                                             trsf),
+                 ptr->error_message,
+                 ptr->error_message);
+
+      for (index_type = 0; index_type < fused_size; index_type++) {
+        _transfer_set_(ptr,index_md,
+                       _transfer_index_(ptr,index_md,index_ic,bin_tt[fused_type[index_type]],index_l,index_q),
+                       trsf[index_type]);
+      }
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine interpolates the perturbation source of a given type
+ * at one wavenumber, and computes the corresponding transfer source
+ * and radial coordinates, in the workspace. This is skipped when the
+ * workspace already contains them, as recorded by its
+ * index_*_interpolated and index_tt_sources fields.
+ *
+ * @param ppr                 Input: pointer to precision structure
+ * @param pba                 Input: pointer to background structure
+ * @param ppt                 Input: pointer to perturbation structure
+ * @param ptr                 Input: pointer to transfer structure
+ * @param tp_of_tt            Input: correspondence between perturbation and transfer source types
+ * @param index_q             Input: index of wavenumber
+ * @param index_md            Input: index of mode
+ * @param index_ic            Input: index of initial condition
+ * @param index_tt            Input: index of transfer type
+ * @param tau_size_max        Input: maximum number of times in transfer sources
+ * @param tau_rec             Input: conformal time at recombination
+ * @param pert_sources        Input: perturbation sources
+ * @param pert_sources_spline Input: their second derivatives with respect to k
+ * @param window              Input: precomputed selection functions
+ * @param ptw                 Input/Output: pointer to workspace
+ * @return the error status
+ */
+
+int transfer_workspace_sources(
+                               struct precision * ppr,
+                               struct background * pba,
+                               struct perturbations * ppt,
+                               struct transfer * ptr,
+                               int ** tp_of_tt,
+                               int index_q,
+                               int index_md,
+                               int index_ic,
+                               int index_tt,
+                               int tau_size_max,
+                               double tau_rec,
+                               double *** pert_sources,
+                               double *** pert_sources_spline,
+                               double * window,
+                               struct transfer_workspace * ptw
+                               ) {
+
+  /* perturbation source type */
+  int index_tp;
+
+  /** - we deal with workspaces, i.e. with contiguous memory zones (one
+      per thread) containing various fields used by the integration
+      routine */
+
+  /* - first workspace field: perturbation source interpolated from perturbation structure */
+  double * interpolated_sources = ptw->interpolated_sources;
+
+  /* - second workspace field: list of tau0-tau values, tau0_minus_tau[index_tau] */
+  double * tau0_minus_tau = ptw->tau0_minus_tau;
+
+  /* - third workspace field: list of trapezoidal weights for integration over tau */
+  double * w_trapz = ptw->w_trapz;
+
+  /* - fourth workspace field, containing just a double: number of time values */
+  int * tau_size = &(ptw->tau_size);
+
+  /* - fifth workspace field, identical to above interpolated sources:
+     sources[index_tau] */
+  double * sources = ptw->sources;
+
+  /** - check if we must now deal with a new source with a
+      new index ppt->index_type. If yes, interpolate it at the
+      right values of k. */
+
+  index_tp = tp_of_tt[index_md][index_tt];
+
+  if ((ptw->index_q_interpolated != index_q) ||
+      (ptw->index_md_interpolated != index_md) ||
+      (ptw->index_ic_interpolated != index_ic) ||
+      (ptw->index_tp_interpolated != index_tp)) {
+
+    class_call(transfer_interpolate_sources(ppr,
+                                            ppt,
+                                            ptr,
+                                            ptw,
+                                            index_q,
+                                            index_md,
+                                            index_ic,
+                                            index_tp,
+                                            pert_sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp],
+                                            pert_sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp],
+                                            interpolated_sources),
+               ptr->error_message,
+               ptr->error_message);
+
+    ptw->index_q_interpolated = index_q;
+    ptw->index_md_interpolated = index_md;
+    ptw->index_ic_interpolated = index_ic;
+    ptw->index_tp_interpolated = index_tp;
+    ptw->index_tt_sources = -1;
+  }
+
+  if (ptw->index_tt_sources != index_tt) {
+
+    /* the code makes a distinction between "perturbation
+       sources" (e.g. gravitational potential) and "transfer
+       sources" (e.g. total density fluctuations, obtained
+       through the Poisson equation, and observed with a given
+       selection function).
+
+       The next routine computes the transfer source given the
+       interpolated perturbation source, and copies it in the
+       workspace. */
+
+    class_call(transfer_sources(ppr,
+                                pba,
+                                ppt,
+                                ptr,
+                                interpolated_sources,
+                                tau_rec,
+                                index_q,
+                                index_md,
+                                index_tt,
+                                sources,
+                                window,
+                                ptw->psa,
+                                tau_size_max,
+                                tau0_minus_tau,
+                                w_trapz,
+                                tau_size),
+               ptr->error_message,
+               ptr->error_message);
+
+    /* now that the array of times tau0_minus_tau is known, we can
+       infer the array of radial coordinates r(tau0_minus_tau) as well as a
+       few other quantities related by trigonometric functions */
+
+    class_call(transfer_radial_coordinates(ptr,ptw,index_md,index_q),
+               ptr->error_message,
+               ptr->error_message);
+
+    ptw->index_tt_sources = index_tt;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine lists the local number count types (density, rsd,
+ * doppler, gr) of one bin, in increasing order.
+ *
+ * @param ppt      Input: pointer to perturbation structure
+ * @param ptr      Input: pointer to transfer structure
+ * @param bin      Input: bin number
+ * @param bin_size Output: number of types
+ * @param bin_tt   Output: their indices (at least _HERMITE_CONVOLUTION_MAX_ allocated)
+ * @return the error status
+ */
+
+int transfer_nc_bin_types(
+                          struct perturbations * ppt,
+                          struct transfer * ptr,
+                          int bin,
+                          int * bin_size,
+                          int * bin_tt
+                          ) {
+
+  int index_type, index_tt;
+
+  *bin_size = 0;
+
+  if (ppt->has_nc_density == _TRUE_) {
+    bin_tt[(*bin_size)++] = ptr->index_tt_density+bin;
+  }
+  if (ppt->has_nc_rsd == _TRUE_) {
+    bin_tt[(*bin_size)++] = ptr->index_tt_rsd+bin;
+    bin_tt[(*bin_size)++] = ptr->index_tt_d0+bin;
+    bin_tt[(*bin_size)++] = ptr->index_tt_d1+bin;
+  }
+  if (ppt->has_nc_gr == _TRUE_) {
+    bin_tt[(*bin_size)++] = ptr->index_tt_nc_g1+bin;
+    bin_tt[(*bin_size)++] = ptr->index_tt_nc_g2+bin;
+    bin_tt[(*bin_size)++] = ptr->index_tt_nc_g3+bin;
+  }
 
-            ptr->transfer[index_md][((index_ic * ptr->tt_size[index_md] + index_tt)
-                                     * ptr->l_size[index_md] + index_l)
-                                    * ptr->q_size + index_q] = 0.;
-          }
-        }
-      }
+  /* sort (insertion) */
+  for (index_type = 1; index_type < *bin_size; index_type++) {
+    index_tt = bin_tt[index_type];
+    while ((index_type > 0) && (bin_tt[index_type-1] > index_tt)) {
+      bin_tt[index_type] = bin_tt[index_type-1];
+      index_type--;
     }
-
-  } /* end of loop over mode */
+    bin_tt[index_type] = index_tt;
+  }
 
   return _SUCCESS_;
-
 }
 
 int transfer_radial_coordinates(
@@ -1984,21 +3386,29 @@ int transfer_radial_coordinates(
  * initial condition and type (of perturbation module), to get them at
  * the right values of k, using the spline interpolation method.
  *
+ * The position of the wavenumber in the sampling of the perturbation
+ * module and the interpolation weights are kept in the workspace, and
+ * reused for all initial conditions and types at this wavenumber.
+ *
+ * @param ppr                   Input: pointer to precision structure
  * @param ppt                   Input: pointer to perturbation structure
  * @param ptr                   Input: pointer to transfer structure
+ * @param ptw                   Input/Output: pointer to workspace (interpolation weights)
  * @param index_q               Input: index of wavenumber
  * @param index_md              Input: index of mode
  * @param index_ic              Input: index of initial condition
  * @param index_type            Input: index of type of source (in perturbation module)
  * @param pert_source           Input: array of sources
- * @param pert_source_spline    Input: array of second derivative of sources
+ * @param pert_source_spline    Input: array of second derivative of sources (if ppr->transfer_sources_k_major is set, sources and second derivatives, see transfer_perturbation_source_spline())
  * @param interpolated_sources  Output: array of interpolated sources (filled here but allocated in transfer_init() to avoid numerous reallocation)
  * @return the error status
  */
 
 int transfer_interpolate_sources(
+                                 struct precision * ppr,
                                  struct perturbations * ppt,
                                  struct transfer * ptr,
+                                 struct transfer_workspace * ptw,
                                  int index_q,
                                  int index_md,
                                  int index_ic,
@@ -2021,25 +3431,65 @@ int transfer_interpolate_sources(
   /* variables used for spline interpolation algorithm */
   double h, a, b;
 
-  /** - interpolate at each k value using the usual
-      spline interpolation algorithm. */
+  /* sources and second derivatives at index_k and index_k+1 (k-major layout) */
+  double * table_k;
+  double * table_k1;
 
-  index_k = 0;
-  h = ppt->k[index_md][index_k+1] - ppt->k[index_md][index_k];
+  /** - find the interpolation weights at this k value, unless
+      already known for the previous initial condition or type */
 
-  while (((index_k+1) < ppt->k_size[index_md]) &&
-         (ppt->k[index_md][index_k+1] <
-          ptr->k[index_md][index_q])) {
-    index_k++;
+  if ((ptw->index_q_weights != index_q) || (ptw->index_md_weights != index_md)) {
+
+    index_k = 0;
     h = ppt->k[index_md][index_k+1] - ppt->k[index_md][index_k];
+
+    while (((index_k+1) < ppt->k_size[index_md]) &&
+           (ppt->k[index_md][index_k+1] <
+            ptr->k[index_md][index_q])) {
+      index_k++;
+      h = ppt->k[index_md][index_k+1] - ppt->k[index_md][index_k];
+    }
+
+    class_test(h==0.,
+               ptr->error_message,
+               "stop to avoid division by zero");
+
+    b = (ptr->k[index_md][index_q] - ppt->k[index_md][index_k])/h;
+    a = 1.-b;
+
+    ptw->index_q_weights = index_q;
+    ptw->index_md_weights = index_md;
+    ptw->index_k_weights = index_k;
+    ptw->a_weights = a;
+    ptw->b_weights = b;
+    ptw->h_weights = h;
   }
 
-  class_test(h==0.,
-             ptr->error_message,
-             "stop to avoid division by zero");
+  index_k = ptw->index_k_weights;
+  a = ptw->a_weights;
+  b = ptw->b_weights;
+  h = ptw->h_weights;
+
+  /** - interpolate at each time using the usual spline
+      interpolation algorithm. */
+
+  if (ppr->transfer_sources_k_major == _TRUE_) {
+
+    table_k = pert_source_spline+2*index_k*ppt->tau_size;
+    table_k1 = table_k+2*ppt->tau_size;
+
+    for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
 
-  b = (ptr->k[index_md][index_q] - ppt->k[index_md][index_k])/h;
-  a = 1.-b;
+      interpolated_sources[index_tau] =
+        a * table_k[2*index_tau]
+        + b * table_k1[2*index_tau]
+        + ((a*a*a-a) * table_k[2*index_tau+1]
+           +(b*b*b-b) * table_k1[2*index_tau+1])*h*h/6.0;
+
+    }
+
+    return _SUCCESS_;
+  }
 
   for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
 
@@ -2075,6 +3525,7 @@ int transfer_interpolate_sources(
  * @param index_tt              Input: index of type of (transfer) source
  * @param sources               Output: transfer source
  * @param window                Input: window functions for each type and time
+ * @param psa                   Input: time sampling of the number count and lensing sources
  * @param tau_size_max          Input: number of times at wich window fucntions are sampled
  * @param tau0_minus_tau        Output: values of (tau0-tau) at which source are sample
  * @param w_trapz               Output: trapezoidal weights for integration over tau
@@ -2094,6 +3545,7 @@ int transfer_sources(
                      int index_tt,
                      double * sources,
                      double * window,
+                     struct transfer_sampling * psa,
                      int tau_size_max,
                      double * tau0_minus_tau,
                      double * w_trapz,
@@ -2107,9 +3559,6 @@ int transfer_sources(
   /* index running on time */
   int index_tau;
 
-  /* bin for computation of cl_density */
-  int bin=0;
-
   /* number of tau values */
   int tau_size;
 
@@ -2236,46 +3685,19 @@ int transfer_sources(
 
       if (_nonintegrated_ncl_) {
 
-        _get_bin_nonintegrated_ncl_(index_tt)
-
-        /* redefine the time sampling */
-        class_call(transfer_selection_sampling(ppr,
-                                               pba,
-                                               ppt,
-                                               ptr,
-                                               bin,
-                                               tau0_minus_tau,
-                                               tau_size),
-                   ptr->error_message,
-                   ptr->error_message);
-
-        class_test(tau0 - tau0_minus_tau[0] > ppt->tau_sampling[ppt->tau_size-1],
-                   ptr->error_message,
-                   "this should not happen, there was probably a rounding error, if this error occurred, then this must be coded more carefully");
+        /* time sampling and trapezoidal weights for the selection
+           function, precomputed in transfer_precompute_selection() */
+        memcpy(tau0_minus_tau,psa->tau0_minus_tau+index_tt*psa->tau_size_max,tau_size*sizeof(double));
+        memcpy(w_trapz,psa->w_trapz+index_tt*psa->tau_size_max,tau_size*sizeof(double));
 
         /* resample the source at those times */
-        class_call(transfer_source_resample(ppr,
-                                            pba,
-                                            ppt,
-                                            ptr,
-                                            bin,
-                                            tau0_minus_tau,
-                                            tau_size,
-                                            index_md,
-                                            tau0,
+        class_call(transfer_source_resample(psa,
+                                            index_tt,
                                             interpolated_sources,
                                             sources),
                    ptr->error_message,
                    ptr->error_message);
 
-        /* Compute trapezoidal weights for integration over tau */
-        class_call(array_trapezoidal_mweights(tau0_minus_tau,
-                                              tau_size,
-                                              w_trapz,
-                                              ptr->error_message),
-                   ptr->error_message,
-                   ptr->error_message);
-
         /* loop over time and rescale */
         for (index_tau = 0; index_tau < tau_size; index_tau++) {
 
@@ -2306,43 +3728,19 @@ int transfer_sources(
 
       if (_integrated_ncl_) {
 
-        _get_bin_integrated_ncl_(index_tt)
-
-        /* redefine the time sampling */
-        class_call(transfer_lensing_sampling(ppr,
-                                             pba,
-                                             ppt,
-                                             ptr,
-                                             bin,
-                                             tau0,
-                                             tau0_minus_tau,
-                                             tau_size),
-                   ptr->error_message,
-                   ptr->error_message);
+        /* time sampling and trapezoidal weights from the selection
+           function up to tau0, precomputed in transfer_precompute_selection() */
+        memcpy(tau0_minus_tau,psa->tau0_minus_tau+index_tt*psa->tau_size_max,tau_size*sizeof(double));
+        memcpy(w_trapz,psa->w_trapz+index_tt*psa->tau_size_max,tau_size*sizeof(double));
 
         /* resample the source at those times */
-        class_call(transfer_source_resample(ppr,
-                                            pba,
-                                            ppt,
-                                            ptr,
-                                            bin,
-                                            tau0_minus_tau,
-                                            tau_size,
-                                            index_md,
-                                            tau0,
+        class_call(transfer_source_resample(psa,
+                                            index_tt,
                                             interpolated_sources,
                                             sources),
                    ptr->error_message,
                    ptr->error_message);
 
-        /* Compute trapezoidal weights for integration over tau */
-        class_call(array_trapezoidal_mweights(tau0_minus_tau,
-                                              tau_size,
-                                              w_trapz,
-                                              ptr->error_message),
-                   ptr->error_message,
-                   ptr->error_message);
-
         /* loop over time and rescale */
         for (index_tau = 0; index_tau < tau_size; index_tau++) {
 
@@ -2710,70 +4108,35 @@ int transfer_lensing_sampling(
 
 /**
  * For sources that need to be multiplied by a selection function,
- * redefine a finer time sampling in a small range, and resample the
- * perturbation sources at the new value by linear interpolation
+ * resample the perturbation sources at the finer time sampling
+ * defined in transfer_precompute_selection(), by linear interpolation
+ * (with the indices and weights stored there)
  *
- * @param ppr                   Input: pointer to precision structure
- * @param pba                   Input: pointer to background structure
- * @param ppt                   Input: pointer to perturbation structure
- * @param ptr                   Input: pointer to transfer structure
- * @param bin                   Input: redshift bin number
- * @param tau0_minus_tau        Output: values of (tau0-tau) at which source are sample
- * @param tau_size              Output: pointer to size of previous array
- * @param index_md              Input: index of mode
- * @param tau0                  Input: time today
+ * @param psa                   Input: time sampling of the number count and lensing sources
+ * @param index_tt              Input: index of type of (transfer) source
  * @param interpolated_sources  Input: interpolated perturbation source
  * @param sources               Output: resampled transfer source
  * @return the error status
  */
 
 int transfer_source_resample(
-                             struct precision * ppr,
-                             struct background * pba,
-                             struct perturbations * ppt,
-                             struct transfer * ptr,
-                             int bin,
-                             double * tau0_minus_tau,
-                             int tau_size,
-                             int index_md,
-                             double tau0,
+                             struct transfer_sampling * psa,
+                             int index_tt,
                              double * interpolated_sources,
                              double * sources) {
 
   /* running index on time */
   int index_tau;
 
-  /* array of values of source */
-  double * source_at_tau;
-
-  /* array of source values for a given time and for all k's */
-  class_alloc(source_at_tau,
-              sizeof(double),
-              ptr->error_message);
+  int * index_resample = psa->index_resample+index_tt*psa->tau_size_max;
+  double * weight_resample = psa->weight_resample+index_tt*psa->tau_size_max;
 
   /* interpolate the sources linearly at the new time values */
-  for (index_tau=0; index_tau<tau_size; index_tau++) {
-
-    class_call(array_interpolate_two(ppt->tau_sampling,
-                                     1,
-                                     0,
-                                     interpolated_sources,
-                                     1,
-                                     ppt->tau_size,
-                                     tau0-tau0_minus_tau[index_tau],
-                                     source_at_tau,
-                                     1,
-                                     ptr->error_message),
-               ptr->error_message,
-               ptr->error_message);
-
-    /* copy the new values in the output sources array */
-    sources[index_tau] = source_at_tau[0];
+  for (index_tau=0; index_tau<psa->tau_size[index_tt]; index_tau++) {
+    sources[index_tau] = interpolated_sources[index_resample[index_tau]] * (1.-weight_resample[index_tau])
+      + weight_resample[index_tau] * interpolated_sources[index_resample[index_tau]+1];
   }
 
-  /* deallocate the temporary array */
-  free(source_at_tau);
-
   return _SUCCESS_;
 
 }
@@ -2890,38 +4253,47 @@ int transfer_selection_compute(
   /* running index over time */
   int index_tau;
 
-  /* running value of time */
-  double tau;
-
   /* used for normalizing the selection to one */
   double norm;
 
-  /* used for calling background_at_tau() */
-  int last_index;
+  /* used for calling background_at_tau_vec(): interval hint, times,
+     and values of (a,H) at each time */
+  int last_index = 0;
+  double * tau_vec;
+  double * aH_vec;
+  int bg_columns[2];
 
   /* running value of redshift */
   double z;
 
   if (tau_size > 1) {
 
+    /* get background quantities at all times at once */
+    class_alloc(tau_vec,tau_size*sizeof(double),ptr->error_message);
+    class_alloc(aH_vec,2*tau_size*sizeof(double),ptr->error_message);
+
+    /* tau0_minus_tau is decreasing, so that tau_vec is growing */
+    for (index_tau = 0; index_tau < tau_size; index_tau++)
+      tau_vec[index_tau] = tau0 - tau0_minus_tau[index_tau];
+
+    bg_columns[0] = pba->index_bg_a;
+    bg_columns[1] = pba->index_bg_H;
+
+    class_call(background_at_tau_vec(pba,
+                                     tau_vec,
+                                     tau_size,
+                                     bg_columns,
+                                     2,
+                                     &last_index,
+                                     aH_vec),
+               pba->error_message,
+               ptr->error_message);
+
     /* loop over time */
     for (index_tau = 0; index_tau < tau_size; index_tau++) {
 
-      /* running value of time */
-      tau = tau0 - tau0_minus_tau[index_tau];
-
-      /* get background quantities at this time */
-      class_call(background_at_tau(pba,
-                                   tau,
-                                   long_info,
-                                   inter_normal,
-                                   &last_index,
-                                   pvecback),
-                 pba->error_message,
-                 ptr->error_message);
-
       /* infer redshift (remember that a in the code is in fact a/a_0) */
-      z = 1./pvecback[pba->index_bg_a]-1.;
+      z = 1./aH_vec[2*index_tau]-1.;
 
       /* get corresponding dN/dz(z,bin) */
       class_call(transfer_selection_function(ppr,
@@ -2934,10 +4306,13 @@ int transfer_selection_compute(
                  ptr->error_message);
 
       /* get corresponding dN/dtau = dN/dz * dz/dtau = dN/dz * H */
-      selection[index_tau] *= pvecback[pba->index_bg_H];
+      selection[index_tau] *= aH_vec[2*index_tau+1];
 
     }
 
+    free(tau_vec);
+    free(aH_vec);
+
     /* compute norm = \int W(tau) dtau */
     class_call(array_trapezoidal_integral(selection,
                                           tau_size,
@@ -3025,9 +4400,9 @@ int transfer_compute_for_each_l(
   /** - return zero transfer function if l is above l_max */
   if (index_l >= ptr->l_size_tt[index_md][index_tt]) {
 
-    ptr->transfer[index_md][((index_ic * ptr->tt_size[index_md] + index_tt)
-                             * ptr->l_size[index_md] + index_l)
-                            * ptr->q_size + index_q] = 0.;
+    _transfer_set_(ptr,index_md,
+                   _transfer_index_(ptr,index_md,index_ic,index_tt,index_l,index_q),
+                   0.);
     return _SUCCESS_;
   }
 
@@ -3064,6 +4439,7 @@ int transfer_compute_for_each_l(
 
   }
   else {
+    class_counters_begin(counter_transfer_integrate);
     class_call(transfer_integrate(
                                   ppt,
                                   ptr,
@@ -3079,13 +4455,13 @@ int transfer_compute_for_each_l(
                                   ),
                ptr->error_message,
                ptr->error_message);
+    class_counters_end(counter_transfer_integrate);
   }
 
   /** - store transfer function in transfer structure */
-  ptr->transfer[index_md][((index_ic * ptr->tt_size[index_md] + index_tt)
-                           * ptr->l_size[index_md] + index_l)
-                          * ptr->q_size + index_q]
-    = transfer_function;
+  _transfer_set_(ptr,index_md,
+                 _transfer_index_(ptr,index_md,index_ic,index_tt,index_l,index_q),
+                 transfer_function);
 
   return _SUCCESS_;
 
@@ -3264,81 +4640,423 @@ int transfer_integrate(
                ptr->error_message,
                ptr->error_message);
 
-    *trsf = sources[0] * bessel;
+    *trsf = sources[0] * bessel;
+    return _SUCCESS_;
+  }
+
+  /** - --> other cases */
+
+  /** - ---> (a) find index in the source's tau list corresponding to the last point in the overlapping region. After this step, index_tau_max can be as small as zero, but not negative. */
+  index_tau_max = ptw->tau_size-1;
+  while (tau0_minus_tau[index_tau_max] < tau0_minus_tau_min_bessel)
+    index_tau_max--;
+  /* Set index so we know if the truncation of the convolution integral is due to Bessel and not
+     due to the source. */
+  index_tau_max_Bessel = index_tau_max;
+
+  /** - ---> (b) the source function can vanish at large \f$ \tau \f$. Check if further points can be eliminated. After this step and if we did not return a null transfer function, index_tau_max can be as small as zero, but not negative. */
+  while (sources[index_tau_max] == 0.) {
+    index_tau_max--;
+    if (index_tau_max < 0) {
+      *trsf = 0.;
+      return _SUCCESS_;
+    }
+  }
+
+  if (ptw->neglect_late_source == _TRUE_) {
+
+    while (tau0_minus_tau[index_tau_max] < ptw->tau0_minus_tau_cut) {
+      index_tau_max--;
+      if (index_tau_max < 0) {
+        *trsf = 0.;
+        return _SUCCESS_;
+      }
+    }
+  }
+
+  /** - In flat space, scalar radial functions are combinations of Phi, dPhi and d2Phi with constant coefficients: compute the convolution integral in one vectorized pass */
+  if ((ptw->sgnK == 0) &&
+      ((radial_type == SCALAR_TEMPERATURE_0) ||
+       (radial_type == SCALAR_TEMPERATURE_1) ||
+       (radial_type == SCALAR_TEMPERATURE_2) ||
+       (radial_type == SCALAR_POLARISATION_E) ||
+       (radial_type == NC_RSD))) {
+    class_call(transfer_integrate_flat(ptr,
+                                       ptw,
+                                       index_l,
+                                       radial_type,
+                                       index_tau_max,
+                                       index_tau_max_Bessel,
+                                       tau0_minus_tau_min_bessel,
+                                       trsf),
+               ptr->error_message,
+               ptr->error_message);
+    return _SUCCESS_;
+  }
+
+  /** - Compute the radial function: */
+  class_alloc(radial_function,sizeof(double)*(index_tau_max+1),ptr->error_message);
+
+  class_call(transfer_radial_function(
+                                      ptw,
+                                      ppt,
+                                      ptr,
+                                      k,
+                                      index_q,
+                                      index_l,
+                                      index_tau_max+1,
+                                      radial_function,
+                                      radial_type
+                                      ),
+             ptr->error_message,
+             ptr->error_message);
+
+  /** - Now we do most of the convolution integral: */
+  class_call(array_trapezoidal_convolution(sources,
+                                           radial_function,
+                                           index_tau_max+1,
+                                           w_trapz,
+                                           trsf,
+                                           ptr->error_message),
+             ptr->error_message,
+             ptr->error_message);
+
+  /** - This integral is correct for the case where no truncation has
+      occurred. If it has been truncated at some index_tau_max because
+      f[index_tau_max+1]==0, it is still correct. The 'mistake' in using
+      the wrong weight w_trapz[index_tau_max] is exactly compensated by the
+      triangle we miss. However, for the Bessel cut off, we must subtract the
+      wrong triangle and add the correct triangle. */
+  if ((index_tau_max!=(ptw->tau_size-1))&&(index_tau_max==index_tau_max_Bessel)){
+    //Bessel truncation
+    *trsf -= 0.5*(tau0_minus_tau[index_tau_max+1]-tau0_minus_tau_min_bessel)*
+      radial_function[index_tau_max]*sources[index_tau_max];
+  }
+
+
+  free(radial_function);
+  return _SUCCESS_;
+}
+
+/**
+ * Convolution integral of transfer_integrate() in flat space for the
+ * scalar radial functions, which are then combinations of Phi, dPhi
+ * and d2Phi with constant coefficients. The source and the trapezoidal
+ * weights are folded into one weight per point, and the weighted sums
+ * of the interpolated Bessel functions are computed by the vectorized
+ * kernel hyperspherical_Hermite4_convolution(), instead of tabulating
+ * the radial function first.
+ *
+ * @param ptr                       Input: pointer to transfer structure
+ * @param ptw                       Input: pointer to transfer_workspace structure
+ * @param index_l                   Input: index of multipole
+ * @param radial_type               Input: type of radial (Bessel) functions to convolve with
+ * @param index_tau_max             Input: index of the last point of the integral
+ * @param index_tau_max_Bessel      Input: index of the last point at which Bessel functions are non-zero
+ * @param tau0_minus_tau_min_bessel Input: minimum value of (tau0-tau) at which Bessel functions are non-zero
+ * @param trsf                      Output: transfer function \f$ \Delta_l(k) \f$
+ * @return the error status
+ */
+
+int transfer_integrate_flat(
+                            struct transfer * ptr,
+                            struct transfer_workspace * ptw,
+                            int index_l,
+                            radial_function_type radial_type,
+                            int index_tau_max,
+                            int index_tau_max_Bessel,
+                            double tau0_minus_tau_min_bessel,
+                            double * trsf
+                            ) {
+
+  double * tau0_minus_tau = ptw->tau0_minus_tau;
+  double * w_trapz = ptw->w_trapz;
+  double * sources = ptw->sources;
+  double * chi = ptw->chi;
+  double * cscKgen = ptw->cscKgen;
+  double * weights = ptw->weights;
+  double l = (double)ptr->l[index_l];
+  double c_Phi = 0., c_dPhi = 0., c_d2Phi = 0.;
+  double sum_Phi = 0., sum_dPhi = 0., sum_d2Phi = 0.;
+  double weight_last;
+  double radial_last;
+  short csc2 = _FALSE_;
+  int index_tau;
+
+  /** - coefficients of Phi, dPhi and d2Phi in the radial function (see transfer_radial_function() with K=0) */
+  switch (radial_type){
+  case SCALAR_TEMPERATURE_0:
+    c_Phi = 1.;
+    break;
+  case SCALAR_TEMPERATURE_1:
+    c_dPhi = 1.;
+    break;
+  case SCALAR_TEMPERATURE_2:
+    c_Phi = 0.5;
+    c_d2Phi = 1.5;
+    break;
+  case SCALAR_POLARISATION_E:
+    c_Phi = sqrt(3.0/8.0*(l+2.0)*(l+1.0)*l*(l-1.0));
+    csc2 = _TRUE_;
+    break;
+  case NC_RSD:
+    c_d2Phi = 1.;
+    break;
+  default:
+    class_stop(ptr->error_message,
+               "radial type %d is not handled by transfer_integrate_flat()",radial_type);
+  }
+
+  class_test(ptw->pBIS->x[ptw->pBIS->x_size-1] < chi[0],
+             ptr->error_message,
+             "Bessels need to be interpolated at %e, outside the range in which they have been computed (<%e). Increase their x_max.",
+             chi[0],
+             ptw->pBIS->x[ptw->pBIS->x_size-1]
+             );
+
+  /** - fold the source and the trapezoidal weights (and for E-polarisation the factor csc^2) into one weight */
+  if (csc2 == _TRUE_) {
+    for (index_tau=0; index_tau<=index_tau_max; index_tau++)
+      weights[index_tau] = sources[index_tau]*w_trapz[index_tau]*cscKgen[index_tau]*cscKgen[index_tau];
+  }
+  else {
+    for (index_tau=0; index_tau<=index_tau_max; index_tau++)
+      weights[index_tau] = sources[index_tau]*w_trapz[index_tau];
+  }
+
+  class_call(hyperspherical_Hermite4_convolution(ptw->pBIS,
+                                                 index_tau_max+1,
+                                                 index_l,
+                                                 chi,
+                                                 weights,
+                                                 (c_Phi != 0. ? &sum_Phi : NULL),
+                                                 (c_dPhi != 0. ? &sum_dPhi : NULL),
+                                                 (c_d2Phi != 0. ? &sum_d2Phi : NULL),
+                                                 ptr->error_message),
+             ptr->error_message,
+             ptr->error_message);
+
+  *trsf = c_Phi*sum_Phi+c_dPhi*sum_dPhi+c_d2Phi*sum_d2Phi;
+
+  /** - correct for the Bessel truncation as in transfer_integrate(), with the radial function evaluated at the last point */
+  if ((index_tau_max!=(ptw->tau_size-1))&&(index_tau_max==index_tau_max_Bessel)){
+    weight_last = (csc2 == _TRUE_ ? cscKgen[index_tau_max]*cscKgen[index_tau_max] : 1.);
+    class_call(hyperspherical_Hermite4_convolution(ptw->pBIS,
+                                                   1,
+                                                   index_l,
+                                                   chi+index_tau_max,
+                                                   &weight_last,
+                                                   (c_Phi != 0. ? &sum_Phi : NULL),
+                                                   (c_dPhi != 0. ? &sum_dPhi : NULL),
+                                                   (c_d2Phi != 0. ? &sum_d2Phi : NULL),
+                                                   ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
+    radial_last = c_Phi*sum_Phi+c_dPhi*sum_dPhi+c_d2Phi*sum_d2Phi;
+    *trsf -= 0.5*(tau0_minus_tau[index_tau_max+1]-tau0_minus_tau_min_bessel)*
+      radial_last*sources[index_tau_max];
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Convolution integrals of transfer_integrate_flat() for several
+ * sources sharing the same time sampling, as the local number count
+ * types of one bin in transfer_compute_for_each_q_bin(). The radial
+ * functions must be Phi (SCALAR_TEMPERATURE_0), dPhi
+ * (SCALAR_TEMPERATURE_1) or d2Phi (NC_RSD): the Bessel functions and
+ * their derivatives are then interpolated only once for all sources
+ * by hyperspherical_Hermite4_convolution_multi(). Each result is
+ * identical to the one of transfer_integrate().
+ *
+ * @param ptr         Input: pointer to transfer structure
+ * @param ptw         Input: pointer to transfer_workspace structure
+ * @param index_l     Input: index of multipole
+ * @param k           Input: wavenumber
+ * @param bin_size    Input: number of sources
+ * @param radial_type Input: type of radial function of each source
+ * @param sources     Input: sources[index_type][index_tau]
+ * @param trsf        Output: transfer function \f$ \Delta_l(k) \f$ of each source
+ * @return the error status
+ */
+
+int transfer_integrate_flat_bin(
+                                struct transfer * ptr,
+                                struct transfer_workspace * ptw,
+                                int index_l,
+                                double k,
+                                int bin_size,
+                                radial_function_type * radial_type,
+                                double ** sources,
+                                double * trsf
+                                ) {
+
+  double * tau0_minus_tau = ptw->tau0_minus_tau;
+  double * w_trapz = ptw->w_trapz;
+  double * chi = ptw->chi;
+  double tau0_minus_tau_min_bessel;
+  int index_tau_max[_HERMITE_CONVOLUTION_MAX_];
+  int index_tau_max_Bessel;
+  int nxi = 0;
+  int index_type, index_tau;
+  int n_Phi = 0, n_dPhi = 0, n_d2Phi = 0;
+  int n_last_Phi = 0, n_last_dPhi = 0, n_last_d2Phi = 0;
+  int index_sum[_HERMITE_CONVOLUTION_MAX_];
+  int index_sum_last[_HERMITE_CONVOLUTION_MAX_];
+  double * weight_Phi[_HERMITE_CONVOLUTION_MAX_];
+  double * weight_dPhi[_HERMITE_CONVOLUTION_MAX_];
+  double * weight_d2Phi[_HERMITE_CONVOLUTION_MAX_];
+  double sum_Phi[_HERMITE_CONVOLUTION_MAX_];
+  double sum_dPhi[_HERMITE_CONVOLUTION_MAX_];
+  double sum_d2Phi[_HERMITE_CONVOLUTION_MAX_];
+  double * weight_last[_HERMITE_CONVOLUTION_MAX_];
+  double one = 1.;
+  double * weights;
+
+  for (index_type = 0; index_type < bin_size; index_type++) {
+    trsf[index_type] = 0.;
+    weight_last[index_type] = &one;
+  }
+
+  /** - find minimum value of (tau0-tau) at which \f$ j_l(k[\tau_0-\tau]) \f$ is known, and return zero if there is no overlap with the sources */
+  tau0_minus_tau_min_bessel = ptw->pBIS->chi_at_phimin[index_l]/k;
+
+  if (tau0_minus_tau_min_bessel >= tau0_minus_tau[0])
     return _SUCCESS_;
+
+  /** - find the last point of each integral, as in transfer_integrate() */
+  index_tau_max_Bessel = ptw->tau_size-1;
+  while (tau0_minus_tau[index_tau_max_Bessel] < tau0_minus_tau_min_bessel)
+    index_tau_max_Bessel--;
+
+  for (index_type = 0; index_type < bin_size; index_type++) {
+    index_tau_max[index_type] = index_tau_max_Bessel;
+    while ((index_tau_max[index_type] >= 0) && (sources[index_type][index_tau_max[index_type]] == 0.))
+      index_tau_max[index_type]--;
+    nxi = MAX(nxi,index_tau_max[index_type]+1);
   }
 
-  /** - --> other cases */
+  if (nxi == 0)
+    return _SUCCESS_;
 
-  /** - ---> (a) find index in the source's tau list corresponding to the last point in the overlapping region. After this step, index_tau_max can be as small as zero, but not negative. */
-  index_tau_max = ptw->tau_size-1;
-  while (tau0_minus_tau[index_tau_max] < tau0_minus_tau_min_bessel)
-    index_tau_max--;
-  /* Set index so we know if the truncation of the convolution integral is due to Bessel and not
-     due to the source. */
-  index_tau_max_Bessel = index_tau_max;
+  class_test(ptw->pBIS->x[ptw->pBIS->x_size-1] < chi[0],
+             ptr->error_message,
+             "Bessels need to be interpolated at %e, outside the range in which they have been computed (<%e). Increase their x_max.",
+             chi[0],
+             ptw->pBIS->x[ptw->pBIS->x_size-1]
+             );
 
-  /** - ---> (b) the source function can vanish at large \f$ \tau \f$. Check if further points can be eliminated. After this step and if we did not return a null transfer function, index_tau_max can be as small as zero, but not negative. */
-  while (sources[index_tau_max] == 0.) {
-    index_tau_max--;
-    if (index_tau_max < 0) {
-      *trsf = 0.;
-      return _SUCCESS_;
+  /** - fold each source and the trapezoidal weights into one weight, vanishing beyond the last point of its integral */
+  for (index_type = 0; index_type < bin_size; index_type++) {
+
+    weights = ptw->bin_weights+index_type*ptw->tau_size_max;
+
+    for (index_tau=0; index_tau<=index_tau_max[index_type]; index_tau++)
+      weights[index_tau] = sources[index_type][index_tau]*w_trapz[index_tau];
+    for (; index_tau<nxi; index_tau++)
+      weights[index_tau] = 0.;
+
+    switch (radial_type[index_type]){
+    case SCALAR_TEMPERATURE_0:
+      index_sum[index_type] = n_Phi;
+      weight_Phi[n_Phi++] = weights;
+      break;
+    case SCALAR_TEMPERATURE_1:
+      index_sum[index_type] = n_dPhi;
+      weight_dPhi[n_dPhi++] = weights;
+      break;
+    case NC_RSD:
+      index_sum[index_type] = n_d2Phi;
+      weight_d2Phi[n_d2Phi++] = weights;
+      break;
+    default:
+      class_stop(ptr->error_message,
+                 "radial type %d is not handled by transfer_integrate_flat_bin()",radial_type[index_type]);
     }
   }
 
-  if (ptw->neglect_late_source == _TRUE_) {
+  class_call(hyperspherical_Hermite4_convolution_multi(ptw->pBIS,
+                                                       nxi,
+                                                       index_l,
+                                                       chi,
+                                                       n_Phi,
+                                                       weight_Phi,
+                                                       sum_Phi,
+                                                       n_dPhi,
+                                                       weight_dPhi,
+                                                       sum_dPhi,
+                                                       n_d2Phi,
+                                                       weight_d2Phi,
+                                                       sum_d2Phi,
+                                                       ptr->error_message),
+             ptr->error_message,
+             ptr->error_message);
 
-    while (tau0_minus_tau[index_tau_max] < ptw->tau0_minus_tau_cut) {
-      index_tau_max--;
-      if (index_tau_max < 0) {
-        *trsf = 0.;
-        return _SUCCESS_;
-      }
+  for (index_type = 0; index_type < bin_size; index_type++) {
+    if (index_tau_max[index_type] < 0)
+      continue;
+    switch (radial_type[index_type]){
+    case SCALAR_TEMPERATURE_0:
+      trsf[index_type] = sum_Phi[index_sum[index_type]];
+      break;
+    case SCALAR_TEMPERATURE_1:
+      trsf[index_type] = sum_dPhi[index_sum[index_type]];
+      break;
+    default:
+      trsf[index_type] = sum_d2Phi[index_sum[index_type]];
     }
   }
 
-  /** - Compute the radial function: */
-  class_alloc(radial_function,sizeof(double)*(index_tau_max+1),ptr->error_message);
+  /** - correct for the Bessel truncation as in transfer_integrate(), for the integrals truncated at index_tau_max_Bessel */
+  if (index_tau_max_Bessel == ptw->tau_size-1)
+    return _SUCCESS_;
 
-  class_call(transfer_radial_function(
-                                      ptw,
-                                      ppt,
-                                      ptr,
-                                      k,
-                                      index_q,
-                                      index_l,
-                                      index_tau_max+1,
-                                      radial_function,
-                                      radial_type
-                                      ),
-             ptr->error_message,
-             ptr->error_message);
+  for (index_type = 0; index_type < bin_size; index_type++) {
+    index_sum_last[index_type] = -1;
+    if (index_tau_max[index_type] != index_tau_max_Bessel)
+      continue;
+    switch (radial_type[index_type]){
+    case SCALAR_TEMPERATURE_0:
+      index_sum_last[index_type] = n_last_Phi++;
+      break;
+    case SCALAR_TEMPERATURE_1:
+      index_sum_last[index_type] = n_last_dPhi++;
+      break;
+    default:
+      index_sum_last[index_type] = n_last_d2Phi++;
+    }
+  }
 
-  /** - Now we do most of the convolution integral: */
-  class_call(array_trapezoidal_convolution(sources,
-                                           radial_function,
-                                           index_tau_max+1,
-                                           w_trapz,
-                                           trsf,
-                                           ptr->error_message),
+  if (n_last_Phi+n_last_dPhi+n_last_d2Phi == 0)
+    return _SUCCESS_;
+
+  class_call(hyperspherical_Hermite4_convolution_multi(ptw->pBIS,
+                                                       1,
+                                                       index_l,
+                                                       chi+index_tau_max_Bessel,
+                                                       n_last_Phi,
+                                                       weight_last,
+                                                       sum_Phi,
+                                                       n_last_dPhi,
+                                                       weight_last,
+                                                       sum_dPhi,
+                                                       n_last_d2Phi,
+                                                       weight_last,
+                                                       sum_d2Phi,
+                                                       ptr->error_message),
              ptr->error_message,
              ptr->error_message);
 
-  /** - This integral is correct for the case where no truncation has
-      occurred. If it has been truncated at some index_tau_max because
-      f[index_tau_max+1]==0, it is still correct. The 'mistake' in using
-      the wrong weight w_trapz[index_tau_max] is exactly compensated by the
-      triangle we miss. However, for the Bessel cut off, we must subtract the
-      wrong triangle and add the correct triangle. */
-  if ((index_tau_max!=(ptw->tau_size-1))&&(index_tau_max==index_tau_max_Bessel)){
-    //Bessel truncation
-    *trsf -= 0.5*(tau0_minus_tau[index_tau_max+1]-tau0_minus_tau_min_bessel)*
-      radial_function[index_tau_max]*sources[index_tau_max];
+  for (index_type = 0; index_type < bin_size; index_type++) {
+    if (index_sum_last[index_type] < 0)
+      continue;
+    trsf[index_type] -= 0.5*(tau0_minus_tau[index_tau_max_Bessel+1]-tau0_minus_tau_min_bessel)*
+      (radial_type[index_type] == SCALAR_TEMPERATURE_0 ? sum_Phi[index_sum_last[index_type]] :
+       (radial_type[index_type] == SCALAR_TEMPERATURE_1 ? sum_dPhi[index_sum_last[index_type]] :
+        sum_d2Phi[index_sum_last[index_type]]))*sources[index_type][index_tau_max_Bessel];
   }
 
-
-  free(radial_function);
   return _SUCCESS_;
 }
 
@@ -3411,6 +5129,7 @@ int transfer_limber(
                                            ptw->sources,
                                            ptw->tau_size,
                                            tau0_minus_tau_limber,
+                                           &(ptw->index_tau_limber[0]),
                                            &S),
                ptr->error_message,
                ptr->error_message);
@@ -3445,6 +5164,7 @@ int transfer_limber(
                                            ptw->sources,
                                            ptw->tau_size,
                                            (l+1.5)/q,
+                                           &(ptw->index_tau_limber[0]),
                                            &Sp),
                ptr->error_message,
                ptr->error_message);
@@ -3454,6 +5174,7 @@ int transfer_limber(
                                            ptw->sources,
                                            ptw->tau_size,
                                            (l-0.5)/q,
+                                           &(ptw->index_tau_limber[1]),
                                            &Sm),
                ptr->error_message,
                ptr->error_message);
@@ -3477,6 +5198,7 @@ int transfer_limber(
                                            ptw->sources,
                                            ptw->tau_size,
                                            (l+2.5)/q,
+                                           &(ptw->index_tau_limber[0]),
                                            &Sp),
                ptr->error_message,
                ptr->error_message);
@@ -3486,6 +5208,7 @@ int transfer_limber(
                                            ptw->sources,
                                            ptw->tau_size,
                                            (l-1.5)/q,
+                                           &(ptw->index_tau_limber[1]),
                                            &Sm),
                ptr->error_message,
                ptr->error_message);
@@ -3495,6 +5218,7 @@ int transfer_limber(
                                            ptw->sources,
                                            ptw->tau_size,
                                            (l+0.5)/q,
+                                           &(ptw->index_tau_limber[2]),
                                            &S),
                ptr->error_message,
                ptr->error_message);
@@ -3518,25 +5242,53 @@ int transfer_limber(
 
 }
 
+/**
+ * This routine interpolates (tau0-tau)*S at one value of (tau0-tau),
+ * with a parabola through the three nearest points, for
+ * transfer_limber().
+ *
+ * The bracketing index is searched starting from index_tau_guess,
+ * which receives the result. Successive multipoles need nearby times,
+ * so that transfer_limber() keeps one guess per evaluation time in
+ * the workspace: the Limber transfer functions of all multipoles of a
+ * given type and wavenumber are then found in a single pass over the
+ * sources, instead of one search from the first time for each of them.
+ * The index found does not depend on the guess.
+ *
+ * @param ptr                   Input: pointer to transfer structure
+ * @param tau0_minus_tau        Input: array of values of (tau0-tau), decreasing
+ * @param sources               Input: source functions
+ * @param tau_size              Input: size of the two arrays above
+ * @param tau0_minus_tau_limber Input: value of (tau0-tau) at which S is needed
+ * @param index_tau_guess       Input/Output: starting point of the search / bracketing index
+ * @param S                     Output: interpolated source
+ * @return the error status
+ */
+
 int transfer_limber_interpolate(
                                 struct transfer * ptr,
                                 double * tau0_minus_tau,
                                 double * sources,
                                 int tau_size,
                                 double tau0_minus_tau_limber,
+                                int * index_tau_guess,
                                 double * S
                                 ){
 
   int index_tau;
   double dS,ddS;
 
-  /** - find  bracketing indices.
+  /** - find  bracketing indices: the smallest index_tau such that
+      tau0_minus_tau[index_tau] <= tau0_minus_tau_limber.
       index_tau must be at least 1 (so that index_tau-1 is at least 0)
       and at most tau_size-2 (so that index_tau+1 is at most tau_size-1).
   */
-  index_tau=1;
+  index_tau = MAX(1,MIN(*index_tau_guess,tau_size-2));
   while ((tau0_minus_tau[index_tau] > tau0_minus_tau_limber) && (index_tau<tau_size-2))
     index_tau++;
+  while ((index_tau > 1) && (tau0_minus_tau[index_tau-1] <= tau0_minus_tau_limber))
+    index_tau--;
+  *index_tau_guess = index_tau;
 
   /** - interpolate by fitting a polynomial of order two; get source
       and its first two derivatives. Note that we are not
@@ -3682,42 +5434,232 @@ int transfer_can_be_neglected(
                               double l,
                               short * neglect) {
 
+  short has_cut;
+  double delta_k;
+
   *neglect = _FALSE_;
 
+  class_call(transfer_neglect_delta_k(ppr,ppt,ptr,index_md,index_tt,&has_cut,&delta_k),
+             ptr->error_message,
+             ptr->error_message);
+
+  if ((has_cut == _TRUE_) && (l < (k-delta_k)*ra_rec)) *neglect = _TRUE_;
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Range of k values taken into account in the transfer function of a
+ * given mode and type: for l < (k-delta_k)*ra_rec, i.e. for k > l/ra_rec
+ * + delta_k, transfer_can_be_neglected() sets it to zero.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param ppt      Input: pointer to perturbation structure
+ * @param ptr      Input: pointer to transfer structure
+ * @param index_md Input: index of mode
+ * @param index_tt Input: index of transfer type
+ * @param has_cut  Output: _TRUE_ if this type is cut at large k
+ * @param delta_k  Output: if so, delta_k
+ * @return the error status
+ */
+
+int transfer_neglect_delta_k(
+                             struct precision * ppr,
+                             struct perturbations * ppt,
+                             struct transfer * ptr,
+                             int index_md,
+                             int index_tt,
+                             short * has_cut,
+                             double * delta_k
+                             ) {
+
+  *has_cut = _TRUE_;
+  *delta_k = 0.;
+
   if (_scalars_) {
 
-    if ((ppt->has_cl_cmb_temperature == _TRUE_) && (index_tt == ptr->index_tt_t0) && (l < (k-ppr->transfer_neglect_delta_k_S_t0)*ra_rec)) *neglect = _TRUE_;
+    if ((ppt->has_cl_cmb_temperature == _TRUE_) && (index_tt == ptr->index_tt_t0)) *delta_k = ppr->transfer_neglect_delta_k_S_t0;
 
-    else if ((ppt->has_cl_cmb_temperature == _TRUE_) && (index_tt == ptr->index_tt_t1) && (l < (k-ppr->transfer_neglect_delta_k_S_t1)*ra_rec)) *neglect = _TRUE_;
+    else if ((ppt->has_cl_cmb_temperature == _TRUE_) && (index_tt == ptr->index_tt_t1)) *delta_k = ppr->transfer_neglect_delta_k_S_t1;
 
-    else if ((ppt->has_cl_cmb_temperature == _TRUE_) && (index_tt == ptr->index_tt_t2) && (l < (k-ppr->transfer_neglect_delta_k_S_t2)*ra_rec)) *neglect = _TRUE_;
+    else if ((ppt->has_cl_cmb_temperature == _TRUE_) && (index_tt == ptr->index_tt_t2)) *delta_k = ppr->transfer_neglect_delta_k_S_t2;
 
-    else if ((ppt->has_cl_cmb_polarization == _TRUE_) && (index_tt == ptr->index_tt_e) && (l < (k-ppr->transfer_neglect_delta_k_S_e)*ra_rec)) *neglect = _TRUE_;
+    else if ((ppt->has_cl_cmb_polarization == _TRUE_) && (index_tt == ptr->index_tt_e)) *delta_k = ppr->transfer_neglect_delta_k_S_e;
+
+    else *has_cut = _FALSE_;
 
   }
 
   else if (_vectors_) {
 
-    if ((ppt->has_cl_cmb_temperature == _TRUE_) && (index_tt == ptr->index_tt_t1) && (l < (k-ppr->transfer_neglect_delta_k_V_t1)*ra_rec)) *neglect = _TRUE_;
+    if ((ppt->has_cl_cmb_temperature == _TRUE_) && (index_tt == ptr->index_tt_t1)) *delta_k = ppr->transfer_neglect_delta_k_V_t1;
+
+    else if ((ppt->has_cl_cmb_temperature == _TRUE_) && (index_tt == ptr->index_tt_t2)) *delta_k = ppr->transfer_neglect_delta_k_V_t2;
 
-    else if ((ppt->has_cl_cmb_temperature == _TRUE_) && (index_tt == ptr->index_tt_t2) && (l < (k-ppr->transfer_neglect_delta_k_V_t2)*ra_rec)) *neglect = _TRUE_;
+    else if ((ppt->has_cl_cmb_polarization == _TRUE_) && (index_tt == ptr->index_tt_e)) *delta_k = ppr->transfer_neglect_delta_k_V_e;
 
-    else if ((ppt->has_cl_cmb_polarization == _TRUE_) && (index_tt == ptr->index_tt_e) && (l < (k-ppr->transfer_neglect_delta_k_V_e)*ra_rec)) *neglect = _TRUE_;
+    else if ((ppt->has_cl_cmb_polarization == _TRUE_) && (index_tt == ptr->index_tt_b)) *delta_k = ppr->transfer_neglect_delta_k_V_b;
 
-    else if ((ppt->has_cl_cmb_polarization == _TRUE_) && (index_tt == ptr->index_tt_b) && (l < (k-ppr->transfer_neglect_delta_k_V_b)*ra_rec)) *neglect = _TRUE_;
+    else *has_cut = _FALSE_;
 
   }
 
   else if (_tensors_) {
 
-    if ((ppt->has_cl_cmb_temperature == _TRUE_) && (index_tt == ptr->index_tt_t2) && (l < (k-ppr->transfer_neglect_delta_k_T_t2)*ra_rec)) *neglect = _TRUE_;
+    if ((ppt->has_cl_cmb_temperature == _TRUE_) && (index_tt == ptr->index_tt_t2)) *delta_k = ppr->transfer_neglect_delta_k_T_t2;
+
+    else if ((ppt->has_cl_cmb_polarization == _TRUE_) && (index_tt == ptr->index_tt_e)) *delta_k = ppr->transfer_neglect_delta_k_T_e;
+
+    else if ((ppt->has_cl_cmb_polarization == _TRUE_) && (index_tt == ptr->index_tt_b)) *delta_k = ppr->transfer_neglect_delta_k_T_b;
+
+    else *has_cut = _FALSE_;
+
+  }
+
+  else *has_cut = _FALSE_;
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Statistics on the integrals cut by transfer_can_be_neglected(),
+ * called after all transfer functions have been computed without
+ * these cuts (ppr->transfer_neglect_statistics). For each mode and
+ * type with a cut, print the number of integrals computed, cut and
+ * without late sources, and the largest fraction (over multipoles and
+ * initial conditions) of the integral of the squared transfer function
+ * over ln(k) carried by the cut integrals. With
+ * ppr->transfer_neglect_budget > 0, also find and print the smallest
+ * delta_k keeping this fraction below the budget. Finally, set the cut
+ * integrals to zero (with this delta_k, or with the usual one), so
+ * that the transfer functions are those of a run with these cuts.
+ *
+ * @param ppr    Input: pointer to precision structure
+ * @param ppt    Input: pointer to perturbation structure
+ * @param ptr    Input/Output: pointer to transfer structure
+ * @param ra_rec Input: comoving distance to recombination, times the angular rescaling
+ * @return the error status
+ */
+
+int transfer_neglect_statistics(
+                                struct precision * ppr,
+                                struct perturbations * ppt,
+                                struct transfer * ptr,
+                                double ra_rec
+                                ) {
+
+  int index_md,index_ic,index_tt,index_l,index_q,index_q_cut;
+  short has_cut;
+  double delta_k,delta_k_budget,delta_k_cut;
+  double l,k,value,weight,total,tail,fraction,fraction_max;
+  double * power;
+  char * name;
+
+  class_alloc(power,ptr->q_size*sizeof(double),ptr->error_message);
+
+  printf(" -> statistics on integrals cut by transfer_can_be_neglected()\n");
+  printf("    mode type    computed         cut  (cut/all)  no late src   max cut fraction   delta_k%s\n",
+         (ppr->transfer_neglect_budget > 0.) ? "   delta_k for budget" : "");
+
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
+    for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+
+      class_call(transfer_neglect_delta_k(ppr,ppt,ptr,index_md,index_tt,&has_cut,&delta_k),
+                 ptr->error_message,
+                 ptr->error_message);
+
+      if (has_cut == _FALSE_)
+        continue;
+
+      fraction_max = 0.;
+      delta_k_budget = -_HUGE_;
+
+      for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+        for (index_l = 0; index_l < ptr->l_size_tt[index_md][index_tt]; index_l++) {
+
+          l = (double)ptr->l[index_l];
+
+          /* contributions of each wavenumber to the integral over ln(k) of the squared transfer function */
+          total = 0.;
+          tail = 0.;
+          for (index_q = 0; index_q < ptr->q_size; index_q++) {
+            k = ptr->k[index_md][index_q];
+            if (index_q == 0)
+              weight = 0.5*log(ptr->k[index_md][1]/k);
+            else if (index_q == ptr->q_size-1)
+              weight = 0.5*log(k/ptr->k[index_md][index_q-1]);
+            else
+              weight = 0.5*log(ptr->k[index_md][index_q+1]/ptr->k[index_md][index_q-1]);
+            value = _transfer_get_(ptr,index_md,_transfer_index_(ptr,index_md,index_ic,index_tt,index_l,index_q));
+            power[index_q] = weight*value*value;
+            total += power[index_q];
+            if (l < (k-delta_k)*ra_rec)
+              tail += power[index_q];
+          }
+
+          if (total <= 0.)
+            continue;
+
+          fraction = tail/total;
+          fraction_max = MAX(fraction_max,fraction);
 
-    else if ((ppt->has_cl_cmb_polarization == _TRUE_) && (index_tt == ptr->index_tt_e) && (l < (k-ppr->transfer_neglect_delta_k_T_e)*ra_rec)) *neglect = _TRUE_;
+          /* smallest delta_k such that the cut integrals carry at most the budget */
+          if (ppr->transfer_neglect_budget > 0.) {
+            tail = 0.;
+            index_q_cut = ptr->q_size;
+            while ((index_q_cut > 0) && (tail+power[index_q_cut-1] <= ppr->transfer_neglect_budget*total)) {
+              index_q_cut--;
+              tail += power[index_q_cut];
+            }
+            /* integrals with index_q >= index_q_cut can be cut: k > l/ra_rec + delta_k_cut for them only */
+            if (index_q_cut > 0)
+              delta_k_cut = ptr->k[index_md][index_q_cut-1]-l/ra_rec;
+            else
+              delta_k_cut = -_HUGE_;
+            delta_k_budget = MAX(delta_k_budget,delta_k_cut);
+          }
+        }
+      }
 
-    else if ((ppt->has_cl_cmb_polarization == _TRUE_) && (index_tt == ptr->index_tt_b) && (l < (k-ppr->transfer_neglect_delta_k_T_b)*ra_rec)) *neglect = _TRUE_;
+      if (index_tt == ptr->index_tt_t0) name = "t0";
+      else if (index_tt == ptr->index_tt_t1) name = "t1";
+      else if (index_tt == ptr->index_tt_t2) name = "t2";
+      else if (index_tt == ptr->index_tt_e) name = "e";
+      else name = "b";
+
+      printf("    %4d %4s %11ld %11ld %10.3e  %11ld   %16.6e  %8.4f",
+             index_md,
+             name,
+             ptr->neglect_count_computed[index_md][index_tt],
+             ptr->neglect_count_cut[index_md][index_tt],
+             (double)ptr->neglect_count_cut[index_md][index_tt]/MAX(1,ptr->neglect_count_computed[index_md][index_tt]+ptr->neglect_count_cut[index_md][index_tt]),
+             ptr->neglect_count_late[index_md][index_tt],
+             fraction_max,
+             delta_k);
+
+      if (ppr->transfer_neglect_budget > 0.) {
+        delta_k = delta_k_budget;
+        printf("   %8.4f",delta_k);
+      }
+      printf("\n");
 
+      /* apply the cuts */
+      for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+        for (index_l = 0; index_l < ptr->l_size_tt[index_md][index_tt]; index_l++) {
+          l = (double)ptr->l[index_l];
+          for (index_q = 0; index_q < ptr->q_size; index_q++) {
+            if (l < (ptr->k[index_md][index_q]-delta_k)*ra_rec)
+              _transfer_set_(ptr,index_md,_transfer_index_(ptr,index_md,index_ic,index_tt,index_l,index_q),0.);
+          }
+        }
+      }
+    }
   }
 
+  free(power);
+
   return _SUCCESS_;
 
 }
@@ -4281,6 +6223,17 @@ int transfer_workspace_init(
   (*ptw)->sgnK = sgnK;
   (*ptw)->tau0_minus_tau_cut = tau0_minus_tau_cut;
   (*ptw)->neglect_late_source = _FALSE_;
+  (*ptw)->index_q_HIS = -1;
+  (*ptw)->index_q_interpolated = -1;
+  (*ptw)->index_md_interpolated = -1;
+  (*ptw)->index_ic_interpolated = -1;
+  (*ptw)->index_tp_interpolated = -1;
+  (*ptw)->index_tt_sources = -1;
+  (*ptw)->index_md_weights = -1;
+  (*ptw)->index_q_weights = -1;
+  (*ptw)->index_tau_limber[0] = 1;
+  (*ptw)->index_tau_limber[1] = 1;
+  (*ptw)->index_tau_limber[2] = 1;
 
   class_alloc((*ptw)->interpolated_sources,perturbations_tau_size*sizeof(double),ptr->error_message);
   class_alloc((*ptw)->sources,tau_size_max*sizeof(double),ptr->error_message);
@@ -4289,6 +6242,9 @@ int transfer_workspace_init(
   class_alloc((*ptw)->chi,tau_size_max*sizeof(double),ptr->error_message);
   class_alloc((*ptw)->cscKgen,tau_size_max*sizeof(double),ptr->error_message);
   class_alloc((*ptw)->cotKgen,tau_size_max*sizeof(double),ptr->error_message);
+  class_alloc((*ptw)->weights,tau_size_max*sizeof(double),ptr->error_message);
+  class_alloc((*ptw)->bin_sources,_HERMITE_CONVOLUTION_MAX_*tau_size_max*sizeof(double),ptr->error_message);
+  class_alloc((*ptw)->bin_weights,_HERMITE_CONVOLUTION_MAX_*tau_size_max*sizeof(double),ptr->error_message);
 
   return _SUCCESS_;
 }
@@ -4311,6 +6267,9 @@ int transfer_workspace_free(
   free(ptw->chi);
   free(ptw->cscKgen);
   free(ptw->cotKgen);
+  free(ptw->weights);
+  free(ptw->bin_sources);
+  free(ptw->bin_weights);
 
   free(ptw);
   return _SUCCESS_;
@@ -4413,17 +6372,19 @@ int transfer_update_HIS(
                "nu=%e when index_q=%d, q=%e, K=%e, sqrt(|K|)=%e; instead nu should always be strictly positive",
                nu,index_q,ptr->q[index_q],ptw->K,sqrt_absK);
 
-    class_call(hyperspherical_HIS_create(ptw->sgnK,
-                                         nu,
-                                         l_size_max,
-                                         ptr->l,
-                                         xmin,
-                                         xmax,
-                                         sampling,
-                                         ptr->l[l_size_max-1]+1,
-                                         ppr->hyper_phi_min_abs,
-                                         &(ptw->HIS),
-                                         ptr->error_message),
+    class_call(hyperspherical_HIS_create_cached(ptw->sgnK,
+                                                nu,
+                                                l_size_max,
+                                                ptr->l,
+                                                xmin,
+                                                xmax,
+                                                sampling,
+                                                ptr->l[l_size_max-1]+1,
+                                                ppr->hyper_phi_min_abs,
+                                                ppr->hyper_cache_size,
+                                                (ppr->hyper_cache_use_file == _TRUE_ ? ppr->hyper_cache_directory : NULL),
+                                                &(ptw->HIS),
+                                                ptr->error_message),
                ptr->error_message,
                ptr->error_message);
 
@@ -4585,6 +6546,10 @@ int transfer_get_lmax(int (*get_xmin_generic)(int sgnK,
  *
  * All factors of k have to be added later (at least in the current version)
  *
+ * The time sampling of these sources, which does not depend on the
+ * wavenumber, is stored at the same time in psa, for
+ * transfer_sources().
+ *
  * @param ppr                   Input: pointer to precision structure
  * @param pba                   Input: pointer to background structure
  * @param ppt                   Input: pointer to perturbation structure
@@ -4592,6 +6557,7 @@ int transfer_get_lmax(int (*get_xmin_generic)(int sgnK,
  * @param tau_rec               Input: recombination time
  * @param tau_size_max          Input: maximum size that tau array can have
  * @param window                Output: pointer to array of selection functions
+ * @param psa                   Output: time sampling of the number count and lensing sources (allocated here, freed by transfer_sampling_free())
  * @return the error status
  */
 
@@ -4602,7 +6568,8 @@ int transfer_precompute_selection(
                      struct transfer * ptr,
                      double tau_rec,
                      int tau_size_max,
-                     double ** window /* Pass a pointer to the pointer, so the pointer can be allocated inside of the function */
+                     double ** window, /* Pass a pointer to the pointer, so the pointer can be allocated inside of the function */
+                     struct transfer_sampling * psa
                      ){
   /** Summary: */
 
@@ -4620,9 +6587,10 @@ int transfer_precompute_selection(
   /* number of tau values */
   int tau_size;
 
-  /* for calling background_at_eta */
-  int last_index;
+  /* for calling background_at_tau_columns(): interval hint, and the only quantities needed here */
+  int last_index = 0;
   double * pvecback = NULL;
+  int bg_columns[3];
 
   /* conformal time */
   double tau, tau0;
@@ -4654,6 +6622,9 @@ int transfer_precompute_selection(
   /* source evolution factor */
   double f_evo = 0.;
 
+  /* for nCl g5: factor multiplying the selection function at each time of the lensing source sampling */
+  double * g5_factor = NULL;
+
 
   /* Setup initial variables and arrays*/
   int index_md = ppt->index_md_scalars;
@@ -4665,6 +6636,16 @@ int transfer_precompute_selection(
   class_alloc(w_trapz,tau_size_max*sizeof(double),ptr->error_message);
   class_alloc((*window),tau_size_max*ptr->tt_size[index_md]*sizeof(double),ptr->error_message);
   class_alloc(pvecback,pba->bg_size*sizeof(double),ptr->error_message);
+  bg_columns[0] = pba->index_bg_a;
+  bg_columns[1] = pba->index_bg_H;
+  bg_columns[2] = pba->index_bg_H_prime;
+
+  psa->tau_size_max = tau_size_max;
+  class_calloc(psa->tau_size,ptr->tt_size[index_md],sizeof(int),ptr->error_message);
+  class_alloc(psa->tau0_minus_tau,tau_size_max*ptr->tt_size[index_md]*sizeof(double),ptr->error_message);
+  class_alloc(psa->w_trapz,tau_size_max*ptr->tt_size[index_md]*sizeof(double),ptr->error_message);
+  class_alloc(psa->index_resample,tau_size_max*ptr->tt_size[index_md]*sizeof(int),ptr->error_message);
+  class_alloc(psa->weight_resample,tau_size_max*ptr->tt_size[index_md]*sizeof(double),ptr->error_message);
 
   /* conformal time today */
   tau0 = pba->conformal_age;
@@ -4713,6 +6694,11 @@ int transfer_precompute_selection(
                  ptr->error_message,
                  ptr->error_message);
 
+      /* keep this sampling for transfer_sources() */
+      class_call(transfer_sampling_store(ppt,ptr,psa,index_tt,tau0,tau0_minus_tau,w_trapz,tau_size),
+                 ptr->error_message,
+                 ptr->error_message);
+
       /* compute values of selection function at sampled values of tau */
       class_call(transfer_selection_compute(ppr,
                                             pba,
@@ -4752,12 +6738,12 @@ int transfer_precompute_selection(
         }
 
         /* corresponding background quantities */
-        class_call(background_at_tau(pba,
-                                     tau,
-                                     long_info,
-                                     inter_normal,
-                                     &last_index,
-                                     pvecback),
+        class_call(background_at_tau_columns(pba,
+                                             tau,
+                                             bg_columns,
+                                             3,
+                                             &last_index,
+                                             pvecback),
                    pba->error_message,
                    ptr->error_message);
 
@@ -4914,6 +6900,76 @@ int transfer_precompute_selection(
                  ptr->error_message,
                  ptr->error_message);
 
+      /* keep this sampling for transfer_sources() */
+      class_call(transfer_sampling_store(ppt,ptr,psa,index_tt,tau0,tau0_minus_tau,w_trapz,tau_size),
+                 ptr->error_message,
+                 ptr->error_message);
+
+      /* nCl g5: the factor multiplying the selection function depends
+         only on the time of the lensing source, compute it once for all
+         the times of the lens */
+      if (_index_tt_in_range_(ptr->index_tt_nc_g5, ppt->selection_num, ppt->has_nc_gr)) {
+
+        class_alloc(g5_factor,
+                    tau_sources_size*sizeof(double),
+                    ptr->error_message);
+
+        for (index_tau_sources=0;
+             index_tau_sources < tau_sources_size;
+             index_tau_sources++) {
+
+          g5_factor[index_tau_sources] = 0.;
+
+          if (tau0_minus_tau_lensing_sources[index_tau_sources] > 0.) {
+
+            switch (pba->sgnK){
+            case 1:
+              sinKgen_source = sin(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(pba->K))/sqrt(pba->K);
+              cotKgen_source = cos(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(pba->K))/sinKgen_source;
+              break;
+            case 0:
+              cotKgen_source = 1./(tau0_minus_tau_lensing_sources[index_tau_sources]);
+              break;
+            case -1:
+              sinKgen_source = sinh(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(-pba->K))/sqrt(-pba->K);
+              cotKgen_source = cosh(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(-pba->K))/sinKgen_source;
+              break;
+            }
+
+            /* background quantities at time tau_lensing_source */
+
+            class_call(background_at_tau_columns(pba,
+                                                 tau0-tau0_minus_tau_lensing_sources[index_tau_sources],
+                                                 bg_columns,
+                                                 3,
+                                                 &last_index,
+                                                 pvecback),
+                       pba->error_message,
+                       ptr->error_message);
+
+            /* Source evolution at time tau_lensing_source */
+
+            class_call(transfer_f_evo(pba,ptr,pvecback,last_index,cotKgen_source,&f_evo),
+                       ptr->error_message,
+                       ptr->error_message);
+
+            g5_factor[index_tau_sources] =
+              (1.
+               + pvecback[pba->index_bg_H_prime]
+               /pvecback[pba->index_bg_a]
+               /pvecback[pba->index_bg_H]
+               /pvecback[pba->index_bg_H]
+               + (2.-5.*ptr->selection_magnification_bias[bin])
+               //  /tau0_minus_tau_lensing_sources[index_tau_sources]
+               * cotKgen_source
+               /pvecback[pba->index_bg_a]
+               /pvecback[pba->index_bg_H]
+               + 5.*ptr->selection_magnification_bias[bin]
+               - f_evo);
+          }
+        }
+      }
+
       /* loop over time and rescale */
       for (index_tau = 0; index_tau < tau_size; index_tau++) {
 
@@ -5001,37 +7057,8 @@ int transfer_precompute_selection(
 
               if (_index_tt_in_range_(ptr->index_tt_nc_g5, ppt->selection_num, ppt->has_nc_gr)) {
 
-                /* background quantities at time tau_lensing_source */
-
-                class_call(background_at_tau(pba,
-                                             tau0-tau0_minus_tau_lensing_sources[index_tau_sources],
-                                             long_info,
-                                             inter_normal,
-                                             &last_index,
-                                             pvecback),
-                           pba->error_message,
-                           ptr->error_message);
-
-                /* Source evolution at time tau_lensing_source */
-
-                class_call(transfer_f_evo(pba,ptr,pvecback,last_index,cotKgen_source,&f_evo),
-                           ptr->error_message,
-                           ptr->error_message);
-
-
                 rescaling +=
-                  (1.
-                   + pvecback[pba->index_bg_H_prime]
-                   /pvecback[pba->index_bg_a]
-                   /pvecback[pba->index_bg_H]
-                   /pvecback[pba->index_bg_H]
-                   + (2.-5.*ptr->selection_magnification_bias[bin])
-                   //  /tau0_minus_tau_lensing_sources[index_tau_sources]
-                   * cotKgen_source
-                   /pvecback[pba->index_bg_a]
-                   /pvecback[pba->index_bg_H]
-                   + 5.*ptr->selection_magnification_bias[bin]
-                   - f_evo)
+                  g5_factor[index_tau_sources]
                   * selection[index_tau_sources]
                   * w_trapz_lensing_sources[index_tau_sources];
               }
@@ -5046,6 +7073,10 @@ int transfer_precompute_selection(
       /* deallocate temporary arrays */
       free(tau0_minus_tau_lensing_sources);
       free(w_trapz_lensing_sources);
+      if (g5_factor != NULL) {
+        free(g5_factor);
+        g5_factor = NULL;
+      }
     }
     /* End integrated contribution */
   }
@@ -5058,6 +7089,88 @@ int transfer_precompute_selection(
   return _SUCCESS_;
 }
 
+/**
+ * Store the time sampling of the sources of one number count or
+ * lensing type in psa, together with the indices and weights of the
+ * linear interpolation of the perturbation sources at these times
+ * (the same as in array_interpolate_two()).
+ *
+ * @param ppt            Input: pointer to perturbation structure
+ * @param ptr            Input: pointer to transfer structure
+ * @param psa            Input/Output: time sampling of the number count and lensing sources
+ * @param index_tt       Input: index of type of (transfer) source
+ * @param tau0           Input: time today
+ * @param tau0_minus_tau Input: values of (tau0-tau) at which sources are sampled
+ * @param w_trapz        Input: trapezoidal weights for integration over tau
+ * @param tau_size       Input: number of times
+ * @return the error status
+ */
+
+int transfer_sampling_store(
+                            struct perturbations * ppt,
+                            struct transfer * ptr,
+                            struct transfer_sampling * psa,
+                            int index_tt,
+                            double tau0,
+                            double * tau0_minus_tau,
+                            double * w_trapz,
+                            int tau_size
+                            ) {
+
+  int index_tau;
+  int inf, sup, mid;
+  double tau;
+  int * index_resample = psa->index_resample+index_tt*psa->tau_size_max;
+  double * weight_resample = psa->weight_resample+index_tt*psa->tau_size_max;
+
+  psa->tau_size[index_tt] = tau_size;
+  memcpy(psa->tau0_minus_tau+index_tt*psa->tau_size_max,tau0_minus_tau,tau_size*sizeof(double));
+  memcpy(psa->w_trapz+index_tt*psa->tau_size_max,w_trapz,tau_size*sizeof(double));
+
+  for (index_tau = 0; index_tau < tau_size; index_tau++) {
+
+    tau = tau0-tau0_minus_tau[index_tau];
+
+    class_test((tau < ppt->tau_sampling[0]) || (tau > ppt->tau_sampling[ppt->tau_size-1]),
+               ptr->error_message,
+               "tau=%e out of the range [%e, %e] in which sources are sampled",
+               tau,ppt->tau_sampling[0],ppt->tau_sampling[ppt->tau_size-1]);
+
+    inf = 0;
+    sup = ppt->tau_size-1;
+    while (sup-inf > 1) {
+      mid = (int)(0.5*(inf+sup));
+      if (tau < ppt->tau_sampling[mid]) {sup=mid;}
+      else {inf=mid;}
+    }
+
+    index_resample[index_tau] = inf;
+    weight_resample[index_tau] = (tau-ppt->tau_sampling[inf])/(ppt->tau_sampling[sup]-ppt->tau_sampling[inf]);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the arrays of psa allocated in transfer_precompute_selection()
+ *
+ * @param psa Input: time sampling of the number count and lensing sources
+ * @return the error status
+ */
+
+int transfer_sampling_free(
+                           struct transfer_sampling * psa
+                           ) {
+
+  free(psa->tau_size);
+  free(psa->tau0_minus_tau);
+  free(psa->w_trapz);
+  free(psa->index_resample);
+  free(psa->weight_resample);
+
+  return _SUCCESS_;
+}
+
 int transfer_f_evo(
                    struct background* pba,
                    struct transfer * ptr,
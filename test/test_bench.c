@@ -0,0 +1,531 @@
+/** @file test_bench.c
+ * Thread-scaling benchmark and performance regression test of the CLASS modules
+ *
+ * Usage: ./test_bench [-t <threads>] [-r <repetitions>] [-o <results>]
+ *                     [-s <baseline>] [-c <baseline>] [-T <percent>] [-M <percent>] [-a <seconds>]
+ *                     file1.ini [file1.pre] [file2.ini [file2.pre] ...]
+ *
+ * For each input file, optionally followed by a precision file (as for
+ * ./class), the modules from input to lensing are run with 1, 2, ...,
+ * <threads> threads (default: the number of OpenMP threads available),
+ * <repetitions> times for each number of threads (default: 3), after
+ * one untimed run. All tables that CLASS caches across runs are cleared
+ * before each run, so that each measurement is the time of an
+ * independent run of CLASS.
+ *
+ * The time and the memory allocated by each run and each module are
+ * written in the file <results> (default: bench.dat), one measurement
+ * per line with the tab-separated columns
+ *
+ *   file  module  threads  repetition  seconds  bytes
+ *
+ * where file is the input file, or 'input.ini+precision.pre', and
+ * module is one of input, background, thermodynamics, perturbations,
+ * primordial, fourier, transfer, harmonic, lensing or total. bytes are
+ * those requested with class_alloc(), class_calloc() and
+ * class_realloc(). A summary is printed for each file: for each module
+ * and number of threads n, the shortest time t_n and the strong-scaling
+ * efficiency t_1/(n t_n).
+ *
+ * With -s, the shortest time and the memory of each file, module and
+ * number of threads are stored in the file <baseline>, with the
+ * columns
+ *
+ *   file  module  threads  seconds  bytes
+ *
+ * With -c, they are compared to those of a previous -s run on the same
+ * machine: the differences are printed for each module, and the
+ * program fails if a module is more than <percent> slower (-T, default:
+ * 10) or allocates more than <percent> more memory (-M, default: 20).
+ * Time differences smaller than <seconds> (-a, default: 0.01) and
+ * memory differences smaller than 1 MB are never counted as
+ * regressions, to ignore the noise of the shortest stages.
+ *
+ * 'make bench' runs the scaling benchmark on the three input files
+ * test/bench_*.ini; 'make perf_baseline' and 'make perf_check' store
+ * and check the baseline of the reference runs PERF_FILES.
+ */
+
+#include "class.h"
+
+#define _BENCH_STAGES_ 10 /**< number of timed stages: input, the eight modules up to lensing, and their total */
+#define _BENCH_NAME_SIZE_ (2*_ARGUMENT_LENGTH_MAX_) /**< size of the name of a benchmark file, 'input.ini+precision.pre' */
+#define _BENCH_MEMORY_FLOOR_ 1.e6 /**< smallest memory difference counted as a regression, in bytes */
+
+static char * bench_stage_name[_BENCH_STAGES_] = {"input","background","thermodynamics","perturbations",
+                                                  "primordial","fourier","transfer","harmonic","lensing","total"};
+
+/* one line of a baseline file */
+struct bench_reference {
+  char name[_BENCH_NAME_SIZE_];
+  char stage[_FILENAMESIZE_];
+  int threads;
+  double seconds;
+  double bytes;
+};
+
+/* options of a regression test */
+struct bench_check {
+  struct bench_reference * reference; /* lines of the baseline (NULL without -c) */
+  int reference_size;
+  double time_threshold;              /* largest allowed slow-down, as a fraction */
+  double memory_threshold;            /* largest allowed memory increase, as a fraction */
+  double time_floor;                  /* smallest time difference counted as a regression, in s */
+  int regressions;                    /* number of regressions found so far */
+};
+
+/**
+ * Clear all tables that CLASS keeps in memory across runs
+ *
+ * @param errmsg Output: error message
+ * @return the error status
+ */
+
+static int bench_caches_clear(ErrorMsg errmsg) {
+
+  class_test(background_ncdm_quadrature_clear() == _FAILURE_ ||
+             thermodynamics_bbn_clear() == _FAILURE_ ||
+             thermodynamics_emulator_clear() == _FAILURE_ ||
+             thermodynamics_recombination_cache_clear() == _FAILURE_ ||
+             thermodynamics_hyrec_tables_clear() == _FAILURE_ ||
+             injection_cache_clear() == _FAILURE_ ||
+             noninjection_cache_clear() == _FAILURE_ ||
+             perturbations_cache_clear() == _FAILURE_ ||
+             perturbations_switches_clear() == _FAILURE_ ||
+             primordial_external_spectrum_clear() == _FAILURE_ ||
+             fourier_hmcode_cache_clear() == _FAILURE_ ||
+             transfer_cache_clear() == _FAILURE_ ||
+             hyperspherical_HIS_cache_clear() == _FAILURE_ ||
+             lensing_d_cache_clear() == _FAILURE_ ||
+             lensing_response_clear() == _FAILURE_ ||
+             distortions_data_clear() == _FAILURE_,
+             errmsg,
+             "could not clear the tables kept in memory");
+
+  return _SUCCESS_;
+}
+
+/**
+ * Run the modules from input to lensing once, and measure the time
+ * spent and the memory allocated in each of them
+ *
+ * @param pfc     Input: parameters
+ * @param seconds Output: time of each stage, in the order of bench_stage_name
+ * @param bytes   Output: memory allocated in each stage, in the same order
+ * @param errmsg  Output: error message
+ * @return the error status
+ */
+
+static int bench_run(struct file_content * pfc,
+                     double * seconds,
+                     double * bytes,
+                     ErrorMsg errmsg) {
+
+  struct precision pr;
+  struct background ba;
+  struct thermodynamics th;
+  struct perturbations pt;
+  struct primordial pm;
+  struct fourier fo;
+  struct transfer tr;
+  struct harmonic hr;
+  struct lensing le;
+  struct distortions sd;
+  struct output op;
+  struct profile prof;
+  int index_stage;
+
+  class_call(bench_caches_clear(errmsg),errmsg,errmsg);
+
+  /* the stages of bench_stage_name are the first ones of enum profile_stage */
+  profile_init(&prof);
+
+  profile_start(&prof,profile_input);
+  class_call(input_read_from_file(pfc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg),errmsg,errmsg);
+  profile_stop(&prof,profile_input);
+  profile_start(&prof,profile_background);
+  class_call(background_init(&pr,&ba),ba.error_message,errmsg);
+  profile_stop(&prof,profile_background);
+  profile_start(&prof,profile_thermodynamics);
+  class_call(thermodynamics_init(&pr,&ba,&th),th.error_message,errmsg);
+  profile_stop(&prof,profile_thermodynamics);
+  profile_start(&prof,profile_perturbations);
+  class_call(perturbations_init(&pr,&ba,&th,&pt),pt.error_message,errmsg);
+  profile_stop(&prof,profile_perturbations);
+  profile_start(&prof,profile_primordial);
+  class_call(primordial_init(&pr,&pt,&pm),pm.error_message,errmsg);
+  profile_stop(&prof,profile_primordial);
+  profile_start(&prof,profile_fourier);
+  class_call(fourier_init(&pr,&ba,&th,&pt,&pm,&fo),fo.error_message,errmsg);
+  profile_stop(&prof,profile_fourier);
+  profile_start(&prof,profile_transfer);
+  class_call(transfer_init(&pr,&ba,&th,&pt,&fo,&tr),tr.error_message,errmsg);
+  profile_stop(&prof,profile_transfer);
+  profile_start(&prof,profile_harmonic);
+  class_call(harmonic_init(&pr,&ba,&pt,&pm,&fo,&tr,&hr),hr.error_message,errmsg);
+  profile_stop(&prof,profile_harmonic);
+  profile_start(&prof,profile_lensing);
+  class_call(lensing_init(&pr,&pt,&hr,&fo,&le),le.error_message,errmsg);
+  profile_stop(&prof,profile_lensing);
+
+  seconds[_BENCH_STAGES_-1] = 0.;
+  bytes[_BENCH_STAGES_-1] = 0.;
+  for (index_stage=0; index_stage<_BENCH_STAGES_-1; index_stage++) {
+    seconds[index_stage] = prof.wall[index_stage];
+    bytes[index_stage] = prof.bytes[index_stage];
+    seconds[_BENCH_STAGES_-1] += seconds[index_stage];
+    bytes[_BENCH_STAGES_-1] += bytes[index_stage];
+  }
+
+  class_call(lensing_free(&le),le.error_message,errmsg);
+  class_call(harmonic_free(&hr),hr.error_message,errmsg);
+  class_call(transfer_free(&tr),tr.error_message,errmsg);
+  class_call(fourier_free(&fo),fo.error_message,errmsg);
+  class_call(primordial_free(&pm),pm.error_message,errmsg);
+  class_call(perturbations_free(&pt),pt.error_message,errmsg);
+  class_call(thermodynamics_free(&th),th.error_message,errmsg);
+  class_call(background_free(&ba),ba.error_message,errmsg);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Read a baseline file written with -s
+ *
+ * @param filename Input: baseline file
+ * @param pbc      Input/Output: regression test, whose reference lines are allocated and filled
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+static int bench_baseline_read(char * filename,
+                               struct bench_check * pbc,
+                               ErrorMsg errmsg) {
+
+  FILE * baseline;
+  char line[_BENCH_NAME_SIZE_+2*_FILENAMESIZE_];
+  struct bench_reference * reference;
+  int capacity = 0;
+
+  class_open(baseline,filename,"r",errmsg);
+
+  while (fgets(line,sizeof(line),baseline) != NULL) {
+
+    if ((line[0] == '#') || (line[0] == '\n'))
+      continue;
+
+    if (pbc->reference_size == capacity) {
+      capacity = 2*capacity+_BENCH_STAGES_;
+      class_realloc(pbc->reference,pbc->reference,capacity*sizeof(struct bench_reference),errmsg);
+    }
+    reference = pbc->reference+pbc->reference_size;
+
+    class_test(sscanf(line,"%s\t%s\t%d\t%lf\t%lf",
+                      reference->name,reference->stage,&reference->threads,&reference->seconds,&reference->bytes) != 5,
+               errmsg,
+               "could not read the line '%s' of the baseline file %s",line,filename);
+
+    pbc->reference_size++;
+  }
+
+  fclose(baseline);
+
+  class_test(pbc->reference_size == 0,
+             errmsg,
+             "the baseline file %s is empty",filename);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compare the best time and the memory of one file to those of the
+ * baseline, print the differences and count the regressions
+ *
+ * @param name        Input: name of the benchmark file
+ * @param max_threads Input: largest number of threads
+ * @param best        Input: best time of each number of threads and stage
+ * @param bytes       Input: memory of each number of threads and stage
+ * @param pbc         Input/Output: regression test
+ */
+
+static void bench_baseline_compare(char * name,
+                                   int max_threads,
+                                   double * best,
+                                   double * bytes,
+                                   struct bench_check * pbc) {
+
+  struct bench_reference * reference;
+  int threads, index_stage, index_reference, index;
+  short found = _FALSE_;
+  short slower, larger;
+
+  printf("%s: comparison to the baseline (limits: +%.0f%% time, +%.0f%% memory)\n%-15s %7s %20s %8s %22s %8s\n",
+         name,100.*pbc->time_threshold,100.*pbc->memory_threshold,
+         "module","threads","time [s]","diff","memory [MB]","diff");
+
+  for (threads=1; threads<=max_threads; threads++) {
+    for (index_stage=0; index_stage<_BENCH_STAGES_; index_stage++) {
+
+      for (index_reference=0; index_reference<pbc->reference_size; index_reference++) {
+        reference = pbc->reference+index_reference;
+        if ((reference->threads == threads) &&
+            (strcmp(reference->name,name) == 0) &&
+            (strcmp(reference->stage,bench_stage_name[index_stage]) == 0))
+          break;
+      }
+      if (index_reference == pbc->reference_size)
+        continue;
+
+      found = _TRUE_;
+      index = (threads-1)*_BENCH_STAGES_+index_stage;
+
+      slower = ((best[index] > (1.+pbc->time_threshold)*reference->seconds) &&
+                (best[index]-reference->seconds > pbc->time_floor));
+      larger = ((bytes[index] > (1.+pbc->memory_threshold)*reference->bytes) &&
+                (bytes[index]-reference->bytes > _BENCH_MEMORY_FLOOR_));
+
+      printf("%-15s %7d %9.4f -> %8.4f %+7.1f%% %10.2f -> %9.2f %+7.1f%%%s%s\n",
+             bench_stage_name[index_stage],threads,
+             reference->seconds,best[index],(reference->seconds > 0. ? 100.*(best[index]/reference->seconds-1.) : 0.),
+             1.e-6*reference->bytes,1.e-6*bytes[index],(reference->bytes > 0. ? 100.*(bytes[index]/reference->bytes-1.) : 0.),
+             (slower == _TRUE_ ? "  SLOWER" : ""),
+             (larger == _TRUE_ ? "  LARGER" : ""));
+
+      if ((slower == _TRUE_) || (larger == _TRUE_))
+        pbc->regressions++;
+    }
+  }
+
+  if (found == _FALSE_)
+    printf(" -> not in the baseline\n");
+  printf("\n");
+}
+
+/**
+ * Benchmark one input file for 1 to max_threads threads
+ *
+ * @param input_file     Input: input file
+ * @param precision_file Input: precision file, or NULL
+ * @param max_threads    Input: largest number of threads
+ * @param repetitions    Input: number of measurements for each number of threads
+ * @param results        Input: results file
+ * @param baseline       Input: baseline file to write, or NULL
+ * @param pbc            Input/Output: regression test, or NULL
+ * @param errmsg         Output: error message
+ * @return the error status
+ */
+
+static int bench_file(char * input_file,
+                      char * precision_file,
+                      int max_threads,
+                      int repetitions,
+                      FILE * results,
+                      FILE * baseline,
+                      struct bench_check * pbc,
+                      ErrorMsg errmsg) {
+
+  struct file_content fc;
+  char name[_BENCH_NAME_SIZE_];
+  char * argv[3] = {"test_bench",input_file,precision_file};
+  double seconds[_BENCH_STAGES_];
+  double memory[_BENCH_STAGES_];
+  double * best;   /* best[(threads-1)*_BENCH_STAGES_+index_stage] */
+  double * bytes;  /* bytes[(threads-1)*_BENCH_STAGES_+index_stage], of the last repetition */
+  int threads, repetition, index_stage;
+
+  if (precision_file == NULL)
+    sprintf(name,"%s",input_file);
+  else
+    sprintf(name,"%s+%s",input_file,precision_file);
+
+  /* read the files as ./class does */
+  class_call(input_find_file((precision_file == NULL ? 2 : 3),argv,&fc,errmsg),errmsg,errmsg);
+  class_alloc(best,max_threads*_BENCH_STAGES_*sizeof(double),errmsg);
+  class_alloc(bytes,max_threads*_BENCH_STAGES_*sizeof(double),errmsg);
+
+  /* untimed run, to read the data files and fault in the code */
+  class_call(bench_run(&fc,seconds,memory,errmsg),errmsg,errmsg);
+
+  for (threads=1; threads<=max_threads; threads++) {
+
+    class_threads_set(threads);
+
+    for (repetition=0; repetition<repetitions; repetition++) {
+
+      class_call(bench_run(&fc,seconds,memory,errmsg),errmsg,errmsg);
+
+      for (index_stage=0; index_stage<_BENCH_STAGES_; index_stage++) {
+        fprintf(results,"%s\t%s\t%d\t%d\t%.6e\t%.0f\n",name,bench_stage_name[index_stage],threads,repetition,seconds[index_stage],memory[index_stage]);
+        if ((repetition == 0) || (seconds[index_stage] < best[(threads-1)*_BENCH_STAGES_+index_stage]))
+          best[(threads-1)*_BENCH_STAGES_+index_stage] = seconds[index_stage];
+        bytes[(threads-1)*_BENCH_STAGES_+index_stage] = memory[index_stage];
+      }
+      fflush(results);
+    }
+
+    printf(" -> %s: %d thread(s), best total %.3f s\n",name,threads,best[(threads-1)*_BENCH_STAGES_+_BENCH_STAGES_-1]);
+    fflush(stdout);
+  }
+
+  /** - summary: best time and efficiency t_1/(n t_n) */
+
+  printf("\n%s: best time in s (efficiency)\n%-15s",name,"module");
+  for (threads=1; threads<=max_threads; threads++)
+    printf("  %6d thread(s)",threads);
+  printf("\n");
+  for (index_stage=0; index_stage<_BENCH_STAGES_; index_stage++) {
+    printf("%-15s",bench_stage_name[index_stage]);
+    for (threads=1; threads<=max_threads; threads++)
+      printf("  %9.4f (%4.2f)",
+             best[(threads-1)*_BENCH_STAGES_+index_stage],
+             best[index_stage]/(threads*best[(threads-1)*_BENCH_STAGES_+index_stage]));
+    printf("\n");
+  }
+  printf("\n");
+
+  /** - baseline: store, or compare to, the best time and the memory */
+
+  if (baseline != NULL) {
+    for (threads=1; threads<=max_threads; threads++)
+      for (index_stage=0; index_stage<_BENCH_STAGES_; index_stage++)
+        fprintf(baseline,"%s\t%s\t%d\t%.6e\t%.0f\n",name,bench_stage_name[index_stage],threads,
+                best[(threads-1)*_BENCH_STAGES_+index_stage],bytes[(threads-1)*_BENCH_STAGES_+index_stage]);
+    fflush(baseline);
+  }
+
+  if (pbc != NULL)
+    bench_baseline_compare(name,max_threads,best,bytes,pbc);
+
+  free(best);
+  free(bytes);
+  parser_free(&fc);
+
+  return _SUCCESS_;
+}
+
+int main(int argc, char **argv) {
+
+  char * results_name = "bench.dat";
+  char * baseline_name = NULL;
+  char * reference_name = NULL;
+  char * precision_file;
+  FILE * results;
+  FILE * baseline = NULL;
+  struct bench_check bc;
+  ErrorMsg errmsg;
+  int max_threads = 1;
+  int repetitions = 3;
+  int threads;
+  int index_arg;
+  int length;
+
+  bc.reference = NULL;
+  bc.reference_size = 0;
+  bc.time_threshold = 0.10;
+  bc.memory_threshold = 0.20;
+  bc.time_floor = 0.01;
+  bc.regressions = 0;
+
+#ifdef _OPENMP
+  max_threads = omp_get_max_threads();
+#endif
+
+  for (index_arg=1; (index_arg<argc-1) && (argv[index_arg][0] == '-'); index_arg+=2) {
+    if (strcmp(argv[index_arg],"-t") == 0)
+      max_threads = atoi(argv[index_arg+1]);
+    else if (strcmp(argv[index_arg],"-r") == 0)
+      repetitions = atoi(argv[index_arg+1]);
+    else if (strcmp(argv[index_arg],"-o") == 0)
+      results_name = argv[index_arg+1];
+    else if (strcmp(argv[index_arg],"-s") == 0)
+      baseline_name = argv[index_arg+1];
+    else if (strcmp(argv[index_arg],"-c") == 0)
+      reference_name = argv[index_arg+1];
+    else if (strcmp(argv[index_arg],"-T") == 0)
+      bc.time_threshold = 0.01*atof(argv[index_arg+1]);
+    else if (strcmp(argv[index_arg],"-M") == 0)
+      bc.memory_threshold = 0.01*atof(argv[index_arg+1]);
+    else if (strcmp(argv[index_arg],"-a") == 0)
+      bc.time_floor = atof(argv[index_arg+1]);
+    else
+      break;
+  }
+
+  if ((index_arg >= argc) || (argv[index_arg][0] == '-') || (max_threads < 1) || (repetitions < 1)) {
+    printf("\n\nUsage: %s [-t <threads>] [-r <repetitions>] [-o <results>]\n"
+           "       [-s <baseline>] [-c <baseline>] [-T <percent>] [-M <percent>] [-a <seconds>]\n"
+           "       file1.ini [file1.pre] [file2.ini [file2.pre] ...]\n",argv[0]);
+    return _FAILURE_;
+  }
+
+  /* read the baseline first, since it may be the file written with -s */
+  if ((reference_name != NULL) && (bench_baseline_read(reference_name,&bc,errmsg) == _FAILURE_)) {
+    printf("\n\nError in reading the baseline\n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  results = fopen(results_name,"w");
+  if (results == NULL) {
+    printf("\n\nError: could not open %s for writing\n",results_name);
+    return _FAILURE_;
+  }
+  fprintf(results,"# CLASS thread-scaling benchmark: %d repetition(s) for 1 to %d thread(s)\n",repetitions,max_threads);
+  fprintf(results,"# file\tmodule\tthreads\trepetition\tseconds\tbytes\n");
+
+  if (baseline_name != NULL) {
+    baseline = fopen(baseline_name,"w");
+    if (baseline == NULL) {
+      printf("\n\nError: could not open %s for writing\n",baseline_name);
+      fclose(results);
+      return _FAILURE_;
+    }
+    fprintf(baseline,"# CLASS performance baseline: best of %d repetition(s)\n",repetitions);
+    fprintf(baseline,"# file\tmodule\tthreads\tseconds\tbytes\n");
+  }
+
+  threads = class_threads_set(0);
+
+  for (; index_arg<argc; index_arg++) {
+
+    /* a precision file applies to the input file before it */
+    precision_file = NULL;
+    if (index_arg+1 < argc) {
+      length = strlen(argv[index_arg+1]);
+      if ((length > 4) && (strcmp(argv[index_arg+1]+length-4,".pre") == 0))
+        precision_file = argv[index_arg+1];
+    }
+
+    if (bench_file(argv[index_arg],precision_file,max_threads,repetitions,results,baseline,
+                   (reference_name != NULL ? &bc : NULL),errmsg) == _FAILURE_) {
+      printf("\n\nError in benchmark of %s\n=>%s\n",argv[index_arg],errmsg);
+      fclose(results);
+      if (baseline != NULL)
+        fclose(baseline);
+      return _FAILURE_;
+    }
+
+    if (precision_file != NULL)
+      index_arg++;
+  }
+
+  class_threads_set(threads);
+  fclose(results);
+
+  printf("Results written in %s\n",results_name);
+
+  if (baseline != NULL) {
+    fclose(baseline);
+    printf("Baseline written in %s\n",baseline_name);
+  }
+
+  if (reference_name != NULL) {
+    free(bc.reference);
+    if (bc.regressions > 0) {
+      printf("Performance regression: %d module(s) slower or larger than in %s\n",bc.regressions,reference_name);
+      return _FAILURE_;
+    }
+    printf("No performance regression with respect to %s\n",reference_name);
+  }
+
+  return _SUCCESS_;
+}
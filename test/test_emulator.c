@@ -0,0 +1,347 @@
+/** @file test_emulator.c
+ *
+ * Train the polynomial emulator of the lensed C_l's and of P(k,z)
+ * (tools/emulator.c) on runs of the code, and write it to a file
+ * read by classy (Class.use_emulator()) and by ClassEngine
+ * (ClassEngine::useEmulator()).
+ *
+ * Usage: ./test_emulator <emulator file> <number of runs> <input file> <name>=<min>:<max> [<name>=<min>:<max> ...]
+ *
+ * The input file (e.g. base_2018_plikHM_TTTEEE_lowl_lowE_lensing.ini)
+ * fixes all the parameters of the runs apart from the emulated ones,
+ * which are drawn in the box given on the command line by Latin
+ * hypercube sampling. Its output should contain lensed C_l's (with
+ * 'lensing = yes') and/or mPk, with P_k_max_1/Mpc rather than
+ * P_k_max_h/Mpc if h is emulated. The last fifth of the runs is first
+ * left out of the fit to estimate the error model.
+ */
+
+#include "class.h"
+
+/* degree of the polynomials, and seed of the Latin hypercube (edit to change them) */
+#define _DEGREE_ 3
+#define _SEED_ 1
+
+/* P(k,z) grid: wavenumbers per decade and number of redshifts between z=0 and z_max_pk */
+#define _K_PER_DECADE_ 30
+#define _Z_SIZE_ 11
+
+/* output-only parameters, which are not stored as fixed parameters of the emulator */
+static short is_output_only(char * name) {
+  return ((strcmp(name,"root") == 0) ||
+          (strcmp(name,"overwrite_root") == 0) ||
+          (strcmp(name,"headers") == 0) ||
+          (strcmp(name,"format") == 0) ||
+          (strncmp(name,"write",5) == 0) ||
+          (strstr(name,"_verbose") != NULL));
+}
+
+int main(int argc, char **argv) {
+
+  struct precision pr;        /* for precision parameters */
+  struct background ba;       /* for cosmological background */
+  struct thermodynamics th;           /* for thermodynamics */
+  struct perturbations pt;         /* for source functions */
+  struct transfer tr;        /* for transfer functions */
+  struct primordial pm;       /* for primordial spectra */
+  struct harmonic hr;          /* for output spectra */
+  struct fourier fo;        /* for non-linear spectra */
+  struct lensing le;          /* for lensed sepctra */
+  struct distortions sd;      /* for spectral distortions */
+  struct output op;           /* for output files */
+  struct emulator em;         /* for the emulator */
+  ErrorMsg errmsg;            /* for error message */
+
+  struct file_content fc_file;
+  struct file_content fc;
+  int par_size;
+  int sample_size;
+  int validation_size;
+  int index_par, index_sample, index, index_fc, index_type, index_k, index_z, l, swap;
+  int * stratum;
+  double * parameters;
+  double * outputs;
+  double * out;
+  double * cl_lensed = NULL;
+  double pk;
+  short has_cl[_EMULATOR_CL_TYPES_];
+  int index_lt[_EMULATOR_CL_TYPES_];
+  char * separator;
+  double k_min, k_max;
+  int k_size;
+
+  if (argc < 5) {
+    printf("Usage: %s <emulator file> <number of runs> <input file> <name>=<min>:<max> [<name>=<min>:<max> ...]\n",argv[0]);
+    return _FAILURE_;
+  }
+
+  sample_size = atoi(argv[2]);
+  par_size = argc-4;
+  validation_size = sample_size/5;
+
+  if (emulator_init(&em,par_size,_DEGREE_,errmsg) == _FAILURE_) {
+    printf("\n\nError running emulator_init \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  /* names and box of the emulated parameters */
+  for (index_par=0; index_par<par_size; index_par++) {
+    separator = strchr(argv[4+index_par],'=');
+    if ((separator == NULL) || (sscanf(separator+1,"%lf:%lf",&(em.par_min[index_par]),&(em.par_max[index_par])) != 2) ||
+        (em.par_max[index_par] <= em.par_min[index_par])) {
+      printf("\n\nCould not read '%s' as <name>=<min>:<max>\n",argv[4+index_par]);
+      return _FAILURE_;
+    }
+    strncpy(em.par_name[index_par],argv[4+index_par],separator-argv[4+index_par]);
+  }
+
+  /* input file without the emulated parameters, which are appended at the end */
+  if (parser_read_file(argv[3],&fc_file,errmsg) == _FAILURE_) {
+    printf("\n\nError running parser_read_file \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  if (parser_init(&fc,fc_file.size+par_size,"emulator",errmsg) == _FAILURE_) {
+    printf("\n\nError running parser_init \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+  em.fixed_size = 0;
+  em.fixed_name = calloc(fc_file.size+1,sizeof(FileArg));
+  em.fixed_value = calloc(fc_file.size+1,sizeof(FileArg));
+  index_fc = 0;
+  for (index=0; index<fc_file.size; index++) {
+    for (index_par=0; index_par<par_size; index_par++) {
+      if (strcmp(fc_file.name[index],em.par_name[index_par]) == 0)
+        break;
+    }
+    if (index_par == par_size) {
+      strcpy(fc.name[index_fc],fc_file.name[index]);
+      strcpy(fc.value[index_fc],fc_file.value[index]);
+      index_fc++;
+      if (is_output_only(fc_file.name[index]) == _FALSE_) {
+        strcpy(em.fixed_name[em.fixed_size],fc_file.name[index]);
+        strcpy(em.fixed_value[em.fixed_size],fc_file.value[index]);
+        em.fixed_size++;
+      }
+    }
+  }
+  for (index_par=0; index_par<par_size; index_par++) {
+    strcpy(fc.name[index_fc+index_par],em.par_name[index_par]);
+  }
+  fc.size = index_fc+par_size;
+  parser_free(&fc_file);
+
+  if (parser_index(&fc,errmsg) == _FAILURE_) {
+    printf("\n\nError running parser_index \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  /* Latin hypercube: along each parameter, one run in each of sample_size strata, in random order */
+  parameters = malloc(sample_size*par_size*sizeof(double));
+  stratum = malloc(sample_size*sizeof(int));
+  srand(_SEED_);
+  for (index_par=0; index_par<par_size; index_par++) {
+    for (index_sample=0; index_sample<sample_size; index_sample++)
+      stratum[index_sample] = index_sample;
+    for (index_sample=sample_size-1; index_sample>0; index_sample--) {
+      index = rand() % (index_sample+1);
+      swap = stratum[index];
+      stratum[index] = stratum[index_sample];
+      stratum[index_sample] = swap;
+    }
+    for (index_sample=0; index_sample<sample_size; index_sample++) {
+      parameters[index_sample*par_size+index_par] = em.par_min[index_par]
+        + (em.par_max[index_par]-em.par_min[index_par])*(stratum[index_sample]+rand()/(RAND_MAX+1.))/sample_size;
+    }
+  }
+  free(stratum);
+
+  outputs = NULL;
+
+  for (index_sample=0; index_sample<sample_size; index_sample++) {
+
+    for (index_par=0; index_par<par_size; index_par++)
+      sprintf(fc.value[index_fc+index_par],"%.16e",parameters[index_sample*par_size+index_par]);
+    for (index=0; index<fc.size; index++)
+      fc.read[index] = _FALSE_;
+
+    if (input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg) == _FAILURE_) {
+      printf("\n\nError running input_read_from_file \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+
+    if (background_init(&pr,&ba) == _FAILURE_) {
+      printf("\n\nError running background_init \n=>%s\n",ba.error_message);
+      return _FAILURE_;
+    }
+
+    if (thermodynamics_init(&pr,&ba,&th) == _FAILURE_) {
+      printf("\n\nError in thermodynamics_init \n=>%s\n",th.error_message);
+      return _FAILURE_;
+    }
+
+    if (perturbations_init(&pr,&ba,&th,&pt) == _FAILURE_) {
+      printf("\n\nError in perturbations_init \n=>%s\n",pt.error_message);
+      return _FAILURE_;
+    }
+
+    if (primordial_init(&pr,&pt,&pm) == _FAILURE_) {
+      printf("\n\nError in primordial_init \n=>%s\n",pm.error_message);
+      return _FAILURE_;
+    }
+
+    if (fourier_init(&pr,&ba,&th,&pt,&pm,&fo) == _FAILURE_) {
+      printf("\n\nError in fourier_init \n=>%s\n",fo.error_message);
+      return _FAILURE_;
+    }
+
+    if (transfer_init(&pr,&ba,&th,&pt,&fo,&tr) == _FAILURE_) {
+      printf("\n\nError in transfer_init \n=>%s\n",tr.error_message);
+      return _FAILURE_;
+    }
+
+    if (harmonic_init(&pr,&ba,&pt,&pm,&fo,&tr,&hr) == _FAILURE_) {
+      printf("\n\nError in harmonic_init \n=>%s\n",hr.error_message);
+      return _FAILURE_;
+    }
+
+    if (lensing_init(&pr,&pt,&hr,&fo,&le) == _FAILURE_) {
+      printf("\n\nError in lensing_init \n=>%s\n",le.error_message);
+      return _FAILURE_;
+    }
+
+    /* the layout of the outputs, once the first run tells which ones are available */
+    if (index_sample == 0) {
+
+      for (index_type=0; index_type<_EMULATOR_CL_TYPES_; index_type++)
+        has_cl[index_type] = _FALSE_;
+
+      if (le.has_lensed_cls == _TRUE_) {
+        has_cl[emulator_tt] = le.has_tt; index_lt[emulator_tt] = le.index_lt_tt;
+        has_cl[emulator_ee] = le.has_ee; index_lt[emulator_ee] = le.index_lt_ee;
+        has_cl[emulator_te] = le.has_te; index_lt[emulator_te] = le.index_lt_te;
+        has_cl[emulator_bb] = le.has_bb; index_lt[emulator_bb] = le.index_lt_bb;
+        has_cl[emulator_pp] = le.has_pp; index_lt[emulator_pp] = le.index_lt_pp;
+      }
+
+      k_size = 0;
+      k_min = 0.;
+      k_max = 0.;
+      if (pt.has_pk_matter == _TRUE_) {
+        /* stay away from the edges of the k sampling, which move with the parameters */
+        k_min = fo.k[0]*2.;
+        k_max = pt.k_max_for_pk/1.2;
+        k_size = (int)(_K_PER_DECADE_*log10(k_max/k_min))+2;
+      }
+
+      if (emulator_outputs_init(&em,has_cl,le.l_lensed_max,k_size,k_min,k_max,
+                                (pt.z_max_pk > 0. ? _Z_SIZE_ : 1),pt.z_max_pk,
+                                (fo.method > nl_none ? _TRUE_ : _FALSE_),errmsg) == _FAILURE_) {
+        printf("\n\nError in emulator_outputs_init \n=>%s\n",errmsg);
+        return _FAILURE_;
+      }
+
+      outputs = malloc(sample_size*em.out_size*sizeof(double));
+      cl_lensed = malloc(le.lt_size*sizeof(double));
+    }
+
+    out = outputs+index_sample*em.out_size;
+
+    for (l=2; l<=em.l_max; l++) {
+      if (lensing_cl_at_l(&le,l,cl_lensed) == _FAILURE_) {
+        printf("\n\nError in lensing_cl_at_l \n=>%s\n",le.error_message);
+        return _FAILURE_;
+      }
+      for (index_type=0; index_type<_EMULATOR_CL_TYPES_; index_type++) {
+        if ((has_cl[index_type] == _FALSE_) || (index_type == emulator_te))
+          continue;
+        if (cl_lensed[index_lt[index_type]] <= 0.) {
+          printf("\n\nA lensed C_l of type %d is not positive at l=%d: it cannot be emulated\n",index_type,l);
+          return _FAILURE_;
+        }
+        out[em.index_cl[index_type]+l-2] = log(cl_lensed[index_lt[index_type]]);
+      }
+      if (has_cl[emulator_te] == _TRUE_)
+        out[em.index_cl[emulator_te]+l-2] = cl_lensed[index_lt[emulator_te]]
+          /sqrt(cl_lensed[index_lt[emulator_tt]]*cl_lensed[index_lt[emulator_ee]]);
+    }
+
+    for (index_z=0; index_z<em.z_size; index_z++) {
+      for (index_k=0; index_k<em.k_size; index_k++) {
+        if (fourier_pk_at_k_and_z(&ba,&pm,&fo,(em.pk_nonlinear == _TRUE_ ? pk_nonlinear : pk_linear),
+                                  exp(em.ln_k[index_k]),em.z[index_z],fo.index_pk_m,&pk,NULL) == _FAILURE_) {
+          printf("\n\nError in fourier_pk_at_k_and_z \n=>%s\n",fo.error_message);
+          return _FAILURE_;
+        }
+        out[em.index_pk+index_z*em.k_size+index_k] = log(pk);
+      }
+    }
+
+    printf("run %d/%d:",index_sample+1,sample_size);
+    for (index_par=0; index_par<par_size; index_par++)
+      printf(" %s=%g",em.par_name[index_par],parameters[index_sample*par_size+index_par]);
+    printf("\n");
+
+    if (lensing_free(&le) == _FAILURE_) {
+      printf("\n\nError in lensing_free \n=>%s\n",le.error_message);
+      return _FAILURE_;
+    }
+
+    if (harmonic_free(&hr) == _FAILURE_) {
+      printf("\n\nError in harmonic_free \n=>%s\n",hr.error_message);
+      return _FAILURE_;
+    }
+
+    if (transfer_free(&tr) == _FAILURE_) {
+      printf("\n\nError in transfer_free \n=>%s\n",tr.error_message);
+      return _FAILURE_;
+    }
+
+    if (fourier_free(&fo) == _FAILURE_) {
+      printf("\n\nError in fourier_free \n=>%s\n",fo.error_message);
+      return _FAILURE_;
+    }
+
+    if (primordial_free(&pm) == _FAILURE_) {
+      printf("\n\nError in primordial_free \n=>%s\n",pm.error_message);
+      return _FAILURE_;
+    }
+
+    if (perturbations_free(&pt) == _FAILURE_) {
+      printf("\n\nError in perturbations_free \n=>%s\n",pt.error_message);
+      return _FAILURE_;
+    }
+
+    if (thermodynamics_free(&th) == _FAILURE_) {
+      printf("\n\nError in thermodynamics_free \n=>%s\n",th.error_message);
+      return _FAILURE_;
+    }
+
+    if (background_free(&ba) == _FAILURE_) {
+      printf("\n\nError in background_free \n=>%s\n",ba.error_message);
+      return _FAILURE_;
+    }
+  }
+
+  if (emulator_train(&em,sample_size,validation_size,parameters,outputs,errmsg) == _FAILURE_) {
+    printf("\n\nError in emulator_train \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  printf("%d monomials fitted on %d runs; largest residuals over %d validation runs: %e on ln(C_l), %e on ln(P(k,z))\n",
+         em.basis_size,sample_size,validation_size,em.error_cl_max,em.error_pk_max);
+
+  if (emulator_write(&em,argv[1],errmsg) == _FAILURE_) {
+    printf("\n\nError in emulator_write \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  free(parameters);
+  free(outputs);
+  free(cl_lensed);
+  emulator_free(&em);
+  parser_free(&fc);
+
+  return _SUCCESS_;
+
+}
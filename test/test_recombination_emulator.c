@@ -0,0 +1,228 @@
+/** @file test_recombination_emulator.c
+ *
+ * Write the grid of recombination histories read by the
+ * recombination emulator of the thermodynamics module
+ * ('recombination_emulator = yes', file given by the precision
+ * parameter 'recombination_emulator_file').
+ *
+ * Usage: ./test_recombination_emulator <grid file> [<input file> ...]
+ *
+ * The optional input files fix all the parameters of the runs apart
+ * from omega_b, omega_cdm, YHe and N_ur, which are set to the nodes of
+ * the grid below. They should not contain ncdm species, since N_eff is
+ * identified with N_ur.
+ */
+
+#include "class.h"
+
+/* nodes of the grid along omega_b, omega_cdm, YHe and N_eff (edit to change the grid) */
+#define _OMEGA_B_SIZE_ 7
+#define _OMEGA_CDM_SIZE_ 7
+#define _YHE_SIZE_ 3
+#define _NEFF_SIZE_ 3
+
+/* the redshifts of the thermodynamics table are written whenever ln(1+z) has decreased by _DLN1PZ_, plus the first and last ones */
+#define _DLN1PZ_ 0.005
+
+int main(int argc, char **argv) {
+
+  struct precision pr;        /* for precision parameters */
+  struct background ba;       /* for cosmological background */
+  struct thermodynamics th;           /* for thermodynamics */
+  struct perturbations pt;         /* for source functions */
+  struct transfer tr;        /* for transfer functions */
+  struct primordial pm;       /* for primordial spectra */
+  struct harmonic hr;          /* for output spectra */
+  struct fourier fo;        /* for non-linear spectra */
+  struct lensing le;          /* for lensed sepctra */
+  struct distortions sd;      /* for spectral distortions */
+  struct output op;           /* for output files */
+  ErrorMsg errmsg;            /* for error message */
+
+  struct file_content fc_base;
+  struct file_content fc;
+  char * grid_names[_RECOMBINATION_EMULATOR_AXES_] = {"omega_b","omega_cdm","YHe","N_ur"};
+  int axis_size[_RECOMBINATION_EMULATOR_AXES_] = {_OMEGA_B_SIZE_,_OMEGA_CDM_SIZE_,_YHE_SIZE_,_NEFF_SIZE_};
+  double axis_min[_RECOMBINATION_EMULATOR_AXES_] = {0.0200,0.100,0.23,2.5};
+  double axis_max[_RECOMBINATION_EMULATOR_AXES_] = {0.0245,0.140,0.27,3.5};
+  double values[_RECOMBINATION_EMULATOR_AXES_];
+  int index_node[_RECOMBINATION_EMULATOR_AXES_];
+  int node_size;
+  int index_axis;
+  int index;
+  int index_file;
+  int index_fc;
+  int node;
+  int index_z;
+  int index_z_min = 0;
+  int z_size = 0;
+  int * z_rows = NULL;
+  FILE * grid;
+  struct file_content fc_file;
+
+  if (argc < 2) {
+    printf("Usage: %s <grid file> [<input file> ...]\n",argv[0]);
+    return _FAILURE_;
+  }
+
+  /* concatenate the optional input files, without the parameters set by the grid */
+  fc_base.size = 0;
+  fc_base.hash_size = 0;
+  for (index_file=2; index_file<argc; index_file++) {
+    if (parser_read_file(argv[index_file],&fc_file,errmsg) == _FAILURE_) {
+      printf("\n\nError running parser_read_file \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+    if (parser_cat(&fc_base,&fc_file,&fc,errmsg) == _FAILURE_) {
+      printf("\n\nError running parser_cat \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+    parser_free(&fc_base);
+    parser_free(&fc_file);
+    fc_base = fc;
+  }
+
+  if (parser_init(&fc,fc_base.size+_RECOMBINATION_EMULATOR_AXES_,"recombination_emulator",errmsg) == _FAILURE_) {
+    printf("\n\nError running parser_init \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+  index_fc = 0;
+  for (index=0; index<fc_base.size; index++) {
+    for (index_axis=0; index_axis<_RECOMBINATION_EMULATOR_AXES_; index_axis++) {
+      if (strcmp(fc_base.name[index],grid_names[index_axis]) == 0)
+        break;
+    }
+    if (index_axis == _RECOMBINATION_EMULATOR_AXES_) {
+      strcpy(fc.name[index_fc],fc_base.name[index]);
+      strcpy(fc.value[index_fc],fc_base.value[index]);
+      index_fc++;
+    }
+  }
+  for (index_axis=0; index_axis<_RECOMBINATION_EMULATOR_AXES_; index_axis++) {
+    strcpy(fc.name[index_fc+index_axis],grid_names[index_axis]);
+  }
+  fc.size = index_fc+_RECOMBINATION_EMULATOR_AXES_;
+  parser_free(&fc_base);
+
+  if (parser_index(&fc,errmsg) == _FAILURE_) {
+    printf("\n\nError running parser_index \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  node_size = 1;
+  for (index_axis=0; index_axis<_RECOMBINATION_EMULATOR_AXES_; index_axis++) {
+    node_size *= axis_size[index_axis];
+  }
+
+  grid = fopen(argv[1],"w");
+  if (grid == NULL) {
+    printf("\n\nCould not open %s for writing\n",argv[1]);
+    return _FAILURE_;
+  }
+
+  /* run the background and thermodynamics modules at each node, N_eff running fastest */
+  for (node=0; node<node_size; node++) {
+
+    index = node;
+    for (index_axis=_RECOMBINATION_EMULATOR_AXES_-1; index_axis>=0; index_axis--) {
+      index_node[index_axis] = index % axis_size[index_axis];
+      index /= axis_size[index_axis];
+      if (axis_size[index_axis] > 1)
+        values[index_axis] = axis_min[index_axis]
+          + (axis_max[index_axis]-axis_min[index_axis])*index_node[index_axis]/(axis_size[index_axis]-1.);
+      else
+        values[index_axis] = axis_min[index_axis];
+      sprintf(fc.value[index_fc+index_axis],"%.10e",values[index_axis]);
+    }
+    for (index=0; index<fc.size; index++) {
+      fc.read[index] = _FALSE_;
+    }
+
+    if (input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg) == _FAILURE_) {
+      printf("\n\nError running input_read_from_file \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+
+    /* never emulate while computing the grid */
+    th.has_recombination_emulator = _FALSE_;
+
+    if (background_init(&pr,&ba) == _FAILURE_) {
+      printf("\n\nError running background_init \n=>%s\n",ba.error_message);
+      return _FAILURE_;
+    }
+
+    if (fabs(ba.Neff-values[3]) > 1.e-3) {
+      printf("\n\nN_eff=%g differs from N_ur=%g: the input files should not contain ncdm species\n",ba.Neff,values[3]);
+      return _FAILURE_;
+    }
+
+    if (thermodynamics_init(&pr,&ba,&th) == _FAILURE_) {
+      printf("\n\nError in thermodynamics_init \n=>%s\n",th.error_message);
+      return _FAILURE_;
+    }
+
+    /* the header, once the redshifts of the table are known */
+    if (node == 0) {
+      /* the first redshift written is the last one below the start of reionization */
+      while ((index_z_min < th.tt_size-1) && (th.z_table[index_z_min+1] <= pr.reionization_z_start_max)) {
+        index_z_min++;
+      }
+      z_rows = malloc(th.tt_size*sizeof(int));
+      z_rows[0] = th.tt_size-1;
+      z_size = 1;
+      for (index_z=th.tt_size-2; index_z>index_z_min; index_z--) {
+        if (log((1.+th.z_table[z_rows[z_size-1]])/(1.+th.z_table[index_z])) >= _DLN1PZ_)
+          z_rows[z_size++] = index_z;
+      }
+      z_rows[z_size++] = index_z_min;
+      fprintf(grid,"# grid of recombination histories for the recombination emulator of CLASS\n");
+      fprintf(grid,"# recombination code, T_cmb\n");
+      fprintf(grid,"%s %.10e\n",(th.recombination == hyrec ? "hyrec" : "recfast"),ba.T_cmb);
+      fprintf(grid,"# numbers of nodes along omega_b, omega_cdm, YHe, N_eff, and number of redshifts\n");
+      fprintf(grid,"%d %d %d %d %d\n",axis_size[0],axis_size[1],axis_size[2],axis_size[3],z_size);
+      for (index_axis=0; index_axis<_RECOMBINATION_EMULATOR_AXES_; index_axis++) {
+        fprintf(grid,"# nodes along %s\n",grid_names[index_axis]);
+        for (index=0; index<axis_size[index_axis]; index++) {
+          if (axis_size[index_axis] > 1)
+            fprintf(grid,"%.10e\n",axis_min[index_axis]+(axis_max[index_axis]-axis_min[index_axis])*index/(axis_size[index_axis]-1.));
+          else
+            fprintf(grid,"%.10e\n",axis_min[index_axis]);
+        }
+      }
+      fprintf(grid,"# redshifts\n");
+      for (index=z_size-1; index>=0; index--) {
+        fprintf(grid,"%.10e\n",th.z_table[z_rows[index]]);
+      }
+    }
+
+    fprintf(grid,"# x_e, T_b, dT_b/dz for omega_b=%g, omega_cdm=%g, YHe=%g, N_eff=%g\n",
+            values[0],values[1],values[2],values[3]);
+    for (index=z_size-1; index>=0; index--) {
+      index_z = z_rows[index];
+      fprintf(grid,"%.10e %.10e %.10e\n",
+              th.thermodynamics_table[index_z*th.th_size+th.index_th_xe],
+              th.thermodynamics_table[index_z*th.th_size+th.index_th_Tb],
+              th.thermodynamics_table[index_z*th.th_size+th.index_th_dTb]);
+    }
+
+    printf("node %d/%d: omega_b=%g, omega_cdm=%g, YHe=%g, N_eff=%g\n",
+           node+1,node_size,values[0],values[1],values[2],values[3]);
+
+    if (thermodynamics_free(&th) == _FAILURE_) {
+      printf("\n\nError in thermodynamics_free \n=>%s\n",th.error_message);
+      return _FAILURE_;
+    }
+
+    if (background_free(&ba) == _FAILURE_) {
+      printf("\n\nError in background_free \n=>%s\n",ba.error_message);
+      return _FAILURE_;
+    }
+  }
+
+  fclose(grid);
+  free(z_rows);
+  parser_free(&fc);
+
+  return _SUCCESS_;
+
+}
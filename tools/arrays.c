@@ -550,167 +550,291 @@ int array_spline_table_line_to_line(
   return _SUCCESS_;
  }
 
-int array_spline_table_lines(
-			     double * x, /* vector of size x_size */
-			     int x_size,
-			     double * y_array, /* array of size x_size*y_size with elements
-						  y_array[index_x*y_size+index_y] */
-			     int y_size,
-			     double * ddy_array, /* array of size x_size*y_size */
-			     short spline_mode,
-			     ErrorMsg errmsg
-			     ) {
+/**
+ * Compute the coefficients of the cubic spline equations which only
+ * depend on the sampling x, and not on the splined function. In the
+ * tridiagonal system, the pivots and the elimination factors are the
+ * same for all columns of a table: computing them once avoids most
+ * divisions in the loops over columns.
+ *
+ * The second derivatives differ from those of array_spline() at the
+ * level of rounding errors only, but adaptive integrators fed with
+ * these tables (e.g. in the thermodynamics module) may then choose
+ * other steps: with the default precision, this moves the LCDM C_l's
+ * by a few 1e-5 compared with the division-based loops.
+ *
+ * @param x           Input: vector of size x_size
+ * @param x_size      Input: number of sampled values (at least 2)
+ * @param spline_mode Input: _SPLINE_NATURAL_ or _SPLINE_EST_DERIV_
+ * @param psc         Output: coefficients, to be freed with array_spline_coefficients_free()
+ * @param errmsg      Output: error message
+ * @return the error status
+ */
 
-  double * p;
-  double * qn;
-  double * un;
-  double * u;
-  double sig;
-  int index_x;
-  int index_y;
-  double dy_first;
-  double dy_last;
+int array_spline_coefficients_init(
+                                   double * x,
+                                   int x_size,
+                                   short spline_mode,
+                                   struct spline_coefficients * psc,
+                                   ErrorMsg errmsg
+                                   ) {
 
-  u = malloc((x_size-1) * y_size * sizeof(double));
-  p = malloc(y_size * sizeof(double));
-  qn = malloc(y_size * sizeof(double));
-  un = malloc(y_size * sizeof(double));
+  int index_x;
+  double p;
 
-  if (u == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate u",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (p == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate p",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (qn == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate qn",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (un == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate un",__func__,__LINE__);
-    return _FAILURE_;
-  }
+  class_test(x_size < 2,
+             errmsg,
+             "cannot spline a function sampled in %d point(s)",x_size);
 
   if (x_size==2) spline_mode = _SPLINE_NATURAL_; // in the case of only 2 x-values, only the natural spline method is appropriate, for _SPLINE_EST_DERIV_ at least 3 x-values are needed.
 
-  index_x=0;
-
-  if (spline_mode == _SPLINE_NATURAL_) {
-    for (index_y=0; index_y < y_size; index_y++) {
-      ddy_array[index_x*y_size+index_y] = u[index_x*y_size+index_y] = 0.0;
-    }
-  }
-  else {
-    if (spline_mode == _SPLINE_EST_DERIV_) {
-
-      for (index_y=0; index_y < y_size; index_y++) {
+  class_test((spline_mode != _SPLINE_NATURAL_) && (spline_mode != _SPLINE_EST_DERIV_),
+             errmsg,
+             "Spline mode not identified: %d",spline_mode);
 
-	dy_first =
-	  ((x[2]-x[0])*(x[2]-x[0])*
-	   (y_array[1*y_size+index_y]-y_array[0*y_size+index_y])-
-	   (x[1]-x[0])*(x[1]-x[0])*
-	   (y_array[2*y_size+index_y]-y_array[0*y_size+index_y]))/
-	  ((x[2]-x[0])*(x[1]-x[0])*(x[2]-x[1]));
+  psc->x_size = x_size;
+  psc->spline_mode = spline_mode;
 
-	ddy_array[index_x*y_size+index_y] = -0.5;
+  class_alloc(psc->sig,5*x_size*sizeof(double),errmsg);
+  psc->w = psc->sig + x_size;
+  psc->inv_p = psc->w + x_size;
+  psc->inv_dx = psc->inv_p + x_size;
+  psc->six_over_dx2 = psc->inv_dx + x_size;
 
-	u[index_x*y_size+index_y] =
-	  (3./(x[1] -  x[0]))*
-	  ((y_array[1*y_size+index_y]-y_array[0*y_size+index_y])/
-	   (x[1] - x[0])-dy_first);
+  for (index_x=0; index_x < x_size-1; index_x++)
+    psc->inv_dx[index_x] = 1./(x[index_x+1] - x[index_x]);
 
-      }
-    }
-    else {
-      sprintf(errmsg,"%s(L:%d) Spline mode not identified: %d",__func__,__LINE__,spline_mode);
-      return _FAILURE_;
-    }
+  if (spline_mode == _SPLINE_NATURAL_) {
+    psc->w[0] = 0.;
+    psc->first_a1 = 0.;
+    psc->first_a2 = 0.;
+    psc->last_a1 = 0.;
+    psc->last_a2 = 0.;
+    psc->qn = 0.;
+  }
+  else {
+    class_test(x[2]-x[0]==0.,
+               errmsg,
+               "x[2]=%g, x[0]=%g, stop to avoid seg fault",x[2],x[0]);
+    class_test(x[1]-x[0]==0.,
+               errmsg,
+               "x[1]=%g, x[0]=%g, stop to avoid seg fault",x[1],x[0]);
+    class_test(x[2]-x[1]==0.,
+               errmsg,
+               "x[2]=%g, x[1]=%g, stop to avoid seg fault",x[2],x[1]);
+    psc->w[0] = -0.5;
+    psc->first_a1 = (x[2]-x[0])/((x[1]-x[0])*(x[2]-x[1]));
+    psc->first_a2 = (x[1]-x[0])/((x[2]-x[0])*(x[2]-x[1]));
+    psc->last_a1 = (x[x_size-3]-x[x_size-1])/((x[x_size-2]-x[x_size-1])*(x[x_size-3]-x[x_size-2]));
+    psc->last_a2 = (x[x_size-2]-x[x_size-1])/((x[x_size-3]-x[x_size-1])*(x[x_size-3]-x[x_size-2]));
+    psc->qn = 0.5;
   }
-
 
   for (index_x=1; index_x < x_size-1; index_x++) {
+    psc->sig[index_x] = (x[index_x] - x[index_x-1])/(x[index_x+1] - x[index_x-1]);
+    p = psc->sig[index_x] * psc->w[index_x-1] + 2.0;
+    psc->w[index_x] = (psc->sig[index_x]-1.0)/p;
+    psc->inv_p[index_x] = 1./p;
+    psc->six_over_dx2[index_x] = 6.0/(x[index_x+1] - x[index_x-1]);
+  }
 
-    sig = (x[index_x] - x[index_x-1])/(x[index_x+1] - x[index_x-1]);
+  psc->last_inv_denominator = 1./(psc->qn * psc->w[x_size-2] + 1.0);
 
-    for (index_y=0; index_y < y_size; index_y++) {
+  return _SUCCESS_;
+}
 
-      p[index_y] = sig * ddy_array[(index_x-1)*y_size+index_y] + 2.0;
+/**
+ * Free the coefficients allocated by array_spline_coefficients_init().
+ *
+ * @param psc Input: coefficients
+ * @return the error status
+ */
 
-      ddy_array[index_x*y_size+index_y] = (sig-1.0)/p[index_y];
+int array_spline_coefficients_free(
+                                   struct spline_coefficients * psc
+                                   ) {
+  free(psc->sig);
+  return _SUCCESS_;
+}
 
-      u[index_x*y_size+index_y] =
-	(y_array[(index_x+1)*y_size+index_y] - y_array[index_x*y_size+index_y])
-	/ (x[index_x+1] - x[index_x])
-	- (y_array[index_x*y_size+index_y] - y_array[(index_x-1)*y_size+index_y])
-	/ (x[index_x] - x[index_x-1]);
+/**
+ * Spline a block of columns of a table, given the coefficients
+ * returned by array_spline_coefficients_init(). The value of column
+ * index_y at x[index_x] is y_array[index_x*x_stride+index_y*y_stride],
+ * so that the same routine applies to tables stored by lines
+ * (x_stride=y_size, y_stride=1) or by columns (x_stride=1,
+ * y_stride=x_size). In each step of the forward and backward sweeps, all
+ * columns of the block are processed together: their recurrences are
+ * independent, so this loop can be vectorized, and the block is small
+ * enough for the part of the table being worked on to stay in cache.
+ * ddy_array is used as workspace during the forward sweep.
+ *
+ * @param psc         Input: spline coefficients
+ * @param y_array     Input: table of values
+ * @param ddy_array   Output: table of second derivatives, with the same layout
+ * @param x_stride    Input: distance between two consecutive values of x in a column
+ * @param y_stride    Input: distance between two consecutive columns
+ * @param index_y_min Input: first column of the block
+ * @param index_y_max Input: last column of the block plus one
+ * @return the error status
+ */
 
-      u[index_x*y_size+index_y] = (6.0 * u[index_x*y_size+index_y] /
-				   (x[index_x+1] - x[index_x-1])
-				   - sig * u[(index_x-1)*y_size+index_y]) / p[index_y];
+int array_spline_table_block(
+                             struct spline_coefficients * psc,
+                             double * y_array,
+                             double * ddy_array,
+                             int x_stride,
+                             int y_stride,
+                             int index_y_min,
+                             int index_y_max
+                             ) {
+
+  int x_size = psc->x_size;
+  int index_x,index_y;
+  double * y;
+  double * ddy;
+  double dy_first,dy_last,un;
+  double inv_dx,inv_dx_prev,six_over_dx2,sig,inv_p,w;
+
+  /** - first point: ddy_array temporarily contains the right-hand side u of the eliminated system */
+
+  y = y_array;
+  ddy = ddy_array;
+  inv_dx = psc->inv_dx[0];
+
+  if (psc->spline_mode == _SPLINE_NATURAL_) {
+    for (index_y=index_y_min; index_y < index_y_max; index_y++)
+      ddy[index_y*y_stride] = 0.0;
+  }
+  else {
+    for (index_y=index_y_min; index_y < index_y_max; index_y++) {
+      dy_first = psc->first_a1*(y[index_y*y_stride+x_stride]-y[index_y*y_stride])
+        - psc->first_a2*(y[index_y*y_stride+2*x_stride]-y[index_y*y_stride]);
+      ddy[index_y*y_stride] = 3.*inv_dx*((y[index_y*y_stride+x_stride]-y[index_y*y_stride])*inv_dx-dy_first);
     }
-
   }
 
-  if (spline_mode == _SPLINE_NATURAL_) {
+  /** - forward sweep */
 
-    for (index_y=0; index_y < y_size; index_y++) {
-      qn[index_y]=un[index_y]=0.0;
-    }
-
-  }
-  else {
-    if (spline_mode == _SPLINE_EST_DERIV_) {
+  for (index_x=1; index_x < x_size-1; index_x++) {
 
-      for (index_y=0; index_y < y_size; index_y++) {
+    y = y_array + index_x*x_stride;
+    ddy = ddy_array + index_x*x_stride;
+    inv_dx_prev = psc->inv_dx[index_x-1];
+    inv_dx = psc->inv_dx[index_x];
+    six_over_dx2 = psc->six_over_dx2[index_x];
+    sig = psc->sig[index_x];
+    inv_p = psc->inv_p[index_x];
 
-	dy_last =
-	  ((x[x_size-3]-x[x_size-1])*(x[x_size-3]-x[x_size-1])*
-	   (y_array[(x_size-2)*y_size+index_y]-y_array[(x_size-1)*y_size+index_y])-
-	   (x[x_size-2]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*
-	   (y_array[(x_size-3)*y_size+index_y]-y_array[(x_size-1)*y_size+index_y]))/
-	  ((x[x_size-3]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*(x[x_size-3]-x[x_size-2]));
+    for (index_y=index_y_min; index_y < index_y_max; index_y++) {
+      ddy[index_y*y_stride] =
+        (((y[index_y*y_stride+x_stride] - y[index_y*y_stride])*inv_dx
+          - (y[index_y*y_stride] - y[index_y*y_stride-x_stride])*inv_dx_prev)*six_over_dx2
+         - sig*ddy[index_y*y_stride-x_stride])*inv_p;
+    }
+  }
 
-	qn[index_y]=0.5;
+  /** - last point */
 
-	un[index_y]=
-	  (3./(x[x_size-1] - x[x_size-2]))*
-	  (dy_last-(y_array[(x_size-1)*y_size+index_y] - y_array[(x_size-2)*y_size+index_y])/
-	   (x[x_size-1] - x[x_size-2]));
+  y = y_array + (x_size-1)*x_stride;
+  ddy = ddy_array + (x_size-1)*x_stride;
+  inv_dx = psc->inv_dx[x_size-2];
 
-      }
+  for (index_y=index_y_min; index_y < index_y_max; index_y++) {
+    if (psc->spline_mode == _SPLINE_NATURAL_) {
+      un = 0.;
     }
     else {
-      sprintf(errmsg,"%s(L:%d) Spline mode not identified: %d",__func__,__LINE__,spline_mode);
-      return _FAILURE_;
+      dy_last = psc->last_a1*(y[index_y*y_stride-x_stride]-y[index_y*y_stride])
+        - psc->last_a2*(y[index_y*y_stride-2*x_stride]-y[index_y*y_stride]);
+      un = 3.*inv_dx*(dy_last-(y[index_y*y_stride]-y[index_y*y_stride-x_stride])*inv_dx);
     }
+    ddy[index_y*y_stride] = (un - psc->qn*ddy[index_y*y_stride-x_stride])*psc->last_inv_denominator;
   }
 
-  index_x=x_size-1;
+  /** - backward sweep */
 
-  for (index_y=0; index_y < y_size; index_y++) {
-    ddy_array[index_x*y_size+index_y] =
-      (un[index_y] - qn[index_y] * u[(index_x-1)*y_size+index_y]) /
-      (qn[index_y] * ddy_array[(index_x-1)*y_size+index_y] + 1.0);
+  for (index_x=x_size-2; index_x >= 0; index_x--) {
+    ddy = ddy_array + index_x*x_stride;
+    w = psc->w[index_x];
+    for (index_y=index_y_min; index_y < index_y_max; index_y++)
+      ddy[index_y*y_stride] = w*ddy[index_y*y_stride+x_stride] + ddy[index_y*y_stride];
   }
 
-  for (index_x=x_size-2; index_x >= 0; index_x--) {
-    for (index_y=0; index_y < y_size; index_y++) {
+  return _SUCCESS_;
+}
+
+/**
+ * Spline all columns of a table, block by block, in parallel if the
+ * table is large enough (see array_spline_table_block() for the
+ * meaning of x_stride and y_stride).
+ *
+ * @param x           Input: vector of size x_size
+ * @param x_size      Input: number of sampled values
+ * @param y_array     Input: table of values
+ * @param y_size      Input: number of columns
+ * @param ddy_array   Output: table of second derivatives, with the same layout
+ * @param x_stride    Input: distance between two consecutive values of x in a column
+ * @param y_stride    Input: distance between two consecutive columns
+ * @param spline_mode Input: _SPLINE_NATURAL_ or _SPLINE_EST_DERIV_
+ * @param errmsg      Output: error message
+ * @return the error status
+ */
 
-      ddy_array[index_x*y_size+index_y] = ddy_array[index_x*y_size+index_y] *
-	ddy_array[(index_x+1)*y_size+index_y] + u[index_x*y_size+index_y];
+int array_spline_table_strided(
+                               double * x,
+                               int x_size,
+                               double * y_array,
+                               int y_size,
+                               double * ddy_array,
+                               int x_stride,
+                               int y_stride,
+                               short spline_mode,
+                               ErrorMsg errmsg
+                               ) {
+
+  struct spline_coefficients sc;
+  int index_block,block_number;
+
+  class_call(array_spline_coefficients_init(x,x_size,spline_mode,&sc,errmsg),
+             errmsg,
+             errmsg);
 
-    }
+  block_number = (y_size+_SPLINE_BLOCK_SIZE_-1)/_SPLINE_BLOCK_SIZE_;
+
+#pragma omp parallel for schedule (static) if ((long)x_size*y_size >= _SPLINE_PARALLEL_MIN_SIZE_)
+  for (index_block=0; index_block < block_number; index_block++) {
+    array_spline_table_block(&sc,
+                             y_array,
+                             ddy_array,
+                             x_stride,
+                             y_stride,
+                             index_block*_SPLINE_BLOCK_SIZE_,
+                             MIN((index_block+1)*_SPLINE_BLOCK_SIZE_,y_size));
   }
 
-  free(qn);
-  free(un);
-  free(p);
-  free(u);
+  array_spline_coefficients_free(&sc);
 
   return _SUCCESS_;
- }
+}
+
+int array_spline_table_lines(
+			     double * x, /* vector of size x_size */
+			     int x_size,
+			     double * y_array, /* array of size x_size*y_size with elements
+						  y_array[index_x*y_size+index_y] */
+			     int y_size,
+			     double * ddy_array, /* array of size x_size*y_size */
+			     short spline_mode,
+			     ErrorMsg errmsg
+			     ) {
+
+  class_call(array_spline_table_strided(x,x_size,y_array,y_size,ddy_array,y_size,1,spline_mode,errmsg),
+             errmsg,
+             errmsg);
+
+  return _SUCCESS_;
+}
 
 int array_logspline_table_lines(
 			     double * x, /* vector of size x_size */
@@ -885,165 +1009,12 @@ int array_spline_table_columns(
 		       ErrorMsg errmsg
 		       ) {
 
-  double * p;
-  double * qn;
-  double * un;
-  double * u;
-  double sig;
-  int index_x;
-  int index_y;
-  double dy_first;
-  double dy_last;
-
-  u = malloc((x_size-1) * y_size * sizeof(double));
-  p = malloc(y_size * sizeof(double));
-  qn = malloc(y_size * sizeof(double));
-  un = malloc(y_size * sizeof(double));
-  if (u == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate u",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (p == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate p",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (qn == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate qn",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (un == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate un",__func__,__LINE__);
-    return _FAILURE_;
-  }
-
-  if (x_size==2) spline_mode = _SPLINE_NATURAL_; // in the case of only 2 x-values, only the natural spline method is appropriate, for _SPLINE_EST_DERIV_ at least 3 x-values are needed.
-
-  index_x=0;
-
-  if (spline_mode == _SPLINE_NATURAL_) {
-    for (index_y=0; index_y < y_size; index_y++) {
-      ddy_array[index_y*x_size+index_x] = 0.0;
-      u[index_x*y_size+index_y] = 0.0;
-    }
-  }
-  else {
-    if (spline_mode == _SPLINE_EST_DERIV_) {
-
-      class_test(x[2]-x[0]==0.,
-		 errmsg,
-		 "x[2]=%g, x[0]=%g, stop to avoid seg fault",x[2],x[0]);
-      class_test(x[1]-x[0]==0.,
-		 errmsg,
-		 "x[1]=%g, x[0]=%g, stop to avoid seg fault",x[1],x[0]);
-      class_test(x[2]-x[1]==0.,
-		 errmsg,
-		 "x[2]=%g, x[1]=%g, stop to avoid seg fault",x[2],x[1]);
-
-      for (index_y=0; index_y < y_size; index_y++) {
-
-	dy_first =
-	  ((x[2]-x[0])*(x[2]-x[0])*
-	   (y_array[index_y*x_size+1]-y_array[index_y*x_size+0])-
-	   (x[1]-x[0])*(x[1]-x[0])*
-	   (y_array[index_y*x_size+2]-y_array[index_y*x_size+0]))/
-	  ((x[2]-x[0])*(x[1]-x[0])*(x[2]-x[1]));
-
-	ddy_array[index_y*x_size+index_x] = -0.5;
-
-	u[index_x*y_size+index_y] =
-	  (3./(x[1] -  x[0]))*
-	  ((y_array[index_y*x_size+1]-y_array[index_y*x_size+0])/
-	   (x[1] - x[0])-dy_first);
-
-      }
-    }
-    else {
-      sprintf(errmsg,"%s(L:%d) Spline mode not identified: %d",__func__,__LINE__,spline_mode);
-      return _FAILURE_;
-    }
-  }
-
-  for (index_x=1; index_x < x_size-1; index_x++) {
-
-    sig = (x[index_x] - x[index_x-1])/(x[index_x+1] - x[index_x-1]);
-
-    for (index_y=0; index_y < y_size; index_y++) {
-
-      p[index_y] = sig * ddy_array[index_y*x_size+(index_x-1)] + 2.0;
-
-      ddy_array[index_y*x_size+index_x] = (sig-1.0)/p[index_y];
-
-      u[index_x*y_size+index_y] =
-	(y_array[index_y*x_size+(index_x+1)] - y_array[index_y*x_size+index_x])
-	/ (x[index_x+1] - x[index_x])
-	- (y_array[index_y*x_size+index_x] - y_array[index_y*x_size+(index_x-1)])
-	/ (x[index_x] - x[index_x-1]);
-
-      u[index_x*y_size+index_y] = (6.0 * u[index_x*y_size+index_y] /
-				   (x[index_x+1] - x[index_x-1])
-				   - sig * u[(index_x-1)*y_size+index_y]) / p[index_y];
-    }
-
-  }
-
-  if (spline_mode == _SPLINE_NATURAL_) {
-
-    for (index_y=0; index_y < y_size; index_y++) {
-      qn[index_y]=un[index_y]=0.0;
-    }
-
-  }
-  else {
-    if (spline_mode == _SPLINE_EST_DERIV_) {
-
-      for (index_y=0; index_y < y_size; index_y++) {
-
-	dy_last =
-	  ((x[x_size-3]-x[x_size-1])*(x[x_size-3]-x[x_size-1])*
-	   (y_array[index_y*x_size+(x_size-2)]-y_array[index_y*x_size+(x_size-1)])-
-	   (x[x_size-2]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*
-	   (y_array[index_y*x_size+(x_size-3)]-y_array[index_y*x_size+(x_size-1)]))/
-	  ((x[x_size-3]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*(x[x_size-3]-x[x_size-2]));
-
-	qn[index_y]=0.5;
-
-	un[index_y]=
-	  (3./(x[x_size-1] - x[x_size-2]))*
-	  (dy_last-(y_array[index_y*x_size+(x_size-1)] - y_array[index_y*x_size+(x_size-2)])/
-	   (x[x_size-1] - x[x_size-2]));
-
-      }
-    }
-    else {
-      sprintf(errmsg,"%s(L:%d) Spline mode not identified: %d",__func__,__LINE__,spline_mode);
-      return _FAILURE_;
-    }
-  }
-
-  index_x=x_size-1;
-
-  for (index_y=0; index_y < y_size; index_y++) {
-    ddy_array[index_y*x_size+index_x] =
-      (un[index_y] - qn[index_y] * u[(index_x-1)*y_size+index_y]) /
-      (qn[index_y] * ddy_array[index_y*x_size+(index_x-1)] + 1.0);
-  }
-
-  for (index_x=x_size-2; index_x >= 0; index_x--) {
-    for (index_y=0; index_y < y_size; index_y++) {
-
-      ddy_array[index_y*x_size+index_x] = ddy_array[index_y*x_size+index_x] *
-	ddy_array[index_y*x_size+(index_x+1)] + u[index_x*y_size+index_y];
-
-    }
-  }
-
-  free(qn);
-  free(p);
-  free(u);
-  free(un);
+  class_call(array_spline_table_strided(x,x_size,y_array,y_size,ddy_array,1,x_size,spline_mode,errmsg),
+             errmsg,
+             errmsg);
 
   return _SUCCESS_;
- }
+}
 
 int array_spline_table_columns2(
 		       double * x, /* vector of size x_size */
@@ -1056,133 +1027,12 @@ int array_spline_table_columns2(
 		       ErrorMsg errmsg
 		       ) {
 
-  double * p;
-  double * qn;
-  double * un;
-  double * u;
-  double sig;
-  int index_x;
-  int index_y;
-  double dy_first;
-  double dy_last;
-
-  u = malloc((x_size-1) * y_size * sizeof(double));
-  p = malloc(y_size * sizeof(double));
-  qn = malloc(y_size * sizeof(double));
-  un = malloc(y_size * sizeof(double));
-  if (u == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate u",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (p == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate p",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (qn == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate qn",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (un == NULL) {
-    sprintf(errmsg,"%s(L:%d) Cannot allocate un",__func__,__LINE__);
-    return _FAILURE_;
-  }
-
-  if (x_size==2) spline_mode = _SPLINE_NATURAL_; // in the case of only 2 x-values, only the natural spline method is appropriate, for _SPLINE_EST_DERIV_ 3 x-values are needed.
-
-#pragma omp parallel                                                \
-  shared(x,x_size,y_array,y_size,ddy_array,spline_mode,p,qn,un,u)   \
-  private(index_y,index_x,sig,dy_first,dy_last)
-  {
-
-#pragma omp for schedule (dynamic)
-
-    for (index_y=0; index_y < y_size; index_y++) {
-
-      if (spline_mode == _SPLINE_NATURAL_) {
-        ddy_array[index_y*x_size+0] = 0.0;
-        u[0*y_size+index_y] = 0.0;
-      }
-      else {
-        dy_first =
-          ((x[2]-x[0])*(x[2]-x[0])*
-           (y_array[index_y*x_size+1]-y_array[index_y*x_size+0])-
-           (x[1]-x[0])*(x[1]-x[0])*
-           (y_array[index_y*x_size+2]-y_array[index_y*x_size+0]))/
-          ((x[2]-x[0])*(x[1]-x[0])*(x[2]-x[1]));
-
-        ddy_array[index_y*x_size+0] = -0.5;
-
-        u[0*y_size+index_y] =
-          (3./(x[1] -  x[0]))*
-          ((y_array[index_y*x_size+1]-y_array[index_y*x_size+0])/
-           (x[1] - x[0])-dy_first);
-
-      }
-
-      for (index_x=1; index_x < x_size-1; index_x++) {
-
-        sig = (x[index_x] - x[index_x-1])/(x[index_x+1] - x[index_x-1]);
-
-        p[index_y] = sig * ddy_array[index_y*x_size+(index_x-1)] + 2.0;
-
-        ddy_array[index_y*x_size+index_x] = (sig-1.0)/p[index_y];
-
-        u[index_x*y_size+index_y] =
-          (y_array[index_y*x_size+(index_x+1)] - y_array[index_y*x_size+index_x])
-          / (x[index_x+1] - x[index_x])
-          - (y_array[index_y*x_size+index_x] - y_array[index_y*x_size+(index_x-1)])
-          / (x[index_x] - x[index_x-1]);
-
-        u[index_x*y_size+index_y] = (6.0 * u[index_x*y_size+index_y] /
-                                     (x[index_x+1] - x[index_x-1])
-                                     - sig * u[(index_x-1)*y_size+index_y]) / p[index_y];
-
-      }
-
-      if (spline_mode == _SPLINE_NATURAL_) {
-
-        qn[index_y]=un[index_y]=0.0;
-
-      }
-      else {
-
-        dy_last =
-          ((x[x_size-3]-x[x_size-1])*(x[x_size-3]-x[x_size-1])*
-           (y_array[index_y*x_size+(x_size-2)]-y_array[index_y*x_size+(x_size-1)])-
-           (x[x_size-2]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*
-           (y_array[index_y*x_size+(x_size-3)]-y_array[index_y*x_size+(x_size-1)]))/
-          ((x[x_size-3]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*(x[x_size-3]-x[x_size-2]));
-
-        qn[index_y]=0.5;
-
-        un[index_y]=
-          (3./(x[x_size-1] - x[x_size-2]))*
-          (dy_last-(y_array[index_y*x_size+(x_size-1)] - y_array[index_y*x_size+(x_size-2)])/
-           (x[x_size-1] - x[x_size-2]));
-
-      }
-
-      index_x=x_size-1;
-
-      ddy_array[index_y*x_size+index_x] =
-        (un[index_y] - qn[index_y] * u[(index_x-1)*y_size+index_y]) /
-        (qn[index_y] * ddy_array[index_y*x_size+(index_x-1)] + 1.0);
-
-      for (index_x=x_size-2; index_x >= 0; index_x--) {
-
-        ddy_array[index_y*x_size+index_x] = ddy_array[index_y*x_size+index_x] *
-          ddy_array[index_y*x_size+(index_x+1)] + u[index_x*y_size+index_y];
-
-      }
-    }
-  }
-  free(qn);
-  free(p);
-  free(u);
-  free(un);
+  class_call(array_spline_table_strided(x,x_size,y_array,y_size,ddy_array,1,x_size,spline_mode,errmsg),
+             errmsg,
+             errmsg);
 
   return _SUCCESS_;
- }
+}
 
 int array_spline_table_one_column(
 		       double * x, /* vector of size x_size */
@@ -1557,6 +1407,249 @@ int array_integrate_all_trapzd_or_spline(
   return _SUCCESS_;
 }
 
+/**
+ * Weights w[i] such that, for any y sampled at the n_lines values
+ * x[i], the result of array_spline() with _SPLINE_EST_DERIV_ followed
+ * by array_integrate_all_trapzd_or_spline() is sum_i w[i] y[i]. Both
+ * routines are linear in y: the weights are obtained by running the
+ * spline algorithm backwards (adjoint), with O(n_lines) operations.
+ *
+ * @param x                  Input: values of x
+ * @param n_lines            Input: number of values (at least 3)
+ * @param index_start_spline Input: same as in array_integrate_all_trapzd_or_spline()
+ * @param w                  Output: weights (allocated by the caller)
+ * @param errmsg             Output: error message
+ * @return the error status
+ */
+int array_integrate_all_trapzd_or_spline_weights(
+                                                 double * x,
+                                                 int n_lines,
+                                                 int index_start_spline,
+                                                 double * w,
+                                                 ErrorMsg errmsg) {
+
+  int i;
+  double h,coef,sig,p;
+  double x0,x1,x2,den;
+  double * d;
+  double * bar_dd;
+  double * bar_u;
+
+  class_test(n_lines < 3,
+             errmsg,
+             "n_lines=%d, while routine needs n_lines >= 3",n_lines);
+
+  class_test((index_start_spline<0) || (index_start_spline>=n_lines),
+             errmsg,
+             "index_start_spline outside of range");
+
+  class_alloc(d,n_lines*sizeof(double),errmsg);
+  class_alloc(bar_dd,n_lines*sizeof(double),errmsg);
+  class_alloc(bar_u,n_lines*sizeof(double),errmsg);
+
+  /* trapezoidal weights, and coefficients of the second derivatives in the result */
+  for (i=0; i < n_lines; i++) {
+    w[i] = 0.;
+    bar_dd[i] = 0.;
+    bar_u[i] = 0.;
+  }
+  for (i=0; i < n_lines-1; i++) {
+    h = x[i+1]-x[i];
+    w[i] += h/2.;
+    w[i+1] += h/2.;
+    if (i >= index_start_spline) {
+      bar_dd[i] += h*h*h/24.;
+      bar_dd[i+1] += h*h*h/24.;
+    }
+  }
+
+  /* diagonal coefficients of array_spline(), which do not depend on y */
+  d[0] = -0.5;
+  for (i=1; i < n_lines-1; i++) {
+    sig = (x[i]-x[i-1])/(x[i+1]-x[i-1]);
+    p = sig*d[i-1]+2.0;
+    d[i] = (sig-1.0)/p;
+  }
+
+  /* adjoint of the back-substitution dd[i] = d[i]*dd[i+1] + u[i] */
+  for (i=0; i < n_lines-1; i++) {
+    bar_u[i] += bar_dd[i];
+    bar_dd[i+1] += d[i]*bar_dd[i];
+  }
+
+  /* adjoint of dd[n-1] = (un - qn*u[n-2])/(qn*d[n-2]+1), with qn=0.5 and
+     un = 3/h*(dy_last-(y[n-1]-y[n-2])/h) */
+  coef = bar_dd[n_lines-1]/(0.5*d[n_lines-2]+1.0);
+  bar_u[n_lines-2] -= 0.5*coef;
+  h = x[n_lines-1]-x[n_lines-2];
+  w[n_lines-1] -= 3./h/h*coef;
+  w[n_lines-2] += 3./h/h*coef;
+  x0 = x[n_lines-1];
+  x1 = x[n_lines-2];
+  x2 = x[n_lines-3];
+  den = (x2-x0)*(x1-x0)*(x2-x1);
+  w[n_lines-2] += 3./h*coef*(x2-x0)*(x2-x0)/den;
+  w[n_lines-3] -= 3./h*coef*(x1-x0)*(x1-x0)/den;
+  w[n_lines-1] -= 3./h*coef*((x2-x0)*(x2-x0)-(x1-x0)*(x1-x0))/den;
+
+  /* adjoint of the forward recursion on u[i] */
+  for (i=n_lines-2; i >= 1; i--) {
+    sig = (x[i]-x[i-1])/(x[i+1]-x[i-1]);
+    p = sig*d[i-1]+2.0;
+    coef = 6.0/(x[i+1]-x[i-1])/p*bar_u[i];
+    w[i+1] += coef/(x[i+1]-x[i]);
+    w[i] -= coef*(1./(x[i+1]-x[i])+1./(x[i]-x[i-1]));
+    w[i-1] += coef/(x[i]-x[i-1]);
+    bar_u[i-1] -= sig/p*bar_u[i];
+  }
+
+  /* adjoint of u[0] = 3/h*((y[1]-y[0])/h-dy_first) */
+  h = x[1]-x[0];
+  coef = 3./h*bar_u[0];
+  w[1] += coef/h;
+  w[0] -= coef/h;
+  x0 = x[0];
+  x1 = x[1];
+  x2 = x[2];
+  den = (x2-x0)*(x1-x0)*(x2-x1);
+  w[1] -= coef*(x2-x0)*(x2-x0)/den;
+  w[2] += coef*(x1-x0)*(x1-x0)/den;
+  w[0] += coef*((x2-x0)*(x2-x0)-(x1-x0)*(x1-x0))/den;
+
+  free(d);
+  free(bar_dd);
+  free(bar_u);
+
+  return _SUCCESS_;
+}
+
+#ifdef _BLAS
+/* Fortran BLAS routines (column-major storage) */
+void dgemm_(const char * transa, const char * transb, const int * m, const int * n, const int * k,
+            const double * alpha, const double * a, const int * lda, const double * b, const int * ldb,
+            const double * beta, double * c, const int * ldc);
+void dsyr2k_(const char * uplo, const char * trans, const int * n, const int * k,
+             const double * alpha, const double * a, const int * lda, const double * b, const int * ldb,
+             const double * beta, double * c, const int * ldc);
+#endif
+
+/** number of columns per block in the loops of array_weighted_product() */
+#define _ARRAY_PRODUCT_BLOCK_ 256
+
+/**
+ * Weighted product of two matrices a and b of m lines and n columns:
+ * c[i*m+j] = sum_k a[i*n+k] w[k] b[j*n+k], for 0 <= i,j < m.
+ *
+ * If symmetric is _TRUE_, b must be equal to a: the product is then
+ * symmetric, and only half of it is computed (a symmetric rank-k
+ * update, with weights of any sign). When the code is compiled with -D_BLAS
+ * (see the Makefile), the product is a call to dgemm, or to dsyr2k in
+ * the symmetric case; otherwise it is computed by blocks of
+ * _ARRAY_PRODUCT_BLOCK_ columns, which keep the lines of a*w and b in
+ * cache. Both give the same result up to rounding errors.
+ *
+ * @param a         Input: first matrix, a[i*n+k]
+ * @param b         Input: second matrix, b[j*n+k] (equal to a if symmetric is _TRUE_)
+ * @param w         Input: weights, w[k]
+ * @param m         Input: number of lines
+ * @param n         Input: number of columns
+ * @param symmetric Input: _TRUE_ if b is equal to a
+ * @param aw        Input: workspace of m*n elements (allocated by the caller)
+ * @param c         Output: product, c[i*m+j] (allocated by the caller)
+ * @param errmsg    Output: error message
+ * @return the error status
+ */
+int array_weighted_product(
+                           double * a,
+                           double * b,
+                           double * w,
+                           int m,
+                           int n,
+                           short symmetric,
+                           double * aw,
+                           double * c,
+                           ErrorMsg errmsg) {
+
+  int i,j,k;
+#ifdef _BLAS
+  double alpha = 1.;
+  double beta = 0.;
+#else
+  int k_min,k_max;
+  double sum;
+#endif
+
+  class_test((m < 0) || (n < 0),
+             errmsg,
+             "invalid dimensions m=%d, n=%d",m,n);
+
+  if (m == 0)
+    return _SUCCESS_;
+
+  /** - a*w */
+
+  for (i=0; i<m; i++) {
+    for (k=0; k<n; k++) {
+      aw[i*n+k] = a[i*n+k]*w[k];
+    }
+  }
+
+#ifdef _BLAS
+
+  /** - with BLAS: the row-major matrices aw and b are the transposes of
+      column-major ones, so c = aw b^T is obtained as b^T aw in
+      column-major storage. In the symmetric case, a W a^T =
+      (aw a^T + a aw^T)/2 is a symmetric rank-2k update */
+
+  if (symmetric == _TRUE_) {
+    alpha = 0.5;
+    dsyr2k_("U","T",&m,&n,&alpha,b,&n,aw,&n,&beta,c,&m);
+    /* the upper triangle in column-major storage is c[i*m+j] with j <= i */
+    for (i=0; i<m; i++) {
+      for (j=i+1; j<m; j++) {
+        c[i*m+j] = c[j*m+i];
+      }
+    }
+  }
+  else {
+    dgemm_("T","N",&m,&m,&n,&alpha,b,&n,aw,&n,&beta,c,&m);
+  }
+
+#else
+
+  /** - without BLAS: accumulate the products by blocks of columns */
+
+  for (i=0; i<m*m; i++) {
+    c[i] = 0.;
+  }
+
+  for (k_min=0; k_min<n; k_min+=_ARRAY_PRODUCT_BLOCK_) {
+    k_max = MIN(k_min+_ARRAY_PRODUCT_BLOCK_,n);
+    for (i=0; i<m; i++) {
+      for (j=(symmetric == _TRUE_ ? i : 0); j<m; j++) {
+        sum = 0.;
+        for (k=k_min; k<k_max; k++) {
+          sum += aw[i*n+k]*b[j*n+k];
+        }
+        c[i*m+j] += sum;
+      }
+    }
+  }
+
+  if (symmetric == _TRUE_) {
+    for (i=0; i<m; i++) {
+      for (j=0; j<i; j++) {
+        c[i*m+j] = c[j*m+i];
+      }
+    }
+  }
+
+#endif
+
+  return _SUCCESS_;
+}
+
+
  /**
  * Not called.
  */
@@ -2748,6 +2841,122 @@ int array_spline_hunt(double* x_array,
   return _SUCCESS_;
 }
 
+/**
+ * Batched version of array_spline_hunt(): for each value x_vec[i],
+ * find the interval [x_array[index_vec[i]], x_array[index_vec[i]+1]]
+ * containing it and the relative position b_vec[i] in this interval.
+ * The search for each value starts from the result for the previous
+ * one, so that it only takes a few steps when x_vec is sorted (in
+ * increasing or decreasing order); any order is allowed. Values outside
+ * the range of x_array are not an error: they get index_vec[i] = -1.
+ *
+ * @param x_array   Input: array of size x_size, in growing order
+ * @param x_size    Input: size of x_array
+ * @param x_vec     Input: values at which interpolation will be performed
+ * @param x_vec_size Input: number of values
+ * @param index_vec Output: index of the lower edge of the interval of each value (or -1), array of size x_vec_size
+ * @param b_vec     Output: relative position (x-x_inf)/(x_sup-x_inf) of each value in its interval, array of size x_vec_size
+ * @param errmsg    Output: error message
+ * @return the error status
+ */
+
+int array_spline_hunt_vec(
+                          double * x_array,
+                          int x_size,
+                          double * x_vec,
+                          int x_vec_size,
+                          int * index_vec,
+                          double * b_vec,
+                          ErrorMsg errmsg
+                          ) {
+
+  int i,last_index;
+  double h,a;
+
+  last_index = 0;
+
+  for (i=0; i<x_vec_size; i++) {
+
+    if ((x_vec[i] < x_array[0]) || (x_vec[i] > x_array[x_size-1])) {
+      index_vec[i] = -1;
+      b_vec[i] = 0.;
+      continue;
+    }
+
+    class_call(array_spline_hunt(x_array,
+                                 x_size,
+                                 x_vec[i],
+                                 &last_index,
+                                 &h,
+                                 &a,
+                                 &(b_vec[i]),
+                                 errmsg),
+               errmsg,
+               errmsg);
+
+    index_vec[i] = last_index;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Batched spline interpolation of one column of a table, at values
+ * located beforehand by array_spline_hunt_vec(). The column is
+ * y_array[index_x*y_size+index_y] (and similarly for ddy_array), so
+ * that y_size=1, index_y=0 applies to a single vector. Results are
+ * written in the caller-provided result array; entries for values
+ * outside the range of x_array (index_vec[i] = -1) are left
+ * untouched.
+ *
+ * @param x_array    Input: array of size x_size, in growing order
+ * @param y_array    Input: table of values
+ * @param ddy_array  Input: table of second derivatives of y_array with respect to x
+ * @param y_size     Input: number of columns of the tables
+ * @param index_y    Input: column to interpolate
+ * @param x_vec_size Input: number of values
+ * @param index_vec  Input: intervals returned by array_spline_hunt_vec()
+ * @param b_vec      Input: relative positions returned by array_spline_hunt_vec()
+ * @param result     Output: interpolated values, array of size x_vec_size
+ * @return the error status
+ */
+
+int array_interpolate_spline_vec(
+                                 double * x_array,
+                                 double * y_array,
+                                 double * ddy_array,
+                                 int y_size,
+                                 int index_y,
+                                 int x_vec_size,
+                                 int * index_vec,
+                                 double * b_vec,
+                                 double * result
+                                 ) {
+
+  int i,inf,sup;
+  double h,a,b;
+
+  for (i=0; i<x_vec_size; i++) {
+
+    if (index_vec[i] < 0)
+      continue;
+
+    inf = index_vec[i];
+    sup = inf+1;
+    h = x_array[sup] - x_array[inf];
+    b = b_vec[i];
+    a = 1.-b;
+
+    result[i] =
+      a * y_array[inf*y_size+index_y] +
+      b * y_array[sup*y_size+index_y] +
+      ((a*a*a-a) * ddy_array[inf*y_size+index_y] +
+       (b*b*b-b) * ddy_array[sup*y_size+index_y])*h*h/6.;
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * interpolate linearily to get y_i(x), when x and y_i are in two different arrays
  *
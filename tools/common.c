@@ -1,4 +1,6 @@
 #include "common.h"
+#include <time.h>
+#include <sys/resource.h>
 
 void class_protect_sprintf(char* dest, char* tpl,...) {
   va_list args;
@@ -114,3 +116,1103 @@ int class_version(
   sprintf(version,"%s",_VERSION_);
   return _SUCCESS_;
 }
+
+/**
+ * Get the index of the current MPI process and the number of MPI
+ * processes. Without MPI (or before MPI_Init() has been called), there
+ * is a single process of index 0.
+ *
+ * @param rank Output: index of the current process
+ * @param size Output: number of processes
+ * @return the error status
+ */
+
+int class_mpi_rank_and_size(
+                            int * rank,
+                            int * size
+                            ) {
+
+#ifdef _MPI
+  int initialized;
+
+  MPI_Initialized(&initialized);
+  if (initialized) {
+    MPI_Comm_rank(MPI_COMM_WORLD,rank);
+    MPI_Comm_size(MPI_COMM_WORLD,size);
+    return _SUCCESS_;
+  }
+#endif
+
+  *rank = 0;
+  *size = 1;
+  return _SUCCESS_;
+}
+
+/**
+ * Replace an array by the sum of its values over all MPI processes.
+ * The array is reduced in chunks, since MPI counts are plain integers.
+ *
+ * @param array         Input/Output: array to be summed
+ * @param size          Input: number of elements in the array
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int class_mpi_allreduce_sum(
+                            double * array,
+                            size_t size,
+                            ErrorMsg error_message
+                            ) {
+
+#ifdef _MPI
+  int rank,mpi_size;
+  size_t start,chunk;
+  const size_t chunk_max = 1<<26;
+
+  class_mpi_rank_and_size(&rank,&mpi_size);
+  if (mpi_size == 1)
+    return _SUCCESS_;
+
+  for (start = 0; start < size; start += chunk) {
+    chunk = MIN(chunk_max,size-start);
+    class_test(MPI_Allreduce(MPI_IN_PLACE,array+start,(int)chunk,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD) != MPI_SUCCESS,
+               error_message,
+               "MPI_Allreduce failed");
+  }
+#endif
+
+  return _SUCCESS_;
+}
+
+/**
+ * Same as class_mpi_allreduce_sum() for an array in single precision.
+ *
+ * @param array         Input/Output: array to be summed
+ * @param size          Input: number of elements in the array
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int class_mpi_allreduce_sum_float(
+                                  float * array,
+                                  size_t size,
+                                  ErrorMsg error_message
+                                  ) {
+
+#ifdef _MPI
+  int rank,mpi_size;
+  size_t start,chunk;
+  const size_t chunk_max = 1<<26;
+
+  class_mpi_rank_and_size(&rank,&mpi_size);
+  if (mpi_size == 1)
+    return _SUCCESS_;
+
+  for (start = 0; start < size; start += chunk) {
+    chunk = MIN(chunk_max,size-start);
+    class_test(MPI_Allreduce(MPI_IN_PLACE,array+start,(int)chunk,MPI_FLOAT,MPI_SUM,MPI_COMM_WORLD) != MPI_SUCCESS,
+               error_message,
+               "MPI_Allreduce failed");
+  }
+#endif
+
+  return _SUCCESS_;
+}
+
+/**
+ * Make all MPI processes agree on an error flag before a collective
+ * operation, so that a failure in one process does not leave the
+ * others waiting.
+ *
+ * @param abort         Input/Output: error flag of the current process, replaced by the logical or over all processes
+ * @param error_message Output: error message, written when the failure occurred in another process
+ * @return the error status
+ */
+
+int class_mpi_synchronize_abort(
+                                int * abort,
+                                ErrorMsg error_message
+                                ) {
+
+#ifdef _MPI
+  int rank,mpi_size;
+  int local_abort = *abort;
+
+  class_mpi_rank_and_size(&rank,&mpi_size);
+  if (mpi_size == 1)
+    return _SUCCESS_;
+
+  MPI_Allreduce(&local_abort,abort,1,MPI_INT,MPI_LOR,MPI_COMM_WORLD);
+  if ((*abort == _TRUE_) && (local_abort == _FALSE_))
+    class_protect_sprintf(error_message,"%s(L:%d) :failure in another MPI process",__func__,__LINE__);
+#endif
+
+  return _SUCCESS_;
+}
+
+/**
+ * Set the number of threads of the parallel regions started from now
+ * on by the calling thread. This setting (the OpenMP nthreads-var
+ * control variable) belongs to the calling thread: runs performed
+ * concurrently by other threads keep their own. Nothing is changed if
+ * num_threads is not positive, or without OpenMP.
+ *
+ * @param num_threads Input: number of threads, or 0 to keep the current one
+ * @return the number of threads before the call, to be restored with this function
+ */
+
+int class_threads_set(
+                      int num_threads
+                      ) {
+
+#ifdef _OPENMP
+  int previous = omp_get_max_threads();
+
+  if (num_threads > 0)
+    omp_set_num_threads(num_threads);
+
+  return previous;
+#else
+  return 1;
+#endif
+}
+
+/**
+ * Write zeros in a newly allocated array from all the threads of a
+ * parallel region, the pages being dealt to the threads in turn. With
+ * the first-touch policy of Linux, each page is placed on the NUMA
+ * node of the thread writing it first: the array is then interleaved
+ * over the nodes of the threads (pinned with OMP_PROC_BIND and
+ * OMP_PLACES) instead of being placed entirely on the node of the
+ * thread calling malloc(). This does not depend on how the array is
+ * filled later, since the filling loops of CLASS have dynamic
+ * schedules. Small arrays, and calls from a parallel region, are
+ * simply zeroed by the calling thread.
+ *
+ * @param pointer Input/Output: array to initialise
+ * @param size    Input: size of the array in bytes
+ * @return the error status
+ */
+
+int class_first_touch(
+                      void * pointer,
+                      size_t size
+                      ) {
+
+  char * bytes = pointer;
+  long long page_num,index_page;
+  size_t offset;
+
+  page_num = (size+_FIRST_TOUCH_PAGE_-1)/_FIRST_TOUCH_PAGE_;
+
+#pragma omp parallel for schedule (static,1) private(offset) if (size >= _FIRST_TOUCH_MIN_)
+  for (index_page=0; index_page<page_num; index_page++) {
+    offset = (size_t)index_page*_FIRST_TOUCH_PAGE_;
+    memset(bytes+offset,0,MIN(_FIRST_TOUCH_PAGE_,size-offset));
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Names of the stages of a profile, in the order of enum profile_stage
+ */
+
+const char * profile_stage_name[_PROFILE_STAGES_] = {"input","background","thermodynamics","perturbations","primordial",
+                                                     "fourier","transfer","harmonic","lensing","distortions","output"};
+
+/* bytes requested so far from class_alloc(), class_calloc() and class_realloc() by the whole process */
+static double class_alloc_bytes = 0.;
+
+/**
+ * Count the bytes of an allocation made by class_alloc(),
+ * class_alloc_parallel(), class_calloc() or class_realloc(). The
+ * counter is shared by all threads (and by runs performed concurrently
+ * in the same process). Memory released with free() is not subtracted:
+ * the difference of the counter over a stage is the total size of its
+ * allocations, an upper bound to its share of the heap.
+ *
+ * @param size Input: number of bytes allocated
+ */
+
+void class_alloc_count(
+                       size_t size
+                       ) {
+#pragma omp atomic
+  class_alloc_bytes += (double)size;
+}
+
+/* current wall-clock time, CPU time of the process and number of counted bytes */
+static void profile_now(double * wall, double * cpu, double * bytes) {
+
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  *wall = now.tv_sec+1.e-9*now.tv_nsec;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&now);
+  *cpu = now.tv_sec+1.e-9*now.tv_nsec;
+#pragma omp atomic read
+  *bytes = class_alloc_bytes;
+}
+
+/**
+ * Reset a profile: no stage has run yet
+ *
+ * @param pprof Output: profile
+ */
+
+void profile_init(
+                  struct profile * pprof
+                  ) {
+  memset(pprof,0,sizeof(struct profile));
+#ifdef _COUNTERS
+  class_counters_reset();
+#endif
+}
+
+/**
+ * Start measuring one stage of a run (typically just before the call
+ * to its *_init() function). Stages may not overlap within a profile.
+ *
+ * @param pprof Input/Output: profile
+ * @param stage Input: stage about to start
+ */
+
+void profile_start(
+                   struct profile * pprof,
+                   enum profile_stage stage
+                   ) {
+
+  profile_now(&(pprof->start_wall),&(pprof->start_cpu),&(pprof->start_bytes));
+
+#ifdef _OPENMP
+  pprof->threads[stage] = omp_get_max_threads();
+#else
+  pprof->threads[stage] = 1;
+#endif
+}
+
+/**
+ * Stop measuring one stage of a run, started with profile_start(). The
+ * peak resident memory is the high-water mark of the whole process
+ * (getrusage), so that it only grows from one stage to the next: a
+ * stage raising it is the one that set the memory footprint of the run.
+ *
+ * @param pprof Input/Output: profile
+ * @param stage Input: stage that just ended
+ */
+
+void profile_stop(
+                  struct profile * pprof,
+                  enum profile_stage stage
+                  ) {
+
+  double wall, cpu, bytes;
+  struct rusage usage;
+
+  profile_now(&wall,&cpu,&bytes);
+
+  pprof->has_stage[stage] = _TRUE_;
+  pprof->wall[stage] = wall-pprof->start_wall;
+  pprof->cpu[stage] = cpu-pprof->start_cpu;
+  pprof->bytes[stage] = bytes-pprof->start_bytes;
+
+  getrusage(RUSAGE_SELF,&usage);
+#ifdef __APPLE__
+  pprof->peak_rss[stage] = (double)usage.ru_maxrss;        /* in bytes on macOS */
+#else
+  pprof->peak_rss[stage] = 1024.*(double)usage.ru_maxrss;  /* in kB on Linux */
+#endif
+}
+
+/**
+ * Print the stages of a profile that ran, and their total
+ *
+ * @param pprof Input: profile
+ */
+
+void profile_print(
+                   struct profile * pprof
+                   ) {
+
+  int index_stage;
+  double wall = 0., cpu = 0., bytes = 0., peak_rss = 0.;
+
+  printf("Profile of the run:\n");
+  printf(" -> %-15s %10s %10s %8s %12s %12s\n","stage","wall [s]","cpu [s]","threads","alloc [MB]","peak [MB]");
+  for (index_stage=0; index_stage<_PROFILE_STAGES_; index_stage++) {
+    if (pprof->has_stage[index_stage] == _FALSE_)
+      continue;
+    printf(" -> %-15s %10.4f %10.4f %8d %12.2f %12.2f\n",
+           profile_stage_name[index_stage],
+           pprof->wall[index_stage],
+           pprof->cpu[index_stage],
+           pprof->threads[index_stage],
+           pprof->bytes[index_stage]/1048576.,
+           pprof->peak_rss[index_stage]/1048576.);
+    wall += pprof->wall[index_stage];
+    cpu += pprof->cpu[index_stage];
+    bytes += pprof->bytes[index_stage];
+    peak_rss = MAX(peak_rss,pprof->peak_rss[index_stage]);
+  }
+  printf(" -> %-15s %10.4f %10.4f %8s %12.2f %12.2f\n","total",wall,cpu,"",bytes/1048576.,peak_rss/1048576.);
+#ifdef _COUNTERS
+  class_counters_print();
+#endif
+}
+
+#ifdef _COUNTERS
+
+/**
+ * Hardware counters of the main kernels, compiled with -D_COUNTERS
+ * (see COUNTERSFLAG in the Makefile; Linux only).
+ *
+ * Each thread opens at its first class_counters_begin() a group of
+ * perf_event counters of its own user-space execution: cycles,
+ * instructions, last-level cache references and misses. If
+ * _COUNTERS_SCALAR and _COUNTERS_PACKED are defined as raw event codes
+ * of the processor (floating-point instructions retired, scalar and
+ * packed, e.g. 0x01c7 and 0x54c7 for double precision on recent Intel
+ * processors), a second group counts them, giving the fraction of
+ * vector instructions. class_counters_end() adds the difference since
+ * class_counters_begin() to the totals of the kernel, shared by all
+ * threads and reset by profile_init(); profile_print() reports them.
+ *
+ * Reading the counters costs a system call at each end of a kernel:
+ * the wall-clock times of an instrumented run are longer, but the
+ * counts only include the user-space execution of the kernels.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define _COUNTER_EVENTS_ 6 /**< cycles, instructions, cache references, cache misses, scalar and packed instructions */
+
+enum {counter_cycles, counter_instructions, counter_cache_references, counter_cache_misses, counter_scalar, counter_packed};
+
+static const char * counter_kernel_name[_COUNTER_KERNELS_] = {"perturbations_derivs","ndf15 linear algebra","transfer_integrate",
+                                                               "harmonic_compute_cl","lensing d-functions","hyperspherical"};
+
+/* totals of all threads since the last reset */
+static double counter_total[_COUNTER_KERNELS_][_COUNTER_EVENTS_];
+static double counter_calls[_COUNTER_KERNELS_];
+static int counter_error = 0; /* errno of the first counter that could not be opened */
+
+/* counters of each thread: file descriptors of the two group leaders (-1
+   if not opened), values at the start of each kernel */
+static int counter_opened = _FALSE_;
+static int counter_fd[2] = {-1,-1};
+static double counter_start_value[_COUNTER_KERNELS_][_COUNTER_EVENTS_];
+#pragma omp threadprivate(counter_opened,counter_fd,counter_start_value)
+
+/* open one counter of the calling thread, in the group of leader (or as a leader if leader = -1) */
+static int counter_open(unsigned int type, unsigned long long config, int leader) {
+
+  struct perf_event_attr attr;
+  int fd;
+
+  memset(&attr,0,sizeof(attr));
+  attr.type = type;
+  attr.size = sizeof(attr);
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+
+  fd = syscall(SYS_perf_event_open,&attr,0,-1,leader,0);
+  if (fd < 0) {
+#pragma omp critical (class_counters)
+    if (counter_error == 0)
+      counter_error = errno;
+  }
+  return fd;
+}
+
+static void counter_open_all() {
+
+  counter_opened = _TRUE_;
+
+  counter_fd[0] = counter_open(PERF_TYPE_HARDWARE,PERF_COUNT_HW_CPU_CYCLES,-1);
+  if (counter_fd[0] >= 0) {
+    if ((counter_open(PERF_TYPE_HARDWARE,PERF_COUNT_HW_INSTRUCTIONS,counter_fd[0]) < 0) ||
+        (counter_open(PERF_TYPE_HARDWARE,PERF_COUNT_HW_CACHE_REFERENCES,counter_fd[0]) < 0) ||
+        (counter_open(PERF_TYPE_HARDWARE,PERF_COUNT_HW_CACHE_MISSES,counter_fd[0]) < 0)) {
+      close(counter_fd[0]);
+      counter_fd[0] = -1;
+    }
+  }
+
+#if defined(_COUNTERS_SCALAR) && defined(_COUNTERS_PACKED)
+  counter_fd[1] = counter_open(PERF_TYPE_RAW,_COUNTERS_SCALAR,-1);
+  if (counter_fd[1] >= 0) {
+    if (counter_open(PERF_TYPE_RAW,_COUNTERS_PACKED,counter_fd[1]) < 0) {
+      close(counter_fd[1]);
+      counter_fd[1] = -1;
+    }
+  }
+#endif
+}
+
+/* current values of the counters of the calling thread (zero for those not opened) */
+static void counter_read(double * value) {
+
+  unsigned long long buffer[1+4];
+  int index_group, index_event, first[2] = {counter_cycles,counter_scalar};
+
+  for (index_event=0; index_event<_COUNTER_EVENTS_; index_event++)
+    value[index_event] = 0.;
+
+  for (index_group=0; index_group<2; index_group++) {
+    if ((counter_fd[index_group] >= 0) && (read(counter_fd[index_group],buffer,sizeof(buffer)) > 0)) {
+      for (index_event=0; index_event<(int)buffer[0]; index_event++)
+        value[first[index_group]+index_event] = (double)buffer[1+index_event];
+    }
+  }
+}
+
+/**
+ * Start counting the hardware events of one kernel in the calling
+ * thread, for class_counters_begin()
+ *
+ * @param kernel Input: kernel
+ */
+
+void class_counters_start(
+                          enum counter_kernel kernel
+                          ) {
+
+  if (counter_opened == _FALSE_)
+    counter_open_all();
+
+  counter_read(counter_start_value[kernel]);
+}
+
+/**
+ * Add the hardware events since class_counters_start() to the totals
+ * of the kernel, for class_counters_end()
+ *
+ * @param kernel Input: kernel
+ */
+
+void class_counters_stop(
+                         enum counter_kernel kernel
+                         ) {
+
+  double value[_COUNTER_EVENTS_];
+  int index_event;
+
+  counter_read(value);
+
+  for (index_event=0; index_event<_COUNTER_EVENTS_; index_event++) {
+#pragma omp atomic
+    counter_total[kernel][index_event] += value[index_event]-counter_start_value[kernel][index_event];
+  }
+#pragma omp atomic
+  counter_calls[kernel] += 1.;
+}
+
+/**
+ * Reset the totals of all kernels (called by profile_init())
+ */
+
+void class_counters_reset() {
+
+#pragma omp critical (class_counters)
+  {
+    memset(counter_total,0,sizeof(counter_total));
+    memset(counter_calls,0,sizeof(counter_calls));
+  }
+}
+
+/**
+ * Print the totals of each kernel since the last reset (called by
+ * profile_print()): number of calls, cycles, instructions per cycle,
+ * last-level cache misses per reference and per thousand instructions,
+ * and the fraction of packed floating-point instructions when counted.
+ */
+
+void class_counters_print() {
+
+  int kernel;
+  double * total;
+
+  printf("Hardware counters of the kernels:\n");
+  if (counter_error != 0)
+    printf(" -> some counters could not be opened (%s): check perf_event_paranoid, or the support of the events by the processor\n",
+           strerror(counter_error));
+  printf(" -> %-22s %12s %12s %8s %12s %12s %10s\n","kernel","calls","Gcycles","IPC","miss/ref","miss/kinstr","packed");
+  for (kernel=0; kernel<_COUNTER_KERNELS_; kernel++) {
+    total = counter_total[kernel];
+    if (counter_calls[kernel] == 0.)
+      continue;
+    printf(" -> %-22s %12.0f %12.4f ",counter_kernel_name[kernel],counter_calls[kernel],1.e-9*total[counter_cycles]);
+    if (total[counter_cycles] > 0.)
+      printf("%8.3f %12.4f %12.4f ",
+             total[counter_instructions]/total[counter_cycles],
+             total[counter_cache_misses]/MAX(total[counter_cache_references],1.),
+             1.e3*total[counter_cache_misses]/MAX(total[counter_instructions],1.));
+    else
+      printf("%8s %12s %12s ","n/a","n/a","n/a");
+    if (total[counter_scalar]+total[counter_packed] > 0.)
+      printf("%10.4f\n",total[counter_packed]/(total[counter_scalar]+total[counter_packed]));
+    else
+      printf("%10s\n","n/a");
+  }
+}
+
+#endif
+
+#ifdef _TRACE
+
+/**
+ * Tracing of the parallel loops, compiled with -D_TRACE (see
+ * TRACEFLAG in the Makefile).
+ *
+ * class_trace_begin() and class_trace_end() (common.h) around the body
+ * of the loops over wavenumbers, multipoles, ... record for each work
+ * item the thread, start and duration, module and index of the item.
+ * class_trace_write() saves them in the Chrome trace event format,
+ * which Perfetto (https://ui.perfetto.dev) or chrome://tracing display
+ * as one timeline per thread, showing load imbalance and serial tails.
+ */
+
+struct trace_event {
+  double start;        /**< wall-clock time of the start of the item, in s */
+  double stop;         /**< wall-clock time of its end, in s */
+  const char * module; /**< module, e.g. "perturbations" */
+  const char * task;   /**< name of the index of the item, e.g. "index_k" */
+  int index;           /**< index of the item */
+  int thread;          /**< thread that treated it */
+};
+
+static struct trace_event * trace_events = NULL;
+static size_t trace_event_size = 0;
+static size_t trace_event_capacity = 0;
+
+/* number of each thread in the trace, given at its first event; with nested
+   parallelism (e.g. class_grid), the threads of all teams are distinct */
+static int trace_thread = -1;
+#pragma omp threadprivate(trace_thread)
+static int trace_thread_size = 0;
+
+/**
+ * Wall-clock time in s, for class_trace_begin()
+ */
+
+double class_trace_time() {
+
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC,&now);
+  return now.tv_sec+1.e-9*now.tv_nsec;
+}
+
+/**
+ * Record one work item, for class_trace_end(). Items that do not fit
+ * in memory are dropped.
+ *
+ * @param module Input: module (a string constant)
+ * @param task   Input: name of the index of the item (a string constant)
+ * @param index  Input: index of the item
+ * @param start  Input: time of the start of the item, from class_trace_time()
+ */
+
+void class_trace_event(
+                       const char * module,
+                       const char * task,
+                       int index,
+                       double start
+                       ) {
+
+  double stop = class_trace_time();
+  struct trace_event * new_events;
+
+#pragma omp critical (class_trace)
+  {
+    if (trace_thread < 0)
+      trace_thread = trace_thread_size++;
+
+    if (trace_event_size == trace_event_capacity) {
+      new_events = realloc(trace_events,MAX(2*trace_event_capacity,4096)*sizeof(struct trace_event));
+      if (new_events != NULL) {
+        trace_events = new_events;
+        trace_event_capacity = MAX(2*trace_event_capacity,4096);
+      }
+    }
+
+    if (trace_event_size < trace_event_capacity) {
+      trace_events[trace_event_size].start = start;
+      trace_events[trace_event_size].stop = stop;
+      trace_events[trace_event_size].module = module;
+      trace_events[trace_event_size].task = task;
+      trace_events[trace_event_size].index = index;
+      trace_events[trace_event_size].thread = trace_thread;
+      trace_event_size++;
+    }
+  }
+}
+
+/**
+ * Write the work items recorded since the previous call in a file, in
+ * the Chrome trace event format ("complete" events, times in
+ * microseconds from the first item), then forget them. With MPI, the
+ * process number is the pid of the events.
+ *
+ * @param filename      Input: name of the file
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int class_trace_write(
+                      char * filename,
+                      ErrorMsg error_message
+                      ) {
+
+  FILE * trace_file;
+  size_t index_event;
+  double origin;
+  int rank, mpi_size, index_thread;
+
+  class_mpi_rank_and_size(&rank,&mpi_size);
+
+  class_open(trace_file,filename,"w",error_message);
+
+#pragma omp critical (class_trace)
+  {
+    origin = (trace_event_size > 0) ? trace_events[0].start : 0.;
+    for (index_event=1; index_event<trace_event_size; index_event++)
+      origin = MIN(origin,trace_events[index_event].start);
+
+    fprintf(trace_file,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(trace_file,"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"CLASS %d\"}}",rank,rank);
+    for (index_thread=0; index_thread<trace_thread_size; index_thread++)
+      fprintf(trace_file,",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+              rank,index_thread,index_thread);
+    for (index_event=0; index_event<trace_event_size; index_event++)
+      fprintf(trace_file,",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"%s\":%d}}",
+              trace_events[index_event].module,
+              trace_events[index_event].module,
+              1.e6*(trace_events[index_event].start-origin),
+              1.e6*(trace_events[index_event].stop-trace_events[index_event].start),
+              rank,
+              trace_events[index_event].thread,
+              trace_events[index_event].task,
+              trace_events[index_event].index);
+    fprintf(trace_file,"\n]}\n");
+
+    trace_event_size = 0;
+  }
+
+  fclose(trace_file);
+
+  return _SUCCESS_;
+}
+
+#endif
+
+#ifdef _MEMORY_TRACKING
+
+/**
+ * Tracking of the memory allocated by CLASS, compiled with
+ * -D_MEMORY_TRACKING (see MEMORYFLAG in the Makefile).
+ *
+ * common.h then redirects malloc(), calloc(), realloc() and free() of
+ * all C files including it to the functions below, which record each
+ * block in use with the file and line of its allocation. For each call
+ * site and each file ("module"), the bytes in use, their high-water
+ * mark, the bytes allocated so far and the number of allocations are
+ * kept up to date. Blocks freed by code that does not include common.h
+ * (external libraries, python wrapper) remain counted until their
+ * address is allocated again.
+ *
+ * The bookkeeping is serialized by a critical section: it is meant for
+ * sizing the memory of a configuration (e.g. of each MPI process), not
+ * for production runs. Without -D_MEMORY_TRACKING, none of this is
+ * compiled and malloc() is called directly.
+ */
+
+/* the functions below call the allocator of the C library */
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
+#define _MEMORY_SITES_MAX_ 16384  /**< size of the table of call sites (power of two); allocations from further sites only enter the totals */
+#define _MEMORY_MODULES_MAX_ 256  /**< maximum number of files; further files only enter the totals */
+#define _MEMORY_BLOCKS_MIN_ 65536 /**< initial size of the table of blocks in use (power of two) */
+
+struct memory_usage {
+  double current; /**< bytes in use */
+  double peak;    /**< highest number of bytes in use */
+  double total;   /**< bytes allocated so far */
+  long count;     /**< number of allocations */
+  long blocks;    /**< number of blocks in use */
+};
+
+struct memory_site {
+  const char * file; /**< __FILE__ of the allocation (NULL for an empty entry) */
+  int line;          /**< __LINE__ of the allocation */
+  int index_module;  /**< index in memory_modules[], or -1 */
+  struct memory_usage usage;
+};
+
+struct memory_module {
+  char name[_FILENAMESIZE_]; /**< file name, without directory */
+  struct memory_usage usage;
+};
+
+struct memory_block {
+  void * pointer;   /**< address of the block (NULL for an empty entry) */
+  size_t size;      /**< size in bytes */
+  int index_site;   /**< index in memory_sites[], or -1 */
+};
+
+static struct memory_site memory_sites[_MEMORY_SITES_MAX_];
+static int memory_site_size = 0;
+static struct memory_module memory_modules[_MEMORY_MODULES_MAX_];
+static int memory_module_size = 0;
+static struct memory_usage memory_all;
+static struct memory_block * memory_blocks = NULL; /* hash table of the blocks in use, with linear probing */
+static size_t memory_block_capacity = 0;
+static size_t memory_block_size = 0;
+
+static size_t memory_block_hash(void * pointer) {
+  return (size_t)(((unsigned long long)(size_t)pointer >> 4) * 11400714819323198485ull);
+}
+
+static const char * memory_basename(const char * file) {
+  const char * slash = strrchr(file,'/');
+  return (slash == NULL) ? file : slash+1;
+}
+
+static void memory_usage_add(struct memory_usage * pusage, double size) {
+  pusage->current += size;
+  pusage->total += size;
+  pusage->count++;
+  pusage->blocks++;
+  pusage->peak = MAX(pusage->peak,pusage->current);
+}
+
+static void memory_usage_remove(struct memory_usage * pusage, double size) {
+  pusage->current -= size;
+  pusage->blocks--;
+}
+
+static int memory_module_index(const char * file) {
+
+  const char * name = memory_basename(file);
+  int index_module;
+
+  for (index_module=0; index_module<memory_module_size; index_module++)
+    if (strcmp(memory_modules[index_module].name,name) == 0)
+      return index_module;
+
+  if (memory_module_size == _MEMORY_MODULES_MAX_)
+    return -1;
+
+  strncpy(memory_modules[memory_module_size].name,name,_FILENAMESIZE_-1);
+  return memory_module_size++;
+}
+
+static int memory_site_index(const char * file, int line) {
+
+  size_t mask = _MEMORY_SITES_MAX_-1;
+  size_t index_site = (memory_block_hash((void*)file)+(size_t)line*2654435761u) & mask;
+
+  while (memory_sites[index_site].file != NULL) {
+    if ((memory_sites[index_site].file == file) && (memory_sites[index_site].line == line))
+      return (int)index_site;
+    index_site = (index_site+1) & mask;
+  }
+
+  /* new site, if the table stays at most three quarters full */
+  if (4*(memory_site_size+1) > 3*_MEMORY_SITES_MAX_)
+    return -1;
+
+  memory_sites[index_site].file = file;
+  memory_sites[index_site].line = line;
+  memory_sites[index_site].index_module = memory_module_index(file);
+  memory_site_size++;
+  return (int)index_site;
+}
+
+/* entry of the block table holding pointer, or the empty entry where it would go */
+static size_t memory_block_find(void * pointer) {
+
+  size_t mask = memory_block_capacity-1;
+  size_t index_block = memory_block_hash(pointer) & mask;
+
+  while ((memory_blocks[index_block].pointer != NULL) && (memory_blocks[index_block].pointer != pointer))
+    index_block = (index_block+1) & mask;
+
+  return index_block;
+}
+
+/* double the size of the block table (or create it); returns _FAILURE_ if out of memory */
+static int memory_block_grow() {
+
+  struct memory_block * old_blocks = memory_blocks;
+  size_t old_capacity = memory_block_capacity;
+  size_t index_block;
+
+  memory_block_capacity = (old_capacity == 0) ? _MEMORY_BLOCKS_MIN_ : 2*old_capacity;
+  memory_blocks = calloc(memory_block_capacity,sizeof(struct memory_block));
+  if (memory_blocks == NULL) {
+    memory_blocks = old_blocks;
+    memory_block_capacity = old_capacity;
+    return _FAILURE_;
+  }
+
+  for (index_block=0; index_block<old_capacity; index_block++)
+    if (old_blocks[index_block].pointer != NULL)
+      memory_blocks[memory_block_find(old_blocks[index_block].pointer)] = old_blocks[index_block];
+
+  free(old_blocks);
+  return _SUCCESS_;
+}
+
+static void memory_block_remove(void * pointer) {
+
+  size_t mask, index_block, index_next, index_home;
+  struct memory_block * pblock;
+
+  if (memory_block_size == 0)
+    return;
+
+  index_block = memory_block_find(pointer);
+  pblock = &(memory_blocks[index_block]);
+  if (pblock->pointer == NULL)
+    return; /* not allocated by a tracked call */
+
+  memory_usage_remove(&memory_all,pblock->size);
+  if (pblock->index_site >= 0) {
+    memory_usage_remove(&(memory_sites[pblock->index_site].usage),pblock->size);
+    if (memory_sites[pblock->index_site].index_module >= 0)
+      memory_usage_remove(&(memory_modules[memory_sites[pblock->index_site].index_module].usage),pblock->size);
+  }
+  pblock->pointer = NULL;
+  memory_block_size--;
+
+  /* move back the following entries that can no longer be reached by probing */
+  mask = memory_block_capacity-1;
+  index_next = index_block;
+  while (1) {
+    index_next = (index_next+1) & mask;
+    if (memory_blocks[index_next].pointer == NULL)
+      break;
+    index_home = memory_block_hash(memory_blocks[index_next].pointer) & mask;
+    if (((index_next > index_block) && ((index_home <= index_block) || (index_home > index_next))) ||
+        ((index_next < index_block) && (index_home <= index_block) && (index_home > index_next))) {
+      memory_blocks[index_block] = memory_blocks[index_next];
+      memory_blocks[index_next].pointer = NULL;
+      index_block = index_next;
+    }
+  }
+}
+
+static void memory_block_add(void * pointer, size_t size, const char * file, int line) {
+
+  struct memory_block * pblock;
+  int index_site;
+
+  /* an address still in the table was freed outside of the tracked code */
+  memory_block_remove(pointer);
+
+  if ((2*(memory_block_size+1) > memory_block_capacity) && (memory_block_grow() == _FAILURE_))
+    return;
+
+  index_site = memory_site_index(file,line);
+
+  memory_usage_add(&memory_all,size);
+  if (index_site >= 0) {
+    memory_usage_add(&(memory_sites[index_site].usage),size);
+    if (memory_sites[index_site].index_module >= 0)
+      memory_usage_add(&(memory_modules[memory_sites[index_site].index_module].usage),size);
+  }
+
+  pblock = &(memory_blocks[memory_block_find(pointer)]);
+  pblock->pointer = pointer;
+  pblock->size = size;
+  pblock->index_site = index_site;
+  memory_block_size++;
+}
+
+void * class_memory_malloc(size_t size, const char * file, int line) {
+
+  void * pointer = malloc(size);
+
+  if (pointer != NULL) {
+#pragma omp critical (class_memory)
+    memory_block_add(pointer,size,file,line);
+  }
+  return pointer;
+}
+
+void * class_memory_calloc(size_t number, size_t size, const char * file, int line) {
+
+  void * pointer = calloc(number,size);
+
+  if (pointer != NULL) {
+#pragma omp critical (class_memory)
+    memory_block_add(pointer,number*size,file,line);
+  }
+  return pointer;
+}
+
+void * class_memory_realloc(void * pointer, size_t size, const char * file, int line) {
+
+  void * new_pointer = realloc(pointer,size);
+
+  /* on failure, the old block is still in use */
+  if ((new_pointer != NULL) || (size == 0)) {
+#pragma omp critical (class_memory)
+    {
+      if (pointer != NULL)
+        memory_block_remove(pointer);
+      if (new_pointer != NULL)
+        memory_block_add(new_pointer,size,file,line);
+    }
+  }
+  return new_pointer;
+}
+
+void class_memory_free(void * pointer) {
+
+  if (pointer != NULL) {
+    /* before free(), so that the address is not handed out again in the meantime */
+#pragma omp critical (class_memory)
+    memory_block_remove(pointer);
+  }
+  free(pointer);
+}
+
+/* prefix of the lines printed by each MPI process */
+static void memory_print_prefix() {
+  int rank, size;
+  class_mpi_rank_and_size(&rank,&size);
+  if (size > 1)
+    printf("[process %d] ",rank);
+}
+
+static int memory_compare_sites(const void * a, const void * b) {
+  const struct memory_site * pa = *(const struct memory_site **)a;
+  const struct memory_site * pb = *(const struct memory_site **)b;
+  return (pa->usage.peak < pb->usage.peak) - (pa->usage.peak > pb->usage.peak);
+}
+
+static int memory_compare_modules(const void * a, const void * b) {
+  const struct memory_module * pa = (const struct memory_module *)a;
+  const struct memory_module * pb = (const struct memory_module *)b;
+  return (pa->usage.peak < pb->usage.peak) - (pa->usage.peak > pb->usage.peak);
+}
+
+/**
+ * Report the memory allocated from a file and still in use, with its
+ * three largest call sites. Called through class_memory_leaks() at the
+ * end of the *_free() function of each module: what remains is either
+ * kept in a cache for later runs (until the corresponding *_clear()
+ * function), or leaked.
+ *
+ * @param file     Input: file of the module (__FILE__)
+ * @param function Input: calling function (__func__)
+ */
+
+void class_memory_check(const char * file, const char * function) {
+
+  const char * name = memory_basename(file);
+  struct memory_site * largest[3] = {NULL,NULL,NULL};
+  int index_module, index_site, index_largest, index;
+
+#pragma omp critical (class_memory)
+  {
+    for (index_module=0; index_module<memory_module_size; index_module++)
+      if (strcmp(memory_modules[index_module].name,name) == 0)
+        break;
+
+    if ((index_module < memory_module_size) && (memory_modules[index_module].usage.blocks > 0)) {
+
+      for (index_site=0; index_site<_MEMORY_SITES_MAX_; index_site++) {
+        if ((memory_sites[index_site].file == NULL) ||
+            (memory_sites[index_site].index_module != index_module) ||
+            (memory_sites[index_site].usage.blocks == 0))
+          continue;
+        for (index_largest=0; index_largest<3; index_largest++) {
+          if ((largest[index_largest] == NULL) ||
+              (memory_sites[index_site].usage.current > largest[index_largest]->usage.current)) {
+            for (index=2; index>index_largest; index--)
+              largest[index] = largest[index-1];
+            largest[index_largest] = &(memory_sites[index_site]);
+            break;
+          }
+        }
+      }
+
+      memory_print_prefix();
+      printf(" -> memory check after %s(): %ld block(s) of %s still in use, %.3f MB (kept for later runs, or leaked)\n",
+             function,memory_modules[index_module].usage.blocks,name,memory_modules[index_module].usage.current/1048576.);
+      for (index_largest=0; (index_largest<3) && (largest[index_largest] != NULL); index_largest++) {
+        memory_print_prefix();
+        printf("    %s:%d: %ld block(s), %.3f MB\n",
+               memory_basename(largest[index_largest]->file),largest[index_largest]->line,
+               largest[index_largest]->usage.blocks,largest[index_largest]->usage.current/1048576.);
+      }
+    }
+  }
+}
+
+/**
+ * Print the memory usage of the process so far: totals, then for each
+ * file and for the twenty call sites with the highest high-water
+ * marks, the peak and current bytes in use, the bytes allocated so far
+ * and the number of allocations. Called through class_memory_report().
+ */
+
+void class_memory_print() {
+
+  struct memory_module * modules = NULL;
+  struct memory_site ** sites = NULL;
+  int index_module, index_site, site_size = 0;
+
+#pragma omp critical (class_memory)
+  {
+    modules = malloc(_MEMORY_MODULES_MAX_*sizeof(struct memory_module));
+    sites = malloc(_MEMORY_SITES_MAX_*sizeof(struct memory_site *));
+
+    if ((modules != NULL) && (sites != NULL)) {
+
+      memcpy(modules,memory_modules,memory_module_size*sizeof(struct memory_module));
+      qsort(modules,memory_module_size,sizeof(struct memory_module),memory_compare_modules);
+      for (index_site=0; index_site<_MEMORY_SITES_MAX_; index_site++)
+        if (memory_sites[index_site].file != NULL)
+          sites[site_size++] = &(memory_sites[index_site]);
+      qsort(sites,site_size,sizeof(struct memory_site *),memory_compare_sites);
+
+      memory_print_prefix();
+      printf("Memory allocated by CLASS: peak %.3f MB, still in use %.3f MB in %ld block(s), %.3f MB in %ld allocation(s)\n",
+             memory_all.peak/1048576.,memory_all.current/1048576.,memory_all.blocks,memory_all.total/1048576.,memory_all.count);
+      memory_print_prefix();
+      printf(" -> %-40s %12s %12s %12s %12s\n","file","peak [MB]","in use [MB]","total [MB]","allocations");
+      for (index_module=0; index_module<memory_module_size; index_module++) {
+        memory_print_prefix();
+        printf(" -> %-40s %12.3f %12.3f %12.3f %12ld\n",modules[index_module].name,modules[index_module].usage.peak/1048576.,
+               modules[index_module].usage.current/1048576.,modules[index_module].usage.total/1048576.,modules[index_module].usage.count);
+      }
+      memory_print_prefix();
+      printf(" -> %-40s %12s %12s %12s %12s\n","call site","peak [MB]","in use [MB]","total [MB]","allocations");
+      for (index_site=0; index_site<MIN(site_size,20); index_site++) {
+        char site_name[_FILENAMESIZE_];
+        snprintf(site_name,_FILENAMESIZE_,"%s:%d",memory_basename(sites[index_site]->file),sites[index_site]->line);
+        memory_print_prefix();
+        printf(" -> %-40s %12.3f %12.3f %12.3f %12ld\n",site_name,sites[index_site]->usage.peak/1048576.,
+               sites[index_site]->usage.current/1048576.,sites[index_site]->usage.total/1048576.,sites[index_site]->usage.count);
+      }
+    }
+
+    free(modules);
+    free(sites);
+  }
+}
+
+#endif
@@ -48,6 +48,19 @@ int initialize_generic_integrator(
 	      sizeof(double)*n_dim,
 	      pgi->error_message);
 
+  class_alloc(pgi->yold,
+	      sizeof(double)*n_dim,
+	      pgi->error_message);
+  class_alloc(pgi->dydxold,
+	      sizeof(double)*n_dim,
+	      pgi->error_message);
+  class_alloc(pgi->yinterp,
+	      sizeof(double)*n_dim,
+	      pgi->error_message);
+  class_alloc(pgi->dydxinterp,
+	      sizeof(double)*n_dim,
+	      pgi->error_message);
+
   return _SUCCESS_;
 }
 
@@ -73,6 +86,11 @@ int cleanup_generic_integrator(struct generic_integrator_workspace * pgi){
   free(pgi->ak6);
   free(pgi->ytemp);
 
+  free(pgi->yold);
+  free(pgi->dydxold);
+  free(pgi->yinterp);
+  free(pgi->dydxinterp);
+
   return _SUCCESS_;
 }
 
@@ -129,6 +147,100 @@ int generic_integrator(int (*derivs)(double x, double y[], double yprime[], void
 
 }
 
+/**
+ * Same as generic_integrator(), with dense output: output() is called
+ * at each value x_sampling[*next_index_x], x_sampling[*next_index_x+1],
+ * ... lying in ]x1,x2], without shortening the adaptive steps to land
+ * on them. The solution at these values is given by the cubic Hermite
+ * interpolant built on y and dy/dx at both ends of the accepted step
+ * containing them; the derivatives are evaluated once at the
+ * interpolated point before calling output(). The derivatives at the
+ * end of each step are re-used at the beginning of the next one, so
+ * that the interpolation requires no additional evaluation. On exit,
+ * *next_index_x is the index of the first value not yet reached.
+ */
+int generic_integrator_dense(int (*derivs)(double x, double y[], double yprime[], void * parameters_and_workspace, ErrorMsg error_message),
+			     double x1,
+			     double x2,
+			     double ystart[],
+			     void * parameters_and_workspace_for_derivs,
+			     double eps,
+			     double hmin,
+			     double * x_sampling,
+			     int x_size,
+			     int * next_index_x,
+			     int (*output)(double x, double y[], double dy[], int index_x, void * parameters_and_workspace, ErrorMsg error_message),
+			     struct generic_integrator_workspace * pgi)
+
+{
+  int nstp,i;
+  double x,xold,hnext,hdid,h,h1,t,h00,h10,h01,h11;
+
+  h1=x2-x1;
+  x=x1;
+  h=dsign(h1,x2-x1);
+  for (i=0;i<pgi->n;i++) pgi->y[i]=ystart[i];
+  class_call((*derivs)(x,pgi->y,pgi->dydx,parameters_and_workspace_for_derivs, pgi->error_message),
+	     pgi->error_message,
+	     pgi->error_message);
+  for (nstp=1;nstp<=_MAXSTP_;nstp++) {
+    for (i=0;i<pgi->n;i++) {
+      pgi->yscal[i]=fabs(pgi->y[i])+fabs(pgi->dydx[i]*h)+_TINY_;
+      pgi->yold[i]=pgi->y[i];
+      pgi->dydxold[i]=pgi->dydx[i];
+    }
+    xold=x;
+    if ((x+h-x2)*(x+h-x1) > 0.0) h=x2-x;
+    class_call(rkqs(&x,
+		    h,
+		    eps,
+		    &hdid,
+		    &hnext,
+		    derivs,
+		    parameters_and_workspace_for_derivs,
+		    pgi),
+	       pgi->error_message,
+	       pgi->error_message);
+    /* derivatives at the end of the step, also used at the beginning of the next one */
+    class_call((*derivs)(x,pgi->y,pgi->dydx,parameters_and_workspace_for_derivs, pgi->error_message),
+	       pgi->error_message,
+	       pgi->error_message);
+    /* output at the values crossed by the step [xold,x] */
+    while ((*next_index_x < x_size) && (x_sampling[*next_index_x] <= x)) {
+      t=(x_sampling[*next_index_x]-xold)/hdid;
+      h00=(1.+2.*t)*(1.-t)*(1.-t);
+      h10=t*(1.-t)*(1.-t)*hdid;
+      h01=t*t*(3.-2.*t);
+      h11=t*t*(t-1.)*hdid;
+      for (i=0;i<pgi->n;i++)
+	pgi->yinterp[i]=h00*pgi->yold[i]+h10*pgi->dydxold[i]+h01*pgi->y[i]+h11*pgi->dydx[i];
+      class_call((*derivs)(x_sampling[*next_index_x],pgi->yinterp,pgi->dydxinterp,parameters_and_workspace_for_derivs, pgi->error_message),
+		 pgi->error_message,
+		 pgi->error_message);
+      class_call((*output)(x_sampling[*next_index_x],pgi->yinterp,pgi->dydxinterp,*next_index_x,parameters_and_workspace_for_derivs, pgi->error_message),
+		 pgi->error_message,
+		 pgi->error_message);
+      (*next_index_x)++;
+    }
+    if ((x-x2)*(x2-x1) >= 0.0) {
+      for (i=0;i<pgi->n;i++) ystart[i]=pgi->y[i];
+      return _SUCCESS_;
+    }
+    class_test(fabs(hnext/x1) <= hmin,
+	       pgi->error_message,
+	       "Step size too small: step:%g, minimum:%g, in interval: [%g:%g]",
+	       fabs(hnext/x1),
+	       hmin,
+	       x1,
+	       x2);
+    h=hnext;
+  }
+
+  class_stop(pgi->error_message,
+	     "Too many integration steps needed within interval [%g : %g],\n the system of equations is probably buggy or featuring a discontinuity",x1,x2);
+
+}
+
 int rkqs(double *x, double htry, double eps,
 	 double *hdid, double *hnext,
 	 int (*derivs)(double, double [], double [], void * parameters_and_workspace, ErrorMsg error_message),
@@ -0,0 +1,904 @@
+/**
+ * Module with a polynomial emulator of the lensed C_l's and of
+ * P(k,z): least-squares fit on a set of runs of the code, error
+ * model estimated on validation runs, evaluation, and storage in a
+ * file
+ */
+
+#include "emulator.h"
+
+/**
+ * Ridge term added to the diagonal of the normal equations, in units
+ * of their largest diagonal element
+ */
+
+#define _EMULATOR_RIDGE_ 1.e-12
+
+/**
+ * Relative tolerance when comparing the numerical values of a fixed
+ * parameter
+ */
+
+#define _EMULATOR_FIXED_TOL_ 1.e-10
+
+/**
+ * Allocate the description of the training box, and list the
+ * monomials of total degree at most 'degree' in 'par_size'
+ * variables.
+ *
+ * @param pem           Output: emulator
+ * @param par_size      Input: number of emulated parameters
+ * @param degree        Input: maximum total degree
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int emulator_init(
+                  struct emulator * pem,
+                  int par_size,
+                  int degree,
+                  ErrorMsg error_message
+                  ){
+
+  int * power;
+  int index_par, index_basis, total, pass;
+
+  class_test(par_size < 1,
+             error_message,
+             "the emulator needs at least one parameter");
+
+  class_test(degree < 0,
+             error_message,
+             "the degree of the emulator (%d) should be positive",degree);
+
+  pem->par_size = par_size;
+  pem->degree = degree;
+  pem->fixed_size = 0;
+  pem->fixed_name = NULL;
+  pem->fixed_value = NULL;
+  pem->l_max = 0;
+  pem->k_size = 0;
+  pem->z_size = 0;
+  pem->ln_k = NULL;
+  pem->z = NULL;
+  pem->out_size = 0;
+  pem->coefficient = NULL;
+  pem->error = NULL;
+
+  class_calloc(pem->par_name,par_size,sizeof(FileArg),error_message);
+  class_alloc(pem->par_min,par_size*sizeof(double),error_message);
+  class_alloc(pem->par_max,par_size*sizeof(double),error_message);
+
+  /** - run an odometer over the powers of each parameter, keeping
+      the monomials of total degree <= degree: count them in a first
+      pass, store them in a second one */
+
+  class_alloc(power,par_size*sizeof(int),error_message);
+  pem->exponent = NULL;
+
+  for (pass=0; pass<2; pass++) {
+
+    for (index_par=0; index_par<par_size; index_par++)
+      power[index_par] = 0;
+
+    index_basis = 0;
+
+    while (_TRUE_) {
+
+      total = 0;
+      for (index_par=0; index_par<par_size; index_par++)
+        total += power[index_par];
+
+      if (total <= degree) {
+        if (pass == 1) {
+          for (index_par=0; index_par<par_size; index_par++)
+            pem->exponent[index_basis*par_size+index_par] = power[index_par];
+        }
+        index_basis++;
+      }
+
+      /* next set of powers */
+      for (index_par=0; index_par<par_size; index_par++) {
+        if (power[index_par] < degree) {
+          power[index_par]++;
+          break;
+        }
+        power[index_par] = 0;
+      }
+      if (index_par == par_size)
+        break;
+    }
+
+    if (pass == 0) {
+      pem->basis_size = index_basis;
+      class_alloc(pem->exponent,pem->basis_size*par_size*sizeof(int),error_message);
+    }
+  }
+
+  free(power);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Define the layout of the output vector, given the lensed C_l types
+ * and the grid of P(k,z) to be emulated.
+ *
+ * @param pem           Input/Output: emulator
+ * @param has_cl        Input: has_cl[emulator_tt,...] = which lensed C_l types are emulated
+ * @param l_max         Input: largest multipole (ignored if no C_l's)
+ * @param k_size        Input: number of wavenumbers of the P(k,z) grid (0 if P(k,z) is not emulated)
+ * @param k_min         Input: smallest wavenumber in 1/Mpc
+ * @param k_max         Input: largest wavenumber in 1/Mpc
+ * @param z_size        Input: number of redshifts of the P(k,z) grid
+ * @param z_max         Input: largest redshift (the grid is linear from z=0)
+ * @param pk_nonlinear  Input: whether P(k,z) is the non-linear spectrum
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int emulator_outputs_init(
+                          struct emulator * pem,
+                          short * has_cl,
+                          int l_max,
+                          int k_size,
+                          double k_min,
+                          double k_max,
+                          int z_size,
+                          double z_max,
+                          short pk_nonlinear,
+                          ErrorMsg error_message
+                          ){
+
+  int index_type, index_k, index_z;
+  short has_any_cl = _FALSE_;
+
+  class_test((has_cl[emulator_te] == _TRUE_) && ((has_cl[emulator_tt] == _FALSE_) || (has_cl[emulator_ee] == _FALSE_)),
+             error_message,
+             "C_l^te can only be emulated together with C_l^tt and C_l^ee");
+
+  pem->out_size = 0;
+  for (index_type=0; index_type<_EMULATOR_CL_TYPES_; index_type++) {
+    pem->has_cl[index_type] = has_cl[index_type];
+    pem->index_cl[index_type] = -1;
+    if (has_cl[index_type] == _TRUE_) {
+      has_any_cl = _TRUE_;
+      pem->index_cl[index_type] = pem->out_size;
+      pem->out_size += l_max-1;
+    }
+  }
+  pem->l_max = (has_any_cl == _TRUE_ ? l_max : 0);
+
+  class_test((has_any_cl == _TRUE_) && (l_max < 2),
+             error_message,
+             "l_max=%d should be at least 2",l_max);
+
+  pem->k_size = k_size;
+  pem->z_size = (k_size > 0 ? z_size : 0);
+  pem->pk_nonlinear = pk_nonlinear;
+  pem->index_pk = pem->out_size;
+
+  if (k_size > 0) {
+
+    class_test((k_size < 2) || (z_size < 1) || (k_min <= 0.) || (k_max <= k_min) || (z_max < 0.) || ((z_size > 1) && (z_max == 0.)),
+               error_message,
+               "inconsistent P(k,z) grid: %d values of k in [%e,%e], %d values of z up to %e",k_size,k_min,k_max,z_size,z_max);
+
+    class_alloc(pem->ln_k,k_size*sizeof(double),error_message);
+    class_alloc(pem->z,z_size*sizeof(double),error_message);
+
+    for (index_k=0; index_k<k_size; index_k++)
+      pem->ln_k[index_k] = log(k_min) + (log(k_max)-log(k_min))*index_k/(k_size-1.);
+
+    for (index_z=0; index_z<z_size; index_z++)
+      pem->z[index_z] = (z_size > 1 ? z_max*index_z/(z_size-1.) : 0.);
+
+    pem->out_size += k_size*z_size;
+  }
+
+  class_test(pem->out_size == 0,
+             error_message,
+             "nothing to emulate: no lensed C_l's and no P(k,z)");
+
+  return _SUCCESS_;
+}
+
+/**
+ * Values of all the monomials at a point of the box
+ *
+ * @param pem        Input: emulator
+ * @param parameters Input: values of the parameters
+ * @param basis      Output: basis[index_basis]
+ * @return the error status
+ */
+
+static int emulator_basis(
+                          struct emulator * pem,
+                          double * parameters,
+                          double * basis
+                          ){
+
+  int index_par, index_basis, p;
+  double x;
+  double * x_power;
+
+  /* x_power[index_par*(degree+1)+p] = x^p, with x the parameter rescaled to [-1,1] */
+  x_power = malloc(pem->par_size*(pem->degree+1)*sizeof(double));
+  if (x_power == NULL)
+    return _FAILURE_;
+
+  for (index_par=0; index_par<pem->par_size; index_par++) {
+    x = (2.*parameters[index_par]-pem->par_min[index_par]-pem->par_max[index_par])/(pem->par_max[index_par]-pem->par_min[index_par]);
+    x_power[index_par*(pem->degree+1)] = 1.;
+    for (p=1; p<=pem->degree; p++)
+      x_power[index_par*(pem->degree+1)+p] = x_power[index_par*(pem->degree+1)+p-1]*x;
+  }
+
+  for (index_basis=0; index_basis<pem->basis_size; index_basis++) {
+    basis[index_basis] = 1.;
+    for (index_par=0; index_par<pem->par_size; index_par++)
+      basis[index_basis] *= x_power[index_par*(pem->degree+1)+pem->exponent[index_basis*pem->par_size+index_par]];
+  }
+
+  free(x_power);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Least-squares fit of the coefficients on the first 'fit_size'
+ * samples, by a Cholesky decomposition of the normal equations
+ *
+ * @param pem           Input/Output: emulator (coefficient is filled)
+ * @param fit_size      Input: number of samples used in the fit
+ * @param parameters    Input: parameters[index_sample*par_size+index_par]
+ * @param outputs       Input: outputs[index_sample*out_size+index_out]
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+static int emulator_fit(
+                        struct emulator * pem,
+                        int fit_size,
+                        double * parameters,
+                        double * outputs,
+                        ErrorMsg error_message
+                        ){
+
+  int nb = pem->basis_size;
+  int no = pem->out_size;
+  int index_sample, i, j, m, index_out;
+  double * design;
+  double * normal;
+  double * rhs;
+  double diag_max, sum;
+
+  class_alloc(design,fit_size*nb*sizeof(double),error_message);
+  class_calloc(normal,nb*nb,sizeof(double),error_message);
+
+  for (index_sample=0; index_sample<fit_size; index_sample++) {
+    class_test(emulator_basis(pem,parameters+index_sample*pem->par_size,design+index_sample*nb) == _FAILURE_,
+               error_message,
+               "could not allocate the powers of the parameters");
+  }
+
+  /** - normal matrix A^T A (lower triangle) and right-hand sides A^T Y */
+  for (i=0; i<nb; i++) {
+    for (j=0; j<=i; j++) {
+      sum = 0.;
+      for (index_sample=0; index_sample<fit_size; index_sample++)
+        sum += design[index_sample*nb+i]*design[index_sample*nb+j];
+      normal[i*nb+j] = sum;
+    }
+  }
+
+  rhs = pem->coefficient;
+  for (i=0; i<nb*no; i++)
+    rhs[i] = 0.;
+  for (index_sample=0; index_sample<fit_size; index_sample++) {
+    for (i=0; i<nb; i++) {
+      for (index_out=0; index_out<no; index_out++) {
+        rhs[i*no+index_out] += design[index_sample*nb+i]*outputs[index_sample*no+index_out];
+      }
+    }
+  }
+
+  diag_max = 0.;
+  for (i=0; i<nb; i++)
+    diag_max = MAX(diag_max,normal[i*nb+i]);
+  for (i=0; i<nb; i++)
+    normal[i*nb+i] += _EMULATOR_RIDGE_*diag_max;
+
+  /** - Cholesky decomposition L L^T in place */
+  for (j=0; j<nb; j++) {
+    sum = normal[j*nb+j];
+    for (m=0; m<j; m++)
+      sum -= normal[j*nb+m]*normal[j*nb+m];
+    class_test(sum <= 0.,
+               error_message,
+               "the normal equations of the fit are singular: increase the number of runs or decrease the degree");
+    normal[j*nb+j] = sqrt(sum);
+    for (i=j+1; i<nb; i++) {
+      sum = normal[i*nb+j];
+      for (m=0; m<j; m++)
+        sum -= normal[i*nb+m]*normal[j*nb+m];
+      normal[i*nb+j] = sum/normal[j*nb+j];
+    }
+  }
+
+  /** - forward and backward substitutions, for all outputs at once */
+  for (i=0; i<nb; i++) {
+    for (m=0; m<i; m++)
+      for (index_out=0; index_out<no; index_out++)
+        rhs[i*no+index_out] -= normal[i*nb+m]*rhs[m*no+index_out];
+    for (index_out=0; index_out<no; index_out++)
+      rhs[i*no+index_out] /= normal[i*nb+i];
+  }
+  for (i=nb-1; i>=0; i--) {
+    for (m=i+1; m<nb; m++)
+      for (index_out=0; index_out<no; index_out++)
+        rhs[i*no+index_out] -= normal[m*nb+i]*rhs[m*no+index_out];
+    for (index_out=0; index_out<no; index_out++)
+      rhs[i*no+index_out] /= normal[i*nb+i];
+  }
+
+  free(design);
+  free(normal);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Fit the emulator on a set of runs. The last 'validation_size' runs
+ * are first left out of the fit and used to estimate the error
+ * model; the final coefficients are then fitted on all runs.
+ *
+ * The outputs must already be transformed as described in struct
+ * emulator (ln(C_l), te correlation coefficient, ln(P)).
+ *
+ * @param pem             Input/Output: emulator
+ * @param sample_size     Input: number of runs
+ * @param validation_size Input: number of runs used for the error model
+ * @param parameters      Input: parameters[index_sample*par_size+index_par]
+ * @param outputs         Input: outputs[index_sample*out_size+index_out]
+ * @param error_message   Output: error message
+ * @return the error status
+ */
+
+int emulator_train(
+                   struct emulator * pem,
+                   int sample_size,
+                   int validation_size,
+                   double * parameters,
+                   double * outputs,
+                   ErrorMsg error_message
+                   ){
+
+  int index_sample, index_out;
+  int fit_size = sample_size-validation_size;
+  double * prediction;
+  double residual;
+
+  class_test((validation_size < 0) || (fit_size < pem->basis_size),
+             error_message,
+             "%d runs are not enough to fit %d coefficients with %d validation runs",sample_size,pem->basis_size,validation_size);
+
+  class_alloc(pem->coefficient,pem->basis_size*pem->out_size*sizeof(double),error_message);
+  class_calloc(pem->error,pem->out_size,sizeof(double),error_message);
+  pem->error_cl_max = 0.;
+  pem->error_pk_max = 0.;
+
+  /** - error model from the validation runs */
+  if (validation_size > 0) {
+
+    class_call(emulator_fit(pem,fit_size,parameters,outputs,error_message),
+               error_message,
+               error_message);
+
+    class_alloc(prediction,pem->out_size*sizeof(double),error_message);
+
+    for (index_sample=fit_size; index_sample<sample_size; index_sample++) {
+
+      class_call(emulator_evaluate(pem,parameters+index_sample*pem->par_size,prediction,error_message),
+                 error_message,
+                 error_message);
+
+      for (index_out=0; index_out<pem->out_size; index_out++) {
+        residual = prediction[index_out]-outputs[index_sample*pem->out_size+index_out];
+        pem->error[index_out] += residual*residual/validation_size;
+        if (index_out < pem->index_pk)
+          pem->error_cl_max = MAX(pem->error_cl_max,fabs(residual));
+        else
+          pem->error_pk_max = MAX(pem->error_pk_max,fabs(residual));
+      }
+    }
+
+    for (index_out=0; index_out<pem->out_size; index_out++)
+      pem->error[index_out] = sqrt(pem->error[index_out]);
+
+    free(prediction);
+  }
+
+  /** - final fit on all runs */
+  class_call(emulator_fit(pem,sample_size,parameters,outputs,error_message),
+             error_message,
+             error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Emulated output vector at a point of the box
+ *
+ * @param pem           Input: emulator
+ * @param parameters    Input: values of the parameters
+ * @param output        Output: output[index_out], of size pem->out_size
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int emulator_evaluate(
+                      struct emulator * pem,
+                      double * parameters,
+                      double * output,
+                      ErrorMsg error_message
+                      ){
+
+  int index_basis, index_out;
+  double * basis;
+  double * coefficient;
+
+  class_alloc(basis,pem->basis_size*sizeof(double),error_message);
+
+  class_test(emulator_basis(pem,parameters,basis) == _FAILURE_,
+             error_message,
+             "could not allocate the powers of the parameters");
+
+  for (index_out=0; index_out<pem->out_size; index_out++)
+    output[index_out] = 0.;
+
+  for (index_basis=0; index_basis<pem->basis_size; index_basis++) {
+    coefficient = pem->coefficient+index_basis*pem->out_size;
+    for (index_out=0; index_out<pem->out_size; index_out++)
+      output[index_out] += basis[index_basis]*coefficient[index_out];
+  }
+
+  free(basis);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Check whether the emulator can replace a run with the input
+ * parameters of a file_content structure: these should consist of
+ * the emulated parameters, inside the training box, and of the fixed
+ * parameters of the training runs, with the same values. Otherwise
+ * the caller should run the full calculation.
+ *
+ * @param pem        Input: emulator
+ * @param pfc        Input: input parameters
+ * @param parameters Output: values of the emulated parameters (if usable)
+ * @param usable     Output: _TRUE_ if the emulator can be used
+ * @return the error status
+ */
+
+int emulator_match(
+                   struct emulator * pem,
+                   struct file_content * pfc,
+                   double * parameters,
+                   short * usable
+                   ){
+
+  int index, index_par, index_fixed;
+  int found_par = 0;
+  int found_fixed = 0;
+  double value, fixed_value;
+  char * end;
+  char * fixed_end;
+
+  *usable = _FALSE_;
+
+  for (index=0; index<pfc->size; index++) {
+
+    for (index_par=0; index_par<pem->par_size; index_par++) {
+      if (strcmp(pfc->name[index],pem->par_name[index_par]) == 0)
+        break;
+    }
+
+    /** - an emulated parameter: read its value and check the box */
+    if (index_par < pem->par_size) {
+      value = strtod(pfc->value[index],&end);
+      if ((end == pfc->value[index]) ||
+          (value < pem->par_min[index_par]) ||
+          (value > pem->par_max[index_par]))
+        return _SUCCESS_;
+      parameters[index_par] = value;
+      found_par++;
+      continue;
+    }
+
+    /** - otherwise, a fixed parameter with the same value, as a string or as a number */
+    for (index_fixed=0; index_fixed<pem->fixed_size; index_fixed++) {
+      if (strcmp(pfc->name[index],pem->fixed_name[index_fixed]) == 0)
+        break;
+    }
+    if (index_fixed == pem->fixed_size)
+      return _SUCCESS_;
+
+    if (strcmp(pfc->value[index],pem->fixed_value[index_fixed]) != 0) {
+      value = strtod(pfc->value[index],&end);
+      fixed_value = strtod(pem->fixed_value[index_fixed],&fixed_end);
+      if ((end == pfc->value[index]) || (*end != '\0') ||
+          (fixed_end == pem->fixed_value[index_fixed]) || (*fixed_end != '\0') ||
+          (fabs(value-fixed_value) > _EMULATOR_FIXED_TOL_*fabs(fixed_value)))
+        return _SUCCESS_;
+    }
+    found_fixed++;
+  }
+
+  if ((found_par == pem->par_size) && (found_fixed == pem->fixed_size))
+    *usable = _TRUE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Lensed C_l's at one multipole from an emulated output vector
+ *
+ * @param pem           Input: emulator
+ * @param output        Input: output vector from emulator_evaluate()
+ * @param l             Input: multipole, 2 <= l <= l_max
+ * @param cl            Output: cl[emulator_tt,...] (left unchanged for the types that are not emulated)
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int emulator_cl_at_l(
+                     struct emulator * pem,
+                     double * output,
+                     int l,
+                     double * cl,
+                     ErrorMsg error_message
+                     ){
+
+  int index_type;
+
+  class_test((l < 2) || (l > pem->l_max),
+             error_message,
+             "l=%d outside of the emulated range [2,%d]",l,pem->l_max);
+
+  for (index_type=0; index_type<_EMULATOR_CL_TYPES_; index_type++) {
+    if ((pem->has_cl[index_type] == _TRUE_) && (index_type != emulator_te))
+      cl[index_type] = exp(output[pem->index_cl[index_type]+l-2]);
+  }
+
+  if (pem->has_cl[emulator_te] == _TRUE_)
+    cl[emulator_te] = output[pem->index_cl[emulator_te]+l-2]*sqrt(cl[emulator_tt]*cl[emulator_ee]);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Weights of the cubic Lagrange interpolation on a regular grid,
+ * using the four nodes around x (or the first/last four at the edges)
+ *
+ * @param x0     Input: first node
+ * @param dx     Input: step
+ * @param size   Input: number of nodes (at least 2)
+ * @param x      Input: point
+ * @param first  Output: index of the first node used
+ * @param used   Output: number of nodes used (at most 4)
+ * @param weight Output: weight[0..used-1]
+ */
+
+static void emulator_lagrange_weights(
+                                      double x0,
+                                      double dx,
+                                      int size,
+                                      double x,
+                                      int * first,
+                                      int * used,
+                                      double * weight
+                                      ){
+
+  int i, j;
+  double t;
+
+  *used = MIN(size,4);
+  t = (x-x0)/dx;
+  *first = (int)floor(t)-(*used-2)/2;
+  *first = MAX(0,MIN(size-*used,*first));
+  t -= *first;
+
+  for (i=0; i<*used; i++) {
+    weight[i] = 1.;
+    for (j=0; j<*used; j++) {
+      if (j != i)
+        weight[i] *= (t-j)/(i-j);
+    }
+  }
+}
+
+/**
+ * Power spectrum at (k,z) from an emulated output vector, by cubic
+ * interpolation in ln(k) and z
+ *
+ * @param pem           Input: emulator
+ * @param output        Input: output vector from emulator_evaluate()
+ * @param k             Input: wavenumber in 1/Mpc
+ * @param z             Input: redshift
+ * @param pk            Output: P(k,z) in Mpc^3
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int emulator_pk_at_k_and_z(
+                           struct emulator * pem,
+                           double * output,
+                           double k,
+                           double z,
+                           double * pk,
+                           ErrorMsg error_message
+                           ){
+
+  double ln_k;
+  double weight_k[4], weight_z[4];
+  int first_k, first_z, used_k, used_z, i, j;
+  double ln_pk;
+
+  class_test(pem->k_size == 0,
+             error_message,
+             "P(k,z) was not emulated");
+
+  ln_k = log(k);
+
+  class_test((ln_k < pem->ln_k[0]-_EPSILON_) || (ln_k > pem->ln_k[pem->k_size-1]+_EPSILON_) ||
+             (z < 0.) || (z > pem->z[pem->z_size-1]*(1.+_EPSILON_)+_EPSILON_),
+             error_message,
+             "(k,z)=(%e,%e) outside of the emulated range [%e,%e]x[0,%e]",
+             k,z,exp(pem->ln_k[0]),exp(pem->ln_k[pem->k_size-1]),pem->z[pem->z_size-1]);
+
+  emulator_lagrange_weights(pem->ln_k[0],pem->ln_k[1]-pem->ln_k[0],pem->k_size,ln_k,&first_k,&used_k,weight_k);
+
+  if (pem->z_size > 1) {
+    emulator_lagrange_weights(0.,pem->z[1]-pem->z[0],pem->z_size,z,&first_z,&used_z,weight_z);
+  }
+  else {
+    first_z = 0;
+    used_z = 1;
+    weight_z[0] = 1.;
+  }
+
+  ln_pk = 0.;
+  for (j=0; j<used_z; j++)
+    for (i=0; i<used_k; i++)
+      ln_pk += weight_z[j]*weight_k[i]*output[pem->index_pk+(first_z+j)*pem->k_size+first_k+i];
+
+  *pk = exp(ln_pk);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Skip blank and comment lines before the next entry of an emulator file
+ *
+ * @param file Input: file
+ */
+
+static void emulator_skip_comments(
+                                   FILE * file
+                                   ){
+
+  int c;
+
+  while ((c = fgetc(file)) != EOF) {
+    if (c == '#') {
+      while (((c = fgetc(file)) != EOF) && (c != '\n'));
+    }
+    else if ((c != ' ') && (c != '\t') && (c != '\n') && (c != '\r')) {
+      ungetc(c,file);
+      return;
+    }
+  }
+}
+
+/**
+ * Write the emulator to a file
+ *
+ * @param pem           Input: emulator
+ * @param filename      Input: name of the file
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int emulator_write(
+                   struct emulator * pem,
+                   char * filename,
+                   ErrorMsg error_message
+                   ){
+
+  FILE * file;
+  int index, index_par, index_out;
+
+  class_open(file,filename,"w",error_message);
+
+  fprintf(file,"# polynomial emulator of the lensed C_l's and of P(k,z) of CLASS\n");
+  fprintf(file,"# number of emulated parameters, degree, number of fixed parameters\n");
+  fprintf(file,"%d %d %d\n",pem->par_size,pem->degree,pem->fixed_size);
+  fprintf(file,"# emulated parameters: name, lower and upper edges of the box\n");
+  for (index=0; index<pem->par_size; index++)
+    fprintf(file,"%s %.16e %.16e\n",pem->par_name[index],pem->par_min[index],pem->par_max[index]);
+  fprintf(file,"# fixed parameters: name, value\n");
+  for (index=0; index<pem->fixed_size; index++)
+    fprintf(file,"%s\t%s\n",pem->fixed_name[index],pem->fixed_value[index]);
+  fprintf(file,"# lensed C_l's: has_tt, has_ee, has_te, has_bb, has_pp, l_max\n");
+  for (index=0; index<_EMULATOR_CL_TYPES_; index++)
+    fprintf(file,"%d ",pem->has_cl[index]);
+  fprintf(file,"%d\n",pem->l_max);
+  fprintf(file,"# P(k,z): number of k, k_min, k_max (1/Mpc), number of z, z_max, non-linear\n");
+  fprintf(file,"%d %.16e %.16e %d %.16e %d\n",
+          pem->k_size,
+          (pem->k_size > 0 ? exp(pem->ln_k[0]) : 0.),
+          (pem->k_size > 0 ? exp(pem->ln_k[pem->k_size-1]) : 0.),
+          pem->z_size,
+          (pem->k_size > 0 ? pem->z[pem->z_size-1] : 0.),
+          pem->pk_nonlinear);
+  fprintf(file,"# largest residuals over the validation runs: ln(C_l) and te correlation, ln(P)\n");
+  fprintf(file,"%.6e %.6e\n",pem->error_cl_max,pem->error_pk_max);
+  fprintf(file,"# rms residual of each output over the validation runs\n");
+  for (index_out=0; index_out<pem->out_size; index_out++)
+    fprintf(file,"%.6e\n",pem->error[index_out]);
+  fprintf(file,"# coefficients: one line per monomial (powers of each parameter, then coefficients of all outputs)\n");
+  for (index=0; index<pem->basis_size; index++) {
+    for (index_par=0; index_par<pem->par_size; index_par++)
+      fprintf(file,"%d ",pem->exponent[index*pem->par_size+index_par]);
+    for (index_out=0; index_out<pem->out_size; index_out++)
+      fprintf(file," %.16e",pem->coefficient[index*pem->out_size+index_out]);
+    fprintf(file,"\n");
+  }
+
+  fclose(file);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Read an emulator written by emulator_write()
+ *
+ * @param filename      Input: name of the file
+ * @param pem           Output: emulator
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int emulator_read(
+                  char * filename,
+                  struct emulator * pem,
+                  ErrorMsg error_message
+                  ){
+
+  FILE * file;
+  int par_size, degree, fixed_size, flag, l_max, k_size, z_size, pk_nonlinear;
+  int index, index_par, index_out, power;
+  double k_min, k_max, z_max;
+  short has_cl[_EMULATOR_CL_TYPES_];
+  char line[2*_ARGUMENT_LENGTH_MAX_];
+  char * separator;
+  int size;
+
+  class_open(file,filename,"r",error_message);
+
+  emulator_skip_comments(file);
+  class_test(fscanf(file,"%d %d %d",&par_size,&degree,&fixed_size) != 3,
+             error_message,
+             "could not read the header of %s",filename);
+
+  class_call(emulator_init(pem,par_size,degree,error_message),
+             error_message,
+             error_message);
+
+  for (index=0; index<par_size; index++) {
+    emulator_skip_comments(file);
+    class_test(fscanf(file,"%1023s %lf %lf",pem->par_name[index],&(pem->par_min[index]),&(pem->par_max[index])) != 3,
+               error_message,
+               "could not read emulated parameter %d in %s",index,filename);
+  }
+
+  pem->fixed_size = fixed_size;
+  class_calloc(pem->fixed_name,MAX(fixed_size,1),sizeof(FileArg),error_message);
+  class_calloc(pem->fixed_value,MAX(fixed_size,1),sizeof(FileArg),error_message);
+  for (index=0; index<fixed_size; index++) {
+    emulator_skip_comments(file);
+    class_test(fgets(line,2*_ARGUMENT_LENGTH_MAX_,file) == NULL,
+               error_message,
+               "could not read fixed parameter %d in %s",index,filename);
+    size = strlen(line);
+    while ((size > 0) && ((line[size-1] == '\n') || (line[size-1] == '\r')))
+      line[--size] = '\0';
+    separator = strchr(line,'\t');
+    class_test(separator == NULL,
+               error_message,
+               "could not read fixed parameter %d in %s",index,filename);
+    *separator = '\0';
+    strcpy(pem->fixed_name[index],line);
+    strcpy(pem->fixed_value[index],separator+1);
+  }
+
+  for (index=0; index<_EMULATOR_CL_TYPES_; index++) {
+    emulator_skip_comments(file);
+    class_test(fscanf(file,"%d",&flag) != 1,
+               error_message,
+               "could not read the list of C_l types in %s",filename);
+    has_cl[index] = (short)flag;
+  }
+  emulator_skip_comments(file);
+  class_test(fscanf(file,"%d",&l_max) != 1,
+             error_message,
+             "could not read l_max in %s",filename);
+
+  emulator_skip_comments(file);
+  class_test(fscanf(file,"%d %lf %lf %d %lf %d",&k_size,&k_min,&k_max,&z_size,&z_max,&pk_nonlinear) != 6,
+             error_message,
+             "could not read the P(k,z) grid in %s",filename);
+
+  class_call(emulator_outputs_init(pem,has_cl,l_max,k_size,k_min,k_max,z_size,z_max,(short)pk_nonlinear,error_message),
+             error_message,
+             error_message);
+
+  emulator_skip_comments(file);
+  class_test(fscanf(file,"%lf %lf",&(pem->error_cl_max),&(pem->error_pk_max)) != 2,
+             error_message,
+             "could not read the largest residuals in %s",filename);
+
+  class_alloc(pem->error,pem->out_size*sizeof(double),error_message);
+  emulator_skip_comments(file);
+  for (index_out=0; index_out<pem->out_size; index_out++) {
+    class_test(fscanf(file,"%lf",&(pem->error[index_out])) != 1,
+               error_message,
+               "could not read the rms residuals in %s",filename);
+  }
+
+  class_alloc(pem->coefficient,pem->basis_size*pem->out_size*sizeof(double),error_message);
+  for (index=0; index<pem->basis_size; index++) {
+    emulator_skip_comments(file);
+    for (index_par=0; index_par<par_size; index_par++) {
+      class_test((fscanf(file,"%d",&power) != 1) || (power != pem->exponent[index*par_size+index_par]),
+                 error_message,
+                 "unexpected monomial %d in %s",index,filename);
+    }
+    for (index_out=0; index_out<pem->out_size; index_out++) {
+      class_test(fscanf(file,"%lf",&(pem->coefficient[index*pem->out_size+index_out])) != 1,
+                 error_message,
+                 "could not read the coefficients of monomial %d in %s",index,filename);
+    }
+  }
+
+  fclose(file);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the arrays of an emulator
+ *
+ * @param pem Input: emulator
+ * @return the error status
+ */
+
+int emulator_free(
+                  struct emulator * pem
+                  ){
+
+  free(pem->par_name);
+  free(pem->par_min);
+  free(pem->par_max);
+  free(pem->fixed_name);
+  free(pem->fixed_value);
+  free(pem->exponent);
+  free(pem->ln_k);
+  free(pem->z);
+  free(pem->coefficient);
+  free(pem->error);
+
+  return _SUCCESS_;
+}
@@ -34,7 +34,8 @@
     stepstat[4] = Number of LU decompositions.
     stepstat[5] = Number of linear solves.
     If ppt->perturbations_verbose > 2, this statistic is printed at the end of
-    each call to evolver.
+    each call to evolver. A caller can also collect it by passing an
+    array in the stepstat field of struct ndf15_options.
 
     Sparsity:
     When the number of equations becomes high, too much times is spent on solving
@@ -53,6 +54,12 @@
     structure of the equations are nearly optimal for the LU decomposition, so we don't
     want to mess it up by too many row permutations if we can avoid it. This is also why
     do not use any column permutation to pre-order the matrix.
+
+    A module that knows the structure of its equations can nevertheless pass a
+    structural sparsity pattern through evolver_ndf15_with_options(). The
+    pattern is then trusted from the start: the dense jacobians of the
+    learning phase are skipped and every jacobian costs one function
+    evaluation per column group instead of one per equation.
 */
 #include "common.h"
 #include "evolver_ndf15.h"
@@ -83,6 +90,50 @@ int evolver_ndf15(
                      ErrorMsg error_message),
           ErrorMsg error_message){
 
+  return evolver_ndf15_with_options(derivs,
+                                    x_ini,
+                                    x_final,
+                                    y_inout,
+                                    used_in_output,
+                                    neq,
+                                    parameters_and_workspace_for_derivs,
+                                    rtol,
+                                    minimum_variation,
+                                    timescale_and_approximation,
+                                    timestep_over_timescale,
+                                    t_vec,
+                                    tres,
+                                    output,
+                                    print_variables,
+                                    NULL,
+                                    error_message);
+}
+
+int evolver_ndf15_with_options(
+          int (*derivs)(double x,double * y,double * dy,
+                void * parameters_and_workspace, ErrorMsg error_message),
+          double x_ini,
+          double x_final,
+          double * y_inout,
+          int * used_in_output,
+          int neq,
+          void * parameters_and_workspace_for_derivs,
+          double rtol,
+          double minimum_variation,
+          int (*timescale_and_approximation)(double x,
+                             void * parameters_and_workspace,
+                             double * timescales,
+                             ErrorMsg error_message),
+          double timestep_over_timescale,
+          double * t_vec,
+          int tres,
+          int (*output)(double x,double y[],double dy[],int index_x,void * parameters_and_workspace,
+                ErrorMsg error_message),
+          int (*print_variables)(double x, double y[], double dy[], void *parameters_and_workspace,
+                     ErrorMsg error_message),
+          struct ndf15_options * options,
+          ErrorMsg error_message){
+
   /* Constants: */
   double G[5]={1.0,3.0/2.0,11.0/6.0,25.0/12.0,137.0/60.0};
   double alpha[5]={-37.0/200,-1.0/9.0,-8.23e-2,-4.15e-2, 0};
@@ -97,7 +148,7 @@ int evolver_ndf15(
   double *f0,*y,*wt,*ddfddt,*pred,*ynew,*invwt,*rhs,*psi,*difkp1,*del,*yinterp;
   double *tempvec1,*tempvec2,*ypinterp,*yppinterp;
   double **dif;
-  struct jacobian jac;
+  struct jacobian jac,*pjac;
   struct numjac_workspace nj_ws;
 
   /* Method variables: */
@@ -183,12 +234,38 @@ int evolver_ndf15(
   /*Set pointers:*/
   ynew = y_inout-1; /* This way y_inout is always up to date. */
 
-  /*Initialize the jacobian:*/
-  class_call(initialize_jacobian(&jac,neq,error_message),error_message,error_message);
+  /*Initialize the jacobian, unless the caller keeps it between calls:*/
+  if ((options != NULL) && (options->jac != NULL)){
+    pjac = options->jac;
+    /* The finite difference increments learned by numjac are only
+       meaningful for the solution they were learned on: at another
+       wavenumber, an increment grown for a small variable can be far
+       too large and spoil the jacobian. Start again from sqrt(eps): */
+    for (ii=1;ii<=neq;ii++) pjac->jacvec[ii]=1.490116119384765597872e-8;
+  }
+  else{
+    pjac = &jac;
+    class_call(initialize_jacobian(pjac,neq,error_message),error_message,error_message);
+  }
 
   /* Initialize workspace for numjac: */
   class_call(initialize_numjac_workspace(&nj_ws,neq,error_message),error_message,error_message);
 
+  /* Use the sparsity pattern of the calling module, if it provides one: */
+  if ((options != NULL) && (options->jacobian_pattern != NULL) && (pjac->use_sparse == _TRUE_) && (pjac->has_jacobian == _FALSE_)){
+    class_call((*options->jacobian_pattern)(neq,
+                                            pjac->max_nonzero,
+                                            pjac->spJ->Ap,
+                                            pjac->spJ->Ai,
+                                            &(pjac->has_pattern),
+                                            parameters_and_workspace_for_derivs,
+                                            error_message),
+               error_message,error_message);
+    if (pjac->has_pattern == _TRUE_){
+      pjac->repeated_pattern = pjac->trust_sparse;
+    }
+  }
+
   /* Initialize some method parameters:*/
   for(ii=0;ii<5;ii++){
     invGa[ii] = 1.0/(G[ii]*(1.0 - alpha[ii]));
@@ -237,7 +314,7 @@ int evolver_ndf15(
 
 
   nfenj=0;
-  class_call(numjac((*derivs),t,y,f0,&jac,&nj_ws,abstol,neq,
+  class_call(numjac((*derivs),t,y,f0,pjac,&nj_ws,abstol,neq,
              &nfenj,parameters_and_workspace_for_derivs,error_message),
              error_message,error_message);
   stepstat[3] += 1;
@@ -265,11 +342,21 @@ int evolver_ndf15(
              error_message,error_message);
   stepstat[2] += 1;
 
-  /*I assume that a full jacobi matrix is always calculated in the beginning...*/
-  for(ii=1;ii<=neq;ii++){
-    ddfddt[ii]=0.0;
-    for(jj=1;jj<=neq;jj++){
-      ddfddt[ii]+=(jac.dfdy[ii][jj])*f0[jj];
+  /* The first jacobian is a full jacobi matrix, unless a trusted sparsity pattern was used: */
+  if ((pjac->use_sparse == _TRUE_) && (pjac->repeated_pattern >= pjac->trust_sparse)){
+    for(ii=1;ii<=neq;ii++) ddfddt[ii]=0.0;
+    for(jj=0;jj<neq;jj++){
+      for(ii=pjac->spJ->Ap[jj];ii<pjac->spJ->Ap[jj+1];ii++){
+        ddfddt[pjac->spJ->Ai[ii]+1]+=pjac->xjac[ii]*f0[jj+1];
+      }
+    }
+  }
+  else{
+    for(ii=1;ii<=neq;ii++){
+      ddfddt[ii]=0.0;
+      for(jj=1;jj<=neq;jj++){
+        ddfddt[ii]+=(pjac->dfdy[ii][jj])*f0[jj];
+      }
     }
   }
 
@@ -293,7 +380,7 @@ int evolver_ndf15(
 
   hinvGak = h*invGa[k-1];
   nconhk = 0;     /*steps taken with current h and k*/
-  class_call(new_linearisation(&jac,hinvGak,neq,error_message),
+  class_call(new_linearisation(pjac,hinvGak,neq,error_message),
              error_message,error_message);
   stepstat[4] += 1;
   havrate = _FALSE_; /*false*/
@@ -328,7 +415,7 @@ int evolver_ndf15(
       adjust_stepsize(dif,(absh/abshlast),neq,k);
       hinvGak = h * invGa[k-1];
       nconhk = 0;
-      class_call(new_linearisation(&jac,hinvGak,neq,error_message),
+      class_call(new_linearisation(pjac,hinvGak,neq,error_message),
                  error_message,error_message);
       stepstat[4] += 1;
       havrate = _FALSE_;
@@ -387,17 +474,19 @@ int evolver_ndf15(
           }
 
           /*Solve the linear system A*x=del by using the LU decomposition stored in jac.*/
-          if (jac.use_sparse){
-            funcreturn = sp_lusolve(jac.Numerical, rhs+1, del+1);
+          class_counters_begin(counter_ndf15_linear_algebra);
+          if (pjac->use_sparse){
+            funcreturn = sp_lusolve(pjac->Numerical, rhs+1, del+1);
             class_test(funcreturn == _FAILURE_,error_message,
             "Failure in sp_lusolve. Possibly singular matrix!");
           }
           else{
             eqvec(rhs,del,neq);
-            funcreturn = lubksb(jac.LU,neq,jac.luidx,del);
+            funcreturn = lubksb(pjac->LU,neq,pjac->luidx,del);
             class_test(funcreturn == _FAILURE_,error_message,
             "Failure in lubksb. Possibly singular matrix!");
           }
+          class_counters_end(counter_ndf15_linear_algebra);
 
           stepstat[5]+=1;
           newnrm = 0.0;
@@ -455,7 +544,7 @@ int evolver_ndf15(
             class_call((*derivs)(t,y+1,f0+1,parameters_and_workspace_for_derivs,error_message),
                        error_message,error_message);
             nfenj=0;
-            class_call(numjac((*derivs),t,y,f0,&jac,&nj_ws,abstol,neq,
+            class_call(numjac((*derivs),t,y,f0,pjac,&nj_ws,abstol,neq,
                        &nfenj,parameters_and_workspace_for_derivs,error_message),
                        error_message,error_message);
             stepstat[3] += 1;
@@ -477,7 +566,7 @@ int evolver_ndf15(
             nconhk = 0;
           }
           /* A new linearisation is needed in both cases */
-          class_call(new_linearisation(&jac,hinvGak,neq,error_message),
+          class_call(new_linearisation(pjac,hinvGak,neq,error_message),
                      error_message,error_message);
           stepstat[4] += 1;
           havrate = _FALSE_;
@@ -526,7 +615,7 @@ int evolver_ndf15(
         adjust_stepsize(dif,(absh/abshlast),neq,k);
         hinvGak = h * invGa[k-1];
         nconhk = 0;
-        class_call(new_linearisation(&jac,hinvGak,neq,error_message),
+        class_call(new_linearisation(pjac,hinvGak,neq,error_message),
                    error_message,error_message);
         stepstat[4] += 1;
         havrate = _FALSE_;
@@ -678,6 +767,10 @@ int evolver_ndf15(
        stepstat[2],stepstat[3],stepstat[4],stepstat[5]);
   }
 
+  if ((options != NULL) && (options->stepstat != NULL)){
+    for(ii=0;ii<6;ii++) options->stepstat[ii] += stepstat[ii];
+  }
+
   /** Deallocate memory */
 
   free(buffer);
@@ -702,7 +795,8 @@ int evolver_ndf15(
   /*     free(dif[1]); */
   /*     free(dif); */
 
-  uninitialize_jacobian(&jac);
+  if (pjac == &jac)
+    uninitialize_jacobian(pjac);
   uninitialize_numjac_workspace(&nj_ws);
   return _SUCCESS_;
 
@@ -949,6 +1043,7 @@ int adjust_stepsize(double **dif, double abshdivabshlast, int neq,int k){
 int new_linearisation(struct jacobian *jac,double hinvGak,int neq,ErrorMsg error_message){
   double luparity, *Ax;
   int i,j,*Ap,*Ai,funcreturn;
+  class_counters_begin(counter_ndf15_linear_algebra);
   if(jac->use_sparse==1){
     Ap = jac->spJ->Ap; Ai = jac->spJ->Ai; Ax = jac->spJ->Ax;
     /* Construct jac->spJ->Ax from jac->xjac, the jacobian:*/
@@ -965,24 +1060,38 @@ int new_linearisation(struct jacobian *jac,double hinvGak,int neq,ErrorMsg error
     }
     /* Matrix constructed... */
     if(jac->new_jacobian==_TRUE_){
-      /*I have a new pattern, and I have not done a LU decomposition
-        since the last jacobian calculation, so    I need to do a full
-        sparse LU-decomposition: */
-      /* Find the sparsity pattern C = J + J':*/
-      calc_C(jac);
-      /* Calculate the optimal ordering: */
-      sp_amd(jac->Cp, jac->Ci, neq, jac->cnzmax,
-         jac->Numerical->q,jac->Numerical->wamd);
-      /* if the next line is uncomented, the code uses natural ordering instead of AMD ordering */
-      /*jac->Numerical->q = NULL;*/
-      funcreturn = sp_ludcmp(jac->Numerical, jac->spJ, 1e-3);
-      class_test(funcreturn == _FAILURE_,error_message,
-         "Failure in sp_ludcmp. Possibly singular matrix!");
+      /*I have not done a LU decomposition since the last jacobian
+        calculation. If the sparsity pattern is unchanged since the
+        last full decomposition, first try a numerical refactorisation
+        re-using its pivots, which are checked with the same threshold
+        as in sp_ludcmp: */
+      funcreturn = _FAILURE_;
+      if (jac->Numerical->has_symbolic == _TRUE_){
+        funcreturn = sp_refactor(jac->Numerical, jac->spJ, 1e-3);
+      }
+      if (funcreturn == _FAILURE_){
+        /* Otherwise, I need to do a full sparse LU-decomposition. The
+           ordering only depends on the pattern, so it is computed only
+           when the pattern has changed: */
+        if (jac->Numerical->has_ordering == _FALSE_){
+          /* Find the sparsity pattern C = J + J':*/
+          calc_C(jac);
+          /* Calculate the optimal ordering: */
+          sp_amd(jac->Cp, jac->Ci, neq, jac->cnzmax,
+                 jac->Numerical->q,jac->Numerical->wamd);
+          /* if the next line is uncomented, the code uses natural ordering instead of AMD ordering */
+          /*jac->Numerical->q = NULL;*/
+          jac->Numerical->has_ordering = _TRUE_;
+        }
+        funcreturn = sp_ludcmp(jac->Numerical, jac->spJ, 1e-3);
+        class_test(funcreturn == _FAILURE_,error_message,
+                   "Failure in sp_ludcmp. Possibly singular matrix!");
+      }
       jac->new_jacobian = _FALSE_;
     }
     else{
       /* I have a repeated pattern, so I can just refactor:*/
-      sp_refactor(jac->Numerical, jac->spJ);
+      sp_refactor(jac->Numerical, jac->spJ, 0.);
     }
   }
   else{
@@ -998,6 +1107,7 @@ int new_linearisation(struct jacobian *jac,double hinvGak,int neq,ErrorMsg error
     class_test(funcreturn == _FAILURE_,error_message,
            "Failure in ludcmp. Possibly singular matrix!");
   }
+  class_counters_end(counter_ndf15_linear_algebra);
   return _SUCCESS_;
 }
 
@@ -1514,10 +1624,12 @@ int numjac(
       else{
         /*Something has changed (or first run), better still do the full calculation..*/
         jac->repeated_pattern = 0;
+        sp_num_invalidate(jac->Numerical);
       }
       jac->has_pattern = 1;
     }
   }
+  jac->has_jacobian = _TRUE_;
   return _SUCCESS_;
 } /* End of numjac */
 
@@ -1539,6 +1651,7 @@ int initialize_jacobian(struct jacobian *jac, int neq, ErrorMsg error_message){
   /* Number of times a pattern is repeated before we trust it. */
   jac->has_grouping = 0;
   jac->has_pattern = 0;
+  jac->has_jacobian = _FALSE_;
   jac->sparse_stuff_initialized=0;
 
   /*Setup memory for the pointers of the dense method:*/
@@ -1,5 +1,10 @@
 #include "evolver_rkck.h"
 
+/**
+ * Runge-Kutta (Cash-Karp) evolver, shortening its steps to land on
+ * each output value x_sampling[]. Same as evolver_rk_with_options()
+ * without options.
+ */
 int evolver_rk(int (*derivs)(double x,
 				  double * y,
 				  double * dy,
@@ -33,11 +38,143 @@ int evolver_rk(int (*derivs)(double x,
 					   ErrorMsg error_message),
 		    ErrorMsg error_message) {
 
+
+  return evolver_rk_with_options(derivs,
+                                 x_ini,
+                                 x_end,
+                                 y,
+                                 used_in_output,
+                                 y_size,
+                                 parameters_and_workspace_for_derivs,
+                                 tolerance,
+                                 minimum_variation,
+                                 evaluate_timescale,
+                                 timestep_over_timescale,
+                                 x_sampling,
+                                 x_size,
+                                 output,
+                                 print_variables,
+                                 NULL,
+                                 error_message);
+}
+
+/**
+ * Runge-Kutta (Cash-Karp) evolver with dense output. Same as
+ * evolver_rk_with_options() with options->dense_output = _TRUE_.
+ */
+int evolver_rk_dense(int (*derivs)(double x,
+				  double * y,
+				  double * dy,
+				  void * parameters_and_workspace,
+				  ErrorMsg error_message),
+		    double x_ini,
+		    double x_end,
+		    double * y,
+		    int * used_in_output,
+		    int y_size,
+		    void * parameters_and_workspace_for_derivs,
+		    double tolerance,
+		    double minimum_variation,
+		    int (*evaluate_timescale)(double x,
+					      void * parameters_and_workspace,
+					      double * timescale,
+					      ErrorMsg error_message),
+		    double timestep_over_timescale,
+		    double * x_sampling,
+		    int x_size,
+		    int (*output)(double x,
+				  double y[],
+				  double dy[],
+				  int index_x,
+				  void * parameters_and_workspace,
+				  ErrorMsg error_message),
+		    int (*print_variables)(double x,
+					   double y[],
+					   double dy[],
+					   void * parameters_and_workspace,
+					   ErrorMsg error_message),
+		    ErrorMsg error_message) {
+
+
+  struct rk_options rk_opt;
+
+  rk_opt.dense_output = _TRUE_;
+
+  return evolver_rk_with_options(derivs,
+                                 x_ini,
+                                 x_end,
+                                 y,
+                                 used_in_output,
+                                 y_size,
+                                 parameters_and_workspace_for_derivs,
+                                 tolerance,
+                                 minimum_variation,
+                                 evaluate_timescale,
+                                 timestep_over_timescale,
+                                 x_sampling,
+                                 x_size,
+                                 output,
+                                 print_variables,
+                                 &rk_opt,
+                                 error_message);
+}
+
+/**
+ * Runge-Kutta (Cash-Karp) evolver with optional settings.
+ *
+ * The integration proceeds by intervals of timestep_over_timescale
+ * times the timescale returned by evaluate_timescale(), each of them
+ * being covered by adaptive steps in generic_integrator(). By default,
+ * an interval is shortened whenever it would overshoot the next output
+ * value, so that output() is always called at the end of a step. With
+ * options->dense_output = _TRUE_, the steps keep the size chosen by the
+ * error control, and generic_integrator_dense() interpolates the
+ * solution at the output values crossed by each of them.
+ */
+int evolver_rk_with_options(int (*derivs)(double x,
+				  double * y,
+				  double * dy,
+				  void * parameters_and_workspace,
+				  ErrorMsg error_message),
+		    double x_ini,
+		    double x_end,
+		    double * y,
+		    int * used_in_output,
+		    int y_size,
+		    void * parameters_and_workspace_for_derivs,
+		    double tolerance,
+		    double minimum_variation,
+		    int (*evaluate_timescale)(double x,
+					      void * parameters_and_workspace,
+					      double * timescale,
+					      ErrorMsg error_message),
+		    double timestep_over_timescale,
+		    double * x_sampling,
+		    int x_size,
+		    int (*output)(double x,
+				  double y[],
+				  double dy[],
+				  int index_x,
+				  void * parameters_and_workspace,
+				  ErrorMsg error_message),
+		    int (*print_variables)(double x,
+					   double y[],
+					   double dy[],
+					   void * parameters_and_workspace,
+					   ErrorMsg error_message),
+		    struct rk_options * options,
+		    ErrorMsg error_message) {
+
   int next_index_x;
   double x1,x2=0.,timestep,timescale;
   struct generic_integrator_workspace gi;
   double * dy;
   short call_output;
+  short dense_output;
+
+  dense_output = _FALSE_;
+  if ((options != NULL) && (options->dense_output == _TRUE_))
+    dense_output = _TRUE_;
 
   class_test(x_ini > x_sampling[x_size-1],
 	     error_message,
@@ -72,7 +209,7 @@ int evolver_rk(int (*derivs)(double x,
 	       error_message,
 	       "integration step =%e < machine precision : leads either to numerical error or infinite loop",fabs(timestep/x1));
 
-    if (x1 + 2.* timestep < x_sampling[next_index_x]) {
+    if ((dense_output == _TRUE_) || (x1 + 2.* timestep < x_sampling[next_index_x])) {
       x2 = x1 + timestep;
     }
     else {
@@ -107,16 +244,34 @@ int evolver_rk(int (*derivs)(double x,
 		 error_message);
     }
 
-    class_call(generic_integrator(derivs,
-				  x1,
-				  x2,
-				  y,
-				  parameters_and_workspace_for_derivs,
-				  tolerance,
-				  x1*minimum_variation,
-				  &gi),
-	       gi.error_message,
-	       error_message);
+    if (dense_output == _TRUE_) {
+      class_call(generic_integrator_dense(derivs,
+					  x1,
+					  x2,
+					  y,
+					  parameters_and_workspace_for_derivs,
+					  tolerance,
+					  x1*minimum_variation,
+					  x_sampling,
+					  x_size,
+					  &next_index_x,
+					  output,
+					  &gi),
+		 gi.error_message,
+		 error_message);
+    }
+    else {
+      class_call(generic_integrator(derivs,
+				    x1,
+				    x2,
+				    y,
+				    parameters_and_workspace_for_derivs,
+				    tolerance,
+				    x1*minimum_variation,
+				    &gi),
+		 gi.error_message,
+		 error_message);
+    }
 
     if (call_output == _TRUE_) {
 
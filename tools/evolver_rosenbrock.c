@@ -0,0 +1,519 @@
+/*************************************************************************************************/
+/* Linearly implicit Rosenbrock-type evolver for CLASS                                           */
+/*                                                                                               */
+/* This is an implementation of the ROS34PW2 method of [New Rosenbrock W-methods of order 3 for  */
+/* partial differential algebraic equations of index 1, J. Rang and L. Angermann, BIT Numerical  */
+/* Mathematics 45, 2005]: a stiffly accurate, L-stable W-method of order 3 with four stages and  */
+/* an embedded method of order 2, written in the transformed variables of [Solving Ordinary      */
+/* Differential Equations II, E. Hairer and G. Wanner, Section IV.7].                            */
+/*************************************************************************************************/
+
+/** @file evolver_rosenbrock.c
+    Each step solves four linear systems with the same matrix W = I - h*gamma*J and
+    evaluates the derivatives three times (plus once at the end of the step, re-used at
+    the beginning of the next one). There is no Newton iteration: the stiff terms (e.g.
+    Thomson scattering before recombination) are damped by the implicit part h*gamma*J,
+    while the other terms are effectively treated explicitly. J is a numerical jacobian
+    computed by the numjac routine of evolver_ndf15.c, and W is decomposed with the same
+    dense or sparse LU routines. Since the method is a W-method, its order does not rely
+    on J being exact: the jacobian is kept from step to step, and only recomputed after
+    a step failure. Similarly, a new LU decomposition is only needed when h changes.
+
+    The solution at the values of t_vec[] where (*output) must be called is
+    interpolated with the cubic Hermite polynomial built on y and dy/dt at both ends
+    of the step, consistent with the order of the method.
+*/
+
+#include "evolver_rosenbrock.h"
+
+int evolver_rosenbrock(
+          int (*derivs)(double x,double * y,double * dy,
+                void * parameters_and_workspace, ErrorMsg error_message),
+          double x_ini,
+          double x_final,
+          double * y_inout,
+          int * used_in_output,
+          int neq,
+          void * parameters_and_workspace_for_derivs,
+          double rtol,
+          double minimum_variation,
+          int (*timescale_and_approximation)(double x,
+                             void * parameters_and_workspace,
+                             double * timescales,
+                             ErrorMsg error_message),
+          double timestep_over_timescale,
+          double * t_vec,
+          int tres,
+          int (*output)(double x,double y[],double dy[],int index_x,void * parameters_and_workspace,
+                ErrorMsg error_message),
+          int (*print_variables)(double x, double y[], double dy[], void *parameters_and_workspace,
+                     ErrorMsg error_message),
+          ErrorMsg error_message){
+
+  return evolver_rosenbrock_with_options(derivs,
+                                         x_ini,
+                                         x_final,
+                                         y_inout,
+                                         used_in_output,
+                                         neq,
+                                         parameters_and_workspace_for_derivs,
+                                         rtol,
+                                         minimum_variation,
+                                         timescale_and_approximation,
+                                         timestep_over_timescale,
+                                         t_vec,
+                                         tres,
+                                         output,
+                                         print_variables,
+                                         NULL,
+                                         error_message);
+}
+
+/**
+ * Same as evolver_rosenbrock(), with the optional information of
+ * struct ndf15_options (sparsity pattern provided by the caller,
+ * jacobian structure kept between calls, step statistics), used exactly
+ * as in evolver_ndf15_with_options().
+ */
+
+int evolver_rosenbrock_with_options(
+          int (*derivs)(double x,double * y,double * dy,
+                void * parameters_and_workspace, ErrorMsg error_message),
+          double x_ini,
+          double x_final,
+          double * y_inout,
+          int * used_in_output,
+          int neq,
+          void * parameters_and_workspace_for_derivs,
+          double rtol,
+          double minimum_variation,
+          int (*timescale_and_approximation)(double x,
+                             void * parameters_and_workspace,
+                             double * timescales,
+                             ErrorMsg error_message),
+          double timestep_over_timescale,
+          double * t_vec,
+          int tres,
+          int (*output)(double x,double y[],double dy[],int index_x,void * parameters_and_workspace,
+                ErrorMsg error_message),
+          int (*print_variables)(double x, double y[], double dy[], void *parameters_and_workspace,
+                     ErrorMsg error_message),
+          struct ndf15_options * options,
+          ErrorMsg error_message){
+
+  /* Coefficients of ROS34PW2: */
+#define _ROS_STAGES_ 4
+  double gam = 4.3586652150845900e-01;
+  double alpha[_ROS_STAGES_][_ROS_STAGES_] = {
+    {0.,0.,0.,0.},
+    {8.7173304301691801e-01,0.,0.,0.},
+    {8.4457060015369423e-01,-1.1299064236484185e-01,0.,0.},
+    {0.,0.,1.,0.}};
+  double Gamma[_ROS_STAGES_][_ROS_STAGES_] = {
+    {4.3586652150845900e-01,0.,0.,0.},
+    {-8.7173304301691801e-01,4.3586652150845900e-01,0.,0.},
+    {-9.0338057013044082e-01,5.4180672388095326e-02,4.3586652150845900e-01,0.},
+    {2.4212380706095346e-01,-1.2232505839045147e+00,5.4526025533510214e-01,4.3586652150845900e-01}};
+  double b[_ROS_STAGES_] = {2.4212380706095346e-01,-1.2232505839045147e+00,1.5452602553351020e+00,4.3586652150845900e-01};
+  double bhat[_ROS_STAGES_] = {3.7810903145819369e-01,-9.6042292212423178e-02,0.5,2.1793326075422950e-01};
+  /* Coefficients in the transformed variables u_i = sum_j Gamma_ij k_j: */
+  double Ginv[_ROS_STAGES_][_ROS_STAGES_],A[_ROS_STAGES_][_ROS_STAGES_],C[_ROS_STAGES_][_ROS_STAGES_];
+  double m[_ROS_STAGES_],mhat[_ROS_STAGES_],alpha_sum[_ROS_STAGES_],gamma_sum[_ROS_STAGES_];
+
+  double abstol = 1e-15, eps=1e-16, threshold=abstol;
+
+  /* Logicals: */
+  int Jcurrent,Jneeded,Wcurrent,done,nofailed;
+
+  /* Storage: */
+  double *f0,*fnew,*y,*ynew,*dfdt,*u[_ROS_STAGES_],*rhs,*ystage,*yinterp,*ypinterp,*swap;
+  struct jacobian jac,*pjac;
+  struct numjac_workspace nj_ws;
+
+  /* Method variables: */
+  double t,t0,tfinal,tnew=0.,hW=0.;
+  double h,absh,hmin,hmax,htspan,tdel,rh,err=0.,hopt,temp,s,maxtmp;
+  double h00,h10,h01,h11,dh00,dh10,dh01,dh11;
+  int next,tdir;
+
+  /* Misc: */
+  int stepstat[6],nfenj,ii,i,j,l,neqp=neq+1;
+
+  /** Transformed coefficients: Ginv = Gamma^-1, A = alpha Ginv, C = diag(1/gam) - Ginv, m = b Ginv */
+  for(i=0;i<_ROS_STAGES_;i++){
+    for(j=0;j<_ROS_STAGES_;j++){
+      Ginv[i][j] = 0.;
+    }
+    Ginv[i][i] = 1./Gamma[i][i];
+    for(j=i-1;j>=0;j--){
+      for(l=j;l<i;l++){
+        Ginv[i][j] -= Gamma[i][l]*Ginv[l][j];
+      }
+      Ginv[i][j] /= Gamma[i][i];
+    }
+  }
+  for(i=0;i<_ROS_STAGES_;i++){
+    alpha_sum[i] = 0.;
+    gamma_sum[i] = 0.;
+    for(j=0;j<_ROS_STAGES_;j++){
+      alpha_sum[i] += alpha[i][j];
+      gamma_sum[i] += Gamma[i][j];
+      A[i][j] = 0.;
+      for(l=0;l<_ROS_STAGES_;l++){
+        A[i][j] += alpha[i][l]*Ginv[l][j];
+      }
+      C[i][j] = -Ginv[i][j];
+    }
+    C[i][i] += 1./gam;
+  }
+  for(j=0;j<_ROS_STAGES_;j++){
+    m[j] = 0.;
+    mhat[j] = 0.;
+    for(l=0;l<_ROS_STAGES_;l++){
+      m[j] += b[l]*Ginv[l][j];
+      mhat[j] += bhat[l]*Ginv[l][j];
+    }
+  }
+
+  /** Allocate memory */
+
+  class_alloc(f0,neqp*sizeof(double),error_message);
+  class_alloc(fnew,neqp*sizeof(double),error_message);
+  class_alloc(y,neqp*sizeof(double),error_message);
+  class_alloc(dfdt,neqp*sizeof(double),error_message);
+  for(i=0;i<_ROS_STAGES_;i++){
+    class_alloc(u[i],neqp*sizeof(double),error_message);
+  }
+  class_alloc(rhs,neqp*sizeof(double),error_message);
+  class_alloc(ystage,neqp*sizeof(double),error_message);
+  class_alloc(yinterp,neqp*sizeof(double),error_message);
+  class_alloc(ypinterp,neqp*sizeof(double),error_message);
+
+  /*Set pointers:*/
+  ynew = y_inout-1; /* This way y_inout is always up to date. */
+
+  /*Initialize the jacobian, unless the caller keeps it between calls:*/
+  if ((options != NULL) && (options->jac != NULL)){
+    pjac = options->jac;
+  }
+  else{
+    pjac = &jac;
+    class_call(initialize_jacobian(pjac,neq,error_message),error_message,error_message);
+  }
+
+  /* Initialize workspace for numjac: */
+  class_call(initialize_numjac_workspace(&nj_ws,neq,error_message),error_message,error_message);
+
+  /* Use the sparsity pattern of the calling module, if it provides one: */
+  if ((options != NULL) && (options->jacobian_pattern != NULL) && (pjac->use_sparse == _TRUE_) && (pjac->has_jacobian == _FALSE_)){
+    class_call((*options->jacobian_pattern)(neq,
+                                            pjac->max_nonzero,
+                                            pjac->spJ->Ap,
+                                            pjac->spJ->Ai,
+                                            &(pjac->has_pattern),
+                                            parameters_and_workspace_for_derivs,
+                                            error_message),
+               error_message,error_message);
+    if (pjac->has_pattern == _TRUE_){
+      pjac->repeated_pattern = pjac->trust_sparse;
+    }
+  }
+
+  for(ii=1;ii<=neq;ii++){
+    y[ii] = y_inout[ii-1];
+  }
+  t0 = x_ini;
+  tfinal = x_final;
+
+  /* Some CLASS-specific stuff:*/
+  next=0;
+  while (t_vec[next] < t0) next++;
+
+  htspan = fabs(tfinal-t0);
+  for(ii=0;ii<6;ii++) stepstat[ii] = 0;
+
+  class_call((*derivs)(t0,y+1,f0+1,parameters_and_workspace_for_derivs,error_message),error_message,error_message);
+  stepstat[2] +=1;
+  if ((tfinal-t0)<0.0){
+    tdir = -1;
+  }
+  else{
+    tdir = 1;
+  }
+  hmax = fabs(tfinal-t0)/10.0;
+  t = t0;
+  hmin = 16.0*eps*MAX(fabs(t),fabs(tfinal));
+
+  /* Calculate initial step */
+  rh = 0.0;
+  for(ii=1;ii<=neq;ii++){
+    rh = MAX(rh,fabs(f0[ii])/MAX(fabs(y[ii]),threshold));
+  }
+  rh /= (0.8*pow(rtol,1.0/3.0));
+  absh = MIN(hmax, htspan);
+  if (absh * rh > 1.0) absh = 1.0 / rh;
+  absh = MAX(absh, hmin);
+
+  Jcurrent = _FALSE_; /* True if the jacobian was computed at the current (t,y). */
+  Jneeded = _TRUE_;
+  Wcurrent = _FALSE_;
+
+  /* Doing main loop: */
+  done = _FALSE_;
+  while (done==_FALSE_){
+
+    maxtmp = MAX(hmin,absh);
+    absh = MIN(hmax, maxtmp);
+    h = tdir * absh;
+    /* Stretch the step if within 10% of tfinal-t. */
+    if (1.1*absh >= fabs(tfinal - t)){
+      h = tfinal - t;
+      absh = fabs(h);
+      done = _TRUE_;
+    }
+
+    /*        Loop for advancing one step */
+    nofailed = _TRUE_;
+    for( ; ; ){
+
+      /* Jacobian and time derivative of the equations at (t,y), at
+         the first step or when the old ones led to a step failure: */
+      if (Jneeded == _TRUE_){
+        nfenj=0;
+        class_call(numjac((*derivs),t,y,f0,pjac,&nj_ws,abstol,neq,
+                          &nfenj,parameters_and_workspace_for_derivs,error_message),
+                   error_message,error_message);
+        stepstat[3] += 1;
+        stepstat[2] += nfenj;
+
+        tdel = (t + tdir*MIN(sqrt(eps)*MAX(fabs(t),fabs(t+h)),absh)) - t;
+        class_call((*derivs)(t+tdel,y+1,ystage+1,parameters_and_workspace_for_derivs,error_message),
+                   error_message,error_message);
+        stepstat[2] += 1;
+        for(ii=1;ii<=neq;ii++){
+          dfdt[ii] = (ystage[ii] - f0[ii]) / tdel;
+        }
+        Jcurrent = _TRUE_;
+        Jneeded = _FALSE_;
+        Wcurrent = _FALSE_;
+      }
+
+      tnew = t + h;
+      if (done==_TRUE_){
+        tnew = tfinal; /*Hit end point exactly. */
+      }
+      h = tnew - t;          /* Purify h. */
+
+      /* LU decomposition of W = I - h*gam*J, if J or h changed: */
+      if ((Wcurrent == _FALSE_) || (h != hW)){
+        class_call(new_linearisation(pjac,h*gam,neq,error_message),
+                   error_message,error_message);
+        stepstat[4] += 1;
+        hW = h;
+        Wcurrent = _TRUE_;
+      }
+
+      /* Stages: (I/(h*gam) - J) u_i = f(t + alpha_i h, y + sum_j A_ij u_j) + sum_j C_ij/h u_j + gamma_i h df/dt */
+      for(i=0;i<_ROS_STAGES_;i++){
+        if (i == 0){
+          for(ii=1;ii<=neq;ii++){
+            rhs[ii] = f0[ii];
+          }
+        }
+        else{
+          for(ii=1;ii<=neq;ii++){
+            ystage[ii] = y[ii];
+            for(j=0;j<i;j++){
+              ystage[ii] += A[i][j]*u[j][ii];
+            }
+          }
+          class_call((*derivs)(t+alpha_sum[i]*h,ystage+1,rhs+1,parameters_and_workspace_for_derivs,error_message),
+                     error_message,error_message);
+          stepstat[2] += 1;
+        }
+        for(ii=1;ii<=neq;ii++){
+          temp = rhs[ii] + gamma_sum[i]*h*dfdt[ii];
+          for(j=0;j<i;j++){
+            temp += C[i][j]/h*u[j][ii];
+          }
+          rhs[ii] = h*gam*temp;
+        }
+        class_call(linearisation_solve(pjac,rhs,u[i],neq,error_message),
+                   error_message,error_message);
+        stepstat[5] += 1;
+      }
+
+      /* New solution and error estimate given by the embedded method: */
+      err = 0.0;
+      for(ii=1;ii<=neq;ii++){
+        ynew[ii] = y[ii];
+        temp = 0.;
+        for(j=0;j<_ROS_STAGES_;j++){
+          ynew[ii] += m[j]*u[j][ii];
+          temp += (m[j]-mhat[j])*u[j][ii];
+        }
+        maxtmp = MAX(fabs(y[ii]),fabs(ynew[ii]));
+        maxtmp = MAX(maxtmp,threshold);
+        err = MAX(err,fabs(temp)/maxtmp);
+      }
+
+      if (err > rtol){
+        /*Step failed */
+        stepstat[1]+= 1;
+        class_test(absh <= hmin, error_message,
+                   "Step size too small: step:%g, minimum:%g, in interval: [%g:%g]\n",
+                   absh,hmin,t0,tfinal);
+        if (nofailed==_TRUE_){
+          nofailed = _FALSE_;
+          absh = MAX(hmin, absh * MAX(0.2, 0.8*pow(rtol/err,1.0/3.0)));
+        }
+        else{
+          absh = MAX(hmin, 0.5 * absh);
+        }
+        h = tdir * absh;
+        done = _FALSE_;
+        /* The old jacobian may be the reason of the failure: */
+        if (Jcurrent == _FALSE_)
+          Jneeded = _TRUE_;
+      }
+      else {
+        break; /* Succesfull step */
+      }
+    }
+    /* End of conditionless FOR loop */
+    stepstat[0] += 1;
+
+    /* Derivatives at the end of the step, used for output and at the beginning of the next step */
+    class_call((*derivs)(tnew,ynew+1,fnew+1,parameters_and_workspace_for_derivs,error_message),
+               error_message,error_message);
+    stepstat[2] += 1;
+
+    /** Output **/
+    while ((next<tres)&&(tdir * (tnew - t_vec[next]) >= 0.0)){
+      if (tnew==t_vec[next]){
+        class_call((*output)(t_vec[next],ynew+1,fnew+1,next,parameters_and_workspace_for_derivs,error_message),
+                   error_message,error_message);
+      }
+      else {
+        /*Interpolate if we have overshot sample values*/
+        s = (t_vec[next]-t)/h;
+        h00 = (1.+2.*s)*(1.-s)*(1.-s);
+        h10 = s*(1.-s)*(1.-s)*h;
+        h01 = s*s*(3.-2.*s);
+        h11 = s*s*(s-1.)*h;
+        dh00 = 6.*s*(s-1.)/h;
+        dh10 = (1.-s)*(1.-3.*s);
+        dh01 = -dh00;
+        dh11 = s*(3.*s-2.);
+        for(ii=1;ii<=neq;ii++){
+          yinterp[ii] = h00*y[ii] + h10*f0[ii] + h01*ynew[ii] + h11*fnew[ii];
+          ypinterp[ii] = dh00*y[ii] + dh10*f0[ii] + dh01*ynew[ii] + dh11*fnew[ii];
+        }
+        class_call((*output)(t_vec[next],yinterp+1,ypinterp+1,next,parameters_and_workspace_for_derivs,
+                             error_message),error_message,error_message);
+      }
+      next++;
+    }
+    /** End of output **/
+    if (done==_TRUE_) {
+      break;
+    }
+
+    /* New step size. A small increase is not worth a new LU decomposition. */
+    temp = 1.25*pow(err/rtol,1.0/3.0);
+    if (temp > 0.2){
+      hopt = absh / temp;
+    }
+    else {
+      hopt = 5.0*absh;
+    }
+    if (nofailed == _FALSE_){
+      hopt = MIN(hopt,absh);
+    }
+    if ((hopt < absh) || (hopt > 1.2*absh)){
+      /* An old jacobian degrades the error estimate of a W-method: when
+         the step size has to decrease, refresh it first. */
+      if ((hopt < absh) && (Jcurrent == _FALSE_))
+        Jneeded = _TRUE_;
+      absh = hopt;
+    }
+
+    /* Advance the integration one step. */
+    t = tnew;
+    eqvec(ynew,y,neq);
+    Jcurrent = _FALSE_;
+    swap = f0;
+    f0 = fnew;
+    fnew = swap;
+
+    if (print_variables!=NULL){
+      class_call((*print_variables)(tnew,ynew+1,f0+1,
+                                    parameters_and_workspace_for_derivs,error_message),
+                 error_message,error_message);
+    }
+  }
+
+  /* a last call is compulsory to ensure that all quantitites in
+     y,dy,parameters_and_workspace_for_derivs are updated to the
+     last point in the covered range */
+  class_call((*derivs)(tnew,
+                   ynew+1,
+                   f0+1,
+                   parameters_and_workspace_for_derivs,error_message),
+             error_message,
+             error_message);
+
+  if (print_variables!=NULL){
+    /** If we are printing variables, we must store the final point */
+    class_call((*print_variables)(tnew,ynew+1,f0+1,
+                  parameters_and_workspace_for_derivs,error_message),
+               error_message,error_message);
+  }
+
+  if ((options != NULL) && (options->stepstat != NULL)){
+    for(ii=0;ii<6;ii++) options->stepstat[ii] += stepstat[ii];
+  }
+
+  /** Deallocate memory */
+
+  free(f0);
+  free(fnew);
+  free(y);
+  free(dfdt);
+  for(i=0;i<_ROS_STAGES_;i++){
+    free(u[i]);
+  }
+  free(rhs);
+  free(ystage);
+  free(yinterp);
+  free(ypinterp);
+
+  if (pjac == &jac)
+    uninitialize_jacobian(pjac);
+  uninitialize_numjac_workspace(&nj_ws);
+  return _SUCCESS_;
+
+#undef _ROS_STAGES_
+} /*End of program*/
+
+/**
+ * Solve W x = rhs with the LU decomposition of W = I - hinvGak*J
+ * computed by new_linearisation() (arrays indexed from 1 to neq, as in
+ * evolver_ndf15.c).
+ */
+
+int linearisation_solve(struct jacobian *jac, double *rhs, double *x, int neq, ErrorMsg error_message){
+  int funcreturn;
+  if (jac->use_sparse){
+    funcreturn = sp_lusolve(jac->Numerical, rhs+1, x+1);
+    class_test(funcreturn == _FAILURE_,error_message,
+               "Failure in sp_lusolve. Possibly singular matrix!");
+  }
+  else{
+    eqvec(rhs,x,neq);
+    funcreturn = lubksb(jac->LU,neq,jac->luidx,x);
+    class_test(funcreturn == _FAILURE_,error_message,
+               "Failure in lubksb. Possibly singular matrix!");
+  }
+  return _SUCCESS_;
+}
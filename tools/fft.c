@@ -0,0 +1,148 @@
+/**
+ * Module with tools for the FFTLog method: a fast Fourier transform
+ * and the logarithm of the Gamma function of a complex number
+ */
+
+#include "fft.h"
+
+/**
+ * In-place complex fast Fourier transform of n values (n must be a
+ * power of two):
+ *
+ * data_j -> sum_m data_m exp(sign 2 i pi j m / n)
+ *
+ * with sign = -1 for the direct transform and +1 for the inverse
+ * one, which is not divided by n.
+ *
+ * @param re            Input/Output: real parts
+ * @param im            Input/Output: imaginary parts
+ * @param n             Input: number of values
+ * @param sign          Input: sign of the exponent (-1 or +1)
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int fft_radix2(
+               double * re,
+               double * im,
+               int n,
+               int sign,
+               ErrorMsg error_message
+               ){
+
+  int i, j, m, step, half;
+  double tmp, theta, wpr, wpi, wr, wi, tr, ti;
+
+  class_test((n < 1) || ((n & (n-1)) != 0),
+             error_message,
+             "the number of values (%d) should be a power of two",n);
+
+  class_test((sign != 1) && (sign != -1),
+             error_message,
+             "the sign of the exponent should be -1 or +1, not %d",sign);
+
+  /** - reorder the values by bit reversal of their index */
+
+  for (i=1, j=0; i<n; i++) {
+    m = n >> 1;
+    while (j & m) {
+      j ^= m;
+      m >>= 1;
+    }
+    j |= m;
+    if (i < j) {
+      tmp = re[i]; re[i] = re[j]; re[j] = tmp;
+      tmp = im[i]; im[i] = im[j]; im[j] = tmp;
+    }
+  }
+
+  /** - Danielson-Lanczos butterflies, with the twiddle factors of
+        each stage obtained by a stable recurrence */
+
+  for (step=2; step<=n; step <<= 1) {
+
+    half = step >> 1;
+    theta = sign*2.*_PI_/step;
+    wpr = -2.*sin(0.5*theta)*sin(0.5*theta);
+    wpi = sin(theta);
+    wr = 1.;
+    wi = 0.;
+
+    for (m=0; m<half; m++) {
+      for (i=m; i<n; i+=step) {
+        j = i+half;
+        tr = wr*re[j]-wi*im[j];
+        ti = wr*im[j]+wi*re[j];
+        re[j] = re[i]-tr;
+        im[j] = im[i]-ti;
+        re[i] += tr;
+        im[i] += ti;
+      }
+      tmp = wr;
+      wr += wr*wpr-wi*wpi;
+      wi += wi*wpr+tmp*wpi;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Logarithm of the Gamma function of z = x + i y, for x > 0, with the
+ * Lanczos approximation (g=7, 9 coefficients, relative accuracy of
+ * about 1e-15). The imaginary part is only defined modulo 2 pi.
+ *
+ * @param x             Input: real part of z
+ * @param y             Input: imaginary part of z
+ * @param ln_gamma_re   Output: real part of ln Gamma(z)
+ * @param ln_gamma_im   Output: imaginary part of ln Gamma(z)
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int fft_log_gamma(
+                  double x,
+                  double y,
+                  double * ln_gamma_re,
+                  double * ln_gamma_im,
+                  ErrorMsg error_message
+                  ){
+
+  static const double lanczos[9] = {0.99999999999980993,
+                                    676.5203681218851,
+                                    -1259.1392167224028,
+                                    771.32342877765313,
+                                    -176.61502916214059,
+                                    12.507343278686905,
+                                    -0.13857109526572012,
+                                    9.9843695780195716e-6,
+                                    1.5056327351493116e-7};
+  double a_re, a_im, d, t_re, t_im, ln_t_re, ln_t_im;
+  int k;
+
+  class_test(x <= 0.,
+             error_message,
+             "this approximation requires a positive real part, not %e",x);
+
+  /** - sum of the Lanczos series A(z) = c_0 + sum_k c_k/(z-1+k) */
+
+  a_re = lanczos[0];
+  a_im = 0.;
+  for (k=1; k<9; k++) {
+    d = (x-1.+k)*(x-1.+k)+y*y;
+    a_re += lanczos[k]*(x-1.+k)/d;
+    a_im -= lanczos[k]*y/d;
+  }
+
+  /** - ln Gamma(z) = ln sqrt(2 pi) + (z-1/2) ln(t) - t + ln A(z), with t = z-1+g+1/2 */
+
+  t_re = x+6.5;
+  t_im = y;
+  ln_t_re = 0.5*log(t_re*t_re+t_im*t_im);
+  ln_t_im = atan2(t_im,t_re);
+
+  *ln_gamma_re = 0.5*log(2.*_PI_) + (x-0.5)*ln_t_re - y*ln_t_im - t_re + 0.5*log(a_re*a_re+a_im*a_im);
+  *ln_gamma_im = (x-0.5)*ln_t_im + y*ln_t_re - t_im + atan2(a_im,a_re);
+
+  return _SUCCESS_;
+}
@@ -32,7 +32,7 @@ int gt_add(
   void* data,      /**< data to be added*/
   long sz          /**< size of the data (in bytes)*/
   ) {
-  long ridx;
+  long ridx,nsz;
   void *res;
   void *nbuffer;
 
@@ -53,13 +53,16 @@ int gt_add(
 	     "Don't know what to do with idx=%ld",ridx);
 
   if (ridx+sz>self->sz) {
-    /** - test -> pass -> ok we need to grow */
-    nbuffer=realloc(self->buffer,self->sz*_GT_FACTOR_);
+    /** - test -> pass -> ok we need to grow (enough for data larger than the current size) */
+    nsz=self->sz;
+    while (ridx+sz>nsz)
+      nsz*=_GT_FACTOR_;
+    nbuffer=realloc(self->buffer,nsz);
     class_test(nbuffer==NULL,
 	       self->error_message,
 	       "Cannot grow growTable");
     self->buffer=nbuffer;
-    self->sz=self->sz*_GT_FACTOR_;
+    self->sz=nsz;
   }
 
   res=memcpy((void*) (self->buffer+ridx),(void*) data,(size_t) sz);
@@ -159,3 +162,185 @@ int gt_free(growTable* self) {
   return _SUCCESS_;
 }
 
+
+/***
+ * gt_arena_init Initialize the growArena.
+ * gt_arena_init will initialize the growArena structure. It must be already allocated.
+ * If the final size is known approximately, passing it as sz allows to
+ * get a contiguous buffer from gt_arena_getPtr() without any copy.
+ */
+int gt_arena_init(
+  growArena* self, /**< a pointer on an empty growArena */
+  long sz          /**< size of the first chunk (in bytes), or 0 for #_GT_INITSIZE_ */
+  ) {
+
+  if (sz <= 0)
+    sz = _GT_INITSIZE_;
+
+  self->first = NULL;
+  self->last = NULL;
+  self->nchunks = 0;
+  self->csz = 0;
+  self->freeze = _FALSE_;
+
+  class_alloc(self->first,sizeof(gtArenaChunk)+sz,self->error_message);
+  self->first->next = NULL;
+  self->first->sz = sz;
+  self->first->csz = 0;
+  self->first->data = (char*) (self->first+1);
+  self->last = self->first;
+  self->nchunks = 1;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Append data to the growArena. When the current chunk is full, a new
+ * chunk is allocated, _GT_FACTOR_ times larger than the previous one
+ * (or large enough for the data), and nothing is copied.
+ */
+int gt_arena_add(
+  growArena* self, /**< a growArena*/
+  void* data,      /**< data to be added*/
+  long sz          /**< size of the data (in bytes)*/
+  ) {
+  gtArenaChunk * chunk;
+  long nsz;
+
+  class_test(self->freeze == _TRUE_,
+	     self->error_message,
+	     "cannot add any more data in the growArena (freeze is on)");
+
+  class_test(sz<0,
+	     self->error_message,
+	     "Don't know what to do with sz=%ld",sz);
+
+  if (self->last->csz+sz > self->last->sz) {
+    /** - test -> pass -> ok we need a new chunk */
+    nsz = self->last->sz*_GT_FACTOR_;
+    while (sz > nsz)
+      nsz *= _GT_FACTOR_;
+    class_alloc(chunk,sizeof(gtArenaChunk)+nsz,self->error_message);
+    chunk->next = NULL;
+    chunk->sz = nsz;
+    chunk->csz = 0;
+    chunk->data = (char*) (chunk+1);
+    self->last->next = chunk;
+    self->last = chunk;
+    self->nchunks++;
+  }
+
+  memcpy(self->last->data+self->last->csz,data,(size_t) sz);
+  self->last->csz += sz;
+  self->csz += sz;
+
+  return _SUCCESS_;
+}
+
+/**
+ * returns the size of the data in the growArena
+ */
+int gt_arena_getSize(
+  growArena* self,/**< a growArena*/
+  long *idx /**< OUTPUT : the size of the data in ::self */
+  ) {
+  *idx=self->csz;
+  return _SUCCESS_;
+}
+
+/**
+ * gives access to the data of one chunk, without any copy. Looping over
+ * index from 0 to nchunks-1 gives all the data in the order it was
+ * added.
+ */
+int gt_arena_getChunk(
+  growArena* self, /**< a growArena*/
+  int index,       /**< index of the chunk, from 0 to self->nchunks-1 */
+  void** ptr,      /**< OUTPUT : pointer on the data of this chunk */
+  long *sz         /**< OUTPUT : size of the data of this chunk (in bytes) */
+  ) {
+  gtArenaChunk * chunk;
+  int i;
+
+  class_test((index<0) || (index>=self->nchunks),
+	     self->error_message,
+	     "chunk index %d out of range [0,%d]",index,self->nchunks-1);
+
+  for (i=0, chunk=self->first; i<index; i++)
+    chunk = chunk->next;
+
+  *ptr = chunk->data;
+  *sz = chunk->csz;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Retrieve all data from the growArena, copying each chunk once.
+ */
+int gt_arena_retrieveAll(
+  growArena *self, /**< a growArena*/
+  void* data       /**< OUTPUT : data must be allocated to the size of the growArena (see gt_arena_getSize)*/
+  ) {
+  gtArenaChunk * chunk;
+  long idx;
+
+  for (chunk=self->first, idx=0; chunk!=NULL; chunk=chunk->next) {
+    memcpy((char*) data+idx,chunk->data,(size_t) chunk->csz);
+    idx += chunk->csz;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * returns a pointer on all the data of the growArena, contiguous in
+ * memory, which remains owned by the growArena. If the data fits in
+ * one chunk (for instance when gt_arena_init() was given the final
+ * size), nothing is copied; otherwise the chunks are merged once.
+ * No Data can be added afterward.
+ */
+int gt_arena_getPtr(
+  growArena* self, /**< a growArena*/
+  void** ptr       /**< OUTPUT : pointer on the data */
+  ) {
+  gtArenaChunk * chunk;
+
+  if (self->nchunks > 1) {
+    class_alloc(chunk,sizeof(gtArenaChunk)+self->csz,self->error_message);
+    chunk->next = NULL;
+    chunk->sz = self->csz;
+    chunk->csz = self->csz;
+    chunk->data = (char*) (chunk+1);
+    gt_arena_retrieveAll(self,chunk->data);
+    gt_arena_free(self);
+    self->first = chunk;
+    self->last = chunk;
+    self->nchunks = 1;
+    self->csz = chunk->csz;
+  }
+
+  self->freeze=_TRUE_;
+  *ptr=self->first->data;
+
+  return _SUCCESS_;
+}
+
+/**
+ * free the growArena
+ */
+int gt_arena_free(growArena* self) {
+  gtArenaChunk * chunk, * next;
+
+  for (chunk=self->first; chunk!=NULL; chunk=next) {
+    next = chunk->next;
+    free(chunk);
+  }
+  self->first = NULL;
+  self->last = NULL;
+  self->nchunks = 0;
+  self->csz = -1;
+  self->freeze = _FALSE_;
+
+  return _SUCCESS_;
+}
@@ -0,0 +1,158 @@
+/** Weighted sums of the Hermite interpolation of order 4 for Phi, dPhi
+    and d2Phi, as computed by hermite4_interpolation_csource.h, but
+    accumulated directly instead of being stored: result_Phi = sum_j
+    weight[j]*Phi(xinterp[j]), and likewise result_dPhi and
+    result_d2Phi. The functions to be summed are selected by the flags
+    HERMITE_DO_PHI, HERMITE_DO_DPHI and HERMITE_DO_D2PHI. As there, the
+    coefficients are only recomputed when a point falls in another
+    interval, so that xinterp should be sorted, and points outside the
+    interpolation region contribute zero. The sums are split over
+    _HERMITE_SUMS_ partial sums, so that successive additions do not
+    wait for each other. Not for the closed case.
+*/
+
+double ym=0, yp=0, dym=0, dyp=0, x;
+double z[3]={0.,0.,0.};
+#ifdef HERMITE_DO_PHI
+double a[3]={0.,0.,0.};
+double partial_Phi[_HERMITE_SUMS_]={0.};
+#endif
+#ifdef HERMITE_DO_DPHI
+double b[3]={0.,0.,0.};
+double partial_dPhi[_HERMITE_SUMS_]={0.};
+#endif
+#ifdef HERMITE_DO_D2PHI
+double c[3]={0.,0.,0.};
+double d3ym=0, d3yp=0;
+double partial_d2Phi[_HERMITE_SUMS_]={0.};
+#endif
+#if defined (HERMITE_DO_DPHI) || defined (HERMITE_DO_D2PHI)
+double *sinK = pHIS->sinK;
+double *cotK = pHIS->cotK;
+double cotKm=0,cotKp=0,sinKm=0,sinKp=0;
+double sinKm2, sinKp2;
+double d2ym = 0, d2yp=0;
+int K = pHIS->K;
+double lxlp1 = pHIS->l[lnum]*(pHIS->l[lnum]+1.0);
+double beta = pHIS->beta;
+double beta2 = beta*beta;
+#endif
+double *xvec;
+double xmin, xmax, deltax;
+double left_border, right_border, next_border;
+int j, nx, current_border_idx=0, index_sum;
+double *Phi_l, *dPhi_l;
+
+xvec = pHIS->x;
+deltax = pHIS->delta_x;
+nx = pHIS->x_size;
+Phi_l = pHIS->phi+lnum*nx;
+dPhi_l = pHIS->dphi+lnum*nx;
+
+xmin = xvec[0];
+xmax = xvec[nx-1];
+
+left_border = xmax;
+right_border = xmin;
+next_border = xmin;
+
+for (j=0; j<nxi; j++){
+  x = xinterp[j];
+  if ((x<xmin)||(x>xmax)){
+    //Outside interpolation region, no contribution.
+    continue;
+  }
+  if ((x>right_border)||(x<left_border)){
+    if ((x>next_border)||(x<left_border)){
+      current_border_idx = ((int) ((x-xmin)/deltax))+1;
+      current_border_idx = MAX(1,current_border_idx);
+      current_border_idx = MIN(nx-1,current_border_idx);
+      //Calculate left derivatives:
+      ym = Phi_l[current_border_idx-1];
+      dym = dPhi_l[current_border_idx-1];
+#if defined HERMITE_DO_DPHI || defined HERMITE_DO_D2PHI
+      cotKm = cotK[current_border_idx-1];
+      sinKm = sinK[current_border_idx-1];
+      sinKm2 = sinKm*sinKm;
+      d2ym = -2*dym*cotKm+ym*(lxlp1/sinKm2-beta2+K);
+#endif
+#ifdef HERMITE_DO_D2PHI
+      d3ym = -2*cotKm*d2ym-2*ym*lxlp1*cotKm/sinKm2+
+        dym*(K-beta2+(2+lxlp1)/sinKm2);
+#endif
+    }
+    else{
+      //x>current_border but not next border: I have moved to next block.
+      current_border_idx++;
+      //Copy former right derivatives to left derivatives.
+      ym = yp;
+      dym = dyp;
+#if defined HERMITE_DO_DPHI || defined HERMITE_DO_D2PHI
+      d2ym = d2yp;
+      sinKm = sinKp;
+      cotKm = cotKp;
+#endif
+#ifdef HERMITE_DO_D2PHI
+      d3ym = d3yp;
+#endif
+    }
+    left_border = xvec[MAX(0,current_border_idx-1)];
+    right_border = xvec[current_border_idx];
+    next_border = xvec[MIN(nx-1,current_border_idx+1)];
+    //Evaluate right derivatives and calculate coefficients:
+    yp = Phi_l[current_border_idx];
+    dyp = dPhi_l[current_border_idx];
+#if defined HERMITE_DO_DPHI || defined HERMITE_DO_D2PHI
+    cotKp = cotK[current_border_idx];
+    sinKp = sinK[current_border_idx];
+    sinKp2 = sinKp*sinKp;
+    d2yp = -2*dyp*cotKp+yp*(lxlp1/sinKp2-beta2+K);
+#endif
+#ifdef HERMITE_DO_D2PHI
+    d3yp = -2*cotKp*d2yp-2*yp*lxlp1*cotKp/sinKp2+
+      dyp*(K-beta2+(2+lxlp1)/sinKp2);
+#endif
+
+#ifdef HERMITE_DO_PHI
+    a[0] = dym*deltax;
+    a[1] = -2*dym*deltax-dyp*deltax-3*ym+3*yp;
+    a[2] = dym*deltax+dyp*deltax+2*ym-2*yp;
+#endif
+#ifdef HERMITE_DO_DPHI
+    b[0] = d2ym*deltax;
+    b[1] = -2*d2ym*deltax-d2yp*deltax-3*dym+3*dyp;
+    b[2] = d2ym*deltax+d2yp*deltax+2*dym-2*dyp;
+#endif
+#ifdef HERMITE_DO_D2PHI
+    c[0] = d3ym*deltax;
+    c[1] = -2*d3ym*deltax-d3yp*deltax-3*d2ym+3*d2yp;
+    c[2] = d3ym*deltax+d3yp*deltax+2*d2ym-2*d2yp;
+#endif
+  }
+  //Evaluate polynomial and add it to the partial sums:
+  z[0] = (x-left_border)/deltax;
+  z[1] = z[0]*z[0];
+  z[2] = z[1]*z[0];
+  index_sum = j%_HERMITE_SUMS_;
+#ifdef HERMITE_DO_PHI
+  partial_Phi[index_sum] += weight[j]*(ym+a[0]*z[0]+a[1]*z[1]+a[2]*z[2]);
+#endif
+#ifdef HERMITE_DO_DPHI
+  partial_dPhi[index_sum] += weight[j]*(dym+b[0]*z[0]+b[1]*z[1]+b[2]*z[2]);
+#endif
+#ifdef HERMITE_DO_D2PHI
+  partial_d2Phi[index_sum] += weight[j]*(d2ym+c[0]*z[0]+c[1]*z[1]+c[2]*z[2]);
+#endif
+ }
+
+for (index_sum=0; index_sum<_HERMITE_SUMS_; index_sum++){
+#ifdef HERMITE_DO_PHI
+  *result_Phi += partial_Phi[index_sum];
+#endif
+#ifdef HERMITE_DO_DPHI
+  *result_dPhi += partial_dPhi[index_sum];
+#endif
+#ifdef HERMITE_DO_D2PHI
+  *result_d2Phi += partial_d2Phi[index_sum];
+#endif
+ }
@@ -6,6 +6,10 @@
  */
 
 #include "hyperspherical.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 int hyperspherical_HIS_create(int K,
                               double beta,
@@ -29,7 +33,7 @@ int hyperspherical_HIS_create(int K,
   double *sqrtK, *one_over_sqrtK,*PhiL;
   int j, k, l, nx, lmax, l_recurrence_max;
   int abort;
-  int current_chunk, index_x;
+  int current_chunk, index_x, lmax_is_beta_minus_one;
 
   beta2 = beta*beta;
   lmax = lvec[nl-1];
@@ -45,6 +49,9 @@ int hyperspherical_HIS_create(int K,
   pHIS->l_size = nl;
   pHIS->x_size = nx;
   pHIS->K = K;
+  pHIS->block = NULL;
+  pHIS->block_size = 0;
+  pHIS->block_is_mapped = _FALSE_;
   //Set pointervalues in pHIS:
 
   class_alloc(pHIS->l, sizeof(int)*nl,error_message);
@@ -52,8 +59,8 @@ int hyperspherical_HIS_create(int K,
   class_alloc(pHIS->x,sizeof(double)*nx,error_message);
   class_alloc(pHIS->sinK,sizeof(double)*nx,error_message);
   class_alloc(pHIS->cotK,sizeof(double)*nx,error_message);
-  class_alloc(pHIS->phi,sizeof(double)*nx*nl,error_message);
-  class_alloc(pHIS->dphi,sizeof(double)*nx*nl,error_message);
+  class_alloc_first_touch(pHIS->phi,sizeof(double)*nx*nl,error_message);
+  class_alloc_first_touch(pHIS->dphi,sizeof(double)*nx*nl,error_message);
 
   //Order needed for trig interpolation: (We are using Taylor's remainder theorem)
   if (0.5*deltax*deltax < _TRIG_PRECISSION_)
@@ -136,47 +143,31 @@ int hyperspherical_HIS_create(int K,
 
 #pragma omp parallel                                                    \
   shared(nx,pHIS,xfwd,K,l_recurrence_max,beta,sqrtK,one_over_sqrtK,lvec,nl,xfwdidx,abort,error_message) \
-  private(j,PhiL,k,l,current_chunk,index_x)                           \
+  private(j,PhiL,k,l,current_chunk,index_x,lmax_is_beta_minus_one)    \
   firstprivate(lmax)
   {
     class_alloc_parallel(PhiL,(lmax+2)*sizeof(double)*_HYPER_CHUNK_,error_message);
+    lmax_is_beta_minus_one = _FALSE_;
 
     if ((K == 1) && ((int)(beta+0.2) == (lmax+1))) {
       /** Take care of special case lmax = beta-1.
           The routine below will try to compute
           Phi_{lmax+1} which is not allowed. However,
           the purpose is to calculate the derivative
-          Phi'_{lmax}, and the formula is correct if we set Phi_{lmax+1} = 0.
+          Phi'_{lmax}, and the formula is correct if we set Phi_{lmax+1} = 0
+          after each chunk.
       */
-      PhiL[lmax+1] = 0.0;
+      lmax_is_beta_minus_one = _TRUE_;
       lmax--;
     }
 
-#pragma omp for schedule (dynamic)              \
+#pragma omp for schedule (dynamic)
 
-
-    for (j=0; j<MIN(nx,xfwdidx); j++){
-      //Use backwards method:
-      hyperspherical_backwards_recurrence(K,
-                                          MIN(l_recurrence_max,lmax)+1,
-                                          beta,
-                                          pHIS->x[j],
-                                          pHIS->sinK[j],
-                                          pHIS->cotK[j],
-                                          sqrtK,
-                                          one_over_sqrtK,
-                                          PhiL);
-      //We have now populated PhiL at x, assign Phi and dPhi for all l in lvec:
-      for (k=0; k<=index_recurrence_max; k++){
-        l = lvec[k];
-        pHIS->phi[k*nx+j] = PhiL[l];
-        pHIS->dphi[k*nx+j] = l*pHIS->cotK[j]*PhiL[l]-sqrtK[l+1]*PhiL[l+1];
-      }
-    }
-    /**
     for (j=0; j<MIN(nx,xfwdidx); j+= _HYPER_CHUNK_){
+      class_trace_begin();
       current_chunk = MIN(_HYPER_CHUNK_,MIN(nx,xfwdidx)-j);
       //Use backwards method:
+      class_counters_begin(counter_hyperspherical);
       hyperspherical_backwards_recurrence_chunk(K,
                                                 MIN(l_recurrence_max,lmax)+1,
                                                 beta,
@@ -187,6 +178,11 @@ int hyperspherical_HIS_create(int K,
                                                 sqrtK,
                                                 one_over_sqrtK,
                                                 PhiL);
+      class_counters_end(counter_hyperspherical);
+      if (lmax_is_beta_minus_one == _TRUE_){
+        for (index_x=0; index_x<current_chunk; index_x++)
+          PhiL[(lmax+2)*current_chunk+index_x] = 0.0;
+      }
       //We have now populated PhiL at x, assign Phi and dPhi for all l in lvec:
       for (k=0; k<=index_recurrence_max; k++){
         l = lvec[k];
@@ -197,15 +193,16 @@ int hyperspherical_HIS_create(int K,
             sqrtK[l+1]*PhiL[(l+1)*current_chunk+index_x];
         }
       }
+      class_trace_end("hyperspherical","index_x",j);
     }
 
-    */
-
-#pragma omp for schedule (dynamic)              \
+#pragma omp for schedule (dynamic)
 
     for (j=xfwdidx; j<nx; j+=_HYPER_CHUNK_){
+      class_trace_begin();
       //Use forwards method:
       current_chunk = MIN(_HYPER_CHUNK_,nx-j);
+      class_counters_begin(counter_hyperspherical);
       hyperspherical_forwards_recurrence_chunk(K,
                                                MIN(l_recurrence_max,lmax)+1,
                                                beta,
@@ -216,6 +213,11 @@ int hyperspherical_HIS_create(int K,
                                                sqrtK,
                                                one_over_sqrtK,
                                                PhiL);
+      class_counters_end(counter_hyperspherical);
+      if (lmax_is_beta_minus_one == _TRUE_){
+        for (index_x=0; index_x<current_chunk; index_x++)
+          PhiL[(lmax+2)*current_chunk+index_x] = 0.0;
+      }
 
       //We have now populated PhiL at x, assign Phi and dPhi for all l in lvec:
       for (k=0; k<=index_recurrence_max; k++){
@@ -227,6 +229,7 @@ int hyperspherical_HIS_create(int K,
             sqrtK[l+1]*PhiL[(l+1)*current_chunk+index_x];
         }
       }
+      class_trace_end("hyperspherical","index_x",j);
     }
     free(PhiL);
   }
@@ -269,6 +272,15 @@ int hyperspherical_update_pointers(HyperInterpStruct *pHIS_local,
 int hyperspherical_HIS_free(HyperInterpStruct *pHIS,
                             ErrorMsg error_message){
   /** Free the Hyperspherical Interpolation Structure. */
+  if (pHIS->block != NULL){
+    /** A table read from a cache is a single block of memory: */
+    if (pHIS->block_is_mapped == _TRUE_)
+      munmap(pHIS->block,pHIS->block_size);
+    else
+      free(pHIS->block);
+    pHIS->block = NULL;
+    return _SUCCESS_;
+  }
   free(pHIS->l);
   free(pHIS->chi_at_phimin);
   free(pHIS->x);
@@ -280,6 +292,453 @@ int hyperspherical_HIS_free(HyperInterpStruct *pHIS,
   return _SUCCESS_;
 }
 
+/**
+ * Tables of hyperspherical Bessel functions kept in memory by
+ * hyperspherical_HIS_create_cached(), each in the single block format
+ * of hyperspherical_HIS_to_block(), and index of the next slot to fill.
+ */
+
+static void * hyperspherical_cache_blocks[_HYPER_CACHE_MAX_];
+static size_t hyperspherical_cache_block_sizes[_HYPER_CACHE_MAX_];
+static int hyperspherical_cache_next = 0;
+
+/**
+ * Same as hyperspherical_HIS_create(), but first look for an identical
+ * table built earlier, in memory (for repeated runs in the same
+ * process, e.g. from classy or ClassEngine) and then in the directory
+ * cache_directory (shared by all processes on a node). A table is
+ * identical when all the arguments of hyperspherical_HIS_create() are,
+ * since they fully determine it.
+ *
+ * A table found in memory is copied in a single block. A table found
+ * in a file is memory-mapped read-only, so that all the processes
+ * reading it share the same physical pages. A newly computed table is
+ * stored in memory, replacing the oldest one when cache_size tables
+ * are already stored, and written to cache_directory.
+ *
+ * @param cache_size      Input: maximum number of tables kept in memory (0 to disable, at most _HYPER_CACHE_MAX_)
+ * @param cache_directory Input: directory of cache files, or NULL to disable
+ * All other arguments as in hyperspherical_HIS_create().
+ * @return the error status
+ */
+
+int hyperspherical_HIS_create_cached(int K,
+                                     double beta,
+                                     int nl,
+                                     int *lvec,
+                                     double xmin,
+                                     double xmax,
+                                     double sampling,
+                                     int l_WKB,
+                                     double phiminabs,
+                                     int cache_size,
+                                     char *cache_directory,
+                                     HyperInterpStruct *pHIS,
+                                     ErrorMsg error_message){
+
+  struct hyperspherical_cache_header header;
+  int index_cache, found, store;
+  void * block;
+  size_t block_size;
+
+  cache_size = MIN(cache_size,_HYPER_CACHE_MAX_);
+
+  if ((cache_size <= 0) && (cache_directory == NULL)) {
+    class_call(hyperspherical_HIS_create(K,beta,nl,lvec,xmin,xmax,sampling,l_WKB,phiminabs,pHIS,error_message),
+               error_message,
+               error_message);
+    return _SUCCESS_;
+  }
+
+  hyperspherical_HIS_cache_header(K,beta,nl,lvec,xmin,xmax,sampling,l_WKB,phiminabs,&header);
+
+  /** - look in memory. The copy is done in the critical section, since
+      another thread may otherwise replace the stored block meanwhile */
+  found = _FALSE_;
+  block = NULL;
+  block_size = 0;
+  if (cache_size > 0) {
+#pragma omp critical (hyperspherical_cache)
+    {
+      for (index_cache = 0; index_cache < _HYPER_CACHE_MAX_; index_cache++) {
+        if ((hyperspherical_cache_blocks[index_cache] != NULL) &&
+            (hyperspherical_HIS_cache_match(&header,
+                                            lvec,
+                                            hyperspherical_cache_blocks[index_cache],
+                                            hyperspherical_cache_block_sizes[index_cache]) == _TRUE_)) {
+          block_size = hyperspherical_cache_block_sizes[index_cache];
+          block = malloc(block_size);
+          if (block != NULL) {
+            memcpy(block,hyperspherical_cache_blocks[index_cache],block_size);
+            found = _TRUE_;
+          }
+          break;
+        }
+      }
+    }
+    class_test((found == _FALSE_) && (block_size > 0),
+               error_message,
+               "could not allocate %zu bytes for a copy of a stored table",block_size);
+    if (found == _TRUE_) {
+      hyperspherical_HIS_from_block(block,block_size,_FALSE_,pHIS);
+      return _SUCCESS_;
+    }
+  }
+
+  /** - look in the cache directory */
+  if (cache_directory != NULL) {
+    hyperspherical_HIS_cache_read_file(cache_directory,&header,lvec,pHIS,&found);
+    if (found == _TRUE_)
+      return _SUCCESS_;
+  }
+
+  /** - otherwise compute the table, and store it */
+  class_call(hyperspherical_HIS_create(K,beta,nl,lvec,xmin,xmax,sampling,l_WKB,phiminabs,pHIS,error_message),
+             error_message,
+             error_message);
+
+  header.x_size = pHIS->x_size;
+  header.delta_x = pHIS->delta_x;
+  header.trig_order = pHIS->trig_order;
+
+  block_size = hyperspherical_HIS_block_size(nl,pHIS->x_size);
+  class_alloc(block,block_size,error_message);
+  hyperspherical_HIS_to_block(pHIS,&header,block);
+
+  if (cache_directory != NULL) {
+    class_call(hyperspherical_HIS_cache_write_file(cache_directory,block,block_size,error_message),
+               error_message,
+               error_message);
+  }
+
+  store = _FALSE_;
+  if (cache_size > 0) {
+#pragma omp critical (hyperspherical_cache)
+    {
+      /* another thread may have stored the same table meanwhile */
+      for (index_cache = 0; index_cache < _HYPER_CACHE_MAX_; index_cache++) {
+        if ((hyperspherical_cache_blocks[index_cache] != NULL) &&
+            (hyperspherical_HIS_cache_match(&header,
+                                            lvec,
+                                            hyperspherical_cache_blocks[index_cache],
+                                            hyperspherical_cache_block_sizes[index_cache]) == _TRUE_))
+          break;
+      }
+      if (index_cache == _HYPER_CACHE_MAX_) {
+        index_cache = hyperspherical_cache_next % cache_size;
+        free(hyperspherical_cache_blocks[index_cache]);
+        hyperspherical_cache_blocks[index_cache] = block;
+        hyperspherical_cache_block_sizes[index_cache] = block_size;
+        hyperspherical_cache_next = index_cache+1;
+        store = _TRUE_;
+      }
+    }
+  }
+  if (store == _FALSE_)
+    free(block);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Fill the header identifying a table, and its 64-bit FNV-1a key
+ * computed from all the arguments of hyperspherical_HIS_create(). The
+ * fields depending on the table itself (x_size, trig_order, delta_x)
+ * are set to zero.
+ */
+
+int hyperspherical_HIS_cache_header(int K,
+                                    double beta,
+                                    int nl,
+                                    int *lvec,
+                                    double xmin,
+                                    double xmax,
+                                    double sampling,
+                                    int l_WKB,
+                                    double phiminabs,
+                                    struct hyperspherical_cache_header *header){
+
+  const unsigned char * byte;
+  size_t index;
+  int index_l;
+  unsigned long long key = 14695981039346656037ULL;
+
+  memset(header,0,sizeof(struct hyperspherical_cache_header));
+  memcpy(header->magic,"CLASSHIS",8);
+  header->version = _HYPER_CACHE_VERSION_;
+  header->K = K;
+  header->nl = nl;
+  header->l_WKB = l_WKB;
+  header->beta = beta;
+  header->xmin = xmin;
+  header->xmax = xmax;
+  header->sampling = sampling;
+  header->phiminabs = phiminabs;
+
+  /* hash everything up to the fields depending on the table itself,
+     then the l list */
+  byte = (const unsigned char *) &(header->version);
+  for (index = 0; index < (size_t)((char*)&(header->x_size)-(char*)&(header->version)); index++) {
+    key ^= byte[index];
+    key *= 1099511628211ULL;
+  }
+  byte = (const unsigned char *) &(header->l_WKB);
+  for (index = 0; index < sizeof(int); index++) {
+    key ^= byte[index];
+    key *= 1099511628211ULL;
+  }
+  byte = (const unsigned char *) &(header->beta);
+  for (index = 0; index < 5*sizeof(double); index++) {
+    key ^= byte[index];
+    key *= 1099511628211ULL;
+  }
+  for (index_l = 0; index_l < nl; index_l++) {
+    byte = (const unsigned char *) (lvec+index_l);
+    for (index = 0; index < sizeof(int); index++) {
+      key ^= byte[index];
+      key *= 1099511628211ULL;
+    }
+  }
+  header->key = key;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Check that a stored block contains the table described by header
+ * and lvec (as filled by hyperspherical_HIS_cache_header()). All the
+ * arguments are compared, not only the key, so that a hash collision
+ * or a corrupted file can never give a wrong table.
+ *
+ * @return _TRUE_ if the block matches, _FALSE_ otherwise
+ */
+
+int hyperspherical_HIS_cache_match(struct hyperspherical_cache_header *header,
+                                   int *lvec,
+                                   void *block,
+                                   size_t block_size){
+
+  struct hyperspherical_cache_header * stored = (struct hyperspherical_cache_header *) block;
+  int * stored_l;
+
+  if (block_size < sizeof(struct hyperspherical_cache_header))
+    return _FALSE_;
+  if ((memcmp(stored->magic,header->magic,8) != 0) ||
+      (stored->key != header->key) ||
+      (stored->version != header->version) ||
+      (stored->K != header->K) ||
+      (stored->nl != header->nl) ||
+      (stored->l_WKB != header->l_WKB) ||
+      (stored->beta != header->beta) ||
+      (stored->xmin != header->xmin) ||
+      (stored->xmax != header->xmax) ||
+      (stored->sampling != header->sampling) ||
+      (stored->phiminabs != header->phiminabs))
+    return _FALSE_;
+  if ((stored->x_size < 2) || (block_size != hyperspherical_HIS_block_size(stored->nl,stored->x_size)))
+    return _FALSE_;
+  stored_l = (int *) ((char *) block + hyperspherical_HIS_block_size(0,0));
+  if (memcmp(stored_l,lvec,header->nl*sizeof(int)) != 0)
+    return _FALSE_;
+
+  return _TRUE_;
+}
+
+/**
+ * Size in bytes of a table in the single block format: the header,
+ * the l list (padded to a multiple of 8 bytes), chi_at_phimin, x, sinK,
+ * cotK, phi and dphi, in this order. With nl = nx = 0, this is the
+ * offset of the l list.
+ */
+
+size_t hyperspherical_HIS_block_size(int nl, int nx){
+
+  size_t header_size = (sizeof(struct hyperspherical_cache_header)+_HIS_BYTE_ALIGNMENT_-1)/_HIS_BYTE_ALIGNMENT_*_HIS_BYTE_ALIGNMENT_;
+  size_t l_size = (nl*sizeof(int)+sizeof(double)-1)/sizeof(double)*sizeof(double);
+
+  return header_size + l_size + sizeof(double)*((size_t)nl+3*(size_t)nx+2*(size_t)nl*(size_t)nx);
+}
+
+/**
+ * Write the header and all the arrays of pHIS in block, which must
+ * have the size given by hyperspherical_HIS_block_size().
+ */
+
+int hyperspherical_HIS_to_block(HyperInterpStruct *pHIS,
+                                struct hyperspherical_cache_header *header,
+                                void *block){
+
+  HyperInterpStruct HIS_in_block;
+  size_t nl = pHIS->l_size;
+  size_t nx = pHIS->x_size;
+
+  memcpy(block,header,sizeof(struct hyperspherical_cache_header));
+  hyperspherical_HIS_from_block(block,hyperspherical_HIS_block_size(nl,nx),_FALSE_,&HIS_in_block);
+
+  memcpy(HIS_in_block.l,pHIS->l,nl*sizeof(int));
+  memcpy(HIS_in_block.chi_at_phimin,pHIS->chi_at_phimin,nl*sizeof(double));
+  memcpy(HIS_in_block.x,pHIS->x,nx*sizeof(double));
+  memcpy(HIS_in_block.sinK,pHIS->sinK,nx*sizeof(double));
+  memcpy(HIS_in_block.cotK,pHIS->cotK,nx*sizeof(double));
+  memcpy(HIS_in_block.phi,pHIS->phi,nl*nx*sizeof(double));
+  memcpy(HIS_in_block.dphi,pHIS->dphi,nl*nx*sizeof(double));
+
+  return _SUCCESS_;
+}
+
+/**
+ * Set all the fields of pHIS from a table in the single block format.
+ * The arrays point inside the block, which is released by
+ * hyperspherical_HIS_free().
+ */
+
+int hyperspherical_HIS_from_block(void *block,
+                                  size_t block_size,
+                                  int block_is_mapped,
+                                  HyperInterpStruct *pHIS){
+
+  struct hyperspherical_cache_header * header = (struct hyperspherical_cache_header *) block;
+  int nl = header->nl;
+  int nx = header->x_size;
+
+  pHIS->K = header->K;
+  pHIS->beta = header->beta;
+  pHIS->delta_x = header->delta_x;
+  pHIS->trig_order = header->trig_order;
+  pHIS->l_size = nl;
+  pHIS->x_size = nx;
+  pHIS->l = (int *) ((char *) block + hyperspherical_HIS_block_size(0,0));
+  pHIS->chi_at_phimin = (double *) ((char *) block + hyperspherical_HIS_block_size(nl,0) - nl*sizeof(double));
+  pHIS->x = pHIS->chi_at_phimin + nl;
+  pHIS->sinK = pHIS->x + nx;
+  pHIS->cotK = pHIS->sinK + nx;
+  pHIS->phi = pHIS->cotK + nx;
+  pHIS->dphi = pHIS->phi + nl*nx;
+  pHIS->block = block;
+  pHIS->block_size = block_size;
+  pHIS->block_is_mapped = block_is_mapped;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Look for the table described by header and lvec in the file
+ * cache_directory/his_<key>.dat, and memory-map it read-only if it
+ * matches. Any problem with the file (missing, truncated, written by
+ * another version) is not an error: the table is then simply not found.
+ *
+ * @param found Output: _TRUE_ if pHIS was filled from the file
+ */
+
+int hyperspherical_HIS_cache_read_file(char *cache_directory,
+                                       struct hyperspherical_cache_header *header,
+                                       int *lvec,
+                                       HyperInterpStruct *pHIS,
+                                       int *found){
+
+  FileName filename;
+  int fd;
+  struct stat file_stat;
+  void * block;
+
+  *found = _FALSE_;
+
+  snprintf(filename,sizeof(FileName),"%s/his_%016llx.dat",cache_directory,header->key);
+
+  fd = open(filename,O_RDONLY);
+  if (fd < 0)
+    return _SUCCESS_;
+
+  if ((fstat(fd,&file_stat) != 0) || (file_stat.st_size < (off_t)sizeof(struct hyperspherical_cache_header))) {
+    close(fd);
+    return _SUCCESS_;
+  }
+
+  block = mmap(NULL,file_stat.st_size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if (block == MAP_FAILED)
+    return _SUCCESS_;
+
+  if (hyperspherical_HIS_cache_match(header,lvec,block,file_stat.st_size) == _FALSE_) {
+    munmap(block,file_stat.st_size);
+    return _SUCCESS_;
+  }
+
+  hyperspherical_HIS_from_block(block,file_stat.st_size,_TRUE_,pHIS);
+  *found = _TRUE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write a table in the single block format to the file
+ * cache_directory/his_<key>.dat, creating the directory if needed. The
+ * file is first written under a unique temporary name and then renamed,
+ * so that other processes never read an incomplete table.
+ */
+
+int hyperspherical_HIS_cache_write_file(char *cache_directory,
+                                        void *block,
+                                        size_t block_size,
+                                        ErrorMsg error_message){
+
+  struct hyperspherical_cache_header * header = (struct hyperspherical_cache_header *) block;
+  FileName filename, tmpname;
+  int fd;
+  size_t written;
+  ssize_t chunk;
+
+  mkdir(cache_directory,0777);
+
+  snprintf(filename,sizeof(FileName),"%s/his_%016llx.dat",cache_directory,header->key);
+  snprintf(tmpname,sizeof(FileName),"%s/his_%016llx.XXXXXX",cache_directory,header->key);
+
+  fd = mkstemp(tmpname);
+  class_test(fd < 0,
+             error_message,
+             "could not create a file in the cache directory %s",cache_directory);
+
+  /* readable by all the runs on the node, like files created with fopen() */
+  fchmod(fd,0644);
+
+  for (written = 0; written < block_size; written += chunk) {
+    chunk = write(fd,(char *) block + written,block_size-written);
+    if (chunk <= 0)
+      break;
+  }
+  close(fd);
+
+  if ((written < block_size) || (rename(tmpname,filename) != 0))
+    unlink(tmpname);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free all the tables stored in memory by
+ * hyperspherical_HIS_create_cached(). Tables already given to a caller
+ * are copies, and remain valid.
+ *
+ * @return the error status
+ */
+
+int hyperspherical_HIS_cache_clear(){
+
+  int index_cache;
+
+#pragma omp critical (hyperspherical_cache)
+  {
+    for (index_cache = 0; index_cache < _HYPER_CACHE_MAX_; index_cache++) {
+      free(hyperspherical_cache_blocks[index_cache]);
+      hyperspherical_cache_blocks[index_cache] = NULL;
+      hyperspherical_cache_block_sizes[index_cache] = 0;
+    }
+    hyperspherical_cache_next = 0;
+  }
+
+  return _SUCCESS_;
+}
+
 int hyperspherical_Hermite_interpolation_vector(HyperInterpStruct *pHIS,
                                                 int nxi,
                                                 int lnum,
@@ -504,6 +963,7 @@ int hyperspherical_forwards_recurrence_chunk(int K,
       (cotK[index_x]-beta/tan(beta*x[index_x]))*one_over_sqrtK[1];
   }
   for (l=2; l<=lmax; l++){
+#pragma omp simd simdlen(_HYPER_SIMD_WIDTH_)
     for (index_x=0; index_x<chunk; index_x++)
       PhiL[l*chunk+index_x] =
         ((2*l-1)*cotK[index_x]*PhiL[(l-1)*chunk+index_x]-
@@ -612,12 +1072,13 @@ int hyperspherical_backwards_recurrence_chunk(int K,
                                               double * __restrict__ one_over_sqrtK,
                                               double * __restrict__ PhiL){
   double phi0, phi1, phipr1;
-  int l, k, isign;
-  int funcreturn = _FAILURE_;
+  int l, k, isign, rescale;
+  int funcreturn;
   int index_x;
   double scalevec[_HYPER_CHUNK_]={0};
 
   for (index_x=0; index_x<chunk; index_x++){
+    funcreturn = _FAILURE_;
     if (K==1){
       if (beta > 1.5*lmax) {
         funcreturn = get_CF1(K,lmax,beta,cotK[index_x], &phipr1, &isign);
@@ -640,21 +1101,32 @@ int hyperspherical_backwards_recurrence_chunk(int K,
   }
   for (l=lmax-2; l>=0; l--){
     //Use recurrence Phi_{l} = --Phi_{l+1} + -- Phi_{l+2}
+#pragma omp simd simdlen(_HYPER_SIMD_WIDTH_)
     for (index_x=0; index_x<chunk; index_x++){
       PhiL[l*chunk+index_x] = one_over_sqrtK[l+1]*
         ((2*l+3)*cotK[index_x]*PhiL[(l+1)*chunk+index_x]-
          sqrtK[l+2]*PhiL[(l+2)*chunk+index_x]);
     }
 
-    if (fabs(PhiL[l*chunk])>_HYPER_OVERFLOW_){
-      //Rescale whole Phi vector until this point.
-      //Create scale vector:
-      for (index_x=0; index_x<chunk; index_x++)
-        scalevec[index_x] = fabs(1.0/PhiL[l*chunk+index_x]);
-      //Now do the scaling: (We do it this way to access elements in order)
-      for (k=l; k<=lmax; k++){
-        for (index_x=0; index_x<chunk; index_x++){
-          PhiL[k*chunk+index_x] *= scalevec[index_x];
+    //Like in the scalar version, check for overflow only every _HYPER_BLOCK_ steps:
+    if (l%_HYPER_BLOCK_ == 0){
+      rescale = _FALSE_;
+      for (index_x=0; index_x<chunk; index_x++){
+        if (fabs(PhiL[l*chunk+index_x])>_HYPER_OVERFLOW_){
+          scalevec[index_x] = _ONE_OVER_HYPER_OVERFLOW_;
+          rescale = _TRUE_;
+        }
+        else{
+          scalevec[index_x] = 1.0;
+        }
+      }
+      if (rescale == _TRUE_){
+        //Rescale whole Phi vector until this point: (We do it this way to access elements in order)
+        for (k=l; k<=lmax; k++){
+#pragma omp simd simdlen(_HYPER_SIMD_WIDTH_)
+          for (index_x=0; index_x<chunk; index_x++){
+            PhiL[k*chunk+index_x] *= scalevec[index_x];
+          }
         }
       }
     }
@@ -664,6 +1136,7 @@ int hyperspherical_backwards_recurrence_chunk(int K,
     scalevec[index_x] = phi0/PhiL[index_x];
   }
   for (k=0; k<=lmax; k++){
+#pragma omp simd simdlen(_HYPER_SIMD_WIDTH_)
     for (index_x=0; index_x<chunk; index_x++){
       PhiL[k*chunk+index_x] *= scalevec[index_x];
     }
@@ -1661,6 +2134,313 @@ int hyperspherical_Hermite4_interpolation_vector_PhidPhid2Phi(HyperInterpStruct
 #include "hermite4_interpolation_csource.h"
   return _SUCCESS_;
 }
+/**
+ * Weighted sums of the order 4 Hermite interpolation of Phi, dPhi and
+ * d2Phi: sum_Phi = sum_j weight[j]*Phi(xinterp[j]), and likewise for
+ * the derivatives (only the sums with non-NULL pointers are computed).
+ * This gives the same result as hyperspherical_Hermite4_interpolation_vector_*
+ * followed by a weighted sum, up to rounding, in a single pass over the
+ * points and without temporary arrays (see hermite4_convolution_csource.h).
+ * The points should be sorted. Not for the closed case, whose
+ * periodicity is not taken into account here.
+ *
+ * @param pHIS          Input: pointer to the interpolation structure
+ * @param nxi           Input: number of points
+ * @param lnum          Input: index of multipole
+ * @param xinterp       Input: points at which the functions are interpolated
+ * @param weight        Input: weights of the points
+ * @param sum_Phi       Output: weighted sum of Phi (or NULL)
+ * @param sum_dPhi      Output: weighted sum of dPhi (or NULL)
+ * @param sum_d2Phi     Output: weighted sum of d2Phi (or NULL)
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int hyperspherical_Hermite4_convolution(HyperInterpStruct *pHIS,
+                                        int nxi,
+                                        int lnum,
+                                        double * xinterp,
+                                        double * weight,
+                                        double * sum_Phi,
+                                        double * sum_dPhi,
+                                        double * sum_d2Phi,
+                                        ErrorMsg error_message) {
+
+  class_test(pHIS->K == 1,
+             error_message,
+             "hyperspherical_Hermite4_convolution() does not handle the closed case");
+
+  if (sum_Phi != NULL) *sum_Phi = 0.;
+  if (sum_dPhi != NULL) *sum_dPhi = 0.;
+  if (sum_d2Phi != NULL) *sum_d2Phi = 0.;
+
+  if (sum_dPhi == NULL) {
+    if (sum_d2Phi == NULL) {
+      class_call(hyperspherical_Hermite4_convolution_Phi(pHIS,nxi,lnum,xinterp,weight,sum_Phi),
+                 error_message,error_message);
+    }
+    else if (sum_Phi == NULL) {
+      class_call(hyperspherical_Hermite4_convolution_d2Phi(pHIS,nxi,lnum,xinterp,weight,sum_d2Phi),
+                 error_message,error_message);
+    }
+    else {
+      class_call(hyperspherical_Hermite4_convolution_Phid2Phi(pHIS,nxi,lnum,xinterp,weight,sum_Phi,sum_d2Phi),
+                 error_message,error_message);
+    }
+  }
+  else {
+    class_test((sum_Phi != NULL) || (sum_d2Phi != NULL),
+               error_message,
+               "hyperspherical_Hermite4_convolution() computes the sum of dPhi only alone");
+    class_call(hyperspherical_Hermite4_convolution_dPhi(pHIS,nxi,lnum,xinterp,weight,sum_dPhi),
+               error_message,error_message);
+  }
+
+  return _SUCCESS_;
+}
+int hyperspherical_Hermite4_convolution_Phi(HyperInterpStruct *pHIS,
+                                            int nxi,
+                                            int lnum,
+                                            double * xinterp,
+                                            double * weight,
+                                            double * result_Phi) {
+#undef HERMITE_DO_PHI
+#undef HERMITE_DO_DPHI
+#undef HERMITE_DO_D2PHI
+#define HERMITE_DO_PHI
+#include "hermite4_convolution_csource.h"
+  return _SUCCESS_;
+}
+int hyperspherical_Hermite4_convolution_dPhi(HyperInterpStruct *pHIS,
+                                             int nxi,
+                                             int lnum,
+                                             double * xinterp,
+                                             double * weight,
+                                             double * result_dPhi) {
+#undef HERMITE_DO_PHI
+#undef HERMITE_DO_DPHI
+#undef HERMITE_DO_D2PHI
+#define HERMITE_DO_DPHI
+#include "hermite4_convolution_csource.h"
+  return _SUCCESS_;
+}
+int hyperspherical_Hermite4_convolution_d2Phi(HyperInterpStruct *pHIS,
+                                              int nxi,
+                                              int lnum,
+                                              double * xinterp,
+                                              double * weight,
+                                              double * result_d2Phi) {
+#undef HERMITE_DO_PHI
+#undef HERMITE_DO_DPHI
+#undef HERMITE_DO_D2PHI
+#define HERMITE_DO_D2PHI
+#include "hermite4_convolution_csource.h"
+  return _SUCCESS_;
+}
+int hyperspherical_Hermite4_convolution_Phid2Phi(HyperInterpStruct *pHIS,
+                                                 int nxi,
+                                                 int lnum,
+                                                 double * xinterp,
+                                                 double * weight,
+                                                 double * result_Phi,
+                                                 double * result_d2Phi) {
+#undef HERMITE_DO_PHI
+#undef HERMITE_DO_DPHI
+#undef HERMITE_DO_D2PHI
+#define HERMITE_DO_PHI
+#define HERMITE_DO_D2PHI
+#include "hermite4_convolution_csource.h"
+  return _SUCCESS_;
+}
+/**
+ * Weighted sums of the order 4 Hermite interpolation of Phi, dPhi and
+ * d2Phi for several sets of weights at once: sum_Phi[i] = sum_j
+ * weight_Phi[i][j]*Phi(xinterp[j]) for i < n_Phi, and likewise for
+ * dPhi and d2Phi. The interpolation is done only once for all the
+ * sums, which are identical to those of hyperspherical_Hermite4_convolution()
+ * called for each set of weights. Not for the closed case.
+ *
+ * @param pHIS          Input: pointer to the interpolation structure
+ * @param nxi           Input: number of points
+ * @param lnum          Input: index of multipole
+ * @param xinterp       Input: points at which the functions are interpolated (sorted)
+ * @param n_Phi         Input: number of sets of weights for Phi (at most _HERMITE_CONVOLUTION_MAX_)
+ * @param weight_Phi    Input: sets of weights for Phi
+ * @param sum_Phi       Output: weighted sums of Phi
+ * @param n_dPhi        Input: number of sets of weights for dPhi (at most _HERMITE_CONVOLUTION_MAX_)
+ * @param weight_dPhi   Input: sets of weights for dPhi
+ * @param sum_dPhi      Output: weighted sums of dPhi
+ * @param n_d2Phi       Input: number of sets of weights for d2Phi (at most _HERMITE_CONVOLUTION_MAX_)
+ * @param weight_d2Phi  Input: sets of weights for d2Phi
+ * @param sum_d2Phi     Output: weighted sums of d2Phi
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int hyperspherical_Hermite4_convolution_multi(HyperInterpStruct *pHIS,
+                                              int nxi,
+                                              int lnum,
+                                              double * xinterp,
+                                              int n_Phi,
+                                              double ** weight_Phi,
+                                              double * sum_Phi,
+                                              int n_dPhi,
+                                              double ** weight_dPhi,
+                                              double * sum_dPhi,
+                                              int n_d2Phi,
+                                              double ** weight_d2Phi,
+                                              double * sum_d2Phi,
+                                              ErrorMsg error_message) {
+
+  double ym=0, yp=0, dym=0, dyp=0, d2ym=0, d2yp=0, d3ym=0, d3yp=0, x;
+  double a[3]={0.,0.,0.}, b[3]={0.,0.,0.}, c[3]={0.,0.,0.}, z[3];
+  double P, dP, d2P;
+  double partial_Phi[_HERMITE_CONVOLUTION_MAX_][_HERMITE_SUMS_];
+  double partial_dPhi[_HERMITE_CONVOLUTION_MAX_][_HERMITE_SUMS_];
+  double partial_d2Phi[_HERMITE_CONVOLUTION_MAX_][_HERMITE_SUMS_];
+  double *sinK = pHIS->sinK;
+  double *cotK = pHIS->cotK;
+  double cotKm=0,cotKp=0,sinKm=0,sinKp=0;
+  double sinKm2, sinKp2;
+  int K = pHIS->K;
+  double lxlp1 = pHIS->l[lnum]*(pHIS->l[lnum]+1.0);
+  double beta = pHIS->beta;
+  double beta2 = beta*beta;
+  double *xvec;
+  double xmin, xmax, deltax;
+  double left_border, right_border, next_border;
+  int j, nx, current_border_idx=0, index_sum, i;
+  double *Phi_l, *dPhi_l;
+  short do_derivatives = ((n_dPhi > 0) || (n_d2Phi > 0));
+
+  class_test(pHIS->K == 1,
+             error_message,
+             "hyperspherical_Hermite4_convolution_multi() does not handle the closed case");
+
+  class_test((n_Phi > _HERMITE_CONVOLUTION_MAX_) || (n_dPhi > _HERMITE_CONVOLUTION_MAX_) || (n_d2Phi > _HERMITE_CONVOLUTION_MAX_),
+             error_message,
+             "at most %d sets of weights per function, increase _HERMITE_CONVOLUTION_MAX_",_HERMITE_CONVOLUTION_MAX_);
+
+  for (i=0; i<_HERMITE_CONVOLUTION_MAX_; i++) {
+    for (index_sum=0; index_sum<_HERMITE_SUMS_; index_sum++) {
+      partial_Phi[i][index_sum] = 0.;
+      partial_dPhi[i][index_sum] = 0.;
+      partial_d2Phi[i][index_sum] = 0.;
+    }
+  }
+
+  xvec = pHIS->x;
+  deltax = pHIS->delta_x;
+  nx = pHIS->x_size;
+  Phi_l = pHIS->phi+lnum*nx;
+  dPhi_l = pHIS->dphi+lnum*nx;
+
+  xmin = xvec[0];
+  xmax = xvec[nx-1];
+
+  left_border = xmax;
+  right_border = xmin;
+  next_border = xmin;
+
+  for (j=0; j<nxi; j++){
+    x = xinterp[j];
+    if ((x<xmin)||(x>xmax)){
+      //Outside interpolation region, no contribution.
+      continue;
+    }
+    if ((x>right_border)||(x<left_border)){
+      if ((x>next_border)||(x<left_border)){
+        current_border_idx = ((int) ((x-xmin)/deltax))+1;
+        current_border_idx = MAX(1,current_border_idx);
+        current_border_idx = MIN(nx-1,current_border_idx);
+        //Calculate left derivatives:
+        ym = Phi_l[current_border_idx-1];
+        dym = dPhi_l[current_border_idx-1];
+        if (do_derivatives == _TRUE_) {
+          cotKm = cotK[current_border_idx-1];
+          sinKm = sinK[current_border_idx-1];
+          sinKm2 = sinKm*sinKm;
+          d2ym = -2*dym*cotKm+ym*(lxlp1/sinKm2-beta2+K);
+          d3ym = -2*cotKm*d2ym-2*ym*lxlp1*cotKm/sinKm2+
+            dym*(K-beta2+(2+lxlp1)/sinKm2);
+        }
+      }
+      else{
+        //x>current_border but not next border: I have moved to next block.
+        current_border_idx++;
+        //Copy former right derivatives to left derivatives.
+        ym = yp;
+        dym = dyp;
+        d2ym = d2yp;
+        d3ym = d3yp;
+        sinKm = sinKp;
+        cotKm = cotKp;
+      }
+      left_border = xvec[MAX(0,current_border_idx-1)];
+      right_border = xvec[current_border_idx];
+      next_border = xvec[MIN(nx-1,current_border_idx+1)];
+      //Evaluate right derivatives and calculate coefficients:
+      yp = Phi_l[current_border_idx];
+      dyp = dPhi_l[current_border_idx];
+      if (do_derivatives == _TRUE_) {
+        cotKp = cotK[current_border_idx];
+        sinKp = sinK[current_border_idx];
+        sinKp2 = sinKp*sinKp;
+        d2yp = -2*dyp*cotKp+yp*(lxlp1/sinKp2-beta2+K);
+        d3yp = -2*cotKp*d2yp-2*yp*lxlp1*cotKp/sinKp2+
+          dyp*(K-beta2+(2+lxlp1)/sinKp2);
+      }
+
+      a[0] = dym*deltax;
+      a[1] = -2*dym*deltax-dyp*deltax-3*ym+3*yp;
+      a[2] = dym*deltax+dyp*deltax+2*ym-2*yp;
+      b[0] = d2ym*deltax;
+      b[1] = -2*d2ym*deltax-d2yp*deltax-3*dym+3*dyp;
+      b[2] = d2ym*deltax+d2yp*deltax+2*dym-2*dyp;
+      c[0] = d3ym*deltax;
+      c[1] = -2*d3ym*deltax-d3yp*deltax-3*d2ym+3*d2yp;
+      c[2] = d3ym*deltax+d3yp*deltax+2*d2ym-2*d2yp;
+    }
+    //Evaluate polynomials and add them to the partial sums:
+    z[0] = (x-left_border)/deltax;
+    z[1] = z[0]*z[0];
+    z[2] = z[1]*z[0];
+    index_sum = j%_HERMITE_SUMS_;
+    if (n_Phi > 0) {
+      P = ym+a[0]*z[0]+a[1]*z[1]+a[2]*z[2];
+      for (i=0; i<n_Phi; i++)
+        partial_Phi[i][index_sum] += weight_Phi[i][j]*P;
+    }
+    if (n_dPhi > 0) {
+      dP = dym+b[0]*z[0]+b[1]*z[1]+b[2]*z[2];
+      for (i=0; i<n_dPhi; i++)
+        partial_dPhi[i][index_sum] += weight_dPhi[i][j]*dP;
+    }
+    if (n_d2Phi > 0) {
+      d2P = d2ym+c[0]*z[0]+c[1]*z[1]+c[2]*z[2];
+      for (i=0; i<n_d2Phi; i++)
+        partial_d2Phi[i][index_sum] += weight_d2Phi[i][j]*d2P;
+    }
+  }
+
+  for (i=0; i<n_Phi; i++) {
+    sum_Phi[i] = 0.;
+    for (index_sum=0; index_sum<_HERMITE_SUMS_; index_sum++)
+      sum_Phi[i] += partial_Phi[i][index_sum];
+  }
+  for (i=0; i<n_dPhi; i++) {
+    sum_dPhi[i] = 0.;
+    for (index_sum=0; index_sum<_HERMITE_SUMS_; index_sum++)
+      sum_dPhi[i] += partial_dPhi[i][index_sum];
+  }
+  for (i=0; i<n_d2Phi; i++) {
+    sum_d2Phi[i] = 0.;
+    for (index_sum=0; index_sum<_HERMITE_SUMS_; index_sum++)
+      sum_d2Phi[i] += partial_d2Phi[i][index_sum];
+  }
+
+  return _SUCCESS_;
+}
 int hyperspherical_Hermite6_interpolation_vector_Phi(HyperInterpStruct *pHIS,
                                                      int nxi,
                                                      int lnum,
@@ -42,15 +42,84 @@ int parser_read_file(char * filename,
 
   fclose(inputfile);
 
+  class_call(parser_index(pfc,errmsg),
+             errmsg,
+             errmsg);
+
   return _SUCCESS_;
 
 }
 
+
+/**
+ * Read parameters given in the format of an input file from a string,
+ * as parser_read_file() does from a file
+ *
+ * @param text     Input: 'name = value' lines
+ * @param filename Input: name given to these parameters in error messages
+ * @param pfc      Output: parameters (size 0 if there are none)
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+int parser_read_text(char * text,
+                     char * filename,
+                     struct file_content * pfc,
+                     ErrorMsg errmsg) {
+
+  char line[_LINE_LENGTH_MAX_];
+  char * start;
+  char * end;
+  size_t length;
+  int is_data;
+  int counter;
+  int pass;
+  FileArg name;
+  FileArg value;
+
+  /* like parser_read_file(): a first pass counts the entries, a second one stores them */
+  pfc->size = 0;
+  pfc->hash_size = 0;
+  for (pass=0; pass<2; pass++) {
+    counter = 0;
+    for (start=text; *start != '\0'; start=end) {
+      end = strchr(start,'\n');
+      end = (end == NULL) ? start+strlen(start) : end+1;
+      length = MIN(end-start,_LINE_LENGTH_MAX_-1);
+      memcpy(line,start,length);
+      line[length] = '\0';
+      class_call(parser_read_line(line,&is_data,name,value,errmsg),errmsg,errmsg);
+      if (is_data == _TRUE_) {
+        if (pass == 1) {
+          strcpy(pfc->name[counter],name);
+          strcpy(pfc->value[counter],value);
+          pfc->read[counter] = _FALSE_;
+        }
+        counter++;
+      }
+    }
+    if (counter == 0)
+      return _SUCCESS_;
+    if (pass == 0)
+      class_call(parser_init(pfc,counter,filename,errmsg),errmsg,errmsg);
+  }
+
+  class_call(parser_index(pfc,errmsg),errmsg,errmsg);
+
+  return _SUCCESS_;
+}
+
 int parser_init(struct file_content * pfc,
                 int size,
                 char * filename,
                 ErrorMsg errmsg) {
 
+  /* the names are not known yet: parser_read_file() builds the hash
+     index once it has filled them, other callers may call
+     parser_index() themselves */
+  pfc->hash_table = NULL;
+  pfc->hash_size = 0;
+
   if (size > 0) {
     pfc->size=size;
     class_alloc(pfc->filename,(strlen(filename)+1)*sizeof(char),errmsg);
@@ -72,6 +141,112 @@ int parser_free(struct file_content * pfc) {
     free(pfc->filename);
   }
 
+  if (pfc->hash_size > 0) {
+    free(pfc->hash_table);
+    pfc->hash_table = NULL;
+    pfc->hash_size = 0;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Build (or rebuild) the hash index of the names of a file_content
+ * structure, used by all parser_read_xxx() functions instead of
+ * comparing the requested name with all entries. This must be called
+ * again if names are modified after the index was built.
+ *
+ * @param pfc    Input/Output: file_content structure
+ * @param errmsg Output: error message
+ * @return the error status
+ */
+
+int parser_index(struct file_content * pfc,
+                 ErrorMsg errmsg) {
+
+  int index;
+  int slot;
+  unsigned int hash;
+  char * c;
+
+  if (pfc->hash_size > 0) {
+    free(pfc->hash_table);
+    pfc->hash_table = NULL;
+    pfc->hash_size = 0;
+  }
+
+  if (pfc->size <= 0)
+    return _SUCCESS_;
+
+  /* at least twice as many slots as names, so that probe sequences remain short */
+  pfc->hash_size = 4;
+  while (pfc->hash_size < 2*pfc->size)
+    pfc->hash_size *= 2;
+
+  class_alloc(pfc->hash_table,pfc->hash_size*sizeof(int),errmsg);
+  for (slot=0; slot<pfc->hash_size; slot++)
+    pfc->hash_table[slot] = -1;
+
+  /* insert names in increasing order, so that multiple entries of the
+     same name appear along their probe sequence in the order of the file */
+  for (index=0; index<pfc->size; index++) {
+    hash = 2166136261u;
+    for (c=pfc->name[index]; *c != '\0'; c++) {
+      hash ^= (unsigned char)(*c);
+      hash *= 16777619u;
+    }
+    slot = hash & (pfc->hash_size-1);
+    while (pfc->hash_table[slot] != -1)
+      slot = (slot+1) & (pfc->hash_size-1);
+    pfc->hash_table[slot] = index;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Find the first entry with a given name, starting from a given
+ * position in the list. Uses the hash index when it has been built
+ * by parser_index(), and otherwise compares all names.
+ *
+ * @param pfc    Input: file_content structure
+ * @param name   Input: name of the parameter
+ * @param start  Input: smallest position to consider
+ * @param index  Output: position of the entry, or pfc->size if not found
+ * @return the error status
+ */
+
+int parser_find(struct file_content * pfc,
+                char * name,
+                int start,
+                int * index) {
+
+  int slot;
+  unsigned int hash;
+  char * c;
+
+  if (pfc->hash_size > 0) {
+    hash = 2166136261u;
+    for (c=name; *c != '\0'; c++) {
+      hash ^= (unsigned char)(*c);
+      hash *= 16777619u;
+    }
+    slot = hash & (pfc->hash_size-1);
+    while (pfc->hash_table[slot] != -1) {
+      if ((pfc->hash_table[slot] >= start) && (strcmp(pfc->name[pfc->hash_table[slot]],name) == 0)) {
+        *index = pfc->hash_table[slot];
+        return _SUCCESS_;
+      }
+      slot = (slot+1) & (pfc->hash_size-1);
+    }
+    *index = pfc->size;
+    return _SUCCESS_;
+  }
+
+  *index=start;
+  while ((*index < pfc->size) && (strcmp(pfc->name[*index],name) != 0))
+    (*index)++;
+
   return _SUCCESS_;
 }
 
@@ -175,9 +350,7 @@ int parser_read_int(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  parser_find(pfc,name,0,&index);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -199,11 +372,10 @@ int parser_read_int(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  parser_find(pfc,name,index+1,&i);
+  class_test(i < pfc->size,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -225,9 +397,7 @@ int parser_read_double(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  parser_find(pfc,name,0,&index);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -249,11 +419,10 @@ int parser_read_double(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  parser_find(pfc,name,index+1,&i);
+  class_test(i < pfc->size,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -276,9 +445,7 @@ int parser_read_double_and_position(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  parser_find(pfc,name,0,&index);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -300,11 +467,10 @@ int parser_read_double_and_position(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  parser_find(pfc,name,index+1,&i);
+  class_test(i < pfc->size,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -328,9 +494,7 @@ int parser_read_string(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  parser_find(pfc,name,0,&index);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -350,11 +514,10 @@ int parser_read_string(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  parser_find(pfc,name,index+1,&i);
+  class_test(i < pfc->size,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -383,9 +546,7 @@ int parser_read_list_of_doubles(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  parser_find(pfc,name,0,&index);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -436,11 +597,10 @@ int parser_read_list_of_doubles(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  parser_find(pfc,name,index+1,&i);
+  class_test(i < pfc->size,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -469,9 +629,7 @@ int parser_read_list_of_integers(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  parser_find(pfc,name,0,&index);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -522,11 +680,10 @@ int parser_read_list_of_integers(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  parser_find(pfc,name,index+1,&i);
+  class_test(i < pfc->size,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
   return _SUCCESS_;
@@ -554,9 +711,7 @@ int parser_read_list_of_strings(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  parser_find(pfc,name,0,&index);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -605,11 +760,10 @@ int parser_read_list_of_strings(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is
      found,
      return an error. */
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  parser_find(pfc,name,index+1,&i);
+  class_test(i < pfc->size,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
   return _SUCCESS_;
@@ -660,11 +814,78 @@ int parser_cat(struct file_content * pfc1,
     pfc3->read[i+pfc1->size]=pfc2->read[i];
   }
 
+  pfc3->hash_table = NULL;
+  pfc3->hash_size = 0;
+  class_call(parser_index(pfc3,errmsg),
+             errmsg,
+             errmsg);
+
   return _SUCCESS_;
 
 }
 
 
+/**
+ * Merge two sets of parameters, the second one taking precedence
+ * (unlike parser_cat(), which requires distinct names)
+ *
+ * @param pfc_default Input: default parameters
+ * @param pfc_new     Input: parameters added to the default ones or replacing them
+ * @param pfc         Output: merged parameters
+ * @param errmsg      Output: error message
+ * @return the error status
+ */
+
+int parser_merge(struct file_content * pfc_default,
+                 struct file_content * pfc_new,
+                 struct file_content * pfc,
+                 ErrorMsg errmsg) {
+
+  int counter;
+  int index;
+  int found;
+
+  counter = pfc_new->size;
+  for (index=0; index<pfc_default->size; index++) {
+    parser_find(pfc_new,pfc_default->name[index],0,&found);
+    if (found == pfc_new->size)
+      counter++;
+  }
+
+  pfc->size = 0;
+  pfc->hash_size = 0;
+  if (counter == 0)
+    return _SUCCESS_;
+
+  class_call(parser_init(pfc,
+                         counter,
+                         (pfc_new->size > 0) ? pfc_new->filename : pfc_default->filename,
+                         errmsg),
+             errmsg,
+             errmsg);
+
+  counter = 0;
+  for (index=0; index<pfc_default->size; index++) {
+    parser_find(pfc_new,pfc_default->name[index],0,&found);
+    if (found == pfc_new->size) {
+      strcpy(pfc->name[counter],pfc_default->name[index]);
+      strcpy(pfc->value[counter],pfc_default->value[index]);
+      pfc->read[counter] = _FALSE_;
+      counter++;
+    }
+  }
+  for (index=0; index<pfc_new->size; index++) {
+    strcpy(pfc->name[counter],pfc_new->name[index]);
+    strcpy(pfc->value[counter],pfc_new->value[index]);
+    pfc->read[counter] = _FALSE_;
+    counter++;
+  }
+
+  class_call(parser_index(pfc,errmsg),errmsg,errmsg);
+
+  return _SUCCESS_;
+}
+
 
 int parser_check_options(char * strinput, char ** options, int N_options, int* valid){
 
@@ -69,6 +69,7 @@ int get_qsampling(double *x,
 		  int (*test)(void * params_for_function, double q, double *psi),
 		  int (*function)(void * params_for_function, double q, double *f0),
 		  void * params_for_function,
+		  int parallel_adapt,
 		  ErrorMsg errmsg) {
 
   /* This routine returns the fewest possible number of abscissas and weights under
@@ -77,7 +78,11 @@ int get_qsampling(double *x,
      or close, a Laguerre quadrature formula is often the best choice.
 
      This function combines two completely different strategies: Adaptive Gauss-Kronrod
-     quadrature and Laguerres quadrature formula. */
+     quadrature and Laguerres quadrature formula.
+
+     If parallel_adapt is _TRUE_, the trees of the adaptive quadratures are refined by
+     several threads (test and function must then be thread-safe). The result does not
+     depend on it. */
 
   int i, NL=2,NR,level,Nadapt=0,NLag,NLag_max,Nold=NL;
   int adapt_converging=_FALSE_,Laguerre_converging=_FALSE_,combined_converging=_FALSE_;
@@ -118,6 +123,8 @@ int get_qsampling(double *x,
   }
 
   /* First do the adaptive quadrature - this will also give the value of the integral: */
+#pragma omp parallel if (parallel_adapt == _TRUE_)
+#pragma omp single
   gk_adapt(&root,(*test),(*function), params_for_function,
 	   rtol*1e-4, 1, 0.0, 1.0, _TRUE_, errmsg);
   /* Do a leaf count: */
@@ -181,6 +188,8 @@ int get_qsampling(double *x,
     }
 
     /* Do the adaptive quadrature - this will also give the main part of the integral: */
+#pragma omp parallel if (parallel_adapt == _TRUE_)
+#pragma omp single
     gk_adapt(&root_comb,(*test),(*function), params_for_function,
 	     rtol*1e-2, 1, qmin, qmax, _FALSE_, errmsg);
     /* Do a leaf count: */
@@ -523,14 +532,19 @@ int gk_adapt(
     return _SUCCESS_;
   }
   else{
-    /* Call gk_adapt recursively on children:*/
+    /* Call gk_adapt recursively on children. Inside a parallel region
+       (see get_qsampling), the two subtrees are refined as separate tasks;
+       otherwise the tasks are executed immediately: */
     mid = 0.5*(a+b);
     //printf("<-%g,%g,%g,%g",mid,tol,(*node)->err,(*node)->I);
+#pragma omp task
     gk_adapt(&((*node)->left),(*test),(*function), params_for_function, 1.5*tol,
 	     treemode, a, mid, isindefinite, errmsg);
     //printf("%g->",mid);
+#pragma omp task
     gk_adapt(&((*node)->right),(*test),(*function), params_for_function, 1.5*tol,
 	     treemode, mid, b, isindefinite, errmsg);
+#pragma omp taskwait
     /* Update integral and error in this node and return: */
     /* Actually, it is more convenient just to keep the nodes own estimate of the
        integral for our purposes.
@@ -56,6 +56,8 @@ int sp_num_alloc(sp_num** N, int n, ErrorMsg error_message){
 	class_alloc((*N)->q,(n+1)*sizeof(int),error_message);
 	class_alloc((*N)->w,n*sizeof(double),error_message);
 	class_alloc((*N)->wamd,(8*(n+1))*sizeof(int),error_message);
+	(*N)->has_ordering = _FALSE_;
+	(*N)->has_symbolic = _FALSE_;
 	return _SUCCESS_;
 }
 
@@ -74,6 +76,14 @@ int sp_num_free(sp_num *N){
 	return _SUCCESS_;
 }
 
+/*	Forget the ordering and the symbolic factorisation, to be called whenever
+	the sparsity pattern of the matrix changes. */
+int sp_num_invalidate(sp_num *N){
+	N->has_ordering = _FALSE_;
+	N->has_symbolic = _FALSE_;
+	return _SUCCESS_;
+}
+
 int reachr(sp_mat *G, sp_mat *B,int k, int *xik,int *pinv){
 	int p, n, top, *Bp, *Bi, *Gp;
 	n=G->ncols; Bp = B->Ap; Bi = B->Ai;Gp = G->Ap;
@@ -136,6 +146,7 @@ int sp_ludcmp(sp_num *N, sp_mat *A, double pivtol){
 	Ui = N->U->Ai; Up = N->U->Ap; Ux = N->U->Ax;
 	lnz = 0; unz = 0;
 	x = N->w; pinv = N->pinv; pvec = N->p;
+	N->has_symbolic = _FALSE_;
 	for (i=0; i<n; i++) x[i]=0;
 	for (i=0; i<n; i++) pinv[i] = -1;
 	for (k=0; k<=n; k++) Lp[k] = 0;
@@ -193,6 +204,7 @@ int sp_ludcmp(sp_num *N, sp_mat *A, double pivtol){
 	Lp[n] = lnz;
 	Up[n] = unz;
 	for(p=0; p<lnz; p++) Li[p] = pinv[Li[p]];
+	N->has_symbolic = _TRUE_;
 	return _SUCCESS_;
 }
 
@@ -202,17 +214,20 @@ int sp_lusolve(sp_num *N, double *b, double *x){
 	n=N->n;
 	/* permute b and initialize x:*/
 	for (j=0; j<n; j++) x[N->pinv[j]] = b[j];
-	/* lower solve: */
+	/*	lower solve. L has a unit diagonal stored first in each column, and
+		columns multiplying a zero entry of x are skipped: the right-hand
+		sides coming from the Newton iteration are often very sparse. */
 	Ap = N->L->Ap; Ai = N->L->Ai; Ax = N->L->Ax;
 	for (j=0; j<n; j++){
-		x[j] /=Ax[Ap[j]];
+		if (x[j] == 0.0) continue;
 		for (p=Ap[j]+1; p<Ap[j+1]; p++){
 			x[Ai[p]] -=Ax[p]*x[j];
 		}
 	}
-	/* upper solve: */
+	/* upper solve (diagonal stored last in each column): */
 	Ap = N->U->Ap; Ai = N->U->Ai; Ax = N->U->Ax;
 	for (j=n-1; j>=0; j--){
+		if (x[j] == 0.0) continue;
 		x[j] /=Ax[Ap[j+1]-1];
 		for (p=Ap[j];p<Ap[j+1]-1; p++){
 			x[Ai[p]] -= Ax[p]*x[j];
@@ -227,8 +242,14 @@ int sp_lusolve(sp_num *N, double *b, double *x){
 	return _SUCCESS_;
 }
 
-int sp_refactor(sp_num *N, sp_mat *A){
-	double pivot, *Lx, *Ux, *x;
+/*	Numerical refactorisation of a matrix A with the same sparsity pattern as
+	the one factorised by sp_ludcmp, re-using its ordering, reach sets and pivot
+	sequence. If pivtol>0, each re-used pivot is checked against the largest
+	candidate of its column, as in the threshold pivoting of sp_ludcmp: if
+	|pivot| < pivtol*max, or if the pivot vanishes, _FAILURE_ is returned and
+	a full sp_ludcmp is needed. */
+int sp_refactor(sp_num *N, sp_mat *A, double pivtol){
+	double pivot, *Lx, *Ux, *x, a, t;
 	int *Lp, *Li, *Up, *Ui, *pinv, *pvec, *q;
 	int n, ipiv, k, top, p, i, col, lnz, unz;
 	n = A->ncols;
@@ -250,6 +271,21 @@ int sp_refactor(sp_num *N, sp_mat *A){
 		/* Assign values to U and L: */
 		ipiv = pvec[k];
 		pivot = x[ipiv];
+		if (pivtol > 0.0){
+			/* Check that the old pivot is still acceptable: */
+			a = 0.0;
+			for (p=top; p<n; p++){
+				i = N->xi[k][p];
+				if (pinv[i]>=k){
+					t = fabs(x[i]);
+					if (t>a) a = t;
+				}
+			}
+			if ((pivot == 0.0)||(fabs(pivot)<pivtol*a)){
+				for (p=top; p<n; p++) x[N->xi[k][p]] = 0;
+				return _FAILURE_;
+			}
+		}
 		Li[lnz] = ipiv;
 		Lx[lnz] = 1;
 		lnz++;